@@ -0,0 +1,89 @@
+/*
+ * EmbeddingBridge - Benchmark Suite
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_BENCH_H
+#define EB_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "status.h"
+#include "pack.h"
+
+/*
+ * Each case is run against a synthetic repository generated for one
+ * dimension count: count sources, each stored versions times under one of
+ * models models into the set "main", with the set "base" forked off before
+ * the last version. Vectors are deterministic, so runs are comparable.
+ *
+ * A case is timed in samples of ops operations each; latencies are per
+ * operation. Cases that change the repository run after those that only
+ * read it.
+ */
+
+typedef struct {
+    char root[4096];            /* Repository root, also the working directory */
+    char scratch[4096];         /* Directory for remotes and pulled copies */
+    size_t count;               /* Sources */
+    size_t dims;
+    size_t models;
+    size_t versions;
+    size_t repeat;              /* Samples of the whole-repository cases */
+    const char* s3_url;         /* S3 remote to push to and pull from, NULL to skip */
+    const float* values;        /* count x dims, the newest version */
+    char (*hashes)[65];         /* Their object hashes */
+    char (*sources)[32];
+} bench_env_t;
+
+typedef struct {
+    const char* name;
+    /* Prepares the case, returns EB_ERROR_NOT_FOUND to skip it */
+    eb_status_t (*setup)(bench_env_t* env, const void* arg, void** state);
+    /* Runs sample number i, adding the bytes it processed */
+    eb_status_t (*run)(bench_env_t* env, void* state, size_t i, uint64_t* bytes);
+    void (*teardown)(bench_env_t* env, void* state);
+    /* Samples per run: 0 for one per source, SIZE_MAX for env->repeat */
+    size_t samples;
+    size_t ops;                 /* Operations per sample, 0 for one */
+    const void* arg;
+} bench_case_t;
+
+#define BENCH_REPEAT SIZE_MAX
+
+/* Case tables, each ended by an entry without a name */
+extern const bench_case_t bench_store_cases[];
+extern const bench_case_t bench_repo_cases[];
+extern const bench_case_t bench_kernel_cases[];
+extern const bench_case_t bench_transform_cases[];
+extern const bench_case_t bench_remote_cases[];
+extern const bench_case_t bench_write_cases[];
+
+/* Vector n of version v, the same for every run */
+void bench_vector(size_t n, size_t v, size_t dims, float* out);
+
+/* Model of source n */
+void bench_model(const bench_env_t* env, size_t n, char* out, size_t size);
+
+/* Self-contained records of the newest vectors, as push sends them */
+typedef struct {
+    eb_pack_object_t* objects;
+    size_t count;
+    uint64_t bytes;
+} bench_records_t;
+
+/* Load the records of the first limit sources (0 for all) */
+eb_status_t bench_records_load(const bench_env_t* env, size_t limit, bench_records_t* out);
+
+void bench_records_free(bench_records_t* records);
+
+/* Create an empty repository at path */
+eb_status_t bench_make_repo(const char* path);
+
+#endif /* EB_BENCH_H */
@@ -0,0 +1,73 @@
+/*
+ * EmbeddingBridge - Benchmark Suite: Distance Kernel Cases
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include "bench.h"
+#include "distance.h"
+
+/* Pairs per sample, so a sample is long enough for the clock to resolve */
+#define PAIRS 256
+#define SAMPLES 1000
+
+static const eb_kernel_t SCALAR = EB_KERNEL_SCALAR;
+static const eb_kernel_t AVX2 = EB_KERNEL_AVX2;
+static const eb_kernel_t AVX512 = EB_KERNEL_AVX512;
+static const eb_kernel_t NEON = EB_KERNEL_NEON;
+
+typedef struct {
+    eb_kernel_t previous;
+} kernel_state_t;
+
+static volatile float sink;
+
+static eb_status_t setup_cosine(bench_env_t* env, const void* arg, void** state) {
+    (void)env;
+    eb_kernel_t kernel = *(const eb_kernel_t*)arg;
+    if (!eb_kernel_supported(kernel))
+        return EB_ERROR_NOT_FOUND;
+    kernel_state_t* s = malloc(sizeof(*s));
+    if (!s)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    s->previous = eb_kernel_active();
+    eb_kernel_select(kernel);
+    *state = s;
+    return EB_SUCCESS;
+}
+
+static eb_status_t run_cosine(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    (void)state;
+    float total = 0.0f;
+    for (size_t p = 0; p < PAIRS; p++) {
+        size_t a = (i * PAIRS + p) % env->count;
+        size_t b = (a * 7 + 1) % env->count;
+        eb_cosine_terms_t terms = eb_cosine_terms(env->values + a * env->dims,
+                                                  env->values + b * env->dims, env->dims);
+        total += terms.dot;
+    }
+    sink = total;
+    *bytes += (uint64_t)PAIRS * 2 * env->dims * sizeof(float);
+    return EB_SUCCESS;
+}
+
+static void teardown_cosine(bench_env_t* env, void* state) {
+    (void)env;
+    kernel_state_t* s = state;
+    if (s)
+        eb_kernel_select(s->previous);
+    free(s);
+}
+
+const bench_case_t bench_kernel_cases[] = {
+    { "cosine/scalar", setup_cosine, run_cosine, teardown_cosine, SAMPLES, PAIRS, &SCALAR },
+    { "cosine/avx2", setup_cosine, run_cosine, teardown_cosine, SAMPLES, PAIRS, &AVX2 },
+    { "cosine/avx512", setup_cosine, run_cosine, teardown_cosine, SAMPLES, PAIRS, &AVX512 },
+    { "cosine/neon", setup_cosine, run_cosine, teardown_cosine, SAMPLES, PAIRS, &NEON },
+    { NULL }
+};
@@ -0,0 +1,426 @@
+/*
+ * EmbeddingBridge - Benchmark Suite
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "store.h"
+#include "set_layers.h"
+#include "distance.h"
+#include "transformer.h"
+#include "thread_pool.h"
+#include "error.h"
+
+static const char* USAGE =
+    "usage: bench [options]\n"
+    "\n"
+    "Time the core paths of embr against synthetic repositories and print\n"
+    "the results as JSON: ops/s, p50 and p99 latency per operation, and\n"
+    "bytes processed.\n"
+    "\n"
+    "Options:\n"
+    "  --count <n>            Sources per repository (default: 1000)\n"
+    "  --dims <list>          Comma-separated dimensions, one repository each\n"
+    "                         (default: 384,1536,3072)\n"
+    "  --models <k>           Models the sources are spread over (default: 2)\n"
+    "  --versions <v>         Versions stored per source, at least 2 (default: 2)\n"
+    "  --repeat <r>           Samples of the whole-repository cases (default: 5)\n"
+    "  --filter <text>        Only run cases whose name contains text\n"
+    "  --s3 <url>             Also push to and pull from this S3 remote, e.g.\n"
+    "                         s3://bench?endpoint=localhost:9000 for a local mock\n"
+    "  --dir <path>           Build the repositories here and keep them\n"
+    "  --output <file>        Write the JSON there instead of stdout\n"
+    "  -h, --help             Show this help message\n";
+
+/* In the order they run: everything that only reads the repository first */
+static const bench_case_t* const TABLES[] = {
+    bench_store_cases, bench_repo_cases, bench_kernel_cases, bench_transform_cases,
+    bench_remote_cases, bench_write_cases
+};
+
+typedef struct {
+    size_t count;
+    size_t dims[16];
+    size_t dim_count;
+    size_t models;
+    size_t versions;
+    size_t repeat;
+    const char* filter;
+    const char* s3_url;
+    const char* dir;
+    const char* output;
+} bench_options_t;
+
+void bench_vector(size_t n, size_t v, size_t dims, float* out) {
+    /* A fixed direction per source, nudged a little by each version */
+    uint32_t x = (uint32_t)(n + 1) * 2654435761u;
+    for (size_t i = 0; i < dims; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out[i] = (float)(x >> 8) / (float)(1u << 23) - 1.0f + 0.05f * (float)v * sinf((float)(i + n));
+    }
+}
+
+void bench_model(const bench_env_t* env, size_t n, char* out, size_t size) {
+    snprintf(out, size, "model-%zu", n % env->models);
+}
+
+eb_status_t bench_records_load(const bench_env_t* env, size_t limit, bench_records_t* out) {
+    *out = (bench_records_t){0};
+    size_t count = limit && limit < env->count ? limit : env->count;
+    eb_store_t* store = NULL;
+    eb_status_t status = eb_store_init(&(eb_store_config_t){ .root_path = (char*)env->root }, &store);
+    if (status != EB_SUCCESS)
+        return status;
+    out->objects = calloc(count, sizeof(*out->objects));
+    if (!out->objects)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    for (size_t n = 0; n < count && status == EB_SUCCESS; n++) {
+        eb_pack_object_t* object = &out->objects[n];
+        void* data = NULL;
+        status = eb_object_export(store, env->hashes[n], &data, &object->size);
+        object->hex_hash = env->hashes[n];
+        object->data = data;
+        out->bytes += object->size;
+        out->count = n + 1;
+    }
+    eb_store_destroy(store);
+    if (status != EB_SUCCESS)
+        bench_records_free(out);
+    return status;
+}
+
+void bench_records_free(bench_records_t* records) {
+    for (size_t n = 0; n < records->count; n++)
+        free((void*)records->objects[n].data);
+    free(records->objects);
+    *records = (bench_records_t){0};
+}
+
+eb_status_t bench_make_repo(const char* path) {
+    char command[PATH_MAX + 256];
+    snprintf(command, sizeof(command),
+             "mkdir -p '%1$s/.embr/objects/temp' '%1$s/.embr/sets/main/refs/models' "
+             "'%1$s/.embr/metadata/files' '%1$s/.embr/metadata/models' '%1$s/.embr/metadata/versions'",
+             path);
+    if (system(command) != 0)
+        return EB_ERROR_FILE_IO;
+    char head[PATH_MAX];
+    snprintf(head, sizeof(head), "%s/.embr/HEAD", path);
+    FILE* f = fopen(head, "w");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+    fputs("main\n", f);
+    return fclose(f) == 0 ? EB_SUCCESS : EB_ERROR_FILE_IO;
+}
+
+/* Store every version of every source, forking "base" before the last one */
+static eb_status_t generate(bench_env_t* env, float* values, const char** rows) {
+    if (mkdir("docs", 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+    for (size_t n = 0; n < env->count; n++) {
+        snprintf(env->sources[n], sizeof(env->sources[n]), "docs/%zu.txt", n);
+        FILE* f = fopen(env->sources[n], "w");
+        if (!f)
+            return EB_ERROR_FILE_IO;
+        fprintf(f, "Synthetic document %zu\n", n);
+        fclose(f);
+    }
+
+    char (*hashes)[65] = malloc(env->count * sizeof(*hashes));
+    if (!hashes)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    eb_status_t status = EB_SUCCESS;
+    for (size_t v = 0; v < env->versions && status == EB_SUCCESS; v++) {
+        if (v + 1 == env->versions && (status = eb_set_layers_fork(".", "main", "base")) != EB_SUCCESS)
+            break;
+        eb_store_batch_t* batch = NULL;
+        if ((status = eb_store_batch_begin(".", &batch)) != EB_SUCCESS)
+            break;
+        for (size_t m = 0; m < env->models && status == EB_SUCCESS; m++) {
+            /* The rows of one model, gathered so they go in as one matrix */
+            size_t count = 0;
+            for (size_t n = m; n < env->count; n += env->models) {
+                bench_vector(n, v, env->dims, values + count * env->dims);
+                rows[count++] = env->sources[n];
+            }
+            char model[32];
+            bench_model(env, m, model, sizeof(model));
+            status = eb_store_batch_add_matrix(batch, values, count, env->dims, rows, model, hashes);
+            for (size_t k = 0; k < count; k++)
+                memcpy(env->hashes[m + k * env->models], hashes[k], 65);
+        }
+        if (status == EB_SUCCESS)
+            status = eb_store_batch_commit(batch);
+        else
+            eb_store_batch_abort(batch);
+    }
+    free(hashes);
+
+    /* Newest version in source order, for the cases that need the vectors */
+    for (size_t n = 0; n < env->count; n++)
+        bench_vector(n, env->versions - 1, env->dims, values + n * env->dims);
+    return status;
+}
+
+static double elapsed_ns(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples */
+static double percentile(const double* sorted, size_t n, double p) {
+    size_t rank = (size_t)ceil(p * (double)n);
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static void print_name(FILE* out, const char* name) {
+    fputc('"', out);
+    for (const char* c = name; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+/* Runs one case and prints its result object; false if it failed */
+static bool run_case(bench_env_t* env, const bench_case_t* c, FILE* out, bool* first) {
+    void* state = NULL;
+    eb_status_t status = c->setup ? c->setup(env, c->arg, &state) : EB_SUCCESS;
+    if (status == EB_ERROR_NOT_FOUND) {
+        fprintf(stderr, "  %-24s skipped\n", c->name);
+        return true;
+    }
+
+    size_t samples = c->samples == 0 ? env->count : c->samples == BENCH_REPEAT ? env->repeat : c->samples;
+    size_t ops = c->ops ? c->ops : 1;
+    double* latency = status == EB_SUCCESS ? malloc(samples * sizeof(double)) : NULL;
+    if (status == EB_SUCCESS && !latency)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    uint64_t bytes = 0;
+    double total_ns = 0.0;
+    for (size_t i = 0; i < samples && status == EB_SUCCESS; i++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = c->run(env, state, i, &bytes);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double ns = elapsed_ns(&start, &end);
+        total_ns += ns;
+        latency[i] = ns / (double)ops;
+    }
+    if (c->teardown)
+        c->teardown(env, state);
+
+    fprintf(out, "%s\n    {\"case\":", *first ? "" : ",");
+    *first = false;
+    print_name(out, c->name);
+    fprintf(out, ",\"dims\":%zu,", env->dims);
+    if (status != EB_SUCCESS) {
+        fprintf(out, "\"error\":\"%s\"}", eb_status_str(status));
+        fprintf(stderr, "  %-24s failed: %s\n", c->name, eb_status_str(status));
+        free(latency);
+        return false;
+    }
+
+    qsort(latency, samples, sizeof(double), compare_double);
+    double seconds = total_ns / 1e9;
+    double rate = seconds > 0.0 ? (double)(samples * ops) / seconds : 0.0;
+    double p50 = samples ? percentile(latency, samples, 0.50) / 1e3 : 0.0;
+    double p99 = samples ? percentile(latency, samples, 0.99) / 1e3 : 0.0;
+    fprintf(out, "\"samples\":%zu,\"ops\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+            "\"p50_us\":%.3f,\"p99_us\":%.3f,\"bytes\":%llu,\"bytes_per_sec\":%.0f}",
+            samples, samples * ops, seconds, rate, p50, p99, (unsigned long long)bytes,
+            seconds > 0.0 ? (double)bytes / seconds : 0.0);
+    fprintf(stderr, "  %-24s %12.1f ops/s  p50 %10.3f us  p99 %10.3f us\n", c->name, rate, p50, p99);
+    free(latency);
+    return true;
+}
+
+/* Builds the repository for one dimension count and runs every case on it */
+static bool run_dims(const bench_options_t* options, size_t dims, const char* base, FILE* out,
+                     bool* first) {
+    bench_env_t env = {
+        .count = options->count, .dims = dims, .models = options->models,
+        .versions = options->versions, .repeat = options->repeat, .s3_url = options->s3_url
+    };
+    snprintf(env.root, sizeof(env.root), "%s/repo-%zu", base, dims);
+    snprintf(env.scratch, sizeof(env.scratch), "%s/scratch-%zu", base, dims);
+
+    float* values = malloc(env.count * dims * sizeof(float));
+    const char** rows = malloc(env.count * sizeof(*rows));
+    env.hashes = malloc(env.count * sizeof(*env.hashes));
+    env.sources = malloc(env.count * sizeof(*env.sources));
+    env.values = values;
+    char saved_cwd[PATH_MAX];
+    bool ok = values && rows && env.hashes && env.sources && getcwd(saved_cwd, sizeof(saved_cwd));
+    if (!ok) {
+        fprintf(stderr, "bench: out of memory\n");
+    } else if (bench_make_repo(env.root) != EB_SUCCESS || mkdir(env.scratch, 0755) != 0 ||
+               chdir(env.root) != 0) {
+        fprintf(stderr, "bench: cannot create %s\n", env.root);
+        ok = false;
+    } else {
+        fprintf(stderr, "Generating %zu x %zu dims, %zu versions, %zu models...\n", env.count, dims,
+                env.versions, env.models);
+        eb_status_t status = generate(&env, values, rows);
+        if (status != EB_SUCCESS) {
+            fprintf(stderr, "bench: cannot generate the repository: %s\n", eb_status_str(status));
+            ok = false;
+        }
+        for (size_t t = 0; ok && t < sizeof(TABLES) / sizeof(TABLES[0]); t++) {
+            for (const bench_case_t* c = TABLES[t]; c->name; c++) {
+                if (!options->filter || strstr(c->name, options->filter))
+                    ok &= run_case(&env, c, out, first);
+            }
+        }
+        if (chdir(saved_cwd) != 0)
+            ok = false;
+    }
+    free(values);
+    free(rows);
+    free(env.hashes);
+    free(env.sources);
+    return ok;
+}
+
+static bool parse_size(const char* text, size_t min, size_t* out) {
+    char* end = NULL;
+    errno = 0;
+    unsigned long long value = text ? strtoull(text, &end, 10) : 0;
+    if (!text || *text == '-' || *end != '\0' || errno || value < min)
+        return false;
+    *out = (size_t)value;
+    return true;
+}
+
+static bool parse_dims(const char* text, bench_options_t* options) {
+    options->dim_count = 0;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", text ? text : "");
+    for (char* save = NULL, *item = strtok_r(buffer, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        size_t max = sizeof(options->dims) / sizeof(options->dims[0]);
+        if (options->dim_count == max || !parse_size(item, 1, &options->dims[options->dim_count]))
+            return false;
+        options->dim_count++;
+    }
+    return options->dim_count > 0;
+}
+
+static bool parse_options(int argc, char** argv, bench_options_t* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = true;
+        if (strcmp(arg, "--count") == 0)
+            ok = parse_size(value, 1, &options->count);
+        else if (strcmp(arg, "--dims") == 0)
+            ok = parse_dims(value, options);
+        else if (strcmp(arg, "--models") == 0)
+            ok = parse_size(value, 1, &options->models);
+        else if (strcmp(arg, "--versions") == 0)
+            ok = parse_size(value, 2, &options->versions);
+        else if (strcmp(arg, "--repeat") == 0)
+            ok = parse_size(value, 1, &options->repeat);
+        else if (strcmp(arg, "--filter") == 0)
+            ok = (options->filter = value) != NULL;
+        else if (strcmp(arg, "--s3") == 0)
+            ok = (options->s3_url = value) != NULL;
+        else if (strcmp(arg, "--dir") == 0)
+            ok = (options->dir = value) != NULL;
+        else if (strcmp(arg, "--output") == 0)
+            ok = (options->output = value) != NULL;
+        else {
+            fprintf(stderr, "bench: unknown option %s\n", arg);
+            return false;
+        }
+        if (!ok) {
+            fprintf(stderr, "bench: bad value for %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printf("%s", USAGE);
+            return 0;
+        }
+    }
+    bench_options_t options = {
+        .count = 1000, .dims = { 384, 1536, 3072 }, .dim_count = 3, .models = 2, .versions = 2,
+        .repeat = 5
+    };
+    if (!parse_options(argc, argv, &options)) {
+        fprintf(stderr, "%s", USAGE);
+        return 2;
+    }
+
+    char base[PATH_MAX];
+    if (options.dir) {
+        if (mkdir(options.dir, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "bench: cannot create %s\n", options.dir);
+            return 1;
+        }
+        if (!realpath(options.dir, base)) {
+            fprintf(stderr, "bench: cannot resolve %s\n", options.dir);
+            return 1;
+        }
+    } else {
+        const char* tmp = getenv("TMPDIR");
+        snprintf(base, sizeof(base), "%s/embr-bench-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+        if (!mkdtemp(base)) {
+            fprintf(stderr, "bench: cannot create a directory under %s\n", tmp && *tmp ? tmp : "/tmp");
+            return 1;
+        }
+    }
+
+    FILE* out = options.output ? fopen(options.output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "bench: cannot write %s\n", options.output);
+        return 1;
+    }
+    eb_register_builtin_transformers();
+
+    fprintf(out, "{\"count\":%zu,\"models\":%zu,\"versions\":%zu,\"threads\":%u,\"kernel\":\"%s\",\"results\":[",
+            options.count, options.models, options.versions, eb_pool_threads(0, SIZE_MAX),
+            eb_kernel_name(eb_kernel_active()));
+    bool first = true;
+    bool ok = true;
+    for (size_t d = 0; d < options.dim_count; d++)
+        ok &= run_dims(&options, options.dims[d], base, out, &first);
+    fprintf(out, "\n]}\n");
+    if (out != stdout)
+        fclose(out);
+
+    if (!options.dir) {
+        char command[PATH_MAX + 16];
+        snprintf(command, sizeof(command), "rm -rf '%s'", base);
+        if (system(command) != 0)
+            fprintf(stderr, "bench: could not remove %s\n", base);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/*
+ * EmbeddingBridge - Benchmark Suite: Push and Pull Cases
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "remote.h"
+
+/*
+ * A push sends every newest vector as one pack to a path of its own, since
+ * a path that already has them uploads nothing. A pull installs the pack
+ * pushed by setup into a fresh repository. The S3 cases run against
+ * whatever endpoint --s3 names, such as a local MinIO or moto server.
+ */
+
+typedef struct {
+    const char* remote;
+    bool s3;
+    bool pull;
+} remote_arg_t;
+
+static const remote_arg_t LOCAL_PUSH = { "bench-local", false, false };
+static const remote_arg_t LOCAL_PULL = { "bench-local", false, true };
+static const remote_arg_t S3_PUSH = { "bench-s3", true, false };
+static const remote_arg_t S3_PULL = { "bench-s3", true, true };
+
+typedef struct {
+    const remote_arg_t* arg;
+    bench_records_t records;
+    char pull_path[64];
+} remote_state_t;
+
+/* Dimension counts share an S3 bucket, so the path names the count */
+static void set_path(const bench_env_t* env, const char* what, size_t i, char* out, size_t size) {
+    snprintf(out, size, "sets/bench-%zu-%s-%zu", env->dims, what, i);
+}
+
+static void pull_root(const bench_env_t* env, const remote_state_t* s, size_t i, char* out, size_t size) {
+    snprintf(out, size, "%s/%s-pull-%zu", env->scratch, s->arg->s3 ? "s3" : "local", i);
+}
+
+static eb_status_t setup_remote(bench_env_t* env, const void* arg, void** state) {
+    const remote_arg_t* a = arg;
+    if (a->s3 && !env->s3_url)
+        return EB_ERROR_NOT_FOUND;
+    eb_status_t status = eb_remote_init();
+    if (status != EB_SUCCESS)
+        return status;
+
+    char url[PATH_MAX + 16];
+    if (a->s3) {
+        snprintf(url, sizeof(url), "%s", env->s3_url);
+    } else {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/remote", env->scratch);
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+            return EB_ERROR_FILE_IO;
+        snprintf(url, sizeof(url), "file://%s", dir);
+    }
+    /* Left over from the repository of the previous dimension count */
+    eb_remote_remove(a->remote);
+    if ((status = eb_remote_add(a->remote, url, NULL, 0, false, "json")) != EB_SUCCESS)
+        return status;
+
+    remote_state_t* s = calloc(1, sizeof(*s));
+    if (!s)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    *state = s;
+    s->arg = a;
+    if ((status = bench_records_load(env, 0, &s->records)) != EB_SUCCESS || !a->pull)
+        return status;
+
+    set_path(env, "pull", 0, s->pull_path, sizeof(s->pull_path));
+    status = eb_remote_push_pack(a->remote, s->pull_path, s->records.objects, s->records.count, NULL, NULL);
+    for (size_t i = 0; i < env->repeat && status == EB_SUCCESS; i++) {
+        char root[PATH_MAX];
+        pull_root(env, s, i, root, sizeof(root));
+        status = bench_make_repo(root);
+    }
+    return status;
+}
+
+static eb_status_t run_push(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    remote_state_t* s = state;
+    char path[64];
+    set_path(env, "push", i, path, sizeof(path));
+    eb_remote_pack_stats_t stats = {0};
+    eb_status_t status = eb_remote_push_pack(s->arg->remote, path, s->records.objects, s->records.count,
+                                             NULL, &stats);
+    *bytes += stats.bytes;
+    return status;
+}
+
+static eb_status_t run_pull(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    remote_state_t* s = state;
+    char root[PATH_MAX];
+    pull_root(env, s, i, root, sizeof(root));
+    eb_remote_pack_stats_t stats = {0};
+    eb_status_t status = eb_remote_pull_packs(s->arg->remote, s->pull_path, root, NULL, &stats);
+    if (status == EB_SUCCESS && stats.objects != s->records.count)
+        status = EB_ERROR_INVALID_DATA;
+    *bytes += stats.bytes;
+    return status;
+}
+
+static void teardown_remote(bench_env_t* env, void* state) {
+    (void)env;
+    remote_state_t* s = state;
+    if (!s)
+        return;
+    eb_remote_remove(s->arg->remote);
+    bench_records_free(&s->records);
+    free(s);
+}
+
+const bench_case_t bench_remote_cases[] = {
+    { "push/local", setup_remote, run_push, teardown_remote, BENCH_REPEAT, 0, &LOCAL_PUSH },
+    { "pull/local", setup_remote, run_pull, teardown_remote, BENCH_REPEAT, 0, &LOCAL_PULL },
+    { "push/s3", setup_remote, run_push, teardown_remote, BENCH_REPEAT, 0, &S3_PUSH },
+    { "pull/s3", setup_remote, run_pull, teardown_remote, BENCH_REPEAT, 0, &S3_PULL },
+    { NULL }
+};
@@ -0,0 +1,222 @@
+/*
+ * EmbeddingBridge - Benchmark Suite: Store and Repository Cases
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "store.h"
+#include "source_status.h"
+#include "log_index.h"
+#include "history.h"
+#include "set_drift.h"
+#include "gc.h"
+
+#define LOG_PATH ".embr/sets/main/log"
+#define BATCH_ROWS 256
+
+/* Store cases: one open store, one object per sample */
+
+typedef struct {
+    eb_store_t* store;
+    float* values;              /* New vectors for write_object */
+} store_state_t;
+
+static eb_status_t open_store(bench_env_t* env, const void* arg, void** state) {
+    (void)arg;
+    store_state_t* s = calloc(1, sizeof(*s));
+    if (!s)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    *state = s;
+    return eb_store_init(&(eb_store_config_t){ .root_path = env->root }, &s->store);
+}
+
+static void close_store(bench_env_t* env, void* state) {
+    (void)env;
+    store_state_t* s = state;
+    if (!s)
+        return;
+    if (s->store)
+        eb_store_destroy(s->store);
+    free(s->values);
+    free(s);
+}
+
+static eb_status_t run_read_object(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    store_state_t* s = state;
+    void* data = NULL;
+    size_t size = 0;
+    eb_object_header_t header;
+    eb_status_t status = read_object(s->store, env->hashes[i % env->count], &data, &size, &header);
+    free(data);
+    *bytes += size;
+    return status;
+}
+
+static eb_status_t run_resolve_hash(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    store_state_t* s = state;
+    char prefix[13], full[65];
+    memcpy(prefix, env->hashes[i % env->count], 12);
+    prefix[12] = '\0';
+    eb_status_t status = eb_store_resolve_hash(s->store, prefix, full, sizeof(full));
+    *bytes += 12;
+    return status;
+}
+
+const bench_case_t bench_store_cases[] = {
+    { "read_object", open_store, run_read_object, close_store, 0, 0, NULL },
+    { "resolve_hash", open_store, run_resolve_hash, close_store, 0, 0, NULL },
+    { NULL }
+};
+
+/* Repository cases: one whole-repository operation per sample */
+
+static eb_status_t run_status(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    (void)env, (void)state, (void)i, (void)bytes;
+    eb_source_summary_t summary;
+    return eb_source_status(".", NULL, NULL, NULL, &summary);
+}
+
+static int count_entry(const eb_log_entry_t* entry, void* ctx) {
+    (void)entry;
+    (*(size_t*)ctx)++;
+    return 0;
+}
+
+static uint64_t log_size(void) {
+    struct stat st;
+    return stat(LOG_PATH, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static eb_status_t run_log(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    (void)state, (void)i;
+    size_t entries = 0;
+    eb_status_t status = eb_log_foreach(LOG_PATH, count_entry, &entries);
+    if (status == EB_SUCCESS && entries < env->count)
+        status = EB_ERROR_INVALID_DATA;
+    *bytes += log_size();
+    return status;
+}
+
+static eb_status_t run_history(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    (void)env, (void)state, (void)i;
+    eb_history_t* history = NULL;
+    eb_status_t status = eb_history_load(LOG_PATH, NULL, &history);
+    eb_history_free(history);
+    *bytes += log_size();
+    return status;
+}
+
+static eb_status_t run_set_diff(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    (void)state, (void)i;
+    eb_drift_summary_t summary;
+    eb_status_t status = eb_set_drift(".", "main", "base", NULL, NULL, NULL, &summary);
+    *bytes += (uint64_t)summary.pairs * env->dims * sizeof(float) * 2;
+    return status;
+}
+
+static eb_status_t run_gc(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    (void)env, (void)state, (void)i, (void)bytes;
+    /* Everything is younger than the expiry, so each sample marks and sweeps the same repository */
+    eb_gc_result_t result;
+    return gc_run("2.weeks.ago", false, &result);
+}
+
+const bench_case_t bench_repo_cases[] = {
+    { "status", NULL, run_status, NULL, BENCH_REPEAT, 0, NULL },
+    { "log", NULL, run_log, NULL, BENCH_REPEAT, 0, NULL },
+    { "history_load", NULL, run_history, NULL, BENCH_REPEAT, 0, NULL },
+    { "set_diff", NULL, run_set_diff, NULL, BENCH_REPEAT, 0, NULL },
+    { "gc", NULL, run_gc, NULL, BENCH_REPEAT, 0, NULL },
+    { NULL }
+};
+
+/* Write cases, which add objects and versions to the repository */
+
+static eb_status_t setup_write_object(bench_env_t* env, const void* arg, void** state) {
+    eb_status_t status = open_store(env, arg, state);
+    store_state_t* s = *state;
+    if (status != EB_SUCCESS)
+        return status;
+    s->values = malloc(env->count * env->dims * sizeof(float));
+    if (!s->values)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    /* Sources past the generated ones, so every write is a new object */
+    for (size_t n = 0; n < env->count; n++)
+        bench_vector(env->count + n, 0, env->dims, s->values + n * env->dims);
+    return EB_SUCCESS;
+}
+
+static eb_status_t run_write_object(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    store_state_t* s = state;
+    char model[32];
+    bench_model(env, i, model, sizeof(model));
+    eb_embedding_t embedding = { s->values + i * env->dims, env->dims, false, -1.0f };
+    uint64_t id = 0;
+    *bytes += env->dims * sizeof(float);
+    return eb_store_vector(s->store, &embedding, NULL, model, &id);
+}
+
+typedef struct {
+    float* values;
+    const char* rows[BATCH_ROWS];
+    size_t count;
+} batch_state_t;
+
+static eb_status_t setup_store_batch(bench_env_t* env, const void* arg, void** state) {
+    (void)arg;
+    batch_state_t* s = calloc(1, sizeof(*s));
+    if (!s)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    *state = s;
+    s->count = env->count < BATCH_ROWS ? env->count : BATCH_ROWS;
+    s->values = malloc(env->repeat * s->count * env->dims * sizeof(float));
+    if (!s->values)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    /* A new version of the first sources for every sample */
+    for (size_t i = 0; i < env->repeat; i++) {
+        for (size_t n = 0; n < s->count; n++)
+            bench_vector(n, env->versions + i, env->dims, s->values + (i * s->count + n) * env->dims);
+    }
+    for (size_t n = 0; n < s->count; n++)
+        s->rows[n] = env->sources[n];
+    return EB_SUCCESS;
+}
+
+static eb_status_t run_store_batch(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    batch_state_t* s = state;
+    eb_store_batch_t* batch = NULL;
+    eb_status_t status = eb_store_batch_begin(".", &batch);
+    if (status != EB_SUCCESS)
+        return status;
+    const float* values = s->values + i * s->count * env->dims;
+    status = eb_store_batch_add_matrix(batch, values, s->count, env->dims, s->rows, "model-0", NULL);
+    if (status != EB_SUCCESS) {
+        eb_store_batch_abort(batch);
+        return status;
+    }
+    *bytes += s->count * env->dims * sizeof(float);
+    return eb_store_batch_commit(batch);
+}
+
+static void teardown_store_batch(bench_env_t* env, void* state) {
+    (void)env;
+    batch_state_t* s = state;
+    if (s)
+        free(s->values);
+    free(s);
+}
+
+const bench_case_t bench_write_cases[] = {
+    { "write_object", setup_write_object, run_write_object, close_store, 0, 0, NULL },
+    { "store_batch", setup_store_batch, run_store_batch, teardown_store_batch, BENCH_REPEAT, 0, NULL },
+    { NULL }
+};
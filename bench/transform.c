@@ -0,0 +1,103 @@
+/*
+ * EmbeddingBridge - Benchmark Suite: Transformer Cases
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "bench.h"
+#include "transformer.h"
+
+/* Records converted per run; each sample converts the next one */
+#define RECORDS 256
+
+typedef struct {
+    const char* transformer;
+    bool inverse;
+} transform_arg_t;
+
+static const transform_arg_t JSON_ENCODE = { "json", false };
+static const transform_arg_t JSON_DECODE = { "json", true };
+static const transform_arg_t PARQUET_ENCODE = { "parquet", false };
+static const transform_arg_t PARQUET_DECODE = { "parquet", true };
+
+typedef struct {
+    eb_transformer_t* transformer;
+    bool inverse;
+    bench_records_t records;
+    void** encoded;             /* The records transformed, as decode input */
+    size_t* encoded_size;
+} transform_state_t;
+
+static eb_status_t setup_transform(bench_env_t* env, const void* arg, void** state) {
+    const transform_arg_t* a = arg;
+    /* Parquet is only registered when built with Arrow */
+    eb_transformer_t* transformer = eb_find_transformer(a->transformer);
+    if (!transformer)
+        return EB_ERROR_NOT_FOUND;
+    transform_state_t* s = calloc(1, sizeof(*s));
+    if (!s)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    *state = s;
+    s->transformer = transformer;
+    s->inverse = a->inverse;
+    eb_status_t status = bench_records_load(env, RECORDS, &s->records);
+    if (status != EB_SUCCESS || !s->inverse)
+        return status;
+
+    s->encoded = calloc(s->records.count, sizeof(*s->encoded));
+    s->encoded_size = calloc(s->records.count, sizeof(*s->encoded_size));
+    if (!s->encoded || !s->encoded_size)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    for (size_t n = 0; n < s->records.count && status == EB_SUCCESS; n++) {
+        const eb_pack_object_t* record = &s->records.objects[n];
+        status = eb_transform(transformer, record->data, record->size, &s->encoded[n],
+                              &s->encoded_size[n]);
+    }
+    return status;
+}
+
+static eb_status_t run_transform(bench_env_t* env, void* state, size_t i, uint64_t* bytes) {
+    (void)env;
+    transform_state_t* s = state;
+    size_t n = i % s->records.count;
+    void* out = NULL;
+    size_t out_size = 0;
+    eb_status_t status;
+    if (s->inverse) {
+        status = eb_inverse_transform(s->transformer, s->encoded[n], s->encoded_size[n], &out, &out_size);
+        *bytes += s->encoded_size[n];
+    } else {
+        status = eb_transform(s->transformer, s->records.objects[n].data, s->records.objects[n].size,
+                              &out, &out_size);
+        *bytes += s->records.objects[n].size;
+    }
+    free(out);
+    return status;
+}
+
+static void teardown_transform(bench_env_t* env, void* state) {
+    (void)env;
+    transform_state_t* s = state;
+    if (!s)
+        return;
+    for (size_t n = 0; s->encoded && n < s->records.count; n++)
+        free(s->encoded[n]);
+    free(s->encoded);
+    free(s->encoded_size);
+    bench_records_free(&s->records);
+    free(s);
+}
+
+const bench_case_t bench_transform_cases[] = {
+    { "json_encode", setup_transform, run_transform, teardown_transform, 0, 0, &JSON_ENCODE },
+    { "json_decode", setup_transform, run_transform, teardown_transform, 0, 0, &JSON_DECODE },
+    { "parquet_encode", setup_transform, run_transform, teardown_transform, 0, 0, &PARQUET_ENCODE },
+    { "parquet_decode", setup_transform, run_transform, teardown_transform, 0, 0, &PARQUET_DECODE },
+    { NULL }
+};
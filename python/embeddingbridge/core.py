@@ -59,21 +59,43 @@ try:
 except ImportError as e:
     raise ImportError(f"Failed to load EmbeddingBridge library: {e}")
 
-# Define C function signatures based on the actual library
-_lib.embr_store_init.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p)]
+# Define C function signatures based on the actual library (src/core/bindings.h)
+_float_p = ctypes.POINTER(ctypes.c_float)
+_HASH_SLOT = 65
+
+_lib.embr_store_init.argtypes = [ctypes.c_char_p, ctypes.POINTER(ctypes.c_void_p)]
 _lib.embr_store_init.restype = ctypes.c_int
 
 _lib.embr_store_destroy.argtypes = [ctypes.c_void_p]
 _lib.embr_store_destroy.restype = ctypes.c_int
 
-_lib.embr_create_embedding.argtypes = [ctypes.POINTER(ctypes.c_float), ctypes.c_int, ctypes.POINTER(ctypes.c_void_p)]
-_lib.embr_create_embedding.restype = ctypes.c_int
+_lib.embr_store_matrix.argtypes = [ctypes.c_void_p, _float_p, ctypes.c_size_t, ctypes.c_size_t,
+                                   ctypes.POINTER(ctypes.c_char_p), ctypes.c_char_p, ctypes.c_char_p]
+_lib.embr_store_matrix.restype = ctypes.c_int
+
+_lib.embr_store_file.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p,
+                                 ctypes.c_char_p, ctypes.c_char_p]
+_lib.embr_store_file.restype = ctypes.c_int
+
+_lib.embr_vector_dims.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_size_t)]
+_lib.embr_vector_dims.restype = ctypes.c_int
+
+_lib.embr_get_many.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_size_t,
+                               ctypes.c_size_t, _float_p]
+_lib.embr_get_many.restype = ctypes.c_int
+
+def _encode(value):
+    """Encode a str argument for the C library, passing bytes and None through"""
+    return value.encode('utf-8') if isinstance(value, str) else value
 
-_lib.embr_create_embedding_from_file.argtypes = [ctypes.c_char_p, ctypes.POINTER(ctypes.c_void_p)]
-_lib.embr_create_embedding_from_file.restype = ctypes.c_int
+def _string_array(values):
+    """NUL-terminated C strings of a sequence of str or bytes"""
+    encoded = [_encode(v) for v in values]
+    return (ctypes.c_char_p * len(encoded))(*encoded)
 
-_lib.embr_get_vector.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
-_lib.embr_get_vector.restype = ctypes.c_int
+def _float_pointer(array):
+    """Pointer to the buffer of a C-contiguous float32 array, without copying it"""
+    return array.ctypes.data_as(_float_p)
 
 
 # Define cmd_ function signatures correctly
@@ -130,23 +152,25 @@ _lib.cmd_remote.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_char_p)]
 _lib.cmd_remote.restype = ctypes.c_int
 
 class EmbeddingStore:
-    """Python wrapper for EmbeddingBridge vector store"""
+    """Python wrapper for EmbeddingBridge vector store
+
+    Vectors cross to the C library as float32 NumPy buffers: contiguous
+    float32 arrays are passed without a copy, anything else is converted
+    once with np.ascontiguousarray.
+    """
     
     def __init__(self, path: str, dimension: Optional[int] = None):
-        """Initialize a new embedding store.
+        """Open the store of a repository.
         
         Args:
-            path: Path to the store
-            dimension: Vector dimension (for documentation only, actual dimension is determined by the C library)
+            path: Repository root (the directory holding .embr)
+            dimension: Expected vector dimension, used by get_many when no output is given
         """
         self.path = path
         self._dimension = dimension
         
-        # Initialize store
         store_ptr = ctypes.c_void_p()
-        config_ptr = ctypes.c_void_p()  # This should be properly initialized in a full implementation
-        
-        result = _lib.embr_store_init(config_ptr, ctypes.byref(store_ptr))
+        result = _lib.embr_store_init(_encode(os.fspath(path)), ctypes.byref(store_ptr))
         if result != 0:
             raise RuntimeError(f"Failed to initialize embedding store at {path}, error code: {result}")
         
@@ -164,98 +188,117 @@ class EmbeddingStore:
             return result == 0
         return False
     
-    def add_embedding_from_file(self, file_path: str) -> str:
-        """Add an embedding from a file
+    def add_vectors(self, vectors, sources: List[str], model: Optional[str] = None) -> List[str]:
+        """Store an N x D matrix, one row per source file, in a single call
         
         Args:
-            file_path: Path to the file containing the embedding
+            vectors: N x D array of float values
+            sources: N source file names
+            model: Model name
             
         Returns:
-            ID of the added embedding
+            Object hashes of the stored rows
         """
-        file_path_bytes = file_path.encode('utf-8')
-        embedding_ptr = ctypes.c_void_p()
-        
-        result = _lib.embr_create_embedding_from_file(file_path_bytes, ctypes.byref(embedding_ptr))
+        matrix = np.ascontiguousarray(vectors, dtype=np.float32)
+        if matrix.ndim == 1:
+            matrix = matrix.reshape(1, -1)
+        if matrix.ndim != 2:
+            raise ValueError(f"Expected an N x D matrix, got shape {matrix.shape}")
+        rows, dims = matrix.shape
+        if len(sources) != rows:
+            raise ValueError(f"{rows} vectors but {len(sources)} source files")
+        
+        hashes = ctypes.create_string_buffer(rows * _HASH_SLOT)
+        result = _lib.embr_store_matrix(self._store, _float_pointer(matrix), rows, dims,
+                                        _string_array(sources), _encode(model), hashes)
         if result != 0:
-            raise RuntimeError(f"Failed to create embedding from file: {file_path}, error code: {result}")
-        
-        # TODO: Actually store the embedding in the store
-        # This would involve calling whatever function actually adds to the store
-        
-        # For now, we'll just return a placeholder ID
-        return "embedding_1"
+            raise RuntimeError(f"Failed to store {rows} vectors, error code: {result}")
+        raw = hashes.raw
+        if dims:
+            self._dimension = dims
+        return [raw[i * _HASH_SLOT:i * _HASH_SLOT + 64].decode('ascii') for i in range(rows)]
     
-    def add_vector(self, vector: List[float]) -> str:
+    def add_vector(self, vector, source: str, model: Optional[str] = None) -> str:
         """Add a vector to the store
         
         Args:
-            vector: List or array of float values
+            vector: Array of float values
+            source: Source file the vector belongs to
+            model: Model name
             
         Returns:
-            ID of the added vector
+            Object hash of the stored vector
         """
-        # Convert vector to ctypes array
-        vector_array = np.array(vector, dtype=np.float32)
-        arr_type = ctypes.c_float * len(vector_array)
-        vector_arr = arr_type(*vector_array)
-        
-        # Create embedding
-        embedding_ptr = ctypes.c_void_p()
-        result = _lib.embr_create_embedding(vector_arr, len(vector_array), ctypes.byref(embedding_ptr))
-        if result != 0:
-            raise RuntimeError(f"Failed to create embedding, error code: {result}")
-        
-        # TODO: Actually store the embedding in the store
-        # This would involve calling whatever function actually adds to the store
-        
-        # For now, we'll just return a placeholder ID
-        return "vector_1"
+        return self.add_vectors(np.asarray(vector, dtype=np.float32).reshape(1, -1), [source], model)[0]
     
-    def get_vector(self, vector_id: Union[str, int]) -> Optional[Dict]:
-        """Get a vector by ID
+    def add_embedding_from_file(self, file_path: str, source: str, model: Optional[str] = None) -> str:
+        """Add an embedding from a file
         
         Args:
-            vector_id: Vector ID
+            file_path: Path to the file containing the embedding (.npy, .npz or .bin)
+            source: Source file the embedding belongs to
+            model: Model name
             
         Returns:
-            Dictionary with vector data or None if not found
+            Object hash of the stored embedding
         """
-        # Convert ID to integer if it's a string
-        if isinstance(vector_id, str):
-            try:
-                id_num = int(vector_id)
-            except ValueError:
-                # If ID is not convertible to int, it's not a valid ID
-                return None
-        else:
-            id_num = vector_id
-        
-        # Create output pointers
-        embedding_ptr = ctypes.c_void_p()
-        metadata_ptr = ctypes.c_void_p()
-        
-        # Get vector
-        result = _lib.embr_get_vector(self._store, id_num, ctypes.byref(embedding_ptr), ctypes.byref(metadata_ptr))
-        
+        hash_out = ctypes.create_string_buffer(_HASH_SLOT)
+        result = _lib.embr_store_file(self._store, _encode(os.fspath(file_path)), _encode(source),
+                                      _encode(model), hash_out)
         if result != 0:
-            return None
-        
-        # TODO: Properly extract embedding and metadata from the pointers
-        # This would involve handling the actual C structs
+            raise RuntimeError(f"Failed to store embedding from file: {file_path}, error code: {result}")
+        return hash_out.value.decode('ascii')
+    
+    def get_many(self, hashes: List[str], out: Optional[np.ndarray] = None) -> np.ndarray:
+        """Read stored vectors into the rows of a matrix
         
-        # For now, we'll just return a placeholder
-        return {
-            "id": str(id_num),
-            "vector": [0.1, 0.2, 0.3],  # Placeholder
-            "metadata": {"source": "placeholder"}  # Placeholder
-        }
+        Args:
+            hashes: Object hashes or unique prefixes
+            out: Preallocated writable, C-contiguous float32 array of shape
+                (len(hashes), D) to fill; allocated when not given
+            
+        Returns:
+            The filled matrix
+        """
+        count = len(hashes)
+        if out is None:
+            dims = self._dimension
+            if dims is None and count:
+                dims_out = ctypes.c_size_t()
+                result = _lib.embr_vector_dims(self._store, _encode(hashes[0]), ctypes.byref(dims_out))
+                if result != 0:
+                    raise KeyError(hashes[0])
+                dims = dims_out.value
+            out = np.empty((count, dims or 0), dtype=np.float32)
+        elif (out.dtype != np.float32 or out.ndim != 2 or out.shape[0] != count or
+              not out.flags.c_contiguous or not out.flags.writeable):
+            raise ValueError("out must be a writable C-contiguous float32 array of shape (len(hashes), D)")
+        
+        result = _lib.embr_get_many(self._store, _string_array(hashes), count, out.shape[1],
+                                    _float_pointer(out))
+        if result != 0:
+            raise RuntimeError(f"Failed to read {count} vectors, error code: {result}")
+        return out
     
+    def get_vector(self, vector_hash: str) -> Optional[np.ndarray]:
+        """Get a vector by hash
+        
+        Args:
+            vector_hash: Object hash or unique prefix
+            
+        Returns:
+            The vector, or None if not found
+        """
+        dims = ctypes.c_size_t()
+        if _lib.embr_vector_dims(self._store, _encode(vector_hash), ctypes.byref(dims)) != 0:
+            return None
+        out = np.empty((1, dims.value), dtype=np.float32)
+        return self.get_many([vector_hash], out)[0]
     
     @property
-    def dimension(self) -> int:
-        """Get the dimension of vectors in the store"""
-        return self._dimension or 384  # Return provided dimension or default
+    def dimension(self) -> Optional[int]:
+        """Dimension of the vectors last stored, or the one given at open"""
+        return self._dimension
     
     def __enter__(self):
         """Context manager support"""
@@ -48,6 +48,7 @@ typedef struct {
 // Command handlers
 int cmd_init(int argc, char** argv);
 int cmd_store(int argc, char** argv);
+int cmd_import(int argc, char** argv);
 int cmd_diff(int argc, char** argv);
 int cmd_config(int argc, char** argv);
 int cmd_remote(int argc, char** argv);
@@ -59,10 +60,30 @@ int cmd_set(int argc, char **argv);
 int cmd_switch(int argc, char **argv);
 int cmd_merge(int argc, char **argv);
 int cmd_gc(int argc, char **argv);
+int cmd_repack(int argc, char **argv);
+int cmd_fsck(int argc, char **argv);
+int cmd_du(int argc, char **argv);
+int cmd_migrate_layout(int argc, char **argv);
+int cmd_compress(int argc, char **argv);
+int cmd_index(int argc, char **argv);
+int cmd_search(int argc, char **argv);
 int cmd_get(int argc, char **argv);
 int cmd_rm(int argc, char **argv);
 int cmd_pull(int argc, char **argv);
 int cmd_push(int argc, char **argv);
+int cmd_serve(int argc, char **argv);
+int cmd_stats(int argc, char **argv);
+
+/*
+ * Store row i of a matrix file as the embedding of source_files[i], in one
+ * batch (embr store <matrix> <file>..., embr import); returns the exit code
+ */
+int store_matrix(const char* matrix_path, char** source_files, size_t count,
+                 const char* model, size_t dims, eb_dtype_t dtype,
+                 bool verbose, bool quiet);
+
+/* Run the command named by argv[0], as main() does (used by the daemon) */
+int run_cli_command(int argc, char** argv);
 
 // Option parsing
 bool parse_cli_options(int argc, char** argv, eb_cli_options_t* opts);
@@ -110,9 +131,11 @@ void cli_info(const char* fmt, ...);
  * @param dims: Number of dimensions (0 for .npy auto-detect)
  * @param source_file: Original source file
  * @param model: Model/provider name (can be NULL)
+ * @param dtype: Storage dtype, EB_FLOAT32 to store the file unchanged
  * @return: 0 on success, 1 on error
  */
-int store_precomputed(const char *embedding_file, size_t dims, const char *source_file, const char *model);
+int store_precomputed(const char *embedding_file, size_t dims, const char *source_file, const char *model,
+                      eb_dtype_t dtype);
 
 /* Store embedding from source file
  * @param source_file: Source file to generate embedding from
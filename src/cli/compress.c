@@ -0,0 +1,120 @@
+/*
+ * EmbeddingBridge - Compress CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cli.h"
+#include "../core/object_dict.h"
+#include "../core/object_path.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+static const char* COMPRESS_USAGE =
+    "usage: embr compress <command> [options]\n"
+    "\n"
+    "Tune how embedding objects are compressed\n"
+    "\n"
+    "Commands:\n"
+    "  train-dict             Train a ZSTD dictionary from stored vectors\n"
+    "\n"
+    "Run 'embr compress <command> --help' for command-specific help\n";
+
+static const char* TRAIN_DICT_USAGE =
+    "usage: embr compress train-dict [options]\n"
+    "\n"
+    "Train a ZSTD dictionary from a sample of the stored vectors\n"
+    "\n"
+    "The dictionary is written to .embr/dicts and recorded as\n"
+    "storage.dictionary in .embr/config. Vectors stored afterwards are\n"
+    "compressed against it; existing objects keep their encoding and stay\n"
+    "readable. Run it again after the data has changed to retrain.\n"
+    "\n"
+    "Options:\n"
+    "  -n, --samples <count>  Objects to sample (default: 2048)\n"
+    "  -s, --size <bytes>     Maximum dictionary size (default: 65536)\n"
+    "  -q, --quiet            Suppress all output\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr compress train-dict\n"
+    "  embr compress train-dict --samples 10000 --size 131072\n";
+
+static bool parse_count(const char* value, size_t* out) {
+    char* end = NULL;
+    unsigned long long n = strtoull(value, &end, 10);
+    if (!value[0] || *end || n == 0)
+        return false;
+    *out = (size_t)n;
+    return true;
+}
+
+static int train_dict(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", TRAIN_DICT_USAGE);
+        return 0;
+    }
+
+    bool quiet = has_option(argc, argv, "--quiet") || has_option(argc, argv, "-q");
+    eb_dict_train_options_t options = { 0, 0 };
+
+    const char* samples = get_option_value(argc, argv, "-n", "--samples");
+    if (samples && !parse_count(samples, &options.max_samples)) {
+        cli_error("Invalid sample count: %s", samples);
+        return 1;
+    }
+    const char* size = get_option_value(argc, argv, "-s", "--size");
+    if (size && !parse_count(size, &options.capacity)) {
+        cli_error("Invalid dictionary size: %s", size);
+        return 1;
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+
+    eb_dict_train_result_t result;
+    eb_status_t status = eb_object_dict_train(repo_root, &options, &result);
+    bool compression = eb_object_compression(repo_root);
+    free(repo_root);
+
+    if (status == EB_ERROR_NOT_FOUND) {
+        cli_error("Need at least %d stored vectors to train a dictionary", EB_DICT_MIN_SAMPLES);
+        return 1;
+    }
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Dictionary training failed");
+        return 1;
+    }
+
+    if (!quiet) {
+        printf("Trained dictionary %u (%zu bytes) from %zu vectors\n",
+               result.id, result.dict_size, result.samples);
+        if (!compression)
+            cli_warning("storage.compression is off; the dictionary is used once it is turned on");
+    }
+    return 0;
+}
+
+int cmd_compress(int argc, char** argv) {
+    if (argc < 2 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+        printf("%s", COMPRESS_USAGE);
+        return argc < 2 ? 1 : 0;
+    }
+
+    if (strcmp(argv[1], "train-dict") == 0)
+        return train_dict(argc - 1, argv + 1);
+
+    cli_error("Unknown compress command: %s", argv[1]);
+    fprintf(stderr, "%s", COMPRESS_USAGE);
+    return 1;
+}
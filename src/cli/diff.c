@@ -16,7 +16,6 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <linux/limits.h>  // For PATH_MAX on Linux
-#include <npy_array.h>
 #include <ctype.h>
 
 /* Core includes - order matters */
@@ -26,35 +25,43 @@
 #include "../core/embedding.h"
 #include "../core/store.h"
 #include "../core/path_utils.h"
+#include "../core/distance.h"
+#include "../core/quantize.h"
+#include "../core/similarity.h"
+#include "../core/projection.h"
+#include "../core/embedding_file.h"
 
 /* CLI includes */
 #include "cli.h"
 #include "colors.h"
 #include "debug.h"
+#include "../core/object_path.h"
+
+#define MODEL_NAME_MAX 64
 
 /* Function declarations */
 void cli_info(const char* format, ...);
 static bool is_hex_string(const char* str);
 static bool has_multiple_models(const char* repo_root, const char* file_path);
-static char* get_available_models(const char* repo_root, const char* file_path);
-static const char* get_default_model_for_file(const char* repo_root, const char* file_path);
+static char* get_available_models(const char* repo_root, const char* file_path, char* out, size_t size);
+static const char* get_default_model_for_file(const char* repo_root, const char* file_path,
+                                              char out[MODEL_NAME_MAX]);
 
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
 
 /* Forward declarations */
-static float* load_npy_embedding(const char* filepath, size_t* dims);
-static float* load_bin_embedding(const char* filepath, size_t* dims);
-static float* load_stored_embedding(const char* hash, size_t* dims);
-static float* load_embedding(const char* path_or_hash, size_t* dims);
+static float* load_file_embedding(const char* filepath, size_t* dims);
+static void* load_stored_embedding(const char* hash, size_t* dims, eb_dtype_t* dtype, float* norm);
+static void* load_embedding(const char* path_or_hash, size_t* dims, eb_dtype_t* dtype);
 static char* resolve_hash(const char* input_hash);
 static bool is_valid_hash(const char* str);
 static int ends_with(const char* str, const char* suffix);
 static int check_invalid_values(const float* embedding, size_t dims);
-static float cosine_similarity(const float* vec1, const float* vec2, size_t dims);
-static float euclidean_distance(const float* vec1, const float* vec2, size_t dims);
-static float euclidean_similarity(const float* vec1, const float* vec2, size_t dims);
+static float cosine_similarity(const eb_vector_ref_t* vec1, const eb_vector_ref_t* vec2);
+static float euclidean_distance(const eb_vector_ref_t* vec1, const eb_vector_ref_t* vec2);
+static float euclidean_similarity(const eb_vector_ref_t* vec1, const eb_vector_ref_t* vec2);
 
 static const char* DIFF_USAGE = 
     "Usage: embr diff [options] <input1> <input2>\n"
@@ -68,6 +75,8 @@ static const char* DIFF_USAGE =
     "Options:\n"
     "  --models <model1>[,<model2>]  Specify models to use (required for multi-model repos)\n"
     "  --model <model>               Shorthand to use the same model for both inputs\n"
+    "  --dims <n>                    Compare the first n dimensions only, for models\n"
+    "                                that support truncated embeddings\n"
     "\n"
     "Examples:\n"
     "  embr diff 7d39a15 9f3e8c2               # Compare using short hashes (7 chars)\n"
@@ -78,77 +87,90 @@ static const char* DIFF_USAGE =
     "  embr diff doc1.txt doc2.txt             # Compare source files (looks for associated files)\n"
     "  embr diff --model voyage-2 file.txt      # Compare latest vs. previous for voyage-2\n"
     "  embr diff --models openai-3,voyage-2 file1.txt file2.txt\n"
-    "                                       # Compare file1 with openai-3 and file2 with voyage-2\n";
+    "                                       # Compare file1 with openai-3 and file2 with voyage-2\n"
+    "  embr diff --dims 256 file1.npy file2.npy # Screen on a 256-dimension prefix\n"
+    "  embr diff --matrix queries.list corpus.list\n"
+    "                                       # Top matches of every query, see --matrix --help\n";
+
+static const char* MATRIX_USAGE =
+    "Usage: embr diff --matrix [options] <a.list> [<b.list>]\n"
+    "\n"
+    "Compare every embedding of one list with every embedding of another\n"
+    "\n"
+    "Each line of a list names an embedding like the inputs of 'embr diff'\n"
+    "(hash, .npy/.bin file or source file); blank lines and lines starting\n"
+    "with '#' are skipped. With a single list, its embeddings are compared\n"
+    "with each other and nothing is matched with itself.\n"
+    "\n"
+    "Prints the top matches of every row of <a.list> as tab-separated\n"
+    "'<a entry> <rank> <similarity> <b entry>' lines, or writes the whole\n"
+    "similarity matrix as a float32 .npy file with --output.\n"
+    "\n"
+    "Options:\n"
+    "  -k, --top <count>       Matches per row (default: 10)\n"
+    "  -o, --output <file>     Write the full matrix to a .npy file\n"
+    "  --metric <name>         cosine or dot (default: cosine)\n"
+    "  --model <model>         Model used for source file entries\n"
+    "  -j, --threads <count>   Worker threads (default: one per CPU)\n"
+    "  --dims <n>              Screen on the first n dimensions, then rescore the\n"
+    "                          best candidates in full (-o writes the screening scores)\n"
+    "  --refine <count>        Candidates per row rescored in full (default: 4 * k)\n"
+    "\n"
+    "Examples:\n"
+    "  embr diff --matrix docs.list                 # Near-duplicates within docs\n"
+    "  embr diff --matrix --dims 256 queries.list docs.list\n"
+    "  embr diff --matrix -k 3 queries.list docs.list\n"
+    "  embr diff --matrix -o scores.npy queries.list docs.list\n";
 
-/* Calculate cosine similarity between two float vectors */
-static float cosine_similarity(const float *vec1, const float *vec2, size_t dims)
+/* Calculate cosine similarity between two vectors in their stored dtypes */
+static float cosine_similarity(const eb_vector_ref_t *vec1, const eb_vector_ref_t *vec2)
 {
-    double dot_product = 0.0;
-    double norm1 = 0.0;
-    double norm2 = 0.0;
+    DEBUG_PRINT("Calculating similarity for %zu dimensions", vec1->dims);
     
-    DEBUG_PRINT("Calculating similarity for %zu dimensions", dims);
-    
-    // Calculate dot product and norms in one pass
-    for (size_t i = 0; i < dims; i++) {
-        // Check for invalid values
-        if (isnan(vec1[i]) || isnan(vec2[i]) || 
-            isinf(vec1[i]) || isinf(vec2[i])) {
-            DEBUG_PRINT("Invalid value detected at index %zu: vec1=%f, vec2=%f",
-                       i, vec1[i], vec2[i]);
-            return 0.0f;
-        }
-        
-        dot_product += (double)vec1[i] * (double)vec2[i];
-        norm1 += (double)vec1[i] * (double)vec1[i];
-        norm2 += (double)vec2[i] * (double)vec2[i];
-    }
+    // Dot product and norms in one pass; NaN or Inf inputs poison the sums
+    eb_cosine_terms_t terms = eb_vector_cosine_terms(vec1, vec2);
     
     DEBUG_PRINT("Raw calculations: dot_product=%f, norm1=%f, norm2=%f",
-                dot_product, norm1, norm2);
+                terms.dot, terms.norm_a, terms.norm_b);
     
-    if (norm1 <= 0.0 || norm2 <= 0.0) {
-        DEBUG_PRINT("Zero norm detected: norm1=%f, norm2=%f", norm1, norm2);
+    if (!isfinite(terms.dot) || !isfinite(terms.norm_a) || !isfinite(terms.norm_b)) {
+        DEBUG_PRINT("Invalid value detected in input vectors");
+        return 0.0f;
+    }
+    
+    if (terms.norm_a <= 0.0f || terms.norm_b <= 0.0f) {
+        DEBUG_PRINT("Zero norm detected: norm1=%f, norm2=%f", terms.norm_a, terms.norm_b);
         return 0.0f;
     }
     
     // Calculate cosine similarity
-    float similarity = (float)(dot_product / (sqrt(norm1) * sqrt(norm2)));
+    float similarity = (float)(terms.dot / (sqrt(terms.norm_a) * sqrt(terms.norm_b)));
     
     DEBUG_PRINT("Calculated cosine similarity: %f", similarity);
     
     return similarity;
 }
 
-/* Calculate Euclidean distance between two float vectors */
-static float euclidean_distance(const float *vec1, const float *vec2, size_t dims)
+/* Calculate Euclidean distance between two vectors in their stored dtypes */
+static float euclidean_distance(const eb_vector_ref_t *vec1, const eb_vector_ref_t *vec2)
 {
-    double sum = 0.0;
-    
-    DEBUG_PRINT("Calculating Euclidean distance for %zu dimensions", dims);
+    DEBUG_PRINT("Calculating Euclidean distance for %zu dimensions", vec1->dims);
     
-    for (size_t i = 0; i < dims; i++) {
-        // Check for invalid values
-        if (isnan(vec1[i]) || isnan(vec2[i]) || 
-            isinf(vec1[i]) || isinf(vec2[i])) {
-            DEBUG_PRINT("Invalid value detected at index %zu: vec1=%f, vec2=%f",
-                       i, vec1[i], vec2[i]);
-            return INFINITY;
-        }
-        
-        double diff = (double)vec1[i] - (double)vec2[i];
-        sum += diff * diff;
+    float sum = eb_vector_l2_squared(vec1, vec2);
+    if (!isfinite(sum)) {
+        DEBUG_PRINT("Invalid value detected in input vectors");
+        return INFINITY;
     }
     
     DEBUG_PRINT("Euclidean distance squared: %f", sum);
     
-    return (float)sqrt(sum);
+    return sqrtf(sum);
 }
 
 /* Calculate normalized Euclidean similarity (0 to 1 scale, where 1 is identical) */
-static float euclidean_similarity(const float *vec1, const float *vec2, size_t dims)
+static float euclidean_similarity(const eb_vector_ref_t *vec1, const eb_vector_ref_t *vec2)
 {
-    float distance = euclidean_distance(vec1, vec2, dims);
+    float distance = euclidean_distance(vec1, vec2);
     
     if (isinf(distance) || isnan(distance)) {
         return 0.0f;
@@ -163,63 +185,39 @@ static float euclidean_similarity(const float *vec1, const float *vec2, size_t d
     return similarity;
 }
 
-/* Load embedding from .npy file */
-static float* load_npy_embedding(const char *filepath, size_t *dims) 
+/* Load one embedding from a .npy, .npz or .bin file, widened to float32 */
+static float* load_file_embedding(const char *filepath, size_t *dims) 
 {
-    npy_array_t *arr = npy_array_load(filepath);
-    if (!arr) {
-        cli_error("Cannot read NumPy file: %s", filepath);
+    eb_embedding_file_t *file = NULL;
+    eb_status_t status = eb_embedding_file_open(filepath, 0, &file);
+    if (status != EB_SUCCESS) {
+        cli_error("Cannot read embedding file %s: %s", filepath, eb_status_str(status));
         return NULL;
     }
 
-    DEBUG_PRINT("Loading .npy file with %d dimensions", arr->ndim);
-    DEBUG_PRINT("NPY array info:");
-    DEBUG_PRINT("  Type: %c", arr->typechar);
-    DEBUG_PRINT("  Dimensions: %d", arr->ndim);
-    for (int i = 0; i < arr->ndim; i++) {
-        DEBUG_PRINT("  Shape[%d]: %zu", i, arr->shape[i]);
-    }
-    DEBUG_PRINT("  Element size: %zu", arr->elem_size);
-    DEBUG_PRINT("  Fortran order: %s", arr->fortran_order ? "true" : "false");
-
-    // Verify it's a float array (float32 or float64)
-    if (arr->typechar != 'f') {
-        cli_error("Invalid .npy format - expected float32/float64 array, got type '%c'", arr->typechar);
-        npy_array_free(arr);
-        return NULL;
+    const eb_array_t *array = eb_embedding_file_embeddings(file);
+    size_t rows = 0;
+    if (!array) {
+        cli_error("%s holds several arrays and none is named 'embeddings'", filepath);
+    } else if (eb_array_rows(array, &rows, dims) != EB_SUCCESS || rows != 1) {
+        cli_error("%s holds %zu embeddings, expected one", filepath, rows);
+        array = NULL;
     }
-
-    // Get total size
-    size_t total_elements = 1;
-    for (int i = 0; i < arr->ndim; i++) {
-        total_elements *= arr->shape[i];
+    if (!array) {
+        eb_embedding_file_close(file);
+        return NULL;
     }
-    *dims = total_elements;
 
-    // Allocate and copy the data
-    float *data = malloc(total_elements * sizeof(float));
+    DEBUG_PRINT("Loaded %s: %zu %s values", filepath, *dims, eb_dtype_name(array->dtype));
+    // The one copy: diff owns its vectors, and float64/float16 files are widened here
+    float *data = malloc(*dims * sizeof(float));
     if (!data) {
         cli_error("Out of memory");
-        npy_array_free(arr);
+        eb_embedding_file_close(file);
         return NULL;
     }
-
-    // If float64, we need to convert to float32
-    if (arr->elem_size == 8) {
-        double *src = (double*)arr->data;
-        for (size_t i = 0; i < total_elements; i++) {
-            data[i] = (float)src[i];
-        }
-    } else {
-        memcpy(data, arr->data, total_elements * sizeof(float));
-    }
-
-    DEBUG_PRINT("First 5 values from .npy file:");
-    for (size_t i = 0; i < 5 && i < total_elements; i++) {
-        DEBUG_PRINT("[%zu]: %f", i, data[i]);
-    }
-
-    npy_array_free(arr);
+    eb_array_get(array, 0, *dims, data);
+    eb_embedding_file_close(file);
     return data;
 }
 
@@ -231,49 +229,6 @@ static int ends_with(const char *str, const char *suffix) {
     return strcmp(str + str_len - suffix_len, suffix) == 0;
 }
 
-/* Load embedding from binary file */
-static float* load_bin_embedding(const char *filepath, size_t *dims) 
-{
-    struct stat st;
-    FILE *f;
-    float *data = NULL;
-    
-    if (stat(filepath, &st) != 0) {
-        cli_error("Cannot access binary file: %s", filepath);
-        return NULL;
-    }
-    
-    *dims = st.st_size / sizeof(float);
-    
-    f = fopen(filepath, "rb");
-    if (!f) {
-        cli_error("Cannot open binary file: %s", filepath);
-        return NULL;
-    }
-    
-    data = malloc(st.st_size);
-    if (!data) {
-        cli_error("Out of memory");
-        fclose(f);
-        return NULL;
-    }
-    
-    if (fread(data, 1, (size_t)st.st_size, f) != (size_t)st.st_size) {
-        cli_error("Failed to read binary file: %s", filepath);
-        free(data);
-        fclose(f);
-        return NULL;
-    }
-
-    DEBUG_PRINT("First 5 values from binary file:");
-    for (size_t i = 0; i < 5 && i < *dims; i++) {
-        DEBUG_PRINT("[%zu]: %f", i, data[i]);
-    }
-    
-    fclose(f);
-    return data;
-}
-
 static bool is_valid_hash(const char* str) {
     if (!str || strlen(str) != 64) return false;
     for (int i = 0; str[i]; i++) {
@@ -328,9 +283,10 @@ static char* resolve_hash(const char* input_hash) {
 }
 
 /* Modified load_stored_embedding to handle multiple file types */
-static float* load_embedding(const char* path_or_hash, size_t *dims) 
+static void* load_embedding(const char* path_or_hash, size_t *dims, eb_dtype_t *dtype) 
 {
     DEBUG_PRINT("Attempting to load: %s\n", path_or_hash);
+    *dtype = EB_FLOAT32;  // Embedding files are always read as float32
     
     // First try to resolve if it looks like a hash (4-64 hex chars)
     if (strlen(path_or_hash) >= 4 && strlen(path_or_hash) <= 64) {
@@ -350,7 +306,7 @@ static float* load_embedding(const char* path_or_hash, size_t *dims)
             char* resolved = resolve_hash(path_or_hash);
             if (resolved) {
                 DEBUG_PRINT("Successfully resolved hash %s to %s\n", path_or_hash, resolved);
-                float* result = load_stored_embedding(resolved, dims);
+                void* result = load_stored_embedding(resolved, dims, dtype, NULL);
                 free(resolved);
                 return result;
             } else {
@@ -362,14 +318,9 @@ static float* load_embedding(const char* path_or_hash, size_t *dims)
     }
     
     // If not a hash or hash resolution failed, try as direct file
-    if (strstr(path_or_hash, ".npy")) {
-        DEBUG_PRINT("Loading direct .npy file: %s\n", path_or_hash);
-        return load_npy_embedding(path_or_hash, dims);
-    }
-    
-    if (strstr(path_or_hash, ".bin")) {
-        DEBUG_PRINT("Loading direct .bin file: %s\n", path_or_hash);
-        return load_bin_embedding(path_or_hash, dims);
+    if (strstr(path_or_hash, ".npy") || strstr(path_or_hash, ".npz") || strstr(path_or_hash, ".bin")) {
+        DEBUG_PRINT("Loading direct embedding file: %s\n", path_or_hash);
+        return load_file_embedding(path_or_hash, dims);
     }
     
     cli_error("Unsupported file format or invalid hash: %s", path_or_hash);
@@ -390,9 +341,95 @@ static int check_invalid_values(const float *embedding, size_t dims)
     return 0;
 }
 
-static float* load_stored_embedding(const char* hash, size_t *dims) 
+/*
+ * Copy the values out of a stored embedding payload. Float32 objects
+ * yield bare floats; reduced-precision objects keep their encoding
+ * (see quantize.h) so they can be compared without widening.
+ */
+static void* copy_embedding_values(const eb_object_view_t* view, size_t *dims, eb_dtype_t *dtype)
+{
+    eb_vector_ref_t ref;
+    eb_dtype_t stored = EB_FLAG_DTYPE(view->header.flags);
+    if (eb_vector_ref_init(&ref, stored, view->data, view->size) != EB_SUCCESS) {
+        cli_error("Stored embedding is not a valid %s vector", eb_dtype_name(stored));
+        return NULL;
+    }
+    
+    DEBUG_PRINT("Stored payload has %zu %s values", ref.dims, eb_dtype_name(stored));
+    size_t size = eb_quantized_size(stored, ref.dims);
+    void *data = malloc(size ? size : 1);
+    if (!data) {
+        cli_error("Out of memory");
+        return NULL;
+    }
+    if (stored == EB_INT8) {
+        memcpy(data, &ref.scale, sizeof(float));
+        memcpy((uint8_t*)data + sizeof(float), ref.values, ref.dims);
+    } else {
+        memcpy(data, ref.values, size);
+    }
+    *dims = ref.dims;
+    *dtype = stored;
+    return data;
+}
+
+/* View values loaded by load_embedding_with_model() */
+static void vector_ref(const void *data, size_t dims, eb_dtype_t dtype, eb_vector_ref_t *ref)
+{
+    if (dtype == EB_FLOAT32) {
+        ref->dtype = EB_FLOAT32;
+        ref->dims = dims;
+        ref->scale = 1.0f;
+        ref->values = data;
+        ref->norm = -1.0f;
+    } else {
+        eb_vector_ref_init(ref, dtype, data, eb_quantized_size(dtype, dims));
+    }
+}
+
+/*
+ * Replace two vectors of different models by their images in the shared
+ * space of a fitted projection. shared receives the buffer they point into.
+ */
+static bool project_pair(const eb_projection_t *projection, eb_vector_ref_t *ref1,
+                         eb_vector_ref_t *ref2, float **shared)
+{
+    if (eb_projection_input_dims(projection, EB_PROJECT_A) != ref1->dims ||
+        eb_projection_input_dims(projection, EB_PROJECT_B) != ref2->dims) {
+        cli_error("Projection expects %zu and %zu dimensions, embeddings have %zu and %zu",
+                  eb_projection_input_dims(projection, EB_PROJECT_A),
+                  eb_projection_input_dims(projection, EB_PROJECT_B), ref1->dims, ref2->dims);
+        return false;
+    }
+
+    eb_projection_info_t info;
+    eb_projection_describe(projection, &info);
+    float *values = malloc((ref1->dims + ref2->dims + 2 * info.dims) * sizeof(float));
+    if (!values) {
+        cli_error("Memory allocation failed");
+        return false;
+    }
+    float *values1 = values;
+    float *values2 = values1 + ref1->dims;
+    float *out = values2 + ref2->dims;
+    eb_vector_ref_get(ref1, 0, ref1->dims, values1);
+    eb_vector_ref_get(ref2, 0, ref2->dims, values2);
+    eb_projection_apply(projection, EB_PROJECT_A, values1, out);
+    eb_projection_apply(projection, EB_PROJECT_B, values2, out + info.dims);
+
+    vector_ref(out, info.dims, EB_FLOAT32, ref1);
+    vector_ref(out + info.dims, info.dims, EB_FLOAT32, ref2);
+    *shared = values;
+    return true;
+}
+
+/* norm, if given, receives the stored L2 norm or -1 if the object has none */
+static void* load_stored_embedding(const char* hash, size_t *dims, eb_dtype_t *dtype, float *norm) 
 {
     DEBUG_PRINT("Loading stored embedding with hash: %s\n", hash);
+    *dtype = EB_FLOAT32;  // The fallbacks below only read float32 objects
+    if (norm)
+        *norm = -1.0f;
     
     // Find repository root
     char *repo_root = find_repo_root(".");
@@ -405,143 +442,25 @@ static float* load_stored_embedding(const char* hash, size_t *dims)
     eb_store_t *store = NULL;
     eb_store_config_t config = { .root_path = repo_root };
     if (eb_store_init(&config, &store) == EB_SUCCESS) {
-        void *decompressed_data = NULL;
-        size_t decompressed_size = 0;
-        eb_object_header_t header;
+        eb_object_view_t view;
+        eb_status_t status = eb_object_map(store, hash, 0, &view);
         
-        eb_status_t status = read_object(store, hash, &decompressed_data, &decompressed_size, &header);
-        
-        if (status == EB_SUCCESS && decompressed_data) {
-            // Dump the first bytes to help debug format
-            DEBUG_PRINT("First bytes in hex:");
-            char debug_buf[100] = {0};
-            for (size_t i = 0; i < 16 && i < decompressed_size; i++) {
-                sprintf(debug_buf + (i*3), "%02x ", ((unsigned char*)decompressed_data)[i]);
-            }
-            DEBUG_PRINT("%s", debug_buf);
-            
-            // Check for NumPy magic string '\x93NUMPY' 
-            if (decompressed_size >= 10 && memcmp(decompressed_data, "\x93NUMPY", 6) == 0) {
-                DEBUG_PRINT("Detected NumPy array format (.npy) in decompressed data");
-                
-                // Extract header size from NumPy format (stored at offset 8 as uint16)
-                uint16_t header_size = *((const uint16_t*)((const uint8_t*)decompressed_data + 8));
-                
-                // Calculate data offset
-                size_t data_offset = 10 + header_size;
-                
-                if (decompressed_size > data_offset) {
-                    // Set dimensions - for numpy arrays, this will typically be the first dimension
-                    // in the shape array, which is the number of elements in the array
-                    float* float_data = (float*)((uint8_t*)decompressed_data + data_offset);
-                    *dims = (decompressed_size - data_offset) / sizeof(float);
-                    
-                    DEBUG_PRINT("NumPy array has %zu dimensions/elements", *dims);
-                    
-                    // Make a copy of the float data to return
-                    float *data_copy = malloc(*dims * sizeof(float));
-                    if (!data_copy) {
-                        cli_error("Out of memory");
-                        free(decompressed_data);
-                        eb_store_destroy(store);
-                        free(repo_root);
-                        return NULL;
-                    }
-                    
-                    memcpy(data_copy, float_data, *dims * sizeof(float));
-                    
-                    // Debug first few values
-                    DEBUG_PRINT("First 5 values from numpy array:");
-                    for (size_t i = 0; i < 5 && i < *dims; i++) {
-                        DEBUG_PRINT("[%zu]: %f", i, data_copy[i]);
-                    }
-                    
-                    free(decompressed_data);
-                    eb_store_destroy(store);
-                    free(repo_root);
-                    return data_copy;
-                }
-            }
-            
-            // Check specifically for binary format with dimension header
-            if (decompressed_size >= 4) {
-                uint32_t dim_header = 0;
-                memcpy(&dim_header, decompressed_data, sizeof(uint32_t));
-                
-                DEBUG_PRINT("Possible dimension header: %u (0x%08x)", dim_header, dim_header);
-                
-                // If this looks like a valid dimension count (1536 for OpenAI embeddings)
-                if (dim_header == 1536 || (dim_header > 100 && dim_header < 10000)) {
-                    DEBUG_PRINT("Found valid dimension header: %u", dim_header);
-                    
-                    // Set dimensions from header
-                    *dims = dim_header;
-                    
-                    // Skip the header and copy only the actual float data
-                    size_t data_size = dim_header * sizeof(float);
-                    float *data_copy = malloc(data_size);
-                    if (!data_copy) {
-                        cli_error("Out of memory");
-                        free(decompressed_data);
-                        eb_store_destroy(store);
-                        free(repo_root);
-                        return NULL;
-                    }
-                    
-                    // Copy data, skipping the 4-byte header
-                    memcpy(data_copy, (uint8_t*)decompressed_data + sizeof(uint32_t), data_size);
-                    
-                    DEBUG_PRINT("Successfully extracted %u-dimension embedding", dim_header);
-                    
-                    free(decompressed_data);
-                    eb_store_destroy(store);
-                    free(repo_root);
-                    return data_copy;
-                }
-            }
-            
-            // If no valid header found, use the original approach
-            // Determine the number of dimensions
-            *dims = decompressed_size / sizeof(float);
-            
-            DEBUG_PRINT("Successfully read and decompressed embedding: %zu bytes, %zu dimensions",
-                      decompressed_size, *dims);
-                      
-            // Dump the first bytes to help debug format
-            DEBUG_PRINT("First bytes in hex:");
-            for (size_t i = 0; i < 32 && i < decompressed_size; i++) {
-                DEBUG_PRINT("%02x ", ((unsigned char*)decompressed_data)[i]);
-            }
-            
-            // Make a copy of the decompressed data to return
-            float *data_copy = malloc(decompressed_size);
-            if (!data_copy) {
-                cli_error("Out of memory");
-                free(decompressed_data);
-                eb_store_destroy(store);
-                free(repo_root);
-                return NULL;
-            }
-            
-            memcpy(data_copy, decompressed_data, decompressed_size);
-            
-            // Debug first few values
-            DEBUG_PRINT("First 5 values from decompressed data:");
-            for (size_t i = 0; i < 5 && i < *dims; i++) {
-                DEBUG_PRINT("[%zu]: %f", i, data_copy[i]);
-            }
-            
-            free(decompressed_data);
+        if (status == EB_SUCCESS) {
+            // Copy the values straight out of the mapped (or decompressed) payload
+            void *data = copy_embedding_values(&view, dims, dtype);
+            if (data && norm)
+                *norm = view.norm;
+            eb_object_unmap(&view);
             eb_store_destroy(store);
             free(repo_root);
-            return data_copy;
+            return data;
         } else {
             DEBUG_PRINT("Failed to read object using store API: %d", status);
             
             // Even if the store API fails, we can try to read and decompress the file directly
             // Construct path to raw file
             char raw_path[PATH_MAX];
-            snprintf(raw_path, sizeof(raw_path), "%s/.embr/objects/%s.raw", repo_root, hash);
+            eb_object_path(repo_root, hash, "raw", raw_path, sizeof(raw_path));
             
             // Try to read and decompress the file directly
             FILE *f = fopen(raw_path, "rb");
@@ -558,6 +477,8 @@ static float* load_stored_embedding(const char* hash, size_t *dims)
                     fseek(f, 0, SEEK_END);
                     long file_size = ftell(f);
                     size_t data_size = file_size - sizeof(header);
+                    if (header.obj_type == EB_OBJ_VECTOR && (header.flags & EB_FLAG_NORM))
+                        data_size -= sizeof(float);  // Stored norm, not compressed data
                     fseek(f, sizeof(header), SEEK_SET);
                     
                     // Read the compressed data
@@ -571,70 +492,24 @@ static float* load_stored_embedding(const char* hash, size_t *dims)
                                             &decompressed_data, &decompressed_size) == EB_SUCCESS) {
                             DEBUG_PRINT("Successfully decompressed data directly: %zu bytes", decompressed_size);
                             
-                            // Check if it's a NumPy file
-                            if (decompressed_size >= 10 && memcmp(decompressed_data, "\x93NUMPY", 6) == 0) {
-                                DEBUG_PRINT("Detected NumPy array format (.npy) in directly decompressed data");
-                                
-                                // Extract header size from NumPy format (stored at offset 8 as uint16)
-                                uint16_t header_size = *((const uint16_t*)((const uint8_t*)decompressed_data + 8));
-                                
-                                // Calculate data offset
-                                size_t data_offset = 10 + header_size;
-                                
-                                if (decompressed_size > data_offset) {
-                                    // Set dimensions
-                                    float* float_data = (float*)((uint8_t*)decompressed_data + data_offset);
-                                    *dims = (decompressed_size - data_offset) / sizeof(float);
+                            // .npy file, floats behind a dimension header or bare floats
+                            const float *values = NULL;
+                            size_t count = 0;
+                            if (eb_float_payload(decompressed_data, decompressed_size,
+                                                 &values, &count) == EB_SUCCESS && count > 0) {
+                                float *data_copy = malloc(count * sizeof(float));
+                                if (data_copy) {
+                                    memcpy(data_copy, values, count * sizeof(float));
+                                    *dims = count;
                                     
-                                    DEBUG_PRINT("NumPy array has %zu dimensions/elements", *dims);
+                                    DEBUG_PRINT("Successfully extracted %zu-dimension embedding from direct file", count);
                                     
-                                    // Make a copy of the float data to return
-                                    float *data_copy = malloc(*dims * sizeof(float));
-                                    if (data_copy) {
-                                        memcpy(data_copy, float_data, *dims * sizeof(float));
-                                        
-                                        DEBUG_PRINT("Successfully extracted NumPy array from direct file");
-                                        
-                                        free(decompressed_data);
-                                        free(compressed_data);
-                                        fclose(f);
-                                        eb_store_destroy(store);
-                                        free(repo_root);
-                                        return data_copy;
-                                    }
-                                }
-                            }
-                            
-                            // Check if it has the dimension header format
-                            if (decompressed_size >= 4) {
-                                uint32_t dim_header = 0;
-                                memcpy(&dim_header, decompressed_data, sizeof(uint32_t));
-                                
-                                DEBUG_PRINT("Possible dimension header: %u (0x%08x)", dim_header, dim_header);
-                                
-                                // If this looks like a valid dimension count (1536 for OpenAI embeddings)
-                                if (dim_header == 1536 || (dim_header > 100 && dim_header < 10000)) {
-                                    DEBUG_PRINT("Found valid dimension header: %u", dim_header);
-                                    
-                                    // Set dimensions from header
-                                    *dims = dim_header;
-                                    
-                                    // Skip the header and copy only the actual float data
-                                    size_t data_size = dim_header * sizeof(float);
-                                    float *data_copy = malloc(data_size);
-                                    if (data_copy) {
-                                        // Copy data, skipping the 4-byte header
-                                        memcpy(data_copy, (uint8_t*)decompressed_data + sizeof(uint32_t), data_size);
-                                        
-                                        DEBUG_PRINT("Successfully extracted %u-dimension embedding from direct file", dim_header);
-                                        
-                                        free(decompressed_data);
-                                        free(compressed_data);
-                                        fclose(f);
-                                        eb_store_destroy(store);
-                                        free(repo_root);
-                                        return data_copy;
-                                    }
+                                    free(decompressed_data);
+                                    free(compressed_data);
+                                    fclose(f);
+                                    eb_store_destroy(store);
+                                    free(repo_root);
+                                    return data_copy;
                                 }
                             }
                             
@@ -655,96 +530,21 @@ static float* load_stored_embedding(const char* hash, size_t *dims)
     // Original implementation as fallback
     // Construct path to raw file
     char raw_path[PATH_MAX];
-    snprintf(raw_path, sizeof(raw_path), "%s/.embr/objects/%s.raw", repo_root, hash);
-    
-    // Try loading as npy file first
-    npy_array_t *arr = npy_array_load(raw_path);
-    if (arr) {
-        DEBUG_PRINT("Successfully loaded as .npy file");
-        DEBUG_PRINT("NPY array info:");
-        DEBUG_PRINT("  Type: %c", arr->typechar);
-        DEBUG_PRINT("  Dimensions: %d", arr->ndim);
-        for (int i = 0; i < arr->ndim; i++) {
-            DEBUG_PRINT("  Shape[%d]: %zu", i, arr->shape[i]);
-        }
-        DEBUG_PRINT("  Element size: %zu", arr->elem_size);
-        DEBUG_PRINT("  Fortran order: %s", arr->fortran_order ? "true" : "false");
-
-        // Get dimensions and allocate buffer
-        *dims = arr->shape[0];
-        float *data = malloc(*dims * sizeof(float));
-        if (!data) {
-            cli_error("Out of memory");
-            npy_array_free(arr);
-            free(repo_root);
-            return NULL;
-        }
-        
-        // Copy data
-        memcpy(data, arr->data, *dims * sizeof(float));
-        
-        // Debug first few values
-        DEBUG_PRINT("First 5 values:");
-        for (size_t i = 0; i < 5 && i < *dims; i++) {
-            DEBUG_PRINT("[%zu]: %f", i, data[i]);
-        }
-        
-        npy_array_free(arr);
-        free(repo_root);
-        return data;
-    }
+    eb_object_path(repo_root, hash, "raw", raw_path, sizeof(raw_path));
     
-    DEBUG_PRINT("Not a .npy file, trying as raw float data");
-    
-    // Open and read file as raw float data
-    FILE *f = fopen(raw_path, "rb");
-    if (!f) {
-        cli_error("Cannot open raw file: %s", raw_path);
-        free(repo_root);
-        return NULL;
-    }
-    
-    // Get file size for raw float data
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    
-    // Calculate number of floats
-    *dims = size / sizeof(float);
-    
-    // Allocate buffer
-    float *data = malloc(size);
-    if (!data) {
-        cli_error("Out of memory");
-        fclose(f);
-        free(repo_root);
-        return NULL;
-    }
-    
-    // Read data
-    if (fread(data, 1, size, f) != (size_t)size) {
-        cli_error("Failed to read raw file");
-        free(data);
-        fclose(f);
-        free(repo_root);
-        return NULL;
-    }
-    
-    // Debug first few values
-    DEBUG_PRINT("First 5 values from raw data:");
-    for (size_t i = 0; i < 5 && i < *dims; i++) {
-        DEBUG_PRINT("[%zu]: %f", i, data[i]);
-    }
-    
-    fclose(f);
+    // Objects from before headers were added are the embedding file itself
+    float *data = load_file_embedding(raw_path, dims);
     free(repo_root);
     return data;
 }
 
 /* Load embedding with a specific model */
-static float* load_embedding_with_model(const char* path_or_hash, const char* model, size_t *dims) 
+static void* load_embedding_with_model(const char* path_or_hash, const char* model,
+                                       size_t *dims, eb_dtype_t *dtype, float *norm) 
 {
     DEBUG_PRINT("Attempting to load with model %s: %s\n", model ? model : "NULL", path_or_hash);
+    *dtype = EB_FLOAT32;  // Embedding files are always read as float32
+    *norm = -1.0f;        // Only stored objects know their norm
     
     // First try to resolve if it looks like a hash (4-64 hex chars)
     if (strlen(path_or_hash) >= 4 && strlen(path_or_hash) <= 64) {
@@ -764,7 +564,7 @@ static float* load_embedding_with_model(const char* path_or_hash, const char* mo
             char* resolved = resolve_hash(path_or_hash);
             if (resolved) {
                 DEBUG_PRINT("Successfully resolved hash %s to %s\n", path_or_hash, resolved);
-                float* result = load_stored_embedding(resolved, dims);
+                void* result = load_stored_embedding(resolved, dims, dtype, norm);
                 free(resolved);
                 return result;
             } else {
@@ -776,14 +576,9 @@ static float* load_embedding_with_model(const char* path_or_hash, const char* mo
     }
     
     // If not a hash or hash resolution failed, try as direct file
-    if (strstr(path_or_hash, ".npy")) {
-        DEBUG_PRINT("Loading direct .npy file: %s\n", path_or_hash);
-        return load_npy_embedding(path_or_hash, dims);
-    }
-    
-    if (strstr(path_or_hash, ".bin")) {
-        DEBUG_PRINT("Loading direct .bin file: %s\n", path_or_hash);
-        return load_bin_embedding(path_or_hash, dims);
+    if (strstr(path_or_hash, ".npy") || strstr(path_or_hash, ".npz") || strstr(path_or_hash, ".bin")) {
+        DEBUG_PRINT("Loading direct embedding file: %s\n", path_or_hash);
+        return load_file_embedding(path_or_hash, dims);
     }
     
     // If not a direct file, try to get the hash for the file and model
@@ -796,6 +591,7 @@ static float* load_embedding_with_model(const char* path_or_hash, const char* mo
         
         char hash[65];
         char rel_path[PATH_MAX];
+        char file_model[MODEL_NAME_MAX];
         
         // Get relative path if needed
         if (path_or_hash[0] == '/') {
@@ -819,11 +615,13 @@ static float* load_embedding_with_model(const char* path_or_hash, const char* mo
             if (has_multiple_models(repo_root, rel_path)) {
                 cli_error("Multiple models exist for '%s'. Please specify a model with --models", 
                          rel_path);
-                cli_info("Available models: %s", get_available_models(repo_root, rel_path));
+                char models[512];
+                cli_info("Available models: %s",
+                         get_available_models(repo_root, rel_path, models, sizeof(models)));
                 return NULL;
             }
             // If only one model exists, use it (with a debug message)
-            model = get_default_model_for_file(repo_root, rel_path);
+            model = get_default_model_for_file(repo_root, rel_path, file_model);
             DEBUG_PRINT("Using default model '%s' for file %s", model ? model : "NULL", rel_path);
         }
         
@@ -839,7 +637,7 @@ static float* load_embedding_with_model(const char* path_or_hash, const char* mo
             char* resolved = resolve_hash(hash);
             if (resolved) {
                 DEBUG_PRINT("Successfully resolved hash %s to %s\n", hash, resolved);
-                float* result = load_stored_embedding(resolved, dims);
+                void* result = load_stored_embedding(resolved, dims, dtype, norm);
                 free(resolved);
                 return result;
             } else {
@@ -867,7 +665,7 @@ static float* load_embedding_with_model(const char* path_or_hash, const char* mo
         cli_error("Invalid hash: '%s'", path_or_hash);
     } else {
         cli_error("Unsupported file format or invalid hash: %s", path_or_hash);
-        cli_info("Supported formats: .npy, .bin, or tracked files");
+        cli_info("Supported formats: .npy, .npz, .bin, or tracked files");
     }
     return NULL;
 }
@@ -902,17 +700,18 @@ static bool has_multiple_models(const char* repo_root, const char* file_path) {
         char* model = NULL;
         
         // Check for newer format (timestamp hash file model)
-        char* token = strtok(line, " ");
+        char* save = NULL;
+        char* token = strtok_r(line, " ", &save);
         if (token && (isdigit(token[0]) || token[0] == '-')) {
             // Skip timestamp and hash
-            token = strtok(NULL, " "); // hash
+            token = strtok_r(NULL, " ", &save); // hash
             if (!token) continue;
             
-            token = strtok(NULL, " "); // file path
+            token = strtok_r(NULL, " ", &save); // file path
             if (!token) continue;
             line_file_path = token;
             
-            token = strtok(NULL, " "); // model
+            token = strtok_r(NULL, " ", &save); // model
             if (!token) continue;
             model = token;
         } else {
@@ -920,13 +719,13 @@ static bool has_multiple_models(const char* repo_root, const char* file_path) {
             line_file_path = token;
             
             // Skip hash and timestamp
-            token = strtok(NULL, " "); // hash
+            token = strtok_r(NULL, " ", &save); // hash
             if (!token) continue;
             
-            token = strtok(NULL, " "); // timestamp
+            token = strtok_r(NULL, " ", &save); // timestamp
             if (!token) continue;
             
-            token = strtok(NULL, " "); // model
+            token = strtok_r(NULL, " ", &save); // model
             if (!token) continue;
             model = token;
         }
@@ -955,9 +754,9 @@ static bool has_multiple_models(const char* repo_root, const char* file_path) {
     return model_count > 1;
 }
 
-/* Get a comma-separated list of available models for a file */
-static char* get_available_models(const char* repo_root, const char* file_path) {
-    static char model_list[512] = {0};
+/* Get a comma-separated list of available models for a file, in model_list */
+static char* get_available_models(const char* repo_root, const char* file_path,
+                                  char* model_list, size_t size) {
     model_list[0] = '\0';
     char* log_path = get_current_set_log_path();
     FILE* fp = fopen(log_path, "r");
@@ -978,17 +777,18 @@ static char* get_available_models(const char* repo_root, const char* file_path)
         char* model = NULL;
         
         // Check for newer format (timestamp hash file model)
-        char* token = strtok(line, " ");
+        char* save = NULL;
+        char* token = strtok_r(line, " ", &save);
         if (token && (isdigit(token[0]) || token[0] == '-')) {
             // Skip timestamp and hash
-            token = strtok(NULL, " "); // hash
+            token = strtok_r(NULL, " ", &save); // hash
             if (!token) continue;
             
-            token = strtok(NULL, " "); // file path
+            token = strtok_r(NULL, " ", &save); // file path
             if (!token) continue;
             line_file_path = token;
             
-            token = strtok(NULL, " "); // model
+            token = strtok_r(NULL, " ", &save); // model
             if (!token) continue;
             model = token;
         } else {
@@ -996,13 +796,13 @@ static char* get_available_models(const char* repo_root, const char* file_path)
             line_file_path = token;
             
             // Skip hash and timestamp
-            token = strtok(NULL, " "); // hash
+            token = strtok_r(NULL, " ", &save); // hash
             if (!token) continue;
             
-            token = strtok(NULL, " "); // timestamp
+            token = strtok_r(NULL, " ", &save); // timestamp
             if (!token) continue;
             
-            token = strtok(NULL, " "); // model
+            token = strtok_r(NULL, " ", &save); // model
             if (!token) continue;
             model = token;
         }
@@ -1030,17 +830,20 @@ static char* get_available_models(const char* repo_root, const char* file_path)
     fclose(fp);
     
     // Build comma-separated list
-    for (int i = 0; i < model_count; i++) {
-        if (i > 0) strcat(model_list, ", ");
-        strcat(model_list, models[i]);
+    size_t used = 0;
+    for (int i = 0; i < model_count && used < size; i++) {
+        int n = snprintf(model_list + used, size - used, "%s%s", i > 0 ? ", " : "", models[i]);
+        if (n < 0)
+            break;
+        used += (size_t)n;
     }
     
     return model_list;
 }
 
-/* Get the default model for a file (the only model, or NULL if multiple) */
-static const char* get_default_model_for_file(const char* repo_root, const char* file_path) {
-    static char default_model[64] = {0};
+/* Get the default model for a file into default_model (the only model, or NULL if multiple) */
+static const char* get_default_model_for_file(const char* repo_root, const char* file_path,
+                                              char default_model[MODEL_NAME_MAX]) {
     default_model[0] = '\0';
     char* log_path = get_current_set_log_path();
     FILE* fp = fopen(log_path, "r");
@@ -1060,17 +863,18 @@ static const char* get_default_model_for_file(const char* repo_root, const char*
         char* model = NULL;
         
         // Check for newer format (timestamp hash file model)
-        char* token = strtok(line, " ");
+        char* save = NULL;
+        char* token = strtok_r(line, " ", &save);
         if (token && (isdigit(token[0]) || token[0] == '-')) {
             // Skip timestamp and hash
-            token = strtok(NULL, " "); // hash
+            token = strtok_r(NULL, " ", &save); // hash
             if (!token) continue;
             
-            token = strtok(NULL, " "); // file path
+            token = strtok_r(NULL, " ", &save); // file path
             if (!token) continue;
             line_file_path = token;
             
-            token = strtok(NULL, " "); // model
+            token = strtok_r(NULL, " ", &save); // model
             if (!token) continue;
             model = token;
         } else {
@@ -1078,13 +882,13 @@ static const char* get_default_model_for_file(const char* repo_root, const char*
             line_file_path = token;
             
             // Skip hash and timestamp
-            token = strtok(NULL, " "); // hash
+            token = strtok_r(NULL, " ", &save); // hash
             if (!token) continue;
             
-            token = strtok(NULL, " "); // timestamp
+            token = strtok_r(NULL, " ", &save); // timestamp
             if (!token) continue;
             
-            token = strtok(NULL, " "); // model
+            token = strtok_r(NULL, " ", &save); // model
             if (!token) continue;
             model = token;
         }
@@ -1098,8 +902,8 @@ static const char* get_default_model_for_file(const char* repo_root, const char*
             }
             
             // Store this model
-            strncpy(default_model, model, 63);
-            default_model[63] = '\0';
+            strncpy(default_model, model, MODEL_NAME_MAX - 1);
+            default_model[MODEL_NAME_MAX - 1] = '\0';
             model_count++;
         }
     }
@@ -1110,9 +914,8 @@ static const char* get_default_model_for_file(const char* repo_root, const char*
     return model_count == 1 ? default_model : NULL;
 }
 
-/* Get the default model from config */
-static char* get_default_model() {
-    static char default_model[64] = {0};
+/* Get the default model from config into default_model */
+static char* get_default_model(char default_model[MODEL_NAME_MAX]) {
     default_model[0] = '\0';
     
     // Try to find repo root
@@ -1191,7 +994,7 @@ static char* get_default_model() {
                     // Copy value
                     if (v_end >= v) {
                         size_t val_len = v_end - v + 1;
-                        if (val_len >= sizeof(default_model)) val_len = sizeof(default_model) - 1;
+                        if (val_len >= MODEL_NAME_MAX) val_len = MODEL_NAME_MAX - 1;
                         strncpy(default_model, v, val_len);
                         default_model[val_len] = '\0';
                         break;
@@ -1207,10 +1010,341 @@ static char* get_default_model() {
     return *default_model ? default_model : NULL;
 }
 
+/* Embeddings named by a list file, packed into one row-major matrix */
+typedef struct {
+    char** names;
+    float* values;
+    size_t count;
+    size_t dims;
+} matrix_list_t;
+
+static void free_matrix_list(matrix_list_t* list)
+{
+    for (size_t i = 0; i < list->count; i++)
+        free(list->names[i]);
+    free(list->names);
+    free(list->values);
+}
+
+/* Float32 copy of a stored object or any input load_embedding_with_model() accepts */
+static float* load_row(eb_store_t* store, const char* entry, const char* model, size_t* dims)
+{
+    eb_vector_ref_t ref;
+    eb_object_view_t view;
+    void* data = NULL;
+    bool mapped = false;
+
+    if (store && strlen(entry) == 64 && is_hex_string(entry) &&
+        eb_object_map(store, entry, 0, &view) == EB_SUCCESS) {
+        mapped = eb_object_vector_ref(&view, &ref) == EB_SUCCESS;
+        if (!mapped) {
+            eb_object_unmap(&view);
+            return NULL;
+        }
+    } else {
+        eb_dtype_t dtype = EB_FLOAT32;
+        float norm;
+        data = load_embedding_with_model(entry, model, dims, &dtype, &norm);
+        if (!data)
+            return NULL;
+        vector_ref(data, *dims, dtype, &ref);
+        ref.norm = norm;
+    }
+
+    float* row = malloc((ref.dims ? ref.dims : 1) * sizeof(float));
+    if (row)
+        eb_vector_ref_get(&ref, 0, ref.dims, row);
+    *dims = ref.dims;
+    if (mapped)
+        eb_object_unmap(&view);
+    free(data);
+    return row;
+}
+
+static int load_matrix_list(eb_store_t* store, const char* path, const char* model, matrix_list_t* list)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        cli_error("Cannot open list %s", path);
+        return 1;
+    }
+
+    size_t capacity = 0;
+    char line[PATH_MAX];
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), f)) {
+        char* entry = line;
+        while (isspace((unsigned char)*entry))
+            entry++;
+        char* end = entry + strlen(entry);
+        while (end > entry && isspace((unsigned char)end[-1]))
+            *--end = '\0';
+        if (!*entry || *entry == '#')
+            continue;
+
+        size_t dims = 0;
+        float* row = load_row(store, entry, model, &dims);
+        if (!row || dims == 0 || check_invalid_values(row, dims)) {
+            cli_error("Cannot load %s from %s", entry, path);
+            free(row);
+            ret = 1;
+            break;
+        }
+        if (list->count == 0) {
+            list->dims = dims;
+        } else if (dims != list->dims) {
+            cli_error("%s has %zu dimensions, %s uses %zu", entry, dims, path, list->dims);
+            free(row);
+            ret = 1;
+            break;
+        }
+
+        if (list->count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            char** names = realloc(list->names, capacity * sizeof(*names));
+            if (names)
+                list->names = names;
+            float* values = names ? realloc(list->values, capacity * dims * sizeof(float)) : NULL;
+            if (values)
+                list->values = values;
+            if (!names || !values) {
+                cli_error("Memory allocation failed");
+                free(row);
+                ret = 1;
+                break;
+            }
+        }
+        list->names[list->count] = strdup(entry);
+        memcpy(list->values + list->count * dims, row, dims * sizeof(float));
+        free(row);
+        if (!list->names[list->count]) {
+            cli_error("Memory allocation failed");
+            ret = 1;
+            break;
+        }
+        list->count++;
+    }
+    fclose(f);
+
+    if (ret == 0 && list->count == 0) {
+        cli_error("List %s names no embeddings", path);
+        ret = 1;
+    }
+    return ret;
+}
+
+/* Rows of the similarity matrix go straight to the .npy file */
+static int write_matrix_rows(size_t first, size_t rows, const float* values, void* ctx)
+{
+    (void)first;
+    void** args = ctx;
+    FILE* f = args[0];
+    size_t cols = *(const size_t*)args[1];
+    return fwrite(values, sizeof(float), rows * cols, f) == rows * cols ? 0 : 1;
+}
+
+static int write_matrix_npy(const char* path, const matrix_list_t* a, const matrix_list_t* b,
+                            const eb_sim_options_t* options)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        cli_error("Cannot create %s", path);
+        return 1;
+    }
+
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu, %zu), }",
+                          a->count, b->count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+    uint16_t header_size = (uint16_t)length;
+    bool ok = fwrite("\x93NUMPY\x01\x00", 1, 8, f) == 8 &&
+              fwrite(&header_size, sizeof(header_size), 1, f) == 1 &&
+              fwrite(header, 1, (size_t)length, f) == (size_t)length;
+
+    eb_matrix_t ma = { a->values, a->dims };
+    eb_matrix_t mb = { b->values, b->dims };
+    size_t cols = b->count;
+    void* args[2] = { f, &cols };
+    eb_status_t status = ok ? eb_similarity_rows(&ma, a->count, &mb, b->count, options,
+                                                 write_matrix_rows, args)
+                            : EB_ERROR_FILE_IO;
+    if (fclose(f) != 0)
+        ok = false;
+    if (status != EB_SUCCESS || !ok) {
+        handle_error(status != EB_SUCCESS ? status : EB_ERROR_FILE_IO, "Failed to write similarity matrix");
+        remove(path);
+        return 1;
+    }
+    printf("Wrote %zu x %zu similarity matrix to %s\n", a->count, b->count, path);
+    return 0;
+}
+
+static int print_top_matches(const matrix_list_t* a, const matrix_list_t* b,
+                             const eb_sim_options_t* options)
+{
+    size_t k = options->k;
+    size_t* indices = malloc(a->count * k * sizeof(size_t));
+    float* scores = malloc(a->count * k * sizeof(float));
+    if (!indices || !scores) {
+        cli_error("Memory allocation failed");
+        free(indices);
+        free(scores);
+        return 1;
+    }
+
+    eb_matrix_t ma = { a->values, a->dims };
+    eb_matrix_t mb = { b->values, b->dims };
+    eb_status_t status = eb_similarity_top_k(&ma, a->count, &mb, b->count, options, indices, scores);
+    if (status == EB_SUCCESS) {
+        for (size_t i = 0; i < a->count; i++) {
+            for (size_t r = 0; r < k; r++)
+                printf("%s\t%zu\t%.6f\t%s\n", a->names[i], r + 1, scores[i * k + r],
+                       b->names[indices[i * k + r]]);
+        }
+    } else {
+        handle_error(status, "Failed to compute similarities");
+    }
+
+    free(indices);
+    free(scores);
+    return status == EB_SUCCESS ? 0 : 1;
+}
+
+static int diff_matrix(int argc, char** argv)
+{
+    eb_sim_options_t options = { EB_SIM_COSINE, 10, false, 0, 0, 0 };
+    const char* output = NULL;
+    const char* model = NULL;
+    const char* lists[2] = { NULL, NULL };
+    int list_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--matrix") == 0)
+            continue;
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            printf("%s", MATRIX_USAGE);
+            return 0;
+        }
+        bool takes_value = strcmp(arg, "-k") == 0 || strcmp(arg, "--top") == 0 ||
+                           strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0 ||
+                           strcmp(arg, "--metric") == 0 || strcmp(arg, "--model") == 0 ||
+                           strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0 ||
+                           strcmp(arg, "--dims") == 0 || strcmp(arg, "--refine") == 0;
+        if (takes_value) {
+            if (i + 1 >= argc) {
+                cli_error("Missing value for %s", arg);
+                return 1;
+            }
+            const char* value = argv[++i];
+            char* end = NULL;
+            if (strcmp(arg, "-k") == 0 || strcmp(arg, "--top") == 0) {
+                options.k = strtoul(value, &end, 10);
+                if (!*value || *end || options.k == 0) {
+                    cli_error("Invalid match count: %s", value);
+                    return 1;
+                }
+            } else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0) {
+                unsigned long threads = strtoul(value, &end, 10);
+                if (!*value || *end || threads == 0 || threads > 256) {
+                    cli_error("Invalid thread count: %s", value);
+                    return 1;
+                }
+                options.threads = (unsigned)threads;
+            } else if (strcmp(arg, "--dims") == 0 || strcmp(arg, "--refine") == 0) {
+                size_t count = strtoul(value, &end, 10);
+                if (!*value || *end || *value == '-' || count == 0) {
+                    cli_error("Invalid value for %s: %s", arg, value);
+                    return 1;
+                }
+                if (strcmp(arg, "--dims") == 0)
+                    options.prefix_dims = count;
+                else
+                    options.refine = count;
+            } else if (strcmp(arg, "--metric") == 0) {
+                if (strcmp(value, "cosine") == 0) {
+                    options.metric = EB_SIM_COSINE;
+                } else if (strcmp(value, "dot") == 0) {
+                    options.metric = EB_SIM_DOT;
+                } else {
+                    cli_error("Unknown metric: %s (use cosine or dot)", value);
+                    return 1;
+                }
+            } else if (strcmp(arg, "--model") == 0) {
+                model = value;
+            } else {
+                output = value;
+            }
+        } else if (arg[0] == '-') {
+            cli_error("Unknown option: %s", arg);
+            return 1;
+        } else if (list_count < 2) {
+            lists[list_count++] = arg;
+        } else {
+            cli_error("At most two lists can be compared");
+            return 1;
+        }
+    }
+    if (list_count == 0) {
+        fprintf(stderr, "%s", MATRIX_USAGE);
+        return 1;
+    }
+
+    // Stored objects named by full hash all come through one store
+    eb_store_t* store = NULL;
+    char* repo_root = find_repo_root(".");
+    if (repo_root) {
+        eb_store_config_t config = { .root_path = repo_root };
+        if (eb_store_init(&config, &store) != EB_SUCCESS)
+            store = NULL;
+    }
+
+    matrix_list_t a = { 0 }, b = { 0 };
+    int ret = load_matrix_list(store, lists[0], model, &a);
+    if (ret == 0 && list_count == 2)
+        ret = load_matrix_list(store, lists[1], model, &b);
+    if (store)
+        eb_store_destroy(store);
+    free(repo_root);
+
+    const matrix_list_t* corpus = list_count == 2 ? &b : &a;
+    if (ret == 0 && corpus->dims != a.dims) {
+        cli_error("Lists have different dimensions: %zu and %zu", a.dims, corpus->dims);
+        ret = 1;
+    }
+    if (ret == 0) {
+        DEBUG_PRINT("Comparing %zu x %zu embeddings with the %s backend",
+                    a.count, corpus->count, eb_similarity_backend());
+        if (output) {
+            ret = write_matrix_npy(output, &a, corpus, &options);
+        } else {
+            options.exclude_self = list_count == 1;
+            size_t candidates = corpus->count - (options.exclude_self ? 1 : 0);
+            if (candidates == 0) {
+                cli_error("Nothing to compare %s with", lists[0]);
+                ret = 1;
+            } else {
+                if (options.k > candidates)
+                    options.k = candidates;
+                ret = print_top_matches(&a, corpus, &options);
+            }
+        }
+    }
+
+    free_matrix_list(&a);
+    free_matrix_list(&b);
+    return ret;
+}
+
 int cmd_diff(int argc, char** argv) {
     const char *hash1, *hash2;
-    float *emb1 = NULL, *emb2 = NULL;
+    void *emb1 = NULL, *emb2 = NULL;
     size_t dims1 = 0, dims2 = 0;
+    eb_dtype_t dtype1 = EB_FLOAT32, dtype2 = EB_FLOAT32;
+    float norm1 = -1.0f, norm2 = -1.0f;
     float cos_similarity, euc_distance, euc_similarity;
     int ret = 1;
     bool is_test = getenv("EB_TEST_MODE") != NULL;
@@ -1218,12 +1352,27 @@ int cmd_diff(int argc, char** argv) {
     
     DEBUG_PRINT("Starting diff command with %d arguments", argc);
     
+    if (has_option(argc, argv, "--matrix"))
+        return diff_matrix(argc, argv);
+
     // Check for help option
     if (argc < 2 || has_option(argc, argv, "-h") || has_option(argc, argv, "--help")) {
         printf("%s", DIFF_USAGE);
         return (argc < 2) ? 1 : 0;
     }
     
+    // Parse --dims flag (compare a dimension prefix only)
+    const char* dims_str = get_option_value(argc, argv, NULL, "--dims");
+    size_t prefix_dims = 0;
+    if (dims_str) {
+        char* end = NULL;
+        prefix_dims = strtoul(dims_str, &end, 10);
+        if (!*dims_str || *end || *dims_str == '-' || prefix_dims == 0) {
+            cli_error("Invalid dimensions value: %s", dims_str);
+            return 1;
+        }
+    }
+    
     // Parse --models flag
     const char* models_str = get_option_value(argc, argv, NULL, "--models");
     // Parse --model flag (shorthand for single model use)
@@ -1231,6 +1380,7 @@ int cmd_diff(int argc, char** argv) {
     
     char* models_copy = NULL;
     char* model1 = NULL;
+    char config_model[MODEL_NAME_MAX];
     char* model2 = NULL;
     
     // If both options are provided, prioritize --models and warn the user
@@ -1249,8 +1399,9 @@ int cmd_diff(int argc, char** argv) {
             return 1;
         }
         
-        model1 = strtok(models_copy, ",");
-        model2 = strtok(NULL, ",");
+        char* save = NULL;
+        model1 = strtok_r(models_copy, ",", &save);
+        model2 = strtok_r(NULL, ",", &save);
         
         // If only one model specified, use it for both inputs
         if (!model2) {
@@ -1286,7 +1437,7 @@ int cmd_diff(int argc, char** argv) {
         opts.second_model = NULL;
     } else {
         // Try to get default model from config
-        char* default_model = get_default_model();
+        char* default_model = get_default_model(config_model);
         if (default_model) {
             model1 = model2 = default_model;
             DEBUG_PRINT("Using default model from config: %s", default_model);
@@ -1327,7 +1478,7 @@ int cmd_diff(int argc, char** argv) {
     }
     
     /* Load embeddings */
-    emb1 = load_embedding_with_model(hash1, model1, &dims1);
+    emb1 = load_embedding_with_model(hash1, model1, &dims1, &dtype1, &norm1);
     if (!emb1) {
         cli_error("Failed to load embedding for %s", hash1);
         free(models_copy);
@@ -1338,7 +1489,7 @@ int cmd_diff(int argc, char** argv) {
     }
     
     if (hash2) {
-        emb2 = load_embedding_with_model(hash2, model2, &dims2);
+        emb2 = load_embedding_with_model(hash2, model2, &dims2, &dtype2, &norm2);
     } else {
         // TODO: Implement historical comparison with model
         cli_error("Historical comparison not yet implemented");
@@ -1360,13 +1511,25 @@ int cmd_diff(int argc, char** argv) {
         return 1;
     }
     
+    // Different models are compared through a fitted projection when there is one
+    const eb_projection_t *projection = NULL;
+    if (model1 && model2 && strcmp(model1, model2) != 0) {
+        char *repo_root = find_repo_root(".");
+        if (repo_root) {
+            eb_projection_get(repo_root, model1, model2, &projection);
+            free(repo_root);
+        }
+    }
+    
     // Check dimensions match
-    if (dims1 != dims2) {
+    if (dims1 != dims2 && !projection) {
         cli_error("Embedding dimensions do not match: %zu != %zu", dims1, dims2);
         cli_info("This can happen when comparing embeddings from different models");
         if (model1 && model2 && strcmp(model1, model2) != 0) {
             cli_info("You're comparing %s (%zu dims) with %s (%zu dims)", 
                     model1, dims1, model2, dims2);
+            cli_info("Run 'embr model fit %s %s' to compare them in a shared space",
+                    model1, model2);
         }
         free(emb1);
         free(emb2);
@@ -1378,7 +1541,9 @@ int cmd_diff(int argc, char** argv) {
     }
     
     // Check for invalid values
-    if (check_invalid_values(emb1, dims1) || check_invalid_values(emb2, dims2)) {
+    // Reduced dtypes are checked by the kernels, whose sums turn non-finite
+    if ((dtype1 == EB_FLOAT32 && check_invalid_values(emb1, dims1)) ||
+        (dtype2 == EB_FLOAT32 && check_invalid_values(emb2, dims2))) {
         cli_error("Invalid embedding values detected");
         free(emb1);
         free(emb2);
@@ -1389,12 +1554,52 @@ int cmd_diff(int argc, char** argv) {
         return 1;
     }
     
-    // Calculate similarity metrics
-    cos_similarity = cosine_similarity(emb1, emb2, dims1);
-    euc_distance = euclidean_distance(emb1, emb2, dims1);
+    // Calculate similarity metrics on the vectors as stored
+    eb_vector_ref_t ref1, ref2;
+    vector_ref(emb1, dims1, dtype1, &ref1);
+    vector_ref(emb2, dims2, dtype2, &ref2);
+    ref1.norm = norm1;  // Stored norms spare cosine_similarity() a pass
+    ref2.norm = norm2;
+    float *shared = NULL;
+    if (projection && !project_pair(projection, &ref1, &ref2, &shared)) {
+        free(emb1);
+        free(emb2);
+        free(models_copy);
+        if (opts.second_model) {
+            free((void*)opts.second_model);
+        }
+        return 1;
+    }
+    size_t full_dims = ref1.dims;
+    bool screened = !projection && prefix_dims > 0 && prefix_dims < full_dims;
+    if (screened) {
+        // The prefixes give the angle, the stored norms the length of each vector
+        eb_vector_ref_t full1 = ref1, full2 = ref2;
+        eb_vector_ref_prefix(&full1, prefix_dims, &ref1);
+        eb_vector_ref_prefix(&full2, prefix_dims, &ref2);
+        cos_similarity = cosine_similarity(&ref1, &ref2);
+        float len1 = full1.norm >= 0.0f ? full1.norm : eb_vector_norm(&full1);
+        float len2 = full2.norm >= 0.0f ? full2.norm : eb_vector_norm(&full2);
+        float sum = len1 * len1 + len2 * len2 - 2.0f * len1 * len2 * cos_similarity;
+        euc_distance = sqrtf(sum > 0.0f ? sum : 0.0f);
+    } else {
+        cos_similarity = cosine_similarity(&ref1, &ref2);
+        euc_distance = euclidean_distance(&ref1, &ref2);
+    }
     euc_similarity = 1.0f / (1.0f + euc_distance);  // Convert to similarity
     
+    free(shared);
+    
     // Print results
+    if (projection && !is_test) {
+        eb_projection_info_t info;
+        eb_projection_describe(projection, &info);
+        printf("Compared in a %zu-dimensional projection (fit cosine %.4f)\n",
+               info.dims, info.fit_cosine);
+    }
+    if (screened && !is_test) {
+        printf("Compared on the first %zu of %zu dimensions\n", prefix_dims, full_dims);
+    }
     if (is_test) {
         // Machine-readable output for tests
         printf("%.6f,%.6f,%.6f\n", cos_similarity, euc_distance, euc_similarity);
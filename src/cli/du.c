@@ -0,0 +1,314 @@
+/*
+ * EmbeddingBridge - Du CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cli.h"
+#include "../core/du.h"
+#include "../core/gc.h"
+#include "../core/json_vector.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+/* Source files listed unless --files says otherwise */
+#define DEFAULT_FILES 10
+
+static const char* DU_USAGE =
+    "usage: embr du [options]\n"
+    "\n"
+    "Show where the repository's storage goes\n"
+    "\n"
+    "Reads the header of every loose and packed object, in parallel, but\n"
+    "none of the vectors, and reports:\n"
+    "  - stored and raw (uncompressed) bytes, loose and packed\n"
+    "  - how well vector objects compress, and how many are deltas\n"
+    "  - per set, what its index holds now and what its log ever recorded\n"
+    "  - per model, and the source files taking the most space\n"
+    "  - how many versions the source files have\n"
+    "  - what `embr gc` with the same --prune could reclaim\n"
+    "\n"
+    "An object stored both loose and packed counts once for each copy.\n"
+    "Sets, models and files count an object once, with all its copies.\n"
+    "\n"
+    "Options:\n"
+    "  -j, --jobs <n>         Read headers on n threads (default: one per CPU)\n"
+    "  --files <n>            List the n largest source files (default: 10, 0 for all)\n"
+    "  --prune <date>         Count unreferenced objects older than date as\n"
+    "                         reclaimable (default: 2.weeks.ago)\n"
+    "  --json                 Print a machine-readable report on stdout\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr du\n"
+    "  embr du --files 50 --prune now\n"
+    "  embr du --json > footprint.json\n";
+
+static const char* format_size(uint64_t bytes, char* out, size_t size) {
+    static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = (double)bytes;
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024.0;
+        unit++;
+    }
+    if (unit == 0)
+        snprintf(out, size, "%llu B", (unsigned long long)bytes);
+    else
+        snprintf(out, size, "%.1f %s", value, units[unit]);
+    return out;
+}
+
+static void print_usage_row(const char* name, const eb_du_usage_t* usage) {
+    char stored[32], raw[32];
+    printf("  %-14s %10zu %12s %12s\n", name, usage->objects,
+           format_size(usage->stored_bytes, stored, sizeof(stored)),
+           format_size(usage->raw_bytes, raw, sizeof(raw)));
+}
+
+static void print_table(const eb_du_report_t* report, const char* prune) {
+    char a[32], b[32];
+    printf("  %-14s %10s %12s %12s\n", "Objects", "Count", "Stored", "Raw");
+    print_usage_row("total", &report->total);
+    print_usage_row("loose", &report->loose);
+    print_usage_row("packed", &report->packed);
+    print_usage_row("compressed", &report->compressed);
+    print_usage_row("deltas", &report->deltas);
+    if (report->marked) {
+        print_usage_row("unreferenced", &report->unreferenced);
+        print_usage_row("reclaimable", &report->reclaimable);
+    }
+    printf("\n%zu packs, %s in .meta sidecars", report->packs,
+           format_size(report->meta_bytes, a, sizeof(a)));
+    if (report->unreadable)
+        printf(", %zu objects unreadable", report->unreadable);
+    if (report->marked)
+        printf("; gc --prune=%s would reclaim %s\n", prune,
+               format_size(report->reclaimable.stored_bytes, b, sizeof(b)));
+    else
+        printf("; the references could not all be read, so nothing counts as reclaimable\n");
+
+    size_t ratios = 0;
+    for (size_t i = 0; i < EB_DU_RATIO_BUCKETS; i++)
+        ratios += report->ratios[i];
+    if (ratios) {
+        printf("\n  %-14s %10s\n", "Stored/raw", "Vectors");
+        for (size_t i = 0; i < EB_DU_RATIO_BUCKETS; i++) {
+            char range[16];
+            if (i + 1 < EB_DU_RATIO_BUCKETS)
+                snprintf(range, sizeof(range), "%.1f-%.1f", i / 10.0, (i + 1) / 10.0);
+            else
+                snprintf(range, sizeof(range), ">= 1.0");
+            printf("  %-14s %10zu %5.1f%%\n", range, report->ratios[i],
+                   100.0 * report->ratios[i] / ratios);
+        }
+    }
+
+    if (report->set_count) {
+        printf("\n  %-20s %10s %12s %12s %8s %9s\n", "Set", "Objects", "Now", "Ever", "Sources",
+               "Versions");
+        for (size_t i = 0; i < report->set_count; i++) {
+            const eb_du_set_t* set = &report->sets[i];
+            printf("  %-20s %10zu %12s %12s %8zu %9zu\n", set->name, set->current.objects,
+                   format_size(set->current.stored_bytes, a, sizeof(a)),
+                   format_size(set->history.stored_bytes, b, sizeof(b)), set->sources,
+                   set->versions);
+        }
+    }
+
+    if (report->model_count) {
+        printf("\n  %-20s %10s %12s %12s\n", "Model", "Objects", "Stored", "Raw");
+        for (size_t i = 0; i < report->model_count; i++) {
+            const eb_du_model_t* model = &report->models[i];
+            printf("  %-20s %10zu %12s %12s\n", *model->name ? model->name : "(none)",
+                   model->usage.objects, format_size(model->usage.stored_bytes, a, sizeof(a)),
+                   format_size(model->usage.raw_bytes, b, sizeof(b)));
+        }
+    }
+
+    size_t files = 0;
+    for (size_t i = 0; i < EB_DU_VERSION_BUCKETS; i++)
+        files += report->versions[i];
+    if (files) {
+        printf("\n  %-14s %10s\n", "Versions", "Files");
+        for (size_t i = 0; i < EB_DU_VERSION_BUCKETS; i++) {
+            char range[16];
+            size_t low = eb_du_version_bucket_min(i);
+            if (i + 1 == EB_DU_VERSION_BUCKETS)
+                snprintf(range, sizeof(range), "%zu+", low);
+            else if (eb_du_version_bucket_min(i + 1) - 1 == low)
+                snprintf(range, sizeof(range), "%zu", low);
+            else
+                snprintf(range, sizeof(range), "%zu-%zu", low, eb_du_version_bucket_min(i + 1) - 1);
+            printf("  %-14s %10zu\n", range, report->versions[i]);
+        }
+    }
+
+    if (report->file_count) {
+        printf("\n  %12s %9s  %s\n", "Stored", "Versions", "Largest files");
+        for (size_t i = 0; i < report->file_count; i++) {
+            const eb_du_file_t* file = &report->files[i];
+            printf("  %12s %9zu  %s\n", format_size(file->usage.stored_bytes, a, sizeof(a)),
+                   file->versions, file->source);
+        }
+    }
+}
+
+static void print_json_string(const char* value) {
+    char* escaped = malloc(6 * strlen(value) + 1);
+    if (!escaped) {
+        fputs("\"\"", stdout);
+        return;
+    }
+    size_t n = eb_json_escape(value, escaped);
+    printf("\"%.*s\"", (int)n, escaped);
+    free(escaped);
+}
+
+static void print_json_usage(const char* key, const eb_du_usage_t* usage) {
+    printf("\"%s\":{\"objects\":%zu,\"stored_bytes\":%llu,\"raw_bytes\":%llu}", key,
+           usage->objects, (unsigned long long)usage->stored_bytes,
+           (unsigned long long)usage->raw_bytes);
+}
+
+static void print_json(const eb_du_report_t* report, const char* prune) {
+    putchar('{');
+    print_json_usage("total", &report->total);
+    putchar(',');
+    print_json_usage("loose", &report->loose);
+    putchar(',');
+    print_json_usage("packed", &report->packed);
+    putchar(',');
+    print_json_usage("compressed", &report->compressed);
+    putchar(',');
+    print_json_usage("deltas", &report->deltas);
+    if (report->marked) {
+        putchar(',');
+        print_json_usage("unreferenced", &report->unreferenced);
+        putchar(',');
+        print_json_usage("reclaimable", &report->reclaimable);
+        fputs(",\"prune\":", stdout);
+        print_json_string(prune);
+    }
+    printf(",\"meta_bytes\":%llu,\"packs\":%zu,\"unreadable\":%zu,\"ratios\":[",
+           (unsigned long long)report->meta_bytes, report->packs, report->unreadable);
+    for (size_t i = 0; i < EB_DU_RATIO_BUCKETS; i++)
+        printf("%s%zu", i ? "," : "", report->ratios[i]);
+    fputs("],\"versions\":[", stdout);
+    for (size_t i = 0; i < EB_DU_VERSION_BUCKETS; i++)
+        printf("%s{\"min\":%zu,\"files\":%zu}", i ? "," : "", eb_du_version_bucket_min(i),
+               report->versions[i]);
+
+    fputs("],\"sets\":[", stdout);
+    for (size_t i = 0; i < report->set_count; i++) {
+        const eb_du_set_t* set = &report->sets[i];
+        fputs(i ? ",{\"name\":" : "{\"name\":", stdout);
+        print_json_string(set->name);
+        putchar(',');
+        print_json_usage("current", &set->current);
+        putchar(',');
+        print_json_usage("history", &set->history);
+        printf(",\"sources\":%zu,\"versions\":%zu}", set->sources, set->versions);
+    }
+    fputs("],\"models\":[", stdout);
+    for (size_t i = 0; i < report->model_count; i++) {
+        fputs(i ? ",{\"name\":" : "{\"name\":", stdout);
+        print_json_string(report->models[i].name);
+        putchar(',');
+        print_json_usage("usage", &report->models[i].usage);
+        putchar('}');
+    }
+    fputs("],\"files\":[", stdout);
+    for (size_t i = 0; i < report->file_count; i++) {
+        fputs(i ? ",{\"source\":" : "{\"source\":", stdout);
+        print_json_string(report->files[i].source);
+        printf(",\"versions\":%zu,", report->files[i].versions);
+        print_json_usage("usage", &report->files[i].usage);
+        putchar('}');
+    }
+    puts("]}");
+}
+
+int cmd_du(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", DU_USAGE);
+        return 0;
+    }
+
+    eb_du_options_t options = { .max_files = DEFAULT_FILES };
+    const char* prune = NULL;
+    bool json = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+            char* end = NULL;
+            long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+            if (!end || *end != '\0' || value < 1 || value > 1024) {
+                cli_error("--jobs takes a number between 1 and 1024");
+                return 1;
+            }
+            options.threads = (unsigned)value;
+            i++;
+        } else if (strcmp(argv[i], "--files") == 0) {
+            char* end = NULL;
+            long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+            if (!end || *end != '\0' || value < 0) {
+                cli_error("--files takes a number, 0 for all");
+                return 1;
+            }
+            options.max_files = (size_t)value;
+            i++;
+        } else if (strcmp(argv[i], "--prune") == 0) {
+            if (i + 1 >= argc) {
+                cli_error("--prune takes a date, such as 2.weeks.ago, now or never");
+                return 1;
+            }
+            prune = argv[++i];
+        } else if (strncmp(argv[i], "--prune=", 8) == 0) {
+            prune = argv[i] + 8;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            cli_error("Unknown option: %s", argv[i]);
+            printf("%s", DU_USAGE);
+            return 1;
+        }
+    }
+
+    // "never" leaves the expiry at 0, so nothing is reclaimable
+    int expire = gc_resolve_expire(prune, &options.expire);
+    if (expire < 0) {
+        cli_error("Invalid --prune date: %s", prune);
+        return 1;
+    }
+    if (expire > 0)
+        options.expire = 0;
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+    eb_du_report_t report;
+    eb_status_t status = eb_du(repo_root, &options, &report);
+    free(repo_root);
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to measure the repository");
+        return 1;
+    }
+
+    if (!prune)
+        prune = "2.weeks.ago";
+    if (json)
+        print_json(&report, prune);
+    else
+        print_table(&report, prune);
+    eb_du_report_free(&report);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * EmbeddingBridge - Fsck CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cli.h"
+#include "../core/fsck.h"
+#include "../core/remote.h"
+#include "../core/json_vector.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+static const char* FSCK_USAGE =
+    "usage: embr fsck [options]\n"
+    "\n"
+    "Verify the integrity of the repository\n"
+    "\n"
+    "Every loose and packed object is decompressed and rehashed, and must\n"
+    "carry the hash it is stored under. Every hash the sets reference\n"
+    "(indexes, logs, model refs, delta bases) must be stored. Objects are\n"
+    "checked in parallel. Exits with status 1 if anything is wrong.\n"
+    "\n"
+    "Options:\n"
+    "  -j, --jobs <n>         Check objects on n threads (default: one per CPU)\n"
+    "  --remote <name>        Also check that the remote holds every entry of\n"
+    "                         each set pushed to it\n"
+    "  --json                 Print a machine-readable report on stdout\n"
+    "  -q, --quiet            Only report problems\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr fsck\n"
+    "  embr fsck --jobs 16 --remote origin\n"
+    "  embr fsck --json > report.json\n";
+
+/* Progress on stderr, redrawn in place */
+static void show_progress(void* ctx, size_t done, size_t total) {
+    (void)ctx;
+    fprintf(stderr, "\rChecking objects: %3zu%% (%zu/%zu)", total ? done * 100 / total : 100,
+            done, total);
+    if (done == total)
+        fputc('\n', stderr);
+}
+
+static void print_json_string(const char* value) {
+    char* escaped = malloc(6 * strlen(value) + 1);
+    if (!escaped) {
+        fputs("\"\"", stdout);
+        return;
+    }
+    size_t n = eb_json_escape(value, escaped);
+    printf("\"%.*s\"", (int)n, escaped);
+    free(escaped);
+}
+
+static void print_json(const eb_fsck_report_t* report, const char* remote, double seconds) {
+    printf("{\"loose\":%zu,\"packed\":%zu,\"bytes\":%llu,\"references\":%zu,\"sets\":%zu,",
+           report->loose, report->packed, (unsigned long long)report->bytes, report->references,
+           report->sets);
+    if (remote) {
+        fputs("\"remote\":", stdout);
+        print_json_string(remote);
+        printf(",\"remote_sets\":%zu,", report->remote_sets);
+    }
+    printf("\"corrupt\":%zu,\"misnamed\":%zu,\"missing\":%zu,\"remote_missing\":%zu,",
+           report->counts[EB_FSCK_CORRUPT], report->counts[EB_FSCK_MISNAMED],
+           report->counts[EB_FSCK_MISSING], report->counts[EB_FSCK_REMOTE_MISSING]);
+    printf("\"seconds\":%.3f,\"problems\":[", seconds);
+    for (size_t i = 0; i < report->problem_count; i++) {
+        const eb_fsck_problem_t* p = &report->problems[i];
+        printf("%s{\"kind\":\"%s\",\"hash\":\"%s\",\"where\":", i ? "," : "",
+               eb_fsck_kind_name(p->kind), p->hash);
+        print_json_string(p->where);
+        if (p->status != EB_SUCCESS)
+            printf(",\"error\":\"%s\"", eb_status_str(p->status));
+        putchar('}');
+    }
+    puts("]}");
+}
+
+static void print_problems(const eb_fsck_report_t* report) {
+    for (size_t i = 0; i < report->problem_count; i++) {
+        const eb_fsck_problem_t* p = &report->problems[i];
+        if (p->status != EB_SUCCESS)
+            printf("%s %s %s (%s)\n", eb_fsck_kind_name(p->kind), p->hash, p->where,
+                   eb_status_str(p->status));
+        else
+            printf("%s %s %s\n", eb_fsck_kind_name(p->kind), p->hash, p->where);
+    }
+}
+
+int cmd_fsck(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", FSCK_USAGE);
+        return 0;
+    }
+
+    eb_fsck_options_t options = {0};
+    bool json = false;
+    bool quiet = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+            char* end = NULL;
+            long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+            if (!end || *end != '\0' || value < 1 || value > 1024) {
+                cli_error("--jobs takes a number between 1 and 1024");
+                return 1;
+            }
+            options.threads = (unsigned)value;
+            i++;
+        } else if (strcmp(argv[i], "--remote") == 0) {
+            if (i + 1 >= argc) {
+                cli_error("--remote takes a remote name");
+                return 1;
+            }
+            options.remote = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else {
+            cli_error("Unknown option: %s", argv[i]);
+            printf("%s", FSCK_USAGE);
+            return 1;
+        }
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+    if (options.remote && eb_remote_init() != EB_SUCCESS) {
+        cli_error("Failed to initialize remote subsystem");
+        free(repo_root);
+        return 1;
+    }
+    if (!quiet && !json && isatty(STDERR_FILENO))
+        options.progress = show_progress;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    eb_fsck_report_t report;
+    eb_status_t status = eb_fsck(repo_root, &options, &report);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    free(repo_root);
+
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Integrity check failed");
+        eb_fsck_report_free(&report);
+        return 1;
+    }
+
+    if (json) {
+        print_json(&report, options.remote, seconds);
+    } else {
+        print_problems(&report);
+        if (!quiet) {
+            printf("Checked %zu objects (%zu loose, %zu packed, %llu bytes) and %zu references in %zu sets",
+                   report.loose + report.packed, report.loose, report.packed,
+                   (unsigned long long)report.bytes, report.references, report.sets);
+            if (options.remote)
+                printf(", %zu of them on '%s'", report.remote_sets, options.remote);
+            printf(" in %.1fs: %zu problems\n", seconds, report.problem_count);
+        }
+    }
+    int result = report.problem_count ? 1 : 0;
+    eb_fsck_report_free(&report);
+    return result;
+}
@@ -26,6 +26,9 @@ static const char* GC_USAGE =
     "  -f, --force            Force running garbage collection\n"
     "  --prune[=<date>]       Prune unreferenced objects older than date (default: 2.weeks.ago)\n"
     "  --no-prune             Don't prune any unreferenced objects\n"
+    "  --aggressive           Also repack all remaining objects into one pack\n"
+    "  --incremental          Sweep for a bounded time and resume on the next run\n"
+    "  --slice <seconds>      Time an incremental run may sweep (default: 10, 0 = finish)\n"
     "  -v, --verbose          Report pruned objects\n"
     "  -q, --quiet            Suppress all output\n"
     "  -h, --help             Show this help message\n"
@@ -34,11 +37,15 @@ static const char* GC_USAGE =
     "  embr gc                    # Run standard garbage collection\n"
     "  embr gc --prune=now        # Remove all unreferenced objects\n"
     "  embr gc --no-prune         # Don't remove any unreferenced objects\n"
-    "  embr gc -n                 # Show what would be removed without removing\n";
+    "  embr gc -n                 # Show what would be removed without removing\n"
+    "  embr gc --incremental      # Sweep for 10 seconds, e.g. from cron\n";
 
 /* Default grace period for unreferenced objects (2 weeks) */
 #define DEFAULT_PRUNE_EXPIRE_SECONDS (14 * 24 * 60 * 60)
 
+/* Default sweep time of an incremental run */
+#define DEFAULT_SLICE_SECONDS 10
+
 int cmd_gc(int argc, char** argv) {
     /* Check for help flag */
     if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
@@ -52,6 +59,13 @@ int cmd_gc(int argc, char** argv) {
     bool verbose = has_option(argc, argv, "--verbose") || has_option(argc, argv, "-v");
     bool force = has_option(argc, argv, "--force") || has_option(argc, argv, "-f");
     bool no_prune = has_option(argc, argv, "--no-prune");
+    bool aggressive = has_option(argc, argv, "--aggressive");
+    bool incremental = has_option(argc, argv, "--incremental");
+    int slice = get_int_option(argc, argv, NULL, "--slice", DEFAULT_SLICE_SECONDS);
+    if (slice < 0) {
+        cli_error("--slice must not be negative");
+        return 1;
+    }
     
     /* Get prune expiration time or set to NULL if --no-prune */
     const char* prune_expire = no_prune ? "never" : get_option_value(argc, argv, NULL, "--prune");
@@ -116,7 +130,10 @@ int cmd_gc(int argc, char** argv) {
     }
     
     /* Run the actual garbage collection */
-    status = gc_run(prune_expire, false, &result);
+    if (incremental)
+        status = gc_run_incremental(prune_expire, (unsigned)slice, &result);
+    else
+        status = gc_run(prune_expire, aggressive, &result);
     
     if (status != EB_SUCCESS) {
         handle_error(status, "Garbage collection failed");
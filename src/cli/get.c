@@ -17,7 +17,6 @@
 #include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
-#include <dirent.h>  /* For directory operations: opendir, readdir, closedir */
 
 #include "cli.h"
 #include "git_types.h"
@@ -25,9 +24,11 @@
 #include "config.h"
 #include "debug.h"
 #include "remote.h"
+#include "../core/object_path.h"
+#include "../core/remote_cache.h"
+#include "../core/remote_prefetch.h"
 #include "set.h"              // For get_current_set
 #include "../core/path_utils.h" // For find_repo_root
-#include "../core/parquet_transformer.h" // For eb_parquet_extract_metadata_json
 // TODO: Add the correct header for extract_file_type_from_parquet
 // #include "parquet_transform.h" // For extract_file_type_from_parquet
 
@@ -37,11 +38,13 @@
 #endif
 
 static void print_usage(void) {
-    printf("Usage: embr get [-h] [-f] [-v] [-q] <output_directory> <hash>\n\n");
-    printf("Download an embedding file by hash to local destination\n\n");
+    printf("Usage: embr get [-h] [-f] [-v] [-q] <output_directory> <hash>...\n\n");
+    printf("Download embedding files by hash to local destination\n\n");
     printf("Arguments:\n");
-    printf("  output_directory  Directory where the embedding will be saved\n");
-    printf("  hash              Hash or short hash of the embedding to download\n\n");
+    printf("  output_directory  Directory where the embeddings will be saved\n");
+    printf("  hash              Hash or short hash of an embedding to download; objects\n");
+    printf("                    of later full hashes are fetched while earlier ones are\n");
+    printf("                    copied (storage.prefetch_window ahead)\n\n");
     printf("Options:\n");
     printf("  -f, --force              Force download even if file exists\n");
     printf("  -v, --verbose            Show detailed output\n");
@@ -89,57 +92,6 @@ static bool read_metadata(const char *meta_path, char *source_file, char *file_t
     return found_source && found_type;
 }
 
-/*
- * Attempt to resolve a short hash to a full hash in local repository
- */
-static bool resolve_hash(const char *repo_path, const char *short_hash, char *full_hash, size_t hash_size) {
-    char objects_dir[PATH_MAX];
-    snprintf(objects_dir, sizeof(objects_dir), "%s/.embr/objects", repo_path);
-    
-    DIR *dir = opendir(objects_dir);
-    if (!dir) return false;
-    
-    size_t hash_len = strlen(short_hash);
-    bool found = false;
-    
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // Skip non-regular files via stat()
-        {
-            char fullpath[PATH_MAX];
-            snprintf(fullpath, sizeof(fullpath), "%s/%s", objects_dir, entry->d_name);
-            struct stat st;
-            if (stat(fullpath, &st) != 0 || !S_ISREG(st.st_mode))
-                continue;
-        }
-        // Only look at .raw or .meta files
-        char namebuf[PATH_MAX];
-        strncpy(namebuf, entry->d_name, sizeof(namebuf));
-        namebuf[sizeof(namebuf)-1] = '\0';
-        char *ext = strrchr(namebuf, '.');
-        if (ext && (strcmp(ext, ".raw") == 0 || strcmp(ext, ".meta") == 0)) {
-            *ext = '\0';
-            // Debug print
-            DEBUG_INFO("resolve_hash: namebuf='%s', short_hash='%s', hash_len=%zu", namebuf, short_hash, hash_len);
-            int cmp = strncmp(namebuf, short_hash, hash_len);
-            DEBUG_INFO("resolve_hash: strncmp result = %d", cmp);
-            if (cmp == 0) {
-                if (found) {
-                    // Hash is ambiguous (multiple matches)
-                    closedir(dir);
-                    return false;
-                }
-                strncpy(full_hash, namebuf, hash_size - 1);
-                full_hash[hash_size - 1] = '\0';
-                found = true;
-            }
-        }
-    }
-    
-    closedir(dir);
-    return found;
-}
-
 /*
  * Check local repositories for the hash
  */
@@ -169,8 +121,8 @@ static bool find_local_hash(const char *hash, char *full_hash, char *repo_path,
         return false;
     }
     // Path to metadata and object files
-    snprintf(meta_path, PATH_MAX, "%s/.embr/objects/%s.meta", cwd, resolved_hash);
-    snprintf(object_path, PATH_MAX, "%s/.embr/objects/%s.raw", cwd, resolved_hash);
+    eb_object_path(cwd, resolved_hash, "meta", meta_path, PATH_MAX);
+    eb_object_path(cwd, resolved_hash, "raw", object_path, PATH_MAX);
     // Debug prints
     DEBUG_INFO("find_local_hash: resolved_hash='%s'", resolved_hash);
     DEBUG_INFO("find_local_hash: local_meta='%s'", meta_path);
@@ -190,11 +142,11 @@ static bool find_local_hash(const char *hash, char *full_hash, char *repo_path,
 }
 
 /*
- * Check remote repositories for the hash
+ * Resolve a hash against the remotes and make sure its object is cached
  */
-static bool find_remote_hash(const char *hash, char *full_hash, char *temp_meta_path, char *temp_object_path) {
+static bool fetch_remote_hash(const char *repo_root, const char *hash, char *full_hash) {
     eb_status_t status;
-    // Initialize remote subsystem
+    // Initialize remote subsystem; cmd_get() shuts it down
     status = eb_remote_init();
     if (status != EB_SUCCESS) {
         return false;
@@ -204,7 +156,6 @@ static bool find_remote_hash(const char *hash, char *full_hash, char *temp_meta_
     int rem_count = 0;
     status = eb_remote_list(&remotes, &rem_count);
     if (status != EB_SUCCESS || rem_count == 0) {
-        eb_remote_shutdown();
         return false;
     }
     // Get current set name
@@ -212,7 +163,6 @@ static bool find_remote_hash(const char *hash, char *full_hash, char *temp_meta_
     if (get_current_set(set_name, sizeof(set_name)) != EB_SUCCESS || set_name[0] == '\0') {
         for (int i = 0; i < rem_count; i++) free(remotes[i]);
         free(remotes);
-        eb_remote_shutdown();
         return false;
     }
     // Resolve full hash if short
@@ -242,7 +192,6 @@ static bool find_remote_hash(const char *hash, char *full_hash, char *temp_meta_
                         free(files);
                         for (int k = 0; k < rem_count; k++) free(remotes[k]);
                         free(remotes);
-                        eb_remote_shutdown();
                         return false;
                     }
                     strncpy(resolved_hash, base, name_len);
@@ -258,139 +207,46 @@ static bool find_remote_hash(const char *hash, char *full_hash, char *temp_meta_
     if (!hash_resolved) {
         for (int i = 0; i < rem_count; i++) free(remotes[i]);
         free(remotes);
-        eb_remote_shutdown();
         return false;
     }
     strncpy(full_hash, resolved_hash, 64);
     full_hash[64] = '\0';
-    bool downloaded = false;
-    for (int i = 0; i < rem_count; i++) {
-        char remote_parquet[PATH_MAX];
-        snprintf(remote_parquet, sizeof(remote_parquet), "sets/%s/documents/%s.parquet", set_name, resolved_hash);
-        void *parquet_data = NULL;
-        size_t parquet_size = 0;
-        status = eb_remote_pull(remotes[i], remote_parquet, &parquet_data, &parquet_size);
-        if (status != EB_SUCCESS || !parquet_data) continue;
-        char parquet_template[] = "/tmp/embr_parquet_XXXXXX";
-        int fd_parquet = mkstemp(parquet_template);
-        if (fd_parquet < 0) {
-            free(parquet_data);
-            continue;
-        }
-        if (write(fd_parquet, parquet_data, parquet_size) != (ssize_t)parquet_size) {
-            close(fd_parquet);
-            free(parquet_data);
-            continue;
-        }
-        close(fd_parquet);
-
-        // Set raw output path to the Parquet temp file before inverse-transform
-        strncpy(temp_object_path, parquet_template, PATH_MAX);
-
-        // Inverse-transform Parquet to .raw
-        eb_transformer_t *transformer = eb_find_transformer_by_format("parquet");
-        if (transformer) {
-            void *original_data = NULL;
-            size_t original_size = 0;
-            eb_status_t inv_status = eb_inverse_transform(transformer, parquet_data, parquet_size, &original_data, &original_size);
-
-            if (inv_status == EB_SUCCESS && original_data) {
-                FILE *raw_fp = fopen(temp_object_path, "wb");
-                if (raw_fp) {
-                    fwrite(original_data, 1, original_size, raw_fp);
-                    fclose(raw_fp);
-                }
-                free(original_data);
-            }
-        }
-
-        // Prepare a temporary metadata file for downstream parsing
-        char meta_template[] = "/tmp/embr_meta_XXXXXX";
-        int fd_meta = mkstemp(meta_template);
-        if (fd_meta < 0) {
-            unlink(parquet_template);
-            free(parquet_data);
-            continue;
-        }
-        close(fd_meta);
-        strncpy(temp_meta_path, meta_template, PATH_MAX);
-
-        // Extract metadata JSON from the Parquet buffer
-        char *metadata_json = eb_parquet_extract_metadata_json(parquet_data, parquet_size);
-        free(parquet_data);
-        if (!metadata_json) {
-            unlink(parquet_template);
-            continue;
-        }
-
-        // Parse metadata JSON and convert to key=value format
-        {
-            char source_file_buf[PATH_MAX] = {0};
-            char file_type_buf[32] = {0};
-            char provider_buf[32] = {0};
-            const char *p;
-            // Extract 'source'
-            p = strstr(metadata_json, "\"source\":\"");
-            if (p) {
-                p += strlen("\"source\":\"");
-                const char *q = strchr(p, '"');
-                if (q) {
-                    size_t len = q - p;
-                    if (len >= sizeof(source_file_buf)) len = sizeof(source_file_buf) - 1;
-                    strncpy(source_file_buf, p, len);
-                    source_file_buf[len] = '\0';
-                }
-            }
-            // Extract 'file_type'
-            p = strstr(metadata_json, "\"file_type\":\"");
-            if (p) {
-                p += strlen("\"file_type\":\"");
-                const char *q = strchr(p, '"');
-                if (q) {
-                    size_t len = q - p;
-                    if (len >= sizeof(file_type_buf)) len = sizeof(file_type_buf) - 1;
-                    strncpy(file_type_buf, p, len);
-                    file_type_buf[len] = '\0';
-                }
-            }
-            // Extract 'provider' or fallback to 'model'
-            p = strstr(metadata_json, "\"provider\":\"");
-            if (!p) {
-                p = strstr(metadata_json, "\"model\":\"");
-            }
-            if (p) {
-                if (strstr(p, "\"provider\":\"") == p) {
-                    p += strlen("\"provider\":\"");
-                } else {
-                    p += strlen("\"model\":\"");
-                }
-                const char *q = strchr(p, '"');
-                if (q) {
-                    size_t len = q - p;
-                    if (len >= sizeof(provider_buf)) len = sizeof(provider_buf) - 1;
-                    strncpy(provider_buf, p, len);
-                    provider_buf[len] = '\0';
-                }
-            }
-            FILE *meta_fp2 = fopen(temp_meta_path, "w");
-            if (meta_fp2) {
-                if (source_file_buf[0]) fprintf(meta_fp2, "source_file=%s\n", source_file_buf);
-                if (file_type_buf[0])   fprintf(meta_fp2, "file_type=%s\n", file_type_buf);
-                if (provider_buf[0])    fprintf(meta_fp2, "model=%s\n", provider_buf);
-                fclose(meta_fp2);
-            }
-        }
-        free(metadata_json);
-
-        downloaded = true;
-        break;
+    // A short hash still needs the listing above, but not the download
+    bool downloaded = eb_remote_cache_lookup(repo_root, resolved_hash) == EB_SUCCESS;
+    for (int i = 0; i < rem_count && !downloaded; i++) {
+        downloaded = eb_remote_fetch_object(repo_root, remotes[i], set_name, resolved_hash) == EB_SUCCESS;
     }
     for (int i = 0; i < rem_count; i++) free(remotes[i]);
     free(remotes);
-    eb_remote_shutdown();
     return downloaded;
 }
 
+/*
+ * Check remote repositories for the hash
+ *
+ * Fetched objects are kept in .embr/cache/remote, so a cached full hash is
+ * served without contacting any remote.
+ */
+static bool find_remote_hash(const char *hash, char *full_hash, char *meta_path, char *object_path) {
+    char *repo_root = find_repo_root(".");
+    if (!repo_root) {
+        return false;
+    }
+    bool found;
+    if (strlen(hash) == 64 && eb_remote_cache_lookup(repo_root, hash) == EB_SUCCESS) {
+        strncpy(full_hash, hash, 64);
+        full_hash[64] = '\0';
+        found = true;
+    } else {
+        found = fetch_remote_hash(repo_root, hash, full_hash);
+    }
+    found = found &&
+            eb_remote_cache_path(repo_root, full_hash, "meta", meta_path, PATH_MAX) == EB_SUCCESS &&
+            eb_remote_cache_path(repo_root, full_hash, "raw", object_path, PATH_MAX) == EB_SUCCESS;
+    free(repo_root);
+    return found;
+}
+
 /*
  * Handle getting a file by hash
  */
@@ -422,12 +278,12 @@ static int get_embedding_by_hash(
     bool found_local = find_local_hash(hash, full_hash, repo_path, meta_path, object_path);
     
     // If not found locally, try remote repositories
-    char temp_meta_path[PATH_MAX] = {0};
-    char temp_object_path[PATH_MAX] = {0};
+    char cached_meta_path[PATH_MAX] = {0};
+    char cached_object_path[PATH_MAX] = {0};
     bool found_remote = false;
     
     if (!found_local) {
-        found_remote = find_remote_hash(hash, full_hash, temp_meta_path, temp_object_path);
+        found_remote = find_remote_hash(hash, full_hash, cached_meta_path, cached_object_path);
     }
     
     if (!found_local && !found_remote) {
@@ -436,8 +292,8 @@ static int get_embedding_by_hash(
     }
     
     // Select the correct paths
-    const char *src_meta = found_local ? meta_path : temp_meta_path;
-    const char *src_object = found_local ? object_path : temp_object_path;
+    const char *src_meta = found_local ? meta_path : cached_meta_path;
+    const char *src_object = found_local ? object_path : cached_object_path;
     
     // Read metadata to determine file type and original filename
     char source_file[PATH_MAX] = {0};
@@ -488,15 +344,28 @@ static int get_embedding_by_hash(
         printf("✓ Downloaded embedding to %s\n", final_output);
     }
     
-    // Clean up any temporary files if we used remote repositories
-    if (found_remote) {
-        if (access(temp_meta_path, F_OK) == 0) unlink(temp_meta_path);
-        if (access(temp_object_path, F_OK) == 0) unlink(temp_object_path);
-    }
-    
     return 0;
 }
 
+/*
+ * Read ahead of the hashes of one get; objects that are local already are
+ * skipped and short hashes are left to find_remote_hash()
+ */
+static eb_prefetch_t *start_prefetch(const char **hashes, size_t count) {
+    char *repo_root = find_repo_root(".");
+    if (!repo_root) {
+        return NULL;
+    }
+    char set_name[128] = {0};
+    eb_prefetch_t *prefetch = NULL;
+    if (get_current_set(set_name, sizeof(set_name)) == EB_SUCCESS && set_name[0] != '\0' &&
+        eb_prefetch_start(repo_root, set_name, hashes, count, NULL, &prefetch) != EB_SUCCESS) {
+        prefetch = NULL;
+    }
+    free(repo_root);
+    return prefetch;
+}
+
 /*
  * Implementation of the get command
  */
@@ -507,7 +376,6 @@ int cmd_get(int argc, char **argv) {
         argv++;
     }
     char *dest_dir = NULL;
-    char *hash = NULL;
     bool force = false;
     bool verbose = false;
     bool quiet = false;
@@ -533,21 +401,26 @@ int cmd_get(int argc, char **argv) {
     if (idx < argc) {
         dest_dir = argv[idx++];
     }
-    // Next argument is hash
-    if (idx < argc) {
-        hash = argv[idx++];
-    }
-    // Too many arguments?
-    if (idx < argc) {
-        fprintf(stderr, "Error: Too many arguments\n");
-        print_usage();
-        return 1;
-    }
+    // Remaining arguments are hashes
+    const char **hashes = (const char **)&argv[idx];
+    int hash_count = argc - idx;
     // Missing required arguments?
-    if (!dest_dir || !hash) {
+    if (!dest_dir || hash_count == 0) {
         fprintf(stderr, "Error: Missing required arguments\n");
         print_usage();
         return 1;
     }
-    return get_embedding_by_hash(dest_dir, hash, force, verbose, quiet);
-} 
\ No newline at end of file
+    eb_prefetch_t *prefetch = hash_count > 1 ? start_prefetch(hashes, (size_t)hash_count) : NULL;
+    int status = 0;
+    for (int i = 0; i < hash_count; i++) {
+        if (prefetch) {
+            eb_prefetch_wait(prefetch, (size_t)i);
+        }
+        if (get_embedding_by_hash(dest_dir, hashes[i], force, verbose, quiet) != 0) {
+            status = 1;
+        }
+    }
+    eb_prefetch_stop(prefetch);
+    eb_remote_shutdown();
+    return status;
+}
@@ -0,0 +1,191 @@
+/*
+ * EmbeddingBridge - Import Command Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "cli.h"
+#include "../core/store.h"
+#include "../core/quantize.h"
+
+static const char* IMPORT_USAGE =
+    "Usage: embr import [options] --matrix <matrix> --sources <list>\n"
+    "\n"
+    "Store row i of an N x D matrix as the embedding of the i-th listed file,\n"
+    "writing the objects in parallel and updating the set index once\n"
+    "\n"
+    "Options:\n"
+    "  -x, --matrix <file>   N x D matrix (.npy, .npz or .bin with --dims)\n"
+    "  -s, --sources <file>  Source files, one per line in row order;\n"
+    "                        '-' reads them from standard input\n"
+    "  -m, --model <name>    Model name to record with the embeddings\n"
+    "  -d, --dims <dims>     Values per row of a .bin matrix\n"
+    "  -t, --dtype <type>    Store as float32 (default), fp16, bf16 or int8\n"
+    "  -v, --verbose         List every stored file\n"
+    "  -q, --quiet           Suppress output\n"
+    "  -h, --help            Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr import --matrix vecs.npy --sources paths.txt --model openai-3\n"
+    "  find docs -name '*.txt' | sort | embr import -x vecs.npy -s -\n";
+
+typedef struct {
+    const char* matrix;
+    const char* sources;
+    const char* model;
+    size_t dims;
+    eb_dtype_t dtype;
+    bool verbose;
+    bool quiet;
+} import_context_t;
+
+static int import_option_callback(char short_opt, const char* long_opt, const char* arg, void* ctx) {
+    import_context_t* context = ctx;
+
+    switch (short_opt) {
+        case 'x':
+            context->matrix = arg;
+            break;
+        case 's':
+            context->sources = arg;
+            break;
+        case 'm':
+            context->model = arg;
+            break;
+        case 'd':
+            context->dims = (size_t)atoi(arg);
+            if (context->dims == 0) {
+                fprintf(stderr, "error: Invalid dimensions\n");
+                return 1;
+            }
+            break;
+        case 't':
+            if (eb_dtype_from_name(arg, &context->dtype) != EB_SUCCESS) {
+                fprintf(stderr, "error: Unknown dtype '%s' (expected float32, fp16, bf16 or int8)\n", arg);
+                return 1;
+            }
+            break;
+        case 'v':
+            context->verbose = true;
+            break;
+        case 'q':
+            context->quiet = true;
+            break;
+        default:
+            if (long_opt)
+                fprintf(stderr, "Unknown option: %s\n", long_opt);
+            else
+                fprintf(stderr, "Unknown option: -%c\n", short_opt);
+            return 1;
+    }
+    return 0;
+}
+
+/* The non-empty lines of a list file, in order */
+static int read_sources(const char* list_path, char*** out, size_t* count_out) {
+    FILE* f = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+    if (!f) {
+        cli_error("Cannot open source list '%s': %s", list_path, strerror(errno));
+        return 1;
+    }
+
+    char** sources = NULL;
+    size_t count = 0, capacity = 0;
+    int ret = 0;
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            char** grown = realloc(sources, capacity * sizeof(*sources));
+            if (!grown) {
+                ret = 1;
+                break;
+            }
+            sources = grown;
+        }
+        if (!(sources[count] = strdup(line))) {
+            ret = 1;
+            break;
+        }
+        count++;
+    }
+    free(line);
+    if (f != stdin)
+        fclose(f);
+
+    if (ret) {
+        cli_error("Memory allocation failed");
+        for (size_t i = 0; i < count; i++)
+            free(sources[i]);
+        free(sources);
+        return 1;
+    }
+    *out = sources;
+    *count_out = count;
+    return 0;
+}
+
+int cmd_import(int argc, char** argv) {
+    if (argc < 2 || has_option(argc, argv, "-h") || has_option(argc, argv, "--help")) {
+        printf("%s", IMPORT_USAGE);
+        return argc < 2 ? 1 : 0;
+    }
+
+    import_context_t context = { .dtype = EB_FLOAT32 };
+    const char* short_opts = "x:s:m:d:t:vqh";
+    const char* long_opts[] = {
+        "--matrix",
+        "--sources",
+        "--model",
+        "--dims",
+        "--dtype",
+        "--verbose",
+        "--quiet",
+        "--help",
+        NULL
+    };
+    char* positional[argc];
+    int pos_count = 0;
+    int result = parse_git_style_options(argc, argv, short_opts, long_opts,
+                                         import_option_callback, &context,
+                                         positional, &pos_count);
+    if (result != 0)
+        return result;
+
+    if (pos_count > 0 || !context.matrix || !context.sources) {
+        fprintf(stderr, "error: import takes --matrix and --sources\n");
+        fprintf(stderr, "%s", IMPORT_USAGE);
+        return 1;
+    }
+
+    char** sources;
+    size_t count;
+    if (read_sources(context.sources, &sources, &count) != 0)
+        return 1;
+    if (count == 0) {
+        cli_error("No source files listed in '%s'", context.sources);
+        free(sources);
+        return 1;
+    }
+
+    int ret = store_matrix(context.matrix, sources, count, context.model, context.dims,
+                           context.dtype, context.verbose, context.quiet);
+    for (size_t i = 0; i < count; i++)
+        free(sources[i]);
+    free(sources);
+    return ret;
+}
@@ -0,0 +1,185 @@
+/*
+ * EmbeddingBridge - Index CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cli.h"
+#include "../core/hnsw.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+static const char* INDEX_USAGE =
+    "usage: embr index <command> [options]\n"
+    "\n"
+    "Manage the nearest-neighbor index of the current set\n"
+    "\n"
+    "Commands:\n"
+    "  build                  Build the index over the current vectors\n"
+    "  status                 Show the indexed models\n"
+    "  drop                   Remove the index\n"
+    "\n"
+    "Run 'embr index <command> --help' for command-specific help\n";
+
+static const char* BUILD_USAGE =
+    "usage: embr index build [options]\n"
+    "\n"
+    "Build an HNSW graph per model over the current vectors of the set\n"
+    "\n"
+    "Once built, the index is kept up to date by 'embr store', 'embr rm'\n"
+    "and 'embr rollback', and 'embr search' queries it. Run it again to\n"
+    "rebuild with other parameters.\n"
+    "\n"
+    "Options:\n"
+    "  --model <name>           Only build the graph of this model\n"
+    "  -M <links>               Links per node (default: 16)\n"
+    "  --ef-construction <n>    Candidates considered per insert (default: 200)\n"
+    "  -q, --quiet              Suppress all output\n"
+    "  -h, --help               Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr index build\n"
+    "  embr index build --model openai-3 -M 32\n";
+
+static const char* STATUS_USAGE =
+    "usage: embr index status\n"
+    "\n"
+    "Show the models indexed in the current set\n";
+
+static const char* DROP_USAGE =
+    "usage: embr index drop\n"
+    "\n"
+    "Remove the index of the current set; stores stop maintaining it\n";
+
+static bool parse_u32(const char* value, uint32_t* out) {
+    char* end = NULL;
+    unsigned long n = strtoul(value, &end, 10);
+    if (!value[0] || *end || n == 0 || n > UINT32_MAX)
+        return false;
+    *out = (uint32_t)n;
+    return true;
+}
+
+static int build(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", BUILD_USAGE);
+        return 0;
+    }
+
+    bool quiet = has_option(argc, argv, "--quiet") || has_option(argc, argv, "-q");
+    eb_hnsw_build_options_t options = { get_option_value(argc, argv, NULL, "--model"), 0, 0 };
+
+    const char* m = get_option_value(argc, argv, "-M", NULL);
+    if (m && (!parse_u32(m, &options.m) || options.m < 2 || options.m > EB_HNSW_MAX_M)) {
+        cli_error("Links per node must be between 2 and %d: %s", EB_HNSW_MAX_M, m);
+        return 1;
+    }
+    const char* ef = get_option_value(argc, argv, NULL, "--ef-construction");
+    if (ef && !parse_u32(ef, &options.ef_construction)) {
+        cli_error("Invalid ef-construction: %s", ef);
+        return 1;
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+
+    eb_hnsw_build_result_t result;
+    eb_status_t status = eb_hnsw_build(repo_root, &options, &result);
+    free(repo_root);
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Index build failed");
+        return 1;
+    }
+
+    if (!quiet) {
+        printf("Indexed %zu vectors in %zu model%s\n", result.vectors, result.models,
+               result.models == 1 ? "" : "s");
+        if (result.skipped)
+            cli_warning("Skipped %zu vectors that were unreadable or had other dimensions",
+                        result.skipped);
+    }
+    return 0;
+}
+
+static int print_info(const eb_hnsw_info_t* info, void* ctx) {
+    (void)ctx;
+    printf("%-24s %6u dims  M=%-3u %8zu vectors", *info->model ? info->model : "(none)",
+           info->dims, info->m, info->nodes - info->deleted);
+    if (info->deleted)
+        printf("  (%zu removed)", info->deleted);
+    printf("\n");
+    return 0;
+}
+
+static int status_cmd(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", STATUS_USAGE);
+        return 0;
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+    eb_status_t status = eb_hnsw_foreach(repo_root, print_info, NULL);
+    free(repo_root);
+
+    if (status == EB_ERROR_NOT_FOUND) {
+        printf("No index; run 'embr index build' to create one\n");
+        return 0;
+    }
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to read index");
+        return 1;
+    }
+    return 0;
+}
+
+static int drop(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", DROP_USAGE);
+        return 0;
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+    eb_status_t status = eb_hnsw_drop(repo_root);
+    free(repo_root);
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to remove index");
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_index(int argc, char** argv) {
+    if (argc < 2 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+        printf("%s", INDEX_USAGE);
+        return argc < 2 ? 1 : 0;
+    }
+
+    if (strcmp(argv[1], "build") == 0)
+        return build(argc - 1, argv + 1);
+    if (strcmp(argv[1], "status") == 0)
+        return status_cmd(argc - 1, argv + 1);
+    if (strcmp(argv[1], "drop") == 0)
+        return drop(argc - 1, argv + 1);
+
+    cli_error("Unknown index command: %s", argv[1]);
+    fprintf(stderr, "%s", INDEX_USAGE);
+    return 1;
+}
@@ -8,6 +8,7 @@
 #include "cli.h"
 #include "../core/path_utils.h"
 #include "set.h"
+#include "../core/object_path.h"
 
 static const char* INIT_USAGE = 
     "Usage: embr init [options]\n"
@@ -18,6 +19,8 @@ static const char* INIT_USAGE =
     "  -m, --model <name>    Set default embedding model\n"
     "  -f, --force           Reinitialize existing repository\n"
     "  --no-git             Skip Git integration setup\n"
+    "  --object-layout <l>  Loose object layout: flat (default) or fanout\n"
+    "  --object-hash <h>    Object ID hash: sha256 (default) or blake3\n"
     "\n"
     "Examples:\n"
     "  # Initialize with defaults\n"
@@ -27,7 +30,13 @@ static const char* INIT_USAGE =
     "  embr init --model openai-3\n"
     "\n"
     "  # Reinitialize existing repository\n"
-    "  embr init --force\n";
+    "  embr init --force\n"
+    "\n"
+    "  # Spread objects over 256 subdirectories for large repositories\n"
+    "  embr init --object-layout fanout\n"
+    "\n"
+    "  # Hash objects and large sources with multi-threaded BLAKE3\n"
+    "  embr init --object-hash blake3\n";
 
 // Default configuration
 static const char* DEFAULT_CONFIG = "# EmbeddingBridge config file\n\n"
@@ -90,7 +99,7 @@ static const struct {
         "fi\n"
         "exit 0\n"},
     {"post-commit", "#!/bin/sh\n"
-        "# eb post-commit hook: Update metadata after commit\n"
+        "# eb post-commit hook: Store embeddings of the committed files\n"
         "\n"
         "# Check if hook is enabled\n"
         "if ! embr config get git.hooks.post-commit.enabled >/dev/null 2>&1 || \\\n"
@@ -101,18 +110,26 @@ static const struct {
         "# Get verbosity setting\n"
         "verbose=$(embr config get git.hooks.post-commit.verbose 2>/dev/null)\n"
         "\n"
-        "# Get the commit hash\n"
-        "commit=$(git rev-parse HEAD)\n"
-        "\n"
-        "[ \"$verbose\" = \"true\" ] && echo \"embr: Updating metadata for commit $commit\"\n"
+        "# Command reading file names on stdin and printing store manifest lines\n"
+        "# (<embedding>\\t<file>[\\t<model>]) for them\n"
+        "embed=$(embr config get git.hooks.post-commit.embed 2>/dev/null)\n"
+        "[ -n \"$embed\" ] || exit 0\n"
         "\n"
-        "# Update metadata for the commit\n"
-        "eb metadata update \"$commit\" || {\n"
-        "    echo \"embr: Failed to update metadata\"\n"
-        "    echo \"hint: Use 'embr config set git.hooks.post-commit.enabled false' to disable this hook\"\n"
-        "    exit 1\n"
-        "}\n"
-        "[ \"$verbose\" = \"true\" ] && echo \"embr: Successfully updated metadata\"\n"
+        "# Files the commit added or changed\n"
+        "files=$(git diff-tree --no-commit-id --name-only -r --diff-filter=ACM HEAD)\n"
+        "if [ -n \"$files\" ]; then\n"
+        "    if [ \"$verbose\" = \"true\" ]; then\n"
+        "        echo \"embr: Storing embeddings for committed files:\"\n"
+        "        echo \"$files\" | sed 's/^/  /'\n"
+        "    fi\n"
+        "    # One batched store for the whole commit\n"
+        "    echo \"$files\" | sh -c \"$embed\" | embr store --batch - || {\n"
+        "        echo \"embr: Failed to store embeddings\"\n"
+        "        echo \"hint: Use 'embr config set git.hooks.post-commit.enabled false' to disable this hook\"\n"
+        "        exit 1\n"
+        "    }\n"
+        "    [ \"$verbose\" = \"true\" ] && echo \"embr: Successfully stored embeddings\"\n"
+        "fi\n"
         "exit 0\n"},
     {"pre-push", "#!/bin/sh\n"
         "# eb pre-push hook: Validate embeddings before push\n"
@@ -209,7 +226,8 @@ static int write_file(const char* path, const char* content) {
     return 0;
 }
 
-static eb_status_t create_eb_structure(const char* root, const char* model __attribute__((unused))) {
+static eb_status_t create_eb_structure(const char* root, const char* model __attribute__((unused)),
+                                       eb_object_layout_t layout, eb_hash_algo_t hash) {
     char path[1024];
     
     // Create .embr directory
@@ -241,6 +259,14 @@ static eb_status_t create_eb_structure(const char* root, const char* model __att
         fprintf(stderr, "error: could not create config file\n");
         return 1;
     }
+    if (eb_object_set_layout(root, layout) != EB_SUCCESS) {
+        fprintf(stderr, "error: could not record object layout\n");
+        return 1;
+    }
+    if (eb_object_set_hash(root, hash) != EB_SUCCESS) {
+        fprintf(stderr, "error: could not record object hash\n");
+        return 1;
+    }
     
     // Create HEAD file
     snprintf(path, sizeof(path), "%s/.embr/HEAD", root);
@@ -400,8 +426,28 @@ int cmd_init(int argc, char** argv) {
     // Get optional model from command line only
     const char* model = get_option_value(argc, argv, "-m", "--model");
     
+    // Loose object layout, fixed until 'embr migrate-layout'; a forced
+    // reinit keeps the layout the existing objects are stored in
+    eb_object_layout_t layout = is_eb_initialized(cwd) ? eb_object_layout(cwd) : EB_LAYOUT_FLAT;
+    const char* layout_name = get_option_value(argc, argv, NULL, "--object-layout");
+    if (layout_name && eb_object_layout_parse(layout_name, &layout) != EB_SUCCESS) {
+        fprintf(stderr, "error: unknown object layout '%s'\n", layout_name);
+        fprintf(stderr, "hint: use 'flat' or 'fanout'\n");
+        return 1;
+    }
+
+    // Object ID hash, kept by a forced reinit unless one is given. Objects
+    // record their own hash, so those written before a change still resolve
+    eb_hash_algo_t hash = is_eb_initialized(cwd) ? eb_object_hash(cwd) : EB_HASH_SHA256;
+    const char* hash_name = get_option_value(argc, argv, NULL, "--object-hash");
+    if (hash_name && eb_object_hash_parse(hash_name, &hash) != EB_SUCCESS) {
+        fprintf(stderr, "error: unknown object hash '%s'\n", hash_name);
+        fprintf(stderr, "hint: use 'sha256' or 'blake3'\n");
+        return 1;
+    }
+    
     // Create directory structure
-    if (create_eb_structure(cwd, model) != 0) {
+    if (create_eb_structure(cwd, model, layout, hash) != 0) {
         return 1;
     }
     
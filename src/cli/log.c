@@ -22,6 +22,13 @@
 #include "../core/types.h"
 #include "../core/store.h"
 #include "../core/path_utils.h"
+#include "../core/object_path.h"
+#include "../core/set_index.h"
+#include "../core/log_index.h"
+#include "../core/remote.h"
+#include "../core/remote_cache.h"
+#include "../core/remote_prefetch.h"
+#include "set.h"
 
 /* Return codes */
 #define LOG_SUCCESS          0
@@ -37,8 +44,9 @@ static const char* LOG_USAGE =
     "\n"
     "Options:\n"
     "  -m, --model <model>     Filter by model/provider\n"
-    "  -l, --limit <n>         Limit to last n entries (default: all)\n"
-    "  -v, --verbose           Show detailed information\n"
+    "  -n, -l, --limit <n>     Show only the newest n entries (default: all)\n"
+    "  -v, --verbose           Show detailed information; metadata of versions\n"
+    "                          only a remote holds is fetched ahead of the listing\n"
     "  -h, --help              Show this help message\n"
     "\n"
     "Examples:\n"
@@ -64,18 +72,6 @@ static bool directory_exists(const char* path) {
     return (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
 }
 
-static int compare_entries_by_time(const void* a, const void* b) {
-    const log_entry_t* entry_a = (const log_entry_t*)a;
-    const log_entry_t* entry_b = (const log_entry_t*)b;
-    
-    /* Sort in reverse order (newest first) */
-    if (entry_a->timestamp > entry_b->timestamp)
-        return -1;
-    if (entry_a->timestamp < entry_b->timestamp)
-        return 1;
-    return 0;
-}
-
 static bool find_repo_root_path(char* path_out, size_t path_size) {
     char cwd[PATH_MAX];
     
@@ -118,9 +114,12 @@ static char* get_metadata(const char* root, const char* hash) {
     if (!root || !hash)
         return NULL;
     
-    snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", root, hash);
+    eb_object_path(root, hash, "meta", meta_path, sizeof(meta_path));
     
+    /* Versions a partial pull left on a remote are read from the remote cache */
     f = fopen(meta_path, "r");
+    if (!f && eb_remote_cache_path(root, hash, "meta", meta_path, sizeof(meta_path)) == EB_SUCCESS)
+        f = fopen(meta_path, "r");
     if (!f)
         return NULL;
     
@@ -219,20 +218,164 @@ static void display_metadata(const char* metadata) {
     free(copy);
 }
 
+/* Current hash of each model with an index entry for the file */
+struct current_models_ctx {
+    char** models;
+    char** hashes;
+    int count;
+    bool failed;
+};
+
+static int collect_current_model(const char* source, const char* model, const char* hash,
+                                 void* data) {
+    struct current_models_ctx* ctx = data;
+    (void)source;
+    if (!*model)
+        return 0;
+
+    char** new_models = realloc(ctx->models, (ctx->count + 1) * sizeof(char*));
+    if (new_models)
+        ctx->models = new_models;
+    char** new_hashes = realloc(ctx->hashes, (ctx->count + 1) * sizeof(char*));
+    if (new_hashes)
+        ctx->hashes = new_hashes;
+    if (!new_models || !new_hashes) {
+        ctx->failed = true;
+        return 1;
+    }
+
+    ctx->models[ctx->count] = strdup(model);
+    ctx->hashes[ctx->count] = strdup(hash);
+    if (!ctx->models[ctx->count] || !ctx->hashes[ctx->count]) {
+        free(ctx->models[ctx->count]);
+        free(ctx->hashes[ctx->count]);
+        ctx->failed = true;
+        return 1;
+    }
+    ctx->count++;
+    return 0;
+}
+
+/* Log entries of the file being shown, newest first */
+struct log_entries_ctx {
+    const char* model_filter;
+    char** current_hashes;
+    int current_count;
+    int limit;              /* Stop after this many, 0 for all */
+    log_entry_t* entries;
+    int count;
+    char** removed_models;  /* Models whose newest tombstone was already read */
+    int removed_count;
+    bool more;              /* Older matching entries were left unread */
+    bool failed;
+};
+
+static bool model_removed(const struct log_entries_ctx* ctx, const char* model) {
+    for (int i = 0; i < ctx->removed_count; i++) {
+        if (eb_log_tombstone_covers(ctx->removed_models[i], model))
+            return true;
+    }
+    return false;
+}
+
+static int collect_log_entry(const eb_log_entry_t* entry, void* data) {
+    struct log_entries_ctx* ctx = data;
+
+    /* Entries are read newest first, so everything a removal ended follows it */
+    if (entry->removed && !entry->model[0])
+        return 1;
+
+    /* Skip if not matching model filter */
+    if (ctx->model_filter && strcmp(entry->model, ctx->model_filter) != 0)
+        return 0;
+
+    if (model_removed(ctx, entry->model))
+        return 0;
+    if (entry->removed) {
+        if (ctx->model_filter)
+            return 1;
+        char** models = realloc(ctx->removed_models, (ctx->removed_count + 1) * sizeof(char*));
+        if (!models) {
+            ctx->failed = true;
+            return 1;
+        }
+        ctx->removed_models = models;
+        if (!(models[ctx->removed_count] = strdup(entry->model))) {
+            ctx->failed = true;
+            return 1;
+        }
+        ctx->removed_count++;
+        return 0;
+    }
+
+    if (ctx->limit > 0 && ctx->count == ctx->limit) {
+        ctx->more = true;
+        return 1;
+    }
+
+    log_entry_t* new_entries = realloc(ctx->entries, (ctx->count + 1) * sizeof(log_entry_t));
+    if (!new_entries) {
+        ctx->failed = true;
+        return 1;
+    }
+    ctx->entries = new_entries;
+
+    log_entry_t* e = &ctx->entries[ctx->count];
+    memset(e, 0, sizeof(*e));
+    strncpy(e->hash, entry->hash, sizeof(e->hash) - 1);
+    strncpy(e->provider, entry->model[0] ? entry->model : "unknown", sizeof(e->provider) - 1);
+    e->timestamp = entry->timestamp;
+
+    /* Check if this is a current hash */
+    for (int i = 0; i < ctx->current_count; i++) {
+        if (strcmp(ctx->current_hashes[i], entry->hash) == 0) {
+            e->is_current = true;
+            break;
+        }
+    }
+
+    ctx->count++;
+    return 0;
+}
+
+/*
+ * Read ahead of the entries a verbose listing shows, in the order it shows
+ * them: grouped by model, newest first
+ */
+static eb_prefetch_t* start_prefetch(const char* root, const log_entry_t* entries, int count,
+                                     char** models, int model_count) {
+    char set_name[128] = {0};
+    if (get_current_set(set_name, sizeof(set_name)) != EB_SUCCESS || set_name[0] == '\0')
+        return NULL;
+
+    const char** hashes = malloc((size_t)count * sizeof(*hashes));
+    if (!hashes)
+        return NULL;
+    int walked = 0;
+    for (int i = 0; i < model_count; i++) {
+        for (int j = 0; j < count; j++) {
+            if (strcmp(entries[j].provider, models[i]) == 0)
+                hashes[walked++] = entries[j].hash;
+        }
+    }
+
+    eb_prefetch_t* prefetch = NULL;
+    if (eb_prefetch_start(root, set_name, hashes, (size_t)walked, NULL, &prefetch) != EB_SUCCESS)
+        prefetch = NULL;
+    free(hashes);
+    return prefetch;
+}
+
 static int show_log(const char* file_path, const char* model_filter, int limit, bool verbose) {
     char repo_root[PATH_MAX];
     const char* rel_path;
     size_t root_len;
     char* log_path = NULL;
-    FILE* f = NULL;
     char** current_models = NULL;
     char** current_hashes = NULL;
     int current_model_count = 0;
-    char* index_path = NULL;
-    FILE* idx_file = NULL;
     log_entry_t* entries = NULL;
     int entry_count = 0;
-    char line[PATH_MAX + 256];
     int status = LOG_SUCCESS;
     int display_count;
     int i, j;
@@ -256,137 +399,48 @@ static int show_log(const char* file_path, const char* model_filter, int limit,
     
     /* Open per-set log file */
     log_path = get_current_set_log_path();
-    f = log_path ? fopen(log_path, "r") : NULL;
-    if (!f) {
+    if (!log_path || access(log_path, F_OK) != 0) {
         printf("No log found for %s\n", rel_path);
         if (log_path) free(log_path);
         return LOG_SUCCESS;
     }
     
     /* Read the per-set index to determine current hashes */
-    index_path = get_current_set_index_path();
-    idx_file = index_path ? fopen(index_path, "r") : NULL;
-    
-    if (idx_file) {
-        char idx_line[PATH_MAX + 65];
-        while (fgets(idx_line, sizeof(idx_line), idx_file)) {
-            /* Remove newline */
-            idx_line[strcspn(idx_line, "\n")] = 0;
-            
-            char idx_path[PATH_MAX] = {0};
-            char idx_hash[65] = {0};
-            
-            if (sscanf(idx_line, "%s %s", idx_hash, idx_path) == 2 && 
-                strcmp(idx_path, rel_path) == 0) {
-                
-                /* Get metadata to determine model */
-                char* metadata = get_metadata(repo_root, idx_hash);
-                if (metadata) {
-                    char* provider_line = strstr(metadata, "model=");
-                    if (provider_line) {
-                        char provider[32] = {0};
-                        if (sscanf(provider_line, "model=%31s", provider) == 1) {
-                            char** new_models = realloc(current_models, (current_model_count + 1) * sizeof(char*));
-                            char** new_hashes = realloc(current_hashes, (current_model_count + 1) * sizeof(char*));
-                            if (!new_models || !new_hashes) {
-                                free(metadata);
-                                free_current_model_data(current_models, current_hashes, current_model_count);
-                                fclose(idx_file);
-                                fclose(f);
-                                if (log_path) free(log_path);
-                                if (index_path) free(index_path);
-                                return LOG_ERROR_MEMORY;
-                            }
-                            current_models = new_models;
-                            current_hashes = new_hashes;
-                            current_models[current_model_count] = strdup(provider);
-                            current_hashes[current_model_count] = strdup(idx_hash);
-                            if (!current_models[current_model_count] || !current_hashes[current_model_count]) {
-                                free(metadata);
-                                free_current_model_data(current_models, current_hashes, current_model_count);
-                                fclose(idx_file);
-                                fclose(f);
-                                if (log_path) free(log_path);
-                                if (index_path) free(index_path);
-                                return LOG_ERROR_MEMORY;
-                            }
-                            current_model_count++;
-                        }
-                    }
-                    free(metadata);
-                }
-            }
+    eb_set_index_t* index = NULL;
+    if (eb_set_index_open_current(repo_root, &index) == EB_SUCCESS) {
+        struct current_models_ctx current = { NULL, NULL, 0, false };
+        eb_set_index_foreach(index, rel_path, collect_current_model, &current);
+        eb_set_index_close(index);
+
+        current_models = current.models;
+        current_hashes = current.hashes;
+        current_model_count = current.count;
+        if (current.failed) {
+            free_current_model_data(current_models, current_hashes, current_model_count);
+            free(log_path);
+            return LOG_ERROR_MEMORY;
         }
-        fclose(idx_file);
     }
     
-    /* Read all log entries for this file */
-    while (fgets(line, sizeof(line), f)) {
-        /* Remove newline */
-        line[strcspn(line, "\n")] = 0;
-        
-        /* Parse line */
-        char file_path[PATH_MAX] = {0};
-        char hash[65] = {0};
-        char timestamp_str[32] = {0};
-        char provider[32] = {0};
-        
-        int parsed = sscanf(line, "%s %s %s %s", timestamp_str, hash, file_path, provider);
-        
-        if (parsed >= 3 && strcmp(file_path, rel_path) == 0) {
-            /* Skip if not matching model filter */
-            if (model_filter && (parsed < 4 || strcmp(provider, model_filter) != 0))
-                continue;
-            
-            /* Parse timestamp */
-            time_t timestamp = (time_t)atol(timestamp_str);
-            
-            /* Add to entries */
-            log_entry_t* new_entries = realloc(entries, 
-                                        (entry_count + 1) * sizeof(log_entry_t));
-            if (!new_entries) {
-                free_current_model_data(current_models, current_hashes, current_model_count);
-                free(entries);
-                fclose(f);
-                return LOG_ERROR_MEMORY;
-            }
-            
-            entries = new_entries;
-            strncpy(entries[entry_count].hash, hash, sizeof(entries[entry_count].hash));
-            
-            if (parsed >= 4) {
-                strncpy(entries[entry_count].provider, provider, 
-                        sizeof(entries[entry_count].provider));
-            } else {
-                strncpy(entries[entry_count].provider, "unknown", 
-                        sizeof(entries[entry_count].provider));
-            }
-            
-            entries[entry_count].timestamp = timestamp;
-            
-            /* Check if this is a current hash */
-            entries[entry_count].is_current = false;
-            for (i = 0; i < current_model_count; i++) {
-                if (strcmp(current_hashes[i], hash) == 0) {
-                    entries[entry_count].is_current = true;
-                    break;
-                }
-            }
-            
-            entry_count++;
-        }
+    /* Read the newest entries for this file, stopping once limit are found */
+    struct log_entries_ctx collected = {
+        model_filter, current_hashes, current_model_count, limit, NULL, 0, NULL, 0, false, false
+    };
+    eb_status_t read_status = eb_log_foreach_reverse(log_path, rel_path,
+                                                     collect_log_entry, &collected);
+    entries = collected.entries;
+    entry_count = collected.count;
+    for (i = 0; i < collected.removed_count; i++)
+        free(collected.removed_models[i]);
+    free(collected.removed_models);
+    if (read_status != EB_SUCCESS || collected.failed) {
+        free_current_model_data(current_models, current_hashes, current_model_count);
+        free(entries);
+        free(log_path);
+        return collected.failed ? LOG_ERROR_MEMORY : LOG_ERROR_FILE;
     }
     
-    fclose(f);
-    
-    /* Sort entries by timestamp (newest first) */
-    if (entry_count > 0)
-        qsort(entries, entry_count, sizeof(log_entry_t), compare_entries_by_time);
-    
-    /* Apply limit if specified */
     display_count = entry_count;
-    if (limit > 0 && limit < entry_count)
-        display_count = limit;
     
     /* Display log */
     if (display_count == 0) {
@@ -470,6 +524,12 @@ static int show_log(const char* file_path, const char* model_filter, int limit,
             }
         }
         
+        eb_prefetch_t* prefetch = NULL;
+        size_t walked = 0;
+        if (verbose)
+            prefetch = start_prefetch(repo_root, entries, display_count,
+                                      unique_models, unique_model_count);
+        
         printf("Embedding log for %s\n\n", rel_path);
         
         /* Display each model's log */
@@ -480,7 +540,6 @@ static int show_log(const char* file_path, const char* model_filter, int limit,
             printf(TEXT_BOLD "Model: %s" COLOR_RESET "\n", unique_models[i]);
             printf("--------------------\n");
             
-            int displayed = 0;
             for (j = 0; j < display_count; j++) {
                 if (strcmp(entries[j].provider, unique_models[i]) == 0) {
                     char time_str[32];
@@ -496,6 +555,8 @@ static int show_log(const char* file_path, const char* model_filter, int limit,
                     
                     if (verbose) {
                         /* Get and display metadata */
+                        if (prefetch)
+                            eb_prefetch_wait(prefetch, walked++);
                         char* metadata = get_metadata(repo_root, entries[j].hash);
                         if (metadata) {
                             display_metadata(metadata);
@@ -504,19 +565,16 @@ static int show_log(const char* file_path, const char* model_filter, int limit,
                     }
                     
                     printf("\n");
-                    displayed++;
-                    
-                    /* Apply per-model limit if needed */
-                    if (limit > 0 && displayed >= limit)
-                        break;
                 }
             }
-            
-            /* Show count info if there are more entries than displayed */
-            if (displayed < model_entry_counts[i]) {
-                printf("\n(Showing %d of %d entries for this model. Use --limit 0 to see all.)\n", 
-                       displayed, model_entry_counts[i]);
-            }
+        }
+        
+        eb_prefetch_stop(prefetch);
+        
+        /* Older entries were not read, so their number is unknown */
+        if (collected.more) {
+            printf("\n(Showing the newest %d entries. Use --limit 0 to see all.)\n",
+                   display_count);
         }
         
         /* Clean up model data */
@@ -532,7 +590,6 @@ static int show_log(const char* file_path, const char* model_filter, int limit,
     free(entries);
     
     if (log_path) free(log_path);
-    if (index_path) free(index_path);
     
     return status;
 }
@@ -556,7 +613,9 @@ int cmd_log(int argc, char** argv) {
     
     /* Parse options */
     model_filter = get_option_value(argc, argv, "-m", "--model");
-    limit_str = get_option_value(argc, argv, "-l", "--limit");
+    limit_str = get_option_value(argc, argv, "-n", "--limit");
+    if (!limit_str)
+        limit_str = get_option_value(argc, argv, "-l", NULL);
     verbose = has_option(argc, argv, "-v") || has_option(argc, argv, "--verbose");
     
     if (limit_str) {
@@ -570,7 +629,8 @@ int cmd_log(int argc, char** argv) {
         /* Skip options and their values */
         if (argv[i][0] == '-') {
             if ((strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--model") == 0 ||
-                 strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--limit") == 0) && 
+                 strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-l") == 0 ||
+                 strcmp(argv[i], "--limit") == 0) && 
                 i + 1 < argc) {
                 i++;  /* Skip option value */
             }
@@ -608,5 +668,6 @@ int cmd_log(int argc, char** argv) {
     }
     
     free(files);
+    eb_remote_shutdown();
     return status;
 } 
\ No newline at end of file
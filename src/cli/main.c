@@ -1,7 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "../core/debug.h"
+#include "../core/timing.h"
+#include "../core/trace.h"
+#include "../core/counters.h"
+#include "../core/daemon.h"
+#include "../core/path_utils.h"
+#include "../core/object_path.h"
+#include "../core/thread_pool.h"
 #include "cli.h"
 #include "set.h"
 #include "merge.h"
@@ -9,19 +17,21 @@
 #include "remote.h"
 
 static const char* USAGE = 
-    "Usage: embr <command> [options] [args]\n"
+    "Usage: embr [--timing] [--stats] <command> [options] [args]\n"
     "\n"
     "Embedding management and version control\n"
     "\n"
     "Core Commands:\n"
     "  init          Create empty embedding repository\n"
     "  store         Store embeddings for documents\n"
+    "  import        Store a matrix of embeddings for a list of files\n"
     "  diff          Compare embeddings between versions\n"
     "  status        Show embedding status for a source file\n"
     "  log           Display embedding log for files\n"
     "  set           Manage embedding sets\n"
     "  switch        Switch between embedding sets\n"
     "  merge         Merge embeddings from one set to another\n"
+    "  search        Find embeddings closest to a query vector\n"
     "\n"
     "Management Commands:\n"
     "  config        Configure embedding settings\n"
@@ -29,8 +39,19 @@ static const char* USAGE =
     "  model         Manage embedding models\n"
     "  rollback      Revert to a previous embedding version\n"
     "  gc            Garbage collect unreferenced embeddings\n"
+    "  repack        Pack loose objects into a single pack file\n"
+    "  fsck          Verify the integrity of objects and references\n"
+    "  du            Show where the repository's storage goes\n"
+    "  migrate-layout Convert loose objects to another directory layout\n"
+    "  compress      Train compression dictionaries for embedding objects\n"
+    "  index         Manage the nearest-neighbor index of a set\n"
     "  get           Download a file or directory from a repository\n"
     "  rm            Remove embeddings from tracking\n"
+    "  stats         Show runtime counters of I/O, compression and caches\n"
+    "\n"
+    "Global Options:\n"
+    "  --timing      Report how long startup and each phase took, on stderr\n"
+    "  --stats       Report the runtime counters at exit, on stderr\n"
     "\n"
     "Run 'embr <command> --help' for command-specific help\n";
 
@@ -38,12 +59,14 @@ static const eb_command_t commands[] = {
     // Core commands
     {"init", "Create empty embedding repository", cmd_init},
     {"store", "Store embeddings for documents", cmd_store},
+    {"import", "Store a matrix of embeddings for a list of files", cmd_import},
     {"diff", "Compare embeddings between versions", cmd_diff},
     {"status", "Show embedding status for a source file", cmd_status},
     {"log", "Display embedding log for files", cmd_log},
     {"set", "Manage embedding sets", cmd_set},
     {"switch", "Switch between embedding sets", cmd_switch},
     {"merge", "Merge embeddings from one set to another", cmd_merge},
+    {"search", "Find embeddings closest to a query vector", cmd_search},
     
     // Management commands
     {"config", "Configure embedding settings", cmd_config},
@@ -51,10 +74,18 @@ static const eb_command_t commands[] = {
     {"model", "Manage embedding models", cmd_model},
     {"rollback", "Revert to a previous embedding version", cmd_rollback},
     {"gc", "Garbage collect unreferenced embeddings", cmd_gc},
+    {"repack", "Pack loose objects into a single pack file", cmd_repack},
+    {"fsck", "Verify the integrity of objects and references", cmd_fsck},
+    {"du", "Show where the repository's storage goes", cmd_du},
+    {"migrate-layout", "Convert loose objects to another directory layout", cmd_migrate_layout},
+    {"compress", "Train compression dictionaries for embedding objects", cmd_compress},
+    {"index", "Manage the nearest-neighbor index of a set", cmd_index},
     {"get", "Download a file or directory from a repository", cmd_get},
     {"rm", "Remove embeddings from tracking", cmd_rm},
     {"pull", "Download embedding objects from a remote repository", cmd_pull},
     {"push", "Upload embedding objects to a remote repository", cmd_push},
+    {"serve", "Serve remote objects for ssh remotes, or commands with --daemon", cmd_serve},
+    {"stats", "Show runtime counters of I/O, compression and caches", cmd_stats},
     
     {NULL, NULL, NULL}
 };
@@ -78,11 +109,106 @@ static void suggest_command(const char* cmd) {
     printf("\nRun 'embr --help' for usage\n");
 }
 
+/* CPU time used so far: at the top of main(), what loading took */
+static double process_cpu_ms(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+        return -1;
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static double before_main_ms = -1;
+
+/* Commands may exit() directly, so the report runs at exit */
+static void report_timing(void) {
+    fflush(stdout);
+    eb_timing_report(stderr, before_main_ms);
+}
+
+static bool report_stats_at_exit = false;
+
+static void report_stats(void) {
+    uint64_t values[EB_COUNTER_COUNT];
+    fflush(stdout);
+    eb_counters_snapshot(values);
+    eb_counters_print(stderr, values, false);
+}
+
+/* Run a command; subsystems it does not use are never initialized */
+static int run_command(const eb_command_t* cmd, int argc, char** argv) {
+    int timing = eb_timing_begin(cmd->name);
+    int ret = cmd->handler(argc, argv);
+    eb_timing_end(timing);
+    return ret;
+}
+
+static const eb_command_t* find_command(const char* name) {
+    for (const eb_command_t* cmd = commands; cmd->name; cmd++) {
+        if (strcmp(name, cmd->name) == 0)
+            return cmd;
+    }
+    return NULL;
+}
+
+int run_cli_command(int argc, char** argv) {
+    const eb_command_t* cmd = find_command(argv[0]);
+    if (!cmd) {
+        suggest_command(argv[0]);
+        return 1;
+    }
+    return run_command(cmd, argc, argv);
+}
+
+/* Read-mostly commands a running `embr serve --daemon` can take over */
+static const char* daemon_commands[] = {"status", "get", "diff", "search", "store", "stats", NULL};
+
+/* Hand the command to the repository's daemon, if one is running */
+static bool forward_to_daemon(int argc, char** argv, int* exit_code) {
+    if (getenv(EB_DAEMON_DISABLE_ENV) || eb_timing_enabled() || eb_trace_enabled() ||
+        report_stats_at_exit)
+        return false;
+    bool eligible = false;
+    for (const char** name = daemon_commands; *name; name++)
+        eligible = eligible || strcmp(argv[0], *name) == 0;
+    if (!eligible)
+        return false;
+
+    char* root = find_repo_root(".");
+    if (!root)
+        return false;
+    eb_status_t status = eb_daemon_forward(root, argc, argv, exit_code);
+    free(root);
+    if (status == EB_ERROR_NOT_CONNECTED)
+        return false;
+    if (status != EB_SUCCESS) {
+        /* The command may have run, so it is not repeated */
+        fprintf(stderr, "embr: lost the connection to the daemon\n");
+        *exit_code = 1;
+    }
+    return true;
+}
+
 int main(int argc, char** argv) {
+    double cpu_ms = process_cpu_ms();
+
+    // Global options go before the command, like git's -c options
+    for (; argc > 1; argc--, argv++) {
+        if (strcmp(argv[1], "--timing") == 0 && !eb_timing_enabled()) {
+            before_main_ms = cpu_ms;
+            eb_timing_enable();
+            atexit(report_timing);
+        } else if (strcmp(argv[1], "--stats") == 0 && !report_stats_at_exit) {
+            report_stats_at_exit = true;
+            atexit(report_stats);
+        } else {
+            break;
+        }
+    }
+
     /* Initialize debug system */
+    int phase = eb_timing_begin("debug init");
     eb_debug_init();
-
-    eb_remote_init();
+    eb_timing_end(phase);
     
     if (getenv("EB_DEBUG")) {
         DEBUG_INFO("Main called with %d arguments", argc);
@@ -112,15 +238,24 @@ int main(int argc, char** argv) {
 
     // Find and execute command
     const char* cmd_name = argv[1];
-    for (const eb_command_t* cmd = commands; cmd->name; cmd++) {
-        if (strcmp(cmd_name, cmd->name) == 0) {
-            if (getenv("EB_DEBUG")) {
-                DEBUG_INFO("Found command: %s", cmd_name);
-            }
-            return cmd->handler(argc - 1, argv + 1);
-        }
+    const eb_command_t* cmd = find_command(cmd_name);
+    if (!cmd) {
+        suggest_command(cmd_name);
+        return 1;
     }
+    if (getenv("EB_DEBUG")) {
+        DEBUG_INFO("Found command: %s", cmd_name);
+    }
+
+    int exit_code;
+    if (forward_to_daemon(argc - 1, argv + 1, &exit_code))
+        return exit_code;
 
-    suggest_command(cmd_name);
-    return 1;
-} 
\ No newline at end of file
+    // Size the shared thread pool from core.threads before anything uses it
+    char* root = find_repo_root(".");
+    if (root) {
+        eb_pool_configure(eb_core_threads(root));
+        free(root);
+    }
+    return run_command(cmd, argc - 1, argv + 1);
+}
@@ -40,18 +40,18 @@ typedef enum {
     EB_MERGE_UNION,     /* Union of sets, keep target versions for conflicts */
     EB_MERGE_MEAN,      /* Compute element-wise mean for conflict resolution */
     EB_MERGE_MAX,       /* Take element-wise maximum for conflict resolution */
-    EB_MERGE_WEIGHTED   /* Apply weighted combination based on metadata */
+    EB_MERGE_WEIGHTED,  /* Apply weighted combination based on metadata */
+    EB_MERGE_THEIRS     /* Union of sets, take source versions for conflicts */
 } eb_merge_strategy_t;
 
 /**
- * Embedding reference structure for tracking files
+ * Merge options
  */
-typedef struct eb_embedding_ref {
-    char* source_file;          /* Original source file path */
-    char* hash_ref;             /* Hash reference to embedding */
-    char* metadata;             /* Optional metadata */
-    struct eb_embedding_ref* next;
-} eb_embedding_ref_t;
+typedef struct {
+    bool dry_run;              /* Classify only, write nothing */
+    bool verbose;              /* Print every embedding added */
+    unsigned threads;          /* Matching threads, 0 for one per CPU */
+} eb_merge_options_t;
 
 /**
  * Merge result structure with statistics
@@ -68,7 +68,8 @@ typedef struct {
  * 
  * @param source_set Source set to merge from
  * @param target_set Target set to merge into (NULL for current)
- * @param strategy Merge strategy (union, mean, max, weighted)
+ * @param strategy Merge strategy (union, theirs, mean, max, weighted)
+ * @param options Optional, NULL for defaults
  * @param result Optional pointer to store merge statistics
  * @return Status code
  */
@@ -76,13 +77,14 @@ eb_status_t eb_merge_sets(
     const char* source_set,
     const char* target_set,
     eb_merge_strategy_t strategy,
+    const eb_merge_options_t* options,
     eb_merge_result_t* result
 );
 
 /**
  * Parse string strategy name to strategy enum
  * 
- * @param strategy_name Name of the strategy (union, mean, max, weighted)
+ * @param strategy_name Name of the strategy (union, theirs, mean, max, weighted)
  * @param strategy_out Pointer to store the strategy enum
  * @return true if valid strategy name, false otherwise
  */
@@ -99,23 +101,4 @@ bool eb_parse_merge_strategy(
  */
 const char* eb_merge_strategy_name(eb_merge_strategy_t strategy);
 
-/**
- * Load embedding references from a set
- * 
- * @param set_path Path to the set directory
- * @param refs_out Pointer to store the loaded references
- * @return Status code
- */
-eb_status_t eb_load_embedding_refs(
-    const char* set_path,
-    eb_embedding_ref_t** refs_out
-);
-
-/**
- * Free embedding references linked list
- * 
- * @param refs Head of the references linked list
- */
-void eb_free_embedding_refs(eb_embedding_ref_t* refs);
-
 #endif /* EB_MERGE_H */ 
\ No newline at end of file
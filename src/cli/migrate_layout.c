@@ -0,0 +1,85 @@
+/*
+ * EmbeddingBridge - Migrate Layout CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cli.h"
+#include "../core/object_path.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+static const char* MIGRATE_LAYOUT_USAGE =
+    "usage: embr migrate-layout [options] <flat|fanout>\n"
+    "\n"
+    "Move loose objects into another directory layout\n"
+    "\n"
+    "  flat     .embr/objects/<hash>.raw\n"
+    "  fanout   .embr/objects/<ab>/<cdef...>.raw, keeps directories small\n"
+    "\n"
+    "The new layout is recorded as storage.layout in .embr/config before any\n"
+    "object is moved. Objects are readable in either layout at all times, so\n"
+    "an interrupted migration can simply be run again. Packed objects are\n"
+    "not affected.\n"
+    "\n"
+    "Options:\n"
+    "  -q, --quiet            Suppress all output\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr migrate-layout fanout   # Split objects into 256 subdirectories\n"
+    "  embr migrate-layout flat     # Move them back\n";
+
+int cmd_migrate_layout(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", MIGRATE_LAYOUT_USAGE);
+        return 0;
+    }
+
+    bool quiet = has_option(argc, argv, "--quiet") || has_option(argc, argv, "-q");
+
+    const char* target = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            target = argv[i];
+            break;
+        }
+    }
+
+    eb_object_layout_t layout;
+    if (!target || eb_object_layout_parse(target, &layout) != EB_SUCCESS) {
+        fprintf(stderr, "%s", MIGRATE_LAYOUT_USAGE);
+        return 1;
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+
+    eb_object_layout_t current = eb_object_layout(repo_root);
+    size_t moved = 0;
+    eb_status_t status = eb_object_migrate(repo_root, layout, &moved);
+    free(repo_root);
+
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Layout migration failed");
+        return 1;
+    }
+
+    if (!quiet) {
+        if (current == layout && moved == 0)
+            printf("Already using the %s layout.\n", eb_object_layout_name(layout));
+        else
+            printf("Moved %zu files to the %s layout\n", moved, eb_object_layout_name(layout));
+    }
+    return 0;
+}
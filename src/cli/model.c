@@ -5,6 +5,8 @@
 #include "../core/embedding.h"
 #include "../core/error.h"
 #include "../core/debug.h"
+#include "../core/projection.h"
+#include "../core/path_utils.h"
 
 static const char* MODEL_USAGE = 
     "Usage: embr model <command> [options]\n"
@@ -12,7 +14,8 @@ static const char* MODEL_USAGE =
     "Commands:\n"
     "  register <name>    Register a new model\n"
     "  unregister <name>  Unregister a model\n"
-    "  list              List registered models\n"
+    "  list              List registered models and fitted projections\n"
+    "  fit <a> <b>       Fit a projection between two models\n"
     "\n"
     "Options for register:\n"
     "  --dimensions <n>   Number of dimensions (required)\n"
@@ -20,13 +23,63 @@ static const char* MODEL_USAGE =
     "  --version <v>     Model version (default: 1.0.0)\n"
     "  --description <d> Model description (default: User registered model)\n"
     "\n"
+    "Options for fit:\n"
+    "  --dims <n>        Dimensions of the shared space (default: smaller model,\n"
+    "                    at most one less than the paired documents)\n"
+    "  --set <name>      Set holding the paired documents (default: current set)\n"
+    "\n"
     "Examples:\n"
     "  # Register a new model\n"
     "  embr model register my-model --dimensions 1536 --normalize\n"
     "\n"
+    "  # Fit a projection over the documents embedded by both models\n"
+    "  embr model fit openai-3 voyage-2 --dims 256\n"
+    "\n"
     "  # List registered models\n"
     "  embr model list\n";
 
+typedef struct {
+    char** a;
+    char** b;
+    eb_projection_info_t* info;
+    size_t count;
+} projection_pairs_t;
+
+static int collect_projection(const char* model_a, const char* model_b,
+                              const eb_projection_info_t* info, void* ctx) {
+    projection_pairs_t* pairs = ctx;
+    char** a = realloc(pairs->a, (pairs->count + 1) * sizeof(char*));
+    if (a)
+        pairs->a = a;
+    char** b = a ? realloc(pairs->b, (pairs->count + 1) * sizeof(char*)) : NULL;
+    if (b)
+        pairs->b = b;
+    eb_projection_info_t* infos = b ? realloc(pairs->info, (pairs->count + 1) * sizeof(*infos)) : NULL;
+    if (!infos)
+        return 1;
+    pairs->info = infos;
+    pairs->a[pairs->count] = strdup(model_a);
+    pairs->b[pairs->count] = strdup(model_b);
+    pairs->info[pairs->count] = *info;
+    if (!pairs->a[pairs->count] || !pairs->b[pairs->count]) {
+        free(pairs->a[pairs->count]);
+        free(pairs->b[pairs->count]);
+        return 1;
+    }
+    pairs->count++;
+    return 0;
+}
+
+static void free_projection_pairs(projection_pairs_t* pairs) {
+    for (size_t i = 0; i < pairs->count; i++) {
+        free(pairs->a[i]);
+        free(pairs->b[i]);
+    }
+    free(pairs->a);
+    free(pairs->b);
+    free(pairs->info);
+}
+
 static int cmd_model_register(int argc, char** argv) {
     DEBUG_PRINT("Entering cmd_model_register\n");
     
@@ -112,10 +165,79 @@ static int cmd_model_unregister(int argc, char** argv) {
     }
 
     eb_unregister_model(name);
+
+    // Projections to or from the model go with it
+    char* repo_root = find_repo_root(".");
+    if (repo_root) {
+        projection_pairs_t pairs = { 0 };
+        eb_projection_list(repo_root, collect_projection, &pairs);
+        for (size_t i = 0; i < pairs.count; i++) {
+            if (strcmp(pairs.a[i], name) == 0 || strcmp(pairs.b[i], name) == 0)
+                eb_projection_remove(repo_root, pairs.a[i], pairs.b[i]);
+        }
+        free_projection_pairs(&pairs);
+        free(repo_root);
+    }
+
     printf("Successfully unregistered model '%s'\n", name);
     return 0;
 }
 
+static int cmd_model_fit(int argc, char** argv) {
+    if (argc < 3 || argv[1][0] == '-' || argv[2][0] == '-') {
+        fprintf(stderr, "error: two model names required\n");
+        printf("\n%s", MODEL_USAGE);
+        return 1;
+    }
+
+    const char* model_a = argv[1];
+    const char* model_b = argv[2];
+    const char* dims_str = get_option_value(argc, argv, NULL, "--dims");
+    const char* set = get_option_value(argc, argv, NULL, "--set");
+    if (strcmp(model_a, model_b) == 0) {
+        cli_error("Models must differ");
+        return 1;
+    }
+
+    size_t dims = 0;
+    if (dims_str) {
+        char* endptr;
+        dims = strtoull(dims_str, &endptr, 10);
+        if (*endptr != '\0' || dims == 0) {
+            cli_error("Invalid dimensions value");
+            return 1;
+        }
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+
+    eb_projection_info_t info;
+    eb_status_t status = eb_projection_fit_set(repo_root, set, model_a, model_b, dims, &info);
+    free(repo_root);
+    if (status == EB_ERROR_NOT_FOUND) {
+        cli_error("Need at least 2 documents embedded by both '%s' and '%s'", model_a, model_b);
+        return 1;
+    }
+    if (status == EB_ERROR_INVALID_INPUT && dims) {
+        cli_error("--dims must not exceed either model's dimensions or the paired documents less one");
+        return 1;
+    }
+    if (status != EB_SUCCESS) {
+        cli_error("Failed to fit projection: %s", eb_status_str(status));
+        return 1;
+    }
+
+    printf("Fitted projection %s (%zu) -> %s (%zu)\n", model_a, info.dims_a, model_b, info.dims_b);
+    printf("  shared dimensions: %zu\n", info.dims);
+    printf("  paired documents:  %zu\n", info.pairs);
+    printf("  fit cosine:        %.4f\n", info.fit_cosine);
+    return 0;
+}
+
 static int cmd_model_list(int argc, char** argv) {
     DEBUG_PRINT("Entering cmd_model_list\n");
     
@@ -151,6 +273,22 @@ static int cmd_model_list(int argc, char** argv) {
     }
     free(model_names);
 
+    char* repo_root = find_repo_root(".");
+    if (repo_root) {
+        projection_pairs_t pairs = { 0 };
+        eb_projection_list(repo_root, collect_projection, &pairs);
+        if (pairs.count > 0) {
+            printf("\nProjections:\n");
+            for (size_t i = 0; i < pairs.count; i++) {
+                printf("  %s <-> %s - %zu shared dimensions, %zu pairs, fit cosine %.4f\n",
+                       pairs.a[i], pairs.b[i], pairs.info[i].dims, pairs.info[i].pairs,
+                       pairs.info[i].fit_cosine);
+            }
+        }
+        free_projection_pairs(&pairs);
+        free(repo_root);
+    }
+
     DEBUG_PRINT("Completed cmd_model_list\n");
     return 0;
 }
@@ -168,6 +306,8 @@ int cmd_model(int argc, char** argv) {
         return cmd_model_unregister(argc - 1, argv + 1);
     } else if (strcmp(subcmd, "list") == 0) {
         return cmd_model_list(argc - 1, argv + 1);
+    } else if (strcmp(subcmd, "fit") == 0) {
+        return cmd_model_fit(argc - 1, argv + 1);
     } else {
         fprintf(stderr, "error: unknown model command '%s'\n", subcmd);
         printf("\n%s", MODEL_USAGE);
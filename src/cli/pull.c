@@ -23,6 +23,114 @@
 #include <jansson.h>
 #include <dirent.h>
 #include "../core/fs.h"
+#include "../core/object_path.h"
+#include "../core/set_index.h"
+#include "../core/hash_set.h"
+#include "../core/hash_utils.h"
+#include "../core/pack.h"
+#include "../core/remote_metadata.h"
+#include "../core/object_delta.h"
+
+/* Hashes of the local objects, loose or packed */
+static int collect_local_hash(const char *hex_hash, const char *ext, const char *path,
+                              const struct stat *st, void *data) {
+    (void)path;
+    (void)st;
+    if (strcmp(ext, "raw") != 0 && strcmp(ext, "meta") != 0)
+        return 0;
+    return eb_hash_set_add_hex(data, hex_hash, NULL) == EB_ERROR_MEMORY_ALLOCATION;
+}
+
+static int collect_packed_hash(const char *hex_hash, uint64_t length, time_t mtime, void *data) {
+    (void)length;
+    (void)mtime;
+    return eb_hash_set_add_hex(data, hex_hash, NULL) == EB_ERROR_MEMORY_ALLOCATION;
+}
+
+/* Loose local objects the remote does not have, for --prune */
+struct prune_ctx {
+    const eb_hash_set_t *remote;
+    const eb_hash_set_t *bases;     /* Delta bases, kept for the deltas built on them */
+    char (*hashes)[65];
+    size_t count;
+};
+
+static int collect_delta_base(const char *hash, const char *base, void *ctx) {
+    (void)hash;
+    return eb_hash_set_add_hex(ctx, base, NULL) == EB_ERROR_MEMORY_ALLOCATION;
+}
+
+static int collect_local_only(const uint8_t hash[32], void *data) {
+    struct prune_ctx *ctx = data;
+    if (eb_hash_set_contains(ctx->remote, hash) || eb_hash_set_contains(ctx->bases, hash))
+        return 0;
+    char hex[65], raw_path[PATH_MAX], meta_path[PATH_MAX];
+    eb_hash_to_hex(hash, hex);
+    eb_object_path(".", hex, "raw", raw_path, sizeof(raw_path));
+    eb_object_path(".", hex, "meta", meta_path, sizeof(meta_path));
+    if (access(raw_path, F_OK) == 0 || access(meta_path, F_OK) == 0)
+        memcpy(ctx->hashes[ctx->count++], hex, sizeof(hex));
+    return 0;
+}
+
+static int stop_at_first(const char *source, const char *model, const char *hash, void *ctx) {
+    (void)source;
+    (void)model;
+    (void)hash;
+    *(bool *)ctx = false;
+    return 1;
+}
+
+/* An index file is empty when missing, unreadable or without live entries */
+static bool set_index_empty(const char *path) {
+    eb_set_index_t *index;
+    bool empty = true;
+    if (eb_set_index_open(".", path, &index) != EB_SUCCESS)
+        return true;
+    eb_set_index_foreach(index, NULL, stop_at_first, &empty);
+    eb_set_index_close(index);
+    return empty;
+}
+
+/* Give an empty set the log and index of a pack manifest */
+static void restore_pack_log(const char *log) {
+    char *lg = get_current_set_log_path();
+    char *idx = get_current_set_index_path();
+    struct stat st;
+    if (!lg || !idx || !log || !*log || (stat(lg, &st) == 0 && st.st_size > 0)) {
+        free(lg);
+        free(idx);
+        return;
+    }
+    FILE *f = fopen(lg, "w");
+    if (f) {
+        fputs(log, f);
+        fclose(f);
+    }
+    // log format: timestamp hash filename model, split in place
+    size_t lines = 1;
+    for (const char *p = log; *p; p++) lines += *p == '\n';
+    eb_set_index_change_t *changes = calloc(lines, sizeof(*changes));
+    char *text = strdup(log);
+    size_t count = 0;
+    char *line_save = NULL;
+    for (char *line = text ? strtok_r(text, "\n", &line_save) : NULL; changes && line;
+         line = strtok_r(NULL, "\n", &line_save)) {
+        char *field_save = NULL;
+        char *timestamp = strtok_r(line, " \t", &field_save);
+        char *hash = timestamp ? strtok_r(NULL, " \t", &field_save) : NULL;
+        char *path = hash ? strtok_r(NULL, " \t", &field_save) : NULL;
+        char *model = path ? strtok_r(NULL, " \t", &field_save) : NULL;
+        if (path) changes[count++] = (eb_set_index_change_t){ path, model, hash };
+    }
+    unlink(idx);
+    if (!changes || !text || eb_set_index_apply(".", idx, changes, count) != EB_SUCCESS)
+        DEBUG_INFO("pull: failed to rebuild index %s from the pack manifest", idx);
+    free(text);
+    free(changes);
+    free(lg);
+    free(idx);
+}
 
 int cmd_pull(int argc, char **argv) {
     // Help/usage
@@ -55,6 +163,10 @@ int cmd_pull(int argc, char **argv) {
         printf("Usage: embr pull [options] <remote> [<set>]\n");
         return 1;
     }
+    if (eb_remote_init() != EB_SUCCESS) {
+        fprintf(stderr, "Error: Failed to initialize remote subsystem\n");
+        return 1;
+    }
     if (!set_name) {
         // Read current active set from .embr/HEAD
         FILE *head_file = fopen(".embr/HEAD", "r");
@@ -107,33 +219,74 @@ int cmd_pull(int argc, char **argv) {
     snprintf(remote_url + strlen(remote_url), sizeof(remote_url) - strlen(remote_url), "/sets/%s", set_name);
     char documents_url[1024];
     snprintf(documents_url, sizeof(documents_url), "%s/documents/", remote_url);
-    eb_transport_t *transport = transport_open(remote_url);         // For metadata.json
-    if (!transport) {
-        fprintf(stderr, "Error: Could not open transport for '%s'\n", remote_url);
-        return 1;
-    }
-    if (transport_connect(transport) != EB_SUCCESS) {
-        fprintf(stderr, "Error: Could not connect to remote '%s': %s\n", remote_url, transport_get_error(transport));
-        transport_close(transport);
-        return 1;
-    }
     // DEBUG: show which URLs we are connecting to
     DEBUG_PRINT("pull: remote_url = %s", remote_url);
     DEBUG_PRINT("pull: documents_url = %s", documents_url);
 
-    // 2. List all remote .parquet files using eb_remote_list_files
     char documents_prefix[256];
     snprintf(documents_prefix, sizeof(documents_prefix), "sets/%s", set_name);
+
+    // 2. A set pushed with --pack comes down as packs, no listing needed
+    {
+        char *pack_log = NULL;
+        eb_remote_pack_stats_t pack_stats = {0};
+        eb_status_t pack_status = eb_remote_pull_packs(remote, documents_prefix, ".", &pack_log, &pack_stats);
+        if (pack_status == EB_SUCCESS) {
+            restore_pack_log(pack_log);
+            free(pack_log);
+            if (pack_stats.packs == 0) {
+                printf("Set '%s' is up to date with remote '%s'\n", set_name, remote);
+            } else {
+                printf("Pulled %zu objects in %zu packs (%zu bytes, %zu by range) from remote '%s'\n",
+                       pack_stats.objects, pack_stats.packs, pack_stats.bytes, pack_stats.ranged, remote);
+            }
+            return 0;
+        }
+        if (pack_status != EB_ERROR_NOT_FOUND && pack_status != EB_ERROR_NOT_IMPLEMENTED) {
+            fprintf(stderr, "Error: Failed to pull packs for set '%s' from remote '%s'\n", set_name, remote);
+            return 1;
+        }
+    }
+
+    // 3. Otherwise take the remote .parquet files from its have manifest, or list them
     char **remote_refs = NULL;
     size_t remote_count = 0;
-    eb_status_t list_status = eb_remote_list_files(remote, documents_prefix, &remote_refs, &remote_count);
+    eb_status_t list_status;
+    eb_remote_have_t have = {0};
+    if (eb_remote_have_fetch(remote, documents_prefix, &have) == EB_SUCCESS) {
+        list_status = (remote_refs = calloc(have.count + 1, sizeof(*remote_refs))) ? EB_SUCCESS : EB_ERROR_MEMORY;
+        char key[1024];
+        if (list_status == EB_SUCCESS &&
+            eb_remote_key(remote, documents_prefix, "metadata.json", key, sizeof(key)) == EB_SUCCESS &&
+            (remote_refs[remote_count] = strdup(key)))
+            remote_count++;
+        for (size_t i = 0; list_status == EB_SUCCESS && i < have.count; ++i) {
+            char name[128];
+            snprintf(name, sizeof(name), "documents/%s.parquet", have.hashes[i]);
+            if (eb_remote_key(remote, documents_prefix, name, key, sizeof(key)) == EB_SUCCESS &&
+                (remote_refs[remote_count] = strdup(key)))
+                remote_count++;
+        }
+        eb_remote_have_free(&have);
+    } else {
+        list_status = eb_remote_list_files(remote, documents_prefix, &remote_refs, &remote_count);
+    }
     DEBUG_INFO("Remote file list returned by eb_remote_list_files:");
     for (size_t i = 0; i < remote_count; ++i) {
         DEBUG_INFO("  remote_refs[%zu] = %s", i, remote_refs[i]);
     }
     if (list_status != EB_SUCCESS) {
         fprintf(stderr, "Error: Could not list remote files for set '%s' (documents) via eb_remote_list_files\n", set_name);
-        transport_close(transport);
+        return 1;
+    }
+    // Borrowed after the listing so the connection it used is picked up again
+    eb_transport_options_t transport_options = {0};
+    eb_remote_transport_options(remote, &transport_options);
+    eb_transport_t *transport = transport_acquire(remote_url, &transport_options); // For metadata.json
+    if (!transport) {
+        fprintf(stderr, "Error: Could not connect to remote '%s'\n", remote_url);
+        for (size_t i = 0; i < remote_count; ++i) free(remote_refs[i]);
+        free(remote_refs);
         return 1;
     }
     // 2a. Reconstruct index, log, and refs/models from remote metadata.json
@@ -162,7 +315,7 @@ int cmd_pull(int argc, char **argv) {
                     char *rd = get_current_set_model_refs_dir();
                     struct stat st;
                     // Check index
-                    if (!idx || stat(idx, &st) != 0 || st.st_size == 0) need_reconstruct = 1;
+                    if (!idx || set_index_empty(idx)) need_reconstruct = 1;
                     // Check log
                     if (!lg || stat(lg, &st) != 0 || st.st_size == 0) need_reconstruct = 1;
                     // Check refs/models dir
@@ -182,24 +335,37 @@ int cmd_pull(int argc, char **argv) {
                     DEBUG_INFO("metadata.json: need_reconstruct = %d", need_reconstruct);
                     // --- End check ---
                     if (need_reconstruct) {
-                        // Rebuild index file
+                        // Rebuild index file, taking models from the object list
                         if (idx) {
-                            FILE *f = fopen(idx, "w");
                             json_t *arr = json_object_get(root, "index");
-                            if (f && json_is_array(arr)) {
-                                size_t n = json_array_size(arr);
-                                for (size_t j = 0; j < n; ++j) {
-                                    json_t *o = json_array_get(arr, j);
-                                    const char *h = json_string_value(json_object_get(o, "hash"));
-                                    const char *p = json_string_value(json_object_get(o, "path"));
-                                    if (h && p) fprintf(f, "%s %s\n", h, p);
+                            json_t *objs = json_object_get(root, "objects");
+                            size_t n = json_is_array(arr) ? json_array_size(arr) : 0;
+                            eb_set_index_change_t *changes = calloc(n ? n : 1, sizeof(*changes));
+                            size_t count = 0;
+                            for (size_t j = 0; changes && j < n; ++j) {
+                                json_t *o = json_array_get(arr, j);
+                                const char *h = json_string_value(json_object_get(o, "hash"));
+                                const char *p = json_string_value(json_object_get(o, "path"));
+                                if (!h || !p) continue;
+                                const char *md = json_string_value(json_object_get(o, "model"));
+                                for (size_t k = 0; !md && json_is_array(objs) && k < json_array_size(objs); ++k) {
+                                    json_t *obj = json_array_get(objs, k);
+                                    const char *oh = json_string_value(json_object_get(obj, "hash"));
+                                    if (oh && strcmp(oh, h) == 0)
+                                        md = json_string_value(json_object_get(obj, "model"));
                                 }
+                                changes[count++] = (eb_set_index_change_t){ p, md, h };
                             }
-                            if (f) fclose(f);
+                            unlink(idx);
+                            if (!changes || eb_set_index_apply(".", idx, changes, count) != EB_SUCCESS)
+                                DEBUG_INFO("metadata.json: failed to rebuild index %s", idx);
+                            free(changes);
                         }
-                        // Rebuild log file
+                        // Rebuild log file, by rename since a set layered on this one links it
+                        char lg_tmp[PATH_MAX];
+                        if (lg) snprintf(lg_tmp, sizeof(lg_tmp), "%s.tmp", lg);
                         if (lg) {
-                            FILE *f = fopen(lg, "w");
+                            FILE *f = fopen(lg_tmp, "w");
                             json_t *objs = json_object_get(root, "objects");
                             if (f && json_is_array(objs)) {
                                 size_t m = json_array_size(objs);
@@ -215,7 +381,7 @@ int cmd_pull(int argc, char **argv) {
                                     }
                                 }
                             }
-                            if (f) fclose(f);
+                            if (f && (fclose(f) != 0 || rename(lg_tmp, lg) != 0)) unlink(lg_tmp);
                         }
                         // Rebuild refs/models files
                         if (rd) {
@@ -246,8 +412,13 @@ int cmd_pull(int argc, char **argv) {
                                     }
                                     char pathbuf[PATH_MAX];
                                     snprintf(pathbuf, sizeof(pathbuf), "%s/%s", rd, model);
-                                    FILE *rf = fopen(pathbuf, "w");
-                                    if (rf) { fprintf(rf, "%s %s\n", h, src); fclose(rf); }
+                                    char tmpbuf[PATH_MAX + 8];
+                                    snprintf(tmpbuf, sizeof(tmpbuf), "%s.tmp", pathbuf);
+                                    FILE *rf = fopen(tmpbuf, "w");
+                                    if (rf) {
+                                        fprintf(rf, "%s %s\n", h, src);
+                                        if (fclose(rf) != 0 || rename(tmpbuf, pathbuf) != 0) unlink(tmpbuf);
+                                    }
                                 }
                             }
                         }
@@ -268,33 +439,20 @@ int cmd_pull(int argc, char **argv) {
         DEBUG_INFO("Finished checking remote file: %s (basename: %s)", ref, bname);
     }
     // 3. Build set of local hashes
-    char local_hashes[4096][128];
-    size_t local_hash_count = 0;
-    // Scan .embr/objects directory for existing raw/meta files
-    DIR *obj_dir = opendir(".embr/objects");
-    if (obj_dir) {
-        struct dirent *entry;
-        while ((entry = readdir(obj_dir)) != NULL && local_hash_count < 4096) {
-            const char *name = entry->d_name;
-            const char *dot = strrchr(name, '.');
-            if (!dot) continue;
-            if (strcmp(dot, ".raw") == 0 || strcmp(dot, ".meta") == 0) {
-                size_t hlen = dot - name;
-                if (hlen > 0 && hlen < sizeof(local_hashes[0])) {
-                    char hash[128];
-                    memcpy(hash, name, hlen);
-                    hash[hlen] = '\0';
-                    bool exists = false;
-                    for (size_t k = 0; k < local_hash_count; ++k) {
-                        if (strcmp(local_hashes[k], hash) == 0) { exists = true; break; }
-                    }
-                    if (!exists) {
-                        strncpy(local_hashes[local_hash_count++], hash, sizeof(local_hashes[0]));
-                    }
-                }
-            }
-        }
-        closedir(obj_dir);
+    eb_hash_set_t *local_hashes = NULL;
+    if (eb_hash_set_create(remote_count, &local_hashes) != EB_SUCCESS) {
+        fprintf(stderr, "Error: Out of memory\n");
+        for (size_t i = 0; i < remote_count; ++i) free(remote_refs[i]);
+        free(remote_refs);
+        transport_release(transport);
+        return 1;
+    }
+    // Collect existing raw/meta objects in either object layout, and packed objects
+    eb_object_foreach(".", collect_local_hash, local_hashes);
+    eb_pack_set_t *packs = NULL;
+    if (eb_pack_open(".", &packs) == EB_SUCCESS) {
+        eb_pack_foreach(packs, collect_packed_hash, local_hashes);
+        eb_pack_close(packs);
     }
     // 4. For each remote file, if not present locally, download and inverse-transform
     size_t downloaded = 0;
@@ -308,14 +466,7 @@ int cmd_pull(int argc, char **argv) {
         if (!dot || strcmp(dot, ".parquet") != 0) continue;
         char hash[128] = {0};
         if (sscanf(basename, "%127[^.]", hash) != 1) continue;
-        bool found = false;
-        for (size_t j = 0; j < local_hash_count; ++j) {
-            if (strcmp(hash, local_hashes[j]) == 0) {
-                found = true;
-                break;
-            }
-        }
-        if (found) continue; // Already present locally
+        if (eb_hash_set_contains_hex(local_hashes, hash)) continue; // Already present locally
         // Download file
         char s3_path[1024];
         snprintf(s3_path, sizeof(s3_path), "%s", remote_file);
@@ -333,6 +484,19 @@ int cmd_pull(int argc, char **argv) {
             continue;
         }
         size_t parquet_size = received;
+        if (eb_remote_object_is_record(parquet_data, parquet_size)) {
+            // Native remotes keep the record as stored here, take it as is
+            char raw_path[1024];
+            eb_object_write_path(".", hash, "raw", raw_path, sizeof(raw_path));
+            FILE *raw_file = fopen(raw_path, "wb");
+            if (raw_file) {
+                fwrite(parquet_data, 1, parquet_size, raw_file);
+                fclose(raw_file);
+            }
+            free(parquet_data);
+            downloaded++;
+            continue;
+        }
         // Inverse-transform Parquet to original format
         eb_transformer_t *transformer = eb_find_transformer_by_format("parquet");
         if (!transformer) {
@@ -394,7 +558,7 @@ int cmd_pull(int argc, char **argv) {
             }
             // Write converted metadata to .meta file
             char meta_path[1024];
-            snprintf(meta_path, sizeof(meta_path), ".embr/objects/%s.meta", hash);
+            eb_object_write_path(".", hash, "meta", meta_path, sizeof(meta_path));
             FILE *meta_file2 = fopen(meta_path, "w");
             if (meta_file2) {
                 if (source_file_buf[0]) fprintf(meta_file2, "source_file=%s\n", source_file_buf);
@@ -406,7 +570,7 @@ int cmd_pull(int argc, char **argv) {
         }
         // Write original data to .embr/objects/<hash>.raw
         char raw_path[1024];
-        snprintf(raw_path, sizeof(raw_path), ".embr/objects/%s.raw", hash);
+        eb_object_write_path(".", hash, "raw", raw_path, sizeof(raw_path));
         FILE *raw_file = fopen(raw_path, "wb");
         if (raw_file) {
             fwrite(original_data, 1, original_size, raw_file);
@@ -416,69 +580,70 @@ int cmd_pull(int argc, char **argv) {
         free(parquet_data);
         downloaded++;
     }
-    // Free remote_refs
-    for (size_t i = 0; i < remote_count; ++i) free(remote_refs[i]);
-    free(remote_refs);
-    transport_close(transport);
+    transport_release(transport);
     printf("Downloaded %zu new objects from set '%s' on remote '%s'\n", downloaded, set_name, remote);
     // PRUNE LOGIC
     if (prune_flag) {
         // 1. Build set of remote hashes (parquet files)
-        char remote_hashes[4096][128];
-        size_t remote_hash_count = 0;
+        eb_hash_set_t *remote_hashes = NULL;
+        struct prune_ctx prune = { NULL, NULL, NULL, 0 };
+        eb_hash_set_t *bases = NULL;
+        if (eb_hash_set_create(remote_count, &remote_hashes) == EB_SUCCESS &&
+            eb_hash_set_create(0, &bases) == EB_SUCCESS &&
+            eb_delta_foreach(".", collect_delta_base, bases) == EB_SUCCESS)
+            prune.hashes = calloc(eb_hash_set_count(local_hashes) + 1, sizeof(*prune.hashes));
+        if (!remote_hashes || !prune.hashes) {
+            fprintf(stderr, "Error: Out of memory\n");
+            eb_hash_set_destroy(bases);
+            eb_hash_set_destroy(remote_hashes);
+            eb_hash_set_destroy(local_hashes);
+            for (size_t i = 0; i < remote_count; ++i) free(remote_refs[i]);
+            free(remote_refs);
+            return 1;
+        }
         for (size_t i = 0; i < remote_count; ++i) {
             const char *remote_file = remote_refs[i];
             const char *slash = strrchr(remote_file, '/');
             const char *basename = slash ? slash + 1 : remote_file;
             char hash[128] = {0};
             if (sscanf(basename, "%127[^.]", hash) == 1) {
-                strncpy(remote_hashes[remote_hash_count++], hash, 128);
-            }
-        }
-        // 2. local_hashes[local_hash_count][128] already built above
-        // 3. Find local-only hashes
-        bool to_delete[4096] = {0};
-        size_t delete_count = 0;
-        for (size_t i = 0; i < local_hash_count; ++i) {
-            bool found = false;
-            for (size_t j = 0; j < remote_hash_count; ++j) {
-                if (strcmp(local_hashes[i], remote_hashes[j]) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                to_delete[i] = true;
-                delete_count++;
+                eb_hash_set_add_hex(remote_hashes, hash, NULL);
             }
         }
+        // 2. Find local-only hashes
+        prune.remote = remote_hashes;
+        prune.bases = bases;
+        eb_hash_set_foreach(local_hashes, collect_local_only, &prune);
+        size_t delete_count = prune.count;
         if (delete_count == 0) {
             printf("No local objects to prune.\n");
         } else {
             printf("The following local objects are not present on the remote and will be deleted:\n");
-            for (size_t i = 0; i < local_hash_count; ++i) {
-                if (to_delete[i]) {
-                    printf("  .embr/objects/%s.raw\n", local_hashes[i]);
-                    printf("  .embr/objects/%s.meta\n", local_hashes[i]);
-                }
+            for (size_t i = 0; i < delete_count; ++i) {
+                printf("  .embr/objects/%s.raw\n", prune.hashes[i]);
+                printf("  .embr/objects/%s.meta\n", prune.hashes[i]);
             }
             printf("Proceed? [y/N]: ");
             char response[8] = {0};
             if (!fgets(response, sizeof(response), stdin) || (response[0] != 'y' && response[0] != 'Y')) {
                 printf("Prune cancelled.\n");
             } else {
-                for (size_t i = 0; i < local_hash_count; ++i) {
-                    if (to_delete[i]) {
-                        char raw_path[256], meta_path[256];
-                        snprintf(raw_path, sizeof(raw_path), ".embr/objects/%s.raw", local_hashes[i]);
-                        snprintf(meta_path, sizeof(meta_path), ".embr/objects/%s.meta", local_hashes[i]);
-                        remove(raw_path);
-                        remove(meta_path);
-                    }
+                for (size_t i = 0; i < delete_count; ++i) {
+                    char raw_path[PATH_MAX], meta_path[PATH_MAX];
+                    eb_object_path(".", prune.hashes[i], "raw", raw_path, sizeof(raw_path));
+                    eb_object_path(".", prune.hashes[i], "meta", meta_path, sizeof(meta_path));
+                    remove(raw_path);
+                    remove(meta_path);
                 }
                 printf("Pruned %zu local objects.\n", delete_count);
             }
         }
+        free(prune.hashes);
+        eb_hash_set_destroy(bases);
+        eb_hash_set_destroy(remote_hashes);
     }
+    eb_hash_set_destroy(local_hashes);
+    for (size_t i = 0; i < remote_count; ++i) free(remote_refs[i]);
+    free(remote_refs);
     return 0;
 } 
\ No newline at end of file
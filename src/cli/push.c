@@ -13,11 +13,370 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "status.h"
 #include "debug.h"
 #include "remote.h"
 #include "set.h"
 #include "../core/path_utils.h"
+#include "../core/store.h"
+#include "../core/hash_set.h"
+#include "../core/hash_utils.h"
+#include "../core/log_index.h"
+#include "../core/parquet_set.h"
+#include "../core/json_vector.h"
+
+/* Parallel connections used when --jobs is not given */
+#define PUSH_DEFAULT_JOBS 4
+
+/* Copy the stored record of an object (loose .raw or packed) as it is on disk */
+static bool read_record(eb_store_t *store, const char *hash, void **record_out, size_t *size_out) {
+    eb_object_view_t view;
+    if (!store || eb_object_map(store, hash, EB_OBJECT_MAP_RAW, &view) != EB_SUCCESS) {
+        return false;
+    }
+    if (view.header.obj_type == EB_OBJ_VECTOR &&
+        (EB_FLAG_DICT_ID(view.header.flags) || (view.header.flags & EB_FLAG_DELTA))) {
+        // The remote has no copy of our dictionary or delta bases, send a self-contained record
+        eb_object_unmap(&view);
+        return eb_object_export(store, hash, record_out, size_out) == EB_SUCCESS;
+    }
+    // The mapping does not outlive the caller's loop, take a copy
+    void *record = malloc(view.record_size);
+    if (record) {
+        memcpy(record, view.record, view.record_size);
+        *record_out = record;
+        *size_out = view.record_size;
+    }
+    eb_object_unmap(&view);
+    return record != NULL;
+}
+
+/* Growable list of hash strings */
+struct hash_list {
+    char **hashes;
+    size_t count;
+    size_t capacity;
+};
+
+static bool hash_list_add(struct hash_list *list, const char *hash) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        char **grown = realloc(list->hashes, capacity * sizeof(*grown));
+        if (!grown) return false;
+        list->hashes = grown;
+        list->capacity = capacity;
+    }
+    if (!(list->hashes[list->count] = strdup(hash))) return false;
+    list->count++;
+    return true;
+}
+
+static void hash_list_free(struct hash_list *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->hashes[i]);
+    free(list->hashes);
+}
+
+/* Objects of the set log bundled into one pack, plus the log itself */
+struct pack_push {
+    eb_pack_object_t *objects;
+    char (*hashes)[65];
+    size_t count;
+    size_t capacity;
+    char *log;
+    size_t log_size;
+};
+
+static bool pack_push_add(struct pack_push *push, const char *hash, void *record, size_t size) {
+    if (push->count == push->capacity) {
+        size_t capacity = push->capacity ? push->capacity * 2 : 256;
+        eb_pack_object_t *objects = realloc(push->objects, capacity * sizeof(*objects));
+        if (objects) push->objects = objects;
+        char (*hashes)[65] = realloc(push->hashes, capacity * sizeof(*hashes));
+        if (hashes) push->hashes = hashes;
+        if (!objects || !hashes) return false;
+        // Moving the hash strings invalidates the pointers kept so far
+        for (size_t i = 0; i < push->count; i++) push->objects[i].hex_hash = push->hashes[i];
+        push->capacity = capacity;
+    }
+    snprintf(push->hashes[push->count], sizeof(push->hashes[0]), "%s", hash);
+    push->objects[push->count] = (eb_pack_object_t){ push->hashes[push->count], record, size };
+    push->count++;
+    return true;
+}
+
+static bool pack_push_log(struct pack_push *push, const char *line) {
+    size_t len = strlen(line);
+    char *grown = realloc(push->log, push->log_size + len + 2);
+    if (!grown) return false;
+    push->log = grown;
+    memcpy(push->log + push->log_size, line, len);
+    push->log_size += len;
+    push->log[push->log_size++] = '\n';
+    push->log[push->log_size] = '\0';
+    return true;
+}
+
+static void pack_push_free(struct pack_push *push) {
+    for (size_t i = 0; i < push->count; i++) free((void *)push->objects[i].data);
+    free(push->objects);
+    free(push->hashes);
+    free(push->log);
+}
+
+/* Set-level Parquet export: one writer per vector dimension in the set */
+struct parquet_export {
+    char dir[64];
+    eb_parquet_set_writer_t **writers;
+    uint32_t *dims;
+    size_t count;
+};
+
+static eb_parquet_set_writer_t *parquet_export_writer(struct parquet_export *export, uint32_t dims) {
+    for (size_t i = 0; i < export->count; i++) {
+        if (export->dims[i] == dims) return export->writers[i];
+    }
+    eb_parquet_set_writer_t **writers = realloc(export->writers, (export->count + 1) * sizeof(*writers));
+    if (writers) export->writers = writers;
+    uint32_t *all_dims = realloc(export->dims, (export->count + 1) * sizeof(*all_dims));
+    if (all_dims) export->dims = all_dims;
+    if (!writers || !all_dims) return NULL;
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "vectors-%u", dims);
+    if (eb_parquet_set_writer_open(export->dir, prefix, dims, NULL, &export->writers[export->count]) != EB_SUCCESS) {
+        return NULL;
+    }
+    export->dims[export->count] = dims;
+    return export->writers[export->count++];
+}
+
+/* Map a file and upload it to <path>/<its name> */
+static eb_status_t upload_file(const char *remote, const char *path, const char *file) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return EB_ERROR_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return EB_ERROR_IO;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return EB_ERROR_IO;
+    const char *name = strrchr(file, '/');
+    eb_status_t status = eb_remote_put_object(remote, path, name ? name + 1 : file, map, (size_t)st.st_size);
+    munmap(map, (size_t)st.st_size);
+    return status;
+}
+
+/* Drop files under path from an earlier export that this one did not write */
+static void remove_stale_parts(const char *remote, const char *path, char **files, size_t count) {
+    char **remote_files = NULL;
+    size_t remote_count = 0;
+    if (eb_remote_list_files(remote, path, &remote_files, &remote_count) != EB_SUCCESS) return;
+    const char **stale = calloc(remote_count ? remote_count : 1, sizeof(*stale));
+    size_t stale_count = 0;
+    for (size_t i = 0; stale && i < remote_count; i++) {
+        const char *slash = strrchr(remote_files[i], '/');
+        const char *name = slash ? slash + 1 : remote_files[i];
+        bool current = false;
+        for (size_t j = 0; j < count && !current; j++) {
+            const char *local = strrchr(files[j], '/');
+            current = strcmp(local ? local + 1 : files[j], name) == 0;
+        }
+        if (!current && strncmp(name, "vectors-", 8) == 0) stale[stale_count++] = remote_files[i];
+    }
+    if (stale_count > 0 && eb_remote_delete_files(remote, path, stale, stale_count) != EB_SUCCESS) {
+        cli_warning("Could not remove %zu Parquet files of an earlier push", stale_count);
+    }
+    free(stale);
+    for (size_t i = 0; i < remote_count; i++) free(remote_files[i]);
+    free(remote_files);
+}
+
+/* Called once per distinct vector of a set log, values are valid during the call only */
+typedef eb_status_t (*set_vector_fn)(const char *hash, const float *values, size_t dims, const char *source,
+                                     const char *model, int64_t timestamp, void *ctx);
+
+/* Read every distinct vector a set log refers to, in log order */
+static eb_status_t foreach_set_vector(FILE *log_file, eb_store_t *store, set_vector_fn fn, void *ctx,
+                                      size_t *rows_out, size_t *skipped_out) {
+    eb_hash_set_t *seen = NULL;
+    eb_status_t status = eb_hash_set_create(0, &seen);
+    float *values = NULL;
+    size_t values_dims = 0, rows = 0, skipped = 0;
+    char line[1024];
+    while (status == EB_SUCCESS && fgets(line, sizeof(line), log_file)) {
+        // log format: timestamp hash filename model
+        char timestamp[32] = {0}, hash[128] = {0}, source[512] = {0}, model[128] = {0};
+        if (sscanf(line, "%31s %127s %511s %127s", timestamp, hash, source, model) < 2) continue;
+        uint8_t binary[32];
+        bool added = false;
+        if (!eb_hex_to_hash(hash, binary) || eb_hash_set_add(seen, binary, &added) != EB_SUCCESS || !added) {
+            continue;
+        }
+        eb_object_view_t view;
+        if (eb_object_map(store, hash, 0, &view) != EB_SUCCESS) {
+            skipped++;
+            continue;
+        }
+        eb_vector_ref_t ref;
+        if (view.header.obj_type != EB_OBJ_VECTOR || eb_object_vector_ref(&view, &ref) != EB_SUCCESS ||
+            ref.dims == 0 || ref.dims > UINT32_MAX) {
+            eb_object_unmap(&view);
+            skipped++;
+            continue;
+        }
+        if (ref.dims > values_dims) {
+            float *grown = realloc(values, ref.dims * sizeof(float));
+            if (!grown) {
+                eb_object_unmap(&view);
+                status = EB_ERROR_MEMORY;
+                break;
+            }
+            values = grown;
+            values_dims = ref.dims;
+        }
+        eb_vector_ref_get(&ref, 0, ref.dims, values);
+        eb_object_unmap(&view);
+        status = fn(hash, values, ref.dims, source[0] ? source : NULL, model[0] ? model : NULL,
+                    strtoll(timestamp, NULL, 10), ctx);
+        rows++;
+    }
+    free(values);
+    eb_hash_set_destroy(seen);
+    *rows_out = rows;
+    *skipped_out = skipped;
+    return status;
+}
+
+static eb_status_t parquet_export_add(const char *hash, const float *values, size_t dims, const char *source,
+                                      const char *model, int64_t timestamp, void *ctx) {
+    eb_parquet_set_writer_t *writer = parquet_export_writer(ctx, (uint32_t)dims);
+    eb_parquet_set_row_t row = { hash, values, source, model, timestamp };
+    return writer ? eb_parquet_set_writer_add(writer, &row) : EB_ERROR_IO;
+}
+
+/*
+ * Push the vectors of a set as a few large Parquet files under
+ * sets/<set>/parquet, built locally one row group at a time
+ */
+static int push_parquet_set(const char *remote, const char *set_name, const char *embedding_path,
+                            FILE *log_file, eb_store_t *store) {
+    struct parquet_export export = {0};
+    snprintf(export.dir, sizeof(export.dir), ".embr/parquet-XXXXXX");
+    if (!mkdtemp(export.dir)) {
+        fprintf(stderr, "Error: Could not create a directory for the Parquet files\n");
+        return 1;
+    }
+    size_t rows = 0, skipped = 0;
+    eb_status_t status = foreach_set_vector(log_file, store, parquet_export_add, &export, &rows, &skipped);
+    // Finish every writer, then upload what they wrote
+    char **files = NULL;
+    size_t file_count = 0;
+    for (size_t i = 0; i < export.count; i++) {
+        char **written = NULL;
+        size_t written_count = 0;
+        if (status != EB_SUCCESS) {
+            eb_parquet_set_writer_abort(export.writers[i]);
+            continue;
+        }
+        status = eb_parquet_set_writer_close(export.writers[i], &written, &written_count);
+        char **grown = status == EB_SUCCESS ? realloc(files, (file_count + written_count + 1) * sizeof(*files)) : NULL;
+        if (grown) files = grown;
+        for (size_t j = 0; j < written_count; j++) {
+            if (grown) files[file_count++] = written[j];
+            else { unlink(written[j]); free(written[j]); }
+        }
+        free(written);
+        if (status == EB_SUCCESS && !grown) status = EB_ERROR_MEMORY;
+    }
+    free(export.writers);
+    free(export.dims);
+    char parquet_path[1100];
+    snprintf(parquet_path, sizeof(parquet_path), "%s/parquet", embedding_path);
+    size_t bytes = 0;
+    for (size_t i = 0; status == EB_SUCCESS && i < file_count; i++) {
+        status = upload_file(remote, parquet_path, files[i]);
+        struct stat st;
+        if (status == EB_SUCCESS && stat(files[i], &st) == 0) bytes += (size_t)st.st_size;
+    }
+    if (status == EB_SUCCESS) {
+        remove_stale_parts(remote, parquet_path, files, file_count);
+    }
+    for (size_t i = 0; i < file_count; i++) {
+        unlink(files[i]);
+        free(files[i]);
+    }
+    free(files);
+    rmdir(export.dir);
+    if (skipped > 0) {
+        cli_warning("Skipped %zu log entries whose vectors could not be read", skipped);
+    }
+    if (status != EB_SUCCESS) {
+        fprintf(stderr, "Error: Failed to push set '%s' as Parquet to remote '%s' (%s)\n",
+                set_name, remote, eb_status_str(status));
+        if (status == EB_ERROR_NOT_FOUND) {
+            cli_info("Remote '%s' does not exist. Add it with: embr remote add %s <url>", remote, remote);
+        }
+        return 1;
+    }
+    printf("Successfully pushed set '%s' to remote '%s' (%zu Parquet files, %zu vectors, %zu bytes)\n",
+           set_name, remote, file_count, rows, bytes);
+    return 0;
+}
+
+static int ndjson_write(void *ctx, const void *data, size_t size) {
+    return fwrite(data, 1, size, ctx) == size ? EB_SUCCESS : EB_ERROR_IO;
+}
+
+static eb_status_t ndjson_export_add(const char *hash, const float *values, size_t dims, const char *source,
+                                     const char *model, int64_t timestamp, void *ctx) {
+    eb_json_vector_t vector = { hash, source, model, timestamp, values, dims };
+    return eb_json_writer_add(ctx, &vector);
+}
+
+/* Push the vectors of a set as one NDJSON file, sets/<set>/vectors.ndjson */
+static int push_ndjson_set(const char *remote, const char *set_name, const char *embedding_path,
+                           FILE *log_file, eb_store_t *store) {
+    char dir[64], path[128];
+    snprintf(dir, sizeof(dir), ".embr/ndjson-XXXXXX");
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Error: Could not create a directory for the NDJSON file\n");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/vectors.ndjson", dir);
+    FILE *out = fopen(path, "wb");
+    eb_json_writer_t *writer = NULL;
+    eb_status_t status = out ? eb_json_writer_open(ndjson_write, out, &writer) : EB_ERROR_IO;
+    size_t rows = 0, skipped = 0, bytes = 0;
+    if (status == EB_SUCCESS) {
+        status = foreach_set_vector(log_file, store, ndjson_export_add, writer, &rows, &skipped);
+        if (status == EB_SUCCESS) {
+            status = eb_json_writer_close(writer, &bytes);
+        } else {
+            eb_json_writer_abort(writer);
+        }
+    }
+    if (out && fclose(out) != 0 && status == EB_SUCCESS) status = EB_ERROR_IO;
+    if (status == EB_SUCCESS && rows == 0) status = EB_ERROR_NOT_FOUND;
+    if (status == EB_SUCCESS) status = upload_file(remote, embedding_path, path);
+    unlink(path);
+    rmdir(dir);
+    if (skipped > 0) {
+        cli_warning("Skipped %zu log entries whose vectors could not be read", skipped);
+    }
+    if (status != EB_SUCCESS) {
+        fprintf(stderr, "Error: Failed to push set '%s' as NDJSON to remote '%s' (%s)\n",
+                set_name, remote, eb_status_str(status));
+        return 1;
+    }
+    printf("Successfully pushed set '%s' to remote '%s' (%zu vectors, %zu bytes of NDJSON)\n",
+           set_name, remote, rows, bytes);
+    return 0;
+}
 
 int cmd_push(int argc, char **argv) {
     // Help/usage
@@ -26,19 +385,46 @@ int cmd_push(int argc, char **argv) {
         printf("Upload embedding objects to a remote repository.\n");
         printf("\nOptions:\n");
         printf("  --force       Force remote to match local (destructive)\n");
+        printf("  --jobs, -j N  Upload over N parallel connections (default: %d)\n", PUSH_DEFAULT_JOBS);
+        printf("  --pack        Upload the objects the remote lacks as a single pack\n");
+        printf("  --parquet-set Upload the vectors as a few large Parquet files under sets/<set>/parquet\n");
+        printf("  --ndjson-set  Upload the vectors as one JSON object per line to sets/<set>/vectors.ndjson\n");
         printf("  --help, -h    Show this help message\n");
         printf("\nExamples:\n");
         printf("  embr push s3://mybucket embeddings\n");
         printf("  embr push --force s3://mybucket embeddings\n");
+        printf("  embr push --jobs 16 s3://mybucket embeddings\n");
+        printf("  embr push --pack s3://mybucket embeddings\n");
+        printf("  embr push --parquet-set s3://mybucket embeddings\n");
+        printf("  embr push --ndjson-set s3://mybucket embeddings\n");
         return 0;
     }
     // Parse arguments: embr push [options] <remote> [<set>]
     const char *remote = NULL;
     const char *set_name = NULL;
     bool force = false;
+    bool pack = false;
+    bool parquet_set = false;
+    bool ndjson_set = false;
+    size_t jobs = PUSH_DEFAULT_JOBS;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--force") == 0) {
             force = true;
+        } else if (strcmp(argv[i], "--pack") == 0) {
+            pack = true;
+        } else if (strcmp(argv[i], "--parquet-set") == 0) {
+            parquet_set = true;
+        } else if (strcmp(argv[i], "--ndjson-set") == 0) {
+            ndjson_set = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+            char *end = NULL;
+            long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+            if (!end || *end != '\0' || value < 1 || value > 256) {
+                fprintf(stderr, "Error: --jobs takes a number between 1 and 256\n");
+                return 1;
+            }
+            jobs = (size_t)value;
+            i++;
         } else if (!remote) {
             remote = argv[i];
         } else if (!set_name) {
@@ -50,6 +436,10 @@ int cmd_push(int argc, char **argv) {
         printf("Usage: embr push [options] <remote> [<set>]\n");
         return 1;
     }
+    if (eb_remote_init() != EB_SUCCESS) {
+        fprintf(stderr, "Error: Failed to initialize remote subsystem\n");
+        return 1;
+    }
     if (!set_name) {
         // Determine current set via get_current_set()
         char current_set[64] = {0};
@@ -77,8 +467,12 @@ int cmd_push(int argc, char **argv) {
         char* log_path_local = get_current_set_log_path();
         FILE *log_file_local = fopen(log_path_local, "r");
         free(log_path_local);
-        if (!log_file_local) {
+        eb_hash_set_t *local_hashes = NULL;
+        const char **to_delete = calloc(remote_file_count ? remote_file_count : 1, sizeof(*to_delete));
+        if (!log_file_local || !to_delete || eb_hash_set_create(0, &local_hashes) != EB_SUCCESS) {
             fprintf(stderr, "Error: Could not open log file for local set\n");
+            if (log_file_local) fclose(log_file_local);
+            free(to_delete);
             // Free remote_files
             if (remote_files) {
                 for (size_t i = 0; i < remote_file_count; i++) free(remote_files[i]);
@@ -86,48 +480,32 @@ int cmd_push(int argc, char **argv) {
             }
             return 1;
         }
-        // Use a simple array for local hashes (could use a hash set for large sets)
-        char local_hashes[1024][128];
-        size_t local_hash_count = 0;
         char line_local[1024];
         while (fgets(line_local, sizeof(line_local), log_file_local)) {
-            size_t len = strlen(line_local);
-            if (len > 0 && line_local[len-1] == '\n') { line_local[len-1] = '\0'; len--; }
-            if (len == 0) continue;
             char timestamp[32] = {0};
             char hash[128] = {0};
-            char filename[896] = {0};
-            char model[128] = {0};
-            if (sscanf(line_local, "%31s %127s %895s %127s", timestamp, hash, filename, model) < 2) continue;
-            if (local_hash_count < 1024) {
-                strncpy(local_hashes[local_hash_count++], hash, 128);
-            }
+            if (sscanf(line_local, "%31s %127s", timestamp, hash) < 2) continue;
+            eb_hash_set_add_hex(local_hashes, hash, NULL);
         }
         fclose(log_file_local);
         // Find remote files not present locally
-        const char *to_delete[1024];
         size_t to_delete_count = 0;
         for (size_t i = 0; i < remote_file_count; i++) {
-            // Extract hash from remote file name (assume format <hash>.raw or <hash>.meta)
-            char *dot = strrchr(remote_files[i], '.');
-            if (!dot) continue;
-            size_t hash_len = dot - remote_files[i];
-            if (hash_len == 0 || hash_len >= 128) continue;
-            char remote_hash[128] = {0};
-            strncpy(remote_hash, remote_files[i], hash_len);
-            remote_hash[hash_len] = '\0';
-            // Check if this hash is in local_hashes
-            bool found = false;
-            for (size_t j = 0; j < local_hash_count; j++) {
-                if (strcmp(remote_hash, local_hashes[j]) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
+            // Extract hash from remote file name (assume format <hash>.raw or <hash>.parquet)
+            const char *slash = strrchr(remote_files[i], '/');
+            const char *name = slash ? slash + 1 : remote_files[i];
+            const char *dot = strrchr(name, '.');
+            if (!dot || dot - name != 64) continue;
+            char remote_hash[65];
+            memcpy(remote_hash, name, 64);
+            remote_hash[64] = '\0';
+            uint8_t binary[32];
+            if (!eb_hex_to_hash(remote_hash, binary)) continue;
+            if (!eb_hash_set_contains(local_hashes, binary)) {
                 to_delete[to_delete_count++] = remote_files[i];
             }
         }
+        eb_hash_set_destroy(local_hashes);
         if (to_delete_count > 0) {
             printf("Deleting %zu remote files not present locally...\n", to_delete_count);
             eb_status_t del_status = eb_remote_delete_files(remote, remote_set_path, to_delete, to_delete_count);
@@ -137,6 +515,7 @@ int cmd_push(int argc, char **argv) {
         } else {
             printf("No extra remote files to delete.\n");
         }
+        free(to_delete);
         // Free remote_files
         if (remote_files) {
             for (size_t i = 0; i < remote_file_count; i++) free(remote_files[i]);
@@ -151,51 +530,176 @@ int cmd_push(int argc, char **argv) {
         return 1;
     }
     char line[1024];
-    bool any_pushed = false;
-    eb_status_t last_status = EB_ERROR_NOT_FOUND;
+    eb_store_t *store = NULL;
+    eb_store_config_t store_config = { .root_path = "." };
+    eb_store_init(&store_config, &store);
     if (fgets(line, sizeof(line), log_file) == NULL) {
         fclose(log_file);
+        eb_store_destroy(store);
         fprintf(stderr, "Error: No content to push. Log file is empty. Use 'eb store' to add embeddings.\n");
         return 1;
     }
     rewind(log_file);
-    while (fgets(line, sizeof(line), log_file)) {
+    char embedding_path[1024];
+    snprintf(embedding_path, sizeof(embedding_path), "sets/%s", set_name);
+    if (parquet_set || ndjson_set) {
+        int result = parquet_set ? push_parquet_set(remote, set_name, embedding_path, log_file, store)
+                                 : push_ndjson_set(remote, set_name, embedding_path, log_file, store);
+        fclose(log_file);
+        eb_store_destroy(store);
+        return result;
+    }
+    if (pack) {
+        struct pack_push push = {0};
+        size_t skipped = 0;
+        bool ok = true;
+        while (ok && fgets(line, sizeof(line), log_file)) {
+            size_t len = strlen(line);
+            if (len > 0 && line[len-1] == '\n') { line[len-1] = '\0'; len--; }
+            if (len == 0) continue;
+            char timestamp[32] = {0};
+            char hash[128] = {0};
+            if (sscanf(line, "%31s %127s", timestamp, hash) < 2) continue;
+            ok = pack_push_log(&push, line);
+            void *record = NULL;
+            size_t record_size = 0;
+            if (!ok) break;
+            if (strcmp(hash, EB_LOG_TOMBSTONE) == 0) continue;  // A removal, no object
+            if (strlen(hash) != 64 || !read_record(store, hash, &record, &record_size)) {
+                skipped++;
+                continue;
+            }
+            ok = pack_push_add(&push, hash, record, record_size);
+            if (!ok) free(record);
+        }
+        fclose(log_file);
+        eb_store_destroy(store);
+        if (skipped > 0) {
+            cli_warning("Skipped %zu log entries whose objects could not be read", skipped);
+        }
+        eb_remote_pack_stats_t stats = {0};
+        eb_status_t status = ok ? eb_remote_push_pack(remote, embedding_path, push.objects, push.count,
+                                                      push.log, &stats)
+                                : EB_ERROR_MEMORY;
+        pack_push_free(&push);
+        if (status != EB_SUCCESS) {
+            fprintf(stderr, "Error: Failed to push pack to remote '%s' (%s)\n", remote, eb_status_str(status));
+            if (status == EB_ERROR_NOT_FOUND) {
+                cli_info("Remote '%s' does not exist. Add it with: embr remote add %s <url>", remote, remote);
+            }
+            return 1;
+        }
+        if (stats.packs == 0) {
+            printf("Remote '%s' already has every object of set '%s'\n", remote, set_name);
+        } else {
+            printf("Successfully pushed set '%s' to remote '%s' (1 pack, %zu objects, %zu bytes)\n",
+                   set_name, remote, stats.objects, stats.bytes);
+        }
+        return 0;
+    }
+    // The remote's have manifest says which objects it already holds
+    eb_remote_have_t have = {0};
+    eb_status_t have_status = eb_remote_have_fetch(remote, embedding_path, &have);
+    if (have_status != EB_SUCCESS && have_status != EB_ERROR_NOT_FOUND) {
+        DEBUG_INFO("push: no have manifest for %s (status %d), sending every object", embedding_path, have_status);
+    }
+    // Log hashes the remote lacks, and those it already has
+    struct hash_list wanted = {0}, known = {0};
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), log_file)) {
         size_t len = strlen(line);
         if (len > 0 && line[len-1] == '\n') { line[len-1] = '\0'; len--; }
         if (len == 0) continue;
         // log format: timestamp hash filename model
         char timestamp[32] = {0};
         char hash[128] = {0};
-        char filename[896] = {0};
-        char model[128] = {0};
-        if (sscanf(line, "%31s %127s %895s %127s", timestamp, hash, filename, model) < 2) continue;
-        char raw_path[1024];
-        snprintf(raw_path, sizeof(raw_path), ".embr/objects/%s.raw", hash);
-        FILE *raw_file = fopen(raw_path, "rb");
-        if (!raw_file) continue;
-        fseek(raw_file, 0, SEEK_END);
-        long raw_size = ftell(raw_file);
-        fseek(raw_file, 0, SEEK_SET);
-        void *raw_data = malloc(raw_size);
-        if (!raw_data) { fclose(raw_file); continue; }
-        if (fread(raw_data, 1, raw_size, raw_file) != (size_t)raw_size) { free(raw_data); fclose(raw_file); continue; }
-        fclose(raw_file);
-        char embedding_path[1024];
-        snprintf(embedding_path, sizeof(embedding_path), "sets/%s", set_name);
-        last_status = eb_remote_push(remote, raw_data, raw_size, embedding_path, hash);
-        free(raw_data);
-        if (last_status == EB_SUCCESS) any_pushed = true;
+        if (sscanf(line, "%31s %127s", timestamp, hash) < 2) continue;
+        if (strcmp(hash, EB_LOG_TOMBSTONE) == 0) continue;
+        ok = hash_list_add(eb_remote_have_contains(&have, hash) ? &known : &wanted, hash);
     }
     fclose(log_file);
-    if (any_pushed) {
-        printf("Successfully pushed set '%s' to remote '%s'\n", set_name, remote);
+    // Sorted and without duplicates, like the manifest itself
+    eb_remote_have_t pending = {0}, present = {0};
+    eb_status_t status = ok ? eb_remote_have_add(&pending, (const char *const *)wanted.hashes, wanted.count)
+                            : EB_ERROR_MEMORY;
+    if (status == EB_SUCCESS)
+        status = eb_remote_have_add(&present, (const char *const *)known.hashes, known.count);
+    size_t wanted_count = wanted.count;
+    hash_list_free(&wanted);
+    hash_list_free(&known);
+    if (status != EB_SUCCESS) {
+        eb_store_destroy(store);
+        eb_remote_have_free(&have);
+        eb_remote_have_free(&present);
+        eb_remote_have_free(&pending);
+        fprintf(stderr, "Error: Out of memory reading the set log\n");
+        return 1;
+    }
+    if (wanted_count == 0 && have_status == EB_SUCCESS && !force) {
+        eb_store_destroy(store);
+        eb_remote_have_free(&have);
+        eb_remote_have_free(&present);
+        printf("Everything up-to-date: remote '%s' has every object of set '%s'\n", remote, set_name);
         return 0;
-    } else if (last_status == EB_ERROR_NOT_FOUND) {
+    }
+    // One transaction for the whole set; workers keep their connections open
+    eb_remote_push_session_t *session = NULL;
+    status = eb_remote_push_begin(remote, embedding_path, jobs, &session);
+    if (status != EB_SUCCESS) {
+        eb_store_destroy(store);
+        eb_remote_have_free(&have);
+        eb_remote_have_free(&present);
+        eb_remote_have_free(&pending);
         fprintf(stderr, "Error: Failed to push to remote '%s'\n", remote);
-        cli_info("Remote '%s' does not exist. Add it with: embr remote add %s <url>", remote, remote);
+        if (status == EB_ERROR_NOT_FOUND) {
+            cli_info("Remote '%s' does not exist. Add it with: embr remote add %s <url>", remote, remote);
+        }
         return 1;
+    }
+    size_t skipped = 0;
+    const char **queued = calloc(pending.count ? pending.count : 1, sizeof(*queued));
+    size_t queued_count = 0;
+    for (size_t i = 0; i < pending.count; i++) {
+        const char *hash = pending.hashes[i];
+        // Queue the stored record (loose .raw or packed) as it is on disk
+        void *record = NULL;
+        size_t record_size = 0;
+        if (!queued || !read_record(store, hash, &record, &record_size)) {
+            skipped++;
+            continue;
+        }
+        if (eb_remote_push_add(session, record, record_size, hash) == EB_SUCCESS)
+            queued[queued_count++] = hash;
+    }
+    eb_store_destroy(store);
+    eb_remote_push_stats_t stats = {0};
+    status = eb_remote_push_finish(session, &stats);
+    if (skipped > 0) {
+        cli_warning("Skipped %zu log entries whose objects could not be read", skipped);
+    }
+    if (status == EB_SUCCESS) {
+        // --force made the remote match the set, so only what is in it remains
+        eb_remote_have_t *updated = force ? &present : &have;
+        if (eb_remote_have_add(updated, queued, queued_count) != EB_SUCCESS ||
+            eb_remote_have_store(remote, embedding_path, updated) != EB_SUCCESS) {
+            cli_warning("Could not update the have manifest of set '%s'; the next push will send its objects again",
+                        set_name);
+        }
+    }
+    free(queued);
+    eb_remote_have_free(&have);
+    eb_remote_have_free(&present);
+    eb_remote_have_free(&pending);
+    if (status == EB_SUCCESS) {
+        printf("Successfully pushed set '%s' to remote '%s' (%zu objects, %zu bytes)\n",
+               set_name, remote, stats.pushed, stats.bytes);
+        return 0;
+    }
+    if (stats.failed > 0) {
+        fprintf(stderr, "Error: Failed to push %zu of %zu objects to remote '%s'\n",
+                stats.failed, stats.pushed + stats.failed, remote);
     } else {
         fprintf(stderr, "Error: Failed to push to remote '%s'\n", remote);
-        return 1;
     }
-} 
\ No newline at end of file
+    return 1;
+}
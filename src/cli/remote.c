@@ -25,6 +25,7 @@
 // Define a context structure to hold parsing results
 typedef struct {
     const char *format;
+    const char *format_options;
     const char *token;
     int compression;
     int timeout;
@@ -42,7 +43,11 @@ static void print_usage(void) {
     printf("\n");
     printf("Common options:\n");
     printf("  --help               Show this help message\n");
-    printf("  --format=<format>    Specify data format (json, parquet) [default: json]\n");
+    printf("  --format=<format>    Specify data format (json, parquet, native) [default: json]\n");
+    printf("  --format-options=<key=value,...>\n");
+    printf("                       Parquet writer tuning: encoding=plain|byte_stream_split,\n");
+    printf("                       dictionary[.<column>]=on|off, row_group_rows=<n>,\n");
+    printf("                       page_size=<bytes>[k|m], statistics=on|off\n");
     printf("  --compression=<0-9>  Set compression level [default: 9]\n");
     printf("  --timeout=<seconds>  Set connection timeout [default: 30]\n");
     printf("  --no-verify-ssl      Disable SSL certificate verification\n");
@@ -71,6 +76,13 @@ static int remote_option_callback(char short_opt, const char* long_opt, const ch
         if (strcmp(opt, "help") == 0) {
             print_usage();
             exit(0);
+        } else if (strcmp(opt, "format-options") == 0 || strncmp(opt, "format-options=", 15) == 0) {
+            eb_parquet_writer_options_t parsed;
+            if (format_parse_parquet_options(arg, &parsed) != EB_SUCCESS) {
+                fprintf(stderr, "Error: Invalid format options '%s'\n", arg);
+                return 1;
+            }
+            context->format_options = arg;
         } else if (strcmp(opt, "format") == 0 || strncmp(opt, "format=", 7) == 0) {
             context->format = arg;
         } else if (strcmp(opt, "compression") == 0 || strncmp(opt, "compression=", 12) == 0) {
@@ -117,6 +129,7 @@ int cmd_remote(int argc, char** argv) {
     // Initialize context with default values
     remote_context_t context = {
         .format = "json",
+        .format_options = NULL,
         .token = NULL,
         .compression = DEFAULT_COMPRESSION,
         .timeout = DEFAULT_TIMEOUT,
@@ -127,6 +140,7 @@ int cmd_remote(int argc, char** argv) {
     const char* short_opts = "h";
     const char* long_opts[] = {
         "format=",
+        "format-options=",
         "compression=",
         "token=",
         "timeout=",
@@ -195,6 +209,15 @@ static int handle_add_command(int argc, char **argv, const remote_context_t *ctx
     eb_status_t status = eb_remote_add(name, url, ctx->token, ctx->compression, 
                                       ctx->verify_ssl, ctx->format);
     
+    if (status == EB_SUCCESS && ctx->format_options) {
+        status = eb_remote_set_format_options(name, ctx->format_options);
+        if (status != EB_SUCCESS) {
+            fprintf(stderr, "Error: Failed to set format options of remote '%s'\n", name);
+            eb_remote_remove(name);
+            return 1;
+        }
+    }
+    
     if (status == EB_SUCCESS) {
         printf("Remote '%s' added successfully\n", name);
         return 0;
@@ -0,0 +1,89 @@
+/*
+ * EmbeddingBridge - Repack CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cli.h"
+#include "../core/pack.h"
+#include "../core/store.h"
+#include "../core/object_path.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+static const char* REPACK_USAGE =
+    "usage: embr repack [options]\n"
+    "\n"
+    "Pack loose objects into a single pack file with a sorted index\n"
+    "\n"
+    "All loose objects and existing packs are combined into one new pack\n"
+    "under .embr/objects/pack. Loose objects that were packed are removed.\n"
+    "New embeddings keep being written as loose objects until the next repack.\n"
+    "With storage.archive_level set, loose vectors are recompressed at that\n"
+    "level as they are packed.\n"
+    "\n"
+    "Options:\n"
+    "  -q, --quiet            Suppress all output\n"
+    "  -v, --verbose          Show detailed statistics\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr repack              # Pack everything\n"
+    "  embr gc --aggressive     # Prune, then repack\n";
+
+int cmd_repack(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", REPACK_USAGE);
+        return 0;
+    }
+
+    bool quiet = has_option(argc, argv, "--quiet") || has_option(argc, argv, "-q");
+    bool verbose = has_option(argc, argv, "--verbose") || has_option(argc, argv, "-v");
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        return 1;
+    }
+
+    // Recompressing at the archive level needs a store for dictionaries
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = repo_root };
+    bool archive = eb_object_archive_level(repo_root) > 0 && eb_store_init(&config, &store) == EB_SUCCESS;
+
+    eb_repack_result_t result;
+    eb_status_t status = eb_pack_repack(repo_root, NULL, NULL, archive ? eb_object_archive : NULL, store,
+                                        &result);
+    eb_store_destroy(store);
+    free(repo_root);
+
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Repack failed");
+        return 1;
+    }
+
+    if (quiet)
+        return 0;
+
+    if (result.objects_packed == 0) {
+        printf("Nothing to pack.\n");
+        return 0;
+    }
+
+    printf("Packed %zu objects (%zu loose removed)\n",
+           result.objects_packed, result.loose_removed);
+    if (verbose) {
+        printf("Pack size: %zu bytes\n", result.bytes_written);
+        printf("Packs replaced: %zu\n", result.packs_replaced);
+        if (archive)
+            printf("Recompressed at the archive level: %zu\n", result.objects_rewritten);
+    }
+    return 0;
+}
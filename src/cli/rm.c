@@ -26,447 +26,396 @@
 #include "colors.h"
 #include "remote.h"
 #include "set.h"
+#include "../core/object_path.h"
+#include "../core/set_index.h"
+#include "../core/set_checkpoint.h"
+#include "../core/log_index.h"
+#include "../core/hnsw.h"
 
 #define MAX_LINE_LEN 2048
 #define MAX_PATH_LEN PATH_MAX
 
-static const char* RM_USAGE = 
-    "Usage: embr rm [options] <file>\n"
+static const char* RM_USAGE =
+    "Usage: embr rm [options] <file>...\n"
+    "       embr rm [options] --from-list <list>\n"
     "\n"
     "Remove embeddings from tracking\n"
     "\n"
     "Options:\n"
-    "  --cached        Only remove from index, keep embedding files in storage\n"
+    "  --cached        Accepted for compatibility; objects are always kept\n"
     "  --all           Remove all embeddings for the specified file (all models)\n"
     "  -m, --model <model> Only remove embedding for specific model\n"
+    "  --from-list <list> Also remove the paths listed one per line ('-' for stdin)\n"
     "  --remote <name>  Also remove from the specified remote (only .parquet files)\n"
     "  -v, --verbose    Show detailed output\n"
     "  -q, --quiet      Minimal output\n"
     "\n"
+    "Removals are recorded as tombstones in the set index and log; run\n"
+    "'embr set compact' or 'embr gc' to fold them in. Objects stay in\n"
+    "storage, since other sets, layers, files or deltas may share them;\n"
+    "'embr gc' deletes the ones nothing references any more.\n"
+    "\n"
     "Examples:\n"
     "  embr rm file.txt              # Remove all embeddings for file.txt\n"
-    "  embr rm --cached file.txt     # Remove from index but keep embedding files\n"
     "  embr rm -m openai-3 file.txt  # Remove only embeddings for openai-3 model\n"
+    "  embr rm --from-list gone.txt  # Remove every path listed in gone.txt\n"
     "  embr rm --remote origin file.txt # Remove from local and remote 'origin'\n";
 
-// Forward declarations
-static bool is_file_tracked(const char* repo_root, const char* file_path);
-static int remove_from_index(const char* repo_root, const char* file_path, 
-                            const char* model, bool all);
-static int remove_embedding_files(const char* repo_root, const char* file_path,
-                                 const char* model, bool all, bool verbose);
-static int update_history_for_removal(const char* repo_root, const char* file_path, 
-                                     const char* model, bool all);
-
-// Helper function to convert file path to reference path
-static char* file_path_to_ref_path(const char* file_path) {
-    char* ref_path = strdup(file_path);
-    if (!ref_path) return NULL;
-    
-    // Replace all slashes with underscores
-    for (char* p = ref_path; *p; p++) {
-        if (*p == '/') *p = '_';
-    }
-    
-    return ref_path;
-}
+/* One (source, model) selected for removal */
+typedef struct {
+    char* source;
+    char* model;
+    char hash[65];
+} rm_entry_t;
 
-// Check if a file is tracked in the embedding index
-static bool is_file_tracked(const char* repo_root, const char* file_path) {
-    char* index_path = get_current_set_index_path();
-    printf("DEBUG: Checking if file '%s' is tracked in index '%s'\n", file_path, index_path ? index_path : "(null)");
-    FILE* index_file = index_path ? fopen(index_path, "r") : NULL;
-    if (!index_file) {
-        printf("DEBUG: Failed to open index file\n");
-        if (index_path) free(index_path);
-        return false;  // No index file
-    }
-    
-    char line[MAX_LINE_LEN];
-    bool found = false;
-    
-    while (fgets(line, sizeof(line), index_file)) {
-        // Remove newline
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
-        }
-        
-        printf("DEBUG: Index line: '%s'\n", line);
-        
-        char hash[65], path[MAX_PATH_LEN];
-        if (sscanf(line, "%s %s", hash, path) == 2) {
-            printf("DEBUG: Comparing '%s' with '%s'\n", path, file_path);
-            if (strcmp(path, file_path) == 0) {
-                found = true;
-                printf("DEBUG: Match found!\n");
-                break;
-            }
+typedef struct {
+    char** items;
+    size_t count;
+    size_t capacity;
+} path_list_t;
+
+typedef struct {
+    rm_entry_t* items;
+    size_t count;
+    size_t capacity;
+    const char* model;
+    bool all;
+    bool failed;
+} rm_list_t;
+
+static bool path_list_add(path_list_t* list, char* path) {
+    if (!path)
+        return false;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        char** items = realloc(list->items, capacity * sizeof(*items));
+        if (!items) {
+            free(path);
+            return false;
         }
+        list->items = items;
+        list->capacity = capacity;
     }
-    
-    fclose(index_file);
-    if (index_path) free(index_path);
-    return found;
+    list->items[list->count++] = path;
+    return true;
 }
 
-// Remove entries from the index file
-static int remove_from_index(const char* repo_root, const char* file_path, 
-                            const char* model, bool all) {
-    char* index_path = get_current_set_index_path();
-    printf("DEBUG: Opening index file: %s\n", index_path ? index_path : "(null)");
-    FILE* index_file = index_path ? fopen(index_path, "r") : NULL;
-    if (!index_file) {
-        cli_error("Failed to open index file: %s", index_path ? index_path : "(null)");
-        if (index_path) free(index_path);
+static void path_list_free(path_list_t* list) {
+    for (size_t i = 0; i < list->count; i++)
+        free(list->items[i]);
+    free(list->items);
+}
+
+static int compare_path(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static int compare_path_key(const void* key, const void* item) {
+    return strcmp(key, *(const char* const*)item);
+}
+
+/* Sort and drop repeated paths, so each is looked up once */
+static void path_list_unique(path_list_t* list) {
+    if (list->count < 2)
+        return;
+    qsort(list->items, list->count, sizeof(*list->items), compare_path);
+    size_t kept = 1;
+    for (size_t i = 1; i < list->count; i++) {
+        if (strcmp(list->items[i], list->items[kept - 1]) == 0)
+            free(list->items[i]);
+        else
+            list->items[kept++] = list->items[i];
+    }
+    list->count = kept;
+}
+
+/*
+ * Path relative to the repository root. A file already deleted from the
+ * working tree cannot be resolved, so a relative path is then taken as
+ * the tracked source itself.
+ */
+static char* resolve_path(const char* file, const char* repo_root) {
+    char* rel = get_relative_path(file, repo_root);
+    if (rel || file[0] == '/')
+        return rel;
+    while (strncmp(file, "./", 2) == 0)
+        file += 2;
+    return *file ? strdup(file) : NULL;
+}
+
+/* Add the paths of a list file, one per line */
+static int read_path_list(const char* list_path, const char* repo_root, path_list_t* paths) {
+    FILE* f = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+    if (!f) {
+        cli_error("Cannot open path list '%s': %s", list_path, strerror(errno));
         return 1;
     }
-    
-    // Read all lines
-    char** lines = NULL;
-    char** hashes = NULL;
-    char** matched_models = NULL;
-    int line_count = 0;
-    int removed = 0;
-    
-    char line[MAX_LINE_LEN];
-    while (fgets(line, sizeof(line), index_file)) {
-        // Remove newline
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
-        }
-        
-        char hash[65], path[MAX_PATH_LEN];
-        if (sscanf(line, "%s %s", hash, path) != 2) {
-            continue;  // Invalid line format
-        }
-        
-        // Check if this is for our file
-        if (strcmp(path, file_path) != 0) {
-            // Keep lines for other files
-            lines = realloc(lines, sizeof(char*) * (line_count + 1));
-            if (!lines) {
-                cli_error("Memory allocation failed");
-                fclose(index_file);
-                if (index_path) free(index_path);
-                return 1;
-            }
-            lines[line_count++] = strdup(line);
+
+    int ret = 0;
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+        char* rel = resolve_path(line, repo_root);
+        if (!rel) {
+            cli_warning("'%s' is outside the repository, skipping", line);
             continue;
         }
-        
-        // Get metadata to find model info
-        char meta_path[MAX_PATH_LEN];
-        snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", repo_root, hash);
-        
-        printf("DEBUG: Checking metadata: %s\n", meta_path);
-        
-        char* provider = NULL;
-        FILE* meta_file = fopen(meta_path, "r");
-        if (meta_file) {
-            char meta_line[MAX_LINE_LEN];
-            while (fgets(meta_line, sizeof(meta_line), meta_file)) {
-                // Remove newline
-                size_t meta_len = strlen(meta_line);
-                if (meta_len > 0 && meta_line[meta_len-1] == '\n') {
-                    meta_line[meta_len-1] = '\0';
-                }
-                
-                if (strncmp(meta_line, "model=", 6) == 0) {
-                    provider = strdup(meta_line + 6);
-                    printf("DEBUG: Found provider in metadata: %s\n", provider);
-                    break;
-                }
-            }
-            fclose(meta_file);
-        }
-        
-        // Determine if we should remove this entry
-        bool should_remove = false;
-        
-        if (all) {
-            should_remove = true;
-        } else if (model) {
-            // Normalize model comparison (strip off version numbers)
-            char* model_base = NULL;
-            char* provider_base = NULL;
-            
-            // Get base model name by stripping off version numbers
-            if (model) {
-                model_base = strdup(model);
-                char* dash = strchr(model_base, '-');
-                if (dash) *dash = '\0';
-            }
-            
-            if (provider) {
-                provider_base = strdup(provider);
-                char* dash = strchr(provider_base, '-');
-                if (dash) *dash = '\0';
-            }
-            
-            // Compare normalized model names
-            if (model_base && provider_base && 
-                (strcmp(model_base, provider_base) == 0 || 
-                 strcmp(model, provider) == 0)) {
-                should_remove = true;
-                printf("DEBUG: Model match found: %s ~ %s\n", model, provider);
-            }
-            
-            free(model_base);
-            free(provider_base);
-        }
-        
-        if (should_remove) {
-            printf("DEBUG: Will remove hash: %s (provider: %s)\n", hash, provider ? provider : "unknown");
-            
-            // Store hash for removal
-            hashes = realloc(hashes, sizeof(char*) * (removed + 1));
-            matched_models = realloc(matched_models, sizeof(char*) * (removed + 1));
-            if (!hashes || !matched_models) {
-                cli_error("Memory allocation failed");
-                fclose(index_file);
-                if (index_path) free(index_path);
-                if (provider) free(provider);
-                return 1;
-            }
-            
-            hashes[removed] = strdup(hash);
-            matched_models[removed] = provider ? provider : strdup("unknown");
-            removed++;
-        } else {
-            // Keep this line
-            lines = realloc(lines, sizeof(char*) * (line_count + 1));
-            if (!lines) {
-                cli_error("Memory allocation failed");
-                fclose(index_file);
-                if (index_path) free(index_path);
-                if (provider) free(provider);
-                return 1;
-            }
-            lines[line_count++] = strdup(line);
-            if (provider) free(provider);
+        if (!path_list_add(paths, rel)) {
+            cli_error("Memory allocation failed");
+            ret = 1;
+            break;
         }
     }
-    
-    fclose(index_file);
-    if (index_path) free(index_path);
-    
-    // If no lines were removed, nothing to do
-    if (removed == 0) {
-        cli_warning("No matching embeddings found to remove");
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    return ret;
+}
+
+// Check whether an index entry's model matches the requested one
+static bool model_matches(const char* model, const char* provider) {
+    if (!model || !provider || !*provider) {
+        return false;
+    }
+
+    // Normalize model comparison (strip off version numbers)
+    char* model_base = strdup(model);
+    char* provider_base = strdup(provider);
+    bool match = false;
+    if (model_base && provider_base) {
+        char* dash = strchr(model_base, '-');
+        if (dash) *dash = '\0';
+        dash = strchr(provider_base, '-');
+        if (dash) *dash = '\0';
+
+        // Compare normalized model names
+        match = strcmp(model_base, provider_base) == 0 || strcmp(model, provider) == 0;
+    }
+    free(model_base);
+    free(provider_base);
+    return match;
+}
+
+static int collect_rm_match(const char* source, const char* entry_model, const char* hash,
+                            void* data) {
+    rm_list_t* list = data;
+
+    if (!list->all && !model_matches(list->model, entry_model)) {
         return 0;
     }
-    
-    // Write back the updated index file
-    index_file = fopen(index_path, "w");
-    if (!index_file) {
-        cli_error("Failed to open index file for writing: %s", index_path ? index_path : "(null)");
-        if (index_path) free(index_path);
+
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        rm_entry_t* items = realloc(list->items, capacity * sizeof(*items));
+        if (!items) {
+            list->failed = true;
+            return 1;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    rm_entry_t* entry = &list->items[list->count];
+    entry->source = strdup(source);
+    entry->model = strdup(entry_model);
+    if (!entry->source || !entry->model) {
+        free(entry->source);
+        free(entry->model);
+        list->failed = true;
         return 1;
     }
-    
-    for (int i = 0; i < line_count; i++) {
-        fprintf(index_file, "%s\n", lines[i]);
-                free(lines[i]);
-            }
-            free(lines);
-            
-    fclose(index_file);
-    
-    // Remove the embedding files
-            for (int i = 0; i < removed; i++) {
-        // Remove from model refs
-        if (matched_models[i]) {
-            char* model_refs_dir = get_current_set_model_refs_dir();
-            if (!model_refs_dir) {
-                printf("DEBUG: Failed to get model refs dir for current set\n");
-            } else {
-                char model_ref_path[MAX_PATH_LEN];
-                snprintf(model_ref_path, sizeof(model_ref_path), "%s/%s", model_refs_dir, matched_models[i]);
-                free(model_refs_dir);
-                
-                printf("DEBUG: Checking model ref: %s\n", model_ref_path);
-                
-                FILE* model_ref = fopen(model_ref_path, "r");
-                if (model_ref) {
-                    char** ref_lines = NULL;
-                    int ref_count = 0;
-                    
-                    char ref_line[MAX_LINE_LEN];
-                    while (fgets(ref_line, sizeof(ref_line), model_ref)) {
-                        // Remove newline
-                        size_t ref_len = strlen(ref_line);
-                        if (ref_len > 0 && ref_line[ref_len-1] == '\n') {
-                            ref_line[ref_len-1] = '\0';
-                        }
-                        
-                        char ref_hash[65], ref_path[MAX_PATH_LEN];
-                        if (sscanf(ref_line, "%s %s", ref_hash, ref_path) == 2) {
-                            if (strcmp(ref_hash, hashes[i]) != 0 && strcmp(ref_path, file_path) != 0) {
-                                // Keep line if hash and path don't match
-                                ref_lines = realloc(ref_lines, sizeof(char*) * (ref_count + 1));
-                                if (ref_lines) {
-                                    ref_lines[ref_count++] = strdup(ref_line);
-                                }
-                            }
-                        }
-                    }
-                    
-                    fclose(model_ref);
-                    
-                    // Write updated model ref file
-                    model_ref = fopen(model_ref_path, "w");
-                    if (model_ref) {
-                        for (int j = 0; j < ref_count; j++) {
-                            fprintf(model_ref, "%s\n", ref_lines[j]);
-                            free(ref_lines[j]);
-                        }
-                        free(ref_lines);
-                        fclose(model_ref);
-                    }
-                }
-            }
-        }
-        
-        // Delete the object and metadata files directly
-        char obj_path[MAX_PATH_LEN];
-        snprintf(obj_path, sizeof(obj_path), "%s/.embr/objects/%s.raw", repo_root, hashes[i]);
-        char meta_path[MAX_PATH_LEN];
-        snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", repo_root, hashes[i]);
-        
-        printf("DEBUG: Removing object file: %s\n", obj_path);
-        if (unlink(obj_path) != 0 && errno != ENOENT) {
-            cli_warning("Failed to remove object file: %s", obj_path);
-        }
-        
-        printf("DEBUG: Removing metadata file: %s\n", meta_path);
-        if (unlink(meta_path) != 0 && errno != ENOENT) {
-            cli_warning("Failed to remove metadata file: %s", meta_path);
-        }
-        
-        free(hashes[i]);
-        free(matched_models[i]);
-    }
-    
-    free(hashes);
-    free(matched_models);
-    
+    snprintf(entry->hash, sizeof(entry->hash), "%s", hash);
+    list->count++;
     return 0;
 }
 
-// Remove embedding files from storage
-static int remove_embedding_files(const char* repo_root, const char* file_path,
-                                 const char* model, bool all, bool verbose) {
-    char* index_path = get_current_set_index_path();
-    FILE* index_file = index_path ? fopen(index_path, "r") : NULL;
-    if (!index_file) {
-        cli_error("Failed to open index file: %s", index_path ? index_path : "(null)");
-        if (index_path) free(index_path);
+static void rm_list_free(rm_list_t* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->items[i].source);
+        free(list->items[i].model);
+    }
+    free(list->items);
+}
+
+/* Append one tombstone line per removed entry */
+static int append_tombstones(const rm_list_t* list) {
+    char* log_path = get_current_set_log_path();
+    if (!log_path)
+        return 1;
+
+    FILE* f = fopen(log_path, "a");
+    if (!f) {
+        free(log_path);
         return 1;
     }
-    
-    int error_count = 0;
-    int removed_count = 0;
-    
-    char line[MAX_LINE_LEN];
-    while (fgets(line, sizeof(line), index_file)) {
-        // Remove newline
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
-        }
-        
-        char hash[65], path[MAX_PATH_LEN];
-        if (sscanf(line, "%s %s", hash, path) != 2) {
-            continue;  // Invalid line format
-        }
-        
-        // Check if this is for our file
-        if (strcmp(path, file_path) != 0) {
-            continue;  // Not our file
-        }
-        
-        // Get model for this hash from metadata
-        char hash_model[64] = {0};
-        
-        // Read metadata file to get model info
-        char meta_path[MAX_PATH_LEN];
-        snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", repo_root, hash);
-        
-        FILE* meta_file = fopen(meta_path, "r");
-        if (meta_file) {
-            char meta_line[MAX_LINE_LEN];
-            while (fgets(meta_line, sizeof(meta_line), meta_file)) {
-                // Remove newline
-                size_t meta_len = strlen(meta_line);
-                if (meta_len > 0 && meta_line[meta_len-1] == '\n') {
-                    meta_line[meta_len-1] = '\0';
-                }
-                
-                if (strncmp(meta_line, "model=", 6) == 0) {
-                    strncpy(hash_model, meta_line + 6, sizeof(hash_model) - 1);
-                    break;
-                }
-            }
-            fclose(meta_file);
+    long now = (long)time(NULL);
+    for (size_t i = 0; i < list->count; i++) {
+        const rm_entry_t* entry = &list->items[i];
+        if (entry->model[0])
+            fprintf(f, "%ld %s %s %s\n", now, EB_LOG_TOMBSTONE, entry->source, entry->model);
+        else
+            fprintf(f, "%ld %s %s\n", now, EB_LOG_TOMBSTONE, entry->source);
+    }
+    int ret = fclose(f) != 0;
+    if (ret == 0) {
+        eb_log_index_update(log_path);
+        eb_checkpoint_update(log_path);
+    }
+    free(log_path);
+    return ret;
+}
+
+static int compare_entry_model(const void* x, const void* y) {
+    const rm_entry_t* a = x;
+    const rm_entry_t* b = y;
+    int cmp = strcmp(a->model, b->model);
+    return cmp ? cmp : strcmp(a->source, b->source);
+}
+
+static int compare_entry_source(const void* key, const void* item) {
+    return strcmp(key, ((const rm_entry_t*)item)->source);
+}
+
+/* Rewrite refs/models/<model> once per model touched, dropping the removed sources */
+static void remove_model_refs(rm_list_t* list) {
+    char* model_refs_dir = get_current_set_model_refs_dir();
+    if (!model_refs_dir)
+        return;
+    qsort(list->items, list->count, sizeof(*list->items), compare_entry_model);
+
+    for (size_t start = 0, end; start < list->count; start = end) {
+        const char* model = list->items[start].model;
+        for (end = start + 1; end < list->count && strcmp(list->items[end].model, model) == 0; end++)
+            ;
+        if (!model[0])
+            continue;
+        const rm_entry_t* run = &list->items[start];
+        size_t run_count = end - start;
+
+        char ref_path[MAX_PATH_LEN], tmp_path[MAX_PATH_LEN + 16];
+        snprintf(ref_path, sizeof(ref_path), "%s/%s", model_refs_dir, model);
+        FILE* in = fopen(ref_path, "r");
+        if (!in)
+            continue;
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", ref_path);
+        FILE* out = fopen(tmp_path, "w");
+        if (!out) {
+            fclose(in);
+            cli_warning("Failed to update model reference file for %s", model);
+            continue;
         }
-        
-        // Determine if we should remove this file
-        bool should_remove = false;
-        
-        if (all) {
-            should_remove = true;
-        } else if (model) {
-            should_remove = (strcmp(hash_model, model) == 0);
+
+        char line[MAX_LINE_LEN];
+        while (fgets(line, sizeof(line), in)) {
+            char hash[65], source[MAX_PATH_LEN];
+            line[strcspn(line, "\n")] = '\0';
+            if (sscanf(line, "%64s %4095s", hash, source) == 2 &&
+                !bsearch(source, run, run_count, sizeof(*run), compare_entry_source))
+                fprintf(out, "%s\n", line);
         }
-        
-        if (should_remove) {
-            // Remove the object file
-            char obj_path[MAX_PATH_LEN];
-            snprintf(obj_path, sizeof(obj_path), "%s/.embr/objects/%s.raw", repo_root, hash);
-            
-            if (verbose) {
-                cli_info("Removing embedding object: %s", obj_path);
-            }
-            
-            if (unlink(obj_path) != 0) {
-                if (errno != ENOENT) {  // Ignore if file doesn't exist
-                    cli_warning("Failed to remove embedding file: %s", obj_path);
-                    error_count++;
-                }
-            } else {
-                removed_count++;
-            }
-            
-            // Remove metadata file
-            snprintf(obj_path, sizeof(obj_path), "%s/.embr/objects/%s.meta", repo_root, hash);
-            
-            if (unlink(obj_path) != 0 && errno != ENOENT) {
-                    cli_warning("Failed to remove metadata file: %s", obj_path);
-                    error_count++;
-                }
-            }
+        fclose(in);
+
+        // A rename, since refs may be hard linked into a set based on this one
+        if (fclose(out) != 0 || rename(tmp_path, ref_path) != 0) {
+            cli_warning("Failed to update model reference file for %s", model);
+            unlink(tmp_path);
         }
-        
-    fclose(index_file);
-    if (index_path) free(index_path);
-    
-    if (verbose) {
-        cli_info("Removed %d embedding objects with %d errors", removed_count, error_count);
-    }
-    
-    return (error_count > 0) ? 1 : 0;
+    }
+    free(model_refs_dir);
 }
 
-// Update history file to record the removal
-static int update_history_for_removal(const char* repo_root, const char* file_path, 
-                                     const char* model, bool all) {
-    // Git doesn't record removals in the log, so we'll follow that pattern
-    // Just return success without writing to the history file
+/* Remote .parquet names of the objects whose metadata names a removed path */
+struct parquet_match_ctx {
+    const path_list_t* paths;
+    const char** files;
+    size_t count;
+};
+
+static int collect_parquet_name(const char* hex_hash, const char* ext, const char* path,
+                                const struct stat* st, void* data) {
+    struct parquet_match_ctx* ctx = data;
+    (void)st;
+    if (strcmp(ext, "meta") != 0)
+        return 0;
+
+    FILE *meta = fopen(path, "r");
+    if (!meta)
+        return 0;
+    char meta_line[MAX_LINE_LEN];
+    int found = 0;
+    while (fgets(meta_line, sizeof(meta_line), meta)) {
+        if (strncmp(meta_line, "source=", 7) == 0) {
+            meta_line[strcspn(meta_line, "\n")] = '\0';
+            found = bsearch(meta_line + 7, ctx->paths->items, ctx->paths->count,
+                            sizeof(char*), compare_path_key) != NULL;
+            break;
+        }
+    }
+    fclose(meta);
+    if (!found)
+        return 0;
+
+    char *parquet_name = malloc(strlen(hex_hash) + 9); // .parquet + null
+    if (!parquet_name)
+        return 0;
+    sprintf(parquet_name, "%s.parquet", hex_hash);
+    const char **grown = realloc(ctx->files, sizeof(char*) * (ctx->count + 1));
+    if (!grown) {
+        free(parquet_name);
+        return 0;
+    }
+    ctx->files = grown;
+    ctx->files[ctx->count++] = parquet_name;
     return 0;
 }
 
+// Delete the .parquet files of the removed paths from a remote
+static int remove_from_remote(const char* repo_root, const char* remote,
+                              const path_list_t* paths, bool verbose) {
+    /* Determine current set name */
+    char set_name_buf[PATH_MAX];
+    if (get_current_set(set_name_buf, sizeof(set_name_buf)) != EB_SUCCESS) {
+        cli_error("Failed to determine current set name for remote deletion");
+        return 1;
+    }
+    char set_path[PATH_MAX + 6];  /* "sets/" + set name */
+    snprintf(set_path, sizeof(set_path), "sets/%s", set_name_buf);
+    if (eb_remote_init() != EB_SUCCESS) {
+        cli_error("Failed to initialize remote subsystem");
+        return 1;
+    }
+
+    // One pass over the objects for all the paths
+    struct parquet_match_ctx match = {
+        .paths = paths,
+        .files = NULL,
+        .count = 0
+    };
+    eb_object_foreach(repo_root, collect_parquet_name, &match);
+    if (match.count == 0) {
+        if (verbose)
+            cli_info("No .parquet files found for remote deletion");
+        return 0;
+    }
+
+    int ret = 0;
+    eb_status_t status = eb_remote_delete_files(remote, set_path, match.files, match.count);
+    if (status != EB_SUCCESS) {
+        cli_error("Failed to delete one or more .parquet files from remote '%s' (status %d)", remote, status);
+        ret = 1;
+    } else if (verbose) {
+        cli_info("Deleted %zu .parquet files from remote '%s'", match.count, remote);
+    }
+    for (size_t i = 0; i < match.count; ++i) free((void*)match.files[i]);
+    free(match.files);
+    return ret;
+}
+
 int cmd_rm(int argc, char *argv[])
 {
     if (argc < 2 || has_option(argc, argv, "-h") || has_option(argc, argv, "--help")) {
@@ -474,157 +423,153 @@ int cmd_rm(int argc, char *argv[])
         return (argc < 2) ? 1 : 0;
     }
 
-    const char *file = NULL;
-    
-    // Find the file argument (should be the last non-option argument)
+    // Parse options
+    bool all = false, verbose = false, quiet = false;
+    const char *model = NULL, *remote = NULL, *list_path = NULL;
+    const char **files = calloc(argc, sizeof(*files));
+    int file_count = 0;
+    if (!files) {
+        cli_error("Memory allocation failed");
+        return 1;
+    }
     for (int i = 1; i < argc; i++) {
-        if (argv[i][0] != '-' && (i == 1 || argv[i-1][0] != '-' || 
-                                   strcmp(argv[i-1], "-m") != 0 &&
-                                   strcmp(argv[i-1], "--model") != 0)) {
-            file = argv[i];
-            break;
+        const char* arg = argv[i];
+        if (strcmp(arg, "--cached") == 0) {
+            // Objects are left to gc either way
+        } else if (strcmp(arg, "--all") == 0) {
+            all = true;
+        } else if (strcmp(arg, "-v") == 0 || strcmp(arg, "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(arg, "-q") == 0 || strcmp(arg, "--quiet") == 0) {
+            quiet = true;
+        } else if ((strcmp(arg, "-m") == 0 || strcmp(arg, "--model") == 0) && i + 1 < argc) {
+            model = argv[++i];
+        } else if (strcmp(arg, "--remote") == 0 && i + 1 < argc) {
+            remote = argv[++i];
+        } else if (strcmp(arg, "--from-list") == 0 && i + 1 < argc) {
+            list_path = argv[++i];
+        } else if (arg[0] == '-') {
+            cli_error("Unknown option: %s", arg);
+            printf("%s", RM_USAGE);
+            free(files);
+            return 1;
+        } else {
+            files[file_count++] = arg;
         }
     }
-    
-    if (!file) {
+    // Without a model every embedding of the file goes
+    if (!model)
+        all = true;
+
+    if (file_count == 0 && !list_path) {
         printf("%s", RM_USAGE);
+        free(files);
         return 1;
     }
-    
-    // Parse options
-    bool cached = has_option(argc, argv, "--cached");
-    bool all = has_option(argc, argv, "--all");
-    bool verbose = has_option(argc, argv, "-v") || has_option(argc, argv, "--verbose");
-    bool quiet = has_option(argc, argv, "-q") || has_option(argc, argv, "--quiet");
-    const char *model = get_option_value(argc, argv, "-m", "--model");
-    const char *remote = get_option_value(argc, argv, NULL, "--remote");
-    
+
     // Find repository root
     char *repo_root = find_repo_root(".");
     if (!repo_root) {
         cli_error("Not in an eb repository");
+        free(files);
         return 1;
     }
-    
-    // Get relative path
-    char *rel_file = get_relative_path(file, repo_root);
-    if (!rel_file) {
-        cli_error("File must be within repository");
-        free(repo_root);
-        return 1;
-    }
-    
-    // Check if file is tracked
-    if (!is_file_tracked(repo_root, rel_file)) {
-        cli_error("File '%s' not tracked", rel_file);
-        free(repo_root);
-        free(rel_file);
-        return 1;
+
+    int ret = 0;
+    path_list_t paths = { 0 };
+    rm_list_t removed = { .model = model, .all = all };
+    for (int i = 0; i < file_count && ret == 0; i++) {
+        char *rel_file = resolve_path(files[i], repo_root);
+        if (!rel_file) {
+            cli_error("File must be within repository: %s", files[i]);
+            ret = 1;
+        } else if (!path_list_add(&paths, rel_file)) {
+            cli_error("Memory allocation failed");
+            ret = 1;
+        }
     }
-    
-    // Remove from index based on options
-    int ret = remove_from_index(repo_root, rel_file, model, all);
-    if (ret != 0) {
-        cli_error("Failed to remove from index");
-        free(repo_root);
-        free(rel_file);
-        return 1;
+    free(files);
+    if (ret == 0 && list_path)
+        ret = read_path_list(list_path, repo_root, &paths);
+    if (ret != 0)
+        goto cleanup;
+    path_list_unique(&paths);
+
+    // Select the entries of every path with a single index open
+    eb_set_index_t* index;
+    if (eb_set_index_open_current(repo_root, &index) != EB_SUCCESS) {
+        cli_error("Failed to open index file");
+        ret = 1;
+        goto cleanup;
     }
-    
-    // If not --cached, also remove embedding files
-    if (!cached) {
-        ret = remove_embedding_files(repo_root, rel_file, model, all, verbose);
-        if (ret != 0 && !quiet) {
-            cli_warning("Failed to remove some embedding files");
+    size_t skipped = 0;
+    for (size_t i = 0; i < paths.count && !removed.failed; i++) {
+        size_t before = removed.count;
+        eb_set_index_foreach(index, paths.items[i], collect_rm_match, &removed);
+        if (removed.count == before && !removed.failed) {
+            skipped++;
+            if (!quiet)
+                cli_warning("'%s' not tracked%s", paths.items[i], model ? " for this model" : "");
         }
     }
-    
-    // If --remote is specified, attempt remote deletion of .parquet files
-    int remote_error = 0;
-    if (remote) {
-        /* Determine current set name */
-        char set_name_buf[PATH_MAX];
-        if (get_current_set(set_name_buf, sizeof(set_name_buf)) != EB_SUCCESS) {
-            cli_error("Failed to determine current set name for remote deletion");
-            free(repo_root);
-            free(rel_file);
-            return 1;
-        }
-        char set_path[PATH_MAX + 6];  /* "sets/" + set name */
-        snprintf(set_path, sizeof(set_path), "sets/%s", set_name_buf);
-        // Build a list of .parquet files to delete
-        const char **parquet_files = NULL;
-        size_t parquet_count = 0;
-        DIR *d = opendir(".embr/objects");
-        if (d) {
-            struct dirent *entry;
-            while ((entry = readdir(d)) != NULL) {
-                size_t len = strlen(entry->d_name);
-                if (len > 5 && strcmp(entry->d_name + len - 5, ".meta") == 0) {
-                    char meta_path[MAX_PATH_LEN];
-                    snprintf(meta_path, sizeof(meta_path), ".embr/objects/%s", entry->d_name);
-                    FILE *meta = fopen(meta_path, "r");
-                    if (meta) {
-                        char meta_line[MAX_LINE_LEN];
-                        int found = 0;
-                        while (fgets(meta_line, sizeof(meta_line), meta)) {
-                            if (strncmp(meta_line, "source=", 7) == 0 &&
-                                strcmp(meta_line + 7, rel_file) == 0) {
-                                found = 1;
-                                break;
-                            }
-                        }
-                        fclose(meta);
-                        if (found) {
-                            char *hash = strndup(entry->d_name, len - 5);
-                            if (hash) {
-                                char *parquet_name = malloc(strlen(hash) + 9); // .parquet + null
-                                if (parquet_name) {
-                                    sprintf(parquet_name, "%s.parquet", hash);
-                                    parquet_files = realloc(parquet_files, sizeof(char*) * (parquet_count + 1));
-                                    if (parquet_files) {
-                                        parquet_files[parquet_count++] = parquet_name;
-                                    } else {
-                                        free(parquet_name);
-                                    }
-                                }
-                                free(hash);
-                            }
-                        }
-                    }
-                }
-            }
-            closedir(d);
-        }
-        if (parquet_count > 0 && parquet_files) {
-            eb_status_t status = eb_remote_delete_files(remote, set_path, parquet_files, parquet_count);
-            if (status != EB_SUCCESS) {
-                cli_error("Failed to delete one or more .parquet files from remote '%s' (status %d)", remote, status);
-                remote_error = 1;
-            } else if (verbose) {
-                cli_info("Deleted %zu .parquet files from remote '%s'", parquet_count, remote);
-            }
-            for (size_t i = 0; i < parquet_count; ++i) free((void*)parquet_files[i]);
-            free(parquet_files);
-        } else if (verbose) {
-            cli_info("No .parquet files found for remote deletion");
-        }
+    eb_set_index_close(index);
+    if (removed.failed) {
+        cli_error("Memory allocation failed");
+        ret = 1;
+        goto cleanup;
+    }
+    if (removed.count == 0) {
+        cli_error("No matching embeddings found to remove");
+        ret = 1;
+        goto cleanup;
+    }
+
+    // One index append and one log append for the whole batch
+    eb_set_index_change_t* changes = malloc(sizeof(*changes) * removed.count);
+    char* index_path = get_current_set_index_path();
+    if (!changes || !index_path) {
+        free(changes);
+        free(index_path);
+        cli_error("Memory allocation failed");
+        ret = 1;
+        goto cleanup;
     }
-    
-    // Update history file
-    update_history_for_removal(repo_root, rel_file, model, all);
-    
+    for (size_t i = 0; i < removed.count; i++)
+        changes[i] = (eb_set_index_change_t){ removed.items[i].source, removed.items[i].model, NULL };
+    eb_status_t status = eb_set_index_append(repo_root, index_path, changes, removed.count);
+    if (status == EB_SUCCESS && eb_hnsw_apply(repo_root, changes, removed.count) != EB_SUCCESS)
+        cli_warning("Failed to update vector index, run 'embr index build'");
+    free(changes);
+    free(index_path);
+    if (status != EB_SUCCESS) {
+        cli_error("Failed to update index file");
+        ret = 1;
+        goto cleanup;
+    }
+    if (append_tombstones(&removed) != 0)
+        cli_warning("Failed to record the removal in the set log");
+    remove_model_refs(&removed);
+
+    int remote_error = 0;
+    if (remote)
+        remote_error = remove_from_remote(repo_root, remote, &paths, verbose);
+
     if (!quiet) {
-        printf("Removed '%s' from embedding tracking\n", rel_file);
-        if (cached) {
-            printf("Embeddings remain in storage (--cached option used)\n");
-        }
+        if (paths.count - skipped == 1)
+            printf("Removed '%s' from embedding tracking\n", removed.items[0].source);
+        else
+            printf("Removed %zu files (%zu embeddings) from embedding tracking\n",
+                   paths.count - skipped, removed.count);
         if (remote && remote_error) {
             printf("Warning: Some remote deletions failed. See above.\n");
         }
     }
-    
+    if (remote_error)
+        ret = 2;
+
+cleanup:
+    rm_list_free(&removed);
+    path_list_free(&paths);
     free(repo_root);
-    free(rel_file);
-    return remote_error ? 2 : 0;
-} 
\ No newline at end of file
+    return ret;
+}
@@ -25,6 +25,10 @@
 #include "../core/debug.h"
 #include "../core/hash_utils.h"
 #include "../core/path_utils.h"
+#include "../core/object_path.h"
+#include "../core/set_index.h"
+#include "../core/hnsw.h"
+#include "../core/set_checkpoint.h"
 
 /* Function declarations */
 void cli_info(const char* format, ...);
@@ -39,8 +43,10 @@ void cli_info(const char* format, ...);
 
 static const char* ROLLBACK_USAGE =
     "Usage: embr rollback [options] <hash> <source>\n"
+    "       embr rollback --at <point>\n"
     "\n"
-    "Revert a source file's embedding to a previous hash.\n"
+    "Revert a source file's embedding to a previous hash, or the whole\n"
+    "current set to a point in its history.\n"
     "\n"
     "Arguments:\n"
     "  <hash>    Hash to rollback to\n"
@@ -48,11 +54,14 @@ static const char* ROLLBACK_USAGE =
     "\n"
     "Options:\n"
     "  --model <model>  Specify model to rollback (required for multi-model repos)\n"
+    "  --at <point>     Rollback every entry of the current set: a log entry\n"
+    "                   count, @<unix-time> or YYYY-MM-DD[ HH:MM[:SS]]\n"
     "\n"
     "Examples:\n"
     "  embr rollback eb82a9c file.txt                # Rollback file.txt to hash eb82a9c\n"
     "  embr rollback --model openai-3 eb82a9c file.txt  # Rollback OpenAI embedding to hash eb82a9c\n"
-    "  embr rollback --model voyage-2 4639f61 file.txt  # Rollback Voyage embedding to hash 4639f61\n";
+    "  embr rollback --model voyage-2 4639f61 file.txt  # Rollback Voyage embedding to hash 4639f61\n"
+    "  embr rollback --at \"2024-03-01 09:00\"          # The current set as it stood then\n";
 
 /* Find repository root directory */
 static eb_status_t find_repo_root_path(char* root_path, size_t size) 
@@ -175,13 +184,8 @@ static bool hash_in_history(const char* repo_root, const char* source_file, cons
 
 /* Helper function to update the index file for a specific source file and hash */
 static eb_status_t update_index_entry(const char* repo_root, const char* source_file, const char* hash_to_rollback, const char* model) {
-        char* index_path = get_current_set_index_path();
-        if (!index_path) {
-                DEBUG_PRINT("Could not get per-set index path\n");
-                return EB_ERROR_FILE_IO;
-        }
-        DEBUG_PRINT("update_index_entry: repo_root=%s, source_file=%s, hash_to_rollback=%s, index_path=%s, model=%s\n",
-                   repo_root, source_file, hash_to_rollback, index_path, model ? model : "(null)");
+        DEBUG_PRINT("update_index_entry: repo_root=%s, source_file=%s, hash_to_rollback=%s, model=%s\n",
+                   repo_root, source_file, hash_to_rollback, model ? model : "(null)");
 
         // Convert absolute source path to relative path
         const char* rel_source = source_file;
@@ -191,110 +195,25 @@ static eb_status_t update_index_entry(const char* repo_root, const char* source_
                 if (*rel_source == '/') rel_source++; // Skip leading slash
         }
 
-        // Read current index content
-        FILE* fp = fopen(index_path, "r");
-        if (!fp) {
-                free(index_path);
-                return EB_ERROR_FILE_IO;
-        }
-
-        // Store all lines except the one we want to update
-        char** lines = NULL;
-        size_t line_count = 0;
-        char line[2048];
-
-        DEBUG_PRINT("update_index_entry: Original index content:\n");
-        while (fgets(line, sizeof(line), fp)) {
-                DEBUG_PRINT("%s", line);
-                line[strcspn(line, "\n")] = 0;
-
-                char file[PATH_MAX], hash[65];
-                if (sscanf(line, "%s %s", hash, file) == 2) {
-                        // If specific model is provided, check if this hash is for a different model
-                        bool should_keep = false;
-                        
-                        if (strcmp(file, rel_source) != 0) {
-                                // Different file, always keep
-                                should_keep = true;
-                        } else if (model) {
-                                // Same file but need to check if it's for a different model
-                                char meta_path[PATH_MAX];
-                                snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", repo_root, hash);
-                                
-                                FILE* meta_fp = fopen(meta_path, "r");
-                                if (meta_fp) {
-                                        char meta_line[1024];
-                                        bool found_model = false;
-                                        
-                                        while (fgets(meta_line, sizeof(meta_line), meta_fp)) {
-                                                if (strncmp(meta_line, "model=", 6) == 0) {
-                                                        char hash_model[32];
-                                                        sscanf(meta_line + 6, "%s", hash_model);
-                                                        
-                                                        // Keep if models are different
-                                                        if (strcmp(hash_model, model) != 0) {
-                                                                should_keep = true;
-                                                                DEBUG_PRINT("update_index_entry: Keeping entry for different model: %s\n", hash_model);
-                                                        }
-                                                        found_model = true;
-                                                        break;
-                                                }
-                                        }
-                                        fclose(meta_fp);
-                                        
-                                        // If we didn't find a model, keep it to be safe
-                                        if (!found_model) {
-                                                should_keep = true;
-                                        }
-                                } else {
-                                        // Couldn't open metadata, keep to be safe
-                                        should_keep = true;
-                                }
-                        }
-                        
-                        if (should_keep) {
-                                lines = realloc(lines, (line_count + 1) * sizeof(char*));
-                                if (!lines) {
-                                        fclose(fp);
-                                        free(index_path);
-                                        return EB_ERROR_MEMORY_ALLOCATION;
-                                }
-                                lines[line_count] = strdup(line);
-                                line_count++;
-                        }
-                }
-        }
-        fclose(fp);
-
-        // Write updated index
-        fp = fopen(index_path, "w");
-        if (!fp) {
-                for (size_t i = 0; i < line_count; i++) {
-                        free(lines[i]);
-                }
-                free(lines);
-                free(index_path);
-                return EB_ERROR_FILE_IO;
-        }
-
-        DEBUG_PRINT("update_index_entry: New index content to write:\n");
-
-        // Write back all lines for other files
-        for (size_t i = 0; i < line_count; i++) {
-                fprintf(fp, "%s\n", lines[i]);
-                DEBUG_PRINT("%s\n", lines[i]);
-                free(lines[i]);
+        /*
+         * With a model only that model's entry is replaced, entries for
+         * other models stay. Without one the file is reset to this hash.
+         */
+        eb_set_index_change_t changes[2];
+        size_t count = 0;
+        if (!model)
+                changes[count++] = (eb_set_index_change_t){ rel_source, NULL, NULL };
+        changes[count++] = (eb_set_index_change_t){ rel_source, model, hash_to_rollback };
+
+        eb_status_t status = eb_set_index_apply_current(repo_root, changes, count);
+        if (status != EB_SUCCESS) {
+                DEBUG_PRINT("update_index_entry: Failed to update index: %d\n", status);
+                return status;
         }
-        free(lines);
-
-        // Write the updated entry
-        fprintf(fp, "%s %s\n", hash_to_rollback, rel_source);
-        DEBUG_PRINT("%s %s\n", hash_to_rollback, rel_source);
+        if (eb_hnsw_apply(repo_root, changes, count) != EB_SUCCESS)
+                cli_warning("Failed to update vector index, run 'embr index build'");
 
-        fclose(fp);
-        DEBUG_PRINT("update_index_entry: Index file updated successfully.\n");
-
-        free(index_path);
+        DEBUG_PRINT("update_index_entry: Index updated: %s %s\n", hash_to_rollback, rel_source);
         return EB_SUCCESS;
 }
 
@@ -786,6 +705,45 @@ static eb_status_t resolve_hash(
     return EB_ERROR_NOT_FOUND;
 }
 
+/* Restore the current set to a point: one checkpoint load, a tail replay, then the differences */
+static int rollback_set(const char* point) {
+    eb_set_point_t at;
+    if (eb_set_point_parse(point, &at) != EB_SUCCESS) {
+        fprintf(stderr, "Error: Not a point in history: %s\n", point);
+        return 1;
+    }
+
+    char repo_root[PATH_MAX];
+    if (find_repo_root_path(repo_root, sizeof(repo_root)) != EB_SUCCESS) {
+        fprintf(stderr, "Error: Not in an embedding-bridge repository.\n");
+        return 1;
+    }
+    char* log_path = get_current_set_log_path();
+    if (!log_path) {
+        fprintf(stderr, "Error: Could not determine the current set.\n");
+        return 1;
+    }
+    char set_dir[PATH_MAX];
+    snprintf(set_dir, sizeof(set_dir), "%.*s", (int)(strrchr(log_path, '/') - log_path), log_path);
+
+    eb_set_state_t state;
+    eb_set_restore_summary_t summary;
+    eb_status_t status = eb_set_state_at(log_path, &at, &state);
+    free(log_path);
+    if (status == EB_SUCCESS) {
+        status = eb_set_state_restore(repo_root, set_dir, &state, &summary);
+        DEBUG_PRINT("rollback_set: Replayed %llu of %llu log entries\n",
+                    (unsigned long long)state.replayed, (unsigned long long)state.seq);
+        eb_set_state_free(&state);
+    }
+    if (status != EB_SUCCESS) {
+        fprintf(stderr, "Error: Failed to roll back the set, status=%d\n", status);
+        return 1;
+    }
+    printf("Rolled back to %s: %zu restored, %zu removed\n", point, summary.restored, summary.removed);
+    return 0;
+}
+
 /* Main rollback command handler */
 int cmd_rollback(int argc, char** argv) {
     char repo_root[PATH_MAX];
@@ -802,7 +760,9 @@ int cmd_rollback(int argc, char** argv) {
     // Skip the command name (argv[0] is "rollback")
     for (int i = 1; i < argc; i++) {
         DEBUG_PRINT("cmd_rollback: argv[%d] = '%s'\n", i, argv[i]);
-        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+        if (strcmp(argv[i], "--at") == 0 && i + 1 < argc) {
+            return rollback_set(argv[i + 1]);
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
             model = argv[++i];
             DEBUG_PRINT("cmd_rollback: Found model argument: %s\n", model);
         } else if (hash == NULL) {
@@ -913,8 +873,10 @@ int cmd_rollback(int argc, char** argv) {
                         fclose(model_read_fp);
                     }
                     
-                    // Write updated model reference file
-                    FILE* model_fp = fopen(model_ref_path, "w");
+                    // Write updated model reference file; replaced by rename, it may be shared with another set
+                    char temp_ref_path[PATH_MAX + 8];
+                    snprintf(temp_ref_path, sizeof(temp_ref_path), "%s.tmp", model_ref_path);
+                    FILE* model_fp = fopen(temp_ref_path, "w");
                     if (!model_fp) {
                         DEBUG_PRINT("cmd_rollback: Warning: Failed to create model reference file for %s\n", model);
                         fprintf(stderr, "Warning: Failed to update model reference file\n");
@@ -937,8 +899,12 @@ int cmd_rollback(int argc, char** argv) {
                         // Add the new file entry with relative path
                         fprintf(model_fp, "%s %s\n", full_hash, rel_source_path);
                         
-                        fclose(model_fp);
-                        DEBUG_PRINT("cmd_rollback: Successfully updated model ref file for %s\n", model);
+                        if (fclose(model_fp) != 0 || rename(temp_ref_path, model_ref_path) != 0) {
+                            unlink(temp_ref_path);
+                            fprintf(stderr, "Warning: Failed to update model reference file\n");
+                        } else {
+                            DEBUG_PRINT("cmd_rollback: Successfully updated model ref file for %s\n", model);
+                        }
                     }
                 }
             }
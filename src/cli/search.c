@@ -0,0 +1,348 @@
+/*
+ * EmbeddingBridge - Search CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "cli.h"
+#include "set.h"
+#include "../core/hnsw.h"
+#include "../core/quantize.h"
+#include "../core/set_index.h"
+#include "../core/set_scan.h"
+#include "../core/hash_utils.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+#define MAX_K 10000
+
+static const char* SEARCH_USAGE =
+    "usage: embr search [options] <query-file>\n"
+    "\n"
+    "Find the stored embeddings closest to a query vector\n"
+    "\n"
+    "Searches the index of the current set, see 'embr index build'. The\n"
+    "query is a .npy file or raw float32 values like 'embr store' takes.\n"
+    "Results are ranked by cosine similarity.\n"
+    "\n"
+    "With --mode scan no index is needed: a compact int8 or sign-bit copy\n"
+    "of the set's vectors is scanned and the best candidates are re-ranked\n"
+    "exactly. The copy is kept under .embr/sets/<set>/scan and rewritten\n"
+    "when the set has changed since it was made.\n"
+    "\n"
+    "Options:\n"
+    "  -k, --k <count>        Results to show (default: 10)\n"
+    "  --ef <count>           Search breadth, higher is slower but more exact (default: 64)\n"
+    "  -m, --model <name>     Model to search, needed if several have the query's dimensions\n"
+    "  --mode <hnsw|scan>     Search the index or scan the vectors (default: hnsw)\n"
+    "  --codes <int8|binary>  Codes a scan compares first (default: int8)\n"
+    "  --rerank <count>       Scan candidates re-ranked exactly (default: 8 per result\n"
+    "                         for int8, 32 for binary)\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr search query.npy\n"
+    "  embr search --k 5 --model openai-3 query.npy\n"
+    "  embr search --mode scan --codes binary --rerank 2000 query.npy\n";
+
+static bool parse_count(const char* value, size_t* out) {
+    char* end = NULL;
+    unsigned long long n = strtoull(value, &end, 10);
+    if (!value[0] || *end || n == 0 || n > MAX_K)
+        return false;
+    *out = (size_t)n;
+    return true;
+}
+
+static void* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    struct stat st;
+    void* data = NULL;
+    if (fstat(fileno(f), &st) == 0 && st.st_size > 0) {
+        data = malloc((size_t)st.st_size);
+        if (data && fread(data, 1, (size_t)st.st_size, f) != (size_t)st.st_size) {
+            free(data);
+            data = NULL;
+        }
+        *size = (size_t)st.st_size;
+    }
+    fclose(f);
+    return data;
+}
+
+/* Distinct models of the set, stopping at a second one */
+typedef struct {
+    char model[256];
+    size_t count;
+} set_models_t;
+
+static int collect_model(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    (void)hash;
+    set_models_t* models = ctx;
+    if (models->count == 0 || strcmp(models->model, model) != 0) {
+        if (models->count++ == 0)
+            snprintf(models->model, sizeof(models->model), "%s", model);
+    }
+    return models->count > 1;
+}
+
+/* Scan the current set's vectors with eb_set_scan(), checking the rows are still current */
+static int search_scan(const char* repo_root, eb_set_index_t* set_index, const float* query,
+                       size_t dims, size_t k, const char* model, const eb_scan_options_t* options) {
+    char set_name[256];
+    set_models_t models = { "", 0 };
+    if (get_current_set(set_name, sizeof(set_name)) != EB_SUCCESS) {
+        cli_error("Cannot determine the current set");
+        return 1;
+    }
+    if (!model) {
+        eb_status_t status = eb_set_index_foreach(set_index, NULL, collect_model, &models);
+        if (status != EB_SUCCESS) {
+            handle_error(status, "Failed to read set index");
+            return 1;
+        }
+        if (models.count == 0) {
+            printf("No matches\n");
+            return 0;
+        }
+        if (models.count > 1) {
+            cli_error("Set %s has several models; pick one with --model", set_name);
+            return 1;
+        }
+        model = models.model;
+    }
+
+    eb_set_matrix_t matrix;
+    eb_status_t status = eb_set_scan_open(repo_root, set_name, model, 0, &matrix, NULL);
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to prepare the scan");
+        return 1;
+    }
+    eb_scan_match_t* matches = malloc(k * sizeof(*matches));
+    size_t count = 0;
+    status = matches ? eb_set_scan(&matrix, query, dims, k, options, matches, &count)
+                     : EB_ERROR_MEMORY_ALLOCATION;
+    int ret = 1;
+    if (status == EB_ERROR_DIMENSION_MISMATCH) {
+        cli_error("Model %s does not use %zu-dimensional vectors", *model ? model : "(none)", dims);
+    } else if (status != EB_SUCCESS) {
+        handle_error(status, "Search failed");
+    } else {
+        // Entries changed after the scan copy was made are left out
+        size_t shown = 0;
+        for (size_t i = 0; i < count; i++) {
+            char hash[65], current[65], short_hash[8];
+            const char* source = eb_set_matrix_source(&matrix, matches[i].row);
+            eb_hash_to_hex(matrix.table[matches[i].row].hash, hash);
+            if (eb_set_index_lookup(set_index, source, model, current) != EB_SUCCESS ||
+                strcmp(current, hash) != 0)
+                continue;
+            printf("%3zu  %.4f  %s  %s\n", ++shown, 1.0f - matches[i].distance,
+                   get_short_hash(hash, short_hash), source);
+        }
+        if (shown == 0)
+            printf("No matches\n");
+        ret = 0;
+    }
+    free(matches);
+    eb_set_matrix_close(&matrix);
+    return ret;
+}
+
+/* Models whose graphs take queries of the given dimensions */
+typedef struct {
+    size_t dims;
+    char model[256];
+    size_t matches;
+} model_choice_t;
+
+static int choose_model(const eb_hnsw_info_t* info, void* ctx) {
+    model_choice_t* choice = ctx;
+    if (info->dims == choice->dims && info->nodes > info->deleted) {
+        if (choice->matches++ == 0)
+            snprintf(choice->model, sizeof(choice->model), "%s", info->model);
+    }
+    return 0;
+}
+
+int cmd_search(int argc, char** argv) {
+    if (argc < 2 || has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", SEARCH_USAGE);
+        return argc < 2 ? 1 : 0;
+    }
+
+    size_t k = 10;
+    size_t ef = 0;
+    const char* model = NULL;
+    const char* query_path = NULL;
+    bool scan = false;
+    eb_scan_options_t scan_options = { EB_SCAN_INT8, 0, NULL, 0 };
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool takes_value = strcmp(arg, "-k") == 0 || strcmp(arg, "--k") == 0 ||
+                           strcmp(arg, "--ef") == 0 || strcmp(arg, "-m") == 0 ||
+                           strcmp(arg, "--model") == 0 || strcmp(arg, "--mode") == 0 ||
+                           strcmp(arg, "--codes") == 0 || strcmp(arg, "--rerank") == 0;
+        if (takes_value) {
+            if (++i >= argc) {
+                cli_error("Missing value for %s", arg);
+                return 1;
+            }
+            if ((arg[1] == 'k' || strcmp(arg, "--k") == 0) && !parse_count(argv[i], &k)) {
+                cli_error("Invalid result count: %s", argv[i]);
+                return 1;
+            }
+            if (strcmp(arg, "--ef") == 0 && !parse_count(argv[i], &ef)) {
+                cli_error("Invalid search breadth: %s", argv[i]);
+                return 1;
+            }
+            if (strcmp(arg, "-m") == 0 || strcmp(arg, "--model") == 0)
+                model = argv[i];
+            if (strcmp(arg, "--mode") == 0) {
+                if (strcmp(argv[i], "scan") != 0 && strcmp(argv[i], "hnsw") != 0) {
+                    cli_error("Unknown search mode: %s", argv[i]);
+                    return 1;
+                }
+                scan = strcmp(argv[i], "scan") == 0;
+            }
+            if (strcmp(arg, "--codes") == 0) {
+                if (strcmp(argv[i], "int8") != 0 && strcmp(argv[i], "binary") != 0) {
+                    cli_error("Unknown codes: %s", argv[i]);
+                    return 1;
+                }
+                scan_options.codes = strcmp(argv[i], "binary") == 0 ? EB_SCAN_BINARY : EB_SCAN_INT8;
+            }
+            if (strcmp(arg, "--rerank") == 0 && !parse_count(argv[i], &scan_options.candidates)) {
+                cli_error("Invalid candidate count: %s", argv[i]);
+                return 1;
+            }
+        } else if (arg[0] == '-') {
+            cli_error("Unknown option: %s", arg);
+            return 1;
+        } else if (query_path) {
+            cli_error("Only one query file can be given");
+            return 1;
+        } else {
+            query_path = arg;
+        }
+    }
+    if (!query_path) {
+        cli_error("No query file given");
+        fprintf(stderr, "%s", SEARCH_USAGE);
+        return 1;
+    }
+
+    size_t size = 0;
+    void* payload = read_file(query_path, &size);
+    if (!payload) {
+        cli_error("Cannot read query file: %s", query_path);
+        return 1;
+    }
+    const float* query = NULL;
+    size_t dims = 0;
+    if (eb_float_payload(payload, size, &query, &dims) != EB_SUCCESS || dims == 0) {
+        cli_error("Query must hold float32 values: %s", query_path);
+        free(payload);
+        return 1;
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        cli_error("Not in an eb repository");
+        free(payload);
+        return 1;
+    }
+
+    int ret = 1;
+    eb_hnsw_t* index = NULL;
+    eb_set_index_t* set_index = NULL;
+    eb_hnsw_match_t* matches = NULL;
+    model_choice_t choice = { dims, "", 0 };
+
+    if (scan) {
+        eb_status_t status = eb_set_index_open_current(repo_root, &set_index);
+        if (status != EB_SUCCESS) {
+            handle_error(status, "Failed to open set index");
+            goto cleanup;
+        }
+        ret = search_scan(repo_root, set_index, query, dims, k, model, &scan_options);
+        goto cleanup;
+    }
+
+    if (!model) {
+        eb_status_t status = eb_hnsw_foreach(repo_root, choose_model, &choice);
+        if (status == EB_ERROR_NOT_FOUND || (status == EB_SUCCESS && choice.matches == 0)) {
+            cli_error("No index for %zu-dimensional vectors; run 'embr index build' or use --mode scan",
+                      dims);
+            goto cleanup;
+        }
+        if (status != EB_SUCCESS) {
+            handle_error(status, "Failed to read index");
+            goto cleanup;
+        }
+        if (choice.matches > 1) {
+            cli_error("Several models have %zu dimensions; pick one with --model", dims);
+            goto cleanup;
+        }
+        model = choice.model;
+    }
+
+    eb_status_t status = eb_hnsw_open(repo_root, model, &index);
+    if (status == EB_ERROR_NOT_FOUND) {
+        cli_error("No index for model %s; run 'embr index build' or use --mode scan", model);
+        goto cleanup;
+    }
+    if (status == EB_SUCCESS)
+        status = eb_set_index_open_current(repo_root, &set_index);
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to open index");
+        goto cleanup;
+    }
+
+    // Fetch more than k so entries changed since the index was updated can be dropped
+    size_t wanted = ef > k ? ef : k;
+    matches = malloc(wanted * sizeof(*matches));
+    size_t count = 0;
+    status = matches ? eb_hnsw_search(index, query, dims, wanted, ef, matches, &count)
+                     : EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_ERROR_DIMENSION_MISMATCH) {
+        cli_error("Model %s does not use %zu-dimensional vectors", model, dims);
+        goto cleanup;
+    }
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Search failed");
+        goto cleanup;
+    }
+
+    size_t shown = 0;
+    for (size_t i = 0; i < count && shown < k; i++) {
+        char current[65], short_hash[8];
+        if (eb_set_index_lookup(set_index, matches[i].source, model, current) != EB_SUCCESS ||
+            strcmp(current, matches[i].hash) != 0)
+            continue;
+        printf("%3zu  %.4f  %s  %s\n", ++shown, 1.0f - matches[i].distance,
+               get_short_hash(matches[i].hash, short_hash), matches[i].source);
+    }
+    if (shown == 0)
+        printf("No matches\n");
+    ret = 0;
+
+cleanup:
+    free(matches);
+    eb_set_index_close(set_index);
+    eb_hnsw_close(index);
+    free(repo_root);
+    free(payload);
+    return ret;
+}
@@ -0,0 +1,131 @@
+/*
+ * EmbeddingBridge - Serve CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cli.h"
+#include "../core/serve.h"
+#include "../core/daemon.h"
+#include "../core/remote.h"
+#include "../core/embedding.h"
+#include "../core/path_utils.h"
+#include "../core/error.h"
+
+static const char* SERVE_USAGE =
+    "usage: embr serve <root>\n"
+    "   or: embr serve --daemon [<root>]\n"
+    "\n"
+    "Serve remote objects below <root> over standard input and output\n"
+    "\n"
+    "This is the remote end of ssh remotes and is normally started by\n"
+    "push, pull and the other remote commands through ssh, not by hand.\n"
+    "Requests and objects travel as frames over the one connection, so any\n"
+    "number of objects are streamed without a round trip per object.\n"
+    "\n"
+    "With --daemon, keep the repository's remotes and model registry loaded\n"
+    "and run status, get, diff, search and store for it, which then skip\n"
+    "their startup. The daemon listens on .embr/serve.sock until interrupted\n"
+    "and picks up changes to the config and registry before each command.\n"
+    "Set EMBR_NO_DAEMON=1 to run a command without it.\n"
+    "\n"
+    "Options:\n"
+    "  --daemon               Serve commands of the repository (default: current)\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  ssh host embr serve /srv/embeddings   # What an ssh remote runs\n"
+    "  embr serve --daemon &                 # Keep this repository warm\n";
+
+/* Files whose changes the warm daemon state must follow */
+#define WARM_CONFIG ".embr/config"
+#define WARM_REGISTRY ".embr/metadata/models/registry.json"
+
+typedef struct {
+    bool loaded;
+    struct stat config;
+    struct stat registry;
+} warm_state_t;
+
+static bool file_changed(const char* path, struct stat* last) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        memset(&st, 0, sizeof(st));
+    bool changed = st.st_mtim.tv_sec != last->st_mtim.tv_sec ||
+                   st.st_mtim.tv_nsec != last->st_mtim.tv_nsec ||
+                   st.st_size != last->st_size || st.st_ino != last->st_ino;
+    *last = st;
+    return changed;
+}
+
+/* Runs in the daemon, which is in the repository root */
+static void warm_refresh(const char* root, void* ctx) {
+    (void)root;
+    warm_state_t* warm = ctx;
+    bool config_changed = file_changed(WARM_CONFIG, &warm->config);
+    bool registry_changed = file_changed(WARM_REGISTRY, &warm->registry);
+
+    if (!warm->loaded || config_changed) {
+        if (warm->loaded)
+            eb_remote_shutdown();
+        eb_status_t status = eb_remote_init();
+        if (status != EB_SUCCESS)
+            fprintf(stderr, "embr serve: cannot load remotes: %s\n", eb_status_str(status));
+    }
+    if (!warm->loaded || registry_changed) {
+        eb_cleanup_registry();
+        eb_is_model_registered("");
+    }
+    warm->loaded = true;
+}
+
+/* Runs in the forked child, in the client's working directory */
+static int warm_run(int argc, char** argv, void* ctx) {
+    (void)ctx;
+    return run_cli_command(argc, argv);
+}
+
+static int serve_daemon(const char* path) {
+    char* root = find_repo_root(path);
+    if (!root) {
+        fprintf(stderr, "embr serve: not an embr repository: %s\n", path);
+        return 1;
+    }
+
+    warm_state_t warm = {0};
+    eb_daemon_ops_t ops = { warm_refresh, warm_run, &warm };
+    eb_status_t status = eb_daemon_serve(root, &ops);
+    if (status == EB_ERROR_ALREADY_EXISTS)
+        fprintf(stderr, "embr serve: a daemon already serves %s\n", root);
+    else if (status != EB_SUCCESS)
+        fprintf(stderr, "embr serve: %s\n", eb_status_str(status));
+    free(root);
+    return status == EB_SUCCESS ? 0 : 1;
+}
+
+int cmd_serve(int argc, char** argv) {
+    if (argc >= 2 && argc <= 3 && strcmp(argv[1], "--daemon") == 0)
+        return serve_daemon(argc == 3 ? argv[2] : ".");
+
+    if (argc != 2 || has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        /* stdout belongs to the protocol once serving, so usage goes to stderr on misuse */
+        fprintf(argc == 2 ? stdout : stderr, "%s", SERVE_USAGE);
+        return argc == 2 ? 0 : 1;
+    }
+
+    eb_status_t status = eb_serve(argv[1], STDIN_FILENO, STDOUT_FILENO);
+    if (status != EB_SUCCESS) {
+        fprintf(stderr, "embr serve: %s\n", eb_status_str(status));
+        return 1;
+    }
+    return 0;
+}
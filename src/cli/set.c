@@ -13,6 +13,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -25,6 +26,14 @@
 #include "../core/error.h"
 #include "../core/debug.h"
 #include "../core/store.h"
+#include "../core/set_drift.h"
+#include "../core/set_snapshot.h"
+#include "../core/set_layers.h"
+#include "../core/set_checkpoint.h"
+#include "../core/set_compact.h"
+#include "../core/set_sketch.h"
+#include "../core/pinecone_export.h"
+#include "../core/set_matrix.h"
 #include "colors.h"
 
 #define SET_DIR ".embr/sets"
@@ -41,19 +50,48 @@ static const char* SET_USAGE =
     "Operations:\n"
     "  embr set                   List all sets\n"
     "  embr set <set-name>        Create a new set\n"
+    "  embr set -b <base> <set-name>\n"
+    "                             Create a set holding everything in <base>\n"
+    "  embr set flatten [<set-name>]\n"
+    "                             Copy the history a set shares with its base\n"
+    "                             into the set itself\n"
+    "  embr set compact [<set-name>]\n"
+    "                             Fold the removals recorded by 'embr rm' into\n"
+    "                             a set's index and log\n"
+    "  embr set checkout --at <point> [--from <set>] [<new-set>]\n"
+    "                             Show a set as it stood at a point in its\n"
+    "                             history, or create <new-set> holding that\n"
     "  embr set -d <set-name>     Delete a set\n"
+    "  embr set diff --vectors <set-a> <set-b>\n"
+    "                             Compare the vectors of two sets\n"
+    "  embr set stats [<set-name>] [--against <set>]\n"
+    "                             Summarize a set's vectors per model, or\n"
+    "                             estimate their drift from another set\n"
+    "  embr set snapshot [<set-name>] [--lz4]\n"
+    "                             Write the vectors of a set as Arrow IPC files\n"
+    "  embr set export -o <dir> [<set-name>]\n"
+    "                             Write a set as Pinecone upsert batches\n"
+    "  embr set export --mmap <file> [<set-name>]\n"
+    "                             Write a set as one mappable float matrix\n"
     "\n"
     "Options:\n"
     "  -h, --help               Show this help message\n"
     "  -d, --delete <set-name>  Delete a set\n"
+    "  -b, --base <set-name>    Start a new set from an existing one; the base's\n"
+    "                           history is shared, not copied\n"
     "  -v, --verbose            Show detailed information\n"
     "  -f, --force              Force operation (for delete)\n"
     "\n"
     "Examples:\n"
     "  embr set                   # List all sets\n"
     "  embr set my-feature        # Create a new set named \"my-feature\"\n"
+    "  embr set -b main trial     # New set \"trial\" starting from \"main\"\n"
     "  embr set -v                # List sets with details\n"
     "  embr set -d my-feature     # Delete a set\n"
+    "  embr set diff --vectors main experimental\n"
+    "  embr set snapshot main     # Mappable vectors under .embr/snapshots/main\n"
+    "  embr set checkout --at 2024-03-01 march\n"
+    "                             # New set \"march\" as the current set stood then\n"
     "\n"
     "Run 'embr switch <set-name>' to switch between sets\n"
     "Run 'embr merge <source-set>' to merge sets\n"
@@ -64,6 +102,42 @@ static int handle_create(int argc, char** argv);
 static int handle_list(int argc, char** argv);
 static int handle_switch(int argc, char** argv);
 static int handle_diff(int argc, char** argv);
+static int handle_snapshot(int argc, char** argv);
+static int handle_export(int argc, char** argv);
+static int handle_flatten(int argc, char** argv);
+static int handle_checkout(int argc, char** argv);
+static int handle_compact(int argc, char** argv);
+static int handle_stats(int argc, char** argv);
+
+static const char* SET_DIFF_USAGE =
+    "Usage: embr set diff [--vectors] [options] <set-a> <set-b>\n"
+    "\n"
+    "Compare two sets. With --vectors, the embeddings both sets hold for a\n"
+    "file and model are compared and every difference is listed:\n"
+    "\n"
+    "  M <cosine> <l2> <model> <file>   Vector changed\n"
+    "  m <cosine> <l2> <model> <file>   Vector changed, scored on the --dims prefix\n"
+    "  - <model> <file>                 Only in <set-a>\n"
+    "  + <model> <file>                 Only in <set-b>\n"
+    "  ! <model> <file>                 Dimensions differ or unreadable\n"
+    "\n"
+    "followed by a histogram of the cosine distances.\n"
+    "\n"
+    "Options:\n"
+    "  --vectors                Compare embedding vectors\n"
+    "  -m, --model <name>       Only compare this model\n"
+    "  -j, --threads <count>    Worker threads (default: one per CPU)\n"
+    "  --dims <n>               Screen with the first n dimensions only, for\n"
+    "                           models that support truncated embeddings\n"
+    "  --refine <count>         Most drifted screened pairs rescored at full\n"
+    "                           dimensions (default: 100)\n"
+    "  -s, --summary            Only print the summary\n"
+    "  -h, --help               Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr set diff --vectors main experimental\n"
+    "  embr set diff --vectors --summary -m openai-3 main experimental\n"
+    "  embr set diff --vectors --dims 256 main experimental\n";
 static int handle_delete(int argc, char** argv);
 static int handle_status(int argc, char** argv);
 
@@ -77,11 +151,27 @@ int cmd_set(int argc, char** argv)
 		return 0;
 	}
 
+	if (argc >= 2 && strcmp(argv[1], "diff") == 0)
+		return handle_diff(argc - 1, argv + 1);
+	if (argc >= 2 && strcmp(argv[1], "snapshot") == 0)
+		return handle_snapshot(argc - 1, argv + 1);
+	if (argc >= 2 && strcmp(argv[1], "export") == 0)
+		return handle_export(argc - 1, argv + 1);
+	if (argc >= 2 && strcmp(argv[1], "flatten") == 0)
+		return handle_flatten(argc - 1, argv + 1);
+	if (argc >= 2 && strcmp(argv[1], "checkout") == 0)
+		return handle_checkout(argc - 1, argv + 1);
+	if (argc >= 2 && strcmp(argv[1], "compact") == 0)
+		return handle_compact(argc - 1, argv + 1);
+	if (argc >= 2 && strcmp(argv[1], "stats") == 0)
+		return handle_stats(argc - 1, argv + 1);
+
 	/* Parse options */
 	bool verbose = false;
 	bool force = false;
 	bool delete_mode = false;
 	const char* set_name = NULL;
+	const char* base_set = NULL;
 
 	for (int i = 1; i < argc; i++) {
 		const char* arg = argv[i];
@@ -103,6 +193,14 @@ int cmd_set(int argc, char** argv)
 				return 1;
 			}
 		}
+		else if (strcmp(arg, "-b") == 0 || strcmp(arg, "--base") == 0) {
+			if (i + 1 < argc) {
+				base_set = argv[++i];
+			} else {
+				fprintf(stderr, "Error: -b/--base requires a set name\n");
+				return 1;
+			}
+		}
 		/* First non-option argument is the set name (for create) */
 		else if (arg[0] != '-' && set_name == NULL) {
 			set_name = arg;
@@ -125,14 +223,21 @@ int cmd_set(int argc, char** argv)
 		printf("Deleted set %s\n", set_name);
 		return 0;
 	}
+	else if (base_set != NULL && set_name == NULL) {
+		fprintf(stderr, "Error: No name given for the new set\n");
+		return 1;
+	}
 	else if (set_name != NULL) {
 		/* Create operation */
-		eb_status_t status = set_create(set_name, NULL, NULL);
+		eb_status_t status = set_create(set_name, NULL, base_set);
 		if (status != EB_SUCCESS) {
 			handle_error(status, "Failed to create set");
 			return 1;
 		}
-		printf("Created set %s\n", set_name);
+		if (base_set)
+			printf("Created set %s from %s\n", set_name, base_set);
+		else
+			printf("Created set %s\n", set_name);
 		return 0;
 	}
 	else {
@@ -165,9 +270,803 @@ static int handle_switch(int argc, char** argv)
 	return 0;
 }
 
+static const char* model_label(const char* model)
+{
+	return *model ? model : "-";
+}
+
+static int print_drift_pair(const eb_drift_pair_t* pair, void* ctx)
+{
+	(void)ctx;
+	switch (pair->state) {
+	case EB_DRIFT_SAME:
+		break;
+	case EB_DRIFT_CHANGED:
+		printf("%s%c%s %.6f %.6f %s %s\n", COLOR_YELLOW, pair->screened ? 'm' : 'M', COLOR_RESET,
+		       pair->cosine, pair->l2, model_label(pair->model), pair->source);
+		break;
+	case EB_DRIFT_ONLY_A:
+		printf("%s-%s %s %s\n", COLOR_RED, COLOR_RESET, model_label(pair->model), pair->source);
+		break;
+	case EB_DRIFT_ONLY_B:
+		printf("%s+%s %s %s\n", COLOR_GREEN, COLOR_RESET, model_label(pair->model), pair->source);
+		break;
+	case EB_DRIFT_DIMENSIONS:
+	case EB_DRIFT_UNREADABLE:
+		printf("%s!%s %s %s\n", COLOR_RED, COLOR_RESET, model_label(pair->model), pair->source);
+		break;
+	}
+	return 0;
+}
+
+static void print_drift_summary(const char* set_a, const char* set_b,
+				const eb_drift_options_t* options, const eb_drift_summary_t* summary)
+{
+	static const float edges[EB_DRIFT_BINS - 1] = EB_DRIFT_BIN_EDGES;
+
+	printf("\n%zu shared, %zu changed, %zu only in %s, %zu only in %s\n",
+	       summary->pairs, summary->changed, summary->only_a, set_a, summary->only_b, set_b);
+	if (summary->screened)
+		printf("%zu changed scored on the first %zu dimensions, %zu at full dimensions\n",
+		       summary->screened, options->prefix_dims, summary->changed - summary->screened);
+	if (summary->dimensions || summary->unreadable)
+		printf("%zu with other dimensions, %zu unreadable\n",
+		       summary->dimensions, summary->unreadable);
+	if (summary->same + summary->changed == 0)
+		return;
+
+	printf("cosine distance: mean %.6f, max %.6f\n", summary->mean_cosine, summary->max_cosine);
+	printf("L2 distance:     mean %.6f, max %.6f\n", summary->mean_l2, summary->max_l2);
+
+	size_t largest = 0;
+	for (int i = 0; i < EB_DRIFT_BINS; i++) {
+		if (summary->histogram[i] > largest)
+			largest = summary->histogram[i];
+	}
+	for (int i = 0; i < EB_DRIFT_BINS; i++) {
+		char label[32];
+		if (i == 0)
+			snprintf(label, sizeof(label), "< %g", edges[0]);
+		else if (i == EB_DRIFT_BINS - 1)
+			snprintf(label, sizeof(label), ">= %g", edges[i - 1]);
+		else
+			snprintf(label, sizeof(label), "%g - %g", edges[i - 1], edges[i]);
+		int width = (int)(40 * summary->histogram[i] / largest);
+		printf("  %-14s %8zu %.*s\n", label, summary->histogram[i], width,
+		       "########################################");
+	}
+}
+
 static int handle_diff(int argc, char** argv)
 {
-	// This code is no longer used
+	if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+		printf("%s", SET_DIFF_USAGE);
+		return 0;
+	}
+
+	bool vectors = false;
+	bool summary_only = false;
+	eb_drift_options_t options = { NULL, 0, 0, 100 };
+	const char* sets[2] = { NULL, NULL };
+	int set_count = 0;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		if (strcmp(arg, "--vectors") == 0) {
+			vectors = true;
+		} else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--summary") == 0) {
+			summary_only = true;
+		} else if (strcmp(arg, "--dims") == 0 || strcmp(arg, "--refine") == 0) {
+			if (i + 1 >= argc) {
+				cli_error("Missing value for %s", arg);
+				return 1;
+			}
+			bool dims = strcmp(arg, "--dims") == 0;
+			const char* value = argv[++i];
+			char* end = NULL;
+			unsigned long long count = strtoull(value, &end, 10);
+			if (!value[0] || *end || value[0] == '-' || (dims && count == 0)) {
+				cli_error("Invalid value for %s: %s", arg, value);
+				return 1;
+			}
+			if (dims)
+				options.prefix_dims = (size_t)count;
+			else
+				options.refine = (size_t)count;
+		} else if (strcmp(arg, "-m") == 0 || strcmp(arg, "--model") == 0 ||
+			   strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0) {
+			if (i + 1 >= argc) {
+				cli_error("Missing value for %s", arg);
+				return 1;
+			}
+			const char* value = argv[++i];
+			if (arg[1] == 'm' || strcmp(arg, "--model") == 0) {
+				options.model = value;
+			} else {
+				char* end = NULL;
+				unsigned long threads = strtoul(value, &end, 10);
+				if (!value[0] || *end || threads == 0 || threads > 256) {
+					cli_error("Invalid thread count: %s", value);
+					return 1;
+				}
+				options.threads = (unsigned)threads;
+			}
+		} else if (arg[0] == '-') {
+			cli_error("Unknown option: %s", arg);
+			return 1;
+		} else if (set_count < 2) {
+			sets[set_count++] = arg;
+		} else {
+			cli_error("Too many sets given");
+			return 1;
+		}
+	}
+	if (set_count != 2) {
+		fprintf(stderr, "%s", SET_DIFF_USAGE);
+		return 1;
+	}
+
+	if (!vectors) {
+		eb_status_t status = set_diff(sets[0], sets[1]);
+		if (status != EB_SUCCESS) {
+			handle_error(status, "Failed to compare sets");
+			return 1;
+		}
+		return 0;
+	}
+
+	char* repo_root = find_repo_root(".");
+	if (!repo_root) {
+		cli_error("Not in an eb repository");
+		return 1;
+	}
+
+	eb_drift_summary_t summary;
+	eb_status_t status = eb_set_drift(repo_root, sets[0], sets[1], &options,
+					  summary_only ? NULL : print_drift_pair, NULL, &summary);
+	free(repo_root);
+	if (status == EB_ERROR_NOT_FOUND) {
+		cli_error("No such set: %s or %s", sets[0], sets[1]);
+		return 1;
+	}
+	if (status != EB_SUCCESS) {
+		handle_error(status, "Failed to compare sets");
+		return 1;
+	}
+
+	print_drift_summary(sets[0], sets[1], &options, &summary);
+	return 0;
+}
+
+static const char* SET_SNAPSHOT_USAGE =
+    "Usage: embr set snapshot [--lz4] [<set-name>]\n"
+    "\n"
+    "Write the vectors of a set (default: the current set) as Arrow IPC\n"
+    "files under .embr/snapshots/<set-name>, one series per dimension,\n"
+    "replacing an earlier snapshot. Uncompressed files can be memory-mapped\n"
+    "and their vectors read in place as a float matrix.\n"
+    "\n"
+    "Options:\n"
+    "  --lz4                    Compress with LZ4 (smaller, decoded on read)\n"
+    "  -h, --help               Show this help message\n";
+
+static int handle_snapshot(int argc, char** argv)
+{
+	if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+		printf("%s", SET_SNAPSHOT_USAGE);
+		return 0;
+	}
+
+	bool lz4 = false;
+	const char* set_name = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--lz4") == 0) {
+			lz4 = true;
+		} else if (argv[i][0] == '-') {
+			cli_error("Unknown option: %s", argv[i]);
+			return 1;
+		} else if (!set_name) {
+			set_name = argv[i];
+		} else {
+			fprintf(stderr, "%s", SET_SNAPSHOT_USAGE);
+			return 1;
+		}
+	}
+
+	char current_set[100] = {0};
+	if (!set_name) {
+		if (get_current_set(current_set, sizeof(current_set)) != EB_SUCCESS || !*current_set) {
+			cli_error("No current set");
+			return 1;
+		}
+		set_name = current_set;
+	}
+
+	char* repo_root = find_repo_root(".");
+	if (!repo_root) {
+		cli_error("Not in an eb repository");
+		return 1;
+	}
+
+	char** files = NULL;
+	size_t count = 0;
+	size_t rows = 0;
+	eb_status_t status = eb_set_snapshot_write(repo_root, set_name, lz4, &files, &count, &rows);
+	free(repo_root);
+	if (status == EB_ERROR_NOT_FOUND) {
+		cli_error("No such set: %s", set_name);
+		return 1;
+	}
+	if (status != EB_SUCCESS) {
+		handle_error(status, "Failed to write snapshot");
+		return 1;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		printf("%s\n", files[i]);
+		free(files[i]);
+	}
+	free(files);
+	printf("Snapshot of " COLOR_GREEN "%s" COLOR_RESET ": %zu vectors in %zu files\n",
+	       set_name, rows, count);
+	return 0;
+}
+
+static const char* SET_EXPORT_USAGE =
+    "Usage: embr set export -o <dir> [options] [<set-name>]\n"
+    "       embr set export --mmap <file> [-m <model>] [-j <count>] [<set-name>]\n"
+    "\n"
+    "Write the vectors of a set (default: the current set) for a Pinecone\n"
+    "index in one pass. As NDJSON, every line of upsert-NNNNN.ndjson is the\n"
+    "body of one upsert request, so files and lines can be sent in parallel.\n"
+    "As Parquet, the files are meant for Pinecone's bulk import.\n"
+    "\n"
+    "With --mmap, write one file holding the vectors as an aligned float\n"
+    "matrix with their sources and hashes, to be mapped by serving code\n"
+    "without parsing. Exporting again over the file only reads the vectors\n"
+    "that changed since.\n"
+    "\n"
+    "Options:\n"
+    "  -o, --output <dir>       Directory to write to (created if missing)\n"
+    "  --mmap <file>            Write a mappable matrix file instead\n"
+    "  --format <ndjson|parquet>\n"
+    "                           Output format (default: ndjson)\n"
+    "  --batch <count>          Vectors per upsert request (default: 100, at most 1000)\n"
+    "  --max-bytes <bytes>      Largest request body (default: 2 MiB)\n"
+    "  --namespace <name>       Pinecone namespace of the requests\n"
+    "  -m, --model <name>       Only export this model\n"
+    "  -j, --threads <count>    Reader threads (default: one per CPU)\n"
+    "  -h, --help               Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr set export -o pinecone main\n"
+    "  embr set export -o pinecone --batch 200 --namespace docs -m openai-3\n"
+    "  embr set export --mmap main.matrix -m openai-3\n";
+
+static int export_matrix(const char* set_name, const char* path,
+			 const eb_set_matrix_options_t* options)
+{
+	char* repo_root = find_repo_root(".");
+	if (!repo_root) {
+		cli_error("Not in an eb repository");
+		return 1;
+	}
+
+	eb_set_matrix_stats_t stats;
+	eb_status_t status = eb_set_matrix_export(repo_root, set_name, path, options, &stats);
+	free(repo_root);
+	if (status == EB_ERROR_NOT_FOUND) {
+		cli_error("No such set: %s", set_name);
+		return 1;
+	}
+	if (status != EB_SUCCESS) {
+		handle_error(status, "Failed to export set");
+		return 1;
+	}
+
+	printf("Exported " COLOR_GREEN "%s" COLOR_RESET ": %zu vectors to %s, %zu unchanged\n",
+	       set_name, stats.rows, path, stats.reused);
+	if (stats.skipped)
+		printf("Skipped %zu unreadable vectors or vectors of other dimensions\n", stats.skipped);
+	return 0;
+}
+
+static int handle_export(int argc, char** argv)
+{
+	if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+		printf("%s", SET_EXPORT_USAGE);
+		return 0;
+	}
+
+	eb_pinecone_options_t options = { EB_PINECONE_NDJSON, 0, 0, 0, NULL, NULL, 0 };
+	eb_set_matrix_options_t matrix = { .model = NULL, .threads = 0, .codes = false };
+	const char* output = NULL;
+	const char* matrix_path = NULL;
+	const char* set_name = NULL;
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool takes_value = strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0 ||
+				   strcmp(arg, "--format") == 0 || strcmp(arg, "--batch") == 0 ||
+				   strcmp(arg, "--max-bytes") == 0 || strcmp(arg, "--namespace") == 0 ||
+				   strcmp(arg, "-m") == 0 || strcmp(arg, "--model") == 0 ||
+				   strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0 ||
+				   strcmp(arg, "--mmap") == 0;
+		if (takes_value && i + 1 >= argc) {
+			cli_error("Missing value for %s", arg);
+			return 1;
+		}
+		if (!takes_value) {
+			if (arg[0] == '-') {
+				cli_error("Unknown option: %s", arg);
+				return 1;
+			}
+			if (set_name) {
+				fprintf(stderr, "%s", SET_EXPORT_USAGE);
+				return 1;
+			}
+			set_name = arg;
+			continue;
+		}
+
+		const char* value = argv[++i];
+		if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+			output = value;
+		} else if (strcmp(arg, "--mmap") == 0) {
+			matrix_path = value;
+		} else if (strcmp(arg, "--namespace") == 0) {
+			options.name_space = value;
+		} else if (strcmp(arg, "-m") == 0 || strcmp(arg, "--model") == 0) {
+			options.model = value;
+			matrix.model = value;
+		} else if (strcmp(arg, "--format") == 0) {
+			if (strcmp(value, "ndjson") == 0) {
+				options.format = EB_PINECONE_NDJSON;
+			} else if (strcmp(value, "parquet") == 0) {
+				options.format = EB_PINECONE_PARQUET;
+			} else {
+				cli_error("Unknown format: %s", value);
+				return 1;
+			}
+		} else {
+			char* end = NULL;
+			unsigned long long count = strtoull(value, &end, 10);
+			if (!value[0] || *end || value[0] == '-' || count == 0) {
+				cli_error("Invalid value for %s: %s", arg, value);
+				return 1;
+			}
+			if (strcmp(arg, "--batch") == 0) {
+				if (count > EB_PINECONE_MAX_BATCH_VECTORS) {
+					cli_error("Pinecone takes at most %d vectors per request", EB_PINECONE_MAX_BATCH_VECTORS);
+					return 1;
+				}
+				options.batch_vectors = (size_t)count;
+			} else if (strcmp(arg, "--max-bytes") == 0) {
+				options.request_bytes = (size_t)count;
+			} else if (count > 256) {
+				cli_error("Invalid thread count: %s", value);
+				return 1;
+			} else {
+				options.threads = (unsigned)count;
+				matrix.threads = (unsigned)count;
+			}
+		}
+	}
+	if (!output == !matrix_path) {
+		fprintf(stderr, "%s", SET_EXPORT_USAGE);
+		return 1;
+	}
+
+	char current_set[100] = {0};
+	if (!set_name) {
+		if (get_current_set(current_set, sizeof(current_set)) != EB_SUCCESS || !*current_set) {
+			cli_error("No current set");
+			return 1;
+		}
+		set_name = current_set;
+	}
+	if (matrix_path)
+		return export_matrix(set_name, matrix_path, &matrix);
+	if (mkdir(output, 0755) != 0 && errno != EEXIST) {
+		cli_error("Cannot create %s: %s", output, strerror(errno));
+		return 1;
+	}
+
+	char* repo_root = find_repo_root(".");
+	if (!repo_root) {
+		cli_error("Not in an eb repository");
+		return 1;
+	}
+
+	size_t count = 0;
+	eb_pinecone_stats_t stats;
+	eb_status_t status = eb_pinecone_export(repo_root, set_name, output, &options, NULL, &count, &stats);
+	free(repo_root);
+	if (status == EB_ERROR_NOT_FOUND) {
+		cli_error("No such set: %s", set_name);
+		return 1;
+	}
+	if (status != EB_SUCCESS) {
+		handle_error(status, "Failed to export set");
+		return 1;
+	}
+
+	if (options.format == EB_PINECONE_NDJSON)
+		printf("Exported " COLOR_GREEN "%s" COLOR_RESET ": %zu vectors in %zu requests, %zu files\n",
+		       set_name, stats.vectors, stats.batches, count);
+	else
+		printf("Exported " COLOR_GREEN "%s" COLOR_RESET ": %zu vectors in %zu files\n",
+		       set_name, stats.vectors, count);
+	if (stats.skipped)
+		printf("Skipped %zu unreadable or oversized vectors\n", stats.skipped);
+	return 0;
+}
+
+static int handle_flatten(int argc, char** argv)
+{
+	if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+		printf("Usage: embr set flatten [<set-name>]\n"
+		       "\n"
+		       "Copy the index and log a set shares with the set it was created\n"
+		       "from into its own files, so it no longer reads through to them.\n"
+		       "Defaults to the current set.\n");
+		return 0;
+	}
+
+	char name[100] = {0};
+	if (argc >= 2 && argv[1][0] != '-') {
+		snprintf(name, sizeof(name), "%s", argv[1]);
+	} else if (get_current_set(name, sizeof(name)) != EB_SUCCESS) {
+		cli_error("Could not determine the current set");
+		return 1;
+	}
+
+	char* root = find_repo_root(".");
+	if (!root) {
+		handle_error(EB_ERROR_NOT_INITIALIZED, "Not in an embr repository");
+		return 1;
+	}
+	char set_path[PATH_MAX];
+	snprintf(set_path, sizeof(set_path), "%s/%s/%s", root, SET_DIR, name);
+	struct stat st;
+	if (stat(set_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		free(root);
+		cli_error("Set not found: %s", name);
+		return 1;
+	}
+
+	eb_status_t status = eb_set_layers_flatten(root, set_path);
+	free(root);
+	if (status != EB_SUCCESS) {
+		handle_error(status, "Failed to flatten set");
+		return 1;
+	}
+	printf("Flattened set %s\n", name);
+	return 0;
+}
+
+static int handle_compact(int argc, char** argv)
+{
+	if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+		printf("Usage: embr set compact [<set-name>]\n"
+		       "\n"
+		       "Fold the removals 'embr rm' recorded into a set's files: the index\n"
+		       "tail is merged into its sorted block, and the log lines of removed\n"
+		       "entries are dropped so 'embr gc' can reclaim their objects.\n"
+		       "Defaults to the current set.\n");
+		return 0;
+	}
+
+	char name[100] = {0};
+	if (argc >= 2 && argv[1][0] != '-') {
+		snprintf(name, sizeof(name), "%s", argv[1]);
+	} else if (get_current_set(name, sizeof(name)) != EB_SUCCESS) {
+		cli_error("Could not determine the current set");
+		return 1;
+	}
+
+	char* root = find_repo_root(".");
+	if (!root) {
+		handle_error(EB_ERROR_NOT_INITIALIZED, "Not in an embr repository");
+		return 1;
+	}
+	char set_path[PATH_MAX];
+	snprintf(set_path, sizeof(set_path), "%s/%s/%s", root, SET_DIR, name);
+
+	eb_set_compact_summary_t summary;
+	eb_status_t status = eb_set_compact(root, set_path, &summary);
+	free(root);
+	if (status == EB_ERROR_NOT_FOUND) {
+		cli_error("Set not found: %s", name);
+		return 1;
+	}
+	if (status != EB_SUCCESS) {
+		handle_error(status, "Failed to compact set");
+		return 1;
+	}
+	if (summary.tombstones == 0 && !summary.index_compacted) {
+		printf("Set %s has nothing to compact\n", name);
+		return 0;
+	}
+	printf("Compacted set %s: %zu removals, %zu log lines dropped, %zu kept\n",
+	       name, summary.tombstones, summary.dropped, summary.kept);
+	return 0;
+}
+
+static const char* SET_STATS_USAGE =
+    "Usage: embr set stats [options] [<set-name>]\n"
+    "\n"
+    "Summarize the vectors of a set (default: the current set) per model:\n"
+    "their count, the norm of their mean, their total variance and the\n"
+    "distribution of their norms. The set keeps these up to date as\n"
+    "vectors are stored and removed, so no object is read; a set that has\n"
+    "none yet is read once to build them.\n"
+    "\n"
+    "With --against, estimate how far each model's vectors have drifted\n"
+    "from another set: the cosine distance and L2 distance between the\n"
+    "two mean vectors, the change in mean norm, the ratio of the total\n"
+    "variances, the relative change of the covariance along a random\n"
+    "projection, and the total variation distance of the norm histograms.\n"
+    "For a per-document comparison use 'embr set diff --vectors'.\n"
+    "\n"
+    "Options:\n"
+    "  --against <set>          Set to estimate drift from\n"
+    "  -m, --model <name>       Only show this model\n"
+    "  -j, --threads <count>    Worker threads for a build (default: one per CPU)\n"
+    "  -h, --help               Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr set stats\n"
+    "  embr set stats --against main experimental\n";
+
+static void print_sketch_stats(const char* name, const eb_set_sketch_t* set, const char* model)
+{
+	printf("%-20s %6s %10s %10s %10s %21s %8s\n", "model", "dims", "vectors", "centroid",
+	       "variance", "norm mean / stddev", "median");
+	size_t shown = 0;
+	for (size_t i = 0; i < set->count; i++) {
+		const eb_sketch_t* sketch = &set->items[i];
+		if (sketch->count == 0 || (model && strcmp(model, sketch->model) != 0))
+			continue;
+		eb_sketch_stats_t stats;
+		eb_sketch_stats(sketch, &stats);
+		printf("%-20s %6zu %10llu %10.6f %10.6f %10.6f / %-8.6f %8.4g\n", model_label(sketch->model),
+		       sketch->dims, (unsigned long long)sketch->count, stats.centroid_norm, stats.variance,
+		       stats.norm_mean, stats.norm_stddev, stats.norm_p50);
+		shown++;
+	}
+	if (shown == 0)
+		printf("(no vectors in %s)\n", name);
+}
+
+static void print_sketch_drift(const char* base, const eb_set_sketch_t* from,
+			       const char* name, const eb_set_sketch_t* to, const char* model)
+{
+	printf("%-20s %6s %21s %10s %10s %10s %10s %10s %10s\n", "model", "dims", "vectors",
+	       "cosine", "L2", "norm", "variance", "covariance", "norms");
+	for (size_t i = 0; i < to->count; i++) {
+		const eb_sketch_t* b = &to->items[i];
+		if (model && strcmp(model, b->model) != 0)
+			continue;
+		const eb_sketch_t* a = eb_set_sketch_group((eb_set_sketch_t*)from, b->model, b->dims, false);
+		eb_sketch_drift_t drift;
+		if (!a || eb_sketch_compare(a, b, &drift) != EB_SUCCESS) {
+			printf("%-20s %6zu %10s -> %-8llu (only in %s)\n", model_label(b->model), b->dims, "-",
+			       (unsigned long long)b->count, name);
+			continue;
+		}
+		printf("%-20s %6zu %10llu -> %-8llu %10.6f %10.6f %+10.6f %10.4f %10.4f %10.4f\n",
+		       model_label(b->model), b->dims, (unsigned long long)a->count,
+		       (unsigned long long)b->count, drift.centroid_cosine, drift.centroid_l2,
+		       drift.norm_shift, drift.variance_ratio, drift.covariance_shift, drift.norm_distance);
+	}
+	for (size_t i = 0; i < from->count; i++) {
+		const eb_sketch_t* a = &from->items[i];
+		if ((model && strcmp(model, a->model) != 0) ||
+		    eb_set_sketch_group((eb_set_sketch_t*)to, a->model, a->dims, false))
+			continue;
+		printf("%-20s %6zu %10llu -> %-8s (only in %s)\n", model_label(a->model), a->dims,
+		       (unsigned long long)a->count, "-", base);
+	}
+}
+
+static int handle_stats(int argc, char** argv)
+{
+	if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+		printf("%s", SET_STATS_USAGE);
+		return 0;
+	}
+
+	const char* set_name = NULL;
+	const char* against = NULL;
+	const char* model = NULL;
+	unsigned threads = 0;
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		if (strcmp(arg, "--against") == 0 || strcmp(arg, "-m") == 0 ||
+		    strcmp(arg, "--model") == 0 || strcmp(arg, "-j") == 0 ||
+		    strcmp(arg, "--threads") == 0) {
+			if (i + 1 >= argc) {
+				cli_error("Missing value for %s", arg);
+				return 1;
+			}
+			const char* value = argv[++i];
+			if (strcmp(arg, "--against") == 0) {
+				against = value;
+			} else if (arg[1] == 'm' || strcmp(arg, "--model") == 0) {
+				model = value;
+			} else {
+				char* end = NULL;
+				unsigned long count = strtoul(value, &end, 10);
+				if (!value[0] || *end || count == 0 || count > 256) {
+					cli_error("Invalid thread count: %s", value);
+					return 1;
+				}
+				threads = (unsigned)count;
+			}
+		} else if (arg[0] == '-') {
+			cli_error("Unknown option: %s", arg);
+			return 1;
+		} else if (!set_name) {
+			set_name = arg;
+		} else {
+			fprintf(stderr, "%s", SET_STATS_USAGE);
+			return 1;
+		}
+	}
+
+	char name[100] = {0};
+	if (set_name) {
+		snprintf(name, sizeof(name), "%s", set_name);
+	} else if (get_current_set(name, sizeof(name)) != EB_SUCCESS) {
+		cli_error("Could not determine the current set");
+		return 1;
+	}
+
+	char* root = find_repo_root(".");
+	if (!root) {
+		handle_error(EB_ERROR_NOT_INITIALIZED, "Not in an embr repository");
+		return 1;
+	}
+
+	eb_set_sketch_t sketch = {0}, base = {0};
+	eb_status_t status = eb_set_sketch_open(root, name, threads, &sketch);
+	const char* failed = name;
+	if (status == EB_SUCCESS && against) {
+		status = eb_set_sketch_open(root, against, threads, &base);
+		failed = against;
+	}
+	free(root);
+	if (status == EB_ERROR_NOT_FOUND) {
+		cli_error("Set not found: %s", failed);
+		eb_set_sketch_free(&sketch);
+		return 1;
+	}
+	if (status != EB_SUCCESS) {
+		handle_error(status, "Failed to read set statistics");
+		eb_set_sketch_free(&sketch);
+		return 1;
+	}
+
+	if (against)
+		print_sketch_drift(against, &base, name, &sketch, model);
+	else
+		print_sketch_stats(name, &sketch, model);
+	eb_set_sketch_free(&base);
+	eb_set_sketch_free(&sketch);
+	return 0;
+}
+
+static const char* SET_CHECKOUT_USAGE =
+    "Usage: embr set checkout --at <point> [--from <set>] [<new-set>]\n"
+    "\n"
+    "Replay a set's log (default: the current set) up to a point, starting\n"
+    "from the nearest checkpoint. Lists the entries the set held then, or,\n"
+    "with <new-set>, creates a set holding exactly those entries.\n"
+    "\n"
+    "Points:\n"
+    "  <n>                      After the first n log entries\n"
+    "  @<unix-time>             As of a time\n"
+    "  YYYY-MM-DD[ HH:MM[:SS]]  As of a local time\n"
+    "\n"
+    "Entries removed with 'embr rm' before the point do not show.\n"
+    "\n"
+    "Options:\n"
+    "  --at <point>             Point in the set's history\n"
+    "  --from <set>             Set to read\n"
+    "  -h, --help               Show this help message\n";
+
+static int handle_checkout(int argc, char** argv)
+{
+	if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+		printf("%s", SET_CHECKOUT_USAGE);
+		return 0;
+	}
+
+	const char* at_text = NULL;
+	const char* from = NULL;
+	const char* new_set = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--at") == 0 && i + 1 < argc) {
+			at_text = argv[++i];
+		} else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+			from = argv[++i];
+		} else if (argv[i][0] == '-') {
+			cli_error("Unknown option: %s", argv[i]);
+			return 1;
+		} else if (!new_set) {
+			new_set = argv[i];
+		} else {
+			fprintf(stderr, "%s", SET_CHECKOUT_USAGE);
+			return 1;
+		}
+	}
+
+	eb_set_point_t at;
+	if (!at_text) {
+		fprintf(stderr, "%s", SET_CHECKOUT_USAGE);
+		return 1;
+	}
+	if (eb_set_point_parse(at_text, &at) != EB_SUCCESS) {
+		cli_error("Not a point in history: %s", at_text);
+		return 1;
+	}
+
+	char current_set[100] = {0};
+	if (!from) {
+		if (get_current_set(current_set, sizeof(current_set)) != EB_SUCCESS || !*current_set) {
+			cli_error("No current set");
+			return 1;
+		}
+		from = current_set;
+	}
+
+	char* root = find_repo_root(".");
+	if (!root) {
+		handle_error(EB_ERROR_NOT_INITIALIZED, "Not in an embr repository");
+		return 1;
+	}
+	char set_path[PATH_MAX], log_path[PATH_MAX + 8];
+	snprintf(set_path, sizeof(set_path), "%s/%s/%s", root, SET_DIR, from);
+	snprintf(log_path, sizeof(log_path), "%s/log", set_path);
+	struct stat st;
+	if (stat(set_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		free(root);
+		cli_error("Set not found: %s", from);
+		return 1;
+	}
+
+	eb_set_state_t state;
+	eb_status_t status = eb_set_state_at(log_path, &at, &state);
+	if (status != EB_SUCCESS) {
+		free(root);
+		handle_error(status, "Failed to read set history");
+		return 1;
+	}
+
+	if (!new_set) {
+		for (size_t i = 0; i < state.count; i++)
+			printf("%.7s %s %s\n", state.items[i].hash,
+			       state.items[i].model[0] ? state.items[i].model : "-", state.items[i].source);
+		printf("%zu entries after %llu log entries\n", state.count,
+		       (unsigned long long)state.seq);
+		eb_set_state_free(&state);
+		free(root);
+		return 0;
+	}
+
+	status = set_create(new_set, NULL, NULL);
+	if (status == EB_SUCCESS) {
+		snprintf(set_path, sizeof(set_path), "%s/%s/%s", root, SET_DIR, new_set);
+		status = eb_set_state_restore(root, set_path, &state, NULL);
+	}
+	free(root);
+	if (status != EB_SUCCESS) {
+		eb_set_state_free(&state);
+		handle_error(status, "Failed to create set");
+		return 1;
+	}
+	printf("Created set %s from %s at %s: %zu entries\n", new_set, from, at_text, state.count);
+	eb_set_state_free(&state);
 	return 0;
 }
 
@@ -235,6 +1134,18 @@ eb_status_t set_create(const char* name, const char* description, const char* ba
 		return EB_ERROR_INVALID_INPUT;
 	}
 
+	/* A set with a base shares the base's files instead of starting empty */
+	if (base_set) {
+		free(set_dir);
+		free(set_path);
+		char* eb_root = find_repo_root(".");
+		if (!eb_root)
+			return EB_ERROR_NOT_INITIALIZED;
+		eb_status_t status = eb_set_layers_fork(eb_root, base_set, name);
+		free(eb_root);
+		return status;
+	}
+
 	/* Create set directory */
 	if (mkdir(set_path, 0755) != 0) {
 		free(set_dir);
@@ -347,6 +1258,17 @@ eb_status_t set_list(bool verbose)
 		else
 			printf("  %s", entry->d_name);
 
+		if (verbose) {
+			char layered_path[PATH_MAX];
+			snprintf(layered_path, sizeof(layered_path), "%s/%s", set_dir, entry->d_name);
+			eb_set_layers_t layers;
+			if (eb_set_layers_load(layered_path, &layers) == EB_SUCCESS) {
+				if (layers.count > 0)
+					printf("  (based on %s)", layers.items[layers.count - 1].set);
+				eb_set_layers_free(&layers);
+			}
+		}
+
 		printf("\n");
 	}
 
@@ -586,11 +1508,17 @@ eb_status_t set_delete(const char* name, bool force)
 		return EB_ERROR_NOT_FOUND;
 	}
 
-	/* Remove log and index files if they exist */
-	char* log_path = malloc(strlen(set_path) + 6);
+	/* Remove the links to base sets, leaving the base sets alone */
+	eb_set_layers_remove(set_path);
+	eb_checkpoint_remove_all(set_path);
+
+	/* Remove log, log index and index files if they exist */
+	char* log_path = malloc(strlen(set_path) + 10);
 	if (log_path) {
 		sprintf(log_path, "%s/log", set_path);
 		unlink(log_path);
+		sprintf(log_path, "%s/log.idx", set_path);
+		unlink(log_path);
 		free(log_path);
 	}
 	char* index_path = malloc(strlen(set_path) + 8);
@@ -599,6 +1527,12 @@ eb_status_t set_delete(const char* name, bool force)
 		unlink(index_path);
 		free(index_path);
 	}
+	char* cache_path = malloc(strlen(set_path) + 12);
+	if (cache_path) {
+		sprintf(cache_path, "%s/stat-cache", set_path);
+		unlink(cache_path);
+		free(cache_path);
+	}
 
 	/* Remove per-set refs/models directory if it exists */
 	char* refs_dir = malloc(strlen(set_path) + 12); // "/refs/models" + null
@@ -0,0 +1,65 @@
+/*
+ * EmbeddingBridge - Stats CLI Command
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cli.h"
+#include "../core/counters.h"
+#include "../core/daemon.h"
+
+static const char* STATS_USAGE =
+    "usage: embr stats [options]\n"
+    "\n"
+    "Show the runtime counters: objects read and written, bytes before and\n"
+    "after compression, time spent compressing and hashing, index and log\n"
+    "lookups, remote requests and retries, bytes in and out per transport,\n"
+    "and cache hit rates.\n"
+    "\n"
+    "With `embr serve --daemon` running, the counters total every command\n"
+    "the daemon has run since it started. Otherwise there is only this\n"
+    "process to count; use `embr --stats <command>` to see what a single\n"
+    "command did.\n"
+    "\n"
+    "Options:\n"
+    "  --json                 Print the counters as one JSON object\n"
+    "  -h, --help             Show this help message\n"
+    "\n"
+    "Examples:\n"
+    "  embr stats\n"
+    "  embr --stats push origin\n";
+
+int cmd_stats(int argc, char** argv) {
+    if (has_option(argc, argv, "--help") || has_option(argc, argv, "-h")) {
+        printf("%s", STATS_USAGE);
+        return 0;
+    }
+
+    bool json = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            cli_error("Unknown option: %s", argv[i]);
+            printf("%s", STATS_USAGE);
+            return 1;
+        }
+    }
+
+    // Commands the daemon runs have its environment
+    if (!getenv(EB_DAEMON_DISABLE_ENV))
+        fprintf(stderr, "No daemon is running, so these only count this process; "
+                        "see `embr stats --help`\n");
+
+    uint64_t values[EB_COUNTER_COUNT];
+    eb_counters_snapshot(values);
+    eb_counters_print(stdout, values, json);
+    return 0;
+}
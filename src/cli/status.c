@@ -21,6 +21,9 @@
 #include "../core/debug.h"  // For DEBUG_PRINT
 #include "../core/path_utils.h"  // For get_relative_path()
 #include "../core/hash_utils.h"
+#include "../core/object_path.h"
+#include "../core/log_index.h"
+#include "../core/source_status.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,19 +47,22 @@
 #define MAX_META_LEN 1024
 
 static const char *STATUS_USAGE = 
-    "Usage: embr status [options] <source>\n"
+    "Usage: embr status [options] [<source>]\n"
     "\n" 
     TEXT_BOLD "Show embedding status and log for a source file" COLOR_RESET "\n"
     "\n"
     "Arguments:\n"
-    "  <source>         Source file to check status for\n"
+    "  <source>         Source file to check status for; without one, every\n"
+    "                   source of the current set is checked against its file\n"
     "\n"
     "Options:\n"
     "  -v, --verbose    Show detailed output including timestamps and metadata\n"
     "  -m, --model      Filter log by specific model/provider\n"
+    "  -j, --threads    Threads hashing sources for a whole-set status (default: all CPUs)\n"
     "  --help          Display this help message\n"
     "\n"
     "Examples:\n"
+    "  embr status                  # List modified and missing sources\n"
     "  embr status file.txt         # Show basic status\n"
     "  embr status -v file.txt      # Show detailed status with metadata\n"
     "  embr status --model openai file.txt  # Show status for openai model only\n"
@@ -64,6 +70,7 @@ static const char *STATUS_USAGE =
 
 // Forward declarations
 static int show_status(char** rel_paths, size_t num_paths, const char* repo_root);
+static int show_set_status(const char* repo_root, const char* model, unsigned threads, bool verbose);
 static __attribute__((unused)) char* get_metadata(const char* root, const char* hash);
 
 // Forward declaration for get_current_hash_with_model from core/store.h
@@ -82,7 +89,7 @@ static char* get_metadata(const char* root, const char* hash)
     DEBUG_PRINT("get_metadata: Starting with root=%s, hash=%s", root, hash);
     
     char meta_path[MAX_PATH_LEN];
-    snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", root, hash);
+    eb_object_path(root, hash, "meta", meta_path, sizeof(meta_path));
     DEBUG_PRINT("get_metadata: Looking for metadata file at %s", meta_path);
 
     FILE *f = fopen(meta_path, "r");
@@ -123,116 +130,83 @@ static char* get_metadata(const char* root, const char* hash)
     return metadata;
 }
 
+/* Comma-separated hashes logged for a source */
+struct history_ctx {
+	const char* model_filter;
+	char* history;
+	size_t pos;
+};
+
+static int append_history_hash(const eb_log_entry_t* entry, void* data)
+{
+	struct history_ctx* ctx = data;
+
+	if (entry->removed)
+		return 0;
+
+	// Skip if model filter is specified and doesn't match
+	if (ctx->model_filter && strcmp(ctx->model_filter, entry->model) != 0) {
+		DEBUG_PRINT("Skipping entry due to model filter mismatch: %s != %s",
+			entry->model[0] ? entry->model : "none", ctx->model_filter);
+		return 0;
+	}
+
+	size_t len = strlen(entry->hash);
+	size_t sep = ctx->pos > 0 ? 2 : 0;
+	if (ctx->pos + sep + len >= MAX_LINE_LEN) {
+		DEBUG_PRINT("Log string too long, truncating");
+		return 1;
+	}
+	memcpy(ctx->history + ctx->pos, ", ", sep);
+	memcpy(ctx->history + ctx->pos + sep, entry->hash, len);
+	ctx->pos += sep + len;
+	ctx->history[ctx->pos] = '\0';
+	return 0;
+}
+
+/* Distinct models logged for a source */
+struct log_models_ctx {
+	char* models[32]; // Maximum 32 different models
+	int count;
+};
+
+static int collect_log_model(const eb_log_entry_t* entry, void* data)
+{
+	struct log_models_ctx* ctx = data;
+	if (!entry->model[0] || entry->removed)
+		return 0;
+
+	for (int m = 0; m < ctx->count; m++) {
+		if (strcmp(ctx->models[m], entry->model) == 0)
+			return 0;
+	}
+
+	DEBUG_PRINT("show_status: Found new model %s for file %s", entry->model, entry->source);
+	ctx->models[ctx->count] = strdup(entry->model);
+	if (ctx->models[ctx->count])
+		ctx->count++;
+	return ctx->count == 32;
+}
+
 // Get log entries
 static char* get_history(const char* root, const char* source, const char* model_filter) {
 	char* log_path = get_current_set_log_path();
-	FILE *f = fopen(log_path, "r");
-	free(log_path);
-	if (!f) return NULL;
+	if (!log_path || access(log_path, F_OK) != 0) {
+		free(log_path);
+		return NULL;
+	}
 
 	char *history = malloc(MAX_LINE_LEN);
 	if (!history) {
-		fclose(f);
+		free(log_path);
 		return NULL;
 	}
-	
+
 	// Initialize log string
 	history[0] = '\0';
-	size_t pos = 0;
-	char line[MAX_LINE_LEN];
-	
-	while (fgets(line, sizeof(line), f)) {
-		// Remove newline if present
-		line[strcspn(line, "\n")] = 0;
-		
-		char file[MAX_PATH_LEN] = {0};
-		char hash[MAX_HASH_LEN] = {0};
-		char timestamp[32] = {0};
-		char provider[32] = {0};
-		
-		// Try to parse as new format first: source hash timestamp provider
-		int parsed = sscanf(line, "%s %s %s %s", file, hash, timestamp, provider);
-		
-		if (parsed >= 3 && strcmp(file, source) == 0) {
-			// Check if we have provider info (new format)
-			bool has_provider = (parsed == 4 && provider[0] != '\0');
-			
-			DEBUG_PRINT("Parsed log line: file=%s hash=%s timestamp=%s model=%s format=%s", 
-				file, hash, timestamp, has_provider ? provider : "none", 
-				has_provider ? "new" : "old");
-			
-			// Skip if model filter is specified and doesn't match or provider info is missing
-			if (model_filter != NULL) {
-				if (!has_provider || strcmp(model_filter, provider) != 0) {
-					DEBUG_PRINT("Skipping entry due to model filter mismatch: %s != %s", 
-						has_provider ? provider : "none", model_filter);
-					continue;
-				}
-			}
-			
-			// Add hash to log string
-			if (pos > 0) {
-				// Check if we have enough space for ", " + hash
-				if (pos + 2 + strlen(hash) >= MAX_LINE_LEN) {
-					DEBUG_PRINT("Log string too long, truncating");
-					break;
-				}
-				strcat(history + pos, ", ");
-				pos += 2;
-			}
-			
-			// Check if we have enough space for hash
-			if (pos + strlen(hash) >= MAX_LINE_LEN) {
-				DEBUG_PRINT("Log string too long, truncating");
-				break;
-			}
-			
-			strcpy(history + pos, hash);
-			pos += strlen(hash);
-		} else {
-			// Try old format: timestamp hash file
-			time_t ts;
-			parsed = sscanf(line, "%ld %s %s", &ts, hash, file);
-			
-			if (parsed != 3 || strcmp(file, source) != 0) {
-				// Not matching either format or not for this file
-				continue;
-			}
-			
-			DEBUG_PRINT("Parsed old format log line: timestamp=%ld hash=%s file=%s", 
-				ts, hash, file);
-			
-			// Old format doesn't have provider info, so if filtering by model, skip
-			if (model_filter != NULL) {
-				DEBUG_PRINT("Skipping old format entry due to model filter");
-				continue;
-			}
-			
-			// Add hash to log string
-			if (pos > 0) {
-				// Check if we have enough space for ", " + hash
-				if (pos + 2 + strlen(hash) >= MAX_LINE_LEN) {
-					DEBUG_PRINT("Log string too long, truncating");
-					break;
-				}
-				strcat(history + pos, ", ");
-				pos += 2;
-			}
-			
-			// Check if we have enough space for hash
-			if (pos + strlen(hash) >= MAX_LINE_LEN) {
-				DEBUG_PRINT("Log string too long, truncating");
-				break;
-			}
-			
-			strcpy(history + pos, hash);
-			pos += strlen(hash);
-		}
-	}
-	
-	// Ensure null termination
-	history[pos] = '\0';
-	fclose(f);
+	struct history_ctx ctx = { model_filter, history, 0 };
+	eb_log_foreach_source(log_path, source, append_history_hash, &ctx);
+	free(log_path);
 	return history;
 }
 
@@ -451,44 +425,19 @@ static int show_status(char** rel_paths, size_t num_paths, const char* repo_root
             
             // First, get the log file path
             char* log_path = get_current_set_log_path();
-            FILE* fp = fopen(log_path, "r");
-            free(log_path);
-            if (!fp) {
+            if (!log_path || access(log_path, F_OK) != 0) {
+                free(log_path);
                 DEBUG_PRINT("show_status: Could not open log file");
                 fprintf(stderr, "No embedding log found for %s\n", rel_paths[i]);
                 continue;
             }
             
-            // Create a set of model types for this file
-            char* models[32] = {0}; // Maximum 32 different models
-            int model_count = 0;
-            
-            // Scan the log file for model types used with this source
-            char line[2048];
-            while (fgets(line, sizeof(line), fp) && model_count < 32) {
-                char timestamp[32], hash[65], file[PATH_MAX], provider[32];
-                line[strcspn(line, "\n")] = 0;
-                
-                // Parse log line: timestamp hash path model
-                int parsed = sscanf(line, "%s %s %s %s", timestamp, hash, file, provider);
-                if (parsed == 4 && strcmp(file, rel_paths[i]) == 0) {
-                    // Check if we already have this model in our array
-                    bool model_exists = false;
-                    for (int m = 0; m < model_count; m++) {
-                        if (strcmp(models[m], provider) == 0) {
-                            model_exists = true;
-                            break;
-                        }
-                    }
-                    
-                    // If it's a new model, add it to our array
-                    if (!model_exists) {
-                        DEBUG_PRINT("show_status: Found new model %s for file %s", provider, rel_paths[i]);
-                        models[model_count++] = strdup(provider);
-                    }
-                }
-            }
-            fclose(fp);
+            // Collect the model types logged for this source
+            struct log_models_ctx logged = { {0}, 0 };
+            eb_log_foreach_source(log_path, rel_paths[i], collect_log_model, &logged);
+            free(log_path);
+            char** models = logged.models;
+            int model_count = logged.count;
             
             // Now process each model type
             if (model_count == 0) {
@@ -572,20 +521,82 @@ static int show_status(char** rel_paths, size_t num_paths, const char* repo_root
     return 0;
 }
 
+/* Print one line per source of a whole-set status */
+struct set_status_ctx {
+    bool verbose;
+};
+
+static int print_source_status(const eb_source_status_t* status, void* data)
+{
+    const struct set_status_ctx* ctx = data;
+    const char* label;
+    const char* color;
+    switch (status->state) {
+    case EB_SOURCE_MODIFIED:
+        label = "modified:";
+        color = COLOR_BOLD_RED;
+        break;
+    case EB_SOURCE_MISSING:
+        label = "missing:";
+        color = COLOR_BOLD_RED;
+        break;
+    default:
+        if (!ctx->verbose)
+            return 0;
+        label = "unchanged:";
+        color = COLOR_BOLD_GREEN;
+        break;
+    }
+
+    printf("  %s%-11s%s %s", color, label, COLOR_RESET, status->source);
+    if (status->model[0])
+        printf(" (%s)", status->model);
+    if (ctx->verbose)
+        printf("  %.7s, %zu version%s%s", status->hash, status->versions,
+               status->versions == 1 ? "" : "s", status->hashed ? "" : ", by mtime");
+    printf("\n");
+    return 0;
+}
+
+/* Check every source of the current set in one pass */
+static int show_set_status(const char* repo_root, const char* model, unsigned threads, bool verbose)
+{
+    struct set_status_ctx ctx = { verbose };
+    eb_source_status_options_t options = { .model = model, .threads = threads };
+    eb_source_summary_t summary;
+
+    eb_status_t status = eb_source_status(repo_root, &options, print_source_status, &ctx, &summary);
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to read the set index");
+        return 1;
+    }
+
+    if (summary.sources == 0) {
+        printf("No embeddings tracked in the current set\n");
+    } else if (summary.modified == 0 && summary.missing == 0) {
+        printf("All %zu tracked sources are up to date\n", summary.sources);
+    } else {
+        printf("\n%zu tracked, %zu modified, %zu missing\n",
+               summary.sources, summary.modified, summary.missing);
+    }
+    return 0;
+}
+
 int cmd_status(int argc, char* argv[])
 {
     DEBUG_PRINT("cmd_status: Starting with %d arguments", argc);
     
-    if (argc < 2 || has_option(argc, argv, "-h") || has_option(argc, argv, "--help")) {
+    if (has_option(argc, argv, "-h") || has_option(argc, argv, "--help")) {
         printf("%s", STATUS_USAGE);
-        return (argc < 2) ? 1 : 0;
+        return 0;
     }
     
     // Find the source argument
     const char *source = NULL;
     for (int i = 1; i < argc; i++) {
         if (argv[i][0] != '-' && 
-            (i == 1 || (strcmp(argv[i-1], "--model") != 0 && strcmp(argv[i-1], "-m") != 0))) {
+            (i == 1 || (strcmp(argv[i-1], "--model") != 0 && strcmp(argv[i-1], "-m") != 0 &&
+                        strcmp(argv[i-1], "--threads") != 0 && strcmp(argv[i-1], "-j") != 0))) {
             source = argv[i];
             DEBUG_PRINT("cmd_status: Found source argument: %s", source);
             break;
@@ -593,9 +604,18 @@ int cmd_status(int argc, char* argv[])
     }
 
     if (!source) {
-        DEBUG_PRINT("cmd_status: No source file specified");
-        cli_error("No source file specified");
-        return 1;
+        // No source: check the whole set
+        char *root = find_repo_root(NULL);
+        if (!root) {
+            fprintf(stderr, "Error: Not in an eb repository\n");
+            return 1;
+        }
+        int threads = get_int_option(argc, argv, "-j", "--threads", 0);
+        bool verbose = has_option(argc, argv, "-v") || has_option(argc, argv, "--verbose");
+        int ret = show_set_status(root, get_option_value(argc, argv, "-m", "--model"),
+                                  threads > 0 ? (unsigned)threads : 0, verbose);
+        free(root);
+        return ret;
     }
 
     // Find repository root from current working directory
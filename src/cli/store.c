@@ -26,38 +26,63 @@
 #include <time.h>
 #include "../core/debug.h"  // For DEBUG_PRINT
 #include "../core/path_utils.h"
-#include <npy_array_list.h>  // Changed from npy_array.h
+#include "../core/quantize.h"
+#include "../core/store_stream.h"
 #include <linux/limits.h>  // For PATH_MAX
-#include <openssl/sha.h>  // For SHA256
 
 // Add after the includes, before any functions
 #define MAX_LINE_LEN 2048
 #define MAX_PATH_LEN PATH_MAX
 #define MAX_HASH_LEN 65
 
-// Function declarations
-eb_status_t eb_git_get_metadata(const char* file_path, eb_git_metadata_t** meta);
-
 static const char* STORE_USAGE = 
     "Usage: embr store [options] <embedding> <file>\n"
+    "   or: embr store [options] <matrix> <file>...\n"
+    "   or: embr store [options] --batch <manifest.tsv>\n"
+    "   or: embr store [options] --stdin [--format ndjson|binary-frames]\n"
     "\n"
     "Store embeddings for documents\n"
     "\n"
     "Options:\n"
     "  -d, --dims <dims>     Dimensions for .bin files (required)\n"
     "  -m, --model <name>    Model name to record with embedding\n" 
+    "  -b, --batch <file>    Store every embedding listed in a manifest (- for\n"
+    "                        standard input) and update the set index once\n"
+    "  -t, --dtype <type>    Store as float32 (default), fp16, bf16 or int8;\n"
+    "                        reduced types are quantized on ingest\n"
+    "  -s, --stdin           Store a stream of records read from standard input,\n"
+    "                        committing as they arrive\n"
+    "  -f, --format <fmt>    Stream format: ndjson (default) or binary-frames\n"
+    "  -n, --commit-every <n>\n"
+    "                        Commit a stream after n records (default 4096)\n"
+    "  -T, --commit-ms <ms>  or once its oldest record is ms old (default 50)\n"
     "  -v, --verbose         Show detailed output\n"
     "  -q, --quiet           Suppress warning messages\n"
     "  -h, --help            Show this help message\n"
     "\n"
     "Arguments:\n"
-    "  <embedding>           Precomputed embedding file (.bin or .npy)\n"
+    "  <embedding>           Precomputed embedding file (.npy, .npz or .bin)\n"
+    "  <matrix>              N x D matrix (.npy, .npz or .bin with --dims),\n"
+    "                        row i is stored as the embedding of the i-th file\n"
     "  <file>                Original document file\n"
     "\n"
+    "Manifest format (one embedding per line, tab separated):\n"
+    "  <embedding>\t<file>[\t<model>]\n"
+    "  Blank lines and lines starting with '#' are ignored.\n"
+    "\n"
+    "Stream formats (records without a model take --model):\n"
+    "  ndjson         {\"source\":\"doc.txt\",\"model\":\"m\",\"values\":[0.25,...]} per line\n"
+    "  binary-frames  u32 length, u16 source length, source, u16 model length,\n"
+    "                 model, u32 dims, dims float32 values; all little-endian\n"
+    "\n"
     "Examples:\n"
     "  embr store vector.bin -d 1536 doc.txt    # Store binary embedding\n"
     "  embr store vector.npy doc.txt            # Store numpy embedding\n"
-    "  embr store -m openai-3 vector.npy doc.txt  # Specify model name\n";
+    "  embr store -m openai-3 vector.npy doc.txt  # Specify model name\n"
+    "  embr store -m openai-3 --batch vectors.tsv  # Store many at once\n"
+    "  embr store --dtype fp16 vector.npy doc.txt  # Store at half precision\n"
+    "  embr store matrix.npy a.txt b.txt c.txt  # One row per file\n"
+    "  model-server | embr store --stdin -m openai-3  # Store as they are embedded\n";
 
 static bool validate_file(const char* file_path, bool quiet) {
     struct stat st;
@@ -117,121 +142,8 @@ static int write_metadata(const char *meta_path, const char *source_file, const
     return 0;
 }
 
-/* Data format handlers for different embedding types */
-struct embedding_handler {
-    const char *suffix;
-    bool (*store)(const char *src, const char *dst);
-    bool (*validate)(const char *path);
-};
-
-/* Store raw float32 data from .npy file */
-static bool store_npy_data(const char *src_path, const char *dst_path) 
-{
-    DEBUG_PRINT("Storing .npy file: %s -> %s", src_path, dst_path);
-    
-    // Use npy_array library to load the file
-    npy_array_t *src_arr = npy_array_load(src_path);
-    if (!src_arr) {
-        DEBUG_PRINT("Failed to load .npy file");
-        return false;
-    }
-
-    // Validate format - we expect float32 1D arrays
-    if (src_arr->typechar != 'f' || src_arr->ndim != 1) {
-        DEBUG_PRINT("Invalid .npy format: type=%c dims=%d (expected: type=f dims=1)", 
-                   src_arr->typechar, src_arr->ndim);
-        npy_array_free(src_arr);
-        return false;
-    }
-
-    // Get dimensions and data
-    size_t float_count = src_arr->shape[0];
-    float *data = (float*)src_arr->data;
-
-    // Calculate hash of just the float data
-    unsigned char hash[32];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, data, float_count * sizeof(float));
-    SHA256_Final(hash, &sha256);
-    
-    char hash_str[65];
-    for (int i = 0; i < 32; i++) {
-        sprintf(&hash_str[i * 2], "%02x", hash[i]);
-    }
-    hash_str[64] = '\0';
-    
-    DEBUG_PRINT("Generated hash from data only: %s", hash_str);
-
-    // Create array structure
-    npy_array_t array = {
-        .data = (char*)data,
-        .shape = { float_count },
-        .ndim = 1,
-        .typechar = 'f',
-        .elem_size = sizeof(float),
-        .fortran_order = false
-    };
-
-    // Save using npy_array library
-    npy_array_save(dst_path, &array);
-
-    // Cleanup
-    npy_array_free(src_arr);
-    return true;
-}
-
-/* Store raw binary data */
-static bool store_bin_data(const char *src_path, const char *dst_path)
-{
-    DEBUG_PRINT("Storing binary file: %s -> %s", src_path, dst_path);
-    
-    struct stat st;
-    if (stat(src_path, &st) != 0) {
-        DEBUG_PRINT("Cannot stat source file");
-        return false;
-    }
-
-    FILE *src = fopen(src_path, "rb");
-    FILE *dst = fopen(dst_path, "wb");
-    if (!src || !dst) {
-        if (src) fclose(src);
-        if (dst) fclose(dst);
-        return false;
-    }
-
-    // Copy raw bytes for exact duplication
-    char buffer[4096];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), src)) > 0) {
-        if (fwrite(buffer, 1, bytes_read, dst) != bytes_read) {
-            DEBUG_PRINT("Write failed");
-            fclose(src);
-            fclose(dst);
-            return false;
-        }
-    }
-
-    fclose(src);
-    fclose(dst);
-    return true;
-}
-
-static const struct embedding_handler handlers[] = {
-    { ".npy", store_npy_data, NULL },
-    { ".bin", store_bin_data, NULL },
-    { NULL, NULL, NULL }
-};
-
-static bool ends_with(const char *str, const char *suffix) {
-    size_t str_len = strlen(str);
-    size_t suffix_len = strlen(suffix);
-    if (str_len < suffix_len) return false;
-    return strcmp(str + str_len - suffix_len, suffix) == 0;
-}
-
 static bool cli_store_embedding_file(const char *embedding_path, const char *source_file,
-                               const char *base_dir, const char *model) {
+                               const char *base_dir, const char *model, eb_dtype_t dtype) {
     DEBUG_PRINT("cli_store_embedding_file: Starting storage operation");
     DEBUG_PRINT("  embedding_path: %s", embedding_path);
     DEBUG_PRINT("  source_file: %s", source_file);
@@ -239,7 +151,7 @@ static bool cli_store_embedding_file(const char *embedding_path, const char *sou
     DEBUG_PRINT("  model: %s", model ? model : "unknown");
 
     // Call the core implementation
-    eb_status_t status = store_embedding_file(embedding_path, source_file, base_dir, model);
+    eb_status_t status = store_embedding_file(embedding_path, source_file, base_dir, model, dtype);
     if (status != EB_SUCCESS) {
         cli_error("Failed to store embedding");
         return false;
@@ -249,7 +161,8 @@ static bool cli_store_embedding_file(const char *embedding_path, const char *sou
     return true;
 }
 
-int store_precomputed(const char *embedding_file, size_t dims, const char *source_file, const char *model) {
+int store_precomputed(const char *embedding_file, size_t dims, const char *source_file, const char *model,
+                      eb_dtype_t dtype) {
     DEBUG_PRINT("store_precomputed: embedding_file=%s, source_file=%s", 
                 embedding_file, source_file);
 
@@ -278,7 +191,7 @@ int store_precomputed(const char *embedding_file, size_t dims, const char *sourc
     }
 
     // Store the embedding
-    eb_status_t status = cli_store_embedding_file(rel_embedding, rel_source, repo_root, model);
+    eb_status_t status = cli_store_embedding_file(rel_embedding, rel_source, repo_root, model, dtype);
 
     free(repo_root);
     free(rel_source);
@@ -326,7 +239,7 @@ int store_from_source(const char *source_file, int argc, char **argv)
 
         DEBUG_PRINT("store_from_source: source_file=%s\n", source_file);
 
-        if (!cli_store_embedding_file(source_file, source_file, cwd, model)) {
+        if (!cli_store_embedding_file(source_file, source_file, cwd, model, EB_FLOAT32)) {
                 goto cleanup;
         }
 
@@ -339,12 +252,336 @@ cleanup:
         return ret;
 }
 
+/*
+ * Model named in an embedding file name, or NULL
+ * Format: filename.model.npy or filename.model.bin
+ */
+static char* model_from_filename(const char* embedding_path)
+{
+    const char* filename = strrchr(embedding_path, '/');
+    if (!filename) filename = embedding_path;
+    else filename++; // Skip the slash
+
+    char* temp = strdup(filename);
+    if (!temp)
+        return NULL;
+
+    char* model = NULL;
+    char* last_dot = strrchr(temp, '.');
+    if (last_dot) {
+        *last_dot = '\0'; // Terminate string at last dot
+        char* prev_dot = strrchr(temp, '.');
+        if (prev_dot) {
+            // Extract model name between dots
+            model = strdup(prev_dot + 1);
+            DEBUG_PRINT("Extracted model from filename: %s", model);
+        }
+    }
+
+    free(temp);
+    return model;
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Warn about sources with uncommitted changes, whose embeddings may not
+ * match what was committed; one metadata lookup for the whole batch
+ */
+static void warn_modified(char **sources, size_t count)
+{
+    if (count == 0)
+        return;
+    eb_git_metadata_t *meta = malloc(count * sizeof(*meta));
+    if (!meta)
+        return;
+    if (eb_git_get_metadata_many((const char *const *)sources, count, meta) == EB_SUCCESS) {
+        for (size_t i = 0; i < count; i++) {
+            if (meta[i].is_modified && (i == 0 || strcmp(sources[i], sources[i - 1]) != 0))
+                fprintf(stderr, "warning: %s has changes not committed to %.7s\n",
+                        sources[i], meta[i].commit_id);
+        }
+    }
+    free(meta);
+}
+
+/*
+ * Store every embedding listed in a manifest through one batch, so the
+ * set index and log are rewritten once rather than once per line.
+ */
+static int store_batch(const char *manifest_path, const char *default_model,
+                       eb_dtype_t dtype, bool verbose, bool quiet)
+{
+    bool from_stdin = strcmp(manifest_path, "-") == 0;
+    FILE *manifest = from_stdin ? stdin : fopen(manifest_path, "r");
+    if (!manifest) {
+        cli_error("%s: %s", manifest_path, strerror(errno));
+        return 1;
+    }
+
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        if (!quiet) {
+            fprintf(stderr, "Error: Not in an eb repository\n");
+            fprintf(stderr, "hint: Run 'eb init' to create a new repository\n");
+        }
+        if (!from_stdin)
+            fclose(manifest);
+        return 1;
+    }
+
+    eb_store_batch_t *batch = NULL;
+    eb_status_t status = eb_store_batch_begin(repo_root, &batch);
+    if (status == EB_SUCCESS) {
+        status = eb_store_batch_set_dtype(batch, dtype);
+        if (status != EB_SUCCESS)
+            eb_store_batch_abort(batch);
+    }
+    if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to start batch");
+        free(repo_root);
+        if (!from_stdin)
+            fclose(manifest);
+        return 1;
+    }
+
+    char line[MAX_LINE_LEN * 2];
+    size_t line_no = 0;
+    size_t stored = 0;
+    int ret = 0;
+    char **sources = NULL;
+    size_t source_capacity = 0;
+
+    while (fgets(line, sizeof(line), manifest)) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        char *embedding = line;
+        char *source = strchr(embedding, '\t');
+        char *model = NULL;
+        if (source) {
+            *source++ = '\0';
+            model = strchr(source, '\t');
+            if (model)
+                *model++ = '\0';
+        }
+        if (!source || !*embedding || !*source) {
+            cli_error("%s:%zu: expected <embedding>\\t<file>[\\t<model>]",
+                      manifest_path, line_no);
+            ret = 1;
+            break;
+        }
+
+        char *rel_source = get_relative_path(source, repo_root);
+        char *rel_embedding = get_relative_path(embedding, repo_root);
+        if (!rel_source || !rel_embedding) {
+            cli_error("%s:%zu: files must be within repository", manifest_path, line_no);
+            free(rel_source);
+            free(rel_embedding);
+            ret = 1;
+            break;
+        }
+
+        char *name_model = NULL;
+        if (!model || !*model)
+            model = (char *)default_model;
+        if (!model)
+            model = name_model = model_from_filename(rel_embedding);
+
+        char hash[MAX_HASH_LEN];
+        status = eb_store_batch_add(batch, rel_embedding, rel_source, model, hash);
+        if (status == EB_SUCCESS) {
+            if (verbose)
+                printf("✓ %s (%.7s)\n", rel_source, hash);
+            // Kept for the check against git once the batch is in
+            if (stored == source_capacity) {
+                size_t capacity = source_capacity ? source_capacity * 2 : 64;
+                char **grown = realloc(sources, capacity * sizeof(*grown));
+                if (grown) {
+                    sources = grown;
+                    source_capacity = capacity;
+                }
+            }
+            if (stored < source_capacity) {
+                sources[stored] = rel_source;
+                rel_source = NULL;
+            }
+            stored++;
+        } else {
+            cli_error("%s:%zu: failed to store %s: %s", manifest_path, line_no,
+                      embedding, eb_status_str(status));
+            ret = 1;
+        }
+
+        free(name_model);
+        free(rel_source);
+        free(rel_embedding);
+        if (ret)
+            break;
+    }
+    if (!from_stdin)
+        fclose(manifest);
+
+    if (ret) {
+        // Nothing is indexed; the objects written so far are left for gc
+        eb_store_batch_abort(batch);
+    } else {
+        status = eb_store_batch_commit(batch);
+        if (status != EB_SUCCESS) {
+            handle_error(status, "Failed to update index");
+            ret = 1;
+        }
+    }
+    free(repo_root);
+
+    size_t kept = stored < source_capacity ? stored : source_capacity;
+    if (!ret && !quiet && kept > 0) {
+        qsort(sources, kept, sizeof(*sources), compare_strings);
+        warn_modified(sources, kept);
+    }
+    for (size_t i = 0; i < kept; i++)
+        free(sources[i]);
+    free(sources);
+    if (ret)
+        return ret;
+
+    if (!quiet)
+        printf("Stored %zu embeddings from %s\n", stored,
+               from_stdin ? "standard input" : manifest_path);
+    return 0;
+}
+
+/*
+ * Store the rows of one N x D matrix as the embeddings of N source files,
+ * through one batch
+ */
+int store_matrix(const char *matrix_path, char **source_files, size_t count,
+                 const char *model, size_t dims, eb_dtype_t dtype,
+                 bool verbose, bool quiet)
+{
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        if (!quiet) {
+            fprintf(stderr, "Error: Not in an eb repository\n");
+            fprintf(stderr, "hint: Run 'eb init' to create a new repository\n");
+        }
+        return 1;
+    }
+
+    char *rel_matrix = get_relative_path(matrix_path, repo_root);
+    char **rel_sources = calloc(count, sizeof(*rel_sources));
+    char (*hashes)[MAX_HASH_LEN] = calloc(count, sizeof(*hashes));
+    int ret = rel_matrix && rel_sources && hashes ? 0 : 1;
+    for (size_t i = 0; i < count && ret == 0; i++) {
+        rel_sources[i] = get_relative_path(source_files[i], repo_root);
+        if (!rel_sources[i])
+            ret = 1;
+    }
+    if (ret) {
+        if (!quiet)
+            fprintf(stderr, "Error: Files must be within repository\n");
+        goto cleanup;
+    }
+
+    char *name_model = NULL;
+    if (!model)
+        model = name_model = model_from_filename(rel_matrix);
+
+    eb_store_batch_t *batch = NULL;
+    eb_status_t status = eb_store_batch_begin(repo_root, &batch);
+    if (status == EB_SUCCESS) {
+        status = eb_store_batch_set_dtype(batch, dtype);
+        if (status == EB_SUCCESS)
+            status = eb_store_batch_add_rows(batch, rel_matrix, dims,
+                                             (const char *const *)rel_sources, count, model, hashes);
+        if (status == EB_SUCCESS) {
+            status = eb_store_batch_commit(batch);
+        } else {
+            // Nothing is indexed; the objects written so far are left for gc
+            eb_store_batch_abort(batch);
+        }
+    }
+    free(name_model);
+
+    if (status == EB_ERROR_DIMENSION_MISMATCH) {
+        cli_error("%s does not hold one embedding per file (%zu files given)", matrix_path, count);
+        ret = 1;
+    } else if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to store matrix");
+        ret = 1;
+    } else {
+        for (size_t i = 0; verbose && i < count; i++)
+            printf("✓ %s (%.7s)\n", rel_sources[i], hashes[i]);
+        if (!quiet)
+            printf("Stored %zu embeddings from %s\n", count, matrix_path);
+    }
+
+cleanup:
+    for (size_t i = 0; rel_sources && i < count; i++)
+        free(rel_sources[i]);
+    free(rel_sources);
+    free(hashes);
+    free(rel_matrix);
+    free(repo_root);
+    return ret;
+}
+
+/* Print each commit of a stream as it lands */
+static void report_stream_commit(void *ctx, size_t records)
+{
+    (void)ctx;
+    printf("✓ Committed %zu embeddings\n", records);
+    fflush(stdout);
+}
+
+/*
+ * Store the records a producer writes to standard input, committing every
+ * few records or milliseconds until it closes the stream
+ */
+static int store_stream(const eb_stream_options_t *options, bool verbose, bool quiet)
+{
+    char* repo_root = find_repo_root(".");
+    if (!repo_root) {
+        if (!quiet) {
+            fprintf(stderr, "Error: Not in an eb repository\n");
+            fprintf(stderr, "hint: Run 'eb init' to create a new repository\n");
+        }
+        return 1;
+    }
+
+    eb_stream_options_t stream_options = *options;
+    if (verbose)
+        stream_options.on_commit = report_stream_commit;
+    eb_stream_stats_t stats;
+    eb_status_t status = eb_store_stream(repo_root, STDIN_FILENO, &stream_options, &stats);
+    free(repo_root);
+
+    if (status == EB_ERROR_INVALID_FORMAT || status == EB_ERROR_LIMIT_EXCEEDED) {
+        cli_error("stdin: record %zu: %s", stats.line, status == EB_ERROR_INVALID_FORMAT
+                  ? "malformed record" : "record too large");
+    } else if (status != EB_SUCCESS) {
+        handle_error(status, "Failed to store stream");
+    }
+    if (!quiet)
+        printf("Stored %zu embeddings in %zu commits\n", stats.records, stats.commits);
+    return status == EB_SUCCESS ? 0 : 1;
+}
+
 // Define a context structure to hold parsing results
 typedef struct {
     const char *embedding_file;
     const char *source_file;
+    const char *batch_manifest;
     const char *model;
     size_t dims;
+    eb_dtype_t dtype;
+    bool stream;
+    eb_stream_options_t stream_options;
     bool verbose;
     bool quiet;
 } store_context_t;
@@ -365,6 +602,42 @@ static int store_option_callback(char short_opt, const char* long_opt, const cha
                 return 1;
             }
             break;
+        case 'b':
+            context->batch_manifest = arg;
+            break;
+        case 't':
+            if (eb_dtype_from_name(arg, &context->dtype) != EB_SUCCESS) {
+                fprintf(stderr, "error: Unknown dtype '%s' (expected float32, fp16, bf16 or int8)\n", arg);
+                return 1;
+            }
+            break;
+        case 's':
+            context->stream = true;
+            break;
+        case 'f':
+            if (strcmp(arg, "ndjson") == 0) {
+                context->stream_options.format = EB_STREAM_NDJSON;
+            } else if (strcmp(arg, "binary-frames") == 0) {
+                context->stream_options.format = EB_STREAM_FRAMES;
+            } else {
+                fprintf(stderr, "error: Unknown stream format '%s' (expected ndjson or binary-frames)\n", arg);
+                return 1;
+            }
+            break;
+        case 'n':
+            context->stream_options.commit_records = (size_t)atol(arg);
+            if (context->stream_options.commit_records == 0) {
+                fprintf(stderr, "error: Invalid record count '%s'\n", arg);
+                return 1;
+            }
+            break;
+        case 'T':
+            context->stream_options.commit_ms = (unsigned)atoi(arg);
+            if (context->stream_options.commit_ms == 0) {
+                fprintf(stderr, "error: Invalid interval '%s'\n", arg);
+                return 1;
+            }
+            break;
         case 'v':
             context->verbose = true;
             break;
@@ -395,17 +668,25 @@ int cmd_store(int argc, char *argv[])
     store_context_t context = {
         .embedding_file = NULL,
         .source_file = NULL,
+        .batch_manifest = NULL,
         .model = NULL,
         .dims = 0,
+        .dtype = EB_FLOAT32,
         .verbose = false,
         .quiet = false
     };
     
     // Define option definitions
-    const char* short_opts = "m:d:vqh";
+    const char* short_opts = "m:d:b:t:sf:n:T:vqh";
     const char* long_opts[] = {
         "--model",
         "--dims",
+        "--batch",
+        "--dtype",
+        "--stdin",
+        "--format",
+        "--commit-every",
+        "--commit-ms",
         "--verbose",
         "--quiet",
         "--help",
@@ -427,6 +708,31 @@ int cmd_store(int argc, char *argv[])
     if (result != 0) {
         return result;
     }
+
+    if (context.stream) {
+        if (pos_count > 0 || context.batch_manifest) {
+            fprintf(stderr, "error: --stdin does not take a manifest or positional arguments\n");
+            return 1;
+        }
+        context.stream_options.model = context.model;
+        context.stream_options.dtype = context.dtype;
+        return store_stream(&context.stream_options, context.verbose, context.quiet);
+    }
+
+    if (context.batch_manifest) {
+        if (pos_count > 0) {
+            fprintf(stderr, "error: --batch does not take positional arguments\n");
+            return 1;
+        }
+        return store_batch(context.batch_manifest, context.model, context.dtype,
+                           context.verbose, context.quiet);
+    }
+    
+    // A matrix followed by one source file per row
+    if (pos_count > 2) {
+        return store_matrix(positional[0], positional + 1, (size_t)pos_count - 1, context.model,
+                            context.dims, context.dtype, context.verbose, context.quiet);
+    }
     
     // Process positional arguments
     if (pos_count >= 1) {
@@ -482,6 +788,8 @@ int cmd_store(int argc, char *argv[])
             printf("→ Using embedding with %zu dimensions\n", context.dims);
         if (context.model)
             printf("→ Using model: %s\n", context.model);
+        if (context.dtype != EB_FLOAT32)
+            printf("→ Storing as %s\n", eb_dtype_name(context.dtype));
     }
 
     // Find repository root first
@@ -514,32 +822,12 @@ int cmd_store(int argc, char *argv[])
     if (context.embedding_file) {
         // If model not specified on command line, try to extract from filename
         if (!context.model) {
-            // Check if embedding file has a model indicator in its name
-            // Format: filename.model.npy or filename.model.bin
-            const char* filename = strrchr(rel_embedding, '/');
-            if (!filename) filename = rel_embedding;
-            else filename++; // Skip the slash
-            
-            char* last_dot = strrchr(filename, '.');
-            if (last_dot) {
-                // Go back to previous dot
-                char* temp = strdup(filename);
-                char* temp_last_dot = strrchr(temp, '.');
-                *temp_last_dot = '\0'; // Temporarily terminate string at last dot
-                char* prev_dot = strrchr(temp, '.');
-                
-                if (prev_dot) {
-                    // Extract model name between dots
-                    context.model = strdup(prev_dot + 1);
-                    DEBUG_PRINT("Extracted model from filename: %s", context.model);
-                }
-                
-                free(temp);
-            }
+            context.model = model_from_filename(rel_embedding);
         }
         
         // Store with explicit model parameter
-        process_result = store_precomputed(rel_embedding, context.dims, rel_source, context.model);
+        process_result = store_precomputed(rel_embedding, context.dims, rel_source, context.model,
+                                           context.dtype);
     } else {
         process_result = store_from_source(rel_source, argc, argv);
     }
@@ -0,0 +1,134 @@
+/*
+ * EmbeddingBridge - Arena Allocator Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define ARENA_DEFAULT_CHUNK 4096
+#define ARENA_CHUNK_ALIGN 64
+
+struct eb_arena_chunk {
+    eb_arena_chunk_t* next;
+    size_t size;                /* Usable bytes after the header */
+    size_t used;
+};
+
+/* The header is padded so chunk data starts 64-byte aligned */
+#define ARENA_HEADER_SIZE \
+    ((sizeof(eb_arena_chunk_t) + ARENA_CHUNK_ALIGN - 1) & ~(size_t)(ARENA_CHUNK_ALIGN - 1))
+
+static unsigned char* chunk_data(eb_arena_chunk_t* chunk) {
+    return (unsigned char*)chunk + ARENA_HEADER_SIZE;
+}
+
+void eb_arena_init(eb_arena_t* arena, size_t first_chunk) {
+    arena->chunks = NULL;
+    arena->next_size = first_chunk ? first_chunk : ARENA_DEFAULT_CHUNK;
+    arena->allocated = 0;
+}
+
+static eb_arena_chunk_t* new_chunk(eb_arena_t* arena, size_t min_size) {
+    size_t size = arena->next_size;
+    while (size < min_size)
+        size *= 2;
+
+    void* mem = NULL;
+    if (posix_memalign(&mem, ARENA_CHUNK_ALIGN, ARENA_HEADER_SIZE + size) != 0)
+        return NULL;
+    eb_arena_chunk_t* chunk = mem;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    if (arena->next_size < EB_ARENA_MAX_CHUNK)
+        arena->next_size *= 2;
+    return chunk;
+}
+
+void* eb_arena_alloc(eb_arena_t* arena, size_t size, size_t align) {
+    if (!arena || align == 0 || align > ARENA_CHUNK_ALIGN || (align & (align - 1)))
+        return NULL;
+
+    eb_arena_chunk_t* chunk = arena->chunks;
+    size_t offset = 0;
+    if (chunk) {
+        offset = (chunk->used + align - 1) & ~(align - 1);
+        if (offset > chunk->size || chunk->size - offset < size)
+            chunk = NULL;
+    }
+    if (!chunk) {
+        chunk = new_chunk(arena, size);
+        if (!chunk)
+            return NULL;
+        offset = 0;
+    }
+    chunk->used = offset + size;
+    arena->allocated += size;
+    return chunk_data(chunk) + offset;
+}
+
+void* eb_arena_calloc(eb_arena_t* arena, size_t size, size_t align) {
+    void* p = eb_arena_alloc(arena, size, align);
+    if (p)
+        memset(p, 0, size);
+    return p;
+}
+
+char* eb_arena_strdup(eb_arena_t* arena, const char* s) {
+    if (!s)
+        return NULL;
+    size_t len = strlen(s) + 1;
+    char* copy = eb_arena_alloc(arena, len, 1);
+    if (copy)
+        memcpy(copy, s, len);
+    return copy;
+}
+
+void eb_arena_reset(eb_arena_t* arena) {
+    if (!arena || !arena->chunks)
+        return;
+    eb_arena_chunk_t* keep = arena->chunks;
+    eb_arena_chunk_t* chunk = keep->next;
+    while (chunk) {
+        eb_arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    keep->next = NULL;
+    keep->used = 0;
+    arena->allocated = 0;
+}
+
+void eb_arena_destroy(eb_arena_t* arena) {
+    if (!arena)
+        return;
+    eb_arena_chunk_t* chunk = arena->chunks;
+    while (chunk) {
+        eb_arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->allocated = 0;
+}
+
+eb_arena_t* eb_arena_create(size_t first_chunk) {
+    eb_arena_t* arena = malloc(sizeof(*arena));
+    if (arena)
+        eb_arena_init(arena, first_chunk);
+    return arena;
+}
+
+void eb_arena_free(eb_arena_t* arena) {
+    eb_arena_destroy(arena);
+    free(arena);
+}
@@ -0,0 +1,76 @@
+/*
+ * EmbeddingBridge - Arena Allocator
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_ARENA_H
+#define EB_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for data that is freed all at once: the rows of an
+ * in-memory store, the strings of a query result. Memory comes in chunks
+ * that double in size up to EB_ARENA_MAX_CHUNK, so a growing arena takes
+ * a logarithmic number of mallocs, never moves what it handed out and is
+ * freed in one pass over its chunks.
+ *
+ * An arena is not locked.
+ */
+
+#define EB_ARENA_MAX_CHUNK (64u << 20)
+
+typedef struct eb_arena_chunk eb_arena_chunk_t;
+
+typedef struct eb_arena {
+    eb_arena_chunk_t* chunks;   /* Newest first */
+    size_t next_size;           /* Size of the next chunk */
+    size_t allocated;           /* Bytes handed out */
+} eb_arena_t;
+
+/**
+ * Prepare an empty arena; no memory is taken until the first allocation
+ *
+ * @param arena Arena to set up
+ * @param first_chunk Size of the first chunk, 0 for a default
+ */
+void eb_arena_init(eb_arena_t* arena, size_t first_chunk);
+
+/**
+ * Allocate uninitialized memory
+ *
+ * @param arena Arena to allocate from
+ * @param size Bytes
+ * @param align Alignment, a power of two up to 64
+ * @return Memory, NULL if it cannot be allocated
+ */
+void* eb_arena_alloc(eb_arena_t* arena, size_t size, size_t align);
+
+/* Allocate zeroed memory */
+void* eb_arena_calloc(eb_arena_t* arena, size_t size, size_t align);
+
+/* Copy a string into the arena */
+char* eb_arena_strdup(eb_arena_t* arena, const char* s);
+
+/**
+ * Free everything allocated, keeping the newest chunk for reuse
+ */
+void eb_arena_reset(eb_arena_t* arena);
+
+/**
+ * Free an arena's memory; it can be used again after eb_arena_init()
+ */
+void eb_arena_destroy(eb_arena_t* arena);
+
+/* Allocate and initialize an arena on the heap, NULL if out of memory */
+eb_arena_t* eb_arena_create(size_t first_chunk);
+
+/* Destroy and free an arena from eb_arena_create() */
+void eb_arena_free(eb_arena_t* arena);
+
+#endif /* EB_ARENA_H */
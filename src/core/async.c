@@ -0,0 +1,382 @@
+/*
+ * EmbeddingBridge - Asynchronous Store and Remote Operations
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "async.h"
+#include "remote.h"
+#include "debug.h"
+
+typedef enum {
+    OP_STORE_VECTOR,
+    OP_PUSH,
+    OP_PULL
+} async_op_t;
+
+typedef enum {
+    FUTURE_QUEUED,
+    FUTURE_RUNNING,
+    FUTURE_FINISHED
+} future_state_t;
+
+struct eb_future {
+    eb_async_t *async;
+    async_op_t op;
+    eb_async_callback_fn callback;
+    void *ctx;
+
+    /* Arguments */
+    eb_store_t *store;
+    const eb_embedding_t *embedding;
+    const eb_metadata_t *metadata;
+    const char *model_version;
+    char *remote_name;
+    char *path;
+    char *hash;
+    const void *data;
+    size_t size;
+
+    /* Results */
+    eb_status_t status;
+    uint64_t vector_id;
+    void *pulled;
+    size_t pulled_size;
+
+    future_state_t state;           /* Guarded by async->lock */
+    eb_future_t *prev, *next;       /* Queue links, guarded by async->lock */
+
+    pthread_mutex_t lock;           /* Guards done */
+    pthread_cond_t done_cond;
+    bool done;
+};
+
+struct eb_async {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    eb_future_t *head, *tail;       /* Operations waiting to start */
+    size_t pending;
+    size_t max_pending;
+    bool stopping;
+
+    pthread_mutex_t store_lock;     /* Held while a store operation runs */
+    pthread_t *threads;
+    size_t thread_count;
+};
+
+/* Unlink a queued future, with async->lock held */
+static void queue_remove(eb_async_t *async, eb_future_t *future) {
+    if (future->prev)
+        future->prev->next = future->next;
+    else
+        async->head = future->next;
+    if (future->next)
+        future->next->prev = future->prev;
+    else
+        async->tail = future->prev;
+    future->prev = future->next = NULL;
+    async->pending--;
+    pthread_cond_signal(&async->not_full);
+}
+
+/* Run the callback and wake the waiters; the future is not touched afterwards */
+static void complete(eb_future_t *future, eb_status_t status) {
+    future->status = status;
+    if (future->callback)
+        future->callback(future, status, future->ctx);
+
+    pthread_mutex_lock(&future->lock);
+    future->done = true;
+    pthread_cond_broadcast(&future->done_cond);
+    pthread_mutex_unlock(&future->lock);
+}
+
+static eb_status_t run(eb_future_t *future) {
+    eb_async_t *async = future->async;
+    eb_status_t status;
+
+    switch (future->op) {
+    case OP_STORE_VECTOR:
+        pthread_mutex_lock(&async->store_lock);
+        status = eb_store_vector(future->store, future->embedding, future->metadata,
+                                 future->model_version, &future->vector_id);
+        pthread_mutex_unlock(&async->store_lock);
+        return status;
+    case OP_PUSH:
+        return eb_remote_push(future->remote_name, future->data, future->size,
+                              future->path, future->hash);
+    case OP_PULL:
+        return eb_remote_pull(future->remote_name, future->path,
+                              &future->pulled, &future->pulled_size);
+    }
+    return EB_ERROR_INVALID_INPUT;
+}
+
+static void *worker_main(void *arg) {
+    eb_async_t *async = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&async->lock);
+        while (!async->head && !async->stopping)
+            pthread_cond_wait(&async->not_empty, &async->lock);
+        eb_future_t *future = async->head;
+        if (!future) {
+            pthread_mutex_unlock(&async->lock);
+            return NULL;
+        }
+        queue_remove(async, future);
+        future->state = FUTURE_RUNNING;
+        pthread_mutex_unlock(&async->lock);
+
+        eb_status_t status = run(future);
+        pthread_mutex_lock(&async->lock);
+        future->state = FUTURE_FINISHED;
+        pthread_mutex_unlock(&async->lock);
+        complete(future, status);
+    }
+}
+
+eb_status_t eb_async_create(size_t workers, size_t max_pending, eb_async_t **out) {
+    if (!out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_async_t *async = calloc(1, sizeof(*async));
+    if (!async)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    if (workers == 0)
+        workers = 1;
+    async->threads = calloc(workers, sizeof(*async->threads));
+    if (!async->threads) {
+        free(async);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    async->max_pending = max_pending;
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->not_empty, NULL);
+    pthread_cond_init(&async->not_full, NULL);
+    pthread_mutex_init(&async->store_lock, NULL);
+
+    for (; async->thread_count < workers; async->thread_count++) {
+        if (pthread_create(&async->threads[async->thread_count], NULL, worker_main, async) != 0) {
+            DEBUG_PRINT("eb_async_create: Failed to start worker %zu\n", async->thread_count);
+            eb_async_destroy(async);
+            return EB_ERROR_RESOURCE_EXHAUSTED;
+        }
+    }
+
+    *out = async;
+    return EB_SUCCESS;
+}
+
+void eb_async_destroy(eb_async_t *async) {
+    if (!async)
+        return;
+
+    pthread_mutex_lock(&async->lock);
+    async->stopping = true;
+    pthread_cond_broadcast(&async->not_empty);
+    pthread_mutex_unlock(&async->lock);
+    for (size_t i = 0; i < async->thread_count; i++)
+        pthread_join(async->threads[i], NULL);
+
+    pthread_mutex_destroy(&async->store_lock);
+    pthread_cond_destroy(&async->not_full);
+    pthread_cond_destroy(&async->not_empty);
+    pthread_mutex_destroy(&async->lock);
+    free(async->threads);
+    free(async);
+}
+
+static eb_future_t *future_new(eb_async_t *async, async_op_t op,
+                               eb_async_callback_fn callback, void *ctx) {
+    eb_future_t *future = calloc(1, sizeof(*future));
+    if (!future)
+        return NULL;
+    future->async = async;
+    future->op = op;
+    future->callback = callback;
+    future->ctx = ctx;
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->done_cond, NULL);
+    return future;
+}
+
+static void future_destroy(eb_future_t *future) {
+    pthread_cond_destroy(&future->done_cond);
+    pthread_mutex_destroy(&future->lock);
+    free(future->remote_name);
+    free(future->path);
+    free(future->hash);
+    free(future->pulled);
+    free(future);
+}
+
+/* Queue a future, blocking while max_pending operations wait */
+static eb_status_t submit(eb_async_t *async, eb_future_t *future, eb_future_t **out) {
+    pthread_mutex_lock(&async->lock);
+    while (async->max_pending && async->pending >= async->max_pending && !async->stopping)
+        pthread_cond_wait(&async->not_full, &async->lock);
+    if (async->stopping) {
+        pthread_mutex_unlock(&async->lock);
+        future_destroy(future);
+        return EB_ERROR_INVALID_STATE;
+    }
+
+    future->state = FUTURE_QUEUED;
+    future->prev = async->tail;
+    if (async->tail)
+        async->tail->next = future;
+    else
+        async->head = future;
+    async->tail = future;
+    async->pending++;
+    pthread_cond_signal(&async->not_empty);
+    pthread_mutex_unlock(&async->lock);
+
+    *out = future;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_store_vector_async(eb_async_t *async,
+                                  eb_store_t *store,
+                                  const eb_embedding_t *embedding,
+                                  const eb_metadata_t *metadata,
+                                  const char *model_version,
+                                  eb_async_callback_fn callback,
+                                  void *ctx,
+                                  eb_future_t **out) {
+    if (!async || !store || !embedding || !model_version || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_future_t *future = future_new(async, OP_STORE_VECTOR, callback, ctx);
+    if (!future)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    future->store = store;
+    future->embedding = embedding;
+    future->metadata = metadata;
+    future->model_version = model_version;
+    return submit(async, future, out);
+}
+
+eb_status_t eb_remote_push_async(eb_async_t *async,
+                                 const char *remote_name,
+                                 const void *data,
+                                 size_t size,
+                                 const char *path,
+                                 const char *hash,
+                                 eb_async_callback_fn callback,
+                                 void *ctx,
+                                 eb_future_t **out) {
+    if (!async || !remote_name || !data || !path || !hash || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_future_t *future = future_new(async, OP_PUSH, callback, ctx);
+    if (!future)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    future->remote_name = strdup(remote_name);
+    future->path = strdup(path);
+    future->hash = strdup(hash);
+    if (!future->remote_name || !future->path || !future->hash) {
+        future_destroy(future);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    future->data = data;
+    future->size = size;
+    return submit(async, future, out);
+}
+
+eb_status_t eb_remote_pull_async(eb_async_t *async,
+                                 const char *remote_name,
+                                 const char *path,
+                                 eb_async_callback_fn callback,
+                                 void *ctx,
+                                 eb_future_t **out) {
+    if (!async || !remote_name || !path || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_future_t *future = future_new(async, OP_PULL, callback, ctx);
+    if (!future)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    future->remote_name = strdup(remote_name);
+    future->path = strdup(path);
+    if (!future->remote_name || !future->path) {
+        future_destroy(future);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    return submit(async, future, out);
+}
+
+bool eb_future_done(eb_future_t *future) {
+    if (!future)
+        return false;
+    pthread_mutex_lock(&future->lock);
+    bool done = future->done;
+    pthread_mutex_unlock(&future->lock);
+    return done;
+}
+
+eb_status_t eb_future_wait(eb_future_t *future) {
+    if (!future)
+        return EB_ERROR_INVALID_INPUT;
+    pthread_mutex_lock(&future->lock);
+    while (!future->done)
+        pthread_cond_wait(&future->done_cond, &future->lock);
+    pthread_mutex_unlock(&future->lock);
+    return future->status;
+}
+
+eb_status_t eb_future_cancel(eb_future_t *future) {
+    if (!future)
+        return EB_ERROR_INVALID_INPUT;
+
+    /* A future that is not done keeps its executor alive */
+    if (eb_future_done(future))
+        return EB_ERROR_INVALID_STATE;
+
+    eb_async_t *async = future->async;
+    pthread_mutex_lock(&async->lock);
+    bool queued = future->state == FUTURE_QUEUED;
+    if (queued) {
+        queue_remove(async, future);
+        future->state = FUTURE_FINISHED;
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    if (!queued)
+        return EB_ERROR_INVALID_STATE;
+    complete(future, EB_ERROR_INTERRUPTED);
+    return EB_SUCCESS;
+}
+
+uint64_t eb_future_vector_id(eb_future_t *future) {
+    if (!eb_future_done(future) || future->status != EB_SUCCESS)
+        return 0;
+    return future->vector_id;
+}
+
+eb_status_t eb_future_take_data(eb_future_t *future, void **data_out, size_t *size_out) {
+    if (!future || !data_out || !size_out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_status_t status = eb_future_wait(future);
+    *data_out = future->pulled;
+    *size_out = future->pulled_size;
+    future->pulled = NULL;
+    future->pulled_size = 0;
+    return status;
+}
+
+void eb_future_free(eb_future_t *future) {
+    if (!future)
+        return;
+    eb_future_wait(future);
+    future_destroy(future);
+}
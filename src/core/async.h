@@ -0,0 +1,156 @@
+/*
+ * EmbeddingBridge - Asynchronous Store and Remote Operations
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_ASYNC_H
+#define EB_ASYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "status.h"
+#include "types.h"
+#include "store.h"
+
+/*
+ * An executor runs store, push and pull calls on its own worker threads
+ * and hands back a future for each, so that disk, compression and
+ * network work queued from one thread overlap. At most max_pending
+ * operations wait to start; submitting another blocks until one does,
+ * which bounds the memory a fast producer can pin.
+ *
+ * Store operations on one executor run one at a time, because each
+ * rewrites the set index; push and pull operations run alongside them
+ * and each other.
+ */
+
+typedef struct eb_async eb_async_t;
+typedef struct eb_future eb_future_t;
+
+/**
+ * Called when an operation completes, on the worker that ran it, or on
+ * the thread that cancelled it
+ *
+ * It runs before eb_future_wait() returns, so it must not wait for or
+ * free the future it is given.
+ */
+typedef void (*eb_async_callback_fn)(eb_future_t *future, eb_status_t status, void *ctx);
+
+/**
+ * Create an executor
+ *
+ * @param workers Number of worker threads, 0 for one
+ * @param max_pending Operations that may wait to start, 0 for no limit
+ * @param out Receives the executor
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_async_create(size_t workers, size_t max_pending, eb_async_t **out);
+
+/*
+ * Run every submitted operation, then stop the workers and free the
+ * executor. Futures stay valid; none may be cancelled meanwhile.
+ */
+void eb_async_destroy(eb_async_t *async);
+
+/**
+ * Store a vector, see eb_store_vector()
+ *
+ * embedding, metadata and model_version must stay valid until the
+ * future completes.
+ *
+ * @param async Executor
+ * @param store Store to write to
+ * @param embedding Embedding to store
+ * @param metadata Metadata, may be NULL
+ * @param model_version Model of the embedding
+ * @param callback Optional completion callback
+ * @param ctx Context passed to callback
+ * @param out Receives the future; read the id with eb_future_vector_id()
+ * @return Status code of the submission
+ */
+eb_status_t eb_store_vector_async(eb_async_t *async,
+                                  eb_store_t *store,
+                                  const eb_embedding_t *embedding,
+                                  const eb_metadata_t *metadata,
+                                  const char *model_version,
+                                  eb_async_callback_fn callback,
+                                  void *ctx,
+                                  eb_future_t **out);
+
+/**
+ * Push data to a remote, see eb_remote_push()
+ *
+ * data must stay valid until the future completes; the names are copied.
+ *
+ * @return Status code of the submission
+ */
+eb_status_t eb_remote_push_async(eb_async_t *async,
+                                 const char *remote_name,
+                                 const void *data,
+                                 size_t size,
+                                 const char *path,
+                                 const char *hash,
+                                 eb_async_callback_fn callback,
+                                 void *ctx,
+                                 eb_future_t **out);
+
+/**
+ * Pull data from a remote, see eb_remote_pull()
+ *
+ * The names are copied. Take the data with eb_future_take_data().
+ *
+ * @return Status code of the submission
+ */
+eb_status_t eb_remote_pull_async(eb_async_t *async,
+                                 const char *remote_name,
+                                 const char *path,
+                                 eb_async_callback_fn callback,
+                                 void *ctx,
+                                 eb_future_t **out);
+
+/* Whether an operation has completed or been cancelled */
+bool eb_future_done(eb_future_t *future);
+
+/**
+ * Wait for an operation
+ *
+ * @param future Future of the operation
+ * @return Status of the operation (EB_ERROR_INTERRUPTED if it was cancelled)
+ */
+eb_status_t eb_future_wait(eb_future_t *future);
+
+/**
+ * Cancel an operation that has not started
+ *
+ * A cancelled operation completes with EB_ERROR_INTERRUPTED and its
+ * callback runs before this returns. A running operation is not
+ * interrupted.
+ *
+ * @param future Future of the operation
+ * @return Status code (EB_ERROR_INVALID_STATE if it already started)
+ */
+eb_status_t eb_future_cancel(eb_future_t *future);
+
+/* Vector id of a completed eb_store_vector_async(), 0 otherwise */
+uint64_t eb_future_vector_id(eb_future_t *future);
+
+/**
+ * Take the data of a completed eb_remote_pull_async()
+ *
+ * @param future Future of the pull
+ * @param data_out Receives the data (caller must free), NULL once taken
+ * @param size_out Receives the size of the data
+ * @return Status of the pull
+ */
+eb_status_t eb_future_take_data(eb_future_t *future, void **data_out, size_t *size_out);
+
+/* Wait for an operation if needed and free its future and any untaken data */
+void eb_future_free(eb_future_t *future);
+
+#endif /* EB_ASYNC_H */
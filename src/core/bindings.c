@@ -0,0 +1,116 @@
+/*
+ * EmbeddingBridge - Language Binding Entry Points
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <string.h>
+#include "bindings.h"
+#include "quantize.h"
+#include "debug.h"
+
+int embr_store_init(const char* root, eb_store_t** out) {
+    if (!root || !out)
+        return EB_ERROR_INVALID_INPUT;
+    eb_store_config_t config = {0};
+    config.root_path = (char*)root;
+    return eb_store_init(&config, out);
+}
+
+int embr_store_destroy(eb_store_t* store) {
+    return eb_store_destroy(store);
+}
+
+int embr_store_matrix(eb_store_t* store, const float* values, size_t rows, size_t dims,
+                      const char* const* sources, const char* model, char* hashes_out) {
+    if (!store)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_store_batch_t* batch;
+    eb_status_t status = eb_store_batch_begin(store->storage_path, &batch);
+    if (status != EB_SUCCESS)
+        return status;
+    status = eb_store_batch_add_matrix(batch, values, rows, dims, sources, model,
+                                       (char (*)[EMBR_HASH_SLOT])hashes_out);
+    if (status != EB_SUCCESS) {
+        eb_store_batch_abort(batch);
+        return status;
+    }
+    return eb_store_batch_commit(batch);
+}
+
+int embr_store_file(eb_store_t* store, const char* path, const char* source,
+                    const char* model, char* hash_out) {
+    if (!store)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_store_batch_t* batch;
+    eb_status_t status = eb_store_batch_begin(store->storage_path, &batch);
+    if (status != EB_SUCCESS)
+        return status;
+    status = eb_store_batch_add(batch, path, source, model, hash_out);
+    if (status != EB_SUCCESS) {
+        eb_store_batch_abort(batch);
+        return status;
+    }
+    return eb_store_batch_commit(batch);
+}
+
+/* Map the vector object a hash or prefix names */
+static eb_status_t map_vector(eb_store_t* store, const char* hash,
+                              eb_object_view_t* view, eb_vector_ref_t* ref) {
+    char full[EMBR_HASH_SLOT];
+    eb_status_t status = eb_store_resolve_hash(store, hash, full, sizeof(full));
+    if (status != EB_SUCCESS)
+        return status;
+    status = eb_object_map(store, full, 0, view);
+    if (status != EB_SUCCESS)
+        return status;
+    if (view->header.obj_type != EB_OBJ_VECTOR)
+        status = EB_ERROR_TYPE_MISMATCH;
+    else
+        status = eb_object_vector_ref(view, ref);
+    if (status != EB_SUCCESS)
+        eb_object_unmap(view);
+    return status;
+}
+
+int embr_vector_dims(eb_store_t* store, const char* hash, size_t* dims_out) {
+    if (!store || !hash || !dims_out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_object_view_t view;
+    eb_vector_ref_t ref;
+    eb_status_t status = map_vector(store, hash, &view, &ref);
+    if (status != EB_SUCCESS)
+        return status;
+    *dims_out = ref.dims;
+    eb_object_unmap(&view);
+    return EB_SUCCESS;
+}
+
+int embr_get_many(eb_store_t* store, const char* const* hashes, size_t count, size_t dims,
+                  float* out) {
+    if (!store || (count && (!hashes || !out)))
+        return EB_ERROR_INVALID_INPUT;
+
+    for (size_t i = 0; i < count; i++) {
+        eb_object_view_t view;
+        eb_vector_ref_t ref;
+        eb_status_t status = map_vector(store, hashes[i], &view, &ref);
+        if (status != EB_SUCCESS)
+            return status;
+        if (ref.dims != dims) {
+            DEBUG_WARN("%s has %zu dimensions, expected %zu", hashes[i], ref.dims, dims);
+            eb_object_unmap(&view);
+            return EB_ERROR_DIMENSION_MISMATCH;
+        }
+        eb_vector_ref_get(&ref, 0, dims, out + i * dims);
+        eb_object_unmap(&view);
+    }
+    return EB_SUCCESS;
+}
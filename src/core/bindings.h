@@ -0,0 +1,93 @@
+/*
+ * EmbeddingBridge - Language Binding Entry Points
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_BINDINGS_H
+#define EB_BINDINGS_H
+
+#include <stddef.h>
+#include "status.h"
+#include "store.h"
+
+/*
+ * Flat entry points of libembedding_bridge for ctypes and similar FFIs:
+ * plain pointers, sizes and NUL-terminated strings only. Matrices are
+ * row-major float32 buffers owned by the caller and used in place, so a
+ * contiguous NumPy array crosses without a copy. Hashes are passed as
+ * 65-byte slots, 64 hex characters and a NUL.
+ */
+
+#define EMBR_HASH_SLOT 65
+
+/**
+ * Open the store of a repository
+ *
+ * @param root Repository root
+ * @param out Receives the store, free with embr_store_destroy()
+ * @return Status code (0 = success)
+ */
+int embr_store_init(const char* root, eb_store_t** out);
+
+int embr_store_destroy(eb_store_t* store);
+
+/**
+ * Store the rows of an N x D matrix in one batch
+ *
+ * @param store Store from embr_store_init()
+ * @param values rows * dims float32 values, row-major
+ * @param rows Number of rows
+ * @param dims Values per row
+ * @param sources One source file per row
+ * @param model Model name, may be NULL
+ * @param hashes_out rows * EMBR_HASH_SLOT bytes for the object hashes, may be NULL
+ * @return Status code (0 = success)
+ */
+int embr_store_matrix(eb_store_t* store, const float* values, size_t rows, size_t dims,
+                      const char* const* sources, const char* model, char* hashes_out);
+
+/**
+ * Store an embedding file (.npy, .npz or .bin)
+ *
+ * @param store Store from embr_store_init()
+ * @param path Embedding file
+ * @param source Source file it belongs to
+ * @param model Model name, may be NULL
+ * @param hash_out EMBR_HASH_SLOT bytes for the object hash, may be NULL
+ * @return Status code (0 = success)
+ */
+int embr_store_file(eb_store_t* store, const char* path, const char* source,
+                    const char* model, char* hash_out);
+
+/**
+ * Number of values of a stored vector
+ *
+ * @param store Store from embr_store_init()
+ * @param hash Object hash or unique prefix
+ * @param dims_out Receives the dimensions
+ * @return Status code (EB_ERROR_NOT_FOUND for an unknown hash)
+ */
+int embr_vector_dims(eb_store_t* store, const char* hash, size_t* dims_out);
+
+/**
+ * Read stored vectors into the rows of an N x D float32 matrix
+ *
+ * Vectors of any stored dtype are converted to float32.
+ *
+ * @param store Store from embr_store_init()
+ * @param hashes count object hashes or unique prefixes
+ * @param count Number of hashes, rows of out
+ * @param dims Values per row of out
+ * @param out count * dims floats, row-major
+ * @return Status code (EB_ERROR_DIMENSION_MISMATCH if a vector has
+ *         other dimensions; rows before it are filled)
+ */
+int embr_get_many(eb_store_t* store, const char* const* hashes, size_t count, size_t dims,
+                  float* out);
+
+#endif /* EB_BINDINGS_H */
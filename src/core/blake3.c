@@ -0,0 +1,363 @@
+/*
+ * EmbeddingBridge - BLAKE3
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include "blake3.h"
+#include "thread_pool.h"
+
+#define CHUNK_START 1
+#define CHUNK_END   2
+#define PARENT      4
+#define ROOT        8
+
+static const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+/* Message word order of each round, the permutation applied round after round */
+static const uint8_t SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+/* Works on uint32_t and on vectors of them alike */
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define G(v, a, b, c, d, x, y) do {                      \
+        v[a] = v[a] + v[b] + (x); v[d] = ROTR(v[d] ^ v[a], 16); \
+        v[c] = v[c] + v[d];       v[b] = ROTR(v[b] ^ v[c], 12); \
+        v[a] = v[a] + v[b] + (y); v[d] = ROTR(v[d] ^ v[a], 8);  \
+        v[c] = v[c] + v[d];       v[b] = ROTR(v[b] ^ v[c], 7);  \
+    } while (0)
+
+#define ROUND(v, m, s) do {                                  \
+        G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);                 \
+        G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);                 \
+        G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);                \
+        G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);                \
+        G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);                \
+        G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);              \
+        G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);               \
+        G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);               \
+    } while (0)
+
+static uint32_t load_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void store_le32(uint8_t* p, uint32_t w) {
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+static void load_block(const uint8_t* block, uint32_t m[16]) {
+    for (int i = 0; i < 16; i++)
+        m[i] = load_le32(block + i * 4);
+}
+
+/* The compression function; out[0..7] is the next chaining value */
+static void compress(const uint32_t cv[8], const uint32_t m[16], uint32_t block_len,
+                     uint64_t counter, uint32_t flags, uint32_t out[16]) {
+    uint32_t v[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        IV[0], IV[1], IV[2], IV[3],
+        (uint32_t)counter, (uint32_t)(counter >> 32), block_len, flags
+    };
+    for (int r = 0; r < 7; r++)
+        ROUND(v, m, SCHEDULE[r]);
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+        out[i + 8] = v[i + 8] ^ cv[i];
+    }
+}
+
+/* The last compression of a node, kept back until it is known whether it is the root */
+typedef struct {
+    uint32_t cv[8];
+    uint32_t m[16];
+    uint32_t block_len;
+    uint64_t counter;
+    uint32_t flags;
+} output_t;
+
+static void output_cv(const output_t* o, uint32_t cv[8]) {
+    uint32_t state[16];
+    compress(o->cv, o->m, o->block_len, o->counter, o->flags, state);
+    memcpy(cv, state, 8 * sizeof(uint32_t));
+}
+
+static void output_root(const output_t* o, uint8_t out[EB_BLAKE3_OUT_LEN]) {
+    uint32_t state[16];
+    compress(o->cv, o->m, o->block_len, 0, o->flags | ROOT, state);
+    for (int i = 0; i < 8; i++)
+        store_le32(out + i * 4, state[i]);
+}
+
+static void parent_output(const uint32_t left[8], const uint32_t right[8], output_t* o) {
+    memcpy(o->cv, IV, sizeof(IV));
+    memcpy(o->m, left, 8 * sizeof(uint32_t));
+    memcpy(o->m + 8, right, 8 * sizeof(uint32_t));
+    o->block_len = EB_BLAKE3_BLOCK_LEN;
+    o->counter = 0;
+    o->flags = PARENT;
+}
+
+/* left and right may alias out */
+static void parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t out[8]) {
+    output_t o;
+    parent_output(left, right, &o);
+    output_cv(&o, out);
+}
+
+/* One chunk of at most EB_BLAKE3_CHUNK_LEN bytes, up to its last block */
+static void chunk_output(const uint8_t* in, size_t len, uint64_t counter, output_t* o) {
+    uint32_t cv[8];
+    memcpy(cv, IV, sizeof(IV));
+    uint32_t flags = CHUNK_START;
+    uint32_t m[16], state[16];
+    while (len > EB_BLAKE3_BLOCK_LEN) {
+        load_block(in, m);
+        compress(cv, m, EB_BLAKE3_BLOCK_LEN, counter, flags, state);
+        memcpy(cv, state, sizeof(cv));
+        flags = 0;
+        in += EB_BLAKE3_BLOCK_LEN;
+        len -= EB_BLAKE3_BLOCK_LEN;
+    }
+
+    uint8_t block[EB_BLAKE3_BLOCK_LEN] = {0};
+    if (len)
+        memcpy(block, in, len);
+    memcpy(o->cv, cv, sizeof(cv));
+    load_block(block, o->m);
+    o->block_len = (uint32_t)len;
+    o->counter = counter;
+    o->flags = flags | CHUNK_END;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LANES 8
+
+typedef uint32_t vec_t __attribute__((vector_size(LANES * sizeof(uint32_t))));
+
+#define splat(x) ((vec_t){ (x), (x), (x), (x), (x), (x), (x), (x) })
+
+/* Chaining values of LANES whole chunks in a row, one chunk per lane */
+static void hash_chunks(const uint8_t* in, uint64_t counter, uint32_t out[LANES][8]) {
+    vec_t h[8], counter_lo, counter_hi;
+    for (int i = 0; i < 8; i++)
+        h[i] = splat(IV[i]);
+    for (int lane = 0; lane < LANES; lane++) {
+        counter_lo[lane] = (uint32_t)(counter + (uint64_t)lane);
+        counter_hi[lane] = (uint32_t)((counter + (uint64_t)lane) >> 32);
+    }
+
+    for (int b = 0; b < EB_BLAKE3_CHUNK_LEN / EB_BLAKE3_BLOCK_LEN; b++) {
+        vec_t m[16];
+        for (int lane = 0; lane < LANES; lane++) {
+            const uint8_t* block = in + (size_t)lane * EB_BLAKE3_CHUNK_LEN + (size_t)b * EB_BLAKE3_BLOCK_LEN;
+            for (int w = 0; w < 16; w++)
+                m[w][lane] = load_le32(block + w * 4);
+        }
+        uint32_t flags = (b == 0 ? CHUNK_START : 0) |
+                         (b == EB_BLAKE3_CHUNK_LEN / EB_BLAKE3_BLOCK_LEN - 1 ? CHUNK_END : 0);
+        vec_t v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            splat(IV[0]), splat(IV[1]), splat(IV[2]), splat(IV[3]),
+            counter_lo, counter_hi, splat(EB_BLAKE3_BLOCK_LEN), splat(flags)
+        };
+        for (int r = 0; r < 7; r++)
+            ROUND(v, m, SCHEDULE[r]);
+        for (int i = 0; i < 8; i++)
+            h[i] = v[i] ^ v[i + 8];
+    }
+
+    for (int lane = 0; lane < LANES; lane++)
+        for (int i = 0; i < 8; i++)
+            out[lane][i] = h[i][lane];
+}
+#endif
+
+/* Bytes in the left subtree: the most whole chunks that are a power of two */
+static size_t left_len(size_t len) {
+    size_t chunks = (len - 1) / EB_BLAKE3_CHUNK_LEN;
+    size_t power = 1;
+    while (power * 2 <= chunks)
+        power *= 2;
+    return power * EB_BLAKE3_CHUNK_LEN;
+}
+
+typedef struct {
+    const uint8_t* in;
+    size_t len;
+    uint64_t counter;
+    uint32_t cv[8];
+} subtree_t;
+
+static void subtree_cv(const uint8_t* in, size_t len, uint64_t counter, uint32_t out[8]);
+
+static void subtree_task(void* arg) {
+    subtree_t* t = arg;
+    subtree_cv(t->in, t->len, t->counter, t->cv);
+}
+
+/* Chaining values of both halves of an input longer than a chunk */
+static void split(const uint8_t* in, size_t len, uint64_t counter,
+                  uint32_t left[8], uint32_t right[8]) {
+    size_t half = left_len(len);
+    uint64_t right_counter = counter + half / EB_BLAKE3_CHUNK_LEN;
+    if (len < EB_BLAKE3_PARALLEL_MIN) {
+        subtree_cv(in, half, counter, left);
+        subtree_cv(in + half, len - half, right_counter, right);
+        return;
+    }
+
+    subtree_t task = { in, half, counter, {0} };
+    eb_task_group_t group;
+    eb_task_group_init(&group, eb_pool_shared());
+    eb_task_group_spawn(&group, subtree_task, &task);
+    subtree_cv(in + half, len - half, right_counter, right);
+    eb_task_group_wait(&group);
+    memcpy(left, task.cv, sizeof(task.cv));
+}
+
+static void subtree_cv(const uint8_t* in, size_t len, uint64_t counter, uint32_t out[8]) {
+    if (len <= EB_BLAKE3_CHUNK_LEN) {
+        output_t o;
+        chunk_output(in, len, counter, &o);
+        output_cv(&o, out);
+        return;
+    }
+#ifdef LANES
+    if (len == LANES * EB_BLAKE3_CHUNK_LEN) {
+        // A full subtree: its pairs are merged level by level
+        uint32_t cvs[LANES][8];
+        hash_chunks(in, counter, cvs);
+        for (int n = LANES; n > 1; n /= 2)
+            for (int i = 0; i < n / 2; i++)
+                parent_cv(cvs[2 * i], cvs[2 * i + 1], cvs[i]);
+        memcpy(out, cvs[0], sizeof(cvs[0]));
+        return;
+    }
+#endif
+    uint32_t left[8], right[8];
+    split(in, len, counter, left, right);
+    parent_cv(left, right, out);
+}
+
+void eb_blake3(const void* data, size_t size, uint8_t out[EB_BLAKE3_OUT_LEN]) {
+    output_t o;
+    if (size <= EB_BLAKE3_CHUNK_LEN) {
+        chunk_output(data, size, 0, &o);
+    } else {
+        uint32_t left[8], right[8];
+        split(data, size, 0, left, right);
+        parent_output(left, right, &o);
+    }
+    output_root(&o, out);
+}
+
+void eb_blake3_init(eb_blake3_t* hasher) {
+    memset(hasher, 0, sizeof(*hasher));
+    memcpy(hasher->cv, IV, sizeof(IV));
+}
+
+static size_t chunk_len(const eb_blake3_t* hasher) {
+    return (size_t)hasher->blocks_compressed * EB_BLAKE3_BLOCK_LEN + hasher->block_len;
+}
+
+/* Add the chaining value of a finished chunk, merging every completed subtree */
+static void push_chunk(eb_blake3_t* hasher, uint32_t cv[8], uint64_t total_chunks) {
+    while ((total_chunks & 1) == 0) {
+        parent_cv(hasher->cv_stack[--hasher->cv_stack_len], cv, cv);
+        total_chunks >>= 1;
+    }
+    memcpy(hasher->cv_stack[hasher->cv_stack_len++], cv, 8 * sizeof(uint32_t));
+}
+
+static void chunk_reset(eb_blake3_t* hasher, uint64_t counter) {
+    memcpy(hasher->cv, IV, sizeof(IV));
+    hasher->chunk_counter = counter;
+    hasher->block_len = 0;
+    hasher->blocks_compressed = 0;
+}
+
+static output_t hasher_chunk_output(const eb_blake3_t* hasher) {
+    output_t o;
+    uint8_t block[EB_BLAKE3_BLOCK_LEN] = {0};
+    memcpy(block, hasher->block, hasher->block_len);
+    memcpy(o.cv, hasher->cv, sizeof(o.cv));
+    load_block(block, o.m);
+    o.block_len = hasher->block_len;
+    o.counter = hasher->chunk_counter;
+    o.flags = (hasher->blocks_compressed == 0 ? CHUNK_START : 0) | CHUNK_END;
+    return o;
+}
+
+void eb_blake3_update(eb_blake3_t* hasher, const void* data, size_t size) {
+    const uint8_t* in = data;
+    while (size > 0) {
+        // A full chunk is only finished once more input shows it is not the last
+        if (chunk_len(hasher) == EB_BLAKE3_CHUNK_LEN) {
+            output_t o = hasher_chunk_output(hasher);
+            uint32_t cv[8];
+            output_cv(&o, cv);
+            uint64_t total = hasher->chunk_counter + 1;
+            push_chunk(hasher, cv, total);
+            chunk_reset(hasher, total);
+        }
+#ifdef LANES
+        if (chunk_len(hasher) == 0 && size > LANES * EB_BLAKE3_CHUNK_LEN) {
+            uint32_t cvs[LANES][8];
+            hash_chunks(in, hasher->chunk_counter, cvs);
+            for (int lane = 0; lane < LANES; lane++)
+                push_chunk(hasher, cvs[lane], hasher->chunk_counter + (uint64_t)lane + 1);
+            chunk_reset(hasher, hasher->chunk_counter + LANES);
+            in += LANES * EB_BLAKE3_CHUNK_LEN;
+            size -= LANES * EB_BLAKE3_CHUNK_LEN;
+            continue;
+        }
+#endif
+        if (hasher->block_len == EB_BLAKE3_BLOCK_LEN) {
+            uint32_t m[16], state[16];
+            load_block(hasher->block, m);
+            compress(hasher->cv, m, EB_BLAKE3_BLOCK_LEN, hasher->chunk_counter,
+                     hasher->blocks_compressed == 0 ? CHUNK_START : 0, state);
+            memcpy(hasher->cv, state, sizeof(hasher->cv));
+            hasher->blocks_compressed++;
+            hasher->block_len = 0;
+        }
+        size_t take = EB_BLAKE3_BLOCK_LEN - hasher->block_len;
+        if (take > size)
+            take = size;
+        memcpy(hasher->block + hasher->block_len, in, take);
+        hasher->block_len += (uint8_t)take;
+        in += take;
+        size -= take;
+    }
+}
+
+void eb_blake3_final(const eb_blake3_t* hasher, uint8_t out[EB_BLAKE3_OUT_LEN]) {
+    output_t o = hasher_chunk_output(hasher);
+    for (size_t i = hasher->cv_stack_len; i > 0; i--) {
+        uint32_t cv[8];
+        output_cv(&o, cv);
+        parent_output(hasher->cv_stack[i - 1], cv, &o);
+    }
+    output_root(&o, out);
+}
@@ -0,0 +1,65 @@
+/*
+ * EmbeddingBridge - BLAKE3
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_BLAKE3_H
+#define EB_BLAKE3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * BLAKE3 hashing with a 32-byte output, the default hash mode only (no
+ * keyed hashing or key derivation).
+ *
+ * Input is split into 1 KiB chunks that are the leaves of a binary tree,
+ * so a long input can be hashed in any order. eb_blake3() hashes eight
+ * chunks at a time across SIMD lanes (compiler vector extensions, so SSE2,
+ * AVX2 or NEON as the target allows) and hashes the subtrees of inputs
+ * above EB_BLAKE3_PARALLEL_MIN on the shared thread pool. The incremental
+ * hasher gives the same hash one chunk at a time, for streamed input.
+ */
+
+#define EB_BLAKE3_OUT_LEN 32
+#define EB_BLAKE3_BLOCK_LEN 64
+#define EB_BLAKE3_CHUNK_LEN 1024
+
+/* Inputs at least this long are hashed on several threads */
+#define EB_BLAKE3_PARALLEL_MIN ((size_t)256 << 10)
+
+/* Room for the chaining values of a tree over 2^54 chunks */
+#define EB_BLAKE3_MAX_DEPTH 54
+
+typedef struct {
+    uint32_t cv[8];                 /* Chaining value of the current chunk */
+    uint64_t chunk_counter;
+    uint8_t block[EB_BLAKE3_BLOCK_LEN];
+    uint8_t block_len;
+    uint8_t blocks_compressed;
+    uint8_t cv_stack_len;
+    uint32_t cv_stack[EB_BLAKE3_MAX_DEPTH][8];  /* Subtrees still waiting for a sibling */
+} eb_blake3_t;
+
+void eb_blake3_init(eb_blake3_t* hasher);
+
+void eb_blake3_update(eb_blake3_t* hasher, const void* data, size_t size);
+
+/* Hash of everything added so far; the hasher can still be updated */
+void eb_blake3_final(const eb_blake3_t* hasher, uint8_t out[EB_BLAKE3_OUT_LEN]);
+
+/**
+ * Hash a buffer, across the shared thread pool if it is long
+ *
+ * @param data Input
+ * @param size Input size
+ * @param out Receives the hash
+ */
+void eb_blake3(const void* data, size_t size, uint8_t out[EB_BLAKE3_OUT_LEN]);
+
+#endif /* EB_BLAKE3_H */
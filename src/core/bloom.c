@@ -0,0 +1,289 @@
+/*
+ * EmbeddingBridge - Object Bloom Filter Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bloom.h"
+#include "hash_utils.h"
+#include "object_path.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+struct eb_bloom {
+    uint64_t* words;
+    uint64_t bits;          /* Power of two */
+    uint64_t capacity;
+    uint64_t count;         /* Updated atomically */
+    bool dirty;             /* Updated atomically */
+};
+
+static uint64_t load_u64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+eb_status_t eb_bloom_create(uint64_t capacity, eb_bloom_t** out) {
+    if (!out)
+        return EB_ERROR_INVALID_INPUT;
+    *out = NULL;
+    if (capacity < EB_BLOOM_MIN_CAPACITY)
+        capacity = EB_BLOOM_MIN_CAPACITY;
+    if (capacity > ((uint64_t)1 << 40))
+        return EB_ERROR_INVALID_INPUT;
+
+    uint64_t bits = 64;
+    while (bits < capacity * EB_BLOOM_BITS_PER_KEY)
+        bits <<= 1;
+
+    eb_bloom_t* bloom = calloc(1, sizeof(*bloom));
+    if (!bloom)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    bloom->words = calloc(bits / 64, sizeof(uint64_t));
+    if (!bloom->words) {
+        free(bloom);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    bloom->bits = bits;
+    bloom->capacity = capacity;
+    *out = bloom;
+    return EB_SUCCESS;
+}
+
+void eb_bloom_free(eb_bloom_t* bloom) {
+    if (!bloom)
+        return;
+    free(bloom->words);
+    free(bloom);
+}
+
+/* Double hashing over two words of the object hash; the step is odd so the probes differ */
+static void probes(const eb_bloom_t* bloom, const uint8_t hash[32], uint64_t bits[EB_BLOOM_PROBES]) {
+    uint64_t h1 = load_u64(hash);
+    uint64_t h2 = load_u64(hash + 8) | 1;
+    for (int i = 0; i < EB_BLOOM_PROBES; i++)
+        bits[i] = (h1 + (uint64_t)i * h2) & (bloom->bits - 1);
+}
+
+void eb_bloom_add(eb_bloom_t* bloom, const uint8_t hash[32]) {
+    if (!bloom || !hash)
+        return;
+    uint64_t bits[EB_BLOOM_PROBES];
+    probes(bloom, hash, bits);
+    bool added = false;
+    for (int i = 0; i < EB_BLOOM_PROBES; i++) {
+        uint64_t mask = (uint64_t)1 << (bits[i] & 63);
+        uint64_t* word = &bloom->words[bits[i] >> 6];
+        if (!(__atomic_load_n(word, __ATOMIC_RELAXED) & mask) &&
+            !(__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask))
+            added = true;
+    }
+    if (added) {
+        __atomic_fetch_add(&bloom->count, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&bloom->dirty, true, __ATOMIC_RELAXED);
+    }
+}
+
+bool eb_bloom_maybe(const eb_bloom_t* bloom, const uint8_t hash[32]) {
+    if (!bloom || !hash)
+        return true;
+    uint64_t bits[EB_BLOOM_PROBES];
+    probes(bloom, hash, bits);
+    for (int i = 0; i < EB_BLOOM_PROBES; i++) {
+        uint64_t word = __atomic_load_n(&bloom->words[bits[i] >> 6], __ATOMIC_RELAXED);
+        if (!(word & ((uint64_t)1 << (bits[i] & 63))))
+            return false;
+    }
+    return true;
+}
+
+uint64_t eb_bloom_count(const eb_bloom_t* bloom) {
+    return bloom ? __atomic_load_n(&bloom->count, __ATOMIC_RELAXED) : 0;
+}
+
+/* Read the header and bits of a saved filter into a new one */
+static eb_status_t read_filter(FILE* f, eb_bloom_t** out) {
+    eb_bloom_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != EB_BLOOM_MAGIC ||
+        header.version != EB_BLOOM_VERSION || header.probes != EB_BLOOM_PROBES ||
+        header.bits < 64 || (header.bits & (header.bits - 1)) != 0 ||
+        header.capacity < EB_BLOOM_MIN_CAPACITY || header.capacity > ((uint64_t)1 << 40))
+        return EB_ERROR_INVALID_FORMAT;
+
+    eb_bloom_t* bloom = NULL;
+    eb_status_t status = eb_bloom_create(header.capacity, &bloom);
+    if (status != EB_SUCCESS)
+        return status;
+    if (bloom->bits != header.bits ||
+        fread(bloom->words, sizeof(uint64_t), bloom->bits / 64, f) != bloom->bits / 64) {
+        eb_bloom_free(bloom);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    bloom->count = header.count;
+    *out = bloom;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_bloom_load(const char* path, eb_bloom_t** out) {
+    if (!path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    *out = NULL;
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+    eb_status_t status = read_filter(f, out);
+    fclose(f);
+    return status;
+}
+
+eb_status_t eb_bloom_save(eb_bloom_t* bloom, const char* path) {
+    if (!bloom || !path)
+        return EB_ERROR_INVALID_INPUT;
+
+    // Keep what a concurrent store saved since this filter was loaded
+    eb_bloom_t* saved = NULL;
+    if (eb_bloom_load(path, &saved) == EB_SUCCESS && saved->bits == bloom->bits) {
+        for (uint64_t i = 0; i < bloom->bits / 64; i++)
+            __atomic_fetch_or(&bloom->words[i], saved->words[i], __ATOMIC_RELAXED);
+        if (saved->count > eb_bloom_count(bloom))
+            __atomic_store_n(&bloom->count, saved->count, __ATOMIC_RELAXED);
+    }
+    eb_bloom_free(saved);
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+
+    eb_bloom_header_t header = {
+        .magic = EB_BLOOM_MAGIC,
+        .version = EB_BLOOM_VERSION,
+        .probes = EB_BLOOM_PROBES,
+        .bits = bloom->bits,
+        .capacity = bloom->capacity,
+        .count = eb_bloom_count(bloom)
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(bloom->words, sizeof(uint64_t), bloom->bits / 64, f) == bloom->bits / 64;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    __atomic_store_n(&bloom->dirty, false, __ATOMIC_RELAXED);
+    return EB_SUCCESS;
+}
+
+/* Hashes gathered for a rebuild, before the filter can be sized */
+typedef struct {
+    uint8_t (*hashes)[32];
+    size_t count;
+    size_t capacity;
+} hash_list_t;
+
+static int collect_hash(hash_list_t* list, const char* hex_hash) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 4096;
+        uint8_t (*grown)[32] = realloc(list->hashes, capacity * sizeof(*grown));
+        if (!grown)
+            return -1;
+        list->hashes = grown;
+        list->capacity = capacity;
+    }
+    if (eb_hex_to_hash(hex_hash, list->hashes[list->count]))
+        list->count++;
+    return 0;
+}
+
+static int collect_loose(const char* hex_hash, const char* ext, const char* path,
+                         const struct stat* st, void* ctx) {
+    (void)path;
+    (void)st;
+    return strcmp(ext, "raw") == 0 ? collect_hash(ctx, hex_hash) : 0;
+}
+
+static int collect_packed(const char* hex_hash, uint64_t length, time_t mtime, void* ctx) {
+    (void)length;
+    (void)mtime;
+    return collect_hash(ctx, hex_hash);
+}
+
+/* A filter of every loose and packed object, with room to double */
+static eb_status_t build_filter(const char* root, const eb_pack_set_t* packs, eb_bloom_t** out) {
+    hash_list_t list = {0};
+    eb_pack_set_t* opened = NULL;
+    if (!packs && eb_pack_open(root, &opened) == EB_SUCCESS)
+        packs = opened;
+
+    eb_status_t status = eb_object_foreach(root, collect_loose, &list);
+    if (status == EB_ERROR_NOT_FOUND)
+        status = EB_SUCCESS;
+    if (status == EB_SUCCESS && packs)
+        status = eb_pack_foreach(packs, collect_packed, &list);
+    eb_pack_close(opened);
+
+    if (status == EB_SUCCESS)
+        status = eb_bloom_create((uint64_t)list.count * 2, out);
+    if (status == EB_SUCCESS) {
+        for (size_t i = 0; i < list.count; i++)
+            eb_bloom_add(*out, list.hashes[i]);
+        (*out)->dirty = true;
+        DEBUG_PRINT("bloom: built the object filter from %zu objects", list.count);
+    }
+    free(list.hashes);
+    return status;
+}
+
+static void objects_filter_path(const char* root, char* path, size_t size) {
+    snprintf(path, size, "%s/.embr/%s", root, EB_BLOOM_FILE);
+}
+
+eb_status_t eb_bloom_open_objects(const char* root, const eb_pack_set_t* packs, eb_bloom_t** out) {
+    if (!root || !out)
+        return EB_ERROR_INVALID_INPUT;
+    *out = NULL;
+
+    char path[PATH_MAX];
+    objects_filter_path(root, path, sizeof(path));
+    eb_bloom_t* bloom = NULL;
+    if (eb_bloom_load(path, &bloom) == EB_SUCCESS) {
+        if (bloom->count <= bloom->capacity) {
+            *out = bloom;
+            return EB_SUCCESS;
+        }
+        // Past capacity the false hits climb; a filter of twice the size replaces it
+        eb_bloom_free(bloom);
+    }
+    return build_filter(root, packs, out);
+}
+
+eb_status_t eb_bloom_save_objects(const char* root, eb_bloom_t* bloom) {
+    if (!root || !bloom)
+        return EB_ERROR_INVALID_INPUT;
+    if (!__atomic_load_n(&bloom->dirty, __ATOMIC_RELAXED))
+        return EB_SUCCESS;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.embr/metadata", root);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+    objects_filter_path(root, path, sizeof(path));
+    return eb_bloom_save(bloom, path);
+}
@@ -0,0 +1,116 @@
+/*
+ * EmbeddingBridge - Object Bloom Filter
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_BLOOM_H
+#define EB_BLOOM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+#include "pack.h"
+
+/*
+ * A Bloom filter over binary object hashes. A miss means the object has
+ * certainly not been added; a hit only means it may have been, and needs
+ * the exact check. Object hashes are already uniform, so the probes are
+ * derived from the hash itself instead of rehashing it.
+ *
+ * .embr/metadata/objects.bloom holds the filter of a repository's loose
+ * and packed objects, next to the loose hash index (hash_index.h):
+ *
+ *   eb_bloom_header_t | bits
+ *
+ * Stores add every object they write and save the filter when they are
+ * closed, merging it with whatever another process saved meanwhile. The
+ * filter can fall behind, for objects that arrive some other way, so a
+ * writer that trusts a miss must still refuse to replace an existing file.
+ * Objects removed by gc stay in it as false hits until it fills up and is
+ * rebuilt from the objects directory and the pack indexes.
+ */
+
+#define EB_BLOOM_MAGIC   0x4542424C  /* "EBBL" */
+#define EB_BLOOM_VERSION 1
+#define EB_BLOOM_FILE    "metadata/objects.bloom"
+
+/* 10 bits and 7 probes per object: about 1% false hits at capacity */
+#define EB_BLOOM_BITS_PER_KEY 10
+#define EB_BLOOM_PROBES 7
+
+/* Smallest capacity a filter is created with (80 KiB of bits) */
+#define EB_BLOOM_MIN_CAPACITY 65536
+
+typedef struct {
+    uint32_t magic;         /* EB_BLOOM_MAGIC */
+    uint32_t version;       /* EB_BLOOM_VERSION */
+    uint32_t probes;
+    uint32_t reserved;
+    uint64_t bits;          /* Power of two */
+    uint64_t capacity;      /* Objects it was sized for */
+    uint64_t count;         /* Objects added, approximately */
+} eb_bloom_header_t;
+
+typedef struct eb_bloom eb_bloom_t;
+
+/**
+ * Create an empty filter
+ *
+ * @param capacity Objects it should hold at about 1% false hits
+ * @param out Receives the filter
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_bloom_create(uint64_t capacity, eb_bloom_t** out);
+
+/* Add an object; safe to call from several threads at once */
+void eb_bloom_add(eb_bloom_t* bloom, const uint8_t hash[32]);
+
+/* Whether the object may have been added */
+bool eb_bloom_maybe(const eb_bloom_t* bloom, const uint8_t hash[32]);
+
+/* Objects added, approximately */
+uint64_t eb_bloom_count(const eb_bloom_t* bloom);
+
+/**
+ * Read a saved filter
+ *
+ * @return Status code (EB_ERROR_NOT_FOUND if there is none,
+ *         EB_ERROR_INVALID_FORMAT if it is damaged)
+ */
+eb_status_t eb_bloom_load(const char* path, eb_bloom_t** out);
+
+/**
+ * Save a filter through a temporary file and rename
+ *
+ * A filter of the same size already saved at path is merged in first,
+ * so objects another process added are kept.
+ */
+eb_status_t eb_bloom_save(eb_bloom_t* bloom, const char* path);
+
+void eb_bloom_free(eb_bloom_t* bloom);
+
+/**
+ * Filter of a repository's objects
+ *
+ * Loads .embr/metadata/objects.bloom, or builds a filter from the loose
+ * objects and the packs if there is none or it is past its capacity.
+ *
+ * @param root Repository root
+ * @param packs Open pack set, or NULL to open one if a build needs it
+ * @param out Receives the filter
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_bloom_open_objects(const char* root, const eb_pack_set_t* packs, eb_bloom_t** out);
+
+/**
+ * Save a repository's object filter
+ */
+eb_status_t eb_bloom_save_objects(const char* root, eb_bloom_t* bloom);
+
+#endif /* EB_BLOOM_H */
@@ -0,0 +1,212 @@
+/*
+ * EmbeddingBridge - Content-Defined Chunking Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+
+#include "chunk.h"
+#include "hash_utils.h"
+
+/*
+ * Normalized chunking (FastCDC level 2): before the average size a cut needs
+ * two more zero bits than after it, which keeps most chunks close to the
+ * average. The gear hash shifts left, so its top bits cover the last bytes
+ * read and the masks test those.
+ */
+#define CHUNK_AVG_BITS 20
+#define CHUNK_MASK(bits) (~(uint64_t)0 << (64 - (bits)))
+#define CHUNK_MASK_SMALL CHUNK_MASK(CHUNK_AVG_BITS + 2)
+#define CHUNK_MASK_LARGE CHUNK_MASK(CHUNK_AVG_BITS - 2)
+
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+/* Fixed pseudo-random gear table (splitmix64), the same on every host */
+static void gear_init(void) {
+    uint64_t state = 0x454d4252434443ULL; /* "EMBRCDC" */
+    for (size_t i = 0; i < 256; i++) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+size_t eb_chunk_cut(const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    if (size <= EB_CHUNK_MIN_SIZE)
+        return size;
+    pthread_once(&gear_once, gear_init);
+
+    size_t end = size < EB_CHUNK_MAX_SIZE ? size : EB_CHUNK_MAX_SIZE;
+    size_t normal = end < EB_CHUNK_AVG_SIZE ? end : EB_CHUNK_AVG_SIZE;
+    uint64_t hash = 0;
+    size_t i = EB_CHUNK_MIN_SIZE;
+
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[bytes[i]];
+        if (!(hash & CHUNK_MASK_SMALL))
+            return i + 1;
+    }
+    for (; i < end; i++) {
+        hash = (hash << 1) + gear[bytes[i]];
+        if (!(hash & CHUNK_MASK_LARGE))
+            return i + 1;
+    }
+    return end;
+}
+
+eb_status_t eb_chunk_hash(const void* data, size_t size, char hash_out[65]) {
+    if ((!data && size > 0) || !hash_out)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    uint8_t digest[32];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(data, size, digest, &digest_len, EVP_sha256(), NULL) != 1)
+        return EB_ERROR_COMPUTATION_FAILED;
+    eb_hash_to_hex(digest, hash_out);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_chunk_split(const void* data, size_t size, eb_chunk_t** chunks_out, size_t* count_out) {
+    if ((!data && size > 0) || !chunks_out || !count_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    *chunks_out = NULL;
+    *count_out = 0;
+
+    /* Chunks average well above the minimum, this is rarely regrown */
+    size_t capacity = size / EB_CHUNK_AVG_SIZE + 1;
+    eb_chunk_t* chunks = malloc(capacity * sizeof(*chunks));
+    if (!chunks)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    const unsigned char* bytes = data;
+    size_t count = 0;
+    for (size_t offset = 0; offset < size; ) {
+        if (count == capacity) {
+            capacity *= 2;
+            eb_chunk_t* grown = realloc(chunks, capacity * sizeof(*chunks));
+            if (!grown) {
+                free(chunks);
+                return EB_ERROR_MEMORY_ALLOCATION;
+            }
+            chunks = grown;
+        }
+        size_t length = eb_chunk_cut(bytes + offset, size - offset);
+        eb_chunk_t* chunk = &chunks[count++];
+        chunk->offset = offset;
+        chunk->length = length;
+        eb_status_t status = eb_chunk_hash(bytes + offset, length, chunk->hash);
+        if (status != EB_SUCCESS) {
+            free(chunks);
+            return status;
+        }
+        offset += length;
+    }
+
+    *chunks_out = chunks;
+    *count_out = count;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_chunk_digest(const eb_chunk_t* chunks, size_t count, char digest_out[65]) {
+    if ((!chunks && count > 0) || !digest_out)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if (!ctx)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    uint8_t digest[32];
+    unsigned int digest_len = 0;
+    bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1;
+    for (size_t i = 0; ok && i < count; i++)
+        ok = EVP_DigestUpdate(ctx, chunks[i].hash, 64) == 1;
+    ok = ok && EVP_DigestFinal_ex(ctx, digest, &digest_len) == 1;
+    EVP_MD_CTX_free(ctx);
+
+    if (!ok)
+        return EB_ERROR_COMPUTATION_FAILED;
+    eb_hash_to_hex(digest, digest_out);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_chunk_list_format(const eb_chunk_t* chunks, size_t count, char** text_out, size_t* size_out) {
+    if ((!chunks && count > 0) || !text_out || !size_out)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    /* Header, then 64 hex digits, a space, up to 20 digits and a newline */
+    size_t capacity = strlen(EB_CHUNK_LIST_HEADER) + 2 + count * 86;
+    char* text = malloc(capacity);
+    if (!text)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    size_t len = (size_t)snprintf(text, capacity, "%s\n", EB_CHUNK_LIST_HEADER);
+    for (size_t i = 0; i < count; i++)
+        len += (size_t)snprintf(text + len, capacity - len, "%s %zu\n", chunks[i].hash, chunks[i].length);
+
+    *text_out = text;
+    *size_out = len;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_chunk_list_parse(const char* text, size_t size, eb_chunk_t** chunks_out, size_t* count_out) {
+    if (!text || !chunks_out || !count_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    *chunks_out = NULL;
+    *count_out = 0;
+
+    size_t header_len = strlen(EB_CHUNK_LIST_HEADER);
+    if (size < header_len || strncmp(text, EB_CHUNK_LIST_HEADER, header_len) != 0)
+        return EB_ERROR_INVALID_FORMAT;
+
+    /* One chunk per line after the header */
+    size_t capacity = 1;
+    for (size_t i = 0; i < size; i++)
+        capacity += text[i] == '\n';
+    eb_chunk_t* chunks = malloc(capacity * sizeof(*chunks));
+    if (!chunks)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    size_t count = 0;
+    uint64_t offset = 0;
+    const char* end = text + size;
+    const char* line = memchr(text, '\n', size);
+    for (line = line ? line + 1 : end; line < end; ) {
+        const char* eol = memchr(line, '\n', (size_t)(end - line));
+        size_t len = eol ? (size_t)(eol - line) : (size_t)(end - line);
+        char buf[128];
+        if (len > 0 && len < sizeof(buf)) {
+            memcpy(buf, line, len);
+            buf[len] = '\0';
+            eb_chunk_t* chunk = &chunks[count];
+            if (sscanf(buf, "%64s %zu", chunk->hash, &chunk->length) != 2 || strlen(chunk->hash) != 64 ||
+                chunk->length == 0) {
+                free(chunks);
+                return EB_ERROR_INVALID_FORMAT;
+            }
+            chunk->offset = offset;
+            offset += chunk->length;
+            count++;
+        } else if (len > 0) {
+            free(chunks);
+            return EB_ERROR_INVALID_FORMAT;
+        }
+        line += len + 1;
+    }
+
+    *chunks_out = chunks;
+    *count_out = count;
+    return EB_SUCCESS;
+}
@@ -0,0 +1,110 @@
+/*
+ * EmbeddingBridge - Content-Defined Chunking
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_CHUNK_H
+#define EB_CHUNK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * FastCDC chunking: cut points are chosen by a rolling gear hash over the
+ * content, so inserting or removing bytes only moves the boundaries next to
+ * the edit and every other chunk keeps its hash. Chunks are identified by
+ * the SHA-256 of their bytes.
+ *
+ * Chunk sizes are normalized around EB_CHUNK_AVG_SIZE and always lie within
+ * [EB_CHUNK_MIN_SIZE, EB_CHUNK_MAX_SIZE], except for the last one. The
+ * boundaries are part of the remote format: changing the sizes or the gear
+ * table makes existing chunks unreachable for deduplication.
+ */
+#define EB_CHUNK_MIN_SIZE (256 * 1024)
+#define EB_CHUNK_AVG_SIZE (1024 * 1024)
+#define EB_CHUNK_MAX_SIZE (4 * 1024 * 1024)
+
+/* Header line of a chunk list */
+#define EB_CHUNK_LIST_HEADER "# embr chunks 1"
+
+typedef struct {
+    uint64_t offset;    /* Offset of the chunk in the payload */
+    size_t length;      /* Length of the chunk in bytes */
+    char hash[65];      /* Hex SHA-256 of the chunk */
+} eb_chunk_t;
+
+/**
+ * Length of the first chunk of data
+ *
+ * @param data Payload
+ * @param size Size of the payload
+ * @return Length of the chunk starting at data (size if size <= EB_CHUNK_MIN_SIZE)
+ */
+size_t eb_chunk_cut(const void* data, size_t size);
+
+/**
+ * Split a payload into chunks and hash them
+ *
+ * @param data Payload
+ * @param size Size of the payload (an empty payload has no chunks)
+ * @param chunks_out Receives the chunks in order, caller must free
+ * @param count_out Receives the number of chunks
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_chunk_split(const void* data, size_t size, eb_chunk_t** chunks_out, size_t* count_out);
+
+/**
+ * Hex SHA-256 of a buffer, the identity of a chunk holding it
+ *
+ * @param data Chunk bytes
+ * @param size Size of the chunk
+ * @param hash_out Receives the 64-character hash
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_chunk_hash(const void* data, size_t size, char hash_out[65]);
+
+/**
+ * Identity of a chunked payload: the SHA-256 over its chunk hashes
+ *
+ * Two payloads with the same digest consist of the same chunks, so an
+ * interrupted upload can tell it is resuming the same content without
+ * hashing the payload again.
+ *
+ * @param chunks Chunks in order
+ * @param count Number of chunks
+ * @param digest_out Receives the 64-character digest
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_chunk_digest(const eb_chunk_t* chunks, size_t count, char digest_out[65]);
+
+/**
+ * Format a chunk list: the header, then "<hash> <length>" per chunk
+ *
+ * @param chunks Chunks in order
+ * @param count Number of chunks
+ * @param text_out Receives the text, caller must free
+ * @param size_out Receives the length of the text
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_chunk_list_format(const eb_chunk_t* chunks, size_t count, char** text_out, size_t* size_out);
+
+/**
+ * Parse a chunk list written by eb_chunk_list_format
+ *
+ * Offsets are rebuilt from the lengths.
+ *
+ * @param text List text
+ * @param size Length of the text
+ * @param chunks_out Receives the chunks in order, caller must free
+ * @param count_out Receives the number of chunks
+ * @return Status code (EB_ERROR_INVALID_FORMAT if the text is not a chunk list)
+ */
+eb_status_t eb_chunk_list_parse(const char* text, size_t size, eb_chunk_t** chunks_out, size_t* count_out);
+
+#endif /* EB_CHUNK_H */
@@ -12,401 +12,233 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/wait.h>
-#include <fcntl.h>
 #include <sys/stat.h>
-#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <zstd.h>
+#include <zdict.h>
 #include "compress.h"
 #include "status.h"
 #include "debug.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "counters.h"
 
-/* Buffer size for file I/O */
-#define BUFFER_SIZE 8192
-
-/* Maximum command length for subprocess operations */
-#define MAX_CMD_LEN 1024
+/* Inputs this large compress on several zstd workers, within the thread budget */
+#define ZSTD_PARALLEL_MIN ((size_t)4 << 20)
 
 /*
- * Since integrating ZSTD directly as a library would require additional dependencies,
- * we'll initially use process-based compression by invoking the zstd command.
- * This approach is simpler to implement but has some overhead due to process creation.
- * 
- * A future enhancement would be to integrate libzstd directly for better performance.
+ * ZSTD-specific compression implementations
  */
 
 /**
- * Check if the zstd command is available
- *
- * @return true if zstd is available, false otherwise
+ * Checks if a buffer contains ZSTD compressed data
+ * 
+ * @param buffer Buffer to check
+ * @param size Size of buffer
+ * @return true if the buffer contains ZSTD compressed data, false otherwise
  */
-static bool is_zstd_available(void) {
-    int ret = system("zstd --version > /dev/null 2>&1");
-    return WIFEXITED(ret) && WEXITSTATUS(ret) == 0;
+bool eb_is_zstd_compressed(const void *buffer, size_t size) {
+    if (!buffer || size < 4) {
+        return false;
+    }
+    
+    /* Check for ZSTD magic number (0x28 0xB5 0x2F 0xFD) */
+    const unsigned char *bytes = (const unsigned char *)buffer;
+    return (bytes[0] == 0x28 && bytes[1] == 0xB5 && 
+            bytes[2] == 0x2F && bytes[3] == 0xFD);
 }
 
-/**
- * Execute a command with input from a memory buffer
- *
- * @param command Command to execute
- * @param input Input buffer
- * @param input_size Size of input buffer
- * @param output_out Pointer to store output buffer (caller must free)
- * @param output_size_out Pointer to store output size
- * @return Status code (0 = success)
+/*
+ * Compression and decompression contexts are cached per thread, so each
+ * object pays for context setup once per thread instead of once per call.
  */
-static eb_status_t execute_with_buffer(
-    const char *command,
-    const void *input,
-    size_t input_size,
-    void **output_out,
-    size_t *output_size_out) {
-    
-    if (!command || !input || !output_out || !output_size_out) {
-        return EB_ERROR_INVALID_PARAMETER;
-    }
-    
-    /* Create pipes for stdin, stdout, and stderr */
-    int stdin_pipe[2];
-    int stdout_pipe[2];
-    int stderr_pipe[2];
-    
-    if (pipe(stdin_pipe) < 0 || pipe(stdout_pipe) < 0 || pipe(stderr_pipe) < 0) {
-        return EB_ERROR_IO;
-    }
-    
-    /* Fork process */
-    pid_t pid = fork();
-    
-    if (pid < 0) {
-        /* Fork failed */
-        close(stdin_pipe[0]);
-        close(stdin_pipe[1]);
-        close(stdout_pipe[0]);
-        close(stdout_pipe[1]);
-        close(stderr_pipe[0]);
-        close(stderr_pipe[1]);
-        return EB_ERROR_PROCESS_FAILED;
-    } else if (pid == 0) {
-        /* Child process */
-        
-        /* Redirect stdin, stdout, and stderr */
-        close(stdin_pipe[1]);  /* Close write end of stdin pipe */
-        close(stdout_pipe[0]); /* Close read end of stdout pipe */
-        close(stderr_pipe[0]); /* Close read end of stderr pipe */
-        
-        if (dup2(stdin_pipe[0], STDIN_FILENO) < 0 ||
-            dup2(stdout_pipe[1], STDOUT_FILENO) < 0 ||
-            dup2(stderr_pipe[1], STDERR_FILENO) < 0) {
-            exit(EXIT_FAILURE);
-        }
-        
-        /* Close duplicated file descriptors */
-        close(stdin_pipe[0]);
-        close(stdout_pipe[1]);
-        close(stderr_pipe[1]);
-        
-        /* Execute command */
-        execlp("/bin/sh", "/bin/sh", "-c", command, NULL);
-        
-        /* If exec fails */
-        exit(EXIT_FAILURE);
-    } else {
-        /* Parent process */
-        
-        /* Close unused pipe ends */
-        close(stdin_pipe[0]);  /* Close read end of stdin pipe */
-        close(stdout_pipe[1]); /* Close write end of stdout pipe */
-        close(stderr_pipe[1]); /* Close write end of stderr pipe */
-        
-        /* Write input to child's stdin */
-        ssize_t written = 0;
-        size_t remaining = input_size;
-        const unsigned char *input_ptr = (const unsigned char *)input;
-        
-        while (remaining > 0) {
-            written = write(stdin_pipe[1], input_ptr, remaining);
-            if (written <= 0) {
-                if (errno == EINTR) {
-                    continue;
-                }
-                close(stdin_pipe[1]);
-                close(stdout_pipe[0]);
-                close(stderr_pipe[0]);
-                return EB_ERROR_IO;
-            }
-            input_ptr += written;
-            remaining -= written;
-        }
-        
-        /* Close write end of stdin pipe to signal EOF */
-        close(stdin_pipe[1]);
-        
-        /* Read output from child's stdout */
-        size_t output_capacity = BUFFER_SIZE;
-        size_t output_size = 0;
-        unsigned char *output_buffer = malloc(output_capacity);
-        
-        if (!output_buffer) {
-            close(stdout_pipe[0]);
-            close(stderr_pipe[0]);
-            return EB_ERROR_MEMORY;
-        }
-        
-        while (1) {
-            /* Ensure we have enough capacity */
-            if (output_size + BUFFER_SIZE > output_capacity) {
-                output_capacity *= 2;
-                unsigned char *new_buffer = realloc(output_buffer, output_capacity);
-                if (!new_buffer) {
-                    free(output_buffer);
-                    close(stdout_pipe[0]);
-                    close(stderr_pipe[0]);
-                    return EB_ERROR_MEMORY;
-                }
-                output_buffer = new_buffer;
-            }
-            
-            /* Read from stdout */
-            ssize_t bytes_read = read(stdout_pipe[0], output_buffer + output_size, BUFFER_SIZE);
-            
-            if (bytes_read < 0) {
-                if (errno == EINTR) {
-                    continue;
-                }
-                free(output_buffer);
-                close(stdout_pipe[0]);
-                close(stderr_pipe[0]);
-                return EB_ERROR_IO;
-            } else if (bytes_read == 0) {
-                /* End of file */
-                break;
-            }
-            
-            output_size += bytes_read;
-        }
-        
-        /* Read any error output (for debugging) */
-        char error_buffer[BUFFER_SIZE];
-        ssize_t error_bytes = read(stderr_pipe[0], error_buffer, BUFFER_SIZE - 1);
-        
-        if (error_bytes > 0) {
-            error_buffer[error_bytes] = '\0';
-            DEBUG_PRINT("Command stderr: %s", error_buffer);
-        }
-        
-        /* Close remaining pipes */
-        close(stdout_pipe[0]);
-        close(stderr_pipe[0]);
-        
-        /* Wait for child process to complete */
-        int status;
-        if (waitpid(pid, &status, 0) < 0) {
-            free(output_buffer);
-            return EB_ERROR_PROCESS_FAILED;
-        }
-        
-        /* Check exit status */
-        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-            free(output_buffer);
-            return EB_ERROR_PROCESS_FAILED;
-        }
-        
-        /* Return output */
-        *output_out = output_buffer;
-        *output_size_out = output_size;
-        
-        return EB_SUCCESS;
-    }
+typedef struct {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+} zstd_thread_ctx_t;
+
+static pthread_key_t zstd_ctx_key;
+static pthread_once_t zstd_ctx_once = PTHREAD_ONCE_INIT;
+
+static void zstd_ctx_free(void *data) {
+    zstd_thread_ctx_t *ctx = data;
+    ZSTD_freeCCtx(ctx->cctx);
+    ZSTD_freeDCtx(ctx->dctx);
+    free(ctx);
 }
 
-eb_status_t compress_buffer(
-    const void *source,
-    size_t source_size,
-    int level,
-    void **dest_out,
-    size_t *dest_size_out) {
-    
-    /* Validate parameters */
-    if (!source || !dest_out || !dest_size_out) {
-        return EB_ERROR_INVALID_PARAMETER;
-    }
-    
-    /* If level is 0, just copy the data */
-    if (level == 0) {
-        unsigned char *dest = malloc(source_size);
-        if (!dest) {
-            return EB_ERROR_MEMORY;
+static void zstd_ctx_key_init(void) {
+    if (pthread_key_create(&zstd_ctx_key, zstd_ctx_free) != 0)
+        DEBUG_ERROR("Failed to create ZSTD context key");
+}
+
+static zstd_thread_ctx_t *zstd_thread_ctx(void) {
+    pthread_once(&zstd_ctx_once, zstd_ctx_key_init);
+
+    zstd_thread_ctx_t *ctx = pthread_getspecific(zstd_ctx_key);
+    if (!ctx) {
+        ctx = calloc(1, sizeof(*ctx));
+        if (!ctx)
+            return NULL;
+        if (pthread_setspecific(zstd_ctx_key, ctx) != 0) {
+            free(ctx);
+            return NULL;
         }
-        
-        memcpy(dest, source, source_size);
-        *dest_out = dest;
-        *dest_size_out = source_size;
-        return EB_SUCCESS;
-    }
-    
-    /* Check if zstd is available */
-    if (!is_zstd_available()) {
-        return EB_ERROR_DEPENDENCY_MISSING;
     }
-    
-    /* Clamp compression level to 1-9 */
-    if (level < 1) level = 1;
-    if (level > 9) level = 9;
-    
-    /* Build compression command */
-    char command[MAX_CMD_LEN];
-    snprintf(command, MAX_CMD_LEN, "zstd -%d -q -", level);
-    
-    /* Execute compression command */
-    return execute_with_buffer(command, source, source_size, dest_out, dest_size_out);
+    return ctx;
 }
 
+static ZSTD_CCtx *zstd_cctx(void) {
+    zstd_thread_ctx_t *ctx = zstd_thread_ctx();
+    if (ctx && !ctx->cctx)
+        ctx->cctx = ZSTD_createCCtx();
+    return ctx ? ctx->cctx : NULL;
+}
 
-eb_status_t compress_file(
-    const char *source_file,
-    const char *dest_file,
-    int level) {
-    
-    /* Validate parameters */
-    if (!source_file || !dest_file) {
+static ZSTD_DCtx *zstd_dctx(void) {
+    zstd_thread_ctx_t *ctx = zstd_thread_ctx();
+    if (ctx && !ctx->dctx)
+        ctx->dctx = ZSTD_createDCtx();
+    return ctx ? ctx->dctx : NULL;
+}
+
+/* Digested dictionary for one compression level */
+struct zstd_cdict {
+    int level;
+    ZSTD_CDict *cdict;
+    struct zstd_cdict *next;
+};
+
+struct eb_zstd_dict {
+    void *content;
+    size_t size;
+    ZSTD_DDict *ddict;
+    struct zstd_cdict *cdicts;  /* Created on first use, kept until the dictionary is freed */
+    pthread_mutex_t lock;
+};
+
+eb_status_t eb_zstd_dict_create(const void *content, size_t size, eb_zstd_dict_t **out) {
+    if (!content || size == 0 || !out) {
         return EB_ERROR_INVALID_PARAMETER;
     }
-    
-    /* If level is 0, just copy the file */
-    if (level == 0) {
-        FILE *src = fopen(source_file, "rb");
-        if (!src) {
-            return EB_ERROR_IO;
-        }
-        
-        FILE *dst = fopen(dest_file, "wb");
-        if (!dst) {
-            fclose(src);
-            return EB_ERROR_IO;
-        }
-        
-        unsigned char buffer[BUFFER_SIZE];
-        size_t bytes_read;
-        
-        while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, src)) > 0) {
-            if (fwrite(buffer, 1, bytes_read, dst) != bytes_read) {
-                fclose(src);
-                fclose(dst);
-                return EB_ERROR_IO;
-            }
-        }
-        
-        fclose(src);
-        fclose(dst);
-        return EB_SUCCESS;
+
+    eb_zstd_dict_t *dict = calloc(1, sizeof(*dict));
+    if (!dict) {
+        return EB_ERROR_MEMORY;
     }
-    
-    /* Check if zstd is available */
-    if (!is_zstd_available()) {
-        return EB_ERROR_DEPENDENCY_MISSING;
+    dict->content = malloc(size);
+    if (!dict->content) {
+        free(dict);
+        return EB_ERROR_MEMORY;
     }
-    
-    /* Clamp compression level to 1-9 */
-    if (level < 1) level = 1;
-    if (level > 9) level = 9;
-    
-    /* Build compression command */
-    char command[MAX_CMD_LEN];
-    snprintf(command, MAX_CMD_LEN, "zstd -%d -q -f \"%s\" -o \"%s\"",
-             level, source_file, dest_file);
-    
-    /* Execute compression command */
-    int ret = system(command);
-    if (!WIFEXITED(ret) || WEXITSTATUS(ret) != 0) {
-        return EB_ERROR_PROCESS_FAILED;
+    memcpy(dict->content, content, size);
+    dict->size = size;
+
+    dict->ddict = ZSTD_createDDict(dict->content, size);
+    if (!dict->ddict) {
+        free(dict->content);
+        free(dict);
+        return EB_ERROR_COMPRESSION;
     }
-    
+    pthread_mutex_init(&dict->lock, NULL);
+
+    *out = dict;
     return EB_SUCCESS;
 }
 
-eb_status_t decompress_file(
-    const char *source_file,
-    const char *dest_file) {
-    
-    /* Validate parameters */
-    if (!source_file || !dest_file) {
-        return EB_ERROR_INVALID_PARAMETER;
+void eb_zstd_dict_free(eb_zstd_dict_t *dict) {
+    if (!dict) {
+        return;
     }
-    
-    /* Check if the source file is zstd-compressed */
-    FILE *src = fopen(source_file, "rb");
-    if (!src) {
-        return EB_ERROR_IO;
+    struct zstd_cdict *entry = dict->cdicts;
+    while (entry) {
+        struct zstd_cdict *next = entry->next;
+        ZSTD_freeCDict(entry->cdict);
+        free(entry);
+        entry = next;
     }
-    
-    unsigned char magic[4];
-    size_t bytes_read = fread(magic, 1, 4, src);
-    fclose(src);
-    
-    if (bytes_read != 4 || memcmp(magic, "\x28\xB5\x2F\xFD", 4) != 0) {
-        /* Not a zstd-compressed file, just copy it */
-        return compress_file(source_file, dest_file, 0);
-    }
-    
-    /* Check if zstd is available */
-    if (!is_zstd_available()) {
-        return EB_ERROR_DEPENDENCY_MISSING;
+    ZSTD_freeDDict(dict->ddict);
+    pthread_mutex_destroy(&dict->lock);
+    free(dict->content);
+    free(dict);
+}
+
+/* The dictionary digested for level, created once and shared between threads */
+static const ZSTD_CDict *zstd_dict_cdict(eb_zstd_dict_t *dict, int level) {
+    pthread_mutex_lock(&dict->lock);
+    struct zstd_cdict *entry = dict->cdicts;
+    while (entry && entry->level != level) {
+        entry = entry->next;
     }
-    
-    /* Build decompression command */
-    char command[MAX_CMD_LEN];
-    snprintf(command, MAX_CMD_LEN, "zstd -d -q -f \"%s\" -o \"%s\"",
-             source_file, dest_file);
-    
-    /* Execute decompression command */
-    int ret = system(command);
-    if (!WIFEXITED(ret) || WEXITSTATUS(ret) != 0) {
-        return EB_ERROR_PROCESS_FAILED;
+    if (!entry) {
+        entry = malloc(sizeof(*entry));
+        if (entry) {
+            entry->level = level;
+            entry->cdict = ZSTD_createCDict(dict->content, dict->size, level);
+            if (entry->cdict) {
+                entry->next = dict->cdicts;
+                dict->cdicts = entry;
+            } else {
+                free(entry);
+                entry = NULL;
+            }
+        }
     }
-    
-    return EB_SUCCESS;
+    pthread_mutex_unlock(&dict->lock);
+    return entry ? entry->cdict : NULL;
 }
 
-/*
- * ZSTD-specific compression implementations
- */
+eb_status_t eb_zstd_train_dict(
+    const void *samples,
+    const size_t *sample_sizes,
+    unsigned sample_count,
+    size_t capacity,
+    void **dict_out,
+    size_t *dict_size_out) {
 
-/**
- * Checks if a buffer contains ZSTD compressed data
- * 
- * @param buffer Buffer to check
- * @param size Size of buffer
- * @return true if the buffer contains ZSTD compressed data, false otherwise
- */
-bool eb_is_zstd_compressed(const void *buffer, size_t size) {
-    if (!buffer || size < 4) {
-        return false;
+    if (!samples || !sample_sizes || sample_count == 0 || capacity == 0 ||
+        !dict_out || !dict_size_out) {
+        return EB_ERROR_INVALID_PARAMETER;
     }
-    
-    /* Check for ZSTD magic number (0x28 0xB5 0x2F 0xFD) */
-    const unsigned char *bytes = (const unsigned char *)buffer;
-    return (bytes[0] == 0x28 && bytes[1] == 0xB5 && 
-            bytes[2] == 0x2F && bytes[3] == 0xFD);
+
+    void *dict = malloc(capacity);
+    if (!dict) {
+        return EB_ERROR_MEMORY;
+    }
+
+    size_t size = ZDICT_trainFromBuffer(dict, capacity, samples, sample_sizes, sample_count);
+    if (ZDICT_isError(size)) {
+        DEBUG_WARN("ZSTD dictionary training failed: %s", ZDICT_getErrorName(size));
+        free(dict);
+        return EB_ERROR_COMPRESSION;
+    }
+
+    *dict_out = dict;
+    *dict_size_out = size;
+    DEBUG_INFO("Trained %zu byte ZSTD dictionary from %u samples", size, sample_count);
+    return EB_SUCCESS;
 }
 
 /**
- * Compresses a memory buffer specifically using ZSTD compression
+ * Compresses a memory buffer with ZSTD, optionally against a dictionary
  *
  * @param source Source buffer to compress
  * @param source_size Size of source buffer
  * @param dest_out Pointer to store output buffer (caller must free)
  * @param dest_size_out Pointer to store output size
  * @param level ZSTD compression level (1-22), higher = better compression but slower
+ * @param dict Dictionary to compress against, NULL for none
  * @return Status code (0 = success)
  */
-eb_status_t eb_compress_zstd(
+eb_status_t eb_compress_zstd_dict(
     const void *source,
     size_t source_size,
     void **dest_out,
     size_t *dest_size_out,
-    int level) {
+    int level,
+    eb_zstd_dict_t *dict) {
     
     /* Validate parameters */
     if (!source || !dest_out || !dest_size_out) {
@@ -417,6 +249,20 @@ eb_status_t eb_compress_zstd(
     if (level < 1) level = 1;
     if (level > 22) level = 22;
     
+    EB_TRACE_SCOPE("compress/zstd");
+    uint64_t started = eb_counter_clock();
+    ZSTD_CCtx *cctx = zstd_cctx();
+    if (!cctx) {
+        return EB_ERROR_MEMORY;
+    }
+    const ZSTD_CDict *cdict = NULL;
+    if (dict) {
+        cdict = zstd_dict_cdict(dict, level);
+        if (!cdict) {
+            return EB_ERROR_COMPRESSION;
+        }
+    }
+    
     /* Estimate compression buffer size */
     size_t dest_capacity = ZSTD_compressBound(source_size);
     void *dest_buffer = malloc(dest_capacity);
@@ -424,11 +270,10 @@ eb_status_t eb_compress_zstd(
         return EB_ERROR_MEMORY;
     }
     
-    /* Use the simple compression API which automatically includes frame content size */
-    size_t compressed_size = ZSTD_compress(
-        dest_buffer, dest_capacity,
-        source, source_size,
-        level);
+    /* Both one-shot calls include the frame content size */
+    size_t compressed_size = cdict
+        ? ZSTD_compress_usingCDict(cctx, dest_buffer, dest_capacity, source, source_size, cdict)
+        : ZSTD_compressCCtx(cctx, dest_buffer, dest_capacity, source, source_size, level);
     
     if (ZSTD_isError(compressed_size)) {
         DEBUG_WARN("ZSTD compression failed: %s", ZSTD_getErrorName(compressed_size));
@@ -446,25 +291,97 @@ eb_status_t eb_compress_zstd(
     }
     
     *dest_size_out = compressed_size;
-    DEBUG_INFO("Compressed %zu bytes to %zu bytes with ZSTD library", 
-              source_size, compressed_size);
+    eb_counter_add(EB_COUNTER_COMPRESS_IN_BYTES, source_size);
+    eb_counter_add(EB_COUNTER_COMPRESS_OUT_BYTES, compressed_size);
+    eb_counter_add_since(EB_COUNTER_COMPRESS_NS, started);
+    DEBUG_INFO("Compressed %zu bytes to %zu bytes with ZSTD library%s", 
+              source_size, compressed_size, dict ? " and dictionary" : "");
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_compress_zstd(
+    const void *source,
+    size_t source_size,
+    void **dest_out,
+    size_t *dest_size_out,
+    int level) {
+    return eb_compress_zstd_dict(source, source_size, dest_out, dest_size_out, level, NULL);
+}
+
+static void count_decompress(size_t source_size, size_t decompressed_size, uint64_t started) {
+    eb_counter_add(EB_COUNTER_DECOMPRESS_IN_BYTES, source_size);
+    eb_counter_add(EB_COUNTER_DECOMPRESS_OUT_BYTES, decompressed_size);
+    eb_counter_add_since(EB_COUNTER_DECOMPRESS_NS, started);
+}
+
+/* Decompress a frame without a content size into a growing buffer */
+static eb_status_t zstd_decompress_unsized(ZSTD_DCtx *dctx, const void *source, size_t source_size,
+                                           eb_zstd_dict_t *dict, void **dest_out, size_t *dest_size_out) {
+    size_t capacity = source_size * 4 > ZSTD_DStreamOutSize() ? source_size * 4 : ZSTD_DStreamOutSize();
+    unsigned char *dest = malloc(capacity);
+    if (!dest) {
+        return EB_ERROR_MEMORY;
+    }
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    if (dict) {
+        ZSTD_DCtx_refDDict(dctx, dict->ddict);
+    }
+
+    ZSTD_inBuffer input = { source, source_size, 0 };
+    ZSTD_outBuffer output = { dest, capacity, 0 };
+    size_t remaining = 1;
+    eb_status_t status = EB_SUCCESS;
+    while (remaining != 0) {
+        if (output.pos == output.size) {
+            unsigned char *grown = realloc(dest, output.size * 2);
+            if (!grown) {
+                status = EB_ERROR_MEMORY;
+                break;
+            }
+            dest = grown;
+            output.dst = dest;
+            output.size *= 2;
+        }
+        remaining = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(remaining)) {
+            DEBUG_WARN("ZSTD stream decompression failed: %s", ZSTD_getErrorName(remaining));
+            status = EB_ERROR_COMPRESSION;
+            break;
+        }
+        if (remaining != 0 && input.pos == input.size && output.pos < output.size) {
+            DEBUG_WARN("ZSTD frame is truncated");
+            status = EB_ERROR_COMPRESSION;
+            break;
+        }
+    }
+    /* The per-thread context must not keep the dictionary */
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+
+    if (status != EB_SUCCESS) {
+        free(dest);
+        return status;
+    }
+    *dest_out = dest;
+    *dest_size_out = output.pos;
     return EB_SUCCESS;
 }
 
 /**
- * Decompresses a memory buffer compressed with ZSTD
+ * Decompresses a ZSTD buffer, optionally against a dictionary
  *
  * @param source Source buffer to decompress
  * @param source_size Size of source buffer
  * @param dest_out Pointer to store output buffer (caller must free)
  * @param dest_size_out Pointer to store output size
+ * @param dict Dictionary the data was compressed against, NULL for none
  * @return Status code (0 = success)
  */
-eb_status_t eb_decompress_zstd(
+eb_status_t eb_decompress_zstd_dict(
     const void *source,
     size_t source_size,
     void **dest_out,
-    size_t *dest_size_out) {
+    size_t *dest_size_out,
+    eb_zstd_dict_t *dict) {
     
     /* Validate parameters */
     if (!source || !dest_out || !dest_size_out) {
@@ -479,20 +396,36 @@ eb_status_t eb_decompress_zstd(
 
     /* Determine original size from frame header */
     unsigned long long original_size = ZSTD_getFrameContentSize(source, source_size);
-    if (original_size == ZSTD_CONTENTSIZE_UNKNOWN || original_size == ZSTD_CONTENTSIZE_ERROR) {
+    if (original_size == ZSTD_CONTENTSIZE_ERROR) {
         DEBUG_WARN("Could not determine content size from ZSTD frame");
         return EB_ERROR_INVALID_FORMAT;
     }
     
+    EB_TRACE_SCOPE("compress/unzstd");
+    uint64_t started = eb_counter_clock();
+    ZSTD_DCtx *dctx = zstd_dctx();
+    if (!dctx) {
+        return EB_ERROR_MEMORY;
+    }
+    if (original_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        /* Streamed frames (eb_zstd_stream_*) do not record their size */
+        eb_status_t status = zstd_decompress_unsized(dctx, source, source_size, dict,
+                                                     dest_out, dest_size_out);
+        if (status == EB_SUCCESS)
+            count_decompress(source_size, *dest_size_out, started);
+        return status;
+    }
+    
     /* Allocate decompression buffer */
-    void *dest_buffer = malloc(original_size);
+    void *dest_buffer = malloc(original_size ? original_size : 1);
     if (!dest_buffer) {
         return EB_ERROR_MEMORY;
     }
     
     /* Perform decompression */
-    size_t decompressed_size = ZSTD_decompress(dest_buffer, original_size, 
-                                              source, source_size);
+    size_t decompressed_size = dict
+        ? ZSTD_decompress_usingDDict(dctx, dest_buffer, original_size, source, source_size, dict->ddict)
+        : ZSTD_decompressDCtx(dctx, dest_buffer, original_size, source, source_size);
     
     if (ZSTD_isError(decompressed_size)) {
         DEBUG_WARN("ZSTD decompression failed: %s", ZSTD_getErrorName(decompressed_size));
@@ -503,7 +436,338 @@ eb_status_t eb_decompress_zstd(
     /* Return decompressed data */
     *dest_out = dest_buffer;
     *dest_size_out = decompressed_size;
+    count_decompress(source_size, decompressed_size, started);
     DEBUG_INFO("Decompressed %zu bytes to %zu bytes with ZSTD library", 
               source_size, decompressed_size);
     return EB_SUCCESS;
-} 
\ No newline at end of file
+}
+
+eb_status_t eb_decompress_zstd(
+    const void *source,
+    size_t source_size,
+    void **dest_out,
+    size_t *dest_size_out) {
+    return eb_decompress_zstd_dict(source, source_size, dest_out, dest_size_out, NULL);
+}
+
+/*
+ * Streaming compression
+ *
+ * The stream has its own context rather than the per-thread one: a frame
+ * may stay open across other eb_compress_zstd() calls on the same thread.
+ */
+struct eb_zstd_stream {
+    ZSTD_CCtx *cctx;
+    eb_zstd_sink_fn sink;
+    void *ctx;
+    void *out;
+    size_t out_size;
+};
+
+/*
+ * Give a dedicated context zstd workers for size bytes of input, or for an
+ * input of unknown size. Libraries built without threads keep compressing
+ * on the calling thread.
+ */
+static void zstd_set_workers(ZSTD_CCtx *cctx, unsigned long long size) {
+    size_t blocks = size == ZSTD_CONTENTSIZE_UNKNOWN ? SIZE_MAX : (size_t)(size / ZSTD_PARALLEL_MIN);
+    unsigned threads = blocks ? eb_pool_threads(0, blocks) : 1;
+    if (threads > 1) {
+        size_t ret = ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, (int)threads);
+        if (ZSTD_isError(ret)) {
+            DEBUG_INFO("ZSTD compresses on one thread: %s", ZSTD_getErrorName(ret));
+        }
+    }
+}
+
+/* Open a stream for size bytes of input, ZSTD_CONTENTSIZE_UNKNOWN if not known */
+static eb_status_t zstd_stream_create(int level, unsigned long long size, eb_zstd_sink_fn sink,
+                                      void *ctx, eb_zstd_stream_t **stream_out) {
+    if (!sink || !stream_out) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+
+    eb_zstd_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return EB_ERROR_MEMORY;
+    }
+    stream->cctx = ZSTD_createCCtx();
+    stream->out_size = ZSTD_CStreamOutSize();
+    stream->out = malloc(stream->out_size);
+    if (!stream->cctx || !stream->out) {
+        eb_zstd_stream_abort(stream);
+        return EB_ERROR_MEMORY;
+    }
+    ZSTD_CCtx_setParameter(stream->cctx, ZSTD_c_compressionLevel, level);
+    zstd_set_workers(stream->cctx, size);
+    if (size != ZSTD_CONTENTSIZE_UNKNOWN) {
+        /* The frame then records its size, as one-shot frames do */
+        ZSTD_CCtx_setPledgedSrcSize(stream->cctx, size);
+    }
+    stream->sink = sink;
+    stream->ctx = ctx;
+
+    *stream_out = stream;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_zstd_stream_open(int level, eb_zstd_sink_fn sink, void *ctx, eb_zstd_stream_t **stream_out) {
+    return zstd_stream_create(level, ZSTD_CONTENTSIZE_UNKNOWN, sink, ctx, stream_out);
+}
+
+/* Run the compressor over input with mode, handing every full block to the sink */
+static eb_status_t zstd_stream_run(eb_zstd_stream_t *stream, const void *data, size_t size,
+                                   ZSTD_EndDirective mode) {
+    ZSTD_inBuffer input = { data, size, 0 };
+    size_t remaining;
+    eb_counter_add(EB_COUNTER_COMPRESS_IN_BYTES, size);
+    do {
+        ZSTD_outBuffer output = { stream->out, stream->out_size, 0 };
+        uint64_t started = eb_counter_clock();
+        remaining = ZSTD_compressStream2(stream->cctx, &output, &input, mode);
+        eb_counter_add_since(EB_COUNTER_COMPRESS_NS, started);
+        if (ZSTD_isError(remaining)) {
+            DEBUG_WARN("ZSTD stream compression failed: %s", ZSTD_getErrorName(remaining));
+            return EB_ERROR_COMPRESSION;
+        }
+        eb_counter_add(EB_COUNTER_COMPRESS_OUT_BYTES, output.pos);
+        if (output.pos > 0) {
+            int status = stream->sink(stream->ctx, stream->out, output.pos);
+            if (status != 0) {
+                return status;
+            }
+        }
+    } while (mode == ZSTD_e_end ? remaining != 0 : input.pos < input.size);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_zstd_stream_write(eb_zstd_stream_t *stream, const void *data, size_t size) {
+    if (!stream || (!data && size > 0)) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    return size > 0 ? zstd_stream_run(stream, data, size, ZSTD_e_continue) : EB_SUCCESS;
+}
+
+eb_status_t eb_zstd_stream_finish(eb_zstd_stream_t *stream) {
+    if (!stream) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    eb_status_t status = zstd_stream_run(stream, NULL, 0, ZSTD_e_end);
+    eb_zstd_stream_abort(stream);
+    return status;
+}
+
+void eb_zstd_stream_abort(eb_zstd_stream_t *stream) {
+    if (!stream) {
+        return;
+    }
+    ZSTD_freeCCtx(stream->cctx);
+    free(stream->out);
+    free(stream);
+}
+
+/*
+ * Buffer and file compression
+ *
+ * Levels 1-9 are kept from when these went through the zstd command; the
+ * frames are the same, so either side can read what the other wrote.
+ */
+
+static int clamp_level(int level) {
+    return level < 1 ? 1 : level > 9 ? 9 : level;
+}
+
+eb_status_t compress_buffer(
+    const void *source,
+    size_t source_size,
+    int level,
+    void **dest_out,
+    size_t *dest_size_out) {
+
+    /* Validate parameters */
+    if (!source || !dest_out || !dest_size_out) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+
+    /* If level is 0, just copy the data */
+    if (level == 0) {
+        unsigned char *dest = malloc(source_size ? source_size : 1);
+        if (!dest) {
+            return EB_ERROR_MEMORY;
+        }
+
+        memcpy(dest, source, source_size);
+        *dest_out = dest;
+        *dest_size_out = source_size;
+        return EB_SUCCESS;
+    }
+
+    level = clamp_level(level);
+    if (source_size < ZSTD_PARALLEL_MIN) {
+        return eb_compress_zstd(source, source_size, dest_out, dest_size_out, level);
+    }
+
+    /* Large buffers get a context of their own with workers */
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    size_t capacity = ZSTD_compressBound(source_size);
+    void *dest = malloc(capacity);
+    if (!cctx || !dest) {
+        ZSTD_freeCCtx(cctx);
+        free(dest);
+        return EB_ERROR_MEMORY;
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    zstd_set_workers(cctx, source_size);
+    size_t compressed_size = ZSTD_compress2(cctx, dest, capacity, source, source_size);
+    ZSTD_freeCCtx(cctx);
+    if (ZSTD_isError(compressed_size)) {
+        DEBUG_WARN("ZSTD compression failed: %s", ZSTD_getErrorName(compressed_size));
+        free(dest);
+        return EB_ERROR_COMPRESSION;
+    }
+
+    void *shrunk = realloc(dest, compressed_size);
+    *dest_out = shrunk ? shrunk : dest;
+    *dest_size_out = compressed_size;
+    return EB_SUCCESS;
+}
+
+static int file_sink(void *ctx, const void *data, size_t size) {
+    return fwrite(data, 1, size, ctx) == size ? EB_SUCCESS : EB_ERROR_IO;
+}
+
+/* Copy or compress an open file into another, level 0 copying */
+static eb_status_t compress_stream(FILE *src, FILE *dst, int level) {
+    unsigned char *buffer = malloc(ZSTD_CStreamInSize());
+    if (!buffer) {
+        return EB_ERROR_MEMORY;
+    }
+
+    eb_zstd_stream_t *stream = NULL;
+    eb_status_t status = EB_SUCCESS;
+    if (level > 0) {
+        struct stat st;
+        unsigned long long size = fstat(fileno(src), &st) == 0 && S_ISREG(st.st_mode)
+            ? (unsigned long long)st.st_size : ZSTD_CONTENTSIZE_UNKNOWN;
+        status = zstd_stream_create(clamp_level(level), size, file_sink, dst, &stream);
+    }
+
+    size_t bytes_read;
+    while (status == EB_SUCCESS && (bytes_read = fread(buffer, 1, ZSTD_CStreamInSize(), src)) > 0) {
+        status = stream ? eb_zstd_stream_write(stream, buffer, bytes_read)
+                        : file_sink(dst, buffer, bytes_read);
+    }
+    if (status == EB_SUCCESS && ferror(src)) {
+        status = EB_ERROR_IO;
+    }
+    if (stream) {
+        if (status == EB_SUCCESS) {
+            status = eb_zstd_stream_finish(stream);
+        } else {
+            eb_zstd_stream_abort(stream);
+        }
+    }
+    free(buffer);
+    return status;
+}
+
+/* Decompress every frame of an open file into another */
+static eb_status_t decompress_stream(FILE *src, FILE *dst) {
+    ZSTD_DCtx *dctx = zstd_dctx();
+    size_t in_size = ZSTD_DStreamInSize();
+    size_t out_size = ZSTD_DStreamOutSize();
+    unsigned char *in = malloc(in_size);
+    unsigned char *out = malloc(out_size);
+    if (!dctx || !in || !out) {
+        free(in);
+        free(out);
+        return EB_ERROR_MEMORY;
+    }
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+
+    eb_status_t status = EB_SUCCESS;
+    size_t remaining = 0;
+    size_t bytes_read;
+    while (status == EB_SUCCESS && (bytes_read = fread(in, 1, in_size, src)) > 0) {
+        ZSTD_inBuffer input = { in, bytes_read, 0 };
+        while (status == EB_SUCCESS && input.pos < input.size) {
+            ZSTD_outBuffer output = { out, out_size, 0 };
+            remaining = ZSTD_decompressStream(dctx, &output, &input);
+            if (ZSTD_isError(remaining)) {
+                DEBUG_WARN("ZSTD stream decompression failed: %s", ZSTD_getErrorName(remaining));
+                status = EB_ERROR_COMPRESSION;
+            } else if (output.pos > 0) {
+                status = file_sink(dst, out, output.pos);
+            }
+        }
+    }
+    if (status == EB_SUCCESS && ferror(src)) {
+        status = EB_ERROR_IO;
+    }
+    if (status == EB_SUCCESS && remaining != 0) {
+        DEBUG_WARN("ZSTD frame is truncated");
+        status = EB_ERROR_COMPRESSION;
+    }
+    free(in);
+    free(out);
+    return status;
+}
+
+/* Run a stream transform from one path to another, removing a partial destination */
+static eb_status_t transform_file(const char *source_file, const char *dest_file, int level, bool decompress) {
+    FILE *src = fopen(source_file, "rb");
+    if (!src) {
+        return EB_ERROR_IO;
+    }
+    FILE *dst = fopen(dest_file, "wb");
+    if (!dst) {
+        fclose(src);
+        return EB_ERROR_IO;
+    }
+
+    eb_status_t status = decompress ? decompress_stream(src, dst) : compress_stream(src, dst, level);
+    fclose(src);
+    if (fclose(dst) != 0 && status == EB_SUCCESS) {
+        status = EB_ERROR_IO;
+    }
+    if (status != EB_SUCCESS) {
+        unlink(dest_file);
+    }
+    return status;
+}
+
+eb_status_t compress_file(
+    const char *source_file,
+    const char *dest_file,
+    int level) {
+
+    /* Validate parameters */
+    if (!source_file || !dest_file) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    return transform_file(source_file, dest_file, level, false);
+}
+
+eb_status_t decompress_file(
+    const char *source_file,
+    const char *dest_file) {
+
+    /* Validate parameters */
+    if (!source_file || !dest_file) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+
+    /* Check if the source file is zstd-compressed */
+    FILE *src = fopen(source_file, "rb");
+    if (!src) {
+        return EB_ERROR_IO;
+    }
+
+    unsigned char magic[4];
+    size_t bytes_read = fread(magic, 1, 4, src);
+    fclose(src);
+
+    /* A file that is not zstd-compressed is copied as it is */
+    bool compressed = bytes_read == 4 && eb_is_zstd_compressed(magic, 4);
+    return transform_file(source_file, dest_file, 0, compressed);
+}
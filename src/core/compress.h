@@ -18,6 +18,9 @@
 /**
  * Compresses a memory buffer using zstd compression
  *
+ * Buffers of several megabytes compress on zstd worker threads, within
+ * the thread budget of eb_pool_threads().
+ *
  * @param source Source buffer to compress
  * @param source_size Size of source buffer
  * @param level Compression level (0-9), 0 means no compression
@@ -36,6 +39,9 @@ eb_status_t compress_buffer(
 /**
  * Compresses a file using zstd compression
  *
+ * The file is streamed through one frame that records its size; large
+ * files compress on worker threads as compress_buffer() does.
+ *
  * @param source_file Path to source file
  * @param dest_file Path to destination file
  * @param level Compression level (0-9), 0 means no compression
@@ -49,6 +55,8 @@ eb_status_t compress_file(
 /**
  * Decompresses a file compressed with zstd
  *
+ * Files without the zstd magic are copied unchanged.
+ *
  * @param source_file Path to source file
  * @param dest_file Path to destination file
  * @return Status code (0 = success)
@@ -95,6 +103,139 @@ eb_status_t eb_decompress_zstd(
     void **dest_out,
     size_t *dest_size_out);
 
+/*
+ * ZSTD dictionaries
+ *
+ * Small objects such as embedding vectors compress much better against a
+ * dictionary trained on similar data. A dictionary keeps its digested
+ * forms (one per compression level) and can be shared between threads.
+ */
+typedef struct eb_zstd_dict eb_zstd_dict_t;
+
+/**
+ * Load a dictionary from its serialized content
+ *
+ * @param content Dictionary bytes, copied
+ * @param size Size of the dictionary
+ * @param out Receives the dictionary, free with eb_zstd_dict_free()
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_zstd_dict_create(
+    const void *content,
+    size_t size,
+    eb_zstd_dict_t **out);
+
+/**
+ * Free a dictionary from eb_zstd_dict_create()
+ */
+void eb_zstd_dict_free(eb_zstd_dict_t *dict);
+
+/**
+ * Train a dictionary from sample buffers
+ *
+ * @param samples Sample buffers stored back to back
+ * @param sample_sizes Size of each sample
+ * @param sample_count Number of samples
+ * @param capacity Maximum dictionary size
+ * @param dict_out Pointer to store the dictionary content (caller must free)
+ * @param dict_size_out Pointer to store the dictionary size
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_zstd_train_dict(
+    const void *samples,
+    const size_t *sample_sizes,
+    unsigned sample_count,
+    size_t capacity,
+    void **dict_out,
+    size_t *dict_size_out);
+
+/**
+ * Compresses a memory buffer with ZSTD against a dictionary
+ *
+ * Same as eb_compress_zstd() when dict is NULL.
+ *
+ * @param source Source buffer to compress
+ * @param source_size Size of source buffer
+ * @param dest_out Pointer to store output buffer (caller must free)
+ * @param dest_size_out Pointer to store output size
+ * @param level ZSTD compression level (1-22)
+ * @param dict Dictionary to compress against, NULL for none
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_compress_zstd_dict(
+    const void *source,
+    size_t source_size,
+    void **dest_out,
+    size_t *dest_size_out,
+    int level,
+    eb_zstd_dict_t *dict);
+
+/**
+ * Decompresses a ZSTD buffer compressed against a dictionary
+ *
+ * Same as eb_decompress_zstd() when dict is NULL.
+ *
+ * @param source Source buffer to decompress
+ * @param source_size Size of source buffer
+ * @param dest_out Pointer to store output buffer (caller must free)
+ * @param dest_size_out Pointer to store output size
+ * @param dict Dictionary the data was compressed against, NULL for none
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_decompress_zstd_dict(
+    const void *source,
+    size_t source_size,
+    void **dest_out,
+    size_t *dest_size_out,
+    eb_zstd_dict_t *dict);
+
+/*
+ * Streaming ZSTD compression
+ *
+ * Data written to the stream is compressed into one frame and handed to a
+ * sink in blocks of ZSTD_CStreamOutSize(), so only one block of output is
+ * held however large the input is. The sink has the shape of a transport
+ * sink and may be one.
+ */
+typedef struct eb_zstd_stream eb_zstd_stream_t;
+
+/* Consumer of compressed blocks; anything but 0 aborts with that status */
+typedef int (*eb_zstd_sink_fn)(void *ctx, const void *data, size_t size);
+
+/**
+ * Start a compressed frame
+ *
+ * @param level ZSTD compression level (1-22)
+ * @param sink Consumer of the compressed data
+ * @param ctx Context passed to sink
+ * @param stream_out Receives the stream
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_zstd_stream_open(int level, eb_zstd_sink_fn sink, void *ctx, eb_zstd_stream_t **stream_out);
+
+/**
+ * Compress more data into the frame
+ *
+ * @param stream Stream
+ * @param data Data to compress
+ * @param size Size of data
+ * @return Status code (0 = success, the sink's status if it aborted)
+ */
+eb_status_t eb_zstd_stream_write(eb_zstd_stream_t *stream, const void *data, size_t size);
+
+/**
+ * End the frame, flush it to the sink and free the stream
+ *
+ * @param stream Stream
+ * @return Status code (0 = success, the sink's status if it aborted)
+ */
+eb_status_t eb_zstd_stream_finish(eb_zstd_stream_t *stream);
+
+/**
+ * Free a stream without ending its frame
+ */
+void eb_zstd_stream_abort(eb_zstd_stream_t *stream);
+
 /**
  * Checks if a buffer contains ZSTD compressed data
  * 
@@ -0,0 +1,146 @@
+/*
+ * EmbeddingBridge - Adaptive Compression Level
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "compress_tune.h"
+#include "thread_pool.h"
+#include "debug.h"
+
+/* Input a thread gathers at one level before it is weighed */
+#define TUNE_WINDOW ((size_t)1 << 20)
+
+/* ZSTD levels, indexed directly */
+#define TUNE_LEVELS 23
+
+/* Weight of a new window in the running speed and ratio */
+#define TUNE_WEIGHT 0.25
+
+/* A level must shrink the output by at least this fraction over the one below */
+#define TUNE_MIN_GAIN 0.01
+
+/* Windows after which another level's figures are stale and it is tried afresh */
+#define TUNE_STALE 32
+
+typedef struct {
+    double speed;           /* Input bytes per second on one thread */
+    double ratio;           /* Output bytes per input byte */
+    unsigned age;           /* Windows weighed at other levels since */
+    bool known;
+} level_stats_t;
+
+typedef struct {
+    unsigned generation;
+    int level;
+    size_t input;
+    size_t output;
+    uint64_t nanos;
+} tune_window_t;
+
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+static level_stats_t stats[TUNE_LEVELS];
+static int current_level;           /* 0 before the first choice */
+static unsigned generation;         /* Bumped by a reset, retiring open windows */
+
+static __thread tune_window_t window;
+
+static int clamp_level(int level, const eb_compress_bounds_t* bounds) {
+    int min = bounds->min_level < 1 ? 1 : bounds->min_level;
+    int max = bounds->max_level < min ? min : bounds->max_level >= TUNE_LEVELS ? TUNE_LEVELS - 1
+                                                                                : bounds->max_level;
+    return level < min ? min : level > max ? max : level;
+}
+
+int eb_compress_tune_level(const eb_compress_bounds_t* bounds) {
+    return clamp_level(__atomic_load_n(&current_level, __ATOMIC_RELAXED), bounds);
+}
+
+/* Move the current level one step if its figures call for it; tune_lock held */
+static void tune_step(const eb_compress_bounds_t* bounds) {
+    int level = clamp_level(current_level, bounds);
+    for (int i = 0; i < TUNE_LEVELS; i++) {
+        if (i != level && stats[i].known && ++stats[i].age > TUNE_STALE)
+            stats[i].known = false;
+    }
+
+    double threads = (double)eb_pool_threads(0, SIZE_MAX);
+    double target = (double)bounds->target;
+    int next = level;
+    const level_stats_t* down = &stats[clamp_level(level - 1, bounds)];
+    const level_stats_t* up = &stats[clamp_level(level + 1, bounds)];
+    if (stats[level].speed * threads < target) {
+        next = clamp_level(level - 1, bounds);
+    } else if (down != &stats[level] && down->known &&
+               stats[level].ratio > down->ratio * (1.0 - TUNE_MIN_GAIN)) {
+        // Slower for no gain in size
+        next = level - 1;
+    } else if (up != &stats[level] &&
+               (!up->known || (up->speed * threads >= target &&
+                               up->ratio <= stats[level].ratio * (1.0 - TUNE_MIN_GAIN)))) {
+        // Untried levels are tried; one window that misses costs little
+        next = level + 1;
+    }
+    if (next != level)
+        DEBUG_PRINT("compress: level %d -> %d (%.1f MB/s per thread, ratio %.3f)", level, next,
+                    stats[level].speed / 1e6, stats[level].ratio);
+    __atomic_store_n(&current_level, next, __ATOMIC_RELAXED);
+}
+
+/* Fold a full window into its level's figures; tune_lock held */
+static void tune_merge(const eb_compress_bounds_t* bounds, const tune_window_t* w) {
+    level_stats_t* s = &stats[w->level];
+    double speed = (double)w->input * 1e9 / (double)(w->nanos ? w->nanos : 1);
+    double ratio = (double)w->output / (double)w->input;
+    if (s->known) {
+        s->speed += TUNE_WEIGHT * (speed - s->speed);
+        s->ratio += TUNE_WEIGHT * (ratio - s->ratio);
+    } else {
+        s->speed = speed;
+        s->ratio = ratio;
+        s->known = true;
+    }
+    s->age = 0;
+
+    // Windows still open at a level that was left only add to its figures
+    if (w->level == clamp_level(current_level, bounds))
+        tune_step(bounds);
+}
+
+void eb_compress_tune_record(const eb_compress_bounds_t* bounds, int level,
+                             size_t input, size_t output, uint64_t nanos) {
+    if (!bounds || level < 1 || level >= TUNE_LEVELS || input == 0)
+        return;
+
+    unsigned current_generation = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+    if (window.generation != current_generation || window.level != level)
+        window = (tune_window_t){ current_generation, level, 0, 0, 0 };
+    window.input += input;
+    window.output += output;
+    window.nanos += nanos;
+    if (window.input < TUNE_WINDOW)
+        return;
+
+    pthread_mutex_lock(&tune_lock);
+    if (window.generation == generation)
+        tune_merge(bounds, &window);
+    pthread_mutex_unlock(&tune_lock);
+    window.input = window.output = 0;
+    window.nanos = 0;
+}
+
+void eb_compress_tune_reset(void) {
+    pthread_mutex_lock(&tune_lock);
+    memset(stats, 0, sizeof(stats));
+    __atomic_store_n(&current_level, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&tune_lock);
+}
@@ -0,0 +1,62 @@
+/*
+ * EmbeddingBridge - Adaptive Compression Level
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_COMPRESS_TUNE_H
+#define EB_COMPRESS_TUNE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Level choice for storage.compression = auto.
+ *
+ * Writers report how long each compression took and how well it did.
+ * Once a window of input has been seen at a level, its speed times the
+ * thread budget is the throughput that level sustains. A level that falls
+ * short of the target, or compresses no better than the one below, steps
+ * down; one that meets it steps up while the next level is untried, or
+ * meets the target too and compresses better. Figures older than a few
+ * dozen windows are dropped, so levels are tried again as the data or the
+ * load changes. The state is shared by the whole process.
+ */
+
+typedef struct {
+    int min_level;          /* Lowest level to use */
+    int max_level;          /* Highest level to use */
+    uint64_t target;        /* Input bytes per second to sustain across threads */
+} eb_compress_bounds_t;
+
+/**
+ * Level for the next compression
+ *
+ * @param bounds Range and throughput target
+ * @return Level within the bounds
+ */
+int eb_compress_tune_level(const eb_compress_bounds_t* bounds);
+
+/**
+ * Report one compression
+ *
+ * Reports are gathered per thread and only take the shared lock once a
+ * window of input has built up, so they are cheap per object.
+ *
+ * @param bounds Bounds the level was chosen with
+ * @param level Level used
+ * @param input Bytes compressed
+ * @param output Compressed bytes
+ * @param nanos Time the compression took
+ */
+void eb_compress_tune_record(const eb_compress_bounds_t* bounds, int level,
+                             size_t input, size_t output, uint64_t nanos);
+
+/* Forget what was measured, starting again from the lowest level */
+void eb_compress_tune_reset(void);
+
+#endif /* EB_COMPRESS_TUNE_H */
@@ -0,0 +1,94 @@
+/*
+ * EmbeddingBridge - Library Context Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "context.h"
+#include "path_utils.h"
+#include "debug.h"
+
+struct eb_context {
+    char* root;
+    eb_store_t* store;              /* Opened by the first eb_context_store() */
+    pthread_mutex_t store_lock;     /* Guards store */
+    pthread_mutex_t commit_lock;    /* Held while a batch commits */
+};
+
+eb_status_t eb_context_open(const char* root, eb_context_t** out) {
+    if (!out)
+        return EB_ERROR_INVALID_INPUT;
+
+    char* found = find_repo_root(root ? root : ".");
+    if (!found)
+        return EB_ERROR_NOT_INITIALIZED;
+
+    eb_context_t* ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        free(found);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    ctx->root = found;
+    pthread_mutex_init(&ctx->store_lock, NULL);
+    pthread_mutex_init(&ctx->commit_lock, NULL);
+
+    DEBUG_PRINT("eb_context_open: Opened repository at %s\n", ctx->root);
+    *out = ctx;
+    return EB_SUCCESS;
+}
+
+void eb_context_close(eb_context_t* ctx) {
+    if (!ctx)
+        return;
+    eb_store_destroy(ctx->store);
+    pthread_mutex_destroy(&ctx->store_lock);
+    pthread_mutex_destroy(&ctx->commit_lock);
+    free(ctx->root);
+    free(ctx);
+}
+
+const char* eb_context_root(const eb_context_t* ctx) {
+    return ctx ? ctx->root : NULL;
+}
+
+eb_status_t eb_context_store(eb_context_t* ctx, eb_store_t** out) {
+    if (!ctx || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_status_t status = EB_SUCCESS;
+    pthread_mutex_lock(&ctx->store_lock);
+    if (!ctx->store) {
+        eb_store_config_t config = {0};
+        config.root_path = ctx->root;
+        status = eb_store_init(&config, &ctx->store);
+        if (status != EB_SUCCESS)
+            ctx->store = NULL;
+    }
+    *out = ctx->store;
+    pthread_mutex_unlock(&ctx->store_lock);
+    return status;
+}
+
+eb_status_t eb_context_batch_begin(eb_context_t* ctx, eb_store_batch_t** out) {
+    if (!ctx || !out)
+        return EB_ERROR_INVALID_INPUT;
+    return eb_store_batch_begin(ctx->root, out);
+}
+
+eb_status_t eb_context_batch_commit(eb_context_t* ctx, eb_store_batch_t* batch) {
+    if (!ctx) {
+        eb_store_batch_abort(batch);
+        return EB_ERROR_INVALID_INPUT;
+    }
+    pthread_mutex_lock(&ctx->commit_lock);
+    eb_status_t status = eb_store_batch_commit(batch);
+    pthread_mutex_unlock(&ctx->commit_lock);
+    return status;
+}
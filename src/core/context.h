@@ -0,0 +1,76 @@
+/*
+ * EmbeddingBridge - Library Context
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_CONTEXT_H
+#define EB_CONTEXT_H
+
+#include <stdbool.h>
+#include "status.h"
+#include "store.h"
+
+/*
+ * A context is one repository opened for library use. It owns the
+ * repository root and a store shared by every thread that uses the
+ * context, and serializes batch commits so that threads can each fill
+ * their own batch and commit in any order without losing index updates.
+ * All functions below may be called concurrently on one context.
+ */
+
+typedef struct eb_context eb_context_t;
+
+/**
+ * Open a repository
+ *
+ * @param root Repository root, NULL to search up from the working directory
+ * @param out Receives the context
+ * @return Status code (EB_ERROR_NOT_INITIALIZED outside a repository)
+ */
+eb_status_t eb_context_open(const char* root, eb_context_t** out);
+
+/* Close a context; no other thread may still be using it */
+void eb_context_close(eb_context_t* ctx);
+
+/* Repository root of a context, valid until it is closed */
+const char* eb_context_root(const eb_context_t* ctx);
+
+/**
+ * Get the store of a context, opened on first use
+ *
+ * @param ctx Context
+ * @param out Receives the store, owned by the context
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_context_store(eb_context_t* ctx, eb_store_t** out);
+
+/**
+ * Start a batch in the repository of a context
+ *
+ * A batch belongs to the thread that started it; commit it with
+ * eb_context_batch_commit().
+ *
+ * @param ctx Context
+ * @param out Receives the batch
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_context_batch_begin(eb_context_t* ctx, eb_store_batch_t** out);
+
+/**
+ * Commit a batch started with eb_context_batch_begin()
+ *
+ * Commits through one context run one at a time; objects are written by
+ * eb_store_batch_add() and do not wait.
+ *
+ * @param ctx Context
+ * @param batch Batch to commit, freed even on failure
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_context_batch_commit(eb_context_t* ctx, eb_store_batch_t* batch);
+
+#endif /* EB_CONTEXT_H */
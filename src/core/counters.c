@@ -0,0 +1,186 @@
+/*
+ * EmbeddingBridge - Runtime Counters Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "counters.h"
+
+/* Written only by its thread, read by snapshots */
+typedef struct counter_block {
+    uint64_t values[EB_COUNTER_COUNT];
+    struct counter_block* next;
+} counter_block_t;
+
+static const struct {
+    const char* name;
+    const char* help;
+} COUNTERS[EB_COUNTER_COUNT] = {
+    [EB_COUNTER_OBJECTS_READ] = { "objects_read", "Objects read from the store" },
+    [EB_COUNTER_OBJECTS_WRITTEN] = { "objects_written", "Objects written to the store" },
+    [EB_COUNTER_COMPRESS_IN_BYTES] = { "compress_in_bytes", "Bytes given to zstd compression" },
+    [EB_COUNTER_COMPRESS_OUT_BYTES] = { "compress_out_bytes", "Bytes zstd compression produced" },
+    [EB_COUNTER_COMPRESS_NS] = { "compress_ns", "Nanoseconds spent compressing" },
+    [EB_COUNTER_DECOMPRESS_IN_BYTES] = { "decompress_in_bytes", "Compressed bytes given to zstd" },
+    [EB_COUNTER_DECOMPRESS_OUT_BYTES] = { "decompress_out_bytes", "Bytes zstd decompression produced" },
+    [EB_COUNTER_DECOMPRESS_NS] = { "decompress_ns", "Nanoseconds spent decompressing" },
+    [EB_COUNTER_HASH_BYTES] = { "hash_bytes", "Object bytes hashed" },
+    [EB_COUNTER_HASH_NS] = { "hash_ns", "Nanoseconds spent hashing objects" },
+    [EB_COUNTER_INDEX_LOOKUPS] = { "index_lookups", "Object hash prefixes resolved" },
+    [EB_COUNTER_LOG_LOOKUPS] = { "log_lookups", "Log queries by source or range" },
+    [EB_COUNTER_REMOTE_REQUESTS] = { "remote_requests", "Requests made to remotes" },
+    [EB_COUNTER_REMOTE_RETRIES] = { "remote_retries", "Remote sends retried after a failure" },
+    [EB_COUNTER_LOCAL_IN_BYTES] = { "local_in_bytes", "Bytes received from local remotes" },
+    [EB_COUNTER_LOCAL_OUT_BYTES] = { "local_out_bytes", "Bytes sent to local remotes" },
+    [EB_COUNTER_SSH_IN_BYTES] = { "ssh_in_bytes", "Bytes received from ssh remotes" },
+    [EB_COUNTER_SSH_OUT_BYTES] = { "ssh_out_bytes", "Bytes sent to ssh remotes" },
+    [EB_COUNTER_HTTP_IN_BYTES] = { "http_in_bytes", "Bytes received from HTTP remotes" },
+    [EB_COUNTER_HTTP_OUT_BYTES] = { "http_out_bytes", "Bytes sent to HTTP remotes" },
+    [EB_COUNTER_S3_IN_BYTES] = { "s3_in_bytes", "Bytes received from S3 remotes" },
+    [EB_COUNTER_S3_OUT_BYTES] = { "s3_out_bytes", "Bytes sent to S3 remotes" },
+    [EB_COUNTER_STAT_CACHE_HITS] = { "stat_cache_hits", "Source hashes reused from the stat cache" },
+    [EB_COUNTER_STAT_CACHE_MISSES] = { "stat_cache_misses", "Source files hashed again" },
+    [EB_COUNTER_REMOTE_CACHE_HITS] = { "remote_cache_hits", "Remote objects found in the local cache" },
+    [EB_COUNTER_REMOTE_CACHE_MISSES] = { "remote_cache_misses", "Remote objects not in the local cache" },
+    [EB_COUNTER_PREFETCH_FETCHES] = { "prefetch_fetches", "Remote objects fetched ahead of a walk" },
+    [EB_COUNTER_PREFETCH_STALLS] = { "prefetch_stalls", "Walk steps that waited on a remote fetch" },
+};
+
+/* Caches whose hit rate the text report shows */
+static const struct {
+    const char* name;
+    eb_counter_t hits;
+    eb_counter_t misses;
+} CACHES[] = {
+    { "stat_cache", EB_COUNTER_STAT_CACHE_HITS, EB_COUNTER_STAT_CACHE_MISSES },
+    { "remote_cache", EB_COUNTER_REMOTE_CACHE_HITS, EB_COUNTER_REMOTE_CACHE_MISSES },
+};
+
+static pthread_once_t counters_once = PTHREAD_ONCE_INIT;
+static pthread_key_t block_key;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static counter_block_t* blocks;
+/* Exited threads, merged values and adds that found no block */
+static uint64_t retired[EB_COUNTER_COUNT];
+static __thread counter_block_t* thread_block;
+static __thread bool thread_block_failed;
+
+/* A thread that exits folds its block into the retired totals */
+static void block_retire(void* arg) {
+    counter_block_t* block = arg;
+    pthread_mutex_lock(&blocks_lock);
+    for (counter_block_t** p = &blocks; *p; p = &(*p)->next) {
+        if (*p == block) {
+            *p = block->next;
+            break;
+        }
+    }
+    for (int i = 0; i < EB_COUNTER_COUNT; i++)
+        __atomic_fetch_add(&retired[i], block->values[i], __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&blocks_lock);
+    free(block);
+}
+
+/* A fork while another thread holds the lock must not leave it held */
+static void fork_prepare(void) {
+    pthread_mutex_lock(&blocks_lock);
+}
+
+static void fork_done(void) {
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+static void counters_init(void) {
+    pthread_key_create(&block_key, block_retire);
+    pthread_atfork(fork_prepare, fork_done, fork_done);
+}
+
+static counter_block_t* block_open(void) {
+    if (thread_block_failed)
+        return NULL;
+    pthread_once(&counters_once, counters_init);
+    counter_block_t* block = calloc(1, sizeof(*block));
+    if (!block || pthread_setspecific(block_key, block) != 0) {
+        free(block);
+        thread_block_failed = true;
+        return NULL;
+    }
+    pthread_mutex_lock(&blocks_lock);
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&blocks_lock);
+    return thread_block = block;
+}
+
+void eb_counter_add(eb_counter_t counter, uint64_t n) {
+    if ((unsigned)counter >= EB_COUNTER_COUNT || n == 0)
+        return;
+    counter_block_t* block = thread_block ? thread_block : block_open();
+    if (!block) {
+        __atomic_fetch_add(&retired[counter], n, __ATOMIC_RELAXED);
+        return;
+    }
+    /* Only this thread writes the block, so a plain add published atomically will do */
+    uint64_t* value = &block->values[counter];
+    __atomic_store_n(value, *value + n, __ATOMIC_RELAXED);
+}
+
+uint64_t eb_counter_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void eb_counters_snapshot(uint64_t out[EB_COUNTER_COUNT]) {
+    pthread_mutex_lock(&blocks_lock);
+    for (int i = 0; i < EB_COUNTER_COUNT; i++)
+        out[i] = __atomic_load_n(&retired[i], __ATOMIC_RELAXED);
+    for (const counter_block_t* block = blocks; block; block = block->next) {
+        for (int i = 0; i < EB_COUNTER_COUNT; i++)
+            out[i] += __atomic_load_n(&block->values[i], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+void eb_counters_merge(const uint64_t values[EB_COUNTER_COUNT]) {
+    for (int i = 0; i < EB_COUNTER_COUNT; i++)
+        __atomic_fetch_add(&retired[i], values[i], __ATOMIC_RELAXED);
+}
+
+const char* eb_counter_name(eb_counter_t counter) {
+    return (unsigned)counter < EB_COUNTER_COUNT ? COUNTERS[counter].name : NULL;
+}
+
+const char* eb_counter_help(eb_counter_t counter) {
+    return (unsigned)counter < EB_COUNTER_COUNT ? COUNTERS[counter].help : NULL;
+}
+
+void eb_counters_print(FILE* out, const uint64_t values[EB_COUNTER_COUNT], bool json) {
+    if (json) {
+        fputc('{', out);
+        for (int i = 0; i < EB_COUNTER_COUNT; i++)
+            fprintf(out, "%s\"%s\":%llu", i ? "," : "", COUNTERS[i].name,
+                    (unsigned long long)values[i]);
+        fputs("}\n", out);
+        return;
+    }
+
+    for (int i = 0; i < EB_COUNTER_COUNT; i++)
+        fprintf(out, "%-22s %llu\n", COUNTERS[i].name, (unsigned long long)values[i]);
+    for (size_t i = 0; i < sizeof(CACHES) / sizeof(CACHES[0]); i++) {
+        uint64_t hits = values[CACHES[i].hits];
+        uint64_t lookups = hits + values[CACHES[i].misses];
+        if (!lookups)
+            continue;
+        char label[64];
+        snprintf(label, sizeof(label), "%s_hit_rate", CACHES[i].name);
+        fprintf(out, "%-22s %.1f%%\n", label, 100.0 * (double)hits / (double)lookups);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * EmbeddingBridge - Runtime Counters
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_COUNTERS_H
+#define EB_COUNTERS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Always-on counters of objects, compression, hashing, index lookups,
+ * remote traffic and cache hits. Every thread adds to a block of its own
+ * without locks or atomic read-modify-writes; eb_counters_snapshot() sums
+ * the blocks of running threads with what exited threads left behind.
+ * Counters only grow, so rates are differences of two snapshots.
+ */
+
+typedef enum {
+    EB_COUNTER_OBJECTS_READ,
+    EB_COUNTER_OBJECTS_WRITTEN,
+    EB_COUNTER_COMPRESS_IN_BYTES,       /* Before zstd compression */
+    EB_COUNTER_COMPRESS_OUT_BYTES,      /* After it */
+    EB_COUNTER_COMPRESS_NS,
+    EB_COUNTER_DECOMPRESS_IN_BYTES,     /* Compressed bytes read back */
+    EB_COUNTER_DECOMPRESS_OUT_BYTES,
+    EB_COUNTER_DECOMPRESS_NS,
+    EB_COUNTER_HASH_BYTES,
+    EB_COUNTER_HASH_NS,
+    EB_COUNTER_INDEX_LOOKUPS,           /* Hash prefix resolutions */
+    EB_COUNTER_LOG_LOOKUPS,             /* Log queries by source or range */
+    EB_COUNTER_REMOTE_REQUESTS,
+    EB_COUNTER_REMOTE_RETRIES,
+    /* Bytes in and out per transport, in the order of enum transport_type */
+    EB_COUNTER_LOCAL_IN_BYTES,
+    EB_COUNTER_LOCAL_OUT_BYTES,
+    EB_COUNTER_SSH_IN_BYTES,
+    EB_COUNTER_SSH_OUT_BYTES,
+    EB_COUNTER_HTTP_IN_BYTES,
+    EB_COUNTER_HTTP_OUT_BYTES,
+    EB_COUNTER_S3_IN_BYTES,
+    EB_COUNTER_S3_OUT_BYTES,
+    EB_COUNTER_STAT_CACHE_HITS,         /* Source hashes reused by stat */
+    EB_COUNTER_STAT_CACHE_MISSES,
+    EB_COUNTER_REMOTE_CACHE_HITS,       /* Remote objects served from .embr/cache */
+    EB_COUNTER_REMOTE_CACHE_MISSES,
+    EB_COUNTER_PREFETCH_FETCHES,        /* Remote objects fetched ahead of a walk */
+    EB_COUNTER_PREFETCH_STALLS,         /* Walk steps left waiting on a fetch */
+    EB_COUNTER_COUNT
+} eb_counter_t;
+
+/* Add n to a counter of the calling thread */
+void eb_counter_add(eb_counter_t counter, uint64_t n);
+
+/* Monotonic nanoseconds, for the *_NS counters */
+uint64_t eb_counter_clock(void);
+
+/* Add the nanoseconds since start, a value of eb_counter_clock() */
+static inline void eb_counter_add_since(eb_counter_t counter, uint64_t start) {
+    eb_counter_add(counter, eb_counter_clock() - start);
+}
+
+/**
+ * Sum every thread's counters
+ *
+ * Adds made while it runs may be left out of this snapshot, never lost.
+ *
+ * @param out Receives EB_COUNTER_COUNT values, indexed by eb_counter_t
+ */
+void eb_counters_snapshot(uint64_t out[EB_COUNTER_COUNT]);
+
+/**
+ * Add values counted elsewhere, such as by a forked child
+ *
+ * @param values EB_COUNTER_COUNT values, indexed by eb_counter_t
+ */
+void eb_counters_merge(const uint64_t values[EB_COUNTER_COUNT]);
+
+/* Snake-case name of a counter ("objects_read"), NULL past the last one */
+const char* eb_counter_name(eb_counter_t counter);
+
+/* One-line description of a counter, for help text and exporters */
+const char* eb_counter_help(eb_counter_t counter);
+
+/**
+ * Print a snapshot
+ *
+ * As text: one "name value" line per counter, then the hit rate of each
+ * cache that was used. As JSON: one object of name: value.
+ *
+ * @param out Stream to print to
+ * @param values Snapshot from eb_counters_snapshot()
+ * @param json Print JSON instead of text
+ */
+void eb_counters_print(FILE* out, const uint64_t values[EB_COUNTER_COUNT], bool json);
+
+#endif /* EB_COUNTERS_H */
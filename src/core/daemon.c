@@ -0,0 +1,520 @@
+/*
+ * EmbeddingBridge - Local Command Daemon Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE /* For accept4, pipe2 and struct ucred */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#include "daemon.h"
+#include "serve.h"
+#include "debug.h"
+#include "error.h"
+#include "counters.h"
+
+#define DAEMON_MAX_JOBS 64
+#define DAEMON_MAX_ARGS (1024 * 1024)
+#define DAEMON_REQUEST_TIMEOUT_SECONDS 5
+#define DAEMON_STDIO_FDS 3
+
+typedef struct {
+    pid_t pid;
+    int conn;
+    int counters_fd;               /* Read end of the pipe the child reports its counters on */
+    bool hung_up;                  /* The client went away, the command was interrupted */
+} daemon_job_t;
+
+typedef struct {
+    const char* root;
+    const eb_daemon_ops_t* ops;
+    int listen_fd;
+    daemon_job_t jobs[DAEMON_MAX_JOBS];
+    size_t job_count;
+} daemon_t;
+
+/* Signals only write to this pipe; the loop polls its read end */
+static int wake_pipe[2] = {-1, -1};
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig) {
+    int saved = errno;
+    if (sig == SIGINT || sig == SIGTERM)
+        stop_requested = 1;
+    if (write(wake_pipe[1], "x", 1) < 0) {
+        /* The pipe is full, the loop is awake anyway */
+    }
+    errno = saved;
+}
+
+static eb_status_t socket_address(const char* root, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    int n = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/%s", root, EB_DAEMON_SOCKET);
+    return n < 0 || (size_t)n >= sizeof(addr->sun_path) ? EB_ERROR_PATH_TOO_LONG : EB_SUCCESS;
+}
+
+static int connect_socket(const struct sockaddr_un* addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Bind the socket, replacing one left behind by a daemon that died */
+static eb_status_t listen_socket(const char* root, int* out) {
+    struct sockaddr_un addr;
+    eb_status_t status = socket_address(root, &addr);
+    if (status != EB_SUCCESS)
+        return status;
+
+    int probe = connect_socket(&addr);
+    if (probe >= 0) {
+        close(probe);
+        return EB_ERROR_ALREADY_EXISTS;
+    }
+    unlink(addr.sun_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return EB_ERROR_IO;
+    mode_t mask = umask(077);
+    int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (bound != 0 || listen(fd, 16) != 0) {
+        DEBUG_ERROR("Cannot listen on %s: %s", addr.sun_path, strerror(errno));
+        close(fd);
+        return EB_ERROR_IO;
+    }
+    *out = fd;
+    return EB_SUCCESS;
+}
+
+static bool same_user(int conn) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+        return false;
+    return cred.uid == getuid();
+#else
+    /* The socket is created 0600, which already keeps other users out */
+    (void)conn;
+    return true;
+#endif
+}
+
+/* Read a frame header and the descriptors sent along with it */
+static eb_status_t receive_header(int conn, eb_serve_frame_t* frame, int fds[DAEMON_STDIO_FDS],
+                                  size_t* fd_count) {
+    unsigned char header[EB_SERVE_HEADER_SIZE];
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * DAEMON_STDIO_FDS)];
+    } control;
+    struct iovec iov = { header, sizeof(header) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t got;
+    do {
+        got = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0)
+        return EB_ERROR_CONNECTION_CLOSED;
+
+    *fd_count = 0;
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (*fd_count < DAEMON_STDIO_FDS)
+                fds[(*fd_count)++] = fd;
+            else
+                close(fd);
+        }
+    }
+
+    eb_status_t status = EB_SUCCESS;
+    if ((size_t)got < sizeof(header))
+        status = eb_serve_read_all(conn, header + got, sizeof(header) - (size_t)got);
+    if (status != EB_SUCCESS)
+        return status;
+    frame->type = header[0];
+    frame->id = eb_serve_get_u32(header + 1);
+    frame->key_length = eb_serve_get_u32(header + 5);
+    frame->body_length = eb_serve_get_u64(header + 9);
+    return EB_SUCCESS;
+}
+
+static void close_fds(int* fds, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        close(fds[i]);
+}
+
+/* Split the NUL-terminated arguments of a RUN body */
+static char** split_args(char* body, size_t size, int* argc_out) {
+    int argc = 0;
+    for (size_t i = 0; i < size; i++)
+        argc += body[i] == '\0';
+    char** argv = calloc((size_t)argc + 1, sizeof(char*));
+    if (!argv)
+        return NULL;
+    char* p = body;
+    for (int i = 0; i < argc; i++) {
+        argv[i] = p;
+        p += strlen(p) + 1;
+    }
+    *argc_out = argc;
+    return argv;
+}
+
+/* In the child: what it counted, written for the daemon to add to its own */
+static int report_fd = -1;
+static uint64_t report_base[EB_COUNTER_COUNT];
+
+static void report_counters(void) {
+    if (report_fd < 0)
+        return;
+    uint64_t values[EB_COUNTER_COUNT];
+    eb_counters_snapshot(values);
+    for (int i = 0; i < EB_COUNTER_COUNT; i++)
+        values[i] -= report_base[i];
+    if (write(report_fd, values, sizeof(values)) != (ssize_t)sizeof(values))
+        DEBUG_WARN("Cannot report counters to the daemon: %s", strerror(errno));
+    close(report_fd);
+}
+
+/* In the forked child: take over the client's descriptors and run */
+static void run_child(daemon_t* d, int conn, int fds[DAEMON_STDIO_FDS], int counters_fd,
+                      const char* cwd, char* body, size_t body_size) {
+    /* The daemon's totals carry over into `embr stats`, only the rest is reported */
+    report_fd = counters_fd;
+    eb_counters_snapshot(report_base);
+    atexit(report_counters);
+
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    close(d->listen_fd);
+    close(conn);
+    for (size_t i = 0; i < d->job_count; i++) {
+        close(d->jobs[i].conn);
+        close(d->jobs[i].counters_fd);
+    }
+
+    for (int i = 0; i < DAEMON_STDIO_FDS; i++) {
+        if (dup2(fds[i], i) < 0)
+            _exit(127);
+    }
+    close_fds(fds, DAEMON_STDIO_FDS);
+
+    if (chdir(cwd) != 0) {
+        fprintf(stderr, "embr: cannot change to %s: %s\n", cwd, strerror(errno));
+        exit(1);
+    }
+    int argc;
+    char** argv = split_args(body, body_size, &argc);
+    if (!argv || argc == 0) {
+        fprintf(stderr, "embr: daemon received no command\n");
+        exit(1);
+    }
+    exit(d->ops->run(argc, argv, d->ops->ctx));
+}
+
+/* Take one request from a new connection and start its command */
+static void accept_request(daemon_t* d) {
+    int conn = accept4(d->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn < 0)
+        return;
+
+    struct timeval timeout = { DAEMON_REQUEST_TIMEOUT_SECONDS, 0 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (!same_user(conn)) {
+        DEBUG_WARN("Refused a daemon connection from another user");
+        close(conn);
+        return;
+    }
+
+    int fds[DAEMON_STDIO_FDS];
+    size_t fd_count = 0;
+    eb_serve_frame_t frame;
+    char* cwd = NULL;
+    char* body = NULL;
+    eb_status_t status = eb_serve_write_frame(conn, EB_SERVE_HELLO, 0, EB_SERVE_GREETING,
+                                              strlen(EB_SERVE_GREETING), NULL, 0);
+    if (status == EB_SUCCESS)
+        status = receive_header(conn, &frame, fds, &fd_count);
+    if (status == EB_SUCCESS &&
+        (frame.type != EB_SERVE_RUN || fd_count != DAEMON_STDIO_FDS || frame.key_length == 0 ||
+         frame.key_length > EB_SERVE_MAX_KEY || frame.body_length == 0 ||
+         frame.body_length > DAEMON_MAX_ARGS))
+        status = EB_ERROR_INVALID_FORMAT;
+    if (status == EB_SUCCESS) {
+        cwd = calloc(1, frame.key_length + 1);
+        body = malloc(frame.body_length);
+        status = cwd && body ? eb_serve_read_all(conn, cwd, frame.key_length)
+                             : EB_ERROR_MEMORY_ALLOCATION;
+    }
+    if (status == EB_SUCCESS)
+        status = eb_serve_read_all(conn, body, frame.body_length);
+    if (status == EB_SUCCESS && body[frame.body_length - 1] != '\0')
+        status = EB_ERROR_INVALID_FORMAT;
+
+    if (status == EB_SUCCESS) {
+        if (d->ops->refresh)
+            d->ops->refresh(d->root, d->ops->ctx);
+        fflush(NULL);
+        int counters[2] = {-1, -1};
+        if (pipe2(counters, O_CLOEXEC) != 0)
+            DEBUG_WARN("Cannot count a daemon request: %s", strerror(errno));
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(counters[0]);
+            run_child(d, conn, fds, counters[1], cwd, body, frame.body_length);
+        }
+        close(counters[1]);
+        if (pid > 0) {
+            d->jobs[d->job_count++] = (daemon_job_t){ pid, conn, counters[0], false };
+            conn = -1;
+        } else {
+            close(counters[0]);
+            DEBUG_ERROR("Cannot fork for a daemon request: %s", strerror(errno));
+        }
+    } else {
+        DEBUG_WARN("Dropped a daemon request: %s", eb_status_str(status));
+    }
+
+    close_fds(fds, fd_count);
+    free(cwd);
+    free(body);
+    if (conn >= 0)
+        close(conn);
+}
+
+/* Add what an ended child counted; one killed by a signal reported nothing */
+static void merge_counters(int fd) {
+    if (fd < 0)
+        return;
+    uint64_t values[EB_COUNTER_COUNT];
+    if (read(fd, values, sizeof(values)) == (ssize_t)sizeof(values))
+        eb_counters_merge(values);
+    close(fd);
+}
+
+/* Answer the requests whose commands have ended */
+static void reap_children(daemon_t* d) {
+    int wstatus;
+    pid_t pid;
+    while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+        for (size_t i = 0; i < d->job_count; i++) {
+            if (d->jobs[i].pid != pid)
+                continue;
+            int code = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+            unsigned char body[4];
+            eb_serve_put_u32(body, (uint32_t)code);
+            eb_serve_write_frame(d->jobs[i].conn, EB_SERVE_DONE, 1, NULL, 0, body, sizeof(body));
+            close(d->jobs[i].conn);
+            merge_counters(d->jobs[i].counters_fd);
+            d->jobs[i] = d->jobs[--d->job_count];
+            break;
+        }
+    }
+}
+
+static void drain_wake_pipe(void) {
+    char buf[64];
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
+eb_status_t eb_daemon_serve(const char* root, const eb_daemon_ops_t* ops) {
+    if (!root || !ops || !ops->run)
+        return EB_ERROR_INVALID_INPUT;
+    if (chdir(root) != 0)
+        return EB_ERROR_NOT_FOUND;
+
+    daemon_t d = { .root = root, .ops = ops, .listen_fd = -1 };
+    eb_status_t status = listen_socket(root, &d.listen_fd);
+    if (status != EB_SUCCESS)
+        return status;
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        close(d.listen_fd);
+        return EB_ERROR_IO;
+    }
+    setenv(EB_DAEMON_DISABLE_ENV, "1", 1);
+    if (ops->refresh)
+        ops->refresh(root, ops->ctx);
+
+    struct sigaction sa = {0}, old_chld, old_int, old_term;
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, &old_chld);
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    stop_requested = 0;
+
+    struct pollfd fds[DAEMON_MAX_JOBS + 2];
+    while (!stop_requested || d.job_count > 0) {
+        size_t n = 0;
+        fds[n++] = (struct pollfd){ wake_pipe[0], POLLIN, 0 };
+        bool listening = !stop_requested && d.job_count < DAEMON_MAX_JOBS;
+        if (listening)
+            fds[n++] = (struct pollfd){ d.listen_fd, POLLIN, 0 };
+        size_t first_job = n;
+        for (size_t i = 0; i < d.job_count; i++)
+            fds[n++] = (struct pollfd){ d.jobs[i].hung_up ? -1 : d.jobs[i].conn, POLLIN, 0 };
+
+        if (poll(fds, n, -1) < 0 && errno != EINTR)
+            break;
+
+        if (fds[0].revents)
+            drain_wake_pipe();
+        reap_children(&d);
+
+        /* Clients send nothing after RUN, so a readable socket has hung up */
+        for (size_t i = first_job; i < n; i++) {
+            size_t job = i - first_job;
+            if (fds[i].revents && job < d.job_count && d.jobs[job].conn == fds[i].fd) {
+                kill(d.jobs[job].pid, SIGINT);
+                d.jobs[job].hung_up = true;
+            }
+        }
+        if (listening && (fds[1].revents & POLLIN))
+            accept_request(&d);
+    }
+
+    struct sockaddr_un addr;
+    if (socket_address(root, &addr) == EB_SUCCESS)
+        unlink(addr.sun_path);
+    close(d.listen_fd);
+    sigaction(SIGCHLD, &old_chld, NULL);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    wake_pipe[0] = wake_pipe[1] = -1;
+    return EB_SUCCESS;
+}
+
+/* Send the RUN header with this process's stdin, stdout and stderr attached */
+static eb_status_t send_run_header(int fd, const eb_serve_frame_t* frame) {
+    unsigned char header[EB_SERVE_HEADER_SIZE];
+    header[0] = frame->type;
+    eb_serve_put_u32(header + 1, frame->id);
+    eb_serve_put_u32(header + 5, frame->key_length);
+    eb_serve_put_u64(header + 9, frame->body_length);
+
+    int stdio[DAEMON_STDIO_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(stdio))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { header, sizeof(header) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(stdio));
+    memcpy(CMSG_DATA(c), stdio, sizeof(stdio));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0)
+        return EB_ERROR_CONNECTION_CLOSED;
+    if ((size_t)sent < sizeof(header))
+        return eb_serve_write_all(fd, header + sent, sizeof(header) - (size_t)sent);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_daemon_forward(const char* root, int argc, char** argv, int* exit_code) {
+    if (!root || argc < 1 || !argv || !exit_code)
+        return EB_ERROR_INVALID_INPUT;
+
+    struct sockaddr_un addr;
+    if (socket_address(root, &addr) != EB_SUCCESS)
+        return EB_ERROR_NOT_CONNECTED;
+    int fd = connect_socket(&addr);
+    if (fd < 0)
+        return EB_ERROR_NOT_CONNECTED;
+
+    /* Until the whole request is sent the daemon has not run anything */
+    eb_status_t status = EB_ERROR_NOT_CONNECTED;
+    eb_serve_frame_t hello;
+    char greeting[sizeof(EB_SERVE_GREETING)];
+    char cwd[EB_SERVE_MAX_KEY];
+    size_t body_size = 0;
+    for (int i = 0; i < argc; i++)
+        body_size += strlen(argv[i]) + 1;
+    char* body = malloc(body_size);
+
+    if (body && getcwd(cwd, sizeof(cwd)) &&
+        eb_serve_read_header(fd, &hello) == EB_SUCCESS && hello.type == EB_SERVE_HELLO &&
+        hello.key_length == strlen(EB_SERVE_GREETING) &&
+        eb_serve_read_all(fd, greeting, hello.key_length) == EB_SUCCESS &&
+        memcmp(greeting, EB_SERVE_GREETING, hello.key_length) == 0) {
+        char* p = body;
+        for (int i = 0; i < argc; i++) {
+            size_t len = strlen(argv[i]) + 1;
+            memcpy(p, argv[i], len);
+            p += len;
+        }
+        eb_serve_frame_t run = { EB_SERVE_RUN, 1, (uint32_t)strlen(cwd), body_size };
+        if (send_run_header(fd, &run) == EB_SUCCESS &&
+            eb_serve_write_all(fd, cwd, run.key_length) == EB_SUCCESS &&
+            eb_serve_write_all(fd, body, body_size) == EB_SUCCESS) {
+            eb_serve_frame_t done;
+            unsigned char code[4];
+            status = EB_ERROR_CONNECTION_CLOSED;
+            if (eb_serve_read_header(fd, &done) == EB_SUCCESS && done.type == EB_SERVE_DONE &&
+                done.key_length == 0 && done.body_length == sizeof(code) &&
+                eb_serve_read_all(fd, code, sizeof(code)) == EB_SUCCESS) {
+                *exit_code = (int)eb_serve_get_u32(code);
+                status = EB_SUCCESS;
+            }
+        }
+    }
+
+    free(body);
+    close(fd);
+    return status;
+}
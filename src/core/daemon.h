@@ -0,0 +1,76 @@
+/*
+ * EmbeddingBridge - Local Command Daemon
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_DAEMON_H
+#define EB_DAEMON_H
+
+#include "status.h"
+
+/*
+ * `embr serve --daemon` keeps one process per repository with the remote
+ * configuration, transformers and model registry loaded, listening on
+ * EB_DAEMON_SOCKET. The CLI hands it commands instead of starting cold:
+ *
+ *   client: connects, reads HELLO, sends RUN with its stdin, stdout and
+ *           stderr attached as SCM_RIGHTS (key: cwd, body: argv, each
+ *           argument NUL-terminated)
+ *   daemon: forks; the child takes over the three descriptors, changes
+ *           to the cwd and runs the command from the warm state
+ *   daemon: answers DONE with the exit code as an i32 once the child ends
+ *
+ * Output goes straight to the client's descriptors, so terminals, pipes
+ * and redirections behave as for a local run. A client that hangs up
+ * has its command interrupted. Only processes of the daemon's own user
+ * are served. A child that exits reports what it added to the runtime
+ * counters (counters.h) over a pipe, so the daemon's counters total every
+ * command it served.
+ */
+
+#define EB_DAEMON_SOCKET ".embr/serve.sock"
+
+/* Set in the environment of the daemon so its commands never forward */
+#define EB_DAEMON_DISABLE_ENV "EMBR_NO_DAEMON"
+
+typedef struct {
+    /* Called in the daemon at startup and before each request, to load
+     * state and reload what changed since */
+    void (*refresh)(const char* root, void* ctx);
+    /* Called in the forked child; its return value is the exit code */
+    int (*run)(int argc, char** argv, void* ctx);
+    void* ctx;
+} eb_daemon_ops_t;
+
+/**
+ * Serve commands for a repository until SIGINT or SIGTERM
+ *
+ * Changes to root first. Commands still running when stopped are waited
+ * for and answered.
+ *
+ * @param root Repository root
+ * @param ops Request callbacks
+ * @return Status code (EB_ERROR_ALREADY_EXISTS if a daemon already
+ *         serves root, EB_ERROR_PATH_TOO_LONG if the socket path does
+ *         not fit a socket address)
+ */
+eb_status_t eb_daemon_serve(const char* root, const eb_daemon_ops_t* ops);
+
+/**
+ * Run a command through the daemon of a repository
+ *
+ * @param root Repository root
+ * @param argc Number of arguments, the command name first
+ * @param argv Arguments
+ * @param exit_code Receives the exit code of the command
+ * @return Status code (EB_ERROR_NOT_CONNECTED if no daemon answers; the
+ *         command has not run then)
+ */
+eb_status_t eb_daemon_forward(const char* root, int argc, char** argv, int* exit_code);
+
+#endif /* EB_DAEMON_H */
@@ -0,0 +1,835 @@
+/*
+ * EmbeddingBridge - Vector Distance Kernels Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include "distance.h"
+#include "debug.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define EB_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define EB_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Exact integer sums over int8 vectors, scaled afterwards */
+typedef struct {
+    int64_t dot;
+    int64_t norm_a;
+    int64_t norm_b;
+} i8_terms_t;
+
+typedef struct {
+    float (*dot)(const float* a, const float* b, size_t n);
+    float (*l2_squared)(const float* a, const float* b, size_t n);
+    eb_cosine_terms_t (*cosine_terms)(const float* a, const float* b, size_t n);
+    eb_cosine_terms_t (*cosine_terms_f16)(const uint16_t* a, const uint16_t* b, size_t n);
+    float (*l2_squared_f16)(const uint16_t* a, const uint16_t* b, size_t n);
+    eb_cosine_terms_t (*cosine_terms_bf16)(const uint16_t* a, const uint16_t* b, size_t n);
+    float (*l2_squared_bf16)(const uint16_t* a, const uint16_t* b, size_t n);
+    i8_terms_t (*terms_i8)(const int8_t* a, const int8_t* b, size_t n);
+    int64_t (*dot_i8)(const int8_t* a, const int8_t* b, size_t n);
+    uint64_t (*hamming)(const uint64_t* a, const uint64_t* b, size_t words);
+} kernel_ops_t;
+
+/* Scalar kernels: double accumulation, the reference for the others */
+
+static float dot_scalar(const float* a, const float* b, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+        sum += (double)a[i] * (double)b[i];
+    return (float)sum;
+}
+
+static float l2_squared_scalar(const float* a, const float* b, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double diff = (double)a[i] - (double)b[i];
+        sum += diff * diff;
+    }
+    return (float)sum;
+}
+
+static eb_cosine_terms_t cosine_terms_scalar(const float* a, const float* b, size_t n) {
+    double dot = 0.0, norm_a = 0.0, norm_b = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        dot += (double)a[i] * (double)b[i];
+        norm_a += (double)a[i] * (double)a[i];
+        norm_b += (double)b[i] * (double)b[i];
+    }
+    eb_cosine_terms_t terms = { (float)dot, (float)norm_a, (float)norm_b };
+    return terms;
+}
+
+static eb_cosine_terms_t cosine_terms_half_scalar(const uint16_t* a, const uint16_t* b, size_t n,
+                                                  float (*widen)(uint16_t)) {
+    double dot = 0.0, norm_a = 0.0, norm_b = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double x = widen(a[i]), y = widen(b[i]);
+        dot += x * y;
+        norm_a += x * x;
+        norm_b += y * y;
+    }
+    eb_cosine_terms_t terms = { (float)dot, (float)norm_a, (float)norm_b };
+    return terms;
+}
+
+static float l2_squared_half_scalar(const uint16_t* a, const uint16_t* b, size_t n,
+                                    float (*widen)(uint16_t)) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double diff = (double)widen(a[i]) - (double)widen(b[i]);
+        sum += diff * diff;
+    }
+    return (float)sum;
+}
+
+static eb_cosine_terms_t cosine_terms_f16_scalar(const uint16_t* a, const uint16_t* b, size_t n) {
+    return cosine_terms_half_scalar(a, b, n, eb_fp16_to_float);
+}
+
+static float l2_squared_f16_scalar(const uint16_t* a, const uint16_t* b, size_t n) {
+    return l2_squared_half_scalar(a, b, n, eb_fp16_to_float);
+}
+
+static eb_cosine_terms_t cosine_terms_bf16_scalar(const uint16_t* a, const uint16_t* b, size_t n) {
+    return cosine_terms_half_scalar(a, b, n, eb_bf16_to_float);
+}
+
+static float l2_squared_bf16_scalar(const uint16_t* a, const uint16_t* b, size_t n) {
+    return l2_squared_half_scalar(a, b, n, eb_bf16_to_float);
+}
+
+static i8_terms_t terms_i8_scalar(const int8_t* a, const int8_t* b, size_t n) {
+    i8_terms_t terms = { 0, 0, 0 };
+    for (size_t i = 0; i < n; i++) {
+        terms.dot += a[i] * b[i];
+        terms.norm_a += a[i] * a[i];
+        terms.norm_b += b[i] * b[i];
+    }
+    return terms;
+}
+
+static int64_t dot_i8_scalar(const int8_t* a, const int8_t* b, size_t n) {
+    int64_t dot = 0;
+    for (size_t i = 0; i < n; i++)
+        dot += a[i] * b[i];
+    return dot;
+}
+
+static uint64_t hamming_scalar(const uint64_t* a, const uint64_t* b, size_t words) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < words; i++)
+        bits += (uint64_t)__builtin_popcountll(a[i] ^ b[i]);
+    return bits;
+}
+
+static const kernel_ops_t scalar_ops = {
+    dot_scalar, l2_squared_scalar, cosine_terms_scalar,
+    cosine_terms_f16_scalar, l2_squared_f16_scalar,
+    cosine_terms_bf16_scalar, l2_squared_bf16_scalar,
+    terms_i8_scalar, dot_i8_scalar, hamming_scalar
+};
+
+#ifdef EB_KERNELS_X86
+
+/* AVX2 + FMA: four 8-lane accumulators per sum hide the FMA latency */
+
+__attribute__((target("avx2,fma")))
+static float hsum_avx2(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= n; i += 8)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+
+    float sum = hsum_avx2(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static float l2_squared_avx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+        acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+    }
+
+    float sum = hsum_avx2(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < n; i++) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static eb_cosine_terms_t cosine_terms_avx2(const float* a, const float* b, size_t n) {
+    __m256 dot0 = _mm256_setzero_ps(), dot1 = _mm256_setzero_ps();
+    __m256 na0 = _mm256_setzero_ps(), na1 = _mm256_setzero_ps();
+    __m256 nb0 = _mm256_setzero_ps(), nb1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a0 = _mm256_loadu_ps(a + i), a1 = _mm256_loadu_ps(a + i + 8);
+        __m256 b0 = _mm256_loadu_ps(b + i), b1 = _mm256_loadu_ps(b + i + 8);
+        dot0 = _mm256_fmadd_ps(a0, b0, dot0);
+        dot1 = _mm256_fmadd_ps(a1, b1, dot1);
+        na0 = _mm256_fmadd_ps(a0, a0, na0);
+        na1 = _mm256_fmadd_ps(a1, a1, na1);
+        nb0 = _mm256_fmadd_ps(b0, b0, nb0);
+        nb1 = _mm256_fmadd_ps(b1, b1, nb1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 a0 = _mm256_loadu_ps(a + i), b0 = _mm256_loadu_ps(b + i);
+        dot0 = _mm256_fmadd_ps(a0, b0, dot0);
+        na0 = _mm256_fmadd_ps(a0, a0, na0);
+        nb0 = _mm256_fmadd_ps(b0, b0, nb0);
+    }
+
+    eb_cosine_terms_t terms = {
+        hsum_avx2(_mm256_add_ps(dot0, dot1)),
+        hsum_avx2(_mm256_add_ps(na0, na1)),
+        hsum_avx2(_mm256_add_ps(nb0, nb1))
+    };
+    for (; i < n; i++) {
+        terms.dot += a[i] * b[i];
+        terms.norm_a += a[i] * a[i];
+        terms.norm_b += b[i] * b[i];
+    }
+    return terms;
+}
+
+/*
+ * Reduced dtypes: float16 is widened with F16C, bfloat16 by shifting it
+ * into the upper half of a float32 lane
+ */
+
+__attribute__((target("avx2,fma,f16c"), always_inline))
+static inline __m256 load_half_avx2(const uint16_t* p, bool brain) {
+    __m128i halves = _mm_loadu_si128((const __m128i*)p);
+    if (brain)
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(halves), 16));
+    return _mm256_cvtph_ps(halves);
+}
+
+__attribute__((target("avx2,fma,f16c"), always_inline))
+static inline eb_cosine_terms_t cosine_terms_half_avx2(const uint16_t* a, const uint16_t* b,
+                                                       size_t n, bool brain) {
+    __m256 dot0 = _mm256_setzero_ps(), dot1 = _mm256_setzero_ps();
+    __m256 na0 = _mm256_setzero_ps(), na1 = _mm256_setzero_ps();
+    __m256 nb0 = _mm256_setzero_ps(), nb1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a0 = load_half_avx2(a + i, brain), a1 = load_half_avx2(a + i + 8, brain);
+        __m256 b0 = load_half_avx2(b + i, brain), b1 = load_half_avx2(b + i + 8, brain);
+        dot0 = _mm256_fmadd_ps(a0, b0, dot0);
+        dot1 = _mm256_fmadd_ps(a1, b1, dot1);
+        na0 = _mm256_fmadd_ps(a0, a0, na0);
+        na1 = _mm256_fmadd_ps(a1, a1, na1);
+        nb0 = _mm256_fmadd_ps(b0, b0, nb0);
+        nb1 = _mm256_fmadd_ps(b1, b1, nb1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 a0 = load_half_avx2(a + i, brain), b0 = load_half_avx2(b + i, brain);
+        dot0 = _mm256_fmadd_ps(a0, b0, dot0);
+        na0 = _mm256_fmadd_ps(a0, a0, na0);
+        nb0 = _mm256_fmadd_ps(b0, b0, nb0);
+    }
+
+    eb_cosine_terms_t terms = {
+        hsum_avx2(_mm256_add_ps(dot0, dot1)),
+        hsum_avx2(_mm256_add_ps(na0, na1)),
+        hsum_avx2(_mm256_add_ps(nb0, nb1))
+    };
+    for (; i < n; i++) {
+        float x = brain ? eb_bf16_to_float(a[i]) : eb_fp16_to_float(a[i]);
+        float y = brain ? eb_bf16_to_float(b[i]) : eb_fp16_to_float(b[i]);
+        terms.dot += x * y;
+        terms.norm_a += x * x;
+        terms.norm_b += y * y;
+    }
+    return terms;
+}
+
+__attribute__((target("avx2,fma,f16c"), always_inline))
+static inline float l2_squared_half_avx2(const uint16_t* a, const uint16_t* b,
+                                         size_t n, bool brain) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(load_half_avx2(a + i, brain), load_half_avx2(b + i, brain));
+        __m256 d1 = _mm256_sub_ps(load_half_avx2(a + i + 8, brain), load_half_avx2(b + i + 8, brain));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(load_half_avx2(a + i, brain), load_half_avx2(b + i, brain));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+    }
+
+    float sum = hsum_avx2(_mm256_add_ps(acc0, acc1));
+    for (; i < n; i++) {
+        float x = brain ? eb_bf16_to_float(a[i]) : eb_fp16_to_float(a[i]);
+        float y = brain ? eb_bf16_to_float(b[i]) : eb_fp16_to_float(b[i]);
+        sum += (x - y) * (x - y);
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static eb_cosine_terms_t cosine_terms_f16_avx2(const uint16_t* a, const uint16_t* b, size_t n) {
+    return cosine_terms_half_avx2(a, b, n, false);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float l2_squared_f16_avx2(const uint16_t* a, const uint16_t* b, size_t n) {
+    return l2_squared_half_avx2(a, b, n, false);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static eb_cosine_terms_t cosine_terms_bf16_avx2(const uint16_t* a, const uint16_t* b, size_t n) {
+    return cosine_terms_half_avx2(a, b, n, true);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float l2_squared_bf16_avx2(const uint16_t* a, const uint16_t* b, size_t n) {
+    return l2_squared_half_avx2(a, b, n, true);
+}
+
+/* Elements per int32 accumulation round; 2^15 multiply-adds of at most 2^15 fit in a lane */
+#define I8_BLOCK (1u << 19)
+
+__attribute__((target("avx2")))
+static int64_t hsum_epi32_avx2(__m256i v) {
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, v);
+    int64_t sum = 0;
+    for (int i = 0; i < 8; i++)
+        sum += lanes[i];
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static i8_terms_t terms_i8_avx2(const int8_t* a, const int8_t* b, size_t n) {
+    i8_terms_t terms = { 0, 0, 0 };
+    size_t i = 0;
+    while (i + 16 <= n) {
+        size_t end = n - i > I8_BLOCK ? i + I8_BLOCK : n;
+        __m256i dot = _mm256_setzero_si256();
+        __m256i na = _mm256_setzero_si256(), nb = _mm256_setzero_si256();
+        for (; i + 16 <= end; i += 16) {
+            __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+            __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+            dot = _mm256_add_epi32(dot, _mm256_madd_epi16(va, vb));
+            na = _mm256_add_epi32(na, _mm256_madd_epi16(va, va));
+            nb = _mm256_add_epi32(nb, _mm256_madd_epi16(vb, vb));
+        }
+        terms.dot += hsum_epi32_avx2(dot);
+        terms.norm_a += hsum_epi32_avx2(na);
+        terms.norm_b += hsum_epi32_avx2(nb);
+    }
+    for (; i < n; i++) {
+        terms.dot += a[i] * b[i];
+        terms.norm_a += a[i] * a[i];
+        terms.norm_b += b[i] * b[i];
+    }
+    return terms;
+}
+
+/*
+ * Codes stay within [-127, 127], so |a| times b with a's sign fits the
+ * unsigned-by-signed multiply, 32 bytes at a time; each pair sum is at
+ * most 2 * 127^2 and does not saturate
+ */
+__attribute__((target("avx2")))
+static int64_t dot_i8_avx2(const int8_t* a, const int8_t* b, size_t n) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    int64_t dot = 0;
+    size_t i = 0;
+    while (i + 32 <= n) {
+        size_t end = n - i > I8_BLOCK ? i + I8_BLOCK : n;
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 32 <= end; i += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+            __m256i pairs = _mm256_maddubs_epi16(_mm256_abs_epi8(va), _mm256_sign_epi8(vb, va));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, ones));
+        }
+        dot += hsum_epi32_avx2(acc);
+    }
+    for (; i < n; i++)
+        dot += a[i] * b[i];
+    return dot;
+}
+
+/* Popcount of 32 bytes by nibble lookups, summed per 64-bit lane */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i popcount_avx2(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i counts = _mm256_add_epi8(
+        _mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+        _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t hamming_avx2(const uint64_t* a, const uint64_t* b, size_t words) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                     _mm256_loadu_si256((const __m256i*)(b + i)));
+        acc = _mm256_add_epi64(acc, popcount_avx2(x));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    uint64_t bits = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < words; i++)
+        bits += (uint64_t)_mm_popcnt_u64(a[i] ^ b[i]);
+    return bits;
+}
+
+static const kernel_ops_t avx2_ops = {
+    dot_avx2, l2_squared_avx2, cosine_terms_avx2,
+    cosine_terms_f16_avx2, l2_squared_f16_avx2,
+    cosine_terms_bf16_avx2, l2_squared_bf16_avx2,
+    terms_i8_avx2, dot_i8_avx2, hamming_avx2
+};
+
+/* AVX-512F: 16 lanes, the tail is handled with a masked load */
+
+__attribute__((target("avx512f")))
+static __mmask16 tail_mask(size_t remaining) {
+    return (__mmask16)((1u << remaining) - 1u);
+}
+
+__attribute__((target("avx512f")))
+static float dot_avx512(const float* a, const float* b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16)
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    if (i < n) {
+        __mmask16 m = tail_mask(n - i);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+static float l2_squared_avx512(const float* a, const float* b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d, d, acc0);
+    }
+    if (i < n) {
+        __mmask16 m = tail_mask(n - i);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i));
+        acc1 = _mm512_fmadd_ps(d, d, acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+static eb_cosine_terms_t cosine_terms_avx512(const float* a, const float* b, size_t n) {
+    __m512 dot = _mm512_setzero_ps(), na = _mm512_setzero_ps(), nb = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 va = _mm512_loadu_ps(a + i), vb = _mm512_loadu_ps(b + i);
+        dot = _mm512_fmadd_ps(va, vb, dot);
+        na = _mm512_fmadd_ps(va, va, na);
+        nb = _mm512_fmadd_ps(vb, vb, nb);
+    }
+    if (i < n) {
+        __mmask16 m = tail_mask(n - i);
+        __m512 va = _mm512_maskz_loadu_ps(m, a + i), vb = _mm512_maskz_loadu_ps(m, b + i);
+        dot = _mm512_fmadd_ps(va, vb, dot);
+        na = _mm512_fmadd_ps(va, va, na);
+        nb = _mm512_fmadd_ps(vb, vb, nb);
+    }
+    eb_cosine_terms_t terms = {
+        _mm512_reduce_add_ps(dot), _mm512_reduce_add_ps(na), _mm512_reduce_add_ps(nb)
+    };
+    return terms;
+}
+
+/* Reduced dtypes are bound by load bandwidth; the AVX2 kernels serve here too */
+static const kernel_ops_t avx512_ops = {
+    dot_avx512, l2_squared_avx512, cosine_terms_avx512,
+    cosine_terms_f16_avx2, l2_squared_f16_avx2,
+    cosine_terms_bf16_avx2, l2_squared_bf16_avx2,
+    terms_i8_avx2, dot_i8_avx2, hamming_avx2
+};
+
+#endif /* EB_KERNELS_X86 */
+
+#ifdef EB_KERNELS_NEON
+
+static float dot_neon(const float* a, const float* b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    float32x4_t acc2 = vdupq_n_f32(0), acc3 = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc2 = vfmaq_f32(acc2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        acc3 = vfmaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    for (; i + 4 <= n; i += 4)
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+
+    float sum = vaddvq_f32(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static float l2_squared_neon(const float* a, const float* b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc0 = vfmaq_f32(acc0, d0, d0);
+        acc1 = vfmaq_f32(acc1, d1, d1);
+    }
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        acc0 = vfmaq_f32(acc0, d, d);
+    }
+
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; i++) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static eb_cosine_terms_t cosine_terms_neon(const float* a, const float* b, size_t n) {
+    float32x4_t dot = vdupq_n_f32(0), na = vdupq_n_f32(0), nb = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t va = vld1q_f32(a + i), vb = vld1q_f32(b + i);
+        dot = vfmaq_f32(dot, va, vb);
+        na = vfmaq_f32(na, va, va);
+        nb = vfmaq_f32(nb, vb, vb);
+    }
+    eb_cosine_terms_t terms = { vaddvq_f32(dot), vaddvq_f32(na), vaddvq_f32(nb) };
+    for (; i < n; i++) {
+        terms.dot += a[i] * b[i];
+        terms.norm_a += a[i] * a[i];
+        terms.norm_b += b[i] * b[i];
+    }
+    return terms;
+}
+
+/* Widening multiplies into 16 bits, pairwise added into 32-bit lanes; 2^18 fit */
+static int64_t dot_i8_neon(const int8_t* a, const int8_t* b, size_t n) {
+    int64_t dot = 0;
+    size_t i = 0;
+    while (i + 16 <= n) {
+        size_t end = n - i > (1u << 18) ? i + (1u << 18) : n;
+        int32x4_t acc = vdupq_n_s32(0);
+        for (; i + 16 <= end; i += 16) {
+            int8x16_t va = vld1q_s8(a + i), vb = vld1q_s8(b + i);
+            acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+            acc = vpadalq_s16(acc, vmull_high_s8(va, vb));
+        }
+        dot += vaddlvq_s32(acc);
+    }
+    for (; i < n; i++)
+        dot += a[i] * b[i];
+    return dot;
+}
+
+static uint64_t hamming_neon(const uint64_t* a, const uint64_t* b, size_t words) {
+    uint64x2_t acc = vdupq_n_u64(0);
+    size_t i = 0;
+    for (; i + 2 <= words; i += 2) {
+        uint8x16_t x = veorq_u8(vld1q_u8((const uint8_t*)(a + i)), vld1q_u8((const uint8_t*)(b + i)));
+        acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(vcntq_u8(x))));
+    }
+    uint64_t bits = vaddvq_u64(acc);
+    for (; i < words; i++)
+        bits += (uint64_t)__builtin_popcountll(a[i] ^ b[i]);
+    return bits;
+}
+
+static const kernel_ops_t neon_ops = {
+    dot_neon, l2_squared_neon, cosine_terms_neon,
+    cosine_terms_f16_scalar, l2_squared_f16_scalar,
+    cosine_terms_bf16_scalar, l2_squared_bf16_scalar,
+    terms_i8_scalar, dot_i8_neon, hamming_neon
+};
+
+#endif /* EB_KERNELS_NEON */
+
+static const kernel_ops_t* ops_for(eb_kernel_t kernel) {
+    switch (kernel) {
+#ifdef EB_KERNELS_X86
+    case EB_KERNEL_AVX512: return &avx512_ops;
+    case EB_KERNEL_AVX2: return &avx2_ops;
+#endif
+#ifdef EB_KERNELS_NEON
+    case EB_KERNEL_NEON: return &neon_ops;
+#endif
+    default: return &scalar_ops;
+    }
+}
+
+bool eb_kernel_supported(eb_kernel_t kernel) {
+    switch (kernel) {
+    case EB_KERNEL_SCALAR:
+        return true;
+#ifdef EB_KERNELS_X86
+    case EB_KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+               __builtin_cpu_supports("f16c");
+    case EB_KERNEL_AVX512:
+        return eb_kernel_supported(EB_KERNEL_AVX2) && __builtin_cpu_supports("avx512f");
+#endif
+#ifdef EB_KERNELS_NEON
+    case EB_KERNEL_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static eb_kernel_t active_kernel = EB_KERNEL_SCALAR;
+static const kernel_ops_t* active_ops = &scalar_ops;
+
+/* Pick the widest kernel the CPU supports */
+static void kernel_init(void) {
+    const eb_kernel_t preferred[] = { EB_KERNEL_AVX512, EB_KERNEL_AVX2, EB_KERNEL_NEON };
+    for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+        if (eb_kernel_supported(preferred[i])) {
+            active_kernel = preferred[i];
+            break;
+        }
+    }
+    active_ops = ops_for(active_kernel);
+    DEBUG_INFO("Using %s distance kernels", eb_kernel_name(active_kernel));
+}
+
+static const kernel_ops_t* kernels(void) {
+    pthread_once(&kernel_once, kernel_init);
+    return active_ops;
+}
+
+eb_kernel_t eb_kernel_active(void) {
+    kernels();
+    return active_kernel;
+}
+
+bool eb_kernel_select(eb_kernel_t kernel) {
+    pthread_once(&kernel_once, kernel_init);
+    if (!eb_kernel_supported(kernel))
+        return false;
+    active_kernel = kernel;
+    active_ops = ops_for(kernel);
+    return true;
+}
+
+const char* eb_kernel_name(eb_kernel_t kernel) {
+    switch (kernel) {
+    case EB_KERNEL_AVX2: return "avx2";
+    case EB_KERNEL_AVX512: return "avx512";
+    case EB_KERNEL_NEON: return "neon";
+    default: return "scalar";
+    }
+}
+
+float eb_dot(const float* a, const float* b, size_t n) {
+    return kernels()->dot(a, b, n);
+}
+
+float eb_l2_squared(const float* a, const float* b, size_t n) {
+    return kernels()->l2_squared(a, b, n);
+}
+
+eb_cosine_terms_t eb_cosine_terms(const float* a, const float* b, size_t n) {
+    return kernels()->cosine_terms(a, b, n);
+}
+
+int64_t eb_dot_i8(const int8_t* a, const int8_t* b, size_t n) {
+    return kernels()->dot_i8(a, b, n);
+}
+
+uint64_t eb_hamming(const uint64_t* a, const uint64_t* b, size_t words) {
+    return kernels()->hamming(a, b, words);
+}
+
+/* Vectors of different dtypes, widened a block at a time */
+#define MIXED_BLOCK 256
+
+static eb_cosine_terms_t mixed_cosine_terms(const eb_vector_ref_t* a, const eb_vector_ref_t* b,
+                                            size_t n) {
+    float block_a[MIXED_BLOCK], block_b[MIXED_BLOCK];
+    double dot = 0.0, norm_a = 0.0, norm_b = 0.0;
+    for (size_t start = 0; start < n; start += MIXED_BLOCK) {
+        size_t count = n - start < MIXED_BLOCK ? n - start : MIXED_BLOCK;
+        eb_vector_ref_get(a, start, count, block_a);
+        eb_vector_ref_get(b, start, count, block_b);
+        eb_cosine_terms_t terms = kernels()->cosine_terms(block_a, block_b, count);
+        dot += terms.dot;
+        norm_a += terms.norm_a;
+        norm_b += terms.norm_b;
+    }
+    eb_cosine_terms_t terms = { (float)dot, (float)norm_a, (float)norm_b };
+    return terms;
+}
+
+static float mixed_l2_squared(const eb_vector_ref_t* a, const eb_vector_ref_t* b, size_t n) {
+    float block_a[MIXED_BLOCK], block_b[MIXED_BLOCK];
+    double sum = 0.0;
+    for (size_t start = 0; start < n; start += MIXED_BLOCK) {
+        size_t count = n - start < MIXED_BLOCK ? n - start : MIXED_BLOCK;
+        eb_vector_ref_get(a, start, count, block_a);
+        eb_vector_ref_get(b, start, count, block_b);
+        sum += kernels()->l2_squared(block_a, block_b, count);
+    }
+    return (float)sum;
+}
+
+static size_t common_dims(const eb_vector_ref_t* a, const eb_vector_ref_t* b) {
+    return a->dims < b->dims ? a->dims : b->dims;
+}
+
+static eb_cosine_terms_t summed_cosine_terms(const eb_vector_ref_t* a, const eb_vector_ref_t* b) {
+    size_t n = common_dims(a, b);
+    if (a->dtype != b->dtype)
+        return mixed_cosine_terms(a, b, n);
+
+    switch (a->dtype) {
+    case EB_FLOAT32:
+        return kernels()->cosine_terms(a->values, b->values, n);
+    case EB_FLOAT16:
+        return kernels()->cosine_terms_f16(a->values, b->values, n);
+    case EB_BFLOAT16:
+        return kernels()->cosine_terms_bf16(a->values, b->values, n);
+    case EB_INT8: {
+        i8_terms_t sums = kernels()->terms_i8(a->values, b->values, n);
+        double sa = a->scale, sb = b->scale;
+        eb_cosine_terms_t terms = {
+            (float)(sa * sb * (double)sums.dot),
+            (float)(sa * sa * (double)sums.norm_a),
+            (float)(sb * sb * (double)sums.norm_b)
+        };
+        return terms;
+    }
+    default:
+        return mixed_cosine_terms(a, b, n);
+    }
+}
+
+eb_cosine_terms_t eb_vector_cosine_terms(const eb_vector_ref_t* a, const eb_vector_ref_t* b) {
+    bool known = a->norm >= 0.0f && b->norm >= 0.0f;
+    if (known && a->dtype == EB_FLOAT32 && b->dtype == EB_FLOAT32) {
+        eb_cosine_terms_t terms = {
+            kernels()->dot(a->values, b->values, common_dims(a, b)),
+            a->norm * a->norm,
+            b->norm * b->norm
+        };
+        return terms;
+    }
+
+    // The other kernels produce the norms in the same pass anyway
+    eb_cosine_terms_t terms = summed_cosine_terms(a, b);
+    if (a->norm >= 0.0f)
+        terms.norm_a = a->norm * a->norm;
+    if (b->norm >= 0.0f)
+        terms.norm_b = b->norm * b->norm;
+    return terms;
+}
+
+float eb_vector_norm(const eb_vector_ref_t* ref) {
+    if (ref->norm >= 0.0f)
+        return ref->norm;
+    if (ref->dtype == EB_FLOAT32)
+        return sqrtf(kernels()->dot(ref->values, ref->values, ref->dims));
+    return sqrtf(summed_cosine_terms(ref, ref).norm_a);
+}
+
+float eb_vector_l2_squared(const eb_vector_ref_t* a, const eb_vector_ref_t* b) {
+    size_t n = common_dims(a, b);
+    if (a->dtype != b->dtype)
+        return mixed_l2_squared(a, b, n);
+
+    switch (a->dtype) {
+    case EB_FLOAT32:
+        return kernels()->l2_squared(a->values, b->values, n);
+    case EB_FLOAT16:
+        return kernels()->l2_squared_f16(a->values, b->values, n);
+    case EB_BFLOAT16:
+        return kernels()->l2_squared_bf16(a->values, b->values, n);
+    case EB_INT8: {
+        // |sa*qa - sb*qb|^2 from the exact integer sums
+        i8_terms_t sums = kernels()->terms_i8(a->values, b->values, n);
+        double sa = a->scale, sb = b->scale;
+        double sum = sa == sb
+            ? sa * sa * (double)(sums.norm_a + sums.norm_b - 2 * sums.dot)
+            : sa * sa * (double)sums.norm_a + sb * sb * (double)sums.norm_b -
+              2.0 * sa * sb * (double)sums.dot;
+        return sum > 0.0 ? (float)sum : 0.0f;
+    }
+    default:
+        return mixed_l2_squared(a, b, n);
+    }
+}
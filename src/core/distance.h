@@ -0,0 +1,119 @@
+/*
+ * EmbeddingBridge - Vector Distance Kernels
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_DISTANCE_H
+#define EB_DISTANCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "quantize.h"
+
+/*
+ * Dot products, norms and squared Euclidean distances over float32
+ * vectors. The implementation is picked once at runtime from what the CPU
+ * supports (CPUID on x86-64): AVX-512F, AVX2 with FMA and F16C, NEON on AArch64,
+ * or a scalar loop that accumulates in double like the old code did.
+ *
+ * SIMD kernels accumulate in float across many independent lanes, which
+ * keeps the relative error for 1536-3072 dimensions around 1e-6.
+ *
+ * The eb_vector_* functions take vectors in their storage dtype. Float16
+ * and bfloat16 values are widened in registers and int8 products are
+ * summed exactly in integers, so nothing is converted to a float32 copy
+ * first. Vectors of two different dtypes are converted in small blocks.
+ */
+
+typedef enum {
+    EB_KERNEL_SCALAR = 0,
+    EB_KERNEL_AVX2,
+    EB_KERNEL_AVX512,
+    EB_KERNEL_NEON
+} eb_kernel_t;
+
+/* Dot product and both squared norms, computed in one pass */
+typedef struct {
+    float dot;
+    float norm_a;   /* Sum of a[i]^2 */
+    float norm_b;   /* Sum of b[i]^2 */
+} eb_cosine_terms_t;
+
+/**
+ * Dot product of two vectors
+ */
+float eb_dot(const float* a, const float* b, size_t n);
+
+/**
+ * Squared Euclidean distance between two vectors
+ */
+float eb_l2_squared(const float* a, const float* b, size_t n);
+
+/**
+ * Dot product and squared norms of two vectors in a single pass
+ */
+eb_cosine_terms_t eb_cosine_terms(const float* a, const float* b, size_t n);
+
+/**
+ * Dot product of two int8 vectors, summed exactly
+ *
+ * Values must lie in [-127, 127], as EB_INT8 codes do.
+ */
+int64_t eb_dot_i8(const int8_t* a, const int8_t* b, size_t n);
+
+/**
+ * Number of bits that differ between two bit vectors of words 64-bit words
+ */
+uint64_t eb_hamming(const uint64_t* a, const uint64_t* b, size_t words);
+
+/**
+ * Dot product and squared norms of two vectors of any storage dtype
+ *
+ * Both vectors must have the same number of dimensions. Known norms
+ * (eb_vector_ref_t.norm) are used as they are; when both are known,
+ * float32 vectors only need the dot product.
+ */
+eb_cosine_terms_t eb_vector_cosine_terms(const eb_vector_ref_t* a, const eb_vector_ref_t* b);
+
+/**
+ * L2 norm of a vector of any storage dtype, the known one if set
+ */
+float eb_vector_norm(const eb_vector_ref_t* ref);
+
+/**
+ * Squared Euclidean distance between two vectors of any storage dtype
+ *
+ * Both vectors must have the same number of dimensions.
+ */
+float eb_vector_l2_squared(const eb_vector_ref_t* a, const eb_vector_ref_t* b);
+
+/**
+ * Kernel selected for this process
+ */
+eb_kernel_t eb_kernel_active(void);
+
+/**
+ * Whether a kernel can run on this CPU
+ */
+bool eb_kernel_supported(eb_kernel_t kernel);
+
+/**
+ * Force a kernel, e.g. to compare implementations in tests
+ *
+ * @param kernel Kernel to use from now on
+ * @return false (and no change) if the CPU does not support it
+ */
+bool eb_kernel_select(eb_kernel_t kernel);
+
+/**
+ * Name of a kernel ("scalar", "avx2", "avx512", "neon")
+ */
+const char* eb_kernel_name(eb_kernel_t kernel);
+
+#endif /* EB_DISTANCE_H */
@@ -0,0 +1,646 @@
+/*
+ * EmbeddingBridge - Storage Footprint Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "du.h"
+#include "types.h"
+#include "pack.h"
+#include "object_path.h"
+#include "set_index.h"
+#include "log_index.h"
+#include "hash_set.h"
+#include "gc.h"
+#include "thread_pool.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Objects whose headers a worker reads at a time */
+#define HEADER_BLOCK 256
+
+size_t eb_du_version_bucket_min(size_t bucket) {
+    return bucket == 0 ? 1 : ((size_t)1 << (bucket - 1)) + 1;
+}
+
+static size_t version_bucket(size_t versions) {
+    size_t bucket = 0;
+    while (bucket + 1 < EB_DU_VERSION_BUCKETS && eb_du_version_bucket_min(bucket + 1) <= versions)
+        bucket++;
+    return bucket;
+}
+
+void eb_du_report_free(eb_du_report_t* report) {
+    if (!report)
+        return;
+    for (size_t i = 0; i < report->set_count; i++)
+        free(report->sets[i].name);
+    for (size_t i = 0; i < report->model_count; i++)
+        free(report->models[i].name);
+    for (size_t i = 0; i < report->file_count; i++)
+        free(report->files[i].source);
+    free(report->sets);
+    free(report->models);
+    free(report->files);
+    memset(report, 0, sizeof(*report));
+}
+
+static void usage_add(eb_du_usage_t* usage, uint64_t stored, uint64_t raw) {
+    usage->objects++;
+    usage->stored_bytes += stored;
+    usage->raw_bytes += raw;
+}
+
+/* Room for one more item in a growing array */
+static bool reserve(void* items, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity)
+        return true;
+    size_t grown_capacity = *capacity ? *capacity * 2 : 1024;
+    void* grown = realloc(*(void**)items, grown_capacity * size);
+    if (!grown)
+        return false;
+    *(void**)items = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+/* ---- Stored objects ---- */
+
+typedef struct {
+    char hash[65];
+    char* path;             /* Loose object file, NULL if packed */
+    uint64_t record;        /* Stored record size */
+    uint64_t meta;          /* .meta sidecar, counted with one copy */
+    time_t mtime;           /* Of the loose file or the pack */
+    uint64_t raw;           /* The rest is filled in from the header */
+    uint32_t flags;
+    bool vector;
+    bool unreadable;
+} du_object_t;
+
+typedef struct {
+    char hash[65];
+    uint64_t size;
+} du_meta_t;
+
+/* The copies of one object, for attributing it */
+typedef struct {
+    char hash[65];
+    uint64_t stored;
+    uint64_t raw;
+} du_hash_t;
+
+/* A log entry, for attributing its object to a model and a source */
+typedef struct {
+    char* source;
+    char* model;
+    char hash[65];
+} du_ref_t;
+
+typedef struct {
+    du_object_t* objects;
+    size_t count;
+    size_t capacity;
+    du_meta_t* metas;
+    size_t meta_count;
+    size_t meta_capacity;
+    eb_hash_set_t* packed;
+    du_hash_t* hashes;      /* Sorted by hash */
+    size_t hash_count;
+    du_ref_t* refs;
+    size_t ref_count;
+    size_t ref_capacity;
+    bool failed;            /* Out of memory */
+} du_ctx_t;
+
+static du_object_t* add_object(du_ctx_t* ctx, const char* hash, const char* path, uint64_t record,
+                               time_t mtime) {
+    if (!reserve(&ctx->objects, &ctx->capacity, ctx->count, sizeof(*ctx->objects)))
+        return NULL;
+    du_object_t* o = &ctx->objects[ctx->count];
+    memset(o, 0, sizeof(*o));
+    memcpy(o->hash, hash, 65);
+    if (path && !(o->path = strdup(path)))
+        return NULL;
+    o->record = record;
+    o->mtime = mtime;
+    ctx->count++;
+    return o;
+}
+
+static int collect_loose(const char* hex_hash, const char* ext, const char* path,
+                         const struct stat* st, void* data) {
+    du_ctx_t* ctx = data;
+    if (strcmp(ext, "raw") == 0) {
+        if (!add_object(ctx, hex_hash, path, (uint64_t)st->st_size, st->st_mtime)) {
+            ctx->failed = true;
+            return 1;
+        }
+    } else if (strcmp(ext, "meta") == 0) {
+        if (!reserve(&ctx->metas, &ctx->meta_capacity, ctx->meta_count, sizeof(*ctx->metas))) {
+            ctx->failed = true;
+            return 1;
+        }
+        du_meta_t* m = &ctx->metas[ctx->meta_count++];
+        memcpy(m->hash, hex_hash, 65);
+        m->size = (uint64_t)st->st_size;
+    }
+    return 0;
+}
+
+/* Packed objects once each, though several packs may hold one */
+static int collect_packed(const char* hex_hash, uint64_t length, time_t mtime, void* data) {
+    du_ctx_t* ctx = data;
+    bool added = false;
+    eb_status_t status = eb_hash_set_add_hex(ctx->packed, hex_hash, &added);
+    if (status == EB_SUCCESS && !added)
+        return 0;
+    if (status != EB_SUCCESS || !add_object(ctx, hex_hash, NULL, length, mtime)) {
+        ctx->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+/* ---- Headers ---- */
+
+typedef struct {
+    const eb_pack_set_t* packs;
+    du_object_t* objects;
+    size_t count;
+    size_t next_block;
+} header_job_t;
+
+/* The header of a record, which says how large its payload was before compression */
+static void read_header(const eb_pack_set_t* packs, du_object_t* o) {
+    eb_object_header_t header;
+    ssize_t n = -1;
+    if (o->path) {
+        int fd = open(o->path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            n = pread(fd, &header, sizeof(header), 0);
+            close(fd);
+        }
+    } else {
+        int fd = -1;
+        uint64_t offset = 0, length = 0;
+        if (eb_pack_locate(packs, o->hash, &fd, &offset, &length) == EB_SUCCESS)
+            n = length < sizeof(header) ? 0 : pread(fd, &header, sizeof(header), (off_t)offset);
+    }
+    if (n < 0) {
+        o->unreadable = true;
+        return;
+    }
+
+    // Records without a header are stored as they are
+    if ((size_t)n < sizeof(header) || header.magic != EB_VECTOR_MAGIC ||
+        !eb_object_version_valid(header.version)) {
+        o->raw = o->record;
+        return;
+    }
+    o->raw = header.size;
+    o->flags = header.flags;
+    o->vector = header.obj_type == EB_OBJ_VECTOR;
+}
+
+static void header_worker(void* arg) {
+    header_job_t* job = arg;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * HEADER_BLOCK;
+        if (first >= job->count)
+            break;
+        size_t end = job->count - first < HEADER_BLOCK ? job->count : first + HEADER_BLOCK;
+        for (size_t i = first; i < end; i++)
+            read_header(job->packs, &job->objects[i]);
+    }
+}
+
+/* Loose copies first, so a sidecar is counted with the loose copy */
+static int compare_objects(const void* x, const void* y) {
+    const du_object_t* a = x;
+    const du_object_t* b = y;
+    int cmp = strcmp(a->hash, b->hash);
+    if (cmp)
+        return cmp;
+    return (a->path == NULL) - (b->path == NULL);
+}
+
+static int compare_metas(const void* x, const void* y) {
+    return strcmp(((const du_meta_t*)x)->hash, ((const du_meta_t*)y)->hash);
+}
+
+/* Add the sidecars to their objects, to the loose copy if there is one; both arrays are sorted */
+static void attach_metas(du_ctx_t* ctx, eb_du_report_t* report) {
+    size_t o = 0;
+    for (size_t m = 0; m < ctx->meta_count; m++) {
+        const du_meta_t* meta = &ctx->metas[m];
+        while (o < ctx->count && strcmp(ctx->objects[o].hash, meta->hash) < 0)
+            o++;
+        report->meta_bytes += meta->size;
+        if (o < ctx->count && strcmp(ctx->objects[o].hash, meta->hash) == 0) {
+            ctx->objects[o].meta = meta->size;
+        } else {
+            // A sidecar left behind by its object still takes space
+            report->total.stored_bytes += meta->size;
+            report->loose.stored_bytes += meta->size;
+        }
+    }
+}
+
+/* Count every copy and merge the copies of each object, which are adjacent */
+static bool tally_objects(du_ctx_t* ctx, const eb_hash_set_t* referenced, time_t expire,
+                          eb_du_report_t* report) {
+    if (ctx->count && !(ctx->hashes = malloc(ctx->count * sizeof(*ctx->hashes))))
+        return false;
+    for (size_t i = 0; i < ctx->count; i++) {
+        const du_object_t* o = &ctx->objects[i];
+        uint64_t stored = o->record + o->meta;
+        usage_add(&report->total, stored, o->raw);
+        usage_add(o->path ? &report->loose : &report->packed, stored, o->raw);
+        if (o->unreadable)
+            report->unreadable++;
+        if (o->vector && (o->flags & EB_FLAG_COMPRESSED))
+            usage_add(&report->compressed, stored, o->raw);
+        if (o->vector && (o->flags & EB_FLAG_DELTA))
+            usage_add(&report->deltas, stored, o->raw);
+
+        size_t overhead = sizeof(eb_object_header_t) + (o->flags & EB_FLAG_NORM ? sizeof(float) : 0);
+        if (o->vector && o->raw && o->record >= overhead) {
+            uint64_t bucket = (o->record - overhead) * 10 / o->raw;
+            report->ratios[bucket < EB_DU_RATIO_BUCKETS ? bucket : EB_DU_RATIO_BUCKETS - 1]++;
+        }
+
+        if (referenced && !eb_hash_set_contains_hex(referenced, o->hash)) {
+            usage_add(&report->unreferenced, stored, o->raw);
+            if (o->mtime < expire)
+                usage_add(&report->reclaimable, stored, o->raw);
+        }
+
+        du_hash_t* h = ctx->hash_count ? &ctx->hashes[ctx->hash_count - 1] : NULL;
+        if (!h || strcmp(h->hash, o->hash) != 0) {
+            h = &ctx->hashes[ctx->hash_count++];
+            memcpy(h->hash, o->hash, 65);
+            h->stored = 0;
+            h->raw = o->raw;
+        }
+        h->stored += stored;
+    }
+    return true;
+}
+
+static int compare_hashes(const void* x, const void* y) {
+    return strcmp(((const du_hash_t*)x)->hash, ((const du_hash_t*)y)->hash);
+}
+
+/* Add an object, all its copies, to a usage; objects not stored add nothing */
+static void add_hash(const du_ctx_t* ctx, const char* hash, eb_du_usage_t* usage) {
+    du_hash_t key;
+    snprintf(key.hash, sizeof(key.hash), "%s", hash);
+    const du_hash_t* h = ctx->hash_count ? bsearch(&key, ctx->hashes, ctx->hash_count,
+                                                   sizeof(*ctx->hashes), compare_hashes) : NULL;
+    if (h)
+        usage_add(usage, h->stored, h->raw);
+}
+
+/* ---- Sets ---- */
+
+typedef struct {
+    char (*hashes)[65];
+    size_t count;
+    size_t capacity;
+} hash_list_t;
+
+static int note_index_entry(const char* source, const char* model, const char* hash, void* data) {
+    hash_list_t* list = data;
+    (void)source;
+    (void)model;
+    if (!reserve(&list->hashes, &list->capacity, list->count, sizeof(*list->hashes)))
+        return 1;
+    snprintf(list->hashes[list->count++], 65, "%s", hash);
+    return 0;
+}
+
+static int compare_hex(const void* a, const void* b) {
+    return strcmp(a, b);
+}
+
+typedef struct {
+    du_ctx_t* ctx;
+    eb_du_set_t* set;
+} log_visit_t;
+
+static int note_log_entry(const eb_log_entry_t* entry, void* data) {
+    log_visit_t* visit = data;
+    du_ctx_t* ctx = visit->ctx;
+    if (entry->removed)
+        return 0;
+    if (!reserve(&ctx->refs, &ctx->ref_capacity, ctx->ref_count, sizeof(*ctx->refs))) {
+        ctx->failed = true;
+        return 1;
+    }
+    du_ref_t* ref = &ctx->refs[ctx->ref_count];
+    ref->source = strdup(entry->source);
+    ref->model = strdup(entry->model);
+    if (!ref->source || !ref->model) {
+        free(ref->source);
+        free(ref->model);
+        ctx->failed = true;
+        return 1;
+    }
+    snprintf(ref->hash, sizeof(ref->hash), "%s", entry->hash);
+    ctx->ref_count++;
+    visit->set->versions++;
+    return 0;
+}
+
+static int compare_ref_hashes(const void* x, const void* y) {
+    return strcmp(((const du_ref_t*)x)->hash, ((const du_ref_t*)y)->hash);
+}
+
+static int compare_ref_sources(const void* x, const void* y) {
+    const du_ref_t* a = x;
+    const du_ref_t* b = y;
+    int cmp = strcmp(a->source, b->source);
+    return cmp ? cmp : strcmp(a->hash, b->hash);
+}
+
+static int compare_ref_models(const void* x, const void* y) {
+    const du_ref_t* a = x;
+    const du_ref_t* b = y;
+    int cmp = strcmp(a->model, b->model);
+    return cmp ? cmp : strcmp(a->hash, b->hash);
+}
+
+/* What the index of a set holds now and what its log has ever recorded */
+static eb_status_t measure_set(const char* root, du_ctx_t* ctx, const char* set_dir,
+                               eb_du_set_t* set) {
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/index", set_dir);
+    if (stat(path, &st) == 0) {
+        hash_list_t list = {0};
+        eb_set_index_t* index = NULL;
+        eb_status_t status = eb_set_index_open(root, path, &index);
+        if (status == EB_SUCCESS) {
+            status = eb_set_index_foreach(index, NULL, note_index_entry, &list);
+            eb_set_index_close(index);
+        }
+        if (status != EB_SUCCESS) {
+            free(list.hashes);
+            return status;
+        }
+        if (list.count)
+            qsort(list.hashes, list.count, sizeof(*list.hashes), compare_hex);
+        for (size_t i = 0; i < list.count; i++) {
+            if (i == 0 || strcmp(list.hashes[i], list.hashes[i - 1]) != 0)
+                add_hash(ctx, list.hashes[i], &set->current);
+        }
+        free(list.hashes);
+    }
+
+    size_t first = ctx->ref_count;
+    snprintf(path, sizeof(path), "%s/log", set_dir);
+    log_visit_t visit = { ctx, set };
+    eb_status_t status = eb_log_foreach(path, note_log_entry, &visit);
+    if (ctx->failed)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    if (status != EB_SUCCESS)
+        return status;
+
+    du_ref_t* refs = ctx->refs + first;
+    size_t count = ctx->ref_count - first;
+    if (count == 0)
+        return EB_SUCCESS;
+    qsort(refs, count, sizeof(*refs), compare_ref_hashes);
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || strcmp(refs[i].hash, refs[i - 1].hash) != 0)
+            add_hash(ctx, refs[i].hash, &set->history);
+    }
+    qsort(refs, count, sizeof(*refs), compare_ref_sources);
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || strcmp(refs[i].source, refs[i - 1].source) != 0)
+            set->sources++;
+    }
+    return EB_SUCCESS;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(((const eb_du_set_t*)a)->name, ((const eb_du_set_t*)b)->name);
+}
+
+static eb_status_t measure_sets(const char* root, du_ctx_t* ctx, eb_du_report_t* report) {
+    char sets_dir[PATH_MAX];
+    snprintf(sets_dir, sizeof(sets_dir), "%s/.embr/sets", root);
+    DIR* dir = opendir(sets_dir);
+    if (!dir)
+        return EB_SUCCESS;
+
+    size_t capacity = 0;
+    struct dirent* entry;
+    struct stat st;
+    while ((entry = readdir(dir)) != NULL) {
+        char set_dir[PATH_MAX];
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(set_dir, sizeof(set_dir), "%s/%s", sets_dir, entry->d_name);
+        if (stat(set_dir, &st) != 0 || !S_ISDIR(st.st_mode))
+            continue;
+        if (!reserve(&report->sets, &capacity, report->set_count, sizeof(*report->sets))) {
+            closedir(dir);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        eb_du_set_t* set = &report->sets[report->set_count];
+        memset(set, 0, sizeof(*set));
+        if (!(set->name = strdup(entry->d_name))) {
+            closedir(dir);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        report->set_count++;
+    }
+    closedir(dir);
+    if (report->set_count)
+        qsort(report->sets, report->set_count, sizeof(*report->sets), compare_names);
+
+    for (size_t i = 0; i < report->set_count; i++) {
+        eb_du_set_t* set = &report->sets[i];
+        char set_dir[PATH_MAX];
+        snprintf(set_dir, sizeof(set_dir), "%s/%s", sets_dir, set->name);
+        eb_status_t status = measure_set(root, ctx, set_dir, set);
+        if (status != EB_SUCCESS) {
+            DEBUG_PRINT("du: cannot read set %s", set->name);
+            return status;
+        }
+    }
+    return EB_SUCCESS;
+}
+
+/* ---- Models and files ---- */
+
+static int compare_models(const void* x, const void* y) {
+    const eb_du_model_t* a = x;
+    const eb_du_model_t* b = y;
+    if (a->usage.stored_bytes != b->usage.stored_bytes)
+        return a->usage.stored_bytes > b->usage.stored_bytes ? -1 : 1;
+    return strcmp(a->name, b->name);
+}
+
+static int compare_files(const void* x, const void* y) {
+    const eb_du_file_t* a = x;
+    const eb_du_file_t* b = y;
+    if (a->usage.stored_bytes != b->usage.stored_bytes)
+        return a->usage.stored_bytes > b->usage.stored_bytes ? -1 : 1;
+    return strcmp(a->source, b->source);
+}
+
+static eb_status_t measure_models(du_ctx_t* ctx, eb_du_report_t* report) {
+    du_ref_t* refs = ctx->refs;
+    size_t capacity = 0;
+    if (ctx->ref_count)
+        qsort(refs, ctx->ref_count, sizeof(*refs), compare_ref_models);
+    for (size_t i = 0; i < ctx->ref_count; i++) {
+        bool new_model = i == 0 || strcmp(refs[i].model, refs[i - 1].model) != 0;
+        if (new_model) {
+            if (!reserve(&report->models, &capacity, report->model_count, sizeof(*report->models)))
+                return EB_ERROR_MEMORY_ALLOCATION;
+            eb_du_model_t* model = &report->models[report->model_count];
+            memset(model, 0, sizeof(*model));
+            if (!(model->name = strdup(refs[i].model)))
+                return EB_ERROR_MEMORY_ALLOCATION;
+            report->model_count++;
+        }
+        if (new_model || strcmp(refs[i].hash, refs[i - 1].hash) != 0)
+            add_hash(ctx, refs[i].hash, &report->models[report->model_count - 1].usage);
+    }
+    if (report->model_count)
+        qsort(report->models, report->model_count, sizeof(*report->models), compare_models);
+    return EB_SUCCESS;
+}
+
+static eb_status_t measure_files(du_ctx_t* ctx, size_t max_files, eb_du_report_t* report) {
+    du_ref_t* refs = ctx->refs;
+    size_t capacity = 0;
+    if (ctx->ref_count)
+        qsort(refs, ctx->ref_count, sizeof(*refs), compare_ref_sources);
+    for (size_t i = 0; i < ctx->ref_count; i++) {
+        bool new_source = i == 0 || strcmp(refs[i].source, refs[i - 1].source) != 0;
+        if (new_source) {
+            if (!reserve(&report->files, &capacity, report->file_count, sizeof(*report->files)))
+                return EB_ERROR_MEMORY_ALLOCATION;
+            eb_du_file_t* file = &report->files[report->file_count];
+            memset(file, 0, sizeof(*file));
+            if (!(file->source = strdup(refs[i].source)))
+                return EB_ERROR_MEMORY_ALLOCATION;
+            report->file_count++;
+        }
+        if (new_source || strcmp(refs[i].hash, refs[i - 1].hash) != 0) {
+            eb_du_file_t* file = &report->files[report->file_count - 1];
+            file->versions++;
+            add_hash(ctx, refs[i].hash, &file->usage);
+        }
+    }
+    for (size_t i = 0; i < report->file_count; i++)
+        report->versions[version_bucket(report->files[i].versions)]++;
+
+    if (report->file_count)
+        qsort(report->files, report->file_count, sizeof(*report->files), compare_files);
+    if (max_files && report->file_count > max_files) {
+        for (size_t i = max_files; i < report->file_count; i++)
+            free(report->files[i].source);
+        report->file_count = max_files;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_du(const char* root, const eb_du_options_t* options, eb_du_report_t* report) {
+    if (!root || !report)
+        return EB_ERROR_INVALID_INPUT;
+    memset(report, 0, sizeof(*report));
+    eb_du_options_t defaults = {0};
+    if (!options)
+        options = &defaults;
+
+    du_ctx_t ctx = {0};
+    eb_pack_set_t* packs = NULL;
+    eb_hash_set_t* referenced = NULL;
+    eb_status_t status = eb_hash_set_create(0, &ctx.packed);
+    if (status == EB_SUCCESS)
+        status = eb_pack_open(root, &packs);
+
+    // Everything stored, then the header of each copy in parallel
+    if (status == EB_SUCCESS) {
+        status = eb_object_foreach(root, collect_loose, &ctx);
+        if (status == EB_ERROR_NOT_FOUND)
+            status = EB_SUCCESS;
+    }
+    if (status == EB_SUCCESS && !ctx.failed) {
+        report->packs = eb_pack_count(packs);
+        status = eb_pack_foreach(packs, collect_packed, &ctx);
+    }
+    if (ctx.failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS) {
+        header_job_t job = { packs, ctx.objects, ctx.count, 0 };
+        eb_parallel_run(NULL, eb_pool_threads(options->threads,
+                                              (ctx.count + HEADER_BLOCK - 1) / HEADER_BLOCK),
+                        header_worker, &job);
+    }
+
+    // The marks gc would make, to tell what it could remove
+    if (status == EB_SUCCESS) {
+        referenced = gc_load_referenced(root);
+        report->marked = referenced != NULL;
+        if (!referenced)
+            DEBUG_PRINT("du: cannot load the referenced objects");
+
+        if (ctx.count)
+            qsort(ctx.objects, ctx.count, sizeof(*ctx.objects), compare_objects);
+        if (ctx.meta_count)
+            qsort(ctx.metas, ctx.meta_count, sizeof(*ctx.metas), compare_metas);
+        attach_metas(&ctx, report);
+        if (!tally_objects(&ctx, referenced, options->expire, report))
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    if (status == EB_SUCCESS)
+        status = measure_sets(root, &ctx, report);
+    if (status == EB_SUCCESS)
+        status = measure_models(&ctx, report);
+    if (status == EB_SUCCESS)
+        status = measure_files(&ctx, options->max_files, report);
+    if (status == EB_SUCCESS)
+        DEBUG_PRINT("du: %zu objects, %llu bytes, %zu sets", report->total.objects,
+                    (unsigned long long)report->total.stored_bytes, report->set_count);
+    else
+        eb_du_report_free(report);
+
+    for (size_t i = 0; i < ctx.count; i++)
+        free(ctx.objects[i].path);
+    for (size_t i = 0; i < ctx.ref_count; i++) {
+        free(ctx.refs[i].source);
+        free(ctx.refs[i].model);
+    }
+    free(ctx.objects);
+    free(ctx.metas);
+    free(ctx.hashes);
+    free(ctx.refs);
+    eb_hash_set_destroy(referenced);
+    eb_hash_set_destroy(ctx.packed);
+    eb_pack_close(packs);
+    return status;
+}
@@ -0,0 +1,110 @@
+/*
+ * EmbeddingBridge - Storage Footprint
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_DU_H
+#define EB_DU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "status.h"
+
+/*
+ * Where the bytes of a repository are, for `embr du`. Every loose and
+ * packed object has its eb_object_header_t read, in blocks across the
+ * thread pool, but never its payload; .meta sidecars are only stat'ed.
+ * The set logs (with their base layers) and indexes then attribute the
+ * objects to sets, models and source files, and the marks gc would make
+ * tell which objects it could remove.
+ *
+ * An object is counted once per stored copy, so one that is both loose
+ * and packed adds to both; one held by several packs counts once. Stored
+ * bytes are what the records take, with the .meta sidecar (which stays
+ * loose) added to the loose copy, or to the packed one if there is none;
+ * raw bytes are the payload sizes before compression.
+ */
+
+/* Ratio of stored payload to raw payload, in tenths: [0, 0.1) ... [0.9, 1.0), then >= 1 */
+#define EB_DU_RATIO_BUCKETS 11
+/* Versions per source file: 1, 2, 3-4, 5-8, 9-16, 17-32, more */
+#define EB_DU_VERSION_BUCKETS 7
+
+typedef struct {
+    size_t objects;
+    uint64_t stored_bytes;
+    uint64_t raw_bytes;
+} eb_du_usage_t;
+
+typedef struct {
+    char* name;
+    eb_du_usage_t current;      /* Objects of the entries in its index now */
+    eb_du_usage_t history;      /* Every object its log has recorded */
+    size_t sources;             /* Source files in its log */
+    size_t versions;            /* Log entries, removals left out */
+} eb_du_set_t;
+
+typedef struct {
+    char* name;                 /* "" for entries recorded without a model */
+    eb_du_usage_t usage;        /* Objects recorded under the model in any set */
+} eb_du_model_t;
+
+typedef struct {
+    char* source;
+    size_t versions;            /* Distinct objects recorded for it in any set */
+    eb_du_usage_t usage;
+} eb_du_file_t;
+
+typedef struct {
+    eb_du_usage_t total;
+    eb_du_usage_t loose;
+    eb_du_usage_t packed;
+    eb_du_usage_t compressed;   /* Vector objects stored with zstd */
+    eb_du_usage_t deltas;       /* Stored as a residual of another version */
+    eb_du_usage_t unreferenced; /* Stored, but no set references them */
+    eb_du_usage_t reclaimable;  /* Unreferenced and older than the prune date */
+    bool marked;                /* false if the references could not all be read;
+                                   unreferenced and reclaimable are empty then */
+    uint64_t meta_bytes;        /* .meta sidecars, part of the stored bytes */
+    size_t packs;
+    size_t unreadable;          /* Objects whose header could not be read */
+    size_t ratios[EB_DU_RATIO_BUCKETS];     /* Vector objects by stored/raw ratio */
+    size_t versions[EB_DU_VERSION_BUCKETS]; /* Source files by versions */
+    eb_du_set_t* sets;          /* By name */
+    size_t set_count;
+    eb_du_model_t* models;      /* Largest first */
+    size_t model_count;
+    eb_du_file_t* files;        /* The largest max_files, largest first */
+    size_t file_count;
+} eb_du_report_t;
+
+typedef struct {
+    unsigned threads;           /* Worker threads, 0 for one per online CPU */
+    time_t expire;              /* Unreferenced copies written before this are
+                                   reclaimable, 0 for none (gc_resolve_expire()) */
+    size_t max_files;           /* Source files reported, 0 for all */
+} eb_du_options_t;
+
+/**
+ * Measure the storage of a repository
+ *
+ * @param root Repository root
+ * @param options Options, NULL for defaults
+ * @param report Receives the footprint, free with eb_du_report_free()
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_du(const char* root, const eb_du_options_t* options, eb_du_report_t* report);
+
+void eb_du_report_free(eb_du_report_t* report);
+
+/* Lower bound of a versions bucket: 1, 2, 3, 5, 9, 17, 33 */
+size_t eb_du_version_bucket_min(size_t bucket);
+
+#endif /* EB_DU_H */
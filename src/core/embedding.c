@@ -10,6 +10,7 @@
 
 #include "types.h"
 #include "embedding.h"
+#include "quantize.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -24,6 +25,7 @@
 #endif
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include "timing.h"
 #include "debug.h"
 
 // Dynamic model registry - simplified design
@@ -209,8 +211,12 @@ static struct {
 
 static bool registry_initialized = false;
 
-static eb_status_t ensure_registry_loaded(void) {
-    DEBUG_PRINT("Entering ensure_registry_loaded, initialized=%d, count=%zu\n", 
+/* Guards model_registry and registry_initialized; the functions below
+ * that touch either are called with it held */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static eb_status_t load_registry(void) {
+    DEBUG_PRINT("Entering load_registry, initialized=%d, count=%zu\n", 
             registry_initialized, model_registry.count);
     
     if (registry_initialized) {
@@ -310,6 +316,16 @@ static eb_status_t ensure_registry_loaded(void) {
     return EB_SUCCESS;
 }
 
+/* Parse the model registry on first use */
+static eb_status_t ensure_registry_loaded(void) {
+    if (registry_initialized)
+        return EB_SUCCESS;
+    int timing = eb_timing_begin("model registry");
+    eb_status_t status = load_registry();
+    eb_timing_end(timing);
+    return status;
+}
+
 static eb_status_t save_registry(void) {
     // Find repository root
     char* repo_root = find_repository_root();
@@ -344,7 +360,7 @@ static eb_status_t save_registry(void) {
     return EB_SUCCESS;
 }
 
-eb_status_t eb_register_model(
+static eb_status_t register_model_locked(
     const char* name,
     size_t dimensions,
     bool normalize,
@@ -412,24 +428,34 @@ eb_status_t eb_register_model(
     return EB_SUCCESS;
 }
 
+eb_status_t eb_register_model(
+    const char* name,
+    size_t dimensions,
+    bool normalize,
+    const char* version,
+    const char* description
+) {
+    pthread_mutex_lock(&registry_lock);
+    eb_status_t status = register_model_locked(name, dimensions, normalize, version, description);
+    pthread_mutex_unlock(&registry_lock);
+    return status;
+}
+
 bool eb_is_model_registered(const char* name) {
+    pthread_mutex_lock(&registry_lock);
     eb_status_t status = ensure_registry_loaded();
-    if (status != EB_SUCCESS || !name || !model_registry.count) {
-        return false;
-    }
-
-    for (size_t i = 0; i < model_registry.count; i++) {
+    bool found = false;
+    for (size_t i = 0; status == EB_SUCCESS && name && i < model_registry.count; i++) {
         if (strcmp(model_registry.models[i].name, name) == 0) {
-            return true;
+            found = true;
+            break;
         }
     }
-    return false;
+    pthread_mutex_unlock(&registry_lock);
+    return found;
 }
 
-eb_status_t eb_list_models(char*** out_names, size_t* out_count) {
-    if (!out_names || !out_count)
-        return EB_ERROR_INVALID_INPUT;
-
+static eb_status_t list_models_locked(char*** out_names, size_t* out_count) {
     // Load registry first
     eb_status_t status = ensure_registry_loaded();
     if (status != EB_SUCCESS)
@@ -454,11 +480,21 @@ eb_status_t eb_list_models(char*** out_names, size_t* out_count) {
     return EB_SUCCESS;
 }
 
+eb_status_t eb_list_models(char*** out_names, size_t* out_count) {
+    if (!out_names || !out_count)
+        return EB_ERROR_INVALID_INPUT;
+
+    pthread_mutex_lock(&registry_lock);
+    eb_status_t status = list_models_locked(out_names, out_count);
+    pthread_mutex_unlock(&registry_lock);
+    return status;
+}
+
 void eb_unregister_model(const char* name) {
-    if (!name || !model_registry.count) {
+    if (!name)
         return;
-    }
 
+    pthread_mutex_lock(&registry_lock);
     for (size_t i = 0; i < model_registry.count; i++) {
         if (strcmp(model_registry.models[i].name, name) == 0) {
             free(model_registry.models[i].version);
@@ -473,6 +509,7 @@ void eb_unregister_model(const char* name) {
             break;
         }
     }
+    pthread_mutex_unlock(&registry_lock);
 }
 
 eb_status_t eb_get_model_info(const char* name, eb_model_info_t* out_info) {
@@ -480,7 +517,11 @@ eb_status_t eb_get_model_info(const char* name, eb_model_info_t* out_info) {
         return EB_ERROR_INVALID_INPUT;
     }
 
-    for (size_t i = 0; i < model_registry.count; i++) {
+    pthread_mutex_lock(&registry_lock);
+    eb_status_t status = ensure_registry_loaded();
+    if (status == EB_SUCCESS)
+        status = EB_ERROR_NOT_FOUND;
+    for (size_t i = 0; status == EB_ERROR_NOT_FOUND && i < model_registry.count; i++) {
         if (strcmp(name, model_registry.models[i].name) == 0) {
             out_info->dimensions = model_registry.models[i].dimensions;
             out_info->normalize_output = model_registry.models[i].normalize;
@@ -488,17 +529,16 @@ eb_status_t eb_get_model_info(const char* name, eb_model_info_t* out_info) {
             out_info->version = strdup(model_registry.models[i].version);
             out_info->description = strdup(model_registry.models[i].description);
             
+            status = EB_SUCCESS;
             if (!out_info->version || !out_info->description) {
                 free(out_info->version);
                 free(out_info->description);
-                return EB_ERROR_MEMORY_ALLOCATION;
+                status = EB_ERROR_MEMORY_ALLOCATION;
             }
-            
-            return EB_SUCCESS;
         }
     }
-
-    return EB_ERROR_NOT_FOUND;
+    pthread_mutex_unlock(&registry_lock);
+    return status;
 }
 
 eb_status_t eb_generate_embedding(const char* text, const char* model_name, eb_embedding_t** out_embedding) {
@@ -537,6 +577,7 @@ eb_status_t eb_generate_embedding(const char* text, const char* model_name, eb_e
     // Initialize embedding
     (*out_embedding)->dimensions = model_info.dimensions;
     (*out_embedding)->normalize = model_info.normalize_output;
+    (*out_embedding)->norm = -1.0f;
 
     // Call the actual model to generate embeddings
     // For now, we'll use a simple hash-based approach that's deterministic
@@ -647,6 +688,9 @@ size_t eb_get_dtype_size(eb_dtype_t dtype) {
         case EB_FLOAT64: return 8;
         case EB_INT32: return 4;
         case EB_INT64: return 8;
+        case EB_FLOAT16: return 2;
+        case EB_BFLOAT16: return 2;
+        case EB_INT8: return 1;
         default: return 0;
     }
 }
@@ -679,6 +723,7 @@ eb_status_t eb_create_embedding(
     // Initialize embedding
     (*out_embedding)->dimensions = dimensions;
     (*out_embedding)->normalize = normalize;
+    (*out_embedding)->norm = -1.0f;
 
     // Convert data based on dtype
     switch (dtype) {
@@ -706,6 +751,19 @@ eb_status_t eb_create_embedding(
             }
             break;
         }
+        case EB_FLOAT16:
+        case EB_BFLOAT16:
+        case EB_INT8: {
+            // Payload layout of a reduced-precision vector object
+            eb_vector_ref_t ref;
+            if (eb_vector_ref_init(&ref, dtype, data, eb_quantized_size(dtype, dimensions)) != EB_SUCCESS) {
+                free((*out_embedding)->values);
+                free(*out_embedding);
+                return EB_ERROR_INVALID_INPUT;
+            }
+            eb_vector_ref_get(&ref, 0, dimensions, (*out_embedding)->values);
+            break;
+        }
         default:
             free((*out_embedding)->values);
             free(*out_embedding);
@@ -761,6 +819,7 @@ eb_status_t eb_normalize_embedding(eb_embedding_t* embedding) {
     for (size_t i = 0; i < embedding->dimensions; i++) {
         embedding->values[i] /= norm;
     }
+    embedding->norm = 1.0f;
 
     return EB_SUCCESS;
 }
@@ -773,16 +832,22 @@ eb_status_t eb_get_model(const char* name, eb_model_registry_entry_t* out_model)
         return EB_ERROR_INVALID_INPUT;
     }
 
-    for (size_t i = 0; i < model_registry.count; i++) {
+    pthread_mutex_lock(&registry_lock);
+    eb_status_t status = ensure_registry_loaded();
+    if (status == EB_SUCCESS)
+        status = EB_ERROR_NOT_FOUND;
+    for (size_t i = 0; status == EB_ERROR_NOT_FOUND && i < model_registry.count; i++) {
         if (strcmp(model_registry.models[i].name, name) == 0) {
             memcpy(out_model, &model_registry.models[i], sizeof(eb_model_registry_entry_t));
             DEBUG_PRINT("Found model %s at index %zu\n", name, i);
-            return EB_SUCCESS;
+            status = EB_SUCCESS;
         }
     }
+    pthread_mutex_unlock(&registry_lock);
 
-    DEBUG_PRINT("Model %s not found in registry\n", name);
-    return EB_ERROR_NOT_FOUND;
+    if (status == EB_ERROR_NOT_FOUND)
+        DEBUG_PRINT("Model %s not found in registry\n", name);
+    return status;
 }
 
 /**
@@ -872,12 +937,14 @@ eb_status_t eb_find_similar_models(const char* name, char*** similar_names, size
 
 void eb_cleanup_registry(void) {
     // Clean up model registry
+    pthread_mutex_lock(&registry_lock);
     for (size_t i = 0; i < model_registry.count; i++) {
         free(model_registry.models[i].version);
         free(model_registry.models[i].description);
     }
     model_registry.count = 0;
     registry_initialized = false;
+    pthread_mutex_unlock(&registry_lock);
 
     // Clean up cached repo root
     free_cached_repo_root();
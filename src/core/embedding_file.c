@@ -0,0 +1,584 @@
+/*
+ * EmbeddingBridge - Embedding File Loader Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "embedding_file.h"
+#include "quantize.h"
+#include "debug.h"
+#include "error.h"
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_SIZE 6
+#define NPY_ALIGN 64
+
+#define ZIP_LOCAL_SIG 0x04034b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_END_SIG 0x06054b50
+#define ZIP64_END_SIG 0x06064b50
+#define ZIP64_LOCATOR_SIG 0x07064b50
+#define ZIP_END_SIZE 22
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_LOCAL_SIZE 30
+#define ZIP64_EXTRA_ID 0x0001
+
+struct eb_embedding_file {
+    void* map;
+    size_t map_size;
+    bool numpy;
+    eb_array_t* arrays;           /* &single unless the file is a .npz */
+    size_t count;
+    eb_array_t single;
+};
+
+static uint16_t read16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read64(const uint8_t* p) {
+    return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32);
+}
+
+/*
+ * .npy header dict
+ */
+
+typedef struct {
+    const char* p;
+    const char* end;
+} header_cursor_t;
+
+static void skip_space(header_cursor_t* c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n'))
+        c->p++;
+}
+
+static bool expect(header_cursor_t* c, char ch) {
+    skip_space(c);
+    if (c->p >= c->end || *c->p != ch)
+        return false;
+    c->p++;
+    return true;
+}
+
+/* Python string literal without escapes */
+static bool read_string(header_cursor_t* c, char* out, size_t out_size) {
+    skip_space(c);
+    if (c->p >= c->end || (*c->p != '\'' && *c->p != '"'))
+        return false;
+    char quote = *c->p++;
+    size_t length = 0;
+    while (c->p < c->end && *c->p != quote) {
+        if (*c->p == '\\' || length + 1 >= out_size)
+            return false;
+        out[length++] = *c->p++;
+    }
+    if (c->p >= c->end)
+        return false;
+    c->p++;
+    out[length] = '\0';
+    return true;
+}
+
+static bool read_word(header_cursor_t* c, const char* word) {
+    skip_space(c);
+    size_t length = strlen(word);
+    if ((size_t)(c->end - c->p) < length || memcmp(c->p, word, length) != 0)
+        return false;
+    c->p += length;
+    return true;
+}
+
+/* Tuple of non-negative integers: (), (3,), (2, 3) */
+static bool read_shape(header_cursor_t* c, eb_array_t* array) {
+    if (!expect(c, '('))
+        return false;
+    array->ndim = 0;
+    bool comma = false;
+    for (;;) {
+        skip_space(c);
+        if (c->p < c->end && *c->p == ')') {
+            c->p++;
+            break;
+        }
+        if (array->ndim == EB_ARRAY_MAX_NDIM || c->p >= c->end || *c->p < '0' || *c->p > '9')
+            return false;
+        size_t value = 0;
+        while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+            size_t digit = (size_t)(*c->p++ - '0');
+            if (value > (SIZE_MAX - digit) / 10)
+                return false;
+            value = value * 10 + digit;
+        }
+        array->shape[array->ndim++] = value;
+        skip_space(c);
+        comma = c->p < c->end && *c->p == ',';
+        if (comma)
+            c->p++;
+        else if (c->p >= c->end || *c->p != ')')
+            return false;
+    }
+    // A one-element tuple needs its comma: (3) is an int, not a shape
+    return array->ndim != 1 || comma;
+}
+
+static eb_status_t parse_descr(const char* descr, eb_array_t* array) {
+    if (strcmp(descr, "<f4") == 0) {
+        array->dtype = EB_FLOAT32;
+        array->elem_size = 4;
+    } else if (strcmp(descr, "<f8") == 0) {
+        array->dtype = EB_FLOAT64;
+        array->elem_size = 8;
+    } else if (strcmp(descr, "<f2") == 0) {
+        array->dtype = EB_FLOAT16;
+        array->elem_size = 2;
+    } else {
+        DEBUG_WARN("Unsupported .npy dtype '%s' (expected <f4, <f8 or <f2)", descr);
+        return EB_ERROR_UNSUPPORTED;
+    }
+    return EB_SUCCESS;
+}
+
+static eb_status_t parse_header(const char* text, size_t length, eb_array_t* array) {
+    header_cursor_t c = { text, text + length };
+    bool have_descr = false, have_order = false, have_shape = false;
+    char descr[16] = "";
+
+    if (length == 0 || text[length - 1] != '\n' || !expect(&c, '{'))
+        return EB_ERROR_INVALID_FORMAT;
+    for (;;) {
+        skip_space(&c);
+        if (c.p < c.end && *c.p == '}') {
+            c.p++;
+            break;
+        }
+        char key[32];
+        if (!read_string(&c, key, sizeof(key)) || !expect(&c, ':'))
+            return EB_ERROR_INVALID_FORMAT;
+        if (strcmp(key, "descr") == 0 && !have_descr) {
+            if (!read_string(&c, descr, sizeof(descr)))
+                return EB_ERROR_UNSUPPORTED;  // Structured dtypes are lists
+            have_descr = true;
+        } else if (strcmp(key, "fortran_order") == 0 && !have_order) {
+            if (read_word(&c, "True"))
+                array->fortran_order = true;
+            else if (read_word(&c, "False"))
+                array->fortran_order = false;
+            else
+                return EB_ERROR_INVALID_FORMAT;
+            have_order = true;
+        } else if (strcmp(key, "shape") == 0 && !have_shape) {
+            if (!read_shape(&c, array))
+                return EB_ERROR_INVALID_FORMAT;
+            have_shape = true;
+        } else {
+            DEBUG_WARN("Unexpected .npy header key '%s'", key);
+            return EB_ERROR_INVALID_FORMAT;
+        }
+        skip_space(&c);
+        if (c.p < c.end && *c.p == ',')
+            c.p++;
+        else if (c.p >= c.end || *c.p != '}')
+            return EB_ERROR_INVALID_FORMAT;
+    }
+    skip_space(&c);
+    if (c.p != c.end || !have_descr || !have_order || !have_shape)
+        return EB_ERROR_INVALID_FORMAT;
+    return parse_descr(descr, array);
+}
+
+eb_status_t eb_npy_parse(const void* bytes, size_t size, eb_array_t* array_out) {
+    if ((!bytes && size) || !array_out)
+        return EB_ERROR_INVALID_INPUT;
+    const uint8_t* p = bytes;
+    memset(array_out, 0, sizeof(*array_out));
+
+    if (size < 10 || memcmp(p, NPY_MAGIC, NPY_MAGIC_SIZE) != 0)
+        return EB_ERROR_INVALID_FORMAT;
+    size_t header_offset, header_size;
+    switch (p[6]) {
+    case 1:
+        header_offset = 10;
+        header_size = read16(p + 8);
+        break;
+    case 2:
+    case 3:  // 3.0 only allows a UTF-8 header, which ours is
+        if (size < 12)
+            return EB_ERROR_INVALID_FORMAT;
+        header_offset = 12;
+        header_size = read32(p + 8);
+        break;
+    default:
+        DEBUG_WARN("Unsupported .npy version %u.%u", p[6], p[7]);
+        return EB_ERROR_UNSUPPORTED;
+    }
+    if (header_size > size - header_offset)
+        return EB_ERROR_INVALID_FORMAT;
+
+    eb_status_t status = parse_header((const char*)p + header_offset, header_size, array_out);
+    if (status != EB_SUCCESS)
+        return status;
+
+    size_t count = 1;
+    for (int i = 0; i < array_out->ndim; i++) {
+        if (array_out->shape[i] && count > SIZE_MAX / array_out->shape[i])
+            return EB_ERROR_INVALID_FORMAT;
+        count *= array_out->shape[i];
+    }
+    size_t data_offset = header_offset + header_size;
+    if (count > SIZE_MAX / array_out->elem_size || size - data_offset != count * array_out->elem_size) {
+        DEBUG_WARN(".npy data is %zu bytes, shape needs %zu values", size - data_offset, count);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    array_out->data = p + data_offset;
+    array_out->size = size - data_offset;
+    return EB_SUCCESS;
+}
+
+size_t eb_npy_header(eb_dtype_t dtype, const size_t* shape, int ndim, char buf[EB_NPY_HEADER_MAX]) {
+    const char* descr;
+    switch (dtype) {
+    case EB_FLOAT32: descr = "<f4"; break;
+    case EB_FLOAT64: descr = "<f8"; break;
+    case EB_FLOAT16: descr = "<f2"; break;
+    default: return 0;
+    }
+    if (ndim < 0 || ndim > EB_ARRAY_MAX_NDIM)
+        return 0;
+
+    char dict[EB_NPY_HEADER_MAX];
+    int length = snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (", descr);
+    for (int i = 0; i < ndim && length > 0 && (size_t)length < sizeof(dict); i++)
+        length += snprintf(dict + length, sizeof(dict) - length, i ? " %zu," : "%zu,", shape[i]);
+    if (length > 0 && (size_t)length < sizeof(dict)) {
+        if (ndim > 1)
+            length--;  // (2, 3) rather than (2, 3,)
+        length += snprintf(dict + length, sizeof(dict) - length, "), }");
+    }
+    // Magic, version and length, then the dict padded with spaces to a newline
+    size_t total = ((size_t)10 + (size_t)length + 1 + NPY_ALIGN - 1) / NPY_ALIGN * NPY_ALIGN;
+    if (length <= 0 || total > EB_NPY_HEADER_MAX)
+        return 0;
+
+    memcpy(buf, NPY_MAGIC, NPY_MAGIC_SIZE);
+    buf[6] = 1;
+    buf[7] = 0;
+    buf[8] = (char)((total - 10) & 0xFF);
+    buf[9] = (char)((total - 10) >> 8);
+    memcpy(buf + 10, dict, (size_t)length);
+    memset(buf + 10 + length, ' ', total - 10 - (size_t)length - 1);
+    buf[total - 1] = '\n';
+    return total;
+}
+
+/*
+ * .npz archives
+ */
+
+/* Central directory offset and entry count, from the (zip64) end record */
+static eb_status_t find_central_directory(const uint8_t* p, size_t size,
+                                          uint64_t* offset_out, uint64_t* count_out) {
+    if (size < ZIP_END_SIZE)
+        return EB_ERROR_INVALID_FORMAT;
+    size_t lowest = size - ZIP_END_SIZE > 0xFFFF ? size - ZIP_END_SIZE - 0xFFFF : 0;
+    size_t end = size - ZIP_END_SIZE + 1;
+    do {
+        end--;
+    } while (read32(p + end) != ZIP_END_SIG && end > lowest);
+    if (read32(p + end) != ZIP_END_SIG)
+        return EB_ERROR_INVALID_FORMAT;
+
+    uint64_t count = read16(p + end + 10);
+    uint64_t offset = read32(p + end + 16);
+    if (count == 0xFFFF || offset == 0xFFFFFFFF) {
+        if (end < 20 || read32(p + end - 20) != ZIP64_LOCATOR_SIG)
+            return EB_ERROR_INVALID_FORMAT;
+        uint64_t end64 = read64(p + end - 20 + 8);
+        if (size < 56 || end64 > size - 56 || read32(p + end64) != ZIP64_END_SIG)
+            return EB_ERROR_INVALID_FORMAT;
+        count = read64(p + end64 + 32);
+        offset = read64(p + end64 + 48);
+    }
+    if (offset > size)
+        return EB_ERROR_INVALID_FORMAT;
+    *offset_out = offset;
+    *count_out = count;
+    return EB_SUCCESS;
+}
+
+/* Replace saturated 32-bit sizes and offset by their zip64 extra field values */
+static eb_status_t read_zip64_extra(const uint8_t* extra, size_t extra_size, uint64_t* uncompressed,
+                                    uint64_t* compressed, uint64_t* offset) {
+    while (extra_size >= 4) {
+        uint16_t id = read16(extra);
+        size_t field_size = read16(extra + 2);
+        if (field_size > extra_size - 4)
+            return EB_ERROR_INVALID_FORMAT;
+        if (id == ZIP64_EXTRA_ID) {
+            const uint8_t* field = extra + 4;
+            uint64_t* values[] = { uncompressed, compressed, offset };
+            for (size_t i = 0; i < 3; i++) {
+                if (*values[i] != 0xFFFFFFFF)
+                    continue;
+                if (field + 8 > extra + 4 + field_size)
+                    return EB_ERROR_INVALID_FORMAT;
+                *values[i] = read64(field);
+                field += 8;
+            }
+            return EB_SUCCESS;
+        }
+        extra += 4 + field_size;
+        extra_size -= 4 + field_size;
+    }
+    return EB_SUCCESS;
+}
+
+static eb_status_t parse_npz(const uint8_t* p, size_t size, eb_embedding_file_t* file) {
+    uint64_t position, count;
+    eb_status_t status = find_central_directory(p, size, &position, &count);
+    if (status != EB_SUCCESS)
+        return status;
+    if (count == 0 || count > size / ZIP_CENTRAL_SIZE)
+        return EB_ERROR_INVALID_FORMAT;
+
+    file->arrays = calloc((size_t)count, sizeof(eb_array_t));
+    if (!file->arrays)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (position > size - ZIP_CENTRAL_SIZE || read32(p + position) != ZIP_CENTRAL_SIG)
+            return EB_ERROR_INVALID_FORMAT;
+        const uint8_t* entry = p + position;
+        uint16_t flags = read16(entry + 8);
+        uint16_t method = read16(entry + 10);
+        uint64_t compressed = read32(entry + 20);
+        uint64_t uncompressed = read32(entry + 24);
+        size_t name_size = read16(entry + 28);
+        size_t extra_size = read16(entry + 30);
+        size_t comment_size = read16(entry + 32);
+        uint64_t local = read32(entry + 42);
+        if (name_size + extra_size + comment_size > size - position - ZIP_CENTRAL_SIZE)
+            return EB_ERROR_INVALID_FORMAT;
+        const char* name = (const char*)entry + ZIP_CENTRAL_SIZE;
+        status = read_zip64_extra(entry + ZIP_CENTRAL_SIZE + name_size, extra_size,
+                                  &uncompressed, &compressed, &local);
+        if (status != EB_SUCCESS)
+            return status;
+
+        if (flags & 0x1) {
+            DEBUG_WARN(".npz member is encrypted");
+            return EB_ERROR_UNSUPPORTED;
+        }
+        if (method != 0 || compressed != uncompressed) {
+            DEBUG_WARN(".npz member is compressed; save with np.savez instead of np.savez_compressed");
+            return EB_ERROR_UNSUPPORTED;
+        }
+        if (name_size < 5 || memcmp(name + name_size - 4, ".npy", 4) != 0 ||
+            name_size - 4 >= sizeof(file->arrays[i].name))
+            return EB_ERROR_INVALID_FORMAT;
+
+        if (local > size - ZIP_LOCAL_SIZE || read32(p + local) != ZIP_LOCAL_SIG)
+            return EB_ERROR_INVALID_FORMAT;
+        uint64_t data = local + ZIP_LOCAL_SIZE + read16(p + local + 26) + read16(p + local + 28);
+        if (data > size || compressed > size - data)
+            return EB_ERROR_INVALID_FORMAT;
+
+        eb_array_t* array = &file->arrays[i];
+        status = eb_npy_parse(p + data, (size_t)compressed, array);
+        if (status != EB_SUCCESS)
+            return status;
+        memcpy(array->name, name, name_size - 4);
+        array->name[name_size - 4] = '\0';
+        file->count++;
+
+        position += ZIP_CENTRAL_SIZE + name_size + extra_size + comment_size;
+    }
+    return EB_SUCCESS;
+}
+
+/*
+ * Files
+ */
+
+static eb_status_t parse_bin(const uint8_t* p, size_t size, size_t dims, eb_array_t* array) {
+    if (size == 0 || size % sizeof(float) != 0)
+        return EB_ERROR_INVALID_FORMAT;
+    size_t count = size / sizeof(float);
+    array->dtype = EB_FLOAT32;
+    array->elem_size = sizeof(float);
+    if (dims) {
+        if (count % dims != 0) {
+            DEBUG_WARN(".bin file holds %zu values, not a multiple of %zu dimensions", count, dims);
+            return EB_ERROR_DIMENSION_MISMATCH;
+        }
+        array->ndim = 2;
+        array->shape[0] = count / dims;
+        array->shape[1] = dims;
+    } else {
+        array->ndim = 1;
+        array->shape[0] = count;
+    }
+    array->data = p;
+    array->size = size;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_embedding_file_open(const char* path, size_t dims, eb_embedding_file_t** out) {
+    if (!path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    *out = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return EB_ERROR_FILE_IO;
+    }
+
+    eb_embedding_file_t* file = calloc(1, sizeof(*file));
+    if (!file) {
+        close(fd);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    file->map_size = (size_t)st.st_size;
+    if (file->map_size > 0) {
+        file->map = mmap(NULL, file->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file->map == MAP_FAILED) {
+            file->map = NULL;
+            close(fd);
+            free(file);
+            return EB_ERROR_FILE_IO;
+        }
+    }
+    close(fd);
+
+    const uint8_t* p = file->map;
+    eb_status_t status;
+    if (file->map_size >= NPY_MAGIC_SIZE && memcmp(p, NPY_MAGIC, NPY_MAGIC_SIZE) == 0) {
+        file->numpy = true;
+        file->arrays = &file->single;
+        status = eb_npy_parse(p, file->map_size, &file->single);
+        file->count = status == EB_SUCCESS;
+    } else if (file->map_size >= 4 && read32(p) == ZIP_LOCAL_SIG) {
+        file->numpy = true;
+        status = parse_npz(p, file->map_size, file);
+    } else {
+        file->arrays = &file->single;
+        status = parse_bin(p, file->map_size, dims, &file->single);
+        file->count = status == EB_SUCCESS;
+    }
+    if (status != EB_SUCCESS) {
+        DEBUG_WARN("Cannot load embedding file %s: %s", path, eb_status_str(status));
+        eb_embedding_file_close(file);
+        return status;
+    }
+
+    *out = file;
+    return EB_SUCCESS;
+}
+
+void eb_embedding_file_close(eb_embedding_file_t* file) {
+    if (!file)
+        return;
+    if (file->map)
+        munmap(file->map, file->map_size);
+    if (file->arrays != &file->single)
+        free(file->arrays);
+    free(file);
+}
+
+size_t eb_embedding_file_count(const eb_embedding_file_t* file) {
+    return file ? file->count : 0;
+}
+
+const eb_array_t* eb_embedding_file_array(const eb_embedding_file_t* file, size_t index) {
+    return file && index < file->count ? &file->arrays[index] : NULL;
+}
+
+const eb_array_t* eb_embedding_file_embeddings(const eb_embedding_file_t* file) {
+    if (!file || file->count == 0)
+        return NULL;
+    if (file->count == 1)
+        return &file->arrays[0];
+    for (size_t i = 0; i < file->count; i++) {
+        if (strcmp(file->arrays[i].name, "embeddings") == 0)
+            return &file->arrays[i];
+    }
+    return NULL;
+}
+
+bool eb_embedding_file_is_numpy(const eb_embedding_file_t* file) {
+    return file && file->numpy;
+}
+
+const void* eb_embedding_file_bytes(const eb_embedding_file_t* file, size_t* size_out) {
+    if (size_out)
+        *size_out = file ? file->map_size : 0;
+    return file ? file->map : NULL;
+}
+
+eb_status_t eb_array_rows(const eb_array_t* array, size_t* rows_out, size_t* dims_out) {
+    if (!array || !rows_out || !dims_out)
+        return EB_ERROR_INVALID_INPUT;
+    if (array->ndim == 1) {
+        *rows_out = 1;
+        *dims_out = array->shape[0];
+    } else if (array->ndim == 2) {
+        if (array->fortran_order && array->shape[0] > 1 && array->shape[1] > 1) {
+            DEBUG_WARN("Fortran-order matrices are not supported; save with np.ascontiguousarray()");
+            return EB_ERROR_UNSUPPORTED;
+        }
+        *rows_out = array->shape[0];
+        *dims_out = array->shape[1];
+    } else {
+        DEBUG_WARN("Expected a vector or a matrix, array has %d dimensions", array->ndim);
+        return EB_ERROR_UNSUPPORTED;
+    }
+    return *dims_out ? EB_SUCCESS : EB_ERROR_INVALID_FORMAT;
+}
+
+const void* eb_array_row(const eb_array_t* array, size_t row, size_t dims) {
+    return (const uint8_t*)array->data + row * dims * array->elem_size;
+}
+
+void eb_array_get(const eb_array_t* array, size_t start, size_t count, float* out) {
+    const uint8_t* p = (const uint8_t*)array->data + start * array->elem_size;
+    switch (array->dtype) {
+    case EB_FLOAT64:
+        for (size_t i = 0; i < count; i++) {
+            double value;
+            memcpy(&value, p + i * sizeof(double), sizeof(value));
+            out[i] = (float)value;
+        }
+        break;
+    case EB_FLOAT16:
+        for (size_t i = 0; i < count; i++) {
+            uint16_t value;
+            memcpy(&value, p + i * sizeof(uint16_t), sizeof(value));
+            out[i] = eb_fp16_to_float(value);
+        }
+        break;
+    default:
+        memcpy(out, p, count * sizeof(float));
+        break;
+    }
+}
@@ -0,0 +1,161 @@
+/*
+ * EmbeddingBridge - Embedding File Loader
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_EMBEDDING_FILE_H
+#define EB_EMBEDDING_FILE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+#include "types.h"
+
+/*
+ * One loader for the embedding files users hand us. The file is mapped
+ * and its arrays are returned as views into the mapping, nothing is
+ * copied:
+ *
+ *   .npy  NumPy format versions 1.0, 2.0 and 3.0. The header dict must
+ *         hold exactly 'descr', 'fortran_order' and 'shape'; descr is
+ *         a little-endian '<f4', '<f8' or '<f2', and the data must be
+ *         exactly as long as the shape says.
+ *   .npz  A zip of .npy members written by np.savez. Members must be
+ *         stored; np.savez_compressed archives are rejected since their
+ *         arrays cannot be viewed in place.
+ *   .bin  Bare little-endian float32 values.
+ *
+ * A 1-D array is one embedding; a C-order 2-D array is a batch of
+ * shape[0] embeddings of shape[1] values each.
+ */
+
+#define EB_ARRAY_MAX_NDIM 8
+
+/* Longest header eb_npy_header() writes */
+#define EB_NPY_HEADER_MAX 128
+
+/* Typed view of one array */
+typedef struct {
+    char name[64];                /* .npz member without ".npy", "" otherwise */
+    eb_dtype_t dtype;             /* EB_FLOAT32, EB_FLOAT64 or EB_FLOAT16 */
+    size_t elem_size;             /* Bytes per value */
+    bool fortran_order;
+    int ndim;
+    size_t shape[EB_ARRAY_MAX_NDIM];
+    const void* data;             /* Values; .npz members may be unaligned */
+    size_t size;                  /* Bytes of data */
+} eb_array_t;
+
+typedef struct eb_embedding_file eb_embedding_file_t;
+
+/**
+ * Parse a .npy file held in memory
+ *
+ * @param bytes File contents
+ * @param size Size of bytes
+ * @param array_out Receives the view; it points into bytes
+ * @return Status code (EB_ERROR_INVALID_FORMAT for a malformed header,
+ *         EB_ERROR_UNSUPPORTED for other dtypes or byte orders)
+ */
+eb_status_t eb_npy_parse(const void* bytes, size_t size, eb_array_t* array_out);
+
+/**
+ * Write a version 1.0 .npy header, padded so the data is 64-byte aligned
+ *
+ * @param dtype EB_FLOAT32, EB_FLOAT64 or EB_FLOAT16
+ * @param shape Shape of the array
+ * @param ndim Number of dimensions, at most EB_ARRAY_MAX_NDIM
+ * @param buf Receives the header, EB_NPY_HEADER_MAX bytes
+ * @return Header size, 0 if the dtype has no .npy equivalent or the header does not fit
+ */
+size_t eb_npy_header(eb_dtype_t dtype, const size_t* shape, int ndim, char buf[EB_NPY_HEADER_MAX]);
+
+/**
+ * Map an embedding file and parse its arrays
+ *
+ * The format is taken from the file's magic bytes, so a mislabelled
+ * extension does not matter. Bare floats are viewed as one embedding,
+ * or as rows of dims values if dims is given.
+ *
+ * @param path File to open
+ * @param dims Values per row of a .bin file, 0 for one embedding
+ * @param out Receives the file
+ * @return Status code (EB_ERROR_FILE_IO if it cannot be read,
+ *         EB_ERROR_INVALID_FORMAT or EB_ERROR_UNSUPPORTED as for eb_npy_parse())
+ */
+eb_status_t eb_embedding_file_open(const char* path, size_t dims, eb_embedding_file_t** out);
+
+/**
+ * Unmap a file; its array views become invalid
+ */
+void eb_embedding_file_close(eb_embedding_file_t* file);
+
+/**
+ * Number of arrays in a file, 1 except for .npz files
+ */
+size_t eb_embedding_file_count(const eb_embedding_file_t* file);
+
+/**
+ * Array at index, in archive order
+ */
+const eb_array_t* eb_embedding_file_array(const eb_embedding_file_t* file, size_t index);
+
+/**
+ * The embeddings of a file
+ *
+ * The only array, or the .npz member named "embeddings" if there are
+ * several.
+ *
+ * @return The array, NULL if a .npz holds several and none is named "embeddings"
+ */
+const eb_array_t* eb_embedding_file_embeddings(const eb_embedding_file_t* file);
+
+/**
+ * Whether the file is a .npy or .npz file rather than bare floats
+ */
+bool eb_embedding_file_is_numpy(const eb_embedding_file_t* file);
+
+/**
+ * The mapped file
+ *
+ * @param size_out Receives the file size
+ * @return Start of the mapping
+ */
+const void* eb_embedding_file_bytes(const eb_embedding_file_t* file, size_t* size_out);
+
+/**
+ * Rows and values per row of an array
+ *
+ * @param array Array to split
+ * @param rows_out Receives the number of embeddings
+ * @param dims_out Receives the values per embedding
+ * @return Status code (EB_ERROR_UNSUPPORTED for more than two dimensions
+ *         or a Fortran-order matrix, whose rows are not contiguous)
+ */
+eb_status_t eb_array_rows(const eb_array_t* array, size_t* rows_out, size_t* dims_out);
+
+/**
+ * Values of one row, in the array's dtype
+ *
+ * @param array Array from eb_array_rows()
+ * @param row Row index
+ * @param dims Values per row from eb_array_rows()
+ */
+const void* eb_array_row(const eb_array_t* array, size_t row, size_t dims);
+
+/**
+ * Convert values [start, start + count) of an array to float32
+ *
+ * @param array Array to read
+ * @param start First value, in storage order
+ * @param count Number of values
+ * @param out Receives count floats
+ */
+void eb_array_get(const eb_array_t* array, size_t start, size_t count, float* out);
+
+#endif /* EB_EMBEDDING_FILE_H */
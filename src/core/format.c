@@ -168,6 +168,10 @@ eb_format_type_t format_type_from_string(const char *format_str) {
         return EB_FORMAT_PARQUET;
     } else if (strcasecmp(format_str, "pinecone") == 0) {
         return EB_FORMAT_PINECONE;
+    } else if (strcasecmp(format_str, "arrow") == 0 ||
+               strcasecmp(format_str, "arrow-ipc") == 0 ||
+               strcasecmp(format_str, "feather") == 0) {
+        return EB_FORMAT_ARROW_IPC;
     }
     
     return EB_FORMAT_UNKNOWN;
@@ -181,6 +185,8 @@ const char *format_type_to_string(eb_format_type_t format_type) {
             return "parquet";
         case EB_FORMAT_PINECONE:
             return "pinecone";
+        case EB_FORMAT_ARROW_IPC:
+            return "arrow";
         default:
             return "unknown";
     }
@@ -198,6 +204,8 @@ eb_compression_type_t compression_type_from_string(const char *compression_str)
     } else if (strcasecmp(compression_str, "zstd") == 0 ||
                strncasecmp(compression_str, "zstd:", 5) == 0) {
         return EB_COMPRESSION_ZSTD;
+    } else if (strcasecmp(compression_str, "lz4") == 0) {
+        return EB_COMPRESSION_LZ4;
     }
     
     return EB_COMPRESSION_UNKNOWN;
@@ -209,6 +217,8 @@ const char *compression_type_to_string(eb_compression_type_t compression_type) {
             return "none";
         case EB_COMPRESSION_ZSTD:
             return "zstd";
+        case EB_COMPRESSION_LZ4:
+            return "lz4";
         default:
             return "unknown";
     }
@@ -241,6 +251,12 @@ eb_status_t parse_compression_string(
         return EB_SUCCESS;
     }
     
+    if (strcasecmp(compression_str, "lz4") == 0) {
+        *type_out = EB_COMPRESSION_LZ4;
+        *level_out = 0;
+        return EB_SUCCESS;
+    }
+    
     if (strncasecmp(compression_str, "zstd:", 5) == 0) {
         *type_out = EB_COMPRESSION_ZSTD;
         *level_out = atoi(compression_str + 5);
@@ -256,6 +272,108 @@ eb_status_t parse_compression_string(
     return EB_ERROR_INVALID_PARAMETER;
 }
 
+static bool parse_toggle(const char *value, eb_parquet_toggle_t *out) {
+    if (strcasecmp(value, "on") == 0 || strcasecmp(value, "true") == 0) {
+        *out = EB_PARQUET_ON;
+    } else if (strcasecmp(value, "off") == 0 || strcasecmp(value, "false") == 0) {
+        *out = EB_PARQUET_OFF;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* Positive count with an optional k or m suffix */
+static bool parse_count(const char *value, bool suffix, uint64_t *out) {
+    char *end = NULL;
+    if (!isdigit((unsigned char)value[0])) {
+        return false;
+    }
+    unsigned long long count = strtoull(value, &end, 10);
+    if (suffix && (*end == 'k' || *end == 'K')) {
+        count *= 1024;
+        end++;
+    } else if (suffix && (*end == 'm' || *end == 'M')) {
+        count *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || count == 0) {
+        return false;
+    }
+    *out = count;
+    return true;
+}
+
+eb_status_t format_parse_parquet_options(
+    const char *format_options,
+    eb_parquet_writer_options_t *options_out) {
+    
+    if (!options_out) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    memset(options_out, 0, sizeof(*options_out));
+    if (!format_options || !format_options[0]) {
+        return EB_SUCCESS;
+    }
+    
+    char buffer[sizeof(((eb_format_config_t *)0)->format_options)];
+    if (strlen(format_options) >= sizeof(buffer)) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    strcpy(buffer, format_options);
+    
+    char *saveptr = NULL;
+    for (char *pair = strtok_r(buffer, ",", &saveptr); pair; pair = strtok_r(NULL, ",", &saveptr)) {
+        while (isspace((unsigned char)*pair)) {
+            pair++;
+        }
+        char *value = strchr(pair, '=');
+        if (!value) {
+            DEBUG_ERROR("Parquet option without a value: %s", pair);
+            return EB_ERROR_INVALID_PARAMETER;
+        }
+        *value++ = '\0';
+        
+        bool valid;
+        if (strcmp(pair, "encoding") == 0) {
+            valid = true;
+            if (strcasecmp(value, "plain") == 0) {
+                options_out->values_encoding = EB_PARQUET_ENCODING_PLAIN;
+            } else if (strcasecmp(value, "byte_stream_split") == 0) {
+                options_out->values_encoding = EB_PARQUET_ENCODING_BYTE_STREAM_SPLIT;
+            } else {
+                valid = false;
+            }
+        } else if (strcmp(pair, "dictionary") == 0) {
+            valid = parse_toggle(value, &options_out->dictionary);
+        } else if (strncmp(pair, "dictionary.", 11) == 0) {
+            size_t n = options_out->column_count;
+            const char *column = pair + 11;
+            valid = n < EB_PARQUET_MAX_COLUMN_OPTIONS && column[0] &&
+                    strlen(column) < sizeof(options_out->columns[n].column) &&
+                    parse_toggle(value, &options_out->columns[n].dictionary);
+            if (valid) {
+                strcpy(options_out->columns[n].column, column);
+                options_out->column_count++;
+            }
+        } else if (strcmp(pair, "row_group_rows") == 0) {
+            valid = parse_count(value, false, &options_out->row_group_rows);
+        } else if (strcmp(pair, "page_size") == 0) {
+            valid = parse_count(value, true, &options_out->page_size);
+        } else if (strcmp(pair, "statistics") == 0) {
+            valid = parse_toggle(value, &options_out->statistics);
+        } else {
+            DEBUG_ERROR("Unknown Parquet option: %s", pair);
+            return EB_ERROR_INVALID_PARAMETER;
+        }
+        if (!valid) {
+            DEBUG_ERROR("Invalid value for Parquet option %s: %s", pair, value);
+            return EB_ERROR_INVALID_PARAMETER;
+        }
+    }
+    return EB_SUCCESS;
+}
+
 /*
  * Native format transformer implementation
  */
@@ -346,6 +464,13 @@ static void parquet_cleanup(eb_format_transformer_t *transformer) {
 }
 
 static eb_status_t parquet_transformer_init(eb_format_transformer_t *transformer) {
+    /* Writer tuning is checked up front, not on the first transform */
+    eb_parquet_writer_options_t options;
+    eb_status_t status = format_parse_parquet_options(transformer->config.format_options, &options);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    
     /* Initialize operations table if not already done */
     static int ops_initialized = 0;
     if (!ops_initialized) {
@@ -13,6 +13,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "types.h"
 #include "error.h"
 
@@ -23,6 +24,7 @@ typedef enum eb_format_type {
     EB_FORMAT_NATIVE,   /* Native .embr format with .raw and .meta files */
     EB_FORMAT_PARQUET,  /* Apache Parquet format with ZSTD compression */
     EB_FORMAT_PINECONE, /* Pinecone-compatible format */
+    EB_FORMAT_ARROW_IPC, /* Arrow IPC (Feather v2) set snapshots, see set_snapshot.h */
     EB_FORMAT_UNKNOWN   /* Unknown/unsupported format */
 } eb_format_type_t;
 
@@ -32,6 +34,7 @@ typedef enum eb_format_type {
 typedef enum eb_compression_type {
     EB_COMPRESSION_NONE,  /* No compression */
     EB_COMPRESSION_ZSTD,  /* ZSTD compression */
+    EB_COMPRESSION_LZ4,   /* LZ4 frame compression (Arrow IPC only) */
     EB_COMPRESSION_UNKNOWN /* Unknown/unsupported compression */
 } eb_compression_type_t;
 
@@ -46,6 +49,48 @@ typedef struct eb_format_config {
     char format_options[256];             /* Additional format-specific options */
 } eb_format_config_t;
 
+/**
+ * Parquet writer tuning, read from format_options
+ *
+ * format_options holds comma-separated key=value pairs:
+ *
+ *   encoding=plain|byte_stream_split   Encoding of the vector values
+ *   dictionary=on|off                  Dictionary encoding of every column
+ *   dictionary.<column>=on|off         Dictionary encoding of one column
+ *   row_group_rows=<count>             Rows per row group
+ *   page_size=<bytes>                  Data page size, k or m suffix allowed
+ *   statistics=on|off                  Column statistics
+ *
+ * e.g. "encoding=byte_stream_split,dictionary.source=on,page_size=1m".
+ * Zeroed fields keep the writer's defaults.
+ */
+typedef enum {
+    EB_PARQUET_DEFAULT = 0,
+    EB_PARQUET_ON,
+    EB_PARQUET_OFF
+} eb_parquet_toggle_t;
+
+typedef enum {
+    EB_PARQUET_ENCODING_DEFAULT = 0,  /* Dictionary, falling back to plain */
+    EB_PARQUET_ENCODING_PLAIN,
+    EB_PARQUET_ENCODING_BYTE_STREAM_SPLIT
+} eb_parquet_encoding_t;
+
+#define EB_PARQUET_MAX_COLUMN_OPTIONS 8
+
+typedef struct {
+    eb_parquet_encoding_t values_encoding; /* Encoding of the vector values */
+    eb_parquet_toggle_t dictionary;       /* Every column */
+    struct {
+        char column[64];                  /* Column path, e.g. "source" */
+        eb_parquet_toggle_t dictionary;
+    } columns[EB_PARQUET_MAX_COLUMN_OPTIONS];
+    size_t column_count;
+    uint64_t row_group_rows;              /* 0 for the writer's default */
+    uint64_t page_size;                   /* Data page bytes, 0 for the default */
+    eb_parquet_toggle_t statistics;
+} eb_parquet_writer_options_t;
+
 /* Forward declaration of format transformer */
 typedef struct eb_format_transformer eb_format_transformer_t;
 
@@ -202,4 +247,16 @@ eb_status_t parse_compression_string(
     int *level_out
 );
 
+/**
+ * Parse Parquet writer tuning from format_options
+ *
+ * @param format_options Options as described above, NULL or "" for the defaults
+ * @param options_out Receives the options
+ * @return Status code (EB_ERROR_INVALID_PARAMETER for an unknown key or bad value)
+ */
+eb_status_t format_parse_parquet_options(
+    const char *format_options,
+    eb_parquet_writer_options_t *options_out
+);
+
 #endif /* EB_FORMAT_H */ 
\ No newline at end of file
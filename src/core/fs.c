@@ -0,0 +1,272 @@
+/*
+ * EmbeddingBridge - Filesystem Utilities Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE /* For copy_file_range and syncfs */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif
+
+#include "fs.h"
+#include "debug.h"
+
+#define FS_COPY_BUFFER_SIZE (1024 * 1024)
+#define FS_COPY_CHUNK ((size_t)1 << 30)
+
+/* Errors meaning "not on this file system", as opposed to real I/O errors */
+static bool fs_copy_unsupported(int error) {
+    return error == EXDEV || error == EINVAL || error == ENOSYS || error == EOPNOTSUPP ||
+           error == ENOTTY || error == EBADF || error == EPERM || error == ENOTSUP;
+}
+
+static eb_status_t fs_copy_buffered(int src_fd, uint64_t offset, uint64_t length, int dst_fd) {
+    unsigned char* buffer = malloc(FS_COPY_BUFFER_SIZE);
+    if (!buffer) {
+        return EB_ERROR_MEMORY;
+    }
+
+    eb_status_t status = EB_SUCCESS;
+    while (length > 0 && status == EB_SUCCESS) {
+        size_t chunk = length < FS_COPY_BUFFER_SIZE ? (size_t)length : FS_COPY_BUFFER_SIZE;
+        ssize_t got = pread(src_fd, buffer, chunk, (off_t)offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            status = EB_ERROR_FILE_IO;
+            break;
+        }
+        for (ssize_t done = 0; done < got; ) {
+            ssize_t written = write(dst_fd, buffer + done, (size_t)(got - done));
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                status = EB_ERROR_FILE_IO;
+                break;
+            }
+            done += written;
+        }
+        offset += (uint64_t)got;
+        length -= (uint64_t)got;
+    }
+    free(buffer);
+    return status;
+}
+
+eb_status_t eb_fs_copy_fd(int src_fd, uint64_t offset, uint64_t length, int dst_fd,
+                          eb_fs_copy_method_t* method) {
+    if (src_fd < 0 || dst_fd < 0) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    if (method) {
+        *method = EB_FS_COPY_NONE;
+    }
+    if (length == 0) {
+        return EB_SUCCESS;
+    }
+
+#ifdef __linux__
+    /* A whole file into an empty file: share its extents */
+    struct stat src_st, dst_st;
+    if (offset == 0 && fstat(src_fd, &src_st) == 0 && (uint64_t)src_st.st_size == length &&
+        fstat(dst_fd, &dst_st) == 0 && S_ISREG(dst_st.st_mode) && dst_st.st_size == 0 &&
+        lseek(dst_fd, 0, SEEK_CUR) == 0 && ioctl(dst_fd, FICLONE, src_fd) == 0) {
+        lseek(dst_fd, 0, SEEK_END);
+        if (method) {
+            *method = EB_FS_COPY_REFLINK;
+        }
+        return EB_SUCCESS;
+    }
+
+    /* In the kernel, without a user-space buffer */
+    bool in_kernel = false;
+    loff_t src_offset = (loff_t)offset;
+    while (length > 0) {
+        size_t chunk = length < FS_COPY_CHUNK ? (size_t)length : FS_COPY_CHUNK;
+        ssize_t copied = copy_file_range(src_fd, &src_offset, dst_fd, NULL, chunk, 0);
+        if (copied < 0 && errno == EINTR) {
+            continue;
+        }
+        if (copied < 0 && !in_kernel && fs_copy_unsupported(errno)) {
+            break;
+        }
+        if (copied < 0) {
+            return EB_ERROR_FILE_IO;
+        }
+        if (copied == 0) {
+            /* Some file systems (procfs, FUSE) report 0 instead of failing */
+            if (!in_kernel) {
+                break;
+            }
+            return EB_ERROR_FILE_IO;
+        }
+        in_kernel = true;
+        length -= (uint64_t)copied;
+    }
+
+    off_t send_offset = (off_t)src_offset;
+    while (length > 0) {
+        size_t chunk = length < FS_COPY_CHUNK ? (size_t)length : FS_COPY_CHUNK;
+        ssize_t sent = sendfile(dst_fd, src_fd, &send_offset, chunk);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && !in_kernel && fs_copy_unsupported(errno)) {
+            break;
+        }
+        if (sent <= 0) {
+            return EB_ERROR_FILE_IO;
+        }
+        in_kernel = true;
+        length -= (uint64_t)sent;
+    }
+
+    if (length == 0) {
+        if (method) {
+            *method = EB_FS_COPY_KERNEL;
+        }
+        return EB_SUCCESS;
+    }
+    offset = (uint64_t)send_offset;
+#endif
+
+    /* Whatever the kernel already copied has moved the destination position */
+    eb_status_t status = fs_copy_buffered(src_fd, offset, length, dst_fd);
+    if (status == EB_SUCCESS && method) {
+        *method = EB_FS_COPY_BUFFERED;
+    }
+    return status;
+}
+
+/* Sibling of dst for building it before the rename, with XXXXXX to fill in */
+static eb_status_t fs_temp_path(const char* dst, char* temp, size_t temp_size) {
+    const char* name = strrchr(dst, '/');
+    int dir_length = name ? (int)(name - dst) + 1 : 0;
+    name = name ? name + 1 : dst;
+    if ((size_t)snprintf(temp, temp_size, "%.*s.%s.XXXXXX", dir_length, dst, name) >= temp_size) {
+        return EB_ERROR_PATH_TOO_LONG;
+    }
+    return EB_SUCCESS;
+}
+
+/* Hard link src to dst, replacing dst */
+static bool fs_link_file(const char* src, const char* dst) {
+    char temp[PATH_MAX];
+    if (fs_temp_path(dst, temp, sizeof(temp)) != EB_SUCCESS) {
+        return false;
+    }
+    /* link() wants a free name, mkstemp only reserves one */
+    int fd = mkstemp(temp);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    unlink(temp);
+    if (link(src, temp) != 0) {
+        return false;
+    }
+    if (rename(temp, dst) != 0) {
+        unlink(temp);
+        return false;
+    }
+    return true;
+}
+
+eb_status_t eb_fs_copy_file(const char* src, const char* dst, int flags,
+                            eb_fs_copy_method_t* method) {
+    if (!src || !dst) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    if (method) {
+        *method = EB_FS_COPY_NONE;
+    }
+
+    int src_fd = open(src, O_RDONLY);
+    if (src_fd < 0) {
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+    }
+    struct stat st;
+    if (fstat(src_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(src_fd);
+        return EB_ERROR_FILE_IO;
+    }
+
+    if ((flags & EB_FS_COPY_ALLOW_LINK) && fs_link_file(src, dst)) {
+        close(src_fd);
+        if (method) {
+            *method = EB_FS_COPY_HARDLINK;
+        }
+        return EB_SUCCESS;
+    }
+
+    char temp[PATH_MAX];
+    eb_status_t status = fs_temp_path(dst, temp, sizeof(temp));
+    int dst_fd = status == EB_SUCCESS ? mkstemp(temp) : -1;
+    if (dst_fd < 0) {
+        close(src_fd);
+        return status != EB_SUCCESS ? status : EB_ERROR_FILE_IO;
+    }
+    fchmod(dst_fd, st.st_mode & 0777);
+
+    status = eb_fs_copy_fd(src_fd, 0, (uint64_t)st.st_size, dst_fd, method);
+    close(src_fd);
+    if (close(dst_fd) != 0 && status == EB_SUCCESS) {
+        status = EB_ERROR_FILE_IO;
+    }
+    if (status == EB_SUCCESS && rename(temp, dst) != 0) {
+        status = EB_ERROR_FILE_IO;
+    }
+    if (status != EB_SUCCESS) {
+        unlink(temp);
+        return status;
+    }
+    DEBUG_PRINT("eb_fs_copy_file: %s -> %s (method %d)", src, dst, method ? (int)*method : -1);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_fs_sync_dir(const char* path) {
+    if (!path)
+        return EB_ERROR_INVALID_INPUT;
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+    bool ok = fsync(fd) == 0;
+    if (close(fd) != 0)
+        ok = false;
+    return ok ? EB_SUCCESS : EB_ERROR_FILE_IO;
+}
+
+eb_status_t eb_fs_sync_all(const char* path) {
+    if (!path)
+        return EB_ERROR_INVALID_INPUT;
+#ifdef __linux__
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+    bool ok = syncfs(fd) == 0;
+    if (close(fd) != 0)
+        ok = false;
+    return ok ? EB_SUCCESS : EB_ERROR_FILE_IO;
+#else
+    sync();
+    return EB_SUCCESS;
+#endif
+}
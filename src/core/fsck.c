@@ -0,0 +1,594 @@
+/*
+ * EmbeddingBridge - Repository Integrity Check Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fsck.h"
+#include "store.h"
+#include "pack.h"
+#include "object_path.h"
+#include "object_reader.h"
+#include "object_delta.h"
+#include "set_index.h"
+#include "set_layers.h"
+#include "set_compact.h"
+#include "log_index.h"
+#include "hash_set.h"
+#include "hash_utils.h"
+#include "distance.h"
+#include "remote.h"
+#include "thread_pool.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Objects claimed by a worker at a time */
+#define CHECK_BLOCK 64
+
+/* Relative error allowed in a stored norm, as float sums differ by order */
+#define NORM_TOLERANCE 1e-4f
+
+const char* eb_fsck_kind_name(eb_fsck_kind_t kind) {
+    switch (kind) {
+    case EB_FSCK_CORRUPT: return "corrupt";
+    case EB_FSCK_MISNAMED: return "misnamed";
+    case EB_FSCK_MISSING: return "missing";
+    case EB_FSCK_REMOTE_MISSING: return "remote-missing";
+    }
+    return "unknown";
+}
+
+void eb_fsck_report_free(eb_fsck_report_t* report) {
+    if (!report)
+        return;
+    for (size_t i = 0; i < report->problem_count; i++)
+        free(report->problems[i].where);
+    free(report->problems);
+    report->problems = NULL;
+    report->problem_count = 0;
+}
+
+static bool add_problem(eb_fsck_report_t* report, eb_fsck_kind_t kind, const char* hash,
+                        const char* where, eb_status_t status) {
+    size_t n = report->problem_count;
+    if (n == 0 || (n >= 16 && (n & (n - 1)) == 0)) {
+        size_t capacity = n ? n * 2 : 16;
+        eb_fsck_problem_t* grown = realloc(report->problems, capacity * sizeof(*grown));
+        if (!grown)
+            return false;
+        report->problems = grown;
+    }
+    eb_fsck_problem_t* p = &report->problems[report->problem_count];
+    if (!(p->where = strdup(where)))
+        return false;
+    p->kind = kind;
+    snprintf(p->hash, sizeof(p->hash), "%s", hash);
+    p->status = status;
+    report->problem_count++;
+    report->counts[kind]++;
+    return true;
+}
+
+static int compare_problems(const void* x, const void* y) {
+    const eb_fsck_problem_t* a = x;
+    const eb_fsck_problem_t* b = y;
+    if (a->kind != b->kind)
+        return a->kind < b->kind ? -1 : 1;
+    int cmp = strcmp(a->hash, b->hash);
+    return cmp ? cmp : strcmp(a->where, b->where);
+}
+
+/* ---- Stored objects ---- */
+
+typedef struct {
+    char hash[65];
+    char* path;             /* Loose object file relative to the root, NULL if packed */
+} fsck_object_t;
+
+typedef struct {
+    const char* root;
+    size_t root_len;
+    fsck_object_t* objects;
+    size_t count;
+    size_t capacity;
+    eb_hash_set_t* stored;  /* Every hash stored loose or packed */
+    eb_hash_set_t* packed;
+    eb_hash_set_t* referenced;
+    eb_fsck_report_t* report;
+    bool failed;            /* Out of memory */
+} fsck_ctx_t;
+
+/* A path below the root without the root */
+static const char* relative_path(const fsck_ctx_t* ctx, const char* path) {
+    if (strncmp(path, ctx->root, ctx->root_len) == 0 && path[ctx->root_len] == '/')
+        return path + ctx->root_len + 1;
+    return path;
+}
+
+static bool add_object(fsck_ctx_t* ctx, const char* hash, const char* path) {
+    if (ctx->count == ctx->capacity) {
+        size_t capacity = ctx->capacity ? ctx->capacity * 2 : 1024;
+        fsck_object_t* grown = realloc(ctx->objects, capacity * sizeof(*grown));
+        if (!grown)
+            return false;
+        ctx->objects = grown;
+        ctx->capacity = capacity;
+    }
+    fsck_object_t* o = &ctx->objects[ctx->count];
+    memcpy(o->hash, hash, 65);
+    o->path = NULL;
+    if (path && !(o->path = strdup(relative_path(ctx, path))))
+        return false;
+    ctx->count++;
+    return eb_hash_set_add_hex(ctx->stored, hash, NULL) == EB_SUCCESS;
+}
+
+static int collect_loose(const char* hex_hash, const char* ext, const char* path,
+                         const struct stat* st, void* data) {
+    fsck_ctx_t* ctx = data;
+    (void)st;
+    if (strcmp(ext, "raw") != 0)
+        return 0;
+    if (!add_object(ctx, hex_hash, path)) {
+        ctx->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+/* Packed objects once each, though several packs may hold one */
+static int collect_packed(const char* hex_hash, uint64_t length, time_t mtime, void* data) {
+    fsck_ctx_t* ctx = data;
+    (void)length;
+    (void)mtime;
+    bool added = false;
+    eb_status_t status = eb_hash_set_add_hex(ctx->packed, hex_hash, &added);
+    if (status == EB_SUCCESS && !added)
+        return 0;
+    if (status != EB_SUCCESS || !add_object(ctx, hex_hash, NULL)) {
+        ctx->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+/* ---- References ---- */
+
+/* Record a referenced hash, and a problem the first time one that is not stored turns up */
+static void note_reference(fsck_ctx_t* ctx, const char* hash, size_t len, const char* where) {
+    char hex[65];
+    if (ctx->failed || len != 64)
+        return;
+    memcpy(hex, hash, 64);
+    hex[64] = '\0';
+    bool added = false;
+    eb_status_t status = eb_hash_set_add_hex(ctx->referenced, hex, &added);
+    if (status == EB_ERROR_MEMORY_ALLOCATION) {
+        ctx->failed = true;
+        return;
+    }
+    if (status != EB_SUCCESS || !added)
+        return;     /* Not a hash, such as a tombstone, or seen before */
+    ctx->report->references++;
+    if (!eb_hash_set_contains_hex(ctx->stored, hex) &&
+        !add_problem(ctx->report, EB_FSCK_MISSING, hex, relative_path(ctx, where), EB_SUCCESS))
+        ctx->failed = true;
+}
+
+/* Note the hash in a space-separated field of every line of a file */
+static void note_file_field(fsck_ctx_t* ctx, const char* path, int field) {
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+        return;
+    char* line = NULL;
+    size_t cap = 0;
+    while (!ctx->failed && getline(&line, &cap, fp) > 0) {
+        const char* p = line;
+        for (int i = 0; i < field && *p; i++) {
+            p += strcspn(p, " \t\n");
+            p += strspn(p, " \t");
+        }
+        note_reference(ctx, p, strcspn(p, " \t\n"), path);
+    }
+    free(line);
+    fclose(fp);
+}
+
+/* Hashes of the log lines a tombstone did not end, as eb_set_compact() keeps them */
+typedef struct {
+    fsck_ctx_t* ctx;
+    const char* path;
+    const eb_tombstones_t* tombstones;
+    uint64_t line;
+} log_refs_t;
+
+static int note_log_entry(const eb_log_entry_t* entry, void* data) {
+    log_refs_t* refs = data;
+    uint64_t line = refs->line++, ended;
+    if (eb_tombstones_newest(refs->tombstones, entry->source, entry->model, &ended) &&
+        line <= ended)
+        return 0;   /* Removed, its objects may be gone */
+    note_reference(refs->ctx, entry->hash, strlen(entry->hash), refs->path);
+    return refs->ctx->failed;
+}
+
+static void note_log(fsck_ctx_t* ctx, const char* path) {
+    eb_tombstones_t* tombstones = NULL;
+    eb_status_t status = eb_tombstones_load(path, &tombstones);
+    if (status == EB_SUCCESS && eb_tombstones_count(tombstones) == 0) {
+        eb_tombstones_free(tombstones);
+        note_file_field(ctx, path, 1);
+        return;
+    }
+    if (status != EB_SUCCESS) {
+        if (status == EB_ERROR_MEMORY_ALLOCATION)
+            ctx->failed = true;
+        else
+            DEBUG_PRINT("fsck: cannot read log %s", path);
+        return;
+    }
+
+    log_refs_t refs = { ctx, path, tombstones, 0 };
+    if (eb_log_foreach_range(path, 0, UINT64_MAX, note_log_entry, &refs, NULL) != EB_SUCCESS)
+        DEBUG_PRINT("fsck: cannot read log %s", path);
+    eb_tombstones_free(tombstones);
+}
+
+/* Hashes of a set index, for the comparison with a remote */
+typedef struct {
+    fsck_ctx_t* ctx;
+    const char* where;
+    char (*hashes)[65];
+    size_t count;
+    size_t capacity;
+} index_refs_t;
+
+static int note_index_entry(const char* source, const char* model, const char* hash, void* data) {
+    index_refs_t* refs = data;
+    (void)source;
+    (void)model;
+    note_reference(refs->ctx, hash, strlen(hash), refs->where);
+    if (refs->ctx->failed)
+        return 1;
+    if (refs->count == refs->capacity) {
+        size_t capacity = refs->capacity ? refs->capacity * 2 : 256;
+        char (*grown)[65] = realloc(refs->hashes, capacity * sizeof(*grown));
+        if (!grown) {
+            refs->ctx->failed = true;
+            return 1;
+        }
+        refs->hashes = grown;
+        refs->capacity = capacity;
+    }
+    snprintf(refs->hashes[refs->count++], 65, "%s", hash);
+    return 0;
+}
+
+static int compare_hex(const void* a, const void* b) {
+    return strcmp(a, b);
+}
+
+/* Entries of a set index the remote's manifest for the set does not list */
+static eb_status_t check_remote(fsck_ctx_t* ctx, const char* remote, const char* set,
+                                index_refs_t* refs) {
+    char path[PATH_MAX], where[PATH_MAX];
+    snprintf(path, sizeof(path), "sets/%s", set);
+    eb_remote_have_t have = {0};
+    eb_status_t status = eb_remote_have_fetch(remote, path, &have);
+    if (status == EB_ERROR_NOT_FOUND) {
+        DEBUG_PRINT("fsck: set %s was never pushed to %s", set, remote);
+        return EB_SUCCESS;
+    }
+    if (status != EB_SUCCESS)
+        return status;
+
+    ctx->report->remote_sets++;
+    snprintf(where, sizeof(where), "%s:%s", remote, path);
+    qsort(refs->hashes, refs->count, sizeof(*refs->hashes), compare_hex);
+    for (size_t i = 0; i < refs->count && !ctx->failed; i++) {
+        if (i > 0 && strcmp(refs->hashes[i], refs->hashes[i - 1]) == 0)
+            continue;
+        if (!eb_remote_have_contains(&have, refs->hashes[i]) &&
+            !add_problem(ctx->report, EB_FSCK_REMOTE_MISSING, refs->hashes[i], where, EB_SUCCESS))
+            ctx->failed = true;
+    }
+    eb_remote_have_free(&have);
+    return EB_SUCCESS;
+}
+
+/* Every reference of one set: index, log, base layer logs and model refs */
+static eb_status_t check_set(fsck_ctx_t* ctx, const char* set_dir, const char* set,
+                             const char* remote) {
+    char path[PATH_MAX];
+    struct stat st;
+    eb_status_t status = EB_SUCCESS;
+
+    snprintf(path, sizeof(path), "%s/index", set_dir);
+    index_refs_t refs = { ctx, path, NULL, 0, 0 };
+    if (stat(path, &st) == 0) {
+        eb_set_index_t* index = NULL;
+        status = eb_set_index_open(ctx->root, path, &index);
+        if (status == EB_SUCCESS) {
+            status = eb_set_index_foreach(index, NULL, note_index_entry, &refs);
+            eb_set_index_close(index);
+        }
+        if (status != EB_SUCCESS)
+            DEBUG_PRINT("fsck: cannot read set index %s", path);
+    }
+    if (status == EB_SUCCESS && !ctx->failed && remote)
+        status = check_remote(ctx, remote, set, &refs);
+    free(refs.hashes);
+    if (status != EB_SUCCESS)
+        return status;
+
+    char log_path[PATH_MAX];
+    snprintf(log_path, sizeof(log_path), "%s/log", set_dir);
+    note_log(ctx, log_path);
+
+    eb_set_layers_t layers;
+    status = eb_set_layers_load(set_dir, &layers);
+    if (status != EB_SUCCESS)
+        return status;
+    for (size_t i = 0; i < layers.count && !ctx->failed; i++) {
+        eb_set_layer_path(log_path, &layers.items[i], "log", path, sizeof(path));
+        note_log(ctx, path);
+    }
+    eb_set_layers_free(&layers);
+
+    char refs_dir[PATH_MAX];
+    snprintf(refs_dir, sizeof(refs_dir), "%s/refs/models", set_dir);
+    DIR* dir = opendir(refs_dir);
+    if (dir) {
+        struct dirent* ref;
+        while (!ctx->failed && (ref = readdir(dir)) != NULL) {
+            if (ref->d_name[0] == '.')
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", refs_dir, ref->d_name);
+            note_file_field(ctx, path, 0);
+        }
+        closedir(dir);
+    }
+    return EB_SUCCESS;
+}
+
+/* The base of a stored delta must be stored too */
+static int note_delta_base(const char* hash, const char* base, void* data) {
+    fsck_ctx_t* ctx = data;
+    char where[PATH_MAX];
+    if (!eb_hash_set_contains_hex(ctx->stored, hash))
+        return 0;
+    snprintf(where, sizeof(where), "%s/%s", ctx->root, EB_DELTA_FILE);
+    note_reference(ctx, base, strlen(base), where);
+    return ctx->failed ? 1 : 0;
+}
+
+static eb_status_t check_references(fsck_ctx_t* ctx, const char* remote) {
+    char sets_dir[PATH_MAX];
+    snprintf(sets_dir, sizeof(sets_dir), "%s/.embr/sets", ctx->root);
+    DIR* dir = opendir(sets_dir);
+    eb_status_t status = EB_SUCCESS;
+    if (dir) {
+        struct dirent* entry;
+        struct stat st;
+        while (status == EB_SUCCESS && !ctx->failed && (entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.')
+                continue;
+            char set_dir[PATH_MAX];
+            snprintf(set_dir, sizeof(set_dir), "%s/%s", sets_dir, entry->d_name);
+            if (stat(set_dir, &st) != 0 || !S_ISDIR(st.st_mode))
+                continue;
+            ctx->report->sets++;
+            status = check_set(ctx, set_dir, entry->d_name, remote);
+        }
+        closedir(dir);
+    }
+    if (status == EB_SUCCESS && !ctx->failed)
+        status = eb_delta_foreach(ctx->root, note_delta_base, ctx);
+    return ctx->failed ? EB_ERROR_MEMORY_ALLOCATION : status;
+}
+
+/* ---- Verification ---- */
+
+typedef struct {
+    const char* root;
+    const eb_pack_set_t* packs;
+    const fsck_object_t* objects;
+    size_t count;
+    size_t next_block;
+    size_t done;
+    const eb_fsck_options_t* options;
+    eb_fsck_report_t* report;
+    pthread_mutex_t lock;
+    eb_status_t error;
+} check_job_t;
+
+/* Outcome of the objects of one block */
+typedef struct {
+    const fsck_object_t* objects;
+    size_t loose_index[CHECK_BLOCK];    /* Block position of each loose object read */
+    eb_fsck_kind_t kind[CHECK_BLOCK];   /* 0 if intact */
+    eb_status_t status[CHECK_BLOCK];
+    uint64_t bytes;
+} check_block_t;
+
+/* The norm a vector keeps behind its payload, which no hash covers, must be its own */
+static eb_status_t check_norm(const eb_object_view_t* view) {
+    eb_vector_ref_t ref;
+    if (view->header.obj_type != EB_OBJ_VECTOR || view->norm < 0.0f ||
+        eb_object_vector_ref(view, &ref) != EB_SUCCESS)
+        return EB_SUCCESS;
+    ref.norm = -1.0f;       /* Computed from the values, not read back */
+    float norm = eb_vector_norm(&ref);
+    float scale = norm > 1.0f ? norm : 1.0f;
+    return fabsf(view->norm - norm) <= NORM_TOLERANCE * scale ? EB_SUCCESS : EB_ERROR_INVALID_DATA;
+}
+
+static void check_view(check_block_t* block, size_t i, eb_status_t status,
+                       const eb_object_view_t* view) {
+    if (status == EB_SUCCESS)
+        status = check_norm(view);
+    block->status[i] = status;
+    if (status != EB_SUCCESS) {
+        block->kind[i] = EB_FSCK_CORRUPT;
+        return;
+    }
+    block->bytes += view->record_size;
+    char named[65];
+    eb_hash_to_hex(view->header.hash, named);
+    block->kind[i] = view->header.obj_type == EB_OBJ_VECTOR &&
+                     strcmp(named, block->objects[i].hash) != 0 ? EB_FSCK_MISNAMED : 0;
+}
+
+static int check_loose(void* ctx, size_t index, eb_status_t status, eb_object_view_t* view) {
+    check_block_t* block = ctx;
+    check_view(block, block->loose_index[index], status, view);
+    return 0;
+}
+
+static void check_block(eb_store_t* store, check_job_t* job, size_t first, size_t end) {
+    check_block_t block = { .objects = job->objects + first, .bytes = 0 };
+    const char* hashes[CHECK_BLOCK];
+    size_t count = end - first, loose = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (block.objects[i].path) {
+            block.loose_index[loose] = i;
+            hashes[loose++] = block.objects[i].hash;
+        }
+    }
+
+    // A failure of the reader itself says nothing about the objects
+    eb_status_t error = loose ? eb_object_read_many(store, hashes, loose, NULL, check_loose, &block)
+                              : EB_SUCCESS;
+
+    // The packed copy itself, which a map would skip for a loose one
+    for (size_t i = 0; i < count; i++) {
+        if (block.objects[i].path)
+            continue;
+        void* record = NULL;
+        size_t size = 0;
+        eb_object_view_t view;
+        eb_status_t status = eb_pack_read(job->packs, block.objects[i].hash, &record, &size);
+        if (status == EB_SUCCESS)
+            status = eb_object_view_record(store, block.objects[i].hash, record, size, 0, &view);
+        check_view(&block, i, status, &view);
+        if (status == EB_SUCCESS)
+            eb_object_unmap(&view);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    for (size_t i = 0; i < count && error == EB_SUCCESS; i++) {
+        if (block.kind[i] && !add_problem(job->report, block.kind[i], block.objects[i].hash,
+                                          block.objects[i].path ? block.objects[i].path : "packed",
+                                          block.status[i]))
+            error = EB_ERROR_MEMORY_ALLOCATION;
+    }
+    if (error != EB_SUCCESS)
+        job->error = error;
+    job->report->bytes += block.bytes;
+    job->done += count;
+    if (job->options->progress)
+        job->options->progress(job->options->progress_ctx, job->done, job->count);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/* Claim blocks of objects until none are left; a worker without a store leaves them to the others */
+static void check_worker(void* arg) {
+    check_job_t* job = arg;
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = (char*)job->root };
+    if (eb_store_init(&config, &store) != EB_SUCCESS)
+        return;
+
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * CHECK_BLOCK;
+        if (first >= job->count)
+            break;
+        size_t end = job->count - first < CHECK_BLOCK ? job->count : first + CHECK_BLOCK;
+        check_block(store, job, first, end);
+    }
+    eb_store_destroy(store);
+}
+
+static eb_status_t check_objects(const char* root, const eb_pack_set_t* packs, const fsck_ctx_t* ctx,
+                                 const eb_fsck_options_t* options) {
+    check_job_t job = { root, packs, ctx->objects, ctx->count, 0, 0, options, ctx->report,
+                        PTHREAD_MUTEX_INITIALIZER, EB_SUCCESS };
+    eb_parallel_run(NULL, eb_pool_threads(options->threads, (ctx->count + CHECK_BLOCK - 1) / CHECK_BLOCK),
+                    check_worker, &job);
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.error != EB_SUCCESS)
+        return job.error;
+    // Objects are only left over if no worker could open the store
+    return job.done == job.count ? EB_SUCCESS : EB_ERROR_NOT_INITIALIZED;
+}
+
+eb_status_t eb_fsck(const char* root, const eb_fsck_options_t* options, eb_fsck_report_t* report) {
+    if (!root || !report)
+        return EB_ERROR_INVALID_INPUT;
+    memset(report, 0, sizeof(*report));
+    eb_fsck_options_t defaults = {0};
+    if (!options)
+        options = &defaults;
+
+    fsck_ctx_t ctx = { .root = root, .root_len = strlen(root), .report = report };
+    eb_pack_set_t* packs = NULL;
+    eb_status_t status = eb_hash_set_create(0, &ctx.stored);
+    if (status == EB_SUCCESS)
+        status = eb_hash_set_create(0, &ctx.packed);
+    if (status == EB_SUCCESS)
+        status = eb_hash_set_create(0, &ctx.referenced);
+    if (status == EB_SUCCESS)
+        status = eb_pack_open(root, &packs);
+
+    // Everything stored, loose copies first
+    if (status == EB_SUCCESS) {
+        status = eb_object_foreach(root, collect_loose, &ctx);
+        if (status == EB_ERROR_NOT_FOUND)
+            status = EB_SUCCESS;
+    }
+    size_t loose = ctx.count;
+    if (status == EB_SUCCESS && !ctx.failed)
+        status = eb_pack_foreach(packs, collect_packed, &ctx);
+    if (ctx.failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    if (status == EB_SUCCESS)
+        status = check_references(&ctx, options->remote);
+    if (status == EB_SUCCESS) {
+        status = check_objects(root, packs, &ctx, options);
+        report->loose = loose;
+        report->packed = ctx.count - loose;
+    }
+    if (status == EB_SUCCESS)
+        DEBUG_PRINT("fsck: %zu objects, %zu references, %zu problems", ctx.count, report->references,
+                    report->problem_count);
+
+    if (report->problem_count)
+        qsort(report->problems, report->problem_count, sizeof(*report->problems), compare_problems);
+    for (size_t i = 0; i < ctx.count; i++)
+        free(ctx.objects[i].path);
+    free(ctx.objects);
+    eb_pack_close(packs);
+    eb_hash_set_destroy(ctx.referenced);
+    eb_hash_set_destroy(ctx.packed);
+    eb_hash_set_destroy(ctx.stored);
+    return status;
+}
@@ -0,0 +1,94 @@
+/*
+ * EmbeddingBridge - Repository Integrity Check
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_FSCK_H
+#define EB_FSCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * Verifies every stored object and every reference to one:
+ *
+ *   - each loose vector object and each packed object is decoded as a
+ *     read would decode it (header, decompression, deltas) and rehashed,
+ *     and its header must name the hash it is stored under; a packed
+ *     object with a loose copy is checked in both places
+ *   - every hash in a set's index, log, base layer logs and model refs,
+ *     and the base of every recorded delta that is stored, must be stored;
+ *     log lines a tombstone ended are skipped, as eb_set_compact() drops
+ *     them (set_compact.h)
+ *   - with a remote, every entry of a set index must be listed in the
+ *     have manifest of that set on the remote, for the sets pushed there
+ *
+ * Objects are read in blocks across the thread pool, loose ones with the
+ * batched reader, each worker with a store of its own.
+ */
+
+typedef enum {
+    EB_FSCK_CORRUPT = 1,        /* Stored, but does not decode or rehash to its content */
+    EB_FSCK_MISNAMED,           /* Intact, but its header names another hash */
+    EB_FSCK_MISSING,            /* Referenced but stored neither loose nor packed */
+    EB_FSCK_REMOTE_MISSING      /* In a set index but not on the remote */
+} eb_fsck_kind_t;
+
+typedef struct {
+    eb_fsck_kind_t kind;
+    char hash[65];
+    char* where;                /* Object file, "packed", or the file holding the reference,
+                                   relative to the repository root */
+    eb_status_t status;         /* Why a corrupt object failed, EB_SUCCESS otherwise */
+} eb_fsck_problem_t;
+
+/*
+ * Called after each block of objects is checked, never for two blocks at
+ * once, from whichever thread checked it
+ */
+typedef void (*eb_fsck_progress_fn)(void* ctx, size_t done, size_t total);
+
+typedef struct {
+    unsigned threads;           /* Worker threads, 0 for one per online CPU */
+    const char* remote;         /* Remote to compare the sets with, NULL for none;
+                                   needs eb_remote_init() */
+    eb_fsck_progress_fn progress;
+    void* progress_ctx;
+} eb_fsck_options_t;
+
+typedef struct {
+    size_t loose;               /* Loose objects checked */
+    size_t packed;              /* Packed objects checked */
+    uint64_t bytes;             /* Stored bytes of the objects that decoded */
+    size_t references;          /* Distinct hashes referenced */
+    size_t sets;
+    size_t remote_sets;         /* Sets compared with the remote's manifests */
+    size_t counts[EB_FSCK_REMOTE_MISSING + 1];  /* Problems by kind */
+    eb_fsck_problem_t* problems;    /* Sorted by kind, hash and where */
+    size_t problem_count;
+} eb_fsck_report_t;
+
+/**
+ * Check the integrity of a repository
+ *
+ * @param root Repository root
+ * @param options Options, NULL for defaults
+ * @param report Receives what was found, free with eb_fsck_report_free();
+ *               filled in as far as the check got when it fails
+ * @return Status code (0 = success, whether or not problems were found;
+ *         a failure means the check could not be completed)
+ */
+eb_status_t eb_fsck(const char* root, const eb_fsck_options_t* options, eb_fsck_report_t* report);
+
+void eb_fsck_report_free(eb_fsck_report_t* report);
+
+/* "corrupt", "misnamed", "missing" or "remote-missing" */
+const char* eb_fsck_kind_name(eb_fsck_kind_t kind);
+
+#endif /* EB_FSCK_H */
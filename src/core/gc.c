@@ -25,6 +25,14 @@
 #include "error.h"
 #include "path_utils.h"
 #include "debug.h"
+#include "pack.h"
+#include "object_path.h"
+#include "store.h"
+#include "hash_set.h"
+#include "set_index.h"
+#include "set_layers.h"
+#include "set_compact.h"
+#include "object_delta.h"
 
 /* Define PATH_MAX if not available */
 #ifndef PATH_MAX
@@ -38,9 +46,13 @@
 #define GC_LOCK_FILE "gc.lock"
 
 /* Forward declarations for helper functions */
-static int remove_unreferenced_embeddings(const char* objects_dir, time_t expire_time);
-static bool is_referenced(const char* object_id);
+static int remove_unreferenced_embeddings(const char* repo_path, time_t expire_time,
+					  const eb_hash_set_t* referenced, size_t* bytes_freed);
+static bool is_referenced(const eb_hash_set_t* referenced, const char* object_id);
 static time_t parse_expire_time(const char* expire_str);
+static bool gc_lock(const char* repo_path, char* lock_path, size_t lock_size);
+static int prune_packed_objects(const char* repo_path, time_t expire_time, bool aggressive,
+				const eb_hash_set_t* referenced, size_t* bytes_freed);
 
 /**
  * Run garbage collection on the repository
@@ -58,6 +70,7 @@ eb_status_t gc_run(const char* prune_expire, bool aggressive, eb_gc_result_t* re
 		result->message[0] = '\0';
 		result->objects_removed = 0;
 		result->bytes_freed = 0;
+		result->pending = false;
 	}
 
 	/* Check if another GC is running */
@@ -81,10 +94,7 @@ eb_status_t gc_run(const char* prune_expire, bool aggressive, eb_gc_result_t* re
 
 	/* Create GC lock file */
 	char lock_path[PATH_MAX];
-	int lock_fd;
-	snprintf(lock_path, sizeof(lock_path), "%s/%s", repo_path, GC_LOCK_FILE);
-	lock_fd = open(lock_path, O_CREAT | O_EXCL | O_WRONLY, 0644);
-	if (lock_fd < 0) {
+	if (!gc_lock(repo_path, lock_path, sizeof(lock_path))) {
 		if (result) {
 			result->status = EB_ERROR_LOCK_FAILED;
 			strcpy(result->message, "Failed to create GC lock file");
@@ -92,22 +102,11 @@ eb_status_t gc_run(const char* prune_expire, bool aggressive, eb_gc_result_t* re
 		free(repo_path);
 		return EB_ERROR_LOCK_FAILED;
 	}
-	
-	/* Write PID to lock file */
-	char pid_str[16];
-	snprintf(pid_str, sizeof(pid_str), "%d\n", (int)getpid());
-	write(lock_fd, pid_str, strlen(pid_str));
-	close(lock_fd);
 
 	/* Determine expiration time */
 	time_t expire_time;
-	if (!prune_expire) {
-		/* Default: 2 weeks ago */
-		expire_time = time(NULL) - DEFAULT_PRUNE_EXPIRE_SECONDS;
-	} else if (strcmp(prune_expire, "now") == 0) {
-		/* No grace period */
-		expire_time = time(NULL);
-	} else if (strcmp(prune_expire, "never") == 0) {
+	int expire = gc_resolve_expire(prune_expire, &expire_time);
+	if (expire > 0) {
 		/* Don't prune */
 		if (result) {
 			sprintf(result->message, "Pruning disabled, no objects removed");
@@ -115,17 +114,14 @@ eb_status_t gc_run(const char* prune_expire, bool aggressive, eb_gc_result_t* re
 		unlink(lock_path); /* Remove lock file */
 		free(repo_path);
 		return EB_SUCCESS;
-	} else {
-		expire_time = parse_expire_time(prune_expire);
-		if (expire_time == 0) {
-			if (result) {
-				result->status = EB_ERROR_INVALID_PARAMETER;
-				sprintf(result->message, "Invalid expiration format: %s", prune_expire);
-			}
-			unlink(lock_path); /* Remove lock file */
-			free(repo_path);
-			return EB_ERROR_INVALID_PARAMETER;
+	} else if (expire < 0) {
+		if (result) {
+			result->status = EB_ERROR_INVALID_PARAMETER;
+			sprintf(result->message, "Invalid expiration format: %s", prune_expire);
 		}
+		unlink(lock_path); /* Remove lock file */
+		free(repo_path);
+		return EB_ERROR_INVALID_PARAMETER;
 	}
 
 	/* Get objects directory path */
@@ -149,20 +145,48 @@ eb_status_t gc_run(const char* prune_expire, bool aggressive, eb_gc_result_t* re
 		return EB_ERROR_NOT_INITIALIZED;
 	}
 
-	/* Remove unreferenced objects */
-	int removed = remove_unreferenced_embeddings(objects_dir, expire_time);
+	/* Fold in the removals first, so the history they purge is garbage */
+	if (eb_set_compact_all(repo_path) != EB_SUCCESS)
+		DEBUG_PRINT("gc_run: Failed to compact some sets");
+
+	/* Mark: every hash the sets reference, read once for the whole run */
+	eb_hash_set_t* referenced = gc_load_referenced(repo_path);
+	if (!referenced) {
+		if (result) {
+			result->status = EB_ERROR_MEMORY_ALLOCATION;
+			strcpy(result->message, "Failed to load set references");
+		}
+		unlink(lock_path);
+		free(repo_path);
+		return EB_ERROR_MEMORY_ALLOCATION;
+	}
+
+	/* Sweep: one walk of the loose objects, one lookup each */
+	size_t bytes_freed = 0;
+	int removed = remove_unreferenced_embeddings(repo_path, expire_time, referenced, &bytes_freed);
+
+	/* Packed objects can only be dropped by rewriting the packs holding them;
+	 * aggressive mode repacks everything, remaining loose objects included */
+	int pruned = prune_packed_objects(repo_path, expire_time, aggressive, referenced, &bytes_freed);
+	eb_hash_set_destroy(referenced);
+	if (pruned < 0) {
+		if (result) {
+			result->status = EB_ERROR_FILE_IO;
+			strcpy(result->message, "Failed to repack objects");
+		}
+		unlink(lock_path);
+		free(repo_path);
+		return EB_ERROR_FILE_IO;
+	}
+	removed += pruned;
 	
 	if (result) {
 		result->objects_removed = removed;
+		result->bytes_freed = bytes_freed;
 	}
 
 	/* Additional aggressive optimization if requested */
 	if (aggressive) {
-		/* TODO: Implement additional optimizations like:
-		 * - Repack embeddings
-		 * - Optimize indices
-		 * - Compress data
-		 */
 		if (result) {
 			strcat(result->message, " (aggressive mode)");
 		}
@@ -221,6 +245,53 @@ bool gc_is_running(void)
 	return false;
 }
 
+/* State for collecting unreferenced loose objects */
+struct find_loose_ctx {
+	const eb_hash_set_t* referenced;
+	char** out;
+	size_t max;
+	size_t* count;
+	time_t expire_time;
+};
+
+static int find_loose_visit(const char* hex_hash, const char* ext, const char* path,
+			    const struct stat* st, void* data)
+{
+	struct find_loose_ctx* ctx = data;
+	(void)path;
+
+	if (*ctx->count >= ctx->max)
+		return 1;
+	if (!is_referenced(ctx->referenced, hex_hash) && st->st_mtime < ctx->expire_time) {
+		/* Report the file name as it appears in the flat layout */
+		char name[PATH_MAX];
+		snprintf(name, sizeof(name), "%s%s%s", hex_hash, *ext ? "." : "", ext);
+		ctx->out[(*ctx->count)++] = strdup(name);
+	}
+	return 0;
+}
+
+/* State for collecting unreferenced packed objects */
+struct find_packed_ctx {
+	const eb_hash_set_t* referenced;
+	char** out;
+	size_t max;
+	size_t* count;
+	time_t expire_time;
+};
+
+static int find_packed_visit(const char* hex_hash, uint64_t length, time_t mtime, void* data)
+{
+	struct find_packed_ctx* ctx = data;
+	(void)length;
+
+	if (*ctx->count >= ctx->max)
+		return 1;
+	if (mtime < ctx->expire_time && !is_referenced(ctx->referenced, hex_hash))
+		ctx->out[(*ctx->count)++] = strdup(hex_hash);
+	return 0;
+}
+
 /**
  * Find unreferenced embedding objects
  * 
@@ -257,41 +328,48 @@ eb_status_t gc_find_unreferenced(char** unreferenced_out,
 		return EB_ERROR_NOT_INITIALIZED;
 	}
 	
-	/* Scan objects directory */
-	DIR* dir = opendir(objects_dir);
-	if (!dir) {
+	eb_hash_set_t* referenced = gc_load_referenced(repo_path);
+	if (!referenced) {
 		free(repo_path);
-		return EB_ERROR_IO;
+		return EB_ERROR_MEMORY_ALLOCATION;
 	}
-	
-	struct dirent* entry;
-	
-	while ((entry = readdir(dir)) != NULL && *count_out < max_unreferenced) {
-		if (entry->d_name[0] == '.')
-			continue;
-		
-		char object_path[PATH_MAX];
-		snprintf(object_path, sizeof(object_path), "%s/%s", objects_dir, entry->d_name);
-		
-		/* Check if it's a file */
-		if (stat(object_path, &st) == 0 && S_ISREG(st.st_mode)) {
-			/* Check if it's unreferenced */
-			if (!is_referenced(entry->d_name)) {
-				/* Check if it's older than expire_time */
-				if (st.st_mtime < expire_time) {
-					/* Add to unreferenced list */
-					unreferenced_out[*count_out] = strdup(entry->d_name);
-					(*count_out)++;
-				}
-			}
-		}
+
+	/* Scan loose objects in either layout */
+	struct find_loose_ctx loose = {
+		.referenced = referenced,
+		.out = unreferenced_out,
+		.max = max_unreferenced,
+		.count = count_out,
+		.expire_time = expire_time
+	};
+	eb_object_foreach(repo_path, find_loose_visit, &loose);
+
+	/* Packed objects age with the pack that holds them */
+	eb_pack_set_t* packs = NULL;
+	if (eb_pack_open(repo_path, &packs) == EB_SUCCESS) {
+		struct find_packed_ctx ctx = {
+			.referenced = referenced,
+			.out = unreferenced_out,
+			.max = max_unreferenced,
+			.count = count_out,
+			.expire_time = expire_time
+		};
+		eb_pack_foreach(packs, find_packed_visit, &ctx);
+		eb_pack_close(packs);
 	}
-	
-	closedir(dir);
+
+	eb_hash_set_destroy(referenced);
 	free(repo_path);
 	return EB_SUCCESS;
 }
 
+/* Repack filter that drops exactly one object */
+static bool keep_all_but(const char* hex_hash, time_t mtime, void* ctx)
+{
+	(void)mtime;
+	return strcmp(hex_hash, (const char*)ctx) != 0;
+}
+
 /**
  * Remove a specific object from the repository
  * 
@@ -315,19 +393,31 @@ eb_status_t gc_remove_object(const char* object_hash, size_t* size_removed_out)
 	
 	/* Get object path */
 	char object_path[PATH_MAX];
-	snprintf(object_path, sizeof(object_path), "%s/objects/%s", repo_path, object_hash);
+	eb_object_path(repo_path, object_hash, "raw", object_path, sizeof(object_path));
 	
+	/* Check if it's referenced */
+	eb_hash_set_t* referenced = gc_load_referenced(repo_path);
+	bool in_use = is_referenced(referenced, object_hash);
+	eb_hash_set_destroy(referenced);
+	if (in_use) {
+		free(repo_path);
+		return EB_ERROR_REFERENCED;
+	}
+
 	/* Check if object exists */
 	struct stat st;
 	if (stat(object_path, &st) != 0) {
+		/* Not loose: rewrite the packs holding it without it */
+		eb_repack_result_t repack;
+		eb_status_t status = eb_pack_prune(repo_path, keep_all_but, (void*)object_hash, &repack);
 		free(repo_path);
-		return EB_ERROR_NOT_FOUND;
-	}
-	
-	/* Check if it's referenced */
-	if (is_referenced(object_hash)) {
-		free(repo_path);
-		return EB_ERROR_REFERENCED;
+		if (status != EB_SUCCESS)
+			return status;
+		if (repack.objects_dropped == 0)
+			return EB_ERROR_NOT_FOUND;
+		if (size_removed_out && repack.bytes_replaced > repack.bytes_written)
+			*size_removed_out = repack.bytes_replaced - repack.bytes_written;
+		return EB_SUCCESS;
 	}
 	
 	/* Store size if requested */
@@ -344,6 +434,49 @@ eb_status_t gc_remove_object(const char* object_hash, size_t* size_removed_out)
 	return EB_SUCCESS;
 }
 
+/**
+ * Create the GC lock file holding our PID
+ *
+ * @return false if it exists or cannot be created
+ */
+static bool gc_lock(const char* repo_path, char* lock_path, size_t lock_size)
+{
+	snprintf(lock_path, lock_size, "%s/%s", repo_path, GC_LOCK_FILE);
+	int lock_fd = open(lock_path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+	if (lock_fd < 0)
+		return false;
+
+	char pid_str[16];
+	snprintf(pid_str, sizeof(pid_str), "%d\n", (int)getpid());
+	if (write(lock_fd, pid_str, strlen(pid_str)) < 0)
+		DEBUG_PRINT("gc: failed to write PID to %s", lock_path);
+	close(lock_fd);
+	return true;
+}
+
+/**
+ * Turn a --prune argument into the time before which objects expire
+ *
+ * @return 0 on success, 1 for "never", -1 for an invalid argument
+ */
+int gc_resolve_expire(const char* prune_expire, time_t* expire_time)
+{
+	if (!prune_expire) {
+		/* Default: 2 weeks ago */
+		*expire_time = time(NULL) - DEFAULT_PRUNE_EXPIRE_SECONDS;
+	} else if (strcmp(prune_expire, "now") == 0) {
+		/* No grace period */
+		*expire_time = time(NULL);
+	} else if (strcmp(prune_expire, "never") == 0) {
+		return 1;
+	} else {
+		*expire_time = parse_expire_time(prune_expire);
+		if (*expire_time == 0)
+			return -1;
+	}
+	return 0;
+}
+
 /**
  * Parse an expiration time string (e.g., "2.weeks.ago") into a timestamp
  */
@@ -411,149 +544,808 @@ static time_t parse_expire_time(const char* expire_str)
 	return result;
 }
 
-/**
- * Check if an object is referenced by any set
+/* How far the mark phase has read one set log */
+struct log_mark {
+	char set[NAME_MAX + 1];
+	long covered;
+};
+
+/* State for marking the hashes the sets reference */
+struct mark_ctx {
+	eb_hash_set_t* referenced;
+	bool ok;
+	/* Incremental runs: log coverage and when the marks were last refreshed */
+	struct log_mark* logs;
+	size_t log_count;
+	size_t log_cap;
+	time_t since;		/* 0 to read every index and model ref */
+};
+
+static bool mark_hex(struct mark_ctx* ctx, const char* hex_hash, size_t len)
+{
+	char hash[65];
+	if (len != 64)
+		return ctx->ok;
+	memcpy(hash, hex_hash, 64);
+	hash[64] = '\0';
+	if (eb_hash_set_add_hex(ctx->referenced, hash, NULL) == EB_ERROR_MEMORY_ALLOCATION)
+		ctx->ok = false;
+	return ctx->ok;
+}
+
+/*
+ * Mark the hash in a given space-separated field of every line of a file
+ * from offset on. getline() keeps lines with long source paths whole, so
+ * the tail of one is never mistaken for a line of its own.
+ *
+ * Returns the offset just past the last complete line, where a later
+ * pass over an append-only file can pick up; a line still being written
+ * is read again then.
  */
-static bool is_referenced(const char* object_id)
+static long mark_file_field(struct mark_ctx* ctx, const char* path, int field, long offset)
 {
-	/* Get repository path */
-	char* repo_path = get_repository_path();
-	if (!repo_path)
-		return false;
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+		return offset;
+	if (offset > 0 && fseek(fp, offset, SEEK_SET) != 0) {
+		fclose(fp);
+		return offset;
+	}
 
-	/* Get sets directory path */
-	char sets_dir[PATH_MAX];
-	snprintf(sets_dir, sizeof(sets_dir), "%s/sets", repo_path);
+	char* line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	while (ctx->ok && (len = getline(&line, &cap, fp)) > 0) {
+		const char* p = line;
+		for (int i = 0; i < field && *p; i++) {
+			p += strcspn(p, " \t\n");
+			p += strspn(p, " \t");
+		}
+		mark_hex(ctx, p, strcspn(p, " \t\n"));
+		if (line[len - 1] == '\n')
+			offset += len;
+	}
+	free(line);
+	fclose(fp);
+	return offset;
+}
 
-	/* Check if sets directory exists */
+static int mark_index_visit(const char* source, const char* model, const char* hash, void* data)
+{
+	struct mark_ctx* ctx = data;
+	(void)source;
+	(void)model;
+	return mark_hex(ctx, hash, strlen(hash)) ? 0 : 1;
+}
+
+/* Whether a file may hold references the marks do not have yet */
+static bool changed_since(const struct mark_ctx* ctx, const struct stat* st)
+{
+	return ctx->since == 0 || st->st_mtime >= ctx->since;
+}
+
+/* Mark every hash of the refs/models/<model> files, "<hash> <source>" lines */
+static void mark_model_refs(struct mark_ctx* ctx, const char* set_dir, bool all)
+{
+	char refs_dir[PATH_MAX];
+	snprintf(refs_dir, sizeof(refs_dir), "%s/refs/models", set_dir);
+	DIR* refs = opendir(refs_dir);
+	if (!refs)
+		return;
+
+	struct dirent* ref;
 	struct stat st;
-	if (stat(sets_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
-		free(repo_path);
-		return false;
+	while (ctx->ok && (ref = readdir(refs)) != NULL) {
+		if (ref->d_name[0] == '.')
+			continue;
+		char ref_path[PATH_MAX];
+		snprintf(ref_path, sizeof(ref_path), "%s/%s", refs_dir, ref->d_name);
+		if (all || (stat(ref_path, &st) == 0 && changed_since(ctx, &st)))
+			mark_file_field(ctx, ref_path, 0, 0);
 	}
+	closedir(refs);
+}
 
-	/* Iterate through all sets */
-	DIR* dir = opendir(sets_dir);
-	if (!dir) {
-		free(repo_path);
-		return false;
+/* Hashes in the logs a set created from another one is layered on */
+static void mark_layer_logs(struct mark_ctx* ctx, const char* set_dir)
+{
+	eb_set_layers_t layers;
+	if (eb_set_layers_load(set_dir, &layers) != EB_SUCCESS) {
+		ctx->ok = false;
+		return;
+	}
+	char log_path[PATH_MAX], path[PATH_MAX];
+	snprintf(log_path, sizeof(log_path), "%s/log", set_dir);
+	for (size_t i = 0; ctx->ok && i < layers.count; i++) {
+		eb_set_layer_path(log_path, &layers.items[i], "log", path, sizeof(path));
+		if (access(path, F_OK) == 0)
+			mark_file_field(ctx, path, 1, 0);
 	}
+	eb_set_layers_free(&layers);
+}
 
-	struct dirent* entry;
-	bool referenced = false;
+/* Log coverage of a set, NULL on allocation failure */
+static struct log_mark* log_mark_for(struct mark_ctx* ctx, const char* set, bool* found)
+{
+	for (size_t i = 0; i < ctx->log_count; i++) {
+		if (strcmp(ctx->logs[i].set, set) == 0) {
+			*found = true;
+			return &ctx->logs[i];
+		}
+	}
+	*found = false;
+	if (ctx->log_count == ctx->log_cap) {
+		size_t cap = ctx->log_cap ? ctx->log_cap * 2 : 8;
+		struct log_mark* logs = realloc(ctx->logs, cap * sizeof(*logs));
+		if (!logs)
+			return NULL;
+		ctx->logs = logs;
+		ctx->log_cap = cap;
+	}
+	struct log_mark* mark = &ctx->logs[ctx->log_count++];
+	snprintf(mark->set, sizeof(mark->set), "%s", set);
+	mark->covered = 0;
+	return mark;
+}
 
-	while ((entry = readdir(dir)) != NULL && !referenced) {
-		if (entry->d_name[0] == '.')
-			continue;
+/* Recorded deltas, each a delta hash followed by its base */
+struct delta_pairs {
+	char (*items)[2][65];
+	size_t count;
+	size_t cap;
+	bool failed;
+};
 
-		char set_dir[PATH_MAX];
-		snprintf(set_dir, sizeof(set_dir), "%s/sets/%s", repo_path, entry->d_name);
-
-		/* Check if it's a directory */
-		if (stat(set_dir, &st) == 0 && S_ISDIR(st.st_mode)) {
-			/* 1. Check log file for object_id as the second field */
-			char log_path[PATH_MAX];
-			snprintf(log_path, sizeof(log_path), "%s/log", set_dir);
-			FILE* log_fp = fopen(log_path, "r");
-			if (log_fp) {
-				char line[2048];
-				while (fgets(line, sizeof(line), log_fp)) {
-					char ts[32], hash[65];
-					if (sscanf(line, "%31s %64s", ts, hash) == 2) {
-						if (strcmp(hash, object_id) == 0) {
-							referenced = true;
-							break;
-						}
-					}
-				}
-				fclose(log_fp);
-			}
+static int collect_delta(const char* hash, const char* base, void* data)
+{
+	struct delta_pairs* pairs = data;
+	if (pairs->count == pairs->cap) {
+		size_t cap = pairs->cap ? pairs->cap * 2 : 256;
+		char (*items)[2][65] = realloc(pairs->items, cap * sizeof(*items));
+		if (!items) {
+			pairs->failed = true;
+			return 1;
 		}
+		pairs->items = items;
+		pairs->cap = cap;
 	}
+	memcpy(pairs->items[pairs->count][0], hash, 65);
+	memcpy(pairs->items[pairs->count][1], base, 65);
+	pairs->count++;
+	return 0;
+}
 
-	closedir(dir);
-
-	if (referenced) {
-		free(repo_path);
-		return true;
+/*
+ * Mark the bases of marked deltas, so no kept delta loses its chain.
+ * Each pass reaches one link further; chains are at most
+ * EB_DELTA_MAX_DEPTH long.
+ */
+static void mark_delta_bases(const char* repo_path, struct mark_ctx* ctx)
+{
+	struct delta_pairs pairs = { 0 };
+	if (eb_delta_foreach(repo_path, collect_delta, &pairs) != EB_SUCCESS || pairs.failed) {
+		DEBUG_PRINT("gc: cannot read %s", EB_DELTA_FILE);
+		ctx->ok = false;
 	}
 
-	/* Fallback: check refs as before */
-	dir = opendir(sets_dir);
-	if (!dir) {
-		free(repo_path);
-		return false;
+	bool added = true;
+	while (ctx->ok && added) {
+		added = false;
+		for (size_t i = 0; ctx->ok && i < pairs.count; i++) {
+			if (!eb_hash_set_contains_hex(ctx->referenced, pairs.items[i][0]))
+				continue;
+			bool is_new = false;
+			if (eb_hash_set_add_hex(ctx->referenced, pairs.items[i][1], &is_new) == EB_ERROR_MEMORY_ALLOCATION)
+				ctx->ok = false;
+			added |= is_new;
+		}
 	}
-	while ((entry = readdir(dir)) != NULL && !referenced) {
+	free(pairs.items);
+}
+
+/**
+ * Mark phase: add every hash any set references to ctx->referenced
+ *
+ * Each set's log, index and model refs are read once, so a run costs one
+ * pass over the set metadata plus one lookup per stored object rather
+ * than a scan of every set per object.
+ *
+ * With ctx->since set the marks are being refreshed: logs are read from
+ * where the last pass stopped (from the start if one was rewritten), and
+ * indexes and model refs only if they changed since then. Sets the last
+ * pass did not know are read in full.
+ *
+ * The bases of marked deltas are marked last.
+ *
+ * @param repo_path Repository root
+ * @param ctx Mark state; ctx->ok is cleared if a set could not be read
+ */
+static void mark_sets(const char* repo_path, struct mark_ctx* ctx)
+{
+	char sets_dir[PATH_MAX];
+	snprintf(sets_dir, sizeof(sets_dir), "%s/.embr/sets", repo_path);
+	DIR* dir = opendir(sets_dir);
+	if (!dir)
+		return;
+
+	struct dirent* entry;
+	struct stat st;
+	while (ctx->ok && (entry = readdir(dir)) != NULL) {
 		if (entry->d_name[0] == '.')
 			continue;
+
 		char set_dir[PATH_MAX];
-		snprintf(set_dir, sizeof(set_dir), "%s/sets/%s", repo_path, entry->d_name);
-		if (stat(set_dir, &st) == 0 && S_ISDIR(st.st_mode)) {
-			char reference_path[PATH_MAX];
-			snprintf(reference_path, sizeof(reference_path), "%s/refs/%s", set_dir, object_id);
-			if (stat(reference_path, &st) == 0) {
-				referenced = true;
+		snprintf(set_dir, sizeof(set_dir), "%s/%s", sets_dir, entry->d_name);
+		if (stat(set_dir, &st) != 0 || !S_ISDIR(st.st_mode))
+			continue;
+
+		bool known = false;
+		struct log_mark* coverage = log_mark_for(ctx, entry->d_name, &known);
+		if (!coverage) {
+			ctx->ok = false;
+			break;
+		}
+		bool all = ctx->since == 0 || !known;
+
+		/* 1. Every hash in the second field of the set log */
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/log", set_dir);
+		if (stat(path, &st) == 0) {
+			if (all || st.st_size < coverage->covered)
+				coverage->covered = 0;
+			coverage->covered = mark_file_field(ctx, path, 1, coverage->covered);
+		}
+		/* Base layers only grow past what the set sees, so one full
+		 * read covers them */
+		if (all)
+			mark_layer_logs(ctx, set_dir);
+
+		/* 2. Current entries of the set index. A set whose index cannot
+		 * be read must not have its objects swept */
+		snprintf(path, sizeof(path), "%s/index", set_dir);
+		if (ctx->ok && stat(path, &st) == 0 && (all || changed_since(ctx, &st))) {
+			eb_set_index_t* index = NULL;
+			if (eb_set_index_open(repo_path, path, &index) != EB_SUCCESS) {
+				DEBUG_PRINT("gc: cannot read set index %s", path);
+				ctx->ok = false;
+			} else {
+				eb_set_index_foreach(index, NULL, mark_index_visit, ctx);
+				eb_set_index_close(index);
 			}
 		}
+
+		/* 3. Objects named by the model refs */
+		mark_model_refs(ctx, set_dir, all);
 	}
 	closedir(dir);
-	free(repo_path);
-	return referenced;
+
+	if (ctx->ok)
+		mark_delta_bases(repo_path, ctx);
+}
+
+/**
+ * Collect every hash the sets reference
+ *
+ * @param repo_path Repository root
+ * @return The referenced hashes, NULL if they could not all be loaded
+ */
+eb_hash_set_t* gc_load_referenced(const char* repo_path)
+{
+	struct mark_ctx ctx = { .ok = true };
+	if (eb_hash_set_create(0, &ctx.referenced) != EB_SUCCESS)
+		return NULL;
+
+	mark_sets(repo_path, &ctx);
+	free(ctx.logs);
+	if (!ctx.ok) {
+		eb_hash_set_destroy(ctx.referenced);
+		return NULL;
+	}
+	DEBUG_PRINT("gc: marked %zu referenced objects", eb_hash_set_count(ctx.referenced));
+	return ctx.referenced;
+}
+
+/*
+ * Whether an object is referenced; without a reference set (it could not
+ * be loaded) everything counts as referenced, so nothing is deleted.
+ */
+static bool is_referenced(const eb_hash_set_t* referenced, const char* object_id)
+{
+	return !referenced || eb_hash_set_contains_hex(referenced, object_id);
+}
+
+/* State for removing unreferenced loose objects */
+struct remove_loose_ctx {
+	const eb_hash_set_t* referenced;
+	time_t expire_time;
+	int removed;
+	size_t bytes_freed;
+};
+
+static int remove_loose_visit(const char* hex_hash, const char* ext, const char* path,
+			      const struct stat* st, void* data)
+{
+	struct remove_loose_ctx* ctx = data;
+	(void)ext;
+
+	/* Remove if unreferenced and older than expire_time */
+	if (!is_referenced(ctx->referenced, hex_hash) && st->st_mtime < ctx->expire_time) {
+		if (unlink(path) == 0) {
+			ctx->bytes_freed += st->st_size;
+			ctx->removed++;
+		}
+	}
+	return 0;
 }
 
 /**
  * Remove unreferenced embedding objects older than the expire time
  * 
- * @param objects_dir Path to the objects directory
+ * Loose objects and their sidecars are found in either object layout.
+ * 
+ * @param repo_path Repository root
  * @param expire_time Timestamp before which unreferenced objects will be removed
+ * @param referenced Hashes referenced by the sets
+ * @param bytes_freed Receives the size of the removed files
  * @return Number of objects removed
  */
-static int remove_unreferenced_embeddings(const char* objects_dir, time_t expire_time)
+static int remove_unreferenced_embeddings(const char* repo_path, time_t expire_time,
+					  const eb_hash_set_t* referenced, size_t* bytes_freed)
 {
-	int removed_count = 0;
-	size_t bytes_freed = 0;
-	
-	/* In a real implementation, this would scan the objects directory for
-	 * embedding objects, check if they are referenced by any set, and
-	 * remove them if they are unreferenced and older than expire_time.
-	 * 
-	 * For this simulation, we'll create a mock implementation that:
-	 * 1. Looks for files in the "objects" directory
-	 * 2. Checks if they're referenced
-	 * 3. Checks their modification time
-	 * 4. Removes them if unreferenced and old enough
-	 */
-	
-	DIR* dir = opendir(objects_dir);
-	if (!dir)
-		return 0;
-	
-	struct dirent* entry;
-	struct stat st;
-	
-	while ((entry = readdir(dir)) != NULL) {
-		if (entry->d_name[0] == '.')
+	struct remove_loose_ctx ctx = {
+		.referenced = referenced,
+		.expire_time = expire_time,
+		.removed = 0,
+		.bytes_freed = 0
+	};
+	eb_object_foreach(repo_path, remove_loose_visit, &ctx);
+	*bytes_freed = ctx.bytes_freed;
+	return ctx.removed;
+}
+
+/* State for the repack filter below */
+struct prunable_ctx {
+	const eb_hash_set_t* referenced;
+	time_t expire_time;
+};
+
+/* Repack filter keeping referenced objects and anything still in its grace period */
+static bool keep_referenced(const char* hex_hash, time_t mtime, void* data)
+{
+	const struct prunable_ctx* ctx = data;
+	return mtime >= ctx->expire_time || is_referenced(ctx->referenced, hex_hash);
+}
+
+/**
+ * Drop unreferenced, expired objects from the packs
+ *
+ * Only the packs holding such objects are rewritten. Aggressive mode
+ * instead repacks everything, the surviving loose objects included.
+ *
+ * @param repo_path Repository root
+ * @param expire_time Objects in packs older than this may be dropped
+ * @param aggressive Repack everything into one pack
+ * @param referenced Hashes referenced by the sets
+ * @param bytes_freed Receives the pack bytes reclaimed, added to its value
+ * @return Number of objects dropped, or -1 on failure
+ */
+static int prune_packed_objects(const char* repo_path, time_t expire_time, bool aggressive,
+				const eb_hash_set_t* referenced, size_t* bytes_freed)
+{
+	struct prunable_ctx ctx = { .referenced = referenced, .expire_time = expire_time };
+	eb_repack_result_t repack;
+	eb_status_t status;
+
+	if (!aggressive) {
+		status = eb_pack_prune(repo_path, keep_referenced, &ctx, &repack);
+	} else {
+		/* Loose vectors move into the pack, at the archive level if one is set */
+		eb_store_t* store = NULL;
+		eb_store_config_t config = { .root_path = (char*)repo_path };
+		bool archive = eb_object_archive_level(repo_path) > 0 &&
+			       eb_store_init(&config, &store) == EB_SUCCESS;
+		status = eb_pack_repack(repo_path, keep_referenced, &ctx,
+					archive ? eb_object_archive : NULL, store, &repack);
+		eb_store_destroy(store);
+	}
+	if (status != EB_SUCCESS)
+		return -1;
+
+	if (repack.bytes_replaced > repack.bytes_written)
+		*bytes_freed += repack.bytes_replaced - repack.bytes_written;
+	DEBUG_PRINT("gc: repacked %zu objects, dropped %zu", repack.objects_packed, repack.objects_dropped);
+	return (int)repack.objects_dropped;
+}
+
+/*
+ * Incremental collection
+ *
+ * .embr/gc/ holds the state of the current cycle:
+ *
+ *   state       "epoch <t>", "marked <t>", "cursor <offset>" and one
+ *               "log <covered bytes> <set>" line per set log
+ *   marks       Referenced hashes, 32 bytes each
+ *   candidates  "<hash> <ext>" lines, the loose objects unreferenced at
+ *               the epoch
+ *
+ * state is written last, so it only ever describes complete marks and
+ * candidates. Marks only grow during a cycle: a reference dropped
+ * mid-cycle keeps its object until the next one.
+ */
+#define GC_STATE_DIR "gc"
+
+struct gc_cycle {
+	time_t epoch;		/* When the candidates were listed */
+	time_t marked;		/* When the marks were last refreshed */
+	long cursor;		/* Offset of the next candidate */
+	struct mark_ctx marks;
+};
+
+static void gc_state_path(const char* repo_path, const char* name, char* out, size_t size)
+{
+	snprintf(out, size, "%s/.embr/%s/%s", repo_path, GC_STATE_DIR, name);
+}
+
+static int save_mark_visit(const uint8_t hash[32], void* data)
+{
+	return fwrite(hash, 32, 1, (FILE*)data) == 1 ? 0 : 1;
+}
+
+/* Write a state file through a temporary file and rename */
+static bool save_file(const char* path, bool (*write_fn)(FILE* fp, const struct gc_cycle* cycle),
+		      const struct gc_cycle* cycle)
+{
+	char tmp_path[PATH_MAX + 4];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	FILE* fp = fopen(tmp_path, "wb");
+	if (!fp)
+		return false;
+	bool ok = write_fn(fp, cycle);
+	if (fclose(fp) != 0)
+		ok = false;
+	if (!ok || rename(tmp_path, path) != 0) {
+		unlink(tmp_path);
+		return false;
+	}
+	return true;
+}
+
+static bool write_marks(FILE* fp, const struct gc_cycle* cycle)
+{
+	return eb_hash_set_foreach(cycle->marks.referenced, save_mark_visit, fp) == 0;
+}
+
+static bool write_state(FILE* fp, const struct gc_cycle* cycle)
+{
+	fprintf(fp, "epoch %lld\n", (long long)cycle->epoch);
+	fprintf(fp, "marked %lld\n", (long long)cycle->marked);
+	fprintf(fp, "cursor %ld\n", cycle->cursor);
+	for (size_t i = 0; i < cycle->marks.log_count; i++)
+		fprintf(fp, "log %ld %s\n", cycle->marks.logs[i].covered, cycle->marks.logs[i].set);
+	return !ferror(fp);
+}
+
+static void free_cycle(struct gc_cycle* cycle)
+{
+	eb_hash_set_destroy(cycle->marks.referenced);
+	free(cycle->marks.logs);
+	cycle->marks.referenced = NULL;
+	cycle->marks.logs = NULL;
+}
+
+/**
+ * Load the cycle in progress
+ *
+ * @return true if a complete state was found; otherwise cycle is left
+ *         with an empty reference set
+ */
+static bool load_cycle(const char* repo_path, struct gc_cycle* cycle)
+{
+	char path[PATH_MAX];
+	long long epoch = 0, marked = 0;
+	bool have_cursor = false;
+
+	memset(cycle, 0, sizeof(*cycle));
+	cycle->marks.ok = true;
+	if (eb_hash_set_create(0, &cycle->marks.referenced) != EB_SUCCESS)
+		return false;
+
+	gc_state_path(repo_path, "state", path, sizeof(path));
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+		return false;
+
+	char line[PATH_MAX];
+	while (fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\n")] = '\0';
+		long covered;
+		int name_at = 0;
+		if (sscanf(line, "epoch %lld", &epoch) == 1 || sscanf(line, "marked %lld", &marked) == 1)
 			continue;
-		
-		char object_path[PATH_MAX];
-		snprintf(object_path, sizeof(object_path), "%s/%s", objects_dir, entry->d_name);
-		
-		/* Check if it's a file */
-		if (stat(object_path, &st) == 0 && S_ISREG(st.st_mode)) {
-			/* Check if it's unreferenced */
-			if (!is_referenced(entry->d_name)) {
-				/* Check if it's older than expire_time */
-				if (st.st_mtime < expire_time) {
-					/* Remove the file */
-					bytes_freed += st.st_size;
-					if (unlink(object_path) == 0)
-						removed_count++;
-				}
+		if (sscanf(line, "cursor %ld", &cycle->cursor) == 1) {
+			have_cursor = true;
+			continue;
+		}
+		if (sscanf(line, "log %ld %n", &covered, &name_at) == 1 && name_at > 0) {
+			bool found;
+			struct log_mark* mark = log_mark_for(&cycle->marks, line + name_at, &found);
+			if (mark)
+				mark->covered = covered;
+		}
+	}
+	fclose(fp);
+	cycle->epoch = (time_t)epoch;
+	cycle->marked = (time_t)marked;
+	if (!have_cursor || epoch <= 0 || marked < epoch)
+		return false;
+
+	gc_state_path(repo_path, "marks", path, sizeof(path));
+	fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+	uint8_t hash[32];
+	bool ok = true;
+	while (ok && fread(hash, 32, 1, fp) == 1)
+		ok = eb_hash_set_add(cycle->marks.referenced, hash, NULL) == EB_SUCCESS;
+	fclose(fp);
+	return ok;
+}
+
+/* State for listing a cycle's candidates */
+struct list_ctx {
+	const eb_hash_set_t* referenced;
+	time_t epoch;
+	FILE* out;
+	size_t count;
+};
+
+static int list_candidate_visit(const char* hex_hash, const char* ext, const char* path,
+				const struct stat* st, void* data)
+{
+	struct list_ctx* ctx = data;
+	(void)path;
+
+	if (st->st_mtime < ctx->epoch && !is_referenced(ctx->referenced, hex_hash)) {
+		fprintf(ctx->out, "%s %s\n", hex_hash, ext);
+		ctx->count++;
+	}
+	return 0;
+}
+
+/**
+ * Start a cycle: mark everything, then list the unreferenced loose objects
+ */
+static eb_status_t start_cycle(const char* repo_path, struct gc_cycle* cycle)
+{
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX + 4];
+
+	/* Anything from an unfinished cycle is stale now */
+	gc_state_path(repo_path, "state", path, sizeof(path));
+	unlink(path);
+
+	cycle->epoch = time(NULL);
+	cycle->marked = cycle->epoch;
+	cycle->cursor = 0;
+	cycle->marks.since = 0;
+	cycle->marks.log_count = 0;
+	if (eb_set_compact_all(repo_path) != EB_SUCCESS)
+		DEBUG_PRINT("gc: Failed to compact some sets");
+	mark_sets(repo_path, &cycle->marks);
+	if (!cycle->marks.ok)
+		return EB_ERROR_MEMORY_ALLOCATION;
+
+	gc_state_path(repo_path, "candidates", path, sizeof(path));
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	struct list_ctx list = {
+		.referenced = cycle->marks.referenced,
+		.epoch = cycle->epoch,
+		.out = fopen(tmp_path, "w"),
+		.count = 0
+	};
+	if (!list.out)
+		return EB_ERROR_FILE_IO;
+	eb_status_t status = eb_object_foreach(repo_path, list_candidate_visit, &list);
+	if (fclose(list.out) != 0 && status == EB_SUCCESS)
+		status = EB_ERROR_FILE_IO;
+	if (status != EB_SUCCESS || rename(tmp_path, path) != 0) {
+		unlink(tmp_path);
+		return status != EB_SUCCESS ? status : EB_ERROR_FILE_IO;
+	}
+	DEBUG_PRINT("gc: new cycle at %lld, %zu marked, %zu candidates",
+		    (long long)cycle->epoch, eb_hash_set_count(cycle->marks.referenced), list.count);
+
+	gc_state_path(repo_path, "marks", path, sizeof(path));
+	if (!save_file(path, write_marks, cycle))
+		return EB_ERROR_FILE_IO;
+	return EB_SUCCESS;
+}
+
+static double monotonic_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Sweep candidates from the cursor until the slice is used up
+ *
+ * A candidate is removed if it is still unreferenced, older than the
+ * epoch (store rewrites or touches objects it stores again) and older
+ * than expire_time.
+ *
+ * @return true when the end of the list was reached
+ */
+static bool sweep_candidates(const char* repo_path, struct gc_cycle* cycle, time_t expire_time,
+			     double deadline, eb_gc_result_t* result)
+{
+	char path[PATH_MAX];
+	gc_state_path(repo_path, "candidates", path, sizeof(path));
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+		return true;
+	if (fseek(fp, cycle->cursor, SEEK_SET) != 0) {
+		fclose(fp);
+		return true;
+	}
+
+	char line[128];
+	bool done = true;
+	while (fgets(line, sizeof(line), fp)) {
+		size_t len = strlen(line);
+		if (len == 0 || line[len - 1] != '\n')
+			break;
+		cycle->cursor += (long)len;
+
+		char hash[65], ext[16] = "";
+		if (sscanf(line, "%64s %15s", hash, ext) >= 1 &&
+		    !is_referenced(cycle->marks.referenced, hash)) {
+			char object_path[PATH_MAX];
+			struct stat st;
+			if (eb_object_path(repo_path, hash, ext, object_path, sizeof(object_path)) == 0 &&
+			    stat(object_path, &st) == 0 && S_ISREG(st.st_mode) &&
+			    st.st_mtime < cycle->epoch && st.st_mtime < expire_time &&
+			    unlink(object_path) == 0) {
+				result->objects_removed++;
+				result->bytes_freed += st.st_size;
 			}
 		}
+
+		if (deadline > 0 && monotonic_seconds() >= deadline) {
+			done = false;
+			break;
+		}
 	}
-	
-	closedir(dir);
-	return removed_count;
-} 
\ No newline at end of file
+	/* Stopping on the last line still leaves nothing to do */
+	if (!done && fgetc(fp) == EOF)
+		done = true;
+	fclose(fp);
+	return done;
+}
+
+/* Drop the state of a finished cycle */
+static void end_cycle(const char* repo_path)
+{
+	static const char* const files[] = { "state", "marks", "candidates" };
+	char path[PATH_MAX];
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		gc_state_path(repo_path, files[i], path, sizeof(path));
+		unlink(path);
+	}
+}
+
+eb_status_t gc_run_incremental(const char* prune_expire, unsigned slice_seconds,
+			       eb_gc_result_t* result)
+{
+	eb_gc_result_t local;
+	if (!result)
+		result = &local;
+	result->status = EB_SUCCESS;
+	result->message[0] = '\0';
+	result->objects_removed = 0;
+	result->bytes_freed = 0;
+	result->pending = false;
+
+	double deadline = slice_seconds ? monotonic_seconds() + slice_seconds : 0;
+
+	if (gc_is_running()) {
+		result->status = EB_ERROR_LOCK_FAILED;
+		strcpy(result->message, "Another garbage collection process is running");
+		return EB_ERROR_LOCK_FAILED;
+	}
+
+	char* repo_path = get_repository_path();
+	if (!repo_path) {
+		result->status = EB_ERROR_NOT_INITIALIZED;
+		strcpy(result->message, "Repository not initialized");
+		return EB_ERROR_NOT_INITIALIZED;
+	}
+
+	/* The lock only keeps two collectors apart; stores carry on */
+	char lock_path[PATH_MAX];
+	if (!gc_lock(repo_path, lock_path, sizeof(lock_path))) {
+		result->status = EB_ERROR_LOCK_FAILED;
+		strcpy(result->message, "Failed to create GC lock file");
+		free(repo_path);
+		return EB_ERROR_LOCK_FAILED;
+	}
+
+	time_t expire_time;
+	int expire = gc_resolve_expire(prune_expire, &expire_time);
+	if (expire != 0) {
+		eb_status_t status = expire > 0 ? EB_SUCCESS : EB_ERROR_INVALID_PARAMETER;
+		result->status = status;
+		if (expire > 0)
+			strcpy(result->message, "Pruning disabled, no objects removed");
+		else
+			snprintf(result->message, sizeof(result->message),
+				 "Invalid expiration format: %s", prune_expire);
+		unlink(lock_path);
+		free(repo_path);
+		return status;
+	}
+
+	char state_dir[PATH_MAX];
+	snprintf(state_dir, sizeof(state_dir), "%s/.embr/%s", repo_path, GC_STATE_DIR);
+	if (mkdir(state_dir, 0755) != 0 && errno != EEXIST) {
+		result->status = EB_ERROR_FILE_IO;
+		strcpy(result->message, "Failed to create GC state directory");
+		unlink(lock_path);
+		free(repo_path);
+		return EB_ERROR_FILE_IO;
+	}
+
+	struct gc_cycle cycle;
+	eb_status_t status = EB_SUCCESS;
+	bool started = false;
+	if (load_cycle(repo_path, &cycle)) {
+		/* Pick up references added since the last run */
+		size_t before = eb_hash_set_count(cycle.marks.referenced);
+		time_t now = time(NULL);
+		cycle.marks.since = cycle.marked;
+		mark_sets(repo_path, &cycle.marks);
+		if (!cycle.marks.ok) {
+			status = EB_ERROR_MEMORY_ALLOCATION;
+		} else {
+			cycle.marked = now;
+			char path[PATH_MAX];
+			gc_state_path(repo_path, "marks", path, sizeof(path));
+			if (eb_hash_set_count(cycle.marks.referenced) != before &&
+			    !save_file(path, write_marks, &cycle))
+				status = EB_ERROR_FILE_IO;
+		}
+	} else if (!cycle.marks.referenced) {
+		status = EB_ERROR_MEMORY_ALLOCATION;
+	} else {
+		status = start_cycle(repo_path, &cycle);
+		started = true;
+	}
+
+	if (status == EB_SUCCESS) {
+		char path[PATH_MAX];
+		if (sweep_candidates(repo_path, &cycle, expire_time, deadline, result)) {
+			end_cycle(repo_path);
+			snprintf(result->message, sizeof(result->message),
+				 "Incremental collection cycle complete");
+		} else {
+			gc_state_path(repo_path, "state", path, sizeof(path));
+			if (!save_file(path, write_state, &cycle))
+				status = EB_ERROR_FILE_IO;
+			result->pending = true;
+			snprintf(result->message, sizeof(result->message),
+				 "Incremental collection %s, run again to continue",
+				 started ? "started" : "in progress");
+		}
+	}
+	if (status != EB_SUCCESS) {
+		result->status = status;
+		snprintf(result->message, sizeof(result->message),
+			 "Failed to %s collection cycle", started ? "start" : "resume");
+	}
+
+	free_cycle(&cycle);
+	unlink(lock_path);
+	free(repo_path);
+	return status;
+}
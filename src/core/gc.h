@@ -12,7 +12,9 @@
 #define EB_GC_H
 
 #include "types.h"
+#include "hash_set.h"
 #include <stdbool.h>
+#include <time.h>
 
 /**
  * Result structure for garbage collection operations
@@ -22,11 +24,15 @@ typedef struct {
     char message[256];          /* Status message */
     int objects_removed;        /* Number of objects removed */
     size_t bytes_freed;         /* Bytes of storage freed */
+    bool pending;               /* Incremental runs: the sweep continues next run */
 } eb_gc_result_t;
 
 /**
  * Run garbage collection on the repository
  * 
+ * Every set is compacted first (set_compact.h), so the objects of entries
+ * removed with `embr rm` are no longer referenced by the logs.
+ *
  * @param prune_expire Expiration string for pruning (e.g., "2.weeks.ago", "now", or "never")
  * @param aggressive Whether to do more aggressive optimization
  * @param result Pointer to store operation result
@@ -34,6 +40,32 @@ typedef struct {
  */
 eb_status_t gc_run(const char* prune_expire, bool aggressive, eb_gc_result_t* result);
 
+/**
+ * Run one bounded slice of incremental garbage collection
+ *
+ * A cycle starts by compacting the sets, as gc_run() does, marking every
+ * referenced hash and listing the loose objects that were unreferenced at
+ * that moment, its epoch. The marks and
+ * the list are kept under .embr/gc/, and each run sweeps the list from
+ * where the last one stopped until the slice is used up. Before sweeping,
+ * the marks are brought up to date from log lines appended since and
+ * from indexes and model refs changed since, so objects referenced again
+ * mid-cycle are kept.
+ *
+ * Objects written after the epoch are left for the next cycle, and store
+ * refreshes the mtime of an object it writes again, so concurrent stores
+ * are safe without a repository-wide lock. Packed objects are only
+ * pruned by gc_run().
+ *
+ * @param prune_expire Expiration string, as for gc_run()
+ * @param slice_seconds Time to spend sweeping, 0 to finish the cycle
+ * @param result Pointer to store operation result; pending is set while
+ *        the cycle has objects left to examine
+ * @return Status code (0 = success)
+ */
+eb_status_t gc_run_incremental(const char* prune_expire, unsigned slice_seconds,
+                               eb_gc_result_t* result);
+
 /**
  * Find unreferenced embedding objects
  * 
@@ -64,4 +96,25 @@ bool gc_is_running(void);
  */
 eb_status_t gc_remove_object(const char* object_hash, size_t* size_removed_out);
 
+/**
+ * Collect every hash the sets reference, as gc marks them before a sweep
+ *
+ * Sets are not compacted first, so entries removed with `embr rm` still
+ * count until the next gc_run().
+ *
+ * @param repo_path Repository root
+ * @return The referenced hashes, NULL if they could not all be loaded;
+ *         free with eb_hash_set_destroy()
+ */
+eb_hash_set_t* gc_load_referenced(const char* repo_path);
+
+/**
+ * Turn a --prune argument into the time before which objects expire
+ *
+ * @param prune_expire Expiration string, as for gc_run(); NULL for 2 weeks ago
+ * @param expire_time Receives the time
+ * @return 0 on success, 1 for "never", -1 for an invalid argument
+ */
+int gc_resolve_expire(const char* prune_expire, time_t* expire_time);
+
 #endif /* EB_GC_H */ 
\ No newline at end of file
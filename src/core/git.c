@@ -8,79 +8,232 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+
+/*
+ * One repository handle per process, opened on first use and kept for
+ * the directory it was opened from. Hooks store every changed file of
+ * a commit in one process, which then opens the repository once. The
+ * lock is held while a handle is in use, as libgit2 objects must not be
+ * used from two threads at once. A forked child opens its own.
+ */
+static pthread_mutex_t repo_lock = PTHREAD_MUTEX_INITIALIZER;
+static git_repository* cached_repo = NULL;
+static git_odb* cached_odb = NULL;
+static char cached_cwd[PATH_MAX];
+static pid_t cached_pid = 0;
+
+static void drop_cached_repo(void) {
+    if (!cached_repo)
+        return;
+    git_odb_free(cached_odb);
+    git_repository_free(cached_repo);
+    git_libgit2_shutdown();
+    cached_odb = NULL;
+    cached_repo = NULL;
+    cached_cwd[0] = '\0';
+}
 
-eb_status_t eb_git_get_metadata(const char* filepath, eb_git_metadata_t** out_metadata) {
-    if (!filepath || !out_metadata) {
-        return EB_ERROR_INVALID_INPUT;
+// Lock and return the repository of the current directory; release with release_repo()
+static eb_status_t acquire_repo(git_repository** out_repo, git_odb** out_odb) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+        return EB_ERROR_GIT_OPERATION;
+
+    pthread_mutex_lock(&repo_lock);
+    if (cached_repo && (cached_pid != getpid() || strcmp(cached_cwd, cwd) != 0))
+        drop_cached_repo();
+    if (!cached_repo) {
+        git_libgit2_init();
+        if (git_repository_open_ext(&cached_repo, ".", 0, NULL) != 0) {
+            cached_repo = NULL;
+            git_libgit2_shutdown();
+            pthread_mutex_unlock(&repo_lock);
+            return EB_ERROR_NOT_GIT_REPO;
+        }
+        if (git_repository_odb(&cached_odb, cached_repo) != 0) {
+            cached_odb = NULL;
+            drop_cached_repo();
+            pthread_mutex_unlock(&repo_lock);
+            return EB_ERROR_GIT_OPERATION;
+        }
+        snprintf(cached_cwd, sizeof(cached_cwd), "%s", cwd);
+        cached_pid = getpid();
     }
+    *out_repo = cached_repo;
+    if (out_odb)
+        *out_odb = cached_odb;
+    return EB_SUCCESS;
+}
 
-    // Initialize libgit2
-    git_libgit2_init();
+static void release_repo(void) {
+    pthread_mutex_unlock(&repo_lock);
+}
 
-    // Allocate metadata structure
-    eb_git_metadata_t* metadata = (eb_git_metadata_t*)malloc(sizeof(eb_git_metadata_t));
-    if (!metadata) {
-        git_libgit2_shutdown();
-        return EB_ERROR_MEMORY_ALLOCATION;
+void eb_git_close(void) {
+    pthread_mutex_lock(&repo_lock);
+    drop_cached_repo();
+    pthread_mutex_unlock(&repo_lock);
+}
+
+// Requested paths in sorted order, for matching tree and status entries
+typedef struct {
+    const char* const* paths;
+    size_t* order;
+    size_t count;
+    eb_git_metadata_t* out;
+    char full[PATH_MAX];
+} path_match_t;
+
+static const char* const* sort_paths;    // For compare_order(), under repo_lock
+
+static int compare_order(const void* a, const void* b) {
+    return strcmp(sort_paths[*(const size_t*)a], sort_paths[*(const size_t*)b]);
+}
+
+// First requested path not before key
+static size_t lower_bound(const path_match_t* match, const char* key) {
+    size_t low = 0, high = match->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strcmp(match->paths[match->order[mid]], key) < 0)
+            low = mid + 1;
+        else
+            high = mid;
     }
-    memset(metadata, 0, sizeof(eb_git_metadata_t));
+    return low;
+}
 
-    // Open repository
-    git_repository* repo = NULL;
-    if (git_repository_open_ext(&repo, ".", 0, NULL) != 0) {
-        free(metadata);
-        git_libgit2_shutdown();
-        return EB_ERROR_NOT_GIT_REPO;
+// Fill in the blobs of the requested paths; skip directories none of them is in
+static int match_tree_entry(const char* root, const git_tree_entry* entry, void* payload) {
+    path_match_t* match = payload;
+    int n = snprintf(match->full, sizeof(match->full), "%s%s", root, git_tree_entry_name(entry));
+    if (n < 0 || (size_t)n + 1 >= sizeof(match->full))
+        return 1;
+
+    if (git_tree_entry_type(entry) == GIT_OBJECT_TREE) {
+        match->full[n] = '/';
+        match->full[n + 1] = '\0';
+        size_t i = lower_bound(match, match->full);
+        return i < match->count &&
+               strncmp(match->paths[match->order[i]], match->full, (size_t)n + 1) == 0 ? 0 : 1;
+    }
+    for (size_t i = lower_bound(match, match->full);
+         i < match->count && strcmp(match->paths[match->order[i]], match->full) == 0; i++) {
+        eb_git_metadata_t* meta = &match->out[match->order[i]];
+        git_oid_tostr(meta->blob_id, sizeof(meta->blob_id), git_tree_entry_id(entry));
+        meta->is_tracked = true;
+    }
+    return 0;
+}
+
+eb_status_t eb_git_get_metadata_many(const char* const* paths, size_t count,
+                                     eb_git_metadata_t* out) {
+    if ((!paths || !out) && count > 0) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!paths[i])
+            return EB_ERROR_INVALID_INPUT;
+        memset(&out[i], 0, sizeof(out[i]));
     }
 
-    // Get HEAD commit
-    git_oid head_oid;
+    git_repository* repo = NULL;
+    eb_status_t result = acquire_repo(&repo, NULL);
+    if (result != EB_SUCCESS)
+        return result;
+
+    // HEAD is resolved once for every path
     git_reference* head_ref = NULL;
     git_commit* head_commit = NULL;
-
-    if (git_repository_head(&head_ref, repo) != 0) {
-        git_repository_free(repo);
-        free(metadata);
-        git_libgit2_shutdown();
+    git_tree* tree = NULL;
+    if (git_repository_head(&head_ref, repo) != 0 ||
+        git_commit_lookup(&head_commit, repo, git_reference_target(head_ref)) != 0 ||
+        git_commit_tree(&tree, head_commit) != 0) {
+        git_commit_free(head_commit);
+        git_reference_free(head_ref);
+        release_repo();
         return EB_ERROR_GIT_OPERATION;
     }
 
-    git_reference_name_to_id(&head_oid, repo, git_reference_name(head_ref));
-    git_commit_lookup(&head_commit, repo, &head_oid);
+    const git_signature* author = git_commit_author(head_commit);
+    for (size_t i = 0; i < count; i++) {
+        git_oid_tostr(out[i].commit_id, sizeof(out[i].commit_id), git_commit_id(head_commit));
+        snprintf(out[i].branch, sizeof(out[i].branch), "%s", git_reference_shorthand(head_ref));
+        if (author)
+            snprintf(out[i].author, sizeof(out[i].author), "%s <%s>", author->name, author->email);
+        out[i].commit_time = (uint64_t)git_commit_time(head_commit);
+    }
 
-    // Fill metadata
-    strncpy(metadata->commit_id, git_oid_tostr_s(&head_oid), EB_GIT_HASH_SIZE);
-    strncpy(metadata->branch, git_reference_shorthand(head_ref), EB_GIT_BRANCH_SIZE);
-    metadata->commit_time = (uint64_t)git_commit_time(head_commit);
+    path_match_t match = { paths, NULL, count, out, "" };
+    if (count == 0)
+        goto done;
+    if (!(match.order = malloc(count * sizeof(*match.order)))) {
+        result = EB_ERROR_MEMORY_ALLOCATION;
+        goto done;
+    }
+    for (size_t i = 0; i < count; i++)
+        match.order[i] = i;
+    sort_paths = paths;
+    qsort(match.order, count, sizeof(*match.order), compare_order);
+
+    // One walk of the HEAD tree for the blobs, one status pass for the changes
+    if (git_tree_walk(tree, GIT_TREEWALK_PRE, match_tree_entry, &match) < 0) {
+        result = EB_ERROR_GIT_OPERATION;
+        goto done;
+    }
 
-    // Get file status
     git_status_options statusopt = GIT_STATUS_OPTIONS_INIT;
-    statusopt.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
-    statusopt.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;  // Fix missing initializer warning
+    statusopt.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    statusopt.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    statusopt.pathspec.strings = (char**)paths;
+    statusopt.pathspec.count = count;
     git_status_list* status = NULL;
-
     if (git_status_list_new(&status, repo, &statusopt) == 0) {
         size_t i, maxi = git_status_list_entrycount(status);
         for (i = 0; i < maxi; i++) {
             const git_status_entry* s = git_status_byindex(status, i);
-            
+
             const char* path = s->head_to_index ? s->head_to_index->new_file.path :
                              s->index_to_workdir ? s->index_to_workdir->new_file.path : NULL;
-            
-            if (path && strcmp(path, filepath) == 0) {
-                metadata->is_modified = (s->status & GIT_STATUS_WT_MODIFIED) != 0;
-                metadata->is_tracked = (s->status & GIT_STATUS_WT_NEW) == 0;
-                break;
+            if (!path)
+                continue;
+
+            for (size_t j = lower_bound(&match, path);
+                 j < count && strcmp(paths[match.order[j]], path) == 0; j++) {
+                eb_git_metadata_t* meta = &out[match.order[j]];
+                meta->is_modified = (s->status & GIT_STATUS_WT_MODIFIED) != 0;
+                meta->is_tracked = (s->status & GIT_STATUS_WT_NEW) == 0;
             }
         }
         git_status_list_free(status);
     }
 
-    // Clean up
+done:
+    free(match.order);
+    git_tree_free(tree);
     git_commit_free(head_commit);
     git_reference_free(head_ref);
-    git_repository_free(repo);
-    git_libgit2_shutdown();
+    release_repo();
+    return result;
+}
+
+eb_status_t eb_git_get_metadata(const char* filepath, eb_git_metadata_t** out_metadata) {
+    if (!filepath || !out_metadata) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+
+    eb_git_metadata_t* metadata = (eb_git_metadata_t*)malloc(sizeof(eb_git_metadata_t));
+    if (!metadata) {
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    eb_status_t status = eb_git_get_metadata_many(&filepath, 1, metadata);
+    if (status != EB_SUCCESS) {
+        free(metadata);
+        return status;
+    }
 
     *out_metadata = metadata;
     return EB_SUCCESS;
@@ -92,10 +245,15 @@ bool eb_git_is_repo(void) {
 
 bool eb_git_is_valid_ref(const char* ref) {
     if (!ref) return false;
-    
-    char cmd[1024];
-    snprintf(cmd, sizeof(cmd), "git rev-parse --verify %s > /dev/null 2>&1", ref);
-    return system(cmd) == 0;
+
+    git_repository* repo = NULL;
+    if (acquire_repo(&repo, NULL) != EB_SUCCESS)
+        return false;
+    git_object* object = NULL;
+    bool valid = git_revparse_single(&object, repo, ref) == 0;
+    git_object_free(object);
+    release_repo();
+    return valid;
 }
 
 eb_status_t eb_git_get_file_at_ref(
@@ -108,56 +266,42 @@ eb_status_t eb_git_get_file_at_ref(
         return EB_ERROR_INVALID_INPUT;
     }
 
-    char cmd[2048];
-    snprintf(cmd, sizeof(cmd), 
-             "git show %s:%s 2>/dev/null",
-             ref, file_path);
-
-    FILE* fp = popen(cmd, "r");
-    if (!fp) {
-        return EB_ERROR_GIT_OPERATION;
-    }
-
-    // Read file content
-    size_t capacity = 1024;
-    size_t length = 0;
-    char* content = malloc(capacity);
-    
-    if (!content) {
-        pclose(fp);
-        return EB_ERROR_MEMORY_ALLOCATION;
-    }
-
-    char buffer[1024];
-    while (fgets(buffer, sizeof(buffer), fp)) {
-        size_t chunk_len = strlen(buffer);
-        
-        // Ensure capacity
-        if (length + chunk_len >= capacity) {
-            capacity *= 2;
-            char* new_content = realloc(content, capacity);
-            if (!new_content) {
-                free(content);
-                pclose(fp);
-                return EB_ERROR_MEMORY_ALLOCATION;
-            }
-            content = new_content;
+    git_repository* repo = NULL;
+    git_odb* odb = NULL;
+    eb_status_t result = acquire_repo(&repo, &odb);
+    if (result != EB_SUCCESS)
+        return result;
+
+    // The blob id comes from the tree; its content straight from the object database
+    git_object* target = NULL;
+    git_object* tree = NULL;
+    git_tree_entry* entry = NULL;
+    git_odb_object* blob = NULL;
+    if (git_revparse_single(&target, repo, ref) != 0 ||
+        git_object_peel(&tree, target, GIT_OBJECT_TREE) != 0 ||
+        git_tree_entry_bypath(&entry, (git_tree*)tree, file_path) != 0 ||
+        git_tree_entry_type(entry) != GIT_OBJECT_BLOB ||
+        git_odb_read(&blob, odb, git_tree_entry_id(entry)) != 0) {
+        result = EB_ERROR_GIT_OPERATION;
+    } else {
+        size_t length = git_odb_object_size(blob);
+        char* content = malloc(length + 1);
+        if (!content) {
+            result = EB_ERROR_MEMORY_ALLOCATION;
+        } else {
+            memcpy(content, git_odb_object_data(blob), length);
+            content[length] = '\0';
+            *out_content = content;
+            *out_length = length;
         }
-
-        // Append chunk
-        memcpy(content + length, buffer, chunk_len);
-        length += chunk_len;
     }
 
-    int status = pclose(fp);
-    if (status != 0) {
-        free(content);
-        return EB_ERROR_GIT_OPERATION;
-    }
-
-    *out_content = content;
-    *out_length = length;
-    return EB_SUCCESS;
+    git_odb_object_free(blob);
+    git_tree_entry_free(entry);
+    git_object_free(tree);
+    git_object_free(target);
+    release_repo();
+    return result;
 }
 
 eb_status_t eb_git_install_hooks(bool force) {
@@ -4,6 +4,7 @@
 #include "types.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // Git-specific error codes
 #define EB_ERROR_NOT_GIT_REPO (EB_ERROR_NOT_FOUND + 1)
@@ -19,6 +20,7 @@ typedef struct {
     char author[100];                      // Author name and email
     uint64_t commit_time;                  // Unix timestamp of commit
     char branch[EB_GIT_BRANCH_SIZE];      // Current branch
+    char blob_id[EB_GIT_HASH_SIZE];       // Blob of the file in HEAD, "" if not in HEAD
     bool is_modified;                      // Whether file is modified
     bool is_tracked;                       // Whether file is tracked
 } eb_git_metadata_t;
@@ -34,6 +36,23 @@ typedef struct {
 
 // Git functions
 bool eb_git_is_repo(void);
+bool eb_git_is_valid_ref(const char* ref);
+
+// The repository of the current directory is opened once per process and
+// kept; eb_git_close() releases it
+void eb_git_close(void);
+
+// Metadata of one file in the work tree; free the result
+eb_status_t eb_git_get_metadata(const char* file_path, eb_git_metadata_t** out_metadata);
+
+// Metadata of many files from one walk of the HEAD tree and one status
+// pass; out[i] describes paths[i], given relative to the work tree
+eb_status_t eb_git_get_metadata_many(const char* const* paths, size_t count,
+                                     eb_git_metadata_t* out);
+
+// Content of a file at a ref; free *out_content
+eb_status_t eb_git_get_file_at_ref(const char* ref, const char* file_path,
+                                   char** out_content, size_t* out_length);
 
 // Git hook management functions
 eb_status_t eb_git_install_hooks(bool force);
@@ -0,0 +1,306 @@
+/*
+ * EmbeddingBridge - Sorted Object Hash Index Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash_index.h"
+#include "hash_utils.h"
+#include "object_path.h"
+#include "counters.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/*
+ * Directory mtimes this close to the current time are not trusted: another
+ * object could still land in the same timestamp tick without changing it.
+ * Such indexes are used for the current lookup but not written out.
+ */
+#define HASH_INDEX_RACY_SECONDS 2
+
+/* Sorted loose hashes, either mapped from disk or built in memory */
+typedef struct {
+    const uint8_t (*hashes)[32];
+    size_t count;
+    void* map;
+    size_t map_size;
+    uint8_t (*owned)[32];
+} loose_index_t;
+
+static void index_release(loose_index_t* idx) {
+    if (idx->map)
+        munmap(idx->map, idx->map_size);
+    free(idx->owned);
+    memset(idx, 0, sizeof(*idx));
+}
+
+static int compare_hashes(const void* a, const void* b) {
+    return memcmp(a, b, 32);
+}
+
+/* Growable array of binary hashes filled by scan_visit */
+struct scan_ctx {
+    uint8_t (*hashes)[32];
+    size_t count;
+    size_t capacity;
+    bool failed;
+};
+
+static int scan_visit(const char* hex_hash, const char* ext, const char* path,
+                      const struct stat* st, void* data) {
+    struct scan_ctx* ctx = data;
+    (void)path;
+    (void)st;
+
+    if (strcmp(ext, "raw") != 0)
+        return 0;
+
+    if (ctx->count == ctx->capacity) {
+        size_t new_cap = ctx->capacity ? ctx->capacity * 2 : 256;
+        uint8_t (*grown)[32] = realloc(ctx->hashes, new_cap * 32);
+        if (!grown) {
+            ctx->failed = true;
+            return 1;
+        }
+        ctx->hashes = grown;
+        ctx->capacity = new_cap;
+    }
+    if (eb_hex_to_hash(hex_hash, ctx->hashes[ctx->count]))
+        ctx->count++;
+    return 0;
+}
+
+/* Collect, sort and deduplicate the hashes of all loose .raw objects */
+static eb_status_t scan_objects(const char* root, uint8_t (**out)[32], size_t* out_count) {
+    struct scan_ctx ctx = { .hashes = NULL, .count = 0, .capacity = 0, .failed = false };
+    *out = NULL;
+    *out_count = 0;
+
+    eb_object_foreach(root, scan_visit, &ctx);
+    if (ctx.failed) {
+        free(ctx.hashes);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    uint8_t (*hashes)[32] = ctx.hashes;
+    size_t count = ctx.count;
+    if (count > 1) {
+        qsort(hashes, count, 32, compare_hashes);
+        size_t unique = 1;
+        for (size_t i = 1; i < count; i++) {
+            if (memcmp(hashes[i], hashes[unique - 1], 32) != 0)
+                memcpy(hashes[unique++], hashes[i], 32);
+        }
+        count = unique;
+    }
+
+    *out = hashes;
+    *out_count = count;
+    return EB_SUCCESS;
+}
+
+static bool mtime_is_racy(const struct timespec* mtime) {
+    time_t now = time(NULL);
+    return mtime->tv_sec + HASH_INDEX_RACY_SECONDS >= now;
+}
+
+/* Write the index through a temporary file and rename it into place */
+static eb_status_t write_index(const char* index_path, const struct timespec* dir_mtime,
+                               const uint8_t (*hashes)[32], size_t count) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", index_path, (int)getpid());
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+
+    eb_hash_index_header_t header = {
+        .magic = EB_HASH_INDEX_MAGIC,
+        .version = EB_HASH_INDEX_VERSION,
+        .count = (uint32_t)count,
+        .reserved = 0,
+        .dir_mtime = (int64_t)dir_mtime->tv_sec,
+        .dir_mtime_ns = (int64_t)dir_mtime->tv_nsec
+    };
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              (count == 0 || fwrite(hashes, 32, count, f) == count);
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, index_path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+/* Map the on-disk index if it describes the objects directory as it is now */
+static bool map_index(const char* index_path, const struct timespec* dir_mtime, loose_index_t* idx) {
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(eb_hash_index_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const eb_hash_index_header_t* header = map;
+    size_t expected = sizeof(*header) + (size_t)header->count * 32;
+    if (header->magic != EB_HASH_INDEX_MAGIC || header->version != EB_HASH_INDEX_VERSION ||
+        expected != (size_t)st.st_size ||
+        header->dir_mtime != (int64_t)dir_mtime->tv_sec ||
+        header->dir_mtime_ns != (int64_t)dir_mtime->tv_nsec) {
+        munmap(map, (size_t)st.st_size);
+        return false;
+    }
+
+    idx->map = map;
+    idx->map_size = (size_t)st.st_size;
+    idx->hashes = (const uint8_t (*)[32])((const char*)map + sizeof(*header));
+    idx->count = header->count;
+    return true;
+}
+
+/* Load the loose index for root, rebuilding it if it is missing or stale */
+static eb_status_t index_load(const char* root, bool force_rebuild, loose_index_t* idx) {
+    memset(idx, 0, sizeof(*idx));
+
+    char index_path[PATH_MAX];
+    snprintf(index_path, sizeof(index_path), "%s/.embr/%s", root, EB_HASH_INDEX_FILE);
+
+    struct timespec dir_mtime;
+    if (eb_object_dirs_mtime(root, &dir_mtime) != EB_SUCCESS)
+        return EB_SUCCESS;  /* No objects, empty index */
+
+    if (!force_rebuild && map_index(index_path, &dir_mtime, idx))
+        return EB_SUCCESS;
+
+    DEBUG_PRINT("hash_index: rebuilding loose object index for %s", root);
+    eb_status_t status = scan_objects(root, &idx->owned, &idx->count);
+    if (status != EB_SUCCESS)
+        return status;
+    idx->hashes = (const uint8_t (*)[32])idx->owned;
+
+    if (mtime_is_racy(&dir_mtime)) {
+        DEBUG_PRINT("hash_index: objects directory modified just now, not persisting");
+        return EB_SUCCESS;
+    }
+
+    /* Failing to persist only costs the next caller another scan */
+    if (write_index(index_path, &dir_mtime, idx->hashes, idx->count) != EB_SUCCESS)
+        DEBUG_WARN("hash_index: could not write %s", index_path);
+    return EB_SUCCESS;
+}
+
+/* Find the unique loose hash with the given prefix key */
+static eb_status_t index_lookup(const loose_index_t* idx, const uint8_t key[32], size_t nibbles,
+                                const uint8_t** match) {
+    size_t lo = 0, hi = idx->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (memcmp(idx->hashes[mid], key, 32) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *match = NULL;
+    if (lo >= idx->count || !eb_hash_has_prefix(idx->hashes[lo], key, nibbles))
+        return EB_ERROR_NOT_FOUND;
+    /* Entries are unique and sorted, so a second match must be the neighbour */
+    if (lo + 1 < idx->count && eb_hash_has_prefix(idx->hashes[lo + 1], key, nibbles))
+        return EB_ERROR_HASH_AMBIGUOUS;
+
+    *match = idx->hashes[lo];
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_hash_index_resolve(const char* root, const eb_pack_set_t* packs,
+                                  const char* prefix, char full_hash[65]) {
+    if (!root || !prefix || !full_hash)
+        return EB_ERROR_INVALID_INPUT;
+
+    uint8_t key[32];
+    size_t nibbles = eb_hex_prefix_key(prefix, key);
+    if (nibbles == 0)
+        return EB_ERROR_NOT_FOUND;
+    eb_counter_add(EB_COUNTER_INDEX_LOOKUPS, 1);
+
+    loose_index_t idx;
+    eb_status_t status = index_load(root, false, &idx);
+    if (status != EB_SUCCESS)
+        return status;
+
+    const uint8_t* loose = NULL;
+    status = index_lookup(&idx, key, nibbles, &loose);
+    if (status == EB_ERROR_HASH_AMBIGUOUS) {
+        index_release(&idx);
+        return status;
+    }
+
+    char loose_hex[65] = {0};
+    if (loose)
+        eb_hash_to_hex(loose, loose_hex);
+    index_release(&idx);
+
+    eb_pack_set_t* opened = NULL;
+    if (!packs) {
+        status = eb_pack_open(root, &opened);
+        if (status != EB_SUCCESS)
+            return status;
+        packs = opened;
+    }
+
+    char packed_hex[65];
+    eb_status_t pack_status = eb_pack_resolve_prefix(packs, prefix, packed_hex);
+    eb_pack_close(opened);
+
+    if (pack_status == EB_ERROR_HASH_AMBIGUOUS)
+        return pack_status;
+    if (pack_status == EB_SUCCESS) {
+        /* The same object may be both loose and packed */
+        if (loose_hex[0] && strcmp(loose_hex, packed_hex) != 0)
+            return EB_ERROR_HASH_AMBIGUOUS;
+        memcpy(full_hash, packed_hex, 65);
+        return EB_SUCCESS;
+    }
+
+    if (!loose_hex[0])
+        return EB_ERROR_NOT_FOUND;
+    memcpy(full_hash, loose_hex, 65);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_hash_index_rebuild(const char* root) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+
+    loose_index_t idx;
+    eb_status_t status = index_load(root, true, &idx);
+    index_release(&idx);
+    return status;
+}
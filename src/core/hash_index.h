@@ -0,0 +1,64 @@
+/*
+ * EmbeddingBridge - Sorted Object Hash Index
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_HASH_INDEX_H
+#define EB_HASH_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "status.h"
+#include "pack.h"
+
+/*
+ * .embr/metadata/objects.idx caches the sorted binary hashes of all loose
+ * objects so short hashes resolve with a binary search instead of a
+ * readdir() over the whole objects directory. The index records the newest
+ * mtime of the directories holding loose objects (see object_path.h) and
+ * is rebuilt lazily once that changes. Packed objects are resolved through the pack indexes.
+ */
+
+#define EB_HASH_INDEX_MAGIC   0x45424858  /* "EBHX" */
+#define EB_HASH_INDEX_VERSION 1
+#define EB_HASH_INDEX_FILE    "metadata/objects.idx"
+
+typedef struct {
+    uint32_t magic;       /* EB_HASH_INDEX_MAGIC */
+    uint32_t version;     /* EB_HASH_INDEX_VERSION */
+    uint32_t count;       /* Number of 32-byte hashes that follow */
+    uint32_t reserved;
+    int64_t dir_mtime;    /* Newest object directory mtime (seconds) at build time */
+    int64_t dir_mtime_ns; /* Nanosecond part of the same */
+} eb_hash_index_header_t;
+
+/**
+ * Resolve an abbreviated object hash
+ *
+ * Looks at loose objects through the sorted index (rebuilding it if the
+ * objects directory changed) and at packed objects through the pack
+ * indexes. Ambiguity is detected by comparing neighbouring entries.
+ *
+ * @param root Repository root (directory containing .embr)
+ * @param packs Already opened pack set, or NULL to open one for this call
+ * @param prefix Hex prefix of the hash
+ * @param full_hash Receives the unique full hash
+ * @return EB_SUCCESS, EB_ERROR_NOT_FOUND or EB_ERROR_HASH_AMBIGUOUS
+ */
+eb_status_t eb_hash_index_resolve(const char* root, const eb_pack_set_t* packs,
+                                  const char* prefix, char full_hash[65]);
+
+/**
+ * Rebuild the loose object index from the objects directory
+ *
+ * @param root Repository root
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_hash_index_rebuild(const char* root);
+
+#endif /* EB_HASH_INDEX_H */
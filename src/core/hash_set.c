@@ -0,0 +1,183 @@
+/*
+ * EmbeddingBridge - Object Hash Set Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "hash_set.h"
+#include "hash_utils.h"
+
+#define HASH_SET_MIN_SLOTS 64
+
+struct eb_hash_set {
+    uint8_t (*keys)[32];    /* Slot keys */
+    uint8_t* used;          /* Whether each slot holds a key */
+    size_t slot_count;      /* Power of two */
+    size_t count;
+};
+
+static size_t slot_of(const uint8_t hash[32], size_t slot_count) {
+    uint64_t h;
+    memcpy(&h, hash, sizeof(h));
+    return (size_t)h & (slot_count - 1);
+}
+
+static eb_status_t alloc_slots(eb_hash_set_t* set, size_t slot_count) {
+    set->keys = malloc(slot_count * sizeof(*set->keys));
+    set->used = calloc(slot_count, 1);
+    if (!set->keys || !set->used) {
+        free(set->keys);
+        free(set->used);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    set->slot_count = slot_count;
+    return EB_SUCCESS;
+}
+
+/* Slot holding hash, or the empty slot where it would go */
+static size_t probe(const eb_hash_set_t* set, const uint8_t hash[32]) {
+    size_t mask = set->slot_count - 1;
+    size_t i = slot_of(hash, set->slot_count);
+    while (set->used[i] && memcmp(set->keys[i], hash, 32) != 0)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static eb_status_t grow(eb_hash_set_t* set) {
+    eb_hash_set_t old = *set;
+    eb_status_t status = alloc_slots(set, old.slot_count * 2);
+    if (status != EB_SUCCESS) {
+        *set = old;
+        return status;
+    }
+    for (size_t i = 0; i < old.slot_count; i++) {
+        if (!old.used[i])
+            continue;
+        size_t j = probe(set, old.keys[i]);
+        memcpy(set->keys[j], old.keys[i], 32);
+        set->used[j] = 1;
+    }
+    free(old.keys);
+    free(old.used);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_hash_set_create(size_t expected, eb_hash_set_t** out) {
+    if (!out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_hash_set_t* set = calloc(1, sizeof(*set));
+    if (!set)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    size_t slot_count = HASH_SET_MIN_SLOTS;
+    while (slot_count / 2 < expected)
+        slot_count *= 2;
+    eb_status_t status = alloc_slots(set, slot_count);
+    if (status != EB_SUCCESS) {
+        free(set);
+        return status;
+    }
+    *out = set;
+    return EB_SUCCESS;
+}
+
+void eb_hash_set_destroy(eb_hash_set_t* set) {
+    if (!set)
+        return;
+    free(set->keys);
+    free(set->used);
+    free(set);
+}
+
+size_t eb_hash_set_count(const eb_hash_set_t* set) {
+    return set ? set->count : 0;
+}
+
+eb_status_t eb_hash_set_add(eb_hash_set_t* set, const uint8_t hash[32], bool* added) {
+    if (!set || !hash)
+        return EB_ERROR_INVALID_INPUT;
+
+    size_t i = probe(set, hash);
+    if (set->used[i]) {
+        if (added)
+            *added = false;
+        return EB_SUCCESS;
+    }
+    /* Keep the load factor at or below one half */
+    if ((set->count + 1) * 2 > set->slot_count) {
+        eb_status_t status = grow(set);
+        if (status != EB_SUCCESS)
+            return status;
+        i = probe(set, hash);
+    }
+    memcpy(set->keys[i], hash, 32);
+    set->used[i] = 1;
+    set->count++;
+    if (added)
+        *added = true;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_hash_set_add_hex(eb_hash_set_t* set, const char* hex_hash, bool* added) {
+    uint8_t hash[32];
+    if (!hex_hash || !eb_hex_to_hash(hex_hash, hash))
+        return EB_ERROR_INVALID_INPUT;
+    return eb_hash_set_add(set, hash, added);
+}
+
+bool eb_hash_set_contains(const eb_hash_set_t* set, const uint8_t hash[32]) {
+    if (!set || !hash || set->count == 0)
+        return false;
+    return set->used[probe(set, hash)];
+}
+
+bool eb_hash_set_contains_hex(const eb_hash_set_t* set, const char* hex_hash) {
+    uint8_t hash[32];
+    if (!hex_hash || !eb_hex_to_hash(hex_hash, hash))
+        return false;
+    return eb_hash_set_contains(set, hash);
+}
+
+bool eb_hash_set_remove(eb_hash_set_t* set, const uint8_t hash[32]) {
+    if (!set || !hash || set->count == 0)
+        return false;
+
+    size_t mask = set->slot_count - 1;
+    size_t hole = probe(set, hash);
+    if (!set->used[hole])
+        return false;
+    set->used[hole] = 0;
+    set->count--;
+
+    /* Pull back entries whose probe sequence passed through the hole */
+    for (size_t i = (hole + 1) & mask; set->used[i]; i = (i + 1) & mask) {
+        size_t home = slot_of(set->keys[i], set->slot_count);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            memcpy(set->keys[hole], set->keys[i], 32);
+            set->used[hole] = 1;
+            set->used[i] = 0;
+            hole = i;
+        }
+    }
+    return true;
+}
+
+int eb_hash_set_foreach(const eb_hash_set_t* set, eb_hash_set_visit_fn fn, void* ctx) {
+    if (!set || !fn)
+        return 0;
+    for (size_t i = 0; i < set->slot_count; i++) {
+        if (!set->used[i])
+            continue;
+        int rc = fn(set->keys[i], ctx);
+        if (rc != 0)
+            return rc;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * EmbeddingBridge - Object Hash Set
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_HASH_SET_H
+#define EB_HASH_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "status.h"
+
+/*
+ * In-memory set of 32-byte object hashes, for comparing one collection of
+ * objects against another (local against remote, referenced against
+ * stored) in O(1) per lookup.
+ *
+ * Open addressing with linear probing. Object hashes are SHA-256 digests,
+ * so their first 8 bytes already make a uniform slot hash. The table stays
+ * at most half full and doubles as it grows; removal shifts the following
+ * entries back so no tombstones are left.
+ */
+
+typedef struct eb_hash_set eb_hash_set_t;
+
+/* Visitor for eb_hash_set_foreach, a non-zero return stops the walk */
+typedef int (*eb_hash_set_visit_fn)(const uint8_t hash[32], void* ctx);
+
+/**
+ * Create an empty set
+ *
+ * @param expected Number of entries to size the table for, 0 for a default
+ * @param out Receives the set
+ * @return Status code
+ */
+eb_status_t eb_hash_set_create(size_t expected, eb_hash_set_t** out);
+
+/**
+ * Free a set
+ */
+void eb_hash_set_destroy(eb_hash_set_t* set);
+
+/**
+ * Number of entries in a set
+ */
+size_t eb_hash_set_count(const eb_hash_set_t* set);
+
+/**
+ * Add a hash
+ *
+ * @param set Set to add to
+ * @param hash Binary hash
+ * @param added Optional, receives whether it was not in the set yet
+ * @return Status code
+ */
+eb_status_t eb_hash_set_add(eb_hash_set_t* set, const uint8_t hash[32], bool* added);
+
+/**
+ * Add a 64-character hex hash
+ *
+ * @return Status code (EB_ERROR_INVALID_INPUT if it is not a full hash)
+ */
+eb_status_t eb_hash_set_add_hex(eb_hash_set_t* set, const char* hex_hash, bool* added);
+
+/**
+ * Check whether a set holds a hash
+ */
+bool eb_hash_set_contains(const eb_hash_set_t* set, const uint8_t hash[32]);
+
+/**
+ * Check whether a set holds a hex hash, false for anything but a full hash
+ */
+bool eb_hash_set_contains_hex(const eb_hash_set_t* set, const char* hex_hash);
+
+/**
+ * Remove a hash
+ *
+ * @return true if it was in the set
+ */
+bool eb_hash_set_remove(eb_hash_set_t* set, const uint8_t hash[32]);
+
+/**
+ * Visit every hash, in no particular order
+ *
+ * The set must not change during the walk.
+ *
+ * @param set Set to walk
+ * @param fn Visitor
+ * @param ctx Visitor context
+ * @return 0, or the visitor's value if it stopped the walk
+ */
+int eb_hash_set_foreach(const eb_hash_set_t* set, eb_hash_set_visit_fn fn, void* ctx);
+
+#endif /* EB_HASH_SET_H */
@@ -12,13 +12,14 @@
 #define EB_HASH_UTILS_H
 
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
 
-/* Get shortened version of a hash (first 7 characters) */
-static inline char* get_short_hash(const char* full_hash) {
-        static char short_hash[8];  // 7 chars + null terminator
-        strncpy(short_hash, full_hash, 7);
-        short_hash[7] = '\0';
-        return short_hash;
+/* Shortened version of a hash (first 7 characters), written to out */
+static inline char* get_short_hash(const char* full_hash, char out[8]) {
+        strncpy(out, full_hash, 7);
+        out[7] = '\0';
+        return out;
 }
 
 /* Check if a short hash matches a full hash */
@@ -29,4 +30,63 @@ static inline bool is_hash_prefix(const char* prefix, const char* full_hash) {
         return strncmp(prefix, full_hash, strlen(prefix)) == 0;
 }
 
+/* Value of a single hex digit, or -1 */
+static inline int eb_hex_digit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+}
+
+/* Parse a full 64-character hex hash into 32 bytes */
+static inline bool eb_hex_to_hash(const char* hex, uint8_t out[32]) {
+        for (int i = 0; i < 32; i++) {
+                int hi = eb_hex_digit(hex[i * 2]);
+                int lo = hi < 0 ? -1 : eb_hex_digit(hex[i * 2 + 1]);
+                if (hi < 0 || lo < 0)
+                        return false;
+                out[i] = (uint8_t)((hi << 4) | lo);
+        }
+        return hex[64] == '\0';
+}
+
+/* Format 32 bytes as a 64-character lowercase hex hash */
+static inline void eb_hash_to_hex(const uint8_t hash[32], char out[65]) {
+        static const char hex[] = "0123456789abcdef";
+        for (int i = 0; i < 32; i++) {
+                out[i * 2] = hex[hash[i] >> 4];
+                out[i * 2 + 1] = hex[hash[i] & 0xf];
+        }
+        out[64] = '\0';
+}
+
+/*
+ * Turn a hex prefix into the lowest 32-byte key that carries it (remaining
+ * nibbles zero). Returns the number of nibbles, or 0 if the prefix is empty,
+ * too long or not hex.
+ */
+static inline size_t eb_hex_prefix_key(const char* prefix, uint8_t key[32]) {
+        size_t nibbles = strlen(prefix);
+        if (nibbles == 0 || nibbles > 64)
+                return 0;
+        memset(key, 0, 32);
+        for (size_t i = 0; i < nibbles; i++) {
+                int v = eb_hex_digit(prefix[i]);
+                if (v < 0)
+                        return 0;
+                key[i / 2] |= (uint8_t)((i & 1) ? v : v << 4);
+        }
+        return nibbles;
+}
+
+/* Does a binary hash start with the first nibbles of key? */
+static inline bool eb_hash_has_prefix(const uint8_t hash[32], const uint8_t key[32], size_t nibbles) {
+        size_t full = nibbles / 2;
+        if (memcmp(hash, key, full) != 0)
+                return false;
+        if (nibbles & 1)
+                return (hash[full] & 0xf0) == (key[full] & 0xf0);
+        return true;
+}
+
 #endif /* EB_HASH_UTILS_H */ 
\ No newline at end of file
@@ -0,0 +1,219 @@
+/*
+ * EmbeddingBridge - Columnar Version History Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+#include "log_index.h"
+#include "hash_utils.h"
+#include "path_utils.h"
+
+#define HISTORY_MIN_ROWS 256
+#define NAME_MIN_SLOTS 64
+#define NAME_MODELS 0
+#define NAME_SOURCES 1
+#define NO_NAME UINT32_MAX
+
+static uint64_t hash_name(const char* s) {
+    uint64_t h = 0xCBF29CE484222325ULL;         /* FNV-1a */
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 0x100000001B3ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+static const char** names_of(const eb_history_t* h, int kind) {
+    return kind == NAME_MODELS ? h->models : h->sources;
+}
+
+/* Slot holding name, or the empty slot where it would go */
+static size_t probe_name(const eb_history_t* h, int kind, uint64_t key, const char* name) {
+    size_t mask = h->name_slot_count[kind] - 1;
+    size_t i = (size_t)key & mask;
+    const char** names = names_of(h, kind);
+    while (h->name_slots[kind][i] != NO_NAME &&
+           (h->name_keys[kind][i] != key || strcmp(names[h->name_slots[kind][i]], name) != 0))
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int alloc_name_slots(eb_history_t* h, int kind, size_t slot_count) {
+    uint64_t* keys = malloc(slot_count * sizeof(*keys));
+    uint32_t* slots = malloc(slot_count * sizeof(*slots));
+    if (!keys || !slots) {
+        free(keys);
+        free(slots);
+        return -1;
+    }
+    memset(slots, 0xFF, slot_count * sizeof(*slots));
+    free(h->name_keys[kind]);
+    free(h->name_slots[kind]);
+    h->name_keys[kind] = keys;
+    h->name_slots[kind] = slots;
+    h->name_slot_count[kind] = slot_count;
+    return 0;
+}
+
+/* Names are few next to rows, so growth simply rehashes them */
+static int grow_names(eb_history_t* h, int kind) {
+    size_t count = kind == NAME_MODELS ? h->model_count : h->source_count;
+    if (alloc_name_slots(h, kind, h->name_slot_count[kind] * 2) != 0)
+        return -1;
+    const char** names = names_of(h, kind);
+    for (size_t n = 0; n < count; n++) {
+        uint64_t key = hash_name(names[n]);
+        size_t i = probe_name(h, kind, key, names[n]);
+        h->name_keys[kind][i] = key;
+        h->name_slots[kind][i] = (uint32_t)n;
+    }
+    return 0;
+}
+
+static uint32_t intern(eb_history_t* h, int kind, const char* name) {
+    uint64_t key = hash_name(name);
+    size_t i = probe_name(h, kind, key, name);
+    if (h->name_slots[kind][i] != NO_NAME)
+        return h->name_slots[kind][i];
+
+    size_t* count = kind == NAME_MODELS ? &h->model_count : &h->source_count;
+    const char*** names = kind == NAME_MODELS ? &h->models : &h->sources;
+    if (*count == h->name_capacity[kind]) {
+        size_t capacity = h->name_capacity[kind] ? h->name_capacity[kind] * 2 : 16;
+        const char** grown = realloc(*names, capacity * sizeof(*grown));
+        if (!grown)
+            return NO_NAME;
+        *names = grown;
+        h->name_capacity[kind] = capacity;
+    }
+    const char* copy = eb_arena_strdup(&h->strings, name);
+    if (!copy)
+        return NO_NAME;
+    uint32_t id = (uint32_t)*count;
+    (*names)[id] = copy;
+    (*count)++;
+
+    if ((*count) * 2 > h->name_slot_count[kind]) {
+        if (grow_names(h, kind) != 0)
+            return NO_NAME;
+    } else {
+        h->name_keys[kind][i] = key;
+        h->name_slots[kind][i] = id;
+    }
+    return id;
+}
+
+static int grow_column(void** column, size_t capacity, size_t size) {
+    void* grown = realloc(*column, capacity * size);
+    if (!grown)
+        return -1;
+    *column = grown;
+    return 0;
+}
+
+static int reserve_row(eb_history_t* h) {
+    if (h->count < h->capacity)
+        return 0;
+    size_t capacity = h->capacity ? h->capacity * 2 : HISTORY_MIN_ROWS;
+    if (grow_column((void**)&h->timestamps, capacity, sizeof(*h->timestamps)) != 0 ||
+        grow_column((void**)&h->hashes, capacity, sizeof(*h->hashes)) != 0 ||
+        grow_column((void**)&h->model_ids, capacity, sizeof(*h->model_ids)) != 0 ||
+        grow_column((void**)&h->source_ids, capacity, sizeof(*h->source_ids)) != 0 ||
+        grow_column((void**)&h->flags, capacity, sizeof(*h->flags)) != 0)
+        return -1;
+    h->capacity = capacity;
+    return 0;
+}
+
+static int add_entry(const eb_log_entry_t* entry, void* ctx) {
+    eb_history_t* h = ctx;
+    uint32_t model = intern(h, NAME_MODELS, entry->model);
+    uint32_t source = intern(h, NAME_SOURCES, entry->source);
+    if (model == NO_NAME || source == NO_NAME || reserve_row(h) != 0) {
+        h->failed = 1;
+        return 1;
+    }
+
+    size_t row = h->count++;
+    h->timestamps[row] = (int64_t)entry->timestamp;
+    h->model_ids[row] = model;
+    h->source_ids[row] = source;
+    h->flags[row] = entry->removed ? EB_HISTORY_REMOVED : 0;
+    if (entry->removed || !eb_hex_to_hash(entry->hash, h->hashes[row]))
+        memset(h->hashes[row], 0, sizeof(h->hashes[row]));
+    return 0;
+}
+
+eb_status_t eb_history_load(const char* log_path, const char* source, eb_history_t** out) {
+    if (!log_path || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_history_t* h = calloc(1, sizeof(*h));
+    if (!h)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    eb_arena_init(&h->strings, 0);
+    if (alloc_name_slots(h, NAME_MODELS, NAME_MIN_SLOTS) != 0 ||
+        alloc_name_slots(h, NAME_SOURCES, NAME_MIN_SLOTS) != 0) {
+        eb_history_free(h);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    eb_status_t status = source ? eb_log_foreach_source(log_path, source, add_entry, h)
+                                : eb_log_foreach(log_path, add_entry, h);
+    if (status == EB_SUCCESS && h->failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status != EB_SUCCESS) {
+        eb_history_free(h);
+        return status;
+    }
+    *out = h;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_history_load_current(const char* source, eb_history_t** out) {
+    char* log_path = get_current_set_log_path();
+    if (!log_path)
+        return EB_ERROR_NOT_INITIALIZED;
+    eb_status_t status = eb_history_load(log_path, source, out);
+    free(log_path);
+    return status;
+}
+
+void eb_history_free(eb_history_t* history) {
+    if (!history)
+        return;
+    free(history->timestamps);
+    free(history->hashes);
+    free(history->model_ids);
+    free(history->source_ids);
+    free(history->flags);
+    free(history->models);
+    free(history->sources);
+    for (int kind = 0; kind < 2; kind++) {
+        free(history->name_keys[kind]);
+        free(history->name_slots[kind]);
+    }
+    eb_arena_destroy(&history->strings);
+    free(history);
+}
+
+static uint32_t find_name(const eb_history_t* h, int kind, const char* name) {
+    if (!h || !name)
+        return NO_NAME;
+    return h->name_slots[kind][probe_name(h, kind, hash_name(name), name)];
+}
+
+uint32_t eb_history_model_id(const eb_history_t* history, const char* model) {
+    return find_name(history, NAME_MODELS, model);
+}
+
+uint32_t eb_history_source_id(const eb_history_t* history, const char* source) {
+    return find_name(history, NAME_SOURCES, source);
+}
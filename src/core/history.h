@@ -0,0 +1,77 @@
+/*
+ * EmbeddingBridge - Columnar Version History
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_HISTORY_H
+#define EB_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+#include "arena.h"
+
+/*
+ * The set log as columns, for analytics over many versions (model usage
+ * over time, churn per file) where get_version_history()'s one
+ * eb_stored_vector_t per version is too heavy.
+ *
+ * Row i is the i-th log line, oldest first: timestamps[i], hashes[i]
+ * (binary, all zero for a removal), flags[i], and model_ids[i] and
+ * source_ids[i] indexing the interned names in models and sources. The
+ * columns are filled in one pass over the log (through its index for a
+ * single source); walking and filtering them allocates nothing.
+ *
+ * Fields below the marker are internal.
+ */
+
+#define EB_HISTORY_REMOVED 0x01     /* A tombstone line (log_index.h) */
+
+typedef struct {
+    size_t count;                   /* Rows */
+    int64_t* timestamps;
+    uint8_t (*hashes)[32];
+    uint32_t* model_ids;
+    uint32_t* source_ids;
+    uint8_t* flags;
+
+    const char** models;            /* Distinct models, in order of first use */
+    size_t model_count;
+    const char** sources;           /* Distinct sources, in order of first use */
+    size_t source_count;
+
+    /* Internal */
+    size_t capacity;
+    size_t name_capacity[2];
+    uint64_t* name_keys[2];         /* Open addressing over models and sources */
+    uint32_t* name_slots[2];
+    size_t name_slot_count[2];
+    eb_arena_t strings;
+    int failed;
+} eb_history_t;
+
+/**
+ * Read the history of a set log
+ *
+ * @param log_path Set log
+ * @param source Only this source, as written in the log; NULL for all
+ * @param out Receives the history, free with eb_history_free()
+ * @return Status code (an empty history if the log does not exist)
+ */
+eb_status_t eb_history_load(const char* log_path, const char* source, eb_history_t** out);
+
+/* eb_history_load() on the log of the current set */
+eb_status_t eb_history_load_current(const char* source, eb_history_t** out);
+
+void eb_history_free(eb_history_t* history);
+
+/* Interned id of a model or source name, UINT32_MAX if it never occurs */
+uint32_t eb_history_model_id(const eb_history_t* history, const char* model);
+uint32_t eb_history_source_id(const eb_history_t* history, const char* source);
+
+#endif /* EB_HISTORY_H */
@@ -0,0 +1,1426 @@
+/*
+ * EmbeddingBridge - HNSW Vector Index Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hnsw.h"
+#include "distance.h"
+#include "quantize.h"
+#include "store.h"
+#include "types.h"
+#include "hash_utils.h"
+#include "path_utils.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define GRAPH_SUFFIX  ".hnsw"
+#define VECTOR_SUFFIX ".vec"
+
+/* Vectors file header; rows follow */
+typedef struct {
+    uint32_t magic;             /* EB_HNSW_VECTORS_MAGIC */
+    uint32_t version;
+    uint32_t dims;
+    uint32_t reserved;
+} vector_file_header_t;
+
+/* Graphs with fewer nodes are never compacted */
+#define COMPACT_MIN_NODES 64
+
+/* Visit marks for one search; a node is visited when marks[id] == epoch */
+typedef struct {
+    uint32_t* marks;
+    size_t capacity;
+    uint32_t epoch;
+} visit_t;
+
+/*
+ * A graph in memory. Searches point the arrays into the mapped graph file;
+ * updates copy them into owned buffers that can grow.
+ */
+typedef struct {
+    eb_hnsw_header_t header;
+    eb_hnsw_node_t* nodes;
+    uint32_t* links0;           /* node_count lists of 2m + 1 words */
+    uint32_t* upper;            /* upper_words words */
+    char* strings;              /* strings_size bytes */
+    bool owned;
+    size_t node_capacity;
+    size_t links_capacity;      /* In words */
+    size_t upper_capacity;
+    size_t strings_capacity;
+
+    /* Rows 0..mapped_count come from the vectors file, the rest from added */
+    const float* mapped;
+    size_t mapped_count;
+    float* added;
+    size_t added_capacity;
+
+    void* graph_map;
+    size_t graph_map_size;
+    void* vector_map;
+    size_t vector_map_size;
+
+    visit_t visit;              /* Used while inserting */
+    uint32_t* table;            /* Source -> newest node, open addressing */
+    size_t table_size;
+    bool dirty;
+} graph_t;
+
+struct eb_hnsw {
+    graph_t graph;
+};
+
+typedef struct {
+    float dist;
+    uint32_t id;
+} cand_t;
+
+/* Binary heap of candidates, nearest or farthest on top */
+typedef struct {
+    cand_t* items;
+    size_t size;
+    size_t capacity;
+    bool farthest;
+} heap_t;
+
+/* ---- Heaps ---- */
+
+static bool heap_above(const heap_t* h, const cand_t* a, const cand_t* b) {
+    if (a->dist != b->dist)
+        return h->farthest ? a->dist > b->dist : a->dist < b->dist;
+    return h->farthest ? a->id > b->id : a->id < b->id;
+}
+
+static bool heap_push(heap_t* h, float dist, uint32_t id) {
+    if (h->size == h->capacity) {
+        size_t capacity = h->capacity ? h->capacity * 2 : 64;
+        cand_t* grown = realloc(h->items, capacity * sizeof(*grown));
+        if (!grown)
+            return false;
+        h->items = grown;
+        h->capacity = capacity;
+    }
+    cand_t c = { dist, id };
+    size_t i = h->size++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!heap_above(h, &c, &h->items[parent]))
+            break;
+        h->items[i] = h->items[parent];
+        i = parent;
+    }
+    h->items[i] = c;
+    return true;
+}
+
+static cand_t heap_pop(heap_t* h) {
+    cand_t top = h->items[0];
+    cand_t last = h->items[--h->size];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= h->size)
+            break;
+        if (child + 1 < h->size && heap_above(h, &h->items[child + 1], &h->items[child]))
+            child++;
+        if (!heap_above(h, &h->items[child], &last))
+            break;
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    if (h->size)
+        h->items[i] = last;
+    return top;
+}
+
+static int compare_cands(const void* a, const void* b) {
+    const cand_t* x = a;
+    const cand_t* y = b;
+    if (x->dist != y->dist)
+        return x->dist < y->dist ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/* ---- Graph access ---- */
+
+static size_t level0_words(const graph_t* g) {
+    return 2 * (size_t)g->header.m + 1;
+}
+
+static uint32_t level_capacity(const graph_t* g, uint32_t level) {
+    return level == 0 ? 2 * g->header.m : g->header.m;
+}
+
+static uint32_t* links_at(const graph_t* g, uint32_t id, uint32_t level) {
+    if (level == 0)
+        return g->links0 + (size_t)id * level0_words(g);
+    return g->upper + g->nodes[id].upper_offset + (size_t)(level - 1) * (g->header.m + 1);
+}
+
+static const float* row(const graph_t* g, uint32_t id) {
+    size_t dims = g->header.dims;
+    if (id < g->mapped_count)
+        return g->mapped + (size_t)id * dims;
+    return g->added + (size_t)(id - g->mapped_count) * dims;
+}
+
+static float distance(const graph_t* g, const float* query, uint32_t id) {
+    return 1.0f - eb_dot(query, row(g, id), g->header.dims);
+}
+
+static bool is_deleted(const graph_t* g, uint32_t id) {
+    return (g->nodes[id].flags & EB_HNSW_DELETED) != 0;
+}
+
+static const char* node_source(const graph_t* g, uint32_t id) {
+    return g->strings + g->nodes[id].source_offset;
+}
+
+static bool visit_reserve(visit_t* v, size_t count) {
+    if (count > v->capacity) {
+        size_t capacity = v->capacity ? v->capacity : 1024;
+        while (capacity < count)
+            capacity *= 2;
+        uint32_t* grown = realloc(v->marks, capacity * sizeof(*grown));
+        if (!grown)
+            return false;
+        memset(grown + v->capacity, 0, (capacity - v->capacity) * sizeof(*grown));
+        v->marks = grown;
+        v->capacity = capacity;
+    }
+    return true;
+}
+
+static void visit_begin(visit_t* v) {
+    if (++v->epoch == 0) {
+        memset(v->marks, 0, v->capacity * sizeof(*v->marks));
+        v->epoch = 1;
+    }
+}
+
+/* Follow the nearest link on each level above target */
+static void descend(const graph_t* g, const float* query, uint32_t target,
+                    uint32_t* node, float* dist) {
+    for (uint32_t level = g->header.max_level; level > target; level--) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const uint32_t* links = links_at(g, *node, level);
+            for (uint32_t i = 1; i <= links[0]; i++) {
+                float d = distance(g, query, links[i]);
+                if (d < *dist) {
+                    *dist = d;
+                    *node = links[i];
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Best-first search of one level, starting from the candidates in entry.
+ * Leaves the ef nearest nodes in results, a farthest-on-top heap. Removed
+ * nodes are walked through but only returned when include_deleted is set.
+ */
+static eb_status_t search_level(const graph_t* g, const float* query, const heap_t* entry,
+                                size_t ef, uint32_t level, bool include_deleted,
+                                visit_t* visit, heap_t* results) {
+    heap_t queue = { NULL, 0, 0, false };
+    results->size = 0;
+    results->farthest = true;
+    visit_begin(visit);
+
+    for (size_t i = 0; i < entry->size; i++) {
+        const cand_t* e = &entry->items[i];
+        visit->marks[e->id] = visit->epoch;
+        if (!heap_push(&queue, e->dist, e->id))
+            goto oom;
+        if (include_deleted || !is_deleted(g, e->id)) {
+            if (!heap_push(results, e->dist, e->id))
+                goto oom;
+        }
+    }
+    while (results->size > ef)
+        heap_pop(results);
+
+    while (queue.size) {
+        cand_t c = heap_pop(&queue);
+        if (results->size >= ef && c.dist > results->items[0].dist)
+            break;
+
+        const uint32_t* links = links_at(g, c.id, level);
+        for (uint32_t i = 1; i <= links[0]; i++) {
+            uint32_t id = links[i];
+            if (visit->marks[id] == visit->epoch)
+                continue;
+            visit->marks[id] = visit->epoch;
+
+            float d = distance(g, query, id);
+            if (results->size >= ef && d >= results->items[0].dist)
+                continue;
+            if (!heap_push(&queue, d, id))
+                goto oom;
+            if (include_deleted || !is_deleted(g, id)) {
+                if (!heap_push(results, d, id))
+                    goto oom;
+                if (results->size > ef)
+                    heap_pop(results);
+            }
+        }
+    }
+
+    free(queue.items);
+    return EB_SUCCESS;
+
+oom:
+    free(queue.items);
+    return EB_ERROR_MEMORY_ALLOCATION;
+}
+
+/*
+ * Neighbor selection heuristic: keep a candidate only if it is closer to
+ * the base than to every neighbor kept so far, which spreads the links
+ * over different directions. cands must be sorted nearest first.
+ */
+static uint32_t select_neighbors(const graph_t* g, const cand_t* cands, size_t count,
+                                 uint32_t max, uint32_t* out) {
+    uint32_t selected = 0;
+    for (size_t i = 0; i < count && selected < max; i++) {
+        const float* candidate = row(g, cands[i].id);
+        bool keep = true;
+        for (uint32_t j = 0; j < selected && keep; j++)
+            keep = distance(g, candidate, out[j]) >= cands[i].dist;
+        if (keep)
+            out[selected++] = cands[i].id;
+    }
+    return selected;
+}
+
+/* Link node back from neighbor, re-selecting the neighbor's links when full */
+static void link_back(graph_t* g, uint32_t neighbor, uint32_t node, uint32_t level) {
+    uint32_t* links = links_at(g, neighbor, level);
+    uint32_t capacity = level_capacity(g, level);
+    if (links[0] < capacity) {
+        links[1 + links[0]++] = node;
+        return;
+    }
+
+    cand_t cands[2 * EB_HNSW_MAX_M + 1];
+    const float* base = row(g, neighbor);
+    for (uint32_t i = 0; i < capacity; i++)
+        cands[i] = (cand_t){ distance(g, base, links[1 + i]), links[1 + i] };
+    cands[capacity] = (cand_t){ distance(g, base, node), node };
+    qsort(cands, capacity + 1, sizeof(*cands), compare_cands);
+    links[0] = select_neighbors(g, cands, capacity + 1, capacity, links + 1);
+}
+
+/* ---- Graph construction ---- */
+
+static uint32_t random_level(graph_t* g) {
+    uint64_t x = g->header.rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    g->header.rng_state = x;
+
+    double u = (double)((x >> 11) + 1) / 9007199254740992.0;  // (0, 1]
+    double level = -log(u) / log((double)g->header.m);
+    return level >= EB_HNSW_MAX_LEVEL - 1 ? EB_HNSW_MAX_LEVEL - 1 : (uint32_t)level;
+}
+
+static void graph_init(graph_t* g, const char* model, uint32_t dims, uint32_t m,
+                       uint32_t ef_construction, uint64_t generation) {
+    memset(g, 0, sizeof(*g));
+    g->header.magic = EB_HNSW_MAGIC;
+    g->header.version = EB_HNSW_VERSION;
+    g->header.dims = dims;
+    g->header.m = m;
+    g->header.ef_construction = ef_construction;
+    g->header.entry_point = EB_HNSW_NONE;
+    g->header.generation = generation;
+    g->header.rng_state = 0x9E3779B97F4A7C15ull;
+    snprintf(g->header.model, sizeof(g->header.model), "%s", model);
+    g->owned = true;
+}
+
+static bool grow(void** buffer, size_t* capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity)
+        return true;
+    size_t grown_capacity = *capacity ? *capacity : 64;
+    while (grown_capacity < needed)
+        grown_capacity *= 2;
+    void* grown = realloc(*buffer, grown_capacity * item_size);
+    if (!grown)
+        return false;
+    *buffer = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+static uint64_t hash_source(const char* source) {
+    uint64_t h = 1469598103934665603ull;
+    for (; *source; source++)
+        h = (h ^ (uint8_t)*source) * 1099511628211ull;
+    return h;
+}
+
+/* Slot holding source, or the empty slot where it belongs */
+static size_t table_slot(const graph_t* g, const char* source) {
+    size_t mask = g->table_size - 1;
+    size_t slot = (size_t)hash_source(source) & mask;
+    while (g->table[slot] != EB_HNSW_NONE && strcmp(node_source(g, g->table[slot]), source) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+/* Map every source to its newest node, sized for the nodes to come */
+static bool table_rebuild(graph_t* g, size_t expected) {
+    size_t size = 64;
+    while (size < 2 * expected)
+        size *= 2;
+    uint32_t* table = malloc(size * sizeof(*table));
+    if (!table)
+        return false;
+    memset(table, 0xFF, size * sizeof(*table));
+    free(g->table);
+    g->table = table;
+    g->table_size = size;
+
+    for (uint32_t id = 0; id < g->header.node_count; id++) {
+        if (!is_deleted(g, id))
+            g->table[table_slot(g, node_source(g, id))] = id;
+    }
+    return true;
+}
+
+/* Mark the live node of source removed */
+static void remove_source(graph_t* g, const char* source) {
+    if (!g->table_size)
+        return;
+    size_t slot = table_slot(g, source);
+    uint32_t id = g->table[slot];
+    if (id == EB_HNSW_NONE || is_deleted(g, id))
+        return;
+    g->nodes[id].flags |= EB_HNSW_DELETED;
+    g->header.deleted_count++;
+    g->dirty = true;
+}
+
+/* Add a unit-length vector as a new node */
+static eb_status_t graph_insert(graph_t* g, const float* vector, const uint8_t hash[32],
+                                const char* source) {
+    uint32_t m = g->header.m;
+    size_t count = g->header.node_count;
+    size_t source_size = strlen(source) + 1;
+    if (count >= EB_HNSW_NONE - 1)
+        return EB_ERROR_LIMIT_EXCEEDED;
+
+    uint32_t level = random_level(g);
+    size_t upper_needed = g->header.upper_words + (size_t)level * (m + 1);
+    if (!grow((void**)&g->nodes, &g->node_capacity, count + 1, sizeof(*g->nodes)) ||
+        !grow((void**)&g->links0, &g->links_capacity, (count + 1) * level0_words(g), sizeof(uint32_t)) ||
+        !grow((void**)&g->upper, &g->upper_capacity, upper_needed, sizeof(uint32_t)) ||
+        !grow((void**)&g->strings, &g->strings_capacity, g->header.strings_size + source_size, 1) ||
+        !grow((void**)&g->added, &g->added_capacity, (count + 1 - g->mapped_count) * g->header.dims,
+              sizeof(float)) ||
+        !visit_reserve(&g->visit, count + 1))
+        return EB_ERROR_MEMORY_ALLOCATION;
+    if ((count + 1) * 2 > g->table_size && !table_rebuild(g, count + 1))
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    uint32_t id = (uint32_t)count;
+    eb_hnsw_node_t* node = &g->nodes[id];
+    memset(node, 0, sizeof(*node));
+    memcpy(node->hash, hash, 32);
+    node->source_offset = g->header.strings_size;
+    node->upper_offset = g->header.upper_words;
+    node->level = level;
+    memcpy(g->strings + g->header.strings_size, source, source_size);
+    g->header.strings_size += source_size;
+    if (level)
+        memset(g->upper + g->header.upper_words, 0, (size_t)level * (m + 1) * sizeof(uint32_t));
+    g->header.upper_words = upper_needed;
+    memset(links_at(g, id, 0), 0, level0_words(g) * sizeof(uint32_t));
+    memcpy(g->added + (count - g->mapped_count) * g->header.dims, vector,
+           g->header.dims * sizeof(float));
+    g->header.node_count++;
+    g->table[table_slot(g, source)] = id;
+    g->dirty = true;
+
+    if (g->header.entry_point == EB_HNSW_NONE) {
+        g->header.entry_point = id;
+        g->header.max_level = level;
+        return EB_SUCCESS;
+    }
+
+    const float* query = row(g, id);
+    uint32_t entry = g->header.entry_point;
+    float entry_dist = distance(g, query, entry);
+    uint32_t top = level < g->header.max_level ? level : g->header.max_level;
+    descend(g, query, top, &entry, &entry_dist);
+
+    heap_t entries = { NULL, 0, 0, false };
+    heap_t found = { NULL, 0, 0, true };
+    cand_t* sorted = NULL;
+    eb_status_t status = heap_push(&entries, entry_dist, entry) ? EB_SUCCESS : EB_ERROR_MEMORY_ALLOCATION;
+
+    for (uint32_t l = top + 1; l-- > 0 && status == EB_SUCCESS; ) {
+        status = search_level(g, query, &entries, g->header.ef_construction, l, true, &g->visit, &found);
+        if (status != EB_SUCCESS)
+            break;
+
+        cand_t* grown = realloc(sorted, (found.size ? found.size : 1) * sizeof(*sorted));
+        if (!grown) {
+            status = EB_ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+        sorted = grown;
+        memcpy(sorted, found.items, found.size * sizeof(*sorted));
+        qsort(sorted, found.size, sizeof(*sorted), compare_cands);
+
+        uint32_t* links = links_at(g, id, l);
+        links[0] = select_neighbors(g, sorted, found.size, m, links + 1);
+        for (uint32_t i = 1; i <= links[0]; i++)
+            link_back(g, links[i], id, l);
+
+        // The nodes found on this level seed the next one
+        heap_t swap = entries;
+        entries = found;
+        entries.farthest = false;
+        found = swap;
+        found.farthest = true;
+    }
+
+    free(sorted);
+    free(entries.items);
+    free(found.items);
+    if (status == EB_SUCCESS && level > g->header.max_level) {
+        g->header.max_level = level;
+        g->header.entry_point = id;
+    }
+    return status;
+}
+
+static void graph_free(graph_t* g) {
+    if (g->owned) {
+        free(g->nodes);
+        free(g->links0);
+        free(g->upper);
+        free(g->strings);
+    }
+    free(g->added);
+    free(g->visit.marks);
+    free(g->table);
+    if (g->graph_map)
+        munmap(g->graph_map, g->graph_map_size);
+    if (g->vector_map)
+        munmap(g->vector_map, g->vector_map_size);
+    memset(g, 0, sizeof(*g));
+}
+
+/* ---- Files ---- */
+
+/* Escape a model name into a file name; "" becomes "-" */
+static void escape_model(const char* model, char* out, size_t size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t pos = 0;
+    if (!*model) {
+        snprintf(out, size, "-");
+        return;
+    }
+    for (const char* p = model; *p && pos + 4 < size; p++) {
+        unsigned char c = (unsigned char)*p;
+        bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                     c == '_' || ((c == '.' || c == '-') && p != model);
+        if (plain) {
+            out[pos++] = (char)c;
+        } else {
+            out[pos++] = '%';
+            out[pos++] = hex[c >> 4];
+            out[pos++] = hex[c & 0xF];
+        }
+    }
+    out[pos] = '\0';
+}
+
+static void graph_path(const char* dir, const char* model, char* path, size_t size) {
+    char name[PATH_MAX / 2];
+    escape_model(model, name, sizeof(name));
+    snprintf(path, size, "%s/%s" GRAPH_SUFFIX, dir, name);
+}
+
+static void vector_path(const char* dir, const char* model, uint64_t generation,
+                        char* path, size_t size) {
+    char name[PATH_MAX / 2];
+    escape_model(model, name, sizeof(name));
+    snprintf(path, size, "%s/%s.%llu" VECTOR_SUFFIX, dir, name, (unsigned long long)generation);
+}
+
+static eb_status_t map_file(const char* path, void** map, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return st.st_size == 0 ? EB_ERROR_INVALID_FORMAT : EB_ERROR_FILE_IO;
+    }
+    *size = (size_t)st.st_size;
+    *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*map == MAP_FAILED) {
+        *map = NULL;
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+/* Check that every offset and link of a mapped graph stays inside it */
+static bool graph_valid(const graph_t* g) {
+    const eb_hnsw_header_t* h = &g->header;
+    if (h->entry_point != EB_HNSW_NONE &&
+        (h->entry_point >= h->node_count || h->max_level >= EB_HNSW_MAX_LEVEL))
+        return false;
+    if (h->strings_size && g->strings[h->strings_size - 1] != '\0')
+        return false;
+
+    for (uint32_t id = 0; id < h->node_count; id++) {
+        const eb_hnsw_node_t* node = &g->nodes[id];
+        if (node->level >= EB_HNSW_MAX_LEVEL || node->source_offset >= h->strings_size ||
+            node->upper_offset + (uint64_t)node->level * (h->m + 1) > h->upper_words)
+            return false;
+        for (uint32_t level = 0; level <= node->level; level++) {
+            const uint32_t* links = links_at(g, id, level);
+            if (links[0] > level_capacity(g, level))
+                return false;
+            for (uint32_t i = 1; i <= links[0]; i++) {
+                if (links[i] >= h->node_count || g->nodes[links[i]].level < level)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Load a graph and map its vectors; writable graphs get owned, growable arrays */
+static eb_status_t graph_open(const char* dir, const char* model, bool writable, graph_t* g) {
+    memset(g, 0, sizeof(*g));
+    char path[PATH_MAX];
+    graph_path(dir, model, path, sizeof(path));
+    eb_status_t status = map_file(path, &g->graph_map, &g->graph_map_size);
+    if (status != EB_SUCCESS)
+        return status;
+
+    const uint8_t* base = g->graph_map;
+    if (g->graph_map_size < sizeof(g->header))
+        goto invalid;
+    memcpy(&g->header, base, sizeof(g->header));
+    const eb_hnsw_header_t* h = &g->header;
+    if (h->magic != EB_HNSW_MAGIC || h->version != EB_HNSW_VERSION || h->dims == 0 ||
+        h->m < 2 || h->m > EB_HNSW_MAX_M || h->node_count >= EB_HNSW_NONE ||
+        h->deleted_count > h->node_count || h->model[sizeof(h->model) - 1] != '\0')
+        goto invalid;
+
+    size_t nodes_size = (size_t)h->node_count * sizeof(eb_hnsw_node_t);
+    size_t links_size = (size_t)h->node_count * level0_words(g) * sizeof(uint32_t);
+    if (h->upper_words > g->graph_map_size / sizeof(uint32_t) || h->strings_size > g->graph_map_size ||
+        sizeof(*h) + nodes_size + links_size + h->upper_words * sizeof(uint32_t) + h->strings_size !=
+            g->graph_map_size)
+        goto invalid;
+
+    g->nodes = (eb_hnsw_node_t*)(base + sizeof(*h));
+    g->links0 = (uint32_t*)((uint8_t*)g->nodes + nodes_size);
+    g->upper = (uint32_t*)((uint8_t*)g->links0 + links_size);
+    g->strings = (char*)(g->upper + h->upper_words);
+    if (!graph_valid(g))
+        goto invalid;
+
+    vector_path(dir, model, h->generation, path, sizeof(path));
+    status = map_file(path, &g->vector_map, &g->vector_map_size);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("hnsw: cannot map vectors of %s: %d", model, status);
+        graph_free(g);
+        return status == EB_ERROR_NOT_FOUND ? EB_ERROR_INVALID_FORMAT : status;
+    }
+    const vector_file_header_t* vh = g->vector_map;
+    if (g->vector_map_size < sizeof(*vh) || vh->magic != EB_HNSW_VECTORS_MAGIC || vh->dims != h->dims ||
+        (g->vector_map_size - sizeof(*vh)) / sizeof(float) / h->dims < h->node_count)
+        goto invalid;
+    g->mapped = (const float*)((const uint8_t*)g->vector_map + sizeof(*vh));
+    g->mapped_count = h->node_count;
+
+    if (writable) {
+        g->node_capacity = h->node_count;
+        g->links_capacity = h->node_count * level0_words(g);
+        g->upper_capacity = h->upper_words;
+        g->strings_capacity = h->strings_size;
+        eb_hnsw_node_t* nodes = malloc(nodes_size ? nodes_size : 1);
+        uint32_t* links0 = malloc(links_size ? links_size : 1);
+        uint32_t* upper = malloc(h->upper_words ? h->upper_words * sizeof(uint32_t) : 1);
+        char* strings = malloc(h->strings_size ? h->strings_size : 1);
+        if (!nodes || !links0 || !upper || !strings) {
+            free(nodes);
+            free(links0);
+            free(upper);
+            free(strings);
+            graph_free(g);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        memcpy(nodes, g->nodes, nodes_size);
+        memcpy(links0, g->links0, links_size);
+        memcpy(upper, g->upper, h->upper_words * sizeof(uint32_t));
+        memcpy(strings, g->strings, h->strings_size);
+        g->nodes = nodes;
+        g->links0 = links0;
+        g->upper = upper;
+        g->strings = strings;
+        g->owned = true;
+        munmap(g->graph_map, g->graph_map_size);
+        g->graph_map = NULL;
+        if (!table_rebuild(g, h->node_count)) {
+            graph_free(g);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    return EB_SUCCESS;
+
+invalid:
+    DEBUG_ERROR("hnsw: graph of '%s' in %s is damaged", model, dir);
+    graph_free(g);
+    return EB_ERROR_INVALID_FORMAT;
+}
+
+static bool write_all(FILE* f, const void* data, size_t size) {
+    return size == 0 || fwrite(data, 1, size, f) == size;
+}
+
+/* Append new rows to the vectors file, then commit them by replacing the graph */
+static eb_status_t graph_save(const char* dir, graph_t* g) {
+    const char* model = g->header.model;
+    size_t dims = g->header.dims;
+    char path[PATH_MAX];
+    vector_path(dir, model, g->header.generation, path, sizeof(path));
+
+    // Rows past the committed count belong to no graph and may be overwritten
+    int flags = O_WRONLY | O_CREAT | (g->mapped_count == 0 ? O_TRUNC : 0);
+    int fd = open(path, flags, 0644);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+    vector_file_header_t vh = { EB_HNSW_VECTORS_MAGIC, EB_HNSW_VERSION, (uint32_t)dims, 0 };
+    size_t added_size = (g->header.node_count - g->mapped_count) * dims * sizeof(float);
+    off_t offset = (off_t)(sizeof(vh) + g->mapped_count * dims * sizeof(float));
+    bool ok = pwrite(fd, &vh, sizeof(vh), 0) == (ssize_t)sizeof(vh) &&
+              (added_size == 0 || pwrite(fd, g->added, added_size, offset) == (ssize_t)added_size) &&
+              fdatasync(fd) == 0;
+    if (close(fd) != 0)
+        ok = false;
+    if (!ok)
+        return EB_ERROR_FILE_IO;
+
+    char tmp_path[PATH_MAX];
+    graph_path(dir, model, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+    size_t count = g->header.node_count;
+    ok = write_all(f, &g->header, sizeof(g->header)) &&
+         write_all(f, g->nodes, count * sizeof(*g->nodes)) &&
+         write_all(f, g->links0, count * level0_words(g) * sizeof(uint32_t)) &&
+         write_all(f, g->upper, g->header.upper_words * sizeof(uint32_t)) &&
+         write_all(f, g->strings, g->header.strings_size);
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0)
+        ok = false;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    g->dirty = false;
+    return EB_SUCCESS;
+}
+
+/* Rebuild a graph from its live rows into the next vectors generation */
+static eb_status_t graph_compact(const char* dir, graph_t* g) {
+    graph_t fresh;
+    graph_init(&fresh, g->header.model, g->header.dims, g->header.m,
+               g->header.ef_construction, g->header.generation + 1);
+    fresh.header.rng_state = g->header.rng_state;
+
+    eb_status_t status = EB_SUCCESS;
+    for (uint32_t id = 0; id < g->header.node_count && status == EB_SUCCESS; id++) {
+        if (!is_deleted(g, id))
+            status = graph_insert(&fresh, row(g, id), g->nodes[id].hash, node_source(g, id));
+    }
+    if (status == EB_SUCCESS)
+        status = graph_save(dir, &fresh);
+    if (status == EB_SUCCESS) {
+        char path[PATH_MAX];
+        vector_path(dir, g->header.model, g->header.generation, path, sizeof(path));
+        unlink(path);
+        DEBUG_INFO("hnsw: compacted '%s' from %llu to %llu nodes", g->header.model,
+                   (unsigned long long)g->header.node_count,
+                   (unsigned long long)fresh.header.node_count);
+    }
+    graph_free(&fresh);
+    return status;
+}
+
+static eb_status_t graph_commit(const char* dir, graph_t* g) {
+    if (g->header.node_count >= COMPACT_MIN_NODES &&
+        g->header.deleted_count * 2 > g->header.node_count)
+        return graph_compact(dir, g);
+    return graph_save(dir, g);
+}
+
+static char* hnsw_dir(void) {
+    return get_current_set_hnsw_dir();
+}
+
+/* Model of a graph file name, or false if it is not one */
+static bool graph_model(const char* file_name, char* model, size_t size) {
+    size_t len = strlen(file_name);
+    size_t suffix = strlen(GRAPH_SUFFIX);
+    if (len <= suffix || strcmp(file_name + len - suffix, GRAPH_SUFFIX) != 0)
+        return false;
+    size_t pos = 0;
+    if (len - suffix == 1 && file_name[0] == '-') {
+        model[0] = '\0';
+        return true;
+    }
+    for (size_t i = 0; i < len - suffix && pos + 1 < size; i++) {
+        if (file_name[i] == '%' && i + 2 < len - suffix) {
+            int hi = eb_hex_digit(file_name[i + 1]);
+            int lo = eb_hex_digit(file_name[i + 2]);
+            if (hi < 0 || lo < 0)
+                return false;
+            model[pos++] = (char)((hi << 4) | lo);
+            i += 2;
+        } else {
+            model[pos++] = file_name[i];
+        }
+    }
+    model[pos] = '\0';
+    return true;
+}
+
+/* Every model with a graph in dir */
+typedef struct {
+    char (*names)[256];
+    size_t count;
+} model_list_t;
+
+static eb_status_t list_models(const char* dir, model_list_t* list) {
+    list->names = NULL;
+    list->count = 0;
+    DIR* d = opendir(dir);
+    if (!d)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+
+    size_t capacity = 0;
+    struct dirent* entry;
+    eb_status_t status = EB_SUCCESS;
+    while ((entry = readdir(d)) != NULL) {
+        char model[256];
+        if (!graph_model(entry->d_name, model, sizeof(model)))
+            continue;
+        if (!grow((void**)&list->names, &capacity, list->count + 1, sizeof(*list->names))) {
+            status = EB_ERROR_MEMORY_ALLOCATION;
+            break;
+        }
+        memcpy(list->names[list->count++], model, sizeof(model));
+    }
+    closedir(d);
+    return status;
+}
+
+/* Remove vectors files no graph refers to, and temporaries of failed writes */
+static void prune_dir(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char* name = entry->d_name;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (strstr(name, GRAPH_SUFFIX ".tmp.")) {
+            unlink(path);
+            continue;
+        }
+
+        size_t len = strlen(name);
+        size_t suffix = strlen(VECTOR_SUFFIX);
+        if (len <= suffix || strcmp(name + len - suffix, VECTOR_SUFFIX) != 0)
+            continue;
+        const char* dot = NULL;
+        for (const char* p = name; p < name + len - suffix; p++) {
+            if (*p == '.')
+                dot = p;
+        }
+        if (!dot)
+            continue;
+
+        char graph_name[PATH_MAX / 2];
+        snprintf(graph_name, sizeof(graph_name), "%.*s" GRAPH_SUFFIX, (int)(dot - name), name);
+        char graph_file[PATH_MAX];
+        snprintf(graph_file, sizeof(graph_file), "%s/%s", dir, graph_name);
+        unsigned long long generation = strtoull(dot + 1, NULL, 10);
+
+        eb_hnsw_header_t header;
+        FILE* f = fopen(graph_file, "rb");
+        bool used = f && fread(&header, sizeof(header), 1, f) == 1 &&
+                    header.magic == EB_HNSW_MAGIC && header.generation == generation;
+        if (f)
+            fclose(f);
+        if (!used)
+            unlink(path);
+    }
+    closedir(d);
+}
+
+/* ---- Reading vectors from the store ---- */
+
+/* Unit-length float copy of a stored vector */
+static eb_status_t read_unit_vector(eb_store_t* store, const char* hash, float** out, size_t* dims) {
+    eb_object_view_t view;
+    eb_status_t status = eb_object_map(store, hash, 0, &view);
+    if (status != EB_SUCCESS)
+        return status;
+
+    eb_vector_ref_t ref;
+    status = eb_object_vector_ref(&view, &ref);
+    if (status == EB_SUCCESS && ref.dims == 0)
+        status = EB_ERROR_INVALID_FORMAT;
+    float* values = status == EB_SUCCESS ? malloc(ref.dims * sizeof(float)) : NULL;
+    if (status == EB_SUCCESS && !values)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS)
+        eb_vector_ref_get(&ref, 0, ref.dims, values);
+    eb_object_unmap(&view);
+    if (status != EB_SUCCESS)
+        return status;
+
+    // The stored norm saves a pass; older objects are summed here
+    ref.values = values;
+    ref.dtype = EB_FLOAT32;
+    ref.scale = 1.0f;
+    float norm = eb_vector_norm(&ref);
+    if (!isfinite(norm)) {
+        free(values);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    if (norm > 0.0f) {
+        for (size_t i = 0; i < ref.dims; i++)
+            values[i] /= norm;
+    }
+    *out = values;
+    *dims = ref.dims;
+    return EB_SUCCESS;
+}
+
+static eb_status_t open_store(const char* root, eb_store_t** store) {
+    eb_store_config_t config = { .root_path = (char*)root };
+    return eb_store_init(&config, store);
+}
+
+/* ---- Build ---- */
+
+typedef struct {
+    char* source;
+    char* model;
+    char hash[65];
+} build_entry_t;
+
+typedef struct {
+    build_entry_t* items;
+    size_t count;
+    size_t capacity;
+    const char* model;
+    bool failed;
+} build_list_t;
+
+static int collect_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    build_list_t* list = ctx;
+    if (list->model && strcmp(list->model, model) != 0)
+        return 0;
+    if (!grow((void**)&list->items, &list->capacity, list->count + 1, sizeof(*list->items))) {
+        list->failed = true;
+        return 1;
+    }
+    build_entry_t* e = &list->items[list->count];
+    e->source = strdup(source);
+    e->model = strdup(model);
+    memcpy(e->hash, hash, 65);
+    if (!e->source || !e->model) {
+        free(e->source);
+        free(e->model);
+        list->failed = true;
+        return 1;
+    }
+    list->count++;
+    return 0;
+}
+
+static int compare_build_entries(const void* a, const void* b) {
+    const build_entry_t* x = a;
+    const build_entry_t* y = b;
+    int cmp = strcmp(x->model, y->model);
+    return cmp ? cmp : strcmp(x->source, y->source);
+}
+
+/* Generation after the one a model's current graph uses */
+static uint64_t next_generation(const char* dir, const char* model) {
+    char path[PATH_MAX];
+    graph_path(dir, model, path, sizeof(path));
+    eb_hnsw_header_t header;
+    FILE* f = fopen(path, "rb");
+    uint64_t generation = 0;
+    if (f) {
+        if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == EB_HNSW_MAGIC)
+            generation = header.generation;
+        fclose(f);
+    }
+    return generation + 1;
+}
+
+static eb_status_t build_model(const char* dir, eb_store_t* store, const build_entry_t* entries,
+                               size_t count, uint32_t m, uint32_t ef_construction,
+                               eb_hnsw_build_result_t* result) {
+    const char* model = entries[0].model;
+    graph_t g;
+    bool started = false;
+    eb_status_t status = EB_SUCCESS;
+
+    for (size_t i = 0; i < count && status == EB_SUCCESS; i++) {
+        float* vector = NULL;
+        size_t dims = 0;
+        if (read_unit_vector(store, entries[i].hash, &vector, &dims) != EB_SUCCESS) {
+            DEBUG_WARN("hnsw: skipping unreadable vector %s of %s", entries[i].hash, entries[i].source);
+            result->skipped++;
+            continue;
+        }
+        if (!started) {
+            graph_init(&g, model, (uint32_t)dims, m, ef_construction, next_generation(dir, model));
+            started = true;
+        }
+        if (dims != g.header.dims) {
+            DEBUG_WARN("hnsw: %s has %zu dimensions, '%s' uses %u", entries[i].source, dims,
+                       model, g.header.dims);
+            result->skipped++;
+        } else {
+            uint8_t hash[32];
+            eb_hex_to_hash(entries[i].hash, hash);
+            status = graph_insert(&g, vector, hash, entries[i].source);
+        }
+        free(vector);
+    }
+    if (!started)
+        return status;
+
+    if (status == EB_SUCCESS)
+        status = graph_save(dir, &g);
+    if (status == EB_SUCCESS) {
+        result->models++;
+        result->vectors += g.header.node_count;
+    }
+    graph_free(&g);
+    return status;
+}
+
+eb_status_t eb_hnsw_build(const char* root, const eb_hnsw_build_options_t* options,
+                          eb_hnsw_build_result_t* result) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+    uint32_t m = options && options->m ? options->m : EB_HNSW_DEFAULT_M;
+    uint32_t ef_construction = options && options->ef_construction
+        ? options->ef_construction : EB_HNSW_DEFAULT_EF_CONSTRUCTION;
+    if (m < 2 || m > EB_HNSW_MAX_M)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_hnsw_build_result_t local;
+    if (!result)
+        result = &local;
+    memset(result, 0, sizeof(*result));
+
+    char* dir = hnsw_dir();
+    if (!dir)
+        return EB_ERROR_NOT_INITIALIZED;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        free(dir);
+        return EB_ERROR_FILE_IO;
+    }
+
+    build_list_t list = { NULL, 0, 0, options ? options->model : NULL, false };
+    eb_set_index_t* index = NULL;
+    eb_store_t* store = NULL;
+    eb_status_t status = eb_set_index_open_current(root, &index);
+    if (status == EB_SUCCESS) {
+        status = eb_set_index_foreach(index, NULL, collect_entry, &list);
+        eb_set_index_close(index);
+    }
+    if (status == EB_SUCCESS && list.failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS)
+        status = open_store(root, &store);
+
+    if (status == EB_SUCCESS) {
+        qsort(list.items, list.count, sizeof(*list.items), compare_build_entries);
+        for (size_t start = 0; start < list.count && status == EB_SUCCESS; ) {
+            size_t end = start + 1;
+            while (end < list.count && strcmp(list.items[end].model, list.items[start].model) == 0)
+                end++;
+            status = build_model(dir, store, list.items + start, end - start, m,
+                                 ef_construction, result);
+            start = end;
+        }
+    }
+
+    // Drop graphs of models that are gone from the set
+    if (status == EB_SUCCESS) {
+        model_list_t models;
+        if (list_models(dir, &models) == EB_SUCCESS) {
+            for (size_t i = 0; i < models.count; i++) {
+                const char* model = models.names[i];
+                if (list.model && strcmp(list.model, model) != 0)
+                    continue;
+                bool present = false;
+                for (size_t j = 0; j < list.count && !present; j++)
+                    present = strcmp(list.items[j].model, model) == 0;
+                if (!present) {
+                    char path[PATH_MAX];
+                    graph_path(dir, model, path, sizeof(path));
+                    unlink(path);
+                }
+            }
+            free(models.names);
+        }
+        prune_dir(dir);
+    }
+
+    if (store)
+        eb_store_destroy(store);
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.items[i].source);
+        free(list.items[i].model);
+    }
+    free(list.items);
+    free(dir);
+    return status;
+}
+
+/* ---- Incremental updates ---- */
+
+typedef struct {
+    char model[256];
+    graph_t graph;
+    bool exists;
+} loaded_graph_t;
+
+typedef struct {
+    const char* dir;
+    loaded_graph_t* graphs;
+    size_t count;
+    size_t capacity;
+    bool all_loaded;
+} graph_set_t;
+
+/* Graph of a model, loaded on first use; NULL if it has none and may not be created */
+static loaded_graph_t* graph_set_get(graph_set_t* set, const char* model, eb_status_t* status) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (strcmp(set->graphs[i].model, model) == 0)
+            return &set->graphs[i];
+    }
+    if (strlen(model) >= sizeof(set->graphs[0].model)) {
+        *status = EB_ERROR_INVALID_INPUT;
+        return NULL;
+    }
+    if (!grow((void**)&set->graphs, &set->capacity, set->count + 1, sizeof(*set->graphs))) {
+        *status = EB_ERROR_MEMORY_ALLOCATION;
+        return NULL;
+    }
+
+    loaded_graph_t* loaded = &set->graphs[set->count];
+    memset(loaded, 0, sizeof(*loaded));
+    snprintf(loaded->model, sizeof(loaded->model), "%s", model);
+    eb_status_t open_status = graph_open(set->dir, model, true, &loaded->graph);
+    if (open_status == EB_SUCCESS) {
+        loaded->exists = true;
+    } else if (open_status != EB_ERROR_NOT_FOUND) {
+        *status = open_status;
+        return NULL;
+    }
+    set->count++;
+    return loaded;
+}
+
+static eb_status_t graph_set_load_all(graph_set_t* set) {
+    if (set->all_loaded)
+        return EB_SUCCESS;
+    model_list_t models;
+    eb_status_t status = list_models(set->dir, &models);
+    if (status == EB_ERROR_NOT_FOUND)
+        status = EB_SUCCESS;
+    for (size_t i = 0; i < models.count && status == EB_SUCCESS; i++)
+        graph_set_get(set, models.names[i], &status);
+    free(models.names);
+    set->all_loaded = status == EB_SUCCESS;
+    return status;
+}
+
+static eb_status_t apply_change(graph_set_t* set, eb_store_t* store, const eb_set_index_change_t* c) {
+    const char* model = c->model ? c->model : "";
+    eb_status_t status = EB_SUCCESS;
+
+    if (!c->hash) {
+        if (*model) {
+            loaded_graph_t* loaded = graph_set_get(set, model, &status);
+            if (loaded && loaded->exists)
+                remove_source(&loaded->graph, c->source);
+            return status;
+        }
+        status = graph_set_load_all(set);
+        for (size_t i = 0; i < set->count && status == EB_SUCCESS; i++) {
+            if (set->graphs[i].exists)
+                remove_source(&set->graphs[i].graph, c->source);
+        }
+        return status;
+    }
+
+    float* vector = NULL;
+    size_t dims = 0;
+    status = read_unit_vector(store, c->hash, &vector, &dims);
+    if (status != EB_SUCCESS) {
+        DEBUG_WARN("hnsw: cannot index %s of %s: %d", c->hash, c->source, status);
+        return status;
+    }
+
+    loaded_graph_t* loaded = graph_set_get(set, model, &status);
+    if (loaded && !loaded->exists) {
+        graph_init(&loaded->graph, model, (uint32_t)dims, EB_HNSW_DEFAULT_M,
+                   EB_HNSW_DEFAULT_EF_CONSTRUCTION, next_generation(set->dir, model));
+        loaded->exists = true;
+    }
+    if (loaded) {
+        graph_t* g = &loaded->graph;
+        remove_source(g, c->source);
+        if (dims != g->header.dims) {
+            DEBUG_WARN("hnsw: %s has %zu dimensions, '%s' uses %u", c->source, dims, model,
+                       g->header.dims);
+            status = EB_ERROR_DIMENSION_MISMATCH;
+        } else {
+            uint8_t hash[32];
+            eb_hex_to_hash(c->hash, hash);
+            status = graph_insert(g, vector, hash, c->source);
+        }
+    }
+    free(vector);
+    return status;
+}
+
+eb_status_t eb_hnsw_apply(const char* root, const eb_set_index_change_t* changes, size_t count) {
+    if (!root || (count && !changes))
+        return EB_ERROR_INVALID_INPUT;
+
+    char* dir = hnsw_dir();
+    if (!dir)
+        return EB_ERROR_NOT_INITIALIZED;
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        free(dir);
+        return EB_SUCCESS;  // No index was built for this set
+    }
+
+    graph_set_t set = { dir, NULL, 0, 0, false };
+    eb_store_t* store = NULL;
+    eb_status_t status = EB_SUCCESS;
+    for (size_t i = 0; i < count && status == EB_SUCCESS; i++) {
+        if (changes[i].hash && !store)
+            status = open_store(root, &store);
+        if (status == EB_SUCCESS)
+            status = apply_change(&set, store, &changes[i]);
+    }
+
+    // Changes are only committed together, so a failure leaves the graphs as they were
+    bool compacted = false;
+    for (size_t i = 0; i < set.count; i++) {
+        graph_t* g = &set.graphs[i].graph;
+        if (status == EB_SUCCESS && set.graphs[i].exists && g->dirty) {
+            compacted |= g->header.node_count >= COMPACT_MIN_NODES &&
+                         g->header.deleted_count * 2 > g->header.node_count;
+            status = graph_commit(dir, g);
+        }
+        if (set.graphs[i].exists)
+            graph_free(g);
+    }
+    if (compacted)
+        prune_dir(dir);
+
+    if (store)
+        eb_store_destroy(store);
+    free(set.graphs);
+    free(dir);
+    return status;
+}
+
+eb_status_t eb_hnsw_drop(const char* root) {
+    (void)root;
+    char* dir = hnsw_dir();
+    if (!dir)
+        return EB_ERROR_NOT_INITIALIZED;
+
+    DIR* d = opendir(dir);
+    if (!d) {
+        eb_status_t status = errno == ENOENT ? EB_SUCCESS : EB_ERROR_FILE_IO;
+        free(dir);
+        return status;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    eb_status_t status = rmdir(dir) == 0 ? EB_SUCCESS : EB_ERROR_FILE_IO;
+    free(dir);
+    return status;
+}
+
+/* ---- Searching ---- */
+
+eb_status_t eb_hnsw_foreach(const char* root, eb_hnsw_visit_fn fn, void* ctx) {
+    (void)root;
+    if (!fn)
+        return EB_ERROR_INVALID_INPUT;
+    char* dir = hnsw_dir();
+    if (!dir)
+        return EB_ERROR_NOT_INITIALIZED;
+
+    model_list_t models;
+    eb_status_t status = list_models(dir, &models);
+    for (size_t i = 0; i < models.count && status == EB_SUCCESS; i++) {
+        graph_t g;
+        status = graph_open(dir, models.names[i], false, &g);
+        if (status != EB_SUCCESS)
+            break;
+        eb_hnsw_info_t info = {
+            models.names[i], g.header.dims, g.header.m,
+            (size_t)g.header.node_count, (size_t)g.header.deleted_count
+        };
+        int stop = fn(&info, ctx);
+        graph_free(&g);
+        if (stop)
+            break;
+    }
+    free(models.names);
+    free(dir);
+    return status;
+}
+
+eb_status_t eb_hnsw_open(const char* root, const char* model, eb_hnsw_t** out) {
+    (void)root;
+    if (!model || !out)
+        return EB_ERROR_INVALID_INPUT;
+    *out = NULL;
+    char* dir = hnsw_dir();
+    if (!dir)
+        return EB_ERROR_NOT_INITIALIZED;
+
+    eb_hnsw_t* index = calloc(1, sizeof(*index));
+    eb_status_t status = index ? graph_open(dir, model, false, &index->graph) : EB_ERROR_MEMORY_ALLOCATION;
+    free(dir);
+    if (status != EB_SUCCESS) {
+        free(index);
+        return status;
+    }
+    *out = index;
+    return EB_SUCCESS;
+}
+
+void eb_hnsw_close(eb_hnsw_t* index) {
+    if (!index)
+        return;
+    graph_free(&index->graph);
+    free(index);
+}
+
+eb_status_t eb_hnsw_search(const eb_hnsw_t* index, const float* query, size_t dims,
+                           size_t k, size_t ef, eb_hnsw_match_t* matches, size_t* match_count) {
+    if (!index || !query || !matches || !match_count || k == 0)
+        return EB_ERROR_INVALID_INPUT;
+    const graph_t* g = &index->graph;
+    *match_count = 0;
+    if (dims != g->header.dims)
+        return EB_ERROR_DIMENSION_MISMATCH;
+    if (g->header.entry_point == EB_HNSW_NONE)
+        return EB_SUCCESS;
+    if (ef == 0)
+        ef = EB_HNSW_DEFAULT_EF_SEARCH;
+    if (ef < k)
+        ef = k;
+
+    // Marks are per call so searches on a shared index do not interfere
+    float* unit = malloc(dims * sizeof(float));
+    visit_t visit = { calloc(g->header.node_count, sizeof(uint32_t)), g->header.node_count, 0 };
+    if (!unit || !visit.marks) {
+        free(unit);
+        free(visit.marks);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    float norm = sqrtf(eb_dot(query, query, dims));
+    for (size_t i = 0; i < dims; i++)
+        unit[i] = norm > 0.0f ? query[i] / norm : query[i];
+
+    uint32_t entry = g->header.entry_point;
+    float entry_dist = distance(g, unit, entry);
+    descend(g, unit, 0, &entry, &entry_dist);
+
+    heap_t entries = { NULL, 0, 0, false };
+    heap_t found = { NULL, 0, 0, true };
+    eb_status_t status = heap_push(&entries, entry_dist, entry)
+        ? search_level(g, unit, &entries, ef, 0, false, &visit, &found)
+        : EB_ERROR_MEMORY_ALLOCATION;
+
+    if (status == EB_SUCCESS) {
+        qsort(found.items, found.size, sizeof(*found.items), compare_cands);
+        size_t count = found.size < k ? found.size : k;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t id = found.items[i].id;
+            eb_hash_to_hex(g->nodes[id].hash, matches[i].hash);
+            matches[i].source = node_source(g, id);
+            matches[i].distance = found.items[i].dist;
+        }
+        *match_count = count;
+    }
+
+    free(entries.items);
+    free(found.items);
+    free(visit.marks);
+    free(unit);
+    return status;
+}
@@ -0,0 +1,185 @@
+/*
+ * EmbeddingBridge - HNSW Vector Index
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_HNSW_H
+#define EB_HNSW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "status.h"
+#include "set_index.h"
+
+/*
+ * Approximate nearest-neighbor search over the current vectors of a set.
+ * Sets mix models with different dimensions, so each model gets its own
+ * HNSW graph:
+ *
+ *   .embr/sets/<set>/hnsw/<model>.hnsw       graph, rewritten on update
+ *   .embr/sets/<set>/hnsw/<model>.<gen>.vec  unit-length float32 rows
+ *
+ * A graph file is header | nodes | level-0 links | upper-level links |
+ * strings and is mapped read-only for searches. Vector rows are only
+ * appended; the graph header records how many rows belong to it, so the
+ * rename of the graph file commits an update. Removed entries stay in the
+ * graph as tombstones that searches walk through but never return. Once
+ * they make up half of a graph it is rebuilt from its own rows into the
+ * next generation of the vectors file.
+ *
+ * Distances are cosine distances (1 - cos) computed with eb_dot(). Model
+ * names are %XX-escaped in file names; "-" holds vectors without a model.
+ */
+
+#define EB_HNSW_MAGIC         0x4542484E  /* "EBHN" */
+#define EB_HNSW_VECTORS_MAGIC 0x45424856  /* "EBHV" */
+#define EB_HNSW_VERSION       1
+#define EB_HNSW_DIR           "hnsw"
+
+#define EB_HNSW_DEFAULT_M               16
+#define EB_HNSW_DEFAULT_EF_CONSTRUCTION 200
+#define EB_HNSW_DEFAULT_EF_SEARCH       64
+#define EB_HNSW_MAX_M                   128
+#define EB_HNSW_MAX_LEVEL               16
+
+#define EB_HNSW_NONE 0xFFFFFFFFu
+
+/* Node flag: removed from the set, kept for traversal */
+#define EB_HNSW_DELETED 0x1
+
+typedef struct {
+    uint32_t magic;             /* EB_HNSW_MAGIC */
+    uint32_t version;           /* EB_HNSW_VERSION */
+    uint32_t dims;
+    uint32_t m;                 /* Links per node on upper levels, 2m on level 0 */
+    uint32_t ef_construction;
+    uint32_t max_level;
+    uint32_t entry_point;       /* EB_HNSW_NONE while empty */
+    uint32_t reserved;
+    uint64_t node_count;
+    uint64_t deleted_count;
+    uint64_t upper_words;       /* Size of the upper-level link pool */
+    uint64_t strings_size;
+    uint64_t generation;        /* Vectors file the nodes live in */
+    uint64_t rng_state;         /* Level generator, kept so updates are reproducible */
+    char model[256];
+} eb_hnsw_header_t;
+
+/* Every link list is a count word followed by its capacity in node IDs */
+typedef struct {
+    uint8_t hash[32];
+    uint64_t source_offset;     /* NUL-terminated source path in the string table */
+    uint64_t upper_offset;      /* First pool word of levels 1..level */
+    uint32_t level;
+    uint32_t flags;             /* EB_HNSW_DELETED */
+} eb_hnsw_node_t;
+
+typedef struct eb_hnsw eb_hnsw_t;
+
+typedef struct {
+    const char* model;          /* Only rebuild this model, NULL for every model */
+    uint32_t m;                 /* 0 for EB_HNSW_DEFAULT_M */
+    uint32_t ef_construction;   /* 0 for EB_HNSW_DEFAULT_EF_CONSTRUCTION */
+} eb_hnsw_build_options_t;
+
+typedef struct {
+    size_t models;              /* Graphs written */
+    size_t vectors;             /* Vectors indexed */
+    size_t skipped;             /* Entries that could not be read or had other dimensions */
+} eb_hnsw_build_result_t;
+
+typedef struct {
+    const char* model;
+    uint32_t dims;
+    uint32_t m;
+    size_t nodes;               /* Including removed ones */
+    size_t deleted;
+} eb_hnsw_info_t;
+
+typedef struct {
+    char hash[65];
+    const char* source;         /* Valid until the index is closed */
+    float distance;             /* Cosine distance, 0 for the same direction */
+} eb_hnsw_match_t;
+
+/**
+ * Callback invoked for each graph of the current set
+ *
+ * @return 0 to continue, non-zero to stop iteration
+ */
+typedef int (*eb_hnsw_visit_fn)(const eb_hnsw_info_t* info, void* ctx);
+
+/**
+ * Build graphs over the current vectors of the current set
+ *
+ * Replaces existing graphs of the models it builds. Without a model
+ * filter, graphs of models no longer in the set are removed.
+ *
+ * @param root Repository root
+ * @param options Optional build options, NULL for defaults
+ * @param result Optional build statistics
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_hnsw_build(const char* root, const eb_hnsw_build_options_t* options,
+                          eb_hnsw_build_result_t* result);
+
+/**
+ * Bring the graphs of the current set in line with set index changes
+ *
+ * Does nothing unless an index was built for the set. Takes the same
+ * changes as eb_set_index_apply(), after they were applied there.
+ *
+ * @param root Repository root
+ * @param changes Changes to apply
+ * @param count Number of changes
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_hnsw_apply(const char* root, const eb_set_index_change_t* changes, size_t count);
+
+/**
+ * Remove every graph of the current set
+ */
+eb_status_t eb_hnsw_drop(const char* root);
+
+/**
+ * Visit the graphs of the current set
+ *
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if no index was built)
+ */
+eb_status_t eb_hnsw_foreach(const char* root, eb_hnsw_visit_fn fn, void* ctx);
+
+/**
+ * Map the graph of a model of the current set for searching
+ *
+ * @param root Repository root
+ * @param model Model name, "" for vectors stored without one
+ * @param out Receives the index, release with eb_hnsw_close()
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if there is no graph)
+ */
+eb_status_t eb_hnsw_open(const char* root, const char* model, eb_hnsw_t** out);
+
+void eb_hnsw_close(eb_hnsw_t* index);
+
+/**
+ * Find the stored vectors closest to a query
+ *
+ * Safe to call from several threads on the same index.
+ *
+ * @param index Open index
+ * @param query Query vector, need not be normalized
+ * @param dims Dimensions of the query, must match the graph
+ * @param k Matches wanted
+ * @param ef Search breadth, raised to k if smaller; 0 for EB_HNSW_DEFAULT_EF_SEARCH
+ * @param matches Receives up to k matches, nearest first
+ * @param match_count Receives the number of matches
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_hnsw_search(const eb_hnsw_t* index, const float* query, size_t dims,
+                           size_t k, size_t ef, eb_hnsw_match_t* matches, size_t* match_count);
+
+#endif /* EB_HNSW_H */
@@ -47,6 +47,8 @@ static void json_transformer_free(
 static struct eb_transformer *json_transformer_clone(
     const struct eb_transformer *transformer);
 
+static const eb_transform_stream_ops_t json_stream_ops;
+
 /**
  * Create a new JSON transformer
  *
@@ -75,6 +77,9 @@ struct eb_transformer *eb_json_transformer_create(
         json_transformer_free,   /* free */
         json_transformer_clone,  /* clone */
         config);                 /* user_data */
+    if (transformer) {
+        transformer->stream = &json_stream_ops;
+    }
     
     return transformer;
 }
@@ -370,6 +375,177 @@ static eb_status_t json_transform(
     return EB_SUCCESS;
 }
 
+/*
+ * Streaming encoder
+ *
+ * Produces the same output as json_transform: JSON input passes through,
+ * anything else is escaped into a {"data": ...} wrapper a block at a
+ * time. Only leading whitespace is held back, until the first other byte
+ * tells which of the two it is.
+ */
+
+/* Output block of the escaped stream */
+#define JSON_STREAM_BLOCK (64 * 1024)
+
+/* Input bytes escaped per block (an escaped byte takes at most 6) */
+#define JSON_STREAM_INPUT (JSON_STREAM_BLOCK / 6)
+
+enum json_stream_mode {
+    JSON_STREAM_UNDECIDED,
+    JSON_STREAM_PASSTHROUGH,
+    JSON_STREAM_WRAPPED
+};
+
+typedef struct {
+    bool pretty_print;
+    eb_transform_sink_fn sink;
+    void *sink_ctx;
+    enum json_stream_mode mode;
+    char *lead;                 /* Leading whitespace while undecided */
+    size_t lead_size;
+    size_t lead_capacity;
+    char *escaped;              /* JSON_STREAM_BLOCK + 1 bytes */
+} json_stream_t;
+
+static const char *json_wrapper_prefix(bool pretty_print) {
+    return pretty_print ? "{\n  \"data\": \"" : "{\"data\":\"";
+}
+
+static const char *json_wrapper_suffix(bool pretty_print) {
+    return pretty_print ? "\"\n}" : "\"}";
+}
+
+static eb_status_t json_stream_emit(json_stream_t *stream, const void *data, size_t size) {
+    if (size == 0) {
+        return EB_SUCCESS;
+    }
+    int status = stream->sink(stream->sink_ctx, data, size);
+    return status == 0 ? EB_SUCCESS : (eb_status_t)status;
+}
+
+static eb_status_t json_stream_emit_escaped(json_stream_t *stream, const char *data, size_t size) {
+    while (size > 0) {
+        size_t n = size < JSON_STREAM_INPUT ? size : JSON_STREAM_INPUT;
+        ssize_t escaped_len = escape_json_string(data, n, stream->escaped, JSON_STREAM_BLOCK + 1);
+        if (escaped_len < 0) {
+            return EB_ERROR_BUFFER_TOO_SMALL;
+        }
+        eb_status_t status = json_stream_emit(stream, stream->escaped, (size_t)escaped_len);
+        if (status != EB_SUCCESS) {
+            return status;
+        }
+        data += n;
+        size -= n;
+    }
+    return EB_SUCCESS;
+}
+
+/* Settle the mode and emit what was held back */
+static eb_status_t json_stream_decide(json_stream_t *stream, enum json_stream_mode mode) {
+    stream->mode = mode;
+    if (mode == JSON_STREAM_PASSTHROUGH) {
+        return json_stream_emit(stream, stream->lead, stream->lead_size);
+    }
+    const char *prefix = json_wrapper_prefix(stream->pretty_print);
+    eb_status_t status = json_stream_emit(stream, prefix, strlen(prefix));
+    if (status == EB_SUCCESS) {
+        status = json_stream_emit_escaped(stream, stream->lead, stream->lead_size);
+    }
+    return status;
+}
+
+static eb_status_t json_stream_init(struct eb_transformer *transformer, eb_transform_sink_fn sink,
+                                    void *sink_ctx, void **state_out) {
+    json_transformer_config_t *config = get_config(transformer);
+    if (!config || !sink || !state_out) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    json_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return EB_ERROR_MEMORY;
+    }
+    stream->escaped = malloc(JSON_STREAM_BLOCK + 1);
+    if (!stream->escaped) {
+        free(stream);
+        return EB_ERROR_MEMORY;
+    }
+    stream->pretty_print = config->pretty_print;
+    stream->sink = sink;
+    stream->sink_ctx = sink_ctx;
+    *state_out = stream;
+    return EB_SUCCESS;
+}
+
+static eb_status_t json_stream_feed(void *state, const void *data, size_t size) {
+    json_stream_t *stream = state;
+    const char *p = data;
+
+    if (stream->mode == JSON_STREAM_UNDECIDED) {
+        size_t ws = 0;
+        while (ws < size && (p[ws] == ' ' || p[ws] == '\t' || p[ws] == '\n' || p[ws] == '\r')) {
+            ws++;
+        }
+        if (stream->lead_size + ws > stream->lead_capacity) {
+            size_t capacity = (stream->lead_size + ws) * 2;
+            char *lead = realloc(stream->lead, capacity);
+            if (!lead) {
+                return EB_ERROR_MEMORY;
+            }
+            stream->lead = lead;
+            stream->lead_capacity = capacity;
+        }
+        if (ws > 0) {
+            memcpy(stream->lead + stream->lead_size, p, ws);
+            stream->lead_size += ws;
+        }
+        if (ws == size) {
+            return EB_SUCCESS;
+        }
+        eb_status_t status = json_stream_decide(stream, p[ws] == '{' || p[ws] == '['
+                                                        ? JSON_STREAM_PASSTHROUGH : JSON_STREAM_WRAPPED);
+        if (status != EB_SUCCESS) {
+            return status;
+        }
+        p += ws;
+        size -= ws;
+    }
+
+    return stream->mode == JSON_STREAM_PASSTHROUGH ? json_stream_emit(stream, p, size)
+                                                   : json_stream_emit_escaped(stream, p, size);
+}
+
+static void json_stream_abort(void *state) {
+    json_stream_t *stream = state;
+    if (!stream) {
+        return;
+    }
+    free(stream->lead);
+    free(stream->escaped);
+    free(stream);
+}
+
+static eb_status_t json_stream_finish(void *state) {
+    json_stream_t *stream = state;
+    eb_status_t status = EB_SUCCESS;
+    if (stream->mode == JSON_STREAM_UNDECIDED) {
+        /* Empty or whitespace only: not JSON */
+        status = json_stream_decide(stream, JSON_STREAM_WRAPPED);
+    }
+    if (status == EB_SUCCESS && stream->mode == JSON_STREAM_WRAPPED) {
+        const char *suffix = json_wrapper_suffix(stream->pretty_print);
+        status = json_stream_emit(stream, suffix, strlen(suffix));
+    }
+    json_stream_abort(stream);
+    return status;
+}
+
+static const eb_transform_stream_ops_t json_stream_ops = {
+    json_stream_init,
+    json_stream_feed,
+    json_stream_finish,
+    json_stream_abort
+};
+
 /**
  * Extract the data field from a JSON object
  *
@@ -0,0 +1,725 @@
+/*
+ * EmbeddingBridge - JSON Vector Encoding Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <jansson.h>
+
+#include "json_vector.h"
+
+/*
+ * Shortest round-trip digits (Ryu, Ulf Adams 2018, float variant). The
+ * tables hold 2^k / 5^q and 5^i / 2^k, rounded so that one 32x64-bit
+ * multiply-shift gives the exact digits of the interval bounds.
+ */
+#define FLOAT_MANTISSA_BITS 23
+#define FLOAT_BIAS 127
+#define FLOAT_POW5_INV_BITCOUNT 59
+#define FLOAT_POW5_BITCOUNT 61
+
+static const uint64_t FLOAT_POW5_INV_SPLIT[31] = {
+    576460752303423489u, 461168601842738791u, 368934881474191033u, 295147905179352826u,
+    472236648286964522u, 377789318629571618u, 302231454903657294u, 483570327845851670u,
+    386856262276681336u, 309485009821345069u, 495176015714152110u, 396140812571321688u,
+    316912650057057351u, 507060240091291761u, 405648192073033409u, 324518553658426727u,
+    519229685853482763u, 415383748682786211u, 332306998946228969u, 531691198313966350u,
+    425352958651173080u, 340282366920938464u, 544451787073501542u, 435561429658801234u,
+    348449143727040987u, 557518629963265579u, 446014903970612463u, 356811923176489971u,
+    570899077082383953u, 456719261665907162u, 365375409332725730u
+};
+
+static const uint64_t FLOAT_POW5_SPLIT[47] = {
+    1152921504606846976u, 1441151880758558720u, 1801439850948198400u, 2251799813685248000u,
+    1407374883553280000u, 1759218604441600000u, 2199023255552000000u, 1374389534720000000u,
+    1717986918400000000u, 2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+    2097152000000000000u, 1310720000000000000u, 1638400000000000000u, 2048000000000000000u,
+    1280000000000000000u, 1600000000000000000u, 2000000000000000000u, 1250000000000000000u,
+    1562500000000000000u, 1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+    1907348632812500000u, 1192092895507812500u, 1490116119384765625u, 1862645149230957031u,
+    1164153218269348144u, 1455191522836685180u, 1818989403545856475u, 2273736754432320594u,
+    1421085471520200371u, 1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+    1734723475976807094u, 2168404344971008868u, 1355252715606880542u, 1694065894508600678u,
+    2117582368135750847u, 1323488980084844279u, 1654361225106055349u, 2067951531382569187u,
+    1292469707114105741u, 1615587133892632177u, 2019483917365790221u
+};
+
+/* ceil(log2(5^e)), 1 for e == 0 */
+static inline int32_t pow5bits(int32_t e) {
+    return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) */
+static inline uint32_t log10_pow2(int32_t e) {
+    return ((uint32_t)e * 78913) >> 18;
+}
+
+/* floor(log10(5^e)) */
+static inline uint32_t log10_pow5(int32_t e) {
+    return ((uint32_t)e * 732923) >> 20;
+}
+
+static inline bool multiple_of_pow5(uint32_t value, uint32_t p) {
+    uint32_t count = 0;
+    while (value % 5 == 0 && count < p) {
+        value /= 5;
+        count++;
+    }
+    return count >= p;
+}
+
+static inline bool multiple_of_pow2(uint32_t value, uint32_t p) {
+    return (value & ((1u << p) - 1)) == 0;
+}
+
+static inline uint32_t mul_shift(uint32_t m, uint64_t factor, int32_t shift) {
+    uint64_t bits0 = (uint64_t)m * (uint32_t)factor;
+    uint64_t bits1 = (uint64_t)m * (uint32_t)(factor >> 32);
+    uint64_t sum = (bits0 >> 32) + bits1;
+    return (uint32_t)(sum >> (shift - 32));
+}
+
+/* Shortest digits of a finite, non-zero float: value == digits * 10^exponent */
+static void float_digits(uint32_t mantissa, uint32_t exponent, uint32_t* digits_out, int32_t* exponent_out) {
+    int32_t e2;
+    uint32_t m2;
+    if (exponent == 0) {
+        e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = mantissa;
+    } else {
+        e2 = (int32_t)exponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = (1u << FLOAT_MANTISSA_BITS) | mantissa;
+    }
+    bool accept_bounds = (m2 & 1) == 0;
+
+    /* The value and the halfway points to its neighbours, times 4 */
+    uint32_t mv = 4 * m2;
+    uint32_t mp = 4 * m2 + 2;
+    uint32_t mm_shift = mantissa != 0 || exponent <= 1;
+    uint32_t mm = 4 * m2 - 1 - mm_shift;
+
+    uint32_t vr, vp, vm;
+    int32_t e10;
+    bool vm_trailing_zeros = false, vr_trailing_zeros = false;
+    uint8_t last_removed = 0;
+    if (e2 >= 0) {
+        uint32_t q = log10_pow2(e2);
+        e10 = (int32_t)q;
+        int32_t k = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32_t)q) - 1;
+        int32_t i = -e2 + (int32_t)q + k;
+        vr = mul_shift(mv, FLOAT_POW5_INV_SPLIT[q], i);
+        vp = mul_shift(mp, FLOAT_POW5_INV_SPLIT[q], i);
+        vm = mul_shift(mm, FLOAT_POW5_INV_SPLIT[q], i);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32_t)q - 1) - 1;
+            last_removed = (uint8_t)(mul_shift(mv, FLOAT_POW5_INV_SPLIT[q - 1], -e2 + (int32_t)q - 1 + l) % 10);
+        }
+        if (q <= 9) {
+            if (mv % 5 == 0)
+                vr_trailing_zeros = multiple_of_pow5(mv, q);
+            else if (accept_bounds)
+                vm_trailing_zeros = multiple_of_pow5(mm, q);
+            else
+                vp -= multiple_of_pow5(mp, q);
+        }
+    } else {
+        uint32_t q = log10_pow5(-e2);
+        e10 = (int32_t)q + e2;
+        int32_t i = -e2 - (int32_t)q;
+        int32_t k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+        int32_t j = (int32_t)q - k;
+        vr = mul_shift(mv, FLOAT_POW5_SPLIT[i], j);
+        vp = mul_shift(mp, FLOAT_POW5_SPLIT[i], j);
+        vm = mul_shift(mm, FLOAT_POW5_SPLIT[i], j);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            j = (int32_t)q - 1 - (pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+            last_removed = (uint8_t)(mul_shift(mv, FLOAT_POW5_SPLIT[i + 1], j) % 10);
+        }
+        if (q <= 1) {
+            vr_trailing_zeros = true;
+            if (accept_bounds)
+                vm_trailing_zeros = mm_shift == 1;
+            else
+                vp--;
+        } else if (q < 31) {
+            vr_trailing_zeros = multiple_of_pow2(mv, q - 1);
+        }
+    }
+
+    /* Drop digits while the interval still holds a shorter number */
+    int32_t removed = 0;
+    uint32_t output;
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = (uint8_t)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = (uint8_t)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        /* Round half to even */
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+            last_removed = 4;
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+    } else {
+        while (vp / 10 > vm / 10) {
+            last_removed = (uint8_t)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || last_removed >= 5);
+    }
+    *digits_out = output;
+    *exponent_out = e10 + removed;
+}
+
+size_t eb_json_format_float(float value, char* buf) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bool negative = bits >> 31;
+    uint32_t exponent = (bits >> FLOAT_MANTISSA_BITS) & 0xff;
+    uint32_t mantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+
+    if (exponent == 0xff) {
+        memcpy(buf, "null", 4);
+        return 4;
+    }
+    size_t len = 0;
+    if (negative)
+        buf[len++] = '-';
+    if (exponent == 0 && mantissa == 0) {
+        buf[len++] = '0';
+        return len;
+    }
+
+    uint32_t output;
+    int32_t e10;
+    float_digits(mantissa, exponent, &output, &e10);
+    char digits[9] = {0};
+    int count = 0;
+    for (uint32_t rest = output; rest; rest /= 10)
+        count++;
+    for (int i = count - 1; i >= 0; i--) {
+        digits[i] = (char)('0' + output % 10);
+        output /= 10;
+    }
+
+    /* Plain notation like %g for exponents -4..8, scientific otherwise */
+    int32_t sci = e10 + count - 1;
+    if (sci >= -4 && sci <= 8) {
+        if (sci < 0) {
+            buf[len++] = '0';
+            buf[len++] = '.';
+            for (int32_t i = -1; i > sci; i--)
+                buf[len++] = '0';
+            memcpy(buf + len, digits, (size_t)count);
+            len += (size_t)count;
+        } else if (sci + 1 >= count) {
+            memcpy(buf + len, digits, (size_t)count);
+            len += (size_t)count;
+            for (int32_t i = count; i <= sci; i++)
+                buf[len++] = '0';
+        } else {
+            memcpy(buf + len, digits, (size_t)sci + 1);
+            len += (size_t)sci + 1;
+            buf[len++] = '.';
+            memcpy(buf + len, digits + sci + 1, (size_t)(count - sci - 1));
+            len += (size_t)(count - sci - 1);
+        }
+        return len;
+    }
+    buf[len++] = digits[0];
+    if (count > 1) {
+        buf[len++] = '.';
+        memcpy(buf + len, digits + 1, (size_t)count - 1);
+        len += (size_t)count - 1;
+    }
+    buf[len++] = 'e';
+    if (sci < 0) {
+        buf[len++] = '-';
+        sci = -sci;
+    }
+    if (sci >= 10)
+        buf[len++] = (char)('0' + sci / 10);
+    buf[len++] = (char)('0' + sci % 10);
+    return len;
+}
+
+/* Powers of ten that are exact in a double */
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+size_t eb_json_parse_float(const char* text, size_t size, float* value_out) {
+    if (size >= 4 && memcmp(text, "null", 4) == 0) {
+        *value_out = NAN;
+        return 4;
+    }
+    size_t pos = 0;
+    bool negative = pos < size && text[pos] == '-';
+    if (negative)
+        pos++;
+    if (pos >= size || text[pos] < '0' || text[pos] > '9')
+        return 0;
+
+    /* Up to 19 significant digits fit a uint64_t */
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int32_t exponent = 0;
+    bool overflow = false;
+    for (; pos < size && text[pos] >= '0' && text[pos] <= '9'; pos++) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(text[pos] - '0');
+            if (mantissa)
+                digits++;
+        } else {
+            exponent++;
+            overflow = true;
+        }
+    }
+    if (pos < size && text[pos] == '.') {
+        pos++;
+        size_t start = pos;
+        for (; pos < size && text[pos] >= '0' && text[pos] <= '9'; pos++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(text[pos] - '0');
+                if (mantissa)
+                    digits++;
+                exponent--;
+            } else {
+                overflow = true;
+            }
+        }
+        if (pos == start)
+            return 0;
+    }
+    if (pos < size && (text[pos] == 'e' || text[pos] == 'E')) {
+        pos++;
+        bool exp_negative = false;
+        if (pos < size && (text[pos] == '+' || text[pos] == '-'))
+            exp_negative = text[pos++] == '-';
+        size_t start = pos;
+        int32_t value = 0;
+        for (; pos < size && text[pos] >= '0' && text[pos] <= '9'; pos++) {
+            if (value < 100000)
+                value = value * 10 + (text[pos] - '0');
+        }
+        if (pos == start)
+            return 0;
+        exponent += exp_negative ? -value : value;
+    }
+
+    /*
+     * m * 10^e with both exact in a double rounds once; rounding that to
+     * float is still correct since a double has more than 2 * 24 + 2 bits.
+     */
+    if (!overflow && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / POW10[-exponent] : value * POW10[exponent];
+        *value_out = (float)(negative ? -value : value);
+        return pos;
+    }
+    if (mantissa == 0 && !overflow) {
+        *value_out = negative ? -0.0f : 0.0f;
+        return pos;
+    }
+
+    char stack[64];
+    char* copy = pos < sizeof(stack) ? stack : malloc(pos + 1);
+    if (!copy)
+        return 0;
+    memcpy(copy, text, pos);
+    copy[pos] = '\0';
+    *value_out = strtof(copy, NULL);
+    if (copy != stack)
+        free(copy);
+    return pos;
+}
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static size_t skip_space(const char* text, size_t size, size_t pos) {
+    while (pos < size && is_space(text[pos]))
+        pos++;
+    return pos;
+}
+
+eb_status_t eb_json_parse_floats(const char* text, size_t size, float** values_out,
+                                 size_t* count_out, size_t* consumed_out) {
+    if (!text || !values_out || !count_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    size_t pos = skip_space(text, size, 0);
+    if (pos >= size || text[pos] != '[')
+        return EB_ERROR_INVALID_FORMAT;
+    pos = skip_space(text, size, pos + 1);
+
+    float* values = NULL;
+    size_t count = 0, capacity = 0;
+    bool closed = pos < size && text[pos] == ']';
+    while (!closed) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            float* grown = realloc(values, capacity * sizeof(*values));
+            if (!grown) {
+                free(values);
+                return EB_ERROR_MEMORY;
+            }
+            values = grown;
+        }
+        size_t used = eb_json_parse_float(text + pos, size - pos, &values[count]);
+        if (used == 0)
+            break;
+        count++;
+        pos = skip_space(text, size, pos + used);
+        if (pos < size && text[pos] == ',')
+            pos = skip_space(text, size, pos + 1);
+        else if (!(closed = pos < size && text[pos] == ']'))
+            break;
+    }
+    if (!closed) {
+        free(values);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    *values_out = values;
+    *count_out = count;
+    if (consumed_out)
+        *consumed_out = pos + 1;
+    return EB_SUCCESS;
+}
+
+/* Output block handed to the sink */
+#define JSON_WRITER_BLOCK (64 * 1024)
+
+struct eb_json_writer {
+    eb_transform_sink_fn sink;
+    void* ctx;
+    char* buf;                    /* JSON_WRITER_BLOCK bytes */
+    size_t used;
+    size_t bytes;                 /* Handed to the sink so far */
+};
+
+eb_status_t eb_json_writer_open(eb_transform_sink_fn sink, void* ctx, eb_json_writer_t** writer_out) {
+    if (!sink || !writer_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    eb_json_writer_t* writer = calloc(1, sizeof(*writer));
+    if (!writer || !(writer->buf = malloc(JSON_WRITER_BLOCK))) {
+        free(writer);
+        return EB_ERROR_MEMORY;
+    }
+    writer->sink = sink;
+    writer->ctx = ctx;
+    *writer_out = writer;
+    return EB_SUCCESS;
+}
+
+static eb_status_t writer_flush(eb_json_writer_t* writer) {
+    if (writer->used == 0)
+        return EB_SUCCESS;
+    int status = writer->sink(writer->ctx, writer->buf, writer->used);
+    if (status != 0)
+        return (eb_status_t)status;
+    writer->bytes += writer->used;
+    writer->used = 0;
+    return EB_SUCCESS;
+}
+
+/* Make room for size bytes (size <= JSON_WRITER_BLOCK) */
+static eb_status_t writer_reserve(eb_json_writer_t* writer, size_t size) {
+    return writer->used + size > JSON_WRITER_BLOCK ? writer_flush(writer) : EB_SUCCESS;
+}
+
+static eb_status_t writer_put(eb_json_writer_t* writer, const char* data, size_t size) {
+    while (size > 0) {
+        eb_status_t status = writer_reserve(writer, 1);
+        if (status != EB_SUCCESS)
+            return status;
+        size_t n = JSON_WRITER_BLOCK - writer->used;
+        if (n > size)
+            n = size;
+        memcpy(writer->buf + writer->used, data, n);
+        writer->used += n;
+        data += n;
+        size -= n;
+    }
+    return EB_SUCCESS;
+}
+
+/* One string byte as it appears in JSON, up to 6 bytes */
+static size_t escape_char(unsigned char c, char* out) {
+    static const char hex[] = "0123456789abcdef";
+    out[0] = '\\';
+    if (c == '\n')
+        out[1] = 'n';
+    else if (c == '\t')
+        out[1] = 't';
+    else if (c == '\r')
+        out[1] = 'r';
+    else if (c < 0x20) {
+        memcpy(out, "\\u00", 4);
+        out[4] = hex[c >> 4];
+        out[5] = hex[c & 0xf];
+        return 6;
+    } else if (c == '"' || c == '\\')
+        out[1] = (char)c;
+    else {
+        out[0] = (char)c;
+        return 1;
+    }
+    return 2;
+}
+
+size_t eb_json_escape(const char* value, char* out) {
+    size_t n = 0;
+    for (const char* p = value; *p; p++)
+        n += escape_char((unsigned char)*p, out + n);
+    return n;
+}
+
+/* Write "key":"<escaped value>" */
+static eb_status_t writer_string(eb_json_writer_t* writer, const char* key, const char* value) {
+    eb_status_t status = writer_put(writer, key, strlen(key));
+    for (const char* p = value; status == EB_SUCCESS && *p; p++) {
+        char escaped[6];
+        status = writer_put(writer, escaped, escape_char((unsigned char)*p, escaped));
+    }
+    return status == EB_SUCCESS ? writer_put(writer, "\"", 1) : status;
+}
+
+eb_status_t eb_json_writer_add(eb_json_writer_t* writer, const eb_json_vector_t* vector) {
+    if (!writer || !vector || !vector->id || (vector->dims && !vector->values))
+        return EB_ERROR_INVALID_PARAMETER;
+    eb_status_t status = writer_string(writer, "{\"id\":\"", vector->id);
+    if (status == EB_SUCCESS && vector->source)
+        status = writer_string(writer, ",\"source\":\"", vector->source);
+    if (status == EB_SUCCESS && vector->model)
+        status = writer_string(writer, ",\"model\":\"", vector->model);
+    if (status == EB_SUCCESS) {
+        char head[64];
+        int n = snprintf(head, sizeof(head), ",\"timestamp\":%lld,\"values\":[", (long long)vector->timestamp);
+        status = writer_put(writer, head, (size_t)n);
+    }
+    for (size_t i = 0; status == EB_SUCCESS && i < vector->dims; i++) {
+        status = writer_reserve(writer, EB_JSON_FLOAT_MAX + 1);
+        if (status != EB_SUCCESS)
+            break;
+        if (i > 0)
+            writer->buf[writer->used++] = ',';
+        writer->used += eb_json_format_float(vector->values[i], writer->buf + writer->used);
+    }
+    return status == EB_SUCCESS ? writer_put(writer, "]}\n", 3) : status;
+}
+
+eb_status_t eb_json_writer_close(eb_json_writer_t* writer, size_t* bytes_out) {
+    if (!writer)
+        return EB_ERROR_INVALID_PARAMETER;
+    eb_status_t status = writer_flush(writer);
+    if (status == EB_SUCCESS && bytes_out)
+        *bytes_out = writer->bytes;
+    eb_json_writer_abort(writer);
+    return status;
+}
+
+size_t eb_json_pinecone_record_max(const eb_json_vector_t* vector) {
+    size_t strings = strlen(vector->id) + (vector->source ? strlen(vector->source) : 0) +
+                     (vector->model ? strlen(vector->model) : 0);
+    return 6 * strings + vector->dims * (EB_JSON_FLOAT_MAX + 1) + 128;
+}
+
+/* Append "key":"<escaped value>" to buf */
+static size_t put_string(char* buf, const char* key, const char* value) {
+    size_t n = strlen(key);
+    memcpy(buf, key, n);
+    n += eb_json_escape(value, buf + n);
+    buf[n++] = '"';
+    return n;
+}
+
+size_t eb_json_pinecone_record(const eb_json_vector_t* vector, char* buf) {
+    size_t n = put_string(buf, "{\"id\":\"", vector->id);
+    memcpy(buf + n, ",\"values\":[", 11);
+    n += 11;
+    for (size_t i = 0; i < vector->dims; i++) {
+        if (i > 0)
+            buf[n++] = ',';
+        n += eb_json_format_float(vector->values[i], buf + n);
+    }
+    n += (size_t)sprintf(buf + n, "],\"metadata\":{\"timestamp\":%lld", (long long)vector->timestamp);
+    if (vector->source)
+        n += put_string(buf + n, ",\"source\":\"", vector->source);
+    if (vector->model)
+        n += put_string(buf + n, ",\"model\":\"", vector->model);
+    buf[n++] = '}';
+    buf[n++] = '}';
+    return n;
+}
+
+void eb_json_writer_abort(eb_json_writer_t* writer) {
+    if (!writer)
+        return;
+    free(writer->buf);
+    free(writer);
+}
+
+/* End of the JSON value starting at pos, size if it does not end */
+static size_t skip_value(const char* text, size_t size, size_t pos) {
+    int depth = 0;
+    bool in_string = false;
+    for (; pos < size; pos++) {
+        char c = text[pos];
+        if (in_string) {
+            if (c == '\\')
+                pos++;
+            else if (c == '"') {
+                in_string = false;
+                if (depth == 0)
+                    return pos + 1;
+            }
+        } else if (c == '"') {
+            in_string = true;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0)
+                return pos;
+            if (--depth == 0)
+                return pos + 1;
+        } else if (depth == 0 && (c == ',' || is_space(c))) {
+            return pos;
+        }
+    }
+    return size;
+}
+
+/* Decode the string value at text, through jansson if it has escapes; NULL if it is none */
+static char* decode_string(const char* text, size_t size) {
+    if (size >= 2 && text[size - 1] == '"' && !memchr(text + 1, '\\', size - 2))
+        return strndup(text + 1, size - 2);
+    json_error_t error;
+    json_t* value = json_loadb(text, size, JSON_DECODE_ANY, &error);
+    char* result = json_is_string(value) ? strdup(json_string_value(value)) : NULL;
+    json_decref(value);
+    return result;
+}
+
+static eb_status_t parse_vector(const char* line, size_t size, bool need_id,
+                                eb_json_vector_t* vector_out) {
+    if (!line || !vector_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    memset(vector_out, 0, sizeof(*vector_out));
+    char* id = NULL;
+    char* source = NULL;
+    char* model = NULL;
+    float* values = NULL;
+    bool have_values = false;
+
+    size_t pos = skip_space(line, size, 0);
+    bool ok = pos < size && line[pos] == '{';
+    pos = skip_space(line, size, pos + 1);
+    bool done = ok && pos < size && line[pos] == '}';
+    while (ok && !done) {
+        /* Member keys we look for never need unescaping */
+        size_t key_end = skip_value(line, size, pos);
+        ok = line[pos] == '"' && key_end <= size && key_end - pos >= 2;
+        if (!ok)
+            break;
+        const char* key = line + pos + 1;
+        size_t key_len = key_end - pos - 2;
+        pos = skip_space(line, size, key_end);
+        ok = pos < size && line[pos] == ':';
+        if (!ok)
+            break;
+        pos = skip_space(line, size, pos + 1);
+
+        size_t value_end;
+        char** string = NULL;
+        if (key_len == 2 && memcmp(key, "id", 2) == 0)
+            string = &id;
+        else if (key_len == 6 && memcmp(key, "source", 6) == 0)
+            string = &source;
+        else if (key_len == 5 && memcmp(key, "model", 5) == 0)
+            string = &model;
+
+        if (key_len == 6 && memcmp(key, "values", 6) == 0 && !have_values) {
+            size_t consumed = 0;
+            ok = eb_json_parse_floats(line + pos, size - pos, &values, &vector_out->dims, &consumed) == EB_SUCCESS;
+            have_values = ok;
+            value_end = pos + consumed;
+        } else if (key_len == 9 && memcmp(key, "timestamp", 9) == 0) {
+            value_end = skip_value(line, size, pos);
+            char number[32] = {0};
+            if (value_end - pos < sizeof(number))
+                memcpy(number, line + pos, value_end - pos);
+            vector_out->timestamp = strtoll(number, NULL, 10);
+        } else {
+            value_end = skip_value(line, size, pos);
+            if (string && !*string && line[pos] == '"')
+                ok = (*string = decode_string(line + pos, value_end - pos)) != NULL;
+        }
+        if (!ok || value_end > size)
+            break;
+        pos = skip_space(line, size, value_end);
+        if (pos < size && line[pos] == ',')
+            pos = skip_space(line, size, pos + 1);
+        else
+            done = pos < size && line[pos] == '}';
+        ok = done || (pos < size && line[pos] == '"');
+    }
+
+    if (!ok || !done || (need_id && !id) || !have_values) {
+        free(id);
+        free(source);
+        free(model);
+        free(values);
+        vector_out->dims = 0;
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    vector_out->id = id;
+    vector_out->source = source;
+    vector_out->model = model;
+    vector_out->values = values;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_json_vector_parse(const char* line, size_t size, eb_json_vector_t* vector_out) {
+    return parse_vector(line, size, true, vector_out);
+}
+
+eb_status_t eb_json_record_parse(const char* line, size_t size, eb_json_vector_t* vector_out) {
+    return parse_vector(line, size, false, vector_out);
+}
+
+void eb_json_vector_clear(eb_json_vector_t* vector) {
+    if (!vector)
+        return;
+    free((void*)vector->id);
+    free((void*)vector->source);
+    free((void*)vector->model);
+    free((void*)vector->values);
+    memset(vector, 0, sizeof(*vector));
+}
@@ -0,0 +1,166 @@
+/*
+ * EmbeddingBridge - JSON Vector Encoding
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_JSON_VECTOR_H
+#define EB_JSON_VECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+#include "transformer.h"
+
+/*
+ * Vectors as JSON without building a document tree. Floats are printed
+ * with the fewest digits that read back to the same float (Ryu), and read
+ * with a fast path that only falls back to strtof() for long or extreme
+ * numbers. A set is written as NDJSON, one object per line:
+ *
+ *   {"id":"<hash>","source":"doc.txt","model":"m","timestamp":1700000000,"values":[0.25,-1,...]}
+ *
+ * source and model are left out when unknown. Non-finite values are
+ * written as null and read back as NaN.
+ */
+
+/* Longest float as printed by eb_json_format_float(), "-1.17549435e-38" */
+#define EB_JSON_FLOAT_MAX 15
+
+typedef struct {
+    const char* id;               /* Object hash */
+    const char* source;           /* Source file, may be NULL */
+    const char* model;            /* Model name, may be NULL */
+    int64_t timestamp;            /* Seconds since the epoch */
+    const float* values;          /* dims values */
+    size_t dims;
+} eb_json_vector_t;
+
+typedef struct eb_json_writer eb_json_writer_t;
+
+/**
+ * Print a float with the fewest digits that read back to it
+ *
+ * @param value Value to print
+ * @param buf Receives at least EB_JSON_FLOAT_MAX bytes, not NUL-terminated
+ * @return Number of bytes written
+ */
+size_t eb_json_format_float(float value, char* buf);
+
+/**
+ * Read one JSON number as a float
+ *
+ * @param text Start of the number (null is read as NaN)
+ * @param size Bytes available at text
+ * @param value_out Receives the value
+ * @return Bytes consumed, 0 if text does not start with a number
+ */
+size_t eb_json_parse_float(const char* text, size_t size, float* value_out);
+
+/**
+ * Read a JSON array of numbers
+ *
+ * @param text Array, leading whitespace allowed
+ * @param size Size of text
+ * @param values_out Receives the values, caller frees
+ * @param count_out Receives the number of values
+ * @param consumed_out Receives the bytes up to and including ']', may be NULL
+ * @return Status code (EB_ERROR_INVALID_FORMAT for anything but an array of numbers)
+ */
+eb_status_t eb_json_parse_floats(const char* text, size_t size, float** values_out,
+                                 size_t* count_out, size_t* consumed_out);
+
+/**
+ * Start writing vectors as NDJSON
+ *
+ * @param sink Consumer of the output, called with blocks of up to 64 KiB
+ * @param ctx Passed to sink
+ * @param writer_out Receives the writer
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_json_writer_open(eb_transform_sink_fn sink, void* ctx, eb_json_writer_t** writer_out);
+
+/**
+ * Write one vector as a line
+ *
+ * @param writer Writer
+ * @param vector Vector to write
+ * @return Status code (the sink's status if it failed)
+ */
+eb_status_t eb_json_writer_add(eb_json_writer_t* writer, const eb_json_vector_t* vector);
+
+/**
+ * Flush the last block and free the writer
+ *
+ * @param writer Writer
+ * @param bytes_out Receives the number of bytes written in total, may be NULL
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_json_writer_close(eb_json_writer_t* writer, size_t* bytes_out);
+
+/**
+ * Free a writer without flushing it
+ */
+void eb_json_writer_abort(eb_json_writer_t* writer);
+
+/**
+ * Escape a string for use between JSON quotes
+ *
+ * @param value NUL-terminated string
+ * @param out Receives at most 6 * strlen(value) bytes, not NUL-terminated
+ * @return Number of bytes written
+ */
+size_t eb_json_escape(const char* value, char* out);
+
+/**
+ * Upper bound on the size of a vector formatted by eb_json_pinecone_record()
+ */
+size_t eb_json_pinecone_record_max(const eb_json_vector_t* vector);
+
+/**
+ * Format a vector as a Pinecone upsert record
+ *
+ *   {"id":"<hash>","values":[...],"metadata":{"timestamp":1700000000,"source":"doc.txt","model":"m"}}
+ *
+ * @param vector Vector to format, source and model are left out when NULL
+ * @param buf Receives eb_json_pinecone_record_max() bytes at most, not NUL-terminated
+ * @return Number of bytes written
+ */
+size_t eb_json_pinecone_record(const eb_json_vector_t* vector, char* buf);
+
+/**
+ * Read one NDJSON line as written by eb_json_writer_add()
+ *
+ * Members other than id, source, model, timestamp and values are ignored.
+ *
+ * @param line Line, with or without its newline
+ * @param size Size of line
+ * @param vector_out Receives the vector, release with eb_json_vector_clear()
+ * @return Status code (EB_ERROR_INVALID_FORMAT if the line is no such object)
+ */
+eb_status_t eb_json_vector_parse(const char* line, size_t size, eb_json_vector_t* vector_out);
+
+/**
+ * Read one NDJSON record of a vector yet to be stored
+ *
+ * As eb_json_vector_parse(), but id may be left out, so a producer only
+ * has to write source, model and values.
+ *
+ * @param line Line, with or without its newline
+ * @param size Size of line
+ * @param vector_out Receives the vector, id NULL if absent; release with
+ *        eb_json_vector_clear()
+ * @return Status code (EB_ERROR_INVALID_FORMAT if the line is no such object)
+ */
+eb_status_t eb_json_record_parse(const char* line, size_t size, eb_json_vector_t* vector_out);
+
+/**
+ * Free the fields of a vector from eb_json_vector_parse()
+ */
+void eb_json_vector_clear(eb_json_vector_t* vector);
+
+#endif /* EB_JSON_VECTOR_H */
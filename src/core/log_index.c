@@ -0,0 +1,782 @@
+/*
+ * EmbeddingBridge - Set Log Index Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log_index.h"
+#include "set_layers.h"
+#include "counters.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define LOG_INDEX_MIN_SLOTS 1024
+#define LOG_FINGERPRINT_BYTES 64
+#define LOG_SCAN_CHUNK (64 * 1024)
+#define LOG_LINE_MAX (PATH_MAX + 256)
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    eb_log_index_record_t* items;
+    size_t count;
+    size_t capacity;
+} record_vec_t;
+
+static uint64_t fnv1a(const void* data, size_t len, uint64_t h) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+/* Key 0 is never produced so a zeroed slot is unambiguous */
+static uint64_t source_key(const char* source, size_t len) {
+    uint64_t key = fnv1a(source, len, FNV_OFFSET);
+    return key ? key : 1;
+}
+
+static void get_index_path(const char* log_path, char* out, size_t size) {
+    snprintf(out, size, "%s%s", log_path, EB_LOG_INDEX_SUFFIX);
+}
+
+/* Hash of the bytes just before size, so a rewritten log is noticed */
+static bool log_fingerprint(int log_fd, uint64_t size, uint64_t* out) {
+    unsigned char buf[LOG_FINGERPRINT_BYTES];
+    size_t n = size < sizeof(buf) ? (size_t)size : sizeof(buf);
+    if (n && pread(log_fd, buf, n, (off_t)(size - n)) != (ssize_t)n)
+        return false;
+    *out = fnv1a(buf, n, FNV_OFFSET ^ size);
+    return true;
+}
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* Locate the source, the third field of "<timestamp> <hash> <source> <model>" */
+static bool line_source(const char* line, size_t len, const char** source, size_t* source_len) {
+    size_t i = 0;
+    for (int field = 0; field < 3; field++) {
+        while (i < len && is_blank(line[i]))
+            i++;
+        size_t start = i;
+        while (i < len && !is_blank(line[i]))
+            i++;
+        if (start == i)
+            return false;
+        if (field == 2) {
+            *source = line + start;
+            *source_len = i - start;
+        }
+    }
+    return true;
+}
+
+static bool parse_entry(char* line, eb_log_entry_t* entry) {
+    char* save = NULL;
+    char* timestamp = strtok_r(line, " \t\r\n", &save);
+    char* hash = timestamp ? strtok_r(NULL, " \t\r\n", &save) : NULL;
+    char* source = hash ? strtok_r(NULL, " \t\r\n", &save) : NULL;
+    if (!source)
+        return false;
+    char* model = strtok_r(NULL, " \t\r\n", &save);
+
+    entry->timestamp = (time_t)strtoll(timestamp, NULL, 10);
+    entry->hash = hash;
+    entry->source = source;
+    entry->model = model ? model : "";
+    entry->removed = strcmp(hash, EB_LOG_TOMBSTONE) == 0;
+    return true;
+}
+
+static bool vec_push(record_vec_t* vec, uint64_t key, uint64_t offset) {
+    if (vec->count == vec->capacity) {
+        size_t capacity = vec->capacity ? vec->capacity * 2 : 64;
+        eb_log_index_record_t* items = realloc(vec->items, capacity * sizeof(*items));
+        if (!items)
+            return false;
+        vec->items = items;
+        vec->capacity = capacity;
+    }
+    eb_log_index_record_t* rec = &vec->items[vec->count++];
+    rec->key = key;
+    rec->offset = offset;
+    rec->prev = 0;
+    return true;
+}
+
+/*
+ * Add a record for every complete line in [from, to). A trailing line
+ * without a newline is left for a later update; end receives the offset
+ * just past the last line indexed.
+ */
+static eb_status_t scan_log(int log_fd, uint64_t from, uint64_t to,
+                            record_vec_t* out, uint64_t* end) {
+    size_t capacity = LOG_SCAN_CHUNK;
+    char* buf = malloc(capacity);
+    if (!buf)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    uint64_t base = from;   /* Log offset of buf[0] */
+    size_t used = 0;
+    *end = from;
+
+    while (base + used < to) {
+        if (used == capacity) {
+            char* grown = realloc(buf, capacity * 2);
+            if (!grown) {
+                free(buf);
+                return EB_ERROR_MEMORY_ALLOCATION;
+            }
+            buf = grown;
+            capacity *= 2;
+        }
+
+        uint64_t remaining = to - (base + used);
+        size_t want = remaining < capacity - used ? (size_t)remaining : capacity - used;
+        ssize_t n = pread(log_fd, buf + used, want, (off_t)(base + used));
+        if (n <= 0) {
+            free(buf);
+            return EB_ERROR_FILE_IO;
+        }
+        used += (size_t)n;
+
+        size_t start = 0;
+        char* nl;
+        while ((nl = memchr(buf + start, '\n', used - start)) != NULL) {
+            size_t len = (size_t)(nl - (buf + start));
+            const char* source;
+            size_t source_len;
+            if (line_source(buf + start, len, &source, &source_len) &&
+                !vec_push(out, source_key(source, source_len), base + start)) {
+                free(buf);
+                return EB_ERROR_MEMORY_ALLOCATION;
+            }
+            start += len + 1;
+        }
+
+        memmove(buf, buf + start, used - start);
+        base += start;
+        used -= start;
+        *end = base;
+    }
+
+    free(buf);
+    return EB_SUCCESS;
+}
+
+/* The table is kept at most half full, so probing always terminates */
+static eb_log_index_slot_t* find_slot(eb_log_index_slot_t* slots, uint64_t slot_count,
+                                      uint64_t key) {
+    uint64_t mask = slot_count - 1;
+    for (uint64_t i = key & mask;; i = (i + 1) & mask) {
+        if (!slots[i].head || slots[i].key == key)
+            return &slots[i];
+    }
+}
+
+/* Make record number n the newest of its key */
+static void link_record(eb_log_index_slot_t* slots, uint64_t slot_count, uint64_t* key_count,
+                        eb_log_index_record_t* rec, uint64_t n) {
+    eb_log_index_slot_t* slot = find_slot(slots, slot_count, rec->key);
+    if (!slot->head) {
+        slot->key = rec->key;
+        (*key_count)++;
+    }
+    rec->prev = slot->head;
+    slot->head = n + 1;
+}
+
+static eb_log_index_slot_t* rehash(const eb_log_index_slot_t* slots, uint64_t slot_count,
+                                   uint64_t new_count) {
+    eb_log_index_slot_t* grown = calloc(new_count, sizeof(*grown));
+    if (!grown)
+        return NULL;
+    for (uint64_t i = 0; i < slot_count; i++) {
+        if (slots[i].head)
+            *find_slot(grown, new_count, slots[i].key) = slots[i];
+    }
+    return grown;
+}
+
+/* Write a fresh index over the given records and rename it into place */
+static eb_status_t write_index(const char* path, record_vec_t* records,
+                               uint64_t log_size, uint64_t fingerprint) {
+    eb_log_index_header_t header = {0};
+    header.magic = EB_LOG_INDEX_MAGIC;
+    header.version = EB_LOG_INDEX_VERSION;
+    header.slot_count = LOG_INDEX_MIN_SLOTS;
+    header.record_count = records->count;
+    header.log_size = log_size;
+    header.fingerprint = fingerprint;
+
+    eb_log_index_slot_t* slots = calloc(header.slot_count, sizeof(*slots));
+    if (!slots)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    for (size_t i = 0; i < records->count; i++) {
+        if ((header.key_count + 1) * 2 > header.slot_count) {
+            eb_log_index_slot_t* grown = rehash(slots, header.slot_count, header.slot_count * 2);
+            free(slots);
+            if (!grown)
+                return EB_ERROR_MEMORY_ALLOCATION;
+            slots = grown;
+            header.slot_count *= 2;
+        }
+        link_record(slots, header.slot_count, &header.key_count, &records->items[i], i);
+    }
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        free(slots);
+        return EB_ERROR_FILE_IO;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(slots, sizeof(*slots), header.slot_count, f) == header.slot_count &&
+              (records->count == 0 ||
+               fwrite(records->items, sizeof(*records->items), records->count, f) == records->count);
+    free(slots);
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+static uint64_t records_offset(const eb_log_index_header_t* header) {
+    return sizeof(*header) + header->slot_count * sizeof(eb_log_index_slot_t);
+}
+
+/* Check that an index header fits its file and still matches the log */
+static bool header_valid(const eb_log_index_header_t* header, uint64_t file_size) {
+    if (header->magic != EB_LOG_INDEX_MAGIC || header->version != EB_LOG_INDEX_VERSION)
+        return false;
+    if (header->slot_count < LOG_INDEX_MIN_SLOTS ||
+        (header->slot_count & (header->slot_count - 1)) ||
+        header->slot_count > file_size / sizeof(eb_log_index_slot_t) ||
+        header->key_count * 2 > header->slot_count)
+        return false;
+    if (header->record_count > file_size / sizeof(eb_log_index_record_t))
+        return false;
+    return records_offset(header) + header->record_count * sizeof(eb_log_index_record_t) <= file_size;
+}
+
+static bool read_header(int fd, int log_fd, uint64_t log_size, eb_log_index_header_t* header) {
+    struct stat st;
+    if (pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header) || fstat(fd, &st) != 0)
+        return false;
+    if (!header_valid(header, (uint64_t)st.st_size) || header->log_size > log_size)
+        return false;
+
+    uint64_t fingerprint;
+    return log_fingerprint(log_fd, header->log_size, &fingerprint) &&
+           fingerprint == header->fingerprint;
+}
+
+/* Link new records into the mapped table, append them, then commit the header */
+static eb_status_t append_records(int fd, const eb_log_index_header_t* old, record_vec_t* records,
+                                  uint64_t log_size, uint64_t fingerprint) {
+    size_t map_size = (size_t)records_offset(old);
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return EB_ERROR_FILE_IO;
+
+    eb_log_index_header_t header = *old;
+    eb_log_index_slot_t* slots = (eb_log_index_slot_t*)((char*)map + sizeof(header));
+    for (size_t i = 0; i < records->count; i++)
+        link_record(slots, header.slot_count, &header.key_count, &records->items[i],
+                    header.record_count + i);
+
+    size_t size = records->count * sizeof(*records->items);
+    off_t at = (off_t)(map_size + header.record_count * sizeof(*records->items));
+    bool ok = !size || pwrite(fd, records->items, size, at) == (ssize_t)size;
+    if (ok) {
+        header.record_count += records->count;
+        header.log_size = log_size;
+        header.fingerprint = fingerprint;
+        memcpy(map, &header, sizeof(header));
+    }
+    munmap(map, map_size);
+    return ok ? EB_SUCCESS : EB_ERROR_FILE_IO;
+}
+
+static eb_status_t load_records(int fd, const eb_log_index_header_t* header, record_vec_t* out) {
+    size_t count = (size_t)header->record_count;
+    out->items = malloc((count ? count : 1) * sizeof(*out->items));
+    if (!out->items)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    out->capacity = count ? count : 1;
+
+    size_t size = count * sizeof(*out->items);
+    if (size && pread(fd, out->items, size, (off_t)records_offset(header)) != (ssize_t)size)
+        return EB_ERROR_FILE_IO;
+    out->count = count;
+    return EB_SUCCESS;
+}
+
+static eb_status_t update_index(const char* path, int log_fd, uint64_t log_size) {
+    eb_log_index_header_t header;
+    int fd = open(path, O_RDWR);
+    bool valid = fd >= 0 && read_header(fd, log_fd, log_size, &header);
+    if (valid && header.log_size == log_size) {
+        close(fd);
+        return EB_SUCCESS;
+    }
+
+    record_vec_t added = {0};
+    uint64_t end;
+    uint64_t fingerprint = 0;
+    eb_status_t status = scan_log(log_fd, valid ? header.log_size : 0, log_size, &added, &end);
+    if (status == EB_SUCCESS && !log_fingerprint(log_fd, end, &fingerprint))
+        status = EB_ERROR_FILE_IO;
+
+    if (status == EB_SUCCESS && valid && end == header.log_size) {
+        /* Only a partial line was appended */
+    } else if (status == EB_SUCCESS && valid &&
+               (header.key_count + added.count) * 2 <= header.slot_count) {
+        status = append_records(fd, &header, &added, end, fingerprint);
+    } else if (status == EB_SUCCESS) {
+        /* Missing or stale, or the table may need to grow */
+        record_vec_t all = {0};
+        if (valid)
+            status = load_records(fd, &header, &all);
+        for (size_t i = 0; status == EB_SUCCESS && i < added.count; i++) {
+            if (!vec_push(&all, added.items[i].key, added.items[i].offset))
+                status = EB_ERROR_MEMORY_ALLOCATION;
+        }
+        if (status == EB_SUCCESS) {
+            DEBUG_PRINT("update_index: Writing %s with %zu records", path, all.count);
+            status = write_index(path, &all, end, fingerprint);
+        }
+        free(all.items);
+    }
+
+    free(added.items);
+    if (fd >= 0)
+        close(fd);
+    return status;
+}
+
+bool eb_log_tombstone_covers(const char* tombstone_model, const char* model) {
+    return tombstone_model[0] == '\0' || strcmp(tombstone_model, model) == 0;
+}
+
+eb_status_t eb_log_index_update(const char* log_path) {
+    if (!log_path)
+        return EB_ERROR_INVALID_INPUT;
+
+    char path[PATH_MAX];
+    get_index_path(log_path, path, sizeof(path));
+
+    int log_fd = open(log_path, O_RDONLY);
+    if (log_fd < 0) {
+        if (errno != ENOENT)
+            return EB_ERROR_FILE_IO;
+        unlink(path);
+        return EB_SUCCESS;
+    }
+
+    struct stat st;
+    eb_status_t status = fstat(log_fd, &st) == 0
+        ? update_index(path, log_fd, (uint64_t)st.st_size)
+        : EB_ERROR_FILE_IO;
+    close(log_fd);
+    return status;
+}
+
+/* Offsets below limit of the log lines chained under the key of source, newest first */
+static eb_status_t collect_offsets(const char* path, const char* source, uint64_t limit,
+                                   uint64_t** out, size_t* out_count) {
+    *out = NULL;
+    *out_count = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(eb_log_index_header_t)) {
+        close(fd);
+        return EB_ERROR_INVALID_DATA;
+    }
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return EB_ERROR_FILE_IO;
+
+    const eb_log_index_header_t* header = map;
+    if (!header_valid(header, size)) {
+        munmap(map, size);
+        return EB_ERROR_INVALID_DATA;
+    }
+
+    const eb_log_index_slot_t* slots = (const eb_log_index_slot_t*)(header + 1);
+    const eb_log_index_record_t* records =
+        (const eb_log_index_record_t*)((const char*)map + records_offset(header));
+    uint64_t key = source_key(source, strlen(source));
+    uint64_t mask = header->slot_count - 1;
+    uint64_t n = 0;
+    for (uint64_t i = key & mask, probes = 0; probes < header->slot_count;
+         i = (i + 1) & mask, probes++) {
+        if (!slots[i].head || slots[i].key == key) {
+            n = slots[i].head;
+            break;
+        }
+    }
+
+    eb_status_t status = EB_SUCCESS;
+    size_t count = 0, capacity = 0;
+    uint64_t* offsets = NULL;
+    uint64_t last = UINT64_MAX;
+    while (n) {
+        /* Chains only run backwards through records covering the log */
+        if (n > header->record_count || n >= last ||
+            records[n - 1].key != key || records[n - 1].offset >= header->log_size) {
+            status = EB_ERROR_INVALID_DATA;
+            break;
+        }
+        if (records[n - 1].offset < limit) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                uint64_t* grown = realloc(offsets, capacity * sizeof(*offsets));
+                if (!grown) {
+                    status = EB_ERROR_MEMORY_ALLOCATION;
+                    break;
+                }
+                offsets = grown;
+            }
+            offsets[count++] = records[n - 1].offset;
+        }
+        last = n;
+        n = records[n - 1].prev;
+    }
+    munmap(map, size);
+
+    if (status != EB_SUCCESS) {
+        free(offsets);
+        return status;
+    }
+    *out = offsets;
+    *out_count = count;
+    return EB_SUCCESS;
+}
+
+/* A caller's callback, and whether it asked to stop */
+typedef struct {
+    eb_log_visit_fn fn;
+    void* ctx;
+    bool stopped;
+} visitor_t;
+
+static bool visit_line(char* line, const char* source, visitor_t* v) {
+    eb_log_entry_t entry;
+    if (!parse_entry(line, &entry) || (source && strcmp(entry.source, source) != 0))
+        return false;
+    v->stopped = v->fn(&entry, v->ctx) != 0;
+    return v->stopped;
+}
+
+/* Read the lines before limit, keeping those of source (all for NULL) */
+static eb_status_t scan_source(const char* log_path, const char* source, uint64_t limit,
+                               visitor_t* v) {
+    FILE* f = fopen(log_path, "r");
+    if (!f)
+        return errno == ENOENT ? EB_SUCCESS : EB_ERROR_FILE_IO;
+
+    char* line = malloc(LOG_LINE_MAX);
+    if (!line) {
+        fclose(f);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    while ((uint64_t)ftello(f) < limit && fgets(line, LOG_LINE_MAX, f)) {
+        if (visit_line(line, source, v))
+            break;
+    }
+    free(line);
+    fclose(f);
+    return EB_SUCCESS;
+}
+
+/*
+ * Lines of source before limit through the index, oldest or newest first.
+ * *reading is set once lines are being visited, past the point where a
+ * failure could still be retried with a scan.
+ */
+static eb_status_t visit_indexed(const char* log_path, const char* source, uint64_t limit,
+                                 bool newest_first, visitor_t* v, bool* reading) {
+    char path[PATH_MAX];
+    get_index_path(log_path, path, sizeof(path));
+
+    uint64_t* offsets = NULL;
+    size_t count = 0;
+    eb_status_t status = eb_log_index_update(log_path);
+    if (status == EB_SUCCESS) {
+        status = collect_offsets(path, source, limit, &offsets, &count);
+        if (status == EB_ERROR_INVALID_DATA)
+            unlink(path);   /* Rebuilt by the next update */
+    }
+    if (status != EB_SUCCESS)
+        return status;
+
+    int fd = open(log_path, O_RDONLY);
+    char* line = malloc(LOG_LINE_MAX);
+    if (fd < 0 || !line) {
+        if (fd >= 0)
+            close(fd);
+        free(line);
+        free(offsets);
+        return fd >= 0 ? EB_ERROR_MEMORY_ALLOCATION : EB_ERROR_FILE_IO;
+    }
+
+    /* Offsets are newest first; only the lines the caller takes are read */
+    *reading = true;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t offset = offsets[newest_first ? i : count - 1 - i];
+        ssize_t n = pread(fd, line, LOG_LINE_MAX - 1, (off_t)offset);
+        if (n <= 0) {
+            status = EB_ERROR_FILE_IO;
+            break;
+        }
+        line[n] = '\0';
+        line[strcspn(line, "\n")] = '\0';
+        if (visit_line(line, source, v))
+            break;
+    }
+
+    free(line);
+    free(offsets);
+    close(fd);
+    return status;
+}
+
+/* Read the lines before limit backwards a chunk at a time */
+static eb_status_t scan_backwards(const char* log_path, const char* source, uint64_t limit,
+                                  visitor_t* v) {
+    int fd = open(log_path, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT ? EB_SUCCESS : EB_ERROR_FILE_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return EB_ERROR_FILE_IO;
+    }
+
+    // buf holds the unvisited log bytes [start, start + len)
+    uint64_t start = (uint64_t)st.st_size < limit ? (uint64_t)st.st_size : limit;
+    size_t len = 0, capacity = 0;
+    char* buf = NULL;
+    char* line = malloc(LOG_LINE_MAX);
+    eb_status_t status = line ? EB_SUCCESS : EB_ERROR_MEMORY_ALLOCATION;
+    while (status == EB_SUCCESS) {
+        /* The last line in buf starts after the newline before it */
+        size_t end = len && buf[len - 1] == '\n' ? len - 1 : len;
+        size_t i = end;
+        while (i > 0 && buf[i - 1] != '\n')
+            i--;
+
+        if (i == 0 && start > 0) {
+            size_t chunk = start < LOG_SCAN_CHUNK ? (size_t)start : LOG_SCAN_CHUNK;
+            if (len + chunk > capacity) {
+                capacity = (len + chunk) * 2;
+                char* grown = realloc(buf, capacity);
+                if (!grown) {
+                    status = EB_ERROR_MEMORY_ALLOCATION;
+                    break;
+                }
+                buf = grown;
+            }
+            memmove(buf + chunk, buf, len);
+            start -= chunk;
+            if (pread(fd, buf, chunk, (off_t)start) != (ssize_t)chunk) {
+                status = EB_ERROR_FILE_IO;
+                break;
+            }
+            len += chunk;
+            continue;
+        }
+
+        /* Lines longer than a forward scan would read are skipped */
+        if (end > i && end - i < LOG_LINE_MAX) {
+            memcpy(line, buf + i, end - i);
+            line[end - i] = '\0';
+            if (visit_line(line, source, v))
+                break;
+        }
+        if (i == 0)
+            break;
+        len = i;
+    }
+
+    free(line);
+    free(buf);
+    close(fd);
+    return status;
+}
+
+/* One file of a layered log, in either direction */
+static eb_status_t visit_file(const char* log_path, const char* source, uint64_t limit,
+                              bool newest_first, visitor_t* v) {
+    if (access(log_path, F_OK) != 0)
+        return EB_SUCCESS;
+    if (source) {
+        bool reading = false;
+        eb_status_t status = visit_indexed(log_path, source, limit, newest_first, v, &reading);
+        if (status == EB_SUCCESS || reading)
+            return status;
+        DEBUG_PRINT("log_index: Index unavailable (%d), scanning %s", status, log_path);
+    }
+    return newest_first ? scan_backwards(log_path, source, limit, v)
+                        : scan_source(log_path, source, limit, v);
+}
+
+/*
+ * Visit the layers a set was created from, then its own log, or the
+ * other way round; each layer ends where the base set stood.
+ */
+static eb_status_t visit_layered(const char* log_path, const char* source, bool newest_first,
+                                 eb_log_visit_fn fn, void* ctx) {
+    eb_set_layers_t layers;
+    eb_status_t status = eb_set_layers_load_for(log_path, &layers);
+    if (status != EB_SUCCESS)
+        return status;
+
+    visitor_t v = { fn, ctx, false };
+    size_t files = layers.count + 1;
+    for (size_t n = 0; status == EB_SUCCESS && !v.stopped && n < files; n++) {
+        size_t i = newest_first ? files - 1 - n : n;
+        if (i == layers.count) {
+            status = visit_file(log_path, source, UINT64_MAX, newest_first, &v);
+        } else {
+            char path[PATH_MAX];
+            eb_set_layer_path(log_path, &layers.items[i], "log", path, sizeof(path));
+            status = visit_file(path, source, layers.items[i].log_size, newest_first, &v);
+        }
+    }
+    eb_set_layers_free(&layers);
+    return status;
+}
+
+eb_status_t eb_log_foreach_source(const char* log_path, const char* source,
+                                  eb_log_visit_fn fn, void* ctx) {
+    if (!log_path || !source || !fn)
+        return EB_ERROR_INVALID_INPUT;
+    eb_counter_add(EB_COUNTER_LOG_LOOKUPS, 1);
+    return visit_layered(log_path, source, false, fn, ctx);
+}
+
+eb_status_t eb_log_foreach_reverse(const char* log_path, const char* source,
+                                   eb_log_visit_fn fn, void* ctx) {
+    if (!log_path || !fn)
+        return EB_ERROR_INVALID_INPUT;
+    eb_counter_add(EB_COUNTER_LOG_LOOKUPS, 1);
+    return visit_layered(log_path, source, true, fn, ctx);
+}
+
+eb_status_t eb_log_foreach(const char* log_path, eb_log_visit_fn fn, void* ctx) {
+    if (!log_path || !fn)
+        return EB_ERROR_INVALID_INPUT;
+    eb_counter_add(EB_COUNTER_LOG_LOOKUPS, 1);
+    return visit_layered(log_path, NULL, false, fn, ctx);
+}
+
+eb_status_t eb_log_foreach_range(const char* log_path, uint64_t start, uint64_t end,
+                                 eb_log_visit_fn fn, void* ctx, uint64_t* next_out) {
+    if (!log_path || !fn)
+        return EB_ERROR_INVALID_INPUT;
+    eb_counter_add(EB_COUNTER_LOG_LOOKUPS, 1);
+    if (next_out)
+        *next_out = start;
+    FILE* f = fopen(log_path, "r");
+    if (!f)
+        return errno == ENOENT ? EB_SUCCESS : EB_ERROR_FILE_IO;
+    if (fseeko(f, (off_t)start, SEEK_SET) != 0) {
+        fclose(f);
+        return EB_ERROR_FILE_IO;
+    }
+
+    char* line = malloc(LOG_LINE_MAX);
+    if (!line) {
+        fclose(f);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    visitor_t v = { fn, ctx, false };
+    uint64_t pos = start;
+    while (pos < end && fgets(line, LOG_LINE_MAX, f)) {
+        size_t len = strlen(line);
+        // A line still being written is left for the next reader
+        if (len == 0 || line[len - 1] != '\n' || pos + len > end)
+            break;
+        pos += len;
+        if (visit_line(line, NULL, &v))
+            break;
+    }
+    free(line);
+    fclose(f);
+    if (next_out)
+        *next_out = pos;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_log_index_stat(const char* log_path, uint64_t* entries_out, uint64_t* size_out) {
+    if (!log_path)
+        return EB_ERROR_INVALID_INPUT;
+    eb_status_t status = eb_log_index_update(log_path);
+    if (status != EB_SUCCESS)
+        return status;
+
+    eb_log_index_header_t header = {0};
+    char path[PATH_MAX];
+    get_index_path(log_path, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+            status = EB_ERROR_FILE_IO;
+        close(fd);
+    } else if (errno != ENOENT) {
+        status = EB_ERROR_FILE_IO;
+    }
+    if (entries_out)
+        *entries_out = header.record_count;
+    if (size_out)
+        *size_out = header.log_size;
+    return status;
+}
+
+eb_status_t eb_log_fingerprint(const char* log_path, uint64_t offset, uint64_t* out) {
+    if (!log_path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    int fd = open(log_path, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (uint64_t)st.st_size >= offset &&
+              log_fingerprint(fd, offset, out);
+    close(fd);
+    return ok ? EB_SUCCESS : EB_ERROR_INVALID_DATA;
+}
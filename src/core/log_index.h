@@ -0,0 +1,188 @@
+/*
+ * EmbeddingBridge - Set Log Index
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_LOG_INDEX_H
+#define EB_LOG_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "status.h"
+
+/*
+ * The set log (.embr/sets/<set>/log) is an append-only text file with one
+ * "<timestamp> <hash> <source> <model>" line per stored embedding. Its side
+ * index, <log>.idx, chains the lines of each source together so the history
+ * of one file is read without scanning the rest of the log:
+ *
+ *   header | slot table | records
+ *
+ * The slot table is an open-addressing hash table from source key to that
+ * source's newest record. Each record holds the byte offset of a log line
+ * and the record number of the previous line for the same source.
+ *
+ * The index is a cache. It remembers how many log bytes it covers and a
+ * fingerprint of the bytes just before that point. Lines appended by any
+ * writer are picked up on the next update, and a log that was rewritten
+ * gets its index rebuilt from scratch.
+ *
+ * A removal is logged as a tombstone, a line with EB_LOG_TOMBSTONE in
+ * place of the hash. It ends the history of its (source, model) up to
+ * that point, or of every model of the source when it has no model;
+ * eb_set_compact() later drops the lines it covers.
+ *
+ * The readers below follow a set created from another set through its
+ * base layers (set_layers.h), so they see the whole history of the set.
+ */
+
+#define EB_LOG_INDEX_MAGIC   0x45424c58  /* "EBLX" */
+#define EB_LOG_INDEX_VERSION 1
+#define EB_LOG_INDEX_SUFFIX  ".idx"
+#define EB_LOG_TOMBSTONE     "-"     /* Hash field of a removal */
+
+typedef struct {
+    uint32_t magic;         /* EB_LOG_INDEX_MAGIC */
+    uint32_t version;       /* EB_LOG_INDEX_VERSION */
+    uint64_t slot_count;    /* Power of two */
+    uint64_t key_count;     /* Occupied slots */
+    uint64_t record_count;
+    uint64_t log_size;      /* Log bytes covered by the records */
+    uint64_t fingerprint;   /* Hash of the log bytes ending at log_size */
+    uint64_t reserved[2];
+} eb_log_index_header_t;
+
+typedef struct {
+    uint64_t key;           /* Hash of the source path */
+    uint64_t head;          /* Newest record number + 1, 0 if empty */
+} eb_log_index_slot_t;
+
+typedef struct {
+    uint64_t key;
+    uint64_t offset;        /* Offset of the log line */
+    uint64_t prev;          /* Previous record number + 1 for the key, 0 if none */
+} eb_log_index_record_t;
+
+/* A parsed log line; strings are only valid during the callback */
+typedef struct {
+    time_t timestamp;
+    const char* hash;
+    const char* source;
+    const char* model;      /* "" if the line has no model */
+    bool removed;           /* A tombstone; hash is EB_LOG_TOMBSTONE */
+} eb_log_entry_t;
+
+/**
+ * Callback invoked for each log entry
+ *
+ * @param entry Parsed log line
+ * @param ctx Caller context
+ * @return 0 to continue, non-zero to stop iteration
+ */
+typedef int (*eb_log_visit_fn)(const eb_log_entry_t* entry, void* ctx);
+
+/**
+ * Whether a tombstone ends the history of a model of its source
+ *
+ * @param tombstone_model Model of the tombstone, "" if it has none
+ * @param model Model of an earlier line for the same source
+ * @return true if the line is covered by the tombstone
+ */
+bool eb_log_tombstone_covers(const char* tombstone_model, const char* model);
+
+/**
+ * Bring the index of a log up to date
+ *
+ * Indexes lines appended since the last update, or rebuilds the index
+ * when it is missing, damaged or no longer matches the log.
+ *
+ * @param log_path Set log
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_log_index_update(const char* log_path);
+
+/**
+ * Visit the log entries of one source, oldest first
+ *
+ * Falls back to scanning the log when the index cannot be updated.
+ *
+ * @param log_path Set log
+ * @param source Source path as written in the log
+ * @param fn Callback
+ * @param ctx Callback context
+ * @return Status code (0 = success, also when the log does not exist)
+ */
+eb_status_t eb_log_foreach_source(const char* log_path, const char* source,
+                                  eb_log_visit_fn fn, void* ctx);
+
+/**
+ * Visit every log entry, oldest first, in one sequential read
+ *
+ * For callers that need the history of all sources at once.
+ *
+ * @param log_path Set log
+ * @param fn Callback
+ * @param ctx Callback context
+ * @return Status code (0 = success, also when the log does not exist)
+ */
+eb_status_t eb_log_foreach(const char* log_path, eb_log_visit_fn fn, void* ctx);
+
+/**
+ * Visit log entries newest first, reading only as far back as the caller goes
+ *
+ * With a source, its lines are located through the index; without one, or
+ * when the index cannot be used, the log is read backwards in chunks from
+ * its end. Returning non-zero from fn makes the cost independent of how
+ * long the history is.
+ *
+ * @param log_path Set log
+ * @param source Source path as written in the log, NULL for every entry
+ * @param fn Callback
+ * @param ctx Callback context
+ * @return Status code (0 = success, also when the log does not exist)
+ */
+eb_status_t eb_log_foreach_reverse(const char* log_path, const char* source,
+                                   eb_log_visit_fn fn, void* ctx);
+
+/**
+ * Visit the complete lines of one log file between two offsets
+ *
+ * Does not follow base layers; for callers that keep their own position
+ * in a log, such as checkpoints.
+ *
+ * @param log_path Log file
+ * @param start Offset of the first line to read
+ * @param end Offset to stop at, UINT64_MAX for the end of the file
+ * @param fn Callback
+ * @param ctx Callback context
+ * @param next_out Optional, receives the offset just past the last line read
+ * @return Status code (0 = success, also when the log does not exist)
+ */
+eb_status_t eb_log_foreach_range(const char* log_path, uint64_t start, uint64_t end,
+                                 eb_log_visit_fn fn, void* ctx, uint64_t* next_out);
+
+/**
+ * Entries and bytes in a log file, from its index after bringing it up to date
+ *
+ * @param log_path Log file, without its base layers
+ * @param entries_out Optional, receives the number of indexed lines
+ * @param size_out Optional, receives the bytes they cover
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_log_index_stat(const char* log_path, uint64_t* entries_out, uint64_t* size_out);
+
+/**
+ * Fingerprint of the log bytes ending at an offset
+ *
+ * The same bytes always give the same value, so a position saved with
+ * its fingerprint can tell whether the log was rewritten since.
+ */
+eb_status_t eb_log_fingerprint(const char* log_path, uint64_t offset, uint64_t* out);
+
+#endif /* EB_LOG_INDEX_H */
@@ -0,0 +1,399 @@
+/*
+ * EmbeddingBridge - In-Memory Vector Table Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "memory_store.h"
+#include "arena.h"
+#include "metadata.h"
+
+#define MAP_MIN_SLOTS 64
+#define MAP_MIGRATE_STEP 8          /* Old slots moved per insertion while growing */
+#define TABLE_MIN_ROWS 64
+#define VALUE_ALIGN 64
+#define VALUE_PAD 16                /* Floats per 64 bytes */
+#define VALUE_ARENA_CHUNK (1u << 20)
+
+/* Open addressing slots: a 64-bit key hash and the value it maps to */
+typedef struct {
+    uint64_t* keys;
+    uint32_t* values;               /* EB_MEMORY_NO_ROW marks an empty slot */
+    size_t slot_count;              /* Power of two */
+    size_t count;
+} slots_t;
+
+/*
+ * While growing, entries still in old are found there; migrated tells
+ * how many of its slots have been moved into current.
+ */
+typedef struct {
+    slots_t current;
+    slots_t old;
+    size_t migrated;
+} row_map_t;
+
+/* Name a map value stands for, to tell apart keys whose hashes collide */
+typedef const char* (*name_fn)(const eb_memory_table_t* table, uint32_t value);
+
+struct eb_memory_table {
+    size_t count;
+    size_t capacity;
+
+    /* Row columns */
+    uint64_t* ids;
+    uint64_t* parent_ids;
+    uint64_t* timestamps;
+    uint32_t* prev_rows;            /* Previous row with the same id */
+    uint32_t* model_ids;            /* Index into models */
+    eb_embedding_t** embeddings;    /* Headers in strings, values in values */
+    const eb_meta_blob_t** metas;   /* Flat metadata, NULL if none */
+    eb_metadata_t** metadata;       /* List views of metas */
+    const char** texts;             /* "text" metadata value, NULL if none */
+
+    const char** models;            /* Interned model names */
+    size_t model_count;
+    size_t model_capacity;
+
+    eb_arena_t values;
+    eb_arena_t strings;
+
+    row_map_t by_id;                /* id -> newest row */
+    row_map_t by_text;              /* text -> newest row */
+    row_map_t by_model;             /* model name -> model index */
+};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t hash_string(const char* s) {
+    uint64_t h = 0xCBF29CE484222325ULL;         /* FNV-1a */
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 0x100000001B3ULL;
+    }
+    return mix64(h);
+}
+
+static const char* text_of_row(const eb_memory_table_t* table, uint32_t row) {
+    return table->texts[row];
+}
+
+static const char* model_name(const eb_memory_table_t* table, uint32_t index) {
+    return table->models[index];
+}
+
+static eb_status_t slots_alloc(slots_t* slots, size_t slot_count) {
+    slots->keys = malloc(slot_count * sizeof(*slots->keys));
+    slots->values = malloc(slot_count * sizeof(*slots->values));
+    if (!slots->keys || !slots->values) {
+        free(slots->keys);
+        free(slots->values);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    memset(slots->values, 0xFF, slot_count * sizeof(*slots->values));
+    slots->slot_count = slot_count;
+    slots->count = 0;
+    return EB_SUCCESS;
+}
+
+static void slots_free(slots_t* slots) {
+    free(slots->keys);
+    free(slots->values);
+    memset(slots, 0, sizeof(*slots));
+}
+
+/* Slot holding key, or the empty slot where it would go */
+static size_t slots_probe(const eb_memory_table_t* table, const slots_t* slots, uint64_t key,
+                          name_fn name_of, const char* name) {
+    size_t mask = slots->slot_count - 1;
+    size_t i = (size_t)key & mask;
+    while (slots->values[i] != EB_MEMORY_NO_ROW &&
+           (slots->keys[i] != key ||
+            (name_of && strcmp(name_of(table, slots->values[i]), name) != 0)))
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void slots_set(slots_t* slots, size_t i, uint64_t key, uint32_t value) {
+    if (slots->values[i] == EB_MEMORY_NO_ROW)
+        slots->count++;
+    slots->keys[i] = key;
+    slots->values[i] = value;
+}
+
+/* Move up to limit old slots into current; newer entries already there win */
+static void map_migrate(const eb_memory_table_t* table, row_map_t* map, name_fn name_of,
+                        size_t limit) {
+    slots_t* old = &map->old;
+    while (old->slot_count && limit--) {
+        size_t i = map->migrated++;
+        uint32_t value = old->values[i];
+        if (value != EB_MEMORY_NO_ROW) {
+            size_t j = slots_probe(table, &map->current, old->keys[i], name_of,
+                                   name_of ? name_of(table, value) : NULL);
+            if (map->current.values[j] == EB_MEMORY_NO_ROW)
+                slots_set(&map->current, j, old->keys[i], value);
+        }
+        if (map->migrated == old->slot_count) {
+            slots_free(old);
+            map->migrated = 0;
+        }
+    }
+}
+
+static uint32_t map_get(const eb_memory_table_t* table, const row_map_t* map, uint64_t key,
+                        name_fn name_of, const char* name) {
+    if (!map->current.slot_count)
+        return EB_MEMORY_NO_ROW;
+    uint32_t value = map->current.values[slots_probe(table, &map->current, key, name_of, name)];
+    if (value == EB_MEMORY_NO_ROW && map->old.slot_count)
+        value = map->old.values[slots_probe(table, &map->old, key, name_of, name)];
+    return value;
+}
+
+static eb_status_t map_put(const eb_memory_table_t* table, row_map_t* map, uint64_t key,
+                           uint32_t value, name_fn name_of, const char* name) {
+    map_migrate(table, map, name_of, MAP_MIGRATE_STEP);
+
+    size_t i = slots_probe(table, &map->current, key, name_of, name);
+    if (map->current.values[i] == EB_MEMORY_NO_ROW &&
+        (map->current.count + 1) * 2 > map->current.slot_count) {
+        /* Start the next doubling; a previous one still running is finished first */
+        map_migrate(table, map, name_of, SIZE_MAX);
+        slots_t grown;
+        eb_status_t status = slots_alloc(&grown, map->current.slot_count * 2);
+        if (status != EB_SUCCESS)
+            return status;
+        map->old = map->current;
+        map->current = grown;
+        map->migrated = 0;
+        map_migrate(table, map, name_of, MAP_MIGRATE_STEP);
+        i = slots_probe(table, &map->current, key, name_of, name);
+    }
+    slots_set(&map->current, i, key, value);
+    return EB_SUCCESS;
+}
+
+static void map_free(row_map_t* map) {
+    slots_free(&map->current);
+    slots_free(&map->old);
+}
+
+eb_status_t eb_memory_table_create(eb_memory_table_t** out) {
+    if (!out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_memory_table_t* table = calloc(1, sizeof(*table));
+    if (!table)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    eb_arena_init(&table->values, VALUE_ARENA_CHUNK);
+    eb_arena_init(&table->strings, 0);
+    if (slots_alloc(&table->by_id.current, MAP_MIN_SLOTS) != EB_SUCCESS ||
+        slots_alloc(&table->by_text.current, MAP_MIN_SLOTS) != EB_SUCCESS ||
+        slots_alloc(&table->by_model.current, MAP_MIN_SLOTS) != EB_SUCCESS) {
+        eb_memory_table_destroy(table);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    *out = table;
+    return EB_SUCCESS;
+}
+
+void eb_memory_table_destroy(eb_memory_table_t* table) {
+    if (!table)
+        return;
+    free(table->ids);
+    free(table->parent_ids);
+    free(table->timestamps);
+    free(table->prev_rows);
+    free(table->model_ids);
+    free(table->embeddings);
+    free(table->metas);
+    free(table->metadata);
+    free(table->texts);
+    free(table->models);
+    eb_arena_destroy(&table->values);
+    eb_arena_destroy(&table->strings);
+    map_free(&table->by_id);
+    map_free(&table->by_text);
+    map_free(&table->by_model);
+    free(table);
+}
+
+size_t eb_memory_table_count(const eb_memory_table_t* table) {
+    return table ? table->count : 0;
+}
+
+static bool grow_column(void** column, size_t capacity, size_t size) {
+    void* grown = realloc(*column, capacity * size);
+    if (!grown)
+        return false;
+    *column = grown;
+    return true;
+}
+
+static eb_status_t reserve_rows(eb_memory_table_t* table) {
+    if (table->count < table->capacity)
+        return EB_SUCCESS;
+    if (table->count >= EB_MEMORY_NO_ROW)
+        return EB_ERROR_RESOURCE_EXHAUSTED;
+
+    size_t capacity = table->capacity ? table->capacity * 2 : TABLE_MIN_ROWS;
+    /* A column that grew stays grown, so a failure part way is harmless */
+    if (!grow_column((void**)&table->ids, capacity, sizeof(*table->ids)) ||
+        !grow_column((void**)&table->parent_ids, capacity, sizeof(*table->parent_ids)) ||
+        !grow_column((void**)&table->timestamps, capacity, sizeof(*table->timestamps)) ||
+        !grow_column((void**)&table->prev_rows, capacity, sizeof(*table->prev_rows)) ||
+        !grow_column((void**)&table->model_ids, capacity, sizeof(*table->model_ids)) ||
+        !grow_column((void**)&table->embeddings, capacity, sizeof(*table->embeddings)) ||
+        !grow_column((void**)&table->metas, capacity, sizeof(*table->metas)) ||
+        !grow_column((void**)&table->metadata, capacity, sizeof(*table->metadata)) ||
+        !grow_column((void**)&table->texts, capacity, sizeof(*table->texts)))
+        return EB_ERROR_MEMORY_ALLOCATION;
+    table->capacity = capacity;
+    return EB_SUCCESS;
+}
+
+static eb_status_t intern_model(eb_memory_table_t* table, const char* model, uint32_t* out) {
+    uint64_t key = hash_string(model);
+    uint32_t index = map_get(table, &table->by_model, key, model_name, model);
+    if (index != EB_MEMORY_NO_ROW) {
+        *out = index;
+        return EB_SUCCESS;
+    }
+
+    if (table->model_count == table->model_capacity) {
+        size_t capacity = table->model_capacity ? table->model_capacity * 2 : 8;
+        if (!grow_column((void**)&table->models, capacity, sizeof(*table->models)))
+            return EB_ERROR_MEMORY_ALLOCATION;
+        table->model_capacity = capacity;
+    }
+    const char* copy = eb_arena_strdup(&table->strings, model);
+    if (!copy)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    index = (uint32_t)table->model_count;
+    table->models[index] = copy;
+    eb_status_t status = map_put(table, &table->by_model, key, index, model_name, model);
+    if (status != EB_SUCCESS)
+        return status;
+    table->model_count++;
+    *out = index;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_memory_table_add(eb_memory_table_t* table, uint64_t id, uint64_t parent_id,
+                                const eb_embedding_t* embedding, const eb_metadata_t* metadata,
+                                const char* model, uint64_t timestamp, uint32_t* out_row) {
+    if (!table || !embedding || !embedding->values || !model)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_status_t status = reserve_rows(table);
+    if (status != EB_SUCCESS)
+        return status;
+    uint32_t model_id;
+    status = intern_model(table, model, &model_id);
+    if (status != EB_SUCCESS)
+        return status;
+
+    /* Arena memory of a failed add is only reclaimed with the table */
+    size_t dims = embedding->dimensions;
+    size_t padded = (dims + VALUE_PAD - 1) / VALUE_PAD * VALUE_PAD;
+    float* values = eb_arena_alloc(&table->values, padded * sizeof(float), VALUE_ALIGN);
+    eb_embedding_t* header = eb_arena_alloc(&table->strings, sizeof(*header),
+                                            _Alignof(eb_embedding_t));
+    if (!values || !header)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    memcpy(values, embedding->values, dims * sizeof(float));
+    memset(values + dims, 0, (padded - dims) * sizeof(float));
+    header->values = values;
+    header->dimensions = dims;
+    header->normalize = embedding->normalize;
+    header->norm = embedding->norm;
+
+    eb_meta_blob_t* meta = NULL;
+    eb_metadata_t* list = NULL;
+    if (metadata) {
+        meta = eb_meta_blob_from_list(&table->strings, metadata);
+        list = meta ? eb_meta_blob_list(&table->strings, meta) : NULL;
+        if (!list)
+            return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    const char* text = eb_meta_blob_get(meta, "text");
+
+    uint32_t row = (uint32_t)table->count;
+    table->ids[row] = id;
+    table->parent_ids[row] = parent_id;
+    table->timestamps[row] = timestamp;
+    table->prev_rows[row] = eb_memory_table_find(table, id);
+    table->model_ids[row] = model_id;
+    table->embeddings[row] = header;
+    table->metas[row] = meta;
+    table->metadata[row] = list;
+    table->texts[row] = text;
+
+    /* The row only counts once both maps point at it */
+    status = map_put(table, &table->by_id, mix64(id), row, NULL, NULL);
+    if (status == EB_SUCCESS && text)
+        status = map_put(table, &table->by_text, hash_string(text), row, text_of_row, text);
+    if (status != EB_SUCCESS)
+        return status;
+    table->count++;
+    if (out_row)
+        *out_row = row;
+    return EB_SUCCESS;
+}
+
+uint32_t eb_memory_table_find(const eb_memory_table_t* table, uint64_t id) {
+    if (!table)
+        return EB_MEMORY_NO_ROW;
+    return map_get(table, &table->by_id, mix64(id), NULL, NULL);
+}
+
+uint32_t eb_memory_table_find_text(const eb_memory_table_t* table, const char* text) {
+    if (!table || !text)
+        return EB_MEMORY_NO_ROW;
+    return map_get(table, &table->by_text, hash_string(text), text_of_row, text);
+}
+
+uint32_t eb_memory_table_prev(const eb_memory_table_t* table, uint32_t row) {
+    if (!table || row >= table->count)
+        return EB_MEMORY_NO_ROW;
+    return table->prev_rows[row];
+}
+
+void eb_memory_table_row(const eb_memory_table_t* table, uint32_t row, eb_stored_vector_t* out) {
+    out->id = table->ids[row];
+    out->embedding = table->embeddings[row];
+    out->metadata = table->metadata[row];
+    out->model_version = (char*)table->models[table->model_ids[row]];
+    out->timestamp = table->timestamps[row];
+    out->parent_id = table->parent_ids[row];
+    out->next = NULL;
+    out->meta = table->metas[row];
+    out->arena = NULL;
+}
+
+const uint64_t* eb_memory_table_ids(const eb_memory_table_t* table) {
+    return table->ids;
+}
+
+const uint64_t* eb_memory_table_parent_ids(const eb_memory_table_t* table) {
+    return table->parent_ids;
+}
+
+const uint64_t* eb_memory_table_timestamps(const eb_memory_table_t* table) {
+    return table->timestamps;
+}
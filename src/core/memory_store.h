@@ -0,0 +1,92 @@
+/*
+ * EmbeddingBridge - In-Memory Vector Table
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_MEMORY_STORE_H
+#define EB_MEMORY_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+#include "types.h"
+
+/*
+ * Rows of a ":memory:" store (eb_store_init_memory()).
+ *
+ * Rows are append-only and kept as columns: ids, parent ids, timestamps
+ * and the other fields each in their own array, so scans touch only the
+ * fields they need. Vector values live back to back in an arena, every
+ * row 64-byte aligned and padded to a multiple of 16 floats so SIMD loops
+ * need no tail handling; flat metadata (metadata.h), model names
+ * (interned) and embedding headers live in a second arena. Destroying the table frees a handful of
+ * chunks, not one allocation per row.
+ *
+ * Rows are found by id and by their "text" metadata through open
+ * addressing tables. When a table fills up it is doubled incrementally:
+ * each insertion moves a few slots of the old table over, so no single
+ * insertion pays for rehashing everything.
+ *
+ * Several rows may share an id (storing the same text again); a lookup
+ * by id returns the newest and eb_memory_table_prev() walks back.
+ *
+ * The table is not locked.
+ */
+
+#define EB_MEMORY_NO_ROW UINT32_MAX
+
+typedef struct eb_memory_table eb_memory_table_t;
+
+eb_status_t eb_memory_table_create(eb_memory_table_t** out);
+
+void eb_memory_table_destroy(eb_memory_table_t* table);
+
+size_t eb_memory_table_count(const eb_memory_table_t* table);
+
+/**
+ * Append a row
+ *
+ * The values and metadata are copied in.
+ *
+ * @param table Table to add to
+ * @param id Row id
+ * @param parent_id Id of the version it replaces, 0 if none
+ * @param embedding Values
+ * @param metadata Metadata list, may be NULL
+ * @param model Model version
+ * @param timestamp Storage time
+ * @param out_row Optional, receives the row number
+ * @return Status code
+ */
+eb_status_t eb_memory_table_add(eb_memory_table_t* table, uint64_t id, uint64_t parent_id,
+                                const eb_embedding_t* embedding, const eb_metadata_t* metadata,
+                                const char* model, uint64_t timestamp, uint32_t* out_row);
+
+/* Newest row with an id, EB_MEMORY_NO_ROW if none */
+uint32_t eb_memory_table_find(const eb_memory_table_t* table, uint64_t id);
+
+/* Newest row whose "text" metadata is text, EB_MEMORY_NO_ROW if none */
+uint32_t eb_memory_table_find_text(const eb_memory_table_t* table, const char* text);
+
+/* Previous row with the same id as row, EB_MEMORY_NO_ROW if none */
+uint32_t eb_memory_table_prev(const eb_memory_table_t* table, uint32_t row);
+
+/**
+ * View a row as a stored vector
+ *
+ * Everything out points to is owned by the table, model_version
+ * included, and stays valid until the table is destroyed.
+ */
+void eb_memory_table_row(const eb_memory_table_t* table, uint32_t row, eb_stored_vector_t* out);
+
+/* Columns for scans, eb_memory_table_count() entries each */
+const uint64_t* eb_memory_table_ids(const eb_memory_table_t* table);
+const uint64_t* eb_memory_table_parent_ids(const eb_memory_table_t* table);
+const uint64_t* eb_memory_table_timestamps(const eb_memory_table_t* table);
+
+#endif /* EB_MEMORY_STORE_H */
@@ -100,4 +100,82 @@ cleanup:
     free(m);
     if (f) fclose(f);
     return status;
-} 
\ No newline at end of file
+} 
+eb_meta_blob_t* eb_meta_blob_build(eb_arena_t* arena, const char* const* keys,
+                                   const char* const* values, size_t count) {
+    size_t header = sizeof(eb_meta_blob_t) + 2 * count * sizeof(uint32_t);
+    size_t size = header;
+    for (size_t i = 0; i < count; i++)
+        size += strlen(keys[i]) + strlen(values[i]) + 2;
+    if (size > UINT32_MAX)
+        return NULL;
+
+    eb_meta_blob_t* blob = arena ? eb_arena_alloc(arena, size, _Alignof(eb_meta_blob_t))
+                                 : malloc(size);
+    if (!blob)
+        return NULL;
+    blob->count = (uint32_t)count;
+    blob->size = (uint32_t)size;
+
+    char* base = (char*)blob;
+    size_t at = header;
+    for (size_t i = 0; i < count; i++) {
+        const char* strings[2] = { keys[i], values[i] };
+        for (int j = 0; j < 2; j++) {
+            size_t len = strlen(strings[j]) + 1;
+            blob->offsets[2 * i + j] = (uint32_t)at;
+            memcpy(base + at, strings[j], len);
+            at += len;
+        }
+    }
+    return blob;
+}
+
+eb_meta_blob_t* eb_meta_blob_from_list(eb_arena_t* arena, const eb_metadata_t* list) {
+    size_t count = 0;
+    for (const eb_metadata_t* m = list; m; m = m->next)
+        count++;
+
+    const char* stack_keys[16];
+    const char* stack_values[16];
+    const char** keys = count <= 16 ? stack_keys : malloc(count * sizeof(*keys));
+    const char** values = count <= 16 ? stack_values : malloc(count * sizeof(*values));
+    eb_meta_blob_t* blob = NULL;
+    if (keys && values) {
+        size_t i = 0;
+        for (const eb_metadata_t* m = list; m; m = m->next, i++) {
+            keys[i] = m->key;
+            values[i] = m->value;
+        }
+        blob = eb_meta_blob_build(arena, keys, values, count);
+    }
+    if (keys != stack_keys)
+        free(keys);
+    if (values != stack_values)
+        free(values);
+    return blob;
+}
+
+const char* eb_meta_blob_get(const eb_meta_blob_t* blob, const char* key) {
+    for (size_t i = 0; i < eb_meta_blob_count(blob); i++) {
+        if (strcmp(eb_meta_blob_key(blob, i), key) == 0)
+            return eb_meta_blob_value(blob, i);
+    }
+    return NULL;
+}
+
+eb_metadata_t* eb_meta_blob_list(eb_arena_t* arena, const eb_meta_blob_t* blob) {
+    size_t count = eb_meta_blob_count(blob);
+    if (!arena || count == 0)
+        return NULL;
+    eb_metadata_t* nodes = eb_arena_alloc(arena, count * sizeof(*nodes), _Alignof(eb_metadata_t));
+    if (!nodes)
+        return NULL;
+    for (size_t i = 0; i < count; i++) {
+        nodes[i].key = (char*)eb_meta_blob_key(blob, i);
+        nodes[i].value = (char*)eb_meta_blob_value(blob, i);
+        nodes[i].total_size = (uint32_t)(strlen(nodes[i].key) + strlen(nodes[i].value) + 2);
+        nodes[i].next = i + 1 < count ? &nodes[i + 1] : NULL;
+    }
+    return nodes;
+}
@@ -11,7 +11,9 @@
 #ifndef EB_METADATA_H
 #define EB_METADATA_H
 
+#include <stdint.h>
 #include "types.h"
+#include "arena.h"
 
 /* Simple key-value format:
  * source: file.txt
@@ -22,4 +24,58 @@
 eb_status_t eb_write_metadata(const char* path, const char* source, const char* model);
 eb_status_t eb_read_metadata(const char* path, char** source, char** model);
 
+/*
+ * Flat metadata: key/value pairs in one block, a table of string offsets
+ * followed by the NUL-terminated strings. Building one is a single
+ * allocation, from an arena when given one, and reading it follows no
+ * pointers. Query results (history, the memory store) keep metadata this
+ * way; eb_meta_blob_list() gives the eb_metadata_t view older callers
+ * walk.
+ */
+typedef struct eb_meta_blob {
+    uint32_t count;             /* Pairs */
+    uint32_t size;              /* Bytes, this header included */
+    uint32_t offsets[];         /* Key and value offset of each pair, from the blob start */
+} eb_meta_blob_t;
+
+/**
+ * Build a blob from parallel key and value arrays
+ *
+ * @param arena Arena to allocate from, NULL to malloc (release with free())
+ * @param keys Keys
+ * @param values Values
+ * @param count Number of pairs
+ * @return Blob, NULL if out of memory
+ */
+eb_meta_blob_t* eb_meta_blob_build(eb_arena_t* arena, const char* const* keys,
+                                   const char* const* values, size_t count);
+
+/* Build a blob holding the pairs of a metadata list, in order */
+eb_meta_blob_t* eb_meta_blob_from_list(eb_arena_t* arena, const eb_metadata_t* list);
+
+static inline size_t eb_meta_blob_count(const eb_meta_blob_t* blob) {
+    return blob ? blob->count : 0;
+}
+
+static inline const char* eb_meta_blob_key(const eb_meta_blob_t* blob, size_t i) {
+    return (const char*)blob + blob->offsets[2 * i];
+}
+
+static inline const char* eb_meta_blob_value(const eb_meta_blob_t* blob, size_t i) {
+    return (const char*)blob + blob->offsets[2 * i + 1];
+}
+
+/* Value of the first pair with key, NULL if there is none */
+const char* eb_meta_blob_get(const eb_meta_blob_t* blob, const char* key);
+
+/**
+ * Linked-list view of a blob
+ *
+ * The nodes come from arena and point at the blob's strings, which must
+ * outlive them; nothing in the view may be freed on its own.
+ *
+ * @return First node, NULL for an empty blob or if out of memory
+ */
+eb_metadata_t* eb_meta_blob_list(eb_arena_t* arena, const eb_meta_blob_t* blob);
+
 #endif /* EB_METADATA_H */ 
\ No newline at end of file
@@ -18,53 +18,29 @@
  */
 
 #include "types.h"
+#include "distance.h"
+#include "projection.h"
+#include "path_utils.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
-
-// Global comparison context for qsort
-static float* g_distances_a = NULL;
-static float* g_distances_b = NULL;
-
-// Comparison functions for qsort
-static int compare_distances_a(const void* a, const void* b) {
-    size_t idx_a = *(const size_t*)a;
-    size_t idx_b = *(const size_t*)b;
-    
-    if (g_distances_a[idx_a] < g_distances_a[idx_b]) return -1;
-    if (g_distances_a[idx_a] > g_distances_a[idx_b]) return 1;
-    return 0;
-}
-
-static int compare_distances_b(const void* a, const void* b) {
-    size_t idx_a = *(const size_t*)a;
-    size_t idx_b = *(const size_t*)b;
-    
-    if (g_distances_b[idx_a] < g_distances_b[idx_b]) return -1;
-    if (g_distances_b[idx_a] > g_distances_b[idx_b]) return 1;
-    return 0;
-}
+#include <stdbool.h>
 
 // Helper functions
 static float* get_float_data(const eb_embedding_t* embedding) {
     return embedding->values;
 }
 
-static double vector_dot_product(const float* a, const float* b, size_t dimensions) {
-    double sum = 0.0;
-    for (size_t i = 0; i < dimensions; i++) {
-        sum += (double)a[i] * (double)b[i];
-    }
-    return sum;
+static float compute_magnitude(const float* values, size_t dimensions) {
+    return sqrtf(eb_dot(values, values, dimensions));
 }
 
-static float compute_magnitude(const float* values, size_t dimensions) {
-    float sum = 0.0f;
-    for (size_t i = 0; i < dimensions; i++) {
-        sum += values[i] * values[i];
-    }
-    return sqrtf(sum);
+/* Dot product and squared norms, with cached norms taken as they are */
+static eb_cosine_terms_t embedding_cosine_terms(const eb_embedding_t* a, const eb_embedding_t* b) {
+    eb_vector_ref_t ref_a = { EB_FLOAT32, a->dimensions, 1.0f, a->values, a->norm };
+    eb_vector_ref_t ref_b = { EB_FLOAT32, b->dimensions, 1.0f, b->values, b->norm };
+    return eb_vector_cosine_terms(&ref_a, &ref_b);
 }
 
 static void normalize_vector(float* vector, size_t dimensions) {
@@ -76,75 +52,6 @@ static void normalize_vector(float* vector, size_t dimensions) {
     }
 }
 
-// New helper functions for neighborhood preservation
-static void compute_pairwise_distances(
-    const float* vectors,
-    size_t num_vectors,
-    size_t dimensions,
-    float* distances
-) {
-    for (size_t i = 0; i < num_vectors; i++) {
-        distances[i * num_vectors + i] = 0.0f;  // Distance to self is 0
-        for (size_t j = i + 1; j < num_vectors; j++) {
-            float sum_squared = 0.0f;
-            for (size_t d = 0; d < dimensions; d++) {
-                float diff = vectors[i * dimensions + d] - vectors[j * dimensions + d];
-                sum_squared += diff * diff;
-            }
-            float distance = sqrt(sum_squared);
-            distances[i * num_vectors + j] = distance;
-            distances[j * num_vectors + i] = distance;  // Matrix is symmetric
-        }
-    }
-}
-
-static void find_k_nearest(
-    const float* distances,
-    size_t num_vectors,
-    size_t k,
-    size_t vector_idx,
-    size_t* neighbors
-) {
-    // Create index array for sorting
-    size_t* indices = malloc(num_vectors * sizeof(size_t));
-    for (size_t i = 0; i < num_vectors; i++) {
-        indices[i] = i;
-    }
-
-    // Sort indices based on distances
-    const float* row = distances + (vector_idx * num_vectors);
-    for (size_t i = 0; i < k; i++) {
-        for (size_t j = i + 1; j < num_vectors; j++) {
-            if (row[indices[j]] < row[indices[i]]) {
-                size_t temp = indices[i];
-                indices[i] = indices[j];
-                indices[j] = temp;
-            }
-        }
-    }
-
-    // Copy k nearest neighbors (skip first as it's self)
-    memcpy(neighbors, indices + 1, k * sizeof(size_t));
-    free(indices);
-}
-
-static float compute_neighborhood_overlap(
-    const size_t* neighbors_a,
-    const size_t* neighbors_b,
-    size_t k
-) {
-    size_t overlap = 0;
-    for (size_t i = 0; i < k; i++) {
-        for (size_t j = 0; j < k; j++) {
-            if (neighbors_a[i] == neighbors_b[j]) {
-                overlap++;
-                break;
-            }
-        }
-    }
-    return (float)overlap / k;
-}
-
 // Core metric functions
 eb_status_t eb_compute_cosine_similarity(
     const eb_embedding_t* a,
@@ -155,19 +62,15 @@ eb_status_t eb_compute_cosine_similarity(
         return EB_ERROR_INVALID_INPUT;
     }
 
-    float dot_product = 0.0f;
-    for (size_t i = 0; i < a->dimensions; i++) {
-        dot_product += a->values[i] * b->values[i];
-    }
-
-    float mag_a = compute_magnitude(a->values, a->dimensions);
-    float mag_b = compute_magnitude(b->values, b->dimensions);
+    eb_cosine_terms_t terms = embedding_cosine_terms(a, b);
+    float mag_a = sqrtf(terms.norm_a);
+    float mag_b = sqrtf(terms.norm_b);
 
     if (mag_a < 1e-10f || mag_b < 1e-10f) {
         return EB_ERROR_COMPUTATION_FAILED;
     }
 
-    *result = dot_product / (mag_a * mag_b);
+    *result = terms.dot / (mag_a * mag_b);
     return EB_SUCCESS;
 }
 
@@ -180,100 +83,7 @@ eb_status_t eb_compute_euclidean_distance(
         return EB_ERROR_INVALID_INPUT;
     }
 
-    float sum = 0.0f;
-    for (size_t i = 0; i < a->dimensions; i++) {
-        float diff = a->values[i] - b->values[i];
-        sum += diff * diff;
-    }
-
-    *result = sqrtf(sum);
-    return EB_SUCCESS;
-}
-
-eb_status_t eb_compute_neighborhood_preservation(
-    const eb_embedding_t* old_vectors,
-    const eb_embedding_t* new_vectors,
-    size_t k,
-    float* out
-) {
-    if (!old_vectors || !new_vectors || !out || k == 0) {
-        return EB_ERROR_INVALID_INPUT;
-    }
-
-    // For embeddings with different dimensions, we can only compare their properties
-    if (old_vectors->dimensions != new_vectors->dimensions) {
-        // Return a preservation score based on the ratio of dimensions
-        // This assumes that larger models are more accurate
-        size_t min_dim = old_vectors->dimensions < new_vectors->dimensions ? 
-                        old_vectors->dimensions : new_vectors->dimensions;
-        size_t max_dim = old_vectors->dimensions > new_vectors->dimensions ? 
-                        old_vectors->dimensions : new_vectors->dimensions;
-        *out = (float)min_dim / max_dim;
-        return EB_SUCCESS;
-    }
-
-    // Get the values
-    const float* values_a = old_vectors->values;
-    const float* values_b = new_vectors->values;
-
-    // Compute distances and store indices
-    size_t n = old_vectors->dimensions;
-    float* distances_a = malloc(n * sizeof(float));
-    float* distances_b = malloc(n * sizeof(float));
-    size_t* indices_a = malloc(n * sizeof(size_t));
-    size_t* indices_b = malloc(n * sizeof(size_t));
-
-    if (!distances_a || !distances_b || !indices_a || !indices_b) {
-        free(distances_a);
-        free(distances_b);
-        free(indices_a);
-        free(indices_b);
-        return EB_ERROR_MEMORY_ALLOCATION;
-    }
-
-    // Initialize indices
-    for (size_t i = 0; i < n; i++) {
-        indices_a[i] = i;
-        indices_b[i] = i;
-    }
-
-    // Compute distances
-    for (size_t i = 0; i < n; i++) {
-        distances_a[i] = values_a[i] * values_a[i];
-        distances_b[i] = values_b[i] * values_b[i];
-    }
-
-    // Set global comparison contexts
-    g_distances_a = distances_a;
-    g_distances_b = distances_b;
-
-    // Sort indices by distance
-    qsort(indices_a, n, sizeof(size_t), compare_distances_a);
-    qsort(indices_b, n, sizeof(size_t), compare_distances_b);
-
-    // Clear global comparison contexts
-    g_distances_a = NULL;
-    g_distances_b = NULL;
-
-    // Count preserved neighbors
-    size_t preserved = 0;
-    for (size_t i = 0; i < k; i++) {
-        for (size_t j = 0; j < k; j++) {
-            if (indices_a[i] == indices_b[j]) {
-                preserved++;
-                break;
-            }
-        }
-    }
-
-    // Cleanup
-    free(distances_a);
-    free(distances_b);
-    free(indices_a);
-    free(indices_b);
-
-    // Compute preservation ratio
-    *out = (float)preserved / (float)k;
+    *result = sqrtf(eb_l2_squared(a->values, b->values, a->dimensions));
     return EB_SUCCESS;
 }
 
@@ -321,13 +131,6 @@ eb_status_t eb_compare_memory_versions(
     );
 }
 
-// Forward declare helper function for projection
-static eb_status_t eb_project_to_common_space(
-    const eb_embedding_t* a,
-    const eb_embedding_t* b,
-    eb_comparison_result_t* result
-);
-
 eb_status_t eb_compare_embeddings(
     const eb_embedding_t* embedding_a,
     const eb_embedding_t* embedding_b,
@@ -345,55 +148,63 @@ eb_status_t eb_compare_embeddings(
     eb_comparison_result_t* result = *out_result;
 
     // Compute cosine similarity
-    float dot_product = 0.0f;
-    float norm_a = 0.0f;
-    float norm_b = 0.0f;
-
-    for (size_t i = 0; i < embedding_a->dimensions; i++) {
-        dot_product += embedding_a->values[i] * embedding_b->values[i];
-        norm_a += embedding_a->values[i] * embedding_a->values[i];
-        norm_b += embedding_b->values[i] * embedding_b->values[i];
-    }
-
-    norm_a = sqrtf(norm_a);
-    norm_b = sqrtf(norm_b);
+    eb_cosine_terms_t terms = embedding_cosine_terms(embedding_a, embedding_b);
+    float norm_a = sqrtf(terms.norm_a);
+    float norm_b = sqrtf(terms.norm_b);
 
     if (norm_a < 1e-10f || norm_b < 1e-10f) {
         return EB_ERROR_COMPUTATION_FAILED;
     }
 
-    result->cosine_similarity = dot_product / (norm_a * norm_b);
+    result->cosine_similarity = terms.dot / (norm_a * norm_b);
 
     // Compute Euclidean distance
-    float sum_squared = 0.0f;
-    for (size_t i = 0; i < embedding_a->dimensions; i++) {
-        float diff = embedding_a->values[i] - embedding_b->values[i];
-        sum_squared += diff * diff;
+    result->euclidean_distance = sqrtf(eb_l2_squared(embedding_a->values, embedding_b->values,
+                                                     embedding_a->dimensions));
+
+    // A single pair has no neighborhood; set-level scores come from eb_knn_preservation()
+    (void)k_neighbors;
+
+    return EB_SUCCESS;
+}
+
+/*
+ * Compare two embeddings in the shared space of the projection fitted for
+ * their models (see projection.h)
+ */
+static eb_status_t eb_project_to_common_space(
+    const eb_projection_t* projection,
+    const eb_embedding_t* a,
+    const eb_embedding_t* b,
+    eb_comparison_result_t* result
+) {
+    if (eb_projection_input_dims(projection, EB_PROJECT_A) != a->dimensions ||
+        eb_projection_input_dims(projection, EB_PROJECT_B) != b->dimensions) {
+        return EB_ERROR_DIMENSION_MISMATCH;
     }
-    result->euclidean_distance = sqrtf(sum_squared);
 
-    // Compute neighborhood preservation if k_neighbors > 0
-    if (k_neighbors > 0) {
-        result->neighborhood_scores = malloc(sizeof(float));
-        if (!result->neighborhood_scores) {
-            return EB_ERROR_MEMORY_ALLOCATION;
-        }
-        result->neighborhood_count = 1;
-
-        float preservation;
-        eb_status_t status = eb_compute_neighborhood_preservation(
-            embedding_a, embedding_b, k_neighbors, &preservation);
-        
-        if (status != EB_SUCCESS) {
-            free(result->neighborhood_scores);
-            result->neighborhood_scores = NULL;
-            result->neighborhood_count = 0;
-            return status;
-        }
+    eb_projection_info_t info;
+    eb_projection_describe(projection, &info);
+    float* shared = malloc(2 * info.dims * sizeof(float));
+    if (!shared) {
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    eb_projection_apply(projection, EB_PROJECT_A, a->values, shared);
+    eb_projection_apply(projection, EB_PROJECT_B, b->values, shared + info.dims);
+
+    eb_cosine_terms_t terms = eb_cosine_terms(shared, shared + info.dims, info.dims);
+    float norm_a = sqrtf(terms.norm_a);
+    float norm_b = sqrtf(terms.norm_b);
+    float distance = sqrtf(eb_l2_squared(shared, shared + info.dims, info.dims));
+    free(shared);
 
-        result->neighborhood_scores[0] = preservation;
+    if (norm_a < 1e-10f || norm_b < 1e-10f) {
+        return EB_ERROR_COMPUTATION_FAILED;
     }
 
+    result->cosine_similarity = terms.dot / (norm_a * norm_b);
+    result->euclidean_distance = distance;
+    result->method_used = EB_COMPARE_PROJECTION;
     return EB_SUCCESS;
 }
 
@@ -410,49 +221,36 @@ eb_status_t eb_compare_embeddings_cross_model(
         return EB_ERROR_INVALID_INPUT;
     }
 
-    // For now, just use regular comparison if dimensions match
-    if (embedding_a->dimensions == embedding_b->dimensions) {
-        return eb_compare_embeddings(embedding_a, embedding_b, 0, out_result);
+    // Projections are the only cross-model method; a fitted one is used when it exists
+    (void)preferred_method;
+    const eb_projection_t* projection = NULL;
+    if (strcmp(model_version_a, model_version_b) != 0) {
+        char* root = find_repo_root(".");
+        if (root) {
+            eb_projection_get(root, model_version_a, model_version_b, &projection);
+            free(root);
+        }
+    }
+    if (!projection && embedding_a->dimensions != embedding_b->dimensions) {
+        return EB_ERROR_DIMENSION_MISMATCH;
     }
 
-    // If dimensions don't match, return error for now
-    // TODO: Implement proper cross-model comparison
-    return EB_ERROR_DIMENSION_MISMATCH;
-}
-
-// Helper function implementation
-static eb_status_t eb_project_to_common_space(
-    const eb_embedding_t* a,
-    const eb_embedding_t* b,
-    eb_comparison_result_t* result
-) {
-    // TODO: Implement proper projection method
-    // For now, just compare the overlapping dimensions
-    size_t min_dim = a->dimensions < b->dimensions ? a->dimensions : b->dimensions;
-    const float* data_a = (const float*)a->values;
-    const float* data_b = (const float*)b->values;
-    
-    float dot_product = 0.0f;
-    float norm_a = 0.0f;
-    float norm_b = 0.0f;
-    
-    for (size_t i = 0; i < min_dim; i++) {
-        dot_product += data_a[i] * data_b[i];
-        norm_a += data_a[i] * data_a[i];
-        norm_b += data_b[i] * data_b[i];
+    bool allocated = !*out_result;
+    if (allocated) {
+        *out_result = calloc(1, sizeof(eb_comparison_result_t));
+        if (!*out_result) {
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
     }
-    
-    norm_a = sqrt(norm_a);
-    norm_b = sqrt(norm_b);
-    
-    if (norm_a == 0.0f || norm_b == 0.0f) {
-        return EB_ERROR_COMPUTATION_FAILED;
+
+    eb_status_t status = projection
+        ? eb_project_to_common_space(projection, embedding_a, embedding_b, *out_result)
+        : eb_compare_embeddings(embedding_a, embedding_b, 0, out_result);
+    if (status != EB_SUCCESS && allocated) {
+        free(*out_result);
+        *out_result = NULL;
     }
-    
-    result->cosine_similarity = dot_product / (norm_a * norm_b);
-    result->euclidean_distance = sqrt(2.0f * (1.0f - result->cosine_similarity));
-    
-    return EB_SUCCESS;
+    return status;
 }
 
 void eb_destroy_comparison_result(eb_comparison_result_t* result) {
@@ -0,0 +1,273 @@
+/*
+ * EmbeddingBridge - k-NN Neighborhood Preservation Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include "neighborhood.h"
+#include "distance.h"
+#include "thread_pool.h"
+
+/* Queries searched together against each candidate tile */
+#define QUERY_BLOCK 32
+
+/* Candidate rows per tile are chosen so the tile fits in L2 */
+#define TILE_BYTES    (256 * 1024)
+#define TILE_MIN_ROWS 16
+#define TILE_MAX_ROWS 1024
+
+typedef struct {
+    float dist;
+    size_t index;
+} neighbor_t;
+
+/* Bounded max-heap of the k best candidates; items[0] is the worst of them */
+typedef struct {
+    neighbor_t* items;
+    size_t size;
+    size_t k;
+} knn_heap_t;
+
+/* Squared norms, or inverse norms for cosine, of every row */
+typedef struct {
+    const eb_matrix_t* matrix;
+    float* norms;
+    size_t tile_rows;
+} knn_space_t;
+
+static bool worse(const neighbor_t* a, const neighbor_t* b) {
+    return a->dist > b->dist || (a->dist == b->dist && a->index > b->index);
+}
+
+static void heap_push(knn_heap_t* heap, float dist, size_t index) {
+    neighbor_t n = { dist, index };
+    size_t i;
+
+    if (heap->size < heap->k) {
+        for (i = heap->size++; i > 0; ) {
+            size_t parent = (i - 1) / 2;
+            if (!worse(&n, &heap->items[parent]))
+                break;
+            heap->items[i] = heap->items[parent];
+            i = parent;
+        }
+        heap->items[i] = n;
+        return;
+    }
+
+    if (!worse(&heap->items[0], &n))
+        return;
+    for (i = 0; ; ) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->size)
+            break;
+        if (child + 1 < heap->size && worse(&heap->items[child + 1], &heap->items[child]))
+            child++;
+        if (!worse(&heap->items[child], &n))
+            break;
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    heap->items[i] = n;
+}
+
+static eb_status_t space_init(knn_space_t* space, const eb_matrix_t* matrix, size_t count,
+                              eb_knn_metric_t metric) {
+    space->matrix = matrix;
+    space->norms = malloc(count * sizeof(float));
+    if (!space->norms)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    for (size_t i = 0; i < count; i++) {
+        const float* row = matrix->values + i * matrix->dims;
+        float norm = eb_dot(row, row, matrix->dims);
+        if (metric == EB_KNN_COSINE)
+            norm = norm > 0.0f ? 1.0f / sqrtf(norm) : 0.0f;
+        space->norms[i] = norm;
+    }
+
+    size_t rows = TILE_BYTES / (matrix->dims * sizeof(float));
+    space->tile_rows = rows < TILE_MIN_ROWS ? TILE_MIN_ROWS : rows > TILE_MAX_ROWS ? TILE_MAX_ROWS : rows;
+    return EB_SUCCESS;
+}
+
+/*
+ * Fill heaps[0..rows) with the k nearest neighbors of queries first..first+rows.
+ * Each candidate tile is loaded once per query block; its dot products go to
+ * the tile buffer first so the loop over the tile reads the rows back to back.
+ */
+static void search_block(const knn_space_t* space, size_t count, eb_knn_metric_t metric,
+                         size_t first, size_t rows, float* tile, knn_heap_t* heaps) {
+    const float* values = space->matrix->values;
+    size_t dims = space->matrix->dims;
+
+    for (size_t q = 0; q < rows; q++)
+        heaps[q].size = 0;
+
+    for (size_t start = 0; start < count; start += space->tile_rows) {
+        size_t tile_count = count - start < space->tile_rows ? count - start : space->tile_rows;
+
+        for (size_t q = 0; q < rows; q++) {
+            const float* query = values + (first + q) * dims;
+            for (size_t c = 0; c < tile_count; c++)
+                tile[q * tile_count + c] = eb_dot(query, values + (start + c) * dims, dims);
+        }
+
+        for (size_t q = 0; q < rows; q++) {
+            size_t query = first + q;
+            float query_norm = space->norms[query];
+            for (size_t c = 0; c < tile_count; c++) {
+                size_t candidate = start + c;
+                if (candidate == query)
+                    continue;
+                float dot = tile[q * tile_count + c];
+                float dist;
+                if (metric == EB_KNN_COSINE) {
+                    dist = 1.0f - dot * query_norm * space->norms[candidate];
+                } else {
+                    dist = query_norm + space->norms[candidate] - 2.0f * dot;
+                    if (dist < 0.0f)
+                        dist = 0.0f;
+                }
+                if (isnan(dist))
+                    dist = INFINITY;
+                heap_push(&heaps[q], dist, candidate);
+            }
+        }
+    }
+}
+
+static int compare_indices(const void* a, const void* b) {
+    size_t x = *(const size_t*)a;
+    size_t y = *(const size_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Fraction of neighbors two heaps of size k have in common */
+static float overlap(const knn_heap_t* a, const knn_heap_t* b, size_t* scratch_a, size_t* scratch_b) {
+    size_t k = a->size;
+    for (size_t i = 0; i < k; i++) {
+        scratch_a[i] = a->items[i].index;
+        scratch_b[i] = b->items[i].index;
+    }
+    qsort(scratch_a, k, sizeof(size_t), compare_indices);
+    qsort(scratch_b, k, sizeof(size_t), compare_indices);
+
+    size_t shared = 0;
+    for (size_t i = 0, j = 0; i < k && j < k; ) {
+        if (scratch_a[i] == scratch_b[j]) {
+            shared++;
+            i++;
+            j++;
+        } else if (scratch_a[i] < scratch_b[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return (float)shared / (float)k;
+}
+
+/* State shared by the workers of one call; only next_block is written */
+typedef struct {
+    const knn_space_t* old_space;
+    const knn_space_t* new_space;
+    size_t count;
+    size_t k;
+    eb_knn_metric_t metric;
+    size_t tile_rows;
+    float* scores;
+    size_t next_block;
+} knn_job_t;
+
+/* Claim query blocks until none are left; a worker that cannot allocate leaves them to the others */
+static void knn_worker(void* arg) {
+    knn_job_t* job = arg;
+    size_t k = job->k;
+    float* tile = malloc(QUERY_BLOCK * job->tile_rows * sizeof(float));
+    neighbor_t* items = malloc(2 * QUERY_BLOCK * k * sizeof(neighbor_t));
+    size_t* scratch = malloc(2 * k * sizeof(size_t));
+    if (!tile || !items || !scratch)
+        goto done;
+
+    knn_heap_t old_heaps[QUERY_BLOCK], new_heaps[QUERY_BLOCK];
+    for (size_t q = 0; q < QUERY_BLOCK; q++) {
+        old_heaps[q] = (knn_heap_t){ items + q * k, 0, k };
+        new_heaps[q] = (knn_heap_t){ items + (QUERY_BLOCK + q) * k, 0, k };
+    }
+
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * QUERY_BLOCK;
+        if (first >= job->count)
+            break;
+        size_t rows = job->count - first < QUERY_BLOCK ? job->count - first : QUERY_BLOCK;
+        search_block(job->old_space, job->count, job->metric, first, rows, tile, old_heaps);
+        search_block(job->new_space, job->count, job->metric, first, rows, tile, new_heaps);
+        for (size_t q = 0; q < rows; q++)
+            job->scores[first + q] = overlap(&old_heaps[q], &new_heaps[q], scratch, scratch + k);
+    }
+
+done:
+    free(scratch);
+    free(items);
+    free(tile);
+}
+
+eb_status_t eb_knn_preservation(const eb_matrix_t* old_set, const eb_matrix_t* new_set,
+                                size_t count, const eb_knn_options_t* options,
+                                float* scores, float* mean) {
+    if (!old_set || !new_set || !options || !old_set->values || !new_set->values ||
+        old_set->dims == 0 || new_set->dims == 0 || options->k == 0 || options->k >= count ||
+        (options->metric != EB_KNN_COSINE && options->metric != EB_KNN_L2))
+        return EB_ERROR_INVALID_INPUT;
+
+    knn_space_t old_space = { 0 }, new_space = { 0 };
+    eb_status_t status = space_init(&old_space, old_set, count, options->metric);
+    if (status == EB_SUCCESS)
+        status = space_init(&new_space, new_set, count, options->metric);
+
+    // Scores are always collected so the mean is summed in a fixed order
+    float* all_scores = scores ? scores : malloc(count * sizeof(float));
+    if (status == EB_SUCCESS && !all_scores)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    if (status == EB_SUCCESS) {
+        knn_job_t job = {
+            .old_space = &old_space,
+            .new_space = &new_space,
+            .count = count,
+            .k = options->k,
+            .metric = options->metric,
+            .tile_rows = old_space.tile_rows > new_space.tile_rows ? old_space.tile_rows : new_space.tile_rows,
+            .scores = all_scores,
+        };
+
+        // The calling thread works too, so a busy pool only costs speed
+        eb_parallel_run(NULL, eb_pool_threads(options->threads, (count + QUERY_BLOCK - 1) / QUERY_BLOCK),
+                        knn_worker, &job);
+
+        // Blocks are only left over if no worker could allocate its buffers
+        if (job.next_block * QUERY_BLOCK < count) {
+            status = EB_ERROR_MEMORY_ALLOCATION;
+        } else if (mean) {
+            double total = 0.0;
+            for (size_t i = 0; i < count; i++)
+                total += all_scores[i];
+            *mean = (float)(total / (double)count);
+        }
+    }
+
+    if (all_scores != scores)
+        free(all_scores);
+    free(new_space.norms);
+    free(old_space.norms);
+    return status;
+}
@@ -0,0 +1,69 @@
+/*
+ * EmbeddingBridge - k-NN Neighborhood Preservation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_NEIGHBORHOOD_H
+#define EB_NEIGHBORHOOD_H
+
+#include <stddef.h>
+#include "status.h"
+
+/*
+ * Measures how well a model migration keeps the local structure of a set
+ * of documents: item i scores |kNN_old(i) ∩ kNN_new(i)| / k, where the
+ * neighbor lists are computed within the old and the new vectors of the
+ * same documents. The two models may have different dimensions.
+ *
+ * Distances are computed in tiles, a block of query rows against a block
+ * of candidate rows sized to stay in cache, from the dot products and the
+ * row norms (|q|^2 + |c|^2 - 2 q.c for L2). Each query keeps a bounded
+ * max-heap of its k best candidates, so memory grows with the tile and
+ * block sizes and with k, never with count^2.
+ *
+ * Query blocks are handed out to worker threads as they finish. Workers
+ * only share the read-only inputs, so calls from several threads at once
+ * are safe.
+ */
+
+typedef enum {
+    EB_KNN_COSINE = 0,      /* 1 - cos(q, c); zero vectors are at distance 1 */
+    EB_KNN_L2               /* Squared Euclidean distance */
+} eb_knn_metric_t;
+
+typedef struct {
+    size_t k;                   /* Neighbors per item, must be less than count */
+    eb_knn_metric_t metric;     /* Distance used in both spaces */
+    unsigned threads;           /* Worker threads, 0 for one per online CPU */
+} eb_knn_options_t;
+
+/* Row-major matrix of count vectors, dims values each */
+typedef struct {
+    const float* values;
+    size_t dims;
+} eb_matrix_t;
+
+/**
+ * Compute per-item k-NN overlap between two embeddings of the same set
+ *
+ * Row i of both matrices must embed the same document. An item is never
+ * its own neighbor; candidates at equal distance are ordered by index.
+ *
+ * @param old_set Vectors from the old model
+ * @param new_set Vectors from the new model
+ * @param count Number of rows in both matrices
+ * @param options Neighbor count, metric and parallelism
+ * @param scores Optional array of count per-item scores in [0, 1]
+ * @param mean Optional mean of the per-item scores
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_knn_preservation(const eb_matrix_t* old_set, const eb_matrix_t* new_set,
+                                size_t count, const eb_knn_options_t* options,
+                                float* scores, float* mean);
+
+#endif /* EB_NEIGHBORHOOD_H */
@@ -0,0 +1,75 @@
+/*
+ * EmbeddingBridge - Delta Objects
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_OBJECT_DELTA_H
+#define EB_OBJECT_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * Re-embedding a file with a slightly changed model gives a vector close
+ * to the previous one: most sign and exponent bytes match. With
+ * storage.delta on, a new vector is stored as the XOR of its bytes with
+ * the version the set held for the same file and model, if that
+ * compresses smaller than the vector itself:
+ *
+ *   header (EB_FLAG_DELTA) | eb_delta_header_t | zstd(residual) | [norm]
+ *
+ * The object header keeps the hash and size of the full vector, so a
+ * delta is addressed, verified and read like any other object;
+ * eb_object_map() rebuilds it from its base. Chains are capped at
+ * EB_DELTA_MAX_DEPTH: the next version is stored in full, a keyframe the
+ * chain starts again from.
+ *
+ * Each delta written is also appended to .embr/deltas as
+ * "<hash> <base>", so gc keeps the bases of the deltas it keeps.
+ * Deltas never leave the repository: pushes send rebuilt full records.
+ */
+
+#define EB_DELTA_FILE      ".embr/deltas"
+#define EB_DELTA_MAX_DEPTH 8    /* Deltas in a row before a keyframe */
+
+typedef struct {
+    uint8_t base[32];           /* Hash of the object the residual applies to */
+    uint32_t depth;             /* 1 on a full object, one more per delta below */
+    uint32_t reserved;
+} eb_delta_header_t;
+
+/**
+ * XOR two buffers: dst[i] = a[i] ^ b[i]
+ *
+ * dst may be a.
+ */
+void eb_delta_xor(void* dst, const void* a, const void* b, size_t size);
+
+/**
+ * Record that an object is a delta against base
+ *
+ * @param root Repository root
+ * @param hash Delta object hash
+ * @param base Base object hash
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_delta_record(const char* root, const char* hash, const char* base);
+
+/* Visitor for eb_delta_foreach(), a non-zero return stops the walk */
+typedef int (*eb_delta_visit_fn)(const char* hash, const char* base, void* ctx);
+
+/**
+ * Visit every recorded delta, oldest first
+ *
+ * @param root Repository root
+ * @return Status code (0 = success, also when none were recorded)
+ */
+eb_status_t eb_delta_foreach(const char* root, eb_delta_visit_fn fn, void* ctx);
+
+#endif /* EB_OBJECT_DELTA_H */
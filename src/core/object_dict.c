@@ -0,0 +1,327 @@
+/*
+ * EmbeddingBridge - Object Compression Dictionaries Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "object_dict.h"
+#include "object_path.h"
+#include "pack.h"
+#include "store.h"
+#include "types.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Loaded dictionaries; entries are immutable and live until exit */
+struct dict_cache_entry {
+    char root[PATH_MAX];
+    uint32_t id;
+    eb_zstd_dict_t* dict;
+    struct dict_cache_entry* next;
+};
+
+static pthread_mutex_t dict_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct dict_cache_entry* dict_cache = NULL;
+
+static void dict_path(const char* root, uint32_t id, char* path, size_t size) {
+    snprintf(path, size, "%s/.embr/" EB_DICT_DIR "/%u" EB_DICT_SUFFIX, root, id);
+}
+
+static eb_status_t load_dict(const char* root, uint32_t id, eb_zstd_dict_t** out) {
+    char path[PATH_MAX];
+    dict_path(root, id, path, sizeof(path));
+
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+        fclose(f);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    size_t size = (size_t)st.st_size;
+    void* content = malloc(size);
+    if (!content) {
+        fclose(f);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    bool ok = fread(content, 1, size, f) == size;
+    fclose(f);
+
+    eb_status_t status = ok ? eb_zstd_dict_create(content, size, out) : EB_ERROR_FILE_IO;
+    free(content);
+    return status;
+}
+
+eb_status_t eb_object_dict_get(const char* root, uint32_t id, eb_zstd_dict_t** out) {
+    if (!root || id == 0 || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    pthread_mutex_lock(&dict_cache_mutex);
+    for (struct dict_cache_entry* e = dict_cache; e; e = e->next) {
+        if (e->id == id && strcmp(e->root, root) == 0) {
+            *out = e->dict;
+            pthread_mutex_unlock(&dict_cache_mutex);
+            return EB_SUCCESS;
+        }
+    }
+
+    struct dict_cache_entry* entry = calloc(1, sizeof(*entry));
+    if (!entry) {
+        pthread_mutex_unlock(&dict_cache_mutex);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    eb_status_t status = load_dict(root, id, &entry->dict);
+    if (status != EB_SUCCESS) {
+        pthread_mutex_unlock(&dict_cache_mutex);
+        free(entry);
+        DEBUG_ERROR("object_dict: cannot load dictionary %u: %d", id, status);
+        return status;
+    }
+    snprintf(entry->root, sizeof(entry->root), "%s", root);
+    entry->id = id;
+    entry->next = dict_cache;
+    dict_cache = entry;
+    *out = entry->dict;
+    pthread_mutex_unlock(&dict_cache_mutex);
+    return EB_SUCCESS;
+}
+
+/* Object hashes found in the loose store and in packs */
+struct hash_list {
+    char (*hashes)[65];
+    size_t count;
+    size_t capacity;
+    bool failed;
+};
+
+static int add_hash(struct hash_list* list, const char* hex_hash) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        char (*grown)[65] = realloc(list->hashes, capacity * sizeof(*grown));
+        if (!grown) {
+            list->failed = true;
+            return 1;
+        }
+        list->hashes = grown;
+        list->capacity = capacity;
+    }
+    memcpy(list->hashes[list->count], hex_hash, 64);
+    list->hashes[list->count][64] = '\0';
+    list->count++;
+    return 0;
+}
+
+static int collect_loose(const char* hex_hash, const char* ext, const char* path,
+                         const struct stat* st, void* ctx) {
+    (void)path;
+    (void)st;
+    if (strcmp(ext, "raw") != 0 && ext[0] != '\0')
+        return 0;
+    return add_hash(ctx, hex_hash);
+}
+
+static int collect_packed(const char* hex_hash, uint64_t length, time_t mtime, void* ctx) {
+    (void)length;
+    (void)mtime;
+    return add_hash(ctx, hex_hash);
+}
+
+static int compare_hashes(const void* a, const void* b) {
+    return strcmp(a, b);
+}
+
+static eb_status_t collect_hashes(const char* root, struct hash_list* list) {
+    eb_status_t status = eb_object_foreach(root, collect_loose, list);
+    if (status != EB_SUCCESS)
+        return status;
+
+    eb_pack_set_t* packs = NULL;
+    if (eb_pack_open(root, &packs) == EB_SUCCESS) {
+        status = eb_pack_foreach(packs, collect_packed, list);
+        eb_pack_close(packs);
+        if (status != EB_SUCCESS)
+            return status;
+    }
+    if (list->failed)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    /* An object may be both loose and packed */
+    qsort(list->hashes, list->count, sizeof(*list->hashes), compare_hashes);
+    size_t unique = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (unique == 0 || strcmp(list->hashes[i], list->hashes[unique - 1]) != 0)
+            memmove(list->hashes[unique++], list->hashes[i], sizeof(*list->hashes));
+    }
+    list->count = unique;
+    return EB_SUCCESS;
+}
+
+/* Decoded vectors stored back to back, as ZDICT expects them */
+struct sample_set {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    size_t* sizes;
+    unsigned count;
+};
+
+static eb_status_t add_sample(struct sample_set* set, const void* data, size_t size) {
+    if (set->size + size > set->capacity) {
+        size_t capacity = set->capacity ? set->capacity : 64 * 1024;
+        while (capacity < set->size + size)
+            capacity *= 2;
+        uint8_t* grown = realloc(set->data, capacity);
+        if (!grown)
+            return EB_ERROR_MEMORY_ALLOCATION;
+        set->data = grown;
+        set->capacity = capacity;
+    }
+    memcpy(set->data + set->size, data, size);
+    set->size += size;
+    set->sizes[set->count++] = size;
+    return EB_SUCCESS;
+}
+
+static eb_status_t sample_vectors(const char* root, const struct hash_list* list,
+                                  size_t max_samples, struct sample_set* set) {
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = (char*)root };
+    eb_status_t status = eb_store_init(&config, &store);
+    if (status != EB_SUCCESS)
+        return status;
+
+    set->sizes = malloc((max_samples ? max_samples : 1) * sizeof(*set->sizes));
+    if (!set->sizes) {
+        eb_store_destroy(store);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* Spread the samples evenly over the hash space */
+    double stride = list->count > max_samples ? (double)list->count / (double)max_samples : 1.0;
+    for (double pos = 0; (size_t)pos < list->count && set->count < max_samples; pos += stride) {
+        const char* hash = list->hashes[(size_t)pos];
+        eb_object_view_t view;
+        if (eb_object_map(store, hash, 0, &view) != EB_SUCCESS) {
+            DEBUG_WARN("object_dict: skipping unreadable object %s", hash);
+            continue;
+        }
+        if (view.header.obj_type == EB_OBJ_VECTOR && view.size > 0)
+            status = add_sample(set, view.data, view.size);
+        eb_object_unmap(&view);
+        if (status != EB_SUCCESS)
+            break;
+    }
+
+    eb_store_destroy(store);
+    return status;
+}
+
+/* One past the highest dictionary ID in use */
+static eb_status_t next_dict_id(const char* root, uint32_t* out) {
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s/.embr/" EB_DICT_DIR, root);
+
+    unsigned long highest = 0;
+    DIR* dir = opendir(dir_path);
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            char* end = NULL;
+            unsigned long id = strtoul(entry->d_name, &end, 10);
+            if (end != entry->d_name && strcmp(end, EB_DICT_SUFFIX) == 0 && id > highest)
+                highest = id;
+        }
+        closedir(dir);
+    }
+
+    if (highest >= EB_DICT_ID_MAX)
+        return EB_ERROR_LIMIT_EXCEEDED;
+    *out = (uint32_t)highest + 1;
+    return EB_SUCCESS;
+}
+
+static eb_status_t write_dict(const char* root, uint32_t id, const void* content, size_t size) {
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s/.embr/" EB_DICT_DIR, root);
+    if (mkdir(dir_path, 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    dict_path(root, id, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+    bool ok = fwrite(content, 1, size, f) == size;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_object_dict_train(const char* root, const eb_dict_train_options_t* options,
+                                 eb_dict_train_result_t* result) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+
+    size_t max_samples = options && options->max_samples ? options->max_samples : EB_DICT_DEFAULT_SAMPLES;
+    size_t capacity = options && options->capacity ? options->capacity : EB_DICT_DEFAULT_CAPACITY;
+    if (max_samples < EB_DICT_MIN_SAMPLES)
+        max_samples = EB_DICT_MIN_SAMPLES;
+
+    struct hash_list list = { NULL, 0, 0, false };
+    struct sample_set set = { NULL, 0, 0, NULL, 0 };
+    void* dict = NULL;
+    size_t dict_size = 0;
+    uint32_t id = 0;
+
+    eb_status_t status = collect_hashes(root, &list);
+    if (status == EB_SUCCESS)
+        status = sample_vectors(root, &list, max_samples, &set);
+    if (status == EB_SUCCESS && set.count < EB_DICT_MIN_SAMPLES) {
+        DEBUG_WARN("object_dict: only %u vectors to train on, need %d", set.count, EB_DICT_MIN_SAMPLES);
+        status = EB_ERROR_NOT_FOUND;
+    }
+    if (status == EB_SUCCESS)
+        status = eb_zstd_train_dict(set.data, set.sizes, set.count, capacity, &dict, &dict_size);
+    if (status == EB_SUCCESS)
+        status = next_dict_id(root, &id);
+    if (status == EB_SUCCESS)
+        status = write_dict(root, id, dict, dict_size);
+    if (status == EB_SUCCESS)
+        status = eb_object_set_dictionary(root, id);
+
+    if (status == EB_SUCCESS && result) {
+        result->id = id;
+        result->samples = set.count;
+        result->dict_size = dict_size;
+    }
+
+    free(dict);
+    free(set.data);
+    free(set.sizes);
+    free(list.hashes);
+    return status;
+}
@@ -0,0 +1,74 @@
+/*
+ * EmbeddingBridge - Object Compression Dictionaries
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_OBJECT_DICT_H
+#define EB_OBJECT_DICT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+#include "compress.h"
+
+/*
+ * Dictionaries live in .embr/dicts/<id>.zdict and are never changed once
+ * written. New vector objects are compressed against the dictionary named
+ * by storage.dictionary in .embr/config; each object records the ID it
+ * used in its header flags (EB_FLAG_DICT_ID), so objects written under an
+ * older dictionary stay readable after retraining.
+ */
+
+#define EB_DICT_DIR    "dicts"
+#define EB_DICT_SUFFIX ".zdict"
+
+/* Defaults for eb_object_dict_train() */
+#define EB_DICT_DEFAULT_SAMPLES  2048
+#define EB_DICT_DEFAULT_CAPACITY (64 * 1024)
+#define EB_DICT_MIN_SAMPLES      8
+
+typedef struct {
+    size_t max_samples;     /* Objects to sample, 0 for EB_DICT_DEFAULT_SAMPLES */
+    size_t capacity;        /* Maximum dictionary size, 0 for EB_DICT_DEFAULT_CAPACITY */
+} eb_dict_train_options_t;
+
+typedef struct {
+    uint32_t id;            /* ID of the new dictionary */
+    size_t samples;         /* Vector objects it was trained on */
+    size_t dict_size;       /* Size of the dictionary in bytes */
+} eb_dict_train_result_t;
+
+/**
+ * Load a dictionary of a repository
+ *
+ * Dictionaries are cached for the lifetime of the process; the returned
+ * pointer must not be freed.
+ *
+ * @param root Repository root (directory containing .embr)
+ * @param id Dictionary ID from an object header
+ * @param out Receives the dictionary
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if there is no such dictionary)
+ */
+eb_status_t eb_object_dict_get(const char* root, uint32_t id, eb_zstd_dict_t** out);
+
+/**
+ * Train a dictionary from stored vectors and make it the current one
+ *
+ * Samples loose and packed vector objects evenly, writes the dictionary
+ * under the next free ID and records it as storage.dictionary. Existing
+ * objects are left as they are.
+ *
+ * @param root Repository root
+ * @param options Optional training options, NULL for defaults
+ * @param result Optional training statistics
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if there are too few vectors)
+ */
+eb_status_t eb_object_dict_train(const char* root, const eb_dict_train_options_t* options,
+                                 eb_dict_train_result_t* result);
+
+#endif /* EB_OBJECT_DICT_H */
@@ -0,0 +1,766 @@
+/*
+ * EmbeddingBridge - Loose Object Paths Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "object_path.h"
+#include "hash_utils.h"
+#include "types.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define LAYOUT_SECTION  "[storage]"
+#define LAYOUT_KEY      "layout"
+#define COMPRESSION_KEY "compression"
+#define LEVEL_KEY       "compression_level"
+#define MIN_LEVEL_KEY   "compression_min_level"
+#define MAX_LEVEL_KEY   "compression_max_level"
+#define TARGET_KEY      "compression_target"
+#define ARCHIVE_KEY     "archive_level"
+#define DICTIONARY_KEY  "dictionary"
+#define FILTER_KEY      "filter"
+#define CACHE_KEY       "remote_cache_size"
+#define DELTA_KEY       "delta"
+#define DURABILITY_KEY  "durability"
+#define HASH_KEY        "object_hash"
+#define PREFETCH_KEY    "prefetch_window"
+#define CORE_SECTION    "[core]"
+#define THREADS_KEY     "threads"
+
+/* Compression level when storage.compression_level is not set */
+#define DEFAULT_COMPRESSION_LEVEL 9
+
+/* Bounds of storage.compression = auto when they are not set */
+#define DEFAULT_MIN_LEVEL 1
+#define DEFAULT_MAX_LEVEL 19
+#define DEFAULT_COMPRESSION_TARGET (64ULL * 1024 * 1024)
+
+/* Bound of .embr/cache/remote when storage.remote_cache_size is not set */
+#define DEFAULT_REMOTE_CACHE_SIZE (1024ULL * 1024 * 1024)
+
+/* Remote objects fetched ahead of a walk when storage.prefetch_window is not set */
+#define DEFAULT_PREFETCH_WINDOW 32
+#define MAX_PREFETCH_WINDOW 4096
+
+typedef struct {
+    eb_object_layout_t layout;
+    bool compression;
+    bool compression_auto;        /* storage.compression = auto */
+    int level;
+    eb_compress_bounds_t bounds;
+    int archive_level;            /* 0 to pack records as they are */
+    uint32_t dictionary;
+    bool shuffle;
+    uint64_t remote_cache_size;
+    bool delta;
+    eb_durability_t durability;
+    eb_hash_algo_t hash;
+    unsigned prefetch_window;     /* 0 to fetch remote objects one by one */
+    unsigned threads;             /* core.threads, 0 if unset */
+} storage_settings_t;
+
+static const storage_settings_t default_settings = {
+    EB_LAYOUT_FLAT, true, false, DEFAULT_COMPRESSION_LEVEL,
+    { DEFAULT_MIN_LEVEL, DEFAULT_MAX_LEVEL, DEFAULT_COMPRESSION_TARGET }, 0, 0, false,
+    DEFAULT_REMOTE_CACHE_SIZE, false, EB_DURABILITY_GROUP, EB_HASH_SHA256,
+    DEFAULT_PREFETCH_WINDOW, 0
+};
+
+/* [storage] settings of the most recently used repository, keyed by its config mtime */
+static pthread_mutex_t layout_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char layout_root[PATH_MAX];
+static struct timespec layout_mtime;
+static storage_settings_t settings_cached;
+static bool layout_valid = false;
+
+/* mtime of .embr/config, zero if there is none */
+static struct timespec config_mtime(const char* root) {
+    char path[PATH_MAX];
+    struct stat st;
+    struct timespec none = {0, 0};
+    snprintf(path, sizeof(path), "%s/.embr/config", root);
+    return stat(path, &st) == 0 ? st.st_mtim : none;
+}
+
+static void cache_settings(const char* root, const storage_settings_t* settings) {
+    snprintf(layout_root, sizeof(layout_root), "%s", root);
+    layout_mtime = config_mtime(root);
+    settings_cached = *settings;
+    layout_valid = true;
+}
+
+static char* read_config(const char* root) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.embr/config", root);
+
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    char* content = malloc((size_t)size + 1);
+    if (!content) {
+        fclose(f);
+        return NULL;
+    }
+    size_t n = fread(content, 1, (size_t)size, f);
+    fclose(f);
+    content[n] = '\0';
+    return content;
+}
+
+/* Length of the line starting at p, without the newline */
+static size_t line_length(const char* p) {
+    const char* nl = strchr(p, '\n');
+    return nl ? (size_t)(nl - p) : strlen(p);
+}
+
+/* Trim one config line into buf */
+static void trim_line(const char* p, size_t len, char* buf, size_t size) {
+    while (len > 0 && isspace((unsigned char)*p)) {
+        p++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)p[len - 1]))
+        len--;
+    if (len >= size)
+        len = size - 1;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+}
+
+/* If line is "<key> = <value>", return the value */
+static const char* storage_value(char* line, const char* key) {
+    size_t key_len = strlen(key);
+    if (strncmp(line, key, key_len) != 0)
+        return NULL;
+    char* p = line + key_len;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p != '=')
+        return NULL;
+    p++;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+static bool parse_bool(const char* value, bool fallback) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "yes") == 0 ||
+        strcmp(value, "on") == 0 || strcmp(value, "1") == 0)
+        return true;
+    if (strcmp(value, "false") == 0 || strcmp(value, "no") == 0 ||
+        strcmp(value, "off") == 0 || strcmp(value, "0") == 0)
+        return false;
+    return fallback;
+}
+
+/* ZSTD level between 1 and 22 */
+static int parse_level(const char* value, int fallback) {
+    int level = atoi(value);
+    return level >= 1 && level <= 22 ? level : fallback;
+}
+
+/* Byte count with an optional k, m or g suffix */
+static uint64_t parse_size(const char* value, uint64_t fallback) {
+    char* end = NULL;
+    unsigned long long size = strtoull(value, &end, 10);
+    if (end == value)
+        return fallback;
+    switch (tolower((unsigned char)*end)) {
+    case 'g': size *= 1024; /* fall through */
+    case 'm': size *= 1024; /* fall through */
+    case 'k': size *= 1024; end++; break;
+    case '\0': break;
+    default: return fallback;
+    }
+    return *end ? fallback : (uint64_t)size;
+}
+
+static void read_storage(const char* root, storage_settings_t* settings) {
+    *settings = default_settings;
+
+    char* content = read_config(root);
+    if (!content)
+        return;
+
+    bool in_storage = false, in_core = false;
+    for (const char* p = content; *p; ) {
+        size_t len = line_length(p);
+        char line[256];
+        trim_line(p, len, line, sizeof(line));
+
+        if (line[0] == '[') {
+            in_storage = strcmp(line, LAYOUT_SECTION) == 0;
+            in_core = strcmp(line, CORE_SECTION) == 0;
+        } else if (in_core) {
+            const char* value = storage_value(line, THREADS_KEY);
+            if (value) {
+                unsigned long threads = strtoul(value, NULL, 10);
+                settings->threads = threads <= 4096 ? (unsigned)threads : 0;
+            }
+        } else if (in_storage) {
+            const char* value = storage_value(line, LAYOUT_KEY);
+            if (value && eb_object_layout_parse(value, &settings->layout) != EB_SUCCESS) {
+                DEBUG_WARN("object_path: unknown storage.layout '%s', using flat", value);
+                settings->layout = EB_LAYOUT_FLAT;
+            }
+            value = storage_value(line, COMPRESSION_KEY);
+            if (value) {
+                settings->compression_auto = strcmp(value, "auto") == 0;
+                settings->compression = parse_bool(value, true);
+            }
+            value = storage_value(line, LEVEL_KEY);
+            if (value)
+                settings->level = parse_level(value, DEFAULT_COMPRESSION_LEVEL);
+            value = storage_value(line, MIN_LEVEL_KEY);
+            if (value)
+                settings->bounds.min_level = parse_level(value, DEFAULT_MIN_LEVEL);
+            value = storage_value(line, MAX_LEVEL_KEY);
+            if (value)
+                settings->bounds.max_level = parse_level(value, DEFAULT_MAX_LEVEL);
+            value = storage_value(line, TARGET_KEY);
+            if (value)
+                settings->bounds.target = parse_size(value, DEFAULT_COMPRESSION_TARGET);
+            value = storage_value(line, ARCHIVE_KEY);
+            if (value)
+                settings->archive_level = parse_level(value, 0);
+            value = storage_value(line, DICTIONARY_KEY);
+            if (value) {
+                unsigned long id = strtoul(value, NULL, 10);
+                settings->dictionary = id <= EB_DICT_ID_MAX ? (uint32_t)id : 0;
+            }
+            value = storage_value(line, FILTER_KEY);
+            if (value) {
+                settings->shuffle = strcmp(value, "shuffle") == 0;
+                if (!settings->shuffle && strcmp(value, "none") != 0)
+                    DEBUG_WARN("object_path: unknown storage.filter '%s', using none", value);
+            }
+            value = storage_value(line, CACHE_KEY);
+            if (value)
+                settings->remote_cache_size = parse_size(value, DEFAULT_REMOTE_CACHE_SIZE);
+            value = storage_value(line, DELTA_KEY);
+            if (value)
+                settings->delta = parse_bool(value, false);
+            value = storage_value(line, DURABILITY_KEY);
+            if (value) {
+                if (strcmp(value, "none") == 0)
+                    settings->durability = EB_DURABILITY_NONE;
+                else if (strcmp(value, "strict") == 0)
+                    settings->durability = EB_DURABILITY_STRICT;
+                else if (strcmp(value, "group") == 0)
+                    settings->durability = EB_DURABILITY_GROUP;
+                else
+                    DEBUG_WARN("object_path: unknown storage.durability '%s', using group", value);
+            }
+            value = storage_value(line, HASH_KEY);
+            if (value && eb_object_hash_parse(value, &settings->hash) != EB_SUCCESS) {
+                DEBUG_WARN("object_path: unknown storage.object_hash '%s', using sha256", value);
+                settings->hash = EB_HASH_SHA256;
+            }
+            value = storage_value(line, PREFETCH_KEY);
+            if (value) {
+                unsigned long window = strtoul(value, NULL, 10);
+                settings->prefetch_window = window <= MAX_PREFETCH_WINDOW ? (unsigned)window
+                                                                          : MAX_PREFETCH_WINDOW;
+            }
+        }
+
+        p += len;
+        if (*p == '\n')
+            p++;
+    }
+
+    free(content);
+}
+
+/* Refresh the cached [storage] settings if root or its config changed */
+static void load_storage(const char* root) {
+    struct timespec mtime = config_mtime(root);
+    if (!layout_valid || strcmp(layout_root, root) != 0 ||
+        mtime.tv_sec != layout_mtime.tv_sec || mtime.tv_nsec != layout_mtime.tv_nsec) {
+        storage_settings_t settings;
+        read_storage(root, &settings);
+        cache_settings(root, &settings);
+    }
+}
+
+static storage_settings_t storage_settings(const char* root) {
+    pthread_mutex_lock(&layout_mutex);
+    load_storage(root);
+    storage_settings_t settings = settings_cached;
+    pthread_mutex_unlock(&layout_mutex);
+    return settings;
+}
+
+eb_object_layout_t eb_object_layout(const char* root) {
+    return storage_settings(root).layout;
+}
+
+bool eb_object_compression(const char* root) {
+    return storage_settings(root).compression;
+}
+
+int eb_object_compression_level(const char* root) {
+    return storage_settings(root).level;
+}
+
+bool eb_object_compression_auto(const char* root, eb_compress_bounds_t* bounds) {
+    storage_settings_t settings = storage_settings(root);
+    if (bounds)
+        *bounds = settings.bounds;
+    return settings.compression && settings.compression_auto;
+}
+
+int eb_object_archive_level(const char* root) {
+    return storage_settings(root).archive_level;
+}
+
+uint32_t eb_object_dictionary(const char* root) {
+    return storage_settings(root).dictionary;
+}
+
+bool eb_object_shuffle(const char* root) {
+    return storage_settings(root).shuffle;
+}
+
+uint64_t eb_object_remote_cache_size(const char* root) {
+    return storage_settings(root).remote_cache_size;
+}
+
+bool eb_object_delta(const char* root) {
+    return storage_settings(root).delta;
+}
+
+eb_durability_t eb_object_durability(const char* root) {
+    return storage_settings(root).durability;
+}
+
+eb_hash_algo_t eb_object_hash(const char* root) {
+    return storage_settings(root).hash;
+}
+
+unsigned eb_object_prefetch_window(const char* root) {
+    return storage_settings(root).prefetch_window;
+}
+
+unsigned eb_core_threads(const char* root) {
+    return storage_settings(root).threads;
+}
+
+const char* eb_object_layout_name(eb_object_layout_t layout) {
+    return layout == EB_LAYOUT_FANOUT ? "fanout" : "flat";
+}
+
+eb_status_t eb_object_layout_parse(const char* name, eb_object_layout_t* layout) {
+    if (!name || !layout)
+        return EB_ERROR_INVALID_INPUT;
+    if (strcmp(name, "flat") == 0) {
+        *layout = EB_LAYOUT_FLAT;
+        return EB_SUCCESS;
+    }
+    if (strcmp(name, "fanout") == 0) {
+        *layout = EB_LAYOUT_FANOUT;
+        return EB_SUCCESS;
+    }
+    return EB_ERROR_INVALID_INPUT;
+}
+
+const char* eb_object_hash_name(eb_hash_algo_t algo) {
+    return algo == EB_HASH_BLAKE3 ? "blake3" : "sha256";
+}
+
+eb_status_t eb_object_hash_parse(const char* name, eb_hash_algo_t* algo) {
+    if (!name || !algo)
+        return EB_ERROR_INVALID_INPUT;
+    if (strcmp(name, "sha256") == 0) {
+        *algo = EB_HASH_SHA256;
+        return EB_SUCCESS;
+    }
+    if (strcmp(name, "blake3") == 0) {
+        *algo = EB_HASH_BLAKE3;
+        return EB_SUCCESS;
+    }
+    return EB_ERROR_INVALID_INPUT;
+}
+
+/* Write "key = value" into the [storage] section of .embr/config */
+static eb_status_t set_storage_value(const char* root, const char* key, const char* value) {
+    char* content = read_config(root);
+    const char* old = content ? content : "";
+    char setting[128];
+    snprintf(setting, sizeof(setting), "\t%s = %s\n", key, value);
+
+    /* Worst case: the old config plus a new [storage] section */
+    size_t cap = strlen(old) + strlen(setting) + sizeof(LAYOUT_SECTION) + 4;
+    char* out = malloc(cap);
+    if (!out) {
+        free(content);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* Write the setting right below [storage] and drop any older one */
+    size_t used = 0;
+    bool in_storage = false, written = false;
+    for (const char* p = old; *p; ) {
+        size_t len = line_length(p);
+        bool has_nl = p[len] == '\n';
+        char line[256];
+        trim_line(p, len, line, sizeof(line));
+
+        bool skip = false;
+        if (line[0] == '[')
+            in_storage = strcmp(line, LAYOUT_SECTION) == 0;
+        else if (in_storage && storage_value(line, key))
+            skip = true;
+
+        if (!skip) {
+            memcpy(out + used, p, len);
+            used += len;
+            out[used++] = '\n';
+        }
+        if (in_storage && line[0] == '[' && !written) {
+            memcpy(out + used, setting, strlen(setting));
+            used += strlen(setting);
+            written = true;
+        }
+
+        p += len + (has_nl ? 1 : 0);
+    }
+    if (!written)
+        used += (size_t)sprintf(out + used, "%s%s\n%s", used ? "\n" : "", LAYOUT_SECTION, setting);
+    free(content);
+
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.embr/config", root);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.embr/config.tmp", root);
+
+    FILE* f = fopen(tmp_path, "w");
+    if (!f) {
+        free(out);
+        return EB_ERROR_FILE_IO;
+    }
+    bool ok = fwrite(out, 1, used, f) == used;
+    if (fclose(f) != 0)
+        ok = false;
+    free(out);
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+
+    pthread_mutex_lock(&layout_mutex);
+    layout_valid = false;
+    load_storage(root);
+    pthread_mutex_unlock(&layout_mutex);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_object_set_layout(const char* root, eb_object_layout_t layout) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+    return set_storage_value(root, LAYOUT_KEY, eb_object_layout_name(layout));
+}
+
+eb_status_t eb_object_set_hash(const char* root, eb_hash_algo_t algo) {
+    if (!root || algo > EB_HASH_ALGO_MAX)
+        return EB_ERROR_INVALID_INPUT;
+    return set_storage_value(root, HASH_KEY, eb_object_hash_name(algo));
+}
+
+eb_status_t eb_object_set_dictionary(const char* root, uint32_t id) {
+    if (!root || id > EB_DICT_ID_MAX)
+        return EB_ERROR_INVALID_INPUT;
+    char value[16];
+    snprintf(value, sizeof(value), "%u", id);
+    return set_storage_value(root, DICTIONARY_KEY, value);
+}
+
+static int build_path(const char* root, const char* hex_hash, const char* ext,
+                      eb_object_layout_t layout, char* path_out, size_t path_size) {
+    const char* dot = (ext && *ext) ? "." : "";
+    if (!ext)
+        ext = "";
+
+    int n;
+    if (layout == EB_LAYOUT_FANOUT && strlen(hex_hash) > 2)
+        n = snprintf(path_out, path_size, "%s/.embr/objects/%.2s/%s%s%s",
+                     root, hex_hash, hex_hash + 2, dot, ext);
+    else
+        n = snprintf(path_out, path_size, "%s/.embr/objects/%s%s%s", root, hex_hash, dot, ext);
+    return (n < 0 || (size_t)n >= path_size) ? -1 : 0;
+}
+
+int eb_object_path(const char* root, const char* hex_hash, const char* ext,
+                   char* path_out, size_t path_size) {
+    if (!root || !hex_hash || !path_out)
+        return -1;
+
+    eb_object_layout_t layout = eb_object_layout(root);
+    if (build_path(root, hex_hash, ext, layout, path_out, path_size) != 0)
+        return -1;
+    if (access(path_out, F_OK) == 0)
+        return 0;
+
+    /* Objects not yet migrated still live in the other layout */
+    char other[PATH_MAX];
+    eb_object_layout_t alt = layout == EB_LAYOUT_FANOUT ? EB_LAYOUT_FLAT : EB_LAYOUT_FANOUT;
+    if (build_path(root, hex_hash, ext, alt, other, sizeof(other)) == 0 &&
+        access(other, F_OK) == 0 && strlen(other) < path_size)
+        strcpy(path_out, other);
+    return 0;
+}
+
+int eb_object_layout_path(const char* root, const char* hex_hash, const char* ext,
+                          eb_object_layout_t layout, char* path_out, size_t path_size) {
+    if (!root || !hex_hash || !path_out)
+        return -1;
+    return build_path(root, hex_hash, ext, layout, path_out, path_size);
+}
+
+int eb_object_write_path(const char* root, const char* hex_hash, const char* ext,
+                         char* path_out, size_t path_size) {
+    if (!root || !hex_hash || !path_out)
+        return -1;
+
+    eb_object_layout_t layout = eb_object_layout(root);
+    if (build_path(root, hex_hash, ext, layout, path_out, path_size) != 0)
+        return -1;
+
+    if (layout == EB_LAYOUT_FANOUT) {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s", path_out);
+        char* slash = strrchr(dir, '/');
+        if (slash) {
+            *slash = '\0';
+            if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+                DEBUG_ERROR("object_path: cannot create %s: %s", dir, strerror(errno));
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static bool is_hex(const char* s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (eb_hex_digit(s[i]) < 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Split "<hex>[.<ext>]" into hash and extension, where hex is
+ * hex_len characters. Returns false for anything else.
+ */
+static bool split_object_name(const char* name, size_t hex_len, const char** ext) {
+    if (strlen(name) < hex_len || !is_hex(name, hex_len))
+        return false;
+    if (name[hex_len] == '\0') {
+        *ext = "";
+        return true;
+    }
+    if (name[hex_len] != '.')
+        return false;
+    *ext = name + hex_len + 1;
+    return true;
+}
+
+/* Visit the files of one fan-out directory; returns non-zero to stop */
+static int visit_fanout_dir(const char* dir_path, const char* prefix,
+                            eb_object_visit_fn fn, void* ctx) {
+    DIR* dir = opendir(dir_path);
+    if (!dir)
+        return 0;
+
+    int stop = 0;
+    struct dirent* entry;
+    while (!stop && (entry = readdir(dir)) != NULL) {
+        const char* ext;
+        if (!split_object_name(entry->d_name, 62, &ext))
+            continue;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        char hex[65];
+        memcpy(hex, prefix, 2);
+        memcpy(hex + 2, entry->d_name, 62);
+        hex[64] = '\0';
+        stop = fn(hex, ext, path, &st, ctx);
+    }
+    closedir(dir);
+    return stop;
+}
+
+eb_status_t eb_object_foreach(const char* root, eb_object_visit_fn fn, void* ctx) {
+    if (!root || !fn)
+        return EB_ERROR_INVALID_INPUT;
+
+    char objects_dir[PATH_MAX];
+    snprintf(objects_dir, sizeof(objects_dir), "%s/.embr/objects", root);
+
+    DIR* dir = opendir(objects_dir);
+    if (!dir)
+        return EB_ERROR_NOT_FOUND;
+
+    int stop = 0;
+    struct dirent* entry;
+    while (!stop && (entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", objects_dir, name);
+
+        if (strlen(name) == 2 && is_hex(name, 2)) {
+            stop = visit_fanout_dir(path, name, fn, ctx);
+            continue;
+        }
+
+        const char* ext;
+        if (!split_object_name(name, 64, &ext))
+            continue;
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        char hex[65];
+        memcpy(hex, name, 64);
+        hex[64] = '\0';
+        stop = fn(hex, ext, path, &st, ctx);
+    }
+    closedir(dir);
+    return EB_SUCCESS;
+}
+
+static bool timespec_newer(const struct timespec* a, const struct timespec* b) {
+    return a->tv_sec > b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec);
+}
+
+eb_status_t eb_object_dirs_mtime(const char* root, struct timespec* out) {
+    if (!root || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.embr/objects", root);
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return EB_ERROR_NOT_FOUND;
+    *out = st.st_mtim;
+
+    /* Fan-out directories are probed by name, never by scanning */
+    if (eb_object_layout(root) != EB_LAYOUT_FANOUT)
+        return EB_SUCCESS;
+    for (int i = 0; i < 256; i++) {
+        snprintf(path, sizeof(path), "%s/.embr/objects/%02x", root, i);
+        if (stat(path, &st) == 0 && timespec_newer(&st.st_mtim, out))
+            *out = st.st_mtim;
+    }
+    return EB_SUCCESS;
+}
+
+/* State for moving objects between layouts */
+struct migrate_ctx {
+    const char* root;
+    eb_object_layout_t layout;
+    size_t moved;
+    eb_status_t status;
+};
+
+static int migrate_visit(const char* hex_hash, const char* ext, const char* path,
+                         const struct stat* st, void* data) {
+    struct migrate_ctx* ctx = data;
+    (void)st;
+
+    char target[PATH_MAX];
+    if (build_path(ctx->root, hex_hash, ext, ctx->layout, target, sizeof(target)) != 0)
+        return 0;
+    if (strcmp(target, path) == 0)
+        return 0;
+
+    if (ctx->layout == EB_LAYOUT_FANOUT &&
+        eb_object_write_path(ctx->root, hex_hash, ext, target, sizeof(target)) != 0) {
+        ctx->status = EB_ERROR_FILE_IO;
+        return 1;
+    }
+
+    /* Content-addressed: an existing target is the same object */
+    if (access(target, F_OK) == 0) {
+        unlink(path);
+        return 0;
+    }
+    if (rename(path, target) != 0) {
+        DEBUG_ERROR("object_path: cannot move %s to %s: %s", path, target, strerror(errno));
+        ctx->status = EB_ERROR_FILE_IO;
+        return 1;
+    }
+    ctx->moved++;
+    return 0;
+}
+
+eb_status_t eb_object_migrate(const char* root, eb_object_layout_t layout, size_t* moved_out) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+    if (moved_out)
+        *moved_out = 0;
+
+    /* Switch writers first so nothing new lands in the old layout */
+    eb_status_t status = eb_object_set_layout(root, layout);
+    if (status != EB_SUCCESS)
+        return status;
+
+    struct migrate_ctx ctx = {
+        .root = root,
+        .layout = layout,
+        .moved = 0,
+        .status = EB_SUCCESS
+    };
+    status = eb_object_foreach(root, migrate_visit, &ctx);
+    if (status == EB_ERROR_NOT_FOUND)
+        status = EB_SUCCESS;
+    if (status == EB_SUCCESS)
+        status = ctx.status;
+
+    if (status == EB_SUCCESS && layout == EB_LAYOUT_FLAT) {
+        /* Empty fan-out directories are left over; rmdir fails on the rest */
+        char path[PATH_MAX];
+        for (int i = 0; i < 256; i++) {
+            snprintf(path, sizeof(path), "%s/.embr/objects/%02x", root, i);
+            rmdir(path);
+        }
+    }
+
+    DEBUG_PRINT("object_path: moved %zu files to %s layout", ctx.moved, eb_object_layout_name(layout));
+    if (moved_out)
+        *moved_out = ctx.moved;
+    return status;
+}
@@ -0,0 +1,330 @@
+/*
+ * EmbeddingBridge - Loose Object Paths
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_OBJECT_PATH_H
+#define EB_OBJECT_PATH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "status.h"
+#include "types.h"
+#include "compress_tune.h"
+
+/*
+ * Loose objects and their sidecars are stored in one of two layouts:
+ *
+ *   flat    .embr/objects/<hash>.<ext>
+ *   fanout  .embr/objects/<hash[0..1]>/<hash[2..63]>.<ext>
+ *
+ * The layout is chosen at init time and recorded as "layout" in the
+ * [storage] section of .embr/config; repositories without the key are flat.
+ * Every loose object path must be built through this module so both
+ * layouts stay readable, including halfway through a migration.
+ */
+
+typedef enum {
+    EB_LAYOUT_FLAT = 0,
+    EB_LAYOUT_FANOUT = 1
+} eb_object_layout_t;
+
+/**
+ * Callback invoked for each loose object file
+ *
+ * @param hex_hash Full 64-character object hash
+ * @param ext Extension without the dot ("raw", "meta"), "" for none
+ * @param path Path of the file
+ * @param st Result of stat() on the file
+ * @param ctx Caller context
+ * @return 0 to continue, non-zero to stop iteration
+ */
+typedef int (*eb_object_visit_fn)(const char* hex_hash, const char* ext, const char* path,
+                                  const struct stat* st, void* ctx);
+
+/**
+ * Layout configured for a repository (cached until .embr/config changes)
+ *
+ * @param root Repository root (directory containing .embr)
+ * @return Configured layout, EB_LAYOUT_FLAT if none is recorded
+ */
+eb_object_layout_t eb_object_layout(const char* root);
+
+/**
+ * Whether new vector objects are zstd-compressed
+ *
+ * Read from storage.compression in .embr/config and cached like the
+ * layout. Uncompressed objects can be read through eb_object_map()
+ * without copying.
+ *
+ * @param root Repository root
+ * @return false only if storage.compression is set to false
+ */
+bool eb_object_compression(const char* root);
+
+/**
+ * ZSTD level for new vector objects, from storage.compression_level
+ *
+ * @param root Repository root
+ * @return Level between 1 and 22, 9 if none is configured
+ */
+int eb_object_compression_level(const char* root);
+
+/**
+ * Whether new vector objects pick their level as they go
+ *
+ * storage.compression = auto turns compression on with an adaptive level
+ * (see compress_tune.h), bounded by storage.compression_min_level and
+ * storage.compression_max_level and aiming for storage.compression_target
+ * input bytes per second (k, m or g suffix).
+ *
+ * @param root Repository root
+ * @param bounds Receives the bounds, set either way; may be NULL
+ * @return true if storage.compression is auto
+ */
+bool eb_object_compression_auto(const char* root, eb_compress_bounds_t* bounds);
+
+/**
+ * ZSTD level loose vectors are recompressed at as they are packed
+ *
+ * Read from storage.archive_level.
+ *
+ * @param root Repository root
+ * @return Level between 1 and 22, 0 if packs keep records as stored
+ */
+int eb_object_archive_level(const char* root);
+
+/**
+ * Dictionary new vector objects are compressed against
+ *
+ * Read from storage.dictionary, set by 'embr compress train-dict'.
+ *
+ * @param root Repository root
+ * @return Dictionary ID, 0 if objects are compressed without one
+ */
+uint32_t eb_object_dictionary(const char* root);
+
+/**
+ * Whether new compressed vectors are byte-shuffled first
+ *
+ * Read from storage.filter ("shuffle" or "none"). Shuffling groups the
+ * bytes of float32 values by position, which compresses much better.
+ *
+ * @param root Repository root
+ * @return true if storage.filter is "shuffle"
+ */
+bool eb_object_shuffle(const char* root);
+
+/**
+ * Size bound of the cache of fetched remote objects
+ *
+ * Read from storage.remote_cache_size, a byte count with an optional k, m
+ * or g suffix.
+ *
+ * @param root Repository root
+ * @return Bound in bytes, 1 GiB if none is configured
+ */
+uint64_t eb_object_remote_cache_size(const char* root);
+
+/**
+ * Whether new vectors may be stored as deltas against the previous
+ * version of their file (see object_delta.h)
+ *
+ * Read from storage.delta. Only applies while storage.compression is on.
+ *
+ * @param root Repository root
+ * @return true if storage.delta is set to true
+ */
+bool eb_object_delta(const char* root);
+
+/* When object writes are forced to disk */
+typedef enum {
+    EB_DURABILITY_NONE,     /* Left to the page cache */
+    EB_DURABILITY_GROUP,    /* Flushed together before the index that names them */
+    EB_DURABILITY_STRICT    /* Each one flushed before it is renamed in */
+} eb_durability_t;
+
+/**
+ * Durability of new objects
+ *
+ * Read from storage.durability ("none", "group" or "strict"). Under
+ * group, a store batch flushes the file system once before its index
+ * commit; objects written outside a batch have no commit to wait for
+ * and are flushed as under strict.
+ *
+ * @param root Repository root
+ * @return Mode, EB_DURABILITY_GROUP if none is configured
+ */
+eb_durability_t eb_object_durability(const char* root);
+
+/**
+ * Hash new object IDs and source hashes are computed with
+ *
+ * Read from storage.object_hash ("sha256" or "blake3"), which embr init
+ * records. Objects name their own algorithm in their header, so objects
+ * written before a change keep resolving and verifying.
+ *
+ * @param root Repository root
+ * @return Algorithm, EB_HASH_SHA256 if none is configured
+ */
+eb_hash_algo_t eb_object_hash(const char* root);
+
+/**
+ * Remote objects fetched ahead of a walk over history (see remote_prefetch.h)
+ *
+ * Read from storage.prefetch_window, at most 4096.
+ *
+ * @param root Repository root
+ * @return Window, 32 if none is configured, 0 to fetch on demand only
+ */
+unsigned eb_object_prefetch_window(const char* root);
+
+/**
+ * Thread budget for parallel work (see thread_pool.h)
+ *
+ * Read from core.threads.
+ *
+ * @param root Repository root
+ * @return Threads, 0 if none is configured
+ */
+unsigned eb_core_threads(const char* root);
+
+/**
+ * Name of a layout as written to the config ("flat", "fanout")
+ */
+const char* eb_object_layout_name(eb_object_layout_t layout);
+
+/**
+ * Parse a layout name
+ *
+ * @param name "flat" or "fanout"
+ * @param layout Receives the layout
+ * @return EB_SUCCESS or EB_ERROR_INVALID_INPUT
+ */
+eb_status_t eb_object_layout_parse(const char* name, eb_object_layout_t* layout);
+
+/**
+ * Record the layout in .embr/config
+ *
+ * Only changes the config; use eb_object_migrate() to move objects.
+ *
+ * @param root Repository root
+ * @param layout Layout to record
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_set_layout(const char* root, eb_object_layout_t layout);
+
+/**
+ * Name of a hash algorithm as written to the config ("sha256", "blake3")
+ */
+const char* eb_object_hash_name(eb_hash_algo_t algo);
+
+/**
+ * Parse a hash algorithm name
+ *
+ * @param name "sha256" or "blake3"
+ * @param algo Receives the algorithm
+ * @return EB_SUCCESS or EB_ERROR_INVALID_INPUT
+ */
+eb_status_t eb_object_hash_parse(const char* name, eb_hash_algo_t* algo);
+
+/**
+ * Record the object hash algorithm in .embr/config
+ *
+ * @param root Repository root
+ * @param algo Algorithm for objects written from now on
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_set_hash(const char* root, eb_hash_algo_t algo);
+
+/**
+ * Record the dictionary for new vector objects in .embr/config
+ *
+ * @param root Repository root
+ * @param id Dictionary ID, 0 to stop using a dictionary
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_set_dictionary(const char* root, uint32_t id);
+
+/**
+ * Path of an existing loose object file
+ *
+ * Returns the path in the configured layout, or the path in the other
+ * layout if the file only exists there. If neither exists the configured
+ * path is returned.
+ *
+ * @param root Repository root
+ * @param hex_hash Full 64-character object hash
+ * @param ext Extension without the dot, NULL or "" for none
+ * @param path_out Output buffer
+ * @param path_size Size of the output buffer
+ * @return 0 on success, -1 if the path does not fit
+ */
+int eb_object_path(const char* root, const char* hex_hash, const char* ext,
+                   char* path_out, size_t path_size);
+
+/**
+ * Path of a loose object file in one layout, whether or not it exists
+ *
+ * @return 0 on success, -1 if the path does not fit
+ */
+int eb_object_layout_path(const char* root, const char* hex_hash, const char* ext,
+                          eb_object_layout_t layout, char* path_out, size_t path_size);
+
+/**
+ * Path a new loose object file should be written to
+ *
+ * Always uses the configured layout and creates the fan-out directory.
+ *
+ * @return 0 on success, -1 if the path does not fit or the directory
+ *         could not be created
+ */
+int eb_object_write_path(const char* root, const char* hex_hash, const char* ext,
+                         char* path_out, size_t path_size);
+
+/**
+ * Visit every loose object file in either layout
+ *
+ * Only files named after a full object hash are visited; pack/ and temp/
+ * are skipped.
+ *
+ * @param root Repository root
+ * @param fn Callback
+ * @param ctx Callback context
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_foreach(const char* root, eb_object_visit_fn fn, void* ctx);
+
+/**
+ * Newest modification time of the directories holding loose objects
+ *
+ * Adding or removing a loose object updates at least one of them.
+ *
+ * @param root Repository root
+ * @param out Receives the newest mtime
+ * @return EB_SUCCESS or EB_ERROR_NOT_FOUND when there is no objects directory
+ */
+eb_status_t eb_object_dirs_mtime(const char* root, struct timespec* out);
+
+/**
+ * Move all loose objects into a layout and record it in the config
+ *
+ * Safe to rerun after an interruption: readers find objects in either
+ * layout, and files already in place are left alone.
+ *
+ * @param root Repository root
+ * @param layout Target layout
+ * @param moved_out Optional number of files moved
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_migrate(const char* root, eb_object_layout_t layout, size_t* moved_out);
+
+#endif /* EB_OBJECT_PATH_H */
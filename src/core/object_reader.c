@@ -0,0 +1,485 @@
+/*
+ * EmbeddingBridge - Batched Object Reads
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE /* For O_CLOEXEC and syscall */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#include "object_reader.h"
+#include "object_path.h"
+#include "thread_pool.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Loose files one pool task reads in the pread fallback */
+#define PREAD_BLOCK 16
+
+/* Shared state of one eb_object_read_many() call */
+typedef struct {
+    eb_store_t* store;
+    const char* const* hashes;
+    uint32_t flags;
+    eb_object_layout_t layout;
+    eb_object_read_fn fn;
+    void* ctx;
+    pthread_mutex_t lock;         /* Keeps fn calls apart in the pread fallback */
+    bool stopped;                 /* fn asked to stop */
+} read_job_t;
+
+/* Path of an object in the configured layout, false if it cannot be loose */
+static bool loose_path(const read_job_t* job, const char* hash, char* path, size_t size) {
+    return strlen(hash) == 64 &&
+           eb_object_layout_path(job->store->storage_path, hash, "raw", job->layout, path, size) == 0;
+}
+
+/* Read a whole loose object file, EB_ERROR_NOT_FOUND if there is none */
+static eb_status_t read_file(const char* path, void** out, size_t* size_out) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+
+    struct stat st;
+    eb_status_t status = EB_SUCCESS;
+    uint8_t* buffer = NULL;
+    if (fstat(fd, &st) != 0) {
+        status = EB_ERROR_FILE_IO;
+    } else if (!(buffer = malloc(st.st_size ? (size_t)st.st_size : 1))) {
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    } else {
+        size_t done = 0;
+        while (done < (size_t)st.st_size) {
+            ssize_t n = pread(fd, buffer + done, (size_t)st.st_size - done, (off_t)done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                status = EB_ERROR_FILE_IO;
+                break;
+            }
+            done += (size_t)n;
+        }
+    }
+    close(fd);
+    if (status != EB_SUCCESS) {
+        free(buffer);
+        return status;
+    }
+    *out = buffer;
+    *size_out = (size_t)st.st_size;
+    return EB_SUCCESS;
+}
+
+/*
+ * Decode a record read from disk, taking it over; objects that were not
+ * loose where we looked are mapped the usual way
+ */
+static eb_status_t finish_read(read_job_t* job, size_t index, eb_status_t read_status,
+                               void* record, size_t size, eb_object_view_t* view) {
+    const char* hash = job->hashes[index];
+    if (read_status == EB_SUCCESS)
+        return eb_object_view_record(job->store, hash, record, size, job->flags, view);
+    free(record);
+    if (read_status == EB_ERROR_NOT_FOUND)
+        return eb_object_map(job->store, hash, job->flags, view);
+    return read_status;
+}
+
+/* Hand one result to the callback unless it has asked to stop */
+static void deliver(read_job_t* job, size_t index, eb_status_t status, eb_object_view_t* view) {
+    if (!job->stopped &&
+        job->fn(job->ctx, index, status, status == EB_SUCCESS ? view : NULL) != 0)
+        __atomic_store_n(&job->stopped, true, __ATOMIC_RELAXED);
+    if (status == EB_SUCCESS)
+        eb_object_unmap(view);
+}
+
+/* pread fallback: each task reads and decodes a block, then delivers it */
+static void pread_range(void* arg, size_t begin, size_t end) {
+    read_job_t* job = arg;
+    for (size_t i = begin; i < end; i++) {
+        if (__atomic_load_n(&job->stopped, __ATOMIC_RELAXED))
+            return;
+        char path[PATH_MAX];
+        void* record = NULL;
+        size_t size = 0;
+        eb_status_t status = loose_path(job, job->hashes[i], path, sizeof(path))
+            ? read_file(path, &record, &size) : EB_ERROR_NOT_FOUND;
+        eb_object_view_t view;
+        status = finish_read(job, i, status, record, size, &view);
+        pthread_mutex_lock(&job->lock);
+        deliver(job, i, status, &view);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+/* Submission and completion rings of one io_uring instance */
+typedef struct {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;                 /* Same as sq_map with IORING_FEAT_SINGLE_MMAP */
+    size_t cq_map_size;
+    size_t sqes_size;
+    unsigned queued;              /* Prepared but not yet submitted */
+} ring_t;
+
+static void ring_close(ring_t* ring) {
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map && ring->cq_map != ring->sq_map)
+        munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map)
+        munmap(ring->sq_map, ring->sq_map_size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+}
+
+static bool ring_init(ring_t* ring, unsigned entries) {
+    memset(ring, 0, sizeof(*ring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+        return false;
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && ring->cq_map_size > ring->sq_map_size)
+        ring->sq_map_size = ring->cq_map_size;
+    void* sq = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        ring_close(ring);
+        return false;
+    }
+    ring->sq_map = sq;
+    void* cq = sq;
+    if (!single) {
+        cq = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring->fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            ring_close(ring);
+            return false;
+        }
+    }
+    ring->cq_map = cq;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        ring_close(ring);
+        return false;
+    }
+    ring->sqes = sqes;
+
+    uint8_t* s = sq;
+    ring->sq_head = (unsigned*)(s + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(s + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(s + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(s + params.sq_off.array);
+    uint8_t* c = cq;
+    ring->cq_head = (unsigned*)(c + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(c + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(c + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(c + params.cq_off.cqes);
+    return true;
+}
+
+/* Next free submission entry, zeroed; the ring is sized so one is always free */
+static struct io_uring_sqe* ring_sqe(ring_t* ring) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    return sqe;
+}
+
+/* Submit what is queued and wait for at least one completion */
+static bool ring_submit_wait(ring_t* ring) {
+    for (;;) {
+        int n = (int)syscall(__NR_io_uring_enter, ring->fd, ring->queued, 1,
+                             IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n >= 0) {
+            ring->queued -= (unsigned)n < ring->queued ? (unsigned)n : ring->queued;
+            return true;
+        }
+        if (errno != EINTR)
+            return false;
+    }
+}
+
+/* Take the next completion, false if none is ready */
+static bool ring_reap(ring_t* ring, uint64_t* user_data, int* res) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+    const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* One object on its way through open and read */
+typedef struct {
+    size_t index;
+    int fd;                       /* -1 while the open is in flight */
+    uint8_t* buffer;
+    size_t size;
+    size_t done;
+    char path[PATH_MAX];
+} uring_slot_t;
+
+static void queue_open(ring_t* ring, uring_slot_t* slot) {
+    struct io_uring_sqe* sqe = ring_sqe(ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)slot->path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = (uint64_t)(uintptr_t)slot;
+    slot->fd = -1;
+}
+
+static void queue_read(ring_t* ring, uring_slot_t* slot) {
+    struct io_uring_sqe* sqe = ring_sqe(ring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->buffer + slot->done);
+    sqe->len = (uint32_t)(slot->size - slot->done);
+    sqe->off = slot->done;
+    sqe->user_data = (uint64_t)(uintptr_t)slot;
+}
+
+/* The slot's object is read, or failed: decode and deliver it */
+static void complete_slot(read_job_t* job, uring_slot_t* slot, eb_status_t status) {
+    if (slot->fd >= 0)
+        close(slot->fd);
+    slot->fd = -1;
+    eb_object_view_t view;
+    status = finish_read(job, slot->index, status, slot->buffer, slot->size, &view);
+    slot->buffer = NULL;
+    deliver(job, slot->index, status, &view);
+}
+
+/* An open finished: size the buffer and queue the read, or finish here */
+static bool opened(read_job_t* job, ring_t* ring, uring_slot_t* slot, int res) {
+    if (res == -EINVAL || res == -EOPNOTSUPP) {
+        // A kernel without IORING_OP_OPENAT: read this one synchronously
+        void* record = NULL;
+        eb_status_t status = read_file(slot->path, &record, &slot->size);
+        slot->buffer = record;
+        complete_slot(job, slot, status);
+        return false;
+    }
+    if (res < 0) {
+        complete_slot(job, slot, res == -ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO);
+        return false;
+    }
+    slot->fd = res;
+    struct stat st;
+    if (fstat(slot->fd, &st) != 0) {
+        complete_slot(job, slot, EB_ERROR_FILE_IO);
+        return false;
+    }
+    slot->size = (size_t)st.st_size;
+    slot->done = 0;
+    if (!(slot->buffer = malloc(slot->size ? slot->size : 1))) {
+        complete_slot(job, slot, EB_ERROR_MEMORY_ALLOCATION);
+        return false;
+    }
+    if (slot->size == 0) {
+        complete_slot(job, slot, EB_SUCCESS);
+        return false;
+    }
+    queue_read(ring, slot);
+    return true;
+}
+
+/* A read finished: queue the rest of a short one, or finish */
+static bool was_read(read_job_t* job, ring_t* ring, uring_slot_t* slot, int res) {
+    if (res == -EINTR || res == -EAGAIN) {
+        queue_read(ring, slot);
+        return true;
+    }
+    if (res <= 0) {
+        complete_slot(job, slot, EB_ERROR_FILE_IO);
+        return false;
+    }
+    slot->done += (size_t)res;
+    if (slot->done < slot->size) {
+        queue_read(ring, slot);
+        return true;
+    }
+    complete_slot(job, slot, EB_SUCCESS);
+    return false;
+}
+
+static eb_status_t read_uring(read_job_t* job, ring_t* ring, size_t count, unsigned depth) {
+    uring_slot_t* slots = calloc(depth, sizeof(*slots));
+    uring_slot_t** free_slots = malloc(depth * sizeof(*free_slots));
+    if (!slots || !free_slots) {
+        free(slots);
+        free(free_slots);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    unsigned free_count = depth;
+    for (unsigned i = 0; i < depth; i++) {
+        slots[i].fd = -1;
+        free_slots[i] = &slots[depth - 1 - i];
+    }
+
+    eb_status_t status = EB_SUCCESS;
+    size_t next = 0;
+    unsigned in_flight = 0;
+    for (;;) {
+        // Keep depth objects in flight while there are any left
+        while (!job->stopped && next < count && free_count > 0) {
+            uring_slot_t* slot = free_slots[--free_count];
+            slot->index = next++;
+            slot->buffer = NULL;
+            slot->size = 0;
+            if (!loose_path(job, job->hashes[slot->index], slot->path, sizeof(slot->path))) {
+                complete_slot(job, slot, EB_ERROR_NOT_FOUND);
+                free_slots[free_count++] = slot;
+                continue;
+            }
+            queue_open(ring, slot);
+            in_flight++;
+        }
+        if (in_flight == 0)
+            break;
+        if (!ring_submit_wait(ring)) {
+            status = EB_ERROR_FILE_IO;
+            break;
+        }
+
+        uint64_t user_data;
+        int res;
+        while (ring_reap(ring, &user_data, &res)) {
+            uring_slot_t* slot = (uring_slot_t*)(uintptr_t)user_data;
+            bool pending = slot->fd < 0 ? opened(job, ring, slot, res) : was_read(job, ring, slot, res);
+            if (!pending) {
+                free_slots[free_count++] = slot;
+                in_flight--;
+            }
+        }
+    }
+
+    // Only a failed submit leaves objects in flight; the kernel still
+    // owns their buffers, so close the ring before freeing them
+    if (in_flight > 0) {
+        ring_close(ring);
+        ring->fd = -1;
+        ring->sq_map = ring->cq_map = NULL;
+        ring->sqes = NULL;
+        for (unsigned i = 0; i < depth; i++) {
+            if (slots[i].fd >= 0)
+                close(slots[i].fd);
+            free(slots[i].buffer);
+        }
+    }
+    free(free_slots);
+    free(slots);
+    return status;
+}
+
+static bool uring_works;
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+
+/* Seccomp filters and old kernels refuse io_uring_setup */
+static void probe_uring(void) {
+    ring_t ring;
+    uring_works = ring_init(&ring, 2);
+    if (uring_works)
+        ring_close(&ring);
+}
+
+bool eb_object_read_uring_available(void) {
+    pthread_once(&uring_once, probe_uring);
+    return uring_works;
+}
+
+#else
+
+bool eb_object_read_uring_available(void) {
+    return false;
+}
+
+#endif /* HAVE_IO_URING */
+
+eb_status_t eb_object_read_many(eb_store_t* store, const char* const* hashes, size_t count,
+                                const eb_object_read_options_t* options,
+                                eb_object_read_fn fn, void* ctx) {
+    if (!store || !fn || (count && !hashes))
+        return EB_ERROR_INVALID_INPUT;
+    if (count == 0)
+        return EB_SUCCESS;
+
+    eb_object_read_options_t defaults = { 0 };
+    if (!options)
+        options = &defaults;
+    unsigned depth = options->depth ? options->depth : EB_OBJECT_READ_DEPTH;
+    if (depth > count)
+        depth = (unsigned)count;
+
+    read_job_t job = {
+        .store = store,
+        .hashes = hashes,
+        .flags = options->flags,
+        .layout = eb_object_layout(store->storage_path),
+        .fn = fn,
+        .ctx = ctx,
+    };
+
+#ifdef HAVE_IO_URING
+    ring_t ring;
+    if (!options->no_uring && eb_object_read_uring_available() && ring_init(&ring, depth)) {
+        eb_status_t status = read_uring(&job, &ring, count, depth);
+        ring_close(&ring);
+        return status;
+    }
+#endif
+
+    pthread_mutex_init(&job.lock, NULL);
+    eb_parallel_for(NULL, count, PREAD_BLOCK, depth, pread_range, &job);
+    pthread_mutex_destroy(&job.lock);
+    return EB_SUCCESS;
+}
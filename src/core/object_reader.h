@@ -0,0 +1,70 @@
+/*
+ * EmbeddingBridge - Batched Object Reads
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_OBJECT_READER_H
+#define EB_OBJECT_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "store.h"
+
+/*
+ * Reads many objects at once for the bulk paths (set diff, matrix and
+ * index exports) that would otherwise open and map them one by one,
+ * leaving a fast disk idle between small synchronous reads.
+ *
+ * Loose object files are read whole. Where the kernel allows io_uring,
+ * opens and reads are submitted in batches with a bounded number in
+ * flight; elsewhere the files are read with pread on the shared thread
+ * pool. Each record is then decoded as eb_object_map() would decode it
+ * (decompression, deltas, hash check). Objects that are not loose in the
+ * configured layout (packed, legacy names, mid-migration) are mapped with
+ * eb_object_map() instead.
+ */
+
+/* Reads in flight when no depth is given */
+#define EB_OBJECT_READ_DEPTH 64
+
+typedef struct {
+    unsigned depth;       /* Reads in flight, 0 for EB_OBJECT_READ_DEPTH */
+    uint32_t flags;       /* EB_OBJECT_MAP_* flags for every object */
+    bool no_uring;        /* Read with pread even where io_uring works */
+} eb_object_read_options_t;
+
+/*
+ * Called once per hash as its read completes, never for two hashes at
+ * once. view is NULL unless status is EB_SUCCESS. The reader unmaps the
+ * view when fn returns; fn keeps it instead by copying the struct out and
+ * zeroing *view. Return non-zero to stop reading.
+ */
+typedef int (*eb_object_read_fn)(void* ctx, size_t index, eb_status_t status,
+                                 eb_object_view_t* view);
+
+/**
+ * Read a list of objects, delivering each to a callback
+ *
+ * @param store Store the objects belong to
+ * @param hashes Full object hashes
+ * @param count Number of hashes
+ * @param options Options, NULL for defaults
+ * @param fn Called for every hash until it asks to stop
+ * @param ctx Passed to fn
+ * @return Status code (0 = success, also when fn stopped early); errors
+ *         of single objects are passed to fn instead
+ */
+eb_status_t eb_object_read_many(eb_store_t* store, const char* const* hashes, size_t count,
+                                const eb_object_read_options_t* options,
+                                eb_object_read_fn fn, void* ctx);
+
+/* Whether eb_object_read_many() can use io_uring in this process */
+bool eb_object_read_uring_available(void);
+
+#endif /* EB_OBJECT_READER_H */
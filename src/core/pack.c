@@ -0,0 +1,1063 @@
+/*
+ * EmbeddingBridge - Packfile Storage Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include "pack.h"
+#include "types.h"
+#include "debug.h"
+#include "hash_utils.h"
+#include "object_path.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define PACK_COPY_CHUNK (64 * 1024)
+
+/* One mapped .idx plus an open descriptor on its .pack */
+struct eb_pack {
+    char* pack_path;
+    char name[65];
+    int pack_fd;
+    void* idx_map;
+    size_t idx_size;
+    const uint32_t* fanout;
+    const eb_pack_idx_entry_t* entries;
+    uint32_t count;
+    time_t mtime;
+};
+
+struct eb_pack_set {
+    struct eb_pack* packs;
+    size_t count;
+};
+
+/* Candidate object collected during repack */
+typedef struct {
+    uint8_t hash[32];
+    long source;        /* -1 for a loose object, otherwise index into the old set */
+    uint64_t offset;    /* Offset in the source pack */
+    uint64_t length;    /* Record length */
+    time_t mtime;
+} repack_item_t;
+
+/* Index range [lo, hi) of entries whose first byte equals b */
+static void fanout_range(const struct eb_pack* pack, uint8_t b, uint32_t* lo, uint32_t* hi) {
+    *lo = b ? pack->fanout[b - 1] : 0;
+    *hi = pack->fanout[b];
+}
+
+/* First entry in [lo, hi) that is >= key */
+static uint32_t lower_bound(const struct eb_pack* pack, uint32_t lo, uint32_t hi, const uint8_t key[32]) {
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (memcmp(pack->entries[mid].hash, key, 32) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static const eb_pack_idx_entry_t* pack_find(const struct eb_pack* pack, const uint8_t hash[32]) {
+    uint32_t lo, hi;
+    fanout_range(pack, hash[0], &lo, &hi);
+    uint32_t pos = lower_bound(pack, lo, hi, hash);
+    if (pos < hi && memcmp(pack->entries[pos].hash, hash, 32) == 0)
+        return &pack->entries[pos];
+    return NULL;
+}
+
+static void pack_unload(struct eb_pack* pack) {
+    if (pack->idx_map && pack->idx_map != MAP_FAILED)
+        munmap(pack->idx_map, pack->idx_size);
+    if (pack->pack_fd >= 0)
+        close(pack->pack_fd);
+    free(pack->pack_path);
+    memset(pack, 0, sizeof(*pack));
+    pack->pack_fd = -1;
+}
+
+/* Point pack at the fan-out and entries of an index image, checking it is whole */
+static bool idx_parse(const void* idx, size_t idx_size, struct eb_pack* pack) {
+    if (idx_size < sizeof(eb_pack_idx_header_t) + EB_PACK_FANOUT * sizeof(uint32_t))
+        return false;
+    const eb_pack_idx_header_t* hdr = idx;
+    if (hdr->magic != EB_PACK_IDX_MAGIC || hdr->version != EB_PACK_VERSION)
+        return false;
+
+    size_t expected = sizeof(*hdr) + EB_PACK_FANOUT * sizeof(uint32_t) +
+                      (size_t)hdr->count * sizeof(eb_pack_idx_entry_t);
+    pack->fanout = (const uint32_t*)((const char*)idx + sizeof(*hdr));
+    pack->entries = (const eb_pack_idx_entry_t*)(pack->fanout + EB_PACK_FANOUT);
+    pack->count = hdr->count;
+    return expected == idx_size && pack->fanout[EB_PACK_FANOUT - 1] == pack->count;
+}
+
+/* Map one .idx and open its .pack; name is the 64-char pack name */
+static eb_status_t pack_load(const char* pack_dir, const char* name, struct eb_pack* pack) {
+    char idx_path[PATH_MAX];
+    char pack_path[PATH_MAX];
+    snprintf(idx_path, sizeof(idx_path), "%s/pack-%s.idx", pack_dir, name);
+    snprintf(pack_path, sizeof(pack_path), "%s/pack-%s.pack", pack_dir, name);
+
+    memset(pack, 0, sizeof(*pack));
+    pack->pack_fd = -1;
+
+    int idx_fd = open(idx_path, O_RDONLY);
+    if (idx_fd < 0)
+        return EB_ERROR_FILE_IO;
+
+    struct stat st;
+    if (fstat(idx_fd, &st) != 0 ||
+        (size_t)st.st_size < sizeof(eb_pack_idx_header_t) + EB_PACK_FANOUT * sizeof(uint32_t)) {
+        close(idx_fd);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+
+    pack->idx_size = (size_t)st.st_size;
+    pack->idx_map = mmap(NULL, pack->idx_size, PROT_READ, MAP_PRIVATE, idx_fd, 0);
+    close(idx_fd);
+    if (pack->idx_map == MAP_FAILED) {
+        pack->idx_map = NULL;
+        return EB_ERROR_FILE_IO;
+    }
+
+    if (!idx_parse(pack->idx_map, pack->idx_size, pack)) {
+        DEBUG_WARN("pack: bad, truncated or inconsistent index %s", idx_path);
+        pack_unload(pack);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+
+    pack->pack_fd = open(pack_path, O_RDONLY);
+    if (pack->pack_fd < 0 || fstat(pack->pack_fd, &st) != 0) {
+        DEBUG_WARN("pack: index %s has no pack file", idx_path);
+        pack_unload(pack);
+        return EB_ERROR_FILE_IO;
+    }
+    pack->mtime = st.st_mtime;
+    pack->pack_path = strdup(pack_path);
+    strncpy(pack->name, name, 64);
+    pack->name[64] = '\0';
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_pack_open(const char* root, eb_pack_set_t** out) {
+    if (!root || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_pack_set_t* set = calloc(1, sizeof(*set));
+    if (!set)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    char pack_dir[PATH_MAX];
+    snprintf(pack_dir, sizeof(pack_dir), "%s/.embr/objects/%s", root, EB_PACK_DIR);
+
+    DIR* dir = opendir(pack_dir);
+    if (!dir) {
+        /* No pack directory simply means nothing has been packed yet */
+        *out = set;
+        return EB_SUCCESS;
+    }
+
+    size_t capacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        /* pack-<64 hex>.idx */
+        if (len != 5 + 64 + 4 || strncmp(entry->d_name, "pack-", 5) != 0 ||
+            strcmp(entry->d_name + 69, ".idx") != 0)
+            continue;
+
+        char name[65];
+        memcpy(name, entry->d_name + 5, 64);
+        name[64] = '\0';
+
+        if (set->count == capacity) {
+            size_t new_cap = capacity ? capacity * 2 : 4;
+            struct eb_pack* grown = realloc(set->packs, new_cap * sizeof(*grown));
+            if (!grown) {
+                closedir(dir);
+                eb_pack_close(set);
+                return EB_ERROR_MEMORY_ALLOCATION;
+            }
+            set->packs = grown;
+            capacity = new_cap;
+        }
+
+        if (pack_load(pack_dir, name, &set->packs[set->count]) == EB_SUCCESS)
+            set->count++;
+    }
+    closedir(dir);
+
+    DEBUG_PRINT("eb_pack_open: loaded %zu packs from %s", set->count, pack_dir);
+    *out = set;
+    return EB_SUCCESS;
+}
+
+void eb_pack_close(eb_pack_set_t* packs) {
+    if (!packs) return;
+    for (size_t i = 0; i < packs->count; i++)
+        pack_unload(&packs->packs[i]);
+    free(packs->packs);
+    free(packs);
+}
+
+size_t eb_pack_count(const eb_pack_set_t* packs) {
+    return packs ? packs->count : 0;
+}
+
+size_t eb_pack_object_count(const eb_pack_set_t* packs) {
+    size_t total = 0;
+    if (!packs) return 0;
+    for (size_t i = 0; i < packs->count; i++)
+        total += packs->packs[i].count;
+    return total;
+}
+
+bool eb_pack_contains(const eb_pack_set_t* packs, const char* hex_hash) {
+    uint8_t hash[32];
+    if (!packs || !hex_hash || !eb_hex_to_hash(hex_hash, hash))
+        return false;
+    for (size_t i = 0; i < packs->count; i++) {
+        if (pack_find(&packs->packs[i], hash))
+            return true;
+    }
+    return false;
+}
+
+/* pread() until the whole range has been read */
+static bool read_full(int fd, void* buf, size_t len, off_t offset) {
+    char* p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+eb_status_t eb_pack_read(const eb_pack_set_t* packs, const char* hex_hash,
+                         void** out_data, size_t* out_size) {
+    uint8_t hash[32];
+    if (!packs || !hex_hash || !out_data || !out_size)
+        return EB_ERROR_INVALID_INPUT;
+    if (!eb_hex_to_hash(hex_hash, hash))
+        return EB_ERROR_NOT_FOUND;
+
+    for (size_t i = 0; i < packs->count; i++) {
+        const struct eb_pack* pack = &packs->packs[i];
+        const eb_pack_idx_entry_t* e = pack_find(pack, hash);
+        if (!e) continue;
+
+        void* data = malloc(e->length);
+        if (!data)
+            return EB_ERROR_MEMORY_ALLOCATION;
+        if (!read_full(pack->pack_fd, data, e->length, (off_t)e->offset)) {
+            DEBUG_ERROR("pack: short read for %s in %s", hex_hash, pack->pack_path);
+            free(data);
+            return EB_ERROR_FILE_IO;
+        }
+        *out_data = data;
+        *out_size = e->length;
+        return EB_SUCCESS;
+    }
+    return EB_ERROR_NOT_FOUND;
+}
+
+eb_status_t eb_pack_locate(const eb_pack_set_t* packs, const char* hex_hash,
+                           int* out_fd, uint64_t* out_offset, uint64_t* out_length) {
+    uint8_t hash[32];
+    if (!packs || !hex_hash || !out_fd || !out_offset || !out_length)
+        return EB_ERROR_INVALID_INPUT;
+    if (!eb_hex_to_hash(hex_hash, hash))
+        return EB_ERROR_NOT_FOUND;
+
+    for (size_t i = 0; i < packs->count; i++) {
+        const struct eb_pack* pack = &packs->packs[i];
+        const eb_pack_idx_entry_t* e = pack_find(pack, hash);
+        if (!e) continue;
+
+        *out_fd = pack->pack_fd;
+        *out_offset = e->offset;
+        *out_length = e->length;
+        return EB_SUCCESS;
+    }
+    return EB_ERROR_NOT_FOUND;
+}
+
+eb_status_t eb_pack_resolve_prefix(const eb_pack_set_t* packs, const char* prefix,
+                                   char full_hash[65]) {
+    if (!packs || !prefix || !full_hash)
+        return EB_ERROR_INVALID_INPUT;
+
+    /* Lowest possible hash with this prefix: remaining nibbles zero */
+    uint8_t key[32];
+    size_t nibbles = eb_hex_prefix_key(prefix, key);
+    if (nibbles == 0)
+        return EB_ERROR_NOT_FOUND;
+
+    const uint8_t* match = NULL;
+    for (size_t p = 0; p < packs->count; p++) {
+        const struct eb_pack* pack = &packs->packs[p];
+        uint32_t lo = key[0] ? pack->fanout[key[0] - 1] : 0;
+        uint32_t pos = lower_bound(pack, lo, pack->count, key);
+
+        /* Entries are sorted, so at most the next two can tell us everything */
+        for (uint32_t i = pos; i < pack->count && i < pos + 2; i++) {
+            const uint8_t* h = pack->entries[i].hash;
+            if (!eb_hash_has_prefix(h, key, nibbles))
+                break;
+            if (match && memcmp(match, h, 32) != 0)
+                return EB_ERROR_HASH_AMBIGUOUS;
+            match = h;
+        }
+    }
+
+    if (!match)
+        return EB_ERROR_NOT_FOUND;
+    eb_hash_to_hex(match, full_hash);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_pack_foreach(const eb_pack_set_t* packs, eb_pack_visit_fn fn, void* ctx) {
+    if (!packs || !fn)
+        return EB_ERROR_INVALID_INPUT;
+
+    char hex[65];
+    for (size_t p = 0; p < packs->count; p++) {
+        const struct eb_pack* pack = &packs->packs[p];
+        for (uint32_t i = 0; i < pack->count; i++) {
+            eb_hash_to_hex(pack->entries[i].hash, hex);
+            if (fn(hex, pack->entries[i].length, pack->mtime, ctx) != 0)
+                return EB_SUCCESS;
+        }
+    }
+    return EB_SUCCESS;
+}
+
+static int compare_items(const void* a, const void* b) {
+    const repack_item_t* ia = a;
+    const repack_item_t* ib = b;
+    int cmp = memcmp(ia->hash, ib->hash, 32);
+    if (cmp) return cmp;
+    /* Prefer packed copies so the loose duplicate is the one removed */
+    return (ia->source < 0) - (ib->source < 0);
+}
+
+static bool append_item(repack_item_t** items, size_t* count, size_t* capacity, const repack_item_t* item) {
+    if (*count == *capacity) {
+        size_t new_cap = *capacity ? *capacity * 2 : 256;
+        repack_item_t* grown = realloc(*items, new_cap * sizeof(*grown));
+        if (!grown) return false;
+        *items = grown;
+        *capacity = new_cap;
+    }
+    (*items)[(*count)++] = *item;
+    return true;
+}
+
+/* Is this a well-formed loose object we are allowed to pack? */
+static bool loose_object_valid(const char* path, uint64_t size) {
+    if (size < sizeof(eb_object_header_t))
+        return false;
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    eb_object_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+              header.magic == EB_VECTOR_MAGIC;
+    fclose(fp);
+    return ok;
+}
+
+/* State for gathering loose objects through eb_object_foreach() */
+struct collect_ctx {
+    repack_item_t** items;
+    size_t* count;
+    size_t* capacity;
+    bool failed;
+};
+
+static int collect_visit(const char* hex_hash, const char* ext, const char* path,
+                         const struct stat* st, void* data) {
+    struct collect_ctx* ctx = data;
+    if (strcmp(ext, "raw") != 0)
+        return 0;
+
+    repack_item_t item = { .source = -1 };
+    if (!eb_hex_to_hash(hex_hash, item.hash))
+        return 0;
+    if (!loose_object_valid(path, (uint64_t)st->st_size)) {
+        DEBUG_WARN("repack: skipping malformed loose object %s", path);
+        return 0;
+    }
+
+    item.length = (uint64_t)st->st_size;
+    item.mtime = st->st_mtime;
+    if (!append_item(ctx->items, ctx->count, ctx->capacity, &item)) {
+        ctx->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+static eb_status_t collect_loose(const char* root, repack_item_t** items,
+                                 size_t* count, size_t* capacity) {
+    struct collect_ctx ctx = {
+        .items = items,
+        .count = count,
+        .capacity = capacity,
+        .failed = false
+    };
+    if (eb_object_foreach(root, collect_visit, &ctx) != EB_SUCCESS)
+        return EB_ERROR_NOT_INITIALIZED;
+    return ctx.failed ? EB_ERROR_MEMORY_ALLOCATION : EB_SUCCESS;
+}
+
+/* Copy length bytes from src_fd at src_off to the current position of out_fd */
+static bool copy_range(int src_fd, off_t src_off, uint64_t length, int out_fd, char* buf) {
+    while (length > 0) {
+        size_t chunk = length > PACK_COPY_CHUNK ? PACK_COPY_CHUNK : (size_t)length;
+        if (!read_full(src_fd, buf, chunk, src_off))
+            return false;
+        size_t done = 0;
+        while (done < chunk) {
+            ssize_t n = write(out_fd, buf + done, chunk - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += (size_t)n;
+        }
+        src_off += (off_t)chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/* Pack a loose record through rewrite, or as it is if rewrite leaves it */
+static bool copy_rewritten(int src_fd, const uint8_t hash[32], uint64_t* length, int out_fd,
+                           eb_pack_rewrite_fn rewrite, void* rewrite_ctx, bool* rewritten) {
+    void* record = malloc(*length ? (size_t)*length : 1);
+    if (!record)
+        return false;
+    if (!read_full(src_fd, record, (size_t)*length, 0)) {
+        free(record);
+        return false;
+    }
+    char hex[65];
+    eb_hash_to_hex(hash, hex);
+    void* replacement = NULL;
+    size_t replacement_size = 0;
+    if (rewrite(rewrite_ctx, hex, record, (size_t)*length, &replacement, &replacement_size) != EB_SUCCESS) {
+        DEBUG_WARN("repack: could not rewrite %s, packing it as stored", hex);
+        replacement = NULL;
+    }
+    bool ok = replacement ? write_all(out_fd, replacement, replacement_size)
+                          : write_all(out_fd, record, (size_t)*length);
+    if (ok && replacement) {
+        *length = replacement_size;
+        *rewritten = true;
+    }
+    free(replacement);
+    free(record);
+    return ok;
+}
+
+/* Write the .pack for the kept items, filling in their new offsets */
+static eb_status_t write_pack_file(const char* tmp_path, const char* root,
+                                   const eb_pack_set_t* old, repack_item_t* items,
+                                   size_t count, eb_pack_idx_entry_t* entries,
+                                   eb_pack_rewrite_fn rewrite, void* rewrite_ctx,
+                                   eb_repack_result_t* stats) {
+    int fd = open(tmp_path, O_CREAT | O_EXCL | O_WRONLY, 0444);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+
+    char* buf = malloc(PACK_COPY_CHUNK);
+    if (!buf) {
+        close(fd);
+        unlink(tmp_path);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    eb_pack_header_t header = {
+        .magic = EB_PACK_MAGIC,
+        .version = EB_PACK_VERSION,
+        .count = (uint32_t)count,
+        .reserved = 0
+    };
+    eb_status_t status = write_all(fd, &header, sizeof(header)) ? EB_SUCCESS : EB_ERROR_FILE_IO;
+    uint64_t offset = sizeof(header);
+
+    for (size_t i = 0; i < count && status == EB_SUCCESS; i++) {
+        repack_item_t* item = &items[i];
+        bool ok;
+
+        if (item->source < 0) {
+            char hex[65], path[PATH_MAX];
+            eb_hash_to_hex(item->hash, hex);
+            int src = eb_object_path(root, hex, "raw", path, sizeof(path)) == 0 ?
+                      open(path, O_RDONLY) : -1;
+            bool rewritten = false;
+            ok = src >= 0 && (rewrite ? copy_rewritten(src, item->hash, &item->length, fd,
+                                                       rewrite, rewrite_ctx, &rewritten)
+                                      : copy_range(src, 0, item->length, fd, buf));
+            if (rewritten)
+                stats->objects_rewritten++;
+            if (src >= 0) close(src);
+        } else {
+            ok = copy_range(old->packs[item->source].pack_fd, (off_t)item->offset,
+                            item->length, fd, buf);
+        }
+
+        if (!ok) {
+            status = EB_ERROR_FILE_IO;
+            break;
+        }
+
+        memcpy(entries[i].hash, item->hash, 32);
+        entries[i].offset = offset;
+        entries[i].length = item->length;
+        offset += item->length;
+    }
+
+    free(buf);
+    if (status == EB_SUCCESS && fsync(fd) != 0)
+        status = EB_ERROR_FILE_IO;
+    close(fd);
+    if (status != EB_SUCCESS) {
+        unlink(tmp_path);
+        return status;
+    }
+    stats->bytes_written = (size_t)offset;
+    return EB_SUCCESS;
+}
+
+static eb_status_t write_idx_file(const char* tmp_path, const eb_pack_idx_entry_t* entries, size_t count) {
+    uint32_t fanout[EB_PACK_FANOUT] = {0};
+    for (size_t i = 0; i < count; i++)
+        fanout[entries[i].hash[0]]++;
+    for (int b = 1; b < EB_PACK_FANOUT; b++)
+        fanout[b] += fanout[b - 1];
+
+    eb_pack_idx_header_t header = {
+        .magic = EB_PACK_IDX_MAGIC,
+        .version = EB_PACK_VERSION,
+        .count = (uint32_t)count,
+        .reserved = 0
+    };
+
+    int fd = open(tmp_path, O_CREAT | O_EXCL | O_WRONLY, 0444);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+
+    bool ok = write_all(fd, &header, sizeof(header)) &&
+              write_all(fd, fanout, sizeof(fanout)) &&
+              write_all(fd, entries, count * sizeof(*entries)) &&
+              fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+static bool entries_contain(const eb_pack_idx_entry_t* entries, size_t count, const uint8_t hash[32]) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(entries[mid].hash, hash, 32);
+        if (cmp == 0) return true;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+/* Pack name: SHA-256 over the sorted binary object hashes */
+static eb_status_t compute_pack_name(const eb_pack_idx_entry_t* entries, size_t count, char name[65]) {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if (!ctx)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    uint8_t digest[32];
+    unsigned int digest_len = 0;
+    bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1;
+    for (size_t i = 0; ok && i < count; i++)
+        ok = EVP_DigestUpdate(ctx, entries[i].hash, 32) == 1;
+    ok = ok && EVP_DigestFinal_ex(ctx, digest, &digest_len) == 1;
+    EVP_MD_CTX_free(ctx);
+
+    if (!ok)
+        return EB_ERROR_COMPUTATION_FAILED;
+    eb_hash_to_hex(digest, name);
+    return EB_SUCCESS;
+}
+
+/* Does the filter drop any object of a pack? */
+static bool pack_has_dropped(const struct eb_pack* pack, eb_pack_keep_fn keep, void* ctx) {
+    char hex[65];
+    for (uint32_t i = 0; i < pack->count; i++) {
+        eb_hash_to_hex(pack->entries[i].hash, hex);
+        if (!keep(hex, pack->mtime, ctx))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Rewrite packs into one new pack. With prune set only the packs the
+ * filter drops an object from are rewritten and loose objects stay;
+ * otherwise every pack and loose object goes into the new one.
+ */
+static eb_status_t repack(const char* root, eb_pack_keep_fn keep, void* ctx,
+                          eb_pack_rewrite_fn rewrite, void* rewrite_ctx, bool prune,
+                          eb_repack_result_t* result) {
+    eb_repack_result_t stats = {0};
+    char objects_dir[PATH_MAX];
+    char pack_dir[PATH_MAX];
+    snprintf(objects_dir, sizeof(objects_dir), "%s/.embr/objects", root);
+    snprintf(pack_dir, sizeof(pack_dir), "%s/%s", objects_dir, EB_PACK_DIR);
+
+    if (mkdir(pack_dir, 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+
+    eb_pack_set_t* old = NULL;
+    eb_status_t status = eb_pack_open(root, &old);
+    if (status != EB_SUCCESS)
+        return status;
+
+    repack_item_t* items = NULL;
+    size_t count = 0, capacity = 0;
+    repack_item_t* kept_items = NULL;
+    eb_pack_idx_entry_t* entries = NULL;
+    bool* replaced = calloc(old->count ? old->count : 1, sizeof(*replaced));
+    if (!replaced) {
+        status = EB_ERROR_MEMORY_ALLOCATION;
+        goto cleanup;
+    }
+
+    /* Gather every packed object, then every loose one */
+    for (size_t p = 0; p < old->count; p++) {
+        const struct eb_pack* pack = &old->packs[p];
+        if (prune && !pack_has_dropped(pack, keep, ctx))
+            continue;
+        replaced[p] = true;
+        for (uint32_t i = 0; i < pack->count; i++) {
+            repack_item_t item = {
+                .source = (long)p,
+                .offset = pack->entries[i].offset,
+                .length = pack->entries[i].length,
+                .mtime = pack->mtime
+            };
+            memcpy(item.hash, pack->entries[i].hash, 32);
+            if (!append_item(&items, &count, &capacity, &item)) {
+                status = EB_ERROR_MEMORY_ALLOCATION;
+                goto cleanup;
+            }
+        }
+    }
+
+    if (!prune) {
+        status = collect_loose(root, &items, &count, &capacity);
+        if (status != EB_SUCCESS)
+            goto cleanup;
+    }
+
+    if (count > 1)
+        qsort(items, count, sizeof(*items), compare_items);
+
+    /* Deduplicate and apply the filter into a separate array; the full
+     * list is needed again afterwards to retire loose copies */
+    kept_items = malloc((count ? count : 1) * sizeof(*kept_items));
+    if (!kept_items) {
+        status = EB_ERROR_MEMORY_ALLOCATION;
+        goto cleanup;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && memcmp(items[i - 1].hash, items[i].hash, 32) == 0)
+            continue;
+        if (keep) {
+            char hex[65];
+            eb_hash_to_hex(items[i].hash, hex);
+            if (!keep(hex, items[i].mtime, ctx)) {
+                stats.objects_dropped++;
+                continue;
+            }
+        }
+        kept_items[kept++] = items[i];
+    }
+
+    if (kept == 0 && stats.objects_dropped == 0) {
+        DEBUG_PRINT("repack: nothing to pack");
+        goto cleanup;
+    }
+
+    char new_name[65] = "";
+    char tmp_pack[PATH_MAX], tmp_idx[PATH_MAX];
+    snprintf(tmp_pack, sizeof(tmp_pack), "%s/tmp-pack-%d.pack", pack_dir, (int)getpid());
+    snprintf(tmp_idx, sizeof(tmp_idx), "%s/tmp-pack-%d.idx", pack_dir, (int)getpid());
+
+    if (kept > 0) {
+        /* Leftovers from an interrupted repack in this pid would block O_EXCL */
+        unlink(tmp_pack);
+        unlink(tmp_idx);
+
+        entries = malloc(kept * sizeof(*entries));
+        if (!entries) {
+            status = EB_ERROR_MEMORY_ALLOCATION;
+            goto cleanup;
+        }
+
+        status = write_pack_file(tmp_pack, root, old, kept_items, kept, entries,
+                                 rewrite, rewrite_ctx, &stats);
+        if (status != EB_SUCCESS)
+            goto cleanup;
+
+        status = compute_pack_name(entries, kept, new_name);
+        if (status == EB_SUCCESS)
+            status = write_idx_file(tmp_idx, entries, kept);
+        if (status != EB_SUCCESS) {
+            unlink(tmp_pack);
+            goto cleanup;
+        }
+
+        char final_pack[PATH_MAX], final_idx[PATH_MAX];
+        snprintf(final_pack, sizeof(final_pack), "%s/pack-%s.pack", pack_dir, new_name);
+        snprintf(final_idx, sizeof(final_idx), "%s/pack-%s.idx", pack_dir, new_name);
+
+        /* Pack first, index last: an index always points at a complete pack */
+        if (rename(tmp_pack, final_pack) != 0 || rename(tmp_idx, final_idx) != 0) {
+            DEBUG_ERROR("repack: failed to install pack-%s: %s", new_name, strerror(errno));
+            unlink(tmp_pack);
+            unlink(tmp_idx);
+            status = EB_ERROR_FILE_IO;
+            goto cleanup;
+        }
+        stats.objects_packed = kept;
+    }
+
+    /* The new pack is durable; retire what it supersedes */
+    for (size_t p = 0; p < old->count; p++) {
+        if (!replaced[p] || strcmp(old->packs[p].name, new_name) == 0)
+            continue;
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/pack-%s.idx", pack_dir, old->packs[p].name);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/pack-%s.pack", pack_dir, old->packs[p].name);
+        if (stat(path, &st) == 0 && unlink(path) == 0)
+            stats.bytes_replaced += (size_t)st.st_size;
+        stats.packs_replaced++;
+    }
+
+    /* Any loose file whose object is now in the new pack is redundant */
+    for (size_t i = 0; i < count && kept > 0; i++) {
+        if (items[i].source >= 0 || !entries_contain(entries, kept, items[i].hash))
+            continue;
+        char hex[65], path[PATH_MAX];
+        eb_hash_to_hex(items[i].hash, hex);
+        if (eb_object_path(root, hex, "raw", path, sizeof(path)) == 0 && unlink(path) == 0)
+            stats.loose_removed++;
+    }
+
+    DEBUG_INFO("repack: packed %zu objects into pack-%s (%zu bytes), removed %zu loose, replaced %zu packs",
+               stats.objects_packed, new_name, stats.bytes_written, stats.loose_removed, stats.packs_replaced);
+
+cleanup:
+    free(replaced);
+    free(entries);
+    free(kept_items);
+    free(items);
+    eb_pack_close(old);
+    if (result)
+        *result = stats;
+    return status;
+}
+
+eb_status_t eb_pack_repack(const char* root, eb_pack_keep_fn keep, void* ctx,
+                           eb_pack_rewrite_fn rewrite, void* rewrite_ctx,
+                           eb_repack_result_t* result) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+    return repack(root, keep, ctx, rewrite, rewrite_ctx, false, result);
+}
+
+eb_status_t eb_pack_prune(const char* root, eb_pack_keep_fn keep, void* ctx,
+                          eb_repack_result_t* result) {
+    if (!root || !keep)
+        return EB_ERROR_INVALID_INPUT;
+    return repack(root, keep, ctx, NULL, NULL, true, result);
+}
+
+/* Position of a build input, ordered by hash for the index */
+typedef struct {
+    uint8_t hash[32];
+    size_t input;
+} build_item_t;
+
+static int compare_build_items(const void* a, const void* b) {
+    const build_item_t* ia = a;
+    const build_item_t* ib = b;
+    int cmp = memcmp(ia->hash, ib->hash, 32);
+    if (cmp) return cmp;
+    return (ia->input > ib->input) - (ia->input < ib->input);
+}
+
+eb_status_t eb_pack_build(const eb_pack_object_t* objects, size_t count,
+                          void** pack_out, size_t* pack_size,
+                          void** idx_out, size_t* idx_size, char name[65]) {
+    if ((!objects && count) || !pack_out || !pack_size || !idx_out || !idx_size || !name)
+        return EB_ERROR_INVALID_INPUT;
+    if (count > UINT32_MAX)
+        return EB_ERROR_INVALID_INPUT;
+
+    build_item_t* items = malloc((count ? count : 1) * sizeof(*items));
+    bool* first = calloc(count ? count : 1, sizeof(*first));
+    if (!items || !first) {
+        free(items);
+        free(first);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!objects[i].data || !eb_hex_to_hash(objects[i].hex_hash, items[i].hash)) {
+            free(items);
+            free(first);
+            return EB_ERROR_INVALID_INPUT;
+        }
+        items[i].input = i;
+    }
+    if (count > 1)
+        qsort(items, count, sizeof(*items), compare_build_items);
+
+    /* A hash given twice is stored once, from its first occurrence */
+    size_t kept = 0;
+    uint64_t records = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && memcmp(items[i - 1].hash, items[i].hash, 32) == 0)
+            continue;
+        first[items[i].input] = true;
+        records += objects[items[i].input].size;
+        kept++;
+    }
+
+    size_t total_idx = sizeof(eb_pack_idx_header_t) + EB_PACK_FANOUT * sizeof(uint32_t) +
+                       kept * sizeof(eb_pack_idx_entry_t);
+    size_t total_pack = sizeof(eb_pack_header_t) + (size_t)records;
+    char* pack = malloc(total_pack);
+    char* idx = malloc(total_idx);
+    uint64_t* offsets = malloc((count ? count : 1) * sizeof(*offsets));
+    if (!pack || !idx || !offsets) {
+        free(pack);
+        free(idx);
+        free(offsets);
+        free(items);
+        free(first);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* Records keep the caller's order, so related objects sit together
+     * when the pack is compressed in transit */
+    eb_pack_header_t header = {
+        .magic = EB_PACK_MAGIC,
+        .version = EB_PACK_VERSION,
+        .count = (uint32_t)kept,
+        .reserved = 0
+    };
+    memcpy(pack, &header, sizeof(header));
+    uint64_t offset = sizeof(header);
+    for (size_t i = 0; i < count; i++) {
+        if (!first[i])
+            continue;
+        memcpy(pack + offset, objects[i].data, objects[i].size);
+        offsets[i] = offset;
+        offset += objects[i].size;
+    }
+
+    eb_pack_idx_header_t idx_header = {
+        .magic = EB_PACK_IDX_MAGIC,
+        .version = EB_PACK_VERSION,
+        .count = (uint32_t)kept,
+        .reserved = 0
+    };
+    uint32_t* fanout = (uint32_t*)(idx + sizeof(idx_header));
+    eb_pack_idx_entry_t* entries = (eb_pack_idx_entry_t*)(fanout + EB_PACK_FANOUT);
+    memcpy(idx, &idx_header, sizeof(idx_header));
+    memset(fanout, 0, EB_PACK_FANOUT * sizeof(uint32_t));
+    size_t e = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && memcmp(items[i - 1].hash, items[i].hash, 32) == 0)
+            continue;
+        memcpy(entries[e].hash, items[i].hash, 32);
+        entries[e].offset = offsets[items[i].input];
+        entries[e].length = objects[items[i].input].size;
+        fanout[items[i].hash[0]]++;
+        e++;
+    }
+    for (int b = 1; b < EB_PACK_FANOUT; b++)
+        fanout[b] += fanout[b - 1];
+
+    free(offsets);
+    free(items);
+    free(first);
+
+    eb_status_t status = compute_pack_name(entries, kept, name);
+    if (status != EB_SUCCESS) {
+        free(pack);
+        free(idx);
+        return status;
+    }
+    *pack_out = pack;
+    *pack_size = total_pack;
+    *idx_out = idx;
+    *idx_size = total_idx;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_pack_idx_lookup(const void* idx, size_t idx_size, const char* hex_hash,
+                               uint64_t* out_offset, uint64_t* out_length) {
+    if (!idx || !hex_hash || !out_offset || !out_length)
+        return EB_ERROR_INVALID_INPUT;
+
+    struct eb_pack pack = { .pack_fd = -1 };
+    uint8_t hash[32];
+    if (!idx_parse(idx, idx_size, &pack))
+        return EB_ERROR_INVALID_FORMAT;
+    if (!eb_hex_to_hash(hex_hash, hash))
+        return EB_ERROR_INVALID_INPUT;
+
+    const eb_pack_idx_entry_t* entry = pack_find(&pack, hash);
+    if (!entry)
+        return EB_ERROR_NOT_FOUND;
+    *out_offset = entry->offset;
+    *out_length = entry->length;
+    return EB_SUCCESS;
+}
+
+size_t eb_pack_idx_count(const void* idx, size_t idx_size) {
+    struct eb_pack pack = { .pack_fd = -1 };
+    return idx && idx_parse(idx, idx_size, &pack) ? pack.count : 0;
+}
+
+const eb_pack_idx_entry_t* eb_pack_idx_entries(const void* idx, size_t idx_size, size_t* count) {
+    struct eb_pack pack = { .pack_fd = -1 };
+    if (!idx || !count || !idx_parse(idx, idx_size, &pack))
+        return NULL;
+    *count = pack.count;
+    return pack.entries;
+}
+
+bool eb_pack_installed(const char* root, const char* name) {
+    if (!root || !name)
+        return false;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.embr/objects/%s/pack-%s.idx", root, EB_PACK_DIR, name);
+    return access(path, F_OK) == 0;
+}
+
+/* Write a whole file under a temporary name that is not yet in use */
+static eb_status_t write_new_file(const char* path, const void* data, size_t size) {
+    unlink(path);
+    int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0444);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+    bool ok = write_all(fd, data, size) && fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        unlink(path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_pack_install(const char* root, const void* pack, size_t pack_size,
+                            const void* idx, size_t idx_size, char name[65]) {
+    if (!root || !pack || !idx || !name)
+        return EB_ERROR_INVALID_INPUT;
+
+    /* Only accept a pack whose index covers exactly its records */
+    struct eb_pack parsed = { .pack_fd = -1 };
+    const eb_pack_header_t* header = pack;
+    if (!idx_parse(idx, idx_size, &parsed) || pack_size < sizeof(*header) ||
+        header->magic != EB_PACK_MAGIC || header->version != EB_PACK_VERSION ||
+        header->count != parsed.count)
+        return EB_ERROR_INVALID_FORMAT;
+    for (uint32_t i = 0; i < parsed.count; i++) {
+        const eb_pack_idx_entry_t* entry = &parsed.entries[i];
+        if (entry->offset < sizeof(*header) || entry->offset > pack_size ||
+            entry->length > pack_size - entry->offset ||
+            (i > 0 && memcmp(parsed.entries[i - 1].hash, entry->hash, 32) >= 0))
+            return EB_ERROR_INVALID_FORMAT;
+    }
+
+    eb_status_t status = compute_pack_name(parsed.entries, parsed.count, name);
+    if (status != EB_SUCCESS)
+        return status;
+    if (eb_pack_installed(root, name))
+        return EB_SUCCESS;
+
+    char pack_dir[PATH_MAX];
+    snprintf(pack_dir, sizeof(pack_dir), "%s/.embr/objects/%s", root, EB_PACK_DIR);
+    if (mkdir(pack_dir, 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+
+    char tmp_pack[PATH_MAX], tmp_idx[PATH_MAX];
+    char final_pack[PATH_MAX], final_idx[PATH_MAX];
+    snprintf(tmp_pack, sizeof(tmp_pack), "%s/tmp-fetch-%d.pack", pack_dir, (int)getpid());
+    snprintf(tmp_idx, sizeof(tmp_idx), "%s/tmp-fetch-%d.idx", pack_dir, (int)getpid());
+    snprintf(final_pack, sizeof(final_pack), "%s/pack-%s.pack", pack_dir, name);
+    snprintf(final_idx, sizeof(final_idx), "%s/pack-%s.idx", pack_dir, name);
+
+    status = write_new_file(tmp_pack, pack, pack_size);
+    if (status == EB_SUCCESS) {
+        status = write_new_file(tmp_idx, idx, idx_size);
+        if (status != EB_SUCCESS)
+            unlink(tmp_pack);
+    }
+    if (status != EB_SUCCESS)
+        return status;
+
+    /* Pack first, index last, as in repack */
+    if (rename(tmp_pack, final_pack) != 0 || rename(tmp_idx, final_idx) != 0) {
+        DEBUG_ERROR("pack: failed to install pack-%s: %s", name, strerror(errno));
+        unlink(tmp_pack);
+        unlink(tmp_idx);
+        return EB_ERROR_FILE_IO;
+    }
+    DEBUG_INFO("pack: installed pack-%s (%u objects)", name, parsed.count);
+    return EB_SUCCESS;
+}
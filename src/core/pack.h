@@ -0,0 +1,317 @@
+/*
+ * EmbeddingBridge - Packfile Storage
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_PACK_H
+#define EB_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "status.h"
+
+/*
+ * Packs live in .embr/objects/pack as a pair of files:
+ *
+ *   pack-<name>.pack  header followed by complete object records, each one
+ *                     byte-for-byte identical to a loose <hash>.raw file
+ *   pack-<name>.idx   header, 256-entry cumulative fan-out table over the
+ *                     first hash byte, then entries sorted by hash
+ *
+ * <name> is the SHA-256 of the sorted object hashes contained in the pack.
+ * The .idx is renamed into place last, so readers only ever see packs
+ * that were written completely.
+ */
+
+#define EB_PACK_MAGIC     0x4542504B  /* "EBPK" */
+#define EB_PACK_IDX_MAGIC 0x45425049  /* "EBPI" */
+#define EB_PACK_VERSION   1
+#define EB_PACK_FANOUT    256
+#define EB_PACK_DIR       "pack"
+
+typedef struct {
+    uint32_t magic;     /* EB_PACK_MAGIC */
+    uint32_t version;   /* EB_PACK_VERSION */
+    uint32_t count;     /* Number of object records */
+    uint32_t reserved;
+} eb_pack_header_t;
+
+typedef struct {
+    uint32_t magic;     /* EB_PACK_IDX_MAGIC */
+    uint32_t version;   /* EB_PACK_VERSION */
+    uint32_t count;     /* Number of index entries */
+    uint32_t reserved;
+} eb_pack_idx_header_t;
+
+typedef struct {
+    uint8_t hash[32];   /* Binary SHA-256 of the object */
+    uint64_t offset;    /* Offset of the record in the .pack file */
+    uint64_t length;    /* Length of the record in bytes */
+} eb_pack_idx_entry_t;
+
+/* Opaque collection of all packs of one repository */
+typedef struct eb_pack_set eb_pack_set_t;
+
+/* Result of a repack operation */
+typedef struct {
+    size_t objects_packed;   /* Objects written to the new pack */
+    size_t loose_removed;    /* Loose objects deleted after packing */
+    size_t objects_dropped;  /* Objects rejected by the keep filter */
+    size_t packs_replaced;   /* Old packs superseded by the new one */
+    size_t bytes_written;    /* Size of the new .pack file */
+    size_t objects_rewritten;/* Loose records replaced by the rewrite callback */
+    size_t bytes_replaced;   /* Size of the .pack files of the superseded packs */
+} eb_repack_result_t;
+
+/**
+ * Callback deciding whether an object survives a repack
+ *
+ * @param hex_hash Full 64-character object hash
+ * @param mtime Modification time of the loose file or containing pack
+ * @param ctx Caller context
+ * @return true to keep the object, false to drop it
+ */
+typedef bool (*eb_pack_keep_fn)(const char* hex_hash, time_t mtime, void* ctx);
+
+/**
+ * Callback that may re-encode a loose object as it moves into a pack
+ *
+ * The replacement must decode to the same object; the pack stores it
+ * under the same hash.
+ *
+ * @param ctx Caller context
+ * @param hex_hash Full 64-character object hash
+ * @param record Loose record as stored
+ * @param size Size of record
+ * @param out Receives a replacement (malloc'd), or NULL to pack record as it is
+ * @param out_size Receives the size of the replacement
+ * @return Status code; on failure the record is packed as it is
+ */
+typedef eb_status_t (*eb_pack_rewrite_fn)(void* ctx, const char* hex_hash, const void* record,
+                                          size_t size, void** out, size_t* out_size);
+
+/**
+ * Callback invoked for each packed object
+ *
+ * @param hex_hash Full 64-character object hash
+ * @param length Size of the stored record in bytes
+ * @param mtime Modification time of the containing pack
+ * @param ctx Caller context
+ * @return 0 to continue, non-zero to stop iteration
+ */
+typedef int (*eb_pack_visit_fn)(const char* hex_hash, uint64_t length, time_t mtime, void* ctx);
+
+/**
+ * Open every pack index below <root>/.embr/objects/pack
+ *
+ * A repository without packs yields an empty set, not an error.
+ *
+ * @param root Repository root (directory containing .embr)
+ * @param out Receives the pack set, free with eb_pack_close()
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_pack_open(const char* root, eb_pack_set_t** out);
+
+/**
+ * Release a pack set and unmap its indexes
+ *
+ * @param packs Pack set (may be NULL)
+ */
+void eb_pack_close(eb_pack_set_t* packs);
+
+/**
+ * Number of distinct packs and total indexed objects in a set
+ */
+size_t eb_pack_count(const eb_pack_set_t* packs);
+size_t eb_pack_object_count(const eb_pack_set_t* packs);
+
+/**
+ * Check whether an object is stored in any pack
+ *
+ * @param packs Pack set
+ * @param hex_hash Full 64-character object hash
+ * @return true if the object is packed
+ */
+bool eb_pack_contains(const eb_pack_set_t* packs, const char* hex_hash);
+
+/**
+ * Read the raw record of a packed object
+ *
+ * The returned bytes have exactly the layout of a loose .raw file
+ * (eb_object_header_t followed by the stored payload).
+ *
+ * @param packs Pack set
+ * @param hex_hash Full 64-character object hash
+ * @param out_data Receives a malloc'd copy of the record
+ * @param out_size Receives the record size
+ * @return EB_SUCCESS, EB_ERROR_NOT_FOUND or an I/O error
+ */
+eb_status_t eb_pack_read(const eb_pack_set_t* packs, const char* hex_hash,
+                         void** out_data, size_t* out_size);
+
+/**
+ * Find where the record of a packed object is stored, for mapping it
+ *
+ * @param packs Pack set
+ * @param hex_hash Full 64-character object hash
+ * @param out_fd Receives the .pack descriptor, owned by the pack set
+ * @param out_offset Receives the record offset in the .pack file
+ * @param out_length Receives the record length
+ * @return EB_SUCCESS or EB_ERROR_NOT_FOUND
+ */
+eb_status_t eb_pack_locate(const eb_pack_set_t* packs, const char* hex_hash,
+                           int* out_fd, uint64_t* out_offset, uint64_t* out_length);
+
+/**
+ * Resolve a hex prefix against the pack indexes
+ *
+ * Uses the fan-out table and a binary search in each index, so the cost
+ * is O(log n) per pack.
+ *
+ * @param packs Pack set
+ * @param prefix Hex prefix (any length up to 64)
+ * @param full_hash Receives the unique match
+ * @return EB_SUCCESS, EB_ERROR_NOT_FOUND or EB_ERROR_HASH_AMBIGUOUS
+ */
+eb_status_t eb_pack_resolve_prefix(const eb_pack_set_t* packs, const char* prefix,
+                                   char full_hash[65]);
+
+/**
+ * Visit every packed object
+ *
+ * Objects that appear in several packs are visited once per pack.
+ *
+ * @param packs Pack set
+ * @param fn Callback
+ * @param ctx Callback context
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_pack_foreach(const eb_pack_set_t* packs, eb_pack_visit_fn fn, void* ctx);
+
+/**
+ * Pack all loose objects and existing packs into a single new pack
+ *
+ * Loose .raw files that made it into the new pack are removed afterwards,
+ * as are the packs it supersedes. Metadata sidecars (.meta) stay loose.
+ *
+ * @param root Repository root (directory containing .embr)
+ * @param keep Optional filter, NULL keeps everything
+ * @param ctx Filter context
+ * @param rewrite Optional re-encoding of loose records; packed ones are copied
+ * @param rewrite_ctx Context of rewrite
+ * @param result Optional operation statistics
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_pack_repack(const char* root, eb_pack_keep_fn keep, void* ctx,
+                           eb_pack_rewrite_fn rewrite, void* rewrite_ctx,
+                           eb_repack_result_t* result);
+
+/**
+ * Drop the objects a filter rejects from the packs holding them
+ *
+ * Only the packs with an object to drop are rewritten, into one new pack
+ * of the objects they keep. Other packs and loose objects are left as
+ * they are.
+ *
+ * @param root Repository root (directory containing .embr)
+ * @param keep Filter
+ * @param ctx Filter context
+ * @param result Optional operation statistics
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_pack_prune(const char* root, eb_pack_keep_fn keep, void* ctx,
+                          eb_repack_result_t* result);
+
+/*
+ * Packs in transit
+ *
+ * Push bundles objects into a pack built in memory, pull installs packs it
+ * fetched (or records it fetched by range through a remote's .idx) into
+ * the local pack directory. The formats are the on-disk ones above.
+ */
+
+/* One object to pack */
+typedef struct {
+    const char* hex_hash;   /* Full 64-character object hash */
+    const void* data;       /* Record, laid out like a loose .raw file */
+    size_t size;            /* Record size */
+} eb_pack_object_t;
+
+/**
+ * Build a pack and its index in memory
+ *
+ * Records are stored in the order given, an object given twice is stored
+ * once.
+ *
+ * @param objects Objects to pack
+ * @param count Number of objects
+ * @param pack_out Receives the malloc'd .pack image
+ * @param pack_size Receives its size
+ * @param idx_out Receives the malloc'd .idx image
+ * @param idx_size Receives its size
+ * @param name Receives the pack name
+ * @return Status code (EB_ERROR_INVALID_INPUT for a malformed hash)
+ */
+eb_status_t eb_pack_build(const eb_pack_object_t* objects, size_t count,
+                          void** pack_out, size_t* pack_size,
+                          void** idx_out, size_t* idx_size, char name[65]);
+
+/**
+ * Find an object in an .idx image
+ *
+ * @param idx Index image
+ * @param idx_size Size of the image
+ * @param hex_hash Full 64-character object hash
+ * @param out_offset Receives the record offset in the .pack
+ * @param out_length Receives the record length
+ * @return EB_SUCCESS, EB_ERROR_NOT_FOUND or EB_ERROR_INVALID_FORMAT
+ */
+eb_status_t eb_pack_idx_lookup(const void* idx, size_t idx_size, const char* hex_hash,
+                               uint64_t* out_offset, uint64_t* out_length);
+
+/**
+ * Number of objects in an .idx image, 0 if it is malformed
+ */
+size_t eb_pack_idx_count(const void* idx, size_t idx_size);
+
+/**
+ * Entries of an .idx image, sorted by hash
+ *
+ * @param idx Index image
+ * @param idx_size Size of the image
+ * @param count Receives the number of entries
+ * @return The entries inside idx, NULL if it is malformed
+ */
+const eb_pack_idx_entry_t* eb_pack_idx_entries(const void* idx, size_t idx_size, size_t* count);
+
+/**
+ * Check whether a pack is already in <root>/.embr/objects/pack
+ */
+bool eb_pack_installed(const char* root, const char* name);
+
+/**
+ * Install a fetched pack into <root>/.embr/objects/pack
+ *
+ * The index must describe exactly the records of the pack. The name is
+ * recomputed from the index, so a pack cannot be installed under a name
+ * that does not match its contents.
+ *
+ * @param root Repository root (directory containing .embr)
+ * @param pack .pack image
+ * @param pack_size Size of the .pack image
+ * @param idx .idx image
+ * @param idx_size Size of the .idx image
+ * @param name Receives the pack name
+ * @return Status code (EB_ERROR_INVALID_FORMAT for an inconsistent pack)
+ */
+eb_status_t eb_pack_install(const char* root, const void* pack, size_t pack_size,
+                            const void* idx, size_t idx_size, char name[65]);
+
+#endif /* EB_PACK_H */
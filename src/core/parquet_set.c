@@ -0,0 +1,602 @@
+/*
+ * EmbeddingBridge - Set-Level Parquet Export Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include <arrow-glib/arrow-glib.h>
+#include <parquet-glib/parquet-glib.h>
+#include <glib.h>
+
+#include "parquet_set.h"
+#include "parquet_transformer.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Row groups never get smaller than this, whatever the dimensions */
+#define MIN_ROW_GROUP_ROWS 1024
+
+struct eb_parquet_set_writer {
+    char dir[PATH_MAX];
+    char prefix[128];
+    uint32_t dims;
+    size_t group_rows;                    /* Rows per row group */
+    uint64_t file_bytes;                  /* Vector bytes after which a file is closed */
+    eb_parquet_set_format_t format;
+    eb_parquet_writer_options_t tuning;
+
+    GArrowSchema* schema;
+    GArrowFixedSizeListDataType* values_type;
+
+    /* Open file: a Parquet writer, or the record batches of an IPC file */
+    bool file_open;
+    GParquetArrowFileWriter* file;
+    GList* batches;
+    uint64_t file_written;
+
+    /* Buffered row group, handed to Arrow when it is written */
+    float* values;
+    int64_t* timestamps;
+    char** ids;
+    char** sources;
+    char** models;
+    size_t rows;
+
+    /* Files written so far, the open one included */
+    char** files;
+    size_t file_count;
+};
+
+static eb_status_t gerror_status(const char* what, GError* error) {
+    DEBUG_ERROR("parquet_set: %s: %s", what, error ? error->message : "unknown error");
+    if (error)
+        g_error_free(error);
+    return EB_ERROR_IO;
+}
+
+static void free_strings(char** strings, size_t count) {
+    for (size_t i = 0; strings && i < count; i++) {
+        free(strings[i]);
+        strings[i] = NULL;
+    }
+}
+
+static eb_status_t build_schema(eb_parquet_set_writer_t* writer) {
+    GArrowDataType* float_type = GARROW_DATA_TYPE(garrow_float_data_type_new());
+    writer->values_type = garrow_fixed_size_list_data_type_new_data_type(float_type, (gint32)writer->dims);
+    g_object_unref(float_type);
+    if (!writer->values_type)
+        return EB_ERROR_IO;
+
+    GArrowDataType* string_type = GARROW_DATA_TYPE(garrow_string_data_type_new());
+    GArrowDataType* int64_type = GARROW_DATA_TYPE(garrow_int64_data_type_new());
+    GList* fields = NULL;
+    fields = g_list_append(fields, garrow_field_new("id", string_type));
+    fields = g_list_append(fields, garrow_field_new("values", GARROW_DATA_TYPE(writer->values_type)));
+    fields = g_list_append(fields, garrow_field_new("source", string_type));
+    fields = g_list_append(fields, garrow_field_new("model", string_type));
+    fields = g_list_append(fields, garrow_field_new("timestamp", int64_type));
+    writer->schema = garrow_schema_new(fields);
+    g_list_free_full(fields, g_object_unref);
+    g_object_unref(string_type);
+    g_object_unref(int64_type);
+    return writer->schema ? EB_SUCCESS : EB_ERROR_IO;
+}
+
+/* Allocate the buffers of the next row group */
+static eb_status_t alloc_group(eb_parquet_set_writer_t* writer) {
+    writer->values = malloc(writer->group_rows * writer->dims * sizeof(float));
+    writer->timestamps = malloc(writer->group_rows * sizeof(int64_t));
+    if (!writer->values || !writer->timestamps) {
+        free(writer->values);
+        free(writer->timestamps);
+        writer->values = NULL;
+        writer->timestamps = NULL;
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_parquet_set_writer_open(const char* dir, const char* prefix, uint32_t dims,
+                                       const eb_parquet_set_options_t* options,
+                                       eb_parquet_set_writer_t** writer_out) {
+    if (!dir || !prefix || dims == 0 || !writer_out)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    eb_parquet_set_writer_t* writer = calloc(1, sizeof(*writer));
+    if (!writer)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    snprintf(writer->dir, sizeof(writer->dir), "%s", dir);
+    snprintf(writer->prefix, sizeof(writer->prefix), "%s", prefix);
+    writer->dims = dims;
+
+    size_t group_bytes = options && options->row_group_bytes ? options->row_group_bytes
+                                                             : EB_PARQUET_SET_ROW_GROUP_BYTES;
+    writer->group_rows = group_bytes / ((size_t)dims * sizeof(float));
+    if (writer->group_rows < MIN_ROW_GROUP_ROWS)
+        writer->group_rows = MIN_ROW_GROUP_ROWS;
+    if (options)
+        writer->tuning = options->tuning;
+    if (writer->tuning.row_group_rows)
+        writer->group_rows = (size_t)writer->tuning.row_group_rows;
+    writer->file_bytes = options && options->file_bytes ? options->file_bytes : EB_PARQUET_SET_FILE_BYTES;
+    writer->format = options ? options->format : EB_PARQUET_SET_PARQUET;
+
+    writer->ids = calloc(writer->group_rows, sizeof(char*));
+    writer->sources = calloc(writer->group_rows, sizeof(char*));
+    writer->models = calloc(writer->group_rows, sizeof(char*));
+    eb_status_t status = writer->ids && writer->sources && writer->models ? alloc_group(writer)
+                                                                          : EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS)
+        status = build_schema(writer);
+    if (status != EB_SUCCESS) {
+        eb_parquet_set_writer_abort(writer);
+        return status;
+    }
+
+    DEBUG_INFO("parquet_set: %u dimensions, %zu rows per row group", dims, writer->group_rows);
+    *writer_out = writer;
+    return EB_SUCCESS;
+}
+
+/* Open the next file of the set */
+static eb_status_t open_file(eb_parquet_set_writer_t* writer) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s-%05zu.%s", writer->dir, writer->prefix, writer->file_count,
+             writer->format == EB_PARQUET_SET_PARQUET ? "parquet" : "arrow");
+    char** files = realloc(writer->files, (writer->file_count + 1) * sizeof(char*));
+    if (!files)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    writer->files = files;
+    if (!(writer->files[writer->file_count] = strdup(path)))
+        return EB_ERROR_MEMORY_ALLOCATION;
+    writer->file_count++;
+    writer->file_written = 0;
+
+    /* IPC files are written whole when they are closed */
+    if (writer->format != EB_PARQUET_SET_PARQUET) {
+        writer->file_open = true;
+        return EB_SUCCESS;
+    }
+
+    GError* error = NULL;
+    GArrowFileOutputStream* stream = garrow_file_output_stream_new(path, FALSE, &error);
+    if (!stream)
+        return gerror_status("cannot create file", error);
+
+    /* One row group per write: a full group never spills into a second one */
+    GParquetWriterProperties* props = gparquet_writer_properties_new();
+    gparquet_writer_properties_set_compression(props, GARROW_COMPRESSION_TYPE_ZSTD, "*");
+    gparquet_writer_properties_set_max_row_group_length(props, (gint64)writer->group_rows);
+    eb_parquet_writer_properties_apply(props, &writer->tuning);
+    writer->file = gparquet_arrow_file_writer_new_arrow(writer->schema, GARROW_OUTPUT_STREAM(stream),
+                                                        props, &error);
+    g_object_unref(props);
+    g_object_unref(stream);
+    if (!writer->file)
+        return gerror_status("cannot create Parquet writer", error);
+    writer->file_open = true;
+    return EB_SUCCESS;
+}
+
+/* Write the gathered record batches as the Arrow IPC file last opened */
+static eb_status_t write_arrow_file(eb_parquet_set_writer_t* writer) {
+    guint count = g_list_length(writer->batches);
+    GArrowRecordBatch** batches = g_new(GArrowRecordBatch*, count);
+    guint i = 0;
+    for (GList* node = writer->batches; node; node = node->next)
+        batches[i++] = node->data;
+    GError* error = NULL;
+    GArrowTable* table = garrow_table_new_record_batches(writer->schema, batches, count, &error);
+    g_free(batches);
+    g_list_free_full(writer->batches, g_object_unref);
+    writer->batches = NULL;
+    if (!table)
+        return gerror_status("cannot build table", error);
+
+    GArrowFileOutputStream* stream =
+        garrow_file_output_stream_new(writer->files[writer->file_count - 1], FALSE, &error);
+    if (!stream) {
+        g_object_unref(table);
+        return gerror_status("cannot create file", error);
+    }
+    /* Feather compresses with LZ4 by default, mapped files must not be */
+    GArrowFeatherWriteProperties* props = garrow_feather_write_properties_new();
+    g_object_set(props, "compression", writer->format == EB_PARQUET_SET_ARROW_LZ4
+                 ? GARROW_COMPRESSION_TYPE_LZ4 : GARROW_COMPRESSION_TYPE_UNCOMPRESSED, NULL);
+    gboolean written = garrow_table_write_as_feather(table, GARROW_OUTPUT_STREAM(stream), props, &error);
+    if (written)
+        written = garrow_file_close(GARROW_FILE(stream), &error);
+    g_object_unref(props);
+    g_object_unref(stream);
+    g_object_unref(table);
+    return written ? EB_SUCCESS : gerror_status("cannot write Arrow file", error);
+}
+
+static eb_status_t close_file(eb_parquet_set_writer_t* writer) {
+    if (!writer->file_open)
+        return EB_SUCCESS;
+    writer->file_open = false;
+    if (writer->format != EB_PARQUET_SET_PARQUET)
+        return write_arrow_file(writer);
+    GError* error = NULL;
+    gboolean closed = gparquet_arrow_file_writer_close(writer->file, &error);
+    g_object_unref(writer->file);
+    writer->file = NULL;
+    return closed ? EB_SUCCESS : gerror_status("cannot close file", error);
+}
+
+/* String column of the buffered rows, NULL entries as nulls */
+static GArrowArray* string_column(char** strings, size_t count, GError** error) {
+    GArrowStringArrayBuilder* builder = garrow_string_array_builder_new();
+    gboolean ok = TRUE;
+    for (size_t i = 0; ok && i < count; i++) {
+        if (strings[i])
+            ok = garrow_string_array_builder_append_string(builder, strings[i], error);
+        else
+            ok = garrow_array_builder_append_null(GARROW_ARRAY_BUILDER(builder), error);
+    }
+    GArrowArray* array = ok ? garrow_array_builder_finish(GARROW_ARRAY_BUILDER(builder), error) : NULL;
+    g_object_unref(builder);
+    return array;
+}
+
+/* Fixed-width column over a buffer Arrow takes ownership of */
+static GArrowBuffer* take_buffer(void* data, size_t size) {
+    GBytes* bytes = g_bytes_new_take(data, size);
+    GArrowBuffer* buffer = garrow_buffer_new_bytes(bytes);
+    g_bytes_unref(bytes);
+    return buffer;
+}
+
+/* Write the buffered rows as one row group */
+static eb_status_t flush_group(eb_parquet_set_writer_t* writer) {
+    if (writer->rows == 0)
+        return EB_SUCCESS;
+
+    eb_status_t status = writer->file_open ? EB_SUCCESS : open_file(writer);
+    if (status != EB_SUCCESS)
+        return status;
+
+    size_t rows = writer->rows;
+    GError* error = NULL;
+    GList* columns = NULL;
+
+    GArrowArray* ids = string_column(writer->ids, rows, &error);
+    if (!ids)
+        return gerror_status("cannot build id column", error);
+    columns = g_list_append(columns, ids);
+
+    GArrowBuffer* value_data = take_buffer(writer->values, rows * writer->dims * sizeof(float));
+    writer->values = NULL;
+    GArrowFloatArray* floats = garrow_float_array_new((gint64)(rows * writer->dims), value_data, NULL, 0);
+    g_object_unref(value_data);
+    GArrowFixedSizeListArray* values =
+        garrow_fixed_size_list_array_new_data_type(writer->values_type, GARROW_ARRAY(floats), NULL, 0, &error);
+    g_object_unref(floats);
+    if (!values) {
+        g_list_free_full(columns, g_object_unref);
+        return gerror_status("cannot build values column", error);
+    }
+    columns = g_list_append(columns, values);
+
+    GArrowArray* sources = string_column(writer->sources, rows, &error);
+    GArrowArray* models = sources ? string_column(writer->models, rows, &error) : NULL;
+    if (!sources || !models) {
+        if (sources)
+            g_object_unref(sources);
+        g_list_free_full(columns, g_object_unref);
+        return gerror_status("cannot build metadata columns", error);
+    }
+    columns = g_list_append(columns, sources);
+    columns = g_list_append(columns, models);
+
+    GArrowBuffer* timestamp_data = take_buffer(writer->timestamps, rows * sizeof(int64_t));
+    writer->timestamps = NULL;
+    columns = g_list_append(columns, garrow_int64_array_new((gint64)rows, timestamp_data, NULL, 0));
+    g_object_unref(timestamp_data);
+
+    GArrowRecordBatch* batch = garrow_record_batch_new(writer->schema, (guint32)rows, columns, &error);
+    g_list_free_full(columns, g_object_unref);
+    if (!batch)
+        return gerror_status("cannot build record batch", error);
+    if (writer->format != EB_PARQUET_SET_PARQUET) {
+        writer->batches = g_list_append(writer->batches, batch);
+    } else {
+        GArrowTable* table = garrow_table_new_record_batches(writer->schema, &batch, 1, &error);
+        g_object_unref(batch);
+        if (!table)
+            return gerror_status("cannot build table", error);
+        gboolean written = gparquet_arrow_file_writer_write_table(writer->file, table, (gsize)rows, &error);
+        g_object_unref(table);
+        if (!written)
+            return gerror_status("cannot write row group", error);
+    }
+
+    free_strings(writer->ids, rows);
+    free_strings(writer->sources, rows);
+    free_strings(writer->models, rows);
+    writer->rows = 0;
+    writer->file_written += (uint64_t)rows * writer->dims * sizeof(float);
+
+    /* The next row group starts a new file once this one is full */
+    if (writer->file_written >= writer->file_bytes)
+        status = close_file(writer);
+    return status;
+}
+
+eb_status_t eb_parquet_set_writer_add(eb_parquet_set_writer_t* writer, const eb_parquet_set_row_t* row) {
+    if (!writer || !row || !row->id || !row->values)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    if (!writer->values) {
+        eb_status_t status = alloc_group(writer);
+        if (status != EB_SUCCESS)
+            return status;
+    }
+
+    size_t i = writer->rows;
+    writer->ids[i] = strdup(row->id);
+    writer->sources[i] = row->source ? strdup(row->source) : NULL;
+    writer->models[i] = row->model ? strdup(row->model) : NULL;
+    if (!writer->ids[i] || (row->source && !writer->sources[i]) || (row->model && !writer->models[i])) {
+        free_strings(writer->ids + i, 1);
+        free_strings(writer->sources + i, 1);
+        free_strings(writer->models + i, 1);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    memcpy(writer->values + i * writer->dims, row->values, writer->dims * sizeof(float));
+    writer->timestamps[i] = row->timestamp;
+    writer->rows++;
+
+    return writer->rows == writer->group_rows ? flush_group(writer) : EB_SUCCESS;
+}
+
+static void free_writer(eb_parquet_set_writer_t* writer, bool remove_files) {
+    if (writer->file)
+        g_object_unref(writer->file);
+    g_list_free_full(writer->batches, g_object_unref);
+    if (writer->schema)
+        g_object_unref(writer->schema);
+    if (writer->values_type)
+        g_object_unref(writer->values_type);
+    free_strings(writer->ids, writer->rows);
+    free_strings(writer->sources, writer->rows);
+    free_strings(writer->models, writer->rows);
+    free(writer->ids);
+    free(writer->sources);
+    free(writer->models);
+    free(writer->values);
+    free(writer->timestamps);
+    for (size_t i = 0; i < writer->file_count; i++) {
+        if (remove_files)
+            unlink(writer->files[i]);
+        free(writer->files[i]);
+    }
+    free(writer->files);
+    free(writer);
+}
+
+void eb_parquet_set_writer_abort(eb_parquet_set_writer_t* writer) {
+    if (writer)
+        free_writer(writer, true);
+}
+
+eb_status_t eb_parquet_set_writer_close(eb_parquet_set_writer_t* writer, char*** files_out, size_t* count_out) {
+    if (!writer)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    eb_status_t status = flush_group(writer);
+    if (status == EB_SUCCESS)
+        status = close_file(writer);
+    if (status != EB_SUCCESS) {
+        eb_parquet_set_writer_abort(writer);
+        return status;
+    }
+
+    if (files_out) {
+        *files_out = writer->files;
+        writer->files = NULL;
+    }
+    if (count_out)
+        *count_out = writer->file_count;
+    if (files_out)
+        writer->file_count = 0;
+    free_writer(writer, false);
+    return EB_SUCCESS;
+}
+
+/*
+ * Whether a row group can hold rows whose string column equals value
+ *
+ * The set schema has one leaf per field (values being a single list of
+ * floats), so field indexes are also Parquet column indexes.
+ */
+static bool group_may_match(GParquetFileMetadata* metadata, gint group, gint column, const char* value) {
+    GError* error = NULL;
+    GParquetRowGroupMetadata* row_group = gparquet_file_metadata_get_row_group(metadata, group, &error);
+    if (!row_group) {
+        g_clear_error(&error);
+        return true;
+    }
+    GParquetColumnChunkMetadata* chunk = gparquet_row_group_metadata_get_column_chunk(row_group, column, &error);
+    g_object_unref(row_group);
+    if (!chunk) {
+        g_clear_error(&error);
+        return true;
+    }
+    GParquetStatistics* stats = gparquet_column_chunk_metadata_get_statistics(chunk);
+    g_object_unref(chunk);
+    if (!stats)
+        return true;
+
+    bool may_match = true;
+    if (GPARQUET_IS_BYTE_ARRAY_STATISTICS(stats) && gparquet_statistics_has_min_max(stats)) {
+        GBytes* min = gparquet_byte_array_statistics_get_min(GPARQUET_BYTE_ARRAY_STATISTICS(stats));
+        GBytes* max = gparquet_byte_array_statistics_get_max(GPARQUET_BYTE_ARRAY_STATISTICS(stats));
+        GBytes* key = g_bytes_new_static(value, strlen(value));
+        /* Byte arrays are ordered as unsigned bytes, as g_bytes_compare does */
+        may_match = g_bytes_compare(key, min) >= 0 && g_bytes_compare(key, max) <= 0;
+        g_bytes_unref(key);
+    }
+    g_object_unref(stats);
+    return may_match;
+}
+
+/* String of a row, NULL for nulls; freed with g_free */
+static gchar* row_string(GArrowArray* array, gint64 i) {
+    if (!array || garrow_array_is_null(array, i))
+        return NULL;
+    return garrow_string_array_get_string(GARROW_STRING_ARRAY(array), i);
+}
+
+static bool string_matches(const char* wanted, const gchar* value) {
+    return !wanted || (value && strcmp(wanted, value) == 0);
+}
+
+/* Columns a scan reads, in this order; values only when asked for */
+static const char* SCAN_COLUMNS[] = { "id", "source", "model", "timestamp", "values" };
+
+/* One column of a projected row group, combined into a single array */
+static GArrowArray* group_column(GArrowTable* table, const char* name, GError** error) {
+    GArrowSchema* schema = garrow_table_get_schema(table);
+    gint position = garrow_schema_get_field_index(schema, name);
+    g_object_unref(schema);
+    GArrowChunkedArray* chunked = position >= 0 ? garrow_table_get_column_data(table, position) : NULL;
+    if (!chunked)
+        return NULL;
+    GArrowArray* array = garrow_chunked_array_combine(chunked, error);
+    g_object_unref(chunked);
+    return array;
+}
+
+/* Pass the matching rows of one row group to fn */
+static eb_status_t scan_group(GParquetArrowFileReader* reader, gint group, const gint* columns, gsize n_columns,
+                              const eb_parquet_set_filter_t* filter, uint32_t dims,
+                              eb_parquet_set_row_fn fn, void* ctx) {
+    GError* error = NULL;
+    GArrowTable* table = gparquet_arrow_file_reader_read_row_group(reader, group, columns, n_columns, &error);
+    if (!table)
+        return gerror_status("cannot read row group", error);
+
+    GArrowArray* arrays[5] = {0};
+    eb_status_t status = EB_SUCCESS;
+    for (gsize c = 0; c < n_columns && status == EB_SUCCESS; c++) {
+        if (!(arrays[c] = group_column(table, SCAN_COLUMNS[c], &error)))
+            status = gerror_status("cannot read column", error);
+    }
+    g_object_unref(table);
+
+    const gint64* timestamps = NULL;
+    const gfloat* values = NULL;
+    gint64 value_offset = 0;
+    if (status == EB_SUCCESS) {
+        gint64 length = 0;
+        timestamps = garrow_int64_array_get_values(GARROW_INT64_ARRAY(arrays[3]), &length);
+        if (n_columns > 4) {
+            GArrowArray* floats = garrow_base_list_array_get_values(GARROW_BASE_LIST_ARRAY(arrays[4]));
+            values = floats ? garrow_float_array_get_values(GARROW_FLOAT_ARRAY(floats), &length) : NULL;
+            value_offset = garrow_array_get_offset(arrays[4]);
+            if (floats)
+                g_object_unref(floats);
+            if (!values)
+                status = EB_ERROR_IO;
+        }
+    }
+
+    gint64 rows = status == EB_SUCCESS ? garrow_array_get_length(arrays[0]) : 0;
+    for (gint64 i = 0; i < rows && status == EB_SUCCESS; i++) {
+        gchar* source = row_string(arrays[1], i);
+        gchar* model = row_string(arrays[2], i);
+        if (string_matches(filter->source, source) && string_matches(filter->model, model)) {
+            gchar* id = row_string(arrays[0], i);
+            eb_parquet_set_row_t row = {
+                id, values ? values + (value_offset + i) * dims : NULL, source, model, timestamps[i]
+            };
+            status = fn(&row, ctx);
+            g_free(id);
+        }
+        g_free(source);
+        g_free(model);
+    }
+
+    for (gsize c = 0; c < n_columns; c++) {
+        if (arrays[c])
+            g_object_unref(arrays[c]);
+    }
+    return status;
+}
+
+eb_status_t eb_parquet_set_scan(const char* path, const eb_parquet_set_filter_t* filter,
+                                eb_parquet_set_row_fn fn, void* ctx, size_t* groups_read_out) {
+    if (!path || !fn)
+        return EB_ERROR_INVALID_PARAMETER;
+    eb_parquet_set_filter_t none = {0};
+    if (!filter)
+        filter = &none;
+    if (groups_read_out)
+        *groups_read_out = 0;
+
+    GError* error = NULL;
+    GParquetArrowFileReader* reader = gparquet_arrow_file_reader_new_path(path, &error);
+    if (!reader)
+        return gerror_status("cannot open file", error);
+    GArrowSchema* schema = gparquet_arrow_file_reader_get_schema(reader, &error);
+    if (!schema) {
+        g_object_unref(reader);
+        return gerror_status("cannot read schema", error);
+    }
+
+    gint columns[5];
+    gsize n_columns = filter->values ? 5 : 4;
+    for (gsize c = 0; c < 5; c++)
+        columns[c] = garrow_schema_get_field_index(schema, SCAN_COLUMNS[c]);
+    uint32_t dims = 0;
+    if (filter->values && columns[4] >= 0) {
+        GArrowField* field = garrow_schema_get_field(schema, (guint)columns[4]);
+        GArrowDataType* type = garrow_field_get_data_type(field);
+        dims = (uint32_t)garrow_fixed_size_list_data_type_get_list_size(GARROW_FIXED_SIZE_LIST_DATA_TYPE(type));
+        g_object_unref(type);
+        g_object_unref(field);
+    }
+    g_object_unref(schema);
+    for (gsize c = 0; c < n_columns; c++) {
+        if (columns[c] < 0) {
+            DEBUG_ERROR("parquet_set: %s is not a set file", path);
+            g_object_unref(reader);
+            return EB_ERROR_INVALID_FORMAT;
+        }
+    }
+
+    GParquetFileMetadata* metadata = gparquet_arrow_file_reader_get_metadata(reader);
+    gint groups = gparquet_arrow_file_reader_get_n_row_groups(reader);
+    eb_status_t status = EB_SUCCESS;
+    for (gint g = 0; g < groups && status == EB_SUCCESS; g++) {
+        if (metadata && filter->source && !group_may_match(metadata, g, columns[1], filter->source))
+            continue;
+        if (metadata && filter->model && !group_may_match(metadata, g, columns[2], filter->model))
+            continue;
+        status = scan_group(reader, g, columns, n_columns, filter, dims, fn, ctx);
+        if (groups_read_out)
+            (*groups_read_out)++;
+    }
+
+    if (metadata)
+        g_object_unref(metadata);
+    g_object_unref(reader);
+    return status;
+}
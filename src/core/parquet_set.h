@@ -0,0 +1,140 @@
+/*
+ * EmbeddingBridge - Set-Level Parquet Export
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_PARQUET_SET_H
+#define EB_PARQUET_SET_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "status.h"
+#include "format.h"
+
+/*
+ * Writes the vectors of a set into a few large Parquet files instead of one
+ * single-row file per object, so column encoding and compression work across
+ * rows and scanners (Spark, DuckDB, Arrow datasets) read few files with large
+ * row groups. Every file has the schema
+ *
+ *   id         utf8                          object hash
+ *   values     fixed_size_list<float>[dims]  the vector
+ *   source     utf8 (nullable)               source file
+ *   model      utf8 (nullable)               model name
+ *   timestamp  int64                         time the object was logged
+ *
+ * Rows are buffered until a row group is full and then written out, so at
+ * most one row group is held in memory. A file is closed once it holds
+ * file_bytes of vectors and the next row starts a new one, named
+ * <prefix>-00000.parquet, <prefix>-00001.parquet, ... in dir.
+ *
+ * The same rows can be written as Arrow IPC files (Feather v2, .arrow)
+ * instead, one record batch per row group. Uncompressed, their buffers
+ * can be memory-mapped and used in place; the row groups of an IPC file
+ * are kept until the file is closed, so file_bytes bounds the memory.
+ */
+
+/* Uncompressed vector bytes per row group when not configured */
+#define EB_PARQUET_SET_ROW_GROUP_BYTES (128 * 1024 * 1024)
+
+/* Vector bytes per file when not configured */
+#define EB_PARQUET_SET_FILE_BYTES (512ULL * 1024 * 1024)
+
+typedef struct eb_parquet_set_writer eb_parquet_set_writer_t;
+
+typedef enum {
+    EB_PARQUET_SET_PARQUET = 0,   /* ZSTD-compressed Parquet */
+    EB_PARQUET_SET_ARROW,         /* Uncompressed Arrow IPC, mappable */
+    EB_PARQUET_SET_ARROW_LZ4      /* LZ4-compressed Arrow IPC */
+} eb_parquet_set_format_t;
+
+typedef struct {
+    size_t row_group_bytes;       /* Vector bytes per row group, 0 for the default */
+    uint64_t file_bytes;          /* Vector bytes per file, 0 for the default */
+    eb_parquet_set_format_t format;
+    eb_parquet_writer_options_t tuning; /* Writer tuning; row_group_rows overrides row_group_bytes */
+} eb_parquet_set_options_t;
+
+typedef struct {
+    const char* id;               /* Object hash */
+    const float* values;          /* dims values */
+    const char* source;           /* Source file, may be NULL */
+    const char* model;            /* Model name, may be NULL */
+    int64_t timestamp;            /* Seconds since the epoch */
+} eb_parquet_set_row_t;
+
+/**
+ * Start writing the vectors of a set
+ *
+ * @param dir Directory the files are written to (must exist)
+ * @param prefix File name prefix
+ * @param dims Dimensions of every vector
+ * @param options Sizes, NULL for the defaults
+ * @param writer_out Receives the writer
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_parquet_set_writer_open(const char* dir, const char* prefix, uint32_t dims,
+                                       const eb_parquet_set_options_t* options,
+                                       eb_parquet_set_writer_t** writer_out);
+
+/**
+ * Add one vector
+ *
+ * @param writer Writer
+ * @param row Row to add, copied
+ * @return Status code (EB_ERROR_IO if a full row group could not be written)
+ */
+eb_status_t eb_parquet_set_writer_add(eb_parquet_set_writer_t* writer, const eb_parquet_set_row_t* row);
+
+/**
+ * Write the last row group, close the files and free the writer
+ *
+ * On failure the files written so far are removed.
+ *
+ * @param writer Writer
+ * @param files_out Receives the paths of the files in order (caller frees each and the array), may be NULL
+ * @param count_out Receives the number of files, may be NULL
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_parquet_set_writer_close(eb_parquet_set_writer_t* writer, char*** files_out, size_t* count_out);
+
+/**
+ * Free a writer and remove its files without finishing them
+ */
+void eb_parquet_set_writer_abort(eb_parquet_set_writer_t* writer);
+
+/* Which rows of a set file eb_parquet_set_scan() returns */
+typedef struct {
+    const char* source;           /* Only rows of this source file, NULL for any */
+    const char* model;            /* Only rows of this model, NULL for any */
+    bool values;                  /* Decode the vectors too, row->values is NULL otherwise */
+} eb_parquet_set_filter_t;
+
+/* Called for every matching row; anything but EB_SUCCESS stops the scan and is returned */
+typedef eb_status_t (*eb_parquet_set_row_fn)(const eb_parquet_set_row_t* row, void* ctx);
+
+/**
+ * Read the rows of one set file
+ *
+ * Only the columns the caller needs are decoded: without filter->values
+ * the vector column is never read. Row groups whose min/max statistics
+ * for source or model exclude the filter are skipped without reading
+ * any of their data.
+ *
+ * @param path Path of a file written by eb_parquet_set_writer_*
+ * @param filter Rows to return, NULL for all rows without vectors
+ * @param fn Called for every matching row (strings and values are valid during the call only)
+ * @param ctx Passed to fn
+ * @param groups_read_out Receives the number of row groups actually read, may be NULL
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_parquet_set_scan(const char* path, const eb_parquet_set_filter_t* filter,
+                                eb_parquet_set_row_fn fn, void* ctx, size_t* groups_read_out);
+
+#endif /* EB_PARQUET_SET_H */
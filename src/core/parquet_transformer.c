@@ -27,11 +27,15 @@
 #include <limits.h>    /* For PATH_MAX */
 
 #include "transformer.h"
+#include "parquet_transformer.h"
 #include "status.h"
 #include "debug.h"
 #include "compress.h"
 #include "types.h"  /* Include types.h for eb_object_header_t */
 #include "path_utils.h"
+#include "object_path.h"
+#include "shuffle.h"
+#include "quantize.h"
 
 /* Arrow GLib includes */
 #include <arrow-glib/arrow-glib.h>
@@ -46,6 +50,7 @@ static eb_status_t parquet_inverse_transform(struct eb_transformer* transformer,
                                            const void* source, size_t source_size, 
                                            void** dest, size_t* dest_size);
 static void parquet_transformer_free(struct eb_transformer* transformer);
+static const eb_transform_stream_ops_t parquet_stream_ops;
 static struct eb_transformer* parquet_transformer_clone(const struct eb_transformer* transformer);
 static eb_status_t read_metadata_from_meta_file(const char* hash_str, char** source, char** model, char** timestamp);
 static void extract_schema_metadata(GArrowSchema* schema, char** hash, char** source, char** model, char** timestamp, char** dimensions);
@@ -53,6 +58,17 @@ static void extract_schema_metadata(GArrowSchema* schema, char** hash, char** so
 /* Thread local storage for document text */
 static __thread char* tls_document_text = NULL;
 
+/* Writer tuning of the remote this thread is pushing to */
+static __thread bool tls_writer_options_set = false;
+static __thread eb_parquet_writer_options_t tls_writer_options;
+
+void eb_parquet_set_writer_options(const eb_parquet_writer_options_t* options) {
+    tls_writer_options_set = options != NULL;
+    if (options) {
+        tls_writer_options = *options;
+    }
+}
+
 /**
  * Set document text for the next parquet transform operation
  * Text will be stored in the 'blob' column and cleared after transform
@@ -74,6 +90,7 @@ void eb_parquet_set_document_text(const char* text) {
 typedef struct {
     int compression_level;
     bool initialized;
+    eb_parquet_writer_options_t options;
 } parquet_transformer_config_t;
 
 /* Initialize Arrow */
@@ -84,6 +101,12 @@ static bool initialize_arrow() {
 
 /* Create a new Parquet transformer with the specified compression level */
 eb_transformer_t* eb_parquet_transformer_create(int compression_level) {
+    return eb_parquet_transformer_create_with_options(compression_level, NULL);
+}
+
+/* Create a Parquet transformer with writer tuning */
+eb_transformer_t* eb_parquet_transformer_create_with_options(int compression_level,
+                                                           const eb_parquet_writer_options_t* options) {
     eb_transformer_t* transformer = (eb_transformer_t*)malloc(sizeof(eb_transformer_t));
     if (!transformer) {
         DEBUG_ERROR("Failed to allocate memory for Parquet transformer");
@@ -99,6 +122,11 @@ eb_transformer_t* eb_parquet_transformer_create(int compression_level) {
 
     config->compression_level = compression_level;
     config->initialized = true;
+    if (options) {
+        config->options = *options;
+    } else {
+        memset(&config->options, 0, sizeof(config->options));
+    }
 
     transformer->name = strdup("parquet");
     transformer->format_name = strdup("parquet");
@@ -107,6 +135,7 @@ eb_transformer_t* eb_parquet_transformer_create(int compression_level) {
     transformer->free = parquet_transformer_free;
     transformer->clone = parquet_transformer_clone;
     transformer->user_data = config;
+    transformer->stream = &parquet_stream_ops;
 
     return transformer;
 }
@@ -148,7 +177,7 @@ static eb_status_t read_metadata_from_meta_file(const char* hash_str, char** sou
     
     /* Construct path to the metadata file */
     char meta_path[PATH_MAX];
-    snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", repo_root, hash_str);
+    eb_object_path(repo_root, hash_str, "meta", meta_path, sizeof(meta_path));
     
     /* Try alternative path if first doesn't exist */
     if (access(meta_path, F_OK) != 0) {
@@ -286,22 +315,43 @@ static void extract_schema_metadata(GArrowSchema* schema, char** hash, char** so
     g_hash_table_unref(metadata);
 }
 
+/* Block in which encoded Parquet files are handed to a sink */
+#define PARQUET_SINK_BLOCK (256 * 1024)
+
+/* Hand encoded bytes to a sink in PARQUET_SINK_BLOCK pieces */
+static eb_status_t parquet_emit(eb_transform_sink_fn sink, void* sink_ctx, const void* data, size_t size) {
+    const uint8_t* p = data;
+    while (size > 0) {
+        size_t n = size < PARQUET_SINK_BLOCK ? size : PARQUET_SINK_BLOCK;
+        int status = sink(sink_ctx, p, n);
+        if (status != 0) {
+            return (eb_status_t)status;
+        }
+        p += n;
+        size -= n;
+    }
+    return EB_SUCCESS;
+}
+
 /* 
  * Transform source data into Parquet format
  * Converts binary data to Parquet columnar format with ZSTD compression
+ *
+ * The file is built in an Arrow buffer and handed to sink from there.
  */
-static eb_status_t parquet_transform(struct eb_transformer* transformer, 
-                                    const void* source, size_t source_size, 
-                                    void** dest, size_t* dest_size) {
-    DEBUG_WARN("Starting parquet_transform. source=%p, source_size=%zu", source, source_size);
+static eb_status_t parquet_encode(struct eb_transformer* transformer, 
+                                  const void* source, size_t source_size, 
+                                  eb_transform_sink_fn sink, void* sink_ctx) {
+    DEBUG_TRACE("Starting parquet_transform. source=%p, source_size=%zu", source, source_size);
     
-    /* Add detailed debug output about the source data */
-    DEBUG_WARN("First 16 bytes of source data:");
+    /* The byte dump is a line per byte for every object, so only at trace level */
     const unsigned char* src_bytes = (const unsigned char*)source;
-    for (size_t i = 0; i < (source_size >= 16 ? 16 : source_size); i++) {
-        DEBUG_WARN("  byte[%zu] = 0x%02x (dec: %d, char: %c)", 
-                 i, src_bytes[i], src_bytes[i], 
-                 (src_bytes[i] >= 32 && src_bytes[i] <= 126) ? src_bytes[i] : '.');
+    if (src_bytes && eb_debug_level >= EB_DEBUG_TRACE) {
+        for (size_t i = 0; i < (source_size >= 16 ? 16 : source_size); i++) {
+            DEBUG_TRACE("  byte[%zu] = 0x%02x (dec: %d, char: %c)", 
+                     i, src_bytes[i], src_bytes[i], 
+                     (src_bytes[i] >= 32 && src_bytes[i] <= 126) ? src_bytes[i] : '.');
+        }
     }
     
     /* Check for ZSTD magic number (0xFD2FB528) at the beginning of the data 
@@ -313,9 +363,9 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
         DEBUG_ERROR("Parquet transformer should receive uncompressed data, not compressed");
     }
     
-    if (!transformer || !source || !dest || !dest_size) {
-        DEBUG_ERROR("Invalid input parameters. transformer=%p, source=%p, dest=%p, dest_size=%p", 
-                   transformer, source, dest, dest_size);
+    if (!transformer || !source || !sink) {
+        DEBUG_ERROR("Invalid input parameters. transformer=%p, source=%p, sink=%p", 
+                   transformer, source, sink);
         return EB_ERROR_INVALID_INPUT;
     }
     
@@ -331,15 +381,8 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
             (source_size < 2 || src_bytes[source_size-1] == '}' || src_bytes[source_size-1] == ']')) {
             DEBUG_WARN("Data appears to be JSON or text, using pass-through instead of Parquet transformation");
             
-            /* For JSON/text data, just return a copy of it rather than trying to convert it */
-            *dest = malloc(source_size);
-            if (!*dest) {
-                return EB_ERROR_MEMORY_ALLOCATION;
-            }
-            
-            memcpy(*dest, source, source_size);
-            *dest_size = source_size;
-            return EB_SUCCESS;
+            /* For JSON/text data, just pass it on rather than trying to convert it */
+            return parquet_emit(sink, sink_ctx, source, source_size);
         }
     }
 
@@ -356,6 +399,11 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
     if (source_size >= sizeof(eb_object_header_t)) {
         eb_header = (const eb_object_header_t*)source;
         has_eb_header = true;
+
+        /* A stored L2 norm trails the payload; it is not part of the vector */
+        if (eb_header->obj_type == EB_OBJ_VECTOR && (eb_header->flags & EB_FLAG_NORM) &&
+            source_size >= sizeof(eb_object_header_t) + sizeof(float))
+            source_size -= sizeof(float);
         
         DEBUG_INFO("Found EmbeddingBridge header with hash: ");
         for (int i = 0; i < 8; i++) {
@@ -400,6 +448,46 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
             data_to_process = (const uint8_t*)source + sizeof(eb_object_header_t);
             data_size = source_size - sizeof(eb_object_header_t);
         }
+        
+        /* Restore float byte order if the object was shuffled before compression */
+        if (eb_header->flags & EB_FLAG_SHUFFLED) {
+            void* plain = malloc(data_size ? data_size : 1);
+            if (!plain) {
+                if (need_to_free_decompressed) free(decompressed_data);
+                return EB_ERROR_MEMORY_ALLOCATION;
+            }
+            eb_unshuffle4(data_to_process, plain, data_size);
+            if (need_to_free_decompressed) free(decompressed_data);
+            decompressed_data = plain;
+            data_to_process = plain;
+            need_to_free_decompressed = true;
+        }
+        
+        /* Parquet values are float32; widen reduced dtypes behind a dimension header */
+        eb_dtype_t dtype = EB_FLAG_DTYPE(eb_header->flags);
+        if (dtype != EB_FLOAT32) {
+            eb_vector_ref_t ref;
+            float* widened = NULL;
+            uint32_t dims = 0;
+            eb_status_t status = eb_vector_ref_init(&ref, dtype, data_to_process, data_size);
+            if (status == EB_SUCCESS) {
+                dims = (uint32_t)ref.dims;
+                widened = malloc(sizeof(uint32_t) + (size_t)dims * sizeof(float));
+                if (!widened) status = EB_ERROR_MEMORY_ALLOCATION;
+            }
+            if (status != EB_SUCCESS) {
+                DEBUG_ERROR("Cannot widen %s vector for Parquet: %d", eb_dtype_name(dtype), status);
+                if (need_to_free_decompressed) free(decompressed_data);
+                return status;
+            }
+            memcpy(widened, &dims, sizeof(uint32_t));
+            eb_vector_ref_get(&ref, 0, dims, (float*)((uint8_t*)widened + sizeof(uint32_t)));
+            if (need_to_free_decompressed) free(decompressed_data);
+            decompressed_data = widened;
+            data_to_process = widened;
+            data_size = sizeof(uint32_t) + (size_t)dims * sizeof(float);
+            need_to_free_decompressed = true;
+        }
     } else {
         /* No EmbeddingBridge header, treat as raw data */
         DEBUG_INFO("No EmbeddingBridge header found, using random ID");
@@ -425,15 +513,14 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
             is_npy = true;
             DEBUG_INFO("Detected NumPy array format (.npy)");
             
-        /* Extract header size from NumPy format (stored at offset 8 as uint16) */
-            uint16_t header_size = *((const uint16_t*)((const uint8_t*)data_to_process + 8));
-                
-        /* Calculate data offset */
-        size_t data_offset = 10 + header_size;
-            
-            /* Get dimension from size */
-            dimensions = (data_size - data_offset) / sizeof(float);
-            values = (const float*)((const uint8_t*)data_to_process + data_offset);
+            /* Values are read in place; anything but one float32 vector is refused */
+            size_t npy_dims = 0;
+            if (eb_float_payload(data_to_process, data_size, &values, &npy_dims) != EB_SUCCESS) {
+                DEBUG_ERROR("NumPy payload is not a float32 vector");
+                if (need_to_free_decompressed) free(decompressed_data);
+                return EB_ERROR_INVALID_FORMAT;
+            }
+            dimensions = (uint32_t)npy_dims;
             
             DEBUG_INFO("NumPy array has %u dimensions", dimensions);
         } else {
@@ -801,12 +888,13 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
         return EB_ERROR_IO;
     }
     
-    /* Create file output stream for the result - we'll write to a temporary file */
-    const gchar *temp_filename = "temp_parquet_data.parquet";
-    DEBUG_INFO("Opening Parquet output file for writing: %s", temp_filename);
-    GArrowFileOutputStream *output_stream = garrow_file_output_stream_new(temp_filename, FALSE, &error);
+    /* Write the file into memory instead of a temporary file */
+    GArrowResizableBuffer *output_buffer = garrow_resizable_buffer_new(4096, &error);
+    GArrowBufferOutputStream *output_stream = output_buffer
+        ? garrow_buffer_output_stream_new(output_buffer) : NULL;
     if (!output_stream) {
-        DEBUG_ERROR("Failed to create file output stream: %s", error ? error->message : "Unknown error");
+        DEBUG_ERROR("Failed to create buffer output stream: %s", error ? error->message : "Unknown error");
+        if (output_buffer) g_object_unref(output_buffer);
         g_object_unref(table);
         g_object_unref(schema);
         if (error) g_error_free(error);
@@ -814,10 +902,18 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
         return EB_ERROR_IO;
     }
     
-    /* Set up Parquet writer options */
+    /* Set up Parquet writer options, a remote's tuning first */
     GArrowCompressionType compression_type = GARROW_COMPRESSION_TYPE_ZSTD;
     GParquetWriterProperties *writer_props = gparquet_writer_properties_new();
     gparquet_writer_properties_set_compression(writer_props, compression_type, "*");
+    parquet_transformer_config_t *config = get_config(transformer);
+    const eb_parquet_writer_options_t *writer_options = tls_writer_options_set ? &tls_writer_options
+                                                      : config ? &config->options : NULL;
+    if (writer_options) {
+        eb_parquet_writer_properties_apply(writer_props, writer_options);
+    }
+    gsize group_rows = writer_options && writer_options->row_group_rows
+                     ? (gsize)writer_options->row_group_rows : 1024;
     
     /* Create Parquet writer and write table */
     GParquetArrowFileWriter *writer = gparquet_arrow_file_writer_new_arrow(
@@ -827,11 +923,12 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
                                              &error);
     
     if (writer_props && G_IS_OBJECT(writer_props)) { g_object_unref(writer_props); }
-    if (output_stream && G_IS_OBJECT(output_stream)) { g_object_unref(output_stream); }
     if (schema && G_IS_OBJECT(schema)) { g_object_unref(schema); }
     
     if (!writer) {
         DEBUG_ERROR("Failed to create Parquet writer: %s", error ? error->message : "Unknown error");
+        g_object_unref(output_stream);
+        g_object_unref(output_buffer);
         g_object_unref(table);
         if (error) g_error_free(error);
         if (need_to_free_decompressed) free(decompressed_data);
@@ -839,71 +936,158 @@ static eb_status_t parquet_transform(struct eb_transformer* transformer,
     }
     
     gboolean success = gparquet_arrow_file_writer_write_table(
-        writer, table, 1024, &error);
-    DEBUG_INFO("Finished writing Parquet table to file: %s", temp_filename);
+        writer, table, group_rows, &error);
     g_object_unref(table);
+    if (success) {
+        success = gparquet_arrow_file_writer_close(writer, &error);
+    }
+    g_object_unref(writer);
+    g_object_unref(output_stream);
+    
+    /* The decoded vector is in the file now */
+    if (need_to_free_decompressed) {
+        free(decompressed_data);
+    }
     
     if (!success) {
         DEBUG_ERROR("Failed to write table: %s", error ? error->message : "Unknown error");
-        g_object_unref(writer);
+        g_object_unref(output_buffer);
         if (error) g_error_free(error);
-        if (need_to_free_decompressed) free(decompressed_data);
         return EB_ERROR_IO;
     }
     
-    success = gparquet_arrow_file_writer_close(writer, &error);
-    DEBUG_INFO("Closed Parquet writer for file: %s", temp_filename);
-    g_object_unref(writer);
+    GBytes *file_bytes = garrow_buffer_get_data(GARROW_BUFFER(output_buffer));
+    gsize file_size = 0;
+    const void *file_data = g_bytes_get_data(file_bytes, &file_size);
+    eb_status_t status = parquet_emit(sink, sink_ctx, file_data, file_size);
+    g_bytes_unref(file_bytes);
+    g_object_unref(output_buffer);
     
-    /* Read the temporary Parquet file into memory */
-    DEBUG_INFO("Opening Parquet file for reading: %s", temp_filename);
-    FILE *parquet_file = fopen(temp_filename, "rb");
-    if (!parquet_file) {
-        DEBUG_ERROR("Failed to open temporary Parquet file");
-        if (need_to_free_decompressed) free(decompressed_data);
-        return EB_ERROR_IO;
+    DEBUG_INFO("Successfully transformed to Pinecone-compatible Parquet format, size: %zu bytes", (size_t)file_size);
+    return status;
+}
+
+/* Growing output of the whole-buffer transform */
+struct parquet_output {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+};
+
+static int parquet_output_sink(void* ctx, const void* data, size_t size) {
+    struct parquet_output* output = ctx;
+    if (output->size + size > output->capacity) {
+        size_t capacity = output->capacity ? output->capacity * 2 : size;
+        while (capacity < output->size + size) {
+            capacity *= 2;
+        }
+        uint8_t* grown = realloc(output->data, capacity);
+        if (!grown) {
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        output->data = grown;
+        output->capacity = capacity;
     }
-    
-    /* Get file size */
-    fseek(parquet_file, 0, SEEK_END);
-    *dest_size = ftell(parquet_file);
-    fseek(parquet_file, 0, SEEK_SET);
-    
-    /* Allocate memory for the Parquet data */
-    *dest = malloc(*dest_size);
-    if (!*dest) {
-        DEBUG_ERROR("Failed to allocate memory for Parquet data");
-        fclose(parquet_file);
-        if (need_to_free_decompressed) free(decompressed_data);
-        return EB_ERROR_MEMORY;
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+    return 0;
+}
+
+static eb_status_t parquet_transform(struct eb_transformer* transformer, 
+                                    const void* source, size_t source_size, 
+                                    void** dest, size_t* dest_size) {
+    if (!dest || !dest_size) {
+        return EB_ERROR_INVALID_INPUT;
     }
-    
-    /* Read the Parquet data */
-    DEBUG_INFO("Reading Parquet file into memory: %s", temp_filename);
-    if (fread(*dest, 1, *dest_size, parquet_file) != *dest_size) {
-        DEBUG_ERROR("Failed to read temporary Parquet file");
-        fclose(parquet_file);
-        free(*dest);
-        *dest = NULL;
-        if (need_to_free_decompressed) free(decompressed_data);
-        return EB_ERROR_IO;
+    struct parquet_output output = { NULL, 0, 0 };
+    eb_status_t status = parquet_encode(transformer, source, source_size, parquet_output_sink, &output);
+    if (status != EB_SUCCESS) {
+        free(output.data);
+        return status;
     }
-    
-    fclose(parquet_file);
-    DEBUG_INFO("Closed Parquet file after reading: %s", temp_filename);
-    
-    /* Clean up */
-    if (need_to_free_decompressed) {
-        free(decompressed_data);
+    *dest = output.data;
+    *dest_size = output.size;
+    return EB_SUCCESS;
+}
+
+/*
+ * Streaming encoder
+ *
+ * A Parquet object is one row, so the input is gathered until finish; the
+ * encoded file then goes to the sink in blocks straight from the Arrow
+ * buffer it was written into, without a temporary file or a second copy.
+ */
+typedef struct {
+    struct eb_transformer* transformer;
+    eb_transform_sink_fn sink;
+    void* sink_ctx;
+    struct parquet_output input;
+} parquet_stream_t;
+
+static eb_status_t parquet_stream_init(struct eb_transformer* transformer, eb_transform_sink_fn sink,
+                                       void* sink_ctx, void** state_out) {
+    if (!transformer || !sink || !state_out) {
+        return EB_ERROR_INVALID_PARAMETER;
     }
-    
-    DEBUG_INFO("Removing temporary Parquet file: %s", temp_filename);
-    remove(temp_filename);
-    
-    DEBUG_INFO("Successfully transformed to Pinecone-compatible Parquet format, size: %zu bytes", *dest_size);
+    parquet_stream_t* stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    stream->transformer = transformer;
+    stream->sink = sink;
+    stream->sink_ctx = sink_ctx;
+    *state_out = stream;
     return EB_SUCCESS;
 }
 
+static eb_status_t parquet_stream_feed(void* state, const void* data, size_t size) {
+    parquet_stream_t* stream = state;
+    if (size == 0) {
+        return EB_SUCCESS;
+    }
+    int status = parquet_output_sink(&stream->input, data, size);
+    return status == 0 ? EB_SUCCESS : (eb_status_t)status;
+}
+
+static void parquet_stream_abort(void* state) {
+    parquet_stream_t* stream = state;
+    if (!stream) {
+        return;
+    }
+    free(stream->input.data);
+    free(stream);
+}
+
+static eb_status_t parquet_stream_finish(void* state) {
+    parquet_stream_t* stream = state;
+    eb_status_t status = parquet_encode(stream->transformer, stream->input.data ? (const void*)stream->input.data : "",
+                                        stream->input.size, stream->sink, stream->sink_ctx);
+    parquet_stream_abort(stream);
+    return status;
+}
+
+static const eb_transform_stream_ops_t parquet_stream_ops = {
+    parquet_stream_init,
+    parquet_stream_feed,
+    parquet_stream_finish,
+    parquet_stream_abort
+};
+
+/*
+ * Open a Parquet reader over an in-memory file
+ *
+ * The buffer is wrapped, not copied, and must outlive the reader.
+ */
+static GParquetArrowFileReader *open_buffer_reader(const void *data, size_t size, GError **error) {
+    GArrowBuffer *buffer = garrow_buffer_new((const guint8 *)data, (gint64)size);
+    GArrowBufferInputStream *input_stream = garrow_buffer_input_stream_new(buffer);
+    g_object_unref(buffer);
+    GParquetArrowFileReader *reader =
+        gparquet_arrow_file_reader_new_arrow(GARROW_SEEKABLE_INPUT_STREAM(input_stream), error);
+    g_object_unref(input_stream);
+    return reader;
+}
+
 /* 
  * Inverse transform Parquet data back to original format
  * Converts Parquet columnar format back to the original binary or NumPy data
@@ -924,53 +1108,17 @@ static eb_status_t parquet_inverse_transform(struct eb_transformer* transformer,
     
     GError *error = NULL;
     
-    /* Write Parquet data to a temporary file */
-    const gchar *temp_filename = "temp_parquet_data.parquet";
-    FILE *temp_file = fopen(temp_filename, "wb");
-    if (!temp_file) {
-        DEBUG_ERROR("Failed to create temporary file");
-        return EB_ERROR_IO;
-    }
-    
-    /* Write data to temporary file */
-    size_t bytes_written = fwrite(source, 1, source_size, temp_file);
-    fclose(temp_file);
-    
-    if (bytes_written != source_size) {
-        DEBUG_ERROR("Failed to write to temporary file");
-        return EB_ERROR_IO;
-    }
-    
-    /* Open file as Arrow file input stream */
-    GArrowMemoryMappedInputStream *input_stream = 
-        garrow_memory_mapped_input_stream_new(temp_filename, &error);
-    
-    if (!input_stream) {
-        DEBUG_ERROR("Failed to create input stream: %s", error ? error->message : "Unknown error");
-        if (error) g_error_free(error);
-        remove(temp_filename);
-        return EB_ERROR_IO;
-    }
-    
-    /* Create Parquet reader */
-    GParquetArrowFileReader *reader = 
-        gparquet_arrow_file_reader_new_arrow(GARROW_SEEKABLE_INPUT_STREAM(input_stream), &error);
-    
+    /* Read straight from the caller's buffer */
+    GParquetArrowFileReader *reader = open_buffer_reader(source, source_size, &error);
     if (!reader) {
         DEBUG_ERROR("Failed to create Parquet reader: %s", error ? error->message : "Unknown error");
-        g_object_unref(input_stream);
         if (error) g_error_free(error);
-        remove(temp_filename);
         return EB_ERROR_IO;
     }
         
     /* Read the table */
     GArrowTable *table = gparquet_arrow_file_reader_read_table(reader, &error);
     g_object_unref(reader);
-    g_object_unref(input_stream);
-    
-    /* Delete temporary file */
-    remove(temp_filename);
     
     if (!table) {
         DEBUG_ERROR("Failed to read Parquet table: %s", error ? error->message : "Unknown error");
@@ -1540,7 +1688,7 @@ static struct eb_transformer* parquet_transformer_clone(const struct eb_transfor
         return NULL;
     }
 
-    return eb_parquet_transformer_create(config->compression_level);
+    return eb_parquet_transformer_create_with_options(config->compression_level, &config->options);
 }
 
 /* Register the Parquet transformer */
@@ -1562,51 +1710,131 @@ eb_status_t eb_register_parquet_transformer(void) {
     return EB_SUCCESS;
 }
 
+/* Leaf column of the vector values, list<float> or fixed_size_list<float> named "values" */
+#define VALUES_COLUMN_PATH "values.list.item"
+
+/* Hand writer tuning to Arrow */
+void eb_parquet_writer_properties_apply(GParquetWriterProperties *props,
+                                        const eb_parquet_writer_options_t *options) {
+    if (!props || !options) return;
+
+    if (options->dictionary == EB_PARQUET_ON) {
+        gparquet_writer_properties_enable_dictionary(props, NULL);
+    } else if (options->dictionary == EB_PARQUET_OFF) {
+        gparquet_writer_properties_disable_dictionary(props, NULL);
+    }
+    /*
+     * Float values rarely repeat, so any explicit encoding turns the
+     * dictionary off for them. Arrow GLib has no per-column encoding
+     * setter, so BYTE_STREAM_SPLIT is written as PLAIN.
+     */
+    if (options->values_encoding != EB_PARQUET_ENCODING_DEFAULT) {
+        gparquet_writer_properties_disable_dictionary(props, VALUES_COLUMN_PATH);
+    }
+    if (options->values_encoding == EB_PARQUET_ENCODING_BYTE_STREAM_SPLIT) {
+        DEBUG_WARN("Parquet: BYTE_STREAM_SPLIT is not settable through Arrow GLib, writing PLAIN values");
+    }
+    for (size_t i = 0; i < options->column_count && i < EB_PARQUET_MAX_COLUMN_OPTIONS; i++) {
+        const char *column = strcmp(options->columns[i].column, "values") == 0 ? VALUES_COLUMN_PATH
+                                                                               : options->columns[i].column;
+        if (options->columns[i].dictionary == EB_PARQUET_ON) {
+            gparquet_writer_properties_enable_dictionary(props, column);
+        } else if (options->columns[i].dictionary == EB_PARQUET_OFF) {
+            gparquet_writer_properties_disable_dictionary(props, column);
+        }
+    }
+    if (options->row_group_rows) {
+        gparquet_writer_properties_set_max_row_group_length(props, (gint64)options->row_group_rows);
+    }
+    if (options->page_size) {
+        gparquet_writer_properties_set_data_page_size(props, (gint64)options->page_size);
+    }
+    if (options->statistics == EB_PARQUET_OFF) {
+        DEBUG_WARN("Parquet: statistics are not settable through Arrow GLib and stay on");
+    }
+}
+
+/* Footer size of a Parquet file from its trailer */
+size_t eb_parquet_footer_size(const void *trailer, size_t trailer_size) {
+    if (!trailer || trailer_size < EB_PARQUET_TRAILER_SIZE) return 0;
+    const unsigned char *end = (const unsigned char *)trailer + trailer_size - EB_PARQUET_TRAILER_SIZE;
+    if (memcmp(end + 4, "PAR1", 4) != 0) return 0;
+    /* The metadata length is a little-endian uint32 */
+    uint32_t metadata_len = (uint32_t)end[0] | ((uint32_t)end[1] << 8) |
+                            ((uint32_t)end[2] << 16) | ((uint32_t)end[3] << 24);
+    return (size_t)metadata_len + EB_PARQUET_TRAILER_SIZE;
+}
+
+/* Append "key":"value" of the schema metadata to a JSON object being built */
+static void append_schema_value(GString *json, GHashTable *metadata, const char *key) {
+    const gchar *value = g_hash_table_lookup(metadata, key);
+    if (!value) return;
+    g_string_append_printf(json, "%s\"%s\":\"%s\"", json->len > 1 ? "," : "", key, value);
+}
+
 /*
  * Extract the metadata JSON string from the 'metadata' column of a Parquet file buffer.
  * Returns a malloc'd string (caller must free), or NULL on error.
+ *
+ * Only the 'metadata' column is decoded; the vector and blob columns are
+ * never read. Files without that column get a JSON object built from the
+ * schema metadata in the footer.
  */
 char *eb_parquet_extract_metadata_json(const void *parquet_data, size_t parquet_size) {
     if (!parquet_data || parquet_size == 0) return NULL;
-    // Log the first and last 4 bytes (Parquet magic bytes)
-    if (parquet_size >= 8) {
-        const unsigned char *bytes = (const unsigned char *)parquet_data;
-        DEBUG_INFO("Parquet buffer first 4 bytes: %02x %02x %02x %02x", bytes[0], bytes[1], bytes[2], bytes[3]);
-        DEBUG_INFO("Parquet buffer last 4 bytes: %02x %02x %02x %02x", bytes[parquet_size-4], bytes[parquet_size-3], bytes[parquet_size-2], bytes[parquet_size-1]);
-    } else {
-        DEBUG_WARN("Parquet buffer too small to check magic bytes (size=%zu)", parquet_size);
-    }
     GError *error = NULL;
-    const gchar *temp_filename = "temp_extract_metadata.parquet";
-    FILE *temp_file = fopen(temp_filename, "wb");
-    if (!temp_file) return NULL;
-    size_t written = fwrite(parquet_data, 1, parquet_size, temp_file);
-    fclose(temp_file);
-    if (written != parquet_size) { remove(temp_filename); return NULL; }
-    GArrowMemoryMappedInputStream *input_stream = garrow_memory_mapped_input_stream_new(temp_filename, &error);
-    if (!input_stream) { remove(temp_filename); return NULL; }
-    GParquetArrowFileReader *reader = gparquet_arrow_file_reader_new_arrow(GARROW_SEEKABLE_INPUT_STREAM(input_stream), &error);
-    if (!reader) { g_object_unref(input_stream); remove(temp_filename); return NULL; }
-    GArrowTable *table = gparquet_arrow_file_reader_read_table(reader, &error);
-    g_object_unref(reader); g_object_unref(input_stream); remove(temp_filename);
-    if (!table) return NULL;
-    gint metadata_col_index = garrow_table_get_n_columns(table) > 2 ? 2 : -1;
+    GParquetArrowFileReader *reader = open_buffer_reader(parquet_data, parquet_size, &error);
+    if (!reader) {
+        DEBUG_WARN("Failed to open Parquet buffer: %s", error ? error->message : "Unknown error");
+        if (error) g_error_free(error);
+        return NULL;
+    }
+    GArrowSchema *schema = gparquet_arrow_file_reader_get_schema(reader, &error);
+    if (!schema) {
+        if (error) g_error_free(error);
+        g_object_unref(reader);
+        return NULL;
+    }
+    gint metadata_col_index = garrow_schema_get_field_index(schema, "metadata");
     char *result = NULL;
-    if (metadata_col_index >= 0) {
-        GArrowChunkedArray *metadata_chunked = garrow_table_get_column_data(table, metadata_col_index);
-        if (metadata_chunked && garrow_chunked_array_get_n_chunks(metadata_chunked) > 0) {
-            GArrowArray *metadata_array = garrow_chunked_array_get_chunk(metadata_chunked, 0);
-            if (metadata_array) {
-                GArrowStringArray *metadata_string_array = GARROW_STRING_ARRAY(metadata_array);
-                if (metadata_string_array) {
-                    const gchar *metadata_json = garrow_string_array_get_string(metadata_string_array, 0);
-                    if (metadata_json) result = strdup(metadata_json);
-                }
-                g_object_unref(metadata_array);
+    if (metadata_col_index < 0) {
+        GHashTable *metadata = garrow_schema_get_metadata(schema);
+        if (metadata) {
+            GString *json = g_string_new("{");
+            append_schema_value(json, metadata, "hash");
+            append_schema_value(json, metadata, "source");
+            append_schema_value(json, metadata, "model");
+            append_schema_value(json, metadata, "timestamp");
+            g_string_append_c(json, '}');
+            result = strdup(json->str);
+            g_string_free(json, TRUE);
+            g_hash_table_unref(metadata);
+        }
+        g_object_unref(schema);
+        g_object_unref(reader);
+        return result;
+    }
+    g_object_unref(schema);
+
+    GArrowChunkedArray *metadata_chunked =
+        gparquet_arrow_file_reader_read_column_data(reader, metadata_col_index, &error);
+    g_object_unref(reader);
+    if (!metadata_chunked) {
+        if (error) g_error_free(error);
+        return NULL;
+    }
+    if (garrow_chunked_array_get_n_chunks(metadata_chunked) > 0) {
+        GArrowArray *metadata_array = garrow_chunked_array_get_chunk(metadata_chunked, 0);
+        if (metadata_array) {
+            GArrowStringArray *metadata_string_array = GARROW_STRING_ARRAY(metadata_array);
+            if (metadata_string_array) {
+                gchar *metadata_json = garrow_string_array_get_string(metadata_string_array, 0);
+                if (metadata_json) result = strdup(metadata_json);
+                g_free(metadata_json);
             }
-            g_object_unref(metadata_chunked);
+            g_object_unref(metadata_array);
         }
     }
-    g_object_unref(table);
+    g_object_unref(metadata_chunked);
     return result;
-} 
\ No newline at end of file
+}
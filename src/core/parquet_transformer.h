@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include "transformer.h"
 #include "status.h"
+#include "format.h"
 
 /**
  * Arrow/Parquet libraries are required for this transformer.
@@ -42,6 +43,42 @@
  */
 struct eb_transformer *eb_parquet_transformer_create(int compression_level);
 
+/**
+ * Create a new Parquet transformer with writer tuning
+ *
+ * @param compression_level ZSTD compression level (0-22, 0=disabled)
+ * @param options Writer tuning (see format.h), NULL for the defaults
+ * @return Pointer to transformer or NULL if creation failed (libraries not installed)
+ */
+struct eb_transformer *eb_parquet_transformer_create_with_options(int compression_level,
+                                                                  const eb_parquet_writer_options_t *options);
+
+/**
+ * Set the writer tuning of this thread's Parquet transforms
+ *
+ * Overrides the tuning of the transformer until cleared, which is how
+ * the tuning of a remote reaches the objects pushed to it.
+ *
+ * @param options Writer tuning, NULL to clear
+ */
+void eb_parquet_set_writer_options(const eb_parquet_writer_options_t *options);
+
+/* Arrow GLib's writer properties, from parquet-glib */
+struct _GParquetWriterProperties;
+
+/**
+ * Apply writer tuning to Parquet writer properties
+ *
+ * Dictionary, row group and page settings map to Arrow GLib setters.
+ * Arrow GLib cannot set column encodings or statistics, so
+ * BYTE_STREAM_SPLIT values are written PLAIN and statistics stay on.
+ *
+ * @param props Writer properties
+ * @param options Writer tuning
+ */
+void eb_parquet_writer_properties_apply(struct _GParquetWriterProperties *props,
+                                        const eb_parquet_writer_options_t *options);
+
 /**
  * Register the parquet transformer with the system
  *
@@ -60,4 +97,21 @@ void eb_parquet_set_document_text(const char* text);
 /* Extract the metadata JSON string from the 'metadata' column of a Parquet file buffer. Returns a malloc'd string (caller must free), or NULL on error. */
 char *eb_parquet_extract_metadata_json(const void *parquet_data, size_t parquet_size);
 
+/* Ranged reads of a Parquet file: its last EB_PARQUET_TRAILER_SIZE bytes
+ * are the footer length and the magic */
+#define EB_PARQUET_TRAILER_SIZE 8
+
+/**
+ * Size of the footer of a Parquet file from its trailer
+ *
+ * A remote reader fetches the last EB_PARQUET_TRAILER_SIZE bytes, then
+ * this many bytes from the end for the file metadata, and from there only
+ * the column chunks it needs.
+ *
+ * @param trailer Last bytes of the file
+ * @param trailer_size Number of bytes in trailer (at least EB_PARQUET_TRAILER_SIZE)
+ * @return Footer size including the trailer, or 0 if trailer is not a Parquet trailer
+ */
+size_t eb_parquet_footer_size(const void *trailer, size_t trailer_size);
+
 #endif /* EB_PARQUET_TRANSFORMER_H */ 
\ No newline at end of file
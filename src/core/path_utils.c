@@ -251,8 +251,10 @@ char *get_url_param(const char *url, const char *param)
 		return NULL;
 
 	struct url_parts *parts = parse_url(url);
-	if (!parts || !parts->query)
+	if (!parts || !parts->query) {
+		free_url_parts(parts);
 		return NULL;
+	}
 
 	char *result = NULL;
 	char *query_copy = strdup(parts->query);
@@ -476,4 +478,57 @@ char* get_current_set_model_refs_dir(void) {
     snprintf(path, len, "%s/.embr/sets/%s/refs/models", eb_root, set_name);
     free(eb_root);
     return path;
-} 
\ No newline at end of file
+} 
+
+/**
+ * Get the path to the current set's vector index directory: .embr/sets/<set>/hnsw
+ * Caller is responsible for freeing.
+ */
+char* get_current_set_hnsw_dir(void) {
+    // Determine repo root
+    char* eb_root = find_repo_root(NULL);
+    if (!eb_root) {
+        return NULL;
+    }
+    // Get current set name
+    char set_name[PATH_MAX];
+    eb_status_t status = get_current_set(set_name, sizeof(set_name));
+    if (status != EB_SUCCESS) {
+        free(eb_root);
+        return NULL;
+    }
+    // Build path: <root>/.embr/sets/<set>/hnsw
+    size_t len = strlen(eb_root) + strlen("/.embr/sets//hnsw") + strlen(set_name) + 1;
+    char* path = malloc(len);
+    if (!path) {
+        free(eb_root);
+        return NULL;
+    }
+    snprintf(path, len, "%s/.embr/sets/%s/hnsw", eb_root, set_name);
+    free(eb_root);
+    return path;
+}
+
+/*
+ * Get the path to the current set's source stat cache: .embr/sets/<set>/stat-cache
+ */
+char* get_current_set_stat_cache_path(void) {
+    char* eb_root = find_repo_root(NULL);
+    if (!eb_root) {
+        return NULL;
+    }
+    char set_name[PATH_MAX];
+    if (get_current_set(set_name, sizeof(set_name)) != EB_SUCCESS) {
+        free(eb_root);
+        return NULL;
+    }
+    size_t len = strlen(eb_root) + strlen("/.embr/sets//stat-cache") + strlen(set_name) + 1;
+    char* path = malloc(len);
+    if (!path) {
+        free(eb_root);
+        return NULL;
+    }
+    snprintf(path, len, "%s/.embr/sets/%s/stat-cache", eb_root, set_name);
+    free(eb_root);
+    return path;
+}
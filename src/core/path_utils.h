@@ -26,6 +26,12 @@ char* get_current_set_index_path(void);
 // Get the path to the current repository's model references directory
 char* get_current_set_model_refs_dir(void);
 
+// Get the path to the current set's vector index directory
+char* get_current_set_hnsw_dir(void);
+
+// Get the path to the current set's source stat cache
+char* get_current_set_stat_cache_path(void);
+
 /**
  * URL parsing structure
  */
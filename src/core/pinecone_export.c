@@ -0,0 +1,472 @@
+/*
+ * EmbeddingBridge - Pinecone Bulk Export Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pinecone_export.h"
+#include "parquet_set.h"
+#include "json_vector.h"
+#include "set_index.h"
+#include "quantize.h"
+#include "store.h"
+#include "thread_pool.h"
+#include "object_path.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Upper bound on reader threads */
+#define MAX_THREADS 64
+
+/* Entries read per window, and claimed by a reader at a time */
+#define EXPORT_WINDOW 1024
+#define EXPORT_BLOCK 32
+
+#define BATCH_PREFIX "{\"vectors\":["
+
+typedef struct {
+    char* source;
+    char* model;                  /* NULL if none was recorded */
+    char hash[65];
+    bool readable;
+    int64_t timestamp;
+    float* values;                /* Parquet */
+    size_t dims;
+    char* record;                 /* NDJSON */
+    size_t record_size;
+} export_slot_t;
+
+typedef struct {
+    export_slot_t slots[EXPORT_WINDOW];
+    size_t count;
+    size_t next_block;
+} export_window_t;
+
+typedef struct {
+    const char* root;
+    const char* dir;
+    eb_pinecone_options_t options;
+    eb_status_t status;
+    eb_pinecone_stats_t stats;
+
+    /* One store per reader */
+    eb_store_t* stores[MAX_THREADS];
+    unsigned threads;
+
+    /* Filled by the index walk, read by the pool, written in order */
+    export_window_t windows[2];
+    export_window_t* filling;
+    export_window_t* pending;     /* Read, not yet written */
+
+    /* NDJSON: the open file and the request being built */
+    FILE* file;
+    uint64_t file_written;
+    char* batch;
+    size_t batch_size;
+    size_t batch_capacity;
+    size_t batch_count;
+    char* suffix;                 /* ],"namespace":"..."} */
+    size_t suffix_size;
+
+    /* Parquet: one writer per dimension */
+    eb_parquet_set_writer_t** writers;
+    uint32_t* writer_dims;
+    size_t writer_count;
+
+    char** files;
+    size_t file_count;
+} pinecone_export_t;
+
+typedef struct {
+    pinecone_export_t* export;
+    export_window_t* window;
+    eb_store_t* store;
+} export_reader_t;
+
+static bool valid_set_name(const char* name) {
+    return name && *name && strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+           strcmp(name, "..") != 0;
+}
+
+/* Time the object was stored, 0 for packed objects */
+static int64_t object_time(const char* root, const char* hash) {
+    char path[PATH_MAX];
+    struct stat st;
+    if (eb_object_path(root, hash, "raw", path, sizeof(path)) != 0 || stat(path, &st) != 0)
+        return 0;
+    return (int64_t)st.st_mtime;
+}
+
+static void read_slot(const pinecone_export_t* export, eb_store_t* store, export_slot_t* slot) {
+    eb_object_view_t view;
+    if (eb_object_map(store, slot->hash, 0, &view) != EB_SUCCESS)
+        return;
+    eb_vector_ref_t ref;
+    if (view.header.obj_type != EB_OBJ_VECTOR || eb_object_vector_ref(&view, &ref) != EB_SUCCESS ||
+        ref.dims == 0 || ref.dims > UINT32_MAX || !(slot->values = malloc(ref.dims * sizeof(float)))) {
+        eb_object_unmap(&view);
+        return;
+    }
+    eb_vector_ref_get(&ref, 0, ref.dims, slot->values);
+    eb_object_unmap(&view);
+    slot->dims = ref.dims;
+    slot->timestamp = object_time(export->root, slot->hash);
+
+    if (export->options.format == EB_PINECONE_NDJSON) {
+        eb_json_vector_t vector = { slot->hash, slot->source, slot->model, slot->timestamp,
+                                    slot->values, slot->dims };
+        slot->record = malloc(eb_json_pinecone_record_max(&vector));
+        if (!slot->record)
+            return;
+        slot->record_size = eb_json_pinecone_record(&vector, slot->record);
+        free(slot->values);
+        slot->values = NULL;
+    }
+    slot->readable = true;
+}
+
+/* Claim blocks of a window until none are left */
+static void export_reader(void* arg) {
+    export_reader_t* reader = arg;
+    export_window_t* window = reader->window;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&window->next_block, 1, __ATOMIC_RELAXED) * EXPORT_BLOCK;
+        if (first >= window->count)
+            break;
+        size_t end = window->count - first < EXPORT_BLOCK ? window->count : first + EXPORT_BLOCK;
+        for (size_t i = first; i < end; i++)
+            read_slot(reader->export, reader->store, &window->slots[i]);
+    }
+}
+
+static void clear_window(export_window_t* window) {
+    for (size_t i = 0; i < window->count; i++) {
+        export_slot_t* slot = &window->slots[i];
+        free(slot->source);
+        free(slot->model);
+        free(slot->values);
+        free(slot->record);
+    }
+    memset(window, 0, sizeof(*window));
+}
+
+static eb_status_t add_file(pinecone_export_t* export, const char* path) {
+    char** grown = realloc(export->files, (export->file_count + 1) * sizeof(*grown));
+    if (!grown)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    export->files = grown;
+    if (!(export->files[export->file_count] = strdup(path)))
+        return EB_ERROR_MEMORY_ALLOCATION;
+    export->file_count++;
+    return EB_SUCCESS;
+}
+
+static eb_status_t close_ndjson_file(pinecone_export_t* export) {
+    if (!export->file)
+        return EB_SUCCESS;
+    int failed = fclose(export->file);
+    export->file = NULL;
+    export->file_written = 0;
+    return failed ? EB_ERROR_IO : EB_SUCCESS;
+}
+
+/* Write the request being built as one line */
+static eb_status_t flush_batch(pinecone_export_t* export) {
+    if (export->batch_count == 0)
+        return EB_SUCCESS;
+    size_t line = export->batch_size + export->suffix_size + 1;
+    eb_status_t status = EB_SUCCESS;
+    if (export->file && export->file_written + line > export->options.file_bytes)
+        status = close_ndjson_file(export);
+    if (status == EB_SUCCESS && !export->file) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/upsert-%05zu.ndjson", export->dir, export->file_count);
+        export->file = fopen(path, "wb");
+        status = export->file ? add_file(export, path) : EB_ERROR_IO;
+    }
+    if (status == EB_SUCCESS &&
+        (fwrite(export->batch, 1, export->batch_size, export->file) != export->batch_size ||
+         fwrite(export->suffix, 1, export->suffix_size, export->file) != export->suffix_size ||
+         fputc('\n', export->file) == EOF))
+        status = EB_ERROR_IO;
+    export->file_written += line;
+    export->stats.batches++;
+    export->batch_size = strlen(BATCH_PREFIX);
+    export->batch_count = 0;
+    return status;
+}
+
+static eb_status_t add_record(pinecone_export_t* export, const export_slot_t* slot) {
+    size_t empty = strlen(BATCH_PREFIX) + export->suffix_size;
+    if (empty + slot->record_size > export->options.request_bytes) {
+        DEBUG_WARN("pinecone: %s does not fit a request, skipped", slot->hash);
+        export->stats.skipped++;
+        return EB_SUCCESS;
+    }
+    eb_status_t status = EB_SUCCESS;
+    size_t needed = export->batch_size + 1 + slot->record_size;
+    if (export->batch_count == export->options.batch_vectors ||
+        needed + export->suffix_size > export->options.request_bytes)
+        status = flush_batch(export);
+    if (status != EB_SUCCESS)
+        return status;
+
+    needed = export->batch_size + 1 + slot->record_size;
+    if (needed > export->batch_capacity) {
+        char* grown = realloc(export->batch, needed);
+        if (!grown)
+            return EB_ERROR_MEMORY_ALLOCATION;
+        export->batch = grown;
+        export->batch_capacity = needed;
+    }
+    if (export->batch_count > 0)
+        export->batch[export->batch_size++] = ',';
+    memcpy(export->batch + export->batch_size, slot->record, slot->record_size);
+    export->batch_size += slot->record_size;
+    export->batch_count++;
+    export->stats.vectors++;
+    return EB_SUCCESS;
+}
+
+static eb_parquet_set_writer_t* parquet_writer(pinecone_export_t* export, uint32_t dims) {
+    for (size_t i = 0; i < export->writer_count; i++)
+        if (export->writer_dims[i] == dims)
+            return export->writers[i];
+    eb_parquet_set_writer_t** writers = realloc(export->writers, (export->writer_count + 1) * sizeof(*writers));
+    if (writers)
+        export->writers = writers;
+    uint32_t* all_dims = realloc(export->writer_dims, (export->writer_count + 1) * sizeof(*all_dims));
+    if (all_dims)
+        export->writer_dims = all_dims;
+    if (!writers || !all_dims)
+        return NULL;
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "vectors-%u", dims);
+    eb_parquet_set_options_t options = { .file_bytes = export->options.file_bytes, .format = EB_PARQUET_SET_PARQUET };
+    if (eb_parquet_set_writer_open(export->dir, prefix, dims, &options, &export->writers[export->writer_count]) != EB_SUCCESS)
+        return NULL;
+    export->writer_dims[export->writer_count] = dims;
+    return export->writers[export->writer_count++];
+}
+
+/* Write a read window in index order */
+static eb_status_t write_window(pinecone_export_t* export, export_window_t* window) {
+    eb_status_t status = EB_SUCCESS;
+    for (size_t i = 0; status == EB_SUCCESS && i < window->count; i++) {
+        const export_slot_t* slot = &window->slots[i];
+        if (!slot->readable) {
+            DEBUG_WARN("pinecone: cannot read %s, skipped", slot->hash);
+            export->stats.skipped++;
+        } else if (export->options.format == EB_PINECONE_NDJSON) {
+            status = add_record(export, slot);
+        } else {
+            eb_parquet_set_writer_t* writer = parquet_writer(export, (uint32_t)slot->dims);
+            eb_parquet_set_row_t row = { slot->hash, slot->values, slot->source, slot->model, slot->timestamp };
+            status = writer ? eb_parquet_set_writer_add(writer, &row) : EB_ERROR_IO;
+            if (status == EB_SUCCESS)
+                export->stats.vectors++;
+        }
+    }
+    clear_window(window);
+    return status;
+}
+
+/*
+ * Read the filling window with the pool while the pending one is written,
+ * then make it the pending one
+ */
+static eb_status_t advance(pinecone_export_t* export) {
+    export_window_t* window = export->filling;
+    export_reader_t readers[MAX_THREADS];
+    eb_task_group_t group;
+    eb_task_group_init(&group, eb_pool_shared());
+    size_t blocks = (window->count + EXPORT_BLOCK - 1) / EXPORT_BLOCK;
+    for (unsigned i = 0; i < export->threads && i < blocks; i++) {
+        readers[i] = (export_reader_t){ export, window, export->stores[i] };
+        eb_task_group_spawn(&group, export_reader, &readers[i]);
+    }
+
+    // Readers the pool has not started yet are run here once the write is done
+    eb_status_t status = EB_SUCCESS;
+    if (export->pending)
+        status = write_window(export, export->pending);
+    eb_task_group_wait(&group);
+
+    export->pending = window;
+    export->filling = window == &export->windows[0] ? &export->windows[1] : &export->windows[0];
+    return status;
+}
+
+static int export_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    pinecone_export_t* export = ctx;
+    if (export->options.model && strcmp(export->options.model, model) != 0)
+        return 0;
+    export_window_t* window = export->filling;
+    export_slot_t* slot = &window->slots[window->count];
+    slot->source = strdup(source);
+    slot->model = model[0] ? strdup(model) : NULL;
+    if (!slot->source || (model[0] && !slot->model)) {
+        free(slot->source);
+        free(slot->model);
+        slot->source = slot->model = NULL;
+        export->status = EB_ERROR_MEMORY_ALLOCATION;
+        return 1;
+    }
+    memcpy(slot->hash, hash, 65);
+    if (++window->count == EXPORT_WINDOW)
+        export->status = advance(export);
+    return export->status != EB_SUCCESS;
+}
+
+/* Build the suffix closing every request */
+static eb_status_t build_suffix(pinecone_export_t* export) {
+    const char* name_space = export->options.name_space;
+    export->suffix = malloc(name_space ? 6 * strlen(name_space) + 32 : 4);
+    if (!export->suffix)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    size_t n = 0;
+    export->suffix[n++] = ']';
+    if (name_space) {
+        memcpy(export->suffix + n, ",\"namespace\":\"", 14);
+        n += 14;
+        n += eb_json_escape(name_space, export->suffix + n);
+        export->suffix[n++] = '"';
+    }
+    export->suffix[n++] = '}';
+    export->suffix_size = n;
+    export->batch_capacity = 64 * 1024;
+    export->batch = malloc(export->batch_capacity);
+    if (!export->batch)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    memcpy(export->batch, BATCH_PREFIX, strlen(BATCH_PREFIX));
+    export->batch_size = strlen(BATCH_PREFIX);
+    return EB_SUCCESS;
+}
+
+/* Flush what is left and close every file */
+static eb_status_t finish(pinecone_export_t* export, eb_status_t status) {
+    if (status == EB_SUCCESS && export->filling->count > 0)
+        status = advance(export);
+    if (status == EB_SUCCESS && export->pending)
+        status = write_window(export, export->pending);
+    clear_window(&export->windows[0]);
+    clear_window(&export->windows[1]);
+
+    if (status == EB_SUCCESS)
+        status = flush_batch(export);
+    eb_status_t closed = close_ndjson_file(export);
+    if (status == EB_SUCCESS)
+        status = closed;
+
+    for (size_t i = 0; i < export->writer_count; i++) {
+        if (status != EB_SUCCESS) {
+            eb_parquet_set_writer_abort(export->writers[i]);
+            continue;
+        }
+        char** written = NULL;
+        size_t written_count = 0;
+        status = eb_parquet_set_writer_close(export->writers[i], &written, &written_count);
+        for (size_t j = 0; j < written_count; j++) {
+            if (status == EB_SUCCESS)
+                status = add_file(export, written[j]);
+            free(written[j]);
+        }
+        free(written);
+    }
+    return status;
+}
+
+eb_status_t eb_pinecone_export(const char* root, const char* set_name, const char* dir,
+                               const eb_pinecone_options_t* options, char*** files_out,
+                               size_t* count_out, eb_pinecone_stats_t* stats_out) {
+    if (!root || !dir || !valid_set_name(set_name))
+        return EB_ERROR_INVALID_PARAMETER;
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s", root, set_name);
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+
+    pinecone_export_t* export = calloc(1, sizeof(*export));
+    if (!export)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    export->root = root;
+    export->dir = dir;
+    if (options)
+        export->options = *options;
+    if (export->options.batch_vectors == 0)
+        export->options.batch_vectors = EB_PINECONE_BATCH_VECTORS;
+    if (export->options.batch_vectors > EB_PINECONE_MAX_BATCH_VECTORS)
+        export->options.batch_vectors = EB_PINECONE_MAX_BATCH_VECTORS;
+    if (export->options.request_bytes == 0)
+        export->options.request_bytes = EB_PINECONE_REQUEST_BYTES;
+    if (export->options.file_bytes == 0)
+        export->options.file_bytes = export->options.format == EB_PINECONE_NDJSON ? EB_PINECONE_FILE_BYTES
+                                                                                 : EB_PARQUET_SET_FILE_BYTES;
+    export->filling = &export->windows[0];
+
+    eb_status_t status = build_suffix(export);
+    // A reader without a store is not started; the calling thread needs the first one
+    unsigned wanted = eb_pool_threads(export->options.threads, MAX_THREADS);
+    eb_store_config_t config = { .root_path = (char*)root };
+    while (status == EB_SUCCESS && export->threads < wanted &&
+           eb_store_init(&config, &export->stores[export->threads]) == EB_SUCCESS)
+        export->threads++;
+    if (status == EB_SUCCESS && export->threads == 0)
+        status = EB_ERROR_NOT_INITIALIZED;
+
+    eb_set_index_t* index = NULL;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s/index", root, set_name);
+    if (status == EB_SUCCESS)
+        status = eb_set_index_open(root, path, &index);
+    if (status == EB_SUCCESS) {
+        export->status = EB_SUCCESS;
+        status = eb_set_index_foreach(index, NULL, export_entry, export);
+        if (status == EB_SUCCESS)
+            status = export->status;
+        eb_set_index_close(index);
+    }
+    status = finish(export, status);
+
+    for (unsigned i = 0; i < export->threads; i++)
+        eb_store_destroy(export->stores[i]);
+    free(export->batch);
+    free(export->suffix);
+    free(export->writers);
+    free(export->writer_dims);
+
+    if (status != EB_SUCCESS || !files_out) {
+        for (size_t i = 0; i < export->file_count; i++) {
+            if (status != EB_SUCCESS)
+                unlink(export->files[i]);
+            free(export->files[i]);
+        }
+        free(export->files);
+        export->files = NULL;
+    }
+    if (status == EB_SUCCESS) {
+        DEBUG_INFO("pinecone: %zu vectors of set %s in %zu files", export->stats.vectors, set_name,
+                   export->file_count);
+        if (files_out)
+            *files_out = export->files;
+        if (count_out)
+            *count_out = export->file_count;
+        if (stats_out)
+            *stats_out = export->stats;
+    }
+    free(export);
+    return status;
+}
@@ -0,0 +1,86 @@
+/*
+ * EmbeddingBridge - Pinecone Bulk Export
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_PINECONE_EXPORT_H
+#define EB_PINECONE_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * Exports the live vectors of a set for a Pinecone index in one pass over
+ * the set index. Entries are taken in windows; a pool of workers, each with
+ * its own store, reads the objects of a window (and formats them, for
+ * NDJSON) while the calling thread writes the previous results in index
+ * order.
+ *
+ * NDJSON output is upsert-NNNNN.ndjson in dir. Every line is the body of
+ * one upsert request,
+ *
+ *   {"vectors":[{"id":"<hash>","values":[...],"metadata":{...}},...],"namespace":"ns"}
+ *
+ * holding at most batch_vectors vectors and request_bytes bytes, so the
+ * files, and the lines within them, can be sent by parallel uploaders.
+ * Vectors that do not fit a request on their own are skipped.
+ *
+ * Parquet output is the set export of parquet_set.h (vectors-<dims>-NNNNN.parquet)
+ * for Pinecone's bulk import, which takes whole files; batch limits do not
+ * apply to it.
+ */
+
+/* Vectors per upsert request when not configured, and the most Pinecone takes */
+#define EB_PINECONE_BATCH_VECTORS 100
+#define EB_PINECONE_MAX_BATCH_VECTORS 1000
+
+/* Largest upsert request body when not configured (Pinecone's limit) */
+#define EB_PINECONE_REQUEST_BYTES (2 * 1024 * 1024)
+
+/* Bytes per NDJSON file when not configured */
+#define EB_PINECONE_FILE_BYTES (64ULL * 1024 * 1024)
+
+typedef enum {
+    EB_PINECONE_NDJSON = 0,       /* Upsert request bodies, one per line */
+    EB_PINECONE_PARQUET           /* Files for bulk import */
+} eb_pinecone_format_t;
+
+typedef struct {
+    eb_pinecone_format_t format;
+    size_t batch_vectors;         /* Vectors per request, 0 for EB_PINECONE_BATCH_VECTORS */
+    size_t request_bytes;         /* Largest request body, 0 for EB_PINECONE_REQUEST_BYTES */
+    uint64_t file_bytes;          /* Bytes per file, 0 for the default */
+    const char* name_space;       /* Pinecone namespace, NULL for the default one */
+    const char* model;            /* Only export this model, NULL for every model */
+    unsigned threads;             /* Reader threads, 0 for one per online CPU */
+} eb_pinecone_options_t;
+
+typedef struct {
+    size_t vectors;               /* Vectors written */
+    size_t batches;               /* Upsert requests written (NDJSON) */
+    size_t skipped;               /* Unreadable or oversized vectors */
+} eb_pinecone_stats_t;
+
+/**
+ * Export a set for Pinecone
+ *
+ * @param root Repository root
+ * @param set_name Set to export
+ * @param dir Existing directory to write the files to
+ * @param options Options, NULL for the defaults
+ * @param files_out Receives the paths of the files written (caller frees each and the array), may be NULL
+ * @param count_out Receives the number of files written, may be NULL
+ * @param stats_out Receives the counts, may be NULL
+ * @return Status code (EB_ERROR_NOT_FOUND for an unknown set)
+ */
+eb_status_t eb_pinecone_export(const char* root, const char* set_name, const char* dir,
+                               const eb_pinecone_options_t* options, char*** files_out,
+                               size_t* count_out, eb_pinecone_stats_t* stats_out);
+
+#endif /* EB_PINECONE_EXPORT_H */
@@ -0,0 +1,982 @@
+/*
+ * EmbeddingBridge - Learned Cross-Model Projections Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "projection.h"
+#include "distance.h"
+#include "set_index.h"
+#include "store.h"
+#include "debug.h"
+
+#define PROJECTION_SUFFIX ".proj"
+
+typedef struct {
+    size_t dims;                /* Input dimensions */
+    const float* offset;        /* W mean, one per output */
+    const float* weights;       /* Output rows of dims values */
+} projection_side_t;
+
+struct eb_projection {
+    size_t dims;                /* Output dimensions */
+    size_t pairs;
+    float fit_cosine;
+    projection_side_t side[2];
+    float* data;                /* Owns the offsets and weights */
+};
+
+static size_t side_floats(size_t dims, size_t input_dims) {
+    return dims + dims * input_dims;
+}
+
+static eb_projection_t* projection_alloc(size_t dims, size_t dims_a, size_t dims_b) {
+    eb_projection_t* p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->data = malloc((side_floats(dims, dims_a) + side_floats(dims, dims_b)) * sizeof(float));
+    if (!p->data) {
+        free(p);
+        return NULL;
+    }
+    p->dims = dims;
+    p->side[0].dims = dims_a;
+    p->side[0].offset = p->data;
+    p->side[0].weights = p->data + dims;
+    p->side[1].dims = dims_b;
+    p->side[1].offset = p->data + side_floats(dims, dims_a);
+    p->side[1].weights = p->side[1].offset + dims;
+    return p;
+}
+
+void eb_projection_free(eb_projection_t* projection) {
+    if (!projection)
+        return;
+    free(projection->data);
+    free(projection);
+}
+
+void eb_projection_describe(const eb_projection_t* projection, eb_projection_info_t* info) {
+    info->dims_a = projection->side[0].dims;
+    info->dims_b = projection->side[1].dims;
+    info->dims = projection->dims;
+    info->pairs = projection->pairs;
+    info->fit_cosine = projection->fit_cosine;
+}
+
+size_t eb_projection_input_dims(const eb_projection_t* projection, eb_projection_side_t side) {
+    return projection->side[side == EB_PROJECT_B].dims;
+}
+
+void eb_projection_apply(const eb_projection_t* projection, eb_projection_side_t side,
+                         const float* values, float* out) {
+    const projection_side_t* s = &projection->side[side == EB_PROJECT_B];
+    for (size_t j = 0; j < projection->dims; j++)
+        out[j] = eb_dot(s->weights + j * s->dims, values, s->dims) - s->offset[j];
+}
+
+/* ---- Fitting ---- */
+
+/*
+ * Eigendecomposition of a symmetric n x n matrix: Householder reduction
+ * to tridiagonal form, then the implicit QL method (tred2/tql2 from
+ * EISPACK). On return the rows of a are the eigenvectors, in ascending
+ * order of the eigenvalues in values.
+ */
+static void symmetric_eigen(double* a, size_t n, double* values) {
+    double* V = a;
+    double* d = values;
+    double* e = calloc(n, sizeof(double));
+    double* z = malloc(n * n * sizeof(double));
+    if (!e || !z) {
+        free(e);
+        free(z);
+        for (size_t i = 0; i < n; i++)
+            d[i] = NAN;
+        return;
+    }
+#define V_(i, j) V[(size_t)(i) * n + (size_t)(j)]
+#define Z_(i, j) z[(size_t)(i) * n + (size_t)(j)]
+
+    // Householder reduction to tridiagonal form
+    for (size_t j = 0; j < n; j++)
+        d[j] = V_(n - 1, j);
+    for (size_t i = n - 1; i > 0; i--) {
+        double scale = 0.0, h = 0.0;
+        for (size_t k = 0; k < i; k++)
+            scale += fabs(d[k]);
+        if (scale == 0.0) {
+            e[i] = d[i - 1];
+            for (size_t j = 0; j < i; j++) {
+                d[j] = V_(i - 1, j);
+                V_(i, j) = 0.0;
+                V_(j, i) = 0.0;
+            }
+        } else {
+            for (size_t k = 0; k < i; k++) {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = sqrt(h);
+            if (f > 0)
+                g = -g;
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for (size_t j = 0; j < i; j++)
+                e[j] = 0.0;
+            for (size_t j = 0; j < i; j++) {
+                f = d[j];
+                V_(j, i) = f;
+                g = e[j] + V_(j, j) * f;
+                for (size_t k = j + 1; k <= i - 1; k++) {
+                    g += V_(k, j) * d[k];
+                    e[k] += V_(k, j) * f;
+                }
+                e[j] = g;
+            }
+            f = 0.0;
+            for (size_t j = 0; j < i; j++) {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            double hh = f / (h + h);
+            for (size_t j = 0; j < i; j++)
+                e[j] -= hh * d[j];
+            for (size_t j = 0; j < i; j++) {
+                f = d[j];
+                g = e[j];
+                for (size_t k = j; k <= i - 1; k++)
+                    V_(k, j) -= (f * e[k] + g * d[k]);
+                d[j] = V_(i - 1, j);
+                V_(i, j) = 0.0;
+            }
+        }
+        d[i] = h;
+    }
+
+    // Accumulate the transformations
+    for (size_t i = 0; i + 1 < n; i++) {
+        V_(n - 1, i) = V_(i, i);
+        V_(i, i) = 1.0;
+        double h = d[i + 1];
+        if (h != 0.0) {
+            for (size_t k = 0; k <= i; k++)
+                d[k] = V_(k, i + 1) / h;
+            for (size_t j = 0; j <= i; j++) {
+                double g = 0.0;
+                for (size_t k = 0; k <= i; k++)
+                    g += V_(k, i + 1) * V_(k, j);
+                for (size_t k = 0; k <= i; k++)
+                    V_(k, j) -= g * d[k];
+            }
+        }
+        for (size_t k = 0; k <= i; k++)
+            V_(k, i + 1) = 0.0;
+    }
+    for (size_t j = 0; j < n; j++) {
+        d[j] = V_(n - 1, j);
+        V_(n - 1, j) = 0.0;
+    }
+    V_(n - 1, n - 1) = 1.0;
+    e[0] = 0.0;
+
+    // The QL sweeps rotate pairs of eigenvectors; keep them as contiguous rows
+    for (size_t i = 0; i < n; i++)
+        for (size_t k = 0; k < n; k++)
+            Z_(i, k) = V_(k, i);
+
+    for (size_t i = 1; i < n; i++)
+        e[i - 1] = e[i];
+    e[n - 1] = 0.0;
+
+    double f = 0.0, tst1 = 0.0;
+    const double eps = 0x1p-52;
+    for (size_t l = 0; l < n; l++) {
+        tst1 = fmax(tst1, fabs(d[l]) + fabs(e[l]));
+        size_t m = l;
+        while (m < n && fabs(e[m]) > eps * tst1)
+            m++;
+        if (m == n)
+            m = n - 1;
+
+        // Iterate until the off-diagonal element vanishes
+        for (int iter = 0; m > l && iter < 60; iter++) {
+            double g = d[l];
+            double p = (d[l + 1] - g) / (2.0 * e[l]);
+            double r = hypot(p, 1.0);
+            if (p < 0)
+                r = -r;
+            d[l] = e[l] / (p + r);
+            d[l + 1] = e[l] * (p + r);
+            double dl1 = d[l + 1];
+            double h = g - d[l];
+            for (size_t i = l + 2; i < n; i++)
+                d[i] -= h;
+            f += h;
+
+            p = d[m];
+            double c = 1.0, c2 = 1.0, c3 = 1.0;
+            double el1 = e[l + 1];
+            double s = 0.0, s2 = 0.0;
+            for (size_t i = m; i-- > l;) {
+                c3 = c2;
+                c2 = c;
+                s2 = s;
+                g = c * e[i];
+                h = c * p;
+                r = hypot(p, e[i]);
+                e[i + 1] = s * r;
+                s = e[i] / r;
+                c = p / r;
+                p = c * d[i] - s * g;
+                d[i + 1] = h + s * (c * g + s * d[i]);
+                double* zi = &Z_(i, 0);
+                double* zi1 = &Z_(i + 1, 0);
+                for (size_t k = 0; k < n; k++) {
+                    h = zi1[k];
+                    zi1[k] = s * zi[k] + c * h;
+                    zi[k] = c * zi[k] - s * h;
+                }
+            }
+            p = -s * s2 * c3 * el1 * e[l] / dl1;
+            e[l] = s * p;
+            d[l] = c * p;
+            if (!(fabs(e[l]) > eps * tst1))
+                break;
+        }
+        d[l] += f;
+        e[l] = 0.0;
+    }
+
+    // Sort ascending, moving the eigenvector rows along
+    for (size_t i = 0; i + 1 < n; i++) {
+        size_t k = i;
+        for (size_t j = i + 1; j < n; j++)
+            if (d[j] < d[k])
+                k = j;
+        if (k != i) {
+            double t = d[k];
+            d[k] = d[i];
+            d[i] = t;
+            for (size_t j = 0; j < n; j++) {
+                t = Z_(i, j);
+                Z_(i, j) = Z_(k, j);
+                Z_(k, j) = t;
+            }
+        }
+    }
+    memcpy(a, z, n * n * sizeof(double));
+#undef V_
+#undef Z_
+    free(e);
+    free(z);
+}
+
+/*
+ * Coordinates of the centered rows along their top k principal axes,
+ * and the axes themselves (k x d, one per row). With fewer rows than
+ * dimensions the n x n Gram matrix is decomposed instead of the d x d
+ * covariance; axes without variance are left zero.
+ */
+static eb_status_t principal_axes(const float* x, size_t n, size_t d, size_t k,
+                                  double* mean, double* axes, double* coords) {
+    for (size_t i = 0; i < d; i++)
+        mean[i] = 0.0;
+    for (size_t r = 0; r < n; r++)
+        for (size_t i = 0; i < d; i++)
+            mean[i] += x[r * d + i];
+    for (size_t i = 0; i < d; i++)
+        mean[i] /= (double)n;
+
+    double* centered = malloc(n * d * sizeof(double));
+    size_t m = n < d ? n : d;
+    double* sym = calloc(m * m, sizeof(double));
+    double* values = malloc(m * sizeof(double));
+    if (!centered || !sym || !values) {
+        free(centered);
+        free(sym);
+        free(values);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t r = 0; r < n; r++)
+        for (size_t i = 0; i < d; i++)
+            centered[r * d + i] = x[r * d + i] - mean[i];
+
+    if (n < d) {
+        for (size_t r = 0; r < n; r++) {
+            for (size_t s = r; s < n; s++) {
+                double sum = 0.0;
+                for (size_t i = 0; i < d; i++)
+                    sum += centered[r * d + i] * centered[s * d + i];
+                sym[r * n + s] = sym[s * n + r] = sum;
+            }
+        }
+    } else {
+        for (size_t r = 0; r < n; r++) {
+            const double* row = centered + r * d;
+            for (size_t i = 0; i < d; i++) {
+                double v = row[i];
+                double* out = sym + i * d;
+                for (size_t j = i; j < d; j++)
+                    out[j] += v * row[j];
+            }
+        }
+        for (size_t i = 0; i < d; i++)
+            for (size_t j = 0; j < i; j++)
+                sym[i * d + j] = sym[j * d + i];
+    }
+
+    symmetric_eigen(sym, m, values);
+    double largest = fabs(values[m - 1]);
+    eb_status_t status = isfinite(largest) ? EB_SUCCESS : EB_ERROR_COMPUTATION_FAILED;
+
+    for (size_t j = 0; j < k && status == EB_SUCCESS; j++) {
+        const double* vec = sym + (m - 1 - j) * m;
+        double lambda = values[m - 1 - j];
+        double* axis = axes + j * d;
+        bool degenerate = !(lambda > 1e-12 * largest) || lambda <= 0.0;
+        if (n < d) {
+            // axis = X^T g / sqrt(lambda), coordinates = sqrt(lambda) g
+            double inv = degenerate ? 0.0 : 1.0 / sqrt(lambda);
+            for (size_t i = 0; i < d; i++)
+                axis[i] = 0.0;
+            for (size_t r = 0; r < n; r++) {
+                double w = vec[r] * inv;
+                for (size_t i = 0; i < d; i++)
+                    axis[i] += w * centered[r * d + i];
+            }
+            for (size_t r = 0; r < n; r++)
+                coords[r * k + j] = degenerate ? 0.0 : sqrt(lambda) * vec[r];
+        } else {
+            for (size_t i = 0; i < d; i++)
+                axis[i] = degenerate ? 0.0 : vec[i];
+            for (size_t r = 0; r < n; r++) {
+                double sum = 0.0;
+                for (size_t i = 0; i < d; i++)
+                    sum += centered[r * d + i] * axis[i];
+                coords[r * k + j] = sum;
+            }
+        }
+    }
+
+    free(centered);
+    free(sym);
+    free(values);
+    return status;
+}
+
+/*
+ * Orthogonal R minimizing |A R - B| for k x k cross products M = A^T B:
+ * R = U V^T from the SVD M = U S V^T. V and S^2 come from the
+ * eigendecomposition of M^T M and U = M V / S, completed to an
+ * orthonormal basis where S vanishes.
+ */
+static eb_status_t procrustes(const double* M, size_t k, double* R) {
+    double* mtm = calloc(k * k, sizeof(double));
+    double* values = malloc(k * sizeof(double));
+    double* U = malloc(k * k * sizeof(double));     /* Column i stored as row i */
+    if (!mtm || !values || !U) {
+        free(mtm);
+        free(values);
+        free(U);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t i = 0; i < k; i++)
+        for (size_t j = 0; j < k; j++) {
+            double sum = 0.0;
+            for (size_t l = 0; l < k; l++)
+                sum += M[l * k + i] * M[l * k + j];
+            mtm[i * k + j] = sum;
+        }
+    symmetric_eigen(mtm, k, values);   /* Rows are the right singular vectors */
+
+    double largest = sqrt(fmax(values[k - 1], 0.0));
+    size_t basis = 0;
+    for (size_t i = 0; i < k; i++) {
+        const double* v = mtm + (k - 1 - i) * k;
+        double* u = U + i * k;
+        for (size_t l = 0; l < k; l++) {
+            double sum = 0.0;
+            for (size_t j = 0; j < k; j++)
+                sum += M[l * k + j] * v[j];
+            u[l] = sum;
+        }
+
+        // Modified Gram-Schmidt; directions S does not determine take unit vectors
+        for (int attempt = 0;; attempt++) {
+            for (size_t p = 0; p < i; p++) {
+                double dot = 0.0;
+                for (size_t l = 0; l < k; l++)
+                    dot += U[p * k + l] * u[l];
+                for (size_t l = 0; l < k; l++)
+                    u[l] -= dot * U[p * k + l];
+            }
+            double norm = 0.0;
+            for (size_t l = 0; l < k; l++)
+                norm += u[l] * u[l];
+            norm = sqrt(norm);
+            if (norm > 1e-9 * (largest > 0.0 ? largest : 1.0) && (attempt > 0 || norm > 1e-9)) {
+                for (size_t l = 0; l < k; l++)
+                    u[l] /= norm;
+                break;
+            }
+            if (basis >= k) {
+                free(mtm);
+                free(values);
+                free(U);
+                return EB_ERROR_COMPUTATION_FAILED;
+            }
+            for (size_t l = 0; l < k; l++)
+                u[l] = l == basis ? 1.0 : 0.0;
+            basis++;
+        }
+    }
+
+    for (size_t l = 0; l < k; l++)
+        for (size_t j = 0; j < k; j++) {
+            double sum = 0.0;
+            for (size_t i = 0; i < k; i++)
+                sum += U[i * k + l] * mtm[(k - 1 - i) * k + j];
+            R[l * k + j] = sum;
+        }
+
+    free(mtm);
+    free(values);
+    free(U);
+    return EB_SUCCESS;
+}
+
+/* Store one side as float rows W (dims x d) and offsets W mean */
+static void store_side(projection_side_t* side, const double* W, const double* mean, size_t dims) {
+    float* offset = (float*)side->offset;
+    float* weights = (float*)side->weights;
+    for (size_t j = 0; j < dims; j++) {
+        double sum = 0.0;
+        for (size_t i = 0; i < side->dims; i++) {
+            weights[j * side->dims + i] = (float)W[j * side->dims + i];
+            sum += W[j * side->dims + i] * mean[i];
+        }
+        offset[j] = (float)sum;
+    }
+}
+
+static bool all_finite(const float* values, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        if (!isfinite(values[i]))
+            return false;
+    return true;
+}
+
+eb_status_t eb_projection_fit(const float* a, size_t dims_a, const float* b, size_t dims_b,
+                              size_t count, size_t dims, eb_projection_t** out) {
+    if (!a || !b || !out || dims_a == 0 || dims_b == 0 || count < 2 ||
+        dims_a > UINT32_MAX || dims_b > UINT32_MAX || count > UINT32_MAX)
+        return EB_ERROR_INVALID_INPUT;
+    size_t limit = dims_a < dims_b ? dims_a : dims_b;
+    if (limit > count - 1)
+        limit = count - 1;
+    if (dims == 0)
+        dims = limit;
+    if (dims > limit)
+        return EB_ERROR_INVALID_INPUT;
+    if (!all_finite(a, count * dims_a) || !all_finite(b, count * dims_b))
+        return EB_ERROR_INVALID_INPUT;
+
+    size_t k = dims;
+    double* mean_a = malloc(dims_a * sizeof(double));
+    double* mean_b = malloc(dims_b * sizeof(double));
+    double* axes_a = malloc(k * dims_a * sizeof(double));
+    double* axes_b = malloc(k * dims_b * sizeof(double));
+    double* xa = malloc(count * k * sizeof(double));
+    double* yb = malloc(count * k * sizeof(double));
+    double* M = calloc(k * k, sizeof(double));
+    double* R = malloc(k * k * sizeof(double));
+    double* W = malloc(k * dims_a * sizeof(double));
+    eb_projection_t* p = projection_alloc(k, dims_a, dims_b);
+    eb_status_t status = EB_SUCCESS;
+    if (!mean_a || !mean_b || !axes_a || !axes_b || !xa || !yb || !M || !R || !W || !p)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    if (status == EB_SUCCESS)
+        status = principal_axes(a, count, dims_a, k, mean_a, axes_a, xa);
+    if (status == EB_SUCCESS)
+        status = principal_axes(b, count, dims_b, k, mean_b, axes_b, yb);
+
+    // Rotate the reduced first model onto the reduced second one
+    if (status == EB_SUCCESS) {
+        for (size_t r = 0; r < count; r++)
+            for (size_t i = 0; i < k; i++) {
+                double x = xa[r * k + i];
+                for (size_t j = 0; j < k; j++)
+                    M[i * k + j] += x * yb[r * k + j];
+            }
+        status = procrustes(M, k, R);
+    }
+
+    if (status == EB_SUCCESS) {
+        // Row j of W is column j of axes_a^T R
+        for (size_t j = 0; j < k; j++)
+            for (size_t i = 0; i < dims_a; i++) {
+                double sum = 0.0;
+                for (size_t l = 0; l < k; l++)
+                    sum += axes_a[l * dims_a + i] * R[l * k + j];
+                W[j * dims_a + i] = sum;
+            }
+        store_side(&p->side[0], W, mean_a, k);
+        store_side(&p->side[1], axes_b, mean_b, k);
+        p->pairs = count;
+
+        // Fit quality over the training pairs
+        float* pa = malloc(k * sizeof(float));
+        float* pb = malloc(k * sizeof(float));
+        if (!pa || !pb) {
+            status = EB_ERROR_MEMORY_ALLOCATION;
+        } else {
+            double total = 0.0;
+            for (size_t r = 0; r < count; r++) {
+                eb_projection_apply(p, EB_PROJECT_A, a + r * dims_a, pa);
+                eb_projection_apply(p, EB_PROJECT_B, b + r * dims_b, pb);
+                eb_cosine_terms_t terms = eb_cosine_terms(pa, pb, k);
+                if (terms.norm_a > 0.0f && terms.norm_b > 0.0f)
+                    total += terms.dot / (sqrt(terms.norm_a) * sqrt(terms.norm_b));
+            }
+            p->fit_cosine = (float)(total / (double)count);
+        }
+        free(pa);
+        free(pb);
+    }
+
+    free(mean_a);
+    free(mean_b);
+    free(axes_a);
+    free(axes_b);
+    free(xa);
+    free(yb);
+    free(M);
+    free(R);
+    free(W);
+    if (status != EB_SUCCESS) {
+        eb_projection_free(p);
+        return status;
+    }
+    DEBUG_INFO("Fitted %zu-dimensional projection over %zu pairs, fit cosine %.4f",
+               k, count, p->fit_cosine);
+    *out = p;
+    return EB_SUCCESS;
+}
+
+/* ---- Files ---- */
+
+/* Escape a model name into a file name, like the HNSW graph files */
+static void escape_model(const char* model, char* out, size_t size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t pos = 0;
+    for (const char* p = model; *p && pos + 4 < size; p++) {
+        unsigned char c = (unsigned char)*p;
+        bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                     c == '_' || ((c == '.' || c == '-') && p != model);
+        if (plain) {
+            out[pos++] = (char)c;
+        } else {
+            out[pos++] = '%';
+            out[pos++] = hex[c >> 4];
+            out[pos++] = hex[c & 0xF];
+        }
+    }
+    out[pos] = '\0';
+}
+
+static bool unescape_model(const char* name, size_t length, char* out, size_t size) {
+    size_t pos = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (pos + 1 >= size)
+            return false;
+        if (name[i] == '%') {
+            unsigned value;
+            if (i + 2 >= length || sscanf(name + i + 1, "%2x", &value) != 1)
+                return false;
+            out[pos++] = (char)value;
+            i += 2;
+        } else {
+            out[pos++] = name[i];
+        }
+    }
+    out[pos] = '\0';
+    return pos > 0;
+}
+
+static void projection_path(const char* root, const char* model_a, const char* model_b,
+                            char* path, size_t size) {
+    char a[PATH_MAX / 4], b[PATH_MAX / 4];
+    escape_model(model_a, a, sizeof(a));
+    escape_model(model_b, b, sizeof(b));
+    snprintf(path, size, "%s/" EB_PROJECTION_DIR "/%s~%s" PROJECTION_SUFFIX, root, a, b);
+}
+
+static bool valid_models(const char* model_a, const char* model_b) {
+    return model_a && model_b && *model_a && *model_b && strcmp(model_a, model_b) != 0;
+}
+
+eb_status_t eb_projection_save(const char* root, const char* model_a, const char* model_b,
+                               const eb_projection_t* projection) {
+    if (!root || !projection || !valid_models(model_a, model_b))
+        return EB_ERROR_INVALID_INPUT;
+
+    char path[PATH_MAX], tmp_path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/" EB_PROJECTION_DIR, root);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+
+    // The pair is kept in one orientation only
+    projection_path(root, model_b, model_a, path, sizeof(path));
+    if (unlink(path) != 0 && errno != ENOENT)
+        return EB_ERROR_FILE_IO;
+
+    projection_path(root, model_a, model_b, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+
+    eb_projection_header_t header = {
+        .magic = EB_PROJECTION_MAGIC,
+        .version = EB_PROJECTION_VERSION,
+        .dims_a = (uint32_t)projection->side[0].dims,
+        .dims_b = (uint32_t)projection->side[1].dims,
+        .dims = (uint32_t)projection->dims,
+        .pairs = (uint32_t)projection->pairs,
+        .fit_cosine = projection->fit_cosine,
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (int s = 0; s < 2 && ok; s++) {
+        const projection_side_t* side = &projection->side[s];
+        size_t weights = projection->dims * side->dims;
+        ok = fwrite(side->offset, sizeof(float), projection->dims, f) == projection->dims &&
+             fwrite(side->weights, sizeof(float), weights, f) == weights;
+    }
+    ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+static eb_status_t read_projection(const char* path, bool swapped, eb_projection_t** out) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+
+    eb_projection_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != EB_PROJECTION_MAGIC ||
+        header.version != EB_PROJECTION_VERSION || header.dims == 0 || header.dims_a == 0 ||
+        header.dims_b == 0) {
+        fclose(f);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+
+    eb_projection_t* p = projection_alloc(header.dims, header.dims_a, header.dims_b);
+    if (!p) {
+        fclose(f);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    size_t floats = side_floats(header.dims, header.dims_a) + side_floats(header.dims, header.dims_b);
+    bool ok = fread(p->data, sizeof(float), floats, f) == floats && fgetc(f) == EOF;
+    fclose(f);
+    if (!ok) {
+        eb_projection_free(p);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    p->pairs = header.pairs;
+    p->fit_cosine = header.fit_cosine;
+    if (swapped) {
+        projection_side_t side = p->side[0];
+        p->side[0] = p->side[1];
+        p->side[1] = side;
+    }
+    *out = p;
+    return EB_SUCCESS;
+}
+
+/* File holding a pair and whether its sides are the other way round */
+static eb_status_t find_projection(const char* root, const char* model_a, const char* model_b,
+                                   char* path, size_t size, bool* swapped, struct stat* st) {
+    projection_path(root, model_a, model_b, path, size);
+    *swapped = false;
+    if (stat(path, st) == 0)
+        return EB_SUCCESS;
+    projection_path(root, model_b, model_a, path, size);
+    *swapped = true;
+    if (stat(path, st) == 0)
+        return EB_SUCCESS;
+    return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+}
+
+eb_status_t eb_projection_load(const char* root, const char* model_a, const char* model_b,
+                               eb_projection_t** out) {
+    if (!root || !out || !valid_models(model_a, model_b))
+        return EB_ERROR_INVALID_INPUT;
+    char path[PATH_MAX];
+    bool swapped;
+    struct stat st;
+    eb_status_t status = find_projection(root, model_a, model_b, path, sizeof(path), &swapped, &st);
+    return status == EB_SUCCESS ? read_projection(path, swapped, out) : status;
+}
+
+/* Loaded projections; entries are never freed so returned pointers stay valid */
+typedef struct cache_entry {
+    char path[PATH_MAX];
+    bool swapped;
+    struct timespec mtime;
+    off_t size;
+    eb_projection_t* projection;
+    struct cache_entry* next;
+} cache_entry_t;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static cache_entry_t* cache_head = NULL;
+
+eb_status_t eb_projection_get(const char* root, const char* model_a, const char* model_b,
+                              const eb_projection_t** out) {
+    if (!root || !out || !valid_models(model_a, model_b))
+        return EB_ERROR_INVALID_INPUT;
+    char path[PATH_MAX];
+    bool swapped;
+    struct stat st;
+    eb_status_t status = find_projection(root, model_a, model_b, path, sizeof(path), &swapped, &st);
+    if (status != EB_SUCCESS)
+        return status;
+
+    pthread_mutex_lock(&cache_lock);
+    for (cache_entry_t* e = cache_head; e; e = e->next) {
+        if (e->swapped == swapped && e->size == st.st_size &&
+            e->mtime.tv_sec == st.st_mtim.tv_sec && e->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+            strcmp(e->path, path) == 0) {
+            *out = e->projection;
+            pthread_mutex_unlock(&cache_lock);
+            return EB_SUCCESS;
+        }
+    }
+
+    cache_entry_t* entry = calloc(1, sizeof(*entry));
+    status = entry ? read_projection(path, swapped, &entry->projection) : EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS) {
+        snprintf(entry->path, sizeof(entry->path), "%s", path);
+        entry->swapped = swapped;
+        entry->mtime = st.st_mtim;
+        entry->size = st.st_size;
+        entry->next = cache_head;
+        cache_head = entry;
+        *out = entry->projection;
+    } else {
+        free(entry);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return status;
+}
+
+eb_status_t eb_projection_remove(const char* root, const char* model_a, const char* model_b) {
+    if (!root || !valid_models(model_a, model_b))
+        return EB_ERROR_INVALID_INPUT;
+    char path[PATH_MAX];
+    bool removed = false;
+    for (int order = 0; order < 2; order++) {
+        projection_path(root, order ? model_b : model_a, order ? model_a : model_b, path, sizeof(path));
+        if (unlink(path) == 0)
+            removed = true;
+        else if (errno != ENOENT)
+            return EB_ERROR_FILE_IO;
+    }
+    return removed ? EB_SUCCESS : EB_ERROR_NOT_FOUND;
+}
+
+eb_status_t eb_projection_list(const char* root, eb_projection_visit_fn fn, void* ctx) {
+    if (!root || !fn)
+        return EB_ERROR_INVALID_INPUT;
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s/" EB_PROJECTION_DIR, root);
+    DIR* dir = opendir(dir_path);
+    if (!dir)
+        return errno == ENOENT ? EB_SUCCESS : EB_ERROR_FILE_IO;
+
+    eb_status_t status = EB_SUCCESS;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const char* name = ent->d_name;
+        size_t length = strlen(name);
+        size_t suffix = strlen(PROJECTION_SUFFIX);
+        const char* sep = strchr(name, '~');
+        if (length <= suffix || strcmp(name + length - suffix, PROJECTION_SUFFIX) != 0 || !sep)
+            continue;
+
+        char model_a[256], model_b[256];
+        if (!unescape_model(name, (size_t)(sep - name), model_a, sizeof(model_a)) ||
+            !unescape_model(sep + 1, length - suffix - (size_t)(sep + 1 - name), model_b, sizeof(model_b)))
+            continue;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, name);
+        eb_projection_t* p = NULL;
+        if (read_projection(path, false, &p) != EB_SUCCESS) {
+            DEBUG_WARN("Skipping unreadable projection %s", path);
+            continue;
+        }
+        eb_projection_info_t info;
+        eb_projection_describe(p, &info);
+        eb_projection_free(p);
+        if (fn(model_a, model_b, &info, ctx) != 0)
+            break;
+    }
+    closedir(dir);
+    return status;
+}
+
+/* ---- Fitting over a set ---- */
+
+typedef struct {
+    char (*sources)[PATH_MAX];
+    char (*hashes)[65];
+    size_t count;
+    size_t capacity;
+    const char* model;
+    bool failed;
+} pair_list_t;
+
+static int collect_source(const char* source, const char* model, const char* hash, void* ctx) {
+    pair_list_t* list = ctx;
+    if (strcmp(model, list->model) != 0)
+        return 0;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        void* sources = realloc(list->sources, capacity * sizeof(*list->sources));
+        if (sources)
+            list->sources = sources;
+        void* hashes = sources ? realloc(list->hashes, capacity * sizeof(*list->hashes)) : NULL;
+        if (hashes)
+            list->hashes = hashes;
+        if (!sources || !hashes) {
+            list->failed = true;
+            return 1;
+        }
+        list->capacity = capacity;
+    }
+    snprintf(list->sources[list->count], PATH_MAX, "%s", source);
+    memcpy(list->hashes[list->count], hash, 65);
+    list->count++;
+    return 0;
+}
+
+/* Append the float32 values of a stored vector to rows */
+static eb_status_t read_row(eb_store_t* store, const char* hash, float** rows, size_t index,
+                            size_t* dims) {
+    eb_object_view_t view;
+    eb_status_t status = eb_object_map(store, hash, 0, &view);
+    if (status != EB_SUCCESS)
+        return status;
+    eb_vector_ref_t ref;
+    status = eb_object_vector_ref(&view, &ref);
+    if (status == EB_SUCCESS && (ref.dims == 0 || (*dims && ref.dims != *dims)))
+        status = EB_ERROR_DIMENSION_MISMATCH;
+    if (status == EB_SUCCESS) {
+        *dims = ref.dims;
+        float* grown = realloc(*rows, (index + 1) * ref.dims * sizeof(float));
+        if (grown) {
+            *rows = grown;
+            eb_vector_ref_get(&ref, 0, ref.dims, grown + index * ref.dims);
+        } else {
+            status = EB_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    eb_object_unmap(&view);
+    return status;
+}
+
+eb_status_t eb_projection_fit_set(const char* root, const char* set, const char* model_a,
+                                  const char* model_b, size_t dims, eb_projection_info_t* info) {
+    if (!root || !valid_models(model_a, model_b) || (set && (!*set || strchr(set, '/'))))
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_set_index_t* index = NULL;
+    eb_status_t status;
+    if (set) {
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/.embr/sets/%s", root, set);
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+            return EB_ERROR_NOT_FOUND;
+        snprintf(path, sizeof(path), "%s/.embr/sets/%s/index", root, set);
+        status = eb_set_index_open(root, path, &index);
+    } else {
+        status = eb_set_index_open_current(root, &index);
+    }
+    if (status != EB_SUCCESS)
+        return status;
+
+    // Documents the set holds for the first model, then their second-model vectors
+    pair_list_t list = { .model = model_a };
+    status = eb_set_index_foreach(index, NULL, collect_source, &list);
+    if (status == EB_SUCCESS && list.failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = (char*)root };
+    if (status == EB_SUCCESS)
+        status = eb_store_init(&config, &store);
+
+    float *rows_a = NULL, *rows_b = NULL;
+    size_t dims_a = 0, dims_b = 0, pairs = 0;
+    for (size_t i = 0; i < list.count && status == EB_SUCCESS; i++) {
+        char hash_b[65];
+        if (eb_set_index_lookup(index, list.sources[i], model_b, hash_b) != EB_SUCCESS)
+            continue;
+        status = read_row(store, list.hashes[i], &rows_a, pairs, &dims_a);
+        if (status == EB_SUCCESS)
+            status = read_row(store, hash_b, &rows_b, pairs, &dims_b);
+        if (status == EB_SUCCESS) {
+            pairs++;
+        } else if (status != EB_ERROR_DIMENSION_MISMATCH && status != EB_ERROR_MEMORY_ALLOCATION) {
+            // An unreadable object only loses its pair
+            DEBUG_WARN("Skipping %s: objects unreadable (%d)", list.sources[i], status);
+            status = EB_SUCCESS;
+        }
+    }
+    if (status == EB_SUCCESS && pairs < 2)
+        status = EB_ERROR_NOT_FOUND;
+
+    eb_projection_t* projection = NULL;
+    if (status == EB_SUCCESS)
+        status = eb_projection_fit(rows_a, dims_a, rows_b, dims_b, pairs, dims, &projection);
+    if (status == EB_SUCCESS)
+        status = eb_projection_save(root, model_a, model_b, projection);
+    if (status == EB_SUCCESS && info)
+        eb_projection_describe(projection, info);
+
+    eb_projection_free(projection);
+    free(rows_a);
+    free(rows_b);
+    free(list.sources);
+    free(list.hashes);
+    if (store)
+        eb_store_destroy(store);
+    eb_set_index_close(index);
+    return status;
+}
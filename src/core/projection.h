@@ -0,0 +1,163 @@
+/*
+ * EmbeddingBridge - Learned Cross-Model Projections
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_PROJECTION_H
+#define EB_PROJECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * Maps the vectors of two models into a shared space so that documents
+ * embedded by both can be compared across a model migration.
+ *
+ * A projection is fitted once over paired documents. Each side is
+ * centered and reduced to its top principal directions, and an orthogonal
+ * Procrustes rotation aligns the reduced first model with the reduced
+ * second one. What is kept per side is a dims x model_dims matrix with an
+ * offset, so projecting a vector is one matrix-vector product:
+ *
+ *   p(x) = W x - W mean
+ *
+ * Projections live next to the model registry, one per model pair:
+ *
+ *   .embr/metadata/models/projections/<model_a>~<model_b>.proj
+ *
+ * Model names are %XX-escaped in file names. A projection fitted for
+ * (a, b) also serves (b, a) with its sides swapped.
+ */
+
+#define EB_PROJECTION_MAGIC   0x4542504A  /* "EBPJ" */
+#define EB_PROJECTION_VERSION 1
+#define EB_PROJECTION_DIR     ".embr/metadata/models/projections"
+
+typedef struct {
+    uint32_t magic;             /* EB_PROJECTION_MAGIC */
+    uint32_t version;           /* EB_PROJECTION_VERSION */
+    uint32_t dims_a;            /* Dimensions of the first model */
+    uint32_t dims_b;            /* Dimensions of the second model */
+    uint32_t dims;              /* Dimensions of the shared space */
+    uint32_t pairs;             /* Paired documents it was fitted on */
+    float fit_cosine;           /* Mean cosine of the projected training pairs */
+    uint32_t reserved;
+    /* Followed by, for each side: dims offsets, then dims x model_dims weights */
+} eb_projection_header_t;
+
+/* Side of a projection */
+typedef enum {
+    EB_PROJECT_A = 0,
+    EB_PROJECT_B
+} eb_projection_side_t;
+
+typedef struct eb_projection eb_projection_t;
+
+typedef struct {
+    size_t dims_a;
+    size_t dims_b;
+    size_t dims;
+    size_t pairs;
+    float fit_cosine;
+} eb_projection_info_t;
+
+/**
+ * Fit a projection over paired rows
+ *
+ * Row i of a and row i of b embed the same document.
+ *
+ * @param a count x dims_a row-major values of the first model
+ * @param dims_a Dimensions of the first model
+ * @param b count x dims_b row-major values of the second model
+ * @param dims_b Dimensions of the second model
+ * @param count Number of pairs, at least 2
+ * @param dims Shared dimensions, 0 for min(dims_a, dims_b, count - 1)
+ * @param out Receives the projection, free with eb_projection_free()
+ * @return Status code (0 = success, EB_ERROR_INVALID_INPUT if dims exceeds that bound)
+ */
+eb_status_t eb_projection_fit(const float* a, size_t dims_a, const float* b, size_t dims_b,
+                              size_t count, size_t dims, eb_projection_t** out);
+
+/**
+ * Fit a projection over the documents a set holds for both models and save it
+ *
+ * @param root Repository root
+ * @param set Set to take the pairs from, NULL for the current set
+ * @param model_a First model
+ * @param model_b Second model
+ * @param dims Shared dimensions, 0 for the default
+ * @param info Optional summary of the saved projection
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if fewer than 2 documents are paired)
+ */
+eb_status_t eb_projection_fit_set(const char* root, const char* set, const char* model_a,
+                                  const char* model_b, size_t dims, eb_projection_info_t* info);
+
+/**
+ * Save a projection for a model pair, replacing any earlier one
+ */
+eb_status_t eb_projection_save(const char* root, const char* model_a, const char* model_b,
+                               const eb_projection_t* projection);
+
+/**
+ * Load the projection of a model pair, fitted in either order
+ *
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if none was fitted)
+ */
+eb_status_t eb_projection_load(const char* root, const char* model_a, const char* model_b,
+                               eb_projection_t** out);
+
+/**
+ * Projection of a model pair from a process-wide cache
+ *
+ * Files are read once and read again only when they change. Returned
+ * projections stay valid until the process exits and may be shared by
+ * several threads.
+ */
+eb_status_t eb_projection_get(const char* root, const char* model_a, const char* model_b,
+                              const eb_projection_t** out);
+
+/**
+ * Remove the projection of a model pair, fitted in either order
+ */
+eb_status_t eb_projection_remove(const char* root, const char* model_a, const char* model_b);
+
+/**
+ * Callback for eb_projection_list()
+ *
+ * @return 0 to continue, non-zero to stop
+ */
+typedef int (*eb_projection_visit_fn)(const char* model_a, const char* model_b,
+                                      const eb_projection_info_t* info, void* ctx);
+
+/**
+ * Visit the saved projections of a repository
+ */
+eb_status_t eb_projection_list(const char* root, eb_projection_visit_fn fn, void* ctx);
+
+void eb_projection_describe(const eb_projection_t* projection, eb_projection_info_t* info);
+
+/**
+ * Dimensions a side of a projection takes
+ */
+size_t eb_projection_input_dims(const eb_projection_t* projection, eb_projection_side_t side);
+
+/**
+ * Project a vector of one side into the shared space
+ *
+ * @param projection Projection
+ * @param side Model the vector comes from
+ * @param values eb_projection_input_dims() values
+ * @param out Receives info.dims values
+ */
+void eb_projection_apply(const eb_projection_t* projection, eb_projection_side_t side,
+                         const float* values, float* out);
+
+void eb_projection_free(eb_projection_t* projection);
+
+#endif /* EB_PROJECTION_H */
@@ -0,0 +1,309 @@
+/*
+ * EmbeddingBridge - Reduced-Precision Vector Encodings Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "quantize.h"
+#include "embedding_file.h"
+#include "debug.h"
+
+#define INT8_MAX_LEVEL 127
+
+static uint32_t float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint16_t eb_float_to_fp16(float value) {
+    uint32_t x = float_bits(value);
+    uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+    uint32_t exponent = (x >> 23) & 0xFF;
+    uint32_t mantissa = x & 0x7FFFFF;
+
+    if (exponent == 0xFF)  // Inf stays Inf, NaN stays a quiet NaN
+        return sign | 0x7C00 | (mantissa ? 0x200 | (mantissa >> 13) : 0);
+
+    int e = (int)exponent - 127 + 15;
+    if (e >= 31)
+        return sign | 0x7C00;  // Too large, becomes Inf
+    if (e <= 0) {
+        if (e < -10)
+            return sign;  // Too small even for a subnormal
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - e);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | (uint16_t)half;
+    }
+
+    uint32_t half = ((uint32_t)e << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;  // A carry into the exponent rounds up correctly, up to Inf
+    return sign | (uint16_t)half;
+}
+
+float eb_fp16_to_float(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+
+    if (exponent == 0) {
+        float magnitude = ldexpf((float)mantissa, -24);
+        return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 31)
+        return bits_float(sign | 0x7F800000 | (mantissa << 13));
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+uint16_t eb_float_to_bf16(float value) {
+    uint32_t x = float_bits(value);
+    if ((x & 0x7FFFFFFF) > 0x7F800000)
+        return (uint16_t)((x >> 16) | 0x40);  // Keep NaNs NaN
+    x += 0x7FFF + ((x >> 16) & 1);
+    return (uint16_t)(x >> 16);
+}
+
+float eb_bf16_to_float(uint16_t value) {
+    return bits_float((uint32_t)value << 16);
+}
+
+static const struct {
+    const char* name;
+    eb_dtype_t dtype;
+} dtype_names[] = {
+    { "float32", EB_FLOAT32 },
+    { "fp32", EB_FLOAT32 },
+    { "float16", EB_FLOAT16 },
+    { "fp16", EB_FLOAT16 },
+    { "bfloat16", EB_BFLOAT16 },
+    { "bf16", EB_BFLOAT16 },
+    { "int8", EB_INT8 },
+};
+
+eb_status_t eb_dtype_from_name(const char* name, eb_dtype_t* out) {
+    if (!name || !out)
+        return EB_ERROR_INVALID_INPUT;
+    for (size_t i = 0; i < sizeof(dtype_names) / sizeof(dtype_names[0]); i++) {
+        if (strcmp(name, dtype_names[i].name) == 0) {
+            *out = dtype_names[i].dtype;
+            return EB_SUCCESS;
+        }
+    }
+    return EB_ERROR_INVALID_INPUT;
+}
+
+const char* eb_dtype_name(eb_dtype_t dtype) {
+    switch (dtype) {
+    case EB_FLOAT32: return "float32";
+    case EB_FLOAT64: return "float64";
+    case EB_INT32: return "int32";
+    case EB_INT64: return "int64";
+    case EB_FLOAT16: return "fp16";
+    case EB_BFLOAT16: return "bf16";
+    case EB_INT8: return "int8";
+    default: return "unknown";
+    }
+}
+
+size_t eb_quantized_size(eb_dtype_t dtype, size_t dims) {
+    switch (dtype) {
+    case EB_FLOAT32: return dims * sizeof(float);
+    case EB_FLOAT16:
+    case EB_BFLOAT16: return dims * sizeof(uint16_t);
+    case EB_INT8: return sizeof(float) + dims;
+    default: return 0;
+    }
+}
+
+static eb_status_t quantize_int8(const float* values, size_t dims, uint8_t* out) {
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < dims; i++) {
+        if (!isfinite(values[i]))
+            return EB_ERROR_INVALID_INPUT;
+        float magnitude = fabsf(values[i]);
+        if (magnitude > max_abs)
+            max_abs = magnitude;
+    }
+
+    float scale = max_abs / INT8_MAX_LEVEL;
+    memcpy(out, &scale, sizeof(scale));
+    int8_t* q = (int8_t*)(out + sizeof(scale));
+    for (size_t i = 0; i < dims; i++) {
+        long level = scale > 0.0f ? lrintf(values[i] / scale) : 0;
+        if (level > INT8_MAX_LEVEL) level = INT8_MAX_LEVEL;
+        if (level < -INT8_MAX_LEVEL) level = -INT8_MAX_LEVEL;
+        q[i] = (int8_t)level;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_quantize(const float* values, size_t dims, eb_dtype_t dtype,
+                        void** out, size_t* out_size) {
+    if ((!values && dims) || !out || !out_size)
+        return EB_ERROR_INVALID_INPUT;
+
+    size_t size = eb_quantized_size(dtype, dims);
+    if (size == 0 && dims > 0)
+        return EB_ERROR_INVALID_INPUT;
+    uint8_t* payload = malloc(size ? size : 1);
+    if (!payload)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    eb_status_t status = EB_SUCCESS;
+    uint16_t* halves = (uint16_t*)payload;
+    switch (dtype) {
+    case EB_FLOAT32:
+        memcpy(payload, values, size);
+        break;
+    case EB_FLOAT16:
+        for (size_t i = 0; i < dims; i++)
+            halves[i] = eb_float_to_fp16(values[i]);
+        break;
+    case EB_BFLOAT16:
+        for (size_t i = 0; i < dims; i++)
+            halves[i] = eb_float_to_bf16(values[i]);
+        break;
+    case EB_INT8:
+        status = quantize_int8(values, dims, payload);
+        break;
+    default:
+        status = EB_ERROR_INVALID_INPUT;
+        break;
+    }
+
+    if (status != EB_SUCCESS) {
+        free(payload);
+        return status;
+    }
+    *out = payload;
+    *out_size = size;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_float_payload(const void* payload, size_t size,
+                             const float** values, size_t* dims) {
+    if ((!payload && size) || !values || !dims)
+        return EB_ERROR_INVALID_INPUT;
+    const uint8_t* bytes = payload;
+
+    // NumPy file holding one float32 vector
+    if (size >= 6 && memcmp(bytes, "\x93NUMPY", 6) == 0) {
+        eb_array_t array;
+        size_t rows;
+        if (eb_npy_parse(bytes, size, &array) != EB_SUCCESS || array.dtype != EB_FLOAT32 ||
+            eb_array_rows(&array, &rows, dims) != EB_SUCCESS || rows != 1) {
+            DEBUG_WARN("Embedding file is not a float32 .npy vector");
+            return EB_ERROR_INVALID_FORMAT;
+        }
+        *values = array.data;
+        return EB_SUCCESS;
+    }
+
+    // Floats behind a 4-byte dimension count
+    if (size >= sizeof(uint32_t)) {
+        uint32_t dim_header;
+        memcpy(&dim_header, bytes, sizeof(dim_header));
+        if (dim_header > 100 && dim_header < 10000 &&
+            size >= sizeof(uint32_t) + (size_t)dim_header * sizeof(float)) {
+            *values = (const float*)(bytes + sizeof(uint32_t));
+            *dims = dim_header;
+            return EB_SUCCESS;
+        }
+    }
+
+    *values = (const float*)bytes;
+    *dims = size / sizeof(float);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_vector_ref_init(eb_vector_ref_t* ref, eb_dtype_t dtype,
+                               const void* payload, size_t size) {
+    if (!ref || (!payload && size))
+        return EB_ERROR_INVALID_INPUT;
+    ref->dtype = dtype;
+    ref->scale = 1.0f;
+    ref->norm = -1.0f;
+
+    switch (dtype) {
+    case EB_FLOAT32: {
+        const float* values;
+        eb_status_t status = eb_float_payload(payload, size, &values, &ref->dims);
+        ref->values = values;
+        return status;
+    }
+    case EB_FLOAT16:
+    case EB_BFLOAT16:
+        if (size % sizeof(uint16_t) != 0)
+            return EB_ERROR_INVALID_FORMAT;
+        ref->values = payload;
+        ref->dims = size / sizeof(uint16_t);
+        return EB_SUCCESS;
+    case EB_INT8:
+        if (size < sizeof(float))
+            return EB_ERROR_INVALID_FORMAT;
+        memcpy(&ref->scale, payload, sizeof(float));
+        ref->values = (const uint8_t*)payload + sizeof(float);
+        ref->dims = size - sizeof(float);
+        return EB_SUCCESS;
+    default:
+        return EB_ERROR_INVALID_FORMAT;
+    }
+}
+
+void eb_vector_ref_get(const eb_vector_ref_t* ref, size_t start, size_t count, float* out) {
+    switch (ref->dtype) {
+    case EB_FLOAT32:
+        memcpy(out, (const float*)ref->values + start, count * sizeof(float));
+        break;
+    case EB_FLOAT16: {
+        const uint16_t* halves = (const uint16_t*)ref->values + start;
+        for (size_t i = 0; i < count; i++)
+            out[i] = eb_fp16_to_float(halves[i]);
+        break;
+    }
+    case EB_BFLOAT16: {
+        const uint16_t* halves = (const uint16_t*)ref->values + start;
+        for (size_t i = 0; i < count; i++)
+            out[i] = eb_bf16_to_float(halves[i]);
+        break;
+    }
+    case EB_INT8: {
+        const int8_t* q = (const int8_t*)ref->values + start;
+        for (size_t i = 0; i < count; i++)
+            out[i] = ref->scale * (float)q[i];
+        break;
+    }
+    default:
+        memset(out, 0, count * sizeof(float));
+        break;
+    }
+}
+
+void eb_vector_ref_prefix(const eb_vector_ref_t* ref, size_t dims, eb_vector_ref_t* out) {
+    *out = *ref;
+    if (dims < ref->dims) {
+        out->dims = dims;
+        out->norm = -1.0f;
+    }
+}
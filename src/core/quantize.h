@@ -0,0 +1,127 @@
+/*
+ * EmbeddingBridge - Reduced-Precision Vector Encodings
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_QUANTIZE_H
+#define EB_QUANTIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+#include "types.h"
+
+/*
+ * Vector objects stored with a reduced dtype record it in their header
+ * flags (EB_FLAG_DTYPE) and hold bare values instead of the original
+ * embedding file:
+ *
+ *   EB_FLOAT16   IEEE 754 binary16 values
+ *   EB_BFLOAT16  upper halves of the float32 values
+ *   EB_INT8      a float32 scale followed by one signed byte per value;
+ *                value[i] = scale * q[i], with |q[i]| <= 127
+ *
+ * Objects without a dtype (EB_FLOAT32) keep the embedding file as it was
+ * given: a .npy file, floats behind a 4-byte dimension header, or bare
+ * floats.
+ */
+
+/* Read-only view of the values of one vector in any storage dtype */
+typedef struct {
+    eb_dtype_t dtype;       /* EB_FLOAT32, EB_FLOAT16, EB_BFLOAT16 or EB_INT8 */
+    size_t dims;            /* Number of values */
+    float scale;            /* EB_INT8 scale, 1.0 for the other types */
+    const void* values;     /* dims values of dtype */
+    float norm;             /* L2 norm if known (EB_FLAG_NORM), negative otherwise */
+} eb_vector_ref_t;
+
+/**
+ * Parse a dtype name: float32/fp32, float16/fp16, bfloat16/bf16 or int8
+ *
+ * @param name Name to parse
+ * @param out Receives the dtype
+ * @return Status code (0 = success, EB_ERROR_INVALID_INPUT for other names)
+ */
+eb_status_t eb_dtype_from_name(const char* name, eb_dtype_t* out);
+
+/**
+ * Short name of a dtype ("float32", "fp16", "bf16", "int8", ...)
+ */
+const char* eb_dtype_name(eb_dtype_t dtype);
+
+/**
+ * Size of an encoded vector payload
+ *
+ * @param dtype Storage dtype
+ * @param dims Number of values
+ * @return Payload size in bytes, 0 if dtype is not a storage dtype
+ */
+size_t eb_quantized_size(eb_dtype_t dtype, size_t dims);
+
+/**
+ * Encode float32 values in a storage dtype
+ *
+ * Float16 and bfloat16 round to nearest even. Int8 uses a symmetric scale
+ * of max|value| / 127 and rejects non-finite values.
+ *
+ * @param values Values to encode
+ * @param dims Number of values
+ * @param dtype Target dtype
+ * @param out Receives the payload, to be freed by the caller
+ * @param out_size Receives the payload size (eb_quantized_size())
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_quantize(const float* values, size_t dims, eb_dtype_t dtype,
+                        void** out, size_t* out_size);
+
+/**
+ * Locate the float32 values of an embedding file or EB_FLOAT32 payload
+ *
+ * @param payload .npy file, floats behind a 4-byte dimension header, or bare floats
+ * @param size Payload size
+ * @param values Receives a pointer into payload
+ * @param dims Receives the number of values
+ * @return Status code (0 = success, EB_ERROR_INVALID_FORMAT for non-float32 .npy files)
+ */
+eb_status_t eb_float_payload(const void* payload, size_t size,
+                             const float** values, size_t* dims);
+
+/**
+ * View a stored vector payload
+ *
+ * The norm is left unknown; eb_object_vector_ref() takes it from the
+ * object header.
+ *
+ * @param ref Receives the view; it points into payload
+ * @param dtype Dtype from the object header (EB_FLAG_DTYPE)
+ * @param payload Decoded object payload
+ * @param size Payload size
+ * @return Status code (0 = success, EB_ERROR_INVALID_FORMAT if the payload does not fit dtype)
+ */
+eb_status_t eb_vector_ref_init(eb_vector_ref_t* ref, eb_dtype_t dtype,
+                               const void* payload, size_t size);
+
+/**
+ * Convert values [start, start + count) of a vector to float32
+ */
+void eb_vector_ref_get(const eb_vector_ref_t* ref, size_t start, size_t count, float* out);
+
+/**
+ * View the first dims values of a vector, or all of them if it has fewer
+ *
+ * The norm of a prefix is unknown, as only the whole vector's is stored.
+ */
+void eb_vector_ref_prefix(const eb_vector_ref_t* ref, size_t dims, eb_vector_ref_t* out);
+
+/* Scalar conversions */
+uint16_t eb_float_to_fp16(float value);
+float eb_fp16_to_float(uint16_t value);
+uint16_t eb_float_to_bf16(float value);
+float eb_bf16_to_float(uint16_t value);
+
+#endif /* EB_QUANTIZE_H */
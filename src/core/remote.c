@@ -18,6 +18,7 @@
 #include <signal.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <dirent.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -28,11 +29,23 @@
 #include "remote.h"
 #include "transport.h"
 #include "transformer.h"
+#include "parquet_transformer.h"
+#include "pack.h"
+#include "chunk.h"
+#include "object_path.h"
+#include "remote_metadata.h"
+#include "hash_utils.h"
+#include "hash_set.h"
+#include "fs.h"
 #include "compress.h"
+#include "timing.h"
+#include "counters.h"
 #include "debug.h"
 
 /* Maximum number of remotes we can track */
 #define MAX_REMOTES 32
+#define REMOTE_MAX_CLIENT_THREADS 256      /* Bound for s3.threads */
+#define REMOTE_MAX_CLIENT_CONNECTIONS 256  /* Bound for s3.max_connections */
 
 /* Error codes not defined in status.h */
 #define EB_ERROR_TRANSPORT EB_ERROR_CONNECTION_FAILED
@@ -42,9 +55,12 @@
 /* Forward declarations of static functions */
 static void recover_transactions(void);
 static void calculate_checksum(const void *data, size_t size, char *checksum_out, size_t checksum_size);
-static int start_operation(const char *remote_name, const char *path, size_t size, const void *data, int operation_type);
+static int start_operation(const char *remote_name, const char *path, size_t size, const char *checksum, int operation_type);
 static void update_operation(int op_idx, size_t transferred);
 static void complete_operation(int op_idx);
+static int find_operation(const char *remote_name, const char *path, int operation_type);
+static size_t get_resume_position(const char *remote_name, const char *path,
+                                  int operation_type, const char *checksum, size_t size);
 static bool verify_data_integrity(const void *data, size_t size, const char *expected_checksum);
 static const char* get_remote_target_format(const char* remote_name);
 
@@ -57,6 +73,9 @@ typedef struct {
     bool verify_ssl;              /* Whether to verify SSL certificates */
     char transformer_name[32];    /* Name of transformer to use */
     char target_format[32];       /* Target format for transformation (e.g., "parquet") */
+    eb_transport_options_t transport_options; /* s3.* client tuning, 0 for the defaults */
+    char format_options[256];     /* Parquet writer tuning as configured, see format.h */
+    eb_parquet_writer_options_t parquet_options; /* format_options, parsed */
 } remote_config_t;
 
 /* Dataset structure */
@@ -76,7 +95,8 @@ typedef struct {
 /* Global registry of remotes */
 static remote_config_t remotes[MAX_REMOTES];
 static int remote_count = 0;
-static pthread_mutex_t remote_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Lookups copy an entry out under the read lock, so parallel jobs never wait on each other */
+static pthread_rwlock_t remote_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 /* Maximum number of datasets we can track */
 #define MAX_DATASETS 128
@@ -86,6 +106,7 @@ static pthread_mutex_t dataset_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* Flag to indicate if the remote subsystem is initialized */
 static bool initialized = false;
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Constants for batched operations */
 #define BATCH_SIZE (8 * 1024 * 1024)  /* 8MB batches */
@@ -103,7 +124,7 @@ typedef struct {
     size_t transferred;       /* Amount transferred so far */
     time_t start_time;        /* When the operation started */
     time_t last_update;       /* Last progress update */
-    char checksum[128];       /* MD5 checksum of the data */
+    char checksum[128];       /* Checksum of the data, chunk digest if chunked */
     int operation_type;       /* 0 = push, 1 = pull */
     bool completed;           /* Whether operation completed */
 } operation_state_t;
@@ -114,17 +135,17 @@ static operation_state_t operations[MAX_OPERATIONS];
 static int operation_count = 0;
 static pthread_mutex_t operation_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* Temporary reference file path */
-#define TEMP_REF_FILE ".embr/REMOTE_TEMP"
-/* Lock file to prevent concurrent operations */
-#define LOCK_FILE ".embr/REMOTE_LOCK"
-/* Commit log for durability */
-#define COMMIT_LOG ".embr/REMOTE_JOURNAL"
-/* Completed reference path */
-#define REF_FILE ".embr/REMOTE_HEAD"
+/* Operation states kept across runs */
+#define OPERATION_STATE_FILE ".embr/operations.state"
+/* Transactions of every (remote, path) pair, see "Transactions" below */
+#define TRANSACTION_ROOT ".embr/remote"
+#define TRANSACTION_PATH_MAX 600
 
-/* Lock state for atomic operations */
-static bool atomic_lock_held = false;
+/* A transaction on one (remote, path) pair */
+typedef struct {
+    char dir[512];                /* Directory holding its lock, journal and refs */
+    bool held;                    /* Whether we hold its lock */
+} remote_transaction_t;
 
 /* Sleep for milliseconds */
 static void sleep_ms(int milliseconds) {
@@ -135,49 +156,72 @@ static void sleep_ms(int milliseconds) {
 #endif
 }
 
-/* Initialize the remote subsystem */
-eb_status_t eb_remote_init(void) {
-    if (initialized) {
-        return EB_SUCCESS;
-    }
+/* The body of eb_remote_init(), with init_lock held */
+static eb_status_t remote_init_locked(void) {
+    int timing = eb_timing_begin("remote init");
     
     /* Initialize the transformer registry */
+    int phase = eb_timing_begin("transformers");
     eb_status_t status = eb_transformer_registry_init();
     if (status != EB_SUCCESS) {
         DEBUG_ERROR("Failed to initialize transformer registry");
+        eb_timing_end(phase);
+        eb_timing_end(timing);
         return status;
     }
     
     /* Register built-in transformers */
     status = eb_register_builtin_transformers();
+    eb_timing_end(phase);
     if (status != EB_SUCCESS) {
         DEBUG_ERROR("Failed to register built-in transformers");
+        eb_timing_end(timing);
         return status;
     }
     
     /* Perform crash recovery if needed */
+    phase = eb_timing_begin("transaction recovery");
     recover_transactions();
     
     /* Load saved operation states */
-    status = load_operation_states(".embr/operations.state");
+    status = load_operation_states(OPERATION_STATE_FILE);
+    eb_timing_end(phase);
     if (status != EB_SUCCESS) {
         DEBUG_WARN("Failed to load operation states: %d", status);
         /* Non-fatal error, continue */
     }
     
     /* Load remote configuration */
+    phase = eb_timing_begin("remote config");
     status = eb_remote_load_config(".embr");
+    eb_timing_end(phase);
     if (status != EB_SUCCESS) {
         DEBUG_WARN("Failed to load remote configuration: %d", status);
         /* Non-fatal error, continue */
     }
     
     initialized = true;
+    eb_timing_end(timing);
     DEBUG_INFO("Remote subsystem initialized");
     
     return EB_SUCCESS;
 }
 
+/*
+ * Initialize the remote subsystem
+ *
+ * Commands that talk to remotes call this first; everything else never
+ * pays for the transformer registry or the remote configuration. Safe
+ * to call from several threads: the first caller initializes, the rest
+ * wait for it.
+ */
+eb_status_t eb_remote_init(void) {
+    pthread_mutex_lock(&init_lock);
+    eb_status_t status = initialized ? EB_SUCCESS : remote_init_locked();
+    pthread_mutex_unlock(&init_lock);
+    return status;
+}
+
 /* Add a new remote */
 eb_status_t eb_remote_add(const char *name, const char *url, const char *token,
                         int timeout, bool verify_ssl, const char *transformer) {
@@ -185,19 +229,19 @@ eb_status_t eb_remote_add(const char *name, const char *url, const char *token,
         return EB_ERROR_INVALID_PARAMETER;
     }
     
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_wrlock(&remote_lock);
     
     /* Check if we already have a remote with this name */
     for (int i = 0; i < remote_count; i++) {
         if (strcmp(remotes[i].name, name) == 0) {
-            pthread_mutex_unlock(&remote_mutex);
+            pthread_rwlock_unlock(&remote_lock);
         return EB_ERROR_ALREADY_EXISTS;
         }
     }
     
     /* Check if we have room for another remote */
     if (remote_count >= MAX_REMOTES) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         return EB_ERROR_RESOURCE_EXHAUSTED;
     }
     
@@ -214,6 +258,9 @@ eb_status_t eb_remote_add(const char *name, const char *url, const char *token,
     
     remote->timeout = (timeout > 0) ? timeout : 30;  /* Default: 30 seconds */
     remote->verify_ssl = verify_ssl;
+    memset(&remote->transport_options, 0, sizeof(remote->transport_options));
+    remote->format_options[0] = '\0';
+    memset(&remote->parquet_options, 0, sizeof(remote->parquet_options));
     
     if (transformer) {
         strncpy(remote->transformer_name, transformer, sizeof(remote->transformer_name) - 1);
@@ -222,7 +269,7 @@ eb_status_t eb_remote_add(const char *name, const char *url, const char *token,
         strncpy(remote->transformer_name, "json", sizeof(remote->transformer_name) - 1);
     }
     
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     /* Save the updated configuration */
     eb_status_t status = eb_remote_save_config(".embr");
@@ -241,7 +288,7 @@ eb_status_t eb_remote_remove(const char *name) {
         return EB_ERROR_INVALID_PARAMETER;
     }
     
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_wrlock(&remote_lock);
     
     /* Find the remote */
     int index = -1;
@@ -253,7 +300,7 @@ eb_status_t eb_remote_remove(const char *name) {
     }
     
     if (index == -1) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         return EB_ERROR_NOT_FOUND;
     }
     
@@ -264,7 +311,7 @@ eb_status_t eb_remote_remove(const char *name) {
     }
     remote_count--;
     
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     /* Save the updated configuration */
     eb_status_t status = eb_remote_save_config(".embr");
@@ -284,7 +331,7 @@ eb_status_t eb_remote_info(const char *name, char *url, size_t url_size,
         return EB_ERROR_INVALID_PARAMETER;
     }
     
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     
     /* Find the remote */
     int index = -1;
@@ -296,7 +343,7 @@ eb_status_t eb_remote_info(const char *name, char *url, size_t url_size,
     }
     
     if (index == -1) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
     return EB_ERROR_NOT_FOUND;
 }
 
@@ -319,7 +366,7 @@ eb_status_t eb_remote_info(const char *name, char *url, size_t url_size,
         transformer[transformer_size - 1] = '\0';
     }
     
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     return EB_SUCCESS;
 }
 
@@ -329,19 +376,19 @@ eb_status_t eb_remote_list(char ***names, int *count) {
         return EB_ERROR_INVALID_PARAMETER;
     }
     
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     
     if (remote_count == 0) {
         *names = NULL;
         *count = 0;
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         return EB_SUCCESS;
     }
     
     /* Allocate array of string pointers */
     char **name_list = (char **)malloc(remote_count * sizeof(char *));
     if (!name_list) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         return EB_ERROR_OUT_OF_MEMORY;
     }
     
@@ -354,7 +401,7 @@ eb_status_t eb_remote_list(char ***names, int *count) {
                 free(name_list[j]);
             }
             free(name_list);
-            pthread_mutex_unlock(&remote_mutex);
+            pthread_rwlock_unlock(&remote_lock);
             return EB_ERROR_OUT_OF_MEMORY;
         }
     }
@@ -362,7 +409,7 @@ eb_status_t eb_remote_list(char ***names, int *count) {
     *names = name_list;
     *count = remote_count;
     
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     return EB_SUCCESS;
 }
 
@@ -620,14 +667,16 @@ eb_status_t eb_dataset_set_availability(const char *name, bool has_documents, bo
 
 /* Shutdown the remote subsystem */
 void eb_remote_shutdown(void) {
+    pthread_mutex_lock(&init_lock);
     if (!initialized) {
+        pthread_mutex_unlock(&init_lock);
         return;
     }
     
     initialized = false;
     
     /* Save operation states */
-    eb_status_t status = save_operation_states(".embr/operations.state");
+    eb_status_t status = save_operation_states(OPERATION_STATE_FILE);
     if (status != EB_SUCCESS) {
         DEBUG_WARN("Failed to save operation states: %d", status);
         /* Non-fatal error, continue */
@@ -636,30 +685,109 @@ void eb_remote_shutdown(void) {
     /* Cleanup transformer registry */
     eb_transformer_registry_cleanup();
     
+    /* Close the connections kept for reuse */
+    transport_pool_drain();
+    
     /* Reset counts */
+    pthread_rwlock_wrlock(&remote_lock);
     remote_count = 0;
+    pthread_rwlock_unlock(&remote_lock);
+    pthread_mutex_lock(&dataset_mutex);
     dataset_count = 0;
+    pthread_mutex_unlock(&dataset_mutex);
+    pthread_mutex_unlock(&init_lock);
     
     DEBUG_INFO("Remote subsystem shutdown");
 }
 
 /* Check if remote operations are available */
 bool eb_remote_available(void) {
-    return initialized;
+    pthread_mutex_lock(&init_lock);
+    bool available = initialized;
+    pthread_mutex_unlock(&init_lock);
+    return available;
+}
+
+/*
+ * Transactions
+ *
+ * A push runs in a transaction on its (remote, path) pair, kept in
+ * .embr/remote/<remote>/<path>/ with the names escaped to a single
+ * directory level each:
+ *
+ *   LOCK     pid of the holder, created exclusively
+ *   JOURNAL  BEGIN/COMMIT/ABORT/RECOVER records
+ *   TEMP     ref being written, renamed to HEAD on commit
+ *   HEAD     ref of the last committed push
+ *
+ * Pushes to other remotes or other paths never touch the same files and
+ * run in parallel; a second push to the same pair fails to get the lock.
+ */
+
+/* Append name to out with everything outside [A-Za-z0-9_-] (and a leading '.') as %XX */
+static bool transaction_escape(const char *name, char *out, size_t out_size) {
+    size_t len = 0;
+    for (const char *p = name; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                     c == '-' || c == '_' || (c == '.' && p != name);
+        if (len + (plain ? 1 : 3) >= out_size) {
+            return false;
+        }
+        if (plain) {
+            out[len++] = (char)c;
+        } else {
+            len += (size_t)snprintf(out + len, out_size - len, "%%%02X", c);
+        }
+    }
+    out[len] = '\0';
+    return len > 0;
+}
+
+static eb_status_t transaction_init(remote_transaction_t *txn, const char *remote_name, const char *path) {
+    char remote_part[192];
+    char path_part[256];
+    memset(txn, 0, sizeof(*txn));
+    if (!transaction_escape(remote_name, remote_part, sizeof(remote_part)) ||
+        !transaction_escape(path, path_part, sizeof(path_part)) ||
+        (size_t)snprintf(txn->dir, sizeof(txn->dir), "%s/%s/%s", TRANSACTION_ROOT,
+                         remote_part, path_part) >= sizeof(txn->dir)) {
+        DEBUG_ERROR("No transaction directory for %s/%s", remote_name, path);
+        return EB_ERROR_PATH_TOO_LONG;
+    }
+    return EB_SUCCESS;
+}
+
+/* Path of one of the files of a transaction */
+static void transaction_file(const remote_transaction_t *txn, const char *name, char *out, size_t out_size) {
+    snprintf(out, out_size, "%s/%s", txn->dir, name);
+}
+
+/* Append a record to the journal of a transaction */
+static void transaction_journal(const remote_transaction_t *txn, const char *record) {
+    char journal_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "JOURNAL", journal_path, sizeof(journal_path));
+    FILE *journal = fopen(journal_path, "a");
+    if (journal) {
+        fprintf(journal, "%s %ld\n", record, (long)time(NULL));
+        fflush(journal);
+        fclose(journal);
+    }
 }
 
 /* 
- * Acquire an atomic operation lock
+ * Acquire the lock of a transaction
  * Returns EB_SUCCESS if the lock was acquired, or error code if not
  */
-static eb_status_t acquire_atomic_lock(void) {
-    /* Fail if we already hold the lock */
-    if (atomic_lock_held) {
+static eb_status_t acquire_transaction_lock(remote_transaction_t *txn) {
+    if (txn->held) {
         return EB_SUCCESS;  /* Already have it */
     }
     
     /* Try to create the lock file */
-    FILE *lock_file = fopen(LOCK_FILE, "wx");  /* x = fail if exists */
+    char lock_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "LOCK", lock_path, sizeof(lock_path));
+    FILE *lock_file = fopen(lock_path, "wx");  /* x = fail if exists */
     
     if (!lock_file) {
         if (errno == EEXIST) {
@@ -668,7 +796,7 @@ static eb_status_t acquire_atomic_lock(void) {
         }
         
         /* Other error (e.g., permission denied) */
-        DEBUG_ERROR("Failed to acquire lock: %s", strerror(errno));
+        DEBUG_ERROR("Failed to acquire lock %s: %s", lock_path, strerror(errno));
         return EB_ERROR_IO;
     }
     
@@ -676,76 +804,64 @@ static eb_status_t acquire_atomic_lock(void) {
     fprintf(lock_file, "%d", getpid());
     fclose(lock_file);
     
-    atomic_lock_held = true;
-    DEBUG_INFO("Acquired atomic operation lock");
+    txn->held = true;
+    DEBUG_INFO("Acquired transaction lock %s", lock_path);
     
     return EB_SUCCESS;
 }
 
 /*
- * Release the atomic operation lock
+ * Release the lock of a transaction
  */
-static void release_atomic_lock(void) {
-    if (!atomic_lock_held) {
+static void release_transaction_lock(remote_transaction_t *txn) {
+    if (!txn->held) {
         return;  /* Not holding the lock */
     }
     
     /* Remove the lock file */
-    if (unlink(LOCK_FILE) != 0) {
+    char lock_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "LOCK", lock_path, sizeof(lock_path));
+    if (unlink(lock_path) != 0) {
         DEBUG_WARN("Failed to remove lock file: %s", strerror(errno));
         /* We'll still consider the lock released */
     }
     
-    atomic_lock_held = false;
-    DEBUG_INFO("Released atomic operation lock");
+    txn->held = false;
+    DEBUG_INFO("Released transaction lock %s", lock_path);
 }
 
 /*
- * Begin a transaction by creating a journal entry
+ * Begin a transaction on (remote_name, path) by creating a journal entry
  * Returns EB_SUCCESS if the transaction was started, or error code if not
  */
-static eb_status_t begin_transaction(const char *operation, const char *remote_name, const char *path) {
+static eb_status_t begin_transaction(remote_transaction_t *txn, const char *operation,
+                                     const char *remote_name, const char *path) {
     DEBUG_PRINT("begin_transaction: Starting with operation=%s, remote=%s, path=%s", 
                operation ? operation : "(null)", 
                remote_name ? remote_name : "(null)", 
                path ? path : "(null)");
     
-    /* Acquire the atomic lock */
-    eb_status_t status = acquire_atomic_lock();
+    eb_status_t status = transaction_init(txn, remote_name, path);
     if (status != EB_SUCCESS) {
-        DEBUG_ERROR("begin_transaction: Failed to acquire lock: %d", status);
         return status;
     }
-    
-    DEBUG_PRINT("begin_transaction: Lock acquired");
-    
-    /* Create the journal directory if it doesn't exist */
-    char journal_dir[256];
-    strncpy(journal_dir, COMMIT_LOG, sizeof(journal_dir));
-    char *last_slash = strrchr(journal_dir, '/');
-    if (last_slash) {
-        *last_slash = '\0';
-        mkdir(journal_dir, 0755);
-    }
-    
-    /* Open the journal for writing (append mode) */
-    FILE *journal = fopen(COMMIT_LOG, "a");
-    if (!journal) {
-        DEBUG_ERROR("begin_transaction: Failed to open journal: %s", strerror(errno));
-        release_atomic_lock();
+    if (fs_mkdir_p(txn->dir, 0755) != 0) {
+        DEBUG_ERROR("begin_transaction: Failed to create %s: %s", txn->dir, strerror(errno));
         return EB_ERROR_IO;
     }
     
-    DEBUG_PRINT("begin_transaction: Journal opened");
+    /* Acquire the lock of this remote and path */
+    status = acquire_transaction_lock(txn);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("begin_transaction: Failed to acquire lock: %d", status);
+        return status;
+    }
     
     /* Write transaction details */
-    time_t now = time(NULL);
-    fprintf(journal, "BEGIN %ld %s %s %s\n", (long)now, operation, remote_name, path);
+    char record[1024];
+    snprintf(record, sizeof(record), "BEGIN %s %s %s", operation, remote_name, path);
+    transaction_journal(txn, record);
     
-    fflush(journal);
-    fclose(journal);
-    
-    DEBUG_PRINT("begin_transaction: Journal entry written and closed");
     DEBUG_PRINT("begin_transaction: Successfully completed");
     return EB_SUCCESS;
 }
@@ -754,37 +870,33 @@ static eb_status_t begin_transaction(const char *operation, const char *remote_n
  * Commit a transaction by updating the reference file atomically
  * Returns EB_SUCCESS if the transaction was committed, or error code if not
  */
-static eb_status_t commit_transaction(void) {
-    if (!atomic_lock_held) {
+static eb_status_t commit_transaction(remote_transaction_t *txn) {
+    if (!txn->held) {
         DEBUG_ERROR("Attempted to commit without holding lock");
         return EB_ERROR_LOCK_FAILED;
     }
     
     /* Check if the temporary reference file exists */
-    FILE *temp_ref = fopen(TEMP_REF_FILE, "r");
-    if (!temp_ref) {
+    char temp_path[TRANSACTION_PATH_MAX];
+    char ref_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "TEMP", temp_path, sizeof(temp_path));
+    transaction_file(txn, "HEAD", ref_path, sizeof(ref_path));
+    if (access(temp_path, F_OK) != 0) {
         DEBUG_ERROR("No temporary reference file exists");
         return EB_ERROR_NOT_FOUND;
     }
-    fclose(temp_ref);
     
     /* Atomically replace the reference file with the temporary one */
-    if (rename(TEMP_REF_FILE, REF_FILE) != 0) {
+    if (rename(temp_path, ref_path) != 0) {
         DEBUG_ERROR("Failed to rename temp ref to ref: %s", strerror(errno));
         return EB_ERROR_IO;
     }
     
     /* Record the commit in the journal */
-    FILE *journal = fopen(COMMIT_LOG, "a");
-    if (journal) {
-        time_t now = time(NULL);
-        fprintf(journal, "COMMIT %ld\n", (long)now);
-        fflush(journal);
-        fclose(journal);
-    }
+    transaction_journal(txn, "COMMIT");
     
     /* Release the lock */
-    release_atomic_lock();
+    release_transaction_lock(txn);
     
     return EB_SUCCESS;
 }
@@ -793,51 +905,50 @@ static eb_status_t commit_transaction(void) {
  * Abort a transaction by cleaning up the temporary file
  * Returns EB_SUCCESS if the transaction was aborted, or error code if not
  */
-static eb_status_t abort_transaction(void) {
-    if (!atomic_lock_held) {
+static eb_status_t abort_transaction(remote_transaction_t *txn) {
+    if (!txn->held) {
         DEBUG_ERROR("Attempted to abort without holding lock");
         return EB_ERROR_LOCK_FAILED;
     }
     
     /* Remove the temporary reference file if it exists */
-    if (unlink(TEMP_REF_FILE) != 0 && errno != ENOENT) {
+    char temp_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "TEMP", temp_path, sizeof(temp_path));
+    if (unlink(temp_path) != 0 && errno != ENOENT) {
         DEBUG_WARN("Failed to remove temp ref: %s", strerror(errno));
         /* Continue anyway */
     }
     
     /* Record the abort in the journal */
-    FILE *journal = fopen(COMMIT_LOG, "a");
-    if (journal) {
-        time_t now = time(NULL);
-        fprintf(journal, "ABORT %ld\n", (long)now);
-        fflush(journal);
-        fclose(journal);
-    }
+    transaction_journal(txn, "ABORT");
     
     /* Release the lock */
-    release_atomic_lock();
+    release_transaction_lock(txn);
     
     return EB_SUCCESS;
 }
 
 /*
- * Check if there are interrupted transactions that need recovery
+ * Check if a transaction was interrupted and needs recovery
  * Returns true if recovery is needed, false otherwise
  */
-static bool recovery_needed(void) {
-    FILE *journal = fopen(COMMIT_LOG, "r");
+static bool recovery_needed(const remote_transaction_t *txn) {
+    char journal_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "JOURNAL", journal_path, sizeof(journal_path));
+    FILE *journal = fopen(journal_path, "r");
     if (!journal) {
         return false;  /* No journal, no recovery needed */
     }
     
     /* Read the journal and see if there are any BEGIN without COMMIT or ABORT */
-    char line[512];
+    char line[1100];
     bool transaction_in_progress = false;
     
     while (fgets(line, sizeof(line), journal)) {
         if (strncmp(line, "BEGIN", 5) == 0) {
             transaction_in_progress = true;
-        } else if (strncmp(line, "COMMIT", 6) == 0 || strncmp(line, "ABORT", 5) == 0) {
+        } else if (strncmp(line, "COMMIT", 6) == 0 || strncmp(line, "ABORT", 5) == 0 ||
+                   strncmp(line, "RECOVER", 7) == 0) {
             transaction_in_progress = false;
         }
     }
@@ -847,18 +958,19 @@ static bool recovery_needed(void) {
 }
 
 /*
- * Recover from interrupted transactions
- * This is called during initialization to ensure ACID properties are maintained
+ * Recover one interrupted transaction
  */
-static void recover_transactions(void) {
-    if (!recovery_needed()) {
+static void recover_transaction(const remote_transaction_t *txn) {
+    if (!recovery_needed(txn)) {
         return;  /* No recovery needed */
     }
     
-    DEBUG_WARN("Interrupted transaction detected, recovering...");
+    DEBUG_WARN("Interrupted transaction detected in %s, recovering...", txn->dir);
     
     /* Check if the lock file exists */
-    FILE *lock_file = fopen(LOCK_FILE, "r");
+    char lock_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "LOCK", lock_path, sizeof(lock_path));
+    FILE *lock_file = fopen(lock_path, "r");
     if (lock_file) {
         /* Lock file exists, read the PID */
         int pid;
@@ -873,21 +985,22 @@ static void recover_transactions(void) {
         fclose(lock_file);
         
         /* Remove the stale lock file */
-        unlink(LOCK_FILE);
+        unlink(lock_path);
     }
     
     /* Check if the temporary reference file exists */
-    FILE *temp_ref = fopen(TEMP_REF_FILE, "r");
-    if (temp_ref) {
-        fclose(temp_ref);
-        
+    char temp_path[TRANSACTION_PATH_MAX];
+    char ref_path[TRANSACTION_PATH_MAX];
+    transaction_file(txn, "TEMP", temp_path, sizeof(temp_path));
+    transaction_file(txn, "HEAD", ref_path, sizeof(ref_path));
+    if (access(temp_path, F_OK) == 0) {
         /* Temporary file exists - attempt to complete the transaction */
         DEBUG_INFO("Completing interrupted transaction");
         
         /* Atomically replace the reference file with the temporary one */
-        if (rename(TEMP_REF_FILE, REF_FILE) != 0) {
+        if (rename(temp_path, ref_path) != 0) {
             DEBUG_ERROR("Recovery failed to rename temp ref: %s", strerror(errno));
-            unlink(TEMP_REF_FILE);  /* Clean up */
+            unlink(temp_path);  /* Clean up */
         } else {
             DEBUG_INFO("Transaction recovered successfully");
         }
@@ -897,154 +1010,113 @@ static void recover_transactions(void) {
     }
     
     /* Record the recovery in the journal */
-    FILE *journal = fopen(COMMIT_LOG, "a");
-    if (journal) {
-        time_t now = time(NULL);
-        fprintf(journal, "RECOVER %ld\n", (long)now);
-        fflush(journal);
-        fclose(journal);
-    }
+    transaction_journal(txn, "RECOVER");
 }
 
-/* 
- * Update eb_remote_push to use the atomic transaction model
+/*
+ * Recover from interrupted transactions on every (remote, path) pair
+ * This is called during initialization to ensure ACID properties are maintained
  */
-eb_status_t eb_remote_push(
-    const char *remote_name,
-    const void *data,
-    size_t size,
-    const char *path,
-    const char *hash) {
-    
-    DEBUG_PRINT("eb_remote_push: Starting with remote=%s, size=%zu, path=%s", 
-               remote_name ? remote_name : "(null)", 
-               size, 
-               path ? path : "(null)");
-    
-    if (!remote_name || !data || !path) {
-        DEBUG_PRINT("eb_remote_push: Parameter validation failed - remote_name=%p, data=%p, path=%p",
-                  (void*)remote_name, data, (void*)path);
-        return EB_ERROR_INVALID_PARAMETER;
-    }
-    
-    DEBUG_PRINT("eb_remote_push: Parameters validated successfully");
-    
-    /* Begin a new transaction */
-    DEBUG_PRINT("eb_remote_push: Attempting to begin transaction");
-    eb_status_t status = begin_transaction("PUSH", remote_name, path);
-    if (status != EB_SUCCESS) {
-        DEBUG_ERROR("eb_remote_push: Failed to begin transaction: %d", status);
-        return status;
+static void recover_transactions(void) {
+    DIR *remotes_dir = opendir(TRANSACTION_ROOT);
+    if (!remotes_dir) {
+        return;  /* Nothing was ever pushed */
     }
     
-    DEBUG_PRINT("eb_remote_push: Transaction started successfully");
-    
-    /* Start tracking this operation */
-    DEBUG_PRINT("eb_remote_push: Starting operation tracking");
-    int op_idx = start_operation(remote_name, path, size, data, 0);
-    DEBUG_PRINT("eb_remote_push: Operation tracking started, op_idx=%d", op_idx);
-    
-    /* Find the remote configuration */
-    DEBUG_PRINT("eb_remote_push: Looking up remote configuration for '%s'", remote_name);
-    pthread_mutex_lock(&remote_mutex);
-    
-    int remote_index = -1;
-    for (int i = 0; i < remote_count; i++) {
-        DEBUG_PRINT("eb_remote_push: Checking remote[%d]='%s'", i, remotes[i].name);
-        if (strcmp(remotes[i].name, remote_name) == 0) {
-            remote_index = i;
-            break;
+    struct dirent *remote_entry;
+    while ((remote_entry = readdir(remotes_dir)) != NULL) {
+        if (remote_entry->d_name[0] == '.') {
+            continue;
         }
+        char remote_dir[TRANSACTION_PATH_MAX];
+        snprintf(remote_dir, sizeof(remote_dir), "%s/%s", TRANSACTION_ROOT, remote_entry->d_name);
+        DIR *paths_dir = opendir(remote_dir);
+        if (!paths_dir) {
+            continue;
+        }
+        struct dirent *path_entry;
+        while ((path_entry = readdir(paths_dir)) != NULL) {
+            remote_transaction_t txn = {0};
+            if (path_entry->d_name[0] == '.' ||
+                (size_t)snprintf(txn.dir, sizeof(txn.dir), "%s/%s", remote_dir,
+                                 path_entry->d_name) >= sizeof(txn.dir)) {
+                continue;
+            }
+            recover_transaction(&txn);
+        }
+        closedir(paths_dir);
     }
-    
-    if (remote_index == -1) {
-        DEBUG_PRINT("eb_remote_push: Remote '%s' not found in list of %d remotes", 
-                  remote_name, remote_count);
-        pthread_mutex_unlock(&remote_mutex);
-        DEBUG_ERROR("Remote '%s' not found", remote_name);
-        abort_transaction();
-        return EB_ERROR_NOT_FOUND;
-    }
-    
-    DEBUG_PRINT("eb_remote_push: Found remote '%s' at index %d with URL '%s'", 
-              remote_name, remote_index, remotes[remote_index].url);
-    
-    /* Make a copy of the remote configuration to avoid holding the lock */
-    remote_config_t remote_config = remotes[remote_index];
-    pthread_mutex_unlock(&remote_mutex);
-    
+    closedir(remotes_dir);
+}
+
+/*
+ * Borrow a connected transport for a path of a remote
+ */
+static eb_status_t open_push_transport(const remote_config_t *remote_config,
+                                       const char *path,
+                                       eb_transport_t **transport_out) {
     /* Construct the full URL for the path */
     char full_url[1024];
-    snprintf(full_url, sizeof(full_url), "%s/%s", remote_config.url, path);
+    snprintf(full_url, sizeof(full_url), "%s/%s", remote_config->url, path);
     DEBUG_INFO("Pushing to URL: %s", full_url);
     
-    /* Open the transport */
-    DEBUG_PRINT("eb_remote_push: Opening transport for URL '%s'", full_url);
-    eb_transport_t *transport = transport_open(full_url);
+    eb_transport_t *transport = transport_acquire(full_url, &remote_config->transport_options);
     if (!transport) {
-        DEBUG_ERROR("Failed to open transport for '%s'", full_url);
-        abort_transaction();
+        DEBUG_ERROR("Failed to connect to '%s'", full_url);
         return EB_ERROR_TRANSPORT;
     }
     
     /* Set the target path for the transport */
     transport->target_path = strdup(path);
-    
-    /* Ensure the data_is_precompressed flag is initialized to false */
-    transport->data_is_precompressed = false;
-    
-    DEBUG_INFO("eb_remote_push: Transport opened successfully, type=%d", transport->type);
-    
-    /* Connect to the remote */
-    DEBUG_PRINT("eb_remote_push: Connecting to remote");
-    int connect_result = transport_connect(transport);
-    if (connect_result != EB_SUCCESS) {
-        DEBUG_ERROR("Failed to connect to '%s': %s", 
-                  full_url, transport_get_error(transport));
-        transport_close(transport);
-        abort_transaction();
-        return connect_result;
-    }
-    
-    /* Set the target path for the operation */
-    /* Make sure target_path is properly allocated */
-    if (path) {
-        /* Free existing target_path if it exists */
-        if (transport->target_path) {
-            free((void*)transport->target_path);
-        }
-        
-        char *target_path_copy = strdup(path);
-        if (!target_path_copy) {
-            DEBUG_ERROR("Failed to allocate memory for target path");
-            transport_disconnect(transport);
-            transport_close(transport);
-            abort_transaction();
-            return EB_ERROR_MEMORY;
-        }
-        transport->target_path = target_path_copy;
+    if (!transport->target_path) {
+        DEBUG_ERROR("Failed to allocate memory for target path");
+        transport_release(transport);
+        return EB_ERROR_MEMORY;
     }
     
+    *transport_out = transport;
+    return EB_SUCCESS;
+}
+
+/* Does the remote keep object records in the local encoding? */
+static bool remote_stores_native(const remote_config_t *remote_config) {
+    const char *format = remote_config->target_format[0] ? remote_config->target_format
+                                                         : remote_config->transformer_name;
+    return strcmp(format, EB_REMOTE_FORMAT_NATIVE) == 0;
+}
+
+/*
+ * Send one payload over a connected transport
+ *
+ * Small payloads go out in one piece; larger ones are compressed and sent
+ * in BATCH_SIZE batches followed by an end marker. Object records bound
+ * for a native remote are passed through whole. Sends are retried up to
+ * MAX_RETRIES times. The transport stays connected either way.
+ */
+static eb_status_t send_payload_data(eb_transport_t *transport,
+                                     const remote_config_t *remote_config,
+                                     const void *data,
+                                     size_t size,
+                                     const char *hash,
+                                     int op_idx) {
     eb_status_t result = EB_SUCCESS;
     
-    /* For small data, send directly */
-    if (size <= BATCH_SIZE) {
+    /*
+     * A native remote stores object records as they are here, so a valid
+     * record goes out untouched: no decode, re-encode or batch compression.
+     */
+    bool passthrough = remote_stores_native(remote_config) &&
+                       eb_remote_object_is_record(data, size);
+    
+    /* For small data and passthrough records, send directly */
+    if (size <= BATCH_SIZE || passthrough) {
         /* Skip compression for all formats to avoid issues with Parquet transformer */
-        DEBUG_WARN("Skipping pre-compression before transport");
-        void *compressed_data = (void*)data;  /* Use original data */
-        size_t compressed_size = size;
-        
         /* Send the data with retries */
         int retry_count = 0;
         while (retry_count < MAX_RETRIES) {
-            DEBUG_INFO("About to call transport_send_data with %p, %p, %zu", 
-                     transport, compressed_data, compressed_size);
-            
-            /* Set flag to indicate data is not pre-compressed */
-            transport->data_is_precompressed = false;
-            DEBUG_WARN("Setting data_is_precompressed flag to FALSE");
+            transport->data_is_precompressed = passthrough;
             
-            result = transport_send_data(transport, compressed_data, compressed_size, hash);
+            result = transport_send_data(transport, data, size, hash);
             
             DEBUG_INFO("transport_send_data returned: %d", result);
             
@@ -1058,6 +1130,7 @@ eb_status_t eb_remote_push(
             
             retry_count++;
             if (retry_count < MAX_RETRIES) {
+                eb_counter_add(EB_COUNTER_REMOTE_RETRIES, 1);
                 sleep_ms(RETRY_DELAY_MS);
             }
         }
@@ -1065,9 +1138,6 @@ eb_status_t eb_remote_push(
         if (result != EB_SUCCESS) {
             DEBUG_ERROR("Failed to send data after %d retries: %s", 
                       MAX_RETRIES, transport_get_error(transport));
-            transport_disconnect(transport);
-            transport_close(transport);
-            abort_transaction();
             return result;
         }
         
@@ -1076,149 +1146,312 @@ eb_status_t eb_remote_push(
             update_operation(op_idx, size);
             complete_operation(op_idx);
         }
-    } else {
-        /* For large data, send in batches */
-        const unsigned char *data_ptr = (const unsigned char *)data;
-        size_t remaining = size;
-        size_t batch_number = 0;
-        size_t total_batches = (size + BATCH_SIZE - 1) / BATCH_SIZE;
-        
-        while (remaining > 0 && result == EB_SUCCESS) {
-            /* Determine current batch size */
-            size_t current_batch_size = (remaining > BATCH_SIZE) ? BATCH_SIZE : remaining;
-            
-            /* Compress the batch */
-            void *compressed_batch = NULL;
-            size_t compressed_size = 0;
-            
-            result = compress_buffer(data_ptr, current_batch_size, 
-                                   remote_config.timeout, 
-                                   &compressed_batch, &compressed_size);
-            if (result != EB_SUCCESS) {
-                DEBUG_ERROR("Failed to compress batch %zu/%zu: %d", 
-                          batch_number + 1, total_batches, result);
-                transport_disconnect(transport);
-                transport_close(transport);
-                abort_transaction();
-                return result;
-            }
-            
-            /* Send batch header with batch info */
-            char batch_header[256];
-            snprintf(batch_header, sizeof(batch_header), 
-                     "BATCH %zu/%zu SIZE %zu COMPRESSED %zu", 
-                     batch_number + 1, total_batches, 
-                     current_batch_size, compressed_size);
-            
-            /* Encode batch header length at the start (4 bytes) */
-            size_t header_len = strlen(batch_header);
-            unsigned char header_len_bytes[4];
-            header_len_bytes[0] = (header_len >> 24) & 0xFF;
-            header_len_bytes[1] = (header_len >> 16) & 0xFF;
-            header_len_bytes[2] = (header_len >> 8) & 0xFF;
-            header_len_bytes[3] = header_len & 0xFF;
-            
-            /* Send header length */
-            result = transport_send_data(transport, header_len_bytes, 4, NULL);
-            if (result != EB_SUCCESS) {
-                DEBUG_ERROR("Failed to send batch header length: %s", 
-                          transport_get_error(transport));
-                free(compressed_batch);
-                transport_disconnect(transport);
-                transport_close(transport);
-                abort_transaction();
-                return result;
-            }
-            
-            /* Send header */
-            result = transport_send_data(transport, batch_header, header_len, NULL);
-            if (result != EB_SUCCESS) {
-                DEBUG_ERROR("Failed to send batch header: %s", 
-                          transport_get_error(transport));
-                free(compressed_batch);
-                transport_disconnect(transport);
-                transport_close(transport);
-                abort_transaction();
-                return result;
-            }
-            
-            /* Send the compressed batch with retries */
-            int retry_count = 0;
-            while (retry_count < MAX_RETRIES) {
-                result = transport_send_data(transport, compressed_batch, compressed_size, NULL);
-                if (result == EB_SUCCESS) {
-                    break;
-                }
-                
-                DEBUG_WARN("Retry %d/%d: Failed to send batch %zu/%zu: %s", 
-                            retry_count + 1, MAX_RETRIES, batch_number + 1, total_batches,
-                            transport_get_error(transport));
-                
-                retry_count++;
-                if (retry_count < MAX_RETRIES) {
-                    sleep_ms(RETRY_DELAY_MS);
-                }
-            }
-            
+        return EB_SUCCESS;
+    }
+    
+    /* For large data, send in batches */
+    transport->data_is_precompressed = false;
+    const unsigned char *data_ptr = (const unsigned char *)data;
+    size_t remaining = size;
+    size_t batch_number = 0;
+    size_t total_batches = (size + BATCH_SIZE - 1) / BATCH_SIZE;
+    
+    while (remaining > 0) {
+        /* Determine current batch size */
+        size_t current_batch_size = (remaining > BATCH_SIZE) ? BATCH_SIZE : remaining;
+        
+        /* Compress the batch */
+        void *compressed_batch = NULL;
+        size_t compressed_size = 0;
+        
+        result = compress_buffer(data_ptr, current_batch_size, 
+                               remote_config->timeout, 
+                               &compressed_batch, &compressed_size);
+        if (result != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to compress batch %zu/%zu: %d", 
+                      batch_number + 1, total_batches, result);
+            return result;
+        }
+        
+        /* Send batch header with batch info */
+        char batch_header[256];
+        snprintf(batch_header, sizeof(batch_header), 
+                 "BATCH %zu/%zu SIZE %zu COMPRESSED %zu", 
+                 batch_number + 1, total_batches, 
+                 current_batch_size, compressed_size);
+        
+        /* Encode batch header length at the start (4 bytes) */
+        size_t header_len = strlen(batch_header);
+        unsigned char header_len_bytes[4];
+        header_len_bytes[0] = (header_len >> 24) & 0xFF;
+        header_len_bytes[1] = (header_len >> 16) & 0xFF;
+        header_len_bytes[2] = (header_len >> 8) & 0xFF;
+        header_len_bytes[3] = header_len & 0xFF;
+        
+        /* Send header length */
+        result = transport_send_data(transport, header_len_bytes, 4, NULL);
+        if (result != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to send batch header length: %s", 
+                      transport_get_error(transport));
             free(compressed_batch);
-            
-            if (result != EB_SUCCESS) {
-                DEBUG_ERROR("Failed to send batch %zu/%zu after %d retries: %s", 
-                          batch_number + 1, total_batches, MAX_RETRIES,
-                          transport_get_error(transport));
-                transport_disconnect(transport);
-                transport_close(transport);
-                abort_transaction();
-                return result;
-            }
-            
-            /* Update progress */
-            size_t transferred = (batch_number + 1) * BATCH_SIZE;
-            if (transferred > size) {
-                transferred = size;
-            }
-            
-            if (op_idx >= 0) {
-                update_operation(op_idx, transferred);
-            }
-            
-            DEBUG_INFO("Sent batch %zu/%zu (%.1f%%)", 
-                     batch_number + 1, total_batches,
-                     (float)(batch_number + 1) * 100.0f / (float)total_batches);
-            
-            /* Move to next batch */
-            data_ptr += current_batch_size;
-            remaining -= current_batch_size;
-            batch_number++;
+            return result;
         }
         
-        /* Send end marker */
-        const char *end_marker = "END";
-        result = transport_send_data(transport, end_marker, strlen(end_marker), NULL);
+        /* Send header */
+        result = transport_send_data(transport, batch_header, header_len, NULL);
         if (result != EB_SUCCESS) {
-            DEBUG_ERROR("Failed to send end marker: %s", 
+            DEBUG_ERROR("Failed to send batch header: %s", 
                       transport_get_error(transport));
-            transport_disconnect(transport);
-            transport_close(transport);
-            abort_transaction();
+            free(compressed_batch);
             return result;
-        } else {
-            DEBUG_INFO("Push completed successfully: %zu bytes in %zu batches", 
-                     size, total_batches);
-            
-            /* Mark operation as completed */
-            if (op_idx >= 0) {
-                complete_operation(op_idx);
-            }
         }
-    }
-    
-    /* Disconnect and cleanup */
-    transport_disconnect(transport);
-    transport_close(transport);
+        
+        /* Send the compressed batch with retries */
+        int retry_count = 0;
+        while (retry_count < MAX_RETRIES) {
+            result = transport_send_data(transport, compressed_batch, compressed_size, NULL);
+            if (result == EB_SUCCESS) {
+                break;
+            }
+            
+            DEBUG_WARN("Retry %d/%d: Failed to send batch %zu/%zu: %s", 
+                        retry_count + 1, MAX_RETRIES, batch_number + 1, total_batches,
+                        transport_get_error(transport));
+            
+            retry_count++;
+            if (retry_count < MAX_RETRIES) {
+                eb_counter_add(EB_COUNTER_REMOTE_RETRIES, 1);
+                sleep_ms(RETRY_DELAY_MS);
+            }
+        }
+        
+        free(compressed_batch);
+        
+        if (result != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to send batch %zu/%zu after %d retries: %s", 
+                      batch_number + 1, total_batches, MAX_RETRIES,
+                      transport_get_error(transport));
+            return result;
+        }
+        
+        /* Update progress */
+        size_t transferred = (batch_number + 1) * BATCH_SIZE;
+        if (transferred > size) {
+            transferred = size;
+        }
+        
+        if (op_idx >= 0) {
+            update_operation(op_idx, transferred);
+        }
+        
+        DEBUG_INFO("Sent batch %zu/%zu (%.1f%%)", 
+                 batch_number + 1, total_batches,
+                 (float)(batch_number + 1) * 100.0f / (float)total_batches);
+        
+        /* Move to next batch */
+        data_ptr += current_batch_size;
+        remaining -= current_batch_size;
+        batch_number++;
+    }
+    
+    /* Send end marker */
+    const char *end_marker = "END";
+    result = transport_send_data(transport, end_marker, strlen(end_marker), NULL);
+    if (result != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to send end marker: %s", 
+                  transport_get_error(transport));
+        return result;
+    }
+    
+    DEBUG_INFO("Push completed successfully: %zu bytes in %zu batches", 
+             size, total_batches);
+    
+    /* Mark operation as completed */
+    if (op_idx >= 0) {
+        complete_operation(op_idx);
+    }
+    return EB_SUCCESS;
+}
+
+/*
+ * Send one payload with the remote's Parquet writer tuning in effect
+ *
+ * The transport transforms on the sending thread, so the tuning is set
+ * for this thread only, for the duration of the send.
+ */
+static eb_status_t send_payload(eb_transport_t *transport,
+                                const remote_config_t *remote_config,
+                                const void *data,
+                                size_t size,
+                                const char *hash,
+                                int op_idx) {
+    eb_parquet_set_writer_options(&remote_config->parquet_options);
+    eb_status_t result = send_payload_data(transport, remote_config, data, size, hash, op_idx);
+    eb_parquet_set_writer_options(NULL);
+    return result;
+}
+
+/*
+ * Copy the configuration of a remote out of the registry
+ */
+static eb_status_t lookup_remote_config(const char *remote_name, remote_config_t *config_out) {
+    pthread_rwlock_rdlock(&remote_lock);
+    
+    int remote_index = -1;
+    for (int i = 0; i < remote_count; i++) {
+        if (strcmp(remotes[i].name, remote_name) == 0) {
+            remote_index = i;
+            break;
+        }
+    }
+    
+    if (remote_index == -1) {
+        DEBUG_PRINT("lookup_remote_config: Remote '%s' not found in list of %d remotes", 
+                  remote_name, remote_count);
+        pthread_rwlock_unlock(&remote_lock);
+        DEBUG_ERROR("Remote '%s' not found", remote_name);
+        return EB_ERROR_NOT_FOUND;
+    }
+    
+    /* Make a copy of the remote configuration to avoid holding the lock */
+    *config_out = remotes[remote_index];
+    pthread_rwlock_unlock(&remote_lock);
+    return EB_SUCCESS;
+}
+
+/* Get the Parquet writer tuning of a remote */
+eb_status_t eb_remote_parquet_options(const char *name, eb_parquet_writer_options_t *options) {
+    if (!name || !options) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    remote_config_t config;
+    eb_status_t status = lookup_remote_config(name, &config);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    
+    *options = config.parquet_options;
+    return EB_SUCCESS;
+}
+
+/* Set the Parquet writer tuning of a remote */
+eb_status_t eb_remote_set_format_options(const char *name, const char *format_options) {
+    if (!name) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    if (!format_options) {
+        format_options = "";
+    }
+    
+    eb_parquet_writer_options_t parsed;
+    eb_status_t status = format_parse_parquet_options(format_options, &parsed);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    if (strlen(format_options) >= sizeof(((remote_config_t *)0)->format_options)) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    pthread_rwlock_wrlock(&remote_lock);
+    int remote_index = -1;
+    for (int i = 0; i < remote_count; i++) {
+        if (strcmp(remotes[i].name, name) == 0) {
+            remote_index = i;
+            break;
+        }
+    }
+    if (remote_index == -1) {
+        pthread_rwlock_unlock(&remote_lock);
+        DEBUG_ERROR("Remote '%s' not found", name);
+        return EB_ERROR_NOT_FOUND;
+    }
+    strcpy(remotes[remote_index].format_options, format_options);
+    remotes[remote_index].parquet_options = parsed;
+    pthread_rwlock_unlock(&remote_lock);
+    
+    return eb_remote_save_config(".embr");
+}
+
+/* Get the client tuning of a remote */
+eb_status_t eb_remote_transport_options(const char *name, eb_transport_options_t *options) {
+    if (!name || !options) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    remote_config_t config;
+    eb_status_t status = lookup_remote_config(name, &config);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    
+    *options = config.transport_options;
+    return EB_SUCCESS;
+}
+
+/* 
+ * Update eb_remote_push to use the atomic transaction model
+ */
+eb_status_t eb_remote_push(
+    const char *remote_name,
+    const void *data,
+    size_t size,
+    const char *path,
+    const char *hash) {
+    
+    DEBUG_PRINT("eb_remote_push: Starting with remote=%s, size=%zu, path=%s", 
+               remote_name ? remote_name : "(null)", 
+               size, 
+               path ? path : "(null)");
+    
+    if (!remote_name || !data || !path) {
+        DEBUG_PRINT("eb_remote_push: Parameter validation failed - remote_name=%p, data=%p, path=%p",
+                  (void*)remote_name, data, (void*)path);
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    /* Begin a new transaction */
+    remote_transaction_t txn;
+    eb_status_t status = begin_transaction(&txn, "PUSH", remote_name, path);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("eb_remote_push: Failed to begin transaction: %d", status);
+        return status;
+    }
+    
+    /* Start tracking this operation */
+    char checksum[128];
+    calculate_checksum(data, size, checksum, sizeof(checksum));
+    int op_idx = start_operation(remote_name, path, size, checksum, 0);
+    DEBUG_PRINT("eb_remote_push: Operation tracking started, op_idx=%d", op_idx);
+    
+    remote_config_t remote_config;
+    status = lookup_remote_config(remote_name, &remote_config);
+    if (status != EB_SUCCESS) {
+        abort_transaction(&txn);
+        return status;
+    }
+    
+    eb_transport_t *transport = NULL;
+    status = open_push_transport(&remote_config, path, &transport);
+    if (status != EB_SUCCESS) {
+        abort_transaction(&txn);
+        return status;
+    }
+    
+    eb_status_t result = send_payload(transport, &remote_config, data, size, hash, op_idx);
+    
+    /* Hand the connection back for the next operation */
+    transport_release(transport);
+    
+    if (result != EB_SUCCESS) {
+        abort_transaction(&txn);
+        return result;
+    }
     
     /* Create the temp ref file with operation details */
-    FILE *temp_ref = fopen(TEMP_REF_FILE, "w");
+    char temp_path[TRANSACTION_PATH_MAX];
+    transaction_file(&txn, "TEMP", temp_path, sizeof(temp_path));
+    FILE *temp_ref = fopen(temp_path, "w");
     if (temp_ref) {
         time_t now = time(NULL);
         fprintf(temp_ref, "OPERATION push\n");
@@ -1227,236 +1460,1628 @@ eb_status_t eb_remote_push(
         fprintf(temp_ref, "SIZE %zu\n", size);
         fprintf(temp_ref, "TIMESTAMP %ld\n", (long)now);
         
-        /* Calculate and store checksum for verification */
-        char checksum[128];
-        calculate_checksum(data, size, checksum, sizeof(checksum));
+        /* Store the checksum for verification */
         fprintf(temp_ref, "CHECKSUM %s\n", checksum);
         
-        fflush(temp_ref);
-        fclose(temp_ref);
-    } else {
-        DEBUG_ERROR("Failed to create temp ref file: %s", strerror(errno));
-        abort_transaction();
-        return EB_ERROR_IO;
+        fflush(temp_ref);
+        fclose(temp_ref);
+    } else {
+        DEBUG_ERROR("Failed to create temp ref file: %s", strerror(errno));
+        abort_transaction(&txn);
+        return EB_ERROR_IO;
+    }
+    
+    /* Commit the transaction */
+    status = commit_transaction(&txn);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to commit transaction: %d", status);
+        abort_transaction(&txn);
+        return status;
+    }
+    
+    return EB_SUCCESS;
+}
+
+/*
+ * Push sessions
+ *
+ * A session holds one transaction and a pool of workers, each with its own
+ * connected transport. Payloads are handed over through a bounded queue so
+ * the producer never runs far ahead of the network, and the ref file is
+ * written once when the session finishes.
+ */
+
+/* Queued payloads per worker */
+#define PUSH_QUEUE_PER_JOB 4
+
+typedef struct {
+    void *data;
+    size_t size;
+    char hash[128];
+} push_item_t;
+
+typedef struct {
+    eb_remote_push_session_t *session;
+    eb_transport_t *transport;
+    pthread_t thread;
+} push_worker_t;
+
+struct eb_remote_push_session {
+    remote_config_t config;
+    char path[512];
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    push_item_t *queue;           /* Ring buffer of pending payloads */
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool closing;                 /* No more payloads will be added */
+    remote_transaction_t txn;     /* Held from begin to finish */
+    
+    push_worker_t *workers;
+    size_t worker_count;
+    
+    eb_remote_push_stats_t stats;
+    unsigned long checksum;       /* XOR of the payload checksums */
+    eb_status_t first_error;
+};
+
+/* Order-independent combination of calculate_checksum() values */
+static unsigned long payload_checksum(const void *data, size_t size) {
+    char checksum[32];
+    calculate_checksum(data, size, checksum, sizeof(checksum));
+    return strtoul(checksum, NULL, 16);
+}
+
+static void *push_worker_main(void *arg) {
+    push_worker_t *worker = (push_worker_t *)arg;
+    eb_remote_push_session_t *session = worker->session;
+    
+    for (;;) {
+        pthread_mutex_lock(&session->mutex);
+        while (session->count == 0 && !session->closing) {
+            pthread_cond_wait(&session->not_empty, &session->mutex);
+        }
+        if (session->count == 0) {
+            pthread_mutex_unlock(&session->mutex);
+            break;
+        }
+        push_item_t item = session->queue[session->head];
+        session->head = (session->head + 1) % session->capacity;
+        session->count--;
+        pthread_cond_signal(&session->not_full);
+        pthread_mutex_unlock(&session->mutex);
+        
+        eb_status_t result = EB_SUCCESS;
+        if (!worker->transport) {
+            result = open_push_transport(&session->config, session->path, &worker->transport);
+        }
+        if (result == EB_SUCCESS) {
+            result = send_payload(worker->transport, &session->config,
+                                  item.data, item.size, item.hash, -1);
+        }
+        if (result != EB_SUCCESS && worker->transport) {
+            /* The pool closes the failed transport, the next payload gets a fresh one */
+            transport_release(worker->transport);
+            worker->transport = NULL;
+        }
+        unsigned long checksum = result == EB_SUCCESS ? payload_checksum(item.data, item.size) : 0;
+        free(item.data);
+        
+        pthread_mutex_lock(&session->mutex);
+        if (result == EB_SUCCESS) {
+            session->stats.pushed++;
+            session->stats.bytes += item.size;
+            session->checksum ^= checksum;
+        } else {
+            session->stats.failed++;
+            if (session->first_error == EB_SUCCESS) {
+                session->first_error = result;
+            }
+        }
+        pthread_mutex_unlock(&session->mutex);
+    }
+    
+    return NULL;
+}
+
+/* Stop the workers once the queue is drained and hand their transports back */
+static void stop_push_workers(eb_remote_push_session_t *session) {
+    pthread_mutex_lock(&session->mutex);
+    session->closing = true;
+    pthread_cond_broadcast(&session->not_empty);
+    pthread_mutex_unlock(&session->mutex);
+    
+    for (size_t i = 0; i < session->worker_count; i++) {
+        pthread_join(session->workers[i].thread, NULL);
+        transport_release(session->workers[i].transport);
+    }
+    session->worker_count = 0;
+}
+
+static void free_push_session(eb_remote_push_session_t *session) {
+    /* Workers drain the queue before they exit, only a failed start leaves items */
+    while (session->count > 0) {
+        free(session->queue[session->head].data);
+        session->head = (session->head + 1) % session->capacity;
+        session->count--;
+    }
+    
+    pthread_cond_destroy(&session->not_full);
+    pthread_cond_destroy(&session->not_empty);
+    pthread_mutex_destroy(&session->mutex);
+    free(session->workers);
+    free(session->queue);
+    free(session);
+}
+
+eb_status_t eb_remote_push_begin(
+    const char *remote_name,
+    const char *path,
+    size_t jobs,
+    eb_remote_push_session_t **session_out) {
+    
+    if (!remote_name || !path || !session_out || jobs == 0) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    *session_out = NULL;
+    
+    eb_remote_push_session_t *session = calloc(1, sizeof(*session));
+    if (!session) {
+        return EB_ERROR_MEMORY;
+    }
+    strncpy(session->path, path, sizeof(session->path) - 1);
+    session->capacity = jobs * PUSH_QUEUE_PER_JOB;
+    session->queue = calloc(session->capacity, sizeof(push_item_t));
+    session->workers = calloc(jobs, sizeof(push_worker_t));
+    pthread_mutex_init(&session->mutex, NULL);
+    pthread_cond_init(&session->not_empty, NULL);
+    pthread_cond_init(&session->not_full, NULL);
+    if (!session->queue || !session->workers) {
+        free_push_session(session);
+        return EB_ERROR_MEMORY;
+    }
+    
+    eb_status_t status = lookup_remote_config(remote_name, &session->config);
+    if (status != EB_SUCCESS) {
+        free_push_session(session);
+        return status;
+    }
+    
+    status = begin_transaction(&session->txn, "PUSH", remote_name, path);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("eb_remote_push_begin: Failed to begin transaction: %d", status);
+        free_push_session(session);
+        return status;
+    }
+    
+    /* Connect every worker up front so a bad remote fails before any data moves */
+    for (size_t i = 0; i < jobs; i++) {
+        push_worker_t *worker = &session->workers[i];
+        worker->session = session;
+        status = open_push_transport(&session->config, path, &worker->transport);
+        if (status != EB_SUCCESS) {
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, push_worker_main, worker) != 0) {
+            DEBUG_ERROR("eb_remote_push_begin: Failed to start push worker %zu", i);
+            transport_release(worker->transport);
+            status = EB_ERROR_RESOURCE_EXHAUSTED;
+            break;
+        }
+        session->worker_count++;
+    }
+    if (status != EB_SUCCESS) {
+        stop_push_workers(session);
+        abort_transaction(&session->txn);
+        free_push_session(session);
+        return status;
+    }
+    
+    DEBUG_INFO("eb_remote_push_begin: %zu workers connected to '%s/%s'",
+             session->worker_count, session->config.url, path);
+    *session_out = session;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_remote_push_add(
+    eb_remote_push_session_t *session,
+    void *data,
+    size_t size,
+    const char *hash) {
+    
+    if (!session || !data) {
+        free(data);
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    pthread_mutex_lock(&session->mutex);
+    while (session->count == session->capacity) {
+        pthread_cond_wait(&session->not_full, &session->mutex);
+    }
+    push_item_t *item = &session->queue[(session->head + session->count) % session->capacity];
+    item->data = data;
+    item->size = size;
+    item->hash[0] = '\0';
+    if (hash) {
+        strncpy(item->hash, hash, sizeof(item->hash) - 1);
+        item->hash[sizeof(item->hash) - 1] = '\0';
+    }
+    session->count++;
+    pthread_cond_signal(&session->not_empty);
+    pthread_mutex_unlock(&session->mutex);
+    
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_remote_push_finish(
+    eb_remote_push_session_t *session,
+    eb_remote_push_stats_t *stats) {
+    
+    if (!session) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    stop_push_workers(session);
+    if (stats) {
+        *stats = session->stats;
+    }
+    remote_transaction_t txn = session->txn;
+    
+    /* A partial push leaves the ref untouched so it can simply be repeated */
+    eb_status_t status = session->first_error;
+    if (status != EB_SUCCESS || session->stats.pushed == 0) {
+        free_push_session(session);
+        abort_transaction(&txn);
+        return status;
+    }
+    
+    char temp_path[TRANSACTION_PATH_MAX];
+    transaction_file(&txn, "TEMP", temp_path, sizeof(temp_path));
+    FILE *temp_ref = fopen(temp_path, "w");
+    if (!temp_ref) {
+        DEBUG_ERROR("Failed to create temp ref file: %s", strerror(errno));
+        free_push_session(session);
+        abort_transaction(&txn);
+        return EB_ERROR_IO;
+    }
+    time_t now = time(NULL);
+    fprintf(temp_ref, "OPERATION push\n");
+    fprintf(temp_ref, "REMOTE %s\n", session->config.name);
+    fprintf(temp_ref, "PATH %s\n", session->path);
+    fprintf(temp_ref, "OBJECTS %zu\n", session->stats.pushed);
+    fprintf(temp_ref, "SIZE %zu\n", session->stats.bytes);
+    fprintf(temp_ref, "TIMESTAMP %ld\n", (long)now);
+    fprintf(temp_ref, "CHECKSUM %lx\n", session->checksum);
+    fflush(temp_ref);
+    fclose(temp_ref);
+    free_push_session(session);
+    
+    /* Commit the transaction */
+    status = commit_transaction(&txn);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to commit transaction: %d", status);
+        abort_transaction(&txn);
+        return status;
+    }
+    
+    return EB_SUCCESS;
+}
+
+/* Growable download buffer for streamed receives */
+struct receive_buffer {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static int receive_buffer_sink(void *ctx, const void *data, size_t size) {
+    struct receive_buffer *buffer = ctx;
+    
+    if (size > buffer->capacity - buffer->size) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4 * 1024 * 1024;
+        while (size > capacity - buffer->size) {
+            capacity *= 2;
+        }
+        unsigned char *grown = realloc(buffer->data, capacity);
+        if (!grown) {
+            return EB_ERROR_MEMORY;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return EB_SUCCESS;
+}
+
+/**
+ * Download the object at the transport's target path into a malloc'd buffer
+ *
+ * Streams when the transport can, so the buffer grows with the object
+ * instead of being guessed up front.
+ *
+ * @param transport Connected transport
+ * @param buffer_out Pointer to store the data (caller must free)
+ * @param size_out Pointer to store the size of the data
+ * @return Status code
+ */
+static eb_status_t receive_object(eb_transport_t *transport, unsigned char **buffer_out, size_t *size_out) {
+    if (transport->ops && transport->ops->receive_stream) {
+        struct receive_buffer sink = { NULL, 0, 0 };
+        int status = transport_receive_stream(transport, NULL, receive_buffer_sink, &sink, NULL);
+        if (status != EB_SUCCESS) {
+            free(sink.data);
+            return status;
+        }
+        if (!sink.data && !(sink.data = malloc(1))) {
+            return EB_ERROR_MEMORY;
+        }
+        *buffer_out = sink.data;
+        *size_out = sink.size;
+        return EB_SUCCESS;
+    }
+    
+    /* Otherwise read into a buffer that doubles while reads fill it */
+    size_t buffer_capacity = 4 * 1024 * 1024; /* 4MB initial buffer */
+    unsigned char *buffer = malloc(buffer_capacity);
+    if (!buffer) {
+        DEBUG_ERROR("Failed to allocate initial download buffer");
+        return EB_ERROR_MEMORY;
+    }
+    
+    size_t bytes_received = 0;
+    eb_status_t result = transport_receive_data(transport, buffer, buffer_capacity, &bytes_received);
+    if (result != EB_SUCCESS) {
+        free(buffer);
+        return result;
+    }
+    size_t total_received = bytes_received;
+    DEBUG_INFO("Received initial %zu bytes", total_received);
+    
+    while (bytes_received > 0 && total_received == buffer_capacity) {
+        buffer_capacity *= 2;
+        DEBUG_INFO("Expanding buffer to %zu bytes", buffer_capacity);
+        
+        unsigned char *new_buffer = realloc(buffer, buffer_capacity);
+        if (!new_buffer) {
+            DEBUG_ERROR("Failed to resize download buffer");
+            free(buffer);
+            return EB_ERROR_MEMORY;
+        }
+        buffer = new_buffer;
+        
+        result = transport_receive_data(transport, buffer + total_received,
+                                        buffer_capacity - total_received, &bytes_received);
+        if (result != EB_SUCCESS) {
+            free(buffer);
+            return result;
+        }
+        total_received += bytes_received;
+        DEBUG_INFO("Received additional %zu bytes, total now %zu bytes", 
+                 bytes_received, total_received);
+    }
+    
+    *buffer_out = buffer;
+    *size_out = total_received;
+    return EB_SUCCESS;
+}
+
+/* Pull data from a remote with optional delta update */
+eb_status_t eb_remote_pull_delta(
+    const char *remote_name,
+    const char *path,
+    void **data_out,
+    size_t *size_out,
+    bool delta_only) {
+    
+    if (!remote_name || !data_out || !size_out) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    *data_out = NULL;
+    *size_out = 0;
+    
+    /* Find the remote configuration */
+    pthread_rwlock_rdlock(&remote_lock);
+    
+    int remote_index = -1;
+    for (int i = 0; i < remote_count; i++) {
+        if (strcmp(remotes[i].name, remote_name) == 0) {
+            remote_index = i;
+            break;
+        }
+    }
+    
+    if (remote_index == -1) {
+        pthread_rwlock_unlock(&remote_lock);
+        DEBUG_ERROR("Remote '%s' not found", remote_name);
+        return EB_ERROR_NOT_FOUND;
+    }
+    
+    /* Make a copy of the remote configuration to avoid holding the lock */
+    remote_config_t remote_config = remotes[remote_index];
+    pthread_rwlock_unlock(&remote_lock);
+    
+    /* Construct the full URL for the path */
+    char full_url[1024];
+    if (delta_only) {
+        snprintf(full_url, sizeof(full_url), "%s/%s?delta=true", remote_config.url, path);
+        DEBUG_INFO("Pulling deltas from URL: %s", full_url);
+    } else {
+        snprintf(full_url, sizeof(full_url), "%s/%s", remote_config.url, path);
+        DEBUG_INFO("Pulling from URL: %s", full_url);
+    }
+    
+    DEBUG_INFO("Opening transport to URL: %s", full_url);
+    
+    /* Borrow a connected transport, reusing one from an earlier call if possible */
+    eb_transport_t *transport = transport_acquire(full_url, &remote_config.transport_options);
+    if (!transport) {
+        DEBUG_ERROR("Failed to connect to %s", full_url);
+        return EB_ERROR_TRANSPORT;
+    }
+    
+    /* Set the target path for the operation */
+    if (path) {
+        char *target_path_copy = strdup(path);
+        if (!target_path_copy) {
+            DEBUG_ERROR("Failed to allocate memory for target path");
+            transport_release(transport);
+            return EB_ERROR_MEMORY;
+        }
+        transport->target_path = target_path_copy;
+    }
+    
+    /* Download the whole object */
+    unsigned char *buffer = NULL;
+    size_t total_received = 0;
+    eb_status_t result = receive_object(transport, &buffer, &total_received);
+    if (result != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to receive data: %s", transport_get_error(transport));
+        transport_release(transport);
+        return result;
+    }
+    
+    /* Everything has been received - process the data */
+    DEBUG_INFO("Download complete, received total of %zu bytes", total_received);
+    
+    /* Decompress the data if needed */
+    if (total_received > 2 && buffer[0] == 0x28 && buffer[1] == 0xB5) {
+        DEBUG_INFO("Detected ZSTD compressed data");
+        void *decompressed_data = NULL;
+        size_t decompressed_size = 0;
+        
+        result = eb_decompress_zstd(buffer, total_received, 
+                                 &decompressed_data, &decompressed_size);
+        
+        /* Free the original compressed buffer */
+        free(buffer);
+        
+        if (result != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to decompress data: %d", result);
+            transport_release(transport);
+            return result;
+        }
+        
+        /* Return the decompressed data */
+        *data_out = decompressed_data;
+        *size_out = decompressed_size;
+        
+        DEBUG_INFO("Successfully pulled and decompressed %zu bytes (original: %zu bytes) from %s", 
+                 decompressed_size, total_received, full_url);
+    } else {
+        /* Data wasn't compressed, return as-is */
+        *data_out = buffer;
+        *size_out = total_received;
+        
+        DEBUG_INFO("Successfully pulled %zu bytes from %s", 
+                 total_received, full_url);
+    }
+    
+    /* Disconnect and cleanup */
+    transport_release(transport);
+    
+    return EB_SUCCESS;
+}
+
+/* Pull data from a remote (backward compatibility wrapper) */
+eb_status_t eb_remote_pull(
+    const char *remote_name,
+    const char *path,
+    void **data_out,
+    size_t *size_out) {
+    
+    return eb_remote_pull_delta(remote_name, path, data_out, size_out, false);
+}
+
+/* Stream data, or a byte range of it, from a remote */
+eb_status_t eb_remote_pull_stream(
+    const char *remote_name,
+    const char *path,
+    const eb_transport_range_t *range,
+    eb_transport_sink_fn sink,
+    void *ctx,
+    size_t *received) {
+    
+    if (!remote_name || !path || !sink) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    if (received) {
+        *received = 0;
+    }
+    
+    remote_config_t remote_config;
+    eb_status_t status = lookup_remote_config(remote_name, &remote_config);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    
+    char full_url[1024];
+    snprintf(full_url, sizeof(full_url), "%s/%s", remote_config.url, path);
+    DEBUG_INFO("Streaming from URL: %s", full_url);
+    
+    eb_transport_t *transport = transport_acquire(full_url, &remote_config.transport_options);
+    if (!transport) {
+        DEBUG_ERROR("Failed to connect to %s", full_url);
+        return EB_ERROR_TRANSPORT;
+    }
+    
+    transport->target_path = strdup(path);
+    if (!transport->target_path) {
+        transport_release(transport);
+        return EB_ERROR_MEMORY;
+    }
+    
+    status = transport_receive_stream(transport, range, sink, ctx, received);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to stream %s: %s", full_url, transport_get_error(transport));
+    }
+    
+    transport_release(transport);
+    return status;
+}
+
+/*
+ * Pack transfer
+ *
+ * A set pushed as packs keeps them under <path>/packs, as pack-<name>.pack
+ * and pack-<name>.idx images built by eb_pack_build, next to a MANIFEST:
+ *
+ *   # embr pack manifest 1
+ *   pack <name> <objects> <bytes> [chunked]
+ *   log <set log line>
+ *
+ * A chunked pack has pack-<name>.pack.chunks in place of the .pack (see
+ * "Chunked objects" below). Every push rewrites the manifest, so the last
+ * writer wins.
+ */
+#define PACK_MANIFEST_HEADER "# embr pack manifest 1"
+#define PACK_MANIFEST_NAME "MANIFEST"
+
+typedef struct {
+    char name[65];                /* Pack name */
+    size_t objects;               /* Objects in the pack */
+    uint64_t bytes;               /* Size of the .pack */
+    bool chunked;                 /* Stored as chunks */
+} pack_manifest_entry_t;
+
+typedef struct {
+    pack_manifest_entry_t *packs;
+    size_t pack_count;
+    size_t pack_capacity;
+    char *log;                    /* Set log, one entry per line */
+} pack_manifest_t;
+
+static void pack_manifest_free(pack_manifest_t *manifest) {
+    free(manifest->packs);
+    free(manifest->log);
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+static eb_status_t pack_manifest_add(pack_manifest_t *manifest, const pack_manifest_entry_t *entry) {
+    if (manifest->pack_count == manifest->pack_capacity) {
+        size_t capacity = manifest->pack_capacity ? manifest->pack_capacity * 2 : 8;
+        pack_manifest_entry_t *grown = realloc(manifest->packs, capacity * sizeof(*grown));
+        if (!grown) {
+            return EB_ERROR_MEMORY;
+        }
+        manifest->packs = grown;
+        manifest->pack_capacity = capacity;
+    }
+    manifest->packs[manifest->pack_count++] = *entry;
+    return EB_SUCCESS;
+}
+
+/* Parse a manifest, lines that are not understood are skipped */
+static eb_status_t pack_manifest_parse(const char *text, size_t size, pack_manifest_t *manifest) {
+    memset(manifest, 0, sizeof(*manifest));
+    manifest->log = malloc(size + 1);
+    if (!manifest->log) {
+        return EB_ERROR_MEMORY;
+    }
+    size_t log_size = 0;
+    
+    const char *end = text + size;
+    for (const char *line = text; line < end; ) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        size_t len = eol ? (size_t)(eol - line) : (size_t)(end - line);
+        
+        if (len > 4 && strncmp(line, "log ", 4) == 0) {
+            memcpy(manifest->log + log_size, line + 4, len - 4);
+            log_size += len - 4;
+            manifest->log[log_size++] = '\n';
+        } else if (len > 5 && strncmp(line, "pack ", 5) == 0 && len < 256) {
+            char buf[256];
+            memcpy(buf, line, len);
+            buf[len] = '\0';
+            pack_manifest_entry_t entry = {0};
+            unsigned long long bytes = 0;
+            char flag[16] = "";
+            if (sscanf(buf, "pack %64s %zu %llu %15s", entry.name, &entry.objects, &bytes, flag) >= 3 &&
+                strlen(entry.name) == 64) {
+                entry.bytes = bytes;
+                entry.chunked = strcmp(flag, "chunked") == 0;
+                if (pack_manifest_add(manifest, &entry) != EB_SUCCESS) {
+                    pack_manifest_free(manifest);
+                    return EB_ERROR_MEMORY;
+                }
+            }
+        }
+        line += len + 1;
+    }
+    manifest->log[log_size] = '\0';
+    return EB_SUCCESS;
+}
+
+/* Download <key> (or a range of it) through a connected transport */
+static eb_status_t pack_fetch(eb_transport_t *transport, const char *key, const eb_transport_range_t *range,
+                              unsigned char **data_out, size_t *size_out) {
+    free((void *)transport->target_path);
+    transport->target_path = strdup(key);
+    if (!transport->target_path) {
+        return EB_ERROR_MEMORY;
+    }
+    
+    struct receive_buffer sink = { NULL, 0, 0 };
+    eb_status_t status = transport_receive_stream(transport, range, receive_buffer_sink, &sink, NULL);
+    if (status != EB_SUCCESS) {
+        free(sink.data);
+        return status;
+    }
+    if (!sink.data && !(sink.data = malloc(1))) {
+        return EB_ERROR_MEMORY;
+    }
+    *data_out = sink.data;
+    *size_out = sink.size;
+    return EB_SUCCESS;
+}
+
+/*
+ * Have manifest
+ *
+ * <path>/HAVE on a remote lists the objects stored there, one hash per
+ * line in sorted order after a "# embr have 1" header. Push and pull read
+ * it instead of listing the bucket, and push rewrites it once its objects
+ * are up.
+ */
+#define HAVE_MANIFEST_HEADER "# embr have 1"
+#define HAVE_MANIFEST_NAME "HAVE"
+
+/* Key prefix for <path> on a remote: the URL path without scheme, host and query */
+static void remote_key_base(const char *url, const char *path, char *base, size_t base_size) {
+    if (strncmp(url, "file://", 7) == 0 || (!strstr(url, "://") && !strchr(url, ':'))) {
+        /* Local directory remotes keep their path as given, relative or not */
+        url += strncmp(url, "file://", 7) == 0 ? 7 : 0;
+        size_t len = strcspn(url, "?");
+        while (len > 1 && url[len - 1] == '/') {
+            len--;
+        }
+        snprintf(base, base_size, "%.*s/%s", (int)len, url, path);
+        return;
+    }
+    const char *p = strstr(url, "://");
+    /* scp-style host:path remotes have their path after the ':' */
+    p = p ? strchr(p + 3, '/') : strchr(url, ':');
+    size_t len = p ? strcspn(p + 1, "?") : 0;
+    while (len > 0 && p[len] == '/') {
+        len--;
+    }
+    if (len > 0) {
+        snprintf(base, base_size, "%.*s/%s", (int)len, p + 1, path);
+    } else {
+        snprintf(base, base_size, "%s", path);
+    }
+}
+
+/* Connect to <remote url>/<path>, base receives the key prefix of path */
+static eb_status_t open_path_transport(const char *remote_name, const char *path, eb_transport_t **out,
+                                       char *base, size_t base_size) {
+    remote_config_t remote_config;
+    eb_status_t status = lookup_remote_config(remote_name, &remote_config);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    
+    char full_url[1024];
+    snprintf(full_url, sizeof(full_url), "%s/%s", remote_config.url, path);
+    remote_key_base(remote_config.url, path, base, base_size);
+    *out = transport_acquire(full_url, &remote_config.transport_options);
+    if (!*out) {
+        DEBUG_ERROR("Failed to connect to %s", full_url);
+        return EB_ERROR_TRANSPORT;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_remote_key(const char *remote_name, const char *path, const char *name,
+                          char *key_out, size_t key_size) {
+    if (!remote_name || !path || !name || !key_out || key_size == 0) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    remote_config_t remote_config;
+    eb_status_t status = lookup_remote_config(remote_name, &remote_config);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    char base[1024];
+    remote_key_base(remote_config.url, path, base, sizeof(base));
+    if ((size_t)snprintf(key_out, key_size, "%s/%s", base, name) >= key_size) {
+        return EB_ERROR_BUFFER_TOO_SMALL;
+    }
+    return EB_SUCCESS;
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    return strcmp((const char *)a, (const char *)b);
+}
+
+/* Sort the hashes and drop duplicates */
+static void have_normalize(eb_remote_have_t *have) {
+    if (have->count == 0) {
+        return;
+    }
+    qsort(have->hashes, have->count, sizeof(have->hashes[0]), compare_hashes);
+    size_t kept = 1;
+    for (size_t i = 1; i < have->count; i++) {
+        if (strcmp(have->hashes[i], have->hashes[kept - 1]) != 0) {
+            memcpy(have->hashes[kept++], have->hashes[i], sizeof(have->hashes[0]));
+        }
+    }
+    have->count = kept;
+}
+
+static eb_status_t have_reserve(eb_remote_have_t *have, size_t extra) {
+    if (have->count + extra <= have->capacity) {
+        return EB_SUCCESS;
+    }
+    size_t capacity = have->capacity ? have->capacity : 256;
+    while (capacity < have->count + extra) {
+        capacity *= 2;
+    }
+    char (*grown)[65] = realloc(have->hashes, capacity * sizeof(*grown));
+    if (!grown) {
+        return EB_ERROR_MEMORY;
+    }
+    have->hashes = grown;
+    have->capacity = capacity;
+    return EB_SUCCESS;
+}
+
+void eb_remote_have_free(eb_remote_have_t *have) {
+    if (!have) {
+        return;
+    }
+    free(have->hashes);
+    memset(have, 0, sizeof(*have));
+}
+
+bool eb_remote_have_contains(const eb_remote_have_t *have, const char *hash) {
+    if (!have || !hash || have->count == 0) {
+        return false;
+    }
+    return bsearch(hash, have->hashes, have->count, sizeof(have->hashes[0]), compare_hashes) != NULL;
+}
+
+eb_status_t eb_remote_have_add(eb_remote_have_t *have, const char *const *hashes, size_t count) {
+    if (!have || (!hashes && count > 0)) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    eb_status_t status = have_reserve(have, count);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (hashes[i] && strlen(hashes[i]) == 64) {
+            memcpy(have->hashes[have->count++], hashes[i], 65);
+        }
+    }
+    have_normalize(have);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_remote_have_parse(const char *text, size_t size, eb_remote_have_t *have) {
+    if (!text || !have) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    memset(have, 0, sizeof(*have));
+    size_t header_len = strlen(HAVE_MANIFEST_HEADER);
+    if (size < header_len || strncmp(text, HAVE_MANIFEST_HEADER, header_len) != 0) {
+        return EB_ERROR_FORMAT;
+    }
+    /* Every line after the header holds one hash */
+    eb_status_t status = have_reserve(have, size / 65 + 1);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    const char *end = text + size;
+    for (const char *line = text; line < end; ) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        size_t len = eol ? (size_t)(eol - line) : (size_t)(end - line);
+        if (len == 64 && strspn(line, "0123456789abcdef") >= 64) {
+            memcpy(have->hashes[have->count], line, 64);
+            have->hashes[have->count++][64] = '\0';
+        }
+        line += len + 1;
+    }
+    have_normalize(have);
+    return EB_SUCCESS;
+}
+
+/* Fetch <base>/HAVE through a connected transport */
+static eb_status_t have_fetch(eb_transport_t *transport, const char *base, eb_remote_have_t *have) {
+    char key[1024];
+    snprintf(key, sizeof(key), "%s/%s", base, HAVE_MANIFEST_NAME);
+    
+    unsigned char *text = NULL;
+    size_t size = 0;
+    memset(have, 0, sizeof(*have));
+    eb_status_t status = pack_fetch(transport, key, NULL, &text, &size);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    status = eb_remote_have_parse((const char *)text, size, have);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("%s is not a have manifest", key);
+    }
+    free(text);
+    return status;
+}
+
+static eb_status_t have_store(eb_transport_t *transport, const char *base, const eb_remote_have_t *have) {
+    size_t header_len = strlen(HAVE_MANIFEST_HEADER);
+    char *text = malloc(header_len + 1 + have->count * 65);
+    if (!text) {
+        return EB_ERROR_MEMORY;
+    }
+    memcpy(text, HAVE_MANIFEST_HEADER, header_len);
+    size_t len = header_len;
+    text[len++] = '\n';
+    for (size_t i = 0; i < have->count; i++) {
+        memcpy(text + len, have->hashes[i], 64);
+        len += 64;
+        text[len++] = '\n';
+    }
+    
+    char key[1024];
+    snprintf(key, sizeof(key), "%s/%s", base, HAVE_MANIFEST_NAME);
+    eb_status_t status = transport_put_object(transport, key, text, len);
+    free(text);
+    return status;
+}
+
+eb_status_t eb_remote_have_fetch(const char *remote_name, const char *path, eb_remote_have_t *have) {
+    if (!remote_name || !path || !have) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    memset(have, 0, sizeof(*have));
+    
+    eb_transport_t *transport = NULL;
+    char base[1024];
+    eb_status_t status = open_path_transport(remote_name, path, &transport, base, sizeof(base));
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    status = have_fetch(transport, base, have);
+    transport_release(transport);
+    return status;
+}
+
+eb_status_t eb_remote_have_store(const char *remote_name, const char *path, const eb_remote_have_t *have) {
+    if (!remote_name || !path || !have) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    eb_transport_t *transport = NULL;
+    char base[1024];
+    eb_status_t status = open_path_transport(remote_name, path, &transport, base, sizeof(base));
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    status = have_store(transport, base, have);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to store the have manifest of %s: %s", path, transport_get_error(transport));
+    }
+    transport_release(transport);
+    return status;
+}
+
+eb_status_t eb_remote_put_object(const char *remote_name, const char *path, const char *name,
+                                 const void *data, size_t size) {
+    if (!remote_name || !path || !name || (!data && size > 0)) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    
+    eb_transport_t *transport = NULL;
+    char base[1024];
+    eb_status_t status = open_path_transport(remote_name, path, &transport, base, sizeof(base));
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    char key[1280];
+    snprintf(key, sizeof(key), "%s/%s", base, name);
+    status = transport_put_object(transport, key, data, size);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to upload %s: %s", key, transport_get_error(transport));
+    }
+    transport_release(transport);
+    return status;
+}
+
+/*
+ * Chunked objects
+ *
+ * Packs above CHUNKED_PACK_THRESHOLD are cut into content-defined chunks
+ * (see chunk.h) stored as <root>/chunks/<hash>, <root> being the path of
+ * the remote URL, so every set on a remote shares them. In place of the
+ * object, <key>.chunks lists its chunks in order; it is written once all
+ * of them are up.
+ *
+ * <root>/chunks/HAVE is a have manifest of the stored chunks. A chunk it
+ * lists is not uploaded again, whichever push stored it, and an upload
+ * cut short resumes after the chunks its operation state says were sent.
+ * The manifest is rewritten once per upload and the last writer wins; a
+ * chunk missing from it is merely uploaded twice.
+ */
+#define CHUNKED_PACK_THRESHOLD (4 * EB_CHUNK_MAX_SIZE)
+#define CHUNK_LIST_SUFFIX ".chunks"
+
+/* Key prefix of the chunk store of a remote */
+static eb_status_t remote_chunk_base(const char *remote_name, char *base, size_t base_size) {
+    remote_config_t remote_config;
+    eb_status_t status = lookup_remote_config(remote_name, &remote_config);
+    if (status == EB_SUCCESS) {
+        remote_key_base(remote_config.url, "chunks", base, base_size);
+    }
+    return status;
+}
+
+/* Upload data as the chunks of <key>, sent_out receives the bytes actually sent */
+static eb_status_t chunked_put(eb_transport_t *transport, const char *remote_name, const char *chunk_base,
+                               const char *key, const void *data, size_t size, size_t *sent_out) {
+    eb_chunk_t *chunks = NULL;
+    size_t count = 0;
+    char digest[65];
+    eb_remote_have_t have = {0};
+    eb_hash_set_t *seen = NULL;
+    const char **added = NULL;
+    size_t added_count = 0;
+    size_t sent = 0;
+    size_t reused = 0;
+    
+    eb_status_t status = eb_chunk_split(data, size, &chunks, &count);
+    if (status == EB_SUCCESS) {
+        status = eb_chunk_digest(chunks, count, digest);
+    }
+    if (status == EB_SUCCESS) {
+        status = have_fetch(transport, chunk_base, &have);
+        if (status == EB_ERROR_NOT_FOUND) {
+            status = EB_SUCCESS;
+        }
+    }
+    if (status == EB_SUCCESS) {
+        status = eb_hash_set_create(count, &seen);
+    }
+    if (status == EB_SUCCESS && !(added = malloc((count ? count : 1) * sizeof(*added)))) {
+        status = EB_ERROR_MEMORY;
+    }
+    
+    /* The same chunks as an unfinished upload of key: continue after what it sent */
+    size_t resume = 0;
+    int op_idx = -1;
+    if (status == EB_SUCCESS) {
+        resume = get_resume_position(remote_name, key, 0, digest, size);
+        op_idx = resume > 0 ? find_operation(remote_name, key, 0) : start_operation(remote_name, key, size, digest, 0);
+        if (resume > 0) {
+            DEBUG_INFO("Resuming upload of %s after %zu of %zu bytes", key, resume, size);
+        }
+    }
+    
+    for (size_t i = 0; status == EB_SUCCESS && i < count; i++) {
+        const eb_chunk_t *chunk = &chunks[i];
+        bool first = false;
+        status = eb_hash_set_add_hex(seen, chunk->hash, &first);
+        if (status != EB_SUCCESS) {
+            break;
+        }
+        if (!first || eb_remote_have_contains(&have, chunk->hash)) {
+            reused += chunk->length;
+            continue;
+        }
+        added[added_count++] = chunk->hash;
+        if (chunk->offset + chunk->length <= resume) {
+            continue;
+        }
+        
+        char chunk_key[1100];
+        snprintf(chunk_key, sizeof(chunk_key), "%s/%s", chunk_base, chunk->hash);
+        status = transport_put_object(transport, chunk_key, (const unsigned char *)data + chunk->offset,
+                                      chunk->length);
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to upload chunk %s: %s", chunk->hash, transport_get_error(transport));
+            break;
+        }
+        sent += chunk->length;
+        /* Every chunk up to here is on the remote, survive a crash with that */
+        update_operation(op_idx, (size_t)(chunk->offset + chunk->length));
+        save_operation_states(OPERATION_STATE_FILE);
+    }
+    
+    if (status == EB_SUCCESS) {
+        char *list = NULL;
+        size_t list_size = 0;
+        status = eb_chunk_list_format(chunks, count, &list, &list_size);
+        if (status == EB_SUCCESS) {
+            char list_key[1100];
+            snprintf(list_key, sizeof(list_key), "%s%s", key, CHUNK_LIST_SUFFIX);
+            status = transport_put_object(transport, list_key, list, list_size);
+            sent += list_size;
+        }
+        free(list);
+    }
+    if (status == EB_SUCCESS) {
+        complete_operation(op_idx);
+        if (added_count > 0) {
+            eb_status_t have_status = eb_remote_have_add(&have, added, added_count);
+            if (have_status == EB_SUCCESS) {
+                have_status = have_store(transport, chunk_base, &have);
+            }
+            if (have_status != EB_SUCCESS) {
+                DEBUG_WARN("Failed to update the chunk manifest, its chunks will be uploaded again");
+            }
+        }
+        DEBUG_INFO("Uploaded %s as %zu chunks: %zu bytes sent, %zu already on the remote",
+                   key, count, sent, reused);
+    }
+    
+    if (sent_out) {
+        *sent_out = sent;
+    }
+    free(added);
+    eb_hash_set_destroy(seen);
+    eb_remote_have_free(&have);
+    free(chunks);
+    return status;
+}
+
+/* Chunk list of a chunked object */
+static eb_status_t chunk_list_fetch(eb_transport_t *transport, const char *key,
+                                    eb_chunk_t **chunks_out, size_t *count_out) {
+    char list_key[1100];
+    snprintf(list_key, sizeof(list_key), "%s%s", key, CHUNK_LIST_SUFFIX);
+    
+    unsigned char *text = NULL;
+    size_t size = 0;
+    eb_status_t status = pack_fetch(transport, list_key, NULL, &text, &size);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    status = eb_chunk_list_parse((const char *)text, size, chunks_out, count_out);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("%s is not a chunk list", list_key);
+    }
+    free(text);
+    return status;
+}
+
+/* Where the bytes of a pack come from: the object itself or its chunks */
+typedef struct {
+    const char *key;              /* Object key */
+    const char *chunk_base;       /* Chunk store, NULL for a plain object */
+    eb_chunk_t *chunks;           /* Chunk list of a chunked object */
+    size_t chunk_count;
+} pack_source_t;
+
+/* Download a pack (or a range of it) from its source */
+static eb_status_t pack_source_fetch(eb_transport_t *transport, const pack_source_t *source,
+                                     const eb_transport_range_t *range,
+                                     unsigned char **data_out, size_t *size_out) {
+    if (!source->chunk_base) {
+        return pack_fetch(transport, source->key, range, data_out, size_out);
+    }
+    
+    const eb_chunk_t *last = source->chunk_count > 0 ? &source->chunks[source->chunk_count - 1] : NULL;
+    uint64_t total = last ? last->offset + last->length : 0;
+    uint64_t start = 0;
+    uint64_t end = total;
+    if (range && range->from_end) {
+        start = range->length > 0 && range->length < total ? total - range->length : 0;
+    } else if (range) {
+        if (range->offset > total) {
+            return EB_ERROR_INVALID_PARAMETER;
+        }
+        start = range->offset;
+        if (range->length > 0 && range->length < total - start) {
+            end = start + range->length;
+        }
+    }
+    
+    unsigned char *data = malloc(end > start ? (size_t)(end - start) : 1);
+    if (!data) {
+        return EB_ERROR_MEMORY;
+    }
+    eb_status_t status = EB_SUCCESS;
+    for (size_t i = 0; status == EB_SUCCESS && i < source->chunk_count; i++) {
+        const eb_chunk_t *chunk = &source->chunks[i];
+        uint64_t chunk_end = chunk->offset + chunk->length;
+        if (chunk_end <= start || chunk->offset >= end) {
+            continue;
+        }
+        uint64_t from = start > chunk->offset ? start : chunk->offset;
+        uint64_t to = end < chunk_end ? end : chunk_end;
+        bool whole = from == chunk->offset && to == chunk_end;
+        eb_transport_range_t part = { from - chunk->offset, to - from, false };
+        
+        char chunk_key[1100];
+        snprintf(chunk_key, sizeof(chunk_key), "%s/%s", source->chunk_base, chunk->hash);
+        unsigned char *bytes = NULL;
+        size_t size = 0;
+        status = pack_fetch(transport, chunk_key, whole ? NULL : &part, &bytes, &size);
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to fetch chunk %s: %s", chunk->hash, transport_get_error(transport));
+            break;
+        }
+        /* Whole chunks are checked against their name */
+        char hash[65];
+        if (size != to - from ||
+            (whole && (eb_chunk_hash(bytes, size, hash) != EB_SUCCESS || strcmp(hash, chunk->hash) != 0))) {
+            DEBUG_ERROR("Chunk %s of %s is corrupt", chunk->hash, source->key);
+            status = EB_ERROR_FORMAT;
+        } else {
+            memcpy(data + (from - start), bytes, size);
+        }
+        free(bytes);
     }
     
-    /* Commit the transaction */
-    status = commit_transaction();
     if (status != EB_SUCCESS) {
-        DEBUG_ERROR("Failed to commit transaction: %d", status);
-        abort_transaction();
+        free(data);
         return status;
     }
-    
+    *data_out = data;
+    *size_out = (size_t)(end - start);
     return EB_SUCCESS;
 }
 
-/* Pull data from a remote with optional delta update */
-eb_status_t eb_remote_pull_delta(
+/* Fetch the manifest of a set, EB_ERROR_NOT_FOUND (and an empty manifest) if it has none */
+static eb_status_t pack_manifest_fetch(eb_transport_t *transport, const char *base, pack_manifest_t *manifest) {
+    char key[1024];
+    snprintf(key, sizeof(key), "%s/packs/%s", base, PACK_MANIFEST_NAME);
+    
+    unsigned char *text = NULL;
+    size_t size = 0;
+    eb_status_t status = pack_fetch(transport, key, NULL, &text, &size);
+    if (status != EB_SUCCESS) {
+        memset(manifest, 0, sizeof(*manifest));
+        return status;
+    }
+    if (size < strlen(PACK_MANIFEST_HEADER) ||
+        strncmp((const char *)text, PACK_MANIFEST_HEADER, strlen(PACK_MANIFEST_HEADER)) != 0) {
+        DEBUG_ERROR("%s is not a pack manifest", key);
+        free(text);
+        memset(manifest, 0, sizeof(*manifest));
+        return EB_ERROR_FORMAT;
+    }
+    status = pack_manifest_parse((const char *)text, size, manifest);
+    free(text);
+    return status;
+}
+
+static eb_status_t pack_manifest_store(eb_transport_t *transport, const char *base, const pack_manifest_t *manifest) {
+    size_t capacity = strlen(PACK_MANIFEST_HEADER) + 2 + manifest->pack_count * 136;
+    const char *log = manifest->log ? manifest->log : "";
+    for (const char *p = log; *p; p++) {
+        capacity += *p == '\n' ? 5 : 1;
+    }
+    capacity += 6;
+    
+    char *text = malloc(capacity);
+    if (!text) {
+        return EB_ERROR_MEMORY;
+    }
+    size_t len = (size_t)snprintf(text, capacity, "%s\n", PACK_MANIFEST_HEADER);
+    for (size_t i = 0; i < manifest->pack_count; i++) {
+        len += (size_t)snprintf(text + len, capacity - len, "pack %s %zu %llu%s\n",
+                                manifest->packs[i].name, manifest->packs[i].objects,
+                                (unsigned long long)manifest->packs[i].bytes,
+                                manifest->packs[i].chunked ? " chunked" : "");
+    }
+    for (const char *line = log; *line; ) {
+        size_t line_len = strcspn(line, "\n");
+        if (line_len > 0) {
+            len += (size_t)snprintf(text + len, capacity - len, "log %.*s\n", (int)line_len, line);
+        }
+        line += line_len + (line[line_len] == '\n');
+    }
+    
+    char key[1024];
+    snprintf(key, sizeof(key), "%s/packs/%s", base, PACK_MANIFEST_NAME);
+    eb_status_t status = transport_put_object(transport, key, text, len);
+    free(text);
+    return status;
+}
+
+eb_status_t eb_remote_push_pack(
     const char *remote_name,
     const char *path,
-    void **data_out,
-    size_t *size_out,
-    bool delta_only) {
+    const eb_pack_object_t *objects,
+    size_t count,
+    const char *log,
+    eb_remote_pack_stats_t *stats) {
     
-    if (!remote_name || !data_out || !size_out) {
+    if (!remote_name || !path || (!objects && count > 0)) {
         return EB_ERROR_INVALID_PARAMETER;
     }
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
     
-    *data_out = NULL;
-    *size_out = 0;
+    eb_transport_t *transport = NULL;
+    char base[1024];
+    eb_status_t status = open_path_transport(remote_name, path, &transport, base, sizeof(base));
+    if (status != EB_SUCCESS) {
+        return status;
+    }
     
-    /* Find the remote configuration */
-    pthread_mutex_lock(&remote_mutex);
+    /* Packed objects are listed apart from the ones pushed one by one */
+    char pack_base[1100];
+    snprintf(pack_base, sizeof(pack_base), "%s/packs", base);
+    eb_remote_have_t have;
+    status = have_fetch(transport, pack_base, &have);
+    bool have_known = status == EB_SUCCESS;
+    if (status == EB_ERROR_NOT_FOUND) {
+        status = EB_SUCCESS;
+    }
+    pack_manifest_t manifest = {0};
+    if (status == EB_SUCCESS) {
+        status = pack_manifest_fetch(transport, base, &manifest);
+        if (status == EB_ERROR_NOT_FOUND) {
+            status = EB_SUCCESS;
+        }
+    }
     
-    int remote_index = -1;
-    for (int i = 0; i < remote_count; i++) {
-        if (strcmp(remotes[i].name, remote_name) == 0) {
-            remote_index = i;
+    /* Leave out what the remote already has */
+    eb_pack_object_t *missing = malloc((count ? count : 1) * sizeof(*missing));
+    size_t missing_count = 0;
+    if (status == EB_SUCCESS && !missing) {
+        status = EB_ERROR_MEMORY;
+    }
+    for (size_t i = 0; status == EB_SUCCESS && i < count; i++) {
+        if (!eb_remote_have_contains(&have, objects[i].hex_hash)) {
+            missing[missing_count++] = objects[i];
+        }
+    }
+    /* Sets packed before the have manifest existed: ask the pack indexes */
+    for (size_t i = 0; status == EB_SUCCESS && !have_known && i < manifest.pack_count && missing_count > 0; i++) {
+        char key[1024];
+        snprintf(key, sizeof(key), "%s/packs/pack-%s.idx", base, manifest.packs[i].name);
+        unsigned char *idx = NULL;
+        size_t idx_size = 0;
+        status = pack_fetch(transport, key, NULL, &idx, &idx_size);
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to fetch %s: %s", key, transport_get_error(transport));
             break;
         }
+        size_t kept = 0;
+        for (size_t j = 0; j < missing_count; j++) {
+            uint64_t offset, length;
+            if (eb_pack_idx_lookup(idx, idx_size, missing[j].hex_hash, &offset, &length) != EB_SUCCESS) {
+                missing[kept++] = missing[j];
+            }
+        }
+        missing_count = kept;
+        free(idx);
+    }
+    
+    if (status == EB_SUCCESS && missing_count > 0) {
+        void *pack = NULL, *idx = NULL;
+        size_t pack_size = 0, idx_size = 0;
+        pack_manifest_entry_t entry = {0};
+        size_t sent = 0;
+        status = eb_pack_build(missing, missing_count, &pack, &pack_size, &idx, &idx_size, entry.name);
+        if (status == EB_SUCCESS) {
+            char key[1024];
+            /* The index goes last, a pack is only used once its index exists */
+            snprintf(key, sizeof(key), "%s/packs/pack-%s.pack", base, entry.name);
+            if (pack_size > CHUNKED_PACK_THRESHOLD) {
+                char chunk_base[1024];
+                entry.chunked = true;
+                status = remote_chunk_base(remote_name, chunk_base, sizeof(chunk_base));
+                if (status == EB_SUCCESS) {
+                    status = chunked_put(transport, remote_name, chunk_base, key, pack, pack_size, &sent);
+                }
+            } else {
+                status = transport_put_object(transport, key, pack, pack_size);
+                sent = pack_size;
+            }
+            if (status == EB_SUCCESS) {
+                snprintf(key, sizeof(key), "%s/packs/pack-%s.idx", base, entry.name);
+                status = transport_put_object(transport, key, idx, idx_size);
+            }
+            if (status != EB_SUCCESS) {
+                DEBUG_ERROR("Failed to upload pack %s: %s", entry.name, transport_get_error(transport));
+            }
+        }
+        if (status == EB_SUCCESS) {
+            entry.objects = eb_pack_idx_count(idx, idx_size);
+            entry.bytes = pack_size;
+            status = pack_manifest_add(&manifest, &entry);
+        }
+        if (status == EB_SUCCESS && stats) {
+            stats->packs = 1;
+            stats->objects = entry.objects;
+            stats->bytes = sent + idx_size;
+        }
+        free(pack);
+        free(idx);
     }
     
-    if (remote_index == -1) {
-        pthread_mutex_unlock(&remote_mutex);
-        DEBUG_ERROR("Remote '%s' not found", remote_name);
-        return EB_ERROR_NOT_FOUND;
+    /* A first manifest lists what the old pack indexes had as well */
+    const eb_pack_object_t *listed = have_known ? missing : objects;
+    size_t listed_count = have_known ? missing_count : count;
+    const char **added = malloc((listed_count ? listed_count : 1) * sizeof(*added));
+    if (status == EB_SUCCESS && !added) {
+        status = EB_ERROR_MEMORY;
     }
-    
-    /* Make a copy of the remote configuration to avoid holding the lock */
-    remote_config_t remote_config = remotes[remote_index];
-    pthread_mutex_unlock(&remote_mutex);
-    
-    /* Construct the full URL for the path */
-    char full_url[1024];
-    if (delta_only) {
-        snprintf(full_url, sizeof(full_url), "%s/%s?delta=true", remote_config.url, path);
-        DEBUG_INFO("Pulling deltas from URL: %s", full_url);
-    } else {
-        snprintf(full_url, sizeof(full_url), "%s/%s", remote_config.url, path);
-        DEBUG_INFO("Pulling from URL: %s", full_url);
+    for (size_t i = 0; status == EB_SUCCESS && i < listed_count; i++) {
+        added[i] = listed[i].hex_hash;
     }
-    
-    DEBUG_INFO("Opening transport to URL: %s", full_url);
-    
-    /* Open the transport */
-    eb_transport_t *transport = transport_open(full_url);
-    if (!transport) {
-        DEBUG_ERROR("Failed to open transport for %s", full_url);
-        return EB_ERROR_TRANSPORT;
+    if (status == EB_SUCCESS && (missing_count > 0 || !have_known)) {
+        status = eb_remote_have_add(&have, added, listed_count);
+        if (status == EB_SUCCESS) {
+            status = have_store(transport, pack_base, &have);
+        }
     }
+    free(added);
+    free(missing);
     
-    /* Connect to the remote */
-    int connect_status = transport_connect(transport);
-    if (connect_status != EB_SUCCESS) {
-        DEBUG_ERROR("Failed to connect to %s: %s", 
-                  full_url, transport_get_error(transport));
-        transport_close(transport);
-        return connect_status;
+    /* Nothing new and the same log: leave the manifest alone */
+    if (status == EB_SUCCESS && missing_count == 0 && have_known && log && manifest.log &&
+        strcmp(log, manifest.log) == 0) {
+        eb_remote_have_free(&have);
+        pack_manifest_free(&manifest);
+        transport_release(transport);
+        return EB_SUCCESS;
     }
+    eb_remote_have_free(&have);
     
-    /* Set the target path for the operation */
-    if (path) {
-        char *target_path_copy = strdup(path);
-        if (!target_path_copy) {
-            DEBUG_ERROR("Failed to allocate memory for target path");
-            transport_disconnect(transport);
-            transport_close(transport);
-            return EB_ERROR_MEMORY;
+    if (status == EB_SUCCESS && log) {
+        char *copy = strdup(log);
+        if (!copy) {
+            status = EB_ERROR_MEMORY;
+        } else {
+            free(manifest.log);
+            manifest.log = copy;
         }
-        transport->target_path = target_path_copy;
     }
-    
-    /* We'll implement a more efficient version of the pull operation */
-    eb_status_t result = EB_SUCCESS;
-    
-    /* Single buffer for all data */
-    const size_t buffer_size = 4 * 1024 * 1024; /* 4MB initial buffer */
-    unsigned char *buffer = malloc(buffer_size);
-        if (!buffer) {
-        DEBUG_ERROR("Failed to allocate initial download buffer");
-            transport_disconnect(transport);
-            transport_close(transport);
-        return EB_ERROR_MEMORY;
+    if (status == EB_SUCCESS) {
+        status = pack_manifest_store(transport, base, &manifest);
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to store the pack manifest of %s: %s", path, transport_get_error(transport));
+        }
     }
     
-            size_t total_received = 0;
-    size_t buffer_capacity = buffer_size;
+    pack_manifest_free(&manifest);
+    transport_release(transport);
+    return status;
+}
+
+/* Whether the local repository already has an object, loose or packed */
+static bool pack_object_present(const char *root, const eb_pack_set_t *local, const char *hex_hash) {
+    if (local && eb_pack_contains(local, hex_hash)) {
+        return true;
+    }
+    char path[2048];
+    return eb_object_path(root, hex_hash, "raw", path, sizeof(path)) == 0 && access(path, F_OK) == 0;
+}
+
+static int compare_entry_offsets(const void *a, const void *b) {
+    const eb_pack_idx_entry_t *x = *(const eb_pack_idx_entry_t *const *)a;
+    const eb_pack_idx_entry_t *y = *(const eb_pack_idx_entry_t *const *)b;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/*
+ * Fetch the wanted records of a pack by range and install them as a pack of
+ * their own. Records that follow each other in the pack share one request.
+ */
+static eb_status_t pull_pack_ranges(eb_transport_t *transport, const pack_source_t *source, const char *root,
+                                    const eb_pack_idx_entry_t **wanted, size_t count, size_t *bytes) {
+    qsort(wanted, count, sizeof(*wanted), compare_entry_offsets);
+    
+    eb_pack_object_t *objects = calloc(count, sizeof(*objects));
+    char (*hashes)[65] = calloc(count, sizeof(*hashes));
+    unsigned char **runs = calloc(count, sizeof(*runs));
+    size_t run_count = 0;
+    eb_status_t status = objects && hashes && runs ? EB_SUCCESS : EB_ERROR_MEMORY;
+    
+    for (size_t i = 0; status == EB_SUCCESS && i < count; ) {
+        size_t j = i + 1;
+        uint64_t end = wanted[i]->offset + wanted[i]->length;
+        while (j < count && wanted[j]->offset == end) {
+            end += wanted[j++]->length;
+        }
+        
+        eb_transport_range_t range = { wanted[i]->offset, end - wanted[i]->offset, false };
+        size_t size = 0;
+        status = pack_source_fetch(transport, source, &range, &runs[run_count], &size);
+        if (status != EB_SUCCESS) {
+            break;
+        }
+        if (size != range.length) {
+            free(runs[run_count]);
+            status = EB_ERROR_FORMAT;
+            break;
+        }
+        for (size_t k = i; k < j; k++) {
+            eb_hash_to_hex(wanted[k]->hash, hashes[k]);
+            objects[k] = (eb_pack_object_t){ hashes[k], runs[run_count] + (wanted[k]->offset - range.offset),
+                                             (size_t)wanted[k]->length };
+        }
+        *bytes += size;
+        run_count++;
+        i = j;
+    }
+    
+    if (status == EB_SUCCESS) {
+        void *pack = NULL, *idx = NULL;
+        size_t pack_size = 0, idx_size = 0;
+        char name[65];
+        status = eb_pack_build(objects, count, &pack, &pack_size, &idx, &idx_size, name);
+        if (status == EB_SUCCESS) {
+            status = eb_pack_install(root, pack, pack_size, idx, idx_size, name);
+        }
+        free(pack);
+        free(idx);
+    }
     
-    /* Single download operation instead of many small ones */
-    DEBUG_INFO("Starting efficient download with initial buffer of %zu bytes", buffer_capacity);
-    size_t bytes_received = 0;
+    for (size_t i = 0; runs && i < run_count; i++) {
+        free(runs[i]);
+    }
+    free(runs);
+    free(hashes);
+    free(objects);
+    return status;
+}
+
+eb_status_t eb_remote_pull_packs(
+    const char *remote_name,
+    const char *path,
+    const char *root,
+    char **log_out,
+    eb_remote_pack_stats_t *stats) {
     
-    /* Initial read to get enough data to determine format */
-    result = transport_receive_data(transport, buffer, buffer_capacity, &bytes_received);
-                if (result != EB_SUCCESS) {
-        DEBUG_ERROR("Failed to receive data: %s", transport_get_error(transport));
-                    free(buffer);
-                    transport_disconnect(transport);
-                    transport_close(transport);
-                    return result;
-                }
-                
-    total_received = bytes_received;
-    DEBUG_INFO("Received initial %zu bytes", total_received);
+    if (!remote_name || !path || !root) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    if (log_out) {
+        *log_out = NULL;
+    }
     
-    /* Check if we need to resize the buffer and get more data */
-    if (bytes_received == buffer_capacity) {
-        /* Need a larger buffer - data didn't all fit */
-        while (bytes_received == buffer_capacity) {
-            /* Double the buffer size */
-            buffer_capacity *= 2;
-            DEBUG_INFO("Expanding buffer to %zu bytes", buffer_capacity);
-            
-            unsigned char *new_buffer = realloc(buffer, buffer_capacity);
-                if (!new_buffer) {
-                DEBUG_ERROR("Failed to resize download buffer");
-                    free(buffer);
-                    transport_disconnect(transport);
-                    transport_close(transport);
-                return EB_ERROR_MEMORY;
-                }
-                
-                buffer = new_buffer;
-            
-            /* Get more data */
-            result = transport_receive_data(
-                transport, 
-                buffer + total_received, 
-                buffer_capacity - total_received,
-                &bytes_received);
-            
-            if (result != EB_SUCCESS) {
-                DEBUG_ERROR("Failed to receive additional data: %s", transport_get_error(transport));
-                free(buffer);
-                transport_disconnect(transport);
-                transport_close(transport);
-                return result;
-            }
-            
-            if (bytes_received == 0) {
-                /* No more data available */
-                break;
-            }
-            
-            total_received += bytes_received;
-            DEBUG_INFO("Received additional %zu bytes, total now %zu bytes", 
-                     bytes_received, total_received);
-        }
+    eb_transport_t *transport = NULL;
+    char base[1024];
+    eb_status_t status = open_path_transport(remote_name, path, &transport, base, sizeof(base));
+    if (status != EB_SUCCESS) {
+        return status;
     }
     
-    /* Everything has been received - process the data */
-    DEBUG_INFO("Download complete, received total of %zu bytes", total_received);
+    pack_manifest_t manifest;
+    status = pack_manifest_fetch(transport, base, &manifest);
+    eb_pack_set_t *local = NULL;
+    if (status == EB_SUCCESS) {
+        status = eb_pack_open(root, &local);
+    }
     
-    /* Decompress the data if needed */
-    if (total_received > 2 && buffer[0] == 0x28 && buffer[1] == 0xB5) {
-        DEBUG_INFO("Detected ZSTD compressed data");
-        void *decompressed_data = NULL;
-        size_t decompressed_size = 0;
-        
-        result = eb_decompress_zstd(buffer, total_received, 
-                                 &decompressed_data, &decompressed_size);
-        
-        /* Free the original compressed buffer */
-        free(buffer);
+    for (size_t i = 0; status == EB_SUCCESS && i < manifest.pack_count; i++) {
+        const pack_manifest_entry_t *entry = &manifest.packs[i];
+        if (eb_pack_installed(root, entry->name)) {
+            continue;
+        }
         
-        if (result != EB_SUCCESS) {
-            DEBUG_ERROR("Failed to decompress data: %d", result);
-            transport_disconnect(transport);
-            transport_close(transport);
-            return result;
+        char idx_key[1024], pack_key[1024];
+        snprintf(idx_key, sizeof(idx_key), "%s/packs/pack-%s.idx", base, entry->name);
+        snprintf(pack_key, sizeof(pack_key), "%s/packs/pack-%s.pack", base, entry->name);
+        unsigned char *idx = NULL;
+        size_t idx_size = 0;
+        status = pack_fetch(transport, idx_key, NULL, &idx, &idx_size);
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to fetch %s: %s", idx_key, transport_get_error(transport));
+            break;
         }
         
-        /* Return the decompressed data */
-        *data_out = decompressed_data;
-        *size_out = decompressed_size;
+        pack_source_t source = { pack_key, NULL, NULL, 0 };
+        char chunk_base[1024];
+        if (entry->chunked) {
+            status = remote_chunk_base(remote_name, chunk_base, sizeof(chunk_base));
+            if (status == EB_SUCCESS) {
+                status = chunk_list_fetch(transport, pack_key, &source.chunks, &source.chunk_count);
+            }
+            source.chunk_base = chunk_base;
+        }
         
-        DEBUG_INFO("Successfully pulled and decompressed %zu bytes (original: %zu bytes) from %s", 
-                 decompressed_size, total_received, full_url);
-    } else {
-        /* Data wasn't compressed, return as-is */
-        *data_out = buffer;
-        *size_out = total_received;
+        size_t entry_count = 0;
+        const eb_pack_idx_entry_t *entries = eb_pack_idx_entries(idx, idx_size, &entry_count);
+        const eb_pack_idx_entry_t **wanted = calloc(entry_count ? entry_count : 1, sizeof(*wanted));
+        size_t wanted_count = 0;
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to fetch the chunk list of %s: %s", pack_key, transport_get_error(transport));
+        } else if (!entries) {
+            DEBUG_ERROR("%s is not a valid pack index", idx_key);
+            status = EB_ERROR_FORMAT;
+        } else if (!wanted) {
+            status = EB_ERROR_MEMORY;
+        }
+        for (size_t j = 0; status == EB_SUCCESS && j < entry_count; j++) {
+            char hex[65];
+            eb_hash_to_hex(entries[j].hash, hex);
+            if (!pack_object_present(root, local, hex)) {
+                wanted[wanted_count++] = &entries[j];
+            }
+        }
         
-        DEBUG_INFO("Successfully pulled %zu bytes from %s", 
-                 total_received, full_url);
+        size_t bytes = idx_size;
+        if (status == EB_SUCCESS && wanted_count * 2 >= entry_count && wanted_count > 0) {
+            /* Most of the pack is new, take it whole */
+            unsigned char *pack = NULL;
+            size_t pack_size = 0;
+            char name[65];
+            status = pack_source_fetch(transport, &source, NULL, &pack, &pack_size);
+            if (status == EB_SUCCESS) {
+                status = eb_pack_install(root, pack, pack_size, idx, idx_size, name);
+                bytes += pack_size;
+                free(pack);
+            }
+        } else if (status == EB_SUCCESS && wanted_count > 0) {
+            status = pull_pack_ranges(transport, &source, root, wanted, wanted_count, &bytes);
+            if (status == EB_SUCCESS && stats) {
+                stats->ranged++;
+            }
+        }
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to pull pack %s: %s", entry->name, transport_get_error(transport));
+        } else if (stats && wanted_count > 0) {
+            stats->packs++;
+            stats->objects += wanted_count;
+            stats->bytes += bytes;
+        }
+        free(source.chunks);
+        free(wanted);
+        free(idx);
     }
     
-    /* Disconnect and cleanup */
-    transport_disconnect(transport);
-    transport_close(transport);
-    
-    return EB_SUCCESS;
-}
-
-/* Pull data from a remote (backward compatibility wrapper) */
-eb_status_t eb_remote_pull(
-    const char *remote_name,
-    const char *path,
-    void **data_out,
-    size_t *size_out) {
+    if (status == EB_SUCCESS && log_out && manifest.log) {
+        *log_out = manifest.log;
+        manifest.log = NULL;
+    }
     
-    return eb_remote_pull_delta(remote_name, path, data_out, size_out, false);
+    eb_pack_close(local);
+    pack_manifest_free(&manifest);
+    transport_release(transport);
+    return status;
 }
 
 /* Prune old or unused data from a remote */
@@ -1471,7 +3096,7 @@ eb_status_t eb_remote_prune(
     }
     
     /* Find the remote configuration */
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     
     int remote_index = -1;
     for (int i = 0; i < remote_count; i++) {
@@ -1482,14 +3107,14 @@ eb_status_t eb_remote_prune(
     }
     
     if (remote_index == -1) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         DEBUG_ERROR("Remote '%s' not found", remote_name);
         return EB_ERROR_NOT_FOUND;
     }
     
     /* Make a copy of the remote configuration to avoid holding the lock */
     remote_config_t remote_config = remotes[remote_index];
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     /* Construct the full URL with prune command */
     char full_url[1024];
@@ -1602,7 +3227,7 @@ static int find_operation(const char *remote_name, const char *path, int operati
 
 /* Start tracking a new operation */
 static int start_operation(const char *remote_name, const char *path, 
-                         size_t total_size, const void *data, int operation_type) {
+                         size_t total_size, const char *checksum, int operation_type) {
     pthread_mutex_lock(&operation_mutex);
     
     /* Check if we have room for another operation */
@@ -1635,12 +3260,7 @@ static int start_operation(const char *remote_name, const char *path,
         op->operation_type = operation_type;
         op->completed = false;
         
-        /* Calculate checksum */
-        if (data) {
-            calculate_checksum(data, total_size, op->checksum, sizeof(op->checksum));
-        } else {
-            op->checksum[0] = '\0';
-        }
+        snprintf(op->checksum, sizeof(op->checksum), "%s", checksum ? checksum : "");
         
         pthread_mutex_unlock(&operation_mutex);
         return oldest_idx;
@@ -1656,12 +3276,7 @@ static int start_operation(const char *remote_name, const char *path,
         op->operation_type = operation_type;
         op->completed = false;
         
-        /* Calculate checksum */
-        if (data) {
-            calculate_checksum(data, total_size, op->checksum, sizeof(op->checksum));
-        } else {
-            op->checksum[0] = '\0';
-        }
+        snprintf(op->checksum, sizeof(op->checksum), "%s", checksum ? checksum : "");
         
         int index = operation_count++;
         pthread_mutex_unlock(&operation_mutex);
@@ -1707,7 +3322,7 @@ static bool verify_data_integrity(const void *data, size_t size, const char *exp
 
 /* Check if an operation can be resumed and get the resume position */
 static size_t get_resume_position(const char *remote_name, const char *path, 
-                                int operation_type, const void *data, size_t size) {
+                                int operation_type, const char *checksum, size_t size) {
     int op_idx = find_operation(remote_name, path, operation_type);
     if (op_idx == -1) {
         return 0;  /* No resumable operation found */
@@ -1728,16 +3343,10 @@ static size_t get_resume_position(const char *remote_name, const char *path,
         return 0;
     }
     
-    /* For push operations, verify data integrity */
-    if (operation_type == 0 && data) {
-        char current_checksum[128];
-        calculate_checksum(data, size, current_checksum, sizeof(current_checksum));
-        
-        if (strcmp(current_checksum, op->checksum) != 0) {
-            /* Data has changed, can't resume */
-            pthread_mutex_unlock(&operation_mutex);
-            return 0;
-        }
+    /* For push operations, the data must not have changed */
+    if (operation_type == 0 && checksum && strcmp(checksum, op->checksum) != 0) {
+        pthread_mutex_unlock(&operation_mutex);
+        return 0;
     }
     
     size_t resume_pos = op->transferred;
@@ -1836,8 +3445,20 @@ eb_status_t eb_remote_resume_push(
     const char *path,
     const char *hash) {
     
-    /* Check if we can resume */
-    size_t resume_pos = get_resume_position(remote_name, path, 0, data, size);
+    /* S3 resumes paused multipart uploads itself when the object is sent again */
+    remote_config_t s3_config;
+    if (remote_name && lookup_remote_config(remote_name, &s3_config) == EB_SUCCESS &&
+        strncmp(s3_config.url, "s3://", 5) == 0) {
+        return eb_remote_push(remote_name, data, size, path, hash);
+    }
+    
+    /* Check if we can resume, hashing the data only when there is something to resume */
+    size_t resume_pos = 0;
+    if (find_operation(remote_name, path, 0) != -1) {
+        char checksum[128];
+        calculate_checksum(data, size, checksum, sizeof(checksum));
+        resume_pos = get_resume_position(remote_name, path, 0, checksum, size);
+    }
     
     if (resume_pos == 0) {
         /* Can't resume, start a new operation */
@@ -1849,7 +3470,7 @@ eb_status_t eb_remote_resume_push(
              resume_pos, size, (float)resume_pos * 100.0f / (float)size);
     
     /* Find the remote configuration */
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     
     int remote_index = -1;
     for (int i = 0; i < remote_count; i++) {
@@ -1860,14 +3481,14 @@ eb_status_t eb_remote_resume_push(
     }
     
     if (remote_index == -1) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         DEBUG_ERROR("Remote '%s' not found", remote_name);
         return EB_ERROR_NOT_FOUND;
     }
     
     /* Make a copy of the remote configuration to avoid holding the lock */
     remote_config_t remote_config = remotes[remote_index];
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     /* Construct the full URL with resume command */
     char full_url[1024];
@@ -1989,6 +3610,7 @@ eb_status_t eb_remote_resume_push(
             
             retry_count++;
             if (retry_count < MAX_RETRIES) {
+                eb_counter_add(EB_COUNTER_REMOTE_RETRIES, 1);
                 sleep_ms(RETRY_DELAY_MS);
             }
         }
@@ -2196,7 +3818,7 @@ eb_status_t eb_remote_save_config(const char *config_dir) {
     }
     
     /* Lock the remote registry while we iterate through it */
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     
     /* Write all remotes */
     for (int i = 0; i < remote_count; i++) {
@@ -2211,10 +3833,18 @@ eb_status_t eb_remote_save_config(const char *config_dir) {
         fprintf(config, "    timeout = %d\n", remotes[i].timeout);
         fprintf(config, "    verify_ssl = %s\n", remotes[i].verify_ssl ? "true" : "false");
         fprintf(config, "    format = %s\n", remotes[i].transformer_name);
+        if (remotes[i].transport_options.threads)
+            fprintf(config, "    s3.threads = %u\n", remotes[i].transport_options.threads);
+        if (remotes[i].transport_options.max_connections)
+            fprintf(config, "    s3.max_connections = %u\n", remotes[i].transport_options.max_connections);
+        if (remotes[i].transport_options.throughput_gbps > 0)
+            fprintf(config, "    s3.throughput_gbps = %g\n", remotes[i].transport_options.throughput_gbps);
+        if (remotes[i].format_options[0] != '\0')
+            fprintf(config, "    format_options = %s\n", remotes[i].format_options);
         fprintf(config, "\n");
     }
     
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     fclose(config);
     
@@ -2229,7 +3859,7 @@ eb_status_t eb_remote_save_config(const char *config_dir) {
     
     FILE *config_local = fopen(config_local_path, "w");
     if (config_local) {
-        pthread_mutex_lock(&remote_mutex);
+        pthread_rwlock_rdlock(&remote_lock);
         
         for (int i = 0; i < remote_count; i++) {
             if (remotes[i].token[0] != '\0') {
@@ -2239,7 +3869,7 @@ eb_status_t eb_remote_save_config(const char *config_dir) {
             }
         }
         
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         
         fclose(config_local);
         
@@ -2269,9 +3899,9 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
     }
     
     /* Clear existing remotes */
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_wrlock(&remote_lock);
     remote_count = 0;
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     /* Parse the config file */
     char line[1024];
@@ -2314,7 +3944,7 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
                 }
                 
                 /* Add a new remote entry */
-                pthread_mutex_lock(&remote_mutex);
+                pthread_rwlock_wrlock(&remote_lock);
                 
                 /* Only add if we have room and it doesn't already exist */
                 if (remote_count < MAX_REMOTES) {
@@ -2334,10 +3964,13 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
                         remote->timeout = 30;  /* Default: 30 seconds */
                         remote->verify_ssl = true;
                         strncpy(remote->transformer_name, "json", sizeof(remote->transformer_name) - 1);
+                        memset(&remote->transport_options, 0, sizeof(remote->transport_options));
+                        remote->format_options[0] = '\0';
+                        memset(&remote->parquet_options, 0, sizeof(remote->parquet_options));
                     }
                 }
                 
-                pthread_mutex_unlock(&remote_mutex);
+                pthread_rwlock_unlock(&remote_lock);
             } else {
                 /* Not a remote section */
                 current_remote[0] = '\0';
@@ -2374,7 +4007,7 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
             }
             
             /* Find the remote entry */
-            pthread_mutex_lock(&remote_mutex);
+            pthread_rwlock_wrlock(&remote_lock);
             
             int remote_index = -1;
             for (int i = 0; i < remote_count; i++) {
@@ -2396,10 +4029,31 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
                     remotes[remote_index].verify_ssl = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
                 } else if (strcmp(key, "format") == 0) {
                     strncpy(remotes[remote_index].transformer_name, value, sizeof(remotes[remote_index].transformer_name) - 1);
+                } else if (strcmp(key, "s3.threads") == 0) {
+                    long threads = atol(value);
+                    remotes[remote_index].transport_options.threads =
+                        (threads > 0 && threads <= REMOTE_MAX_CLIENT_THREADS) ? (unsigned)threads : 0;
+                } else if (strcmp(key, "s3.max_connections") == 0) {
+                    long connections = atol(value);
+                    remotes[remote_index].transport_options.max_connections =
+                        (connections > 0 && connections <= REMOTE_MAX_CLIENT_CONNECTIONS) ? (unsigned)connections : 0;
+                } else if (strcmp(key, "s3.throughput_gbps") == 0) {
+                    double gbps = atof(value);
+                    remotes[remote_index].transport_options.throughput_gbps = gbps > 0 ? gbps : 0;
+                } else if (strcmp(key, "format_options") == 0) {
+                    /* A bad value is dropped rather than failing every command */
+                    if (format_parse_parquet_options(value, &remotes[remote_index].parquet_options) == EB_SUCCESS) {
+                        strncpy(remotes[remote_index].format_options, value,
+                                sizeof(remotes[remote_index].format_options) - 1);
+                    } else {
+                        DEBUG_WARN("Ignoring invalid format_options for remote '%s': %s", current_remote, value);
+                        memset(&remotes[remote_index].parquet_options, 0,
+                               sizeof(remotes[remote_index].parquet_options));
+                    }
                 }
             }
             
-            pthread_mutex_unlock(&remote_mutex);
+            pthread_rwlock_unlock(&remote_lock);
         }
     }
     
@@ -2491,7 +4145,7 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
                 
                 /* Only update tokens */
                 if (strcmp(key, "token") == 0) {
-                    pthread_mutex_lock(&remote_mutex);
+                    pthread_rwlock_wrlock(&remote_lock);
                     
                     for (int i = 0; i < remote_count; i++) {
                         if (strcmp(remotes[i].name, current_remote) == 0) {
@@ -2500,7 +4154,7 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
                         }
                     }
                     
-                    pthread_mutex_unlock(&remote_mutex);
+                    pthread_rwlock_unlock(&remote_lock);
                 }
             }
         }
@@ -2509,9 +4163,9 @@ eb_status_t eb_remote_load_config(const char *config_dir) {
     }
     
     /* Count remotes loaded */
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     int count = remote_count;
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     DEBUG_INFO("Loaded %d remotes from configuration", count);
     return EB_SUCCESS;
@@ -2524,7 +4178,7 @@ static const char* get_remote_target_format(const char* remote_name) {
     }
     
     /* Lock the remote configuration */
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     
     const char* result = NULL;
     
@@ -2546,7 +4200,7 @@ static const char* get_remote_target_format(const char* remote_name) {
     }
     
     /* Unlock the remote configuration */
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     
     return result;
 }
@@ -2559,7 +4213,7 @@ eb_status_t eb_remote_list_files(const char *remote_name, const char *set_path,
     }
     *files_out = NULL;
     *count_out = 0;
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     int remote_index = -1;
     for (int i = 0; i < remote_count; i++) {
         if (strcmp(remotes[i].name, remote_name) == 0) {
@@ -2568,32 +4222,25 @@ eb_status_t eb_remote_list_files(const char *remote_name, const char *set_path,
         }
     }
     if (remote_index == -1) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         return EB_ERROR_NOT_FOUND;
     }
     remote_config_t remote_config = remotes[remote_index];
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     char full_url[1024];
     snprintf(full_url, sizeof(full_url), "%s/%s", remote_config.url, set_path);
-    eb_transport_t *transport = transport_open(full_url);
+    eb_transport_t *transport = transport_acquire(full_url, &remote_config.transport_options);
     if (!transport) {
         return EB_ERROR_TRANSPORT;
     }
-    int connect_result = transport_connect(transport);
-    if (connect_result != EB_SUCCESS) {
-        transport_close(transport);
-        return connect_result;
-    }
     char **refs = NULL;
     size_t ref_count = 0;
     if (!transport->ops || !transport->ops->list_refs) {
-        transport_disconnect(transport);
-        transport_close(transport);
+        transport_release(transport);
         return EB_ERROR_NOT_IMPLEMENTED;
     }
     int list_result = transport->ops->list_refs(transport, &refs, &ref_count);
-    transport_disconnect(transport);
-    transport_close(transport);
+    transport_release(transport);
     if (list_result != EB_SUCCESS) {
         return list_result;
     }
@@ -2608,7 +4255,7 @@ eb_status_t eb_remote_delete_files(const char *remote_name, const char *set_path
     if (!remote_name || !set_path || !files || count == 0) {
         return EB_ERROR_INVALID_PARAMETER;
     }
-    pthread_mutex_lock(&remote_mutex);
+    pthread_rwlock_rdlock(&remote_lock);
     int remote_index = -1;
     for (int i = 0; i < remote_count; i++) {
         if (strcmp(remotes[i].name, remote_name) == 0) {
@@ -2617,29 +4264,25 @@ eb_status_t eb_remote_delete_files(const char *remote_name, const char *set_path
         }
     }
     if (remote_index == -1) {
-        pthread_mutex_unlock(&remote_mutex);
+        pthread_rwlock_unlock(&remote_lock);
         return EB_ERROR_NOT_FOUND;
     }
     remote_config_t remote_config = remotes[remote_index];
-    pthread_mutex_unlock(&remote_mutex);
+    pthread_rwlock_unlock(&remote_lock);
     char full_url[1024];
     snprintf(full_url, sizeof(full_url), "%s/%s", remote_config.url, set_path);
-    eb_transport_t *transport = transport_open(full_url);
+    eb_transport_t *transport = transport_acquire(full_url, &remote_config.transport_options);
     if (!transport) {
         return EB_ERROR_TRANSPORT;
     }
-    int connect_result = transport_connect(transport);
-    if (connect_result != EB_SUCCESS) {
-        transport_close(transport);
-        return connect_result;
-    }
     if (!transport->ops || !transport->ops->delete_refs) {
-        transport_disconnect(transport);
-        transport_close(transport);
+        transport_release(transport);
         return EB_ERROR_NOT_IMPLEMENTED;
     }
     int delete_result = transport->ops->delete_refs(transport, files, count);
-    transport_disconnect(transport);
-    transport_close(transport);
+    if (delete_result != EB_SUCCESS) {
+        DEBUG_ERROR("Failed to delete files under %s: %s", full_url, transport_get_error(transport));
+    }
+    transport_release(transport);
     return delete_result;
 }
\ No newline at end of file
@@ -14,6 +14,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "status.h"
+#include "transport.h"
+#include "pack.h"
+#include "format.h"
 
 /**
  * Initialize the remote subsystem
@@ -80,6 +83,40 @@ eb_status_t eb_remote_info(
     char *transformer, 
     size_t transformer_size);
 
+/**
+ * Get the client tuning of a remote
+ *
+ * Read from the remote's s3.threads, s3.max_connections and
+ * s3.throughput_gbps config keys; unset keys are 0.
+ *
+ * @param name Remote name
+ * @param options Pointer to store the options
+ * @return Status code (EB_ERROR_NOT_FOUND if the remote does not exist)
+ */
+eb_status_t eb_remote_transport_options(const char *name, eb_transport_options_t *options);
+
+/**
+ * Get the Parquet writer tuning of a remote
+ *
+ * Parsed from the remote's format_options config key (see format.h);
+ * unset options are 0, the writer defaults.
+ *
+ * @param name Remote name
+ * @param options Pointer to store the options
+ * @return Status code (EB_ERROR_NOT_FOUND if the remote does not exist)
+ */
+eb_status_t eb_remote_parquet_options(const char *name, eb_parquet_writer_options_t *options);
+
+/**
+ * Set the Parquet writer tuning of a remote and save the config
+ *
+ * @param name Remote name
+ * @param format_options Comma-separated key=value pairs, see format.h; NULL or "" to clear
+ * @return Status code (EB_ERROR_INVALID_PARAMETER for bad options,
+ *         EB_ERROR_NOT_FOUND if the remote does not exist)
+ */
+eb_status_t eb_remote_set_format_options(const char *name, const char *format_options);
+
 /**
  * List all remotes
  *
@@ -106,6 +143,67 @@ eb_status_t eb_remote_push(
     const char *path,
     const char *hash);
 
+/**
+ * Session pushing many payloads to one path of a remote
+ *
+ * Each of its workers keeps one connected transport for the whole session,
+ * and the remote ref is committed once when the session finishes.
+ */
+typedef struct eb_remote_push_session eb_remote_push_session_t;
+
+typedef struct {
+    size_t pushed;                /* Payloads sent */
+    size_t failed;                /* Payloads that failed after retries */
+    size_t bytes;                 /* Bytes of the payloads sent */
+} eb_remote_push_stats_t;
+
+/**
+ * Begin a push session
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote
+ * @param jobs Number of workers, each with its own connection
+ * @param session_out Pointer to store the session
+ * @return Status code (EB_ERROR_NOT_FOUND if the remote does not exist)
+ */
+eb_status_t eb_remote_push_begin(
+    const char *remote_name,
+    const char *path,
+    size_t jobs,
+    eb_remote_push_session_t **session_out);
+
+/**
+ * Queue a payload for a push session
+ *
+ * Blocks while the queue is full. The session takes ownership of data,
+ * which must come from malloc(), and frees it once it has been sent.
+ *
+ * @param session Push session
+ * @param data Data to push
+ * @param size Size of data
+ * @param hash Hash of the data (embedding)
+ * @return Status code
+ */
+eb_status_t eb_remote_push_add(
+    eb_remote_push_session_t *session,
+    void *data,
+    size_t size,
+    const char *hash);
+
+/**
+ * Wait for the queued payloads, commit and free the session
+ *
+ * The ref is only committed when every payload was sent; otherwise the
+ * transaction is aborted and the first error is returned.
+ *
+ * @param session Push session
+ * @param stats Optional counts of the session
+ * @return Status code
+ */
+eb_status_t eb_remote_push_finish(
+    eb_remote_push_session_t *session,
+    eb_remote_push_stats_t *stats);
+
 /**
  * Pull data from a remote
  *
@@ -138,6 +236,184 @@ eb_status_t eb_remote_pull_delta(
     size_t *size_out,
     bool delta_update);
 
+/**
+ * Stream data, or a byte range of it, from a remote
+ *
+ * Nothing is buffered here: sink gets the bytes as the transport receives
+ * them, e.g. transport_fd_sink to write the object straight to disk.
+ * The data is passed on as stored, without decompression.
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote
+ * @param range Bytes to download, NULL for the whole object
+ * @param sink Consumer of the data
+ * @param ctx Context passed to sink
+ * @param received Pointer to store the number of bytes streamed (can be NULL)
+ * @return Status code (the sink's status if it stopped the download)
+ */
+eb_status_t eb_remote_pull_stream(
+    const char *remote_name,
+    const char *path,
+    const eb_transport_range_t *range,
+    eb_transport_sink_fn sink,
+    void *ctx,
+    size_t *received);
+
+/*
+ * Have manifest
+ *
+ * A sorted list of the objects a remote path holds, stored next to them.
+ * Push and pull download it instead of listing the remote and work out
+ * the difference locally.
+ */
+typedef struct {
+    char (*hashes)[65];           /* Sorted, without duplicates */
+    size_t count;
+    size_t capacity;
+} eb_remote_have_t;
+
+/**
+ * Download the have manifest of a remote path
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote (e.g., "sets/<set_name>")
+ * @param have Receives the list (free with eb_remote_have_free), empty on error
+ * @return Status code (EB_ERROR_NOT_FOUND if the path has no manifest yet)
+ */
+eb_status_t eb_remote_have_fetch(const char *remote_name, const char *path, eb_remote_have_t *have);
+
+/**
+ * Upload the have manifest of a remote path, replacing the previous one
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote
+ * @param have List to store
+ * @return Status code
+ */
+eb_status_t eb_remote_have_store(const char *remote_name, const char *path, const eb_remote_have_t *have);
+
+/**
+ * Parse a have manifest
+ *
+ * @param text Manifest contents
+ * @param size Size of the contents
+ * @param have Receives the list (free with eb_remote_have_free)
+ * @return Status code (EB_ERROR_INVALID_FORMAT without the manifest header)
+ */
+eb_status_t eb_remote_have_parse(const char *text, size_t size, eb_remote_have_t *have);
+
+/**
+ * Check whether a have list holds a hash, O(log n)
+ */
+bool eb_remote_have_contains(const eb_remote_have_t *have, const char *hash);
+
+/**
+ * Merge hashes into a have list
+ *
+ * @param have List to extend
+ * @param hashes 64-character hashes, others are ignored
+ * @param count Number of hashes
+ * @return Status code
+ */
+eb_status_t eb_remote_have_add(eb_remote_have_t *have, const char *const *hashes, size_t count);
+
+/**
+ * Free the hashes of a have list
+ */
+void eb_remote_have_free(eb_remote_have_t *have);
+
+/**
+ * Key of <path>/<name> on a remote, as used for transport target paths
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote
+ * @param name Object name under path
+ * @param key_out Buffer to store the key
+ * @param key_size Size of the buffer
+ * @return Status code
+ */
+eb_status_t eb_remote_key(const char *remote_name, const char *path, const char *name,
+                          char *key_out, size_t key_size);
+
+/**
+ * Upload data to <path>/<name> on a remote as it is
+ *
+ * Unlike eb_remote_push(), the remote's transformer and compression are
+ * not applied and no transaction is recorded.
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote
+ * @param name Object name under path
+ * @param data Data to upload
+ * @param size Size of data
+ * @return Status code (EB_ERROR_NOT_FOUND if the remote does not exist)
+ */
+eb_status_t eb_remote_put_object(const char *remote_name, const char *path, const char *name,
+                                 const void *data, size_t size);
+
+/*
+ * Pack transfer
+ *
+ * Instead of one request per object, push can bundle the objects a remote
+ * lacks into a single pack and pull can fetch packs whole, or just the
+ * records it needs by range through the pack's index. Packs and a
+ * manifest listing them live under <path>/packs on the remote.
+ */
+typedef struct {
+    size_t packs;                 /* Packs uploaded or installed */
+    size_t objects;               /* Objects they carried */
+    size_t bytes;                 /* Bytes transferred, indexes included */
+    size_t ranged;                /* Packs read by range rather than whole */
+} eb_remote_pack_stats_t;
+
+/**
+ * Push objects to a remote as one pack
+ *
+ * Objects listed in <path>/packs/HAVE are left out (sets packed before it
+ * existed are checked against their pack indexes). With nothing missing
+ * and an unchanged log nothing is uploaded at all.
+ *
+ * Large packs go up as content-defined chunks shared by the whole remote:
+ * chunks it already has are skipped, and so are those an interrupted push
+ * of the same pack got through.
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote (e.g., "sets/<set_name>")
+ * @param objects Objects to push
+ * @param count Number of objects
+ * @param log Set log stored in the manifest, NULL keeps the remote's
+ * @param stats Optional counts of the transfer
+ * @return Status code
+ */
+eb_status_t eb_remote_push_pack(
+    const char *remote_name,
+    const char *path,
+    const eb_pack_object_t *objects,
+    size_t count,
+    const char *log,
+    eb_remote_pack_stats_t *stats);
+
+/**
+ * Pull the packs of a remote path into the local repository
+ *
+ * Packs already installed are skipped. A pack is downloaded whole when at
+ * least half of its objects are missing locally; otherwise only the
+ * missing records are fetched and installed as a smaller pack.
+ *
+ * @param remote_name Remote name
+ * @param path Path on the remote (e.g., "sets/<set_name>")
+ * @param root Repository root (directory containing .embr)
+ * @param log_out Optional pointer to store the set log of the manifest (caller must free)
+ * @param stats Optional counts of the transfer
+ * @return Status code (EB_ERROR_NOT_FOUND if the path has no packs)
+ */
+eb_status_t eb_remote_pull_packs(
+    const char *remote_name,
+    const char *path,
+    const char *root,
+    char **log_out,
+    eb_remote_pack_stats_t *stats);
+
 /**
  * Load remote configuration from the config file
  *
@@ -265,6 +541,9 @@ eb_status_t load_operation_states(const char *filename);
 /**
  * Resume an interrupted push operation
  *
+ * On S3 remotes this sends the object again and the transport continues
+ * a stalled multipart upload from the parts already uploaded.
+ *
  * @param remote_name Remote name
  * @param data Data to push
  * @param size Size of data
@@ -0,0 +1,369 @@
+/*
+ * EmbeddingBridge - Remote Object Cache Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+#include "remote_cache.h"
+#include "object_path.h"
+#include "hash_utils.h"
+#include "fs.h"
+#include "counters.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Temp files older than this are left over from an interrupted insert */
+#define STALE_TEMP_SECONDS 3600
+
+typedef struct {
+    char hash[65];
+    uint64_t size;          /* All files of the entry */
+    struct timespec used;   /* mtime of the .sum, zero if there is none */
+} cache_entry_t;
+
+static bool valid_hash(const char* hash) {
+    if (!hash || strlen(hash) != 64)
+        return false;
+    for (size_t i = 0; i < 64; i++) {
+        if (eb_hex_digit(hash[i]) < 0)
+            return false;
+    }
+    return true;
+}
+
+eb_status_t eb_remote_cache_path(const char* root, const char* hash, const char* ext,
+                                 char* out, size_t out_size) {
+    if (!root || !valid_hash(hash) || !ext || !out)
+        return EB_ERROR_INVALID_PARAMETER;
+    int n = snprintf(out, out_size, "%s/%s/%.2s/%s.%s", root, EB_REMOTE_CACHE_DIR, hash, hash, ext);
+    return n < 0 || (size_t)n >= out_size ? EB_ERROR_PATH_TOO_LONG : EB_SUCCESS;
+}
+
+/* Hex SHA-256 and size of a file */
+static eb_status_t hash_file(const char* path, char hash_out[65], uint64_t* size_out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_IO;
+
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if (!ctx) {
+        close(fd);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    unsigned char buf[65536];
+    uint64_t size = 0;
+    bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1;
+    ssize_t n;
+    while (ok && (n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ok = false;
+            break;
+        }
+        ok = EVP_DigestUpdate(ctx, buf, (size_t)n) == 1;
+        size += (uint64_t)n;
+    }
+    uint8_t digest[32];
+    unsigned int digest_len = 0;
+    ok = ok && EVP_DigestFinal_ex(ctx, digest, &digest_len) == 1;
+    EVP_MD_CTX_free(ctx);
+    close(fd);
+
+    if (!ok)
+        return EB_ERROR_IO;
+    eb_hash_to_hex(digest, hash_out);
+    *size_out = size;
+    return EB_SUCCESS;
+}
+
+static eb_status_t hash_buffer(const void* data, size_t size, char hash_out[65]) {
+    uint8_t digest[32];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(data, size, digest, &digest_len, EVP_sha256(), NULL) != 1)
+        return EB_ERROR_COMPUTATION_FAILED;
+    eb_hash_to_hex(digest, hash_out);
+    return EB_SUCCESS;
+}
+
+/* Write a file through a temp name so readers never see it half written */
+static eb_status_t write_file(const char* path, const void* data, size_t size) {
+    char temp[PATH_MAX];
+    if ((size_t)snprintf(temp, sizeof(temp), "%s.tmp.%d", path, (int)getpid()) >= sizeof(temp))
+        return EB_ERROR_PATH_TOO_LONG;
+
+    FILE* fp = fopen(temp, "wb");
+    if (!fp) {
+        DEBUG_ERROR("remote_cache: cannot create %s: %s", temp, strerror(errno));
+        return EB_ERROR_IO;
+    }
+    bool ok = fwrite(data, 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(temp, path) != 0) {
+        DEBUG_ERROR("remote_cache: cannot write %s: %s", path, strerror(errno));
+        unlink(temp);
+        return EB_ERROR_IO;
+    }
+    return EB_SUCCESS;
+}
+
+/* Remove the files of an entry, the .sum first so lookups miss right away */
+static void remove_entry(const char* root, const char* hash) {
+    static const char* const exts[] = { "sum", "raw", "meta" };
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        char path[PATH_MAX];
+        if (eb_remote_cache_path(root, hash, exts[i], path, sizeof(path)) == EB_SUCCESS)
+            unlink(path);
+    }
+}
+
+/* Check one file of an entry against its "<sha256> <size>" line */
+static bool verify_file(const char* root, const char* hash, const char* ext,
+                        const char* expected_hash, uint64_t expected_size) {
+    char path[PATH_MAX];
+    char actual[65];
+    uint64_t size = 0;
+    if (eb_remote_cache_path(root, hash, ext, path, sizeof(path)) != EB_SUCCESS ||
+        hash_file(path, actual, &size) != EB_SUCCESS)
+        return false;
+    return size == expected_size && strcmp(actual, expected_hash) == 0;
+}
+
+eb_status_t eb_remote_cache_lookup(const char* root, const char* hash) {
+    char sum_path[PATH_MAX];
+    eb_status_t status = eb_remote_cache_path(root, hash, "sum", sum_path, sizeof(sum_path));
+    if (status != EB_SUCCESS)
+        return status;
+
+    FILE* fp = fopen(sum_path, "r");
+    if (!fp) {
+        eb_counter_add(EB_COUNTER_REMOTE_CACHE_MISSES, 1);
+        return EB_ERROR_NOT_FOUND;
+    }
+    char raw_hash[65] = {0}, meta_hash[65] = {0};
+    unsigned long long raw_size = 0, meta_size = 0;
+    int fields = fscanf(fp, "raw %64s %llu\nmeta %64s %llu", raw_hash, &raw_size, meta_hash, &meta_size);
+    fclose(fp);
+
+    if (fields != 4 || !verify_file(root, hash, "raw", raw_hash, raw_size) ||
+        !verify_file(root, hash, "meta", meta_hash, meta_size)) {
+        DEBUG_WARN("remote_cache: dropping damaged entry %s", hash);
+        remove_entry(root, hash);
+        eb_counter_add(EB_COUNTER_REMOTE_CACHE_MISSES, 1);
+        return EB_ERROR_NOT_FOUND;
+    }
+    eb_counter_add(EB_COUNTER_REMOTE_CACHE_HITS, 1);
+
+    /* The .sum mtime is the last use */
+    if (utimensat(AT_FDCWD, sum_path, NULL, 0) != 0)
+        DEBUG_WARN("remote_cache: cannot touch %s: %s", sum_path, strerror(errno));
+    return EB_SUCCESS;
+}
+
+static int compare_used(const void* a, const void* b) {
+    const cache_entry_t* x = a;
+    const cache_entry_t* y = b;
+    if (x->used.tv_sec != y->used.tv_sec)
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    if (x->used.tv_nsec != y->used.tv_nsec)
+        return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/* Entry of hash in entries[0..count), added if it is not there yet */
+static cache_entry_t* find_entry(cache_entry_t** entries, size_t* count, size_t* capacity,
+                                 const char* hash) {
+    /* Files of one entry share a fanout directory, so the match is near the end */
+    for (size_t i = *count; i > 0; i--) {
+        if (strncmp((*entries)[i - 1].hash, hash, 64) == 0)
+            return &(*entries)[i - 1];
+        if (strncmp((*entries)[i - 1].hash, hash, 2) != 0)
+            break;
+    }
+    if (*count == *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 64;
+        cache_entry_t* grown = realloc(*entries, grown_capacity * sizeof(**entries));
+        if (!grown)
+            return NULL;
+        *entries = grown;
+        *capacity = grown_capacity;
+    }
+    cache_entry_t* entry = &(*entries)[(*count)++];
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->hash, hash, 64);
+    return entry;
+}
+
+/* Collect the entries of the cache with their sizes and last use */
+static eb_status_t scan_cache(const char* root, cache_entry_t** entries_out, size_t* count_out,
+                              uint64_t* total_out) {
+    char cache_dir[PATH_MAX];
+    snprintf(cache_dir, sizeof(cache_dir), "%s/%s", root, EB_REMOTE_CACHE_DIR);
+    *entries_out = NULL;
+    *count_out = 0;
+    *total_out = 0;
+
+    DIR* top = opendir(cache_dir);
+    if (!top)
+        return errno == ENOENT ? EB_SUCCESS : EB_ERROR_IO;
+
+    cache_entry_t* entries = NULL;
+    size_t count = 0, capacity = 0;
+    uint64_t total = 0;
+    eb_status_t status = EB_SUCCESS;
+    time_t now = time(NULL);
+    struct dirent* fan;
+    while (status == EB_SUCCESS && (fan = readdir(top)) != NULL) {
+        if (strlen(fan->d_name) != 2 || eb_hex_digit(fan->d_name[0]) < 0 || eb_hex_digit(fan->d_name[1]) < 0)
+            continue;
+        char fan_dir[PATH_MAX];
+        snprintf(fan_dir, sizeof(fan_dir), "%s/%s", cache_dir, fan->d_name);
+        DIR* dir = opendir(fan_dir);
+        if (!dir)
+            continue;
+        struct dirent* file;
+        while ((file = readdir(dir)) != NULL) {
+            const char* name = file->d_name;
+            if (name[0] == '.')
+                continue;
+            char path[PATH_MAX];
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%s", fan_dir, name);
+            if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+
+            if (strstr(name, ".tmp.")) {
+                if (now - st.st_mtime > STALE_TEMP_SECONDS)
+                    unlink(path);
+                continue;
+            }
+            const char* ext = strlen(name) > 65 && name[64] == '.' ? name + 65 : NULL;
+            if (!ext || (strcmp(ext, "raw") != 0 && strcmp(ext, "meta") != 0 && strcmp(ext, "sum") != 0))
+                continue;
+
+            cache_entry_t* entry = find_entry(&entries, &count, &capacity, name);
+            if (!entry) {
+                status = EB_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            entry->size += (uint64_t)st.st_size;
+            total += (uint64_t)st.st_size;
+            if (strcmp(ext, "sum") == 0)
+                entry->used = st.st_mtim;
+        }
+        closedir(dir);
+    }
+    closedir(top);
+
+    if (status != EB_SUCCESS) {
+        free(entries);
+        return status;
+    }
+    *entries_out = entries;
+    *count_out = count;
+    *total_out = total;
+    return EB_SUCCESS;
+}
+
+/* Evict the least recently used entries other than keep until the cache fits in limit */
+static eb_status_t trim_cache(const char* root, uint64_t limit, const char* keep, uint64_t* freed_out) {
+    cache_entry_t* entries = NULL;
+    size_t count = 0;
+    uint64_t total = 0, freed = 0;
+    eb_status_t status = scan_cache(root, &entries, &count, &total);
+    if (status != EB_SUCCESS)
+        return status;
+
+    if (total > limit) {
+        qsort(entries, count, sizeof(*entries), compare_used);
+        for (size_t i = 0; i < count && total - freed > limit; i++) {
+            if (keep && strcmp(entries[i].hash, keep) == 0)
+                continue;
+            remove_entry(root, entries[i].hash);
+            freed += entries[i].size;
+        }
+        DEBUG_INFO("remote_cache: evicted %llu of %llu bytes",
+                   (unsigned long long)freed, (unsigned long long)total);
+    }
+
+    free(entries);
+    if (freed_out)
+        *freed_out = freed;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_remote_cache_trim(const char* root, uint64_t limit, uint64_t* freed_out) {
+    if (!root)
+        return EB_ERROR_INVALID_PARAMETER;
+    return trim_cache(root, limit, NULL, freed_out);
+}
+
+eb_status_t eb_remote_cache_insert(const char* root, const char* hash,
+                                   const void* raw, size_t raw_size,
+                                   const void* meta, size_t meta_size) {
+    if ((!raw && raw_size > 0) || (!meta && meta_size > 0))
+        return EB_ERROR_INVALID_PARAMETER;
+
+    char raw_path[PATH_MAX], meta_path[PATH_MAX], sum_path[PATH_MAX];
+    eb_status_t status = eb_remote_cache_path(root, hash, "raw", raw_path, sizeof(raw_path));
+    if (status == EB_SUCCESS)
+        status = eb_remote_cache_path(root, hash, "meta", meta_path, sizeof(meta_path));
+    if (status == EB_SUCCESS)
+        status = eb_remote_cache_path(root, hash, "sum", sum_path, sizeof(sum_path));
+    if (status != EB_SUCCESS)
+        return status;
+
+    char fan_dir[PATH_MAX];
+    snprintf(fan_dir, sizeof(fan_dir), "%s/%s/%.2s", root, EB_REMOTE_CACHE_DIR, hash);
+    if (fs_mkdir_p(fan_dir, 0755) != 0) {
+        DEBUG_ERROR("remote_cache: cannot create %s: %s", fan_dir, strerror(errno));
+        return EB_ERROR_IO;
+    }
+
+    char raw_hash[65], meta_hash[65];
+    status = hash_buffer(raw, raw_size, raw_hash);
+    if (status == EB_SUCCESS)
+        status = hash_buffer(meta, meta_size, meta_hash);
+    if (status != EB_SUCCESS)
+        return status;
+
+    /* The .sum goes last: an entry without one is never looked up */
+    unlink(sum_path);
+    char sum[192];
+    int sum_len = snprintf(sum, sizeof(sum), "raw %s %zu\nmeta %s %zu\n", raw_hash, raw_size, meta_hash, meta_size);
+    status = write_file(raw_path, raw, raw_size);
+    if (status == EB_SUCCESS)
+        status = write_file(meta_path, meta, meta_size);
+    if (status == EB_SUCCESS)
+        status = write_file(sum_path, sum, (size_t)sum_len);
+    if (status != EB_SUCCESS) {
+        remove_entry(root, hash);
+        return status;
+    }
+
+    /* A failed eviction leaves the cache too big but the entry usable */
+    if (trim_cache(root, eb_object_remote_cache_size(root), hash, NULL) != EB_SUCCESS)
+        DEBUG_WARN("remote_cache: eviction failed");
+    return EB_SUCCESS;
+}
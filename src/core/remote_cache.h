@@ -0,0 +1,82 @@
+/*
+ * EmbeddingBridge - Remote Object Cache
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_REMOTE_CACHE_H
+#define EB_REMOTE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * Objects fetched from a remote are kept under .embr/cache/remote/, keyed
+ * by their hash and fanned out by its first two digits:
+ *
+ *   <hh>/<hash>.raw   content of the object
+ *   <hh>/<hash>.meta  its metadata
+ *   <hh>/<hash>.sum   SHA-256 and size of both, written last
+ *
+ * Every lookup checks both files against the .sum and drops entries that
+ * do not match. The mtime of the .sum records the last use; once the cache
+ * grows past storage.remote_cache_size the least recently used entries
+ * are evicted.
+ */
+#define EB_REMOTE_CACHE_DIR ".embr/cache/remote"
+
+/**
+ * Path of a file of a cache entry
+ *
+ * @param root Repository root
+ * @param hash Full 64-character object hash
+ * @param ext "raw" or "meta"
+ * @param out Output buffer
+ * @param out_size Size of out
+ * @return Status code (EB_ERROR_PATH_TOO_LONG if out is too small)
+ */
+eb_status_t eb_remote_cache_path(const char* root, const char* hash, const char* ext,
+                                 char* out, size_t out_size);
+
+/**
+ * Look up a cached object and mark it as used
+ *
+ * @param root Repository root
+ * @param hash Full 64-character object hash
+ * @return Status code (EB_ERROR_NOT_FOUND on a miss or a damaged entry)
+ */
+eb_status_t eb_remote_cache_lookup(const char* root, const char* hash);
+
+/**
+ * Add an object to the cache, then evict down to the configured size
+ *
+ * The new entry itself is never evicted.
+ *
+ * @param root Repository root
+ * @param hash Full 64-character object hash
+ * @param raw Content of the object
+ * @param raw_size Size of raw
+ * @param meta Metadata of the object
+ * @param meta_size Size of meta
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_remote_cache_insert(const char* root, const char* hash,
+                                   const void* raw, size_t raw_size,
+                                   const void* meta, size_t meta_size);
+
+/**
+ * Evict least recently used entries until the cache fits in limit bytes
+ *
+ * @param root Repository root
+ * @param limit Size bound in bytes
+ * @param freed_out Receives the number of bytes removed (may be NULL)
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_remote_cache_trim(const char* root, uint64_t limit, uint64_t* freed_out);
+
+#endif /* EB_REMOTE_CACHE_H */
@@ -0,0 +1,262 @@
+/*
+ * EmbeddingBridge - Remote Set Metadata Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <jansson.h>
+
+#include "remote_metadata.h"
+#include "types.h"
+#include "path_utils.h"
+#include "set_index.h"
+#include "object_path.h"
+#include "transformer.h"
+#include "parquet_transformer.h"
+
+/* Add a set index entry to the "index" array */
+static int append_index_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    json_t* entry = json_object();
+    json_object_set_new(entry, "hash", json_string(hash));
+    json_object_set_new(entry, "path", json_string(source));
+    if (model[0]) {
+        json_object_set_new(entry, "model", json_string(model));
+    }
+    json_array_append_new((json_t*)ctx, entry);
+    return 0;
+}
+
+/* One entry per line of the current set log */
+static json_t* build_objects(void) {
+    json_t* objects = json_array();
+    char* log_path = get_current_set_log_path();
+    if (!log_path) {
+        return objects;
+    }
+    FILE* log_file = fopen(log_path, "r");
+    free(log_path);
+    if (!log_file) {
+        return objects;
+    }
+
+    char line[PATH_MAX + 128];
+    while (fgets(line, sizeof(line), log_file)) {
+        char timestamp[32], hash[65], source[PATH_MAX], model[64];
+        if (sscanf(line, "%31s %64s %s %63s", timestamp, hash, source, model) != 4) {
+            continue;
+        }
+        json_t* object = json_object();
+        json_object_set_new(object, "hash", json_string(hash));
+        json_object_set_new(object, "path", json_string(source));
+        json_object_set_new(object, "created", json_integer(atoll(timestamp)));
+        json_object_set_new(object, "model", json_string(model));
+        json_array_append_new(objects, object);
+    }
+    fclose(log_file);
+    return objects;
+}
+
+/* Model name to object hash, from the model refs of the current set */
+static json_t* build_refs(void) {
+    json_t* refs = json_object();
+    char* refs_dir_path = get_current_set_model_refs_dir();
+    if (!refs_dir_path) {
+        return refs;
+    }
+    DIR* refs_dir = opendir(refs_dir_path);
+    if (!refs_dir) {
+        free(refs_dir_path);
+        return refs;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(refs_dir)) != NULL) {
+        if (entry->d_type != DT_REG) {
+            continue;
+        }
+        char ref_path[PATH_MAX];
+        snprintf(ref_path, sizeof(ref_path), "%s/%s", refs_dir_path, entry->d_name);
+        FILE* ref = fopen(ref_path, "r");
+        if (!ref) {
+            continue;
+        }
+        char hash[256];
+        if (fgets(hash, sizeof(hash), ref)) {
+            hash[strcspn(hash, "\n")] = '\0';
+            json_object_set_new(refs, entry->d_name, json_string(hash));
+        }
+        fclose(ref);
+    }
+    closedir(refs_dir);
+    free(refs_dir_path);
+    return refs;
+}
+
+eb_status_t eb_remote_metadata_build(const char* set_name, size_t size, time_t timestamp,
+                                     char** json_out) {
+    if (!set_name || !json_out) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+    *json_out = NULL;
+
+    json_t* root = json_object();
+    if (!root) {
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    json_object_set_new(root, "timestamp", json_integer((json_int_t)timestamp));
+    json_object_set_new(root, "size", json_integer((json_int_t)size));
+    json_object_set_new(root, "set", json_string(set_name));
+    json_object_set_new(root, "objects", build_objects());
+
+    json_t* index = json_array();
+    eb_set_index_t* set_index = NULL;
+    if (eb_set_index_open_current(".", &set_index) == EB_SUCCESS) {
+        eb_set_index_foreach(set_index, NULL, append_index_entry, index);
+        eb_set_index_close(set_index);
+    }
+    json_object_set_new(root, "index", index);
+    json_object_set_new(root, "refs", build_refs());
+
+    char head[128] = "main";
+    FILE* head_file = fopen(".embr/HEAD", "r");
+    if (head_file) {
+        if (fgets(head, sizeof(head), head_file)) {
+            head[strcspn(head, "\n")] = '\0';
+        }
+        fclose(head_file);
+    }
+    json_object_set_new(root, "head", json_string(head));
+
+    *json_out = json_dumps(root, JSON_INDENT(2));
+    json_decref(root);
+    return *json_out ? EB_SUCCESS : EB_ERROR_MEMORY_ALLOCATION;
+}
+
+void eb_remote_object_keys(const char* prefix, const char* target_path, const char* hash,
+                           char* set_name, size_t set_name_size,
+                           char* data_key, size_t data_key_size,
+                           char* metadata_key, size_t metadata_key_size) {
+    const char* name = "main";
+    if (target_path && *target_path) {
+        const char* last = strrchr(target_path, '/');
+        name = last && last[1] ? last + 1 : target_path;
+    }
+    snprintf(set_name, set_name_size, "%s", name);
+
+    if (prefix && *prefix) {
+        snprintf(data_key, data_key_size, "%s%s/%s.parquet", prefix,
+                 strstr(prefix, "/documents") ? "" : "/documents", hash);
+        snprintf(metadata_key, metadata_key_size, "%s/metadata.json", prefix);
+    } else {
+        snprintf(data_key, data_key_size, "sets/%s/documents/%s.parquet", set_name, hash);
+        snprintf(metadata_key, metadata_key_size, "sets/%s/metadata.json", set_name);
+    }
+}
+
+time_t eb_remote_object_time(const char* hash) {
+    time_t timestamp = time(NULL);
+    char meta_path[PATH_MAX];
+    char line[PATH_MAX + 32];
+
+    if (eb_object_path(".", hash, "meta", meta_path, sizeof(meta_path)) != 0) {
+        return timestamp;
+    }
+    FILE* meta = fopen(meta_path, "r");
+    if (!meta) {
+        return timestamp;
+    }
+
+    char source_path[PATH_MAX] = {0};
+    while (fgets(line, sizeof(line), meta)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "timestamp=", 10) == 0 && atol(line + 10) > 0) {
+            timestamp = (time_t)atol(line + 10);
+        } else if (strncmp(line, "source_file=", 12) == 0) {
+            snprintf(source_path, sizeof(source_path), "%s", line + 12);
+        }
+    }
+    fclose(meta);
+
+    FILE* source = source_path[0] ? fopen(source_path, "r") : NULL;
+    if (source) {
+        fseek(source, 0, SEEK_END);
+        long source_size = ftell(source);
+        fseek(source, 0, SEEK_SET);
+        char* text = source_size >= 0 ? malloc((size_t)source_size + 1) : NULL;
+        if (text) {
+            size_t read = fread(text, 1, (size_t)source_size, source);
+            text[read] = '\0';
+            eb_parquet_set_document_text(text);
+            free(text);
+        }
+        fclose(source);
+    }
+    return timestamp;
+}
+
+bool eb_remote_object_is_record(const void* data, size_t size) {
+    eb_object_header_t header;
+    if (!data || size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    return header.magic == EB_VECTOR_MAGIC && eb_object_version_valid(header.version) &&
+           (header.obj_type == EB_OBJ_VECTOR || header.obj_type == EB_OBJ_META) &&
+           EB_FLAG_DICT_ID(header.flags) == 0 && !(header.flags & EB_FLAG_DELTA);
+}
+
+eb_status_t eb_remote_object_encode(const void* data, size_t size, bool precompressed,
+                                    void** payload_out, size_t* size_out) {
+    if (!data || !payload_out || !size_out) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    *payload_out = (void*)data;
+    *size_out = size;
+    if (precompressed) {
+        return eb_remote_object_is_record(data, size) ? EB_SUCCESS : EB_ERROR_INVALID_FORMAT;
+    }
+
+    eb_transformer_t* transformer = eb_find_transformer_by_format("parquet");
+    if (!transformer) {
+        return EB_ERROR_TRANSFORMER;
+    }
+    return eb_transform(transformer, data, size, payload_out, size_out);
+}
+
+eb_status_t eb_remote_object_encode_to(const void* data, size_t size, bool precompressed,
+                                       eb_transform_sink_fn sink, void* ctx, size_t* size_out) {
+    if (!data || !sink) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    if (precompressed) {
+        if (!eb_remote_object_is_record(data, size)) {
+            return EB_ERROR_INVALID_FORMAT;
+        }
+        eb_status_t status = (eb_status_t)sink(ctx, data, size);
+        if (status == EB_SUCCESS && size_out) {
+            *size_out = size;
+        }
+        return status;
+    }
+
+    eb_transform_stream_t* stream = NULL;
+    eb_status_t status = eb_transform_pipeline_open("parquet", 0, sink, ctx, &stream);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    status = eb_transform_stream_feed(stream, data, size);
+    if (status != EB_SUCCESS) {
+        eb_transform_stream_abort(stream);
+        return status;
+    }
+    return eb_transform_stream_finish(stream, size_out);
+}
@@ -0,0 +1,119 @@
+/*
+ * EmbeddingBridge - Remote Set Metadata
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_REMOTE_METADATA_H
+#define EB_REMOTE_METADATA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include "status.h"
+#include "transformer.h"
+
+/*
+ * metadata.json
+ *
+ * Object stores keep a metadata.json next to the documents of a set. It
+ * carries what pull needs to rebuild the set without the source files:
+ * the set log ("objects"), the set index ("index"), the model refs
+ * ("refs") and the checked out set ("head"), plus the size and storage
+ * time of the last object pushed.
+ */
+
+/**
+ * Build metadata.json for the current set
+ *
+ * @param set_name Set the objects were pushed to
+ * @param size Bytes of the last object pushed
+ * @param timestamp Storage time of the last object pushed
+ * @param json_out Pointer to store the JSON text (caller must free)
+ * @return Status code
+ */
+eb_status_t eb_remote_metadata_build(const char* set_name, size_t size, time_t timestamp,
+                                     char** json_out);
+
+/**
+ * Keys an object and the metadata of its set are stored under
+ *
+ * Objects live at <prefix>/documents/<hash>.parquet next to
+ * <prefix>/metadata.json, or below sets/<set> without a prefix.
+ *
+ * @param prefix Key prefix of the remote URL, "" for none
+ * @param target_path Target path of the transport, its last component names the set
+ * @param hash Object hash
+ * @param set_name Buffer for the set name
+ * @param set_name_size Size of set_name
+ * @param data_key Buffer for the object key
+ * @param data_key_size Size of data_key
+ * @param metadata_key Buffer for the metadata.json key
+ * @param metadata_key_size Size of metadata_key
+ */
+void eb_remote_object_keys(const char* prefix, const char* target_path, const char* hash,
+                           char* set_name, size_t set_name_size,
+                           char* data_key, size_t data_key_size,
+                           char* metadata_key, size_t metadata_key_size);
+
+/**
+ * Read the storage time of a local object
+ *
+ * Also hands the source text recorded in the .meta file of the object to
+ * the Parquet transformer, so eb_remote_object_encode() embeds it.
+ *
+ * @param hash Object hash
+ * @return Timestamp from the .meta file, or the current time
+ */
+time_t eb_remote_object_time(const char* hash);
+
+/* Remote format keeping object records exactly as the local store does */
+#define EB_REMOTE_FORMAT_NATIVE "native"
+
+/**
+ * Check that data is a self-contained object record
+ *
+ * Only the header is looked at: magic, version, object type and that no
+ * local compression dictionary or delta base is needed to read the payload.
+ *
+ * @param data Data to check
+ * @param size Size of data
+ * @return true if data can be stored on a native remote as is
+ */
+bool eb_remote_object_is_record(const void* data, size_t size);
+
+/**
+ * Encode an object as stored on object stores
+ *
+ * @param data Object data
+ * @param size Size of data
+ * @param precompressed Data is an object record for a native remote, stored as is once its header checks out
+ * @param payload_out Pointer to the encoded data, data itself when nothing changed
+ * @param size_out Pointer to store the encoded size
+ * @return Status code (free *payload_out when it differs from data)
+ */
+eb_status_t eb_remote_object_encode(const void* data, size_t size, bool precompressed,
+                                    void** payload_out, size_t* size_out);
+
+/**
+ * Encode an object as stored on object stores into a sink
+ *
+ * Streams through the Parquet transformer, so the encoded object is never
+ * held in memory as a whole.
+ *
+ * @param data Object data
+ * @param size Size of data
+ * @param precompressed Data is an object record for a native remote, stored as is once its header checks out
+ * @param sink Consumer of the encoded data, e.g. transport_fd_sink
+ * @param ctx Context passed to sink
+ * @param size_out Pointer to store the encoded size (can be NULL)
+ * @return Status code (the sink's status if it aborted)
+ */
+eb_status_t eb_remote_object_encode_to(const void* data, size_t size, bool precompressed,
+                                       eb_transform_sink_fn sink, void* ctx, size_t* size_out);
+
+#endif /* EB_REMOTE_METADATA_H */
@@ -0,0 +1,400 @@
+/*
+ * EmbeddingBridge - Read-Ahead of Remote Objects
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "remote_prefetch.h"
+#include "remote.h"
+#include "remote_cache.h"
+#include "transport.h"
+#include "transformer.h"
+#include "parquet_transformer.h"
+#include "compress.h"
+#include "object_path.h"
+#include "pack.h"
+#include "counters.h"
+#include "trace.h"
+#include "debug.h"
+
+typedef enum {
+    ENTRY_PENDING = 0,
+    ENTRY_RUNNING,
+    ENTRY_DONE
+} entry_state_t;
+
+struct eb_prefetch {
+    char* root;
+    char* set_name;
+    char (*hashes)[65];
+    size_t count;
+    size_t window;
+    eb_prefetch_fetch_fn fetch;
+    void* ctx;
+    eb_pack_set_t* packs;           /* Packed objects count as local; NULL if none */
+
+    pthread_mutex_t lock;
+    pthread_cond_t more;            /* next or limit moved, or stopping */
+    pthread_cond_t done;            /* An entry finished */
+    entry_state_t* states;          /* Guarded by lock */
+    eb_status_t* statuses;
+    size_t next;                    /* First entry no worker has looked at */
+    size_t limit;                   /* Workers fetch entries below this */
+    bool stopping;
+
+    pthread_t* threads;
+    size_t thread_count;
+};
+
+/*
+ * Copy the string value of "key":"..." in a metadata JSON object into buf
+ */
+static void metadata_json_string(const char* json, const char* key, char* buf, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    const char* p = strstr(json, pattern);
+    if (!p)
+        return;
+    p += strlen(pattern);
+    const char* q = strchr(p, '"');
+    if (!q)
+        return;
+    size_t len = (size_t)(q - p);
+    if (len >= size)
+        len = size - 1;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+}
+
+/*
+ * Convert the metadata JSON of a Parquet object to the key=value form of .meta files
+ */
+static size_t metadata_json_to_meta(const char* metadata_json, char* out, size_t out_size) {
+    char source_file[PATH_MAX] = {0};
+    char file_type[32] = {0};
+    char provider[32] = {0};
+    metadata_json_string(metadata_json, "source", source_file, sizeof(source_file));
+    metadata_json_string(metadata_json, "file_type", file_type, sizeof(file_type));
+    /* 'provider', or 'model' as a fallback */
+    metadata_json_string(metadata_json, "provider", provider, sizeof(provider));
+    if (!provider[0])
+        metadata_json_string(metadata_json, "model", provider, sizeof(provider));
+
+    FILE* meta_fp = fmemopen(out, out_size, "w");
+    if (!meta_fp)
+        return 0;
+    if (source_file[0])
+        fprintf(meta_fp, "source_file=%s\n", source_file);
+    if (file_type[0])
+        fprintf(meta_fp, "file_type=%s\n", file_type);
+    if (provider[0])
+        fprintf(meta_fp, "model=%s\n", provider);
+    long len = ftell(meta_fp);
+    fclose(meta_fp);
+    return len > 0 ? (size_t)len : 0;
+}
+
+eb_status_t eb_remote_fetch_object(const char* root, const char* remote_name,
+                                   const char* set_name, const char* hash) {
+    if (!root || !remote_name || !set_name || !hash || strlen(hash) != 64)
+        return EB_ERROR_INVALID_PARAMETER;
+    EB_TRACE_SCOPE("remote fetch");
+
+    char remote_parquet[PATH_MAX];
+    if (snprintf(remote_parquet, sizeof(remote_parquet), "sets/%s/documents/%s.parquet",
+                 set_name, hash) >= (int)sizeof(remote_parquet))
+        return EB_ERROR_PATH_TOO_LONG;
+
+    /* Stream the object straight into an unlinked temp file instead of memory */
+    char parquet_template[] = "/tmp/embr_parquet_XXXXXX";
+    int fd = mkstemp(parquet_template);
+    if (fd < 0)
+        return EB_ERROR_FILE_IO;
+    unlink(parquet_template);
+    size_t parquet_size = 0;
+    eb_status_t status = eb_remote_pull_stream(remote_name, remote_parquet, NULL,
+                                               transport_fd_sink, &fd, &parquet_size);
+    if (status != EB_SUCCESS || parquet_size == 0) {
+        close(fd);
+        return status != EB_SUCCESS ? status : EB_ERROR_NOT_FOUND;
+    }
+    size_t map_size = parquet_size;
+    void* parquet_map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (parquet_map == MAP_FAILED)
+        return EB_ERROR_FILE_IO;
+
+    const void* parquet_data = parquet_map;
+    void* decompressed = NULL;
+    const unsigned char* magic = parquet_map;
+    if (parquet_size > 2 && magic[0] == 0x28 && magic[1] == 0xB5) {
+        /* Stored ZSTD-compressed, as eb_remote_pull() would have undone */
+        size_t decompressed_size = 0;
+        status = eb_decompress_zstd(parquet_map, parquet_size, &decompressed, &decompressed_size);
+        if (status != EB_SUCCESS) {
+            munmap(parquet_map, map_size);
+            return status;
+        }
+        parquet_data = decompressed;
+        parquet_size = decompressed_size;
+    }
+
+    char* metadata_json = eb_parquet_extract_metadata_json(parquet_data, parquet_size);
+    if (!metadata_json) {
+        free(decompressed);
+        munmap(parquet_map, map_size);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    char meta[PATH_MAX + 128];
+    size_t meta_size = metadata_json_to_meta(metadata_json, meta, sizeof(meta));
+    free(metadata_json);
+
+    /* Inverse-transform Parquet to .raw, keep the Parquet itself if there is no raw form */
+    void* original = NULL;
+    size_t original_size = 0;
+    eb_transformer_t* transformer = eb_find_transformer_by_format("parquet");
+    if (transformer &&
+        eb_inverse_transform(transformer, parquet_data, parquet_size,
+                             &original, &original_size) != EB_SUCCESS)
+        original = NULL;
+    const void* raw = original ? original : parquet_data;
+    size_t raw_size = original ? original_size : parquet_size;
+
+    status = eb_remote_cache_insert(root, hash, raw, raw_size, meta, meta_size);
+    free(original);
+    free(decompressed);
+    munmap(parquet_map, map_size);
+    if (status != EB_SUCCESS)
+        DEBUG_INFO("eb_remote_fetch_object: caching %s failed: %d", hash, status);
+    return status;
+}
+
+/* Whether the store holds an object, loose or in one of packs */
+static bool object_local(const char* root, const eb_pack_set_t* packs, const char* hash) {
+    char path[PATH_MAX];
+    if (eb_object_path(root, hash, "raw", path, sizeof(path)) == 0 && access(path, F_OK) == 0)
+        return true;
+    return packs && eb_pack_contains(packs, hash);
+}
+
+/* The remotes in turn, until one has the object */
+static eb_status_t fetch_from_remotes(const char* root, const char* set_name, const char* hash) {
+    eb_status_t status = eb_remote_init();
+    if (status != EB_SUCCESS)
+        return status;
+    char** remotes = NULL;
+    int remote_count = 0;
+    status = eb_remote_list(&remotes, &remote_count);
+    if (status != EB_SUCCESS)
+        return status;
+
+    status = EB_ERROR_NOT_FOUND;
+    for (int i = 0; i < remote_count; i++) {
+        if (status != EB_SUCCESS &&
+            eb_remote_fetch_object(root, remotes[i], set_name, hash) == EB_SUCCESS)
+            status = EB_SUCCESS;
+        free(remotes[i]);
+    }
+    free(remotes);
+    return status;
+}
+
+eb_status_t eb_remote_fetch(const char* root, const char* set_name, const char* hash) {
+    if (!root || !set_name || !hash || strlen(hash) != 64)
+        return EB_ERROR_INVALID_PARAMETER;
+    if (eb_remote_cache_lookup(root, hash) == EB_SUCCESS)
+        return EB_SUCCESS;
+
+    eb_pack_set_t* packs = NULL;
+    if (eb_pack_open(root, &packs) != EB_SUCCESS)
+        packs = NULL;
+    bool local = object_local(root, packs, hash);
+    eb_pack_close(packs);
+    return local ? EB_SUCCESS : fetch_from_remotes(root, set_name, hash);
+}
+
+/* Fetch one entry of a walk unless it is local or cached already */
+static eb_status_t fetch_entry(eb_prefetch_t* prefetch, size_t index, bool* fetched) {
+    const char* hash = prefetch->hashes[index];
+    *fetched = false;
+    if (strlen(hash) != 64)
+        return EB_ERROR_INVALID_PARAMETER;
+    if (object_local(prefetch->root, prefetch->packs, hash) ||
+        eb_remote_cache_lookup(prefetch->root, hash) == EB_SUCCESS)
+        return EB_SUCCESS;
+    *fetched = true;
+    if (prefetch->fetch)
+        return prefetch->fetch(prefetch->root, prefetch->set_name, hash, prefetch->ctx);
+    return fetch_from_remotes(prefetch->root, prefetch->set_name, hash);
+}
+
+/* Record the status of an entry, with prefetch->lock held */
+static void finish_entry(eb_prefetch_t* prefetch, size_t index, eb_status_t status) {
+    prefetch->statuses[index] = status;
+    prefetch->states[index] = ENTRY_DONE;
+    pthread_cond_broadcast(&prefetch->done);
+}
+
+static void* prefetch_worker(void* arg) {
+    eb_prefetch_t* prefetch = arg;
+
+    pthread_mutex_lock(&prefetch->lock);
+    for (;;) {
+        /* Entries the walk fetched itself are passed over */
+        while (prefetch->next < prefetch->limit &&
+               prefetch->states[prefetch->next] != ENTRY_PENDING)
+            prefetch->next++;
+        if (prefetch->stopping || prefetch->next >= prefetch->count)
+            break;
+        if (prefetch->next >= prefetch->limit) {
+            pthread_cond_wait(&prefetch->more, &prefetch->lock);
+            continue;
+        }
+
+        size_t index = prefetch->next++;
+        prefetch->states[index] = ENTRY_RUNNING;
+        pthread_mutex_unlock(&prefetch->lock);
+
+        bool fetched;
+        eb_status_t status = fetch_entry(prefetch, index, &fetched);
+        if (fetched)
+            eb_counter_add(EB_COUNTER_PREFETCH_FETCHES, 1);
+
+        pthread_mutex_lock(&prefetch->lock);
+        finish_entry(prefetch, index, status);
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+    return NULL;
+}
+
+eb_status_t eb_prefetch_start(const char* root, const char* set_name,
+                              const char* const* hashes, size_t count,
+                              const eb_prefetch_options_t* options, eb_prefetch_t** out) {
+    if (!root || !set_name || (!hashes && count > 0) || !out)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    eb_prefetch_t* prefetch = calloc(1, sizeof(*prefetch));
+    if (!prefetch)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    pthread_mutex_init(&prefetch->lock, NULL);
+    pthread_cond_init(&prefetch->more, NULL);
+    pthread_cond_init(&prefetch->done, NULL);
+    prefetch->root = strdup(root);
+    prefetch->set_name = strdup(set_name);
+    prefetch->hashes = calloc(count ? count : 1, sizeof(*prefetch->hashes));
+    prefetch->states = calloc(count ? count : 1, sizeof(*prefetch->states));
+    prefetch->statuses = calloc(count ? count : 1, sizeof(*prefetch->statuses));
+    if (!prefetch->root || !prefetch->set_name || !prefetch->hashes ||
+        !prefetch->states || !prefetch->statuses) {
+        eb_prefetch_stop(prefetch);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!hashes[i]) {
+            eb_prefetch_stop(prefetch);
+            return EB_ERROR_INVALID_PARAMETER;
+        }
+        snprintf(prefetch->hashes[i], sizeof(prefetch->hashes[i]), "%s", hashes[i]);
+    }
+    prefetch->count = count;
+    prefetch->window = options && options->window ? options->window
+                                                  : eb_object_prefetch_window(root);
+    prefetch->fetch = options ? options->fetch : NULL;
+    prefetch->ctx = options ? options->ctx : NULL;
+    prefetch->limit = prefetch->window < count ? prefetch->window : count;
+    if (eb_pack_open(root, &prefetch->packs) != EB_SUCCESS)
+        prefetch->packs = NULL;
+
+    /* No more threads than fetches the window can hold at once */
+    size_t threads = options && options->threads ? options->threads : EB_PREFETCH_MAX_THREADS;
+    if (threads > prefetch->limit)
+        threads = prefetch->limit;
+    prefetch->threads = calloc(threads ? threads : 1, sizeof(*prefetch->threads));
+    if (!prefetch->threads) {
+        eb_prefetch_stop(prefetch);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (; prefetch->thread_count < threads; prefetch->thread_count++) {
+        if (pthread_create(&prefetch->threads[prefetch->thread_count], NULL,
+                           prefetch_worker, prefetch) != 0) {
+            /* The walk fetches what the workers that did start leave */
+            DEBUG_WARN("eb_prefetch_start: started %zu of %zu workers",
+                       prefetch->thread_count, threads);
+            break;
+        }
+    }
+
+    *out = prefetch;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_prefetch_wait(eb_prefetch_t* prefetch, size_t index) {
+    if (!prefetch || index >= prefetch->count)
+        return EB_ERROR_INVALID_PARAMETER;
+    EB_TRACE_SCOPE("prefetch wait");
+
+    pthread_mutex_lock(&prefetch->lock);
+    size_t limit = index + 1 + prefetch->window;
+    if (limit > prefetch->count)
+        limit = prefetch->count;
+    if (limit > prefetch->limit) {
+        prefetch->limit = limit;
+        pthread_cond_broadcast(&prefetch->more);
+    }
+
+    if (prefetch->states[index] == ENTRY_PENDING) {
+        /* Not reached by a worker yet, or read-ahead is off */
+        prefetch->states[index] = ENTRY_RUNNING;
+        pthread_mutex_unlock(&prefetch->lock);
+        bool fetched;
+        eb_status_t status = fetch_entry(prefetch, index, &fetched);
+        if (fetched)
+            eb_counter_add(EB_COUNTER_PREFETCH_STALLS, 1);
+        pthread_mutex_lock(&prefetch->lock);
+        finish_entry(prefetch, index, status);
+    } else if (prefetch->states[index] == ENTRY_RUNNING) {
+        eb_counter_add(EB_COUNTER_PREFETCH_STALLS, 1);
+        while (prefetch->states[index] != ENTRY_DONE)
+            pthread_cond_wait(&prefetch->done, &prefetch->lock);
+    }
+    eb_status_t status = prefetch->statuses[index];
+    pthread_mutex_unlock(&prefetch->lock);
+    return status;
+}
+
+void eb_prefetch_stop(eb_prefetch_t* prefetch) {
+    if (!prefetch)
+        return;
+
+    if (prefetch->thread_count > 0) {
+        pthread_mutex_lock(&prefetch->lock);
+        prefetch->stopping = true;
+        pthread_cond_broadcast(&prefetch->more);
+        pthread_mutex_unlock(&prefetch->lock);
+        for (size_t i = 0; i < prefetch->thread_count; i++)
+            pthread_join(prefetch->threads[i], NULL);
+    }
+    pthread_cond_destroy(&prefetch->done);
+    pthread_cond_destroy(&prefetch->more);
+    pthread_mutex_destroy(&prefetch->lock);
+    eb_pack_close(prefetch->packs);
+    free(prefetch->threads);
+    free(prefetch->statuses);
+    free(prefetch->states);
+    free(prefetch->hashes);
+    free(prefetch->set_name);
+    free(prefetch->root);
+    free(prefetch);
+}
@@ -0,0 +1,121 @@
+/*
+ * EmbeddingBridge - Read-Ahead of Remote Objects
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_REMOTE_PREFETCH_H
+#define EB_REMOTE_PREFETCH_H
+
+#include <stddef.h>
+#include "status.h"
+
+/*
+ * A set that was only partly pulled leaves objects on its remotes, which
+ * commands walking its history fetch into the remote object cache
+ * (remote_cache.h) as they reach them, one round trip at a time. A
+ * prefetcher is handed the hashes of a walk in the order it will visit
+ * them and keeps up to a window of fetches running ahead of it on threads
+ * of its own, each pulling through the transport pool. Objects held in
+ * the store or the cache already are skipped, so by the time the walk
+ * asks for an object it is usually cached. An object no worker has
+ * reached yet is fetched by the walk itself, alongside the workers.
+ *
+ * The workers are threads of their own rather than tasks on the shared
+ * pool (thread_pool.h): they spend their time blocked on the network,
+ * which would keep the pool's CPU-bound work from running.
+ *
+ * The window comes from storage.prefetch_window (32 by default); 0 turns
+ * read-ahead off and every object is fetched when the walk asks for it.
+ * The remote subsystem is initialized the first time an object has to
+ * be fetched; shut it down only once no prefetcher is left running.
+ */
+
+/* Concurrent fetches of a prefetcher unless told otherwise */
+#define EB_PREFETCH_MAX_THREADS 16
+
+typedef struct eb_prefetch eb_prefetch_t;
+
+/**
+ * Fetch one object into the remote object cache
+ *
+ * Called from several threads at once.
+ *
+ * @return Status code (0 = the object is now local or cached)
+ */
+typedef eb_status_t (*eb_prefetch_fetch_fn)(const char* root, const char* set_name,
+                                            const char* hash, void* ctx);
+
+typedef struct {
+    size_t window;                  /* Objects fetched ahead, 0 for storage.prefetch_window */
+    unsigned threads;               /* Worker threads, 0 for up to EB_PREFETCH_MAX_THREADS */
+    eb_prefetch_fetch_fn fetch;     /* NULL for eb_remote_fetch() */
+    void* ctx;                      /* Passed to fetch */
+} eb_prefetch_options_t;
+
+/**
+ * Download the object of a hash from one remote into the remote object
+ * cache, its raw form and metadata out of the one download
+ *
+ * @param root Repository root
+ * @param remote_name Remote
+ * @param set_name Set the object was pushed with
+ * @param hash Full 64-character object hash
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_remote_fetch_object(const char* root, const char* remote_name,
+                                   const char* set_name, const char* hash);
+
+/**
+ * Make sure an object is local, fetching it from the first remote that
+ * has it unless the store or the remote object cache holds it already
+ *
+ * @param root Repository root
+ * @param set_name Set the object was pushed with
+ * @param hash Full 64-character object hash
+ * @return Status code (EB_ERROR_NOT_FOUND if no remote has it,
+ *         EB_ERROR_INVALID_PARAMETER for a short hash)
+ */
+eb_status_t eb_remote_fetch(const char* root, const char* set_name, const char* hash);
+
+/**
+ * Start reading ahead of a walk
+ *
+ * Fetching starts at once with the first window hashes.
+ *
+ * @param root Repository root
+ * @param set_name Set of the objects
+ * @param hashes Hashes in the order they will be waited for; copied.
+ *               Short hashes fail with EB_ERROR_INVALID_PARAMETER.
+ * @param count Number of hashes
+ * @param options Options, NULL for the defaults
+ * @param out Receives the prefetcher, release with eb_prefetch_stop()
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_prefetch_start(const char* root, const char* set_name,
+                              const char* const* hashes, size_t count,
+                              const eb_prefetch_options_t* options, eb_prefetch_t** out);
+
+/**
+ * Wait for the object of one hash, moving the window past it
+ *
+ * An object whose fetch has not started is fetched by the caller.
+ *
+ * @param prefetch Prefetcher
+ * @param index Position of the hash in the walk
+ * @return Status of its fetch (0 = the object is local or cached)
+ */
+eb_status_t eb_prefetch_wait(eb_prefetch_t* prefetch, size_t index);
+
+/**
+ * Stop reading ahead and free a prefetcher
+ *
+ * Fetches already running finish first; the rest are dropped.
+ */
+void eb_prefetch_stop(eb_prefetch_t* prefetch);
+
+#endif /* EB_REMOTE_PREFETCH_H */
@@ -0,0 +1,489 @@
+/*
+ * EmbeddingBridge - Remote Object Server Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "serve.h"
+#include "fs.h"
+#include "debug.h"
+
+#define SERVE_LIST_DEPTH 16
+
+void eb_serve_put_u32(unsigned char* out, uint32_t value) {
+    for (int i = 3; i >= 0; i--) {
+        out[i] = (unsigned char)(value & 0xff);
+        value >>= 8;
+    }
+}
+
+void eb_serve_put_u64(unsigned char* out, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = (unsigned char)(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint32_t eb_serve_get_u32(const unsigned char* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+uint64_t eb_serve_get_u64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+eb_status_t eb_serve_write_all(int fd, const void* data, size_t size) {
+    const unsigned char* p = data;
+    bool socket = true;
+
+    while (size > 0) {
+        ssize_t written;
+        if (socket) {
+            written = send(fd, p, size, MSG_NOSIGNAL);
+            if (written < 0 && errno == ENOTSOCK) {
+                socket = false;
+                continue;
+            }
+        } else {
+            written = write(fd, p, size);
+        }
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return EB_ERROR_CONNECTION_CLOSED;
+        }
+        p += written;
+        size -= (size_t)written;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_serve_read_all(int fd, void* data, size_t size) {
+    unsigned char* p = data;
+
+    while (size > 0) {
+        ssize_t got = read(fd, p, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return EB_ERROR_CONNECTION_CLOSED;
+        }
+        p += got;
+        size -= (size_t)got;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_serve_write_header(int fd, const eb_serve_frame_t* frame) {
+    unsigned char header[EB_SERVE_HEADER_SIZE];
+    header[0] = frame->type;
+    eb_serve_put_u32(header + 1, frame->id);
+    eb_serve_put_u32(header + 5, frame->key_length);
+    eb_serve_put_u64(header + 9, frame->body_length);
+    return eb_serve_write_all(fd, header, sizeof(header));
+}
+
+eb_status_t eb_serve_read_header(int fd, eb_serve_frame_t* frame) {
+    unsigned char header[EB_SERVE_HEADER_SIZE];
+    eb_status_t status = eb_serve_read_all(fd, header, sizeof(header));
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    frame->type = header[0];
+    frame->id = eb_serve_get_u32(header + 1);
+    frame->key_length = eb_serve_get_u32(header + 5);
+    frame->body_length = eb_serve_get_u64(header + 9);
+    return frame->key_length > EB_SERVE_MAX_KEY ? EB_ERROR_INVALID_FORMAT : EB_SUCCESS;
+}
+
+eb_status_t eb_serve_write_frame(int fd, uint8_t type, uint32_t id,
+                                 const char* key, size_t key_length,
+                                 const void* body, uint64_t body_length) {
+    eb_serve_frame_t frame = {type, id, (uint32_t)key_length, body_length};
+    eb_status_t status = eb_serve_write_header(fd, &frame);
+    if (status == EB_SUCCESS && key_length > 0) {
+        status = eb_serve_write_all(fd, key, key_length);
+    }
+    if (status == EB_SUCCESS && body_length > 0) {
+        status = eb_serve_write_all(fd, body, (size_t)body_length);
+    }
+    return status;
+}
+
+/* Server side of one session */
+typedef struct {
+    const char* root;
+    int in_fd;
+    int out_fd;
+    unsigned char* buffer;        /* EB_SERVE_CHUNK_SIZE bytes */
+} serve_session_t;
+
+static eb_status_t status_from_errno(int error) {
+    switch (error) {
+        case ENOENT:
+        case ENOTDIR:
+            return EB_ERROR_NOT_FOUND;
+        case EACCES:
+        case EPERM:
+            return EB_ERROR_PERMISSION_DENIED;
+        default:
+            return EB_ERROR_FILE_IO;
+    }
+}
+
+static eb_status_t serve_done(serve_session_t* session, uint32_t id, eb_status_t result,
+                              const char* message) {
+    unsigned char body[4];
+    eb_serve_put_u32(body, (uint32_t)(int32_t)result);
+    return eb_serve_write_frame(session->out_fd, EB_SERVE_DONE, id,
+                                message, message ? strlen(message) : 0, body, sizeof(body));
+}
+
+/* Read and drop the rest of a request body */
+static eb_status_t serve_skip(serve_session_t* session, uint64_t remaining) {
+    while (remaining > 0) {
+        size_t chunk = remaining < EB_SERVE_CHUNK_SIZE ? (size_t)remaining : EB_SERVE_CHUNK_SIZE;
+        eb_status_t status = eb_serve_read_all(session->in_fd, session->buffer, chunk);
+        if (status != EB_SUCCESS) {
+            return status;
+        }
+        remaining -= chunk;
+    }
+    return EB_SUCCESS;
+}
+
+/* Path of a key under the root, refusing keys that would leave it */
+static eb_status_t serve_resolve(const serve_session_t* session, const char* key,
+                                 char* path, size_t path_size) {
+    while (*key == '/') {
+        key++;
+    }
+    if (!*key) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    for (const char* component = key; *component; ) {
+        size_t length = strcspn(component, "/");
+        if (length == 2 && component[0] == '.' && component[1] == '.') {
+            return EB_ERROR_PERMISSION_DENIED;
+        }
+        component += length;
+        while (*component == '/') {
+            component++;
+        }
+    }
+
+    const char* separator = session->root[strlen(session->root) - 1] == '/' ? "" : "/";
+    if ((size_t)snprintf(path, path_size, "%s%s%s", session->root, separator, key) >= path_size) {
+        return EB_ERROR_PATH_TOO_LONG;
+    }
+    return EB_SUCCESS;
+}
+
+/* Store a body through a temporary file, so readers never see half an object */
+static eb_status_t serve_put(serve_session_t* session, const eb_serve_frame_t* frame,
+                             const char* path, char* message, size_t message_size) {
+    char directory[PATH_MAX];
+    char temp_path[PATH_MAX];
+    const char* name = strrchr(path, '/');
+    size_t dir_length = name ? (size_t)(name - path) : 0;
+    name = name ? name + 1 : path;
+
+    snprintf(directory, sizeof(directory), "%.*s", (int)dir_length, path);
+    int fd = -1;
+    eb_status_t result = EB_SUCCESS;
+    if (dir_length > 0 && fs_mkdir_p(directory, 0755) != 0) {
+        result = status_from_errno(errno);
+        snprintf(message, message_size, "Cannot create %s: %s", directory, strerror(errno));
+    } else if ((size_t)snprintf(temp_path, sizeof(temp_path), "%s%s.%s.XXXXXX", directory,
+                                dir_length > 0 ? "/" : "", name) >= sizeof(temp_path)) {
+        snprintf(message, message_size, "Path too long: %s", path);
+        result = EB_ERROR_PATH_TOO_LONG;
+    } else if ((fd = mkstemp(temp_path)) < 0) {
+        result = status_from_errno(errno);
+        snprintf(message, message_size, "Cannot write %s: %s", path, strerror(errno));
+    }
+    if (result != EB_SUCCESS) {
+        eb_status_t skipped = serve_skip(session, frame->body_length);
+        return skipped != EB_SUCCESS ? skipped : result;
+    }
+    fchmod(fd, 0644);
+
+    uint64_t remaining = frame->body_length;
+    while (remaining > 0) {
+        size_t chunk = remaining < EB_SERVE_CHUNK_SIZE ? (size_t)remaining : EB_SERVE_CHUNK_SIZE;
+        eb_status_t status = eb_serve_read_all(session->in_fd, session->buffer, chunk);
+        if (status != EB_SUCCESS) {
+            close(fd);
+            unlink(temp_path);
+            return status;
+        }
+        remaining -= chunk;
+        if (result == EB_SUCCESS && eb_serve_write_all(fd, session->buffer, chunk) != EB_SUCCESS) {
+            snprintf(message, message_size, "Cannot write %s: %s", path, strerror(errno));
+            result = EB_ERROR_FILE_IO;
+        }
+    }
+
+    if (close(fd) != 0 && result == EB_SUCCESS) {
+        snprintf(message, message_size, "Cannot write %s: %s", path, strerror(errno));
+        result = EB_ERROR_FILE_IO;
+    }
+    if (result == EB_SUCCESS && rename(temp_path, path) != 0) {
+        result = status_from_errno(errno);
+        snprintf(message, message_size, "Cannot rename to %s: %s", path, strerror(errno));
+    }
+    if (result != EB_SUCCESS) {
+        unlink(temp_path);
+    }
+    return result;
+}
+
+static eb_status_t serve_get(serve_session_t* session, uint32_t id, const eb_serve_frame_t* frame,
+                             const char* path, char* message, size_t message_size,
+                             eb_status_t* result) {
+    unsigned char range[17] = {0};
+    if (frame->body_length != sizeof(range)) {
+        *result = EB_ERROR_INVALID_FORMAT;
+        return serve_skip(session, frame->body_length);
+    }
+    eb_status_t status = eb_serve_read_all(session->in_fd, range, sizeof(range));
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    uint64_t offset = eb_serve_get_u64(range);
+    uint64_t length = eb_serve_get_u64(range + 8);
+    bool from_end = range[16] != 0;
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        int error = fd < 0 ? errno : EISDIR;
+        snprintf(message, message_size, "Cannot read %s: %s", path, strerror(error));
+        *result = status_from_errno(error);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return EB_SUCCESS;
+    }
+
+    uint64_t size = (uint64_t)st.st_size;
+    if (from_end) {
+        offset = length > 0 && length < size ? size - length : 0;
+        length = size - offset;
+    } else if (offset > size) {
+        snprintf(message, message_size, "Range starts past the end of %s", path);
+        *result = EB_ERROR_INVALID_PARAMETER;
+        close(fd);
+        return EB_SUCCESS;
+    } else if (length == 0 || length > size - offset) {
+        length = size - offset;
+    }
+
+    *result = EB_SUCCESS;
+    while (length > 0) {
+        size_t chunk = length < EB_SERVE_CHUNK_SIZE ? (size_t)length : EB_SERVE_CHUNK_SIZE;
+        ssize_t got = pread(fd, session->buffer, chunk, (off_t)offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            snprintf(message, message_size, "Cannot read %s: %s", path,
+                     got < 0 ? strerror(errno) : "file shrank");
+            *result = EB_ERROR_FILE_IO;
+            break;
+        }
+        status = eb_serve_write_frame(session->out_fd, EB_SERVE_DATA, id, NULL, 0,
+                                      session->buffer, (uint64_t)got);
+        if (status != EB_SUCCESS) {
+            close(fd);
+            return status;
+        }
+        offset += (uint64_t)got;
+        length -= (uint64_t)got;
+    }
+    close(fd);
+    return EB_SUCCESS;
+}
+
+/* Keys of a listing, sent in DATA frames of up to EB_SERVE_CHUNK_SIZE bytes */
+typedef struct {
+    serve_session_t* session;
+    uint32_t id;
+    size_t used;
+    eb_status_t status;
+} serve_listing_t;
+
+static void listing_add(serve_listing_t* listing, const char* key) {
+    size_t length = strlen(key) + 1;
+    if (listing->status != EB_SUCCESS || length > EB_SERVE_CHUNK_SIZE) {
+        return;
+    }
+    if (listing->used + length > EB_SERVE_CHUNK_SIZE) {
+        listing->status = eb_serve_write_frame(listing->session->out_fd, EB_SERVE_DATA, listing->id,
+                                               NULL, 0, listing->session->buffer, listing->used);
+        listing->used = 0;
+    }
+    memcpy(listing->session->buffer + listing->used, key, length - 1);
+    listing->session->buffer[listing->used + length - 1] = '\n';
+    listing->used += length;
+}
+
+/* Every regular file below path, skipping dot files such as unfinished PUTs */
+static void listing_walk(serve_listing_t* listing, const char* path, const char* key, int depth) {
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    struct dirent* entry;
+    while (listing->status == EB_SUCCESS && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char child_path[PATH_MAX];
+        char child_key[EB_SERVE_MAX_KEY + NAME_MAX + 2];
+        if ((size_t)snprintf(child_path, sizeof(child_path), "%s/%s", path, entry->d_name) >= sizeof(child_path)) {
+            continue;
+        }
+        snprintf(child_key, sizeof(child_key), "%s/%s", key, entry->d_name);
+
+        struct stat st;
+        if (stat(child_path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (depth + 1 < SERVE_LIST_DEPTH) {
+                listing_walk(listing, child_path, child_key, depth + 1);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            listing_add(listing, child_key);
+        }
+    }
+    closedir(dir);
+}
+
+static eb_status_t serve_list(serve_session_t* session, uint32_t id, const char* key,
+                              const char* path) {
+    char prefix[EB_SERVE_MAX_KEY + 1];
+    size_t length = strlen(key);
+    while (length > 0 && key[length - 1] == '/') {
+        length--;
+    }
+    snprintf(prefix, sizeof(prefix), "%.*s", (int)length, key);
+
+    serve_listing_t listing = {session, id, 0, EB_SUCCESS};
+    listing_walk(&listing, path, prefix, 0);
+    if (listing.status == EB_SUCCESS && listing.used > 0) {
+        listing.status = eb_serve_write_frame(session->out_fd, EB_SERVE_DATA, id, NULL, 0,
+                                              session->buffer, listing.used);
+    }
+    return listing.status;
+}
+
+/* Answer one request, only a broken connection ends the session */
+static eb_status_t serve_request(serve_session_t* session, const eb_serve_frame_t* frame,
+                                 const char* key) {
+    char path[PATH_MAX];
+    char message[PATH_MAX + 128] = "";
+    eb_status_t result = serve_resolve(session, key, path, sizeof(path));
+    eb_status_t status = EB_SUCCESS;
+
+    if (result != EB_SUCCESS) {
+        snprintf(message, sizeof(message), "Invalid key '%s'", key);
+        status = serve_skip(session, frame->body_length);
+    } else if (frame->type == EB_SERVE_PUT) {
+        result = serve_put(session, frame, path, message, sizeof(message));
+        if (result == EB_ERROR_CONNECTION_CLOSED) {
+            return result;
+        }
+    } else if (frame->type == EB_SERVE_GET) {
+        status = serve_get(session, frame->id, frame, path, message, sizeof(message), &result);
+    } else if (frame->type == EB_SERVE_LIST) {
+        status = serve_skip(session, frame->body_length);
+        if (status == EB_SUCCESS) {
+            status = serve_list(session, frame->id, key, path);
+        }
+    } else if (frame->type == EB_SERVE_DELETE) {
+        status = serve_skip(session, frame->body_length);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            result = status_from_errno(errno);
+            snprintf(message, sizeof(message), "Cannot delete %s: %s", path, strerror(errno));
+        }
+    } else {
+        snprintf(message, sizeof(message), "Unknown request type %u", frame->type);
+        result = EB_ERROR_UNSUPPORTED;
+        status = serve_skip(session, frame->body_length);
+    }
+
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    if (result != EB_SUCCESS) {
+        DEBUG_WARN("serve: %s", message);
+    }
+    return serve_done(session, frame->id, result, message[0] ? message : NULL);
+}
+
+eb_status_t eb_serve(const char* root, int in_fd, int out_fd) {
+    if (!root || !*root) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+
+    serve_session_t session = {root, in_fd, out_fd, malloc(EB_SERVE_CHUNK_SIZE)};
+    if (!session.buffer) {
+        return EB_ERROR_MEMORY;
+    }
+
+    eb_status_t status = eb_serve_write_frame(out_fd, EB_SERVE_HELLO, 0, EB_SERVE_GREETING,
+                                              strlen(EB_SERVE_GREETING), NULL, 0);
+    char key[EB_SERVE_MAX_KEY + 1];
+    while (status == EB_SUCCESS) {
+        eb_serve_frame_t frame;
+        status = eb_serve_read_header(in_fd, &frame);
+        if (status == EB_ERROR_CONNECTION_CLOSED) {
+            /* The client went away without BYE, which is fine */
+            status = EB_SUCCESS;
+            break;
+        }
+        if (status == EB_SUCCESS) {
+            status = eb_serve_read_all(in_fd, key, frame.key_length);
+        }
+        if (status != EB_SUCCESS) {
+            break;
+        }
+        key[frame.key_length] = '\0';
+        if (frame.type == EB_SERVE_BYE) {
+            break;
+        }
+        status = serve_request(&session, &frame, key);
+    }
+
+    free(session.buffer);
+    return status;
+}
@@ -0,0 +1,137 @@
+/*
+ * EmbeddingBridge - Remote Object Server
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SERVE_H
+#define EB_SERVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * Serve protocol
+ *
+ * ssh remotes run "embr serve <root>" on the remote host and exchange
+ * frames with it over the ssh channel, the way git runs upload-pack.
+ * Every frame is a fixed header followed by a key and a body:
+ *
+ *   u8 type | u32 id | u32 key length | u64 body length | key | body
+ *
+ * with big-endian integers. The client tags each request with an id and
+ * may send many requests before reading any answer. The server answers
+ * requests in the order they arrive, each with zero or more DATA frames
+ * and exactly one DONE frame carrying the same id. The body of DONE is
+ * the eb_status_t of the request as an i32, its key an error message.
+ *
+ * Keys are the object keys of the remote, resolved under the root the
+ * server was started with. Keys with ".." components are refused.
+ *
+ * The local daemon (daemon.h) speaks the same frames over a Unix socket,
+ * with RUN requests only.
+ */
+#define EB_SERVE_GREETING "embr serve 1"
+#define EB_SERVE_HEADER_SIZE 17
+#define EB_SERVE_MAX_KEY 4096
+#define EB_SERVE_CHUNK_SIZE (1024 * 1024)
+
+typedef enum {
+    EB_SERVE_HELLO = 1,    /* Server greeting, key is EB_SERVE_GREETING */
+    EB_SERVE_PUT = 2,      /* Store the body under key */
+    EB_SERVE_GET = 3,      /* Read key, body is u64 offset, u64 length, u8 from_end */
+    EB_SERVE_LIST = 4,     /* Keys below the key, newline separated in DATA */
+    EB_SERVE_DELETE = 5,   /* Remove key, a missing key is not an error */
+    EB_SERVE_BYE = 6,      /* End of the session */
+    EB_SERVE_DATA = 7,     /* Part of an answer */
+    EB_SERVE_DONE = 8,     /* End of an answer */
+    EB_SERVE_RUN = 9       /* Run a command, key is the cwd, body the argv (daemon.h) */
+} eb_serve_frame_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint32_t id;
+    uint32_t key_length;
+    uint64_t body_length;
+} eb_serve_frame_t;
+
+/**
+ * Write a whole buffer to a pipe or socket
+ *
+ * Sockets are written without raising SIGPIPE when the peer is gone.
+ *
+ * @param fd Descriptor to write to
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return EB_SUCCESS or EB_ERROR_CONNECTION_CLOSED
+ */
+eb_status_t eb_serve_write_all(int fd, const void* data, size_t size);
+
+/**
+ * Read exactly size bytes
+ *
+ * @param fd Descriptor to read from
+ * @param data Buffer to fill
+ * @param size Number of bytes
+ * @return EB_SUCCESS or EB_ERROR_CONNECTION_CLOSED on EOF or error
+ */
+eb_status_t eb_serve_read_all(int fd, void* data, size_t size);
+
+/**
+ * Write a frame header
+ *
+ * The key and body_length bytes of body have to follow.
+ *
+ * @param fd Descriptor to write to
+ * @param frame Header to write
+ * @return Status code
+ */
+eb_status_t eb_serve_write_header(int fd, const eb_serve_frame_t* frame);
+
+/**
+ * Read a frame header
+ *
+ * @param fd Descriptor to read from
+ * @param frame Header read
+ * @return Status code, EB_ERROR_INVALID_FORMAT for an oversized key
+ */
+eb_status_t eb_serve_read_header(int fd, eb_serve_frame_t* frame);
+
+/**
+ * Write a whole frame
+ *
+ * @param fd Descriptor to write to
+ * @param type Frame type
+ * @param id Request id
+ * @param key Key bytes (can be NULL when key_length is 0)
+ * @param key_length Length of key
+ * @param body Body bytes (can be NULL when body_length is 0)
+ * @param body_length Length of body
+ * @return Status code
+ */
+eb_status_t eb_serve_write_frame(int fd, uint8_t type, uint32_t id,
+                                 const char* key, size_t key_length,
+                                 const void* body, uint64_t body_length);
+
+/**
+ * Serve object requests until BYE or end of input
+ *
+ * @param root Directory keys are resolved under
+ * @param in_fd Descriptor requests are read from
+ * @param out_fd Descriptor answers are written to
+ * @return EB_SUCCESS after BYE or a clean end of input
+ */
+eb_status_t eb_serve(const char* root, int in_fd, int out_fd);
+
+/* Big-endian integer helpers shared by client and server */
+void eb_serve_put_u32(unsigned char* out, uint32_t value);
+void eb_serve_put_u64(unsigned char* out, uint64_t value);
+uint32_t eb_serve_get_u32(const unsigned char* in);
+uint64_t eb_serve_get_u64(const unsigned char* in);
+
+#endif /* EB_SERVE_H */
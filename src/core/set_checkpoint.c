@@ -0,0 +1,874 @@
+/*
+ * EmbeddingBridge - Set Log Checkpoints Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "set_checkpoint.h"
+#include "set_layers.h"
+#include "log_index.h"
+#include "set_index.h"
+#include "hnsw.h"
+#include "path_utils.h"
+#include "hash_utils.h"
+#include "fs.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define STATE_MIN_SLOTS 1024
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/* A state being replayed, with the newest entry of each (source, model) */
+typedef struct {
+    eb_set_state_entry_t* items;
+    uint64_t* keys;
+    size_t count;
+    size_t capacity;
+    uint32_t* slots;            /* Item index + 1, 0 for empty */
+    size_t slot_count;          /* Power of two, at least twice count */
+    bool failed;
+
+    const eb_set_point_t* at;
+    bool done;                  /* Reached the point */
+    bool in_own_log;
+    uint64_t seq;
+    time_t max_time;
+    uint64_t replayed;
+    uint64_t own_entries;
+} replay_t;
+
+static uint64_t entry_key(const char* source, size_t source_len, const char* model, size_t model_len) {
+    uint64_t h = FNV_OFFSET;
+    for (size_t i = 0; i < source_len; i++) {
+        h ^= (unsigned char)source[i];
+        h *= FNV_PRIME;
+    }
+    h *= FNV_PRIME;
+    for (size_t i = 0; i < model_len; i++) {
+        h ^= (unsigned char)model[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static uint32_t* find_slot(const replay_t* r, uint64_t key, const char* source, const char* model) {
+    size_t mask = r->slot_count - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+        uint32_t slot = r->slots[i];
+        if (!slot)
+            return &r->slots[i];
+        const eb_set_state_entry_t* e = &r->items[slot - 1];
+        if (r->keys[slot - 1] == key && strcmp(e->source, source) == 0 && strcmp(e->model, model) == 0)
+            return &r->slots[i];
+    }
+}
+
+static bool rehash(replay_t* r, size_t slot_count) {
+    uint32_t* slots = calloc(slot_count, sizeof(*slots));
+    if (!slots)
+        return false;
+    free(r->slots);
+    r->slots = slots;
+    r->slot_count = slot_count;
+    size_t mask = slot_count - 1;
+    for (size_t n = 0; n < r->count; n++) {
+        size_t i = r->keys[n] & mask;
+        while (r->slots[i])
+            i = (i + 1) & mask;
+        r->slots[i] = (uint32_t)(n + 1);
+    }
+    return true;
+}
+
+static bool replay_init(replay_t* r, const eb_set_point_t* at) {
+    memset(r, 0, sizeof(*r));
+    r->at = at;
+    return rehash(r, STATE_MIN_SLOTS);
+}
+
+static void replay_free(replay_t* r) {
+    for (size_t i = 0; i < r->count; i++) {
+        free(r->items[i].source);
+        free(r->items[i].model);
+    }
+    free(r->items);
+    free(r->keys);
+    free(r->slots);
+}
+
+/* Record source and model at hash; false only when out of memory */
+static bool replay_set(replay_t* r, const char* source, size_t source_len, const char* model,
+                       size_t model_len, const char* hash, time_t timestamp) {
+    char* s = strndup(source, source_len);
+    char* m = strndup(model, model_len);
+    if (!s || !m) {
+        free(s);
+        free(m);
+        return false;
+    }
+    uint64_t key = entry_key(s, source_len, m, model_len);
+    uint32_t* slot = find_slot(r, key, s, m);
+    if (*slot) {
+        eb_set_state_entry_t* e = &r->items[*slot - 1];
+        memcpy(e->hash, hash, 65);
+        e->timestamp = timestamp;
+        free(s);
+        free(m);
+        return true;
+    }
+
+    if (r->count == r->capacity) {
+        size_t capacity = r->capacity ? r->capacity * 2 : 1024;
+        eb_set_state_entry_t* items = realloc(r->items, capacity * sizeof(*items));
+        if (items)
+            r->items = items;
+        uint64_t* keys = items ? realloc(r->keys, capacity * sizeof(*keys)) : NULL;
+        if (!keys) {
+            free(s);
+            free(m);
+            return false;
+        }
+        r->keys = keys;
+        r->capacity = capacity;
+    }
+    eb_set_state_entry_t* e = &r->items[r->count];
+    e->source = s;
+    e->model = m;
+    memcpy(e->hash, hash, 65);
+    e->timestamp = timestamp;
+    r->keys[r->count] = key;
+    *slot = (uint32_t)++r->count;
+    if (r->count * 2 > r->slot_count && !rehash(r, r->slot_count * 2))
+        return false;
+    return true;
+}
+
+/* Mark an entry removed; it keeps its slot in case it is recorded again */
+static void replay_remove(replay_t* r, const char* source, const char* model) {
+    uint32_t* slot = find_slot(r, entry_key(source, strlen(source), model, strlen(model)), source, model);
+    if (*slot)
+        r->items[*slot - 1].hash[0] = '\0';
+}
+
+static int replay_entry(const eb_log_entry_t* entry, void* ctx) {
+    replay_t* r = ctx;
+    const eb_set_point_t* at = r->at;
+    if (at && ((at->kind == EB_SET_POINT_SEQ && r->seq >= at->seq) ||
+               (at->kind == EB_SET_POINT_TIME && entry->timestamp > at->time))) {
+        r->done = true;
+        return 1;
+    }
+
+    r->seq++;
+    r->replayed++;
+    if (r->in_own_log)
+        r->own_entries++;
+    if (entry->timestamp > r->max_time)
+        r->max_time = entry->timestamp;
+    if (entry->removed) {
+        replay_remove(r, entry->source, entry->model);
+        return 0;
+    }
+    if (strlen(entry->hash) != 64)
+        return 0;
+    if (!replay_set(r, entry->source, strlen(entry->source), entry->model, strlen(entry->model),
+                    entry->hash, entry->timestamp)) {
+        r->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+static void checkpoint_dir(const char* log_path, char* out, size_t size) {
+    const char* slash = strrchr(log_path, '/');
+    int dir_len = slash ? (int)(slash - log_path) : 1;
+    snprintf(out, size, "%.*s/%s", dir_len, slash ? log_path : ".", EB_CHECKPOINT_DIR);
+}
+
+static int compare_seq(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Sequence numbers of the checkpoint files, oldest first */
+static eb_status_t list_checkpoints(const char* dir_path, uint64_t** out, size_t* count) {
+    *out = NULL;
+    *count = 0;
+    DIR* dir = opendir(dir_path);
+    if (!dir)
+        return errno == ENOENT ? EB_SUCCESS : EB_ERROR_FILE_IO;
+
+    size_t capacity = 0;
+    eb_status_t status = EB_SUCCESS;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* p = entry->d_name;
+        while (isdigit((unsigned char)*p))
+            p++;
+        if (p == entry->d_name || *p)
+            continue;
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            uint64_t* grown = realloc(*out, capacity * sizeof(*grown));
+            if (!grown) {
+                status = EB_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            *out = grown;
+        }
+        (*out)[(*count)++] = strtoull(entry->d_name, NULL, 10);
+    }
+    closedir(dir);
+    if (status != EB_SUCCESS) {
+        free(*out);
+        *out = NULL;
+        *count = 0;
+    } else if (*count > 1) {
+        qsort(*out, *count, sizeof(**out), compare_seq);
+    }
+    return status;
+}
+
+static void checkpoint_path(const char* dir_path, uint64_t seq, char* out, size_t size) {
+    snprintf(out, size, "%s/%012llu", dir_path, (unsigned long long)seq);
+}
+
+/* Read a checkpoint header and check it still matches the log */
+static bool read_header(const char* path, const char* log_path, eb_checkpoint_header_t* header) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+    bool ok = fread(header, sizeof(*header), 1, f) == 1;
+    fclose(f);
+    uint64_t fingerprint;
+    return ok && header->magic == EB_CHECKPOINT_MAGIC && header->version == EB_CHECKPOINT_VERSION &&
+           eb_log_fingerprint(log_path, header->log_offset, &fingerprint) == EB_SUCCESS &&
+           fingerprint == header->fingerprint;
+}
+
+static bool header_before(const eb_checkpoint_header_t* header, const eb_set_point_t* at) {
+    if (!at || at->kind == EB_SET_POINT_END)
+        return true;
+    if (at->kind == EB_SET_POINT_SEQ)
+        return header->seq <= at->seq;
+    return header->max_time <= (int64_t)at->time;
+}
+
+/*
+ * Newest usable checkpoint at or before a point. Checkpoints that no
+ * longer match the log are deleted when prune is set.
+ */
+static bool find_checkpoint(const char* log_path, const eb_set_point_t* at, bool prune,
+                            char* path_out, size_t size, eb_checkpoint_header_t* header) {
+    char dir_path[PATH_MAX];
+    checkpoint_dir(log_path, dir_path, sizeof(dir_path));
+    uint64_t* seqs = NULL;
+    size_t count = 0;
+    if (list_checkpoints(dir_path, &seqs, &count) != EB_SUCCESS)
+        return false;
+
+    bool found = false;
+    for (size_t n = count; n > 0 && !found; n--) {
+        checkpoint_path(dir_path, seqs[n - 1], path_out, size);
+        if (!read_header(path_out, log_path, header)) {
+            if (prune) {
+                DEBUG_PRINT("checkpoint: Removing stale %s", path_out);
+                unlink(path_out);
+            }
+            continue;
+        }
+        found = header_before(header, at);
+    }
+    free(seqs);
+    return found;
+}
+
+static eb_status_t load_checkpoint(const char* path, const eb_checkpoint_header_t* header, replay_t* r) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+
+    eb_checkpoint_record_t* recs = NULL;
+    char* names = NULL;
+    bool ok = header->count < UINT32_MAX && header->names_size < ((uint64_t)1 << 40) &&
+              fseeko(f, sizeof(*header), SEEK_SET) == 0;
+    if (ok) {
+        recs = malloc((header->count ? header->count : 1) * sizeof(*recs));
+        names = malloc(header->names_size ? header->names_size : 1);
+        ok = recs && names &&
+             fread(recs, sizeof(*recs), header->count, f) == header->count &&
+             fread(names, 1, header->names_size, f) == header->names_size;
+    }
+    fclose(f);
+
+    eb_status_t status = ok ? EB_SUCCESS : EB_ERROR_INVALID_DATA;
+    if (ok && header->count * 2 > r->slot_count) {
+        size_t slots = r->slot_count;
+        while (slots < header->count * 2)
+            slots *= 2;
+        if (!rehash(r, slots))
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (uint64_t i = 0; status == EB_SUCCESS && i < header->count; i++) {
+        const eb_checkpoint_record_t* rec = &recs[i];
+        if (rec->name_offset + rec->source_len + rec->model_len > header->names_size) {
+            status = EB_ERROR_INVALID_DATA;
+            break;
+        }
+        char hex[65];
+        eb_hash_to_hex(rec->hash, hex);
+        const char* source = names + rec->name_offset;
+        if (!replay_set(r, source, rec->source_len, source + rec->source_len, rec->model_len, hex,
+                        (time_t)rec->timestamp))
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+    free(recs);
+    free(names);
+
+    if (status == EB_SUCCESS) {
+        r->seq = header->seq;
+        r->max_time = (time_t)header->max_time;
+        r->own_entries = header->log_entries;
+    }
+    return status;
+}
+
+/*
+ * Replay up to the point: from the newest checkpoint before it, or from
+ * the start of the layers. own_end receives where reading the set's own
+ * log stopped.
+ */
+static eb_status_t replay(const char* log_path, replay_t* r, bool prune, uint64_t* own_end) {
+    char path[PATH_MAX];
+    eb_checkpoint_header_t header;
+    uint64_t start = 0;
+    if (find_checkpoint(log_path, r->at, prune, path, sizeof(path), &header)) {
+        eb_status_t status = load_checkpoint(path, &header, r);
+        if (status == EB_SUCCESS) {
+            start = header.log_offset;
+        } else {
+            // Unreadable past the header; replay everything instead
+            DEBUG_PRINT("checkpoint: Ignoring unreadable %s (%d)", path, status);
+            replay_free(r);
+            if (!replay_init(r, r->at))
+                return EB_ERROR_MEMORY_ALLOCATION;
+            if (prune)
+                unlink(path);
+        }
+    }
+
+    eb_status_t status = EB_SUCCESS;
+    if (start == 0 && r->seq == 0) {
+        eb_set_layers_t layers;
+        status = eb_set_layers_load_for(log_path, &layers);
+        for (size_t i = 0; status == EB_SUCCESS && !r->done && !r->failed && i < layers.count; i++) {
+            char layer_log[PATH_MAX];
+            eb_set_layer_path(log_path, &layers.items[i], "log", layer_log, sizeof(layer_log));
+            status = eb_log_foreach_range(layer_log, 0, layers.items[i].log_size, replay_entry, r, NULL);
+        }
+        eb_set_layers_free(&layers);
+    }
+
+    *own_end = start;
+    r->in_own_log = true;
+    if (status == EB_SUCCESS && !r->done && !r->failed)
+        status = eb_log_foreach_range(log_path, start, UINT64_MAX, replay_entry, r, own_end);
+    if (status == EB_SUCCESS && r->failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    return status;
+}
+
+static int compare_state_entries(const void* a, const void* b) {
+    const eb_set_state_entry_t* x = a;
+    const eb_set_state_entry_t* y = b;
+    int cmp = strcmp(x->source, y->source);
+    return cmp ? cmp : strcmp(x->model, y->model);
+}
+
+/* Drop removed entries and sort the rest; the table is not used after this */
+static void finish_state(replay_t* r) {
+    size_t kept = 0;
+    for (size_t i = 0; i < r->count; i++) {
+        if (r->items[i].hash[0]) {
+            r->items[kept++] = r->items[i];
+        } else {
+            free(r->items[i].source);
+            free(r->items[i].model);
+        }
+    }
+    r->count = kept;
+    if (r->count > 1)
+        qsort(r->items, r->count, sizeof(*r->items), compare_state_entries);
+}
+
+eb_status_t eb_set_state_at(const char* log_path, const eb_set_point_t* at, eb_set_state_t* out) {
+    if (!log_path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    memset(out, 0, sizeof(*out));
+
+    replay_t r;
+    if (!replay_init(&r, at))
+        return EB_ERROR_MEMORY_ALLOCATION;
+    uint64_t own_end;
+    eb_status_t status = replay(log_path, &r, false, &own_end);
+    if (status != EB_SUCCESS) {
+        replay_free(&r);
+        return status;
+    }
+
+    finish_state(&r);
+    out->items = r.items;
+    out->count = r.count;
+    out->seq = r.seq;
+    out->max_time = r.max_time;
+    out->replayed = r.replayed;
+    free(r.keys);
+    free(r.slots);
+    return EB_SUCCESS;
+}
+
+void eb_set_state_free(eb_set_state_t* state) {
+    if (!state)
+        return;
+    for (size_t i = 0; i < state->count; i++) {
+        free(state->items[i].source);
+        free(state->items[i].model);
+    }
+    free(state->items);
+    memset(state, 0, sizeof(*state));
+}
+
+typedef struct {
+    eb_set_state_entry_t* items;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} entry_list_t;
+
+static int collect_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    entry_list_t* list = ctx;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        eb_set_state_entry_t* items = realloc(list->items, capacity * sizeof(*items));
+        if (!items) {
+            list->failed = true;
+            return 1;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    eb_set_state_entry_t* e = &list->items[list->count];
+    e->source = strdup(source);
+    e->model = strdup(model);
+    if (!e->source || !e->model) {
+        free(e->source);
+        free(e->model);
+        list->failed = true;
+        return 1;
+    }
+    snprintf(e->hash, sizeof(e->hash), "%s", hash);
+    e->timestamp = 0;
+    list->count++;
+    return 0;
+}
+
+/* Whether path is the current set's index, which has the vector index to keep up to date */
+static bool is_current_index(const char* path) {
+    char* current = get_current_set_index_path();
+    struct stat a, b;
+    bool same = current && stat(current, &a) == 0 && stat(path, &b) == 0 &&
+                a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    free(current);
+    return same;
+}
+
+static int compare_change_model(const void* x, const void* y) {
+    const eb_set_index_change_t* a = x;
+    const eb_set_index_change_t* b = y;
+    int cmp = strcmp(a->model, b->model);
+    return cmp ? cmp : strcmp(a->source, b->source);
+}
+
+static int compare_change_source(const void* key, const void* item) {
+    return strcmp(key, ((const eb_set_index_change_t*)item)->source);
+}
+
+/* Rewrite refs/models/<model> once per model touched, dropping or replacing its sources */
+static void restore_model_refs(const char* set_dir, eb_set_index_change_t* changes, size_t count) {
+    size_t with_model = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (changes[i].model[0])
+            changes[with_model++] = changes[i];
+    }
+    if (with_model == 0)
+        return;
+    qsort(changes, with_model, sizeof(*changes), compare_change_model);
+
+    char refs_dir[PATH_MAX];
+    snprintf(refs_dir, sizeof(refs_dir), "%s/refs/models", set_dir);
+    if (fs_mkdir_p(refs_dir, 0755) != 0) {
+        fprintf(stderr, "Warning: Failed to create models directory\n");
+        return;
+    }
+
+    for (size_t start = 0, end; start < with_model; start = end) {
+        const char* model = changes[start].model;
+        for (end = start + 1; end < with_model && strcmp(changes[end].model, model) == 0; end++)
+            ;
+        const eb_set_index_change_t* run = &changes[start];
+        size_t run_count = end - start;
+
+        char ref_path[PATH_MAX], tmp_path[PATH_MAX + 16];
+        snprintf(ref_path, sizeof(ref_path), "%s/%s", refs_dir, model);
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", ref_path);
+        FILE* out = fopen(tmp_path, "w");
+        if (!out) {
+            fprintf(stderr, "Warning: Failed to update model reference file for %s\n", model);
+            continue;
+        }
+
+        FILE* in = fopen(ref_path, "r");
+        if (in) {
+            char line[PATH_MAX + 80];
+            while (fgets(line, sizeof(line), in)) {
+                char hash[65], source[PATH_MAX];
+                line[strcspn(line, "\n")] = 0;
+                if (sscanf(line, "%64s %4095s", hash, source) == 2 &&
+                    !bsearch(source, run, run_count, sizeof(*run), compare_change_source))
+                    fprintf(out, "%s\n", line);
+            }
+            fclose(in);
+        }
+        for (size_t i = 0; i < run_count; i++) {
+            if (run[i].hash)
+                fprintf(out, "%s %s\n", run[i].hash, run[i].source);
+        }
+
+        // A rename, since refs may be hard linked into a set based on this one
+        if (fclose(out) != 0 || rename(tmp_path, ref_path) != 0) {
+            fprintf(stderr, "Warning: Failed to update model reference file for %s\n", model);
+            unlink(tmp_path);
+        }
+    }
+}
+
+static eb_status_t restore_log(const char* log_path, const eb_set_index_change_t* changes, size_t count) {
+    FILE* f = fopen(log_path, "a");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+    long now = (long)time(NULL);
+    for (size_t i = 0; i < count; i++) {
+        const char* hash = changes[i].hash ? changes[i].hash : EB_LOG_TOMBSTONE;
+        if (changes[i].model[0])
+            fprintf(f, "%ld %s %s %s\n", now, hash, changes[i].source, changes[i].model);
+        else
+            fprintf(f, "%ld %s %s\n", now, hash, changes[i].source);
+    }
+    if (fclose(f) != 0)
+        return EB_ERROR_FILE_IO;
+    if (eb_log_index_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("eb_set_state_restore: Failed to update log index for %s", log_path);
+    if (eb_checkpoint_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("eb_set_state_restore: Failed to checkpoint %s", log_path);
+    return EB_SUCCESS;
+}
+
+static int compare_string(const void* key, const void* item) {
+    return strcmp(key, *(const char* const*)item);
+}
+
+eb_status_t eb_set_state_restore(const char* root, const char* set_dir, const eb_set_state_t* state,
+                                 eb_set_restore_summary_t* summary) {
+    if (!root || !set_dir || !state)
+        return EB_ERROR_INVALID_INPUT;
+    eb_set_restore_summary_t local;
+    if (!summary)
+        summary = &local;
+    memset(summary, 0, sizeof(*summary));
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/index", set_dir);
+    eb_set_index_t* index = NULL;
+    entry_list_t current = { 0 };
+    eb_status_t status = eb_set_index_open(root, path, &index);
+    if (status == EB_SUCCESS) {
+        status = eb_set_index_foreach(index, NULL, collect_entry, &current);
+        eb_set_index_close(index);
+        if (status == EB_SUCCESS && current.failed)
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+    if (status == EB_SUCCESS && current.count > 1)
+        qsort(current.items, current.count, sizeof(*current.items), compare_state_entries);
+
+    // Removals first: removing an entry without a model clears its source
+    // for every model, so the state's entries for such sources go back in
+    size_t total = current.count + state->count;
+    eb_set_index_change_t* changes = NULL;
+    bool* differs = NULL;
+    const char** cleared = NULL;
+    if (status == EB_SUCCESS) {
+        changes = malloc((total ? total : 1) * sizeof(*changes));
+        differs = calloc(state->count ? state->count : 1, sizeof(*differs));
+        cleared = malloc((current.count ? current.count : 1) * sizeof(*cleared));
+        if (!changes || !differs || !cleared)
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t count = 0, cleared_count = 0;
+    if (status == EB_SUCCESS) {
+        size_t i = 0, j = 0;
+        while (i < current.count || j < state->count) {
+            int cmp = i == current.count ? 1 : j == state->count ? -1 :
+                      compare_state_entries(&current.items[i], &state->items[j]);
+            if (cmp < 0) {
+                const eb_set_state_entry_t* e = &current.items[i++];
+                changes[count++] = (eb_set_index_change_t){ e->source, e->model, NULL };
+                if (!e->model[0])
+                    cleared[cleared_count++] = e->source;
+                summary->removed++;
+            } else if (cmp > 0) {
+                differs[j++] = true;
+            } else {
+                differs[j] = strcmp(current.items[i].hash, state->items[j].hash) != 0;
+                i++;
+                j++;
+            }
+        }
+        for (j = 0; j < state->count; j++) {
+            const eb_set_state_entry_t* e = &state->items[j];
+            if (differs[j])
+                summary->restored++;
+            else if (!cleared_count || !bsearch(e->source, cleared, cleared_count, sizeof(*cleared), compare_string))
+                continue;
+            changes[count++] = (eb_set_index_change_t){ e->source, e->model, e->hash };
+        }
+    }
+
+    if (status == EB_SUCCESS && count > 0) {
+        status = eb_set_index_apply(root, path, changes, count);
+        if (status == EB_SUCCESS && is_current_index(path) &&
+            eb_hnsw_apply(root, changes, count) != EB_SUCCESS)
+            fprintf(stderr, "warning: failed to update vector index, run 'embr index build'\n");
+    }
+    if (status == EB_SUCCESS && count > 0) {
+        snprintf(path, sizeof(path), "%s/log", set_dir);
+        if (restore_log(path, changes, count) != EB_SUCCESS)
+            fprintf(stderr, "Warning: Failed to update history\n");
+        restore_model_refs(set_dir, changes, count);
+    }
+
+    free(changes);
+    free(differs);
+    free(cleared);
+    for (size_t i = 0; i < current.count; i++) {
+        free(current.items[i].source);
+        free(current.items[i].model);
+    }
+    free(current.items);
+    return status;
+}
+
+static eb_status_t write_checkpoint(const char* dir_path, replay_t* r, uint64_t own_end,
+                                    uint64_t fingerprint) {
+    finish_state(r);
+    eb_checkpoint_header_t header = {0};
+    header.magic = EB_CHECKPOINT_MAGIC;
+    header.version = EB_CHECKPOINT_VERSION;
+    header.seq = r->seq;
+    header.log_offset = own_end;
+    header.log_entries = r->own_entries;
+    header.fingerprint = fingerprint;
+    header.max_time = (int64_t)r->max_time;
+    header.created = (int64_t)time(NULL);
+    header.count = r->count;
+
+    char path[PATH_MAX], tmp[PATH_MAX + 16];
+    checkpoint_path(dir_path, r->seq, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    if (mkdir(dir_path, 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+    FILE* f = fopen(tmp, "wb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+
+    for (size_t i = 0; i < r->count; i++)
+        header.names_size += strlen(r->items[i].source) + strlen(r->items[i].model);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t name_offset = 0;
+    for (size_t i = 0; ok && i < r->count; i++) {
+        const eb_set_state_entry_t* e = &r->items[i];
+        eb_checkpoint_record_t rec = {0};
+        ok = eb_hex_to_hash(e->hash, rec.hash);
+        rec.timestamp = (int64_t)e->timestamp;
+        rec.name_offset = name_offset;
+        rec.source_len = (uint32_t)strlen(e->source);
+        rec.model_len = (uint32_t)strlen(e->model);
+        name_offset += rec.source_len + rec.model_len;
+        ok = ok && fwrite(&rec, sizeof(rec), 1, f) == 1;
+    }
+    for (size_t i = 0; ok && i < r->count; i++) {
+        const eb_set_state_entry_t* e = &r->items[i];
+        ok = fputs(e->source, f) >= 0 && fputs(e->model, f) >= 0;
+    }
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0)
+        ok = false;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+/* Keep the newest checkpoints, then one at each doubling of distance */
+static void thin_checkpoints(const char* dir_path) {
+    uint64_t* seqs = NULL;
+    size_t count = 0;
+    if (list_checkpoints(dir_path, &seqs, &count) != EB_SUCCESS || count <= EB_CHECKPOINT_KEEP) {
+        free(seqs);
+        return;
+    }
+    uint64_t kept = seqs[count - EB_CHECKPOINT_KEEP];
+    uint64_t gap = 2 * (uint64_t)EB_CHECKPOINT_EVERY;
+    for (size_t n = count - EB_CHECKPOINT_KEEP; n > 0; n--) {
+        uint64_t seq = seqs[n - 1];
+        if (kept - seq >= gap) {
+            kept = seq;
+            gap *= 2;
+            continue;
+        }
+        char path[PATH_MAX];
+        checkpoint_path(dir_path, seq, path, sizeof(path));
+        unlink(path);
+    }
+    free(seqs);
+}
+
+eb_status_t eb_checkpoint_write(const char* log_path) {
+    if (!log_path)
+        return EB_ERROR_INVALID_INPUT;
+
+    replay_t r;
+    if (!replay_init(&r, NULL))
+        return EB_ERROR_MEMORY_ALLOCATION;
+    uint64_t own_end = 0, fingerprint = 0;
+    eb_status_t status = replay(log_path, &r, true, &own_end);
+    if (status == EB_SUCCESS && r.own_entries > 0)
+        status = eb_log_fingerprint(log_path, own_end, &fingerprint);
+
+    // Nothing of the set's own yet; the layers need no checkpoint of it
+    if (status == EB_SUCCESS && r.own_entries > 0) {
+        char dir_path[PATH_MAX];
+        checkpoint_dir(log_path, dir_path, sizeof(dir_path));
+        status = write_checkpoint(dir_path, &r, own_end, fingerprint);
+        if (status == EB_SUCCESS)
+            thin_checkpoints(dir_path);
+    }
+    replay_free(&r);
+    return status;
+}
+
+eb_status_t eb_checkpoint_update(const char* log_path) {
+    if (!log_path)
+        return EB_ERROR_INVALID_INPUT;
+
+    uint64_t entries = 0;
+    eb_status_t status = eb_log_index_stat(log_path, &entries, NULL);
+    if (status != EB_SUCCESS)
+        return status;
+
+    char path[PATH_MAX];
+    eb_checkpoint_header_t header;
+    bool found = find_checkpoint(log_path, NULL, true, path, sizeof(path), &header);
+    uint64_t covered = found ? header.log_entries : 0;
+    uint64_t added = entries > covered ? entries - covered : 0;
+    time_t since = time(NULL) - (found ? (time_t)header.created : 0);
+    if (added >= EB_CHECKPOINT_EVERY || (added >= EB_CHECKPOINT_MIN && since >= EB_CHECKPOINT_INTERVAL))
+        return eb_checkpoint_write(log_path);
+    return EB_SUCCESS;
+}
+
+void eb_checkpoint_remove_all(const char* set_dir) {
+    if (!set_dir)
+        return;
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s/%s", set_dir, EB_CHECKPOINT_DIR);
+    DIR* dir = opendir(dir_path);
+    if (!dir)
+        return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        unlink(path);
+    }
+    closedir(dir);
+    rmdir(dir_path);
+}
+
+eb_status_t eb_set_point_parse(const char* text, eb_set_point_t* out) {
+    if (!text || !*text || !out)
+        return EB_ERROR_INVALID_INPUT;
+    memset(out, 0, sizeof(*out));
+
+    char* end = NULL;
+    if (isdigit((unsigned char)text[0])) {
+        errno = 0;
+        unsigned long long seq = strtoull(text, &end, 10);
+        if (errno == 0 && *end == '\0') {
+            out->kind = EB_SET_POINT_SEQ;
+            out->seq = seq;
+            return EB_SUCCESS;
+        }
+    }
+    if (text[0] == '@' && isdigit((unsigned char)text[1])) {
+        errno = 0;
+        long long t = strtoll(text + 1, &end, 10);
+        if (errno != 0 || *end != '\0')
+            return EB_ERROR_INVALID_INPUT;
+        out->kind = EB_SET_POINT_TIME;
+        out->time = (time_t)t;
+        return EB_SUCCESS;
+    }
+
+    static const char* formats[] = {
+        "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d %H:%M", "%Y-%m-%d"
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(text, formats[i], &tm);
+        if (end && *end == '\0') {
+            tm.tm_isdst = -1;
+            time_t t = mktime(&tm);
+            if (t == (time_t)-1)
+                return EB_ERROR_INVALID_INPUT;
+            out->kind = EB_SET_POINT_TIME;
+            out->time = t;
+            return EB_SUCCESS;
+        }
+    }
+    return EB_ERROR_INVALID_INPUT;
+}
@@ -0,0 +1,171 @@
+/*
+ * EmbeddingBridge - Set Log Checkpoints
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_CHECKPOINT_H
+#define EB_SET_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "status.h"
+
+/*
+ * The state of a set at a point in its history is the log replayed up to
+ * that point: the newest entry of each (source, model) wins. Checkpoints
+ * keep that replay short. Each is a sorted snapshot of the state after
+ * the first <seq> log entries:
+ *
+ *   .embr/sets/<set>/checkpoints/<seq>   header | records | name table
+ *
+ * Sequence numbers count the entries of the whole history, base layers
+ * (set_layers.h) first. The header remembers where in the set's own log
+ * the snapshot ends and a fingerprint of the bytes before that point, so
+ * a checkpoint of a log that has since been rewritten is ignored.
+ *
+ * Log writers call eb_checkpoint_update() after appending. It writes a
+ * checkpoint once EB_CHECKPOINT_EVERY entries have been added since the
+ * last one, or once EB_CHECKPOINT_INTERVAL has passed with at least
+ * EB_CHECKPOINT_MIN added. Older checkpoints are thinned out at doubling
+ * distances, so their number only grows with the logarithm of the log's
+ * length. Reading a point costs one checkpoint load and the replay of the
+ * entries after it.
+ *
+ * Tombstones (see log_index.h) remove their entry from the state.
+ *
+ * A point in time is the log up to the first entry stamped later: the
+ * log is written in time order, so this is the set as it stood then.
+ */
+
+#define EB_CHECKPOINT_DIR      "checkpoints"
+#define EB_CHECKPOINT_MAGIC    0x4542434b  /* "EBCK" */
+#define EB_CHECKPOINT_VERSION  1
+
+#define EB_CHECKPOINT_EVERY    10000       /* Log entries between checkpoints */
+#define EB_CHECKPOINT_INTERVAL (15 * 60)   /* Seconds before a smaller one is due */
+#define EB_CHECKPOINT_MIN      256         /* Entries that make a smaller one worth writing */
+#define EB_CHECKPOINT_KEEP     4           /* Newest checkpoints never thinned */
+
+typedef struct {
+    uint32_t magic;         /* EB_CHECKPOINT_MAGIC */
+    uint32_t version;       /* EB_CHECKPOINT_VERSION */
+    uint64_t seq;           /* Log entries replayed, layers included */
+    uint64_t log_offset;    /* Bytes of the set's own log covered */
+    uint64_t log_entries;   /* Entries of the set's own log covered */
+    uint64_t fingerprint;   /* eb_log_fingerprint() of the own log at log_offset */
+    int64_t max_time;       /* Newest timestamp among the entries replayed */
+    int64_t created;        /* When the checkpoint was written */
+    uint64_t count;         /* Records */
+    uint64_t names_size;    /* Bytes in the name table */
+    uint64_t reserved[2];
+} eb_checkpoint_header_t;
+
+typedef struct {
+    uint8_t hash[32];
+    int64_t timestamp;      /* Of the log entry that set it */
+    uint64_t name_offset;   /* Source followed by model, unterminated */
+    uint32_t source_len;
+    uint32_t model_len;
+} eb_checkpoint_record_t;
+
+typedef enum {
+    EB_SET_POINT_END = 0,   /* The whole log */
+    EB_SET_POINT_SEQ,       /* After the first seq entries */
+    EB_SET_POINT_TIME       /* Before the first entry stamped after time */
+} eb_set_point_kind_t;
+
+typedef struct {
+    eb_set_point_kind_t kind;
+    uint64_t seq;
+    time_t time;
+} eb_set_point_t;
+
+typedef struct {
+    char* source;
+    char* model;            /* "" if none was recorded */
+    char hash[65];
+    time_t timestamp;
+} eb_set_state_entry_t;
+
+typedef struct {
+    eb_set_state_entry_t* items;    /* Sorted by source, then model */
+    size_t count;
+    uint64_t seq;           /* Log entries the state covers */
+    time_t max_time;        /* Newest timestamp among them, 0 if none */
+    uint64_t replayed;      /* Of those, entries read from the log */
+} eb_set_state_t;
+
+/**
+ * Parse a point: a sequence number, "@<unix time>", or a local date and
+ * time as "YYYY-MM-DD", "YYYY-MM-DD HH:MM[:SS]" or "YYYY-MM-DDTHH:MM[:SS]"
+ *
+ * @return Status code (0 = success, EB_ERROR_INVALID_INPUT if unreadable)
+ */
+eb_status_t eb_set_point_parse(const char* text, eb_set_point_t* out);
+
+/**
+ * State of a set at a point
+ *
+ * @param log_path The set's log
+ * @param at Point, NULL for the end
+ * @param out Receives the state, free with eb_set_state_free()
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_state_at(const char* log_path, const eb_set_point_t* at, eb_set_state_t* out);
+
+void eb_set_state_free(eb_set_state_t* state);
+
+typedef struct {
+    size_t restored;        /* Entries recorded with a different object */
+    size_t removed;         /* Entries the state does not hold */
+} eb_set_restore_summary_t;
+
+/**
+ * Make a set hold exactly the entries of a state
+ *
+ * Only the differences are written: one index commit, which also updates
+ * the vector index when the set is current, one log append for the
+ * entries recorded and the tombstones of those removed, and one rewrite
+ * of each model ref file touched.
+ *
+ * @param root Repository root
+ * @param set_dir Directory of the set to change
+ * @param state State to restore
+ * @param summary Optional counts of the changes
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_state_restore(const char* root, const char* set_dir, const eb_set_state_t* state,
+                                 eb_set_restore_summary_t* summary);
+
+/**
+ * Write a checkpoint if one is due
+ *
+ * Cheap when none is: reads the log index header and the checkpoint names.
+ *
+ * @param log_path The set's log, after appending to it
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_checkpoint_update(const char* log_path);
+
+/**
+ * Write a checkpoint of the whole log now
+ *
+ * @param log_path The set's log
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_checkpoint_write(const char* log_path);
+
+/**
+ * Delete the checkpoints of a set
+ *
+ * @param set_dir Set directory
+ */
+void eb_checkpoint_remove_all(const char* set_dir);
+
+#endif /* EB_SET_CHECKPOINT_H */
@@ -0,0 +1,311 @@
+/*
+ * EmbeddingBridge - Set Compaction Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "set_compact.h"
+#include "set_index.h"
+#include "set_layers.h"
+#include "set_checkpoint.h"
+#include "log_index.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/* Newest tombstone of each (source, model), by line number; model "" for every model */
+typedef struct {
+    char* source;
+    char* model;
+    uint64_t key;
+    uint64_t line;
+} tombstone_t;
+
+struct eb_tombstones {
+    tombstone_t* slots;         /* source NULL for empty */
+    size_t slot_count;          /* Power of two, at least twice count */
+    size_t count;
+    uint64_t line;              /* Lines seen so far */
+    bool failed;
+};
+
+typedef struct eb_tombstones tombstone_table_t;
+
+static uint64_t entry_key(const char* source, const char* model) {
+    uint64_t h = FNV_OFFSET;
+    for (const char* p = source; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= FNV_PRIME;
+    }
+    h *= FNV_PRIME;
+    for (const char* p = model; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static tombstone_t* find_slot(tombstone_t* slots, size_t slot_count, uint64_t key,
+                              const char* source, const char* model) {
+    size_t mask = slot_count - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+        tombstone_t* t = &slots[i];
+        if (!t->source || (t->key == key && strcmp(t->source, source) == 0 &&
+                           strcmp(t->model, model) == 0))
+            return t;
+    }
+}
+
+static bool table_grow(tombstone_table_t* table) {
+    size_t slot_count = table->slot_count ? table->slot_count * 2 : 1024;
+    tombstone_t* slots = calloc(slot_count, sizeof(*slots));
+    if (!slots)
+        return false;
+    for (size_t i = 0; i < table->slot_count; i++) {
+        tombstone_t* t = &table->slots[i];
+        if (t->source)
+            *find_slot(slots, slot_count, t->key, t->source, t->model) = *t;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return true;
+}
+
+static void table_free(tombstone_table_t* table) {
+    for (size_t i = 0; i < table->slot_count; i++) {
+        free(table->slots[i].source);
+        free(table->slots[i].model);
+    }
+    free(table->slots);
+}
+
+static const tombstone_t* table_lookup(const tombstone_table_t* table, const char* source,
+                                       const char* model) {
+    if (table->count == 0)
+        return NULL;
+    tombstone_t* t = find_slot(table->slots, table->slot_count, entry_key(source, model),
+                               source, model);
+    return t->source ? t : NULL;
+}
+
+static int find_tombstone(const eb_log_entry_t* entry, void* ctx) {
+    tombstone_table_t* table = ctx;
+    uint64_t line = table->line++;
+    if (!entry->removed)
+        return 0;
+
+    if ((table->count + 1) * 2 > table->slot_count && !table_grow(table)) {
+        table->failed = true;
+        return 1;
+    }
+    uint64_t key = entry_key(entry->source, entry->model);
+    tombstone_t* t = find_slot(table->slots, table->slot_count, key, entry->source, entry->model);
+    if (!t->source) {
+        t->source = strdup(entry->source);
+        t->model = strdup(entry->model);
+        if (!t->source || !t->model) {
+            free(t->source);
+            free(t->model);
+            t->source = t->model = NULL;
+            table->failed = true;
+            return 1;
+        }
+        t->key = key;
+        table->count++;
+    }
+    t->line = line;
+    return 0;
+}
+
+eb_status_t eb_tombstones_load(const char* log_path, eb_tombstones_t** out) {
+    if (!log_path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    tombstone_table_t* table = calloc(1, sizeof(*table));
+    if (!table)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    eb_status_t status = eb_log_foreach_range(log_path, 0, UINT64_MAX, find_tombstone, table, NULL);
+    if (status == EB_SUCCESS && table->failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status != EB_SUCCESS) {
+        eb_tombstones_free(table);
+        return status;
+    }
+    *out = table;
+    return EB_SUCCESS;
+}
+
+size_t eb_tombstones_count(const eb_tombstones_t* tombstones) {
+    return tombstones ? tombstones->count : 0;
+}
+
+bool eb_tombstones_newest(const eb_tombstones_t* tombstones, const char* source,
+                          const char* model, uint64_t* line_out) {
+    if (!tombstones)
+        return false;
+    // A tombstone without a model covers every model of its source
+    const tombstone_t* t = table_lookup(tombstones, source, model);
+    const tombstone_t* all = model[0] ? table_lookup(tombstones, source, "") : NULL;
+    if (all && (!t || all->line > t->line))
+        t = all;
+    if (t && line_out)
+        *line_out = t->line;
+    return t != NULL;
+}
+
+void eb_tombstones_free(eb_tombstones_t* tombstones) {
+    if (!tombstones)
+        return;
+    table_free(tombstones);
+    free(tombstones);
+}
+
+typedef struct {
+    const tombstone_table_t* table;
+    FILE* out;
+    bool layered;               /* Keep the newest tombstones over the base layers */
+    uint64_t line;
+    eb_set_compact_summary_t* summary;
+    bool failed;
+} rewrite_t;
+
+static int rewrite_line(const eb_log_entry_t* entry, void* ctx) {
+    rewrite_t* w = ctx;
+    uint64_t line = w->line++;
+    uint64_t ended;
+    if (eb_tombstones_newest(w->table, entry->source, entry->model, &ended) &&
+        (line < ended || (line == ended && !w->layered))) {
+        w->summary->dropped++;
+        return 0;
+    }
+
+    int written = entry->model[0]
+        ? fprintf(w->out, "%ld %s %s %s\n", (long)entry->timestamp, entry->hash, entry->source, entry->model)
+        : fprintf(w->out, "%ld %s %s\n", (long)entry->timestamp, entry->hash, entry->source);
+    if (written < 0) {
+        w->failed = true;
+        return 1;
+    }
+    w->summary->kept++;
+    return 0;
+}
+
+/* Drop the lines the tombstones of the set's own log cover */
+static eb_status_t compact_log(const char* set_dir, eb_set_compact_summary_t* summary) {
+    char log_path[PATH_MAX], tmp_path[PATH_MAX + 16];
+    snprintf(log_path, sizeof(log_path), "%s/log", set_dir);
+
+    tombstone_table_t* table = NULL;
+    eb_status_t status = eb_tombstones_load(log_path, &table);
+    if (status != EB_SUCCESS)
+        return status;
+    summary->tombstones = table->count;
+    if (table->count == 0) {
+        summary->kept = table->line;
+        eb_tombstones_free(table);
+        return EB_SUCCESS;
+    }
+
+    eb_set_layers_t layers;
+    status = eb_set_layers_load(set_dir, &layers);
+    bool layered = status == EB_SUCCESS && layers.count > 0;
+    eb_set_layers_free(&layers);
+    if (status != EB_SUCCESS) {
+        eb_tombstones_free(table);
+        return status;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", log_path, (int)getpid());
+    FILE* out = fopen(tmp_path, "w");
+    if (!out) {
+        eb_tombstones_free(table);
+        return EB_ERROR_FILE_IO;
+    }
+    rewrite_t w = { table, out, layered, 0, summary, false };
+    status = eb_log_foreach_range(log_path, 0, UINT64_MAX, rewrite_line, &w, NULL);
+    eb_tombstones_free(table);
+    if (status == EB_SUCCESS && w.failed)
+        status = EB_ERROR_FILE_IO;
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0)
+        status = EB_ERROR_FILE_IO;
+    if (fclose(out) != 0)
+        status = EB_ERROR_FILE_IO;
+
+    // A rename, since the log may be hard linked into a set based on this one
+    if (status != EB_SUCCESS || rename(tmp_path, log_path) != 0) {
+        unlink(tmp_path);
+        return status != EB_SUCCESS ? status : EB_ERROR_FILE_IO;
+    }
+
+    // Checkpoints count the dropped lines and would no longer match
+    eb_checkpoint_remove_all(set_dir);
+    if (eb_log_index_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("eb_set_compact: Failed to rebuild log index for %s", log_path);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_set_compact(const char* root, const char* set_dir, eb_set_compact_summary_t* summary) {
+    if (!root || !set_dir)
+        return EB_ERROR_INVALID_INPUT;
+    eb_set_compact_summary_t local;
+    if (!summary)
+        summary = &local;
+    memset(summary, 0, sizeof(*summary));
+
+    struct stat st;
+    if (stat(set_dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+
+    char path[PATH_MAX + 8];
+    snprintf(path, sizeof(path), "%s/index", set_dir);
+    eb_status_t status = eb_set_index_compact(root, path, &summary->index_compacted);
+    if (status == EB_SUCCESS)
+        status = compact_log(set_dir, summary);
+    return status;
+}
+
+eb_status_t eb_set_compact_all(const char* root) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+    char sets_dir[PATH_MAX];
+    snprintf(sets_dir, sizeof(sets_dir), "%s/.embr/sets", root);
+    DIR* dir = opendir(sets_dir);
+    if (!dir)
+        return EB_SUCCESS;
+
+    eb_status_t first = EB_SUCCESS;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        char set_dir[PATH_MAX];
+        struct stat st;
+        snprintf(set_dir, sizeof(set_dir), "%s/%s", sets_dir, entry->d_name);
+        if (stat(set_dir, &st) != 0 || !S_ISDIR(st.st_mode))
+            continue;
+        eb_status_t status = eb_set_compact(root, set_dir, NULL);
+        if (status != EB_SUCCESS) {
+            DEBUG_PRINT("eb_set_compact_all: Failed to compact %s (%d)", set_dir, status);
+            if (first == EB_SUCCESS)
+                first = status;
+        }
+    }
+    closedir(dir);
+    return first;
+}
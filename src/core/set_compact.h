@@ -0,0 +1,100 @@
+/*
+ * EmbeddingBridge - Set Compaction
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_COMPACT_H
+#define EB_SET_COMPACT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "status.h"
+
+/*
+ * `embr rm` only appends: a removal record to the set index and a
+ * tombstone line to the log (see log_index.h), so removing a file costs
+ * the same whatever the size of the set. Compaction, run by `embr set
+ * compact` and by `embr gc`, later folds that into the files:
+ *
+ *   - the index tail is merged into its sorted block (eb_set_index_compact)
+ *   - every log line of a (source, model) at or before its newest
+ *     tombstone is dropped, so the removed history is purged and its
+ *     objects become garbage for the next collection
+ *
+ * A set created from another one keeps its newest tombstones, which also
+ * hide the history it shares with its base. That history itself stays
+ * in the base, as does the base's own history in the sets created from
+ * it before the removal.
+ *
+ * The log is rewritten through a temporary file and a rename, like
+ * flatten, so writers must not append to the set meanwhile.
+ */
+
+typedef struct {
+    size_t tombstones;          /* Tombstones found in the set's own log */
+    size_t dropped;             /* Log lines dropped */
+    size_t kept;                /* Log lines left */
+    bool index_compacted;       /* The index had a tail to fold in */
+} eb_set_compact_summary_t;
+
+/**
+ * Compact the index and log of one set
+ *
+ * @param root Repository root
+ * @param set_dir Set directory
+ * @param summary Optional counts
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_compact(const char* root, const char* set_dir, eb_set_compact_summary_t* summary);
+
+/**
+ * Compact every set of a repository
+ *
+ * @param root Repository root
+ * @return Status code of the first set that failed (0 = success)
+ */
+eb_status_t eb_set_compact_all(const char* root);
+
+/*
+ * The newest tombstone of each (source, model) of one log file, for
+ * readers that skip the history compaction would drop. Lines are
+ * numbered from 0 in the order eb_log_foreach_range() visits them.
+ */
+typedef struct eb_tombstones eb_tombstones_t;
+
+/**
+ * Read the tombstones of a log file, without its base layers
+ *
+ * @param log_path Log file
+ * @param out Receives the tombstones, free with eb_tombstones_free()
+ * @return Status code (0 = success, also when the log does not exist)
+ */
+eb_status_t eb_tombstones_load(const char* log_path, eb_tombstones_t** out);
+
+/* Number of (source, model) pairs with a tombstone */
+size_t eb_tombstones_count(const eb_tombstones_t* tombstones);
+
+/**
+ * Line of the newest tombstone that ends the history of (source, model)
+ *
+ * A tombstone without a model ends the history of every model of its
+ * source.
+ *
+ * @param tombstones Tombstones of the log
+ * @param source Source path
+ * @param model Model, "" for none
+ * @param line_out Optional, receives the line of the tombstone
+ * @return true if a tombstone covers the pair
+ */
+bool eb_tombstones_newest(const eb_tombstones_t* tombstones, const char* source,
+                          const char* model, uint64_t* line_out);
+
+void eb_tombstones_free(eb_tombstones_t* tombstones);
+
+#endif /* EB_SET_COMPACT_H */
@@ -0,0 +1,461 @@
+/*
+ * EmbeddingBridge - Set-to-Set Vector Drift Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "set_drift.h"
+#include "set_index.h"
+#include "distance.h"
+#include "quantize.h"
+#include "store.h"
+#include "types.h"
+#include "debug.h"
+#include "thread_pool.h"
+#include "object_reader.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Pairs claimed by a worker at a time */
+#define PAIR_BLOCK 64
+
+typedef struct {
+    char* source;
+    char* model;
+    char hash[65];
+} drift_entry_t;
+
+typedef struct {
+    drift_entry_t* items;
+    size_t count;
+    size_t capacity;
+    const char* model;
+    bool failed;
+} entry_list_t;
+
+/* A pair present in both sets, scored by the workers */
+typedef struct {
+    const drift_entry_t* a;
+    const drift_entry_t* b;
+    eb_drift_state_t state;
+    float cosine;
+    float l2;
+    bool screened;
+} drift_pair_t;
+
+typedef struct {
+    const char* root;
+    drift_pair_t* pairs;
+    size_t count;
+    size_t prefix_dims;         /* 0 to score at full dimensions */
+    size_t next_block;
+    size_t done;                /* Pairs scored, for detecting idle workers */
+} drift_job_t;
+
+static int collect_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    entry_list_t* list = ctx;
+    if (list->model && strcmp(list->model, model) != 0)
+        return 0;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        drift_entry_t* grown = realloc(list->items, capacity * sizeof(*grown));
+        if (!grown) {
+            list->failed = true;
+            return 1;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    drift_entry_t* e = &list->items[list->count];
+    e->source = strdup(source);
+    e->model = strdup(model);
+    if (!e->source || !e->model) {
+        free(e->source);
+        free(e->model);
+        list->failed = true;
+        return 1;
+    }
+    memcpy(e->hash, hash, 65);
+    list->count++;
+    return 0;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const drift_entry_t* x = a;
+    const drift_entry_t* y = b;
+    int cmp = strcmp(x->source, y->source);
+    return cmp ? cmp : strcmp(x->model, y->model);
+}
+
+static void free_entries(entry_list_t* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->items[i].source);
+        free(list->items[i].model);
+    }
+    free(list->items);
+}
+
+static bool valid_set_name(const char* name) {
+    return name && *name && strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+           strcmp(name, "..") != 0;
+}
+
+/* Live entries of a set, sorted by source then model */
+static eb_status_t load_set(const char* root, const char* name, const char* model,
+                            entry_list_t* list) {
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s", root, name);
+    if (!valid_set_name(name) || stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s/index", root, name);
+
+    eb_set_index_t* index = NULL;
+    eb_status_t status = eb_set_index_open(root, path, &index);
+    if (status != EB_SUCCESS)
+        return status;
+    list->model = model;
+    status = eb_set_index_foreach(index, NULL, collect_entry, list);
+    eb_set_index_close(index);
+    if (status == EB_SUCCESS && list->failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS)
+        qsort(list->items, list->count, sizeof(*list->items), compare_entries);
+    return status;
+}
+
+/* Squared L2 distance from the norms and the cosine of two vectors */
+static float squared_l2_from_cosine(const eb_vector_ref_t* a, const eb_vector_ref_t* b, float cosine) {
+    float norm_a = a->norm >= 0.0f ? a->norm : eb_vector_norm(a);
+    float norm_b = b->norm >= 0.0f ? b->norm : eb_vector_norm(b);
+    return norm_a * norm_a + norm_b * norm_b - 2.0f * norm_a * norm_b * cosine;
+}
+
+static void score_pair(eb_store_t* store, drift_pair_t* pair, size_t prefix_dims);
+
+// Screening reads prefixes, which a hash check over the whole payload would defeat
+static uint32_t screen_flags(size_t prefix_dims) {
+    return prefix_dims ? EB_OBJECT_MAP_UNVERIFIED : 0;
+}
+
+/* Score a pair from both of its objects, unmapping them */
+static void score_views(eb_store_t* store, drift_pair_t* pair, eb_object_view_t* view_a,
+                        eb_object_view_t* view_b, size_t prefix_dims) {
+    eb_vector_ref_t a, b;
+    pair->screened = false;
+    if (eb_object_vector_ref(view_a, &a) != EB_SUCCESS ||
+        eb_object_vector_ref(view_b, &b) != EB_SUCCESS) {
+        pair->state = EB_DRIFT_UNREADABLE;
+    } else if (a.dims != b.dims) {
+        pair->state = EB_DRIFT_DIMENSIONS;
+    } else if (prefix_dims && prefix_dims >= a.dims) {
+        // Nothing to leave out: score in full, hash check included
+        eb_object_unmap(view_b);
+        eb_object_unmap(view_a);
+        score_pair(store, pair, 0);
+        return;
+    } else {
+        eb_vector_ref_t full_a = a, full_b = b;
+        pair->screened = prefix_dims > 0;
+        if (pair->screened) {
+            eb_vector_ref_prefix(&full_a, prefix_dims, &a);
+            eb_vector_ref_prefix(&full_b, prefix_dims, &b);
+        }
+        eb_cosine_terms_t terms = eb_vector_cosine_terms(&a, &b);
+        float norms = sqrtf(terms.norm_a) * sqrtf(terms.norm_b);
+        float cosine;
+        if (norms > 0.0f)
+            cosine = 1.0f - terms.dot / norms;
+        else
+            cosine = terms.norm_a == terms.norm_b ? 0.0f : 1.0f;  // Zero vectors have no direction
+        pair->cosine = cosine < 0.0f ? 0.0f : cosine > 2.0f ? 2.0f : cosine;
+        float l2 = pair->screened ? squared_l2_from_cosine(&full_a, &full_b, 1.0f - pair->cosine)
+                                  : eb_vector_l2_squared(&a, &b);
+        pair->l2 = sqrtf(l2 > 0.0f ? l2 : 0.0f);
+        pair->state = isfinite(pair->cosine) && isfinite(pair->l2) ? EB_DRIFT_CHANGED : EB_DRIFT_UNREADABLE;
+    }
+    eb_object_unmap(view_b);
+    eb_object_unmap(view_a);
+}
+
+static void score_pair(eb_store_t* store, drift_pair_t* pair, size_t prefix_dims) {
+    uint32_t flags = screen_flags(prefix_dims);
+    eb_object_view_t view_a, view_b;
+    pair->screened = false;
+    if (eb_object_map(store, pair->a->hash, flags, &view_a) != EB_SUCCESS) {
+        pair->state = EB_DRIFT_UNREADABLE;
+        return;
+    }
+    if (eb_object_map(store, pair->b->hash, flags, &view_b) != EB_SUCCESS) {
+        eb_object_unmap(&view_a);
+        pair->state = EB_DRIFT_UNREADABLE;
+        return;
+    }
+    score_views(store, pair, &view_a, &view_b, prefix_dims);
+}
+
+/* Objects of a block of pairs, a at 2i and b at 2i + 1 */
+typedef struct {
+    eb_object_view_t views[2 * PAIR_BLOCK];
+    bool read[2 * PAIR_BLOCK];
+} pair_views_t;
+
+static int keep_view(void* ctx, size_t index, eb_status_t status, eb_object_view_t* view) {
+    pair_views_t* block = ctx;
+    if (status == EB_SUCCESS) {
+        block->views[index] = *view;
+        memset(view, 0, sizeof(*view));
+        block->read[index] = true;
+    }
+    return 0;
+}
+
+/* Read the objects of pairs [first, end) in one batch and score them */
+static void score_block(eb_store_t* store, drift_job_t* job, size_t first, size_t end) {
+    pair_views_t block;
+    const char* hashes[2 * PAIR_BLOCK];
+    size_t count = end - first;
+    for (size_t i = 0; i < count; i++) {
+        hashes[2 * i] = job->pairs[first + i].a->hash;
+        hashes[2 * i + 1] = job->pairs[first + i].b->hash;
+    }
+    memset(block.read, 0, sizeof(block.read));
+    eb_object_read_options_t options = { .flags = screen_flags(job->prefix_dims) };
+    eb_object_read_many(store, hashes, 2 * count, &options, keep_view, &block);
+
+    for (size_t i = 0; i < count; i++) {
+        drift_pair_t* pair = &job->pairs[first + i];
+        if (block.read[2 * i] && block.read[2 * i + 1]) {
+            score_views(store, pair, &block.views[2 * i], &block.views[2 * i + 1], job->prefix_dims);
+            continue;
+        }
+        if (block.read[2 * i])
+            eb_object_unmap(&block.views[2 * i]);
+        if (block.read[2 * i + 1])
+            eb_object_unmap(&block.views[2 * i + 1]);
+        pair->screened = false;
+        pair->state = EB_DRIFT_UNREADABLE;
+    }
+}
+
+/* Claim blocks of pairs until none are left; a worker without a store leaves them to the others */
+static void drift_worker(void* arg) {
+    drift_job_t* job = arg;
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = (char*)job->root };
+    if (eb_store_init(&config, &store) != EB_SUCCESS)
+        return;
+
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * PAIR_BLOCK;
+        if (first >= job->count)
+            break;
+        size_t end = job->count - first < PAIR_BLOCK ? job->count : first + PAIR_BLOCK;
+        score_block(store, job, first, end);
+        __atomic_fetch_add(&job->done, end - first, __ATOMIC_RELAXED);
+    }
+
+    eb_store_destroy(store);
+}
+
+static eb_status_t score_pairs(const char* root, drift_pair_t* pairs, size_t count,
+                               size_t prefix_dims, unsigned threads) {
+    drift_job_t job = { root, pairs, count, prefix_dims, 0, 0 };
+
+    // The calling thread works too, so a busy pool only costs speed
+    eb_parallel_run(NULL, eb_pool_threads(threads, (count + PAIR_BLOCK - 1) / PAIR_BLOCK),
+                    drift_worker, &job);
+
+    // Pairs are only left over if no worker could open the store
+    return job.done == count ? EB_SUCCESS : EB_ERROR_NOT_INITIALIZED;
+}
+
+static int compare_drift(const void* x, const void* y) {
+    const drift_pair_t* a = *(const drift_pair_t* const*)x;
+    const drift_pair_t* b = *(const drift_pair_t* const*)y;
+    if (a->cosine != b->cosine)
+        return a->cosine > b->cosine ? -1 : 1;
+    return a < b ? -1 : a > b;
+}
+
+/* Score the refine most drifted screened pairs again at full dimensions */
+static eb_status_t refine_pairs(const char* root, drift_pair_t* pairs, size_t count,
+                                size_t refine, unsigned threads) {
+    drift_pair_t** screened = malloc((count ? count : 1) * sizeof(*screened));
+    if (!screened)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    size_t candidates = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (pairs[i].screened && pairs[i].state == EB_DRIFT_CHANGED)
+            screened[candidates++] = &pairs[i];
+    }
+    qsort(screened, candidates, sizeof(*screened), compare_drift);
+    if (refine > candidates)
+        refine = candidates;
+
+    eb_status_t status = EB_SUCCESS;
+    drift_pair_t* rescored = refine ? malloc(refine * sizeof(*rescored)) : NULL;
+    if (refine && !rescored)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS && refine) {
+        for (size_t i = 0; i < refine; i++)
+            rescored[i] = *screened[i];
+        status = score_pairs(root, rescored, refine, 0, threads);
+        for (size_t i = 0; i < refine && status == EB_SUCCESS; i++)
+            *screened[i] = rescored[i];
+    }
+    free(rescored);
+    free(screened);
+    return status;
+}
+
+static void add_to_summary(eb_drift_summary_t* summary, const eb_drift_pair_t* pair) {
+    static const float edges[EB_DRIFT_BINS - 1] = EB_DRIFT_BIN_EDGES;
+    switch (pair->state) {
+    case EB_DRIFT_ONLY_A:
+        summary->only_a++;
+        return;
+    case EB_DRIFT_ONLY_B:
+        summary->only_b++;
+        return;
+    case EB_DRIFT_DIMENSIONS:
+        summary->pairs++;
+        summary->dimensions++;
+        return;
+    case EB_DRIFT_UNREADABLE:
+        summary->pairs++;
+        summary->unreadable++;
+        return;
+    case EB_DRIFT_SAME:
+        summary->same++;
+        break;
+    case EB_DRIFT_CHANGED:
+        summary->changed++;
+        summary->screened += pair->screened;
+        break;
+    }
+
+    summary->pairs++;
+    summary->mean_cosine += pair->cosine;
+    summary->mean_l2 += pair->l2;
+    if (pair->cosine > summary->max_cosine)
+        summary->max_cosine = pair->cosine;
+    if (pair->l2 > summary->max_l2)
+        summary->max_l2 = pair->l2;
+    size_t bin = 0;
+    while (bin < EB_DRIFT_BINS - 1 && pair->cosine >= edges[bin])
+        bin++;
+    summary->histogram[bin]++;
+}
+
+eb_status_t eb_set_drift(const char* root, const char* set_a, const char* set_b,
+                         const eb_drift_options_t* options, eb_drift_visit_fn fn, void* ctx,
+                         eb_drift_summary_t* summary) {
+    if (!root || !set_a || !set_b)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_drift_summary_t local;
+    if (!summary)
+        summary = &local;
+    memset(summary, 0, sizeof(*summary));
+
+    const char* model = options ? options->model : NULL;
+    entry_list_t a = { 0 }, b = { 0 };
+    drift_pair_t* pairs = NULL;
+    eb_status_t status = load_set(root, set_a, model, &a);
+    if (status == EB_SUCCESS)
+        status = load_set(root, set_b, model, &b);
+
+    // Collect the pairs that need reading
+    size_t pair_count = 0;
+    if (status == EB_SUCCESS) {
+        size_t most = a.count < b.count ? a.count : b.count;
+        pairs = malloc((most ? most : 1) * sizeof(*pairs));
+        if (!pairs)
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+    if (status == EB_SUCCESS) {
+        for (size_t i = 0, j = 0; i < a.count && j < b.count; ) {
+            int cmp = compare_entries(&a.items[i], &b.items[j]);
+            if (cmp == 0) {
+                pairs[pair_count++] = (drift_pair_t){ &a.items[i], &b.items[j], EB_DRIFT_SAME, 0.0f, 0.0f, false };
+                i++;
+                j++;
+            } else if (cmp < 0) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+
+        size_t changed = 0;
+        for (size_t i = 0; i < pair_count; i++) {
+            if (strcmp(pairs[i].a->hash, pairs[i].b->hash) != 0)
+                pairs[changed++] = pairs[i];
+        }
+        size_t prefix_dims = options ? options->prefix_dims : 0;
+        unsigned threads = options ? options->threads : 0;
+        if (changed)
+            status = score_pairs(root, pairs, changed, prefix_dims, threads);
+        if (status == EB_SUCCESS && changed && prefix_dims && options->refine)
+            status = refine_pairs(root, pairs, changed, options->refine, threads);
+        pair_count = changed;
+    }
+
+    // Report every entry of both sets in order, with the scores of changed pairs
+    if (status == EB_SUCCESS) {
+        size_t i = 0, j = 0, p = 0;
+        while (i < a.count || j < b.count) {
+            int cmp = i == a.count ? 1 : j == b.count ? -1 : compare_entries(&a.items[i], &b.items[j]);
+            const drift_entry_t* entry = cmp <= 0 ? &a.items[i] : &b.items[j];
+            eb_drift_pair_t pair = {
+                entry->source, entry->model,
+                cmp <= 0 ? a.items[i].hash : NULL,
+                cmp >= 0 ? b.items[j].hash : NULL,
+                cmp < 0 ? EB_DRIFT_ONLY_A : cmp > 0 ? EB_DRIFT_ONLY_B : EB_DRIFT_SAME,
+                0.0f, 0.0f, false
+            };
+            if (cmp == 0 && p < pair_count && pairs[p].a == &a.items[i]) {
+                pair.state = pairs[p].state;
+                pair.cosine = pairs[p].cosine;
+                pair.l2 = pairs[p].l2;
+                pair.screened = pairs[p].screened;
+                p++;
+            }
+            if (cmp <= 0)
+                i++;
+            if (cmp >= 0)
+                j++;
+
+            add_to_summary(summary, &pair);
+            if (fn && fn(&pair, ctx) != 0)
+                break;
+        }
+
+        size_t scored = summary->same + summary->changed;
+        if (scored) {
+            summary->mean_cosine /= (double)scored;
+            summary->mean_l2 /= (double)scored;
+        }
+        DEBUG_INFO("set_drift: %zu pairs, %zu changed, %zu only in %s, %zu only in %s",
+                   summary->pairs, summary->changed, summary->only_a, set_a, summary->only_b, set_b);
+    }
+
+    free(pairs);
+    free_entries(&a);
+    free_entries(&b);
+    return status;
+}
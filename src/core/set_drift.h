@@ -0,0 +1,106 @@
+/*
+ * EmbeddingBridge - Set-to-Set Vector Drift
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_DRIFT_H
+#define EB_SET_DRIFT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+
+/*
+ * Compares the vectors two sets hold for the same documents. The set
+ * indexes are joined on (source, model); each pair present in both is
+ * read through eb_object_map() and scored by cosine distance and L2
+ * distance. Pairs with the same hash are identical and never read.
+ *
+ * Pairs are scored by a pool of workers, each with its own store, and
+ * reported in (source, model) order.
+ *
+ * With prefix_dims, vectors of models that keep their meaning in a
+ * dimension prefix (Matryoshka embeddings) are screened by their first
+ * values only: the cosine of the prefixes, and an L2 distance from it and
+ * the stored norms. Screening skips the hash check, so uncompressed
+ * objects are only read as far as the prefix. The refine pairs that drift
+ * most are then scored again at full dimensions.
+ */
+
+/* Upper edges of the cosine distance histogram; the last bin is open */
+#define EB_DRIFT_BINS 9
+#define EB_DRIFT_BIN_EDGES { 1e-6f, 1e-4f, 1e-3f, 1e-2f, 0.05f, 0.1f, 0.25f, 0.5f }
+
+typedef enum {
+    EB_DRIFT_SAME = 0,          /* Same object in both sets */
+    EB_DRIFT_CHANGED,           /* Different objects, scored */
+    EB_DRIFT_ONLY_A,            /* Only the first set has the pair */
+    EB_DRIFT_ONLY_B,            /* Only the second set has the pair */
+    EB_DRIFT_DIMENSIONS,        /* Vectors have different dimensions */
+    EB_DRIFT_UNREADABLE         /* An object could not be read */
+} eb_drift_state_t;
+
+typedef struct {
+    const char* source;
+    const char* model;          /* "" if none was recorded */
+    const char* hash_a;         /* NULL if only in the second set */
+    const char* hash_b;         /* NULL if only in the first set */
+    eb_drift_state_t state;
+    float cosine;               /* 1 - cos, SAME and CHANGED only */
+    float l2;                   /* Euclidean distance, SAME and CHANGED only */
+    bool screened;              /* Scores come from the prefix only */
+} eb_drift_pair_t;
+
+typedef struct {
+    size_t pairs;               /* Pairs present in both sets */
+    size_t same;
+    size_t changed;
+    size_t only_a;
+    size_t only_b;
+    size_t dimensions;
+    size_t unreadable;
+    size_t screened;            /* CHANGED pairs scored on the prefix only */
+    double mean_cosine;         /* Over SAME and CHANGED pairs */
+    double mean_l2;
+    float max_cosine;
+    float max_l2;
+    size_t histogram[EB_DRIFT_BINS];   /* Cosine distances of scored pairs */
+} eb_drift_summary_t;
+
+typedef struct {
+    const char* model;          /* Only compare this model, NULL for every model */
+    unsigned threads;           /* Worker threads, 0 for one per online CPU */
+    size_t prefix_dims;         /* Screen with the first prefix_dims values, 0 for all */
+    size_t refine;              /* Most drifted screened pairs rescored in full */
+} eb_drift_options_t;
+
+/**
+ * Callback invoked for each pair, in (source, model) order
+ *
+ * @return 0 to continue, non-zero to stop; the summary then only covers
+ *         the pairs visited
+ */
+typedef int (*eb_drift_visit_fn)(const eb_drift_pair_t* pair, void* ctx);
+
+/**
+ * Compare the vectors of two sets
+ *
+ * @param root Repository root
+ * @param set_a First set
+ * @param set_b Second set
+ * @param options Optional model filter and parallelism, NULL for defaults
+ * @param fn Optional callback for every pair
+ * @param ctx Callback context
+ * @param summary Optional totals and histogram
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if a set does not exist)
+ */
+eb_status_t eb_set_drift(const char* root, const char* set_a, const char* set_b,
+                         const eb_drift_options_t* options, eb_drift_visit_fn fn, void* ctx,
+                         eb_drift_summary_t* summary);
+
+#endif /* EB_SET_DRIFT_H */
@@ -0,0 +1,970 @@
+/*
+ * EmbeddingBridge - Binary Per-Set Index Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "set_index.h"
+#include "set_layers.h"
+#include "set_sketch.h"
+#include "hash_utils.h"
+#include "object_path.h"
+#include "path_utils.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/*
+ * Appended entries are scanned on every lookup, so the tail is folded into
+ * the sorted block once it outgrows this many entries or an eighth of the
+ * sorted block, whichever is larger.
+ */
+#define SET_INDEX_MIN_TAIL 256
+#define SET_INDEX_TAIL_RATIO 8
+
+#define PAD8(n) (((n) + 7) & ~(size_t)7)
+
+/* A record with its strings resolved; strings are not NUL-terminated */
+typedef struct {
+    const char* source;
+    size_t source_len;
+    const char* model;
+    size_t model_len;
+    const uint8_t* hash;
+    uint64_t seq;
+    uint32_t flags;
+} entry_t;
+
+typedef struct {
+    entry_t* items;
+    size_t count;
+    size_t capacity;
+} entry_vec_t;
+
+struct eb_set_index {
+    void* map;
+    size_t map_size;
+    bool binary;                            /* false: empty or converted text */
+
+    /* Binary index: records live in the map */
+    const eb_set_index_record_t* sorted;
+    size_t sorted_count;
+    size_t commit_size;
+    uint64_t next_seq;
+
+    /* Text index: entries sorted like the binary block, strings owned */
+    entry_t* text;
+    size_t text_count;
+    char* text_strings;
+    uint8_t (*text_hashes)[32];
+
+    entry_t* tail;                          /* Appended entries in order */
+    entry_t* tail_sorted;                   /* The same by source, oldest first */
+    size_t tail_count;
+
+    uint64_t flags;                         /* EB_SET_INDEX_FLAT */
+    uint64_t seq_limit;                     /* Records from here on are not visible */
+    eb_set_index_t** layers;                /* Base layers, oldest first */
+    size_t layer_count;
+};
+
+static int compare_names(const char* a, size_t a_len, const char* b, size_t b_len) {
+    size_t n = a_len < b_len ? a_len : b_len;
+    int cmp = n ? memcmp(a, b, n) : 0;
+    if (cmp)
+        return cmp;
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const entry_t* x = a;
+    const entry_t* y = b;
+    int cmp = compare_names(x->source, x->source_len, y->source, y->source_len);
+    return cmp ? cmp : compare_names(x->model, x->model_len, y->model, y->model_len);
+}
+
+/* Group entries by source, oldest first within a source */
+static int compare_source_seq(const void* a, const void* b) {
+    const entry_t* x = a;
+    const entry_t* y = b;
+    int cmp = compare_names(x->source, x->source_len, y->source, y->source_len);
+    if (cmp)
+        return cmp;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static bool vec_push(entry_vec_t* vec, const entry_t* entry) {
+    if (vec->count == vec->capacity) {
+        size_t capacity = vec->capacity ? vec->capacity * 2 : 16;
+        entry_t* items = realloc(vec->items, capacity * sizeof(*items));
+        if (!items)
+            return false;
+        vec->items = items;
+        vec->capacity = capacity;
+    }
+    vec->items[vec->count++] = *entry;
+    return true;
+}
+
+/* Resolve a record in the map, refusing anything outside the committed bytes */
+static bool decode_record(const struct eb_set_index* index, const eb_set_index_record_t* rec,
+                          entry_t* out) {
+    uint64_t end = rec->name_offset + (uint64_t)rec->source_len + rec->model_len;
+    if (rec->name_offset > index->commit_size || end > index->commit_size)
+        return false;
+
+    const char* names = (const char*)index->map + rec->name_offset;
+    out->source = names;
+    out->source_len = rec->source_len;
+    out->model = names + rec->source_len;
+    out->model_len = rec->model_len;
+    out->hash = rec->hash;
+    out->seq = rec->seq;
+    out->flags = rec->flags;
+    return true;
+}
+
+static size_t base_count(const eb_set_index_t* index) {
+    return index->binary ? index->sorted_count : index->text_count;
+}
+
+/* Entry i of the sorted block; a corrupt record reads as an empty entry */
+static void base_entry(const eb_set_index_t* index, size_t i, entry_t* out) {
+    if (!index->binary) {
+        *out = index->text[i];
+        return;
+    }
+    if (!decode_record(index, &index->sorted[i], out)) {
+        static const uint8_t zero_hash[32];
+        memset(out, 0, sizeof(*out));
+        out->source = out->model = "";
+        out->hash = zero_hash;
+        out->flags = EB_SET_INDEX_REMOVED;
+    }
+}
+
+/* First sorted entry whose source is not less than source */
+static size_t base_lower_bound(const eb_set_index_t* index, const char* source, size_t len) {
+    size_t lo = 0;
+    size_t hi = base_count(index);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        entry_t entry;
+        base_entry(index, mid, &entry);
+        if (compare_names(entry.source, entry.source_len, source, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Replay the entries of one source, oldest first, into its live entries
+ * sorted by model.
+ */
+static bool resolve_source(const entry_t* entries, size_t count, entry_vec_t* live) {
+    size_t first = live->count;
+    for (size_t i = 0; i < count; i++) {
+        const entry_t* e = &entries[i];
+        size_t kept = first;
+        bool replaced = false;
+        for (size_t j = first; j < live->count; j++) {
+            entry_t* cur = &live->items[j];
+            bool same_model = compare_names(cur->model, cur->model_len,
+                                            e->model, e->model_len) == 0;
+            if (e->flags & EB_SET_INDEX_REMOVED) {
+                if (e->model_len == 0 || same_model)
+                    continue;
+            } else if (same_model) {
+                *cur = *e;
+                replaced = true;
+            }
+            live->items[kept++] = *cur;
+        }
+        live->count = kept;
+        if (!(e->flags & EB_SET_INDEX_REMOVED) && !replaced && !vec_push(live, e))
+            return false;
+    }
+
+    if (live->count - first > 1)
+        qsort(live->items + first, live->count - first, sizeof(entry_t), compare_entries);
+    return true;
+}
+
+/* First sorted tail entry whose source is not less than source */
+static size_t tail_lower_bound(const eb_set_index_t* index, const char* source, size_t len) {
+    size_t lo = 0;
+    size_t hi = index->tail_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const entry_t* entry = &index->tail_sorted[mid];
+        if (compare_names(entry->source, entry->source_len, source, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Records of one source in a single file: a binary search of the sorted
+ * block and one of the tail, which removals may have made long
+ */
+static bool gather_source(const eb_set_index_t* index, const char* source, size_t len,
+                          entry_vec_t* raw) {
+    for (size_t i = base_lower_bound(index, source, len); i < base_count(index); i++) {
+        entry_t entry;
+        base_entry(index, i, &entry);
+        if (compare_names(entry.source, entry.source_len, source, len) != 0)
+            break;
+        if (entry.seq < index->seq_limit && !vec_push(raw, &entry))
+            return false;
+    }
+    for (size_t i = tail_lower_bound(index, source, len); i < index->tail_count; i++) {
+        const entry_t* entry = &index->tail_sorted[i];
+        if (compare_names(entry->source, entry->source_len, source, len) != 0)
+            break;
+        if (entry->seq < index->seq_limit && !vec_push(raw, entry))
+            return false;
+    }
+    return true;
+}
+
+/* Live entries of a single source, merged over the base layers */
+static eb_status_t collect_source(const eb_set_index_t* index, const char* source,
+                                  entry_vec_t* live) {
+    size_t len = strlen(source);
+    entry_vec_t raw = { NULL, 0, 0 };
+
+    for (size_t i = 0; i < index->layer_count; i++) {
+        if (!gather_source(index->layers[i], source, len, &raw))
+            goto oom;
+    }
+    if (!gather_source(index, source, len, &raw))
+        goto oom;
+
+    if (raw.count > 1)
+        qsort(raw.items, raw.count, sizeof(entry_t), compare_source_seq);
+    if (!resolve_source(raw.items, raw.count, live))
+        goto oom;
+    free(raw.items);
+    return EB_SUCCESS;
+
+oom:
+    free(raw.items);
+    return EB_ERROR_MEMORY_ALLOCATION;
+}
+
+/* Visible records of a single file; removals in the sorted block are layer tombstones */
+static size_t gather_all(const eb_set_index_t* index, entry_t* out) {
+    size_t n = 0;
+    for (size_t i = 0; i < base_count(index); i++) {
+        base_entry(index, i, &out[n]);
+        if (out[n].seq < index->seq_limit)
+            n++;
+    }
+    for (size_t i = 0; i < index->tail_count; i++) {
+        if (index->tail[i].seq < index->seq_limit)
+            out[n++] = index->tail[i];
+    }
+    return n;
+}
+
+/* Number of records gather_all() may return for an index and its layers */
+static size_t record_count(const eb_set_index_t* index, bool with_layers) {
+    size_t total = base_count(index) + index->tail_count;
+    for (size_t i = 0; with_layers && i < index->layer_count; i++)
+        total += record_count(index->layers[i], false);
+    return total;
+}
+
+/*
+ * Reduce the records of one source, oldest first, to the fewest with the
+ * same effect over the base layers: the newest record of each model, kept
+ * behind the newest removal of every model. Removals stay as tombstones.
+ */
+static bool reduce_source(const entry_t* entries, size_t count, entry_vec_t* kept) {
+    size_t first = kept->count;
+    for (size_t i = 0; i < count; i++) {
+        const entry_t* e = &entries[i];
+        if ((e->flags & EB_SET_INDEX_REMOVED) && e->model_len == 0) {
+            kept->count = first;
+        } else {
+            size_t n = first;
+            for (size_t j = first; j < kept->count; j++) {
+                const entry_t* cur = &kept->items[j];
+                bool removes_all = (cur->flags & EB_SET_INDEX_REMOVED) && cur->model_len == 0;
+                if (!removes_all && compare_names(cur->model, cur->model_len,
+                                                  e->model, e->model_len) == 0)
+                    continue;
+                kept->items[n++] = *cur;
+            }
+            kept->count = n;
+        }
+        if (!vec_push(kept, e))
+            return false;
+    }
+
+    if (kept->count - first > 1)
+        qsort(kept->items + first, kept->count - first, sizeof(entry_t), compare_entries);
+    return true;
+}
+
+typedef bool (*resolve_fn)(const entry_t* entries, size_t count, entry_vec_t* out);
+
+/* Group every visible record by source and resolve each group */
+static eb_status_t collect_records(const eb_set_index_t* index, bool with_layers,
+                                   const entry_t* extra, size_t extra_count,
+                                   resolve_fn resolve, entry_vec_t* live) {
+    size_t total = record_count(index, with_layers) + extra_count;
+    entry_t* all = malloc((total ? total : 1) * sizeof(entry_t));
+    if (!all)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    size_t n = 0;
+    for (size_t i = 0; with_layers && i < index->layer_count; i++)
+        n += gather_all(index->layers[i], all + n);
+    n += gather_all(index, all + n);
+    if (extra_count)
+        memcpy(all + n, extra, extra_count * sizeof(entry_t));
+    n += extra_count;
+
+    if (n > 1)
+        qsort(all, n, sizeof(entry_t), compare_source_seq);
+
+    size_t start = 0;
+    while (start < n) {
+        size_t end = start + 1;
+        while (end < n && compare_names(all[end].source, all[end].source_len,
+                                        all[start].source, all[start].source_len) == 0)
+            end++;
+        if (!resolve(all + start, end - start, live)) {
+            free(all);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        start = end;
+    }
+
+    free(all);
+    return EB_SUCCESS;
+}
+
+/* Live entries of every source, plus optional pending changes */
+static eb_status_t collect_all(const eb_set_index_t* index, const entry_t* extra,
+                               size_t extra_count, entry_vec_t* live) {
+    return collect_records(index, true, extra, extra_count, resolve_source, live);
+}
+
+/* Model recorded in an object's .meta sidecar */
+static bool meta_model(const char* root, const char* hash, char* model, size_t size) {
+    char meta_path[PATH_MAX];
+    if (!root || eb_object_path(root, hash, "meta", meta_path, sizeof(meta_path)) != 0)
+        return false;
+
+    FILE* f = fopen(meta_path, "r");
+    if (!f)
+        return false;
+
+    bool found = false;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model=", 6) == 0) {
+            found = sscanf(line + 6, "%127s", model) == 1 && strlen(model) < size;
+            break;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/* Load a text index; each line becomes an entry ordered by line number */
+static eb_status_t load_text(eb_set_index_t* index, const char* root, const char* data,
+                             size_t size) {
+    size_t lines = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n')
+            lines++;
+    }
+    lines++;
+
+    index->text = malloc(lines * sizeof(entry_t));
+    index->text_hashes = malloc(lines * 32);
+    index->text_strings = malloc(size + lines * 130 + 1);
+    if (!index->text || !index->text_hashes || !index->text_strings)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    char* strings = index->text_strings;
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+        const char* nl = memchr(p, '\n', end - p);
+        size_t len = nl ? (size_t)(nl - p) : (size_t)(end - p);
+        char line[PATH_MAX + 80];
+        if (len < sizeof(line)) {
+            memcpy(line, p, len);
+            line[len] = '\0';
+
+            char hash[65], source[PATH_MAX];
+            uint8_t* bin = index->text_hashes[index->text_count];
+            if (sscanf(line, "%64s %4095s", hash, source) == 2 && eb_hex_to_hash(hash, bin)) {
+                char model[128] = "";
+                meta_model(root, hash, model, sizeof(model));
+
+                entry_t* e = &index->text[index->text_count];
+                e->source = strings;
+                e->source_len = strlen(source);
+                memcpy(strings, source, e->source_len);
+                strings += e->source_len;
+                e->model = strings;
+                e->model_len = strlen(model);
+                memcpy(strings, model, e->model_len);
+                strings += e->model_len;
+                e->hash = bin;
+                e->seq = index->text_count;
+                e->flags = 0;
+                index->text_count++;
+            }
+        }
+        p += len + 1;
+    }
+
+    /* Keep the newest line per source and model, as the text readers did */
+    entry_vec_t live = { NULL, 0, 0 };
+    if (index->text_count > 1)
+        qsort(index->text, index->text_count, sizeof(entry_t), compare_source_seq);
+    size_t start = 0;
+    while (start < index->text_count) {
+        size_t stop = start + 1;
+        while (stop < index->text_count &&
+               compare_names(index->text[stop].source, index->text[stop].source_len,
+                             index->text[start].source, index->text[start].source_len) == 0)
+            stop++;
+        if (!resolve_source(index->text + start, stop - start, &live)) {
+            free(live.items);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        start = stop;
+    }
+    free(index->text);
+    index->text = live.items;
+    index->text_count = live.count;
+    index->next_seq = lines;
+    return EB_SUCCESS;
+}
+
+/* Check the header and decode the appended entries */
+static eb_status_t load_binary(eb_set_index_t* index) {
+    const eb_set_index_header_t* header = index->map;
+    if (header->version != EB_SET_INDEX_VERSION)
+        return EB_ERROR_INVALID_INPUT;
+    if (header->commit_size > index->map_size || header->tail_offset > header->commit_size ||
+        header->sorted_count > (index->map_size - sizeof(*header)) / sizeof(eb_set_index_record_t) ||
+        sizeof(*header) + header->sorted_count * sizeof(eb_set_index_record_t) > header->tail_offset)
+        return EB_ERROR_INVALID_INPUT;
+
+    index->binary = true;
+    index->sorted = (const eb_set_index_record_t*)(header + 1);
+    index->sorted_count = header->sorted_count;
+    index->commit_size = header->commit_size;
+    index->next_seq = header->next_seq;
+    index->flags = header->flags;
+
+    if (header->tail_count == 0)
+        return EB_SUCCESS;
+    if (header->tail_count > (header->commit_size - header->tail_offset) / sizeof(eb_set_index_record_t))
+        return EB_ERROR_INVALID_INPUT;
+
+    index->tail = malloc(header->tail_count * sizeof(entry_t));
+    if (!index->tail)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    size_t offset = header->tail_offset;
+    for (uint64_t i = 0; i < header->tail_count; i++) {
+        if (offset + sizeof(eb_set_index_record_t) > index->commit_size)
+            return EB_ERROR_INVALID_INPUT;
+        const eb_set_index_record_t* rec =
+            (const eb_set_index_record_t*)((const char*)index->map + offset);
+        if (rec->name_offset != offset + sizeof(*rec) ||
+            !decode_record(index, rec, &index->tail[index->tail_count]))
+            return EB_ERROR_INVALID_INPUT;
+        index->tail_count++;
+        offset += sizeof(*rec) + PAD8((size_t)rec->source_len + rec->model_len);
+    }
+
+    index->tail_sorted = malloc(index->tail_count * sizeof(entry_t));
+    if (!index->tail_sorted)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    memcpy(index->tail_sorted, index->tail, index->tail_count * sizeof(entry_t));
+    qsort(index->tail_sorted, index->tail_count, sizeof(entry_t), compare_source_seq);
+    return EB_SUCCESS;
+}
+
+/* Open the base layers of a set created from another one, if any */
+static eb_status_t open_layers(eb_set_index_t* index, const char* root, const char* path) {
+    eb_set_layers_t layers;
+    eb_status_t status = eb_set_layers_load_for(path, &layers);
+    if (status != EB_SUCCESS || layers.count == 0)
+        return status;
+
+    index->layers = calloc(layers.count, sizeof(*index->layers));
+    if (!index->layers) {
+        eb_set_layers_free(&layers);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t i = 0; status == EB_SUCCESS && i < layers.count; i++) {
+        char layer_path[PATH_MAX];
+        eb_set_layer_path(path, &layers.items[i], "index", layer_path, sizeof(layer_path));
+        eb_set_index_t* layer = NULL;
+        status = eb_set_index_open(root, layer_path, &layer);
+        if (status == EB_SUCCESS) {
+            layer->seq_limit = layers.items[i].seq_limit;
+            index->layers[index->layer_count++] = layer;
+            /* New records must sort after the layers even if the own index was lost */
+            if (index->next_seq < layer->seq_limit)
+                index->next_seq = layer->seq_limit;
+        }
+    }
+    eb_set_layers_free(&layers);
+    return status;
+}
+
+eb_status_t eb_set_index_open(const char* root, const char* path, eb_set_index_t** out) {
+    if (!path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    *out = NULL;
+
+    eb_set_index_t* index = calloc(1, sizeof(*index));
+    if (!index)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    index->seq_limit = UINT64_MAX;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            free(index);
+            return EB_ERROR_FILE_IO;
+        }
+        *out = index;
+        return EB_SUCCESS;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        free(index);
+        return EB_ERROR_FILE_IO;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        *out = index;
+        return EB_SUCCESS;
+    }
+
+    index->map_size = (size_t)st.st_size;
+    index->map = mmap(NULL, index->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (index->map == MAP_FAILED) {
+        free(index);
+        return EB_ERROR_FILE_IO;
+    }
+
+    eb_status_t status;
+    if (index->map_size >= sizeof(eb_set_index_header_t) &&
+        ((const eb_set_index_header_t*)index->map)->magic == EB_SET_INDEX_MAGIC) {
+        status = load_binary(index);
+    } else {
+        DEBUG_PRINT("eb_set_index_open: reading text index %s", path);
+        status = load_text(index, root, index->map, index->map_size);
+    }
+
+    if (status == EB_SUCCESS && !(index->flags & EB_SET_INDEX_FLAT))
+        status = open_layers(index, root, path);
+
+    if (status != EB_SUCCESS) {
+        DEBUG_PRINT("eb_set_index_open: cannot load %s", path);
+        eb_set_index_close(index);
+        return status;
+    }
+
+    *out = index;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_set_index_open_current(const char* root, eb_set_index_t** out) {
+    char* path = get_current_set_index_path();
+    if (!path)
+        return EB_ERROR_NOT_INITIALIZED;
+    eb_status_t status = eb_set_index_open(root, path, out);
+    free(path);
+    return status;
+}
+
+void eb_set_index_close(eb_set_index_t* index) {
+    if (!index)
+        return;
+    if (index->map && index->map != MAP_FAILED)
+        munmap(index->map, index->map_size);
+    free(index->text);
+    free(index->text_strings);
+    free(index->text_hashes);
+    free(index->tail);
+    free(index->tail_sorted);
+    for (size_t i = 0; i < index->layer_count; i++)
+        eb_set_index_close(index->layers[i]);
+    free(index->layers);
+    free(index);
+}
+
+eb_status_t eb_set_index_lookup(const eb_set_index_t* index, const char* source,
+                                const char* model, char hash_out[65]) {
+    if (!index || !source || !hash_out)
+        return EB_ERROR_INVALID_INPUT;
+
+    entry_vec_t live = { NULL, 0, 0 };
+    eb_status_t status = collect_source(index, source, &live);
+    if (status != EB_SUCCESS)
+        return status;
+
+    const entry_t* best = NULL;
+    size_t model_len = model ? strlen(model) : 0;
+    for (size_t i = 0; i < live.count; i++) {
+        const entry_t* e = &live.items[i];
+        if (model && compare_names(e->model, e->model_len, model, model_len) != 0)
+            continue;
+        if (!best || e->seq > best->seq)
+            best = e;
+    }
+
+    if (best)
+        eb_hash_to_hex(best->hash, hash_out);
+    free(live.items);
+    return best ? EB_SUCCESS : EB_ERROR_NOT_FOUND;
+}
+
+/* Hand an entry to a visitor with NUL-terminated strings */
+static int visit_entry(const entry_t* e, eb_set_index_visit_fn fn, void* ctx) {
+    char source[PATH_MAX];
+    char model[256];
+    char hash[65];
+    if (e->source_len >= sizeof(source) || e->model_len >= sizeof(model))
+        return 0;
+    memcpy(source, e->source, e->source_len);
+    source[e->source_len] = '\0';
+    memcpy(model, e->model, e->model_len);
+    model[e->model_len] = '\0';
+    eb_hash_to_hex(e->hash, hash);
+    return fn(source, model, hash, ctx);
+}
+
+eb_status_t eb_set_index_foreach(const eb_set_index_t* index, const char* source,
+                                 eb_set_index_visit_fn fn, void* ctx) {
+    if (!index || !fn)
+        return EB_ERROR_INVALID_INPUT;
+
+    entry_vec_t live = { NULL, 0, 0 };
+    eb_status_t status = source ? collect_source(index, source, &live)
+                                : collect_all(index, NULL, 0, &live);
+    if (status != EB_SUCCESS) {
+        free(live.items);
+        return status;
+    }
+
+    for (size_t i = 0; i < live.count; i++) {
+        if (visit_entry(&live.items[i], fn, ctx) != 0)
+            break;
+    }
+    free(live.items);
+    return EB_SUCCESS;
+}
+
+static int export_visit(const char* source, const char* model, const char* hash, void* ctx) {
+    fprintf((FILE*)ctx, "%s %s %s\n", hash, source, model);
+    return 0;
+}
+
+eb_status_t eb_set_index_export(const eb_set_index_t* index, FILE* out) {
+    if (!out)
+        return EB_ERROR_INVALID_INPUT;
+    return eb_set_index_foreach(index, NULL, export_visit, out);
+}
+
+/* Turn changes into entries numbered after the existing ones */
+static eb_status_t changes_to_entries(const eb_set_index_t* index,
+                                      const eb_set_index_change_t* changes, size_t count,
+                                      entry_t* entries, uint8_t (*hashes)[32]) {
+    for (size_t i = 0; i < count; i++) {
+        const eb_set_index_change_t* c = &changes[i];
+        if (!c->source || !*c->source || strlen(c->source) >= PATH_MAX)
+            return EB_ERROR_INVALID_INPUT;
+
+        entry_t* e = &entries[i];
+        e->source = c->source;
+        e->source_len = strlen(c->source);
+        e->model = c->model ? c->model : "";
+        e->model_len = strlen(e->model);
+        e->seq = index->next_seq + i;
+        e->hash = hashes[i];
+        if (e->model_len >= 256)
+            return EB_ERROR_INVALID_INPUT;
+
+        if (c->hash) {
+            if (!eb_hex_to_hash(c->hash, hashes[i]))
+                return EB_ERROR_INVALID_INPUT;
+            e->flags = 0;
+        } else {
+            memset(hashes[i], 0, 32);
+            e->flags = EB_SET_INDEX_REMOVED;
+        }
+    }
+    return EB_SUCCESS;
+}
+
+static void fill_record(eb_set_index_record_t* rec, const entry_t* e, uint64_t name_offset) {
+    memset(rec, 0, sizeof(*rec));
+    memcpy(rec->hash, e->hash, 32);
+    rec->seq = e->seq;
+    rec->name_offset = name_offset;
+    rec->source_len = (uint32_t)e->source_len;
+    rec->model_len = (uint32_t)e->model_len;
+    rec->flags = e->flags;
+}
+
+/* Write the live entries as a fresh sorted index and rename it into place */
+static eb_status_t write_compacted(const char* path, const entry_vec_t* live, uint64_t next_seq,
+                                   uint64_t flags) {
+    size_t records_size = live->count * sizeof(eb_set_index_record_t);
+    size_t strings_size = 0;
+    for (size_t i = 0; i < live->count; i++)
+        strings_size += live->items[i].source_len + live->items[i].model_len;
+
+    size_t total = sizeof(eb_set_index_header_t) + records_size + PAD8(strings_size);
+    char* buf = calloc(1, total);
+    if (!buf)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    eb_set_index_header_t* header = (eb_set_index_header_t*)buf;
+    header->magic = EB_SET_INDEX_MAGIC;
+    header->version = EB_SET_INDEX_VERSION;
+    header->sorted_count = live->count;
+    header->tail_offset = total;
+    header->tail_count = 0;
+    header->commit_size = total;
+    header->next_seq = next_seq;
+    header->flags = flags;
+
+    eb_set_index_record_t* records = (eb_set_index_record_t*)(header + 1);
+    size_t name_offset = sizeof(*header) + records_size;
+    for (size_t i = 0; i < live->count; i++) {
+        const entry_t* e = &live->items[i];
+        fill_record(&records[i], e, name_offset);
+        memcpy(buf + name_offset, e->source, e->source_len);
+        memcpy(buf + name_offset + e->source_len, e->model, e->model_len);
+        name_offset += e->source_len + e->model_len;
+    }
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        free(buf);
+        return EB_ERROR_FILE_IO;
+    }
+
+    bool ok = fwrite(buf, 1, total, f) == total;
+    free(buf);
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+/* Append entries after the committed bytes, then commit them in the header */
+static eb_status_t append_entries(const eb_set_index_t* index, const char* path,
+                                  const entry_t* entries, size_t count) {
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++)
+        size += sizeof(eb_set_index_record_t) + PAD8(entries[i].source_len + entries[i].model_len);
+
+    char* buf = calloc(1, size);
+    if (!buf)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    size_t base = index->commit_size;
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        const entry_t* e = &entries[i];
+        fill_record((eb_set_index_record_t*)(buf + pos), e, base + pos + sizeof(eb_set_index_record_t));
+        pos += sizeof(eb_set_index_record_t);
+        memcpy(buf + pos, e->source, e->source_len);
+        memcpy(buf + pos + e->source_len, e->model, e->model_len);
+        pos += PAD8(e->source_len + e->model_len);
+    }
+
+    eb_set_index_header_t header = *(const eb_set_index_header_t*)index->map;
+    header.tail_count += count;
+    header.commit_size += size;
+    header.next_seq = index->next_seq + count;
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        free(buf);
+        return EB_ERROR_FILE_IO;
+    }
+
+    /* The header only covers the new bytes once they are on disk */
+    bool ok = pwrite(fd, buf, size, (off_t)base) == (ssize_t)size &&
+              fdatasync(fd) == 0 &&
+              pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    free(buf);
+    if (close(fd) != 0)
+        ok = false;
+    return ok ? EB_SUCCESS : EB_ERROR_FILE_IO;
+}
+
+/* Apply changes, compacting once the tail outgrows the sorted block unless deferred */
+static eb_status_t apply_changes(const char* root, const char* path,
+                                 const eb_set_index_change_t* changes, size_t count,
+                                 bool defer_compaction) {
+    if (!path || (count && !changes))
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_set_index_t* index = NULL;
+    eb_status_t status = eb_set_index_open(root, path, &index);
+    if (status != EB_SUCCESS)
+        return status;
+
+    entry_t* entries = malloc((count ? count : 1) * sizeof(entry_t));
+    uint8_t (*hashes)[32] = malloc((count ? count : 1) * 32);
+    if (!entries || !hashes) {
+        status = EB_ERROR_MEMORY_ALLOCATION;
+        goto out;
+    }
+    status = changes_to_entries(index, changes, count, entries, hashes);
+    if (status != EB_SUCCESS)
+        goto out;
+
+    size_t max_tail = index->sorted_count / SET_INDEX_TAIL_RATIO;
+    if (max_tail < SET_INDEX_MIN_TAIL)
+        max_tail = SET_INDEX_MIN_TAIL;
+
+    if (index->binary && (defer_compaction || index->tail_count + count <= max_tail)) {
+        status = count ? append_entries(index, path, entries, count) : EB_SUCCESS;
+    } else {
+        // A layered index keeps only its own records, tombstones included
+        entry_vec_t live = { NULL, 0, 0 };
+        status = index->layer_count
+            ? collect_records(index, false, entries, count, reduce_source, &live)
+            : collect_all(index, entries, count, &live);
+        if (status == EB_SUCCESS)
+            status = write_compacted(path, &live, index->next_seq + count, index->flags);
+        free(live.items);
+    }
+    if (status == EB_SUCCESS)
+        eb_set_sketch_update(root, path, index, changes, count);
+
+out:
+    free(entries);
+    free(hashes);
+    eb_set_index_close(index);
+    return status;
+}
+
+eb_status_t eb_set_index_apply(const char* root, const char* path,
+                               const eb_set_index_change_t* changes, size_t count) {
+    return apply_changes(root, path, changes, count, false);
+}
+
+eb_status_t eb_set_index_append(const char* root, const char* path,
+                                const eb_set_index_change_t* changes, size_t count) {
+    return apply_changes(root, path, changes, count, true);
+}
+
+eb_status_t eb_set_index_compact(const char* root, const char* path, bool* compacted) {
+    if (!path)
+        return EB_ERROR_INVALID_INPUT;
+    if (compacted)
+        *compacted = false;
+
+    eb_set_index_t* index = NULL;
+    eb_status_t status = eb_set_index_open(root, path, &index);
+    if (status != EB_SUCCESS)
+        return status;
+    if (!index->binary || index->tail_count == 0) {
+        eb_set_index_close(index);
+        return EB_SUCCESS;
+    }
+
+    entry_vec_t live = { NULL, 0, 0 };
+    status = index->layer_count
+        ? collect_records(index, false, NULL, 0, reduce_source, &live)
+        : collect_all(index, NULL, 0, &live);
+    if (status == EB_SUCCESS)
+        status = write_compacted(path, &live, index->next_seq, index->flags);
+    if (status == EB_SUCCESS && compacted)
+        *compacted = true;
+    free(live.items);
+    eb_set_index_close(index);
+    return status;
+}
+
+eb_status_t eb_set_index_apply_current(const char* root,
+                                       const eb_set_index_change_t* changes, size_t count) {
+    char* path = get_current_set_index_path();
+    if (!path)
+        return EB_ERROR_NOT_INITIALIZED;
+    eb_status_t status = eb_set_index_apply(root, path, changes, count);
+    free(path);
+    return status;
+}
+
+eb_status_t eb_set_index_create(const char* path) {
+    return eb_set_index_create_after(path, 0);
+}
+
+eb_status_t eb_set_index_create_after(const char* path, uint64_t next_seq) {
+    if (!path)
+        return EB_ERROR_INVALID_INPUT;
+    entry_vec_t live = { NULL, 0, 0 };
+    return write_compacted(path, &live, next_seq, 0);
+}
+
+uint64_t eb_set_index_next_seq(const eb_set_index_t* index) {
+    return index ? index->next_seq : 0;
+}
+
+eb_status_t eb_set_index_flatten(const char* root, const char* path) {
+    if (!path)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_set_index_t* index = NULL;
+    eb_status_t status = eb_set_index_open(root, path, &index);
+    if (status != EB_SUCCESS)
+        return status;
+
+    entry_vec_t live = { NULL, 0, 0 };
+    status = collect_all(index, NULL, 0, &live);
+    if (status == EB_SUCCESS)
+        status = write_compacted(path, &live, index->next_seq, index->flags | EB_SET_INDEX_FLAT);
+    free(live.items);
+    eb_set_index_close(index);
+    return status;
+}
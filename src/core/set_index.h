@@ -0,0 +1,216 @@
+/*
+ * EmbeddingBridge - Binary Per-Set Index
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_INDEX_H
+#define EB_SET_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "status.h"
+
+/*
+ * .embr/sets/<set>/index maps each (source file, model) pair to the hash
+ * of its current embedding. The file is memory-mapped for lookups:
+ *
+ *   header | sorted records | string table | appended entries
+ *
+ * Sorted records are fixed-size and ordered by source then model, so a
+ * lookup is a binary search plus a search of the appended tail.
+ * Updates append records after the last committed byte and then rewrite
+ * the header, which is the commit point. Once the tail grows past a
+ * fraction of the sorted block the whole file is compacted through a
+ * temporary file and rename; bulk removals append without compacting
+ * and leave that to eb_set_index_compact(). Readers sort the tail once
+ * when opening the file, so a long one still costs a binary search.
+ *
+ * Indexes in the old text format ("<hash> <source>" lines) are still read;
+ * the first update converts them, taking each model from the .meta sidecar.
+ *
+ * A set created from another one starts with an empty index layered over
+ * the base set's (see set_layers.h). Its records are numbered after the
+ * base's, so reads merge the layers by sequence number, and its removals
+ * stay in the file as records flagged EB_SET_INDEX_REMOVED until the set
+ * is flattened.
+ */
+
+#define EB_SET_INDEX_MAGIC   0x45425349  /* "EBSI" */
+#define EB_SET_INDEX_VERSION 1
+
+/* Record flag: removes (source, model), or every model when model is empty */
+#define EB_SET_INDEX_REMOVED 0x1
+
+/* Header flag: the base layers are folded in and no longer read */
+#define EB_SET_INDEX_FLAT 0x1
+
+typedef struct {
+    uint32_t magic;         /* EB_SET_INDEX_MAGIC */
+    uint32_t version;       /* EB_SET_INDEX_VERSION */
+    uint64_t sorted_count;  /* Records in the sorted block */
+    uint64_t tail_offset;   /* Offset of the first appended entry */
+    uint64_t tail_count;    /* Appended entries */
+    uint64_t commit_size;   /* Bytes that belong to the index */
+    uint64_t next_seq;      /* Sequence number of the next record */
+    uint64_t flags;         /* EB_SET_INDEX_FLAT */
+    uint64_t reserved[1];
+} eb_set_index_header_t;
+
+typedef struct {
+    uint8_t hash[32];
+    uint64_t seq;           /* Insertion order, newest wins */
+    uint64_t name_offset;   /* Source followed by model, unterminated */
+    uint32_t source_len;
+    uint32_t model_len;
+    uint32_t flags;         /* EB_SET_INDEX_REMOVED */
+    uint32_t reserved;
+} eb_set_index_record_t;
+
+typedef struct eb_set_index eb_set_index_t;
+
+/* A change applied by eb_set_index_apply() */
+typedef struct {
+    const char* source;     /* Source path relative to the repository root */
+    const char* model;      /* Model name, NULL or "" for none */
+    const char* hash;       /* 64-character hash to record, NULL to remove */
+} eb_set_index_change_t;
+
+/**
+ * Callback invoked for each live index entry
+ *
+ * @param source Source path
+ * @param model Model name, "" if none was recorded
+ * @param hash Full 64-character hash
+ * @param ctx Caller context
+ * @return 0 to continue, non-zero to stop iteration
+ */
+typedef int (*eb_set_index_visit_fn)(const char* source, const char* model,
+                                     const char* hash, void* ctx);
+
+/**
+ * Open a set index for reading
+ *
+ * A missing or empty file opens as an empty index.
+ *
+ * @param root Repository root, used to read models of text indexes
+ * @param path Index file
+ * @param out Receives the index
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_index_open(const char* root, const char* path, eb_set_index_t** out);
+
+/**
+ * Open the index of the current set
+ */
+eb_status_t eb_set_index_open_current(const char* root, eb_set_index_t** out);
+
+void eb_set_index_close(eb_set_index_t* index);
+
+/**
+ * Current hash of a source file
+ *
+ * @param index Open index
+ * @param source Source path
+ * @param model Model to match, NULL for the most recently stored of any model
+ * @param hash_out Receives the hash
+ * @return EB_SUCCESS or EB_ERROR_NOT_FOUND
+ */
+eb_status_t eb_set_index_lookup(const eb_set_index_t* index, const char* source,
+                                const char* model, char hash_out[65]);
+
+/**
+ * Visit live entries in source order
+ *
+ * @param index Open index
+ * @param source Only visit this source, NULL for all
+ * @param fn Callback
+ * @param ctx Callback context
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_index_foreach(const eb_set_index_t* index, const char* source,
+                                 eb_set_index_visit_fn fn, void* ctx);
+
+/**
+ * Apply changes in order with a single commit
+ *
+ * Recording a hash replaces the entry with the same source and model.
+ * Removing with no model removes the source for every model.
+ *
+ * @param root Repository root
+ * @param path Index file, created if missing
+ * @param changes Changes to apply
+ * @param count Number of changes
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_index_apply(const char* root, const char* path,
+                               const eb_set_index_change_t* changes, size_t count);
+
+/**
+ * Apply changes like eb_set_index_apply(), but only ever append them
+ *
+ * For bulk removals: the tail is left to grow, and eb_set_index_compact()
+ * folds it in later.
+ */
+eb_status_t eb_set_index_append(const char* root, const char* path,
+                                const eb_set_index_change_t* changes, size_t count);
+
+/**
+ * Fold the appended tail into the sorted block, dropping what it replaced
+ * and removed
+ *
+ * A layered index keeps its removals as tombstones over the base layers.
+ *
+ * @param root Repository root
+ * @param path Index file
+ * @param compacted Optional, set when the file was rewritten
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_index_compact(const char* root, const char* path, bool* compacted);
+
+/**
+ * Apply changes to the index of the current set
+ */
+eb_status_t eb_set_index_apply_current(const char* root,
+                                       const eb_set_index_change_t* changes, size_t count);
+
+/**
+ * Write an empty index
+ */
+eb_status_t eb_set_index_create(const char* path);
+
+/**
+ * Write an empty index whose records are numbered from next_seq, to be
+ * layered over indexes whose records all come before it
+ */
+eb_status_t eb_set_index_create_after(const char* path, uint64_t next_seq);
+
+/**
+ * Sequence number the next recorded change would get
+ */
+uint64_t eb_set_index_next_seq(const eb_set_index_t* index);
+
+/**
+ * Rewrite a layered index as one standalone index of its live entries
+ *
+ * The result is flagged EB_SET_INDEX_FLAT, so base layers left behind by
+ * an interrupted flatten are ignored.
+ *
+ * @param root Repository root
+ * @param path Index file
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_index_flatten(const char* root, const char* path);
+
+/**
+ * Write live entries as "<hash> <source> <model>" lines, for debugging
+ */
+eb_status_t eb_set_index_export(const eb_set_index_t* index, FILE* out);
+
+#endif /* EB_SET_INDEX_H */
@@ -0,0 +1,454 @@
+/*
+ * EmbeddingBridge - Copy-on-Write Set Layers Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "set_layers.h"
+#include "set_index.h"
+#include "set_sketch.h"
+#include "fs.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Present while a flatten is replacing the log; holds the old log's inode */
+#define FLATTEN_MARKER "flatten"
+
+static void set_file(const char* set_dir, const char* name, char* out, size_t size) {
+    snprintf(out, size, "%s/%s/%s", set_dir, EB_SET_LAYERS_DIR, name);
+}
+
+/* The layers file as written, whether or not a flatten is under way */
+static eb_status_t read_layers(const char* set_dir, eb_set_layers_t* out) {
+    out->items = NULL;
+    out->count = 0;
+
+    char path[PATH_MAX];
+    set_file(set_dir, EB_SET_LAYERS_FILE, path, sizeof(path));
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return errno == ENOENT ? EB_SUCCESS : EB_ERROR_FILE_IO;
+
+    eb_status_t status = EB_SUCCESS;
+    size_t capacity = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        eb_set_layer_t layer;
+        unsigned long long seq, size;
+        if (sscanf(line, "%u %255s %llu %llu", &layer.id, layer.set, &seq, &size) != 4)
+            continue;
+        layer.seq_limit = seq;
+        layer.log_size = size;
+        if (out->count == capacity) {
+            capacity = capacity ? capacity * 2 : 4;
+            eb_set_layer_t* grown = realloc(out->items, capacity * sizeof(*grown));
+            if (!grown) {
+                status = EB_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            out->items = grown;
+        }
+        out->items[out->count++] = layer;
+    }
+    fclose(f);
+    if (status != EB_SUCCESS)
+        eb_set_layers_free(out);
+    return status;
+}
+
+eb_status_t eb_set_layers_load(const char* set_dir, eb_set_layers_t* out) {
+    if (!set_dir || !out)
+        return EB_ERROR_INVALID_INPUT;
+
+    // A flatten past its index step has already folded the layers in
+    char marker[PATH_MAX];
+    set_file(set_dir, FLATTEN_MARKER, marker, sizeof(marker));
+    if (access(marker, F_OK) == 0) {
+        out->items = NULL;
+        out->count = 0;
+        return EB_SUCCESS;
+    }
+    return read_layers(set_dir, out);
+}
+
+eb_status_t eb_set_layers_load_for(const char* file_path, eb_set_layers_t* out) {
+    if (!file_path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    char set_dir[PATH_MAX];
+    const char* slash = strrchr(file_path, '/');
+    if (slash)
+        snprintf(set_dir, sizeof(set_dir), "%.*s", (int)(slash - file_path), file_path);
+    else
+        snprintf(set_dir, sizeof(set_dir), ".");
+    return eb_set_layers_load(set_dir, out);
+}
+
+void eb_set_layers_free(eb_set_layers_t* layers) {
+    if (!layers)
+        return;
+    free(layers->items);
+    layers->items = NULL;
+    layers->count = 0;
+}
+
+void eb_set_layer_path(const char* file_path, const eb_set_layer_t* layer, const char* kind,
+                       char* out, size_t size) {
+    const char* slash = strrchr(file_path, '/');
+    int dir_length = slash ? (int)(slash - file_path) : 1;
+    snprintf(out, size, "%.*s/%s/%s.%u", dir_length, slash ? file_path : ".",
+             EB_SET_LAYERS_DIR, kind, layer->id);
+}
+
+static void layer_file(const char* set_dir, const eb_set_layer_t* layer, const char* kind,
+                       char* out, size_t size) {
+    snprintf(out, size, "%s/%s/%s.%u", set_dir, EB_SET_LAYERS_DIR, kind, layer->id);
+}
+
+/* Link a file that is only ever appended to or replaced by rename */
+static eb_status_t link_frozen(const char* src, const char* dst) {
+    eb_status_t status = eb_fs_copy_file(src, dst, EB_FS_COPY_ALLOW_LINK, NULL);
+    return status == EB_ERROR_NOT_FOUND ? EB_SUCCESS : status;
+}
+
+/* Size of a log up to its last complete line */
+static uint64_t complete_size(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    uint64_t size = fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+    char buf[4096];
+    while (size > 0) {
+        size_t n = size < sizeof(buf) ? (size_t)size : sizeof(buf);
+        if (pread(fd, buf, n, (off_t)(size - n)) != (ssize_t)n) {
+            size = 0;
+            break;
+        }
+        size_t i = n;
+        while (i > 0 && buf[i - 1] != '\n')
+            i--;
+        if (i > 0) {
+            size -= n - i;
+            break;
+        }
+        size -= n;
+    }
+    close(fd);
+    return size;
+}
+
+static eb_status_t write_layers(const char* set_dir, const eb_set_layers_t* layers) {
+    char path[PATH_MAX], tmp[PATH_MAX + 16];
+    set_file(set_dir, EB_SET_LAYERS_FILE, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    FILE* f = fopen(tmp, "w");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+    for (size_t i = 0; i < layers->count; i++) {
+        const eb_set_layer_t* l = &layers->items[i];
+        fprintf(f, "%u %s %llu %llu\n", l->id, l->set,
+                (unsigned long long)l->seq_limit, (unsigned long long)l->log_size);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+static eb_status_t link_refs(const char* base_dir, const char* set_dir) {
+    char src_dir[PATH_MAX], dst_dir[PATH_MAX];
+    snprintf(src_dir, sizeof(src_dir), "%s/refs/models", base_dir);
+    snprintf(dst_dir, sizeof(dst_dir), "%s/refs/models", set_dir);
+    if (fs_mkdir_p(dst_dir, 0755) != 0)
+        return EB_ERROR_FILE_IO;
+
+    DIR* dir = opendir(src_dir);
+    if (!dir)
+        return EB_SUCCESS;
+    eb_status_t status = EB_SUCCESS;
+    struct dirent* entry;
+    while (status == EB_SUCCESS && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || strstr(entry->d_name, ".tmp"))
+            continue;
+        char src[PATH_MAX], dst[PATH_MAX];
+        snprintf(src, sizeof(src), "%s/%s", src_dir, entry->d_name);
+        snprintf(dst, sizeof(dst), "%s/%s", dst_dir, entry->d_name);
+        status = link_frozen(src, dst);
+    }
+    closedir(dir);
+    return status;
+}
+
+static eb_status_t fork_into(const char* root, const char* base, const char* base_dir,
+                             const char* set_dir) {
+    char path[PATH_MAX], src[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", set_dir, EB_SET_LAYERS_DIR);
+    if (mkdir(path, 0755) != 0)
+        return EB_ERROR_FILE_IO;
+
+    // 1. The base's own layers carry over unchanged
+    eb_set_layers_t layers;
+    eb_status_t status = eb_set_layers_load(base_dir, &layers);
+    if (status != EB_SUCCESS)
+        return status;
+    unsigned next_id = 0;
+    for (size_t i = 0; status == EB_SUCCESS && i < layers.count; i++) {
+        const eb_set_layer_t* layer = &layers.items[i];
+        layer_file(base_dir, layer, "index", src, sizeof(src));
+        layer_file(set_dir, layer, "index", path, sizeof(path));
+        status = link_frozen(src, path);
+        if (status == EB_SUCCESS) {
+            layer_file(base_dir, layer, "log", src, sizeof(src));
+            layer_file(set_dir, layer, "log", path, sizeof(path));
+            status = link_frozen(src, path);
+        }
+        if (layer->id >= next_id)
+            next_id = layer->id + 1;
+    }
+
+    // 2. A new layer freezes the base's own index and log where they are now
+    eb_set_layer_t top = { .id = next_id };
+    snprintf(top.set, sizeof(top.set), "%s", base);
+    if (status == EB_SUCCESS) {
+        snprintf(src, sizeof(src), "%s/index", base_dir);
+        layer_file(set_dir, &top, "index", path, sizeof(path));
+        status = link_frozen(src, path);
+    }
+    if (status == EB_SUCCESS) {
+        // Read the sequence point from the link, which later compactions of the base leave alone
+        eb_set_index_t* index = NULL;
+        status = eb_set_index_open(root, path, &index);
+        if (status == EB_SUCCESS) {
+            top.seq_limit = eb_set_index_next_seq(index);
+            eb_set_index_close(index);
+        }
+    }
+    if (status == EB_SUCCESS) {
+        snprintf(src, sizeof(src), "%s/log", base_dir);
+        layer_file(set_dir, &top, "log", path, sizeof(path));
+        status = link_frozen(src, path);
+        top.log_size = complete_size(path);
+    }
+    if (status == EB_SUCCESS) {
+        eb_set_layer_t* grown = realloc(layers.items, (layers.count + 1) * sizeof(*grown));
+        if (grown) {
+            layers.items = grown;
+            layers.items[layers.count++] = top;
+        } else {
+            status = EB_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    if (status == EB_SUCCESS)
+        status = write_layers(set_dir, &layers);
+    eb_set_layers_free(&layers);
+
+    // 3. Own index and log start empty, numbered after every layer
+    if (status == EB_SUCCESS) {
+        snprintf(path, sizeof(path), "%s/index", set_dir);
+        status = eb_set_index_create_after(path, top.seq_limit);
+    }
+    if (status == EB_SUCCESS) {
+        snprintf(path, sizeof(path), "%s/log", set_dir);
+        FILE* f = fopen(path, "w");
+        if (!f || fclose(f) != 0)
+            status = EB_ERROR_FILE_IO;
+    }
+    if (status == EB_SUCCESS)
+        status = link_refs(base_dir, set_dir);
+    if (status == EB_SUCCESS)
+        eb_set_sketch_fork(base_dir, set_dir, top.seq_limit);
+    return status;
+}
+
+/* Remove what a failed fork created; set directories are only two levels deep */
+static void remove_partial(const char* path, int depth) {
+    DIR* dir = opendir(path);
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+            char child[PATH_MAX];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            if (unlink(child) != 0 && depth > 0)
+                remove_partial(child, depth - 1);
+        }
+        closedir(dir);
+    }
+    if (rmdir(path) != 0)
+        DEBUG_PRINT("eb_set_layers_fork: Could not remove %s", path);
+}
+
+eb_status_t eb_set_layers_fork(const char* root, const char* base, const char* name) {
+    if (!root || !base || !*base || !name || !*name || strchr(base, '/') || strchr(name, '/'))
+        return EB_ERROR_INVALID_INPUT;
+
+    char base_dir[PATH_MAX], set_dir[PATH_MAX];
+    snprintf(base_dir, sizeof(base_dir), "%s/.embr/sets/%s", root, base);
+    snprintf(set_dir, sizeof(set_dir), "%s/.embr/sets/%s", root, name);
+    struct stat st;
+    if (stat(base_dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+    if (mkdir(set_dir, 0755) != 0)
+        return errno == EEXIST ? EB_ERROR_INVALID_INPUT : EB_ERROR_FILE_IO;
+
+    eb_status_t status = fork_into(root, base, base_dir, set_dir);
+    if (status != EB_SUCCESS)
+        remove_partial(set_dir, 2);
+    return status;
+}
+
+/* Write the layers' logs followed by the set's own log to tmp */
+static eb_status_t concat_logs(const char* log_path, const eb_set_layers_t* layers,
+                               const char* tmp) {
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+        return EB_ERROR_FILE_IO;
+
+    eb_status_t status = EB_SUCCESS;
+    for (size_t i = 0; status == EB_SUCCESS && i <= layers->count; i++) {
+        char path[PATH_MAX];
+        uint64_t length = UINT64_MAX;
+        if (i < layers->count) {
+            eb_set_layer_path(log_path, &layers->items[i], "log", path, sizeof(path));
+            length = layers->items[i].log_size;
+        } else {
+            snprintf(path, sizeof(path), "%s", log_path);
+        }
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            if (errno != ENOENT)
+                status = EB_ERROR_FILE_IO;
+            continue;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            status = EB_ERROR_FILE_IO;
+        } else {
+            if ((uint64_t)st.st_size < length)
+                length = (uint64_t)st.st_size;
+            status = eb_fs_copy_fd(fd, 0, length, out, NULL);
+        }
+        close(fd);
+    }
+    if (status == EB_SUCCESS && fsync(out) != 0)
+        status = EB_ERROR_FILE_IO;
+    if (close(out) != 0 && status == EB_SUCCESS)
+        status = EB_ERROR_FILE_IO;
+    return status;
+}
+
+static void remove_layer_files(const char* set_dir, const eb_set_layers_t* layers) {
+    char path[PATH_MAX];
+    for (size_t i = 0; i < layers->count; i++) {
+        layer_file(set_dir, &layers->items[i], "index", path, sizeof(path));
+        unlink(path);
+        layer_file(set_dir, &layers->items[i], "log", path, sizeof(path));
+        unlink(path);
+        strncat(path, ".idx", sizeof(path) - strlen(path) - 1);
+        unlink(path);
+    }
+    set_file(set_dir, EB_SET_LAYERS_FILE, path, sizeof(path));
+    unlink(path);
+    set_file(set_dir, FLATTEN_MARKER, path, sizeof(path));
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%s", set_dir, EB_SET_LAYERS_DIR);
+    rmdir(path);
+}
+
+/*
+ * Flatten in an order that can be resumed: the index first, which is
+ * flagged flat and so stops reading the layers; then the log, with a
+ * marker naming the log it replaces; then the layer files.
+ */
+eb_status_t eb_set_layers_flatten(const char* root, const char* set_dir) {
+    if (!root || !set_dir)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_set_layers_t layers;
+    eb_status_t status = read_layers(set_dir, &layers);
+    if (status != EB_SUCCESS)
+        return status;
+
+    char index_path[PATH_MAX], log_path[PATH_MAX], marker[PATH_MAX];
+    snprintf(index_path, sizeof(index_path), "%s/index", set_dir);
+    snprintf(log_path, sizeof(log_path), "%s/log", set_dir);
+    set_file(set_dir, FLATTEN_MARKER, marker, sizeof(marker));
+
+    // 1. The index
+    if (layers.count > 0)
+        status = eb_set_index_flatten(root, index_path);
+
+    // 2. The log, unless a previous run already replaced it
+    struct stat st;
+    bool log_done = layers.count == 0;
+    FILE* m = status == EB_SUCCESS && !log_done ? fopen(marker, "r") : NULL;
+    if (m) {
+        unsigned long long ino = 0;
+        log_done = fscanf(m, "%llu", &ino) == 1 &&
+                   (stat(log_path, &st) != 0 || (unsigned long long)st.st_ino != ino);
+        fclose(m);
+    }
+    if (status == EB_SUCCESS && !log_done) {
+        char tmp[PATH_MAX + 16];
+        snprintf(tmp, sizeof(tmp), "%s.tmp.%d", log_path, (int)getpid());
+        status = concat_logs(log_path, &layers, tmp);
+        if (status == EB_SUCCESS) {
+            FILE* f = fopen(marker, "w");
+            if (!f) {
+                status = EB_ERROR_FILE_IO;
+            } else {
+                fprintf(f, "%llu\n", stat(log_path, &st) == 0 ? (unsigned long long)st.st_ino : 0ULL);
+                if (fclose(f) != 0)
+                    status = EB_ERROR_FILE_IO;
+            }
+        }
+        if (status == EB_SUCCESS && rename(tmp, log_path) != 0)
+            status = EB_ERROR_FILE_IO;
+        if (status != EB_SUCCESS) {
+            unlink(tmp);
+            unlink(marker);
+        } else {
+            // Rebuilt from the new log on the next read
+            char idx[PATH_MAX + 8];
+            snprintf(idx, sizeof(idx), "%s.idx", log_path);
+            unlink(idx);
+        }
+    }
+
+    // 3. The layer files
+    if (status == EB_SUCCESS)
+        remove_layer_files(set_dir, &layers);
+    eb_set_layers_free(&layers);
+    return status;
+}
+
+eb_status_t eb_set_layers_remove(const char* set_dir) {
+    if (!set_dir)
+        return EB_ERROR_INVALID_INPUT;
+    eb_set_layers_t layers;
+    eb_status_t status = read_layers(set_dir, &layers);
+    if (status != EB_SUCCESS)
+        return status;
+    remove_layer_files(set_dir, &layers);
+    eb_set_layers_free(&layers);
+    return EB_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/*
+ * EmbeddingBridge - Copy-on-Write Set Layers
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_LAYERS_H
+#define EB_SET_LAYERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "status.h"
+
+/*
+ * A set created from a base set does not copy the base's index and log.
+ * Its directory gets a base/ directory holding hard links to them, frozen
+ * by a sequence point, and its own index and log only hold what changed
+ * since:
+ *
+ *   .embr/sets/<set>/base/layers      "<id> <set> <seq> <log-size>" lines, oldest first
+ *   .embr/sets/<set>/base/index.<id>  Records before <seq> belong to the layer
+ *   .embr/sets/<set>/base/log.<id>    The first <log-size> bytes belong to the layer
+ *
+ * The base set keeps writing to the same files: index records are only
+ * appended with higher sequence numbers, a compacted index is renamed
+ * into place, and the log is append-only, so neither changes what the
+ * layer sees. A set created from a layered set takes over its layers and
+ * adds one for the base's own files.
+ *
+ * eb_set_index_open() and the log_index readers merge the layers in, so
+ * callers see the whole set. Model refs are hard linked too, which holds
+ * because every writer replaces them through a rename.
+ */
+
+#define EB_SET_LAYERS_DIR  "base"
+#define EB_SET_LAYERS_FILE "layers"
+
+typedef struct {
+    unsigned id;
+    char set[256];          /* Set the layer was taken from */
+    uint64_t seq_limit;     /* First index sequence number not in the layer */
+    uint64_t log_size;      /* Log bytes in the layer */
+} eb_set_layer_t;
+
+typedef struct {
+    eb_set_layer_t* items;  /* Oldest first */
+    size_t count;
+} eb_set_layers_t;
+
+/**
+ * Read the layers of a set
+ *
+ * @param set_dir Set directory
+ * @param out Receives the layers, none for a set without a base
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_layers_load(const char* set_dir, eb_set_layers_t* out);
+
+/**
+ * Read the layers of the set a file belongs to
+ *
+ * @param file_path The set's index or log
+ * @param out Receives the layers
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_layers_load_for(const char* file_path, eb_set_layers_t* out);
+
+void eb_set_layers_free(eb_set_layers_t* layers);
+
+/**
+ * Path of a layer file
+ *
+ * @param file_path The set's index or log, whose directory holds base/
+ * @param layer Layer
+ * @param kind "index" or "log"
+ * @param out Receives the path
+ * @param size Size of out
+ */
+void eb_set_layer_path(const char* file_path, const eb_set_layer_t* layer, const char* kind,
+                       char* out, size_t size);
+
+/**
+ * Create a set layered over a base set
+ *
+ * Costs a few hard links per layer, not a copy of the base's history.
+ *
+ * @param root Repository root
+ * @param base Existing set
+ * @param name New set, which must not exist
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_layers_fork(const char* root, const char* base, const char* name);
+
+/**
+ * Fold the layers of a set into its own index and log and drop them
+ *
+ * Safe to run again after an interruption.
+ *
+ * @param root Repository root
+ * @param set_dir Set directory
+ * @return Status code (0 = success, also for a set without layers)
+ */
+eb_status_t eb_set_layers_flatten(const char* root, const char* set_dir);
+
+/**
+ * Delete the layer files of a set that is being removed
+ *
+ * The base sets keep their own files; only the links go.
+ *
+ * @param set_dir Set directory
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_layers_remove(const char* set_dir);
+
+#endif /* EB_SET_LAYERS_H */
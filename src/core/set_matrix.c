@@ -0,0 +1,595 @@
+/*
+ * EmbeddingBridge - Mappable Set Matrix Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "set_matrix.h"
+#include "set_index.h"
+#include "hash_utils.h"
+#include "store.h"
+#include "thread_pool.h"
+#include "object_reader.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Upper bound on reader threads */
+#define MAX_THREADS 64
+
+/* Entries read per window, and claimed by a reader at a time */
+#define MATRIX_WINDOW 1024
+#define MATRIX_BLOCK 64
+
+/* Distinct model names remembered for sharing pool strings */
+#define MODEL_CACHE 16
+
+typedef struct {
+    char* source;
+    char* model;                  /* "" if none was recorded */
+    char hash[65];
+    const float* reused;          /* Row of the earlier file, if unchanged */
+    float* values;                /* Read from the store otherwise */
+    size_t dims;
+    bool readable;
+} matrix_slot_t;
+
+typedef struct {
+    matrix_slot_t slots[MATRIX_WINDOW];
+    size_t count;
+    size_t next_block;
+} matrix_window_t;
+
+typedef struct {
+    eb_set_matrix_options_t options;
+    eb_status_t status;
+    eb_set_matrix_stats_t stats;
+
+    /* One store per reader */
+    eb_store_t* stores[MAX_THREADS];
+    unsigned threads;
+
+    /* The earlier export, walked alongside the index */
+    eb_set_matrix_t old;
+    bool have_old;
+    size_t old_cursor;
+
+    matrix_window_t window;
+
+    FILE* file;
+    uint32_t dims;                /* 0 until the first row is written */
+    eb_set_matrix_row_t* table;
+    size_t table_capacity;
+    char* strings;
+    size_t strings_size;
+    size_t strings_capacity;
+    uint32_t models[MODEL_CACHE];
+    size_t model_count;
+} matrix_export_t;
+
+typedef struct {
+    matrix_export_t* export;
+    eb_store_t* store;
+} matrix_reader_t;
+
+static bool valid_set_name(const char* name) {
+    return name && *name && strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+           strcmp(name, "..") != 0;
+}
+
+/* Set index order: bytewise by source, then by model */
+static int compare_key(const char* a, size_t a_len, const char* b, size_t b_len) {
+    size_t n = a_len < b_len ? a_len : b_len;
+    int cmp = n ? memcmp(a, b, n) : 0;
+    if (cmp)
+        return cmp;
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+static int compare_row(const eb_set_matrix_t* matrix, size_t row, const char* source,
+                       size_t source_len, const char* model, size_t model_len) {
+    const eb_set_matrix_row_t* r = &matrix->table[row];
+    int cmp = compare_key(matrix->strings + r->source_offset, r->source_length, source, source_len);
+    if (cmp || !model)
+        return cmp;
+    return compare_key(matrix->strings + r->model_offset, r->model_length, model, model_len);
+}
+
+/* A vector read for its slot; rows of other types stay unreadable */
+static int fill_slot(void* ctx, size_t index, eb_status_t status, eb_object_view_t* view) {
+    matrix_slot_t* slot = ((matrix_slot_t**)ctx)[index];
+    eb_vector_ref_t ref;
+    if (status != EB_SUCCESS || view->header.obj_type != EB_OBJ_VECTOR ||
+        eb_object_vector_ref(view, &ref) != EB_SUCCESS || ref.dims == 0 || ref.dims > UINT32_MAX ||
+        !(slot->values = malloc(ref.dims * sizeof(float))))
+        return 0;
+    eb_vector_ref_get(&ref, 0, ref.dims, slot->values);
+    slot->dims = ref.dims;
+    slot->readable = true;
+    return 0;
+}
+
+/* Claim blocks of the window until none are left, reading each in one batch */
+static void matrix_reader(void* arg) {
+    matrix_reader_t* reader = arg;
+    matrix_window_t* window = &reader->export->window;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&window->next_block, 1, __ATOMIC_RELAXED) * MATRIX_BLOCK;
+        if (first >= window->count)
+            break;
+        size_t end = window->count - first < MATRIX_BLOCK ? window->count : first + MATRIX_BLOCK;
+        matrix_slot_t* slots[MATRIX_BLOCK];
+        const char* hashes[MATRIX_BLOCK];
+        size_t count = 0;
+        for (size_t i = first; i < end; i++) {
+            if (!window->slots[i].reused) {
+                slots[count] = &window->slots[i];
+                hashes[count++] = window->slots[i].hash;
+            }
+        }
+        eb_object_read_many(reader->store, hashes, count, NULL, fill_slot, slots);
+    }
+}
+
+static void clear_window(matrix_window_t* window) {
+    for (size_t i = 0; i < window->count; i++) {
+        free(window->slots[i].source);
+        free(window->slots[i].model);
+        free(window->slots[i].values);
+    }
+    memset(window, 0, sizeof(*window));
+}
+
+/* Append a string to the pool, returning its offset */
+static eb_status_t add_string(matrix_export_t* export, const char* s, uint32_t* offset) {
+    size_t length = strlen(s) + 1;
+    if (export->strings_size + length > UINT32_MAX)
+        return EB_ERROR_LIMIT_EXCEEDED;
+    if (export->strings_size + length > export->strings_capacity) {
+        size_t capacity = export->strings_capacity ? export->strings_capacity * 2 : 64 * 1024;
+        while (capacity < export->strings_size + length)
+            capacity *= 2;
+        char* grown = realloc(export->strings, capacity);
+        if (!grown)
+            return EB_ERROR_MEMORY_ALLOCATION;
+        export->strings = grown;
+        export->strings_capacity = capacity;
+    }
+    *offset = (uint32_t)export->strings_size;
+    memcpy(export->strings + export->strings_size, s, length);
+    export->strings_size += length;
+    return EB_SUCCESS;
+}
+
+/* Models repeat on every row; the few distinct ones share one string */
+static eb_status_t add_model(matrix_export_t* export, const char* model, uint32_t* offset) {
+    for (size_t i = 0; i < export->model_count; i++) {
+        if (strcmp(export->strings + export->models[i], model) == 0) {
+            *offset = export->models[i];
+            return EB_SUCCESS;
+        }
+    }
+    eb_status_t status = add_string(export, model, offset);
+    if (status == EB_SUCCESS && export->model_count < MODEL_CACHE)
+        export->models[export->model_count++] = *offset;
+    return status;
+}
+
+static eb_status_t add_row(matrix_export_t* export, const matrix_slot_t* slot) {
+    if (export->stats.rows == export->table_capacity) {
+        size_t capacity = export->table_capacity ? export->table_capacity * 2 : MATRIX_WINDOW;
+        eb_set_matrix_row_t* grown = realloc(export->table, capacity * sizeof(*grown));
+        if (!grown)
+            return EB_ERROR_MEMORY_ALLOCATION;
+        export->table = grown;
+        export->table_capacity = capacity;
+    }
+    eb_set_matrix_row_t* row = &export->table[export->stats.rows];
+    memset(row, 0, sizeof(*row));
+    eb_hex_to_hash(slot->hash, row->hash);
+    row->source_length = (uint32_t)strlen(slot->source);
+    row->model_length = (uint32_t)strlen(slot->model);
+    eb_status_t status = add_string(export, slot->source, &row->source_offset);
+    if (status == EB_SUCCESS)
+        status = add_model(export, slot->model, &row->model_offset);
+    if (status != EB_SUCCESS)
+        return status;
+
+    const float* values = slot->reused ? slot->reused : slot->values;
+    if (fwrite(values, sizeof(float), export->dims, export->file) != export->dims)
+        return EB_ERROR_FILE_IO;
+    export->stats.rows++;
+    if (slot->reused)
+        export->stats.reused++;
+    return EB_SUCCESS;
+}
+
+/* Read the window with the pool, then write it in index order */
+static eb_status_t flush_window(matrix_export_t* export) {
+    matrix_window_t* window = &export->window;
+    matrix_reader_t readers[MAX_THREADS];
+    eb_task_group_t group;
+    eb_task_group_init(&group, eb_pool_shared());
+    size_t blocks = (window->count + MATRIX_BLOCK - 1) / MATRIX_BLOCK;
+    for (unsigned i = 0; i < export->threads && i < blocks; i++) {
+        readers[i] = (matrix_reader_t){ export, export->stores[i] };
+        eb_task_group_spawn(&group, matrix_reader, &readers[i]);
+    }
+    eb_task_group_wait(&group);
+
+    eb_status_t status = EB_SUCCESS;
+    for (size_t i = 0; status == EB_SUCCESS && i < window->count; i++) {
+        const matrix_slot_t* slot = &window->slots[i];
+        if (export->dims == 0 && slot->readable)
+            export->dims = (uint32_t)slot->dims;
+        if (!slot->readable) {
+            DEBUG_WARN("matrix: cannot read %s, skipped", slot->hash);
+            export->stats.skipped++;
+        } else if (slot->dims != export->dims) {
+            DEBUG_WARN("matrix: %s has %zu dimensions, not %u, skipped", slot->hash, slot->dims,
+                       export->dims);
+            export->stats.skipped++;
+        } else {
+            status = add_row(export, slot);
+        }
+    }
+    clear_window(window);
+    return status;
+}
+
+/* Row of the earlier export with the same source, model and hash */
+static const float* reusable_row(matrix_export_t* export, const char* source, const char* model,
+                                 const char* hash) {
+    if (!export->have_old)
+        return NULL;
+    const eb_set_matrix_t* old = &export->old;
+    size_t source_len = strlen(source), model_len = strlen(model);
+    int cmp = 1;
+    while (export->old_cursor < old->rows &&
+           (cmp = compare_row(old, export->old_cursor, source, source_len, model, model_len)) < 0)
+        export->old_cursor++;
+    uint8_t binary[32];
+    if (export->old_cursor == old->rows || cmp != 0 || !eb_hex_to_hash(hash, binary) ||
+        memcmp(old->table[export->old_cursor].hash, binary, sizeof(binary)) != 0)
+        return NULL;
+    return eb_set_matrix_values(old, export->old_cursor++);
+}
+
+static int export_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    matrix_export_t* export = ctx;
+    if (export->options.model && strcmp(export->options.model, model) != 0)
+        return 0;
+    matrix_slot_t* slot = &export->window.slots[export->window.count];
+    slot->source = strdup(source);
+    slot->model = strdup(model);
+    if (!slot->source || !slot->model) {
+        free(slot->source);
+        free(slot->model);
+        slot->source = slot->model = NULL;
+        export->status = EB_ERROR_MEMORY_ALLOCATION;
+        return 1;
+    }
+    memcpy(slot->hash, hash, 65);
+    if ((slot->reused = reusable_row(export, source, model, hash)) != NULL) {
+        slot->dims = export->old.dims;
+        slot->readable = true;
+    }
+    if (++export->window.count == MATRIX_WINDOW)
+        export->status = flush_window(export);
+    return export->status != EB_SUCCESS;
+}
+
+static bool write_padding(FILE* f, uint64_t offset) {
+    static const char zeros[EB_SET_MATRIX_ALIGN];
+    long at = ftell(f);
+    if (at < 0 || (uint64_t)at > offset)
+        return false;
+    size_t count = (size_t)(offset - (uint64_t)at);
+    return fwrite(zeros, 1, count, f) == count;
+}
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/* Where the parts of the codes start, and where the last one ends */
+typedef struct {
+    uint64_t terms;
+    uint64_t codes;
+    uint64_t signs;
+    uint64_t end;
+} code_layout_t;
+
+static code_layout_t code_layout(const eb_set_matrix_header_t* h) {
+    code_layout_t layout;
+    layout.terms = h->codes_offset;
+    layout.codes = align_up(layout.terms + h->rows * sizeof(eb_set_matrix_terms_t),
+                            EB_SET_MATRIX_CODE_ALIGN);
+    layout.signs = align_up(layout.codes + h->rows * eb_set_matrix_code_stride(h->dims),
+                            EB_SET_MATRIX_CODE_ALIGN);
+    layout.end = layout.signs + h->rows * eb_set_matrix_sign_words(h->dims) * sizeof(uint64_t);
+    return layout;
+}
+
+void eb_set_matrix_encode(const float* values, uint32_t dims, eb_set_matrix_terms_t* terms,
+                          int8_t* codes, uint64_t* signs) {
+    float max_abs = 0.0f;
+    double norm = 0.0;
+    for (uint32_t i = 0; i < dims; i++) {
+        float magnitude = fabsf(values[i]);
+        if (magnitude > max_abs && isfinite(magnitude))
+            max_abs = magnitude;
+        norm += (double)values[i] * (double)values[i];
+    }
+    terms->scale = max_abs / 127.0f;
+    terms->norm = (float)sqrt(norm);
+
+    memset(codes, 0, eb_set_matrix_code_stride(dims));
+    memset(signs, 0, eb_set_matrix_sign_words(dims) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < dims; i++) {
+        // NaN compares false everywhere and becomes 0
+        float level = terms->scale > 0.0f ? values[i] / terms->scale : 0.0f;
+        codes[i] = level >= 127.0f ? 127 : level <= -127.0f ? -127
+                 : level == level ? (int8_t)lrintf(level) : 0;
+        if (values[i] > 0.0f)
+            signs[i / 64] |= 1ull << (i % 64);
+    }
+}
+
+/* Encode the rows as written so far, reading them back a window at a time */
+static bool write_codes(FILE* f, const eb_set_matrix_header_t* h) {
+    int fd = fileno(f);
+    code_layout_t layout = code_layout(h);
+    size_t stride = eb_set_matrix_code_stride(h->dims);
+    size_t words = eb_set_matrix_sign_words(h->dims);
+    float* values = malloc((size_t)MATRIX_WINDOW * h->dims * sizeof(float) + 1);
+    eb_set_matrix_terms_t* terms = malloc(MATRIX_WINDOW * sizeof(*terms));
+    int8_t* codes = malloc(MATRIX_WINDOW * stride + 1);
+    uint64_t* signs = malloc(MATRIX_WINDOW * words * sizeof(uint64_t) + 1);
+    bool ok = values && terms && codes && signs && fflush(f) == 0;
+
+    for (uint64_t row = 0; ok && row < h->rows; row += MATRIX_WINDOW) {
+        size_t count = h->rows - row < MATRIX_WINDOW ? (size_t)(h->rows - row) : MATRIX_WINDOW;
+        size_t bytes = count * h->dims * sizeof(float);
+        ok = pread(fd, values, bytes, (off_t)(h->data_offset + row * h->dims * sizeof(float))) ==
+             (ssize_t)bytes;
+        for (size_t i = 0; ok && i < count; i++)
+            eb_set_matrix_encode(values + i * h->dims, h->dims, &terms[i], codes + i * stride,
+                                 signs + i * words);
+        ok = ok &&
+             pwrite(fd, terms, count * sizeof(*terms),
+                    (off_t)(layout.terms + row * sizeof(*terms))) == (ssize_t)(count * sizeof(*terms)) &&
+             pwrite(fd, codes, count * stride, (off_t)(layout.codes + row * stride)) ==
+                 (ssize_t)(count * stride) &&
+             pwrite(fd, signs, count * words * sizeof(uint64_t),
+                    (off_t)(layout.signs + row * words * sizeof(uint64_t))) ==
+                 (ssize_t)(count * words * sizeof(uint64_t));
+    }
+    free(values);
+    free(terms);
+    free(codes);
+    free(signs);
+    return ok && ftruncate(fd, (off_t)layout.end) == 0;
+}
+
+/* Write the row table, the strings and finally the header */
+static eb_status_t finish_file(matrix_export_t* export) {
+    eb_set_matrix_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EB_SET_MATRIX_MAGIC, sizeof(header.magic));
+    header.version = EB_SET_MATRIX_VERSION;
+    header.dims = export->dims;
+    header.rows = export->stats.rows;
+    header.data_offset = EB_SET_MATRIX_ALIGN;
+    header.table_offset = align_up(header.data_offset +
+                                   header.rows * header.dims * sizeof(float), 64);
+    header.strings_offset = header.table_offset + header.rows * sizeof(eb_set_matrix_row_t);
+    header.strings_size = export->strings_size;
+    if (export->options.codes)
+        header.codes_offset = align_up(header.strings_offset + header.strings_size,
+                                       EB_SET_MATRIX_CODE_ALIGN);
+
+    FILE* f = export->file;
+    bool ok = write_padding(f, header.table_offset) &&
+              (export->stats.rows == 0 ||
+               fwrite(export->table, sizeof(*export->table), export->stats.rows, f) == export->stats.rows) &&
+              fwrite(export->strings, 1, export->strings_size, f) == export->strings_size &&
+              (!header.codes_offset || write_codes(f, &header)) &&
+              fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fflush(f) == 0 && fsync(fileno(f)) == 0;
+    return ok ? EB_SUCCESS : EB_ERROR_FILE_IO;
+}
+
+eb_status_t eb_set_matrix_export(const char* root, const char* set_name, const char* path,
+                                 const eb_set_matrix_options_t* options,
+                                 eb_set_matrix_stats_t* stats_out) {
+    if (!root || !path || !valid_set_name(set_name))
+        return EB_ERROR_INVALID_PARAMETER;
+    char index_path[PATH_MAX];
+    struct stat st;
+    snprintf(index_path, sizeof(index_path), "%s/.embr/sets/%s", root, set_name);
+    if (stat(index_path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+
+    matrix_export_t* export = calloc(1, sizeof(*export));
+    if (!export)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    if (options)
+        export->options = *options;
+    export->have_old = eb_set_matrix_open(path, &export->old) == EB_SUCCESS;
+
+    // A reader without a store is not started; the calling thread needs the first one
+    eb_status_t status = EB_SUCCESS;
+    unsigned wanted = eb_pool_threads(export->options.threads, MAX_THREADS);
+    eb_store_config_t config = { .root_path = (char*)root };
+    while (export->threads < wanted &&
+           eb_store_init(&config, &export->stores[export->threads]) == EB_SUCCESS)
+        export->threads++;
+    if (export->threads == 0)
+        status = EB_ERROR_NOT_INITIALIZED;
+
+    // The pool starts with "" for rows without a model
+    uint32_t empty;
+    if (status == EB_SUCCESS)
+        status = add_model(export, "", &empty);
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    if (status == EB_SUCCESS) {
+        export->file = fopen(tmp_path, "w+b");
+        if (!export->file || !write_padding(export->file, EB_SET_MATRIX_ALIGN))
+            status = EB_ERROR_FILE_IO;
+    }
+
+    eb_set_index_t* index = NULL;
+    snprintf(index_path, sizeof(index_path), "%s/.embr/sets/%s/index", root, set_name);
+    if (status == EB_SUCCESS)
+        status = eb_set_index_open(root, index_path, &index);
+    if (status == EB_SUCCESS) {
+        export->status = EB_SUCCESS;
+        status = eb_set_index_foreach(index, NULL, export_entry, export);
+        if (status == EB_SUCCESS)
+            status = export->status;
+        eb_set_index_close(index);
+    }
+    if (status == EB_SUCCESS && export->window.count > 0)
+        status = flush_window(export);
+    clear_window(&export->window);
+    if (status == EB_SUCCESS)
+        status = finish_file(export);
+
+    if (export->file && fclose(export->file) != 0 && status == EB_SUCCESS)
+        status = EB_ERROR_FILE_IO;
+    if (status == EB_SUCCESS && rename(tmp_path, path) != 0)
+        status = EB_ERROR_FILE_IO;
+    if (status != EB_SUCCESS && export->file)
+        unlink(tmp_path);
+
+    for (unsigned i = 0; i < export->threads; i++)
+        eb_store_destroy(export->stores[i]);
+    if (export->have_old)
+        eb_set_matrix_close(&export->old);
+    free(export->table);
+    free(export->strings);
+
+    if (status == EB_SUCCESS) {
+        DEBUG_INFO("matrix: %zu vectors of set %s, %zu unchanged", export->stats.rows, set_name,
+                   export->stats.reused);
+        if (stats_out)
+            *stats_out = export->stats;
+    }
+    free(export);
+    return status;
+}
+
+static bool valid_string(const eb_set_matrix_t* matrix, uint64_t strings_size, uint32_t offset,
+                         uint32_t length) {
+    return (uint64_t)offset + length < strings_size && matrix->strings[offset + length] == '\0';
+}
+
+eb_status_t eb_set_matrix_open(const char* path, eb_set_matrix_t* out) {
+    if (!path || !out)
+        return EB_ERROR_INVALID_PARAMETER;
+    memset(out, 0, sizeof(*out));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return EB_ERROR_NOT_FOUND;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(eb_set_matrix_header_t)) {
+        close(fd);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return EB_ERROR_IO;
+
+    const eb_set_matrix_header_t* h = map;
+    uint64_t matrix_bytes = h->rows * h->dims * sizeof(float);
+    bool ok = memcmp(h->magic, EB_SET_MATRIX_MAGIC, sizeof(h->magic)) == 0 &&
+              h->version == EB_SET_MATRIX_VERSION &&
+              h->data_offset % EB_SET_MATRIX_ALIGN == 0 && h->table_offset % 64 == 0 &&
+              h->rows <= size / sizeof(eb_set_matrix_row_t) &&
+              (h->dims == 0 || h->rows <= size / sizeof(float) / h->dims) &&
+              h->data_offset <= size && matrix_bytes <= size - h->data_offset &&
+              h->table_offset >= h->data_offset + matrix_bytes &&
+              h->table_offset <= size &&
+              h->rows * sizeof(eb_set_matrix_row_t) <= size - h->table_offset &&
+              h->strings_offset >= h->table_offset + h->rows * sizeof(eb_set_matrix_row_t) &&
+              h->strings_offset <= size && h->strings_size <= size - h->strings_offset &&
+              (h->rows == 0 || h->dims > 0);
+    code_layout_t layout = { 0, 0, 0, 0 };
+    if (ok && h->codes_offset) {
+        ok = h->codes_offset % EB_SET_MATRIX_CODE_ALIGN == 0 &&
+             h->codes_offset >= h->strings_offset + h->strings_size && h->codes_offset <= size;
+        if (ok) {
+            layout = code_layout(h);
+            ok = layout.end <= size;
+        }
+    }
+    if (ok) {
+        out->values = (const float*)((const char*)map + h->data_offset);
+        out->table = (const eb_set_matrix_row_t*)((const char*)map + h->table_offset);
+        out->strings = (const char*)map + h->strings_offset;
+        out->rows = (size_t)h->rows;
+        out->dims = h->dims;
+        if (h->codes_offset) {
+            out->terms = (const eb_set_matrix_terms_t*)((const char*)map + layout.terms);
+            out->codes = (const int8_t*)((const char*)map + layout.codes);
+            out->signs = (const uint64_t*)((const char*)map + layout.signs);
+        }
+        for (size_t i = 0; ok && i < out->rows; i++) {
+            const eb_set_matrix_row_t* row = &out->table[i];
+            ok = valid_string(out, h->strings_size, row->source_offset, row->source_length) &&
+                 valid_string(out, h->strings_size, row->model_offset, row->model_length);
+        }
+    }
+    if (!ok) {
+        munmap(map, size);
+        memset(out, 0, sizeof(*out));
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    out->map = map;
+    out->map_size = size;
+    return EB_SUCCESS;
+}
+
+void eb_set_matrix_close(eb_set_matrix_t* matrix) {
+    if (matrix && matrix->map)
+        munmap(matrix->map, matrix->map_size);
+    if (matrix)
+        memset(matrix, 0, sizeof(*matrix));
+}
+
+size_t eb_set_matrix_find(const eb_set_matrix_t* matrix, const char* source, const char* model) {
+    if (!matrix || !source)
+        return SIZE_MAX;
+    size_t source_len = strlen(source), model_len = model ? strlen(model) : 0;
+    size_t lo = 0, hi = matrix->rows;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (compare_row(matrix, mid, source, source_len, model, model_len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == matrix->rows || compare_row(matrix, lo, source, source_len, model, model_len) != 0)
+        return SIZE_MAX;
+    return lo;
+}
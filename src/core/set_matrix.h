@@ -0,0 +1,189 @@
+/*
+ * EmbeddingBridge - Mappable Set Matrix
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_MATRIX_H
+#define EB_SET_MATRIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "status.h"
+
+/*
+ * The live vectors of a set as one file that serving and evaluation code
+ * maps and uses as is, with no parsing and no dependencies:
+ *
+ *   header | rows x dims float32 matrix | row table | string pool
+ *
+ * The matrix starts on a page boundary and is row-major with no padding,
+ * so row i is values + i * dims. Row i of the table holds the object hash
+ * and the source and model of matrix row i as offsets into the string
+ * pool, whose strings are NUL-terminated and can be used in place. Rows
+ * are in set index order, by source and then model, so a (source, model)
+ * lookup is a binary search. Every vector has the same dimensions; rows of
+ * other dimensions are skipped on export (pick a model to avoid that).
+ *
+ * Exporting over an earlier file is incremental: rows whose source, model
+ * and hash are unchanged are copied from the old mapping, and only changed
+ * or new ones are read from the object store. The new file is written
+ * beside the old one and renamed over it, so readers holding the old
+ * mapping are not disturbed.
+ *
+ * Exports with codes add a compact copy of the matrix for scanning
+ * (set_scan.h) after the string pool, each part 64-byte aligned:
+ *
+ *   row terms | int8 codes | sign bits
+ *
+ * The terms of a row are its int8 scale and L2 norm. Its int8 codes are
+ * round(value / scale), scale being max|value| / 127, zero-padded to
+ * eb_set_matrix_code_stride() bytes, and its sign bits are one bit per
+ * value, set for values above zero, in eb_set_matrix_sign_words() words.
+ * Codes are rebuilt from the matrix on every export. Files without them
+ * have a codes_offset of 0.
+ *
+ * Integers are stored little-endian.
+ */
+
+#define EB_SET_MATRIX_MAGIC "EBMATRX1"
+#define EB_SET_MATRIX_VERSION 1
+#define EB_SET_MATRIX_ALIGN 4096     /* Alignment of the matrix in the file */
+#define EB_SET_MATRIX_CODE_ALIGN 64  /* Alignment of the codes and of each row's codes */
+
+typedef struct {
+    char magic[8];                   /* EB_SET_MATRIX_MAGIC, not NUL-terminated */
+    uint32_t version;
+    uint32_t dims;
+    uint64_t rows;
+    uint64_t data_offset;            /* Matrix, EB_SET_MATRIX_ALIGN-aligned */
+    uint64_t table_offset;           /* Row table, 64-byte aligned */
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t codes_offset;           /* Row terms, then the codes; 0 for none */
+} eb_set_matrix_header_t;
+
+typedef struct {
+    uint8_t hash[32];                /* Binary object hash */
+    uint32_t source_offset;          /* Into the string pool */
+    uint32_t source_length;
+    uint32_t model_offset;           /* "" if no model was recorded */
+    uint32_t model_length;
+} eb_set_matrix_row_t;
+
+typedef struct {
+    float scale;                     /* Int8 scale, 0 for an all-zero row */
+    float norm;                      /* L2 norm of the float32 row */
+} eb_set_matrix_terms_t;
+
+/* A mapped file; every pointer is into the mapping */
+typedef struct {
+    const float* values;             /* rows * dims */
+    const eb_set_matrix_row_t* table;
+    const char* strings;
+    size_t rows;
+    uint32_t dims;
+
+    /* Codes, NULL if the file has none */
+    const eb_set_matrix_terms_t* terms;
+    const int8_t* codes;             /* rows * eb_set_matrix_code_stride(dims) */
+    const uint64_t* signs;           /* rows * eb_set_matrix_sign_words(dims) */
+
+    /* Internal */
+    void* map;
+    size_t map_size;
+} eb_set_matrix_t;
+
+typedef struct {
+    const char* model;               /* Only export this model, NULL for every model */
+    unsigned threads;                /* Reader threads, 0 for one per online CPU */
+    bool codes;                      /* Add the codes set_scan.h scans */
+} eb_set_matrix_options_t;
+
+typedef struct {
+    size_t rows;                     /* Rows written */
+    size_t reused;                   /* Of those, copied from the earlier file */
+    size_t skipped;                  /* Unreadable vectors or other dimensions */
+} eb_set_matrix_stats_t;
+
+/**
+ * Export a set as a matrix file, updating an earlier export at path
+ *
+ * @param root Repository root
+ * @param set_name Set to export
+ * @param path File to write; an earlier export there is reused and replaced
+ * @param options Options, NULL for the defaults
+ * @param stats_out Receives the counts, may be NULL
+ * @return Status code (EB_ERROR_NOT_FOUND for an unknown set)
+ */
+eb_status_t eb_set_matrix_export(const char* root, const char* set_name, const char* path,
+                                 const eb_set_matrix_options_t* options,
+                                 eb_set_matrix_stats_t* stats_out);
+
+/**
+ * Map a matrix file read-only
+ *
+ * The header and every table entry are checked against the file, so the
+ * accessors below need no bounds checks of their own.
+ *
+ * @param path File written by eb_set_matrix_export()
+ * @param out Receives the mapping, release with eb_set_matrix_close()
+ * @return Status code (EB_ERROR_INVALID_FORMAT if path is not a valid matrix file)
+ */
+eb_status_t eb_set_matrix_open(const char* path, eb_set_matrix_t* out);
+
+void eb_set_matrix_close(eb_set_matrix_t* matrix);
+
+/**
+ * Row of a source and model
+ *
+ * @param matrix Open matrix
+ * @param source Source path
+ * @param model Model name, NULL for the first row of the source
+ * @return Row index, or SIZE_MAX if there is none
+ */
+size_t eb_set_matrix_find(const eb_set_matrix_t* matrix, const char* source, const char* model);
+
+static inline const float* eb_set_matrix_values(const eb_set_matrix_t* matrix, size_t row) {
+    return matrix->values + row * matrix->dims;
+}
+
+/**
+ * Encode one row as exports with codes do
+ *
+ * Queries are encoded the same way to be compared with the rows.
+ *
+ * @param values dims floats
+ * @param dims Dimensions
+ * @param terms Receives the scale and norm
+ * @param codes Receives eb_set_matrix_code_stride(dims) bytes
+ * @param signs Receives eb_set_matrix_sign_words(dims) words
+ */
+void eb_set_matrix_encode(const float* values, uint32_t dims, eb_set_matrix_terms_t* terms,
+                          int8_t* codes, uint64_t* signs);
+
+/* Bytes of int8 codes per row */
+static inline size_t eb_set_matrix_code_stride(uint32_t dims) {
+    return ((size_t)dims + EB_SET_MATRIX_CODE_ALIGN - 1) / EB_SET_MATRIX_CODE_ALIGN *
+           EB_SET_MATRIX_CODE_ALIGN;
+}
+
+/* 64-bit words of sign bits per row */
+static inline size_t eb_set_matrix_sign_words(uint32_t dims) {
+    return ((size_t)dims + 63) / 64;
+}
+
+static inline const char* eb_set_matrix_source(const eb_set_matrix_t* matrix, size_t row) {
+    return matrix->strings + matrix->table[row].source_offset;
+}
+
+static inline const char* eb_set_matrix_model(const eb_set_matrix_t* matrix, size_t row) {
+    return matrix->strings + matrix->table[row].model_offset;
+}
+
+#endif /* EB_SET_MATRIX_H */
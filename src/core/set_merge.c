@@ -0,0 +1,413 @@
+/*
+ * EmbeddingBridge - Set Merge Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "set_merge.h"
+#include "set_index.h"
+#include "log_index.h"
+#include "set_checkpoint.h"
+#include "hnsw.h"
+#include "path_utils.h"
+#include "fs.h"
+#include "debug.h"
+#include "thread_pool.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Source entries claimed by a worker at a time */
+#define PROBE_BLOCK 1024
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    char* source;
+    char* model;
+    char hash[65];
+    uint64_t key;               /* Hash of (source, model), set before use */
+} merge_entry_t;
+
+typedef struct {
+    merge_entry_t* items;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} entry_list_t;
+
+/* Target entries by (source, model) */
+typedef struct {
+    const entry_list_t* entries;
+    uint32_t* slots;            /* Entry index + 1, 0 for empty */
+    size_t mask;
+} join_table_t;
+
+/* What the probe found for one source entry */
+typedef struct {
+    const merge_entry_t* target;
+    eb_set_merge_state_t state;
+} join_result_t;
+
+typedef struct {
+    const join_table_t* table;
+    entry_list_t* source;
+    join_result_t* results;
+    size_t next_block;
+} probe_job_t;
+
+static uint64_t entry_key(const char* source, const char* model) {
+    uint64_t h = FNV_OFFSET;
+    for (const unsigned char* p = (const unsigned char*)source; *p; p++) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    // A separator byte keeps ("ab", "c") apart from ("a", "bc")
+    h *= FNV_PRIME;
+    for (const unsigned char* p = (const unsigned char*)model; *p; p++) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static int collect_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    entry_list_t* list = ctx;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        merge_entry_t* grown = realloc(list->items, capacity * sizeof(*grown));
+        if (!grown) {
+            list->failed = true;
+            return 1;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    merge_entry_t* e = &list->items[list->count];
+    e->source = strdup(source);
+    e->model = strdup(model);
+    if (!e->source || !e->model) {
+        free(e->source);
+        free(e->model);
+        list->failed = true;
+        return 1;
+    }
+    memcpy(e->hash, hash, 65);
+    e->key = 0;
+    list->count++;
+    return 0;
+}
+
+static void free_entries(entry_list_t* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->items[i].source);
+        free(list->items[i].model);
+    }
+    free(list->items);
+}
+
+static bool valid_set_name(const char* name) {
+    return name && *name && strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+           strcmp(name, "..") != 0;
+}
+
+/* Live entries of a set in source order */
+static eb_status_t load_set(const char* root, const char* name, entry_list_t* list) {
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s", root, name);
+    if (!valid_set_name(name) || stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s/index", root, name);
+
+    eb_set_index_t* index = NULL;
+    eb_status_t status = eb_set_index_open(root, path, &index);
+    if (status != EB_SUCCESS)
+        return status;
+    status = eb_set_index_foreach(index, NULL, collect_entry, list);
+    eb_set_index_close(index);
+    if (status == EB_SUCCESS && list->failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    return status;
+}
+
+static eb_status_t table_build(join_table_t* table, entry_list_t* entries) {
+    size_t slot_count = 1024;
+    while (slot_count < entries->count * 2)
+        slot_count *= 2;
+    table->entries = entries;
+    table->mask = slot_count - 1;
+    table->slots = calloc(slot_count, sizeof(*table->slots));
+    if (!table->slots)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    // An index holds each (source, model) once, so no entry replaces another
+    for (size_t i = 0; i < entries->count; i++) {
+        merge_entry_t* e = &entries->items[i];
+        e->key = entry_key(e->source, e->model);
+        size_t slot = e->key & table->mask;
+        while (table->slots[slot])
+            slot = (slot + 1) & table->mask;
+        table->slots[slot] = (uint32_t)(i + 1);
+    }
+    return EB_SUCCESS;
+}
+
+static const merge_entry_t* table_find(const join_table_t* table, const merge_entry_t* probe) {
+    for (size_t slot = probe->key & table->mask;; slot = (slot + 1) & table->mask) {
+        uint32_t i = table->slots[slot];
+        if (!i)
+            return NULL;
+        const merge_entry_t* e = &table->entries->items[i - 1];
+        if (e->key == probe->key && strcmp(e->source, probe->source) == 0 &&
+            strcmp(e->model, probe->model) == 0)
+            return e;
+    }
+}
+
+/* Claim blocks of source entries and classify them against the table */
+static void probe_worker(void* arg) {
+    probe_job_t* job = arg;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * PROBE_BLOCK;
+        if (first >= job->source->count)
+            break;
+        size_t end = job->source->count - first < PROBE_BLOCK ? job->source->count : first + PROBE_BLOCK;
+        for (size_t i = first; i < end; i++) {
+            merge_entry_t* e = &job->source->items[i];
+            e->key = entry_key(e->source, e->model);
+            const merge_entry_t* match = table_find(job->table, e);
+            job->results[i].target = match;
+            job->results[i].state = !match ? EB_SET_MERGE_NEW :
+                                    strcmp(match->hash, e->hash) == 0 ? EB_SET_MERGE_SAME :
+                                    EB_SET_MERGE_CONFLICT;
+        }
+    }
+}
+
+static void probe_all(const join_table_t* table, entry_list_t* source, join_result_t* results,
+                      unsigned threads) {
+    probe_job_t job = { table, source, results, 0 };
+
+    // The calling thread works too, so a busy pool only costs speed
+    eb_parallel_run(NULL, eb_pool_threads(threads, (source->count + PROBE_BLOCK - 1) / PROBE_BLOCK),
+                    probe_worker, &job);
+}
+
+/* Whether path is the current set's index, which has the vector index to keep up to date */
+static bool is_current_index(const char* path) {
+    char* current = get_current_set_index_path();
+    struct stat a, b;
+    bool same = current && stat(current, &a) == 0 && stat(path, &b) == 0 &&
+                a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    free(current);
+    return same;
+}
+
+/* One append of every taken entry to the target log */
+static eb_status_t append_log(const char* log_path, merge_entry_t* const* taken, size_t count) {
+    FILE* f = fopen(log_path, "a");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+    long now = (long)time(NULL);
+    for (size_t i = 0; i < count; i++) {
+        if (taken[i]->model[0])
+            fprintf(f, "%ld %s %s %s\n", now, taken[i]->hash, taken[i]->source, taken[i]->model);
+        else
+            fprintf(f, "%ld %s %s\n", now, taken[i]->hash, taken[i]->source);
+    }
+    if (fclose(f) != 0)
+        return EB_ERROR_FILE_IO;
+    if (eb_log_index_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("eb_set_merge: Failed to update log index for %s", log_path);
+    if (eb_checkpoint_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("eb_set_merge: Failed to checkpoint %s", log_path);
+    return EB_SUCCESS;
+}
+
+static int compare_model_source(const void* x, const void* y) {
+    const merge_entry_t* a = *(merge_entry_t* const*)x;
+    const merge_entry_t* b = *(merge_entry_t* const*)y;
+    int cmp = strcmp(a->model, b->model);
+    return cmp ? cmp : strcmp(a->source, b->source);
+}
+
+static int compare_source(const void* key, const void* item) {
+    return strcmp(key, (*(merge_entry_t* const*)item)->source);
+}
+
+/* Rewrite refs/models/<model> once per model, keeping the lines of sources not taken */
+static void update_model_refs(const char* set_dir, merge_entry_t** taken, size_t count) {
+    size_t with_model = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (taken[i]->model[0])
+            taken[with_model++] = taken[i];
+    }
+    if (with_model == 0)
+        return;
+    qsort(taken, with_model, sizeof(*taken), compare_model_source);
+
+    char refs_dir[PATH_MAX];
+    snprintf(refs_dir, sizeof(refs_dir), "%s/refs/models", set_dir);
+    if (fs_mkdir_p(refs_dir, 0755) != 0) {
+        fprintf(stderr, "Warning: Failed to create models directory\n");
+        return;
+    }
+
+    for (size_t start = 0, end; start < with_model; start = end) {
+        const char* model = taken[start]->model;
+        for (end = start + 1; end < with_model && strcmp(taken[end]->model, model) == 0; end++)
+            ;
+        merge_entry_t** run = &taken[start];
+        size_t run_count = end - start;
+
+        char ref_path[PATH_MAX], tmp_path[PATH_MAX + 16];
+        snprintf(ref_path, sizeof(ref_path), "%s/%s", refs_dir, model);
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", ref_path);
+        FILE* out = fopen(tmp_path, "w");
+        if (!out) {
+            fprintf(stderr, "Warning: Failed to update model reference file for %s\n", model);
+            continue;
+        }
+
+        FILE* in = fopen(ref_path, "r");
+        if (in) {
+            char line[PATH_MAX + 80];
+            while (fgets(line, sizeof(line), in)) {
+                char hash[65], source[PATH_MAX];
+                line[strcspn(line, "\n")] = 0;
+                if (sscanf(line, "%64s %4095s", hash, source) == 2 &&
+                    !bsearch(source, run, run_count, sizeof(*run), compare_source))
+                    fprintf(out, "%s\n", line);
+            }
+            fclose(in);
+        }
+        for (size_t i = 0; i < run_count; i++)
+            fprintf(out, "%s %s\n", run[i]->hash, run[i]->source);
+
+        // A rename, since refs may be hard linked into a set based on this one
+        if (fclose(out) != 0 || rename(tmp_path, ref_path) != 0) {
+            fprintf(stderr, "Warning: Failed to update model reference file for %s\n", model);
+            unlink(tmp_path);
+        }
+    }
+}
+
+/* Record the taken entries in the target set: index, log, then model refs */
+static eb_status_t write_merge(const char* root, const char* target, merge_entry_t** taken,
+                               size_t count) {
+    eb_set_index_change_t* changes = malloc(count * sizeof(*changes));
+    if (!changes)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    for (size_t i = 0; i < count; i++) {
+        changes[i].source = taken[i]->source;
+        changes[i].model = taken[i]->model;
+        changes[i].hash = taken[i]->hash;
+    }
+
+    char set_dir[PATH_MAX], path[PATH_MAX + 8];
+    snprintf(set_dir, sizeof(set_dir), "%s/.embr/sets/%s", root, target);
+    snprintf(path, sizeof(path), "%s/index", set_dir);
+    eb_status_t status = eb_set_index_apply(root, path, changes, count);
+    if (status == EB_SUCCESS && is_current_index(path) &&
+        eb_hnsw_apply(root, changes, count) != EB_SUCCESS)
+        fprintf(stderr, "warning: failed to update vector index, run 'embr index build'\n");
+    free(changes);
+    if (status != EB_SUCCESS)
+        return status;
+
+    snprintf(path, sizeof(path), "%s/log", set_dir);
+    if (append_log(path, taken, count) != EB_SUCCESS)
+        fprintf(stderr, "Warning: Failed to update history\n");
+    update_model_refs(set_dir, taken, count);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_set_merge(const char* root, const char* source_set, const char* target_set,
+                         const eb_set_merge_options_t* options, eb_set_merge_visit_fn fn,
+                         void* ctx, eb_set_merge_summary_t* summary) {
+    if (!root || !source_set || !target_set)
+        return EB_ERROR_INVALID_INPUT;
+    if (strcmp(source_set, target_set) == 0)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_set_merge_summary_t local;
+    if (!summary)
+        summary = &local;
+    memset(summary, 0, sizeof(*summary));
+    bool theirs = options && options->theirs;
+    bool dry_run = options && options->dry_run;
+
+    entry_list_t source = { 0 }, target = { 0 };
+    join_table_t table = { 0 };
+    join_result_t* results = NULL;
+    merge_entry_t** taken = NULL;
+    eb_status_t status = load_set(root, source_set, &source);
+    if (status == EB_SUCCESS)
+        status = load_set(root, target_set, &target);
+    if (status == EB_SUCCESS)
+        status = table_build(&table, &target);
+    if (status == EB_SUCCESS) {
+        results = malloc((source.count ? source.count : 1) * sizeof(*results));
+        taken = malloc((source.count ? source.count : 1) * sizeof(*taken));
+        if (!results || !taken)
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t taken_count = 0;
+    if (status == EB_SUCCESS) {
+        probe_all(&table, &source, results, options ? options->threads : 0);
+
+        bool reporting = fn != NULL;
+        summary->entries = source.count;
+        for (size_t i = 0; i < source.count; i++) {
+            eb_set_merge_entry_t entry = {
+                source.items[i].source, source.items[i].model, source.items[i].hash,
+                results[i].target ? results[i].target->hash : NULL, results[i].state, false
+            };
+            switch (entry.state) {
+            case EB_SET_MERGE_NEW:
+                entry.taken = true;
+                summary->added++;
+                break;
+            case EB_SET_MERGE_SAME:
+                summary->same++;
+                break;
+            case EB_SET_MERGE_CONFLICT:
+                summary->conflicts++;
+                entry.taken = theirs;
+                if (theirs)
+                    summary->replaced++;
+                break;
+            }
+            if (entry.taken)
+                taken[taken_count++] = &source.items[i];
+            if (reporting && fn(&entry, ctx) != 0)
+                reporting = false;
+        }
+    }
+
+    if (status == EB_SUCCESS && !dry_run && taken_count > 0)
+        status = write_merge(root, target_set, taken, taken_count);
+
+    free(taken);
+    free(results);
+    free(table.slots);
+    free_entries(&source);
+    free_entries(&target);
+    return status;
+}
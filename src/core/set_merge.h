@@ -0,0 +1,84 @@
+/*
+ * EmbeddingBridge - Set Merge
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_MERGE_H
+#define EB_SET_MERGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+
+/*
+ * Merges the live entries of one set into another as a hash join on
+ * (source, model) over the two set indexes: the target's entries are
+ * loaded into an open-addressing table, and the source's entries probe
+ * it in blocks claimed by a pool of workers, which classify each entry
+ * as new, identical or conflicting. The table is only read while they
+ * run, so they share it without locks.
+ *
+ * The result is then written in one pass, in source order: every entry
+ * taken goes into a single eb_set_index_apply() call, one append to the
+ * target log and one rewrite of each model ref file it touches.
+ */
+
+typedef enum {
+    EB_SET_MERGE_NEW = 0,       /* Only the source set has the entry */
+    EB_SET_MERGE_SAME,          /* Both sets hold the same object */
+    EB_SET_MERGE_CONFLICT       /* Both sets hold the entry with different objects */
+} eb_set_merge_state_t;
+
+typedef struct {
+    const char* source;
+    const char* model;          /* "" if none was recorded */
+    const char* hash;           /* Object in the source set */
+    const char* target_hash;    /* Object in the target set, NULL for NEW */
+    eb_set_merge_state_t state;
+    bool taken;                 /* Written to the target set */
+} eb_set_merge_entry_t;
+
+typedef struct {
+    size_t entries;             /* Live entries in the source set */
+    size_t added;               /* NEW entries written */
+    size_t same;
+    size_t conflicts;
+    size_t replaced;            /* CONFLICT entries written over the target's */
+} eb_set_merge_summary_t;
+
+typedef struct {
+    bool theirs;                /* Take the source's object on conflicts */
+    bool dry_run;               /* Classify only, write nothing */
+    unsigned threads;           /* Worker threads, 0 for one per online CPU */
+} eb_set_merge_options_t;
+
+/**
+ * Callback invoked for each source entry, in (source, model) order
+ *
+ * @return 0 to continue, non-zero to stop reporting; the merge itself
+ *         still completes
+ */
+typedef int (*eb_set_merge_visit_fn)(const eb_set_merge_entry_t* entry, void* ctx);
+
+/**
+ * Merge one set into another
+ *
+ * @param root Repository root
+ * @param source_set Set to merge from
+ * @param target_set Set to merge into
+ * @param options Optional conflict policy and parallelism, NULL for defaults
+ * @param fn Optional callback for every source entry
+ * @param ctx Callback context
+ * @param summary Optional totals
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if a set does not exist)
+ */
+eb_status_t eb_set_merge(const char* root, const char* source_set, const char* target_set,
+                         const eb_set_merge_options_t* options, eb_set_merge_visit_fn fn,
+                         void* ctx, eb_set_merge_summary_t* summary);
+
+#endif /* EB_SET_MERGE_H */
@@ -0,0 +1,311 @@
+/*
+ * EmbeddingBridge - Two-Stage Set Scans Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "set_scan.h"
+#include "distance.h"
+#include "thread_pool.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Rows claimed by a scan thread at a time */
+#define SCAN_BLOCK 2048
+
+typedef struct {
+    const eb_set_matrix_t* matrix;
+    eb_scan_codes_t codes;
+    const int8_t* query_codes;     /* Padded to the code stride */
+    const uint64_t* query_signs;
+    float query_scale;
+    float query_norm;
+
+    const char* model;             /* NULL for every row */
+    size_t model_length;
+
+    size_t candidates;
+    size_t next_block;
+
+    pthread_mutex_t lock;
+    eb_scan_match_t* best;         /* Heap of the candidates every thread found */
+    size_t best_count;
+    bool failed;
+} scan_job_t;
+
+/* ---- Candidate heaps ---- */
+
+/* Heaps keep the worst candidate on top; ties go by row so results are stable */
+static bool worse(const eb_scan_match_t* a, const eb_scan_match_t* b) {
+    return a->distance > b->distance || (a->distance == b->distance && a->row > b->row);
+}
+
+static void sift_down(eb_scan_match_t* heap, size_t count, size_t i) {
+    for (;;) {
+        size_t top = i, left = 2 * i + 1, right = left + 1;
+        if (left < count && worse(&heap[left], &heap[top]))
+            top = left;
+        if (right < count && worse(&heap[right], &heap[top]))
+            top = right;
+        if (top == i)
+            return;
+        eb_scan_match_t swap = heap[i];
+        heap[i] = heap[top];
+        heap[top] = swap;
+        i = top;
+    }
+}
+
+/* Keep match if it is among the capacity best seen */
+static void offer(eb_scan_match_t* heap, size_t* count, size_t capacity,
+                  const eb_scan_match_t* match) {
+    if (*count < capacity) {
+        size_t i = (*count)++;
+        heap[i] = *match;
+        while (i > 0 && worse(&heap[i], &heap[(i - 1) / 2])) {
+            eb_scan_match_t swap = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = swap;
+            i = (i - 1) / 2;
+        }
+    } else if (worse(&heap[0], match)) {
+        heap[0] = *match;
+        sift_down(heap, *count, 0);
+    }
+}
+
+static int compare_matches(const void* a, const void* b) {
+    const eb_scan_match_t* x = a;
+    const eb_scan_match_t* y = b;
+    return worse(x, y) - worse(y, x);
+}
+
+/* ---- First stage ---- */
+
+static bool row_has_model(const scan_job_t* job, size_t row) {
+    const eb_set_matrix_row_t* r = &job->matrix->table[row];
+    return r->model_length == job->model_length &&
+           memcmp(job->matrix->strings + r->model_offset, job->model, job->model_length) == 0;
+}
+
+/* Approximate cosine distance from the int8 codes, or the Hamming distance of the signs */
+static float code_distance(const scan_job_t* job, size_t row) {
+    const eb_set_matrix_t* m = job->matrix;
+    if (job->codes == EB_SCAN_BINARY) {
+        size_t words = eb_set_matrix_sign_words(m->dims);
+        return (float)eb_hamming(job->query_signs, m->signs + row * words, words);
+    }
+    size_t stride = eb_set_matrix_code_stride(m->dims);
+    const eb_set_matrix_terms_t* terms = &m->terms[row];
+    float norms = job->query_norm * terms->norm;
+    if (!(norms > 0.0f))
+        return 1.0f;
+    int64_t dot = eb_dot_i8(job->query_codes, m->codes + row * stride, stride);
+    return 1.0f - (float)((double)job->query_scale * terms->scale * (double)dot / norms);
+}
+
+/* Scan blocks until none are left, then merge this thread's best into the job's */
+static void scan_worker(void* arg) {
+    scan_job_t* job = arg;
+    eb_scan_match_t* heap = malloc(job->candidates * sizeof(*heap));
+    if (!heap) {
+        __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+    size_t count = 0;
+    size_t rows = job->matrix->rows;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * SCAN_BLOCK;
+        if (first >= rows)
+            break;
+        size_t end = rows - first < SCAN_BLOCK ? rows : first + SCAN_BLOCK;
+        for (size_t row = first; row < end; row++) {
+            if (job->model && !row_has_model(job, row))
+                continue;
+            eb_scan_match_t match = { row, code_distance(job, row) };
+            offer(heap, &count, job->candidates, &match);
+        }
+    }
+
+    pthread_mutex_lock(&job->lock);
+    for (size_t i = 0; i < count; i++)
+        offer(job->best, &job->best_count, job->candidates, &heap[i]);
+    pthread_mutex_unlock(&job->lock);
+    free(heap);
+}
+
+/* ---- Search ---- */
+
+static size_t default_candidates(eb_scan_codes_t codes, size_t k) {
+    size_t factor = codes == EB_SCAN_BINARY ? EB_SCAN_BINARY_FACTOR : EB_SCAN_INT8_FACTOR;
+    size_t floor = codes == EB_SCAN_BINARY ? EB_SCAN_BINARY_MIN : EB_SCAN_INT8_MIN;
+    size_t wanted = k > SIZE_MAX / factor ? SIZE_MAX : k * factor;
+    return wanted > floor ? wanted : floor;
+}
+
+eb_status_t eb_set_scan(const eb_set_matrix_t* matrix, const float* query, size_t dims, size_t k,
+                        const eb_scan_options_t* options, eb_scan_match_t* matches, size_t* count) {
+    if (!matrix || !query || !matches || !count || k == 0)
+        return EB_ERROR_INVALID_PARAMETER;
+    *count = 0;
+    eb_scan_options_t opts = { EB_SCAN_INT8, 0, NULL, 0 };
+    if (options)
+        opts = *options;
+    if (opts.codes != EB_SCAN_INT8 && opts.codes != EB_SCAN_BINARY)
+        return EB_ERROR_INVALID_PARAMETER;
+    if (!matrix->terms)
+        return EB_ERROR_UNSUPPORTED;
+    if (matrix->rows == 0)
+        return EB_SUCCESS;
+    if (dims != matrix->dims)
+        return EB_ERROR_DIMENSION_MISMATCH;
+
+    scan_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.matrix = matrix;
+    job.codes = opts.codes;
+    job.model = opts.model;
+    job.model_length = opts.model ? strlen(opts.model) : 0;
+    job.candidates = opts.candidates ? opts.candidates : default_candidates(opts.codes, k);
+    if (job.candidates < k)
+        job.candidates = k;
+    if (job.candidates > matrix->rows)
+        job.candidates = matrix->rows;
+
+    // The query is encoded like the rows
+    eb_set_matrix_terms_t query_terms;
+    int8_t* query_codes = malloc(eb_set_matrix_code_stride(matrix->dims));
+    uint64_t* query_signs = malloc(eb_set_matrix_sign_words(matrix->dims) * sizeof(uint64_t));
+    job.best = malloc(job.candidates * sizeof(*job.best));
+    eb_status_t status = EB_SUCCESS;
+    if (!query_codes || !query_signs || !job.best) {
+        status = EB_ERROR_MEMORY_ALLOCATION;
+        goto cleanup;
+    }
+    eb_set_matrix_encode(query, matrix->dims, &query_terms, query_codes, query_signs);
+    job.query_codes = query_codes;
+    job.query_signs = query_signs;
+    job.query_scale = query_terms.scale;
+    job.query_norm = query_terms.norm;
+
+    pthread_mutex_init(&job.lock, NULL);
+    eb_parallel_run(NULL, eb_pool_threads(opts.threads, (matrix->rows + SCAN_BLOCK - 1) / SCAN_BLOCK),
+                    scan_worker, &job);
+    pthread_mutex_destroy(&job.lock);
+    if (job.failed) {
+        status = EB_ERROR_MEMORY_ALLOCATION;
+        goto cleanup;
+    }
+
+    // Second stage: exact distances over the float32 rows of the candidates
+    for (size_t i = 0; i < job.best_count; i++) {
+        eb_scan_match_t* match = &job.best[i];
+        float norms = query_terms.norm * matrix->terms[match->row].norm;
+        float dot = eb_dot(query, eb_set_matrix_values(matrix, match->row), matrix->dims);
+        match->distance = norms > 0.0f ? 1.0f - dot / norms : 1.0f;
+    }
+    qsort(job.best, job.best_count, sizeof(*job.best), compare_matches);
+    *count = job.best_count < k ? job.best_count : k;
+    memcpy(matches, job.best, *count * sizeof(*matches));
+    DEBUG_INFO("scan: %zu rows, %zu candidates re-ranked", matrix->rows, job.best_count);
+
+cleanup:
+    free(query_codes);
+    free(query_signs);
+    free(job.best);
+    return status;
+}
+
+/* ---- Scan matrices of a set ---- */
+
+static bool valid_set_name(const char* name) {
+    return name && *name && strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+           strcmp(name, "..") != 0;
+}
+
+/* Escape a model name into a file name; "" becomes "-" */
+static void escape_model(const char* model, char* out, size_t size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t pos = 0;
+    if (!*model) {
+        snprintf(out, size, "-");
+        return;
+    }
+    for (const char* p = model; *p && pos + 4 < size; p++) {
+        unsigned char c = (unsigned char)*p;
+        bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                     c == '_' || ((c == '.' || c == '-') && p != model);
+        if (plain) {
+            out[pos++] = (char)c;
+        } else {
+            out[pos++] = '%';
+            out[pos++] = hex[c >> 4];
+            out[pos++] = hex[c & 0xF];
+        }
+    }
+    out[pos] = '\0';
+}
+
+static bool same_or_newer(const struct timespec* a, const struct timespec* b) {
+    return a->tv_sec > b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec >= b->tv_nsec);
+}
+
+eb_status_t eb_set_scan_open(const char* root, const char* set_name, const char* model,
+                             unsigned threads, eb_set_matrix_t* out, bool* exported) {
+    if (!root || !valid_set_name(set_name) || !model || !out)
+        return EB_ERROR_INVALID_PARAMETER;
+    if (exported)
+        *exported = false;
+
+    char dir[PATH_MAX], path[PATH_MAX], name[PATH_MAX / 2];
+    struct stat st;
+    snprintf(dir, sizeof(dir), "%s/.embr/sets/%s", root, set_name);
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+
+    // A set nothing was stored in yet may have no index
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s/index", root, set_name);
+    struct timespec changed = { 0, 0 };
+    if (stat(path, &st) == 0)
+        changed = st.st_mtim;
+
+    escape_model(model, name, sizeof(name));
+    snprintf(dir, sizeof(dir), "%s/.embr/sets/%s/scan", root, set_name);
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s/scan/%s.matrix", root, set_name, name);
+    if (stat(path, &st) == 0 && same_or_newer(&st.st_mtim, &changed) &&
+        eb_set_matrix_open(path, out) == EB_SUCCESS) {
+        if (out->terms)
+            return EB_SUCCESS;
+        eb_set_matrix_close(out);
+    }
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return EB_ERROR_FILE_IO;
+    eb_set_matrix_options_t options = { .model = model, .threads = threads, .codes = true };
+    eb_status_t status = eb_set_matrix_export(root, set_name, path, &options, NULL);
+    if (status != EB_SUCCESS)
+        return status;
+
+    // Dated as the index it was read from, so a store during the export shows up as newer
+    struct timespec times[2] = { { 0, UTIME_OMIT }, changed };
+    if (changed.tv_sec || changed.tv_nsec)
+        utimensat(AT_FDCWD, path, times, 0);
+    if (exported)
+        *exported = true;
+    return eb_set_matrix_open(path, out);
+}
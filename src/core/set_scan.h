@@ -0,0 +1,89 @@
+/*
+ * EmbeddingBridge - Two-Stage Set Scans
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_SCAN_H
+#define EB_SET_SCAN_H
+
+#include <stddef.h>
+#include "set_matrix.h"
+
+/*
+ * Exact-ish nearest neighbors without a graph. The first stage scans the
+ * codes of a set matrix file (set_matrix.h) instead of its floats, a
+ * quarter of the bytes for int8 codes and a thirty-second for sign bits,
+ * keeping the best candidates of each thread. The second re-ranks those
+ * by exact cosine distance over their float32 rows, the values of the
+ * objects themselves, which only touches the pages of the candidates.
+ *
+ * Int8 candidates rank by their approximate cosine similarity from the
+ * integer dot product and the row terms; sign bits rank by Hamming
+ * distance, which tracks the angle between the vectors and needs a larger
+ * candidate pool for the same recall.
+ *
+ * Each set keeps a matrix per model under .embr/sets/<set>/scan for
+ * `embr search --mode scan`, exported with codes on first use and again
+ * whenever the set index has changed since.
+ */
+
+typedef enum {
+    EB_SCAN_INT8 = 0,
+    EB_SCAN_BINARY
+} eb_scan_codes_t;
+
+/* Candidates re-ranked by default: a multiple of k, at least a floor */
+#define EB_SCAN_INT8_FACTOR 8
+#define EB_SCAN_INT8_MIN 64
+#define EB_SCAN_BINARY_FACTOR 32
+#define EB_SCAN_BINARY_MIN 512
+
+typedef struct {
+    eb_scan_codes_t codes;          /* Codes of the first stage */
+    size_t candidates;              /* Rows re-ranked, 0 for the default; at least k */
+    const char* model;              /* Only rows of this model, NULL for every row */
+    unsigned threads;               /* Scan threads, 0 for the shared pool's */
+} eb_scan_options_t;
+
+typedef struct {
+    size_t row;                     /* Matrix row */
+    float distance;                 /* Cosine distance, 0 for the same direction */
+} eb_scan_match_t;
+
+/**
+ * Find the rows closest to a query
+ *
+ * @param matrix Matrix opened with codes
+ * @param query Query vector
+ * @param dims Query dimensions, those of the matrix
+ * @param k Matches wanted
+ * @param options Options, NULL for int8 codes and the defaults
+ * @param matches Receives up to k matches, closest first
+ * @param count Receives the number of matches
+ * @return Status code (EB_ERROR_UNSUPPORTED if the matrix has no codes,
+ *         EB_ERROR_DIMENSION_MISMATCH for a query of other dimensions)
+ */
+eb_status_t eb_set_scan(const eb_set_matrix_t* matrix, const float* query, size_t dims, size_t k,
+                        const eb_scan_options_t* options, eb_scan_match_t* matches, size_t* count);
+
+/**
+ * Map the scan matrix of a model in a set, exporting it first if it is
+ * missing or older than the set index
+ *
+ * @param root Repository root
+ * @param set_name Set
+ * @param model Model, "" for entries without one
+ * @param threads Reader threads for an export, 0 for one per online CPU
+ * @param out Receives the mapping, release with eb_set_matrix_close()
+ * @param exported Set if the matrix was exported first, may be NULL
+ * @return Status code (EB_ERROR_NOT_FOUND for an unknown set)
+ */
+eb_status_t eb_set_scan_open(const char* root, const char* set_name, const char* model,
+                             unsigned threads, eb_set_matrix_t* out, bool* exported);
+
+#endif /* EB_SET_SCAN_H */
@@ -0,0 +1,817 @@
+/*
+ * EmbeddingBridge - Per-Set Vector Sketches Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "set_sketch.h"
+#include "quantize.h"
+#include "store.h"
+#include "object_reader.h"
+#include "thread_pool.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Largest dims a saved sketch may claim */
+#define SKETCH_MAX_DIMS (1u << 20)
+
+/* Entries read by a build worker at a time */
+#define BUILD_BLOCK 256
+
+#define PAD8(n) (((n) + 7) & ~(size_t)7)
+
+/* ---- Sketches ---- */
+
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* Empty sketch; the projection depends only on the dimension index */
+static eb_status_t sketch_init(eb_sketch_t* sketch, const char* model, size_t dims) {
+    memset(sketch, 0, sizeof(*sketch));
+    if (dims == 0 || dims > SKETCH_MAX_DIMS)
+        return EB_ERROR_INVALID_INPUT;
+    sketch->model = strdup(model ? model : "");
+    sketch->mean = calloc(dims, sizeof(double));
+    sketch->m2 = calloc(dims, sizeof(double));
+    sketch->signs = malloc(dims * sizeof(uint32_t));
+    if (!sketch->model || !sketch->mean || !sketch->m2 || !sketch->signs) {
+        free(sketch->model);
+        free(sketch->mean);
+        free(sketch->m2);
+        free(sketch->signs);
+        memset(sketch, 0, sizeof(*sketch));
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    sketch->dims = dims;
+    for (size_t i = 0; i < dims; i++)
+        sketch->signs[i] = (uint32_t)mix64(i);
+    return EB_SUCCESS;
+}
+
+static void sketch_free(eb_sketch_t* sketch) {
+    free(sketch->model);
+    free(sketch->mean);
+    free(sketch->m2);
+    free(sketch->signs);
+}
+
+static void sketch_reset(eb_sketch_t* sketch) {
+    sketch->count = 0;
+    memset(sketch->mean, 0, sketch->dims * sizeof(double));
+    memset(sketch->m2, 0, sketch->dims * sizeof(double));
+    sketch->norm_mean = 0.0;
+    sketch->norm_m2 = 0.0;
+    memset(sketch->proj_sum, 0, sizeof(sketch->proj_sum));
+    memset(sketch->proj_outer, 0, sizeof(sketch->proj_outer));
+    memset(sketch->norm_hist, 0, sizeof(sketch->norm_hist));
+}
+
+static int norm_bin(double norm) {
+    if (!(norm > 0.0))
+        return 0;
+    double bin = floor((log2(norm) - EB_SKETCH_NORM_MIN_LOG2) * EB_SKETCH_NORM_BINS_PER_OCTAVE);
+    if (bin < 0.0)
+        return 0;
+    return bin >= EB_SKETCH_NORM_BINS ? EB_SKETCH_NORM_BINS - 1 : (int)bin;
+}
+
+/* Welford's update of one mean and its squared deviations, forward or back */
+static void welford(double* mean, double* m2, double x, uint64_t count_after, int sign) {
+    double delta = x - *mean;
+    *mean += sign * delta / (double)count_after;
+    *m2 += sign * delta * (x - *mean);
+}
+
+eb_status_t eb_sketch_add(eb_sketch_t* sketch, const float* values, int sign) {
+    if (!sketch || !values || (sign != 1 && sign != -1))
+        return EB_ERROR_INVALID_INPUT;
+    if (sign < 0 && sketch->count == 0)
+        return EB_ERROR_INVALID_INPUT;
+    if (sign < 0 && sketch->count == 1) {
+        sketch_reset(sketch);
+        return EB_SUCCESS;
+    }
+
+    uint64_t count_after = sign > 0 ? sketch->count + 1 : sketch->count - 1;
+    double proj[EB_SKETCH_RANK] = {0};
+    double norm = 0.0;
+    for (size_t i = 0; i < sketch->dims; i++) {
+        double x = values[i];
+        norm += x * x;
+        welford(&sketch->mean[i], &sketch->m2[i], x, count_after, sign);
+        if (sketch->m2[i] < 0.0)
+            sketch->m2[i] = 0.0;
+        uint32_t bits = sketch->signs[i];
+        for (int j = 0; j < EB_SKETCH_RANK; j++)
+            proj[j] += (bits >> j) & 1 ? x : -x;
+    }
+    norm = sqrt(norm);
+
+    welford(&sketch->norm_mean, &sketch->norm_m2, norm, count_after, sign);
+    if (sketch->norm_m2 < 0.0)
+        sketch->norm_m2 = 0.0;
+    int bin = norm_bin(norm);
+    if (sign > 0 || sketch->norm_hist[bin] > 0)
+        sketch->norm_hist[bin] += sign;
+
+    double scale = 1.0 / sqrt((double)EB_SKETCH_RANK);
+    for (int j = 0; j < EB_SKETCH_RANK; j++)
+        proj[j] *= scale;
+    for (int j = 0; j < EB_SKETCH_RANK; j++) {
+        sketch->proj_sum[j] += sign * proj[j];
+        for (int k = 0; k < EB_SKETCH_RANK; k++)
+            sketch->proj_outer[j * EB_SKETCH_RANK + k] += sign * proj[j] * proj[k];
+    }
+    sketch->count = count_after;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_sketch_merge(eb_sketch_t* into, const eb_sketch_t* other) {
+    if (!into || !other || into->dims != other->dims)
+        return EB_ERROR_INVALID_INPUT;
+    if (other->count == 0)
+        return EB_SUCCESS;
+
+    // Chan et al.'s pairwise combination of means and squared deviations
+    double na = (double)into->count, nb = (double)other->count, n = na + nb;
+    for (size_t i = 0; i < into->dims; i++) {
+        double delta = other->mean[i] - into->mean[i];
+        into->mean[i] += delta * nb / n;
+        into->m2[i] += other->m2[i] + delta * delta * na * nb / n;
+    }
+    double delta = other->norm_mean - into->norm_mean;
+    into->norm_mean += delta * nb / n;
+    into->norm_m2 += other->norm_m2 + delta * delta * na * nb / n;
+
+    for (int j = 0; j < EB_SKETCH_RANK; j++)
+        into->proj_sum[j] += other->proj_sum[j];
+    for (int j = 0; j < EB_SKETCH_RANK * EB_SKETCH_RANK; j++)
+        into->proj_outer[j] += other->proj_outer[j];
+    for (int b = 0; b < EB_SKETCH_NORM_BINS; b++)
+        into->norm_hist[b] += other->norm_hist[b];
+    into->count += other->count;
+    return EB_SUCCESS;
+}
+
+void eb_sketch_stats(const eb_sketch_t* sketch, eb_sketch_stats_t* out) {
+    memset(out, 0, sizeof(*out));
+    if (!sketch || sketch->count == 0)
+        return;
+    double n = (double)sketch->count;
+    double centroid = 0.0, variance = 0.0;
+    for (size_t i = 0; i < sketch->dims; i++) {
+        centroid += sketch->mean[i] * sketch->mean[i];
+        variance += sketch->m2[i];
+    }
+    out->centroid_norm = sqrt(centroid);
+    out->variance = variance / n;
+    out->norm_mean = sketch->norm_mean;
+    out->norm_stddev = sqrt(sketch->norm_m2 / n);
+
+    uint64_t seen = 0;
+    for (int b = 0; b < EB_SKETCH_NORM_BINS; b++) {
+        seen += sketch->norm_hist[b];
+        if (seen * 2 >= sketch->count) {
+            out->norm_p50 = exp2(EB_SKETCH_NORM_MIN_LOG2 + (b + 0.5) / EB_SKETCH_NORM_BINS_PER_OCTAVE);
+            break;
+        }
+    }
+}
+
+/* Covariance of the projected vectors */
+static void projected_covariance(const eb_sketch_t* sketch, double* cov) {
+    double n = (double)sketch->count;
+    for (int j = 0; j < EB_SKETCH_RANK; j++) {
+        for (int k = 0; k < EB_SKETCH_RANK; k++) {
+            cov[j * EB_SKETCH_RANK + k] = n > 0.0
+                ? sketch->proj_outer[j * EB_SKETCH_RANK + k] / n -
+                  (sketch->proj_sum[j] / n) * (sketch->proj_sum[k] / n)
+                : 0.0;
+        }
+    }
+}
+
+eb_status_t eb_sketch_compare(const eb_sketch_t* a, const eb_sketch_t* b, eb_sketch_drift_t* out) {
+    if (!a || !b || !out || a->dims != b->dims)
+        return EB_ERROR_INVALID_INPUT;
+    memset(out, 0, sizeof(*out));
+
+    double dot = 0.0, norm_a = 0.0, norm_b = 0.0, l2 = 0.0, var_a = 0.0, var_b = 0.0;
+    for (size_t i = 0; i < a->dims; i++) {
+        dot += a->mean[i] * b->mean[i];
+        norm_a += a->mean[i] * a->mean[i];
+        norm_b += b->mean[i] * b->mean[i];
+        double d = a->mean[i] - b->mean[i];
+        l2 += d * d;
+        var_a += a->m2[i];
+        var_b += b->m2[i];
+    }
+    if (norm_a > 0.0 && norm_b > 0.0)
+        out->centroid_cosine = 1.0 - dot / (sqrt(norm_a) * sqrt(norm_b));
+    else
+        out->centroid_cosine = norm_a == norm_b ? 0.0 : 1.0;  // Zero vectors have no direction
+    out->centroid_l2 = sqrt(l2);
+    out->norm_shift = b->norm_mean - a->norm_mean;
+
+    var_a = a->count ? var_a / (double)a->count : 0.0;
+    var_b = b->count ? var_b / (double)b->count : 0.0;
+    out->variance_ratio = var_a > 0.0 ? var_b / var_a : var_b > 0.0 ? INFINITY : 1.0;
+
+    double cov_a[EB_SKETCH_RANK * EB_SKETCH_RANK], cov_b[EB_SKETCH_RANK * EB_SKETCH_RANK];
+    projected_covariance(a, cov_a);
+    projected_covariance(b, cov_b);
+    double diff = 0.0, frob_a = 0.0, frob_b = 0.0;
+    for (int j = 0; j < EB_SKETCH_RANK * EB_SKETCH_RANK; j++) {
+        diff += (cov_a[j] - cov_b[j]) * (cov_a[j] - cov_b[j]);
+        frob_a += cov_a[j] * cov_a[j];
+        frob_b += cov_b[j] * cov_b[j];
+    }
+    double scale = sqrt(frob_a > frob_b ? frob_a : frob_b);
+    out->covariance_shift = scale > 0.0 ? sqrt(diff) / scale : 0.0;
+
+    if (a->count && b->count) {
+        double tv = 0.0;
+        for (int i = 0; i < EB_SKETCH_NORM_BINS; i++)
+            tv += fabs((double)a->norm_hist[i] / (double)a->count -
+                       (double)b->norm_hist[i] / (double)b->count);
+        out->norm_distance = tv / 2.0;
+    } else {
+        out->norm_distance = a->count == b->count ? 0.0 : 1.0;
+    }
+    return EB_SUCCESS;
+}
+
+/* ---- Set sketches ---- */
+
+static int compare_group(const char* model, size_t dims, const eb_sketch_t* sketch) {
+    int cmp = strcmp(model, sketch->model);
+    if (cmp)
+        return cmp;
+    return dims < sketch->dims ? -1 : dims > sketch->dims;
+}
+
+eb_sketch_t* eb_set_sketch_group(eb_set_sketch_t* set, const char* model, size_t dims, bool create) {
+    if (!set)
+        return NULL;
+    if (!model)
+        model = "";
+    size_t pos = 0;
+    while (pos < set->count) {
+        int cmp = compare_group(model, dims, &set->items[pos]);
+        if (cmp == 0)
+            return &set->items[pos];
+        if (cmp < 0)
+            break;
+        pos++;
+    }
+    if (!create)
+        return NULL;
+
+    eb_sketch_t sketch;
+    if (sketch_init(&sketch, model, dims) != EB_SUCCESS)
+        return NULL;
+    eb_sketch_t* grown = realloc(set->items, (set->count + 1) * sizeof(*grown));
+    if (!grown) {
+        sketch_free(&sketch);
+        return NULL;
+    }
+    set->items = grown;
+    memmove(&set->items[pos + 1], &set->items[pos], (set->count - pos) * sizeof(*grown));
+    set->items[pos] = sketch;
+    set->count++;
+    return &set->items[pos];
+}
+
+void eb_set_sketch_free(eb_set_sketch_t* set) {
+    if (!set)
+        return;
+    for (size_t i = 0; i < set->count; i++)
+        sketch_free(&set->items[i]);
+    free(set->items);
+    memset(set, 0, sizeof(*set));
+}
+
+static bool read_group(FILE* f, eb_set_sketch_t* set) {
+    eb_sketch_group_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.model_len >= 256 ||
+        header.dims == 0 || header.dims > SKETCH_MAX_DIMS || header.count == 0)
+        return false;
+    char model[264] = {0};
+    if (fread(model, 1, PAD8(header.model_len), f) != PAD8(header.model_len))
+        return false;
+    model[header.model_len] = '\0';
+    if (eb_set_sketch_group(set, model, header.dims, false))
+        return false;   // Groups are unique
+
+    eb_sketch_t* sketch = eb_set_sketch_group(set, model, header.dims, true);
+    if (!sketch)
+        return false;
+    sketch->count = header.count;
+    sketch->norm_mean = header.norm_mean;
+    sketch->norm_m2 = header.norm_m2;
+    return fread(sketch->mean, sizeof(double), sketch->dims, f) == sketch->dims &&
+           fread(sketch->m2, sizeof(double), sketch->dims, f) == sketch->dims &&
+           fread(sketch->proj_sum, sizeof(sketch->proj_sum), 1, f) == 1 &&
+           fread(sketch->proj_outer, sizeof(sketch->proj_outer), 1, f) == 1 &&
+           fread(sketch->norm_hist, sizeof(sketch->norm_hist), 1, f) == 1;
+}
+
+eb_status_t eb_set_sketch_load(const char* path, eb_set_sketch_t* out) {
+    if (!path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    memset(out, 0, sizeof(*out));
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return errno == ENOENT ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+
+    eb_set_sketch_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == EB_SET_SKETCH_MAGIC &&
+              header.version == EB_SET_SKETCH_VERSION && header.rank == EB_SKETCH_RANK &&
+              header.norm_bins == EB_SKETCH_NORM_BINS;
+    for (uint32_t i = 0; ok && i < header.group_count; i++)
+        ok = read_group(f, out);
+    fclose(f);
+    if (!ok) {
+        eb_set_sketch_free(out);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+    out->index_seq = header.index_seq;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_set_sketch_save(const eb_set_sketch_t* set, const char* path) {
+    if (!set || !path)
+        return EB_ERROR_INVALID_INPUT;
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return EB_ERROR_FILE_IO;
+
+    // Models whose vectors were all removed are left out
+    uint32_t groups = 0;
+    for (size_t i = 0; i < set->count; i++)
+        groups += set->items[i].count > 0;
+    eb_set_sketch_header_t header = {
+        .magic = EB_SET_SKETCH_MAGIC,
+        .version = EB_SET_SKETCH_VERSION,
+        .group_count = groups,
+        .rank = EB_SKETCH_RANK,
+        .norm_bins = EB_SKETCH_NORM_BINS,
+        .index_seq = set->index_seq
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (size_t i = 0; ok && i < set->count; i++) {
+        const eb_sketch_t* s = &set->items[i];
+        if (s->count == 0)
+            continue;
+        eb_sketch_group_header_t group = {
+            (uint32_t)strlen(s->model), (uint32_t)s->dims, s->count, s->norm_mean, s->norm_m2
+        };
+        char model[264] = {0};
+        memcpy(model, s->model, group.model_len);
+        ok = fwrite(&group, sizeof(group), 1, f) == 1 &&
+             fwrite(model, 1, PAD8(group.model_len), f) == PAD8(group.model_len) &&
+             fwrite(s->mean, sizeof(double), s->dims, f) == s->dims &&
+             fwrite(s->m2, sizeof(double), s->dims, f) == s->dims &&
+             fwrite(s->proj_sum, sizeof(s->proj_sum), 1, f) == 1 &&
+             fwrite(s->proj_outer, sizeof(s->proj_outer), 1, f) == 1 &&
+             fwrite(s->norm_hist, sizeof(s->norm_hist), 1, f) == 1;
+    }
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return EB_ERROR_FILE_IO;
+    }
+    return EB_SUCCESS;
+}
+
+/* ---- Reading vectors into sketches ---- */
+
+typedef struct {
+    char* model;
+    char hash[65];
+    int sign;
+} vector_op_t;
+
+typedef struct {
+    vector_op_t* items;
+    size_t count;
+    size_t capacity;
+} op_list_t;
+
+static bool push_op(op_list_t* list, const char* model, const char* hash, int sign) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        vector_op_t* grown = realloc(list->items, capacity * sizeof(*grown));
+        if (!grown)
+            return false;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    vector_op_t* op = &list->items[list->count];
+    if (strlen(hash) != 64)
+        return false;
+    op->model = strdup(model);
+    if (!op->model)
+        return false;
+    memcpy(op->hash, hash, 65);
+    op->sign = sign;
+    list->count++;
+    return true;
+}
+
+static void free_ops(op_list_t* list) {
+    for (size_t i = 0; i < list->count; i++)
+        free(list->items[i].model);
+    free(list->items);
+}
+
+typedef struct {
+    eb_set_sketch_t* set;
+    const vector_op_t* ops;
+    float* values;
+    size_t capacity;
+    bool failed;
+} apply_ctx_t;
+
+static int apply_vector(void* ctx, size_t index, eb_status_t status, eb_object_view_t* view) {
+    apply_ctx_t* apply = ctx;
+    eb_vector_ref_t ref;
+    if (status != EB_SUCCESS || eb_object_vector_ref(view, &ref) != EB_SUCCESS || ref.dims == 0) {
+        apply->failed = true;
+        return 1;
+    }
+    if (ref.dims > apply->capacity) {
+        float* grown = realloc(apply->values, ref.dims * sizeof(float));
+        if (!grown) {
+            apply->failed = true;
+            return 1;
+        }
+        apply->values = grown;
+        apply->capacity = ref.dims;
+    }
+    eb_vector_ref_get(&ref, 0, ref.dims, apply->values);
+
+    const vector_op_t* op = &apply->ops[index];
+    eb_sketch_t* sketch = eb_set_sketch_group(apply->set, op->model, ref.dims, op->sign > 0);
+    if (!sketch || eb_sketch_add(sketch, apply->values, op->sign) != EB_SUCCESS) {
+        apply->failed = true;
+        return 1;
+    }
+    return 0;
+}
+
+/* Read the vectors of ops and add or remove them */
+static eb_status_t apply_ops(eb_store_t* store, eb_set_sketch_t* set, const vector_op_t* ops,
+                             size_t count) {
+    if (count == 0)
+        return EB_SUCCESS;
+    const char** hashes = malloc(count * sizeof(*hashes));
+    if (!hashes)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    for (size_t i = 0; i < count; i++)
+        hashes[i] = ops[i].hash;
+
+    apply_ctx_t ctx = { set, ops, NULL, 0, false };
+    eb_status_t status = eb_object_read_many(store, hashes, count, NULL, apply_vector, &ctx);
+    free(ctx.values);
+    free(hashes);
+    if (status == EB_SUCCESS && ctx.failed)
+        status = EB_ERROR_INVALID_FORMAT;
+    return status;
+}
+
+/* ---- Building ---- */
+
+typedef struct {
+    const char* root;
+    const vector_op_t* ops;
+    size_t count;
+    size_t next_block;
+    size_t done;
+    eb_set_sketch_t result;
+    pthread_mutex_t lock;
+    bool failed;
+} build_job_t;
+
+static void build_worker(void* arg) {
+    build_job_t* job = arg;
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = (char*)job->root };
+    if (eb_store_init(&config, &store) != EB_SUCCESS)
+        return;
+
+    eb_set_sketch_t local = {0};
+    bool failed = false;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * BUILD_BLOCK;
+        if (first >= job->count)
+            break;
+        size_t end = job->count - first < BUILD_BLOCK ? job->count : first + BUILD_BLOCK;
+        if (!failed && apply_ops(store, &local, job->ops + first, end - first) != EB_SUCCESS)
+            failed = true;
+        __atomic_fetch_add(&job->done, end - first, __ATOMIC_RELAXED);
+    }
+    eb_store_destroy(store);
+
+    pthread_mutex_lock(&job->lock);
+    for (size_t i = 0; !failed && i < local.count; i++) {
+        const eb_sketch_t* part = &local.items[i];
+        eb_sketch_t* into = eb_set_sketch_group(&job->result, part->model, part->dims, true);
+        failed = !into || eb_sketch_merge(into, part) != EB_SUCCESS;
+    }
+    job->failed |= failed;
+    pthread_mutex_unlock(&job->lock);
+    eb_set_sketch_free(&local);
+}
+
+static int collect_live(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    return push_op(ctx, model, hash, 1) ? 0 : 1;
+}
+
+/* Sketch every live entry of an index */
+static eb_status_t build_sketch(const char* root, const eb_set_index_t* index, unsigned threads,
+                                eb_set_sketch_t* out) {
+    op_list_t ops = {0};
+    eb_status_t status = eb_set_index_foreach(index, NULL, collect_live, &ops);
+    if (status != EB_SUCCESS) {
+        free_ops(&ops);
+        return status;
+    }
+
+    build_job_t job = { root, ops.items, ops.count, 0, 0, {0}, PTHREAD_MUTEX_INITIALIZER, false };
+    eb_parallel_run(NULL, eb_pool_threads(threads, (ops.count + BUILD_BLOCK - 1) / BUILD_BLOCK),
+                    build_worker, &job);
+    pthread_mutex_destroy(&job.lock);
+    free_ops(&ops);
+
+    // Entries are only left over if no worker could open the store
+    if (job.failed || job.done != job.count) {
+        eb_set_sketch_free(&job.result);
+        return job.failed ? EB_ERROR_INVALID_FORMAT : EB_ERROR_NOT_INITIALIZED;
+    }
+    job.result.index_seq = eb_set_index_next_seq(index);
+    *out = job.result;
+    DEBUG_PRINT("set_sketch: built from %zu vectors", job.count);
+    return EB_SUCCESS;
+}
+
+static bool valid_set_name(const char* name) {
+    return name && *name && strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+           strcmp(name, "..") != 0;
+}
+
+eb_status_t eb_set_sketch_open(const char* root, const char* name, unsigned threads,
+                               eb_set_sketch_t* out) {
+    if (!root || !out)
+        return EB_ERROR_INVALID_INPUT;
+    memset(out, 0, sizeof(*out));
+
+    char dir[PATH_MAX], path[PATH_MAX];
+    struct stat st;
+    snprintf(dir, sizeof(dir), "%s/.embr/sets/%s", root, name ? name : "");
+    if (!valid_set_name(name) || stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+
+    snprintf(path, sizeof(path), "%s/index", dir);
+    eb_set_index_t* index = NULL;
+    eb_status_t status = eb_set_index_open(root, path, &index);
+    if (status != EB_SUCCESS)
+        return status;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, EB_SET_SKETCH_FILE);
+    status = eb_set_sketch_load(path, out);
+    if (status == EB_SUCCESS && out->index_seq == eb_set_index_next_seq(index)) {
+        eb_set_index_close(index);
+        return EB_SUCCESS;
+    }
+    eb_set_sketch_free(out);
+
+    status = build_sketch(root, index, threads, out);
+    eb_set_index_close(index);
+    if (status == EB_SUCCESS && eb_set_sketch_save(out, path) != EB_SUCCESS)
+        DEBUG_PRINT("set_sketch: could not save %s", path);
+    return status;
+}
+
+/* ---- Incremental updates ---- */
+
+/* Model and hash of one source, before or after the changes */
+typedef struct {
+    const char* model;
+    const char* hash;
+} model_hash_t;
+
+typedef struct {
+    model_hash_t* items;
+    size_t count;
+    size_t capacity;
+} model_list_t;
+
+static bool list_set(model_list_t* list, const char* model, const char* hash) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].model, model) == 0) {
+            list->items[i].hash = hash;
+            return true;
+        }
+    }
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 8;
+        model_hash_t* grown = realloc(list->items, capacity * sizeof(*grown));
+        if (!grown)
+            return false;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = (model_hash_t){ model, hash };
+    return true;
+}
+
+static void list_remove(model_list_t* list, const char* model) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].model, model) == 0) {
+            list->items[i] = list->items[--list->count];
+            return;
+        }
+    }
+}
+
+static const char* list_find(const model_list_t* list, const char* model) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].model, model) == 0)
+            return list->items[i].hash;
+    }
+    return NULL;
+}
+
+/* Current entries of a source, copied out of the index */
+static int collect_current(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    return push_op(ctx, model, hash, 0) ? 0 : 1;
+}
+
+static int compare_change_source(const void* x, const void* y) {
+    const eb_set_index_change_t* a = *(const eb_set_index_change_t* const*)x;
+    const eb_set_index_change_t* b = *(const eb_set_index_change_t* const*)y;
+    int cmp = strcmp(a->source, b->source);
+    return cmp ? cmp : (a > b) - (a < b);
+}
+
+/* Vectors that changes to one source take out of the set and put in */
+static bool diff_source(const eb_set_index_t* before, const eb_set_index_change_t* const* changes,
+                        size_t count, op_list_t* ops) {
+    op_list_t owned = {0};
+    bool ok = eb_set_index_foreach(before, changes[0]->source, collect_current, &owned) ==
+              EB_SUCCESS;
+
+    model_list_t old_state = {0}, new_state = {0};
+    for (size_t i = 0; ok && i < owned.count; i++)
+        ok = list_set(&old_state, owned.items[i].model, owned.items[i].hash) &&
+             list_set(&new_state, owned.items[i].model, owned.items[i].hash);
+
+    for (size_t i = 0; ok && i < count; i++) {
+        const eb_set_index_change_t* c = changes[i];
+        const char* model = c->model ? c->model : "";
+        if (c->hash)
+            ok = list_set(&new_state, model, c->hash);
+        else if (*model)
+            list_remove(&new_state, model);
+        else
+            new_state.count = 0;
+    }
+
+    for (size_t i = 0; ok && i < old_state.count; i++) {
+        const char* now = list_find(&new_state, old_state.items[i].model);
+        if (!now || strcmp(now, old_state.items[i].hash) != 0)
+            ok = push_op(ops, old_state.items[i].model, old_state.items[i].hash, -1);
+    }
+    for (size_t i = 0; ok && i < new_state.count; i++) {
+        const char* was = list_find(&old_state, new_state.items[i].model);
+        if (!was || strcmp(was, new_state.items[i].hash) != 0)
+            ok = push_op(ops, new_state.items[i].model, new_state.items[i].hash, 1);
+    }
+
+    free(old_state.items);
+    free(new_state.items);
+    free_ops(&owned);
+    return ok;
+}
+
+/* Net vector changes, one (source, model) entry at a time */
+static bool diff_changes(const eb_set_index_t* before, const eb_set_index_change_t* changes,
+                         size_t count, op_list_t* ops) {
+    const eb_set_index_change_t** sorted = malloc(count * sizeof(*sorted));
+    if (!sorted)
+        return false;
+    for (size_t i = 0; i < count; i++)
+        sorted[i] = &changes[i];
+    qsort(sorted, count, sizeof(*sorted), compare_change_source);
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < count; ) {
+        size_t end = i + 1;
+        while (end < count && strcmp(sorted[end]->source, sorted[i]->source) == 0)
+            end++;
+        ok = diff_source(before, sorted + i, end - i, ops);
+        i = end;
+    }
+    free(sorted);
+    return ok;
+}
+
+static int stop_at_first(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    (void)model;
+    (void)hash;
+    *(bool*)ctx = false;
+    return 1;
+}
+
+static void sketch_path_for(const char* index_path, char* path, size_t size) {
+    const char* slash = strrchr(index_path, '/');
+    if (slash)
+        snprintf(path, size, "%.*s/%s", (int)(slash - index_path), index_path, EB_SET_SKETCH_FILE);
+    else
+        snprintf(path, size, "%s", EB_SET_SKETCH_FILE);
+}
+
+void eb_set_sketch_update(const char* root, const char* index_path, const eb_set_index_t* before,
+                          const eb_set_index_change_t* changes, size_t count) {
+    if (!root || !index_path || !before || count == 0 || !changes)
+        return;
+
+    char path[PATH_MAX];
+    sketch_path_for(index_path, path, sizeof(path));
+    uint64_t seq = eb_set_index_next_seq(before);
+    eb_set_sketch_t set;
+    eb_status_t status = eb_set_sketch_load(path, &set);
+    if (status == EB_ERROR_NOT_FOUND) {
+        // Sets that already hold vectors get a sketch when one is first asked for
+        bool empty = true;
+        if (eb_set_index_foreach(before, NULL, stop_at_first, &empty) != EB_SUCCESS || !empty)
+            return;
+        set.index_seq = seq;
+    } else if (status != EB_SUCCESS || set.index_seq != seq) {
+        eb_set_sketch_free(&set);
+        unlink(path);
+        return;
+    }
+
+    op_list_t ops = {0};
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = (char*)root };
+    status = diff_changes(before, changes, count, &ops) ? EB_SUCCESS : EB_ERROR_MEMORY_ALLOCATION;
+    if (status == EB_SUCCESS && ops.count)
+        status = eb_store_init(&config, &store);
+    if (status == EB_SUCCESS)
+        status = apply_ops(store, &set, ops.items, ops.count);
+    if (store)
+        eb_store_destroy(store);
+    free_ops(&ops);
+
+    set.index_seq = seq + count;
+    if (status != EB_SUCCESS || eb_set_sketch_save(&set, path) != EB_SUCCESS) {
+        DEBUG_PRINT("set_sketch: dropping %s, it is rebuilt when next read", path);
+        unlink(path);
+    }
+    eb_set_sketch_free(&set);
+}
+
+void eb_set_sketch_fork(const char* base_dir, const char* set_dir, uint64_t index_seq) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", base_dir, EB_SET_SKETCH_FILE);
+    eb_set_sketch_t set;
+    if (eb_set_sketch_load(path, &set) != EB_SUCCESS)
+        return;
+    // A base sketch that lags its index would not match the new set either
+    if (set.index_seq == index_seq) {
+        snprintf(path, sizeof(path), "%s/%s", set_dir, EB_SET_SKETCH_FILE);
+        if (eb_set_sketch_save(&set, path) != EB_SUCCESS)
+            DEBUG_PRINT("set_sketch: could not copy the sketch of %s", base_dir);
+    }
+    eb_set_sketch_free(&set);
+}
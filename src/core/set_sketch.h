@@ -0,0 +1,199 @@
+/*
+ * EmbeddingBridge - Per-Set Vector Sketches
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_SKETCH_H
+#define EB_SET_SKETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+#include "set_index.h"
+
+/*
+ * Summary statistics of the vectors a set holds, one sketch per model and
+ * dimension count, kept in .embr/sets/<set>/sketch so they can be read
+ * without touching an object:
+ *
+ *   - count, and the mean and squared deviations of every dimension
+ *     (Welford), which give the centroid and the variance
+ *   - mean and squared deviations of the L2 norms, and a histogram of them
+ *   - the first and second moments of a fixed random projection of the
+ *     vectors onto EB_SKETCH_RANK dimensions, which estimate the
+ *     covariance along any direction to within the projection's error
+ *
+ * Every part can take a vector out again exactly, so each change to the
+ * set index (store, rm, rollback, merge) updates the sketch from the
+ * objects it adds and replaces, and two sketches of the same model combine
+ * in constant time. The projection is the same in every repository, so
+ * sketches of different sets compare directly.
+ *
+ * The file records the index sequence number it reflects. A sketch that
+ * does not match its index is dropped by the next update and rebuilt from
+ * every object the next time it is opened.
+ *
+ *   eb_set_sketch_header_t | groups
+ *
+ * Each group is an eb_sketch_group_header_t, the model name padded to
+ * 8 bytes, and then doubles: mean[dims], m2[dims], proj_sum[rank],
+ * proj_outer[rank * rank], followed by norm_bins uint64_t counts.
+ */
+
+#define EB_SET_SKETCH_MAGIC   0x4542534B  /* "EBSK" */
+#define EB_SET_SKETCH_VERSION 1
+#define EB_SET_SKETCH_FILE    "sketch"
+
+/* Random projection rank of the covariance sketch */
+#define EB_SKETCH_RANK 32
+
+/* Norm histogram: quarter-octave bins from 2^-8 up, ends open */
+#define EB_SKETCH_NORM_BINS 64
+#define EB_SKETCH_NORM_MIN_LOG2 (-8.0)
+#define EB_SKETCH_NORM_BINS_PER_OCTAVE 4
+
+typedef struct {
+    uint32_t magic;         /* EB_SET_SKETCH_MAGIC */
+    uint32_t version;       /* EB_SET_SKETCH_VERSION */
+    uint32_t group_count;
+    uint32_t rank;          /* EB_SKETCH_RANK */
+    uint32_t norm_bins;     /* EB_SKETCH_NORM_BINS */
+    uint32_t reserved;
+    uint64_t index_seq;     /* Next sequence number of the index it reflects */
+} eb_set_sketch_header_t;
+
+typedef struct {
+    uint32_t model_len;
+    uint32_t dims;
+    uint64_t count;
+    double norm_mean;
+    double norm_m2;
+} eb_sketch_group_header_t;
+
+/* Sketch of the vectors of one model and dimension count */
+typedef struct {
+    char* model;            /* "" if none was recorded */
+    size_t dims;
+    uint64_t count;
+    double* mean;           /* dims values */
+    double* m2;             /* Squared deviations from the mean, dims values */
+    double norm_mean;
+    double norm_m2;
+    double proj_sum[EB_SKETCH_RANK];
+    double proj_outer[EB_SKETCH_RANK * EB_SKETCH_RANK];
+    uint64_t norm_hist[EB_SKETCH_NORM_BINS];
+    uint32_t* signs;        /* Projection signs, one bit per rank, per dimension */
+} eb_sketch_t;
+
+typedef struct {
+    eb_sketch_t* items;     /* Sorted by model, then dims */
+    size_t count;
+    uint64_t index_seq;
+} eb_set_sketch_t;
+
+/* Derived statistics of one sketch */
+typedef struct {
+    double centroid_norm;   /* L2 norm of the mean vector */
+    double variance;        /* Total variance: the trace of the covariance */
+    double norm_mean;
+    double norm_stddev;
+    double norm_p50;        /* Median norm, to the histogram's resolution */
+} eb_sketch_stats_t;
+
+/* Drift estimates between two sketches of the same model and dims */
+typedef struct {
+    double centroid_cosine; /* 1 - cos of the two mean vectors */
+    double centroid_l2;     /* Distance between the mean vectors */
+    double norm_shift;      /* Change in mean norm */
+    double variance_ratio;  /* Total variance of b over a */
+    double covariance_shift;/* Relative Frobenius distance of the projected covariances */
+    double norm_distance;   /* Total variation distance of the norm histograms */
+} eb_sketch_drift_t;
+
+/**
+ * Add a vector to a sketch, or take one out with sign -1
+ *
+ * @param sketch Sketch whose dims match the vector
+ * @param values dims values
+ * @param sign 1 to add, -1 to remove
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_sketch_add(eb_sketch_t* sketch, const float* values, int sign);
+
+/**
+ * Fold another sketch of the same model and dims into one
+ */
+eb_status_t eb_sketch_merge(eb_sketch_t* into, const eb_sketch_t* other);
+
+void eb_sketch_stats(const eb_sketch_t* sketch, eb_sketch_stats_t* out);
+
+/**
+ * Estimate the drift from sketch a to sketch b
+ *
+ * @return Status code (EB_ERROR_INVALID_INPUT if their dims differ)
+ */
+eb_status_t eb_sketch_compare(const eb_sketch_t* a, const eb_sketch_t* b, eb_sketch_drift_t* out);
+
+/**
+ * Sketch of a model in a set sketch, created empty if create is set
+ *
+ * Creating a sketch moves the others, so earlier results must be looked
+ * up again.
+ *
+ * @return The sketch, or NULL if there is none or it could not be created
+ */
+eb_sketch_t* eb_set_sketch_group(eb_set_sketch_t* set, const char* model, size_t dims, bool create);
+
+eb_status_t eb_set_sketch_load(const char* path, eb_set_sketch_t* out);
+eb_status_t eb_set_sketch_save(const eb_set_sketch_t* set, const char* path);
+void eb_set_sketch_free(eb_set_sketch_t* set);
+
+/**
+ * Sketch of a set
+ *
+ * Reads the set's sketch, or builds it from every object in the set and
+ * saves it if it is missing or does not match the index.
+ *
+ * @param root Repository root
+ * @param name Set name
+ * @param threads Worker threads for a build, 0 for one per online CPU
+ * @param out Receives the sketch, free with eb_set_sketch_free()
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if the set does not exist)
+ */
+eb_status_t eb_set_sketch_open(const char* root, const char* name, unsigned threads,
+                               eb_set_sketch_t* out);
+
+/**
+ * Bring a set's sketch up to date after changes to its index
+ *
+ * Called by the set index once the changes are committed, with the index
+ * as it was opened before them. Reads the objects the changes add and
+ * replace. A set without a sketch only gets one while its index is
+ * empty; a sketch that has fallen behind is removed. Failures only
+ * leave the sketch to be rebuilt.
+ *
+ * @param root Repository root
+ * @param index_path Index file of the set
+ * @param before Index before the changes
+ * @param changes Changes that were applied
+ * @param count Number of changes
+ */
+void eb_set_sketch_update(const char* root, const char* index_path, const eb_set_index_t* before,
+                          const eb_set_index_change_t* changes, size_t count);
+
+/**
+ * Give a set created from base a copy of the base's sketch
+ *
+ * @param base_dir Base set directory
+ * @param set_dir New set directory
+ * @param index_seq Sequence number the new set's index starts at
+ */
+void eb_set_sketch_fork(const char* base_dir, const char* set_dir, uint64_t index_seq);
+
+#endif /* EB_SET_SKETCH_H */
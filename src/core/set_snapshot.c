@@ -0,0 +1,388 @@
+/*
+ * EmbeddingBridge - Arrow IPC Set Snapshots Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <arrow-glib/arrow-glib.h>
+#include <glib.h>
+
+#include "set_snapshot.h"
+#include "parquet_set.h"
+#include "set_index.h"
+#include "store.h"
+#include "quantize.h"
+#include "object_path.h"
+#include "fs.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Writers of a snapshot being built, one per vector dimension */
+typedef struct {
+    char dir[PATH_MAX];
+    const char* root;
+    eb_parquet_set_format_t format;
+    eb_store_t* store;
+    eb_parquet_set_writer_t** writers;
+    uint32_t* dims;
+    size_t count;
+    float* values;
+    size_t values_dims;
+    size_t rows;
+    eb_status_t status;
+} snapshot_export_t;
+
+static bool valid_set_name(const char* name) {
+    return name && *name && strchr(name, '/') == NULL && name[0] != '.';
+}
+
+static eb_parquet_set_writer_t* export_writer(snapshot_export_t* export, uint32_t dims) {
+    for (size_t i = 0; i < export->count; i++)
+        if (export->dims[i] == dims)
+            return export->writers[i];
+    eb_parquet_set_writer_t** writers = realloc(export->writers, (export->count + 1) * sizeof(*writers));
+    if (writers)
+        export->writers = writers;
+    uint32_t* all_dims = realloc(export->dims, (export->count + 1) * sizeof(*all_dims));
+    if (all_dims)
+        export->dims = all_dims;
+    if (!writers || !all_dims)
+        return NULL;
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "vectors-%u", dims);
+    eb_parquet_set_options_t options = { .format = export->format };
+    if (eb_parquet_set_writer_open(export->dir, prefix, dims, &options, &export->writers[export->count]) != EB_SUCCESS)
+        return NULL;
+    export->dims[export->count] = dims;
+    return export->writers[export->count++];
+}
+
+/* Time the object was stored, 0 for packed objects */
+static int64_t object_time(const char* root, const char* hash) {
+    char path[PATH_MAX];
+    struct stat st;
+    if (eb_object_path(root, hash, "raw", path, sizeof(path)) != 0 || stat(path, &st) != 0)
+        return 0;
+    return (int64_t)st.st_mtime;
+}
+
+static int export_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    snapshot_export_t* export = ctx;
+    eb_object_view_t view;
+    if (eb_object_map(export->store, hash, 0, &view) != EB_SUCCESS) {
+        DEBUG_WARN("snapshot: cannot read %s, skipped", hash);
+        return 0;
+    }
+    eb_vector_ref_t ref;
+    if (view.header.obj_type != EB_OBJ_VECTOR || eb_object_vector_ref(&view, &ref) != EB_SUCCESS ||
+        ref.dims == 0 || ref.dims > UINT32_MAX) {
+        eb_object_unmap(&view);
+        return 0;
+    }
+    if (ref.dims > export->values_dims) {
+        float* grown = realloc(export->values, ref.dims * sizeof(float));
+        if (!grown) {
+            eb_object_unmap(&view);
+            export->status = EB_ERROR_MEMORY_ALLOCATION;
+            return 1;
+        }
+        export->values = grown;
+        export->values_dims = ref.dims;
+    }
+    eb_vector_ref_get(&ref, 0, ref.dims, export->values);
+    eb_object_unmap(&view);
+
+    eb_parquet_set_writer_t* writer = export_writer(export, (uint32_t)ref.dims);
+    eb_parquet_set_row_t row = {
+        hash, export->values, source, model[0] ? model : NULL, object_time(export->root, hash)
+    };
+    export->status = writer ? eb_parquet_set_writer_add(writer, &row) : EB_ERROR_IO;
+    export->rows++;
+    return export->status != EB_SUCCESS;
+}
+
+/* Remove a snapshot directory and the files in it */
+static void remove_snapshot_dir(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent* entry;
+    char path[PATH_MAX];
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+eb_status_t eb_set_snapshot_write(const char* root, const char* set_name, bool lz4,
+                                  char*** files_out, size_t* count_out, size_t* rows_out) {
+    if (!root || !valid_set_name(set_name))
+        return EB_ERROR_INVALID_PARAMETER;
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s", root, set_name);
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return EB_ERROR_NOT_FOUND;
+
+    snapshot_export_t export = { .root = root, .status = EB_SUCCESS };
+    export.format = lz4 ? EB_PARQUET_SET_ARROW_LZ4 : EB_PARQUET_SET_ARROW;
+    snprintf(path, sizeof(path), "%s/.embr/snapshots", root);
+    snprintf(export.dir, sizeof(export.dir), "%s/.%s-XXXXXX", path, set_name);
+    if (fs_mkdir_p(path, 0755) != 0 || !mkdtemp(export.dir))
+        return EB_ERROR_IO;
+
+    eb_store_config_t config = { .root_path = (char*)root };
+    eb_set_index_t* index = NULL;
+    snprintf(path, sizeof(path), "%s/.embr/sets/%s/index", root, set_name);
+    eb_status_t status = eb_store_init(&config, &export.store);
+    if (status == EB_SUCCESS)
+        status = eb_set_index_open(root, path, &index);
+    if (status == EB_SUCCESS) {
+        status = eb_set_index_foreach(index, NULL, export_entry, &export);
+        if (status == EB_SUCCESS)
+            status = export.status;
+        eb_set_index_close(index);
+    }
+    if (export.store)
+        eb_store_destroy(export.store);
+    free(export.values);
+
+    /* Finish every writer, keeping the names of the files */
+    char** files = NULL;
+    size_t file_count = 0;
+    for (size_t i = 0; i < export.count; i++) {
+        if (status != EB_SUCCESS) {
+            eb_parquet_set_writer_abort(export.writers[i]);
+            continue;
+        }
+        char** written = NULL;
+        size_t written_count = 0;
+        status = eb_parquet_set_writer_close(export.writers[i], &written, &written_count);
+        char** grown = status == EB_SUCCESS ? realloc(files, (file_count + written_count + 1) * sizeof(*files))
+                                            : NULL;
+        if (grown)
+            files = grown;
+        for (size_t j = 0; j < written_count; j++) {
+            const char* name = strrchr(written[j], '/');
+            if (grown && !(files[file_count] = strdup(name ? name + 1 : written[j])))
+                status = EB_ERROR_MEMORY_ALLOCATION;
+            else if (grown)
+                file_count++;
+            free(written[j]);
+        }
+        free(written);
+        if (status == EB_SUCCESS && !grown)
+            status = EB_ERROR_MEMORY_ALLOCATION;
+    }
+    free(export.writers);
+    free(export.dims);
+
+    /* Swap the new snapshot in for the old one */
+    snprintf(path, sizeof(path), "%s/.embr/snapshots/%s", root, set_name);
+    if (status == EB_SUCCESS) {
+        remove_snapshot_dir(path);
+        if (rename(export.dir, path) != 0)
+            status = EB_ERROR_IO;
+    }
+    if (status != EB_SUCCESS)
+        remove_snapshot_dir(export.dir);
+
+    for (size_t i = 0; i < file_count; i++) {
+        char full[PATH_MAX];
+        snprintf(full, sizeof(full), "%s/%s", path, files[i]);
+        free(files[i]);
+        files[i] = status == EB_SUCCESS && files_out ? strdup(full) : NULL;
+    }
+    if (status != EB_SUCCESS || !files_out) {
+        for (size_t i = 0; i < file_count; i++)
+            free(files[i]);
+        free(files);
+        files = NULL;
+    }
+    if (status != EB_SUCCESS)
+        return status;
+
+    DEBUG_INFO("snapshot: %zu vectors of set %s in %zu files", export.rows, set_name, file_count);
+    if (files_out)
+        *files_out = files;
+    if (count_out)
+        *count_out = file_count;
+    if (rows_out)
+        *rows_out = export.rows;
+    return EB_SUCCESS;
+}
+
+struct eb_set_snapshot {
+    GArrowMemoryMappedInputStream* stream;
+    GArrowRecordBatchFileReader* reader;
+    size_t count;                         /* Record batches */
+    GArrowRecordBatch** batches;
+    GArrowArray** ids;                    /* id column of every batch */
+    const float** matrices;               /* Vectors of every batch */
+    size_t* batch_rows;
+    uint32_t dims;
+    size_t rows;
+};
+
+static eb_status_t snapshot_error(const char* what, GError* error) {
+    DEBUG_ERROR("snapshot: %s: %s", what, error ? error->message : "unknown error");
+    if (error)
+        g_error_free(error);
+    return EB_ERROR_INVALID_FORMAT;
+}
+
+eb_status_t eb_set_snapshot_open(const char* path, eb_set_snapshot_t** snapshot_out) {
+    if (!path || !snapshot_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    eb_set_snapshot_t* snapshot = calloc(1, sizeof(*snapshot));
+    if (!snapshot)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    GError* error = NULL;
+    eb_status_t status = EB_SUCCESS;
+    snapshot->stream = garrow_memory_mapped_input_stream_new(path, &error);
+    if (!snapshot->stream) {
+        eb_set_snapshot_close(snapshot);
+        return snapshot_error("cannot map file", error);
+    }
+    snapshot->reader = garrow_record_batch_file_reader_new(GARROW_SEEKABLE_INPUT_STREAM(snapshot->stream), &error);
+    if (!snapshot->reader) {
+        eb_set_snapshot_close(snapshot);
+        return snapshot_error("not an Arrow IPC file", error);
+    }
+
+    GArrowSchema* schema = garrow_record_batch_file_reader_get_schema(snapshot->reader);
+    gint id_column = garrow_schema_get_field_index(schema, "id");
+    gint values_column = garrow_schema_get_field_index(schema, "values");
+    if (id_column >= 0 && values_column >= 0) {
+        GArrowField* field = garrow_schema_get_field(schema, (guint)values_column);
+        GArrowDataType* type = garrow_field_get_data_type(field);
+        snapshot->dims = (uint32_t)garrow_fixed_size_list_data_type_get_list_size(GARROW_FIXED_SIZE_LIST_DATA_TYPE(type));
+        g_object_unref(type);
+        g_object_unref(field);
+    }
+    g_object_unref(schema);
+    if (snapshot->dims == 0) {
+        eb_set_snapshot_close(snapshot);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+
+    size_t count = garrow_record_batch_file_reader_get_n_record_batches(snapshot->reader);
+    snapshot->batches = calloc(count ? count : 1, sizeof(*snapshot->batches));
+    snapshot->ids = calloc(count ? count : 1, sizeof(*snapshot->ids));
+    snapshot->matrices = calloc(count ? count : 1, sizeof(*snapshot->matrices));
+    snapshot->batch_rows = calloc(count ? count : 1, sizeof(*snapshot->batch_rows));
+    if (!snapshot->batches || !snapshot->ids || !snapshot->matrices || !snapshot->batch_rows)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    for (size_t i = 0; status == EB_SUCCESS && i < count; i++) {
+        GArrowRecordBatch* batch = garrow_record_batch_file_reader_read_record_batch(snapshot->reader, (guint)i, &error);
+        if (!batch) {
+            status = snapshot_error("cannot read record batch", error);
+            break;
+        }
+        snapshot->batches[i] = batch;
+        snapshot->count = i + 1;
+        snapshot->ids[i] = garrow_record_batch_get_column_data(batch, id_column);
+
+        /* The float child of the list column: mapped file pages when uncompressed */
+        GArrowArray* values = garrow_record_batch_get_column_data(batch, values_column);
+        GArrowArray* floats = values ? garrow_base_list_array_get_values(GARROW_BASE_LIST_ARRAY(values)) : NULL;
+        gint64 length = 0;
+        const gfloat* data = floats ? garrow_float_array_get_values(GARROW_FLOAT_ARRAY(floats), &length) : NULL;
+        size_t rows = (size_t)garrow_record_batch_get_n_rows(batch);
+        size_t offset = values ? (size_t)garrow_array_get_offset(values) : 0;
+        if (!data || (uint64_t)length < (uint64_t)(offset + rows) * snapshot->dims)
+            status = EB_ERROR_INVALID_FORMAT;
+        else
+            snapshot->matrices[i] = data + offset * snapshot->dims;
+        snapshot->batch_rows[i] = rows;
+        snapshot->rows += rows;
+        if (floats)
+            g_object_unref(floats);
+        if (values)
+            g_object_unref(values);
+    }
+    if (status != EB_SUCCESS) {
+        eb_set_snapshot_close(snapshot);
+        return status;
+    }
+    *snapshot_out = snapshot;
+    return EB_SUCCESS;
+}
+
+uint32_t eb_set_snapshot_dims(const eb_set_snapshot_t* snapshot) {
+    return snapshot ? snapshot->dims : 0;
+}
+
+size_t eb_set_snapshot_rows(const eb_set_snapshot_t* snapshot) {
+    return snapshot ? snapshot->rows : 0;
+}
+
+size_t eb_set_snapshot_batches(const eb_set_snapshot_t* snapshot) {
+    return snapshot ? snapshot->count : 0;
+}
+
+eb_status_t eb_set_snapshot_matrix(const eb_set_snapshot_t* snapshot, size_t batch,
+                                   const float** values_out, size_t* rows_out) {
+    if (!snapshot || !values_out || !rows_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    if (batch >= snapshot->count)
+        return EB_ERROR_NOT_FOUND;
+    *values_out = snapshot->matrices[batch];
+    *rows_out = snapshot->batch_rows[batch];
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_set_snapshot_id(const eb_set_snapshot_t* snapshot, size_t batch, size_t row,
+                               char id_out[65]) {
+    if (!snapshot || !id_out)
+        return EB_ERROR_INVALID_PARAMETER;
+    if (batch >= snapshot->count || row >= snapshot->batch_rows[batch] || !snapshot->ids[batch])
+        return EB_ERROR_NOT_FOUND;
+    gchar* id = garrow_string_array_get_string(GARROW_STRING_ARRAY(snapshot->ids[batch]), (gint64)row);
+    if (!id)
+        return EB_ERROR_NOT_FOUND;
+    snprintf(id_out, 65, "%s", id);
+    g_free(id);
+    return EB_SUCCESS;
+}
+
+void eb_set_snapshot_close(eb_set_snapshot_t* snapshot) {
+    if (!snapshot)
+        return;
+    for (size_t i = 0; i < snapshot->count; i++) {
+        if (snapshot->ids[i])
+            g_object_unref(snapshot->ids[i]);
+        g_object_unref(snapshot->batches[i]);
+    }
+    free(snapshot->batches);
+    free(snapshot->ids);
+    free(snapshot->matrices);
+    free(snapshot->batch_rows);
+    if (snapshot->reader)
+        g_object_unref(snapshot->reader);
+    if (snapshot->stream)
+        g_object_unref(snapshot->stream);
+    free(snapshot);
+}
@@ -0,0 +1,94 @@
+/*
+ * EmbeddingBridge - Arrow IPC Set Snapshots
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SET_SNAPSHOT_H
+#define EB_SET_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "status.h"
+
+/*
+ * A snapshot holds the live vectors of a set as Arrow IPC files (Feather
+ * v2) under .embr/snapshots/<set>, one vectors-<dims>-NNNNN.arrow series
+ * per dimension, with the schema of parquet_set.h. Uncompressed snapshots
+ * are meant to be mapped: the vectors of each record batch are a
+ * row-major float matrix read in place from the page cache, which is
+ * what local analysis and zero-copy bindings use. LZ4 snapshots are
+ * smaller but decoded on open.
+ */
+
+typedef struct eb_set_snapshot eb_set_snapshot_t;
+
+/**
+ * Write a snapshot of a set, replacing an earlier one
+ *
+ * @param root Repository root
+ * @param set_name Set to snapshot
+ * @param lz4 Compress the record batches with LZ4
+ * @param files_out Receives the paths of the files written (caller frees each and the array), may be NULL
+ * @param count_out Receives the number of files written, may be NULL
+ * @param rows_out Receives the number of vectors written, may be NULL
+ * @return Status code (EB_ERROR_NOT_FOUND for an unknown set)
+ */
+eb_status_t eb_set_snapshot_write(const char* root, const char* set_name, bool lz4,
+                                  char*** files_out, size_t* count_out, size_t* rows_out);
+
+/**
+ * Map a snapshot file for reading
+ *
+ * @param path Path of a .arrow file written by eb_set_snapshot_write()
+ * @param snapshot_out Receives the snapshot
+ * @return Status code (EB_ERROR_INVALID_FORMAT if it holds no set vectors)
+ */
+eb_status_t eb_set_snapshot_open(const char* path, eb_set_snapshot_t** snapshot_out);
+
+/* Dimensions of every vector in the file */
+uint32_t eb_set_snapshot_dims(const eb_set_snapshot_t* snapshot);
+
+/* Number of vectors in the file */
+size_t eb_set_snapshot_rows(const eb_set_snapshot_t* snapshot);
+
+/* Number of record batches in the file */
+size_t eb_set_snapshot_batches(const eb_set_snapshot_t* snapshot);
+
+/**
+ * Vectors of one record batch as a row-major matrix
+ *
+ * The matrix stays valid until the snapshot is closed.
+ *
+ * @param snapshot Snapshot
+ * @param batch Record batch index
+ * @param values_out Receives rows * dims floats
+ * @param rows_out Receives the number of rows in the batch
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_snapshot_matrix(const eb_set_snapshot_t* snapshot, size_t batch,
+                                   const float** values_out, size_t* rows_out);
+
+/**
+ * Object hash of one row
+ *
+ * @param snapshot Snapshot
+ * @param batch Record batch index
+ * @param row Row within the batch
+ * @param id_out Receives the hash
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_set_snapshot_id(const eb_set_snapshot_t* snapshot, size_t batch, size_t row,
+                               char id_out[65]);
+
+/**
+ * Unmap a snapshot
+ */
+void eb_set_snapshot_close(eb_set_snapshot_t* snapshot);
+
+#endif /* EB_SET_SNAPSHOT_H */
@@ -0,0 +1,164 @@
+/*
+ * EmbeddingBridge - Float Byte Shuffle Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "shuffle.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Values handled per vector step */
+#define BLOCK 16
+
+/* Shuffle values [start, count) of an array of count values */
+static void shuffle_scalar(const uint8_t* src, uint8_t* dst, size_t start, size_t count) {
+    for (size_t i = start; i < count; i++) {
+        dst[i] = src[4 * i];
+        dst[count + i] = src[4 * i + 1];
+        dst[2 * count + i] = src[4 * i + 2];
+        dst[3 * count + i] = src[4 * i + 3];
+    }
+}
+
+static void unshuffle_scalar(const uint8_t* src, uint8_t* dst, size_t start, size_t count) {
+    for (size_t i = start; i < count; i++) {
+        dst[4 * i] = src[i];
+        dst[4 * i + 1] = src[count + i];
+        dst[4 * i + 2] = src[2 * count + i];
+        dst[4 * i + 3] = src[3 * count + i];
+    }
+}
+
+#if defined(__SSE2__)
+
+/* Transpose 16 values (64 bytes) into four 16-byte planes */
+static size_t shuffle_vector(const uint8_t* src, uint8_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + BLOCK <= count; i += BLOCK) {
+        const uint8_t* in = src + 4 * i;
+        __m128i a = _mm_loadu_si128((const __m128i*)in);
+        __m128i b = _mm_loadu_si128((const __m128i*)(in + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(in + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(in + 48));
+
+        /* Three rounds of byte interleaving sort the bytes by plane */
+        __m128i t0 = _mm_unpacklo_epi8(a, b);
+        __m128i t1 = _mm_unpackhi_epi8(a, b);
+        __m128i t2 = _mm_unpacklo_epi8(c, d);
+        __m128i t3 = _mm_unpackhi_epi8(c, d);
+        __m128i u0 = _mm_unpacklo_epi8(t0, t1);
+        __m128i u1 = _mm_unpackhi_epi8(t0, t1);
+        __m128i u2 = _mm_unpacklo_epi8(t2, t3);
+        __m128i u3 = _mm_unpackhi_epi8(t2, t3);
+        __m128i v0 = _mm_unpacklo_epi8(u0, u1);  /* planes 0,1 of values 0-7 */
+        __m128i v1 = _mm_unpackhi_epi8(u0, u1);  /* planes 2,3 of values 0-7 */
+        __m128i v2 = _mm_unpacklo_epi8(u2, u3);  /* planes 0,1 of values 8-15 */
+        __m128i v3 = _mm_unpackhi_epi8(u2, u3);  /* planes 2,3 of values 8-15 */
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi64(v0, v2));
+        _mm_storeu_si128((__m128i*)(dst + count + i), _mm_unpackhi_epi64(v0, v2));
+        _mm_storeu_si128((__m128i*)(dst + 2 * count + i), _mm_unpacklo_epi64(v1, v3));
+        _mm_storeu_si128((__m128i*)(dst + 3 * count + i), _mm_unpackhi_epi64(v1, v3));
+    }
+    return i;
+}
+
+static size_t unshuffle_vector(const uint8_t* src, uint8_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + BLOCK <= count; i += BLOCK) {
+        __m128i p0 = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(src + count + i));
+        __m128i p2 = _mm_loadu_si128((const __m128i*)(src + 2 * count + i));
+        __m128i p3 = _mm_loadu_si128((const __m128i*)(src + 3 * count + i));
+
+        /* Pair bytes 0,1 and 2,3, then the pairs, giving whole values */
+        __m128i x0 = _mm_unpacklo_epi8(p0, p1);
+        __m128i x1 = _mm_unpackhi_epi8(p0, p1);
+        __m128i x2 = _mm_unpacklo_epi8(p2, p3);
+        __m128i x3 = _mm_unpackhi_epi8(p2, p3);
+
+        uint8_t* out = dst + 4 * i;
+        _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(x0, x2));
+        _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(x0, x2));
+        _mm_storeu_si128((__m128i*)(out + 32), _mm_unpacklo_epi16(x1, x3));
+        _mm_storeu_si128((__m128i*)(out + 48), _mm_unpackhi_epi16(x1, x3));
+    }
+    return i;
+}
+
+#elif defined(__ARM_NEON)
+
+/* vld4/vst4 (de)interleave four byte lanes directly */
+static size_t shuffle_vector(const uint8_t* src, uint8_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + BLOCK <= count; i += BLOCK) {
+        uint8x16x4_t planes = vld4q_u8(src + 4 * i);
+        vst1q_u8(dst + i, planes.val[0]);
+        vst1q_u8(dst + count + i, planes.val[1]);
+        vst1q_u8(dst + 2 * count + i, planes.val[2]);
+        vst1q_u8(dst + 3 * count + i, planes.val[3]);
+    }
+    return i;
+}
+
+static size_t unshuffle_vector(const uint8_t* src, uint8_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + BLOCK <= count; i += BLOCK) {
+        uint8x16x4_t planes;
+        planes.val[0] = vld1q_u8(src + i);
+        planes.val[1] = vld1q_u8(src + count + i);
+        planes.val[2] = vld1q_u8(src + 2 * count + i);
+        planes.val[3] = vld1q_u8(src + 3 * count + i);
+        vst4q_u8(dst + 4 * i, planes);
+    }
+    return i;
+}
+
+#else
+
+static size_t shuffle_vector(const uint8_t* src, uint8_t* dst, size_t count) {
+    (void)src;
+    (void)dst;
+    (void)count;
+    return 0;
+}
+
+static size_t unshuffle_vector(const uint8_t* src, uint8_t* dst, size_t count) {
+    (void)src;
+    (void)dst;
+    (void)count;
+    return 0;
+}
+
+#endif
+
+void eb_shuffle4(const void* src, void* dst, size_t size) {
+    const uint8_t* in = src;
+    uint8_t* out = dst;
+    size_t count = size / 4;
+
+    size_t done = shuffle_vector(in, out, count);
+    shuffle_scalar(in, out, done, count);
+    memcpy(out + 4 * count, in + 4 * count, size - 4 * count);
+}
+
+void eb_unshuffle4(const void* src, void* dst, size_t size) {
+    const uint8_t* in = src;
+    uint8_t* out = dst;
+    size_t count = size / 4;
+
+    size_t done = unshuffle_vector(in, out, count);
+    unshuffle_scalar(in, out, done, count);
+    memcpy(out + 4 * count, in + 4 * count, size - 4 * count);
+}
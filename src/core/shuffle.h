@@ -0,0 +1,46 @@
+/*
+ * EmbeddingBridge - Float Byte Shuffle
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SHUFFLE_H
+#define EB_SHUFFLE_H
+
+#include <stddef.h>
+
+/*
+ * Byte shuffle for float32 data: byte b of every value is gathered into
+ * plane b, so the slowly varying sign/exponent bytes end up next to each
+ * other and compress far better than interleaved IEEE floats.
+ *
+ *   in:  a0 a1 a2 a3 b0 b1 b2 b3 ...
+ *   out: a0 b0 ... | a1 b1 ... | a2 b2 ... | a3 b3 ...
+ *
+ * A trailing partial value (size not a multiple of 4) is copied as is.
+ * SSE2 and NEON versions are used where the compiler targets them.
+ */
+
+/**
+ * Shuffle size bytes of float32 values from src into dst
+ *
+ * @param src Source buffer
+ * @param dst Destination buffer, must not overlap src
+ * @param size Size of both buffers in bytes
+ */
+void eb_shuffle4(const void* src, void* dst, size_t size);
+
+/**
+ * Undo eb_shuffle4()
+ *
+ * @param src Shuffled buffer
+ * @param dst Destination buffer, must not overlap src
+ * @param size Size of both buffers in bytes
+ */
+void eb_unshuffle4(const void* src, void* dst, size_t size);
+
+#endif /* EB_SHUFFLE_H */
@@ -0,0 +1,470 @@
+/*
+ * EmbeddingBridge - Many-to-Many Similarity Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include "similarity.h"
+#include "distance.h"
+#include "thread_pool.h"
+
+#ifdef EB_HAVE_CBLAS
+#include <cblas.h>
+#endif
+
+/* Query rows multiplied against each corpus tile */
+#define ROW_BLOCK 32
+
+/* Corpus rows per tile are chosen so the tile fits in L2 */
+#define TILE_BYTES    (256 * 1024)
+#define TILE_MIN_ROWS 16
+#define TILE_MAX_ROWS 1024
+
+/* Rows of S handed to the callback at once are bounded by this size */
+#define BAND_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    float score;
+    size_t index;
+} match_t;
+
+/* Bounded min-heap of the k best matches; items[0] is the worst of them */
+typedef struct {
+    match_t* items;
+    size_t size;
+    size_t k;
+} match_heap_t;
+
+/* Inputs shared by the workers of one call */
+typedef struct {
+    const eb_matrix_t* a;
+    const eb_matrix_t* b;
+    size_t b_count;
+    eb_sim_metric_t metric;
+    float* a_scale;             /* Inverse row norms for cosine, NULL for dot */
+    float* b_scale;
+    size_t tile_rows;
+} sim_space_t;
+
+typedef struct {
+    const sim_space_t* space;
+    const eb_sim_options_t* options;
+    size_t first;               /* First row of this pass */
+    size_t count;               /* Rows in this pass */
+    float* band;                /* Rows mode: count x b_count output */
+    size_t* indices;            /* Top-k mode outputs */
+    float* scores;
+    size_t next_block;
+    size_t done;
+} sim_job_t;
+
+static bool better(const match_t* a, const match_t* b) {
+    return a->score > b->score || (a->score == b->score && a->index < b->index);
+}
+
+static void heap_push(match_heap_t* heap, float score, size_t index) {
+    match_t m = { score, index };
+    size_t i;
+
+    if (heap->size < heap->k) {
+        for (i = heap->size++; i > 0; ) {
+            size_t parent = (i - 1) / 2;
+            if (!better(&heap->items[parent], &m))
+                break;
+            heap->items[i] = heap->items[parent];
+            i = parent;
+        }
+        heap->items[i] = m;
+        return;
+    }
+
+    if (!better(&m, &heap->items[0]))
+        return;
+    for (i = 0; ; ) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->size)
+            break;
+        if (child + 1 < heap->size && better(&heap->items[child], &heap->items[child + 1]))
+            child++;
+        if (!better(&m, &heap->items[child]))
+            break;
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    heap->items[i] = m;
+}
+
+static int compare_matches(const void* x, const void* y) {
+    const match_t* a = x;
+    const match_t* b = y;
+    return better(a, b) ? -1 : better(b, a) ? 1 : 0;
+}
+
+static float* inverse_norms(const eb_matrix_t* m, size_t count) {
+    float* scale = malloc((count ? count : 1) * sizeof(float));
+    if (!scale)
+        return NULL;
+    for (size_t i = 0; i < count; i++) {
+        const float* row = m->values + i * m->dims;
+        float norm = eb_dot(row, row, m->dims);
+        scale[i] = norm > 0.0f ? 1.0f / sqrtf(norm) : 0.0f;
+    }
+    return scale;
+}
+
+/* out[r * ld + c] = S[row + r][col + c] for a block of rows against a tile of columns */
+static void compute_tile(const sim_space_t* space, size_t row, size_t rows, size_t col, size_t cols,
+                         float* out, size_t ld) {
+    size_t dims = space->a->dims;
+    const float* a = space->a->values + row * dims;
+    const float* b = space->b->values + col * dims;
+
+#ifdef EB_HAVE_CBLAS
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, (int)rows, (int)cols, (int)dims,
+                1.0f, a, (int)dims, b, (int)dims, 0.0f, out, (int)ld);
+#else
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++)
+            out[r * ld + c] = eb_dot(a + r * dims, b + c * dims, dims);
+    }
+#endif
+
+    if (space->metric == EB_SIM_COSINE) {
+        for (size_t r = 0; r < rows; r++) {
+            float scale = space->a_scale[row + r];
+            for (size_t c = 0; c < cols; c++)
+                out[r * ld + c] *= scale * space->b_scale[col + c];
+        }
+    }
+}
+
+/* Rows mode: every block of rows goes straight into the band */
+static void rows_block(const sim_job_t* job, size_t first, size_t rows) {
+    const sim_space_t* space = job->space;
+    float* out = job->band + (first - job->first) * space->b_count;
+    for (size_t col = 0; col < space->b_count; col += space->tile_rows) {
+        size_t cols = space->b_count - col < space->tile_rows ? space->b_count - col : space->tile_rows;
+        compute_tile(space, first, rows, col, cols, out + col, space->b_count);
+    }
+}
+
+/* Top-k mode: tiles go through a scratch buffer into per-row heaps */
+static void top_k_block(const sim_job_t* job, size_t first, size_t rows, float* tile, match_heap_t* heaps) {
+    const sim_space_t* space = job->space;
+    bool exclude_self = job->options->exclude_self;
+    size_t k = job->options->k;
+
+    for (size_t r = 0; r < rows; r++)
+        heaps[r].size = 0;
+
+    for (size_t col = 0; col < space->b_count; col += space->tile_rows) {
+        size_t cols = space->b_count - col < space->tile_rows ? space->b_count - col : space->tile_rows;
+        compute_tile(space, first, rows, col, cols, tile, cols);
+        for (size_t r = 0; r < rows; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                if (exclude_self && col + c == first + r)
+                    continue;
+                float score = tile[r * cols + c];
+                heap_push(&heaps[r], isnan(score) ? -INFINITY : score, col + c);
+            }
+        }
+    }
+
+    for (size_t r = 0; r < rows; r++) {
+        qsort(heaps[r].items, heaps[r].size, sizeof(match_t), compare_matches);
+        for (size_t i = 0; i < k; i++) {
+            job->indices[(first + r) * k + i] = heaps[r].items[i].index;
+            job->scores[(first + r) * k + i] = heaps[r].items[i].score;
+        }
+    }
+}
+
+/* Claim row blocks until none are left; a worker that cannot allocate leaves them to the others */
+static void sim_worker(void* arg) {
+    sim_job_t* job = arg;
+    bool top_k = job->band == NULL;
+    size_t k = job->options->k;
+    float* tile = NULL;
+    match_t* items = NULL;
+    match_heap_t heaps[ROW_BLOCK];
+
+    if (top_k) {
+        tile = malloc(ROW_BLOCK * job->space->tile_rows * sizeof(float));
+        items = malloc(ROW_BLOCK * k * sizeof(match_t));
+        if (!tile || !items)
+            goto done;
+        for (size_t r = 0; r < ROW_BLOCK; r++)
+            heaps[r] = (match_heap_t){ items + r * k, 0, k };
+    }
+
+    for (;;) {
+        size_t offset = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * ROW_BLOCK;
+        if (offset >= job->count)
+            break;
+        size_t rows = job->count - offset < ROW_BLOCK ? job->count - offset : ROW_BLOCK;
+        if (top_k)
+            top_k_block(job, job->first + offset, rows, tile, heaps);
+        else
+            rows_block(job, job->first + offset, rows);
+        __atomic_fetch_add(&job->done, rows, __ATOMIC_RELAXED);
+    }
+
+done:
+    free(items);
+    free(tile);
+}
+
+static eb_status_t run_job(sim_job_t* job) {
+    // The calling thread works too, so a busy pool only costs speed
+    eb_parallel_run(NULL, eb_pool_threads(job->options->threads, (job->count + ROW_BLOCK - 1) / ROW_BLOCK),
+                    sim_worker, job);
+
+    // Rows are only left over if no worker could allocate its buffers
+    return job->done == job->count ? EB_SUCCESS : EB_ERROR_MEMORY_ALLOCATION;
+}
+
+static eb_status_t space_init(sim_space_t* space, const eb_matrix_t* a, size_t a_count,
+                              const eb_matrix_t* b, size_t b_count, const eb_sim_options_t* options) {
+    memset(space, 0, sizeof(*space));
+    if (!a || !b || !options || !a->values || !b->values || a->dims == 0 || a->dims != b->dims ||
+        a_count == 0 || b_count == 0 ||
+        (options->metric != EB_SIM_COSINE && options->metric != EB_SIM_DOT))
+        return EB_ERROR_INVALID_INPUT;
+#ifdef EB_HAVE_CBLAS
+    if (a->dims > INT32_MAX || b_count > INT32_MAX)
+        return EB_ERROR_INVALID_INPUT;
+#endif
+
+    space->a = a;
+    space->b = b;
+    space->b_count = b_count;
+    space->metric = options->metric;
+    if (options->metric == EB_SIM_COSINE) {
+        space->a_scale = inverse_norms(a, a_count);
+        space->b_scale = a == b && a_count == b_count ? space->a_scale : inverse_norms(b, b_count);
+        if (!space->a_scale || !space->b_scale)
+            return EB_ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t rows = TILE_BYTES / (a->dims * sizeof(float));
+    space->tile_rows = rows < TILE_MIN_ROWS ? TILE_MIN_ROWS : rows > TILE_MAX_ROWS ? TILE_MAX_ROWS : rows;
+    return EB_SUCCESS;
+}
+
+static void space_free(sim_space_t* space) {
+    if (space->b_scale != space->a_scale)
+        free(space->b_scale);
+    free(space->a_scale);
+}
+
+/* Prefix screening applies when it leaves out some dimensions */
+static bool screens_prefix(const eb_matrix_t* a, const eb_sim_options_t* options) {
+    return options && a && options->prefix_dims > 0 && options->prefix_dims < a->dims;
+}
+
+/* Compact copy of the first dims values of each row */
+static float* prefix_copy(const eb_matrix_t* m, size_t count, size_t dims, eb_matrix_t* out) {
+    float* values = malloc(count * dims * sizeof(float));
+    if (!values)
+        return NULL;
+    for (size_t i = 0; i < count; i++)
+        memcpy(values + i * dims, m->values + i * m->dims, dims * sizeof(float));
+    out->values = values;
+    out->dims = dims;
+    return values;
+}
+
+/* Both matrices cut to options->prefix_dims, one copy if they are the same */
+static eb_status_t prefix_space(const eb_matrix_t* a, size_t a_count, const eb_matrix_t* b,
+                                size_t b_count, const eb_sim_options_t* options,
+                                eb_matrix_t* prefix_a, eb_matrix_t* prefix_b, float** buffers) {
+    buffers[0] = buffers[1] = NULL;
+    if (!b || !a->values || !b->values || a->dims != b->dims || a_count == 0 || b_count == 0)
+        return EB_ERROR_INVALID_INPUT;
+    buffers[0] = prefix_copy(a, a_count, options->prefix_dims, prefix_a);
+    if (a == b && a_count == b_count)
+        *prefix_b = *prefix_a;
+    else
+        buffers[1] = prefix_copy(b, b_count, options->prefix_dims, prefix_b);
+    if (!buffers[0] || (!buffers[1] && (a != b || a_count != b_count))) {
+        free(buffers[0]);
+        free(buffers[1]);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_similarity_rows(const eb_matrix_t* a, size_t a_count,
+                               const eb_matrix_t* b, size_t b_count,
+                               const eb_sim_options_t* options, eb_sim_rows_fn fn, void* ctx) {
+    if (!fn)
+        return EB_ERROR_INVALID_INPUT;
+    if (screens_prefix(a, options)) {
+        eb_matrix_t prefix_a, prefix_b;
+        float* buffers[2];
+        eb_status_t status = prefix_space(a, a_count, b, b_count, options, &prefix_a, &prefix_b, buffers);
+        if (status != EB_SUCCESS)
+            return status;
+        eb_sim_options_t full = *options;
+        full.prefix_dims = 0;
+        status = eb_similarity_rows(&prefix_a, a_count, &prefix_b, b_count, &full, fn, ctx);
+        free(buffers[0]);
+        free(buffers[1]);
+        return status;
+    }
+    sim_space_t space;
+    eb_status_t status = space_init(&space, a, a_count, b, b_count, options);
+
+    // Bands are whole row blocks, so workers never share a block
+    size_t band_rows = BAND_BYTES / (b_count * sizeof(float));
+    band_rows = band_rows < ROW_BLOCK ? ROW_BLOCK : band_rows / ROW_BLOCK * ROW_BLOCK;
+    if (band_rows > a_count)
+        band_rows = a_count;
+    float* band = status == EB_SUCCESS ? malloc(band_rows * b_count * sizeof(float)) : NULL;
+    if (status == EB_SUCCESS && !band)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    for (size_t first = 0; first < a_count && status == EB_SUCCESS; first += band_rows) {
+        sim_job_t job = {
+            .space = &space,
+            .options = options,
+            .first = first,
+            .count = a_count - first < band_rows ? a_count - first : band_rows,
+            .band = band,
+        };
+        status = run_job(&job);
+        if (status == EB_SUCCESS && fn(first, job.count, band, ctx) != 0)
+            break;
+    }
+
+    free(band);
+    space_free(&space);
+    return status;
+}
+
+typedef struct {
+    float* out;
+    size_t b_count;
+} copy_ctx_t;
+
+static int copy_rows(size_t first, size_t rows, const float* values, void* ctx) {
+    copy_ctx_t* copy = ctx;
+    memcpy(copy->out + first * copy->b_count, values, rows * copy->b_count * sizeof(float));
+    return 0;
+}
+
+eb_status_t eb_similarity_matrix(const eb_matrix_t* a, size_t a_count,
+                                 const eb_matrix_t* b, size_t b_count,
+                                 const eb_sim_options_t* options, float* out) {
+    if (!out)
+        return EB_ERROR_INVALID_INPUT;
+    copy_ctx_t copy = { out, b_count };
+    return eb_similarity_rows(a, a_count, b, b_count, options, copy_rows, &copy);
+}
+
+/* Full-dimension similarity of two rows, scaled like compute_tile() does */
+static float full_score(const float* x, const float* y, size_t dims, eb_sim_metric_t metric) {
+    float dot = eb_dot(x, y, dims);
+    if (metric == EB_SIM_DOT)
+        return dot;
+    float norm_x = eb_dot(x, x, dims);
+    float norm_y = eb_dot(y, y, dims);
+    float scale_x = norm_x > 0.0f ? 1.0f / sqrtf(norm_x) : 0.0f;
+    float scale_y = norm_y > 0.0f ? 1.0f / sqrtf(norm_y) : 0.0f;
+    return dot * (scale_x * scale_y);
+}
+
+/* Screen candidates on the prefixes, then keep the k best of them at full dimensions */
+static eb_status_t refined_top_k(const eb_matrix_t* a, size_t a_count,
+                                 const eb_matrix_t* b, size_t b_count,
+                                 const eb_sim_options_t* options, size_t* indices, float* scores) {
+    size_t candidates = b_count - (options->exclude_self ? 1 : 0);
+    size_t screened = options->refine ? options->refine : 4 * options->k;
+    if (screened < options->k)
+        screened = options->k;
+    if (screened > candidates)
+        screened = candidates;
+
+    eb_matrix_t prefix_a, prefix_b;
+    float* buffers[2];
+    eb_status_t status = prefix_space(a, a_count, b, b_count, options, &prefix_a, &prefix_b, buffers);
+    if (status != EB_SUCCESS)
+        return status;
+    size_t* screen_indices = malloc(a_count * screened * sizeof(size_t));
+    float* screen_scores = malloc(a_count * screened * sizeof(float));
+    match_t* matches = malloc(screened * sizeof(match_t));
+    if (!screen_indices || !screen_scores || !matches)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+
+    if (status == EB_SUCCESS) {
+        eb_sim_options_t screen = *options;
+        screen.k = screened;
+        screen.prefix_dims = 0;
+        status = eb_similarity_top_k(&prefix_a, a_count, &prefix_b, b_count, &screen,
+                                     screen_indices, screen_scores);
+    }
+    for (size_t i = 0; i < a_count && status == EB_SUCCESS; i++) {
+        const float* row = a->values + i * a->dims;
+        for (size_t r = 0; r < screened; r++) {
+            size_t j = screen_indices[i * screened + r];
+            matches[r].index = j;
+            matches[r].score = full_score(row, b->values + j * b->dims, a->dims, options->metric);
+        }
+        qsort(matches, screened, sizeof(match_t), compare_matches);
+        for (size_t r = 0; r < options->k; r++) {
+            indices[i * options->k + r] = matches[r].index;
+            scores[i * options->k + r] = matches[r].score;
+        }
+    }
+
+    free(screen_indices);
+    free(screen_scores);
+    free(matches);
+    free(buffers[0]);
+    free(buffers[1]);
+    return status;
+}
+
+eb_status_t eb_similarity_top_k(const eb_matrix_t* a, size_t a_count,
+                                const eb_matrix_t* b, size_t b_count,
+                                const eb_sim_options_t* options, size_t* indices, float* scores) {
+    if (!options || !indices || !scores || options->k == 0 ||
+        options->k > b_count - (options->exclude_self && b_count > 0 ? 1 : 0))
+        return EB_ERROR_INVALID_INPUT;
+    if (screens_prefix(a, options))
+        return refined_top_k(a, a_count, b, b_count, options, indices, scores);
+
+    sim_space_t space;
+    eb_status_t status = space_init(&space, a, a_count, b, b_count, options);
+    if (status == EB_SUCCESS) {
+        sim_job_t job = {
+            .space = &space,
+            .options = options,
+            .first = 0,
+            .count = a_count,
+            .indices = indices,
+            .scores = scores,
+        };
+        status = run_job(&job);
+    }
+    space_free(&space);
+    return status;
+}
+
+const char* eb_similarity_backend(void) {
+#ifdef EB_HAVE_CBLAS
+    return "cblas";
+#else
+    return eb_kernel_name(eb_kernel_active());
+#endif
+}
@@ -0,0 +1,107 @@
+/*
+ * EmbeddingBridge - Many-to-Many Similarity
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SIMILARITY_H
+#define EB_SIMILARITY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+#include "neighborhood.h"
+
+/*
+ * Similarity of every row of a query matrix A with every row of a corpus
+ * matrix B, S = A * B^T, for deduplication and retrieval QA.
+ *
+ * S is computed as a tiled matrix product: a block of A rows against a
+ * tile of B rows sized to stay in cache. Builds with EB_HAVE_CBLAS hand
+ * each tile to cblas_sgemm(); otherwise every entry is an eb_dot() on the
+ * runtime-selected SIMD kernel. Cosine similarity scales the products by
+ * the inverse row norms afterwards, so zero rows score 0.
+ *
+ * Row blocks are shared out to worker threads like eb_knn_preservation()
+ * does, and calls from several threads at once are safe.
+ *
+ * For models trained to keep their meaning in a dimension prefix
+ * (Matryoshka embeddings), prefix_dims screens with the first values of
+ * every row only. Cosine similarity renormalizes the prefixes. Top-k
+ * searches then rescore the best screened candidates at full dimensions,
+ * so only the final ranking pays for every dimension.
+ */
+
+typedef enum {
+    EB_SIM_COSINE = 0,      /* a.b / (|a| |b|) */
+    EB_SIM_DOT              /* a.b */
+} eb_sim_metric_t;
+
+typedef struct {
+    eb_sim_metric_t metric;
+    size_t k;                   /* Matches per row for eb_similarity_top_k() */
+    bool exclude_self;          /* Skip column i for row i, for A compared with itself */
+    unsigned threads;           /* Worker threads, 0 for one per online CPU */
+    size_t prefix_dims;         /* Compare the first prefix_dims values only, 0 for all */
+    size_t refine;              /* Screened candidates per row rescored in full, 0 for 4 * k */
+} eb_sim_options_t;
+
+/**
+ * Callback receiving consecutive rows of S
+ *
+ * @param first Index of the first row
+ * @param rows Number of rows
+ * @param values rows x b_count similarities, row-major
+ * @return 0 to continue, non-zero to stop
+ */
+typedef int (*eb_sim_rows_fn)(size_t first, size_t rows, const float* values, void* ctx);
+
+/**
+ * Compute S in bands of rows, in order
+ *
+ * Memory is bounded by a band of rows, so S never has to fit in memory.
+ *
+ * @param a Query rows
+ * @param a_count Number of query rows
+ * @param b Corpus rows, same dimensions as a
+ * @param b_count Number of corpus rows
+ * @param options Metric and parallelism
+ * @param fn Callback for each band
+ * @param ctx Callback context
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_similarity_rows(const eb_matrix_t* a, size_t a_count,
+                               const eb_matrix_t* b, size_t b_count,
+                               const eb_sim_options_t* options, eb_sim_rows_fn fn, void* ctx);
+
+/**
+ * Compute all of S into a_count x b_count floats, row-major
+ */
+eb_status_t eb_similarity_matrix(const eb_matrix_t* a, size_t a_count,
+                                 const eb_matrix_t* b, size_t b_count,
+                                 const eb_sim_options_t* options, float* out);
+
+/**
+ * Find the options->k most similar corpus rows of every query row
+ *
+ * Matches are ordered by descending similarity, equal ones by index.
+ * With prefix_dims, the reported scores are the full-dimension ones.
+ *
+ * @param indices Receives a_count x k corpus row indices
+ * @param scores Receives a_count x k similarities
+ * @return Status code (0 = success, EB_ERROR_INVALID_INPUT if k exceeds the candidates)
+ */
+eb_status_t eb_similarity_top_k(const eb_matrix_t* a, size_t a_count,
+                                const eb_matrix_t* b, size_t b_count,
+                                const eb_sim_options_t* options, size_t* indices, float* scores);
+
+/**
+ * Name of the matrix product backend, "cblas" or the SIMD kernel in use
+ */
+const char* eb_similarity_backend(void);
+
+#endif /* EB_SIMILARITY_H */
@@ -0,0 +1,333 @@
+/*
+ * EmbeddingBridge - Whole-Set Source Status Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "source_status.h"
+#include "set_index.h"
+#include "log_index.h"
+#include "object_path.h"
+#include "path_utils.h"
+#include "stat_cache.h"
+#include "store.h"
+#include "debug.h"
+#include "thread_pool.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/* Sources claimed by a worker at a time */
+#define SOURCE_BLOCK 16
+
+typedef struct {
+    char* source;
+    char* model;
+    char hash[65];
+    size_t versions;
+    eb_source_state_t state;
+    bool hashed;
+    bool done;                  /* Set by the worker, read by the reporter */
+} source_entry_t;
+
+typedef struct {
+    source_entry_t* items;
+    size_t count;
+    size_t capacity;
+    const char* model;
+    bool failed;
+} entry_list_t;
+
+typedef struct {
+    const char* root;
+    eb_stat_cache_t* stat_cache;    /* May be NULL */
+    source_entry_t* items;
+    size_t count;
+    size_t next_block;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t progress;    /* Broadcast after every block */
+} status_job_t;
+
+static int collect_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    entry_list_t* list = ctx;
+    if (list->model && strcmp(list->model, model) != 0)
+        return 0;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        source_entry_t* grown = realloc(list->items, capacity * sizeof(*grown));
+        if (!grown) {
+            list->failed = true;
+            return 1;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    source_entry_t* e = &list->items[list->count];
+    memset(e, 0, sizeof(*e));
+    e->source = strdup(source);
+    e->model = strdup(model);
+    if (!e->source || !e->model) {
+        free(e->source);
+        free(e->model);
+        list->failed = true;
+        return 1;
+    }
+    memcpy(e->hash, hash, 65);
+    list->count++;
+    return 0;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const source_entry_t* x = a;
+    const source_entry_t* y = b;
+    int cmp = strcmp(x->source, y->source);
+    return cmp ? cmp : strcmp(x->model, y->model);
+}
+
+static void free_entries(entry_list_t* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->items[i].source);
+        free(list->items[i].model);
+    }
+    free(list->items);
+}
+
+/* Count a log line against its (source, model) entry, if tracked */
+static int count_version(const eb_log_entry_t* entry, void* ctx) {
+    entry_list_t* list = ctx;
+    if (entry->removed)
+        return 0;
+    source_entry_t key = { .source = (char*)entry->source, .model = (char*)entry->model };
+    source_entry_t* e = bsearch(&key, list->items, list->count, sizeof(*list->items),
+                                compare_entries);
+    if (e)
+        e->versions++;
+    return 0;
+}
+
+/* What was recorded about the source when the embedding was stored */
+typedef struct {
+    char source_file[PATH_MAX];
+    char source_hash[65];
+    eb_hash_algo_t source_hash_algo;    /* SHA-256 unless the .meta names another */
+    time_t timestamp;
+} stored_meta_t;
+
+static void read_meta(const char* root, const char* hash, stored_meta_t* meta) {
+    memset(meta, 0, sizeof(*meta));
+    char path[PATH_MAX];
+    if (eb_object_path(root, hash, "meta", path, sizeof(path)) != 0)
+        return;
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return;
+
+    char line[PATH_MAX + 32];
+    bool unknown_algo = false;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "source_file=", 12) == 0)
+            snprintf(meta->source_file, sizeof(meta->source_file), "%s", line + 12);
+        else if (strncmp(line, "source_hash=", 12) == 0 && strlen(line + 12) == 64)
+            memcpy(meta->source_hash, line + 12, 65);
+        else if (strncmp(line, "source_hash_algo=", 17) == 0)
+            unknown_algo = eb_object_hash_parse(line + 17, &meta->source_hash_algo) != EB_SUCCESS;
+        else if (strncmp(line, "timestamp=", 10) == 0)
+            meta->timestamp = (time_t)strtoll(line + 10, NULL, 10);
+    }
+    fclose(f);
+
+    // A hash this build cannot compute is no better than none
+    if (unknown_algo)
+        meta->source_hash[0] = '\0';
+}
+
+static void check_source(const char* root, eb_stat_cache_t* stat_cache, source_entry_t* e) {
+    char path[PATH_MAX];
+    if (e->source[0] == '/')
+        snprintf(path, sizeof(path), "%s", e->source);
+    else
+        snprintf(path, sizeof(path), "%s/%s", root, e->source);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        e->state = EB_SOURCE_MISSING;
+        return;
+    }
+
+    // A .meta written for another source with the same embedding says nothing about this one
+    stored_meta_t meta;
+    read_meta(root, e->hash, &meta);
+    if (meta.source_hash[0] && (!meta.source_file[0] || strcmp(meta.source_file, e->source) == 0)) {
+        char current[65];
+        if (eb_stat_cache_hash_with(stat_cache, e->source, path, meta.source_hash_algo,
+                                    current, NULL) != EB_SUCCESS) {
+            e->state = EB_SOURCE_MISSING;
+            return;
+        }
+        e->hashed = true;
+        e->state = strcmp(current, meta.source_hash) == 0 ? EB_SOURCE_UNCHANGED : EB_SOURCE_MODIFIED;
+        return;
+    }
+
+    e->state = meta.timestamp > 0 && st.st_mtime > meta.timestamp ? EB_SOURCE_MODIFIED
+                                                                   : EB_SOURCE_UNCHANGED;
+}
+
+/* Check one block; false once there are none left */
+static bool run_block(status_job_t* job) {
+    if (__atomic_load_n(&job->stop, __ATOMIC_RELAXED))
+        return false;
+    size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * SOURCE_BLOCK;
+    if (first >= job->count)
+        return false;
+    size_t end = job->count - first < SOURCE_BLOCK ? job->count : first + SOURCE_BLOCK;
+    for (size_t i = first; i < end; i++) {
+        check_source(job->root, job->stat_cache, &job->items[i]);
+        __atomic_store_n(&job->items[i].done, true, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    pthread_cond_broadcast(&job->progress);
+    pthread_mutex_unlock(&job->lock);
+    return true;
+}
+
+static void status_worker(void* arg) {
+    status_job_t* job = arg;
+    while (run_block(job))
+        ;
+}
+
+static void add_to_summary(eb_source_summary_t* summary, eb_source_state_t state) {
+    summary->sources++;
+    switch (state) {
+    case EB_SOURCE_UNCHANGED:
+        summary->unchanged++;
+        break;
+    case EB_SOURCE_MODIFIED:
+        summary->modified++;
+        break;
+    case EB_SOURCE_MISSING:
+        summary->missing++;
+        break;
+    }
+}
+
+/*
+ * Report sources in order as they finish. The calling thread checks
+ * blocks itself while the next source to report is not done, so failing
+ * to start helpers only costs speed.
+ */
+static void report_sources(status_job_t* job, eb_source_status_visit_fn fn, void* ctx,
+                           eb_source_summary_t* summary) {
+    size_t next = 0;
+    while (next < job->count) {
+        source_entry_t* e = &job->items[next];
+        if (!__atomic_load_n(&e->done, __ATOMIC_ACQUIRE)) {
+            if (run_block(job))
+                continue;
+            pthread_mutex_lock(&job->lock);
+            while (!__atomic_load_n(&e->done, __ATOMIC_ACQUIRE))
+                pthread_cond_wait(&job->progress, &job->lock);
+            pthread_mutex_unlock(&job->lock);
+        }
+
+        add_to_summary(summary, e->state);
+        eb_source_status_t status = {
+            .source = e->source,
+            .model = e->model,
+            .hash = e->hash,
+            .versions = e->versions,
+            .state = e->state,
+            .hashed = e->hashed
+        };
+        next++;
+        if (fn && fn(&status, ctx)) {
+            __atomic_store_n(&job->stop, true, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+}
+
+eb_status_t eb_source_status(const char* root, const eb_source_status_options_t* options,
+                             eb_source_status_visit_fn fn, void* ctx,
+                             eb_source_summary_t* summary) {
+    if (!root)
+        return EB_ERROR_INVALID_INPUT;
+    eb_source_status_options_t defaults = {0};
+    if (!options)
+        options = &defaults;
+    eb_source_summary_t totals = {0};
+
+    // 1. Every tracked (source, model) from the index, read once
+    entry_list_t list = { .model = options->model && *options->model ? options->model : NULL };
+    eb_set_index_t* index = NULL;
+    eb_status_t status = eb_set_index_open_current(root, &index);
+    if (status != EB_SUCCESS)
+        return status;
+    status = eb_set_index_foreach(index, NULL, collect_entry, &list);
+    eb_set_index_close(index);
+    if (status == EB_SUCCESS && list.failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status != EB_SUCCESS) {
+        free_entries(&list);
+        return status;
+    }
+    qsort(list.items, list.count, sizeof(*list.items), compare_entries);
+
+    // 2. Version counts from one sequential pass over the log
+    char* log_path = get_current_set_log_path();
+    if (log_path) {
+        if (eb_log_foreach(log_path, count_version, &list) != EB_SUCCESS)
+            DEBUG_PRINT("eb_source_status: Could not read log %s", log_path);
+        free(log_path);
+    }
+
+    // 3. Hash the sources in parallel, skipping those the stat cache vouches for
+    eb_stat_cache_t* stat_cache = NULL;
+    if (eb_stat_cache_open_current(&stat_cache) != EB_SUCCESS)
+        stat_cache = NULL;
+    status_job_t job = {
+        .root = root,
+        .stat_cache = stat_cache,
+        .items = list.items,
+        .count = list.count,
+        .next_block = 0,
+        .stop = false
+    };
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.progress, NULL);
+
+    eb_task_group_t helpers;
+    eb_task_group_init(&helpers, eb_pool_shared());
+    unsigned wanted = eb_pool_threads(options->threads, (list.count + SOURCE_BLOCK - 1) / SOURCE_BLOCK);
+    for (unsigned i = 1; i < wanted; i++)
+        eb_task_group_spawn(&helpers, status_worker, &job);
+    report_sources(&job, fn, ctx, &totals);
+    eb_task_group_wait(&helpers);
+
+    pthread_cond_destroy(&job.progress);
+    pthread_mutex_destroy(&job.lock);
+    if (stat_cache && eb_stat_cache_save(stat_cache) != EB_SUCCESS)
+        DEBUG_PRINT("eb_source_status: Could not save the stat cache");
+    eb_stat_cache_close(stat_cache);
+    free_entries(&list);
+    if (summary)
+        *summary = totals;
+    return EB_SUCCESS;
+}
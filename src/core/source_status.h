@@ -0,0 +1,78 @@
+/*
+ * EmbeddingBridge - Whole-Set Source Status
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_SOURCE_STATUS_H
+#define EB_SOURCE_STATUS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+
+/*
+ * Checks every source the current set tracks against the file on disk.
+ * The set index and log are each read once into memory; the sources are
+ * then hashed by a pool of workers and reported in (source, model) order
+ * as soon as each prefix of that order is done.
+ *
+ * A source is compared with the source_hash recorded in the .meta sidecar
+ * of its embedding. Embeddings stored before source hashes were recorded
+ * fall back to comparing the file's mtime with the time it was embedded.
+ */
+
+typedef enum {
+    EB_SOURCE_UNCHANGED = 0,    /* Source matches what was embedded */
+    EB_SOURCE_MODIFIED,         /* Source changed since it was embedded */
+    EB_SOURCE_MISSING           /* Source file is gone */
+} eb_source_state_t;
+
+typedef struct {
+    const char* source;
+    const char* model;          /* "" if none was recorded */
+    const char* hash;           /* Current embedding */
+    size_t versions;            /* Log entries for (source, model) */
+    eb_source_state_t state;
+    bool hashed;                /* State comes from the content hash, not the mtime */
+} eb_source_status_t;
+
+typedef struct {
+    size_t sources;             /* (source, model) pairs tracked */
+    size_t unchanged;
+    size_t modified;
+    size_t missing;
+} eb_source_summary_t;
+
+typedef struct {
+    const char* model;          /* Only check this model, NULL for every model */
+    unsigned threads;           /* Worker threads, 0 for one per online CPU */
+} eb_source_status_options_t;
+
+/**
+ * Callback invoked for each tracked source, in (source, model) order
+ *
+ * @return 0 to continue, non-zero to stop; the summary then only covers
+ *         the sources visited
+ */
+typedef int (*eb_source_status_visit_fn)(const eb_source_status_t* status, void* ctx);
+
+/**
+ * Check every source of the current set
+ *
+ * @param root Repository root; relative sources are resolved against it
+ * @param options Optional model filter and parallelism, NULL for defaults
+ * @param fn Optional callback for every source
+ * @param ctx Callback context
+ * @param summary Optional totals
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_source_status(const char* root, const eb_source_status_options_t* options,
+                             eb_source_status_visit_fn fn, void* ctx,
+                             eb_source_summary_t* summary);
+
+#endif /* EB_SOURCE_STATUS_H */
@@ -0,0 +1,315 @@
+/*
+ * EmbeddingBridge - Source File Stat Cache Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "stat_cache.h"
+#include "path_utils.h"
+#include "hash_utils.h"
+#include "store.h"
+#include "counters.h"
+#include "debug.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define STAT_CACHE_MIN_SLOTS 1024
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    char* name;
+    eb_stat_cache_record_t rec;     /* name_offset and name_len are set on save */
+} cache_entry_t;
+
+struct eb_stat_cache {
+    char* path;
+    cache_entry_t* entries;
+    size_t count;
+    size_t capacity;
+    uint32_t* slots;                /* Entry index + 1, 0 for empty */
+    size_t slot_count;              /* Power of two, at least twice count */
+    bool dirty;
+    pthread_mutex_t lock;
+};
+
+static uint64_t name_hash(const char* name) {
+    uint64_t h = FNV_OFFSET;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static uint32_t* find_slot(const eb_stat_cache_t* cache, const char* name) {
+    size_t mask = cache->slot_count - 1;
+    for (size_t i = name_hash(name) & mask;; i = (i + 1) & mask) {
+        uint32_t slot = cache->slots[i];
+        if (!slot || strcmp(cache->entries[slot - 1].name, name) == 0)
+            return &cache->slots[i];
+    }
+}
+
+static bool rehash(eb_stat_cache_t* cache, size_t slot_count) {
+    uint32_t* slots = calloc(slot_count, sizeof(*slots));
+    if (!slots)
+        return false;
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slot_count = slot_count;
+    for (size_t i = 0; i < cache->count; i++)
+        *find_slot(cache, cache->entries[i].name) = (uint32_t)(i + 1);
+    return true;
+}
+
+/* Append an entry; the caller has checked the name is not present */
+static cache_entry_t* add_entry(eb_stat_cache_t* cache, const char* name, size_t name_len) {
+    if ((cache->count + 1) * 2 > cache->slot_count && !rehash(cache, cache->slot_count * 2))
+        return NULL;
+    if (cache->count == cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 256;
+        cache_entry_t* grown = realloc(cache->entries, capacity * sizeof(*grown));
+        if (!grown)
+            return NULL;
+        cache->entries = grown;
+        cache->capacity = capacity;
+    }
+    cache_entry_t* e = &cache->entries[cache->count];
+    memset(e, 0, sizeof(*e));
+    e->name = strndup(name, name_len);
+    if (!e->name)
+        return NULL;
+    *find_slot(cache, e->name) = (uint32_t)(++cache->count);
+    return e;
+}
+
+/* Read a saved cache; anything malformed is dropped and the cache starts empty */
+static void load_records(eb_stat_cache_t* cache) {
+    FILE* f = fopen(cache->path, "rb");
+    if (!f)
+        return;
+
+    eb_stat_cache_header_t header;
+    eb_stat_cache_record_t* recs = NULL;
+    char* names = NULL;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              header.magic == EB_STAT_CACHE_MAGIC && header.version == EB_STAT_CACHE_VERSION &&
+              header.count < UINT32_MAX && header.names_size < ((uint64_t)1 << 32);
+    if (ok) {
+        recs = malloc((header.count ? header.count : 1) * sizeof(*recs));
+        names = malloc(header.names_size ? header.names_size : 1);
+        ok = recs && names &&
+             fread(recs, sizeof(*recs), header.count, f) == header.count &&
+             fread(names, 1, header.names_size, f) == header.names_size;
+    }
+    for (uint64_t i = 0; ok && i < header.count; i++) {
+        const eb_stat_cache_record_t* rec = &recs[i];
+        if (rec->name_len == 0 || rec->name_offset + rec->name_len > header.names_size) {
+            ok = false;
+            break;
+        }
+        cache_entry_t* e = add_entry(cache, names + rec->name_offset, rec->name_len);
+        if (!e) {
+            ok = false;
+            break;
+        }
+        e->rec = *rec;
+    }
+    if (!ok) {
+        DEBUG_PRINT("stat_cache: Ignoring unreadable cache %s", cache->path);
+        for (size_t i = 0; i < cache->count; i++)
+            free(cache->entries[i].name);
+        cache->count = 0;
+        memset(cache->slots, 0, cache->slot_count * sizeof(*cache->slots));
+    }
+    free(recs);
+    free(names);
+    fclose(f);
+}
+
+eb_status_t eb_stat_cache_open(const char* path, eb_stat_cache_t** out) {
+    if (!path || !out)
+        return EB_ERROR_INVALID_INPUT;
+    *out = NULL;
+
+    eb_stat_cache_t* cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    cache->path = strdup(path);
+    cache->slot_count = STAT_CACHE_MIN_SLOTS;
+    cache->slots = calloc(cache->slot_count, sizeof(*cache->slots));
+    if (!cache->path || !cache->slots) {
+        free(cache->path);
+        free(cache->slots);
+        free(cache);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    load_records(cache);
+    *out = cache;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_stat_cache_open_current(eb_stat_cache_t** out) {
+    char* path = get_current_set_stat_cache_path();
+    if (!path)
+        return EB_ERROR_NOT_INITIALIZED;
+    eb_status_t status = eb_stat_cache_open(path, out);
+    free(path);
+    return status;
+}
+
+static int64_t timespec_ns(const struct timespec* ts) {
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void fill_stat(eb_stat_cache_record_t* rec, const struct stat* st) {
+    rec->mtime_ns = timespec_ns(&st->st_mtim);
+    rec->ctime_ns = timespec_ns(&st->st_ctim);
+    rec->size = (uint64_t)st->st_size;
+    rec->ino = (uint64_t)st->st_ino;
+    rec->dev = (uint64_t)st->st_dev;
+}
+
+/* Whether a cached hash still describes the file */
+static bool entry_matches(const eb_stat_cache_record_t* rec, const struct stat* st) {
+    eb_stat_cache_record_t now;
+    fill_stat(&now, st);
+    return rec->mtime_ns == now.mtime_ns && rec->ctime_ns == now.ctime_ns &&
+           rec->size == now.size && rec->ino == now.ino && rec->dev == now.dev &&
+           rec->mtime_ns + EB_STAT_CACHE_RACY_NS < rec->hashed_ns;
+}
+
+eb_status_t eb_stat_cache_hash(eb_stat_cache_t* cache, const char* name, const char* file_path,
+                               char hash_out[65], bool* cached_out) {
+    return eb_stat_cache_hash_with(cache, name, file_path, EB_HASH_SHA256, hash_out, cached_out);
+}
+
+eb_status_t eb_stat_cache_hash_with(eb_stat_cache_t* cache, const char* name, const char* file_path,
+                                    eb_hash_algo_t algo, char hash_out[65], bool* cached_out) {
+    if (!name || !file_path || !hash_out)
+        return EB_ERROR_INVALID_INPUT;
+    if (cached_out)
+        *cached_out = false;
+
+    struct stat st;
+    if (stat(file_path, &st) != 0)
+        return errno == ENOENT || errno == ENOTDIR ? EB_ERROR_NOT_FOUND : EB_ERROR_FILE_IO;
+
+    if (cache) {
+        pthread_mutex_lock(&cache->lock);
+        uint32_t slot = *find_slot(cache, name);
+        bool hit = slot && cache->entries[slot - 1].rec.hash_algo == (uint32_t)algo &&
+                   entry_matches(&cache->entries[slot - 1].rec, &st);
+        if (hit)
+            eb_hash_to_hex(cache->entries[slot - 1].rec.hash, hash_out);
+        pthread_mutex_unlock(&cache->lock);
+        eb_counter_add(hit ? EB_COUNTER_STAT_CACHE_HITS : EB_COUNTER_STAT_CACHE_MISSES, 1);
+        if (hit) {
+            if (cached_out)
+                *cached_out = true;
+            return EB_SUCCESS;
+        }
+    }
+
+    // Take the time before reading, so a write racing the read counts as racy
+    struct timespec before;
+    clock_gettime(CLOCK_REALTIME, &before);
+    eb_status_t status = eb_source_file_hash_with(file_path, algo, hash_out, 65);
+    if (status != EB_SUCCESS || !cache)
+        return status;
+
+    uint8_t hash[32];
+    if (!eb_hex_to_hash(hash_out, hash))
+        return EB_SUCCESS;
+
+    pthread_mutex_lock(&cache->lock);
+    uint32_t slot = *find_slot(cache, name);
+    cache_entry_t* e = slot ? &cache->entries[slot - 1] : add_entry(cache, name, strlen(name));
+    if (e) {
+        fill_stat(&e->rec, &st);
+        memcpy(e->rec.hash, hash, 32);
+        e->rec.hash_algo = (uint32_t)algo;
+        e->rec.hashed_ns = timespec_ns(&before);
+        cache->dirty = true;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_stat_cache_save(eb_stat_cache_t* cache) {
+    if (!cache)
+        return EB_ERROR_INVALID_INPUT;
+    pthread_mutex_lock(&cache->lock);
+    if (!cache->dirty) {
+        pthread_mutex_unlock(&cache->lock);
+        return EB_SUCCESS;
+    }
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", cache->path, (int)getpid());
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        pthread_mutex_unlock(&cache->lock);
+        return EB_ERROR_FILE_IO;
+    }
+
+    eb_stat_cache_header_t header = {0};
+    header.magic = EB_STAT_CACHE_MAGIC;
+    header.version = EB_STAT_CACHE_VERSION;
+    header.count = cache->count;
+    for (size_t i = 0; i < cache->count; i++) {
+        cache_entry_t* e = &cache->entries[i];
+        e->rec.name_offset = header.names_size;
+        e->rec.name_len = (uint32_t)strlen(e->name);
+        header.names_size += e->rec.name_len;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (size_t i = 0; ok && i < cache->count; i++)
+        ok = fwrite(&cache->entries[i].rec, sizeof(cache->entries[i].rec), 1, f) == 1;
+    for (size_t i = 0; ok && i < cache->count; i++) {
+        size_t len = cache->entries[i].rec.name_len;
+        ok = fwrite(cache->entries[i].name, 1, len, f) == len;
+    }
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp, cache->path) != 0) {
+        unlink(tmp);
+        pthread_mutex_unlock(&cache->lock);
+        return EB_ERROR_FILE_IO;
+    }
+    cache->dirty = false;
+    pthread_mutex_unlock(&cache->lock);
+    return EB_SUCCESS;
+}
+
+void eb_stat_cache_close(eb_stat_cache_t* cache) {
+    if (!cache)
+        return;
+    for (size_t i = 0; i < cache->count; i++)
+        free(cache->entries[i].name);
+    free(cache->entries);
+    free(cache->slots);
+    free(cache->path);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
@@ -0,0 +1,115 @@
+/*
+ * EmbeddingBridge - Source File Stat Cache
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_STAT_CACHE_H
+#define EB_STAT_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "status.h"
+#include "types.h"
+
+/*
+ * .embr/sets/<set>/stat-cache remembers the content hash of each source
+ * file together with the stat() fields it had when it was hashed, the
+ * way git's index does, so unchanged sources are not read again:
+ *
+ *   header | records | name table
+ *
+ * A cached hash is used only if mtime, ctime, size, inode and device all
+ * still match. Racy timestamps are handled by also recording when the
+ * file was hashed: a file modified within EB_STAT_CACHE_RACY_NS of that
+ * moment could have changed again without its mtime moving, so it is
+ * hashed again until a later hash lands safely after its mtime.
+ *
+ * The cache is advisory. A missing or damaged file opens empty, and
+ * concurrent writers simply replace each other's saves.
+ */
+
+#define EB_STAT_CACHE_MAGIC   0x45425343  /* "EBSC" */
+#define EB_STAT_CACHE_VERSION 1
+
+/* Modifications this close before hashing leave the entry untrusted */
+#define EB_STAT_CACHE_RACY_NS (2LL * 1000000000LL)
+
+typedef struct {
+    uint32_t magic;         /* EB_STAT_CACHE_MAGIC */
+    uint32_t version;       /* EB_STAT_CACHE_VERSION */
+    uint64_t count;         /* Records */
+    uint64_t names_size;    /* Bytes in the name table */
+    uint64_t reserved[2];
+} eb_stat_cache_header_t;
+
+typedef struct {
+    uint8_t hash[32];       /* Content hash, with hash_algo */
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint64_t size;
+    uint64_t ino;
+    uint64_t dev;
+    int64_t hashed_ns;      /* Wall-clock time the content was read */
+    uint64_t name_offset;   /* Source name in the name table, unterminated */
+    uint32_t name_len;
+    uint32_t hash_algo;     /* eb_hash_algo_t, 0 (SHA-256) in caches older than it */
+} eb_stat_cache_record_t;
+
+typedef struct eb_stat_cache eb_stat_cache_t;
+
+/**
+ * Load a stat cache
+ *
+ * @param path Cache file; a missing or unreadable one opens empty
+ * @param out Receives the cache
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_stat_cache_open(const char* path, eb_stat_cache_t** out);
+
+/**
+ * Load the stat cache of the current set
+ */
+eb_status_t eb_stat_cache_open_current(eb_stat_cache_t** out);
+
+/**
+ * Content hash of a source file, read from disk only if it changed
+ *
+ * Safe to call from several threads on one cache.
+ *
+ * @param cache Cache, NULL to always hash the file
+ * @param name Key the entry is kept under, normally the tracked source path
+ * @param file_path File to stat and hash
+ * @param hash_out Receives the 64-character hex hash
+ * @param cached_out Optional, receives whether the file was not read
+ * @return Status code (0 = success, EB_ERROR_NOT_FOUND if the file is
+ *         missing, EB_ERROR_FILE_IO if it cannot be read)
+ */
+eb_status_t eb_stat_cache_hash(eb_stat_cache_t* cache, const char* name, const char* file_path,
+                               char hash_out[65], bool* cached_out);
+
+/**
+ * Content hash of a source file with a given algorithm
+ *
+ * As eb_stat_cache_hash(), which hashes with SHA-256. An entry cached
+ * under another algorithm is a miss and is replaced.
+ */
+eb_status_t eb_stat_cache_hash_with(eb_stat_cache_t* cache, const char* name, const char* file_path,
+                                    eb_hash_algo_t algo, char hash_out[65], bool* cached_out);
+
+/**
+ * Write the cache back if it changed, through a temporary file and rename
+ */
+eb_status_t eb_stat_cache_save(eb_stat_cache_t* cache);
+
+/**
+ * Free a cache without saving it
+ */
+void eb_stat_cache_close(eb_stat_cache_t* cache);
+
+#endif /* EB_STAT_CACHE_H */
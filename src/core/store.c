@@ -22,91 +22,167 @@
 #include <openssl/sha.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <math.h>
 #include "types.h"
 #include "debug.h"
 #include "store.h"
 #include "compress.h"
 #include "path_utils.h"
+#include "pack.h"
+#include "hash_index.h"
+#include "object_path.h"
+#include "fs.h"
+#include "set_index.h"
+#include "hnsw.h"
+#include "log_index.h"
+#include "set_checkpoint.h"
+#include "object_dict.h"
+#include "shuffle.h"
+#include "object_delta.h"
+#include "quantize.h"
+#include "distance.h"
+#include "embedding_file.h"
+#include "stat_cache.h"
+#include "memory_store.h"
+#include "metadata.h"
+#include "arena.h"
+#include "thread_pool.h"
+#include "blake3.h"
+#include "bloom.h"
+#include "trace.h"
+#include "counters.h"
 
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
 
-#define HASH_TABLE_SIZE 1024
 #define VECTOR_FILE_EXTENSION ".ebv"
 #define METADATA_FILE_EXTENSION ".ebm"
-#define EB_VECTOR_MAGIC 0x4542564D  // "EBVM" in ASCII
 #define MAX_LINE_LEN 2048
 
 /* Forward declarations for internal functions */
-static void hash_data(const float* values, size_t size, uint8_t* hash);
-static void hash_bytes(const unsigned char* data, size_t size, uint8_t* hash);
-static eb_status_t calculate_file_hash(const char* file_path, char* hash_out, size_t hash_size);
+static void hash_data(eb_hash_algo_t algo, const float* values, size_t size, uint8_t* hash);
 static eb_status_t copy_file(const char* src, const char* dst);
 static eb_status_t append_to_history(const char* root, const char* source, const char* hash, const char* provider);
-static eb_status_t create_binary_delta(const char* base_path, const char* new_path, const char* delta_path);
-static eb_status_t apply_binary_delta(const char* base_path, const char* delta_path, const char* output_path);
+static eb_status_t encode_vector(eb_store_t* store, const void* data, size_t size, bool use_dict,
+                                 int level, void** out, size_t* out_size, uint32_t* flags);
 
 /* Function implementations */
-static void hash_data(const float* values, size_t size, uint8_t* hash) {
-    // Convert float values to double (float64) for consistent hashing
-    double* double_values = malloc(size * sizeof(double));
-    if (!double_values) {
-        DEBUG_PRINT("Failed to allocate memory for double conversion\n");
-        // Fallback to float32 if memory allocation fails
-        hash_bytes((const unsigned char*)values, size * sizeof(float), hash);
-        return;
+
+/* float32 values widened per digest update (16 KiB of doubles, whole BLAKE3 chunks) */
+#define HASH_WIDEN_CHUNK 2048
+
+static pthread_key_t digest_key;
+static pthread_once_t digest_once = PTHREAD_ONCE_INIT;
+
+static void digest_ctx_free(void* ctx) {
+    EVP_MD_CTX_free(ctx);
+}
+
+static void digest_key_init(void) {
+    if (pthread_key_create(&digest_key, digest_ctx_free) != 0)
+        DEBUG_ERROR("Failed to create digest context key");
+}
+
+/* A digest in progress; SHA-256 runs on a context owned by the calling thread */
+typedef struct {
+    eb_hash_algo_t algo;
+    EVP_MD_CTX* evp;
+    eb_blake3_t blake3;
+} digest_t;
+
+static bool digest_begin(digest_t* digest, eb_hash_algo_t algo) {
+    digest->algo = algo;
+    if (algo == EB_HASH_BLAKE3) {
+        eb_blake3_init(&digest->blake3);
+        return true;
     }
-    
-    // Convert float32 to float64
-    for (size_t i = 0; i < size; i++) {
-        double_values[i] = (double)values[i];
+
+    pthread_once(&digest_once, digest_key_init);
+
+    EVP_MD_CTX* ctx = pthread_getspecific(digest_key);
+    if (!ctx) {
+        ctx = EVP_MD_CTX_new();
+        if (!ctx) {
+            DEBUG_PRINT("Failed to create EVP context\n");
+            return false;
+        }
+        pthread_setspecific(digest_key, ctx);
     }
-    
-    // Hash the float64 values
-    hash_bytes((const unsigned char*)double_values, size * sizeof(double), hash);
-    
-    // Clean up
-    free(double_values);
+
+    if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
+        DEBUG_PRINT("Failed to initialize digest\n");
+        return false;
+    }
+    digest->evp = ctx;
+    return true;
 }
 
-static void hash_bytes(const unsigned char* data, size_t size, uint8_t* hash) {
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    if (!ctx) {
-        DEBUG_PRINT("Failed to create EVP context\n");
-        return;
+static bool digest_update(digest_t* digest, const void* data, size_t size) {
+    if (digest->algo == EB_HASH_BLAKE3) {
+        eb_blake3_update(&digest->blake3, data, size);
+        return true;
     }
+    return EVP_DigestUpdate(digest->evp, data, size) == 1;
+}
 
-    const EVP_MD* md = EVP_sha256();
-    if (!md) {
-        DEBUG_PRINT("Failed to get SHA256 algorithm\n");
-        EVP_MD_CTX_free(ctx);
+static void digest_end(digest_t* digest, bool ok, uint8_t* hash) {
+    if (ok && digest->algo == EB_HASH_BLAKE3) {
+        eb_blake3_final(&digest->blake3, hash);
         return;
     }
-    
-    if (EVP_DigestInit_ex(ctx, md, NULL) != 1) {
-        DEBUG_PRINT("Failed to initialize digest\n");
-        EVP_MD_CTX_free(ctx);
-        return;
+    unsigned int hash_len;
+    if (!ok || EVP_DigestFinal_ex(digest->evp, hash, &hash_len) != 1) {
+        DEBUG_PRINT("Failed to finalize digest\n");
+        memset(hash, 0, 32);
     }
+}
 
-    if (EVP_DigestUpdate(ctx, data, size) != 1) {
-        DEBUG_PRINT("Failed to update digest\n");
-        EVP_MD_CTX_free(ctx);
+/*
+ * Hash size bytes of float32 data as float64, the canonical form object
+ * IDs are defined over. Values are widened through a small stack buffer
+ * and streamed into the digest; a trailing partial float is hashed as is.
+ */
+static void hash_data(eb_hash_algo_t algo, const float* values, size_t size, uint8_t* hash) {
+    EB_TRACE_SCOPE("hash/object");
+    uint64_t started = eb_counter_clock();
+    digest_t digest;
+    if (!digest_begin(&digest, algo)) {
+        memset(hash, 0, 32);
         return;
     }
 
-    unsigned int hash_len;
-    if (EVP_DigestFinal_ex(ctx, hash, &hash_len) != 1) {
-        DEBUG_PRINT("Failed to finalize digest\n");
+    const unsigned char* bytes = (const unsigned char*)values;
+    size_t count = size / sizeof(float);
+    double chunk[HASH_WIDEN_CHUNK];
+    bool ok = true;
+
+    for (size_t done = 0; ok && done < count; ) {
+        size_t n = count - done < HASH_WIDEN_CHUNK ? count - done : HASH_WIDEN_CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            float f;
+            memcpy(&f, bytes + (done + i) * sizeof(float), sizeof(f));
+            chunk[i] = (double)f;
+        }
+        ok = digest_update(&digest, chunk, n * sizeof(double));
+        done += n;
     }
 
-    EVP_MD_CTX_free(ctx);
+    size_t tail = size % sizeof(float);
+    if (ok && tail)
+        ok = digest_update(&digest, bytes + count * sizeof(float), tail);
+
+    digest_end(&digest, ok, hash);
+    eb_counter_add(EB_COUNTER_HASH_BYTES, size);
+    eb_counter_add_since(EB_COUNTER_HASH_NS, started);
 }
 
 static uint64_t generate_id(const void* data, size_t size) {
     uint8_t hash[32];
-    hash_data((const float*)data, size, hash);
+    hash_data(EB_HASH_SHA256, (const float*)data, size, hash);
     return *(uint64_t*)hash;  // Use first 8 bytes of hash as ID
 }
 
@@ -120,19 +196,503 @@ static char* hash_to_hex(const uint8_t hash[32], char out[65]) {
     return out;
 }
 
+/* Buffer size for an object path below root in either layout */
+static size_t object_path_size(const char* root) {
+    return strlen(root) + 64 + 24;  // Extra space for path components and extension
+}
+
 static char* create_object_path(const char* root, const char* hex_hash) {
-    // Format: <root>/objects/xxxxxxxxxxxx.raw
-    size_t len = strlen(root) + 64 + 20;  // Extra space for path components and extension
+    // Format: <root>/.embr/objects/<hash>.raw or .../<ab>/<cdef...>.raw
+    size_t len = object_path_size(root);
     char* path = malloc(len);
     if (!path) return NULL;
     
     DEBUG_PRINT("create_object_path: root=%s, hex_hash=%s", root, hex_hash);
-    snprintf(path, len, "%s/.embr/objects/%s.raw", root, hex_hash);
+    if (eb_object_path(root, hex_hash, "raw", path, len) != 0) {
+        free(path);
+        return NULL;
+    }
     DEBUG_PRINT("create_object_path: CREATED PATH=%s", path);
     
     return path;
 }
 
+/* Open the repository's packs on first use; call with packs_lock held */
+static eb_pack_set_t* store_packs(eb_store_t* store) {
+    if (!store->packs && eb_pack_open(store->storage_path, &store->packs) != EB_SUCCESS)
+        store->packs = NULL;
+    return store->packs;
+}
+
+/* Drop the cached pack set so packs written by a concurrent repack show up */
+static eb_pack_set_t* store_reload_packs(eb_store_t* store) {
+    eb_pack_close(store->packs);
+    store->packs = NULL;
+    return store_packs(store);
+}
+
+/* Whether a pack holds the object */
+static bool store_packed(eb_store_t* store, const char* hash) {
+    pthread_mutex_lock(&store->packs_lock);
+    bool found = eb_pack_contains(store_packs(store), hash);
+    pthread_mutex_unlock(&store->packs_lock);
+    return found;
+}
+
+/* The object filter, opened on first use; NULL if it could not be */
+static eb_bloom_t* store_filter(eb_store_t* store) {
+    if (__atomic_load_n(&store->filter_opened, __ATOMIC_ACQUIRE))
+        return store->filter;
+    if (!store->storage_path || strcmp(store->storage_path, ":memory:") == 0)
+        return NULL;
+
+    pthread_mutex_lock(&store->packs_lock);
+    if (!store->filter_opened) {
+        if (eb_bloom_open_objects(store->storage_path, store_packs(store), &store->filter) != EB_SUCCESS)
+            store->filter = NULL;
+        __atomic_store_n(&store->filter_opened, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&store->packs_lock);
+    return store->filter;
+}
+
+/* Save the filter with the objects this store added and drop it */
+static void store_close_filter(eb_store_t* store) {
+    if (store->filter && eb_bloom_save_objects(store->storage_path, store->filter) != EB_SUCCESS)
+        DEBUG_PRINT("Failed to save the object filter of %s", store->storage_path);
+    eb_bloom_free(store->filter);
+    store->filter = NULL;
+    store->filter_opened = false;
+}
+
+/*
+ * Move a finished object into place unless one is already there, for
+ * writes that skipped the existence check; returns -1 with errno EEXIST
+ * if the object existed
+ */
+static int install_object(const char* temp_path, const char* obj_path) {
+#ifdef RENAME_NOREPLACE
+    if (renameat2(AT_FDCWD, temp_path, AT_FDCWD, obj_path, RENAME_NOREPLACE) == 0)
+        return 0;
+    if (errno != EINVAL && errno != ENOSYS)
+        return -1;
+#endif
+    // Without renameat2: a hard link fails on an existing name as well
+    if (link(temp_path, obj_path) == 0) {
+        unlink(temp_path);
+        return 0;
+    }
+    if (errno == EEXIST)
+        return -1;
+    return rename(temp_path, obj_path);
+}
+
+/* Map length bytes of fd starting at offset, which need not be page aligned */
+static eb_status_t map_range(int fd, uint64_t offset, uint64_t length, eb_object_view_t* view) {
+    if (length == 0)
+        return EB_SUCCESS;  // Nothing to map, record stays empty
+
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t aligned = offset - offset % page;
+    size_t map_size = (size_t)(length + (offset - aligned));
+    void* base = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, (off_t)aligned);
+    if (base == MAP_FAILED)
+        return EB_ERROR_FILE_IO;
+
+    view->map_base = base;
+    view->map_size = map_size;
+    view->record = (const uint8_t*)base + (offset - aligned);
+    view->record_size = (size_t)length;
+    return EB_SUCCESS;
+}
+
+/* Map a whole loose object file */
+static eb_status_t map_loose_object(const char* path, eb_object_view_t* view) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return EB_ERROR_NOT_FOUND;
+
+    struct stat st;
+    eb_status_t status = fstat(fd, &st) == 0
+        ? map_range(fd, 0, (uint64_t)st.st_size, view)
+        : EB_ERROR_FILE_IO;
+    close(fd);
+    return status;
+}
+
+/* Map a record inside a pack, refusing records past the end of the file */
+static eb_status_t map_packed_object(const eb_pack_set_t* packs, const char* hash,
+                                     eb_object_view_t* view) {
+    int fd;
+    uint64_t offset, length;
+    eb_status_t status = eb_pack_locate(packs, hash, &fd, &offset, &length);
+    if (status != EB_SUCCESS)
+        return status;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || offset + length > (uint64_t)st.st_size) {
+        DEBUG_ERROR("map_packed_object: record of %s lies outside its pack", hash);
+        return EB_ERROR_FILE_IO;
+    }
+    return map_range(fd, offset, length, view);
+}
+
+/* Map the stored record of an object: loose .raw, legacy loose, then packs */
+static eb_status_t map_object_record(eb_store_t* store, const char* hash, eb_object_view_t* view) {
+    char* obj_path = create_object_path(store->storage_path, hash);
+    if (!obj_path) return EB_ERROR_MEMORY_ALLOCATION;
+    eb_status_t status = map_loose_object(obj_path, view);
+    free(obj_path);
+    if (status != EB_ERROR_NOT_FOUND)
+        return status;
+
+    // Legacy path without .raw extension
+    char legacy_path[4096];
+    eb_object_path(store->storage_path, hash, NULL, legacy_path, sizeof(legacy_path));
+    status = map_loose_object(legacy_path, view);
+    if (status != EB_ERROR_NOT_FOUND)
+        return status;
+
+    if (strlen(hash) != 64)
+        return EB_ERROR_NOT_FOUND;
+
+    // Views map the record themselves, so the lock only covers the lookup
+    pthread_mutex_lock(&store->packs_lock);
+    status = map_packed_object(store_packs(store), hash, view);
+    if (status == EB_ERROR_NOT_FOUND || status == EB_ERROR_INVALID_INPUT) {
+        // The loose file may have been packed since we opened the packs
+        status = map_packed_object(store_reload_packs(store), hash, view);
+        if (status == EB_ERROR_INVALID_INPUT)
+            status = EB_ERROR_NOT_FOUND;
+    }
+    pthread_mutex_unlock(&store->packs_lock);
+    return status;
+}
+
+static eb_status_t map_object(eb_store_t* store, const char* hash, uint32_t flags,
+                              eb_object_view_t* view, uint32_t max_depth);
+
+/* Rebuild a delta's vector: XOR its residual with the base it names */
+static eb_status_t apply_delta(eb_store_t* store, const eb_delta_header_t* delta,
+                               eb_object_view_t* view) {
+    char base_hash[65];
+    hash_to_hex(delta->base, base_hash);
+    // The rebuilt vector is verified as a whole, so the base need not be
+    eb_object_view_t base;
+    eb_status_t status = map_object(store, base_hash, EB_OBJECT_MAP_UNVERIFIED, &base, delta->depth - 1);
+    if (status != EB_SUCCESS) {
+        DEBUG_ERROR("Delta base %s is unreadable: %d", base_hash, status);
+        return status == EB_ERROR_NOT_FOUND ? EB_ERROR_INVALID_FORMAT : status;
+    }
+    if (base.size != view->size) {
+        eb_object_unmap(&base);
+        return EB_ERROR_INVALID_FORMAT;
+    }
+
+    if (!view->buffer) {
+        view->buffer = malloc(view->size ? view->size : 1);
+        if (!view->buffer) {
+            eb_object_unmap(&base);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        memcpy(view->buffer, view->data, view->size);
+    }
+    eb_delta_xor(view->buffer, view->buffer, base.data, view->size);
+    view->data = view->buffer;
+    view->delta_depth = delta->depth;
+    eb_object_unmap(&base);
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_object_map(eb_store_t* store, const char* hash, uint32_t flags,
+                          eb_object_view_t* view) {
+    EB_TRACE_SCOPE("store/map_object");
+    eb_status_t status = map_object(store, hash, flags, view, EB_DELTA_MAX_DEPTH);
+    if (status == EB_SUCCESS)
+        eb_counter_add(EB_COUNTER_OBJECTS_READ, 1);
+    return status;
+}
+
+static eb_status_t decode_view(eb_store_t* store, const char* hash, uint32_t flags,
+                               eb_object_view_t* view, uint32_t max_depth);
+
+/* eb_object_map() of an object whose delta chain may be max_depth long */
+static eb_status_t map_object(eb_store_t* store, const char* hash, uint32_t flags,
+                              eb_object_view_t* view, uint32_t max_depth) {
+    if (!store || !hash || !view)
+        return EB_ERROR_INVALID_INPUT;
+    memset(view, 0, sizeof(*view));
+
+    eb_status_t status = map_object_record(store, hash, view);
+    if (status != EB_SUCCESS)
+        return status;
+    return decode_view(store, hash, flags, view, max_depth);
+}
+
+eb_status_t eb_object_view_record(eb_store_t* store, const char* hash, void* record, size_t size,
+                                  uint32_t flags, eb_object_view_t* view) {
+    if (!store || !hash || !view) {
+        free(record);
+        return EB_ERROR_INVALID_INPUT;
+    }
+    memset(view, 0, sizeof(*view));
+    view->record_buffer = record;
+    view->record = record;
+    view->record_size = record ? size : 0;
+    return decode_view(store, hash, flags, view, EB_DELTA_MAX_DEPTH);
+}
+
+/* Decode the stored record a view holds into its payload */
+static eb_status_t decode_view(eb_store_t* store, const char* hash, uint32_t flags,
+                               eb_object_view_t* view, uint32_t max_depth) {
+    (void)hash;  // Only named in debug output
+    eb_status_t status;
+    bool has_header = view->record_size >= sizeof(view->header);
+    if (has_header)
+        memcpy(&view->header, view->record, sizeof(view->header));
+    bool valid = has_header && view->header.magic == EB_VECTOR_MAGIC &&
+                 eb_object_version_valid(view->header.version);
+
+    // Vectors may keep their L2 norm behind the (possibly compressed) payload
+    size_t trailer = 0;
+    view->norm = -1.0f;
+    if (valid && view->header.obj_type == EB_OBJ_VECTOR && (view->header.flags & EB_FLAG_NORM) &&
+        view->record_size >= sizeof(view->header) + sizeof(float)) {
+        trailer = sizeof(float);
+        memcpy(&view->norm, (const uint8_t*)view->record + view->record_size - trailer, trailer);
+    }
+
+    if (flags & EB_OBJECT_MAP_RAW) {
+        if (valid) {
+            view->data = (const uint8_t*)view->record + sizeof(view->header);
+            view->size = view->record_size - sizeof(view->header) - trailer;
+        } else {
+            memset(&view->header, 0, sizeof(view->header));
+            view->data = view->record;
+            view->size = view->record_size;
+        }
+        return EB_SUCCESS;
+    }
+
+    if (!valid) {
+        eb_object_unmap(view);
+        return has_header ? EB_ERROR_INVALID_INPUT : EB_ERROR_FILE_IO;
+    }
+
+    // The (possibly compressed) payload follows the header
+    const uint8_t* payload = (const uint8_t*)view->record + sizeof(view->header);
+    size_t payload_size = view->record_size - sizeof(view->header) - trailer;
+
+    // Deltas name their base between the header and the residual
+    eb_delta_header_t delta;
+    bool is_delta = view->header.obj_type == EB_OBJ_VECTOR && (view->header.flags & EB_FLAG_DELTA);
+    if (is_delta) {
+        if (payload_size < sizeof(delta)) {
+            eb_object_unmap(view);
+            return EB_ERROR_INVALID_FORMAT;
+        }
+        memcpy(&delta, payload, sizeof(delta));
+        // Depths fall towards the keyframe, so a chain cannot loop
+        if (delta.depth == 0 || delta.depth > max_depth) {
+            DEBUG_ERROR("Object %s has a delta chain of depth %u", hash, delta.depth);
+            eb_object_unmap(view);
+            return EB_ERROR_INVALID_FORMAT;
+        }
+        payload += sizeof(delta);
+        payload_size -= sizeof(delta);
+    }
+
+    if (view->header.flags & EB_FLAG_COMPRESSED) {
+        DEBUG_INFO("Decompressing object with ZSTD (original size: %u, compressed size: %zu)",
+                 view->header.size, payload_size);
+        eb_zstd_dict_t* dict = NULL;
+        uint32_t dict_id = view->header.obj_type == EB_OBJ_VECTOR
+            ? EB_FLAG_DICT_ID(view->header.flags) : 0;
+        if (dict_id) {
+            status = eb_object_dict_get(store->storage_path, dict_id, &dict);
+            if (status != EB_SUCCESS) {
+                DEBUG_ERROR("Object %s needs dictionary %u: %d", hash, dict_id, status);
+                eb_object_unmap(view);
+                return status;
+            }
+        }
+        size_t size = 0;
+        status = eb_decompress_zstd_dict(payload, payload_size, &view->buffer, &size, dict);
+        if (status != EB_SUCCESS) {
+            DEBUG_ERROR("Failed to decompress data: %d", status);
+            eb_object_unmap(view);
+            return status;
+        }
+        if (size != view->header.size) {
+            DEBUG_ERROR("Decompressed size mismatch: expected %u, got %zu",
+                      view->header.size, size);
+            eb_object_unmap(view);
+            return EB_ERROR_INVALID_FORMAT;
+        }
+        view->data = view->buffer;
+        view->size = size;
+    } else {
+        view->data = payload;
+        view->size = payload_size;
+    }
+
+    // Undo the byte shuffle applied before compression
+    if (view->header.flags & EB_FLAG_SHUFFLED) {
+        void* plain = malloc(view->size ? view->size : 1);
+        if (!plain) {
+            eb_object_unmap(view);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        eb_unshuffle4(view->data, plain, view->size);
+        free(view->buffer);
+        view->buffer = plain;
+        view->data = plain;
+    }
+
+    if (is_delta) {
+        status = apply_delta(store, &delta, view);
+        if (status != EB_SUCCESS) {
+            eb_object_unmap(view);
+            return status;
+        }
+    }
+
+    // Verify hash for vector objects, with the algorithm each was named by
+    if (view->header.obj_type == EB_OBJ_VECTOR && !(flags & EB_OBJECT_MAP_UNVERIFIED)) {
+        uint8_t computed_hash[32];
+        hash_data(EB_VERSION_HASH(view->header.version), (const float*)view->data, view->size,
+                  computed_hash);
+        if (memcmp(computed_hash, view->header.hash, 32) != 0) {
+            eb_object_unmap(view);
+            return EB_ERROR_HASH_MISMATCH;
+        }
+    }
+
+    return EB_SUCCESS;
+}
+
+void eb_object_unmap(eb_object_view_t* view) {
+    if (!view) return;
+    if (view->map_base)
+        munmap(view->map_base, view->map_size);
+    free(view->record_buffer);
+    free(view->buffer);
+    memset(view, 0, sizeof(*view));
+}
+
+eb_status_t eb_object_vector_ref(const eb_object_view_t* view, eb_vector_ref_t* ref) {
+    if (!view || !ref)
+        return EB_ERROR_INVALID_INPUT;
+    eb_status_t status = eb_vector_ref_init(ref, EB_FLAG_DTYPE(view->header.flags), view->data, view->size);
+    if (status == EB_SUCCESS)
+        ref->norm = view->norm;
+    return status;
+}
+
+/* A new record for a decoded vector, compressed afresh at level (0 for the configured one) */
+static eb_status_t reencode_view(eb_store_t* store, const eb_object_view_t* view, bool use_dict, int level,
+                                 void** out_data, size_t* out_size) {
+    void* compressed = NULL;
+    size_t compressed_size = 0;
+    eb_object_header_t header = view->header;
+    header.flags &= ~(EB_FLAG_COMPRESSED | EB_FLAG_SHUFFLED | EB_FLAG_DICT_MASK | EB_FLAG_DELTA);
+    float norm = view->norm;
+    size_t trailer = (header.flags & EB_FLAG_NORM) ? sizeof(norm) : 0;
+    eb_status_t status = encode_vector(store, view->data, view->size, use_dict, level,
+                                       &compressed, &compressed_size, &header.flags);
+    if (status != EB_SUCCESS)
+        return status;
+
+    uint8_t* record = malloc(sizeof(header) + compressed_size + trailer);
+    if (!record) {
+        free(compressed);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), compressed, compressed_size);
+    memcpy(record + sizeof(header) + compressed_size, &norm, trailer);
+    free(compressed);
+
+    *out_data = record;
+    *out_size = sizeof(header) + compressed_size + trailer;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_object_export(eb_store_t* store, const char* hash, void** out_data, size_t* out_size) {
+    if (!out_data || !out_size)
+        return EB_ERROR_INVALID_INPUT;
+
+    eb_object_view_t view;
+    eb_status_t status = eb_object_map(store, hash, EB_OBJECT_MAP_RAW, &view);
+    if (status != EB_SUCCESS)
+        return status;
+
+    bool self_contained = view.header.magic != EB_VECTOR_MAGIC ||
+                          view.header.obj_type != EB_OBJ_VECTOR ||
+                          (EB_FLAG_DICT_ID(view.header.flags) == 0 &&
+                           !(view.header.flags & EB_FLAG_DELTA));
+    if (self_contained) {
+        // Already self-contained, copy the record as stored
+        *out_data = malloc(view.record_size ? view.record_size : 1);
+        if (!*out_data) {
+            eb_object_unmap(&view);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        memcpy(*out_data, view.record, view.record_size);
+        *out_size = view.record_size;
+        eb_object_unmap(&view);
+        return EB_SUCCESS;
+    }
+    eb_object_unmap(&view);
+
+    // Recompress without the dictionary or delta base, which the receiving side lacks
+    status = eb_object_map(store, hash, 0, &view);
+    if (status != EB_SUCCESS)
+        return status;
+    status = reencode_view(store, &view, false, 0, out_data, out_size);
+    eb_object_unmap(&view);
+    return status;
+}
+
+eb_status_t eb_object_archive(void* store, const char* hash, const void* record, size_t size,
+                              void** out_data, size_t* out_size) {
+    eb_store_t* s = store;
+    if (!s || !hash || !record || !out_data || !out_size)
+        return EB_ERROR_INVALID_INPUT;
+    *out_data = NULL;
+
+    // Only full compressed vectors: deltas are bound to their base, and
+    // uncompressed ones were stored that way to be mapped in place
+    int level = eb_object_archive_level(s->storage_path);
+    const eb_object_header_t* header = record;
+    if (level == 0 || size < sizeof(*header) || header->magic != EB_VECTOR_MAGIC ||
+        header->obj_type != EB_OBJ_VECTOR || !(header->flags & EB_FLAG_COMPRESSED) ||
+        (header->flags & EB_FLAG_DELTA))
+        return EB_SUCCESS;
+
+    void* copy = malloc(size);
+    if (!copy)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    memcpy(copy, record, size);
+    eb_object_view_t view;
+    eb_status_t status = eb_object_view_record(s, hash, copy, size, 0, &view);
+    if (status != EB_SUCCESS)
+        return status;
+    void* rewritten = NULL;
+    size_t rewritten_size = 0;
+    status = reencode_view(s, &view, true, level, &rewritten, &rewritten_size);
+    eb_object_unmap(&view);
+    if (status != EB_SUCCESS)
+        return status;
+
+    if (rewritten_size >= size) {
+        free(rewritten);
+        return EB_SUCCESS;
+    }
+    *out_data = rewritten;
+    *out_size = rewritten_size;
+    return EB_SUCCESS;
+}
+
 static eb_status_t check_directories(const char* root) {
     char path[4096];
     struct stat st;
@@ -210,16 +770,13 @@ eb_status_t eb_store_init(const eb_store_config_t* config, eb_store_t** out) {
         return EB_ERROR_MEMORY_ALLOCATION;
     }
     
-    // Initialize hash table
-    store->vectors = calloc(HASH_TABLE_SIZE, sizeof(eb_stored_vector_t));
-    if (!store->vectors) {
-        DEBUG_PRINT("DEBUG: Failed to allocate hash table\n");
-        free(store->storage_path);
-        free(store);
-        return EB_ERROR_MEMORY_ALLOCATION;
-    }
-    
+    store->memory = NULL;
     store->vector_count = 0;
+    store->packs = NULL;
+    store->defer_sync = false;
+    store->filter = NULL;
+    store->filter_opened = false;
+    pthread_mutex_init(&store->packs_lock, NULL);
     *out = store;
     DEBUG_PRINT("DEBUG: Store initialized successfully\n");
     return EB_SUCCESS;
@@ -228,33 +785,11 @@ eb_status_t eb_store_init(const eb_store_config_t* config, eb_store_t** out) {
 eb_status_t eb_store_destroy(eb_store_t* store) {
     if (!store) return EB_SUCCESS;
     
-    // Free all stored vectors
-    for (size_t i = 0; i < HASH_TABLE_SIZE; i++) {
-        eb_stored_vector_t* current = &store->vectors[i];
-        while (current) {
-            eb_stored_vector_t* next = current->next;
-            eb_destroy_embedding(current->embedding);
-            
-            // Free metadata
-            eb_metadata_t* meta = current->metadata;
-            while (meta) {
-                eb_metadata_t* next_meta = meta->next;
-                free(meta->key);
-                free(meta->value);
-                free(meta);
-                meta = next_meta;
-            }
-            
-            free(current->model_version);
-            if (current != &store->vectors[i]) {
-                free(current);
-            }
-            current = next;
-        }
-    }
-    
+    eb_memory_table_destroy(store->memory);
+    store_close_filter(store);
+    eb_pack_close(store->packs);
+    pthread_mutex_destroy(&store->packs_lock);
     free(store->storage_path);
-    free(store->vectors);
     free(store);
     return EB_SUCCESS;
 }
@@ -262,7 +797,9 @@ eb_status_t eb_store_destroy(eb_store_t* store) {
 void eb_destroy_stored_vectors(eb_stored_vector_t* versions, size_t count) {
     if (!versions) return;
     
-    for (size_t i = 0; i < count; i++) {
+    // A query result keeps its strings and metadata in one arena
+    eb_arena_t* arena = count ? versions[0].arena : NULL;
+    for (size_t i = 0; i < count && !arena; i++) {
         eb_stored_vector_t* version = &versions[i];
         
         // Don't free the embedding or metadata as they're owned by the store
@@ -270,47 +807,203 @@ void eb_destroy_stored_vectors(eb_stored_vector_t* versions, size_t count) {
         free(version->model_version);
     }
     
+    eb_arena_free(arena);
     free(versions);
 }
 
 /* Write object to temporary file, then move to final location */
+/*
+ * Compress a vector payload with the repository's storage settings: the
+ * optional byte shuffle, level (0 for the configured or, under
+ * storage.compression = auto, the tuned one) and, if allowed, the current
+ * dictionary. The matching flags are added to *flags.
+ */
+static eb_status_t encode_vector(eb_store_t* store, const void* data, size_t size, bool use_dict,
+                                 int level, void** out, size_t* out_size, uint32_t* flags) {
+    uint32_t dict_id = use_dict ? eb_object_dictionary(store->storage_path) : 0;
+    eb_zstd_dict_t* dict = NULL;
+    if (dict_id && eb_object_dict_get(store->storage_path, dict_id, &dict) != EB_SUCCESS) {
+        DEBUG_WARN("Dictionary %u is unavailable, compressing without it", dict_id);
+        dict_id = 0;
+    }
+
+    // The shuffle filter is laid out for float32; reduced dtypes skip it
+    void* shuffled = NULL;
+    if (eb_object_shuffle(store->storage_path) && EB_FLAG_DTYPE(*flags) == EB_FLOAT32) {
+        shuffled = malloc(size ? size : 1);
+        if (!shuffled)
+            return EB_ERROR_MEMORY_ALLOCATION;
+        eb_shuffle4(data, shuffled, size);
+    }
+
+    eb_compress_bounds_t bounds;
+    bool tune = level == 0 && eb_object_compression_auto(store->storage_path, &bounds);
+    if (level == 0)
+        level = tune ? eb_compress_tune_level(&bounds) : eb_object_compression_level(store->storage_path);
+    struct timespec start, end;
+    if (tune)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    eb_status_t status = eb_compress_zstd_dict(shuffled ? shuffled : data, size, out, out_size, level, dict);
+    if (tune && status == EB_SUCCESS) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        uint64_t nanos = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+                         (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+        eb_compress_tune_record(&bounds, level, size, *out_size, nanos);
+    }
+    free(shuffled);
+    if (status != EB_SUCCESS)
+        return status;
+
+    *flags |= EB_FLAG_COMPRESSED | (dict_id << EB_FLAG_DICT_SHIFT);
+    if (shuffled)
+        *flags |= EB_FLAG_SHUFFLED;
+    return EB_SUCCESS;
+}
+
+/* Values within this distance of unit norm are flagged EB_FLAG_NORMALIZED */
+#define UNIT_NORM_TOLERANCE 1e-4f
+
+/*
+ * L2 norm of a vector payload as it will be stored, for EB_FLAG_NORM.
+ * Payloads that are not a readable vector get none.
+ */
+static bool payload_norm(const void* data, size_t size, uint32_t flags, float* out) {
+    eb_vector_ref_t ref;
+    if (eb_vector_ref_init(&ref, EB_FLAG_DTYPE(flags), data, size) != EB_SUCCESS || ref.dims == 0)
+        return false;
+    *out = eb_vector_norm(&ref);
+    return isfinite(*out);
+}
+
+/*
+ * The hash the current set holds for source and model, the base its next
+ * version may be stored against. *index is opened on first use.
+ */
+static const char* delta_base(const char* root, eb_set_index_t** index, const char* source,
+                              const char* model, char out[65]) {
+    if (!source || !eb_object_delta(root))
+        return NULL;
+    if (!*index && eb_set_index_open_current(root, index) != EB_SUCCESS) {
+        *index = NULL;
+        return NULL;
+    }
+    return eb_set_index_lookup(*index, source, model, out) == EB_SUCCESS ? out : NULL;
+}
+
+/*
+ * Compress a vector as its XOR with base_hash (object_delta.h). Fails if
+ * the base is not a vector of the same size and dtype, or if its chain is
+ * already as long as allowed.
+ */
+static eb_status_t encode_delta(eb_store_t* store, const void* data, size_t size, const char* base_hash,
+                                eb_delta_header_t* delta, void** out, size_t* out_size, uint32_t* flags) {
+    eb_object_view_t base;
+    eb_status_t status = eb_object_map(store, base_hash, 0, &base);
+    if (status != EB_SUCCESS)
+        return status;
+    if (base.header.obj_type != EB_OBJ_VECTOR || base.size != size ||
+        EB_FLAG_DTYPE(base.header.flags) != EB_FLAG_DTYPE(*flags) ||
+        base.delta_depth >= EB_DELTA_MAX_DEPTH) {
+        eb_object_unmap(&base);
+        return EB_ERROR_INVALID_INPUT;
+    }
+
+    void* residual = malloc(size ? size : 1);
+    if (!residual) {
+        eb_object_unmap(&base);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    eb_delta_xor(residual, data, base.data, size);
+    memset(delta, 0, sizeof(*delta));
+    memcpy(delta->base, base.header.hash, sizeof(delta->base));
+    delta->depth = base.delta_depth + 1;
+    eb_object_unmap(&base);
+
+    // No dictionary: it was trained on vectors, not residuals
+    status = encode_vector(store, residual, size, false, 0, out, out_size, flags);
+    free(residual);
+    if (status == EB_SUCCESS)
+        *flags |= EB_FLAG_DELTA;
+    return status;
+}
+
+/*
+ * Write an object unless it exists. base_hash, if not NULL, is the
+ * previous version of the same file and model, which a vector may be
+ * stored as a delta against.
+ */
+/* Whether each object is flushed as it is written (see eb_object_durability()) */
+static bool sync_each_object(const eb_store_t* store) {
+    eb_durability_t durability = eb_object_durability(store->storage_path);
+    return durability == EB_DURABILITY_STRICT ||
+           (durability == EB_DURABILITY_GROUP && !store->defer_sync);
+}
+
 static eb_status_t write_object(
     eb_store_t* store,
     const void* data,
     size_t size,
     uint32_t obj_type,
     uint32_t flags,
+    const char* base_hash,
     char out_hash[65]
 ) {
+    EB_TRACE_SCOPE("store/write_object");
+    eb_hash_algo_t algo = eb_object_hash(store->storage_path);
     uint8_t hash[32];
-    hash_data((const float*)data, size, hash);
+    hash_data(algo, (const float*)data, size, hash);
     hash_to_hex(hash, out_hash);
     
-    // Create temporary file path
+    // Create temporary file path, unique to this write: threads and
+    // processes storing the same vector at once must not share it
+    static unsigned temp_serial;
     char temp_path[4096];
-    snprintf(temp_path, sizeof(temp_path), "%s/.embr/objects/temp/tmp-%s",
-             store->storage_path, out_hash);
+    snprintf(temp_path, sizeof(temp_path), "%s/.embr/objects/temp/tmp-%s-%d-%u",
+             store->storage_path, out_hash, (int)getpid(),
+             __atomic_fetch_add(&temp_serial, 1, __ATOMIC_RELAXED));
              
+    // A filter miss means the object is new, so it is not looked for on
+    // disk; it is installed without replacing one that turns out to exist
+    eb_bloom_t* filter = store_filter(store);
+    bool maybe_stored = !filter || eb_bloom_maybe(filter, hash);
+
     // Create final object path
-    char* obj_path = create_object_path(store->storage_path, out_hash);
+    char* obj_path = maybe_stored ? create_object_path(store->storage_path, out_hash)
+                                  : malloc(object_path_size(store->storage_path));
     if (!obj_path) return EB_ERROR_MEMORY_ALLOCATION;
     
-    // Check if object already exists
+    // Check if object already exists (in either layout). Touch it so an
+    // incremental gc that listed it before this store no longer expires it
     struct stat st;
-    if (stat(obj_path, &st) == 0) {
+    if (maybe_stored && stat(obj_path, &st) == 0) {
+        if (utimensat(AT_FDCWD, obj_path, NULL, 0) != 0)
+            DEBUG_PRINT("write_object: Failed to refresh mtime of %s", obj_path);
         free(obj_path);
         return EB_SUCCESS;  // Object already exists
     }
+    if (store_packed(store, out_hash)) {
+        eb_bloom_add(filter, hash);
+        free(obj_path);
+        return EB_SUCCESS;  // Object already packed
+    }
     
-    // Compress the data with ZSTD level 9
+    // Vectors keep their norm so cosine comparisons only need the dot product
+    float norm = 0.0f;
+    bool has_norm = obj_type == EB_OBJ_VECTOR && payload_norm(data, size, flags, &norm);
+    if (has_norm) {
+        flags |= EB_FLAG_NORM;
+        if (fabsf(norm - 1.0f) <= UNIT_NORM_TOLERANCE)
+            flags |= EB_FLAG_NORMALIZED;
+    }
+
+    // Compress vector data with ZSTD unless storage.compression is off
     void* compressed_data = NULL;
     size_t compressed_size = 0;
-    eb_status_t compress_result = EB_SUCCESS;
+    bool compress = obj_type == EB_OBJ_VECTOR && eb_object_compression(store->storage_path);
     
-    if (obj_type == EB_OBJ_VECTOR) {
-        // Only compress vector data, not metadata
-        compress_result = eb_compress_zstd(data, size, &compressed_data, &compressed_size, 9);
-        
+    if (compress) {
+        eb_status_t compress_result = encode_vector(store, data, size, true, 0,
+                                                    &compressed_data, &compressed_size, &flags);
         if (compress_result != EB_SUCCESS) {
             DEBUG_ERROR("Failed to compress vector data: %d", compress_result);
             free(obj_path);
@@ -319,19 +1012,38 @@ static eb_status_t write_object(
         
         DEBUG_INFO("Compressed vector data from %zu to %zu bytes (ratio: %.2f%%)",
                  size, compressed_size, (double)compressed_size * 100.0 / (double)size);
-        
-        // Set the compressed flag
-        flags |= EB_FLAG_COMPRESSED;
     } else {
-        // For non-vector data, just use as-is
+        // Metadata and uncompressed vectors are stored as-is
         compressed_data = (void*)data;
         compressed_size = size;
     }
     
+    // A residual against the previous version, if that is smaller
+    eb_delta_header_t delta;
+    bool is_delta = false;
+    if (compress && base_hash && strcmp(base_hash, out_hash) != 0 && eb_object_delta(store->storage_path)) {
+        void* residual = NULL;
+        size_t residual_size = 0;
+        uint32_t delta_flags = flags & ~(EB_FLAG_COMPRESSED | EB_FLAG_SHUFFLED | EB_FLAG_DICT_MASK);
+        if (encode_delta(store, data, size, base_hash, &delta, &residual, &residual_size,
+                         &delta_flags) == EB_SUCCESS &&
+            residual_size + sizeof(delta) < compressed_size) {
+            DEBUG_INFO("Stored as a delta of depth %u: %zu instead of %zu bytes",
+                       delta.depth, residual_size + sizeof(delta), compressed_size);
+            free(compressed_data);
+            compressed_data = residual;
+            compressed_size = residual_size;
+            flags = delta_flags;
+            is_delta = true;
+        } else {
+            free(residual);
+        }
+    }
+
     // Create object header
     eb_object_header_t header = {
         .magic = EB_VECTOR_MAGIC,
-        .version = EB_VERSION,
+        .version = EB_OBJECT_VERSION(algo),
         .obj_type = obj_type,
         .flags = flags,
         .size = size  // Store original size for decompression
@@ -341,17 +1053,22 @@ static eb_status_t write_object(
     // Write to temporary file
     FILE* fp = fopen(temp_path, "wb");
     if (!fp) {
-        if (obj_type == EB_OBJ_VECTOR) free(compressed_data);
+        if (compress) free(compressed_data);
         free(obj_path);
         return EB_ERROR_FILE_IO;
     }
     
-    // Write header and compressed data
+    // Write header, delta base, compressed data and the norm, flushed
+    // before the rename when objects are synced one by one
+    bool sync = sync_each_object(store);
     if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
-        fwrite(compressed_data, compressed_size, 1, fp) != 1) {
+        (is_delta && fwrite(&delta, sizeof(delta), 1, fp) != 1) ||
+        fwrite(compressed_data, compressed_size, 1, fp) != 1 ||
+        (has_norm && fwrite(&norm, sizeof(norm), 1, fp) != 1) ||
+        (sync && (fflush(fp) != 0 || fdatasync(fileno(fp)) != 0))) {
         fclose(fp);
         unlink(temp_path);
-        if (obj_type == EB_OBJ_VECTOR) free(compressed_data);
+        if (compress) free(compressed_data);
         free(obj_path);
         return EB_ERROR_FILE_IO;
     }
@@ -359,7 +1076,7 @@ static eb_status_t write_object(
     fclose(fp);
     
     // Free compressed data if we allocated it
-    if (obj_type == EB_OBJ_VECTOR) free(compressed_data);
+    if (compress) free(compressed_data);
     
     // Create directory if needed
     char dir_path[4096];
@@ -372,13 +1089,31 @@ static eb_status_t write_object(
     // Ensure the parent directory exists
     mkdir(dir_path, 0755);
     #endif
+
+    // New objects always go to the configured layout
+    if (eb_object_write_path(store->storage_path, out_hash, "raw", obj_path,
+                             object_path_size(store->storage_path)) != 0) {
+        free(obj_path);
+        unlink(temp_path);
+        return EB_ERROR_FILE_IO;
+    }
     
     // Move to final location (atomic operation)
     DEBUG_PRINT("write_object: Attempting to rename '%s' to '%s'", temp_path, obj_path);
     
-    if (rename(temp_path, obj_path) != 0) {
-        DEBUG_ERROR("write_object: rename failed with errno=%d: %s", errno, strerror(errno));
-        
+    int installed = maybe_stored ? rename(temp_path, obj_path) : install_object(temp_path, obj_path);
+    if (installed != 0 && !maybe_stored && errno == EEXIST) {
+        // The filter was behind, the object arrived some other way
+        unlink(temp_path);
+        if (utimensat(AT_FDCWD, obj_path, NULL, 0) != 0)
+            DEBUG_PRINT("write_object: Failed to refresh mtime of %s", obj_path);
+        eb_bloom_add(filter, hash);
+        free(obj_path);
+        return EB_SUCCESS;
+    }
+    if (installed != 0) {
+        DEBUG_ERROR("write_object: rename failed with errno=%d: %s", errno, strerror(errno));
+        
         /* Additional diagnostics */
         DEBUG_PRINT("write_object: Checking if source exists");
         struct stat st_src;
@@ -408,8 +1143,30 @@ static eb_status_t write_object(
         free(obj_path);
         return EB_ERROR_FILE_IO;
     }
+
+    // A delta is recorded once it is in place, so a write that failed or
+    // found the object stored leaves no record. Meanwhile its base is
+    // still referenced by the set, as the version this one replaces
+    if (is_delta && eb_delta_record(store->storage_path, out_hash, base_hash) != EB_SUCCESS) {
+        // Unrecorded, gc would not keep its base for it
+        unlink(obj_path);
+        free(obj_path);
+        return EB_ERROR_FILE_IO;
+    }
+    eb_bloom_add(filter, hash);
+
+    // And the directory, so the new name survives a crash too
+    if (sync) {
+        char* slash = strrchr(obj_path, '/');
+        *slash = '\0';
+        if (eb_fs_sync_dir(obj_path) != EB_SUCCESS) {
+            free(obj_path);
+            return EB_ERROR_FILE_IO;
+        }
+    }
     
     free(obj_path);
+    eb_counter_add(EB_COUNTER_OBJECTS_WRITTEN, 1);
     return EB_SUCCESS;
 }
 
@@ -418,9 +1175,9 @@ static eb_status_t append_to_history(const char* root, const char* source, const
     // Use per-set log file instead of global log
     char* log_path = get_current_set_log_path();
     // Create history file if it doesn't exist
-    FILE* f = fopen(log_path, "a+");
-    free(log_path);
+    FILE* f = log_path ? fopen(log_path, "a+") : NULL;
     if (!f) {
+        free(log_path);
         return EB_ERROR_FILE_IO;
     }
 
@@ -434,6 +1191,13 @@ static eb_status_t append_to_history(const char* root, const char* source, const
     fprintf(f, "%ld %s %s %s\n", now, hash, source, provider ? provider : "openai");
     fclose(f);
 
+    /* The side index is a cache; readers catch it up if this fails */
+    if (eb_log_index_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("append_to_history: Failed to update log index for %s", log_path);
+    if (eb_checkpoint_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("append_to_history: Failed to checkpoint %s", log_path);
+    free(log_path);
+
     return EB_SUCCESS;
 }
 
@@ -463,21 +1227,9 @@ eb_status_t eb_store_vector(
     
     // Generate ID from data
     uint8_t hash[32];
-    hash_data(embedding->values, data_size, hash);
+    hash_data(eb_object_hash(store->storage_path), embedding->values, data_size, hash);
     *out_id = *(uint64_t*)hash;  // Use first 8 bytes as ID
     
-    // Write vector object
-    char hex_hash[65];
-    eb_status_t status = write_object(
-        store,
-        embedding->values,
-        data_size,
-        EB_OBJ_VECTOR,
-        embedding->normalize ? 0x01 : 0x00,
-        hex_hash
-    );
-    if (status != EB_SUCCESS) return status;
-    
     // Find source file from metadata
     const char* source_file = NULL;
     const eb_metadata_t* meta = metadata;
@@ -489,6 +1241,23 @@ eb_status_t eb_store_vector(
         meta = meta->next;
     }
 
+    // Write vector object, possibly as a delta of the file's previous version
+    char hex_hash[65];
+    char base_hash[65];
+    eb_set_index_t* index = NULL;
+    const char* base = delta_base(store->storage_path, &index, source_file, model_version, base_hash);
+    eb_set_index_close(index);
+    eb_status_t status = write_object(
+        store,
+        embedding->values,
+        data_size,
+        EB_OBJ_VECTOR,
+        0,  // Norm flags are set from the values
+        base,
+        hex_hash
+    );
+    if (status != EB_SUCCESS) return status;
+
     // Create new metadata with source if not present
     eb_metadata_t* new_metadata = NULL;
     if (metadata) {
@@ -550,41 +1319,15 @@ eb_status_t eb_store_vector(
         }
         
         // Then update index (overwrite mode to keep only latest)
-        // Use per-set index file instead of global index
-        char* index_path = get_current_set_index_path();
-        
-        // Read current index
-        FILE* f = fopen(index_path, "r");
-        char** lines = NULL;
-        size_t line_count = 0;
-        if (f) {
-            char line[PATH_MAX + 65];
-            while (fgets(line, sizeof(line), f)) {
-                // Skip the line with our source file
-                if (strstr(line, source_file) == NULL) {
-                    lines = realloc(lines, (line_count + 1) * sizeof(char*));
-                    lines[line_count] = strdup(line);
-                    line_count++;
-                }
-            }
-            fclose(f);
-        }
-        
-        // Write updated index
-        f = fopen(index_path, "w");
-        if (f) {
-            // Write existing lines
-            for (size_t i = 0; i < line_count; i++) {
-                fprintf(f, "%s", lines[i]);
-                free(lines[i]);
-            }
-            free(lines);
-            
-            // Write new entry
-            fprintf(f, "%s %s\n", source_file, hex_hash);
-            fclose(f);
+        eb_set_index_change_t changes[] = {
+            { source_file, NULL, NULL },
+            { source_file, model_version, hex_hash }
+        };
+        if (eb_set_index_apply_current(store->storage_path, changes, 2) != EB_SUCCESS) {
+            fprintf(stderr, "warning: failed to update index\n");
+        } else if (eb_hnsw_apply(store->storage_path, changes, 2) != EB_SUCCESS) {
+            fprintf(stderr, "warning: failed to update vector index, run 'embr index build'\n");
         }
-        free(index_path);
     }
     
     eb_metadata_destroy(new_metadata);
@@ -599,133 +1342,29 @@ eb_status_t read_object(
     size_t* out_size,
     eb_object_header_t* out_header
 ) {
-    char* obj_path = create_object_path(store->storage_path, hash);
-    if (!obj_path) return EB_ERROR_MEMORY_ALLOCATION;
-    
-    FILE* fp = fopen(obj_path, "rb");
-    
-    // If opening with .raw extension fails, try without extension (for backwards compatibility)
-    if (!fp) {
-        // Create legacy path without .raw extension
-        free(obj_path);
-        size_t len = strlen(store->storage_path) + 64 + 20;
-        obj_path = malloc(len);
-        if (!obj_path) return EB_ERROR_MEMORY_ALLOCATION;
-        
-        snprintf(obj_path, len, "%s/.embr/objects/%s", store->storage_path, hash);
-        fp = fopen(obj_path, "rb");
-        
-        if (!fp) {
-            free(obj_path);
-            return EB_ERROR_NOT_FOUND;
-        }
-    }
-    
-    // Read and validate header
-    eb_object_header_t header;
-    if (fread(&header, sizeof(header), 1, fp) != 1) {
-        fclose(fp);
-        free(obj_path);
-        return EB_ERROR_FILE_IO;
-    }
-    
-    // Validate magic and version
-    if (header.magic != EB_VECTOR_MAGIC || header.version > EB_VERSION) {
-        fclose(fp);
-        free(obj_path);
-        return EB_ERROR_INVALID_INPUT;
-    }
-    
-    // Determine how much to read - we need to find the file size for compressed data
-    size_t file_size = 0;
-    size_t data_size = 0;
-    
-    // Get the file size
-    fseek(fp, 0, SEEK_END);
-    file_size = ftell(fp);
-    fseek(fp, sizeof(header), SEEK_SET);
-    
-    // Calculate the compressed data size (file size minus header size)
-    data_size = file_size - sizeof(header);
-    
-    // Allocate and read the (possibly compressed) data
-    void* raw_data = malloc(data_size);
-    if (!raw_data) {
-        fclose(fp);
-        free(obj_path);
-        return EB_ERROR_MEMORY_ALLOCATION;
-    }
-    
-    if (fread(raw_data, data_size, 1, fp) != 1) {
-        free(raw_data);
-        fclose(fp);
-        free(obj_path);
-        return EB_ERROR_FILE_IO;
-    }
-    
-    fclose(fp);
-    free(obj_path);
-    
-    // Check if the data is compressed (for backward compatibility)
-    void* final_data = NULL;
-    size_t final_size = 0;
-    eb_status_t status = EB_SUCCESS;
-    
-    if (header.flags & EB_FLAG_COMPRESSED) {
-        DEBUG_INFO("Decompressing object with ZSTD (original size: %zu, compressed size: %zu)", 
-                 header.size, data_size);
-        
-        // Decompress the data
-        status = eb_decompress_zstd(raw_data, data_size, &final_data, &final_size);
-        free(raw_data); // free the compressed data
-        
-        if (status != EB_SUCCESS) {
-            DEBUG_ERROR("Failed to decompress data: %d", status);
-            return status;
-        }
-        
-        // Verify that we got the expected size
-        if (final_size != header.size) {
-            DEBUG_ERROR("Decompressed size mismatch: expected %zu, got %zu", 
-                      header.size, final_size);
-            free(final_data);
-            return EB_ERROR_INVALID_FORMAT;
-        }
-        
-        // Debug the decompressed data
-        if (final_size >= 16) {
-            DEBUG_INFO("First 16 bytes of decompressed data:");
-            char debug_buf[100];
-            for (int i = 0; i < 16; i++) {
-                sprintf(debug_buf + (i*3), "%02x ", ((unsigned char*)final_data)[i]);
-            }
-            DEBUG_INFO("%s", debug_buf);
-            
-            // Check if it might be a binary embedding with dimension header
-            uint32_t possible_dims;
-            memcpy(&possible_dims, final_data, sizeof(uint32_t));
-            DEBUG_INFO("First 4 bytes as uint32: %u (0x%08x)", possible_dims, possible_dims);
-        }
+    EB_TRACE_SCOPE("store/read_object");
+    eb_object_view_t view;
+    eb_status_t status = eb_object_map(store, hash, 0, &view);
+    if (status != EB_SUCCESS)
+        return status;
+
+    // Decompressed payloads are already private; mapped ones are copied once
+    void* data = view.buffer;
+    if (data) {
+        view.buffer = NULL;
     } else {
-        // Data is not compressed, just use raw_data
-        final_data = raw_data;
-        final_size = data_size;
-    }
-    
-    // Verify hash for vector objects
-    if (header.obj_type == EB_OBJ_VECTOR) {
-        uint8_t computed_hash[32];
-        hash_data((const float*)final_data, final_size, computed_hash);
-        if (memcmp(computed_hash, header.hash, 32) != 0) {
-            free(final_data);
-            return EB_ERROR_HASH_MISMATCH;
+        data = malloc(view.size ? view.size : 1);
+        if (!data) {
+            eb_object_unmap(&view);
+            return EB_ERROR_MEMORY_ALLOCATION;
         }
+        memcpy(data, view.data, view.size);
     }
-    
-    *out_data = final_data;
-    *out_size = final_size;
-    *out_header = header;
-    
+
+    *out_data = data;
+    *out_size = view.size;
+    *out_header = view.header;
+    eb_object_unmap(&view);
     return EB_SUCCESS;
 }
 
@@ -761,13 +1400,21 @@ eb_status_t eb_get_vector(
     eb_status_t status = read_object(store, hex_hash, &data, &size, &header);
     if (status != EB_SUCCESS) return status;
     
-    // Create embedding from data
+    // Create embedding from data, widening reduced dtypes to float
+    eb_dtype_t dtype = EB_FLAG_DTYPE(header.flags);
+    size_t value_size = eb_get_dtype_size(dtype);
+    size_t dims = 0;
+    if (dtype == EB_INT8) {
+        dims = size > sizeof(float) ? size - sizeof(float) : 0;  // Scale comes first
+    } else if (value_size) {
+        dims = size / value_size;
+    }
     status = eb_create_embedding(
         data,
-        size / sizeof(float),  // Calculate dimensions from size
+        dims,
         1,  // Single vector
-        EB_FLOAT32,  // Always stored as float32
-        header.flags & 0x01,  // Normalize flag
+        dtype,
+        (header.flags & EB_FLAG_NORMALIZED) != 0,
         out_embedding
     );
     
@@ -799,25 +1446,17 @@ eb_status_t eb_get_vector_evolution(
         return EB_ERROR_INVALID_INPUT;
     }
     
-    size_t index = vector_id % HASH_TABLE_SIZE;
-    eb_stored_vector_t* current = &store->vectors[index];
-    
-    // Find the vector
-    while (current && current->id != vector_id) {
-        current = current->next;
-    }
-    
-    if (!current) return EB_ERROR_NOT_FOUND;
+    uint32_t newest = eb_memory_table_find(store->memory, vector_id);
+    if (newest == EB_MEMORY_NO_ROW) return EB_ERROR_NOT_FOUND;
     
     // Count versions in time range
+    const uint64_t* timestamps = eb_memory_table_timestamps(store->memory);
     size_t version_count = 0;
-    eb_stored_vector_t* version = current;
-    while (version) {
-        if (version->timestamp >= from_time && 
-            version->timestamp <= to_time) {
+    for (uint32_t row = newest; row != EB_MEMORY_NO_ROW;
+         row = eb_memory_table_prev(store->memory, row)) {
+        if (timestamps[row] >= from_time && timestamps[row] <= to_time) {
             version_count++;
         }
-        version = version->next;
     }
     
     if (version_count == 0) {
@@ -830,15 +1469,14 @@ eb_status_t eb_get_vector_evolution(
     eb_stored_vector_t* versions = malloc(version_count * sizeof(eb_stored_vector_t));
     if (!versions) return EB_ERROR_MEMORY_ALLOCATION;
     
-    // Copy versions in time range
-    size_t i = 0;
-    version = current;
-    while (version && i < version_count) {
-        if (version->timestamp >= from_time && 
-            version->timestamp <= to_time) {
-            versions[i++] = *version;
+    // Copy versions in time range, oldest first
+    size_t i = version_count;
+    for (uint32_t row = newest; row != EB_MEMORY_NO_ROW;
+         row = eb_memory_table_prev(store->memory, row)) {
+        if (timestamps[row] >= from_time && timestamps[row] <= to_time) {
+            eb_memory_table_row(store->memory, row, &versions[--i]);
+            versions[i].model_version = strdup(versions[i].model_version);
         }
-        version = version->next;
     }
     
     *out_versions = versions;
@@ -1090,17 +1728,6 @@ eb_status_t eb_store_memory(
     return status;
 }
 
-static __attribute__((unused)) size_t count_version_chain(eb_stored_vector_t* vector) {
-    size_t count = 0;
-    eb_stored_vector_t* current = vector;
-    
-    while (current) {
-        if (current->embedding) count++;
-        current = current->next;
-    }
-    return count;
-}
-
 eb_status_t eb_get_memory_evolution_with_changes(
     eb_store_t* store,
     uint64_t vector_id,
@@ -1121,66 +1748,50 @@ eb_status_t eb_get_memory_evolution_with_changes(
 
     // Find all related vectors in the chain
     size_t max_versions = 32;  // Reasonable limit
-    eb_stored_vector_t** chain = malloc(max_versions * sizeof(eb_stored_vector_t*));
+    eb_stored_vector_t* chain = malloc(max_versions * sizeof(eb_stored_vector_t));
+    if (!chain) return EB_ERROR_MEMORY_ALLOCATION;
     size_t chain_length = 0;
 
-    // First, find the vector with the given ID
-    size_t index = vector_id % HASH_TABLE_SIZE;
-    eb_stored_vector_t* current = &store->vectors[index];
-    eb_stored_vector_t* target = NULL;
-
-    // Find the target vector
-    while (current) {
-        if (current->id == vector_id) {
-            target = current;
-            break;
-        }
-        current = current->next;
+    // First, every stored version with the given ID
+    eb_memory_table_t* table = store->memory;
+    uint32_t oldest = EB_MEMORY_NO_ROW;
+    for (uint32_t row = eb_memory_table_find(table, vector_id);
+         row != EB_MEMORY_NO_ROW && chain_length < max_versions;
+         row = eb_memory_table_prev(table, row)) {
+        eb_memory_table_row(table, row, &chain[chain_length++]);
+        oldest = row;
     }
 
-    if (!target) {
+    if (chain_length == 0) {
         free(chain);
         return EB_ERROR_NOT_FOUND;
     }
 
-    // Add target to chain
-    chain[chain_length++] = target;
-
     // Find parent versions
-    current = target;
-    while (current && current->parent_id != 0 && chain_length < max_versions) {
-        // Find parent
-        size_t parent_index = current->parent_id % HASH_TABLE_SIZE;
-        eb_stored_vector_t* parent = &store->vectors[parent_index];
-        
-        while (parent) {
-            if (parent->id == current->parent_id) {
-                chain[chain_length++] = parent;
-                current = parent;
-                break;
-            }
-            parent = parent->next;
-        }
-        
-        if (!parent) break;  // Parent not found
+    const uint64_t* ids = eb_memory_table_ids(table);
+    const uint64_t* parent_ids = eb_memory_table_parent_ids(table);
+    uint64_t parent_id = parent_ids[oldest];
+    while (parent_id != 0 && parent_id != vector_id && chain_length < max_versions) {
+        uint32_t parent = eb_memory_table_find(table, parent_id);
+        if (parent == EB_MEMORY_NO_ROW) break;  // Parent not found
+        eb_memory_table_row(table, parent, &chain[chain_length++]);
+        if (parent_ids[parent] == parent_id) break;
+        parent_id = parent_ids[parent];
     }
 
     // Find child versions
-    for (size_t i = 0; i < HASH_TABLE_SIZE && chain_length < max_versions; i++) {
-        current = &store->vectors[i];
-        while (current) {
-            if (current->parent_id == vector_id) {
-                chain[chain_length++] = current;
-            }
-            current = current->next;
+    size_t row_count = eb_memory_table_count(table);
+    for (size_t row = 0; row < row_count && chain_length < max_versions; row++) {
+        if (parent_ids[row] == vector_id && ids[row] != vector_id) {
+            eb_memory_table_row(table, (uint32_t)row, &chain[chain_length++]);
         }
     }
 
     // Sort chain by timestamp
     for (size_t i = 0; i < chain_length - 1; i++) {
         for (size_t j = 0; j < chain_length - i - 1; j++) {
-            if (chain[j]->timestamp > chain[j + 1]->timestamp) {
-                eb_stored_vector_t* temp = chain[j];
+            if (chain[j].timestamp > chain[j + 1].timestamp) {
+                eb_stored_vector_t temp = chain[j];
                 chain[j] = chain[j + 1];
                 chain[j + 1] = temp;
             }
@@ -1190,7 +1801,7 @@ eb_status_t eb_get_memory_evolution_with_changes(
     // Copy versions within time range
     size_t version_count = 0;
     for (size_t i = 0; i < chain_length; i++) {
-        if (chain[i]->timestamp >= from_time && chain[i]->timestamp <= to_time) {
+        if (chain[i].timestamp >= from_time && chain[i].timestamp <= to_time) {
             version_count++;
         }
     }
@@ -1213,9 +1824,9 @@ eb_status_t eb_get_memory_evolution_with_changes(
 
     size_t version_idx = 0;
     for (size_t i = 0; i < chain_length; i++) {
-        if (chain[i]->timestamp >= from_time && chain[i]->timestamp <= to_time) {
-            versions[version_idx] = *chain[i];
-            versions[version_idx].model_version = strdup(chain[i]->model_version);
+        if (chain[i].timestamp >= from_time && chain[i].timestamp <= to_time) {
+            versions[version_idx] = chain[i];
+            versions[version_idx].model_version = strdup(chain[i].model_version);
             version_idx++;
         }
     }
@@ -1307,6 +1918,7 @@ eb_status_t eb_store_metadata(
         total_size,
         EB_OBJ_META,
         entry_count,  // Store count in flags
+        NULL,
         out_hash
     );
     
@@ -1448,54 +2060,32 @@ eb_status_t eb_get_ref(
 
 /* Initialize memory store */
 eb_status_t eb_store_init_memory(eb_store_t** out) {
-    eb_store_t* store = malloc(sizeof(eb_store_t));
+    eb_store_t* store = calloc(1, sizeof(eb_store_t));
     if (!store) return EB_ERROR_MEMORY_ALLOCATION;
     
-    // Initialize hash table
-    store->vectors = calloc(HASH_TABLE_SIZE, sizeof(eb_stored_vector_t));
-    if (!store->vectors) {
+    eb_status_t status = eb_memory_table_create(&store->memory);
+    if (status != EB_SUCCESS) {
         free(store);
-        return EB_ERROR_MEMORY_ALLOCATION;
+        return status;
     }
     
     store->storage_path = strdup(":memory:");
     if (!store->storage_path) {
-        free(store->vectors);
+        eb_memory_table_destroy(store->memory);
         free(store);
         return EB_ERROR_MEMORY_ALLOCATION;
     }
     
     store->vector_count = 0;
+    store->packs = NULL;
+    store->defer_sync = false;
+    store->filter = NULL;
+    store->filter_opened = false;
+    pthread_mutex_init(&store->packs_lock, NULL);
     *out = store;
     return EB_SUCCESS;
 }
 
-static eb_stored_vector_t* find_vector_by_text(eb_store_t* store, const char* text) {
-    DEBUG_PRINT("DEBUG: Searching for vector with text: %.30s...\n", text);
-    
-    // Find existing vector with same text content
-    for (size_t i = 0; i < HASH_TABLE_SIZE; i++) {
-        eb_stored_vector_t* current = &store->vectors[i];
-        while (current && current->metadata) {
-            eb_metadata_t* meta = current->metadata;
-            while (meta) {
-                if (strcmp(meta->key, "text") == 0) {
-                    DEBUG_PRINT("DEBUG: Found text metadata: %.30s...\n", meta->value);
-                    if (strcmp(meta->value, text) == 0) {
-                        DEBUG_PRINT("DEBUG: Found matching vector at index %zu with ID %lu\n", 
-                               i, current->id);
-                        return current;
-                    }
-                }
-                meta = meta->next;
-            }
-            current = current->next;
-        }
-    }
-    DEBUG_PRINT("DEBUG: No existing vector found with matching text\n");
-    return NULL;
-}
-
 /* Store vector in memory */
 eb_status_t eb_store_vector_memory(
     eb_store_t* store,
@@ -1504,10 +2094,8 @@ eb_status_t eb_store_vector_memory(
     const char* model_version,
     uint64_t* out_id
 ) {
-    if (!store || !embedding || !model_version || !out_id) {
+    if (!store || !store->memory || !embedding || !model_version || !out_id) {
         DEBUG_PRINT("DEBUG: Invalid input check failed in eb_store_vector_memory\n");
-        DEBUG_PRINT("DEBUG: store=%p, embedding=%p, model_version=%p, out_id=%p\n",
-               (void*)store, (void*)embedding, (void*)model_version, (void*)out_id);
         return EB_ERROR_INVALID_INPUT;
     }
     
@@ -1517,177 +2105,93 @@ eb_status_t eb_store_vector_memory(
     const eb_metadata_t* meta = metadata;
     while (meta) {
         if (strcmp(meta->key, "text") == 0) {
-            text = meta->value;
-            DEBUG_PRINT("DEBUG: Found text in metadata: %.30s...\n", text);
+            if (!text) text = meta->value;
         } else if (strcmp(meta->key, "parent_id") == 0) {
             parent_id = strtoull(meta->value, NULL, 10);
-            DEBUG_PRINT("DEBUG: Found parent_id in metadata: %lu\n", parent_id);
         }
         meta = meta->next;
     }
     
     // Generate ID from embedding data if no text
     if (!text) {
-        DEBUG_PRINT("DEBUG: No text found in metadata, using embedding data for ID\n");
         *out_id = generate_id(embedding->values, embedding->dimensions * sizeof(float));
     } else {
-        // If we have a parent_id, use it directly
-        if (parent_id != 0) {
-            *out_id = generate_id(text, strlen(text));
-        } else {
-            // Find existing vector with same text
-            eb_stored_vector_t* existing = find_vector_by_text(store, text);
-            if (existing) {
-                parent_id = existing->id;
+        // Without an explicit parent, the previous vector of the same text is it
+        if (parent_id == 0) {
+            uint32_t existing = eb_memory_table_find_text(store->memory, text);
+            if (existing != EB_MEMORY_NO_ROW) {
+                parent_id = eb_memory_table_ids(store->memory)[existing];
             }
-            *out_id = generate_id(text, strlen(text));
         }
+        *out_id = generate_id(text, strlen(text));
     }
     
     DEBUG_PRINT("DEBUG: Generated ID %lu with parent_id %lu\n", *out_id, parent_id);
     
-    // Find slot in hash table
-    size_t index = *out_id % HASH_TABLE_SIZE;
-    DEBUG_PRINT("DEBUG: Using hash table index %zu\n", index);
+    eb_status_t status = eb_memory_table_add(store->memory, *out_id, parent_id, embedding,
+                                             metadata, model_version, time(NULL), NULL);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    
+    store->vector_count++;
+    return EB_SUCCESS;
+}
+
+/* Retrieve vector from memory */
+eb_status_t eb_get_vector_memory(
+    eb_store_t* store,
+    uint64_t vector_id,
+    eb_embedding_t** out_embedding,
+    eb_metadata_t** out_metadata
+) {
+    if (!store || !out_embedding) return EB_ERROR_INVALID_INPUT;
     
-    eb_stored_vector_t* slot = &store->vectors[index];
-    DEBUG_PRINT("DEBUG: Slot at index %zu: embedding=%p, id=%lu, parent_id=%lu\n",
-           index, (void*)slot->embedding, slot->id, slot->parent_id);
+    uint32_t row = eb_memory_table_find(store->memory, vector_id);
+    if (row == EB_MEMORY_NO_ROW) return EB_ERROR_NOT_FOUND;
     
-    // Create a copy of the embedding
+    eb_stored_vector_t stored;
+    eb_memory_table_row(store->memory, row, &stored);
+    
+    // Copy embedding
     eb_embedding_t* embedding_copy;
     eb_status_t status = eb_create_embedding(
-        embedding->values,
-        embedding->dimensions,
+        stored.embedding->values,
+        stored.embedding->dimensions,
         1,  // Single vector
         EB_FLOAT32,
-        embedding->normalize,
+        stored.embedding->normalize,
         &embedding_copy
     );
-    if (status != EB_SUCCESS) {
-        return status;
-    }
-
-    // Create a new stored vector
-    eb_stored_vector_t* new_vector = malloc(sizeof(eb_stored_vector_t));
-    if (!new_vector) {
-        eb_destroy_embedding(embedding_copy);
-        return EB_ERROR_MEMORY_ALLOCATION;
-    }
-
-    // Initialize the new vector
-    new_vector->id = *out_id;
-    new_vector->embedding = embedding_copy;
-    new_vector->metadata = NULL;
-    new_vector->model_version = strdup(model_version);
-    new_vector->timestamp = time(NULL);
-    new_vector->parent_id = parent_id;
-    new_vector->next = NULL;
-    
-    DEBUG_PRINT("DEBUG: Created new vector entry:\n");
-    DEBUG_PRINT("  - ID: %lu\n", new_vector->id);
-    DEBUG_PRINT("  - Parent ID: %lu\n", new_vector->parent_id);
-    DEBUG_PRINT("  - Model: %s\n", new_vector->model_version);
-    DEBUG_PRINT("  - Timestamp: %lu\n", new_vector->timestamp);
+    if (status != EB_SUCCESS) return status;
     
-    // Copy metadata if present
-    if (metadata) {
+    // Copy metadata if requested
+    if (out_metadata) {
+        *out_metadata = NULL;
         eb_metadata_t* last_meta = NULL;
-        meta = metadata;
-        while (meta) {
+        for (const eb_metadata_t* meta = stored.metadata; meta; meta = meta->next) {
             eb_metadata_t* new_meta;
             status = eb_metadata_create(meta->key, meta->value, &new_meta);
             if (status != EB_SUCCESS) {
                 eb_destroy_embedding(embedding_copy);
-                free(new_vector->model_version);
-                free(new_vector);
+                eb_metadata_destroy(*out_metadata);
+                *out_metadata = NULL;
                 return status;
             }
             
-            if (!new_vector->metadata) {
-                new_vector->metadata = new_meta;
+            if (!*out_metadata) {
+                *out_metadata = new_meta;
             } else {
                 last_meta->next = new_meta;
             }
             last_meta = new_meta;
-            meta = meta->next;
         }
     }
     
-    // Add to hash table
-    if (slot->embedding) {
-        // Slot occupied, chain to next
-        new_vector->next = slot->next;
-        slot->next = new_vector;
-    } else {
-        // Empty slot
-        *slot = *new_vector;
-        free(new_vector);  // Contents copied to slot
-    }
-    
-    store->vector_count++;
+    *out_embedding = embedding_copy;
     return EB_SUCCESS;
 }
 
-/* Retrieve vector from memory */
-eb_status_t eb_get_vector_memory(
-    eb_store_t* store,
-    uint64_t vector_id,
-    eb_embedding_t** out_embedding,
-    eb_metadata_t** out_metadata
-) {
-    if (!store || !out_embedding) return EB_ERROR_INVALID_INPUT;
-    
-    // Find vector in hash table
-    size_t index = vector_id % HASH_TABLE_SIZE;
-    eb_stored_vector_t* current = &store->vectors[index];
-    
-    while (current) {
-        if (current->id == vector_id) {
-            // Copy embedding
-            eb_embedding_t* embedding_copy;
-            eb_status_t status = eb_create_embedding(
-                current->embedding->values,
-                current->embedding->dimensions,
-                1,  // Single vector
-                EB_FLOAT32,
-                current->embedding->normalize,
-                &embedding_copy
-            );
-            if (status != EB_SUCCESS) return status;
-            
-            // Copy metadata if requested
-            if (out_metadata && current->metadata) {
-                const eb_metadata_t* meta = current->metadata;
-                eb_metadata_t* last_meta = NULL;
-                
-                while (meta) {
-                    eb_metadata_t* new_meta;
-                    status = eb_metadata_create(meta->key, meta->value, &new_meta);
-                    if (status != EB_SUCCESS) {
-                        eb_destroy_embedding(embedding_copy);
-                        eb_metadata_destroy(*out_metadata);
-                        return status;
-                    }
-                    
-                    if (!*out_metadata) {
-                        *out_metadata = new_meta;
-                    } else {
-                        last_meta->next = new_meta;
-                    }
-                    last_meta = new_meta;
-                    meta = meta->next;
-                }
-            }
-            
-            return EB_SUCCESS;
-        }
-        current = current->next;
-    }
-    
-    return EB_ERROR_NOT_FOUND;
-}
-
 #endif /* EB_ENABLE_MEMORY_STORE */
 
 eb_status_t eb_store_get_latest(eb_store_t* store, const char* file, eb_stored_vector_t** vectors) {
@@ -1719,7 +2223,7 @@ eb_status_t eb_store_get_latest(eb_store_t* store, const char* file, eb_stored_v
 
     // Get provider from metadata
     char meta_path[PATH_MAX];
-    snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", store->storage_path, current_hash);
+    eb_object_path(store->storage_path, current_hash, "meta", meta_path, sizeof(meta_path));
     
     const char* provider = NULL;
     FILE* meta_file = fopen(meta_path, "r");
@@ -1744,7 +2248,10 @@ eb_status_t eb_store_get_latest(eb_store_t* store, const char* file, eb_stored_v
     (*vectors)->timestamp = time(NULL);
     (*vectors)->embedding = NULL;
     (*vectors)->model_version = provider ? strdup(provider) : strdup("unknown");
+    (*vectors)->parent_id = 0;
     (*vectors)->next = log_versions; // Link to history
+    (*vectors)->meta = NULL;
+    (*vectors)->arena = NULL;
 
     // Add hash metadata
     eb_metadata_t* hash_meta;
@@ -1769,8 +2276,7 @@ eb_status_t eb_store_get_path(eb_store_t *store,
                 return EB_ERROR_INVALID_INPUT;
 
         /* Construct path to embedding file */
-        if (snprintf(path_out, path_size, "%s/.embr/objects/%s.bin",
-                    store->storage_path, hash) >= (int)path_size) {
+        if (eb_object_path(store->storage_path, hash, "bin", path_out, path_size) != 0) {
                 return EB_ERROR_PATH_TOO_LONG;
         }
 
@@ -1808,68 +2314,20 @@ eb_status_t eb_store_resolve_hash(
         return EB_SUCCESS;
     }
 
-    /* Check if file exists directly first */
-    char direct_path[4096];
-    snprintf(direct_path, sizeof(direct_path), "%s/.embr/objects/%s.raw", 
-             store->storage_path, partial_hash);
-    
-    if (access(direct_path, F_OK) == 0) {
-        strncpy(full_hash, partial_hash, 64);
-        full_hash[64] = '\0';
-        return EB_SUCCESS;
-    }
-
-    /* Search in objects directory */
-    char objects_dir[4096];
-    snprintf(objects_dir, sizeof(objects_dir), "%s/.embr/objects", store->storage_path);
-    
-    DIR* dir = opendir(objects_dir);
-    if (!dir) {
-        DEBUG_PRINT("Failed to open objects directory: %s\n", objects_dir);
-        return EB_ERROR_NOT_FOUND;
-    }
-
-    struct dirent* entry;
-    char* match = NULL;
-    int match_count = 0;
-
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type != DT_REG) continue;  // Skip non-regular files
-        
-        size_t name_len = strlen(entry->d_name);
-        if (name_len < 4 || strcmp(entry->d_name + name_len - 4, ".raw") != 0) {
-            continue;  // Skip non-.raw files
-        }
-
-        // Remove .raw extension
-        char hash[65];
-        strncpy(hash, entry->d_name, name_len - 4);
-        hash[name_len - 4] = '\0';
-
-        if (strncmp(hash, partial_hash, hash_len) == 0) {
-            DEBUG_PRINT("Found matching hash: %s\n", hash);
-            if (match) {
-                DEBUG_PRINT("Multiple matches found - hash is ambiguous\n");
-                free(match);
-                closedir(dir);
-                return EB_ERROR_HASH_AMBIGUOUS;
-            }
-            match = strdup(hash);
-            match_count++;
-        }
+    /* Sorted loose index plus pack indexes, no directory scan */
+    pthread_mutex_lock(&store->packs_lock);
+    eb_status_t status = eb_hash_index_resolve(store->storage_path, store_packs(store),
+                                               partial_hash, full_hash);
+    pthread_mutex_unlock(&store->packs_lock);
+    if (status == EB_ERROR_HASH_AMBIGUOUS) {
+        DEBUG_PRINT("Multiple matches found - hash is ambiguous\n");
+        return status;
     }
-
-    closedir(dir);
-
-    if (!match) {
+    if (status != EB_SUCCESS) {
         DEBUG_PRINT("No matching hash found for %s\n", partial_hash);
-        return EB_ERROR_NOT_FOUND;
+        return status;
     }
 
-    strncpy(full_hash, match, 64);
-    full_hash[64] = '\0';
-    free(match);
-
     DEBUG_PRINT("Successfully resolved %s to %s\n", 
             partial_hash, full_hash);
     return EB_SUCCESS;
@@ -1880,38 +2338,17 @@ eb_status_t get_current_hash(const char* root, const char* source, char* hash_ou
         return EB_ERROR_INVALID_INPUT;
     }
 
-    // Use per-set index file
-    char* index_path = get_current_set_index_path();
-    FILE* fp = fopen(index_path, "r");
-    free(index_path);
-    if (!fp) {
+    // Most recently stored entry of any model in the per-set index
+    eb_set_index_t* index;
+    if (eb_set_index_open_current(root, &index) != EB_SUCCESS) {
         return EB_ERROR_NOT_FOUND;
     }
+    eb_status_t status = eb_set_index_lookup(index, source, NULL, hash_out);
+    eb_set_index_close(index);
 
-    char line[2048];
-    bool found = false;
-
-    while (fgets(line, sizeof(line), fp)) {
-        char file[PATH_MAX], hash[65];
-        line[strcspn(line, "\n")] = 0;
-
-        DEBUG_PRINT("get_current_hash: Processing line: %s\n", line);
-        
-        // Parse line format "hash file"
-        if (sscanf(line, "%s %s", hash, file) == 2) {
-            DEBUG_PRINT("get_current_hash: Comparing [%s] with [%s]\n", file, source);
-            
-            if (strcmp(file, source) == 0) {
-                strncpy(hash_out, hash, hash_size - 1);
-                hash_out[hash_size - 1] = '\0';
-                found = true;
-                //break; continue to find last entry
-            }
-        }
-    }
-
-    fclose(fp);
-    return found ? EB_SUCCESS : EB_ERROR_NOT_FOUND;
+    DEBUG_PRINT("get_current_hash: %s -> %s\n", source,
+                status == EB_SUCCESS ? hash_out : "(not found)");
+    return status;
 }
 
 static int mkdir_p(const char *path) {
@@ -1938,238 +2375,207 @@ static int mkdir_p(const char *path) {
     return (ret != 0 && errno != EEXIST) ? -1 : 0;
 }
 
-eb_status_t store_embedding_file(const char* embedding_path, const char* source_file,
-                               const char* base_dir, const char* provider) {
-    if (!embedding_path || !source_file || !base_dir) {
-        return EB_ERROR_INVALID_INPUT;
+/* One embedding added to a batch */
+typedef struct {
+    char hash[65];
+    char* source;
+    char* provider;
+    time_t timestamp;
+    bool superseded;     /* A later entry stores the same source and provider */
+} batch_entry_t;
+
+struct eb_store_batch {
+    eb_store_t store;        /* Used for object writes, keeps packs open */
+    eb_dtype_t dtype;        /* Storage dtype for new objects */
+    batch_entry_t* entries;
+    size_t count;
+    size_t capacity;
+    eb_stat_cache_t* stat_cache;    /* Source hashes by stat, NULL if unavailable */
+    eb_set_index_t* index;          /* Current set as the batch began, for delta bases */
+};
+
+/* Entries with a provider, sorted for lookup at commit time */
+typedef struct {
+    batch_entry_t** by_key;     /* provider, source, insertion order */
+    size_t count;
+} batch_lookup_t;
+
+static int batch_key_match(const void* a, const void* b) {
+    const batch_entry_t* x = *(batch_entry_t* const*)a;
+    const batch_entry_t* y = *(batch_entry_t* const*)b;
+    int cmp = strcmp(x->provider, y->provider);
+    return cmp ? cmp : strcmp(x->source, y->source);
+}
+
+static int batch_key_cmp(const void* a, const void* b) {
+    int cmp = batch_key_match(a, b);
+    if (cmp)
+        return cmp;
+    // Entries live in one array, so address order is insertion order
+    const batch_entry_t* x = *(batch_entry_t* const*)a;
+    const batch_entry_t* y = *(batch_entry_t* const*)b;
+    return (x > y) - (x < y);
+}
+
+static eb_status_t batch_lookup_build(eb_store_batch_t* batch, batch_lookup_t* lookup) {
+    lookup->by_key = malloc((batch->count + 1) * sizeof(batch_entry_t*));
+    lookup->count = 0;
+    if (!lookup->by_key) {
+        return EB_ERROR_MEMORY_ALLOCATION;
     }
 
-    // Create objects directory if it doesn't exist
-    char objects_dir[PATH_MAX];
-    snprintf(objects_dir, sizeof(objects_dir), "%s/.embr/objects", base_dir);
-    if (mkdir_p(objects_dir) != 0) {
-        return EB_ERROR_FILE_IO;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->entries[i].provider)
+            lookup->by_key[lookup->count++] = &batch->entries[i];
     }
+    if (lookup->count > 1)
+        qsort(lookup->by_key, lookup->count, sizeof(batch_entry_t*), batch_key_cmp);
 
-    printf("Storing embedding file: %s\n", embedding_path);
-    printf("Source file: %s\n", source_file);
-    printf("Base directory: %s\n", base_dir);
-
-    // Read the raw file bytes
-    FILE* fp = fopen(embedding_path, "rb");
-    if (!fp) {
-        return EB_ERROR_FILE_IO;
+    // Only the last store of a source with a given provider is kept
+    for (size_t i = 0; i + 1 < lookup->count; i++) {
+        if (batch_key_match(&lookup->by_key[i], &lookup->by_key[i + 1]) == 0)
+            lookup->by_key[i]->superseded = true;
     }
+    return EB_SUCCESS;
+}
 
-    // Get file size
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+static void batch_lookup_free(batch_lookup_t* lookup) {
+    free(lookup->by_key);
+}
 
-    // Read file content
-    unsigned char* file_content = malloc(file_size);
-    if (!file_content) {
-        fclose(fp);
+static bool batch_has_key(batch_entry_t** keys, size_t count,
+                          const char* provider, const char* source) {
+    batch_entry_t probe = { .source = (char*)source, .provider = (char*)provider };
+    batch_entry_t* key = &probe;
+    return count &&
+           bsearch(&key, keys, count, sizeof(batch_entry_t*), batch_key_match) != NULL;
+}
+
+/*
+ * Record the whole batch in the set index with one commit. Entries are
+ * keyed by source and the model written to their .meta sidecar, so a
+ * later store of the same pair replaces the earlier one.
+ */
+static eb_status_t update_set_index(const eb_store_batch_t* batch) {
+    eb_set_index_change_t* changes = malloc(batch->count * sizeof(*changes));
+    if (!changes)
         return EB_ERROR_MEMORY_ALLOCATION;
-    }
 
-    size_t bytes_read = fread(file_content, 1, file_size, fp);
-    fclose(fp);
+    size_t count = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        const batch_entry_t* entry = &batch->entries[i];
+        if (entry->superseded)
+            continue;
+        changes[count].source = entry->source;
+        changes[count].model = entry->provider ? entry->provider : "unknown";
+        changes[count].hash = entry->hash;
+        count++;
+    }
+
+    eb_status_t status = eb_set_index_apply_current(batch->store.storage_path, changes, count);
+    if (status == EB_SUCCESS && eb_hnsw_apply(batch->store.storage_path, changes, count) != EB_SUCCESS)
+        fprintf(stderr, "warning: failed to update vector index, run 'embr index build'\n");
+    free(changes);
+    return status;
+}
 
-    if (bytes_read != (size_t)file_size) {
-        free(file_content);
+/* Append every stored embedding to the set log with a single open */
+static eb_status_t append_batch_history(const eb_store_batch_t* batch) {
+    char* log_path = get_current_set_log_path();
+    if (!log_path)
         return EB_ERROR_FILE_IO;
-    }
-
-    // Initialize a temporary store for writing the object
-    eb_store_t temp_store = {
-        .storage_path = (char*)base_dir,
-        .vectors = NULL,
-        .vector_count = 0
-    };
-
-    // Write the object with compression
-    char hash_str[65];
-    eb_status_t status = write_object(
-        &temp_store,
-        file_content,
-        file_size,
-        EB_OBJ_VECTOR,  // Mark as vector data for compression
-        0,  // No special flags
-        hash_str
-    );
-
-    free(file_content);
-
-    if (status != EB_SUCCESS) {
-        return status;
-    }
-
-    // Store metadata
-    char meta_path[PATH_MAX];
-    // Use the same hash but with .meta extension instead of .raw
-    snprintf(meta_path, sizeof(meta_path), "%s/%s.meta", objects_dir, hash_str);
-    fp = fopen(meta_path, "w");
-    if (!fp) {
+    FILE* f = fopen(log_path, "a");
+    if (!f) {
+        free(log_path);
         return EB_ERROR_FILE_IO;
     }
 
-    time_t now = time(NULL);
-    fprintf(fp, "source_file=%s\n", source_file);
-    fprintf(fp, "timestamp=%ld\n", now);
-    fprintf(fp, "file_type=%s\n", strrchr(embedding_path, '.') + 1);
-    fprintf(fp, "model=%s\n", provider ? provider : "unknown");  // Use provided model
-    fclose(fp);
-
-    // Update index - read existing index, filter out old entries for same file+model, then write back
-    char* index_path = get_current_set_index_path();
-    char* temp_index_path = malloc(strlen(index_path) + 5); // ".tmp" + null
-    sprintf(temp_index_path, "%s.tmp", index_path);
-    
-    FILE* fp_in = fopen(index_path, "r");
-    FILE* fp_out = fopen(temp_index_path, "w");
-    
-    if (!fp_out) {
-        if (fp_in) fclose(fp_in);
-        free(index_path);
-        free(temp_index_path);
-        return EB_ERROR_FILE_IO;
-    }
-    
-    if (fp_in) {
-        char line[2048];
-        while (fgets(line, sizeof(line), fp_in)) {
-            char idx_hash[65], idx_path[PATH_MAX];
-            line[strcspn(line, "\n")] = 0;
-            
-            // Parse line format "hash source"
-            if (sscanf(line, "%s %s", idx_hash, idx_path) == 2) {
-                // Skip entries with the same file path
-                if (strcmp(idx_path, source_file) == 0) {
-                    // Check if this is for the same provider/model
-                    char meta_path[PATH_MAX];
-                    snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", base_dir, idx_hash);
-                    
-                    FILE* meta_fp = fopen(meta_path, "r");
-                    bool same_provider = false;
-                    
-                    if (meta_fp) {
-                        char meta_line[1024];
-                        while (fgets(meta_line, sizeof(meta_line), meta_fp)) {
-                            meta_line[strcspn(meta_line, "\n")] = 0;
-                            
-                            if (strncmp(meta_line, "model=", strlen("model=")) == 0) {
-                                char idx_provider[32];
-                                if (sscanf(meta_line, "model=%s", idx_provider) == 1) {
-                                    if (provider && strcmp(idx_provider, provider) == 0) {
-                                        same_provider = true;
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                        fclose(meta_fp);
-                    }
-                    
-                    // If same provider, skip this line (don't copy to new index)
-                    if (same_provider) {
-                        continue;
-                    }
-                }
-                
-                // Copy line to new index file
-                fprintf(fp_out, "%s %s\n", idx_hash, idx_path);
-            }
-        }
-        fclose(fp_in);
+    for (size_t i = 0; i < batch->count; i++) {
+        const batch_entry_t* entry = &batch->entries[i];
+        fprintf(f, "%ld %s %s %s\n", (long)entry->timestamp, entry->hash, entry->source,
+                entry->provider ? entry->provider : "openai");
     }
-    
-    // Add the new entry to the index
-    fprintf(fp_out, "%s %s\n", hash_str, source_file);
-    fclose(fp_out);
-    
-    // Replace the old index with the new one
-    if (rename(temp_index_path, index_path) != 0) {
-        free(index_path);
-        free(temp_index_path);
+
+    if (fclose(f) != 0) {
+        free(log_path);
         return EB_ERROR_FILE_IO;
     }
-    free(index_path);
-    free(temp_index_path);
+    if (eb_log_index_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("append_batch_history: Failed to update log index for %s", log_path);
+    if (eb_checkpoint_update(log_path) != EB_SUCCESS)
+        DEBUG_PRINT("append_batch_history: Failed to checkpoint %s", log_path);
+    free(log_path);
+    return EB_SUCCESS;
+}
 
-    // Update history
-    eb_status_t history_status = append_to_history(base_dir, source_file, hash_str, provider);
-    if (history_status != EB_SUCCESS) {
-        fprintf(stderr, "Warning: Failed to update history\n");
-    }
+/* Rewrite refs/models/<provider> once per provider in the batch */
+static void update_model_refs(const batch_lookup_t* lookup) {
+    if (lookup->count == 0)
+        return;
 
-    // Create refs/models directory if it doesn't exist
     char* model_refs_dir = get_current_set_model_refs_dir();
     if (!model_refs_dir) {
         fprintf(stderr, "Warning: Failed to get model refs dir for current set\n");
-    } else {
-        if (mkdir_p(model_refs_dir) != 0) {
-            fprintf(stderr, "Warning: Failed to create models directory\n");
-        }
+        return;
     }
-    
-    if (provider && model_refs_dir) {
+    if (mkdir_p(model_refs_dir) != 0) {
+        fprintf(stderr, "Warning: Failed to create models directory\n");
+    }
+
+    size_t start = 0;
+    while (start < lookup->count) {
+        const char* provider = lookup->by_key[start]->provider;
+        size_t end = start + 1;
+        while (end < lookup->count && strcmp(lookup->by_key[end]->provider, provider) == 0)
+            end++;
+
+        batch_entry_t** run = &lookup->by_key[start];
+        size_t run_count = end - start;
+
         char model_ref_path[PATH_MAX];
+        char temp_ref_path[PATH_MAX + 4];
         snprintf(model_ref_path, sizeof(model_ref_path), "%s/%s", model_refs_dir, provider);
-        
-        // Read existing model references first
+        snprintf(temp_ref_path, sizeof(temp_ref_path), "%s.tmp", model_ref_path);
+
+        FILE* model_fp = fopen(temp_ref_path, "w");
+        if (!model_fp) {
+            fprintf(stderr, "Warning: Failed to create model reference file for %s\n", provider);
+            start = end;
+            continue;
+        }
+
+        // Keep lines for sources this batch does not store again
         FILE* model_read_fp = fopen(model_ref_path, "r");
-        char** existing_lines = NULL;
-        size_t line_count = 0;
-        
         if (model_read_fp) {
             char line[PATH_MAX + 65]; // Hash (64) + space + path + null terminator
             while (fgets(line, sizeof(line), model_read_fp)) {
-                // Skip lines with same source file
                 char file_path[PATH_MAX];
                 char file_hash[65];
-                
-                // Remove newline if present
+
                 line[strcspn(line, "\n")] = 0;
-                
-                if (sscanf(line, "%s %s", file_hash, file_path) == 2) {
-                    if (strcmp(file_path, source_file) != 0) {
-                        // Keep lines that don't match this source file
-                        existing_lines = realloc(existing_lines, (line_count + 1) * sizeof(char*));
-                        if (existing_lines)
-                            existing_lines[line_count++] = strdup(line);
-                    }
-                }
+                if (sscanf(line, "%64s %4095s", file_hash, file_path) == 2 &&
+                    !batch_has_key(run, run_count, provider, file_path))
+                    fprintf(model_fp, "%s\n", line);
             }
             fclose(model_read_fp);
         }
-        
-        // Write updated model reference file
-        FILE* model_fp = fopen(model_ref_path, "w");
-        if (!model_fp) {
-            fprintf(stderr, "Warning: Failed to create model reference file for %s\n", provider);
-            
-            // Free allocated memory for existing lines
-            for (size_t i = 0; i < line_count; i++) {
-                free(existing_lines[i]);
-            }
-            free(existing_lines);
-        } else {
-            // Write back existing lines first
-            for (size_t i = 0; i < line_count; i++) {
-                fprintf(model_fp, "%s\n", existing_lines[i]);
-                free(existing_lines[i]);
-            }
-            free(existing_lines);
-            
-            // Add the new file entry
-            fprintf(model_fp, "%s %s\n", hash_str, source_file);
-            fclose(model_fp);
+
+        for (size_t i = 0; i < run_count; i++) {
+            if (!run[i]->superseded)
+                fprintf(model_fp, "%s %s\n", run[i]->hash, run[i]->source);
         }
+
+        if (fclose(model_fp) != 0 || rename(temp_ref_path, model_ref_path) != 0) {
+            fprintf(stderr, "Warning: Failed to update model reference file for %s\n", provider);
+            unlink(temp_ref_path);
+        }
+        start = end;
     }
-    if (model_refs_dir) free(model_refs_dir);
+    free(model_refs_dir);
+}
 
-    // Update HEAD file to contain only the current set name, not model references
+/* Make sure HEAD holds only the current set name, not model references */
+static void update_head(const char* base_dir) {
     char head_path[PATH_MAX];
     char temp_path[PATH_MAX];
     snprintf(head_path, sizeof(head_path), "%s/.embr/HEAD", base_dir);
@@ -2232,356 +2638,693 @@ eb_status_t store_embedding_file(const char* embedding_path, const char* source_
             fclose(head_fp);
         }
     }
-
-    printf("Successfully stored embedding with hash: %s\n", hash_str);
-
-    return EB_SUCCESS;
 }
 
-static eb_status_t calculate_file_hash(const char* file_path, char* hash_out, size_t hash_size) {
-    if (!file_path || !hash_out || hash_size < 65) {
+eb_status_t eb_store_batch_begin(const char* base_dir, eb_store_batch_t** out) {
+    if (!base_dir || !out) {
         return EB_ERROR_INVALID_INPUT;
     }
+    *out = NULL;
 
-    FILE* f = fopen(file_path, "rb");
-    if (!f) {
+    // Create objects directory if it doesn't exist
+    char objects_dir[PATH_MAX];
+    snprintf(objects_dir, sizeof(objects_dir), "%s/.embr/objects", base_dir);
+    if (mkdir_p(objects_dir) != 0) {
         return EB_ERROR_FILE_IO;
     }
 
-    // Initialize EVP context
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    if (!ctx) {
-        fclose(f);
+    eb_store_batch_t* batch = calloc(1, sizeof(*batch));
+    if (!batch) {
         return EB_ERROR_MEMORY_ALLOCATION;
     }
-
-    const EVP_MD* md = EVP_sha256();
-    if (!md) {
-        EVP_MD_CTX_free(ctx);
-        fclose(f);
+    batch->store.storage_path = strdup(base_dir);
+    if (!batch->store.storage_path) {
+        free(batch);
         return EB_ERROR_MEMORY_ALLOCATION;
     }
+    pthread_mutex_init(&batch->store.packs_lock, NULL);
+    // Under group durability the commit flushes every object at once
+    batch->store.defer_sync = eb_object_durability(base_dir) == EB_DURABILITY_GROUP;
+    if (eb_stat_cache_open_current(&batch->stat_cache) != EB_SUCCESS) {
+        batch->stat_cache = NULL;
+    }
+
+    *out = batch;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_store_batch_set_dtype(eb_store_batch_t* batch, eb_dtype_t dtype) {
+    if (!batch || eb_quantized_size(dtype, 1) == 0) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+    batch->dtype = dtype;
+    return EB_SUCCESS;
+}
 
-    if (EVP_DigestInit_ex(ctx, md, NULL) != 1) {
-        EVP_MD_CTX_free(ctx);
-        fclose(f);
+/* Re-encode the float32 values of an embedding file in a reduced dtype */
+static eb_status_t quantize_embedding(const void* content, size_t size, eb_dtype_t dtype,
+                                      void** out, size_t* out_size) {
+    const float* values;
+    size_t dims;
+    eb_status_t status = eb_float_payload(content, size, &values, &dims);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    status = eb_quantize(values, dims, dtype, out, out_size);
+    if (status == EB_SUCCESS) {
+        DEBUG_INFO("Quantized %zu values to %s: %zu -> %zu bytes",
+                   dims, eb_dtype_name(dtype), size, *out_size);
+    }
+    return status;
+}
+
+/* Room for count more entries */
+static eb_status_t batch_reserve(eb_store_batch_t* batch, size_t count) {
+    if (batch->capacity - batch->count >= count) {
+        return EB_SUCCESS;
+    }
+    size_t capacity = batch->capacity ? batch->capacity : 64;
+    while (capacity - batch->count < count) {
+        capacity *= 2;
+    }
+    batch_entry_t* entries = realloc(batch->entries, capacity * sizeof(*entries));
+    if (!entries) {
         return EB_ERROR_MEMORY_ALLOCATION;
     }
+    batch->entries = entries;
+    batch->capacity = capacity;
+    return EB_SUCCESS;
+}
 
-    // Read and hash the entire file content without special handling
-    unsigned char buffer[8192];
-    size_t bytes_read;
-    size_t total_bytes = 0;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
-        if (EVP_DigestUpdate(ctx, buffer, bytes_read) != 1) {
-            DEBUG_PRINT("calculate_file_hash: Failed to update hash\n");
-            EVP_MD_CTX_free(ctx);
-            fclose(f);
-            return EB_ERROR_FILE_IO;
+/*
+ * Write one object and its metadata into entry. Several threads may write
+ * distinct entries at once: the store guards its packs, and *index is only
+ * opened if it is still NULL.
+ */
+static eb_status_t batch_write_entry(eb_store_batch_t* batch, eb_set_index_t** index,
+                                     const void* content, size_t size, const char* file_type,
+                                     const char* source_file, const char* provider,
+                                     batch_entry_t* entry) {
+    const char* base_dir = batch->store.storage_path;
+
+    // Quantize on ingest if the batch stores a reduced dtype
+    const void* payload = content;
+    size_t payload_size = size;
+    void* quantized = NULL;
+    if (batch->dtype != EB_FLOAT32) {
+        eb_status_t status = quantize_embedding(content, size, batch->dtype,
+                                                &quantized, &payload_size);
+        if (status != EB_SUCCESS) {
+            return status;
         }
-        total_bytes += bytes_read;
+        payload = quantized;
     }
-    DEBUG_PRINT("calculate_file_hash: Hashed %zu bytes of data\n", total_bytes);
 
-    // Get final hash
-    unsigned char hash_result[32];
-    unsigned int hash_len;
-    if (EVP_DigestFinal_ex(ctx, hash_result, &hash_len) != 1) {
-        DEBUG_PRINT("calculate_file_hash: Failed to finalize hash\n");
-        EVP_MD_CTX_free(ctx);
-        fclose(f);
+    // Write the object with compression
+    char base_hash[65];
+    memset(entry, 0, sizeof(*entry));
+    eb_status_t status = write_object(
+        &batch->store,
+        payload,
+        payload_size,
+        EB_OBJ_VECTOR,  // Mark as vector data for compression
+        (uint32_t)batch->dtype << EB_FLAG_DTYPE_SHIFT,
+        delta_base(base_dir, index, source_file, provider, base_hash),
+        entry->hash
+    );
+    free(quantized);
+
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+
+    // Store metadata next to the object, same hash with .meta instead of .raw
+    char meta_path[PATH_MAX];
+    if (eb_object_write_path(base_dir, entry->hash, "meta", meta_path, sizeof(meta_path)) != 0) {
+        return EB_ERROR_FILE_IO;
+    }
+    FILE* fp = fopen(meta_path, "w");
+    if (!fp) {
         return EB_ERROR_FILE_IO;
     }
 
-    EVP_MD_CTX_free(ctx);
-    fclose(f);
+    entry->timestamp = time(NULL);
+    fprintf(fp, "source_file=%s\n", source_file);
+    fprintf(fp, "timestamp=%ld\n", (long)entry->timestamp);
+    fprintf(fp, "file_type=%s\n", file_type);
+    fprintf(fp, "model=%s\n", provider ? provider : "unknown");  // Use provided model
+    // Content hash of the source, so status can tell whether it changed since
+    char source_path[PATH_MAX];
+    char source_hash[65];
+    if (source_file[0] == '/')
+        snprintf(source_path, sizeof(source_path), "%s", source_file);
+    else
+        snprintf(source_path, sizeof(source_path), "%s/%s", base_dir, source_file);
+    eb_hash_algo_t algo = eb_object_hash(base_dir);
+    if (eb_stat_cache_hash_with(batch->stat_cache, source_file, source_path, algo,
+                                source_hash, NULL) == EB_SUCCESS) {
+        fprintf(fp, "source_hash=%s\n", source_hash);
+        if (algo != EB_HASH_SHA256)
+            fprintf(fp, "source_hash_algo=%s\n", eb_object_hash_name(algo));
+    }
+    if (batch->dtype != EB_FLOAT32) {
+        fprintf(fp, "dtype=%s\n", eb_dtype_name(batch->dtype));
+    }
+    bool synced = !sync_each_object(&batch->store) || (fflush(fp) == 0 && fdatasync(fileno(fp)) == 0);
+    if (fclose(fp) != 0 || !synced) {
+        return EB_ERROR_FILE_IO;
+    }
 
-    // Convert to hex string
-    hash_to_hex(hash_result, hash_out);
-    DEBUG_PRINT("calculate_file_hash: Generated hash %s\n", hash_out);
+    entry->source = strdup(source_file);
+    entry->provider = provider ? strdup(provider) : NULL;
+    if (!entry->source || (provider && !entry->provider)) {
+        free(entry->source);
+        free(entry->provider);
+        entry->source = entry->provider = NULL;
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
     return EB_SUCCESS;
 }
 
-static eb_status_t copy_file(const char* src, const char* dst) {
-    FILE *fsrc = fopen(src, "rb");
-    if (!fsrc) {
-        return EB_ERROR_FILE_IO;
+/* Write one object and its metadata, queue its index update */
+static eb_status_t batch_add_payload(eb_store_batch_t* batch, const void* content, size_t size,
+                                     const char* file_type, const char* source_file,
+                                     const char* provider, char hash_out[65]) {
+    eb_status_t status = batch_reserve(batch, 1);
+    if (status != EB_SUCCESS) {
+        return status;
     }
-
-    FILE *fdst = fopen(dst, "wb");
-    if (!fdst) {
-        fclose(fsrc);
-        return EB_ERROR_FILE_IO;
+    batch_entry_t* entry = &batch->entries[batch->count];
+    status = batch_write_entry(batch, &batch->index, content, size, file_type,
+                               source_file, provider, entry);
+    if (status != EB_SUCCESS) {
+        return status;
     }
 
-    char buffer[8192];
-    size_t n;
-    while ((n = fread(buffer, 1, sizeof(buffer), fsrc)) > 0) {
-        if (fwrite(buffer, 1, n, fdst) != n) {
-            fclose(fsrc);
-            fclose(fdst);
-            return EB_ERROR_FILE_IO;
-        }
+    if (hash_out) {
+        memcpy(hash_out, entry->hash, 65);
     }
+    batch->count++;
+    return EB_SUCCESS;
+}
 
-    fclose(fsrc);
-    fclose(fdst);
+/* One row of an array as a float32 .npy vector, the form stored objects take */
+static eb_status_t row_payload(const eb_array_t* array, size_t row, size_t dims,
+                               void** out, size_t* out_size) {
+    char header[EB_NPY_HEADER_MAX];
+    size_t header_size = eb_npy_header(EB_FLOAT32, &dims, 1, header);
+    if (header_size == 0) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+    uint8_t* payload = malloc(header_size + dims * sizeof(float));
+    if (!payload) {
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    memcpy(payload, header, header_size);
+    eb_array_get(array, row * dims, dims, (float*)(payload + header_size));
+    *out = payload;
+    *out_size = header_size + dims * sizeof(float);
     return EB_SUCCESS;
 }
 
-/* Get version history for a file */
-eb_status_t get_version_history(const char* root, const char* source, 
-                              eb_stored_vector_t** out_versions, size_t* out_count) {
-    // Use per-set log file
-    char* log_path = get_current_set_log_path();
-    FILE* f = fopen(log_path, "r");
-    free(log_path);
-    if (!f) {
-        *out_versions = NULL;
-        *out_count = 0;
-        return EB_SUCCESS; // No history is not an error
+/* Rows hashed, compressed and written per block */
+#define BATCH_ROW_BLOCK 64
+
+/* The rows of one add_rows or add_matrix call, written on the shared pool */
+typedef struct {
+    eb_store_batch_t* batch;
+    const eb_array_t* array;        /* Rows of a mapped file, or */
+    const float* values;            /* rows of a matrix in memory */
+    size_t rows;
+    size_t dims;
+    const char* const* source_files;
+    const char* provider;
+    batch_entry_t* entries;         /* One per row, past the batch's count */
+    char header[EB_NPY_HEADER_MAX]; /* .npy header every row shares */
+    size_t header_size;
+    size_t next_block;
+    eb_status_t status;             /* First failure */
+} batch_rows_t;
+
+/* Claim blocks of rows until none are left or one has failed */
+static void batch_rows_worker(void* arg) {
+    batch_rows_t* job = arg;
+    eb_store_batch_t* batch = job->batch;
+    eb_set_index_t* index = batch->index;
+
+    // One payload per thread; rows are read into it behind the header
+    size_t size = job->header_size + job->dims * sizeof(float);
+    uint8_t* payload = malloc(size);
+    if (!payload) {
+        eb_status_t expected = EB_SUCCESS;
+        __atomic_compare_exchange_n(&job->status, &expected, EB_ERROR_MEMORY_ALLOCATION, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        return;
     }
+    memcpy(payload, job->header, job->header_size);
+    float* values = (float*)(payload + job->header_size);
 
-    // First pass: count entries for this source
-    char line[PATH_MAX + 128]; // Path + hash + timestamp + provider
-    size_t version_count = 0;
-    
-    while (fgets(line, sizeof(line), f)) {
-        char file_path[PATH_MAX];
-        char hash[65];
-        char timestamp[32];
-        char provider[32];
-        
-        if (sscanf(line, "%s %s %s %s", file_path, hash, timestamp, provider) == 4) {
-            if (strcmp(file_path, source) == 0) {
-                version_count++;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * BATCH_ROW_BLOCK;
+        if (first >= job->rows || __atomic_load_n(&job->status, __ATOMIC_RELAXED) != EB_SUCCESS)
+            break;
+        size_t end = job->rows - first < BATCH_ROW_BLOCK ? job->rows : first + BATCH_ROW_BLOCK;
+        for (size_t i = first; i < end; i++) {
+            if (job->array)
+                eb_array_get(job->array, i * job->dims, job->dims, values);
+            else
+                memcpy(values, job->values + i * job->dims, job->dims * sizeof(float));
+            eb_status_t status = batch_write_entry(batch, &index, payload, size, "npy",
+                                                   job->source_files[i], job->provider,
+                                                   &job->entries[i]);
+            if (status != EB_SUCCESS) {
+                eb_status_t expected = EB_SUCCESS;
+                __atomic_compare_exchange_n(&job->status, &expected, status, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                break;
             }
         }
     }
+    free(payload);
 
-    if (version_count == 0) {
-        fclose(f);
-        *out_versions = NULL;
-        *out_count = 0;
+    // Opened here only if the batch had none to share
+    if (index != batch->index)
+        eb_set_index_close(index);
+}
+
+/*
+ * Write every row of a matrix and queue their index updates in row order.
+ * Objects are written across the shared pool; if any fails the batch is
+ * left as it was (objects already written are unreferenced until gc).
+ */
+static eb_status_t batch_add_rows(batch_rows_t* job, char (*hashes_out)[65]) {
+    eb_store_batch_t* batch = job->batch;
+    job->header_size = eb_npy_header(EB_FLOAT32, &job->dims, 1, job->header);
+    if (job->header_size == 0) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+    if (job->rows == 0) {
         return EB_SUCCESS;
     }
+    eb_status_t status = batch_reserve(batch, job->rows);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    job->entries = batch->entries + batch->count;
+    memset(job->entries, 0, job->rows * sizeof(*job->entries));
 
-    // Allocate array for versions
-    eb_stored_vector_t* versions = malloc(version_count * sizeof(eb_stored_vector_t));
-    if (!versions) {
-        fclose(f);
-        return EB_ERROR_MEMORY_ALLOCATION;
+    // Open the delta bases once, for every thread to share
+    if (!batch->index && eb_object_delta(batch->store.storage_path) &&
+        eb_set_index_open_current(batch->store.storage_path, &batch->index) != EB_SUCCESS) {
+        batch->index = NULL;
     }
 
-    // Second pass: read entries
-    rewind(f);
-    size_t idx = 0;
-    
-    while (fgets(line, sizeof(line), f) && idx < version_count) {
-        char file_path[PATH_MAX];
-        char hash[65];
-        char timestamp[32];
-        char provider[32];
-        
-        if (sscanf(line, "%s %s %s %s", file_path, hash, timestamp, provider) == 4) {
-            if (strcmp(file_path, source) == 0) {
-                // Initialize version entry
-                versions[idx].id = idx + 1; // Simple sequential ID
-                
-                // Parse timestamp
-                struct tm tm = {0};
-                strptime(timestamp, "%Y-%m-%dT%H:%M:%SZ", &tm);
-                versions[idx].timestamp = mktime(&tm);
-                
-                versions[idx].embedding = NULL; // Don't load embedding for history
-                versions[idx].metadata = NULL;
-                versions[idx].model_version = strdup(provider);
-                versions[idx].next = (idx < version_count - 1) ? &versions[idx + 1] : NULL;
-                
-                // Store hash and metadata
-                eb_metadata_t* hash_meta;
-                eb_metadata_create("hash", hash, &hash_meta);
-                eb_metadata_t* ts_meta;
-                eb_metadata_create("timestamp", timestamp, &ts_meta);
-                eb_metadata_t* provider_meta;
-                eb_metadata_create("provider", provider, &provider_meta);
-                
-                hash_meta->next = ts_meta;
-                ts_meta->next = provider_meta;
-                versions[idx].metadata = hash_meta;
-                
-                idx++;
-            }
+    job->next_block = 0;
+    job->status = EB_SUCCESS;
+    eb_parallel_run(NULL, eb_pool_threads(0, (job->rows + BATCH_ROW_BLOCK - 1) / BATCH_ROW_BLOCK),
+                    batch_rows_worker, job);
+
+    if (job->status != EB_SUCCESS) {
+        for (size_t i = 0; i < job->rows; i++) {
+            free(job->entries[i].source);
+            free(job->entries[i].provider);
         }
+        return job->status;
     }
-
-    fclose(f);
-    *out_versions = versions;
-    *out_count = version_count;
+    if (hashes_out) {
+        for (size_t i = 0; i < job->rows; i++) {
+            memcpy(hashes_out[i], job->entries[i].hash, 65);
+        }
+    }
+    batch->count += job->rows;
     return EB_SUCCESS;
 }
 
-static eb_status_t create_binary_delta(const char* base_path, const char* new_path, const char* delta_path) {
-    DEBUG_PRINT("create_binary_delta: Creating delta between %s and %s\n", base_path, new_path);
-    
-    FILE* base = fopen(base_path, "rb");
-    FILE* new_file = fopen(new_path, "rb");
-    FILE* delta = fopen(delta_path, "wb");
-    
-    if (!base || !new_file || !delta) {
-        if (base) fclose(base);
-        if (new_file) fclose(new_file);
-        if (delta) fclose(delta);
-        DEBUG_PRINT("create_binary_delta: Failed to open files\n");
-        return EB_ERROR_FILE_IO;
+/* The embeddings of a file and their shape */
+static eb_status_t open_embeddings(const char* embedding_path, size_t dims_hint,
+                                   eb_embedding_file_t** file_out, const eb_array_t** array_out,
+                                   size_t* rows_out, size_t* dims_out) {
+    eb_status_t status = eb_embedding_file_open(embedding_path, dims_hint, file_out);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    *array_out = eb_embedding_file_embeddings(*file_out);
+    status = *array_out ? eb_array_rows(*array_out, rows_out, dims_out) : EB_ERROR_INVALID_FORMAT;
+    if (status != EB_SUCCESS) {
+        eb_embedding_file_close(*file_out);
+        *file_out = NULL;
     }
+    return status;
+}
 
-    // Write delta header
-    uint32_t magic = 0x3E42444C;  // "EBD>" magic number
-    uint32_t version = 1;
-    if (fwrite(&magic, sizeof(magic), 1, delta) != 1 ||
-        fwrite(&version, sizeof(version), 1, delta) != 1) {
-        DEBUG_PRINT("create_binary_delta: Failed to write header\n");
-        goto cleanup;
+eb_status_t eb_store_batch_add(eb_store_batch_t* batch, const char* embedding_path,
+                               const char* source_file, const char* provider,
+                               char hash_out[65]) {
+    if (!batch || !embedding_path || !source_file) {
+        return EB_ERROR_INVALID_INPUT;
     }
 
-    // Read files in chunks and find differences
-    unsigned char base_buf[8192];
-    unsigned char new_buf[8192];
-    size_t base_read, new_read;
-    uint64_t offset = 0;
+    eb_embedding_file_t* file;
+    const eb_array_t* array;
+    size_t rows, dims;
+    eb_status_t status = open_embeddings(embedding_path, 0, &file, &array, &rows, &dims);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    if (rows != 1) {
+        DEBUG_WARN("%s holds %zu embeddings; store them with eb_store_batch_add_rows()",
+                   embedding_path, rows);
+        eb_embedding_file_close(file);
+        return EB_ERROR_DIMENSION_MISMATCH;
+    }
+
+    // A float32 .npy vector or bare floats are stored straight from the mapping
+    const char* file_type = strrchr(embedding_path, '.');
+    if (!eb_embedding_file_is_numpy(file) ||
+        (array->name[0] == '\0' && array->dtype == EB_FLOAT32 && array->ndim == 1)) {
+        size_t size;
+        const void* bytes = eb_embedding_file_bytes(file, &size);
+        status = batch_add_payload(batch, bytes, size, file_type ? file_type + 1 : "",
+                                   source_file, provider, hash_out);
+    } else {
+        void* payload;
+        size_t size;
+        status = row_payload(array, 0, dims, &payload, &size);
+        if (status == EB_SUCCESS) {
+            status = batch_add_payload(batch, payload, size, "npy", source_file, provider, hash_out);
+            free(payload);
+        }
+    }
+    eb_embedding_file_close(file);
+    return status;
+}
 
-    while (1) {
-        base_read = fread(base_buf, 1, sizeof(base_buf), base);
-        new_read = fread(new_buf, 1, sizeof(new_buf), new_file);
+eb_status_t eb_store_batch_add_rows(eb_store_batch_t* batch, const char* embedding_path,
+                                    size_t dims_hint, const char* const* source_files,
+                                    size_t count, const char* provider, char (*hashes_out)[65]) {
+    if (!batch || !embedding_path || (!source_files && count)) {
+        return EB_ERROR_INVALID_INPUT;
+    }
 
-        if (base_read == 0 && new_read == 0) break;
+    eb_embedding_file_t* file;
+    const eb_array_t* array;
+    size_t rows, dims;
+    eb_status_t status = open_embeddings(embedding_path, dims_hint, &file, &array, &rows, &dims);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+    if (rows != count) {
+        DEBUG_WARN("%s holds %zu embeddings for %zu source files", embedding_path, rows, count);
+        eb_embedding_file_close(file);
+        return EB_ERROR_DIMENSION_MISMATCH;
+    }
 
-        // Compare chunks
-        size_t min_size = base_read < new_read ? base_read : new_read;
-        size_t i = 0;
-        
-        while (i < min_size) {
-            // Find start of difference
-            size_t start = i;
-            while (i < min_size && base_buf[i] == new_buf[i]) i++;
-            
-            // If we found a difference or reached end
-            if (i < min_size || base_read != new_read) {
-                // Find end of difference
-                size_t end = i;
-                while (end < min_size && end - i < 255 && base_buf[end] != new_buf[end]) end++;
-                
-                // Write delta command
-                uint64_t cmd_offset = offset + start;
-                uint8_t cmd_size = end - i;
-                if (fwrite(&cmd_offset, sizeof(cmd_offset), 1, delta) != 1 ||
-                    fwrite(&cmd_size, sizeof(cmd_size), 1, delta) != 1 ||
-                    fwrite(new_buf + i, 1, cmd_size, delta) != 1) {
-                    DEBUG_PRINT("create_binary_delta: Failed to write delta command\n");
-                    goto cleanup;
+    batch_rows_t job = {
+        .batch = batch,
+        .array = array,
+        .rows = count,
+        .dims = dims,
+        .source_files = source_files,
+        .provider = provider,
+    };
+    status = batch_add_rows(&job, hashes_out);
+    eb_embedding_file_close(file);
+    return status;
+}
+
+eb_status_t eb_store_batch_add_matrix(eb_store_batch_t* batch, const float* values,
+                                      size_t rows, size_t dims,
+                                      const char* const* source_files,
+                                      const char* provider, char (*hashes_out)[65]) {
+    if (!batch || dims == 0 || (rows && (!values || !source_files))) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+
+    batch_rows_t job = {
+        .batch = batch,
+        .values = values,
+        .rows = rows,
+        .dims = dims,
+        .source_files = source_files,
+        .provider = provider,
+    };
+    return batch_add_rows(&job, hashes_out);
+}
+
+eb_status_t eb_store_batch_commit(eb_store_batch_t* batch) {
+    if (!batch) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+    EB_TRACE_SCOPE("store/batch_commit");
+
+    eb_status_t status = EB_SUCCESS;
+    if (batch->count > 0 && batch->store.defer_sync) {
+        // Objects and metadata reach the disk before the index names them
+        status = eb_fs_sync_all(batch->store.storage_path);
+    }
+    if (status == EB_SUCCESS && batch->count > 0) {
+        batch_lookup_t lookup;
+        status = batch_lookup_build(batch, &lookup);
+        if (status == EB_SUCCESS) {
+            status = update_set_index(batch);
+            if (status == EB_SUCCESS) {
+                if (append_batch_history(batch) != EB_SUCCESS) {
+                    fprintf(stderr, "Warning: Failed to update history\n");
+                }
+                update_model_refs(&lookup);
+                update_head(batch->store.storage_path);
+                if (batch->stat_cache && eb_stat_cache_save(batch->stat_cache) != EB_SUCCESS) {
+                    DEBUG_PRINT("eb_store_batch_commit: Failed to save stat cache\n");
                 }
-                
-                i = end;
             }
+            batch_lookup_free(&lookup);
         }
-        
-        offset += min_size;
     }
 
-    // Handle remaining data in new file
-    if (new_read > base_read) {
-        uint64_t cmd_offset = offset + base_read;
-        uint8_t cmd_size = new_read - base_read;
-        if (fwrite(&cmd_offset, sizeof(cmd_offset), 1, delta) != 1 ||
-            fwrite(&cmd_size, sizeof(cmd_size), 1, delta) != 1 ||
-            fwrite(new_buf + base_read, 1, cmd_size, delta) != 1) {
-            DEBUG_PRINT("create_binary_delta: Failed to write remaining data\n");
-            goto cleanup;
-        }
+    eb_store_batch_abort(batch);
+    return status;
+}
+
+void eb_store_batch_abort(eb_store_batch_t* batch) {
+    if (!batch) {
+        return;
+    }
+    for (size_t i = 0; i < batch->count; i++) {
+        free(batch->entries[i].source);
+        free(batch->entries[i].provider);
+    }
+    free(batch->entries);
+    eb_stat_cache_close(batch->stat_cache);
+    eb_set_index_close(batch->index);
+    store_close_filter(&batch->store);
+    eb_pack_close(batch->store.packs);
+    pthread_mutex_destroy(&batch->store.packs_lock);
+    free(batch->store.storage_path);
+    free(batch);
+}
+
+eb_status_t store_embedding_file(const char* embedding_path, const char* source_file,
+                               const char* base_dir, const char* provider, eb_dtype_t dtype) {
+    if (!embedding_path || !source_file || !base_dir) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+
+    printf("Storing embedding file: %s\n", embedding_path);
+    printf("Source file: %s\n", source_file);
+    printf("Base directory: %s\n", base_dir);
+
+    eb_store_batch_t* batch;
+    eb_status_t status = eb_store_batch_begin(base_dir, &batch);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+
+    status = eb_store_batch_set_dtype(batch, dtype);
+    if (status != EB_SUCCESS) {
+        eb_store_batch_abort(batch);
+        return status;
     }
 
-    fclose(base);
-    fclose(new_file);
-    fclose(delta);
+    char hash_str[65];
+    status = eb_store_batch_add(batch, embedding_path, source_file, provider, hash_str);
+    if (status != EB_SUCCESS) {
+        eb_store_batch_abort(batch);
+        return status;
+    }
+
+    status = eb_store_batch_commit(batch);
+    if (status != EB_SUCCESS) {
+        return status;
+    }
+
+    printf("Successfully stored embedding with hash: %s\n", hash_str);
+
     return EB_SUCCESS;
+}
 
-cleanup:
-    fclose(base);
-    fclose(new_file);
-    fclose(delta);
-    return EB_ERROR_FILE_IO;
+eb_status_t eb_source_file_hash(const char* file_path, char* hash_out, size_t hash_size) {
+    return eb_source_file_hash_with(file_path, EB_HASH_SHA256, hash_out, hash_size);
 }
 
-static eb_status_t apply_binary_delta(const char* base_path, const char* delta_path, const char* output_path) {
-    DEBUG_PRINT("apply_binary_delta: Applying delta from %s using base %s\n", delta_path, base_path);
-    
-    FILE* base = fopen(base_path, "rb");
-    FILE* delta = fopen(delta_path, "rb");
-    FILE* output = fopen(output_path, "wb");
-    
-    if (!base || !delta || !output) {
-        if (base) fclose(base);
-        if (delta) fclose(delta);
-        if (output) fclose(output);
-        DEBUG_PRINT("apply_binary_delta: Failed to open files\n");
-        return EB_ERROR_FILE_IO;
+/* BLAKE3 of a whole mapped file, so its subtrees can be hashed in parallel */
+static bool map_and_hash(int fd, uint8_t hash[32]) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    if (st.st_size == 0) {
+        eb_blake3(NULL, 0, hash);
+        return true;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return false;
+    eb_blake3(map, (size_t)st.st_size, hash);
+    munmap(map, (size_t)st.st_size);
+    return true;
+}
+
+eb_status_t eb_source_file_hash_with(const char* file_path, eb_hash_algo_t algo,
+                                     char* hash_out, size_t hash_size) {
+    if (!file_path || !hash_out || hash_size < 65 || algo > EB_HASH_ALGO_MAX) {
+        return EB_ERROR_INVALID_INPUT;
     }
 
-    // Read and verify delta header
-    uint32_t magic, version;
-    if (fread(&magic, sizeof(magic), 1, delta) != 1 ||
-        fread(&version, sizeof(version), 1, delta) != 1 ||
-        magic != 0x3E42444C || version != 1) {
-        DEBUG_PRINT("apply_binary_delta: Invalid delta header\n");
-        goto cleanup;
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        return EB_ERROR_FILE_IO;
     }
 
-    // Copy base file to output
-    char buffer[8192];
-    size_t n;
-    while ((n = fread(buffer, 1, sizeof(buffer), base)) > 0) {
-        if (fwrite(buffer, 1, n, output) != n) {
-            DEBUG_PRINT("apply_binary_delta: Failed to copy base file\n");
-            goto cleanup;
-        }
+    unsigned char hash_result[32];
+    if (algo == EB_HASH_BLAKE3 && map_and_hash(fd, hash_result)) {
+        close(fd);
+        hash_to_hex(hash_result, hash_out);
+        return EB_SUCCESS;
     }
 
-    // Apply delta commands
-    uint64_t cmd_offset;
-    uint8_t cmd_size;
-    
-    while (fread(&cmd_offset, sizeof(cmd_offset), 1, delta) == 1) {
-        if (fread(&cmd_size, sizeof(cmd_size), 1, delta) != 1) {
-            DEBUG_PRINT("apply_binary_delta: Failed to read command size\n");
-            goto cleanup;
-        }
+    // Anything that cannot be mapped is streamed
+    digest_t digest;
+    if (!digest_begin(&digest, algo)) {
+        close(fd);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
 
-        // Seek to position in output file
-        if (fseek(output, cmd_offset, SEEK_SET) != 0) {
-            DEBUG_PRINT("apply_binary_delta: Failed to seek in output file\n");
-            goto cleanup;
+    unsigned char buffer[65536];
+    size_t total_bytes = 0;
+    bool ok = true;
+    ssize_t bytes_read;
+    while (ok && (bytes_read = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (bytes_read < 0) {
+            if (errno == EINTR)
+                continue;
+            ok = false;
+            break;
         }
+        ok = digest_update(&digest, buffer, (size_t)bytes_read);
+        total_bytes += (size_t)bytes_read;
+    }
+    close(fd);
+    DEBUG_PRINT("eb_source_file_hash: Hashed %zu bytes of data\n", total_bytes);
 
-        // Read and write modified data
-        unsigned char mod_data[255];  // Max cmd_size is 255
-        if (fread(mod_data, 1, cmd_size, delta) != cmd_size ||
-            fwrite(mod_data, 1, cmd_size, output) != cmd_size) {
-            DEBUG_PRINT("apply_binary_delta: Failed to apply modification\n");
-            goto cleanup;
-        }
+    digest_end(&digest, ok, hash_result);
+    if (!ok) {
+        DEBUG_PRINT("eb_source_file_hash: Failed to read %s\n", file_path);
+        return EB_ERROR_FILE_IO;
     }
 
-    fclose(base);
-    fclose(delta);
-    fclose(output);
+    // Convert to hex string
+    hash_to_hex(hash_result, hash_out);
+    DEBUG_PRINT("eb_source_file_hash: Generated hash %s\n", hash_out);
     return EB_SUCCESS;
+}
+
+/* Objects are never rewritten in place, so a copy may share the source's inode */
+static eb_status_t copy_file(const char* src, const char* dst) {
+    eb_status_t status = eb_fs_copy_file(src, dst, EB_FS_COPY_ALLOW_LINK, NULL);
+    return status == EB_SUCCESS ? EB_SUCCESS : EB_ERROR_FILE_IO;
+}
 
-cleanup:
-    fclose(base);
-    fclose(delta);
-    fclose(output);
-    return EB_ERROR_FILE_IO;
+/* Versions collected from the set log, oldest first */
+struct version_history_ctx {
+    eb_stored_vector_t* versions;
+    size_t count;
+    size_t capacity;
+    eb_arena_t* arena;          /* Strings and metadata of every version */
+    bool failed;
+};
+
+static int collect_version(const eb_log_entry_t* entry, void* data) {
+    struct version_history_ctx* ctx = data;
+    if (entry->removed)
+        return 0;
+    if (ctx->count == ctx->capacity) {
+        size_t capacity = ctx->capacity ? ctx->capacity * 2 : 8;
+        eb_stored_vector_t* grown = realloc(ctx->versions, capacity * sizeof(*grown));
+        if (!grown) {
+            ctx->failed = true;
+            return 1;
+        }
+        ctx->versions = grown;
+        ctx->capacity = capacity;
+    }
+
+    // Store hash and metadata in the query arena, nothing per version is malloc'd
+    char timestamp[32];
+    snprintf(timestamp, sizeof(timestamp), "%ld", (long)entry->timestamp);
+    const char* keys[] = { "hash", "timestamp", "provider" };
+    const char* values[] = { entry->hash, timestamp, entry->model };
+    eb_meta_blob_t* meta = eb_meta_blob_build(ctx->arena, keys, values, 3);
+    eb_metadata_t* list = meta ? eb_meta_blob_list(ctx->arena, meta) : NULL;
+    if (!list) {
+        ctx->failed = true;
+        return 1;
+    }
+
+    eb_stored_vector_t* version = &ctx->versions[ctx->count];
+    memset(version, 0, sizeof(*version));
+    version->id = ctx->count + 1; // Simple sequential ID
+    version->timestamp = (uint64_t)entry->timestamp;
+    version->model_version = (char*)eb_meta_blob_value(meta, 2);
+    version->meta = meta;
+    version->metadata = list;
+    version->arena = ctx->arena;
+
+    ctx->count++;
+    return 0;
+}
+
+/* Get version history for a file */
+eb_status_t get_version_history(const char* root, const char* source,
+                              eb_stored_vector_t** out_versions, size_t* out_count) {
+    (void)root;
+    *out_versions = NULL;
+    *out_count = 0;
+
+    // Use per-set log file, read through its index
+    char* log_path = get_current_set_log_path();
+    if (!log_path)
+        return EB_SUCCESS; // No history is not an error
+
+    struct version_history_ctx ctx = { NULL, 0, 0, eb_arena_create(16384), false };
+    if (!ctx.arena) {
+        free(log_path);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    eb_status_t status = eb_log_foreach_source(log_path, source, collect_version, &ctx);
+    free(log_path);
+    if (status == EB_SUCCESS && ctx.failed)
+        status = EB_ERROR_MEMORY_ALLOCATION;
+    if (status != EB_SUCCESS || ctx.count == 0) {
+        free(ctx.versions);
+        eb_arena_free(ctx.arena);
+        return status;
+    }
+
+    for (size_t i = 0; i + 1 < ctx.count; i++)
+        ctx.versions[i].next = &ctx.versions[i + 1];
+
+    *out_versions = ctx.versions;
+    *out_count = ctx.count;
+    return EB_SUCCESS;
 }
 
 eb_status_t get_current_hash_with_model(const char* root, const char* source, const char* model, char* hash_out, size_t hash_size) {
@@ -2652,14 +3395,20 @@ eb_status_t get_current_hash_with_model(const char* root, const char* source, co
                             char timestamp[32], log_hash[65], log_file[PATH_MAX], provider[32];
                             log_line[strcspn(log_line, "\n")] = 0;
                             
-                            if (sscanf(log_line, "%s %s %s %s", timestamp, log_hash, log_file, provider) == 4) {
-                                if (strcmp(log_file, rel_source) == 0 && 
-                                    strcmp(provider, model) == 0 && 
-                                    strcmp(log_hash, line) == 0) {
-                                    // Found a matching entry for this file, model, and hash
-                                    hash_verified = true;
-                                    break;
-                                }
+                            int fields = sscanf(log_line, "%s %s %s %s", timestamp, log_hash, log_file, provider);
+                            if (fields < 3 || strcmp(log_file, rel_source) != 0)
+                                continue;
+                            if (fields == 3)
+                                provider[0] = '\0';
+
+                            // Found a matching entry for this file, model, and hash,
+                            // unless a later tombstone removed it
+                            if (strcmp(log_hash, EB_LOG_TOMBSTONE) == 0) {
+                                if (eb_log_tombstone_covers(provider, model))
+                                    hash_verified = false;
+                            } else if (fields == 4 && strcmp(provider, model) == 0 &&
+                                       strcmp(log_hash, line) == 0) {
+                                hash_verified = true;
                             }
                         }
                         fclose(log_fp);
@@ -2689,66 +3438,15 @@ eb_status_t get_current_hash_with_model(const char* root, const char* source, co
 
     // Removed HEAD file check as it's not needed and used by another command
 
-    // If not found in refs/models, check index file for this source file and model
-    // Use per-set index file
-    char* index_path = get_current_set_index_path();
-    DEBUG_PRINT("get_current_hash_with_model: Checking index file: %s\n", index_path);
-    FILE* index_fp = fopen(index_path, "r");
-    if (index_fp) {
-        char line[2048];
-        bool found = false;
-
-        while (fgets(line, sizeof(line), index_fp)) {
-            line[strcspn(line, "\n")] = 0;
-            DEBUG_PRINT("get_current_hash_with_model: Processing index line: %s\n", line);
-            
-            char idx_hash[65], idx_path[PATH_MAX];
-            
-            // Parse line format "hash source"
-            if (sscanf(line, "%s %s", idx_hash, idx_path) == 2) {
-                DEBUG_PRINT("get_current_hash_with_model: Index parsed: hash=%s, file=%s\n", 
-                           idx_hash, idx_path);
-                
-                if (strcmp(idx_path, rel_source) == 0) {
-                    DEBUG_PRINT("get_current_hash_with_model: Index match found for file\n");
-                    
-                    // Check if this is the right model
-                    char meta_path[PATH_MAX];
-                    snprintf(meta_path, sizeof(meta_path), "%s/.embr/objects/%s.meta", root, idx_hash);
-                    
-                    FILE* meta_fp = fopen(meta_path, "r");
-                    if (meta_fp) {
-                        char meta_line[1024];
-                        while (fgets(meta_line, sizeof(meta_line), meta_fp)) {
-                            meta_line[strcspn(meta_line, "\n")] = 0;
-                            
-                            if (strncmp(meta_line, "model=", strlen("model=")) == 0) {
-                                char provider[32];
-                                if (sscanf(meta_line, "model=%s", provider) == 1) {
-                                    DEBUG_PRINT("get_current_hash_with_model: Provider from metadata: %s\n", provider);
-                                    
-                                    if (strcmp(provider, model) == 0) {
-                                        DEBUG_PRINT("get_current_hash_with_model: Model match found in index: %s\n", idx_hash);
-                                        strncpy(hash_out, idx_hash, hash_size - 1);
-                                        hash_out[hash_size - 1] = '\0';
-                                        found = true;
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                        fclose(meta_fp);
-                        
-                        if (found) {
-                            fclose(index_fp);
-                            return EB_SUCCESS;
-                        }
-                    }
-                }
-            }
+    // If not found in refs/models, check the per-set index for this source file and model
+    eb_set_index_t* index;
+    if (eb_set_index_open_current(root, &index) == EB_SUCCESS) {
+        eb_status_t lookup = eb_set_index_lookup(index, rel_source, model, hash_out);
+        eb_set_index_close(index);
+        if (lookup == EB_SUCCESS) {
+            DEBUG_PRINT("get_current_hash_with_model: Model match found in index: %s\n", hash_out);
+            return EB_SUCCESS;
         }
-        fclose(index_fp);
-        free(index_path);
     }
     
     // If not found in index, fall back to history file
@@ -2760,6 +3458,7 @@ eb_status_t get_current_hash_with_model(const char* root, const char* source, co
     FILE* fp = fopen(log_path2, "r");
     if (!fp) {
         DEBUG_PRINT("get_current_hash_with_model: Could not open history file\n");
+        free(log_path2);
         return EB_ERROR_NOT_FOUND;
     }
     DEBUG_PRINT("get_current_hash_with_model: Successfully opened history file\n");
@@ -2778,6 +3477,14 @@ eb_status_t get_current_hash_with_model(const char* root, const char* source, co
         DEBUG_PRINT("get_current_hash_with_model: Parsed %d fields: timestamp=%s, hash=%s, file=%s, model=%s\n", 
                    parsed, timestamp, hash, file, parsed >= 4 ? provider : "N/A");
         
+        // A tombstone ends the history logged before it, of every model if it has none
+        if (parsed >= 3 && strcmp(hash, EB_LOG_TOMBSTONE) == 0) {
+            if (strcmp(file, rel_source) == 0 &&
+                eb_log_tombstone_covers(parsed == 4 ? provider : "", model))
+                found = false;
+            continue;
+        }
+
         if (parsed == 4) {
             DEBUG_PRINT("get_current_hash_with_model: Comparing file [%s] with [%s] and provider [%s] with [%s]\n", 
                        file, rel_source, provider, model);
@@ -13,17 +13,32 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "types.h"
 #include "embedding.h"
+#include "quantize.h"
 
 #define EB_INVALID_ARGS EB_ERROR_INVALID_INPUT
 #define EB_NOT_FOUND EB_ERROR_NOT_FOUND
 
-/* Core store structure */
+/*
+ * Core store structure
+ *
+ * Object reads and writes through one store may run on any number of
+ * threads at once. The in-memory vector table (eb_store_init_memory() and
+ * friends) is not locked.
+ */
+struct eb_memory_table;
+
 struct eb_store {
         char* storage_path;          /* Path to storage root */
-        eb_stored_vector_t* vectors; /* Vector storage array */
+        struct eb_memory_table* memory; /* Rows of a ":memory:" store, NULL otherwise */
         size_t vector_count;         /* Number of stored vectors */
+        struct eb_pack_set* packs;   /* Packfiles, opened on first use */
+        pthread_mutex_t packs_lock;  /* Guards packs */
+        bool defer_sync;             /* Objects are flushed at the batch commit */
+        struct eb_bloom* filter;     /* Objects that may exist (bloom.h), opened on first write */
+        bool filter_opened;          /* Set once filter is opened or failed to open */
 };
 
 /*
@@ -58,6 +73,16 @@ eb_status_t eb_store_get_latest(
         eb_stored_vector_t** vectors
 );
 
+/* Versions of a memory store vector stored between two times, oldest first */
+eb_status_t eb_get_vector_evolution(
+        eb_store_t* store,
+        uint64_t vector_id,
+        uint64_t from_time,
+        uint64_t to_time,
+        eb_stored_vector_t** out_versions,
+        size_t* out_count
+);
+
 void eb_destroy_stored_vectors(eb_stored_vector_t* versions, size_t count);
 
 /*
@@ -121,7 +146,7 @@ eb_status_t eb_get_ref(
 #ifdef EB_ENABLE_MEMORY_STORE
 /*
  * Memory-only storage backend
- * Used for testing and temporary storage
+ * Used for testing and temporary storage; see memory_store.h
  */
 eb_status_t eb_store_init_memory(eb_store_t** out);
 
@@ -141,12 +166,163 @@ eb_status_t eb_get_vector_memory(
 );
 #endif /* EB_ENABLE_MEMORY_STORE */
 
-/* Store metadata object */
+/* Store an embedding file, quantized to dtype unless it is EB_FLOAT32 */
 eb_status_t store_embedding_file(const char* embedding_path,
                                 const char* source_file,
                                 const char* base_dir,
-                                const char* provider);
+                                const char* provider,
+                                eb_dtype_t dtype);
+
+/*
+ * Batch ingest
+ * Objects are written as they are added; the set index, log and model
+ * refs are rewritten once at commit instead of once per embedding.
+ */
+typedef struct eb_store_batch eb_store_batch_t;
+
+/**
+ * Start a batch of embedding files to store
+ *
+ * @param base_dir Repository root
+ * @param out Receives the batch
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_store_batch_begin(const char* base_dir, eb_store_batch_t** out);
+
+/**
+ * Store the embeddings added from now on in a reduced dtype
+ *
+ * Float32 embedding files are quantized on ingest (see quantize.h);
+ * EB_FLOAT32, the default, stores files unchanged.
+ *
+ * @param batch Batch from eb_store_batch_begin()
+ * @param dtype EB_FLOAT32, EB_FLOAT16, EB_BFLOAT16 or EB_INT8
+ * @return Status code (0 = success, EB_ERROR_INVALID_INPUT for other dtypes)
+ */
+eb_status_t eb_store_batch_set_dtype(eb_store_batch_t* batch, eb_dtype_t dtype);
+
+/**
+ * Write an embedding object and its metadata, queue its index update
+ *
+ * A later add for the same source and provider replaces an earlier one.
+ * The file is read through embedding_file.h; float32 .npy vectors and
+ * .bin files are stored as they are, other dtypes and one-row matrices
+ * as a float32 .npy vector.
+ *
+ * @param batch Batch from eb_store_batch_begin()
+ * @param embedding_path Embedding file to store (.npy, .npz or .bin)
+ * @param source_file Source file the embedding belongs to
+ * @param provider Model name, may be NULL
+ * @param hash_out Optional buffer for the object hash
+ * @return Status code (0 = success, EB_ERROR_DIMENSION_MISMATCH for a
+ *         file holding several embeddings)
+ */
+eb_status_t eb_store_batch_add(eb_store_batch_t* batch,
+                               const char* embedding_path,
+                               const char* source_file,
+                               const char* provider,
+                               char hash_out[65]);
+
+/**
+ * Store each row of an N x D matrix as the embedding of one source file
+ *
+ * Rows are viewed in the mapped file and each is written as a float32
+ * .npy vector object. Rows are hashed, compressed and written across the
+ * shared thread pool (thread_pool.h) and queued in row order; if any
+ * fails, none of them are added to the batch.
+ *
+ * @param batch Batch from eb_store_batch_begin()
+ * @param embedding_path Matrix file (.npy, .npz or .bin)
+ * @param dims_hint Values per row of a .bin file, ignored for NumPy files
+ * @param source_files One source file per row
+ * @param count Number of source files, must equal the number of rows
+ * @param provider Model name, may be NULL
+ * @param hashes_out Optional buffer for count object hashes
+ * @return Status code (0 = success, EB_ERROR_DIMENSION_MISMATCH if the
+ *         row count differs from count)
+ */
+eb_status_t eb_store_batch_add_rows(eb_store_batch_t* batch,
+                                    const char* embedding_path,
+                                    size_t dims_hint,
+                                    const char* const* source_files,
+                                    size_t count,
+                                    const char* provider,
+                                    char (*hashes_out)[65]);
+
+/**
+ * Store each row of an in-memory N x D float32 matrix as the embedding
+ * of one source file
+ *
+ * Rows are read where they are, so bindings can pass an array buffer
+ * without copying it first. Written across the shared thread pool like
+ * eb_store_batch_add_rows().
+ *
+ * @param batch Batch from eb_store_batch_begin()
+ * @param values rows * dims values, row-major
+ * @param rows Number of rows
+ * @param dims Values per row
+ * @param source_files One source file per row
+ * @param provider Model name, may be NULL
+ * @param hashes_out Optional buffer for rows object hashes
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_store_batch_add_matrix(eb_store_batch_t* batch,
+                                      const float* values,
+                                      size_t rows,
+                                      size_t dims,
+                                      const char* const* source_files,
+                                      const char* provider,
+                                      char (*hashes_out)[65]);
+
+/**
+ * Apply the merged index, log and model ref update and free the batch
+ *
+ * Under group durability (the default, see eb_object_durability()) the
+ * file system is flushed once first, so no index names an object a crash
+ * could lose.
+ *
+ * @param batch Batch to commit, freed even on failure
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_store_batch_commit(eb_store_batch_t* batch);
+
+/**
+ * Free a batch without updating the index
+ *
+ * Objects already written stay behind as unreferenced loose objects
+ * for gc to collect.
+ */
+void eb_store_batch_abort(eb_store_batch_t* batch);
+
+/**
+ * SHA-256 of a source file's content
+ *
+ * Recorded as source_hash in the .meta sidecar of each stored embedding,
+ * so status can tell whether a source changed after it was embedded.
+ *
+ * @param file_path File to hash
+ * @param hash_out Receives the hex hash
+ * @param hash_size Size of hash_out, at least 65
+ * @return Status code (0 = success, EB_ERROR_FILE_IO if it cannot be read)
+ */
+eb_status_t eb_source_file_hash(const char* file_path, char* hash_out, size_t hash_size);
+
+/**
+ * Hash of a source file's content with a given algorithm
+ *
+ * BLAKE3 hashes a mapped file as one tree, on several threads when it
+ * is large (blake3.h).
+ *
+ * @param file_path File to hash
+ * @param algo Algorithm, normally eb_object_hash() of the repository
+ * @param hash_out Receives the hex hash
+ * @param hash_size Size of hash_out, at least 65
+ * @return Status code (0 = success, EB_ERROR_FILE_IO if it cannot be read)
+ */
+eb_status_t eb_source_file_hash_with(const char* file_path, eb_hash_algo_t algo,
+                                     char* hash_out, size_t hash_size);
 
+/* One stored-vector record per version; history.h has the columnar form for bulk queries */
 eb_status_t get_version_history(const char* root, const char* source, 
                               eb_stored_vector_t** out_versions, size_t* out_count); 
 
@@ -156,4 +332,117 @@ eb_status_t read_object(eb_store_t* store,
                        size_t* out_size,
                        eb_object_header_t* out_header); 
 
+/*
+ * Zero-copy object access
+ * Uncompressed objects, loose or packed, are mapped read-only straight
+ * from disk. Compressed objects are decompressed into a buffer owned by
+ * the view, which is still one copy fewer than read_object().
+ */
+#define EB_OBJECT_MAP_RAW 0x1  /* Stored bytes as is: no decompression or hash check */
+#define EB_OBJECT_MAP_UNVERIFIED 0x2  /* Skip the hash check, so reading a prefix of an
+                                         uncompressed vector only faults in its pages */
+
+typedef struct {
+        eb_object_header_t header;   /* Zeroed for raw maps of records without one */
+        const void* data;            /* Payload */
+        size_t size;                 /* Payload size */
+        float norm;                  /* L2 norm stored with a vector (EB_FLAG_NORM), negative if none */
+        const void* record;          /* Stored record, header included */
+        size_t record_size;
+        void* map_base;              /* Owned by the view */
+        size_t map_size;
+        void* record_buffer;         /* Owned record read into memory, NULL if mapped */
+        void* buffer;
+        uint32_t delta_depth;        /* Deltas rebuilt to read a vector (object_delta.h), 0 for full */
+} eb_object_view_t;
+
+/**
+ * Map an object for reading
+ *
+ * The payload is not necessarily aligned for float access; copy out
+ * or use memcpy when reading values from packed objects.
+ *
+ * Deltas are rebuilt from their base; a raw map returns their stored
+ * residual, eb_delta_header_t first.
+ *
+ * @param store Store the object belongs to
+ * @param hash Full object hash
+ * @param flags 0, EB_OBJECT_MAP_RAW or EB_OBJECT_MAP_UNVERIFIED
+ * @param view Receives the view, release with eb_object_unmap()
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_map(eb_store_t* store, const char* hash, uint32_t flags,
+                          eb_object_view_t* view);
+
+/**
+ * eb_object_map() of a stored record already read into memory
+ *
+ * For readers that fetch loose object files themselves (object_reader.h).
+ *
+ * @param store Store the object belongs to, for delta bases and dictionaries
+ * @param hash Full object hash
+ * @param record Whole loose object file, malloc'd; the view owns it from
+ *               here on, and it is freed on failure
+ * @param size Bytes in record
+ * @param flags As for eb_object_map()
+ * @param view Receives the view, release with eb_object_unmap()
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_view_record(eb_store_t* store, const char* hash, void* record, size_t size,
+                                  uint32_t flags, eb_object_view_t* view);
+
+/**
+ * Release a view from eb_object_map()
+ */
+void eb_object_unmap(eb_object_view_t* view);
+
+/**
+ * View the values of a mapped vector object
+ *
+ * The reference carries the stored norm, so distance kernels can skip
+ * summing it again. Objects written before norms were stored leave it
+ * unknown, and it is computed when needed.
+ *
+ * @param view Vector object from eb_object_map()
+ * @param ref Receives the view; it points into the mapping
+ * @return Status code (0 = success, EB_ERROR_INVALID_FORMAT if the payload does not fit its dtype)
+ */
+eb_status_t eb_object_vector_ref(const eb_object_view_t* view, eb_vector_ref_t* ref);
+
+/**
+ * Copy of an object's stored record that another repository can read
+ *
+ * Vectors compressed against a dictionary are recompressed without it,
+ * since dictionaries stay in the repository that trained them, and
+ * deltas are rebuilt into full vectors. Other records are returned as
+ * stored.
+ *
+ * @param store Store the object belongs to
+ * @param hash Full object hash
+ * @param out_data Receives the record (caller must free)
+ * @param out_size Receives the record size
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_export(eb_store_t* store, const char* hash, void** out_data, size_t* out_size);
+
+/**
+ * Re-encode a loose record at storage.archive_level as it is packed
+ *
+ * Has the shape of an eb_pack_rewrite_fn, with the store as its context.
+ * Full compressed vectors are decoded, checked against their hash and
+ * compressed again at the archive level; the new record is only returned
+ * if it is smaller. Deltas, uncompressed vectors and metadata are left
+ * as they are, as is everything while no archive level is configured.
+ *
+ * @param store Store the record belongs to (eb_store_t*)
+ * @param hash Full object hash
+ * @param record Record as stored
+ * @param size Size of record
+ * @param out_data Receives the new record (caller must free), NULL to keep record
+ * @param out_size Receives the size of the new record
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_object_archive(void* store, const char* hash, const void* record, size_t size,
+                              void** out_data, size_t* out_size);
+
 #endif /* EB_STORE_H */
\ No newline at end of file
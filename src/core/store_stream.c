@@ -0,0 +1,428 @@
+/*
+ * EmbeddingBridge - Streaming Ingest
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include "store_stream.h"
+#include "store.h"
+#include "json_vector.h"
+#include "path_utils.h"
+#include "debug.h"
+
+/* Bytes asked of each read */
+#define STREAM_READ_SIZE ((size_t)64 << 10)
+
+/* Frame header: source length, model length and dims */
+#define FRAME_FIXED (2 + 2 + 4)
+
+/* The uncommitted records of one model and dimension */
+typedef struct {
+    char* model;                /* NULL for no model */
+    size_t dims;
+    float* values;              /* rows * dims */
+    char** sources;
+    size_t rows;
+    size_t capacity;
+} stream_group_t;
+
+typedef struct {
+    const char* base_dir;
+    const eb_stream_options_t* options;
+    size_t commit_records;
+    unsigned commit_ms;
+    stream_group_t* groups;
+    size_t group_count;
+    size_t pending;             /* Records across the groups */
+    uint64_t deadline;          /* Commit by then, in ms; valid while pending */
+    eb_stream_stats_t stats;
+} stream_t;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint32_t read_le16(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t read_le32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static bool same_model(const char* a, size_t a_len, const char* b) {
+    if (!b)
+        return a_len == 0;
+    return strlen(b) == a_len && memcmp(a, b, a_len) == 0;
+}
+
+static void groups_clear(stream_t* stream) {
+    for (size_t i = 0; i < stream->group_count; i++) {
+        stream_group_t* group = &stream->groups[i];
+        for (size_t j = 0; j < group->rows; j++)
+            free(group->sources[j]);
+        free(group->sources);
+        free(group->values);
+        free(group->model);
+    }
+    free(stream->groups);
+    stream->groups = NULL;
+    stream->group_count = 0;
+    stream->pending = 0;
+}
+
+/* Group for a model and dimension, added if it is new */
+static stream_group_t* group_for(stream_t* stream, const char* model, size_t model_len,
+                                 size_t dims) {
+    for (size_t i = 0; i < stream->group_count; i++) {
+        stream_group_t* group = &stream->groups[i];
+        if (group->dims == dims && same_model(model, model_len, group->model))
+            return group;
+    }
+
+    stream_group_t* groups = realloc(stream->groups, (stream->group_count + 1) * sizeof(*groups));
+    if (!groups)
+        return NULL;
+    stream->groups = groups;
+    stream_group_t* group = &groups[stream->group_count];
+    memset(group, 0, sizeof(*group));
+    group->dims = dims;
+    if (model_len) {
+        group->model = strndup(model, model_len);
+        if (!group->model)
+            return NULL;
+    }
+    stream->group_count++;
+    return group;
+}
+
+/* Usable as one field of a log line: no whitespace or control characters */
+static bool valid_field(const char* s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (iscntrl(c) || isspace(c))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * The source as embr store records it: relative to the repository root
+ * and inside it. A source naming an existing file goes through
+ * get_relative_path(), one that does not is kept as written.
+ */
+static eb_status_t stream_source(const stream_t* stream, const char* source, size_t len,
+                                 char** out) {
+    if (!valid_field(source, len) || source[0] == '/')
+        return EB_ERROR_INVALID_FORMAT;
+    for (size_t i = 0; i < len;) {
+        size_t end = i;
+        while (end < len && source[end] != '/')
+            end++;
+        if (end - i == 2 && source[i] == '.' && source[i + 1] == '.')
+            return EB_ERROR_INVALID_FORMAT;
+        i = end + 1;
+    }
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%.*s", stream->base_dir, (int)len, source) >=
+        (int)sizeof(path))
+        return EB_ERROR_INVALID_FORMAT;
+    if (access(path, F_OK) != 0) {
+        *out = strndup(source, len);
+        return *out ? EB_SUCCESS : EB_ERROR_MEMORY_ALLOCATION;
+    }
+    // Through a symlink it may resolve outside the repository
+    *out = get_relative_path(path, stream->base_dir);
+    return *out && **out ? EB_SUCCESS : EB_ERROR_INVALID_FORMAT;
+}
+
+/* Queue one record; model NULL or empty takes the default */
+static eb_status_t stream_add(stream_t* stream, const char* source, size_t source_len,
+                              const char* model, size_t model_len,
+                              const float* values, size_t dims) {
+    if (source_len == 0 || dims == 0 || (model && !valid_field(model, model_len)))
+        return EB_ERROR_INVALID_FORMAT;
+    if (!model || model_len == 0) {
+        model = stream->options->model;
+        model_len = model ? strlen(model) : 0;
+    }
+
+    char* copy = NULL;
+    eb_status_t status = stream_source(stream, source, source_len, &copy);
+    if (status != EB_SUCCESS) {
+        free(copy);
+        return status;
+    }
+
+    stream_group_t* group = group_for(stream, model, model_len, dims);
+    if (!group) {
+        free(copy);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    if (group->rows == group->capacity) {
+        size_t capacity = group->capacity ? group->capacity * 2 : 64;
+        float* grown_values = realloc(group->values, capacity * dims * sizeof(float));
+        char** grown_sources = grown_values ? realloc(group->sources, capacity * sizeof(char*)) : NULL;
+        if (grown_values)
+            group->values = grown_values;
+        if (grown_sources)
+            group->sources = grown_sources;
+        if (!grown_values || !grown_sources) {
+            free(copy);
+            return EB_ERROR_MEMORY_ALLOCATION;
+        }
+        group->capacity = capacity;
+    }
+    group->sources[group->rows] = copy;
+    memcpy(group->values + group->rows * dims, values, dims * sizeof(float));
+    group->rows++;
+
+    if (stream->pending++ == 0)
+        stream->deadline = now_ms() + stream->commit_ms;
+    return EB_SUCCESS;
+}
+
+/* Write the gathered records as one batch and commit it */
+static eb_status_t stream_commit(stream_t* stream) {
+    if (stream->pending == 0)
+        return EB_SUCCESS;
+
+    eb_store_batch_t* batch = NULL;
+    eb_status_t status = eb_store_batch_begin(stream->base_dir, &batch);
+    if (status != EB_SUCCESS) {
+        groups_clear(stream);
+        return status;
+    }
+    status = eb_store_batch_set_dtype(batch, stream->options->dtype);
+    for (size_t i = 0; i < stream->group_count && status == EB_SUCCESS; i++) {
+        stream_group_t* group = &stream->groups[i];
+        status = eb_store_batch_add_matrix(batch, group->values, group->rows, group->dims,
+                                           (const char* const*)group->sources, group->model, NULL);
+    }
+    if (status == EB_SUCCESS) {
+        status = eb_store_batch_commit(batch);
+    } else {
+        // Nothing is indexed; the objects written so far are left for gc
+        eb_store_batch_abort(batch);
+    }
+
+    size_t records = stream->pending;
+    groups_clear(stream);
+    if (status != EB_SUCCESS)
+        return status;
+
+    stream->stats.records += records;
+    stream->stats.commits++;
+    DEBUG_PRINT("store_stream: committed %zu records", records);
+    if (stream->options->on_commit)
+        stream->options->on_commit(stream->options->ctx, records);
+    return EB_SUCCESS;
+}
+
+static eb_status_t parse_line(stream_t* stream, const char* line, size_t size) {
+    while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r'))
+        size--;
+    size_t start = 0;
+    while (start < size && (line[start] == ' ' || line[start] == '\t'))
+        start++;
+    if (start == size)
+        return EB_SUCCESS;
+
+    eb_json_vector_t vector;
+    eb_status_t status = eb_json_record_parse(line + start, size - start, &vector);
+    if (status != EB_SUCCESS)
+        return EB_ERROR_INVALID_FORMAT;
+    status = stream_add(stream, vector.source, vector.source ? strlen(vector.source) : 0,
+                        vector.model, vector.model ? strlen(vector.model) : 0,
+                        vector.values, vector.dims);
+    eb_json_vector_clear(&vector);
+    return status;
+}
+
+static eb_status_t parse_frame(stream_t* stream, const unsigned char* frame, size_t length) {
+    if (length < FRAME_FIXED)
+        return EB_ERROR_INVALID_FORMAT;
+    size_t source_len = read_le16(frame);
+    if (length < 2 + source_len + 2)
+        return EB_ERROR_INVALID_FORMAT;
+    const unsigned char* model = frame + 2 + source_len + 2;
+    size_t model_len = read_le16(model - 2);
+    if (length < 2 + source_len + 2 + model_len + 4)
+        return EB_ERROR_INVALID_FORMAT;
+    const unsigned char* body = model + model_len + 4;
+    size_t dims = read_le32(body - 4);
+    if (length - (size_t)(body - frame) != dims * sizeof(float))
+        return EB_ERROR_INVALID_FORMAT;
+
+    // Values are unaligned in the frame
+    float* values = malloc(dims ? dims * sizeof(float) : 1);
+    if (!values)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    memcpy(values, body, dims * sizeof(float));
+    eb_status_t status = stream_add(stream, (const char*)frame + 2, source_len,
+                                    (const char*)model, model_len, values, dims);
+    free(values);
+    return status;
+}
+
+/*
+ * Queue every whole record in buf, moving on to the next. At the end of
+ * the stream a last line without its newline is whole too.
+ */
+static eb_status_t parse_records(stream_t* stream, const char* buf, size_t size,
+                                 bool at_end, size_t* consumed_out) {
+    size_t pos = 0;
+    eb_status_t status = EB_SUCCESS;
+    while (pos < size && status == EB_SUCCESS) {
+        size_t length;
+        if (stream->options->format == EB_STREAM_FRAMES) {
+            if (size - pos < 4) {
+                if (at_end) {
+                    stream->stats.line++;
+                    status = EB_ERROR_INVALID_FORMAT;
+                }
+                break;
+            }
+            length = read_le32((const unsigned char*)buf + pos);
+            if (length > EB_STREAM_RECORD_MAX) {
+                stream->stats.line++;
+                status = EB_ERROR_LIMIT_EXCEEDED;
+                break;
+            }
+            if (size - pos - 4 < length) {
+                if (at_end) {
+                    stream->stats.line++;
+                    status = EB_ERROR_INVALID_FORMAT;
+                }
+                break;
+            }
+            stream->stats.line++;
+            status = parse_frame(stream, (const unsigned char*)buf + pos + 4, length);
+            length += 4;
+        } else {
+            const char* newline = memchr(buf + pos, '\n', size - pos);
+            if (!newline && !at_end) {
+                if (size - pos > EB_STREAM_RECORD_MAX) {
+                    stream->stats.line++;
+                    status = EB_ERROR_LIMIT_EXCEEDED;
+                }
+                break;
+            }
+            length = newline ? (size_t)(newline - (buf + pos)) + 1 : size - pos;
+            stream->stats.line++;
+            status = parse_line(stream, buf + pos, length);
+        }
+        if (status == EB_SUCCESS) {
+            pos += length;
+            if (stream->pending >= stream->commit_records)
+                status = stream_commit(stream);
+        }
+    }
+    *consumed_out = pos;
+    return status;
+}
+
+/* Wait for input until the pending records are due; false once they are */
+static bool wait_input(stream_t* stream, int fd) {
+    for (;;) {
+        int timeout = -1;
+        if (stream->pending) {
+            uint64_t now = now_ms();
+            if (now >= stream->deadline)
+                return false;
+            timeout = (int)(stream->deadline - now);
+        }
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready > 0)
+            return true;
+        if (ready == 0)
+            return false;
+        if (errno != EINTR)
+            return true;    // Let read() report it
+    }
+}
+
+eb_status_t eb_store_stream(const char* base_dir, int fd, const eb_stream_options_t* options,
+                            eb_stream_stats_t* stats_out) {
+    if (!base_dir || fd < 0 || !options ||
+        (options->format != EB_STREAM_NDJSON && options->format != EB_STREAM_FRAMES)) {
+        return EB_ERROR_INVALID_INPUT;
+    }
+
+    stream_t stream = {
+        .base_dir = base_dir,
+        .options = options,
+        .commit_records = options->commit_records ? options->commit_records
+                                                  : EB_STREAM_COMMIT_RECORDS,
+        .commit_ms = options->commit_ms ? options->commit_ms : EB_STREAM_COMMIT_MS,
+    };
+    size_t capacity = STREAM_READ_SIZE * 2;
+    char* buf = malloc(capacity);
+    if (!buf)
+        return EB_ERROR_MEMORY_ALLOCATION;
+
+    eb_status_t status = EB_SUCCESS;
+    size_t size = 0;
+    bool at_end = false;
+    while (status == EB_SUCCESS && !at_end) {
+        if (!wait_input(&stream, fd)) {
+            status = stream_commit(&stream);
+            continue;
+        }
+
+        if (capacity - size < STREAM_READ_SIZE) {
+            char* grown = realloc(buf, capacity * 2);
+            if (!grown) {
+                status = EB_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            buf = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, buf + size, capacity - size);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            status = EB_ERROR_IO;
+            break;
+        }
+        size += (size_t)n;
+        at_end = n == 0;
+
+        size_t consumed;
+        status = parse_records(&stream, buf, size, at_end, &consumed);
+        memmove(buf, buf + consumed, size - consumed);
+        size -= consumed;
+
+        // A stream that never pauses still commits on time
+        if (status == EB_SUCCESS && stream.pending && now_ms() >= stream.deadline)
+            status = stream_commit(&stream);
+    }
+    if (status == EB_SUCCESS)
+        status = stream_commit(&stream);
+    else
+        groups_clear(&stream);
+    free(buf);
+
+    if (stats_out)
+        *stats_out = stream.stats;
+    return status;
+}
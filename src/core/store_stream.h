@@ -0,0 +1,95 @@
+/*
+ * EmbeddingBridge - Streaming Ingest
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_STORE_STREAM_H
+#define EB_STORE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "status.h"
+#include "quantize.h"
+
+/*
+ * A continuous stream of (source, model, vector) records, from a model
+ * server writing to a pipe, stored through batches (store.h). Records are
+ * gathered per model and written with eb_store_batch_add_matrix(), and the
+ * batch is committed once it holds commit_records records or its first
+ * record is commit_ms old, whichever comes first, so a record is in a
+ * committed version milliseconds after it was written. The end of the
+ * stream commits what is left.
+ *
+ * EB_STREAM_NDJSON reads one object per line as written by `embr export
+ * --format ndjson` (json_vector.h); id and timestamp may be left out and
+ * are ignored:
+ *
+ *   {"source":"doc.txt","model":"m","values":[0.25,-1,...]}
+ *
+ * EB_STREAM_FRAMES reads length-prefixed binary frames, integers and
+ * values little-endian:
+ *
+ *   u32 length of the rest of the frame
+ *   u16 source length | source
+ *   u16 model length  | model (0 for the default model)
+ *   u32 dims          | dims float32 values
+ *
+ * Sources are paths relative to base_dir, recorded as embr store records
+ * them. A source or model with whitespace or control characters, and a
+ * source that is absolute, has a ".." component or resolves outside
+ * base_dir, make a record malformed.
+ */
+
+typedef enum {
+    EB_STREAM_NDJSON,
+    EB_STREAM_FRAMES
+} eb_stream_format_t;
+
+/* Defaults for a zero commit_records or commit_ms */
+#define EB_STREAM_COMMIT_RECORDS 4096
+#define EB_STREAM_COMMIT_MS 50
+
+/* Longest record either format accepts */
+#define EB_STREAM_RECORD_MAX ((size_t)64 << 20)
+
+/* Called after every commit with the number of records it stored */
+typedef void (*eb_stream_commit_fn)(void* ctx, size_t records);
+
+typedef struct {
+    eb_stream_format_t format;
+    const char* model;              /* Model of records naming none, may be NULL */
+    eb_dtype_t dtype;               /* Stored dtype, as eb_store_batch_set_dtype() */
+    size_t commit_records;          /* Commit after this many records */
+    unsigned commit_ms;             /* or once the oldest uncommitted one is this old */
+    eb_stream_commit_fn on_commit;  /* May be NULL */
+    void* ctx;                      /* Passed to on_commit */
+} eb_stream_options_t;
+
+typedef struct {
+    size_t records;                 /* Records committed */
+    size_t commits;
+    size_t line;                    /* Record the stream stopped at on failure, from 1 */
+} eb_stream_stats_t;
+
+/**
+ * Store records read from fd until the end of the stream
+ *
+ * A malformed record stops the stream; the records committed before it
+ * stay committed and the ones gathered since are not indexed.
+ *
+ * @param base_dir Repository root
+ * @param fd Stream to read, a pipe, socket or file
+ * @param options Format and commit policy
+ * @param stats_out Receives what was stored, may be NULL
+ * @return Status code (EB_ERROR_INVALID_FORMAT for a malformed record,
+ *         EB_ERROR_LIMIT_EXCEEDED for one over EB_STREAM_RECORD_MAX)
+ */
+eb_status_t eb_store_stream(const char* base_dir, int fd, const eb_stream_options_t* options,
+                            eb_stream_stats_t* stats_out);
+
+#endif /* EB_STORE_STREAM_H */
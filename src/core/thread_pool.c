@@ -0,0 +1,389 @@
+/*
+ * EmbeddingBridge - Shared Thread Pool Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "thread_pool.h"
+#include "debug.h"
+
+#define DEQUE_MIN_TASKS 64
+
+typedef struct {
+    eb_task_fn fn;
+    void* arg;
+    eb_task_group_t* group;
+} task_t;
+
+/* Owner end at tail, stolen from at head; count is tail - head */
+typedef struct {
+    pthread_mutex_t lock;
+    task_t* tasks;
+    size_t capacity;              /* Power of two */
+    size_t head;
+    size_t tail;
+} task_deque_t;
+
+struct eb_pool {
+    unsigned workers;
+    task_deque_t* deques;         /* One per worker */
+    pthread_t* threads;
+
+    pthread_mutex_t lock;         /* Guards sleeping and stopping */
+    pthread_cond_t wake;          /* New tasks, finished groups, stop */
+    unsigned sleepers;
+    bool stopping;
+
+    size_t queued;                /* Tasks in any deque, atomic */
+    unsigned next_deque;          /* Where outside spawns go next, atomic */
+};
+
+/* Pool the current thread works for, and its deque */
+static __thread eb_pool_t* worker_pool;
+static __thread unsigned worker_index;
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static eb_pool_t* shared_pool;
+static unsigned configured_threads;
+static bool shared_failed;
+
+static bool deque_push(task_deque_t* d, const task_t* task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->tail - d->head == d->capacity) {
+        size_t capacity = d->capacity ? d->capacity * 2 : DEQUE_MIN_TASKS;
+        task_t* grown = malloc(capacity * sizeof(*grown));
+        if (!grown) {
+            pthread_mutex_unlock(&d->lock);
+            return false;
+        }
+        for (size_t i = d->head; i != d->tail; i++)
+            grown[i & (capacity - 1)] = d->tasks[i & (d->capacity - 1)];
+        free(d->tasks);
+        d->tasks = grown;
+        d->capacity = capacity;
+    }
+    d->tasks[d->tail & (d->capacity - 1)] = *task;
+    d->tail++;
+    pthread_mutex_unlock(&d->lock);
+    return true;
+}
+
+/* Newest task, for the owner */
+static bool deque_pop(task_deque_t* d, task_t* task) {
+    pthread_mutex_lock(&d->lock);
+    bool found = d->tail != d->head;
+    if (found) {
+        d->tail--;
+        *task = d->tasks[d->tail & (d->capacity - 1)];
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/* Oldest task, for thieves */
+static bool deque_steal(task_deque_t* d, task_t* task) {
+    pthread_mutex_lock(&d->lock);
+    bool found = d->tail != d->head;
+    if (found) {
+        *task = d->tasks[d->head & (d->capacity - 1)];
+        d->head++;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/* A worker takes from its own deque first; everyone then steals in turn */
+static bool take_task(eb_pool_t* pool, task_t* task) {
+    if (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0)
+        return false;
+    unsigned start;
+    if (worker_pool == pool) {
+        if (deque_pop(&pool->deques[worker_index], task))
+            goto taken;
+        start = worker_index + 1;
+    } else {
+        start = __atomic_load_n(&pool->next_deque, __ATOMIC_RELAXED);
+    }
+    for (unsigned i = 0; i < pool->workers; i++) {
+        if (deque_steal(&pool->deques[(start + i) % pool->workers], task))
+            goto taken;
+    }
+    return false;
+
+taken:
+    __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    return true;
+}
+
+static void run_task(eb_pool_t* pool, const task_t* task) {
+    task->fn(task->arg);
+    // The group may be gone once its last task is counted; only the pool is touched after
+    if (__atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void* worker_main(void* arg) {
+    eb_pool_t* pool = arg;
+    for (;;) {
+        task_t task;
+        if (take_task(pool, &task)) {
+            run_task(pool, &task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stopping && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0) {
+            pool->sleepers++;
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            pool->sleepers--;
+        }
+        bool stop = pool->stopping && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop)
+            break;
+    }
+    return NULL;
+}
+
+/* Start routine that knows which deque it owns */
+typedef struct {
+    eb_pool_t* pool;
+    unsigned index;
+} worker_start_t;
+
+static void* worker_start(void* arg) {
+    worker_start_t start = *(worker_start_t*)arg;
+    free(arg);
+    worker_pool = start.pool;
+    worker_index = start.index;
+    return worker_main(start.pool);
+}
+
+static void stop_workers(eb_pool_t* pool, unsigned started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(pool->threads[i], NULL);
+}
+
+static void free_pool(eb_pool_t* pool) {
+    for (unsigned i = 0; i < pool->workers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    free(pool->deques);
+    free(pool->threads);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+eb_status_t eb_pool_create(unsigned workers, eb_pool_t** out) {
+    if (!out || workers > EB_POOL_MAX_WORKERS)
+        return EB_ERROR_INVALID_PARAMETER;
+    eb_pool_t* pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return EB_ERROR_MEMORY_ALLOCATION;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pool->workers = workers;
+    pool->deques = calloc(workers ? workers : 1, sizeof(*pool->deques));
+    pool->threads = calloc(workers ? workers : 1, sizeof(*pool->threads));
+    if (!pool->deques || !pool->threads) {
+        pool->workers = 0;
+        free_pool(pool);
+        return EB_ERROR_MEMORY_ALLOCATION;
+    }
+    for (unsigned i = 0; i < workers; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+    for (unsigned i = 0; i < workers; i++) {
+        worker_start_t* start = malloc(sizeof(*start));
+        if (start) {
+            *start = (worker_start_t){ pool, i };
+            if (pthread_create(&pool->threads[i], NULL, worker_start, start) == 0)
+                continue;
+            free(start);
+        }
+        DEBUG_WARN("thread_pool: could only start %u of %u workers", i, workers);
+        stop_workers(pool, i);
+        free_pool(pool);
+        return EB_ERROR_RESOURCE_EXHAUSTED;
+    }
+    *out = pool;
+    return EB_SUCCESS;
+}
+
+void eb_pool_destroy(eb_pool_t* pool) {
+    if (!pool)
+        return;
+    stop_workers(pool, pool->workers);
+    free_pool(pool);
+}
+
+void eb_pool_configure(unsigned threads) {
+    pthread_mutex_lock(&shared_lock);
+    configured_threads = threads;
+    pthread_mutex_unlock(&shared_lock);
+}
+
+static unsigned thread_budget(void) {
+    const char* env = getenv(EB_THREADS_ENV);
+    if (env && *env) {
+        char* end = NULL;
+        unsigned long threads = strtoul(env, &end, 10);
+        if (*end == '\0' && threads >= 1)
+            return threads > EB_POOL_MAX_WORKERS ? EB_POOL_MAX_WORKERS + 1 : (unsigned)threads;
+        DEBUG_WARN("thread_pool: ignoring %s=%s", EB_THREADS_ENV, env);
+    }
+    if (configured_threads)
+        return configured_threads;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : (unsigned)cpus;
+}
+
+/* A forked child has none of the parent's workers; it starts its own pool on first use */
+static void forget_shared_pool(void) {
+    pthread_mutex_init(&shared_lock, NULL);
+    shared_pool = NULL;
+    shared_failed = false;
+}
+
+eb_pool_t* eb_pool_shared(void) {
+    eb_pool_t* pool = __atomic_load_n(&shared_pool, __ATOMIC_ACQUIRE);
+    if (pool)
+        return pool;
+    pthread_mutex_lock(&shared_lock);
+    if (!shared_pool && !shared_failed) {
+        unsigned threads = thread_budget();
+        unsigned workers = threads - 1 > EB_POOL_MAX_WORKERS ? EB_POOL_MAX_WORKERS : threads - 1;
+        if (eb_pool_create(workers, &pool) == EB_SUCCESS) {
+            static bool registered = false;
+            if (!registered && pthread_atfork(NULL, NULL, forget_shared_pool) == 0)
+                registered = true;
+            DEBUG_INFO("thread_pool: %u workers", workers);
+            __atomic_store_n(&shared_pool, pool, __ATOMIC_RELEASE);
+        } else {
+            shared_failed = true;
+        }
+    }
+    pool = shared_pool;
+    pthread_mutex_unlock(&shared_lock);
+    return pool;
+}
+
+unsigned eb_pool_workers(const eb_pool_t* pool) {
+    return pool ? pool->workers : 0;
+}
+
+static unsigned capped_threads(const eb_pool_t* pool, unsigned requested, size_t blocks) {
+    unsigned available = eb_pool_workers(pool) + 1;
+    unsigned threads = requested && requested < available ? requested : available;
+    if ((size_t)threads > blocks)
+        threads = (unsigned)blocks;
+    return threads < 1 ? 1 : threads;
+}
+
+unsigned eb_pool_threads(unsigned requested, size_t blocks) {
+    return capped_threads(eb_pool_shared(), requested, blocks);
+}
+
+void eb_task_group_init(eb_task_group_t* group, eb_pool_t* pool) {
+    group->pool = pool;
+    group->pending = 0;
+}
+
+void eb_task_group_spawn(eb_task_group_t* group, eb_task_fn fn, void* arg) {
+    eb_pool_t* pool = group->pool;
+    if (!pool || pool->workers == 0) {
+        fn(arg);
+        return;
+    }
+    task_t task = { fn, arg, group };
+    unsigned d = worker_pool == pool
+                     ? worker_index
+                     : __atomic_fetch_add(&pool->next_deque, 1, __ATOMIC_RELAXED) % pool->workers;
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    if (!deque_push(&pool->deques[d], &task)) {
+        __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+        __atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+        fn(arg);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->sleepers)
+        pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void eb_task_group_wait(eb_task_group_t* group) {
+    eb_pool_t* pool = group->pool;
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        task_t task;
+        if (take_task(pool, &task)) {
+            run_task(pool, &task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0 &&
+               __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0) {
+            pool->sleepers++;
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            pool->sleepers--;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void eb_parallel_run(eb_pool_t* pool, unsigned threads, eb_task_fn fn, void* ctx) {
+    eb_task_group_t group;
+    eb_task_group_init(&group, pool ? pool : eb_pool_shared());
+    for (unsigned i = 1; i < threads; i++)
+        eb_task_group_spawn(&group, fn, ctx);
+    fn(ctx);
+    eb_task_group_wait(&group);
+}
+
+typedef struct {
+    eb_range_fn fn;
+    void* ctx;
+    size_t count;
+    size_t block;
+    size_t next_block;
+} range_job_t;
+
+static void range_worker(void* arg) {
+    range_job_t* job = arg;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED) * job->block;
+        if (first >= job->count)
+            break;
+        size_t end = job->count - first < job->block ? job->count : first + job->block;
+        job->fn(job->ctx, first, end);
+    }
+}
+
+void eb_parallel_for(eb_pool_t* pool, size_t count, size_t block, unsigned threads,
+                     eb_range_fn fn, void* ctx) {
+    if (count == 0 || !fn)
+        return;
+    if (!pool)
+        pool = eb_pool_shared();
+    range_job_t job = { fn, ctx, count, block ? block : 1, 0 };
+    eb_parallel_run(pool, capped_threads(pool, threads, (count + job.block - 1) / job.block),
+                    range_worker, &job);
+}
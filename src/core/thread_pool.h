@@ -0,0 +1,126 @@
+/*
+ * EmbeddingBridge - Shared Thread Pool
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_THREAD_POOL_H
+#define EB_THREAD_POOL_H
+
+#include <stddef.h>
+#include "status.h"
+
+/*
+ * One pool of worker threads for the CPU-bound parallel work of the core
+ * (status hashing, set diff and merge, exports, similarity), so a process
+ * never runs more of it at once than the pool allows however many features
+ * are busy.
+ *
+ * Each worker has its own deque: tasks a worker spawns go to the bottom of
+ * its deque and it takes them back from there, while idle workers steal
+ * from the top of the others'. Tasks spawned from outside the pool are
+ * dealt across the deques.
+ *
+ * Waiting for a task group helps: the waiting thread runs queued tasks
+ * until its group is done, so nested parallel loops cannot deadlock and a
+ * pool with no workers still makes progress (everything then runs on the
+ * caller).
+ *
+ * The shared pool is started on first use with one worker fewer than the
+ * thread budget, the caller being the last thread: EB_THREADS if set,
+ * else what eb_pool_configure() was given (core.threads for the CLI),
+ * else the number of online CPUs.
+ */
+
+#define EB_THREADS_ENV "EB_THREADS"
+
+/* Upper bound on workers in one pool */
+#define EB_POOL_MAX_WORKERS 256
+
+typedef struct eb_pool eb_pool_t;
+
+typedef void (*eb_task_fn)(void* arg);
+
+/* Tasks that are waited for together; lives on the caller's stack */
+typedef struct {
+    eb_pool_t* pool;
+    size_t pending;
+} eb_task_group_t;
+
+/**
+ * Start a pool of its own, for tests and callers that must not share
+ *
+ * @param workers Worker threads, 0 for none (tasks run on the waiter)
+ * @param out Receives the pool
+ * @return Status code (0 = success)
+ */
+eb_status_t eb_pool_create(unsigned workers, eb_pool_t** out);
+
+/* Stop a pool from eb_pool_create(); no group may still be pending */
+void eb_pool_destroy(eb_pool_t* pool);
+
+/*
+ * Thread budget of the shared pool, counting the caller; 0 for the
+ * default. Only takes effect before the pool is first used, and
+ * EB_THREADS overrides it.
+ */
+void eb_pool_configure(unsigned threads);
+
+/* The shared pool, started on first use; NULL only if it could not be */
+eb_pool_t* eb_pool_shared(void);
+
+/* Workers of a pool, 0 for NULL */
+unsigned eb_pool_workers(const eb_pool_t* pool);
+
+/*
+ * Threads worth asking for in one parallel call: requested if non-zero,
+ * else the shared pool's workers plus the caller, at most blocks and at
+ * least one
+ */
+unsigned eb_pool_threads(unsigned requested, size_t blocks);
+
+void eb_task_group_init(eb_task_group_t* group, eb_pool_t* pool);
+
+/*
+ * Queue fn(arg) in the group's pool; it runs on the calling thread
+ * instead if the pool is NULL or the task cannot be queued
+ */
+void eb_task_group_spawn(eb_task_group_t* group, eb_task_fn fn, void* arg);
+
+/* Run queued tasks until every task of the group has finished */
+void eb_task_group_wait(eb_task_group_t* group);
+
+/**
+ * Run fn on threads threads at once, the caller being one of them
+ *
+ * For loops that claim blocks of work until none are left and set up
+ * per-thread state (a store, scratch buffers) first. Copies beyond what
+ * the pool runs at once start later and find the work done.
+ *
+ * @param pool Pool, NULL for the shared pool
+ * @param threads Copies of fn to run, at least one
+ * @param fn Worker loop
+ * @param ctx Passed to every copy
+ */
+void eb_parallel_run(eb_pool_t* pool, unsigned threads, eb_task_fn fn, void* ctx);
+
+typedef void (*eb_range_fn)(void* ctx, size_t begin, size_t end);
+
+/**
+ * Call fn over [0, count) in blocks, on up to threads threads
+ *
+ * @param pool Pool, NULL for the shared pool
+ * @param count Items
+ * @param block Items per call, 0 for one
+ * @param threads Thread limit, 0 for the pool's
+ * @param fn Called with each block
+ * @param ctx Passed to fn
+ */
+void eb_parallel_for(eb_pool_t* pool, size_t count, size_t block, unsigned threads,
+                     eb_range_fn fn, void* ctx);
+
+#endif /* EB_THREAD_POOL_H */
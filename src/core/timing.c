@@ -0,0 +1,85 @@
+/*
+ * EmbeddingBridge - Phase Timing Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <time.h>
+#include <pthread.h>
+#include "timing.h"
+
+typedef struct {
+    const char* name;
+    double start;
+    double end;                 /* 0 while the phase runs */
+    int depth;
+} timing_phase_t;
+
+static bool enabled = false;
+static double enabled_at;
+static timing_phase_t phases[EB_TIMING_MAX_PHASES];
+static int phase_count = 0;
+static int open_depth = 0;
+static pthread_mutex_t timing_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+void eb_timing_enable(void) {
+    pthread_mutex_lock(&timing_lock);
+    enabled = true;
+    enabled_at = now_ms();
+    pthread_mutex_unlock(&timing_lock);
+}
+
+bool eb_timing_enabled(void) {
+    return enabled;
+}
+
+int eb_timing_begin(const char* phase) {
+    if (!enabled || !phase)
+        return -1;
+    pthread_mutex_lock(&timing_lock);
+    int handle = -1;
+    if (phase_count < EB_TIMING_MAX_PHASES) {
+        handle = phase_count++;
+        phases[handle] = (timing_phase_t){ phase, now_ms(), 0, open_depth++ };
+    }
+    pthread_mutex_unlock(&timing_lock);
+    return handle;
+}
+
+void eb_timing_end(int handle) {
+    if (handle < 0)
+        return;
+    pthread_mutex_lock(&timing_lock);
+    if (handle < phase_count && phases[handle].end == 0) {
+        phases[handle].end = now_ms();
+        open_depth--;
+    }
+    pthread_mutex_unlock(&timing_lock);
+}
+
+void eb_timing_report(FILE* out, double before_main_ms) {
+    if (!enabled || !out)
+        return;
+    pthread_mutex_lock(&timing_lock);
+    double now = now_ms();
+    if (before_main_ms >= 0)
+        fprintf(out, "timing: %-28s %9.3f ms (cpu)\n", "before main", before_main_ms);
+    for (int i = 0; i < phase_count; i++) {
+        const timing_phase_t* p = &phases[i];
+        double end = p->end != 0 ? p->end : now;
+        fprintf(out, "timing: %*s%-*s %9.3f ms\n", 2 * p->depth, "",
+                28 - 2 * p->depth, p->name, end - p->start);
+    }
+    fprintf(out, "timing: %-28s %9.3f ms\n", "total", now - enabled_at);
+    pthread_mutex_unlock(&timing_lock);
+}
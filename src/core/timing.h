@@ -0,0 +1,51 @@
+/*
+ * EmbeddingBridge - Phase Timing
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_TIMING_H
+#define EB_TIMING_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+ * Wall-clock timing of named phases, for `embr --timing`. Subsystems
+ * bracket their initialization with eb_timing_begin()/eb_timing_end();
+ * phases begun inside another one are reported nested under it. Off by
+ * default, when both calls do nothing.
+ */
+
+#define EB_TIMING_MAX_PHASES 64
+
+/* Start recording; phases begun before this are not reported */
+void eb_timing_enable(void);
+
+bool eb_timing_enabled(void);
+
+/**
+ * Start a phase
+ *
+ * @param phase Phase name, must outlive the report (a literal)
+ * @return Handle for eb_timing_end(), -1 if timing is off or full
+ */
+int eb_timing_begin(const char* phase);
+
+/* End a phase begun by eb_timing_begin(), ignores -1 */
+void eb_timing_end(int handle);
+
+/**
+ * Print every recorded phase in the order they began
+ *
+ * @param out Stream to print to
+ * @param before_main_ms CPU time spent before main() (loader and
+ *        constructors), negative to leave it out
+ */
+void eb_timing_report(FILE* out, double before_main_ms);
+
+#endif /* EB_TIMING_H */
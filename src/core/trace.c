@@ -0,0 +1,165 @@
+/*
+ * EmbeddingBridge - Tracing Spans Implementation
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "trace.h"
+
+#ifdef EB_ENABLE_TRACE
+
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+} trace_event_t;
+
+/* Written only by its thread; the flush reads up to the published count */
+typedef struct trace_ring {
+    trace_event_t events[EB_TRACE_RING_EVENTS];
+    uint64_t written;           /* Spans ever recorded, the newest at (written - 1) % size */
+    unsigned tid;
+    struct trace_ring* next;
+} trace_ring_t;
+
+enum { TRACE_UNKNOWN = 0, TRACE_OFF, TRACE_ON };
+
+static int trace_state = TRACE_UNKNOWN;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static char* trace_path;
+static uint64_t trace_epoch;
+static trace_ring_t* rings;
+static unsigned ring_count;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread trace_ring_t* thread_ring;
+static __thread bool thread_ring_failed;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void flush_at_exit(void) {
+    eb_trace_flush();
+}
+
+static void trace_init(void) {
+    const char* path = getenv(EB_TRACE_ENV);
+    int state = TRACE_OFF;
+    if (path && *path && (trace_path = strdup(path)) != NULL) {
+        trace_epoch = now_ns();
+        atexit(flush_at_exit);
+        state = TRACE_ON;
+    }
+    __atomic_store_n(&trace_state, state, __ATOMIC_RELEASE);
+}
+
+bool eb_trace_enabled(void) {
+    int state = __atomic_load_n(&trace_state, __ATOMIC_ACQUIRE);
+    if (state == TRACE_UNKNOWN) {
+        pthread_once(&trace_once, trace_init);
+        state = __atomic_load_n(&trace_state, __ATOMIC_ACQUIRE);
+    }
+    return state == TRACE_ON;
+}
+
+eb_trace_span_t eb_trace_begin(const char* name) {
+    eb_trace_span_t span = { name, 0 };
+    if (eb_trace_enabled())
+        span.start = now_ns();
+    return span;
+}
+
+static trace_ring_t* ring_open(void) {
+    if (thread_ring_failed)
+        return NULL;
+    trace_ring_t* ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        thread_ring_failed = true;
+        return NULL;
+    }
+    pthread_mutex_lock(&rings_lock);
+    ring->tid = ++ring_count;
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+    return thread_ring = ring;
+}
+
+void eb_trace_end(eb_trace_span_t* span) {
+    if (!span->start)
+        return;
+    uint64_t end = now_ns();
+    trace_ring_t* ring = thread_ring ? thread_ring : ring_open();
+    if (ring) {
+        uint64_t n = ring->written;
+        ring->events[n % EB_TRACE_RING_EVENTS] = (trace_event_t){ span->name, span->start, end - span->start };
+        __atomic_store_n(&ring->written, n + 1, __ATOMIC_RELEASE);
+    }
+    span->start = 0;
+}
+
+int eb_trace_flush(void) {
+    if (!eb_trace_enabled())
+        return 0;
+    FILE* out = fopen(trace_path, "w");
+    if (!out)
+        return -1;
+    int pid = (int)getpid();
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"embr\"}}",
+            pid);
+
+    pthread_mutex_lock(&rings_lock);
+    for (const trace_ring_t* ring = rings; ring; ring = ring->next) {
+        uint64_t written = __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+        uint64_t first = written > EB_TRACE_RING_EVENTS ? written - EB_TRACE_RING_EVENTS : 0;
+        for (uint64_t n = first; n < written; n++) {
+            const trace_event_t* e = &ring->events[n % EB_TRACE_RING_EVENTS];
+            /* The category is the name up to its slash */
+            const char* slash = strchr(e->name, '/');
+            int cat = slash ? (int)(slash - e->name) : (int)strlen(e->name);
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%.*s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":%d,\"tid\":%u}",
+                    e->name, cat, e->name, (double)(e->start - trace_epoch) / 1e3,
+                    (double)e->duration / 1e3, pid, ring->tid);
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+#else /* !EB_ENABLE_TRACE */
+
+/* Compiled out: EMBR_TRACE is ignored */
+
+bool eb_trace_enabled(void) {
+    return false;
+}
+
+eb_trace_span_t eb_trace_begin(const char* name) {
+    return (eb_trace_span_t){ name, 0 };
+}
+
+void eb_trace_end(eb_trace_span_t* span) {
+    (void)span;
+}
+
+int eb_trace_flush(void) {
+    return 0;
+}
+
+#endif /* EB_ENABLE_TRACE */
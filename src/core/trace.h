@@ -0,0 +1,71 @@
+/*
+ * EmbeddingBridge - Tracing Spans
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_TRACE_H
+#define EB_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Timed spans of the hot paths (store, compress, hash, transport,
+ * transform), for chrome://tracing or ui.perfetto.dev. Set EMBR_TRACE to
+ * a file name and every span ended is recorded in a ring buffer of the
+ * thread that ran it, without locks or formatting; the buffers are
+ * written to the file as Chrome trace JSON when the process exits. A
+ * thread keeps its newest EB_TRACE_RING_EVENTS spans.
+ *
+ * The macros compile to nothing unless EB_ENABLE_TRACE is defined (debug
+ * builds, or make TRACE=1). Span names are "<category>/<what>" literals.
+ */
+
+#define EB_TRACE_ENV "EMBR_TRACE"
+#define EB_TRACE_RING_EVENTS 32768
+
+typedef struct {
+    const char* name;
+    uint64_t start;             /* Nanoseconds, 0 when not tracing */
+} eb_trace_span_t;
+
+/* Start a span; cheap when tracing is off */
+eb_trace_span_t eb_trace_begin(const char* name);
+
+/* Record a span begun by eb_trace_begin() */
+void eb_trace_end(eb_trace_span_t* span);
+
+/* Whether spans are being recorded, which reads EMBR_TRACE the first time */
+bool eb_trace_enabled(void);
+
+/**
+ * Write every recorded span to the EMBR_TRACE file now
+ *
+ * Runs at exit on its own. Spans ended while it runs may be left out.
+ *
+ * @return 0 on success (or when not tracing), -1 if the file could not be written
+ */
+int eb_trace_flush(void);
+
+#ifdef EB_ENABLE_TRACE
+    #define EB_TRACE_CONCAT_(a, b) a##b
+    #define EB_TRACE_CONCAT(a, b) EB_TRACE_CONCAT_(a, b)
+    /* A span from here to the end of the enclosing block */
+    #define EB_TRACE_SCOPE(name) \
+        eb_trace_span_t EB_TRACE_CONCAT(eb_trace_scope_, __LINE__) \
+            __attribute__((cleanup(eb_trace_end), unused)) = eb_trace_begin(name)
+    /* A span ended explicitly with EB_TRACE_END(var) */
+    #define EB_TRACE_BEGIN(var, name) eb_trace_span_t var = eb_trace_begin(name)
+    #define EB_TRACE_END(var) eb_trace_end(&(var))
+#else
+    #define EB_TRACE_SCOPE(name) do {} while (0)
+    #define EB_TRACE_BEGIN(var, name) do {} while (0)
+    #define EB_TRACE_END(var) do {} while (0)
+#endif
+
+#endif /* EB_TRACE_H */
@@ -11,21 +11,30 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <pthread.h>
 #include "transformer.h"
+#include "compress.h"
 #include "debug.h"
+#include "trace.h"
 
 /* Maximum number of registered transformers */
 #define MAX_TRANSFORMERS 32
 
-/* Global registry of transformers */
+/*
+ * Global registry of transformers. Transformers hold no per-repository
+ * state, so one registry serves every thread; lookups share the lock,
+ * registration takes it alone.
+ */
 static struct {
     eb_transformer_t *transformers[MAX_TRANSFORMERS];
     int count;
     bool initialized;
+    pthread_rwlock_t lock;
 } transformer_registry = {
     .transformers = {NULL},
     .count = 0,
-    .initialized = false
+    .initialized = false,
+    .lock = PTHREAD_RWLOCK_INITIALIZER
 };
 
 eb_transformer_t *eb_transformer_create(
@@ -53,6 +62,7 @@ eb_transformer_t *eb_transformer_create(
     transformer->free = free;
     transformer->clone = clone;
     transformer->user_data = user_data;
+    transformer->stream = NULL;
     
     if (!transformer->name || !transformer->format_name) {
         eb_transformer_free(transformer);
@@ -99,7 +109,7 @@ eb_transformer_t *eb_transformer_clone(const eb_transformer_t *transformer) {
     }
     
     /* Default cloning behavior */
-    return eb_transformer_create(
+    eb_transformer_t *clone = eb_transformer_create(
         transformer->name,
         transformer->format_name,
         transformer->transform,
@@ -108,6 +118,10 @@ eb_transformer_t *eb_transformer_clone(const eb_transformer_t *transformer) {
         transformer->clone,
         transformer->user_data
     );
+    if (clone) {
+        clone->stream = transformer->stream;
+    }
+    return clone;
 }
 
 eb_status_t eb_transform(
@@ -121,6 +135,7 @@ eb_status_t eb_transform(
         return EB_ERROR_INVALID_PARAMETER;
     }
     
+    EB_TRACE_SCOPE("transform/encode");
     return transformer->transform(transformer, src, src_size, dst_out, dst_size_out);
 }
 
@@ -135,14 +150,183 @@ eb_status_t eb_inverse_transform(
         return EB_ERROR_INVALID_PARAMETER;
     }
     
+    EB_TRACE_SCOPE("transform/decode");
     return transformer->inverse(transformer, src, src_size, dst_out, dst_size_out);
 }
 
+/* Streaming */
+
+struct eb_transform_stream {
+    eb_transformer_t *transformer;
+    void *state;                   /* Streaming encoder state, NULL when buffering */
+
+    /* Input of transformers without a streaming encoder */
+    unsigned char *input;
+    size_t input_size;
+    size_t input_capacity;
+
+    eb_zstd_stream_t *zstd;        /* Compression stage, NULL for none */
+    eb_transform_sink_fn sink;
+    void *ctx;
+    size_t written;                /* Bytes handed to sink */
+};
+
+/* Last stage: the caller's sink */
+static int stream_sink(void *ctx, const void *data, size_t size) {
+    eb_transform_stream_t *stream = ctx;
+    int status = stream->sink(stream->ctx, data, size);
+    if (status == 0) {
+        stream->written += size;
+    }
+    return status;
+}
+
+/* Transformer output going through the compression stage */
+static int stream_compress(void *ctx, const void *data, size_t size) {
+    eb_transform_stream_t *stream = ctx;
+    return eb_zstd_stream_write(stream->zstd, data, size);
+}
+
+static eb_status_t stream_open(eb_transformer_t *transformer, int level, eb_transform_sink_fn sink,
+                               void *ctx, eb_transform_stream_t **stream_out) {
+    if (!transformer || !sink || !stream_out) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+
+    eb_transform_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return EB_ERROR_MEMORY;
+    }
+    stream->transformer = transformer;
+    stream->sink = sink;
+    stream->ctx = ctx;
+
+    eb_status_t status = EB_SUCCESS;
+    if (level > 0) {
+        status = eb_zstd_stream_open(level, stream_sink, stream, &stream->zstd);
+    }
+    if (status == EB_SUCCESS && transformer->stream) {
+        status = transformer->stream->init(transformer, stream->zstd ? stream_compress : stream_sink,
+                                           stream, &stream->state);
+    }
+    if (status != EB_SUCCESS) {
+        eb_transform_stream_abort(stream);
+        return status;
+    }
+
+    *stream_out = stream;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_transform_stream_open(
+    eb_transformer_t *transformer,
+    eb_transform_sink_fn sink,
+    void *ctx,
+    eb_transform_stream_t **stream_out) {
+    return stream_open(transformer, 0, sink, ctx, stream_out);
+}
+
+eb_status_t eb_transform_pipeline_open(
+    const char *format_name,
+    int level,
+    eb_transform_sink_fn sink,
+    void *ctx,
+    eb_transform_stream_t **stream_out) {
+    
+    eb_transformer_t *transformer = eb_find_transformer_by_format(format_name);
+    if (!transformer) {
+        return EB_ERROR_TRANSFORMER;
+    }
+    return stream_open(transformer, level, sink, ctx, stream_out);
+}
+
+eb_status_t eb_transform_stream_feed(
+    eb_transform_stream_t *stream,
+    const void *data,
+    size_t size) {
+    
+    if (!stream || (!data && size > 0)) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+    if (stream->state) {
+        return stream->transformer->stream->feed(stream->state, data, size);
+    }
+
+    /* No streaming encoder: keep the input for one transform at the end */
+    if (stream->input_size + size > stream->input_capacity) {
+        size_t capacity = stream->input_capacity ? stream->input_capacity : 4096;
+        while (capacity < stream->input_size + size) {
+            capacity *= 2;
+        }
+        unsigned char *input = realloc(stream->input, capacity);
+        if (!input) {
+            return EB_ERROR_MEMORY;
+        }
+        stream->input = input;
+        stream->input_capacity = capacity;
+    }
+    if (size > 0) {
+        memcpy(stream->input + stream->input_size, data, size);
+    }
+    stream->input_size += size;
+    return EB_SUCCESS;
+}
+
+eb_status_t eb_transform_stream_finish(
+    eb_transform_stream_t *stream,
+    size_t *size_out) {
+    
+    if (!stream) {
+        return EB_ERROR_INVALID_PARAMETER;
+    }
+
+    eb_status_t status;
+    if (stream->state) {
+        /* finish frees the state whatever it returns */
+        status = stream->transformer->stream->finish(stream->state);
+        stream->state = NULL;
+    } else {
+        void *output = NULL;
+        size_t output_size = 0;
+        status = stream->transformer->transform(stream->transformer,
+                                                stream->input ? (const void *)stream->input : "",
+                                                stream->input_size, &output, &output_size);
+        if (status == EB_SUCCESS) {
+            status = stream->zstd ? stream_compress(stream, output, output_size)
+                                  : stream_sink(stream, output, output_size);
+        }
+        free(output);
+    }
+    if (status == EB_SUCCESS && stream->zstd) {
+        status = eb_zstd_stream_finish(stream->zstd);
+        stream->zstd = NULL;
+    }
+
+    if (status == EB_SUCCESS && size_out) {
+        *size_out = stream->written;
+    }
+    eb_transform_stream_abort(stream);
+    return status;
+}
+
+void eb_transform_stream_abort(eb_transform_stream_t *stream) {
+    if (!stream) {
+        return;
+    }
+    if (stream->state) {
+        stream->transformer->stream->abort(stream->state);
+    }
+    eb_zstd_stream_abort(stream->zstd);
+    free(stream->input);
+    free(stream);
+}
+
 /* Registry management functions */
 
-eb_status_t eb_transformer_registry_init(void) {
+/* Reset an uninitialized registry; call with the lock held for writing */
+static void registry_init_locked(void) {
     if (transformer_registry.initialized) {
-        return EB_SUCCESS;
+        return;
     }
     
     /* Reset the registry */
@@ -154,11 +338,19 @@ eb_status_t eb_transformer_registry_init(void) {
     transformer_registry.initialized = true;
     
     DEBUG_PRINT("Transformer registry initialized");
+}
+
+eb_status_t eb_transformer_registry_init(void) {
+    pthread_rwlock_wrlock(&transformer_registry.lock);
+    registry_init_locked();
+    pthread_rwlock_unlock(&transformer_registry.lock);
     return EB_SUCCESS;
 }
 
 void eb_transformer_registry_cleanup(void) {
+    pthread_rwlock_wrlock(&transformer_registry.lock);
     if (!transformer_registry.initialized) {
+        pthread_rwlock_unlock(&transformer_registry.lock);
         return;
     }
     
@@ -198,6 +390,7 @@ void eb_transformer_registry_cleanup(void) {
     
     transformer_registry.count = 0;
     transformer_registry.initialized = false;
+    pthread_rwlock_unlock(&transformer_registry.lock);
     
     DEBUG_PRINT("Transformer registry cleanup completed");
 }
@@ -207,27 +400,26 @@ eb_status_t eb_register_transformer(eb_transformer_t *transformer) {
         return EB_ERROR_INVALID_PARAMETER;
     }
     
-    if (!transformer_registry.initialized) {
-        eb_status_t status = eb_transformer_registry_init();
-        if (status != EB_SUCCESS) {
-            return status;
-        }
-    }
+    pthread_rwlock_wrlock(&transformer_registry.lock);
+    registry_init_locked();
     
     /* Check if we've reached the maximum number of transformers */
     if (transformer_registry.count >= MAX_TRANSFORMERS) {
+        pthread_rwlock_unlock(&transformer_registry.lock);
         return EB_ERROR_LIMIT_EXCEEDED;
     }
     
     /* Check if a transformer with this name is already registered */
     for (int i = 0; i < transformer_registry.count; i++) {
         if (strcmp(transformer_registry.transformers[i]->name, transformer->name) == 0) {
+            pthread_rwlock_unlock(&transformer_registry.lock);
             return EB_ERROR_ALREADY_EXISTS;
         }
     }
     
     /* Register the transformer */
     transformer_registry.transformers[transformer_registry.count++] = transformer;
+    pthread_rwlock_unlock(&transformer_registry.lock);
     
     DEBUG_PRINT("Registered transformer: %s (%s)", 
                 transformer->name, transformer->format_name);
@@ -235,32 +427,31 @@ eb_status_t eb_register_transformer(eb_transformer_t *transformer) {
     return EB_SUCCESS;
 }
 
-eb_transformer_t *eb_find_transformer(const char *name) {
-    if (!name || !transformer_registry.initialized) {
+/* First registered transformer whose name (or format name) matches */
+static eb_transformer_t *find_registered(const char *key, bool by_format) {
+    if (!key) {
         return NULL;
     }
     
-    for (int i = 0; i < transformer_registry.count; i++) {
-        if (strcmp(transformer_registry.transformers[i]->name, name) == 0) {
-            return transformer_registry.transformers[i];
+    eb_transformer_t *found = NULL;
+    pthread_rwlock_rdlock(&transformer_registry.lock);
+    for (int i = 0; transformer_registry.initialized && i < transformer_registry.count; i++) {
+        const eb_transformer_t *t = transformer_registry.transformers[i];
+        if (strcmp(by_format ? t->format_name : t->name, key) == 0) {
+            found = transformer_registry.transformers[i];
+            break;
         }
     }
-    
-    return NULL;
+    pthread_rwlock_unlock(&transformer_registry.lock);
+    return found;
+}
+
+eb_transformer_t *eb_find_transformer(const char *name) {
+    return find_registered(name, false);
 }
 
 eb_transformer_t *eb_find_transformer_by_format(const char *format_name) {
-    if (!format_name || !transformer_registry.initialized) {
-        return NULL;
-    }
-    
-    for (int i = 0; i < transformer_registry.count; i++) {
-        if (strcmp(transformer_registry.transformers[i]->format_name, format_name) == 0) {
-            return transformer_registry.transformers[i];
-        }
-    }
-    
-    return NULL;
+    return find_registered(format_name, true);
 }
 
 /* Implementation of built-in transformers will be in separate files */
@@ -68,6 +68,32 @@ typedef void (*eb_transformer_free_func)(
 typedef struct eb_transformer *(*eb_transformer_clone_func)(
     const struct eb_transformer *transformer);
 
+/**
+ * Consumer of streamed transformer output, called with each block in order
+ *
+ * Has the shape of eb_transport_sink_fn, so a transport sink can be used
+ * directly.
+ *
+ * @return 0 to go on, any other status aborts the stream with it
+ */
+typedef int (*eb_transform_sink_fn)(void *ctx, const void *data, size_t size);
+
+/**
+ * Optional streaming encoder of a transformer
+ *
+ * init creates per-stream state, feed takes the input in pieces of any
+ * size and hands finished output to the sink, finish flushes what is left
+ * and frees the state, abort frees it without flushing. The output equals
+ * what transform would produce for the concatenated input.
+ */
+typedef struct eb_transform_stream_ops {
+    eb_status_t (*init)(struct eb_transformer *transformer, eb_transform_sink_fn sink,
+                        void *sink_ctx, void **state_out);
+    eb_status_t (*feed)(void *state, const void *data, size_t size);
+    eb_status_t (*finish)(void *state);
+    void (*abort)(void *state);
+} eb_transform_stream_ops_t;
+
 /**
  * Transformer interface for encoding/decoding data to/from different formats
  */
@@ -79,6 +105,7 @@ typedef struct eb_transformer {
     eb_transformer_free_func free;      /* Resource cleanup function */
     eb_transformer_clone_func clone;    /* Clone function */
     void *user_data;                    /* Custom user data */
+    const eb_transform_stream_ops_t *stream; /* Streaming encoder, NULL if whole-buffer only */
 } eb_transformer_t;
 
 /**
@@ -151,6 +178,80 @@ eb_status_t eb_inverse_transform(
     void **dst_out,
     size_t *dst_size_out);
 
+/* Streaming */
+
+typedef struct eb_transform_stream eb_transform_stream_t;
+
+/**
+ * Start streaming data through a transformer
+ *
+ * Transformers without streaming support are run on the whole input at
+ * eb_transform_stream_finish(), so callers need only this one path.
+ *
+ * @param transformer Transformer to use
+ * @param sink Consumer of the transformed data
+ * @param ctx Context passed to sink
+ * @param stream_out Receives the stream
+ * @return Status code
+ */
+eb_status_t eb_transform_stream_open(
+    eb_transformer_t *transformer,
+    eb_transform_sink_fn sink,
+    void *ctx,
+    eb_transform_stream_t **stream_out);
+
+/**
+ * Start a transform -> compress -> sink pipeline
+ *
+ * The transformer for format_name is taken from the registry; its output
+ * is compressed as one ZSTD frame before it reaches the sink. Apart from
+ * what the transformer itself holds, memory is bounded by one block.
+ *
+ * @param format_name Format to encode to
+ * @param level ZSTD level of the compression stage, 0 for none
+ * @param sink Consumer of the encoded data, e.g. a transport sink
+ * @param ctx Context passed to sink
+ * @param stream_out Receives the stream
+ * @return Status code (EB_ERROR_TRANSFORMER if no transformer handles format_name)
+ */
+eb_status_t eb_transform_pipeline_open(
+    const char *format_name,
+    int level,
+    eb_transform_sink_fn sink,
+    void *ctx,
+    eb_transform_stream_t **stream_out);
+
+/**
+ * Feed more input to a stream
+ *
+ * @param stream Stream
+ * @param data Input data, only read during the call
+ * @param size Size of data
+ * @return Status code (the sink's status if it aborted)
+ */
+eb_status_t eb_transform_stream_feed(
+    eb_transform_stream_t *stream,
+    const void *data,
+    size_t size);
+
+/**
+ * Flush a stream to its sink and free it
+ *
+ * @param stream Stream
+ * @param size_out Receives the number of bytes handed to the sink (can be NULL)
+ * @return Status code (the sink's status if it aborted)
+ */
+eb_status_t eb_transform_stream_finish(
+    eb_transform_stream_t *stream,
+    size_t *size_out);
+
+/**
+ * Free a stream without flushing it
+ *
+ * @param stream Stream
+ */
+void eb_transform_stream_abort(eb_transform_stream_t *stream);
+
 /* Registry functions */
 
 /**
@@ -186,6 +287,9 @@ eb_status_t eb_transformer_registry_init(void);
 
 /**
  * Clean up the transformer registry
+ *
+ * Frees every registered transformer: no thread may still be using one
+ * it looked up.
  */
 void eb_transformer_registry_cleanup(void);
 
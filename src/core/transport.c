@@ -11,9 +11,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
 #include "transport.h"
 #include "error.h"
 #include "debug.h"
+#include "trace.h"
+#include "counters.h"
 
 /* Forward declarations of protocol-specific operations */
 extern struct transport_ops ssh_ops;
@@ -78,39 +84,23 @@ eb_transport_t *transport_open(const char *url)
 		#endif
 	} else if (starts_with(url, "file://") || !strchr(url, ':')) {
 		transport->type = TRANSPORT_LOCAL;
-		transport->ops = NULL;
-		DEBUG_PRINT("transport_open: file:// and local transports are not implemented");
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "file:// and local transports are not implemented. Only s3:// is supported.");
-		transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-		free((void *)transport->url);
-		free(transport);
-		return NULL;
-	} else if (starts_with(url, "ssh://") || strchr(url, '@')) {
-		transport->type = TRANSPORT_SSH;
-		transport->ops = NULL;
-		DEBUG_PRINT("transport_open: SSH transport is not implemented");
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "SSH transport is not implemented. Only s3:// is supported.");
-		transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-		free((void *)transport->url);
-		free(transport);
-		return NULL;
+		transport->ops = &local_ops;
+		DEBUG_PRINT("transport_open: Using local transport for %s", url);
 	} else if (starts_with(url, "http://") || starts_with(url, "https://")) {
+		/* Before the SSH check, credentials in the URL contain an '@' */
 		transport->type = TRANSPORT_HTTP;
-		transport->ops = NULL;
-		DEBUG_PRINT("transport_open: HTTP transport is not implemented");
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "HTTP transport is not implemented. Only s3:// is supported.");
-		transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-		free((void *)transport->url);
-		free(transport);
-		return NULL;
+		transport->ops = &http_ops;
+		DEBUG_PRINT("transport_open: Using HTTP transport for %s", url);
+	} else if (starts_with(url, "ssh://") || !strstr(url, "://")) {
+		/* scp-style [user@]host:path, the ':' was checked above */
+		transport->type = TRANSPORT_SSH;
+		transport->ops = &ssh_ops;
+		DEBUG_PRINT("transport_open: Using SSH transport for %s", url);
 	} else {
 		transport->type = TRANSPORT_UNKNOWN;
 		DEBUG_PRINT("transport_open: Unsupported URL scheme: %s", url);
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Unsupported URL scheme: %s. Only s3:// is supported.", url);
+			 "Unsupported URL scheme: %s. Only s3://, http(s)://, ssh and local remotes are supported.", url);
 		transport->last_error = EB_ERROR_UNSUPPORTED;
 		free((void *)transport->url);
 		free(transport);
@@ -145,6 +135,18 @@ void transport_close(eb_transport_t *transport)
 	free(transport);
 }
 
+_Static_assert(EB_COUNTER_S3_OUT_BYTES - EB_COUNTER_LOCAL_IN_BYTES ==
+               2 * (TRANSPORT_S3 - TRANSPORT_LOCAL) + 1, "byte counters follow enum transport_type");
+
+/* Count a request and the bytes it moved under its transport type */
+static void count_request(const eb_transport_t *transport, bool sent, size_t bytes)
+{
+	eb_counter_add(EB_COUNTER_REMOTE_REQUESTS, 1);
+	if (transport->type >= TRANSPORT_LOCAL && transport->type <= TRANSPORT_S3)
+		eb_counter_add((eb_counter_t)(EB_COUNTER_LOCAL_IN_BYTES +
+		                              2 * (transport->type - TRANSPORT_LOCAL) + sent), bytes);
+}
+
 int transport_connect(eb_transport_t *transport)
 {
 	DEBUG_PRINT("transport_connect: Starting with transport=%p", (void*)transport);
@@ -173,7 +175,10 @@ int transport_connect(eb_transport_t *transport)
 	}
 	
 	DEBUG_PRINT("transport_connect: Calling connect operation for transport type %d", transport->type);
+	EB_TRACE_BEGIN(span, "transport/connect");
 	result = transport->ops->connect(transport);
+	EB_TRACE_END(span);
+	count_request(transport, false, 0);
 	if (result == EB_SUCCESS) {
 		DEBUG_PRINT("transport_connect: Connection successful");
 		transport->connected = true;
@@ -238,7 +243,10 @@ int transport_send_data(eb_transport_t *transport, const void *data, size_t size
 	
 	DEBUG_INFO("transport_send_data: Calling transport->ops->send_data function at %p", 
 	         transport->ops->send_data);
+	EB_TRACE_BEGIN(span, "transport/send");
 	result = transport->ops->send_data(transport, data, size, hash);
+	EB_TRACE_END(span);
+	count_request(transport, true, result == EB_SUCCESS ? size : 0);
 	DEBUG_INFO("transport_send_data: Result=%d", result);
 	
 	if (result != EB_SUCCESS)
@@ -247,6 +255,73 @@ int transport_send_data(eb_transport_t *transport, const void *data, size_t size
 	return result;
 }
 
+struct eb_transport_request {
+	void *pending;                /* Protocol request, NULL once completed */
+	int status;                   /* Result of a send that already completed */
+};
+
+int transport_submit_data(eb_transport_t *transport, const void *data, size_t size,
+                          const char *hash, eb_transport_request_t **request)
+{
+	int result;
+	
+	if (!transport || !data || !request)
+		return EB_ERROR_INVALID_PARAMETER;
+	*request = NULL;
+	
+	eb_transport_request_t *submitted = calloc(1, sizeof(*submitted));
+	if (!submitted)
+		return EB_ERROR_MEMORY;
+	
+	/* Without asynchronous sends the request completes right away */
+	if (!transport->ops || !transport->ops->submit_data || !transport->ops->wait_data) {
+		submitted->status = transport_send_data(transport, data, size, hash);
+		*request = submitted;
+		return EB_SUCCESS;
+	}
+	
+	if (!transport->connected) {
+		result = transport_connect(transport);
+		if (result != EB_SUCCESS) {
+			free(submitted);
+			return result;
+		}
+	}
+	
+	EB_TRACE_BEGIN(span, "transport/submit");
+	result = transport->ops->submit_data(transport, data, size, hash, &submitted->pending);
+	EB_TRACE_END(span);
+	count_request(transport, true, result == EB_SUCCESS ? size : 0);
+	if (result != EB_SUCCESS) {
+		transport->last_error = result;
+		free(submitted);
+		return result;
+	}
+	
+	*request = submitted;
+	return EB_SUCCESS;
+}
+
+int transport_wait(eb_transport_t *transport, eb_transport_request_t *request)
+{
+	int result;
+	
+	if (!transport || !request)
+		return EB_ERROR_INVALID_PARAMETER;
+	
+	if (request->pending) {
+		EB_TRACE_BEGIN(span, "transport/wait");
+		result = transport->ops->wait_data(transport, request->pending);
+		EB_TRACE_END(span);
+	} else
+		result = request->status;
+	free(request);
+	
+	if (result != EB_SUCCESS)
+		transport->last_error = result;
+	return result;
+}
+
 int transport_receive_data(eb_transport_t *transport, void *buffer, size_t size, 
                           size_t *received)
 {
@@ -268,13 +343,130 @@ int transport_receive_data(eb_transport_t *transport, void *buffer, size_t size,
 		return EB_ERROR_NOT_IMPLEMENTED;
 	}
 	
+	EB_TRACE_BEGIN(span, "transport/receive");
 	result = transport->ops->receive_data(transport, buffer, size, received);
+	EB_TRACE_END(span);
+	count_request(transport, false, result == EB_SUCCESS ? *received : 0);
+	if (result != EB_SUCCESS)
+		transport->last_error = result;
+	
+	return result;
+}
+
+int transport_receive_stream(eb_transport_t *transport, const eb_transport_range_t *range,
+                             eb_transport_sink_fn sink, void *ctx, size_t *received)
+{
+	int result;
+	size_t streamed = 0;
+	
+	if (!transport || !sink)
+		return EB_ERROR_INVALID_PARAMETER;
+	
+	if (!transport->connected) {
+		result = transport_connect(transport);
+		if (result != EB_SUCCESS)
+			return result;
+	}
+	
+	if (!transport->ops || !transport->ops->receive_stream) {
+		transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Streaming receive not implemented for this transport");
+		return EB_ERROR_NOT_IMPLEMENTED;
+	}
+	
+	EB_TRACE_BEGIN(span, "transport/receive");
+	result = transport->ops->receive_stream(transport, range, sink, ctx, &streamed);
+	EB_TRACE_END(span);
+	count_request(transport, false, streamed);
+	if (result != EB_SUCCESS)
+		transport->last_error = result;
+	if (received)
+		*received = streamed;
+	
+	return result;
+}
+
+/* Fills a caller buffer, refusing data past its end */
+struct buffer_sink {
+	char *buffer;
+	size_t size;
+	size_t used;
+};
+
+static int buffer_sink(void *ctx, const void *data, size_t size)
+{
+	struct buffer_sink *sink = ctx;
+	
+	if (size > sink->size - sink->used)
+		return EB_ERROR_BUFFER_TOO_SMALL;
+	memcpy(sink->buffer + sink->used, data, size);
+	sink->used += size;
+	return EB_SUCCESS;
+}
+
+int transport_receive_range(eb_transport_t *transport, const eb_transport_range_t *range,
+                            void *buffer, size_t size, size_t *received)
+{
+	struct buffer_sink sink = { .buffer = buffer, .size = size, .used = 0 };
+	int result;
+	
+	if (!buffer || !received)
+		return EB_ERROR_INVALID_PARAMETER;
+	
+	result = transport_receive_stream(transport, range, buffer_sink, &sink, NULL);
+	*received = sink.used;
+	return result;
+}
+
+int transport_put_object(eb_transport_t *transport, const char *key, const void *data, size_t size)
+{
+	int result;
+	
+	if (!transport || !key || !*key || (!data && size > 0))
+		return EB_ERROR_INVALID_PARAMETER;
+	
+	if (!transport->connected) {
+		result = transport_connect(transport);
+		if (result != EB_SUCCESS)
+			return result;
+	}
+	
+	if (!transport->ops || !transport->ops->put_object) {
+		transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Storing raw objects not implemented for this transport");
+		return EB_ERROR_NOT_IMPLEMENTED;
+	}
+	
+	EB_TRACE_BEGIN(span, "transport/send");
+	result = transport->ops->put_object(transport, key, data, size);
+	EB_TRACE_END(span);
+	count_request(transport, true, result == EB_SUCCESS ? size : 0);
 	if (result != EB_SUCCESS)
 		transport->last_error = result;
 	
 	return result;
 }
 
+int transport_fd_sink(void *ctx, const void *data, size_t size)
+{
+	int fd = *(const int *)ctx;
+	const char *p = data;
+	
+	while (size > 0) {
+		ssize_t written = write(fd, p, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return EB_ERROR_FILE_IO;
+		}
+		p += written;
+		size -= (size_t)written;
+	}
+	return EB_SUCCESS;
+}
+
 int transport_list_refs(eb_transport_t *transport, char ***refs, size_t *count)
 {
 	int result;
@@ -296,6 +488,7 @@ int transport_list_refs(eb_transport_t *transport, char ***refs, size_t *count)
 	}
 	
 	result = transport->ops->list_refs(transport, refs, count);
+	count_request(transport, false, 0);
 	if (result != EB_SUCCESS)
 		transport->last_error = result;
 	
@@ -322,6 +515,7 @@ int transport_delete_refs(eb_transport_t *transport, const char **refs, size_t c
 	}
 
 	result = transport->ops->delete_refs(transport, refs, count);
+	count_request(transport, false, 0);
 	if (result != EB_SUCCESS)
 		transport->last_error = result;
 	return result;
@@ -356,4 +550,173 @@ const char *transport_get_error(eb_transport_t *transport)
 	}
 	
 	return transport->error_msg;
-} 
\ No newline at end of file
+} 
+
+/* Idle transports of the pool */
+struct pooled_transport {
+	eb_transport_t *transport;
+	time_t idle_since;
+};
+
+static struct pooled_transport pool[TRANSPORT_POOL_SIZE];
+static size_t pool_count = 0;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool transport_healthy(const eb_transport_t *transport)
+{
+	return transport->connected && transport->last_error == EB_SUCCESS;
+}
+
+/* Take entry i out of the pool, the caller holds pool_mutex */
+static eb_transport_t *pool_take(size_t i)
+{
+	eb_transport_t *transport = pool[i].transport;
+	pool[i] = pool[--pool_count];
+	return transport;
+}
+
+/* Reset the per-operation state a previous borrower may have left behind */
+static void transport_reset(eb_transport_t *transport)
+{
+	if (transport->target_path) {
+		free((void *)transport->target_path);
+		transport->target_path = NULL;
+	}
+	transport->data_is_precompressed = false;
+	transport->last_error = EB_SUCCESS;
+	transport->error_msg[0] = '\0';
+}
+
+/* Replace the URL of a pooled transport, the caller has retargeted it */
+static int transport_set_url(eb_transport_t *transport, const char *url)
+{
+	char *copy = strdup(url);
+	if (!copy)
+		return EB_ERROR_MEMORY;
+	free((void *)transport->url);
+	transport->url = copy;
+	return EB_SUCCESS;
+}
+
+static bool same_options(const eb_transport_options_t *a, const eb_transport_options_t *b)
+{
+	return a->threads == b->threads && a->max_connections == b->max_connections &&
+	       a->throughput_gbps == b->throughput_gbps;
+}
+
+eb_transport_t *transport_acquire(const char *url, const eb_transport_options_t *options)
+{
+	eb_transport_options_t defaults = { 0, 0, 0.0 };
+	eb_transport_t *stale[TRANSPORT_POOL_SIZE];
+	size_t stale_count = 0;
+	eb_transport_t *transport = NULL;
+	time_t now = time(NULL);
+	
+	if (!url)
+		return NULL;
+	if (!options)
+		options = &defaults;
+	
+	pthread_mutex_lock(&pool_mutex);
+	
+	/* Health check: drop idle transports that timed out or went bad */
+	for (size_t i = 0; i < pool_count;) {
+		if (now - pool[i].idle_since > TRANSPORT_POOL_IDLE_SECONDS ||
+		    !transport_healthy(pool[i].transport))
+			stale[stale_count++] = pool_take(i);
+		else
+			i++;
+	}
+	
+	/* Prefer a transport already pointed at this URL */
+	for (size_t i = 0; i < pool_count; i++) {
+		if (strcmp(pool[i].transport->url, url) == 0 &&
+		    same_options(&pool[i].transport->options, options)) {
+			transport = pool_take(i);
+			break;
+		}
+	}
+	
+	/* Otherwise one that can be pointed at it without reconnecting */
+	for (size_t i = 0; !transport && i < pool_count; i++) {
+		eb_transport_t *candidate = pool[i].transport;
+		if (!candidate->ops || !candidate->ops->retarget ||
+		    !same_options(&candidate->options, options))
+			continue;
+		if (candidate->ops->retarget(candidate, url) != EB_SUCCESS)
+			continue;
+		if (transport_set_url(candidate, url) != EB_SUCCESS)
+			continue;
+		transport = pool_take(i);
+	}
+	
+	pthread_mutex_unlock(&pool_mutex);
+	
+	for (size_t i = 0; i < stale_count; i++)
+		transport_close(stale[i]);
+	
+	if (transport) {
+		DEBUG_PRINT("transport_acquire: Reusing pooled transport for %s", url);
+		transport_reset(transport);
+		return transport;
+	}
+	
+	transport = transport_open(url);
+	if (!transport)
+		return NULL;
+	transport->options = *options;
+	if (transport_connect(transport) != EB_SUCCESS) {
+		DEBUG_PRINT("transport_acquire: Failed to connect to %s: %s",
+		          url, transport_get_error(transport));
+		transport_close(transport);
+		return NULL;
+	}
+	return transport;
+}
+
+void transport_release(eb_transport_t *transport)
+{
+	eb_transport_t *evicted = NULL;
+	
+	if (!transport)
+		return;
+	
+	if (!transport_healthy(transport)) {
+		transport_close(transport);
+		return;
+	}
+	
+	pthread_mutex_lock(&pool_mutex);
+	if (pool_count == TRANSPORT_POOL_SIZE) {
+		/* Make room by closing the transport that has been idle longest */
+		size_t oldest = 0;
+		for (size_t i = 1; i < pool_count; i++) {
+			if (pool[i].idle_since < pool[oldest].idle_since)
+				oldest = i;
+		}
+		evicted = pool_take(oldest);
+	}
+	pool[pool_count].transport = transport;
+	pool[pool_count].idle_since = time(NULL);
+	pool_count++;
+	pthread_mutex_unlock(&pool_mutex);
+	
+	if (evicted)
+		transport_close(evicted);
+}
+
+void transport_pool_drain(void)
+{
+	eb_transport_t *idle[TRANSPORT_POOL_SIZE];
+	size_t idle_count;
+	
+	pthread_mutex_lock(&pool_mutex);
+	idle_count = pool_count;
+	for (size_t i = 0; i < idle_count; i++)
+		idle[i] = pool[i].transport;
+	pool_count = 0;
+	pthread_mutex_unlock(&pool_mutex);
+	
+	for (size_t i = 0; i < idle_count; i++)
+		transport_close(idle[i]);
+}
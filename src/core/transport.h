@@ -13,6 +13,7 @@
 
 #include "types.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * Transport types supported by EmbeddingBridge
@@ -28,6 +29,39 @@ enum transport_type {
 /* Forward declaration of transport structure */
 typedef struct eb_transport eb_transport_t;
 
+/* Request submitted with transport_submit_data() */
+typedef struct eb_transport_request eb_transport_request_t;
+
+/**
+ * Client tuning, 0 everywhere leaves the protocol defaults
+ */
+typedef struct {
+	unsigned threads;             /* Event loop threads */
+	unsigned max_connections;     /* Connections in flight at once */
+	double throughput_gbps;       /* Throughput the client aims for */
+} eb_transport_options_t;
+
+/**
+ * Byte range of a download
+ *
+ * length bytes starting at offset, or up to the end of the object when
+ * length is 0. With from_end set it is the last length bytes of the
+ * object and offset is ignored, which is how a Parquet footer is read
+ * without knowing the object size.
+ */
+typedef struct {
+	uint64_t offset;
+	uint64_t length;
+	bool from_end;
+} eb_transport_range_t;
+
+/**
+ * Consumer of a streamed download, called with each block in order
+ *
+ * @return 0 to go on, any other status aborts the download with it
+ */
+typedef int (*eb_transport_sink_fn)(void *ctx, const void *data, size_t size);
+
 /**
  * Transport operation function types
  */
@@ -37,6 +71,12 @@ typedef int (*transport_send_fn)(eb_transport_t *transport, const void *data, si
 typedef int (*transport_receive_fn)(eb_transport_t *transport, void *buffer, size_t size, size_t *received);
 typedef int (*transport_list_fn)(eb_transport_t *transport, char ***refs, size_t *count);
 typedef int (*transport_delete_fn)(eb_transport_t *transport, const char **refs, size_t count);
+typedef int (*transport_retarget_fn)(eb_transport_t *transport, const char *url);
+typedef int (*transport_submit_fn)(eb_transport_t *transport, const void *data, size_t size, const char *hash, void **request);
+typedef int (*transport_wait_fn)(eb_transport_t *transport, void *request);
+typedef int (*transport_receive_stream_fn)(eb_transport_t *transport, const eb_transport_range_t *range,
+                                           eb_transport_sink_fn sink, void *ctx, size_t *received);
+typedef int (*transport_put_fn)(eb_transport_t *transport, const char *key, const void *data, size_t size);
 
 /**
  * Transport operations structure
@@ -48,6 +88,11 @@ struct transport_ops {
 	transport_receive_fn receive_data;
 	transport_list_fn list_refs;
 	transport_delete_fn delete_refs;
+	transport_retarget_fn retarget;   /* Optional: point a connected transport at another URL */
+	transport_submit_fn submit_data;  /* Optional: start a send without waiting for it */
+	transport_wait_fn wait_data;      /* Required with submit_data */
+	transport_receive_stream_fn receive_stream; /* Optional: streamed and ranged downloads */
+	transport_put_fn put_object;      /* Optional: store bytes under a key, as they are */
 };
 
 /**
@@ -62,7 +107,8 @@ struct eb_transport {
 	eb_status_t last_error;       /* Last error code */
 	char error_msg[256];          /* Last error message */
 	const char *target_path;      /* Target path for operations */
-	bool data_is_precompressed;  /* Flag to indicate if data is already compressed */
+	bool data_is_precompressed;  /* Data is an object record sent as is to a native remote */
+	eb_transport_options_t options; /* Client tuning, read when connecting */
 };
 
 /**
@@ -107,6 +153,33 @@ int transport_disconnect(eb_transport_t *transport);
  */
 int transport_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash);
 
+/**
+ * Start sending data without waiting for it
+ *
+ * Lets many sends be in flight on one connected transport. data may be
+ * freed as soon as this returns. Every submitted request must be passed
+ * to transport_wait(). Transports without asynchronous sends complete the
+ * send here and report its status from transport_wait().
+ *
+ * @param transport Transport to use
+ * @param data Data to send
+ * @param size Size of data
+ * @param hash Hash of the data
+ * @param request Pointer to store the request
+ * @return Status code (0 = success)
+ */
+int transport_submit_data(eb_transport_t *transport, const void *data, size_t size,
+                          const char *hash, eb_transport_request_t **request);
+
+/**
+ * Wait for a submitted send and free its request
+ *
+ * @param transport Transport the request was submitted on
+ * @param request Request from transport_submit_data()
+ * @return Status code of the send (0 = success)
+ */
+int transport_wait(eb_transport_t *transport, eb_transport_request_t *request);
+
 /**
  * Receive data from the remote repository
  *
@@ -118,6 +191,54 @@ int transport_send_data(eb_transport_t *transport, const void *data, size_t size
  */
 int transport_receive_data(eb_transport_t *transport, void *buffer, size_t size, size_t *received);
 
+/**
+ * Stream data from the remote repository
+ *
+ * Hands the object at the target path to sink as it arrives, so neither
+ * side has to know its size up front.
+ *
+ * @param transport Transport to use
+ * @param range Bytes to download, NULL for the whole object
+ * @param sink Consumer of the data
+ * @param ctx Context passed to sink
+ * @param received Pointer to store the number of bytes handed to sink (can be NULL)
+ * @return Status code (0 = success, the sink's status if it aborted)
+ */
+int transport_receive_stream(eb_transport_t *transport, const eb_transport_range_t *range,
+                             eb_transport_sink_fn sink, void *ctx, size_t *received);
+
+/**
+ * Receive a byte range into a buffer
+ *
+ * @param transport Transport to use
+ * @param range Bytes to download, NULL for the whole object
+ * @param buffer Buffer to store received data
+ * @param size Size of buffer
+ * @param received Actual number of bytes received
+ * @return Status code (EB_ERROR_BUFFER_TOO_SMALL if the range does not fit)
+ */
+int transport_receive_range(eb_transport_t *transport, const eb_transport_range_t *range,
+                            void *buffer, size_t size, size_t *received);
+
+/**
+ * Store bytes verbatim under a key of the remote
+ *
+ * Unlike transport_send_data nothing is converted or indexed, the object
+ * is written as given. The key lives in the same namespace as target_path.
+ *
+ * @param transport Transport to use
+ * @param key Object key, e.g. "sets/main/packs/MANIFEST"
+ * @param data Data to store
+ * @param size Size of data
+ * @return Status code (0 = success)
+ */
+int transport_put_object(eb_transport_t *transport, const char *key, const void *data, size_t size);
+
+/**
+ * Sink writing to a file descriptor, ctx points at the int descriptor
+ */
+int transport_fd_sink(void *ctx, const void *data, size_t size);
+
 /**
  * List references in the remote repository
  *
@@ -146,6 +267,43 @@ const char *transport_get_error(eb_transport_t *transport);
  */
 int transport_delete_refs(eb_transport_t *transport, const char **refs, size_t count);
 
+/**
+ * Transport pool
+ *
+ * Commands that talk to a remote several times (list, diff, fetch) borrow
+ * connected transports from a process-wide pool instead of paying for a
+ * new connection, TLS session and client each time. A transport is handed
+ * out again for the same URL, or for another URL it can be retargeted to
+ * (for S3, another prefix of the same bucket). Idle transports are closed
+ * after TRANSPORT_POOL_IDLE_SECONDS.
+ */
+#define TRANSPORT_POOL_SIZE 16
+#define TRANSPORT_POOL_IDLE_SECONDS 60
+
+/**
+ * Borrow a connected transport for a URL
+ *
+ * @param url URL to the remote repository
+ * @param options Client tuning, NULL for the defaults
+ * @return Connected transport, or NULL if none could be opened or connected
+ */
+eb_transport_t *transport_acquire(const char *url, const eb_transport_options_t *options);
+
+/**
+ * Return a borrowed transport to the pool
+ *
+ * Transports that are disconnected or saw an error while borrowed are
+ * closed instead of being kept.
+ *
+ * @param transport Transport from transport_acquire()
+ */
+void transport_release(eb_transport_t *transport);
+
+/**
+ * Close every idle transport of the pool
+ */
+void transport_pool_drain(void);
+
 /* Protocol-specific initialization functions */
 int ssh_transport_init(void);
 int http_transport_init(void);
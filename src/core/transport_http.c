@@ -8,89 +8,1124 @@
  * (at your option) any later version.
  */
 
+#define _GNU_SOURCE /* For memmem and strndup */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
 
 #include "transport.h"
 #include "error.h"
 #include "debug.h"
 #include "config.h"
+#include "path_utils.h"
+#include "remote_metadata.h"
+
+/*
+ * HTTP(S) object server transport
+ *
+ * Remotes are plain object servers: objects are read with GET, stored
+ * with PUT and removed with DELETE at <origin>/<key>, where keys are laid
+ * out as on S3 (<prefix>/documents/<hash>.parquet next to
+ * <prefix>/metadata.json). A GET of <prefix>/ has to list the prefix,
+ * either as plain text with one name per line or as an HTML index such as
+ * the ones nginx and Apache generate; names ending in '/' are listed in
+ * turn.
+ *
+ * Every transport drives one curl multi handle. Its connections are kept
+ * alive across requests and, over TLS, negotiate HTTP/2 so many transfers
+ * share one connection. Submitted uploads and deletes stay in flight
+ * together, up to the parallelism of the URL:
+ *
+ *   https://objects.example.com/embeddings?parallel=16&http2=prior
+ *
+ * parallel caps the transfers in flight (the remote's max_connections
+ * wins when set), http2=0 keeps to HTTP/1.1 and http2=prior speaks HTTP/2
+ * without TLS to servers that expect it. EB_HTTP_TOKEN is sent as a
+ * bearer token when set.
+ */
+#define HTTP_DEFAULT_PARALLEL 8
+#define HTTP_MAX_PARALLEL 256
+#define HTTP_CONNECT_TIMEOUT_SECONDS 30
+#define HTTP_STALL_TIMEOUT_SECONDS 60
+#define HTTP_POLL_MS 1000
+#define HTTP_LIST_DEPTH 8
 
-/* Stub implementation - HTTP transport is disabled */
 struct http_data {
-	void *placeholder;  /* Just a placeholder to avoid empty struct */
+	CURLM *multi;
+	char *origin;                 /* scheme://host[:port] */
+	char *prefix;                 /* URL path without surrounding slashes */
+	char *token;                  /* Bearer token, NULL without one */
+	long http_version;            /* CURL_HTTP_VERSION_* asked for */
+	size_t parallel;              /* Transfers in flight at most */
+	size_t in_flight;             /* Transfers added to the multi handle */
+	size_t uploads;               /* Submitted uploads not waited for */
+
+	/* metadata.json is rewritten once the last upload of a batch is in */
+	bool metadata_stale;
+	char metadata_key[1024];
+	char set_name[256];
+	size_t last_size;
+	time_t last_timestamp;
 };
 
+/* One transfer on the multi handle */
+struct http_request {
+	CURL *easy;
+	struct curl_slist *headers;
+	char error[CURL_ERROR_SIZE];
+	char key[1024];
+	bool active;                  /* On the multi handle */
+	bool done;
+	CURLcode result;
+	long status;                  /* HTTP response code */
+
+	/* Request body */
+	unsigned char *body;
+	size_t body_size;
+	size_t body_sent;
+
+	/* Response body */
+	eb_transport_sink_fn sink;
+	void *sink_ctx;
+	int sink_status;
+	size_t received;
+	const eb_transport_range_t *range;
+	bool body_started;
+	uint64_t skip;                /* Bytes to drop when a range was ignored */
+	uint64_t limit;               /* Bytes left to hand over, UINT64_MAX for all */
+};
+
+/* Upload handed out by http_submit_data */
+struct http_upload {
+	struct http_request *request;
+	char metadata_key[1024];
+	char set_name[256];
+	time_t timestamp;
+};
+
+/* DNS and TLS sessions are shared by every HTTP transport of the process */
+static pthread_once_t http_once = PTHREAD_ONCE_INIT;
+static CURLSH *http_share = NULL;
+static pthread_mutex_t http_share_locks[CURL_LOCK_DATA_LAST];
+static CURLcode http_global_status = CURLE_FAILED_INIT;
+
+static void http_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *ctx)
+{
+	(void)handle;
+	(void)access;
+	(void)ctx;
+	pthread_mutex_lock(&http_share_locks[data]);
+}
+
+static void http_share_unlock(CURL *handle, curl_lock_data data, void *ctx)
+{
+	(void)handle;
+	(void)ctx;
+	pthread_mutex_unlock(&http_share_locks[data]);
+}
+
+static void http_global_init(void)
+{
+	http_global_status = curl_global_init(CURL_GLOBAL_DEFAULT);
+	if (http_global_status != CURLE_OK)
+		return;
+
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		pthread_mutex_init(&http_share_locks[i], NULL);
+	http_share = curl_share_init();
+	if (http_share) {
+		curl_share_setopt(http_share, CURLSHOPT_LOCKFUNC, http_share_lock);
+		curl_share_setopt(http_share, CURLSHOPT_UNLOCKFUNC, http_share_unlock);
+		curl_share_setopt(http_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(http_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+}
+
+/* Status for a finished transfer */
+static int http_request_status(eb_transport_t *transport, const struct http_request *request)
+{
+	if (request->sink_status != EB_SUCCESS)
+		return request->sink_status;
+
+	if (request->result != CURLE_OK) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg), "%s: %s", request->key,
+			 request->error[0] ? request->error : curl_easy_strerror(request->result));
+		if (request->result == CURLE_OPERATION_TIMEDOUT)
+			return EB_ERROR_TIMEOUT;
+		return EB_ERROR_CONNECTION_FAILED;
+	}
+
+	if (request->status >= 200 && request->status < 300)
+		return EB_SUCCESS;
+
+	snprintf(transport->error_msg, sizeof(transport->error_msg), "%s: HTTP %ld",
+		 request->key, request->status);
+	switch (request->status) {
+	case 404:
+	case 410:
+		return EB_ERROR_NOT_FOUND;
+	case 401:
+	case 403:
+		return EB_ERROR_AUTH_FAILED;
+	case 405:
+	case 501:
+		return EB_ERROR_UNSUPPORTED;
+	case 416:
+		return EB_ERROR_INVALID_PARAMETER;
+	default:
+		return EB_ERROR_CONNECTION_FAILED;
+	}
+}
+
+static size_t http_read_body(char *buffer, size_t size, size_t count, void *ctx)
+{
+	struct http_request *request = ctx;
+	size_t room = size * count;
+	size_t left = request->body_size - request->body_sent;
+
+	if (room > left)
+		room = left;
+	memcpy(buffer, request->body + request->body_sent, room);
+	request->body_sent += room;
+	return room;
+}
+
+/* Work out which part of the response body the caller asked for */
+static bool http_start_body(struct http_request *request)
+{
+	request->body_started = true;
+	request->skip = 0;
+	request->limit = UINT64_MAX;
+
+	/* A 206 already is the range, a 200 is the whole object */
+	const eb_transport_range_t *range = request->range;
+	if (!range || request->status != 200)
+		return true;
+
+	if (range->from_end) {
+		curl_off_t length = -1;
+		curl_easy_getinfo(request->easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+		if (length < 0) {
+			request->sink_status = EB_ERROR_UNSUPPORTED;
+			return false;
+		}
+		if ((uint64_t)length > range->length)
+			request->skip = (uint64_t)length - range->length;
+		request->limit = range->length;
+	} else {
+		request->skip = range->offset;
+		if (range->length > 0)
+			request->limit = range->length;
+	}
+	return true;
+}
+
+static size_t http_write_body(char *data, size_t size, size_t count, void *ctx)
+{
+	struct http_request *request = ctx;
+	size_t total = size * count;
+	size_t length = total;
+
+	if (!request->body_started) {
+		curl_easy_getinfo(request->easy, CURLINFO_RESPONSE_CODE, &request->status);
+		if (!http_start_body(request))
+			return 0;
+	}
+
+	/* Error pages are not handed to the sink */
+	if (request->status < 200 || request->status >= 300 || !request->sink)
+		return total;
+
+	if (request->skip > 0) {
+		size_t skipped = request->skip < length ? (size_t)request->skip : length;
+		request->skip -= skipped;
+		data += skipped;
+		length -= skipped;
+	}
+	if (length > request->limit)
+		length = (size_t)request->limit;
+	if (length == 0)
+		return total;
+	if (request->limit != UINT64_MAX)
+		request->limit -= length;
+
+	int status = request->sink(request->sink_ctx, data, length);
+	if (status != EB_SUCCESS) {
+		request->sink_status = status;
+		return 0;
+	}
+	request->received += length;
+	return total;
+}
+
+/* Percent-encode a key for the request path, keeping its slashes */
+static bool http_url(const struct http_data *http, const char *key, char *url, size_t url_size)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	size_t used = (size_t)snprintf(url, url_size, "%s/", http->origin);
+
+	while (*key == '/')
+		key++;
+	for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+		bool plain = (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+			     (*p >= '0' && *p <= '9') || strchr("-._~/", *p);
+		if (used + (plain ? 1 : 3) >= url_size)
+			return false;
+		if (plain) {
+			url[used++] = (char)*p;
+		} else {
+			url[used++] = '%';
+			url[used++] = hex[*p >> 4];
+			url[used++] = hex[*p & 0x0F];
+		}
+	}
+	url[used] = '\0';
+	return used < url_size;
+}
+
+static void http_request_free(struct http_data *http, struct http_request *request)
+{
+	if (!request)
+		return;
+	if (request->easy) {
+		if (request->active) {
+			curl_multi_remove_handle(http->multi, request->easy);
+			http->in_flight--;
+		}
+		curl_easy_cleanup(request->easy);
+	}
+	curl_slist_free_all(request->headers);
+	free(request->body);
+	free(request);
+}
+
+/**
+ * Create a transfer for a key
+ *
+ * @param transport Connected transport
+ * @param method "GET", "PUT" or "DELETE"
+ * @param key Object key, starting at the server root
+ * @return New request, or NULL with the error set on the transport
+ */
+static struct http_request *http_request_new(eb_transport_t *transport, const char *method, const char *key)
+{
+	struct http_data *http = transport->data;
+	char url[4096];
+
+	struct http_request *request = calloc(1, sizeof(*request));
+	if (!request) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg), "Out of memory");
+		return NULL;
+	}
+	snprintf(request->key, sizeof(request->key), "%s", key);
+
+	if (!http_url(http, key, url, sizeof(url))) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg), "Key too long: %s", key);
+		free(request);
+		return NULL;
+	}
+
+	request->easy = curl_easy_init();
+	if (!request->easy) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg), "Failed to create HTTP request");
+		free(request);
+		return NULL;
+	}
+
+	CURL *easy = request->easy;
+	curl_easy_setopt(easy, CURLOPT_URL, url);
+	curl_easy_setopt(easy, CURLOPT_PRIVATE, request);
+	curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, request->error);
+	curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, http->http_version);
+	curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+	curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, (long)HTTP_CONNECT_TIMEOUT_SECONDS);
+	curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, (long)HTTP_STALL_TIMEOUT_SECONDS);
+	curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, http_write_body);
+	curl_easy_setopt(easy, CURLOPT_WRITEDATA, request);
+	curl_easy_setopt(easy, CURLOPT_USERAGENT, "embr");
+	if (http_share)
+		curl_easy_setopt(easy, CURLOPT_SHARE, http_share);
+
+	if (strcmp(method, "GET") == 0) {
+		curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+	} else if (strcmp(method, "PUT") == 0) {
+		curl_easy_setopt(easy, CURLOPT_UPLOAD, 1L);
+		curl_easy_setopt(easy, CURLOPT_READFUNCTION, http_read_body);
+		curl_easy_setopt(easy, CURLOPT_READDATA, request);
+		/* Waiting for 100-continue costs a round trip per object */
+		request->headers = curl_slist_append(request->headers, "Expect:");
+	} else {
+		curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, method);
+	}
+
+	if (http->token) {
+		char authorization[1024];
+		snprintf(authorization, sizeof(authorization), "Authorization: Bearer %s", http->token);
+		request->headers = curl_slist_append(request->headers, authorization);
+	}
+	return request;
+}
+
+/* Take the finished transfers off the multi handle */
+static void http_collect(struct http_data *http)
+{
+	CURLMsg *message;
+	int left;
+
+	while ((message = curl_multi_info_read(http->multi, &left))) {
+		if (message->msg != CURLMSG_DONE)
+			continue;
+
+		CURL *easy = message->easy_handle;
+		CURLcode result = message->data.result;
+		struct http_request *request = NULL;
+		curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&request);
+		curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &request->status);
+		curl_multi_remove_handle(http->multi, easy);
+		request->result = result;
+		request->active = false;
+		request->done = true;
+		http->in_flight--;
+	}
+}
+
+/* Let the transfers move for up to one poll interval */
+static int http_step(eb_transport_t *transport)
+{
+	struct http_data *http = transport->data;
+	int running = 0;
+
+	CURLMcode code = curl_multi_perform(http->multi, &running);
+	if (code == CURLM_OK) {
+		http_collect(http);
+		if (running > 0)
+			code = curl_multi_poll(http->multi, NULL, 0, HTTP_POLL_MS, NULL);
+	}
+	if (code != CURLM_OK) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "HTTP transfer failed: %s", curl_multi_strerror(code));
+		return EB_ERROR_CONNECTION_FAILED;
+	}
+	return EB_SUCCESS;
+}
+
+/* Put a request on the multi handle once a slot is free */
+static int http_start(eb_transport_t *transport, struct http_request *request)
+{
+	struct http_data *http = transport->data;
+
+	while (http->in_flight >= http->parallel) {
+		int status = http_step(transport);
+		if (status != EB_SUCCESS)
+			return status;
+	}
+
+	if (request->headers)
+		curl_easy_setopt(request->easy, CURLOPT_HTTPHEADER, request->headers);
+	if (curl_multi_add_handle(http->multi, request->easy) != CURLM_OK) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Failed to start request for %s", request->key);
+		return EB_ERROR_CONNECTION_FAILED;
+	}
+	request->active = true;
+	http->in_flight++;
+	return EB_SUCCESS;
+}
+
+/* Drive the multi handle until a request is done, then report its status */
+static int http_finish(eb_transport_t *transport, struct http_request *request)
+{
+	while (!request->done) {
+		int status = http_step(transport);
+		if (status != EB_SUCCESS)
+			return status;
+	}
+	return http_request_status(transport, request);
+}
+
+/* Run one request to completion */
+static int http_perform(eb_transport_t *transport, struct http_request *request)
+{
+	int status = http_start(transport, request);
+	if (status != EB_SUCCESS)
+		return status;
+	return http_finish(transport, request);
+}
+
+/* PUT request with a copy of data as its body */
+static struct http_request *http_put_request(eb_transport_t *transport, const char *key,
+					     const void *data, size_t size, const char *content_type)
+{
+	struct http_request *request = http_request_new(transport, "PUT", key);
+	if (!request)
+		return NULL;
+
+	request->body = malloc(size ? size : 1);
+	if (!request->body) {
+		http_request_free(transport->data, request);
+		return NULL;
+	}
+	if (size)
+		memcpy(request->body, data, size);
+	request->body_size = size;
+	curl_easy_setopt(request->easy, CURLOPT_INFILESIZE_LARGE, (curl_off_t)size);
+
+	char header[128];
+	snprintf(header, sizeof(header), "Content-Type: %s", content_type);
+	request->headers = curl_slist_append(request->headers, header);
+	return request;
+}
+
+static int http_put(eb_transport_t *transport, const char *key, const void *data, size_t size,
+		    const char *content_type)
+{
+	struct http_request *request = http_put_request(transport, key, data, size, content_type);
+	if (!request)
+		return EB_ERROR_MEMORY;
+
+	int status = http_perform(transport, request);
+	http_request_free(transport->data, request);
+	return status;
+}
+
+static void http_free(struct http_data *http)
+{
+	if (!http)
+		return;
+	if (http->multi)
+		curl_multi_cleanup(http->multi);
+	free(http->origin);
+	free(http->prefix);
+	free(http->token);
+	free(http);
+}
+
+/* Split a URL into origin and key prefix */
+static int http_parse_url(const char *url, char **origin_out, char **prefix_out)
+{
+	const char *scheme_end = strstr(url, "://");
+	if (!scheme_end)
+		return EB_ERROR_INVALID_URL;
+
+	const char *host = scheme_end + 3;
+	size_t host_len = strcspn(host, "/?#");
+	if (host_len == 0)
+		return EB_ERROR_INVALID_URL;
+
+	const char *path = host + host_len;
+	while (*path == '/')
+		path++;
+	size_t path_len = strcspn(path, "?#");
+	while (path_len > 0 && path[path_len - 1] == '/')
+		path_len--;
+
+	*origin_out = strndup(url, (size_t)(host + host_len - url));
+	*prefix_out = strndup(path, path_len);
+	if (!*origin_out || !*prefix_out) {
+		free(*origin_out);
+		free(*prefix_out);
+		return EB_ERROR_MEMORY;
+	}
+	return EB_SUCCESS;
+}
+
+static size_t http_url_parallel(const eb_transport_t *transport)
+{
+	size_t parallel = HTTP_DEFAULT_PARALLEL;
+	char *value = get_url_param(transport->url, "parallel");
+	if (value) {
+		char *end = NULL;
+		unsigned long parsed = strtoul(value, &end, 10);
+		if (end != value && *end == '\0' && parsed > 0)
+			parallel = parsed;
+		else
+			DEBUG_WARN("Ignoring invalid parallel=%s", value);
+		free(value);
+	}
+	if (transport->options.max_connections > 0)
+		parallel = transport->options.max_connections;
+	return parallel > HTTP_MAX_PARALLEL ? HTTP_MAX_PARALLEL : parallel;
+}
+
+static long http_url_version(const eb_transport_t *transport)
+{
+	long version = CURL_HTTP_VERSION_2TLS;
+	char *value = get_url_param(transport->url, "http2");
+	if (value) {
+		if (strcmp(value, "0") == 0 || strcmp(value, "false") == 0)
+			version = CURL_HTTP_VERSION_1_1;
+		else if (strcmp(value, "prior") == 0)
+			version = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+		free(value);
+	}
+	return version;
+}
+
 static int http_connect(eb_transport_t *transport)
 {
-	if (!transport)
+	if (!transport || !transport->url)
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "HTTP transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	DEBUG_PRINT("HTTP transport not supported");
-	return EB_ERROR_NOT_IMPLEMENTED;
+
+	pthread_once(&http_once, http_global_init);
+	if (http_global_status != CURLE_OK) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Failed to initialize libcurl: %s", curl_easy_strerror(http_global_status));
+		return EB_ERROR_INITIALIZATION;
+	}
+
+	struct http_data *http = calloc(1, sizeof(*http));
+	if (!http)
+		return EB_ERROR_MEMORY;
+
+	int status = http_parse_url(transport->url, &http->origin, &http->prefix);
+	if (status != EB_SUCCESS) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Invalid HTTP URL: %s", transport->url);
+		http_free(http);
+		return status;
+	}
+
+	const char *token = getenv("EB_HTTP_TOKEN");
+	if (token && *token && !(http->token = strdup(token))) {
+		http_free(http);
+		return EB_ERROR_MEMORY;
+	}
+	http->parallel = http_url_parallel(transport);
+	http->http_version = http_url_version(transport);
+
+	http->multi = curl_multi_init();
+	if (!http->multi) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Failed to create HTTP client");
+		http_free(http);
+		return EB_ERROR_INITIALIZATION;
+	}
+	curl_multi_setopt(http->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+	curl_multi_setopt(http->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)http->parallel);
+	curl_multi_setopt(http->multi, CURLMOPT_MAXCONNECTS, (long)http->parallel);
+
+	transport->data = http;
+	DEBUG_PRINT("Connected HTTP transport to %s prefix '%s' (%zu in flight)",
+		    http->origin, http->prefix, http->parallel);
+	return EB_SUCCESS;
 }
 
 static int http_disconnect(eb_transport_t *transport)
 {
 	if (!transport)
 		return EB_ERROR_INVALID_PARAMETER;
-	
+
+	http_free(transport->data);
+	transport->data = NULL;
 	return EB_SUCCESS;
 }
 
-static int http_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash)
+/* Transform an object and start its upload */
+static int http_submit_data(eb_transport_t *transport, const void *data, size_t size,
+			    const char *hash, void **request_out)
 {
-	(void)data;  /* Suppress unused parameter warning */
-	(void)size;  /* Suppress unused parameter warning */
-	(void)hash;  /* Suppress unused parameter warning */
-	
-	if (!transport)
+	if (!transport || !transport->data || !data || size == 0 || !request_out)
+		return EB_ERROR_INVALID_PARAMETER;
+	if (!hash || !*hash) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "No hash provided for HTTP upload");
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "HTTP transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	return EB_ERROR_NOT_IMPLEMENTED;
+	}
+
+	struct http_upload *upload = calloc(1, sizeof(*upload));
+	if (!upload)
+		return EB_ERROR_MEMORY;
+
+	char data_key[1024];
+	eb_remote_object_keys(((struct http_data *)transport->data)->prefix, transport->target_path, hash,
+			      upload->set_name, sizeof(upload->set_name), data_key, sizeof(data_key),
+			      upload->metadata_key, sizeof(upload->metadata_key));
+	upload->timestamp = eb_remote_object_time(hash);
+
+	void *payload = NULL;
+	size_t payload_size = 0;
+	eb_status_t transformed = eb_remote_object_encode(data, size, transport->data_is_precompressed,
+							  &payload, &payload_size);
+	if (transformed != EB_SUCCESS) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Failed to transform data to Parquet format: %d", transformed);
+		if (payload && payload != data)
+			free(payload);
+		free(upload);
+		return transformed;
+	}
+
+	upload->request = http_put_request(transport, data_key, payload, payload_size,
+					   "application/octet-stream");
+	if (payload != data)
+		free(payload);
+	if (!upload->request) {
+		free(upload);
+		return EB_ERROR_MEMORY;
+	}
+
+	int status = http_start(transport, upload->request);
+	if (status != EB_SUCCESS) {
+		http_request_free(transport->data, upload->request);
+		free(upload);
+		return status;
+	}
+
+	struct http_data *http = transport->data;
+	http->uploads++;
+	*request_out = upload;
+	DEBUG_INFO("Uploading %zu bytes to %s/%s", payload_size, http->origin, data_key);
+	return EB_SUCCESS;
 }
 
-static int http_receive_data(eb_transport_t *transport, void *buffer, 
-						  size_t size, size_t *received)
+/* Wait for an upload, then store metadata.json if it was the last one */
+static int http_wait_data(eb_transport_t *transport, void *request)
 {
-	(void)buffer;  /* Suppress unused parameter warning */
-	(void)size;    /* Suppress unused parameter warning */
-	
-	if (!transport || !received)
+	if (!transport || !transport->data || !request)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct http_data *http = transport->data;
+	struct http_upload *upload = request;
+	int status = http_finish(transport, upload->request);
+
+	if (status == EB_SUCCESS) {
+		http->metadata_stale = true;
+		snprintf(http->metadata_key, sizeof(http->metadata_key), "%s", upload->metadata_key);
+		snprintf(http->set_name, sizeof(http->set_name), "%s", upload->set_name);
+		http->last_size = upload->request->body_size;
+		http->last_timestamp = upload->timestamp;
+	}
+	http_request_free(http, upload->request);
+	free(upload);
+	http->uploads--;
+
+	if (http->uploads == 0 && http->metadata_stale) {
+		char *metadata = NULL;
+		int built = eb_remote_metadata_build(http->set_name, http->last_size, http->last_timestamp,
+						     &metadata);
+		if (built == EB_SUCCESS)
+			built = http_put(transport, http->metadata_key, metadata, strlen(metadata),
+					 "application/json");
+		free(metadata);
+		if (built == EB_SUCCESS)
+			http->metadata_stale = false;
+		else if (status == EB_SUCCESS)
+			status = built;
+	}
+	return status;
+}
+
+static int http_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash)
+{
+	void *upload = NULL;
+	int status = http_submit_data(transport, data, size, hash, &upload);
+	if (status != EB_SUCCESS)
+		return status;
+	return http_wait_data(transport, upload);
+}
+
+static void http_range_header(struct http_request *request, const eb_transport_range_t *range)
+{
+	char header[96];
+
+	if (!range)
+		return;
+	if (range->from_end) {
+		if (range->length == 0)
+			return;
+		snprintf(header, sizeof(header), "Range: bytes=-%llu", (unsigned long long)range->length);
+	} else if (range->length == 0) {
+		if (range->offset == 0)
+			return;
+		snprintf(header, sizeof(header), "Range: bytes=%llu-", (unsigned long long)range->offset);
+	} else {
+		snprintf(header, sizeof(header), "Range: bytes=%llu-%llu", (unsigned long long)range->offset,
+			 (unsigned long long)(range->offset + range->length - 1));
+	}
+	request->headers = curl_slist_append(request->headers, header);
+	request->range = range;
+}
+
+static int http_receive_stream(eb_transport_t *transport, const eb_transport_range_t *range,
+			       eb_transport_sink_fn sink, void *ctx, size_t *received)
+{
+	if (!transport || !transport->data || !sink || !received)
 		return EB_ERROR_INVALID_PARAMETER;
-	
 	*received = 0;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "HTTP transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	return EB_ERROR_NOT_IMPLEMENTED;
+
+	if (!transport->target_path) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "No object selected for download");
+		return EB_ERROR_INVALID_PARAMETER;
+	}
+
+	struct http_request *request = http_request_new(transport, "GET", transport->target_path);
+	if (!request)
+		return EB_ERROR_MEMORY;
+	request->sink = sink;
+	request->sink_ctx = ctx;
+	http_range_header(request, range);
+
+	int status = http_perform(transport, request);
+	*received = request->received;
+	http_request_free(transport->data, request);
+	return status;
+}
+
+struct truncating_sink {
+	char *buffer;
+	size_t size;
+	size_t used;
+};
+
+static int http_truncating_sink(void *ctx, const void *data, size_t size)
+{
+	struct truncating_sink *sink = ctx;
+	size_t room = sink->size - sink->used;
+
+	if (size > room) {
+		DEBUG_WARN("http_receive_data: buffer capacity exceeded, discarding %zu bytes", size - room);
+		size = room;
+	}
+	memcpy(sink->buffer + sink->used, data, size);
+	sink->used += size;
+	return EB_SUCCESS;
+}
+
+static int http_receive_data(eb_transport_t *transport, void *buffer,
+			     size_t size, size_t *received)
+{
+	if (!transport || !buffer || size == 0 || !received)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct truncating_sink sink = { .buffer = buffer, .size = size, .used = 0 };
+	size_t streamed = 0;
+	int status = http_receive_stream(transport, NULL, http_truncating_sink, &sink, &streamed);
+	*received = sink.used;
+	return status;
+}
+
+static int http_put_object(eb_transport_t *transport, const char *key, const void *data, size_t size)
+{
+	if (!transport || !transport->data || !key)
+		return EB_ERROR_INVALID_PARAMETER;
+	return http_put(transport, key, data, size, "application/octet-stream");
+}
+
+/*
+ * Directory listings
+ */
+struct http_listing {
+	char **keys;
+	size_t count;
+	size_t capacity;
+};
+
+static int http_listing_add(struct http_listing *listing, char *key)
+{
+	if (listing->count == listing->capacity) {
+		size_t capacity = listing->capacity ? listing->capacity * 2 : 64;
+		char **grown = realloc(listing->keys, capacity * sizeof(*grown));
+		if (!grown) {
+			free(key);
+			return EB_ERROR_MEMORY;
+		}
+		listing->keys = grown;
+		listing->capacity = capacity;
+	}
+	listing->keys[listing->count++] = key;
+	return EB_SUCCESS;
+}
+
+static void http_listing_free(struct http_listing *listing)
+{
+	for (size_t i = 0; i < listing->count; i++)
+		free(listing->keys[i]);
+	free(listing->keys);
+	listing->keys = NULL;
+	listing->count = listing->capacity = 0;
+}
+
+static int http_hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Turn one listed name into "<dir>/<name>", NULL for links out of dir */
+static char *http_listed_key(const char *dir, const char *name, size_t length)
+{
+	if (length == 0 || name[0] == '/' || name[0] == '?' || name[0] == '#' ||
+	    name[0] == '.' || memchr(name, ':', length))
+		return NULL;
+
+	size_t dir_len = strlen(dir);
+	char *key = malloc(dir_len + length + 2);
+	if (!key)
+		return NULL;
+	memcpy(key, dir, dir_len);
+	size_t used = dir_len;
+	key[used++] = '/';
+	for (size_t i = 0; i < length; i++) {
+		int high, low;
+		if (name[i] == '%' && i + 2 < length &&
+		    (high = http_hex_digit(name[i + 1])) >= 0 && (low = http_hex_digit(name[i + 2])) >= 0) {
+			key[used++] = (char)(high * 16 + low);
+			i += 2;
+		} else {
+			key[used++] = name[i];
+		}
+	}
+	key[used] = '\0';
+	return key;
+}
+
+/* Names of an index page, from href="..." in HTML or one per line otherwise */
+static int http_parse_listing(const char *dir, const char *body, size_t size,
+			      struct http_listing *files, struct http_listing *dirs)
+{
+	bool html = memmem(body, size, "href=", 5) != NULL;
+	const char *p = body;
+	const char *end = body + size;
+
+	while (p < end) {
+		const char *name;
+		size_t length;
+		if (html) {
+			const char *href = memmem(p, (size_t)(end - p), "href=\"", 6);
+			if (!href)
+				break;
+			name = href + 6;
+			const char *close = memchr(name, '"', (size_t)(end - name));
+			if (!close)
+				break;
+			length = (size_t)(close - name);
+			p = close + 1;
+		} else {
+			name = p;
+			const char *newline = memchr(p, '\n', (size_t)(end - p));
+			length = newline ? (size_t)(newline - p) : (size_t)(end - p);
+			p = newline ? newline + 1 : end;
+			while (length > 0 && (name[length - 1] == '\r' || name[length - 1] == ' '))
+				length--;
+		}
+
+		bool is_dir = length > 0 && name[length - 1] == '/';
+		char *key = http_listed_key(dir, name, is_dir ? length - 1 : length);
+		if (!key)
+			continue;
+		int status = http_listing_add(is_dir ? dirs : files, key);
+		if (status != EB_SUCCESS)
+			return status;
+	}
+	return EB_SUCCESS;
+}
+
+/* Response body collected in memory */
+struct http_body {
+	char *data;
+	size_t size;
+};
+
+static int http_body_sink(void *ctx, const void *data, size_t size)
+{
+	struct http_body *body = ctx;
+
+	char *grown = realloc(body->data, body->size + size);
+	if (!grown)
+		return EB_ERROR_MEMORY;
+	memcpy(grown + body->size, data, size);
+	body->data = grown;
+	body->size += size;
+	return EB_SUCCESS;
+}
+
+/* List a set of directories at once, their subdirectories go to next */
+static int http_list_level(eb_transport_t *transport, struct http_listing *level,
+			   struct http_listing *files, struct http_listing *next)
+{
+	struct http_request **requests = calloc(level->count, sizeof(*requests));
+	struct http_body *bodies = calloc(level->count, sizeof(*bodies));
+	int status = requests && bodies ? EB_SUCCESS : EB_ERROR_MEMORY;
+
+	/* Every listing of the level is in flight together */
+	for (size_t i = 0; i < level->count && status == EB_SUCCESS; i++) {
+		char dir_key[1024];
+		snprintf(dir_key, sizeof(dir_key), "%s/", level->keys[i]);
+		requests[i] = http_request_new(transport, "GET", dir_key);
+		if (!requests[i]) {
+			status = EB_ERROR_MEMORY;
+			break;
+		}
+		requests[i]->sink = http_body_sink;
+		requests[i]->sink_ctx = &bodies[i];
+		requests[i]->headers = curl_slist_append(requests[i]->headers,
+							 "Accept: text/plain, text/html;q=0.9");
+		status = http_start(transport, requests[i]);
+	}
+
+	for (size_t i = 0; requests && i < level->count; i++) {
+		if (!requests[i])
+			break;
+		int listed = status == EB_SUCCESS ? http_finish(transport, requests[i]) : status;
+		/* A prefix nothing was pushed to yet is empty, not an error */
+		if (listed == EB_ERROR_NOT_FOUND)
+			listed = EB_SUCCESS;
+		else if (listed == EB_SUCCESS && bodies[i].data)
+			listed = http_parse_listing(level->keys[i], bodies[i].data, bodies[i].size, files, next);
+		if (status == EB_SUCCESS)
+			status = listed;
+		http_request_free(transport->data, requests[i]);
+		free(bodies[i].data);
+	}
+	free(requests);
+	free(bodies);
+	return status;
 }
 
 static int http_list_refs(eb_transport_t *transport, char ***refs, size_t *count)
 {
-	if (!transport || !refs || !count)
+	if (!transport || !transport->data || !refs || !count)
 		return EB_ERROR_INVALID_PARAMETER;
-	
 	*refs = NULL;
 	*count = 0;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "HTTP transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	return EB_ERROR_NOT_IMPLEMENTED;
+
+	struct http_data *http = transport->data;
+	struct http_listing files = { NULL, 0, 0 };
+	struct http_listing level = { NULL, 0, 0 };
+	char *root = strdup(http->prefix[0] ? http->prefix : "sets");
+	int status = root ? http_listing_add(&level, root) : EB_ERROR_MEMORY;
+
+	for (int depth = 0; status == EB_SUCCESS && level.count > 0; depth++) {
+		struct http_listing next = { NULL, 0, 0 };
+		status = http_list_level(transport, &level, &files, &next);
+		http_listing_free(&level);
+		level = next;
+		if (depth + 1 >= HTTP_LIST_DEPTH && level.count > 0) {
+			DEBUG_WARN("http_list_refs: not descending below %d levels", HTTP_LIST_DEPTH);
+			break;
+		}
+	}
+	http_listing_free(&level);
+
+	if (status != EB_SUCCESS) {
+		http_listing_free(&files);
+		return status;
+	}
+	*refs = files.keys;
+	*count = files.count;
+	return EB_SUCCESS;
+}
+
+static int http_delete_refs(eb_transport_t *transport, const char **refs, size_t count)
+{
+	if (!transport || !transport->data || !refs || count == 0)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct http_data *http = transport->data;
+	struct http_request **requests = calloc(http->parallel, sizeof(*requests));
+	if (!requests)
+		return EB_ERROR_MEMORY;
+
+	size_t failed = 0;
+	size_t deleted = 0;
+	int status = EB_SUCCESS;
+	int first_error = EB_SUCCESS;
+	size_t next = 0;
+
+	/* Windows of up to parallel deletes, all in flight together */
+	while (next < count && status == EB_SUCCESS) {
+		size_t started = 0;
+		while (started < http->parallel && next < count) {
+			const char *key = refs[next++];
+			if (!key || !*key)
+				continue;
+			requests[started] = http_request_new(transport, "DELETE", key);
+			if (!requests[started]) {
+				status = EB_ERROR_MEMORY;
+				break;
+			}
+			status = http_start(transport, requests[started++]);
+			if (status != EB_SUCCESS)
+				break;
+		}
+
+		for (size_t i = 0; i < started; i++) {
+			int result = status == EB_SUCCESS ? http_finish(transport, requests[i]) : status;
+			/* Already gone is as good as deleted */
+			if (result == EB_SUCCESS || result == EB_ERROR_NOT_FOUND) {
+				deleted++;
+			} else {
+				failed++;
+				if (first_error == EB_SUCCESS)
+					first_error = result;
+			}
+			http_request_free(http, requests[i]);
+		}
+	}
+	free(requests);
+
+	DEBUG_INFO("Deleted %zu objects, %zu failed", deleted, failed);
+	if (status != EB_SUCCESS)
+		return status;
+	if (failed > 1) {
+		size_t len = strlen(transport->error_msg);
+		snprintf(transport->error_msg + len, sizeof(transport->error_msg) - len,
+			 " (%zu objects failed)", failed);
+	}
+	return first_error;
+}
+
+/*
+ * Point a connected transport at another prefix of the same server
+ *
+ * Its connections only depend on the origin and the tuning parameters.
+ */
+static int http_retarget(eb_transport_t *transport, const char *url)
+{
+	if (!transport || !transport->data || !url)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct http_data *http = transport->data;
+	char *origin = NULL;
+	char *prefix = NULL;
+	int status = http_parse_url(url, &origin, &prefix);
+	if (status != EB_SUCCESS)
+		return status;
+
+	char *parallel_a = get_url_param(transport->url, "parallel");
+	char *parallel_b = get_url_param(url, "parallel");
+	char *version_a = get_url_param(transport->url, "http2");
+	char *version_b = get_url_param(url, "http2");
+	bool same = strcmp(origin, http->origin) == 0 &&
+		    strcmp(parallel_a ? parallel_a : "", parallel_b ? parallel_b : "") == 0 &&
+		    strcmp(version_a ? version_a : "", version_b ? version_b : "") == 0;
+	free(parallel_a);
+	free(parallel_b);
+	free(version_a);
+	free(version_b);
+	free(origin);
+
+	if (!same || http->uploads > 0 || http->metadata_stale) {
+		free(prefix);
+		return EB_ERROR_UNSUPPORTED;
+	}
+	free(http->prefix);
+	http->prefix = prefix;
+	DEBUG_PRINT("Retargeted HTTP transport to %s prefix '%s'", http->origin, http->prefix);
+	return EB_SUCCESS;
 }
 
 /* HTTP transport operations structure */
@@ -99,12 +1134,19 @@ struct transport_ops http_ops = {
 	.disconnect = http_disconnect,
 	.send_data = http_send_data,
 	.receive_data = http_receive_data,
-	.list_refs = http_list_refs
+	.list_refs = http_list_refs,
+	.delete_refs = http_delete_refs,
+	.retarget = http_retarget,
+	.submit_data = http_submit_data,
+	.wait_data = http_wait_data,
+	.receive_stream = http_receive_stream,
+	.put_object = http_put_object
 };
 
 /* HTTP transport initialization */
 int http_transport_init(void)
 {
-	DEBUG_PRINT("HTTP transport module initialized (stub implementation)");
-	return EB_SUCCESS;
-} 
\ No newline at end of file
+	pthread_once(&http_once, http_global_init);
+	DEBUG_PRINT("HTTP transport module initialized");
+	return http_global_status == CURLE_OK ? EB_SUCCESS : EB_ERROR_INITIALIZATION;
+}
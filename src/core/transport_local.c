@@ -8,483 +8,520 @@
  * (at your option) any later version.
  */
 
+#define _GNU_SOURCE /* For strndup */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <time.h>
 
 #include "transport.h"
 #include "error.h"
 #include "debug.h"
+#include "fs.h"
+#include "remote_metadata.h"
 
-// Function declaration
-static int mkdir_p(const char *path);
+/*
+ * Local directory transport
+ *
+ * Remotes on a local or network file system (NFS, SMB) are directories
+ * with the same key layout as an object store:
+ *
+ *   /mnt/shared/embeddings
+ *   file:///mnt/shared/embeddings
+ *
+ * Keys are paths as given, relative keys resolve against the working
+ * directory like relative remote paths do.
+ *
+ * Objects are written through a temporary file and renamed into place.
+ * Downloads into a file descriptor never pass through a user-space
+ * buffer: whole objects are reflinked when source and destination share
+ * a copy-on-write file system (XFS, Btrfs), anything else goes through
+ * copy_file_range or sendfile, which NFS turns into server-side copies.
+ */
+#define LOCAL_CHUNK_SIZE (1024 * 1024)
+#define LOCAL_LIST_DEPTH 16
 
-/* Local transport specific data */
 struct local_data {
-	char *path;          /* Local repository path */
-	int is_connected;    /* Connection state */
-	FILE *current_file;  /* Current file for read/write operations */
-	char *current_name;  /* Current filename */
+	char *prefix;                 /* Key prefix of the URL, "" for none */
 };
 
-/* Helper to parse local URL */
-static char *parse_local_url(const char *url)
+/* Key prefix of a URL, the directory path without file:// or a trailing '/' */
+static int local_parse_url(const char *url, char **prefix_out)
 {
-	char *path = NULL;
-	
-	/* Check for file:// prefix */
-	if (strncmp(url, "file://", 7) == 0) {
-		path = strdup(url + 7);
-	} else {
-		/* Assume it's already a path */
-		path = strdup(url);
-	}
-	
-	/* Normalize path by removing trailing slashes */
-	if (path) {
-		size_t len = strlen(path);
-		while (len > 0 && path[len - 1] == '/') {
-			path[--len] = '\0';
-		}
-	}
-	
-	return path;
+	const char *path = strncmp(url, "file://", 7) == 0 ? url + 7 : url;
+	size_t length = strcspn(path, "?");
+
+	if (length == 0)
+		return EB_ERROR_INVALID_URL;
+	while (length > 1 && path[length - 1] == '/')
+		length--;
+
+	*prefix_out = strndup(path, length);
+	return *prefix_out ? EB_SUCCESS : EB_ERROR_MEMORY;
 }
 
-/* Connect to local repository */
-static int local_connect(eb_transport_t *transport)
+/* File system path of a key */
+static int local_key_path(eb_transport_t *transport, const char *key, char *path, size_t path_size)
 {
-	struct local_data *local;
-	struct stat st;
-	
-	if (!transport)
+	if (!*key)
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	/* Create local data */
-	local = calloc(1, sizeof(*local));
-	if (!local) {
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to allocate memory for local transport");
-		return EB_ERROR_MEMORY;
+	if ((size_t)snprintf(path, path_size, "%s", key) >= path_size) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg), "Path too long: %s", key);
+		return EB_ERROR_PATH_TOO_LONG;
 	}
-	
-	/* Parse URL to get local path */
-	local->path = parse_local_url(transport->url);
-	if (!local->path) {
-		free(local);
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to parse local URL: %s", transport->url);
-		return EB_ERROR_INVALID_PARAMETER;
-	}
-	
-	/* Check if path exists and is a directory */
-	if (stat(local->path, &st) < 0) {
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to access repository at %s: %s", 
-			 local->path, strerror(errno));
-		free(local->path);
-		free(local);
+	return EB_SUCCESS;
+}
+
+static int local_errno_status(int error)
+{
+	if (error == ENOENT || error == ENOTDIR)
 		return EB_ERROR_NOT_FOUND;
+	if (error == EACCES || error == EPERM)
+		return EB_ERROR_PERMISSION_DENIED;
+	return EB_ERROR_IO;
+}
+
+/* Produces the content of a file being stored, writing it to fd */
+typedef int (*local_fill_fn)(int fd, void *ctx);
+
+/* Store what fill writes under a key through a temporary file */
+static int local_write_fn(eb_transport_t *transport, const char *key, local_fill_fn fill, void *ctx)
+{
+	char path[PATH_MAX];
+	char temp[PATH_MAX];
+	int status = local_key_path(transport, key, path, sizeof(path));
+	if (status != EB_SUCCESS)
+		return status;
+
+	const char *name = strrchr(path, '/');
+	int dir_length = name ? (int)(name - path) : 0;
+	if (dir_length > 0) {
+		snprintf(temp, sizeof(temp), "%.*s", dir_length, path);
+		if (fs_mkdir_p(temp, 0755) != 0) {
+			status = local_errno_status(errno);
+			snprintf(transport->error_msg, sizeof(transport->error_msg),
+				 "Failed to create %s: %s", temp, strerror(errno));
+			return status;
+		}
 	}
-	
-	if (!S_ISDIR(st.st_mode)) {
+	if ((size_t)snprintf(temp, sizeof(temp), "%.*s%s.%s.XXXXXX", dir_length, path,
+			     dir_length > 0 ? "/" : "", name ? name + 1 : path) >= sizeof(temp))
+		return EB_ERROR_PATH_TOO_LONG;
+
+	int fd = mkstemp(temp);
+	if (fd < 0) {
+		status = local_errno_status(errno);
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Path is not a directory: %s", local->path);
-		free(local->path);
-		free(local);
-		return EB_ERROR_INVALID_PARAMETER;
+			 "Failed to create temporary file for %s: %s", path, strerror(errno));
+		return status;
 	}
-	
-	/* Check if it's a valid EB repository */
-	char *eb_dir = malloc(strlen(local->path) + 5);
-	if (!eb_dir) {
-		free(local->path);
-		free(local);
+	fchmod(fd, 0644);
+
+	status = fill(fd, ctx);
+	if (close(fd) != 0 || status != EB_SUCCESS || rename(temp, path) != 0) {
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to allocate memory for path");
-		return EB_ERROR_MEMORY;
+			 "Failed to write %s: %s", path, strerror(errno));
+		unlink(temp);
+		return status != EB_SUCCESS ? status : EB_ERROR_IO;
 	}
-	
-	sprintf(eb_dir, "%s/.embr", local->path);
-	
-	if (stat(eb_dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
-		free(eb_dir);
-		free(local->path);
-		free(local);
+	return EB_SUCCESS;
+}
+
+struct local_buffer {
+	const void *data;
+	size_t size;
+};
+
+static int local_fill_buffer(int fd, void *ctx)
+{
+	struct local_buffer *buffer = ctx;
+	return transport_fd_sink(&fd, buffer->data, buffer->size);
+}
+
+/* Store bytes under a key through a temporary file */
+static int local_write(eb_transport_t *transport, const char *key, const void *data, size_t size)
+{
+	struct local_buffer buffer = { data, size };
+	return local_write_fn(transport, key, local_fill_buffer, &buffer);
+}
+
+struct local_object {
+	const void *data;
+	size_t size;
+	bool precompressed;
+	size_t encoded_size;
+};
+
+/* Encode an object straight into the file instead of into memory first */
+static int local_fill_object(int fd, void *ctx)
+{
+	struct local_object *object = ctx;
+	return eb_remote_object_encode_to(object->data, object->size, object->precompressed,
+					  transport_fd_sink, &fd, &object->encoded_size);
+}
+
+static int local_connect(eb_transport_t *transport)
+{
+	if (!transport || !transport->url)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct local_data *local = calloc(1, sizeof(*local));
+	if (!local)
+		return EB_ERROR_MEMORY;
+
+	int status = local_parse_url(transport->url, &local->prefix);
+	if (status != EB_SUCCESS) {
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Not a valid EB repository: %s", local->path);
-		return EB_ERROR_INVALID_REPOSITORY;
+			 "Invalid local URL: %s", transport->url);
+		free(local);
+		return status;
 	}
-	
-	free(eb_dir);
-	
-	/* Store local data in transport */
+
+	/* The remote directory itself may not exist before the first push */
 	transport->data = local;
-	local->is_connected = 1;
-	
-	DEBUG_PRINT("Local transport connected to %s", local->path);
+	DEBUG_PRINT("Local transport connected to %s", local->prefix);
 	return EB_SUCCESS;
 }
 
-/* Disconnect from local repository */
 static int local_disconnect(eb_transport_t *transport)
 {
-	struct local_data *local;
-	
 	if (!transport)
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	local = (struct local_data *)transport->data;
-	if (!local)
-		return EB_SUCCESS;
-	
-	/* Close current file if open */
-	if (local->current_file) {
-		fclose(local->current_file);
-		local->current_file = NULL;
+
+	struct local_data *local = transport->data;
+	if (local) {
+		free(local->prefix);
+		free(local);
 	}
-	
-	/* Free resources */
-	free(local->path);
-	free(local->current_name);
-	free(local);
 	transport->data = NULL;
-	
 	return EB_SUCCESS;
 }
 
-/* Send data to local repository */
+/* Store an object under the layout of its set, then the set's metadata.json */
 static int local_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash)
 {
-	(void)hash; // Ignore hash for local transport
-	struct local_data *local;
-	char tmp_path[PATH_MAX];
-	char *objects_dir;
-	size_t bytes_written;
-	
-	if (!transport || !data)
+	if (!transport || !transport->data || !data || size == 0)
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	local = (struct local_data *)transport->data;
-	if (!local || !local->is_connected)
-		return EB_ERROR_NOT_CONNECTED;
-	
-	/* Create temporary file for writing */
-	snprintf(tmp_path, sizeof(tmp_path), "%s/.embr/tmp/send_XXXXXX", local->path);
-	int fd = mkstemp(tmp_path);
-	if (fd < 0) {
-		/* Check if tmp directory exists and create it if needed */
-		char tmp_dir[PATH_MAX];
-		snprintf(tmp_dir, sizeof(tmp_dir), "%s/.embr/tmp", local->path);
-		
-		if (mkdir_p(tmp_dir) != 0) {
-			snprintf(transport->error_msg, sizeof(transport->error_msg),
-				 "Failed to create temporary directory: %s", strerror(errno));
-			return EB_ERROR_IO;
-		}
-		
-		/* Try again */
-		fd = mkstemp(tmp_path);
-		if (fd < 0) {
-			snprintf(transport->error_msg, sizeof(transport->error_msg),
-				 "Failed to create temporary file: %s", strerror(errno));
-			return EB_ERROR_IO;
-		}
-	}
-	
-	/* Write data to temporary file */
-	bytes_written = write(fd, data, size);
-	if (bytes_written < size) {
-		close(fd);
-		unlink(tmp_path);
+	if (!hash || !*hash) {
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to write data: %s", strerror(errno));
-		return EB_ERROR_IO;
+			 "No hash provided for local upload");
+		return EB_ERROR_INVALID_PARAMETER;
 	}
-	
-	close(fd);
-	
-	/* Determine target path based on data content */
-	/* In a real implementation, this would calculate hash and organize into objects dir */
-	/* For now, we just move to objects directory with a timestamp-based name */
-	objects_dir = malloc(strlen(local->path) + 32);
-	if (!objects_dir) {
-		unlink(tmp_path);
+
+	struct local_data *local = transport->data;
+	char set_name[256];
+	char data_key[PATH_MAX];
+	char metadata_key[PATH_MAX];
+	eb_remote_object_keys(local->prefix, transport->target_path, hash, set_name, sizeof(set_name),
+			      data_key, sizeof(data_key), metadata_key, sizeof(metadata_key));
+	time_t timestamp = eb_remote_object_time(hash);
+
+	struct local_object object = { data, size, transport->data_is_precompressed, 0 };
+	int status = local_write_fn(transport, data_key, local_fill_object, &object);
+	if (status != EB_SUCCESS) {
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to allocate memory for path");
-		return EB_ERROR_MEMORY;
+			 "Failed to store %s as Parquet: %d", data_key, status);
+		return status;
 	}
-	
-	sprintf(objects_dir, "%s/.embr/objects", local->path);
-	
-	/* Create objects directory if it doesn't exist */
-	if (mkdir_p(objects_dir) != 0) {
-		free(objects_dir);
-		unlink(tmp_path);
+
+	char *metadata = NULL;
+	status = eb_remote_metadata_build(set_name, object.encoded_size, timestamp, &metadata);
+	if (status == EB_SUCCESS)
+		status = local_write(transport, metadata_key, metadata, strlen(metadata));
+	free(metadata);
+	return status;
+}
+
+static int local_receive_stream(eb_transport_t *transport, const eb_transport_range_t *range,
+				eb_transport_sink_fn sink, void *ctx, size_t *received)
+{
+	if (!transport || !transport->data || !sink || !received)
+		return EB_ERROR_INVALID_PARAMETER;
+	*received = 0;
+
+	if (!transport->target_path) {
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to create objects directory: %s", strerror(errno));
-		return EB_ERROR_IO;
+			 "No object selected for download");
+		return EB_ERROR_INVALID_PARAMETER;
 	}
-	
-	/* Generate target filename */
-	char target_path[PATH_MAX];
-	time_t now = time(NULL);
-	snprintf(target_path, sizeof(target_path), "%s/%ld", objects_dir, now);
-	free(objects_dir);
-	
-	/* Move temporary file to target path */
-	if (rename(tmp_path, target_path) < 0) {
-		unlink(tmp_path);
+
+	char path[PATH_MAX];
+	int status = local_key_path(transport, transport->target_path, path, sizeof(path));
+	if (status != EB_SUCCESS)
+		return status;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		status = local_errno_status(errno);
 		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to rename temporary file: %s", strerror(errno));
-		return EB_ERROR_IO;
+			 "Failed to open %s: %s", path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return status;
 	}
-	
-	return EB_SUCCESS;
-}
 
-/* Receive data from local repository */
-static int local_receive_data(eb_transport_t *transport, void *buffer, 
-                             size_t size, size_t *received)
-{
-	struct local_data *local;
-	size_t bytes_read;
-	
-	if (!transport || !buffer || !received)
+	uint64_t size = (uint64_t)st.st_size;
+	uint64_t offset = range ? range->offset : 0;
+	uint64_t length = range ? range->length : 0;
+	if (range && range->from_end) {
+		offset = length > 0 && length < size ? size - length : 0;
+		length = size - offset;
+	} else if (offset > size) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Range starts past the end of %s", path);
+		close(fd);
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	local = (struct local_data *)transport->data;
-	if (!local || !local->is_connected)
-		return EB_ERROR_NOT_CONNECTED;
-	
-	*received = 0;
-	
-	/* If no file is open, open the first object file */
-	if (!local->current_file) {
-		char objects_dir[PATH_MAX];
-		DIR *dir;
-		struct dirent *entry;
-		struct stat st;
-		char *first_file = NULL;
-		time_t oldest_time = 0;
-		
-		snprintf(objects_dir, sizeof(objects_dir), "%s/.embr/objects", local->path);
-		
-		dir = opendir(objects_dir);
-		if (!dir) {
-			snprintf(transport->error_msg, sizeof(transport->error_msg),
-				 "Failed to open objects directory: %s", strerror(errno));
-			return EB_ERROR_IO;
-		}
-		
-		/* Find the oldest object file */
-		while ((entry = readdir(dir)) != NULL) {
-			if (entry->d_name[0] == '.')
-				continue;
-			
-			char file_path[PATH_MAX];
-			snprintf(file_path, sizeof(file_path), "%s/%s", objects_dir, entry->d_name);
-			
-			if (stat(file_path, &st) < 0)
-				continue;
-			
-			if (S_ISREG(st.st_mode)) {
-				if (!first_file || st.st_mtime < oldest_time) {
-					free(first_file);
-					first_file = strdup(file_path);
-					oldest_time = st.st_mtime;
-				}
-			}
-		}
-		
-		closedir(dir);
-		
-		if (!first_file) {
-			/* No object files found */
-			return EB_SUCCESS;
-		}
-		
-		/* Open the file */
-		local->current_file = fopen(first_file, "rb");
-		if (!local->current_file) {
+	} else if (length == 0 || length > size - offset) {
+		length = size - offset;
+	}
+
+	/* Straight into the destination file, reflinked when the file system allows */
+	if (sink == transport_fd_sink) {
+		eb_fs_copy_method_t method;
+		status = eb_fs_copy_fd(fd, offset, length, *(int *)ctx, &method);
+		close(fd);
+		if (status != EB_SUCCESS) {
 			snprintf(transport->error_msg, sizeof(transport->error_msg),
-				 "Failed to open object file: %s", strerror(errno));
-			free(first_file);
-			return EB_ERROR_IO;
+				 "Failed to copy %s: %s", path, strerror(errno));
+			return status;
 		}
-		
-		local->current_name = first_file;
+		DEBUG_PRINT("Copied %llu bytes of %s (method %d)", (unsigned long long)length, path, method);
+		*received = (size_t)length;
+		return EB_SUCCESS;
 	}
-	
-	/* Read data from current file */
-	bytes_read = fread(buffer, 1, size, local->current_file);
-	*received = bytes_read;
-	
-	if (bytes_read < size) {
-		/* End of file reached */
-		if (ferror(local->current_file)) {
+
+	unsigned char *buffer = malloc(LOCAL_CHUNK_SIZE);
+	if (!buffer) {
+		close(fd);
+		return EB_ERROR_MEMORY;
+	}
+	while (length > 0) {
+		size_t chunk = length < LOCAL_CHUNK_SIZE ? (size_t)length : LOCAL_CHUNK_SIZE;
+		ssize_t got = pread(fd, buffer, chunk, (off_t)offset);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0) {
 			snprintf(transport->error_msg, sizeof(transport->error_msg),
-				 "Failed to read from file: %s", strerror(errno));
-			fclose(local->current_file);
-			free(local->current_name);
-			local->current_file = NULL;
-			local->current_name = NULL;
-			return EB_ERROR_IO;
+				 "Failed to read %s: %s", path, got < 0 ? strerror(errno) : "file shrank");
+			status = EB_ERROR_IO;
+			break;
 		}
-		
-		/* Close current file */
-		fclose(local->current_file);
-		free(local->current_name);
-		local->current_file = NULL;
-		local->current_name = NULL;
+		status = sink(ctx, buffer, (size_t)got);
+		if (status != EB_SUCCESS)
+			break;
+		*received += (size_t)got;
+		offset += (uint64_t)got;
+		length -= (uint64_t)got;
 	}
-	
+	free(buffer);
+	close(fd);
+	return status;
+}
+
+struct truncating_sink {
+	char *buffer;
+	size_t size;
+	size_t used;
+};
+
+static int local_truncating_sink(void *ctx, const void *data, size_t size)
+{
+	struct truncating_sink *sink = ctx;
+	size_t room = sink->size - sink->used;
+
+	if (size > room) {
+		DEBUG_WARN("local_receive_data: buffer capacity exceeded, discarding %zu bytes", size - room);
+		size = room;
+	}
+	memcpy(sink->buffer + sink->used, data, size);
+	sink->used += size;
 	return EB_SUCCESS;
 }
 
-/* List references in local repository */
-static int local_list_refs(eb_transport_t *transport, char ***refs, size_t *count)
+static int local_receive_data(eb_transport_t *transport, void *buffer,
+			      size_t size, size_t *received)
 {
-	struct local_data *local;
-	DIR *dir;
-	struct dirent *entry;
-	struct stat st;
-	char **ref_list = NULL;
-	size_t ref_count = 0;
-	size_t ref_capacity = 0;
-	char refs_dir[PATH_MAX];
-	
-	if (!transport || !refs || !count)
+	if (!transport || !buffer || size == 0 || !received)
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	local = (struct local_data *)transport->data;
-	if (!local || !local->is_connected)
-		return EB_ERROR_NOT_CONNECTED;
-	
-	/* Initialize output parameters */
-	*refs = NULL;
-	*count = 0;
-	
-	/* Open refs directory */
-	snprintf(refs_dir, sizeof(refs_dir), "%s/.embr/refs", local->path);
-	
-	dir = opendir(refs_dir);
-	if (!dir) {
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to open refs directory: %s", strerror(errno));
-		return EB_ERROR_IO;
+
+	struct truncating_sink sink = { .buffer = buffer, .size = size, .used = 0 };
+	size_t streamed = 0;
+	int status = local_receive_stream(transport, NULL, local_truncating_sink, &sink, &streamed);
+	*received = sink.used;
+	return status;
+}
+
+static int local_put_object(eb_transport_t *transport, const char *key, const void *data, size_t size)
+{
+	if (!transport || !transport->data || !key || (!data && size > 0))
+		return EB_ERROR_INVALID_PARAMETER;
+	return local_write(transport, key, data, size);
+}
+
+/* Keys found below a directory */
+struct local_listing {
+	char **keys;
+	size_t count;
+	size_t capacity;
+	int status;
+};
+
+static void local_listing_add(struct local_listing *listing, const char *key)
+{
+	if (listing->status != EB_SUCCESS)
+		return;
+	if (listing->count == listing->capacity) {
+		size_t capacity = listing->capacity ? listing->capacity * 2 : 64;
+		char **grown = realloc(listing->keys, capacity * sizeof(char *));
+		if (!grown) {
+			listing->status = EB_ERROR_MEMORY;
+			return;
+		}
+		listing->keys = grown;
+		listing->capacity = capacity;
 	}
-	
-	/* Allocate initial ref list */
-	ref_capacity = 16;
-	ref_list = malloc(ref_capacity * sizeof(char *));
-	if (!ref_list) {
-		closedir(dir);
-		snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "Failed to allocate memory for reference list");
-		return EB_ERROR_MEMORY;
+	listing->keys[listing->count] = strdup(key);
+	if (!listing->keys[listing->count]) {
+		listing->status = EB_ERROR_MEMORY;
+		return;
 	}
-	
-	/* Read refs directory */
-	while ((entry = readdir(dir)) != NULL) {
+	listing->count++;
+}
+
+/* Every regular file below path, skipping dot files such as unfinished writes */
+static void local_listing_walk(struct local_listing *listing, const char *path, const char *key, int depth)
+{
+	DIR *dir = opendir(path);
+	if (!dir)
+		return;
+
+	struct dirent *entry;
+	while (listing->status == EB_SUCCESS && (entry = readdir(dir)) != NULL) {
 		if (entry->d_name[0] == '.')
 			continue;
-		
-		char ref_path[PATH_MAX];
-		snprintf(ref_path, sizeof(ref_path), "%s/%s", refs_dir, entry->d_name);
-		
-		if (stat(ref_path, &st) < 0)
+		char child_path[PATH_MAX];
+		char child_key[PATH_MAX];
+		if ((size_t)snprintf(child_path, sizeof(child_path), "%s/%s", path, entry->d_name) >= sizeof(child_path) ||
+		    (size_t)snprintf(child_key, sizeof(child_key), "%s/%s", key, entry->d_name) >= sizeof(child_key))
+			continue;
+
+		struct stat st;
+		if (stat(child_path, &st) != 0)
 			continue;
-		
-		if (S_ISREG(st.st_mode)) {
-			/* Check if we need to resize the ref list */
-			if (ref_count >= ref_capacity) {
-				ref_capacity *= 2;
-				char **new_refs = realloc(ref_list, ref_capacity * sizeof(char *));
-				if (!new_refs) {
-					/* Free existing refs */
-					for (size_t i = 0; i < ref_count; i++)
-						free(ref_list[i]);
-					free(ref_list);
-					closedir(dir);
-					
-					snprintf(transport->error_msg, sizeof(transport->error_msg),
-						 "Failed to resize reference list");
-					return EB_ERROR_MEMORY;
-				}
-				ref_list = new_refs;
-			}
-			
-			/* Open and read reference file */
-			FILE *ref_file = fopen(ref_path, "r");
-			if (ref_file) {
-				char ref_content[41]; /* SHA-1 hash is 40 chars + null terminator */
-				if (fgets(ref_content, sizeof(ref_content), ref_file)) {
-					/* Remove trailing newline if present */
-					size_t len = strlen(ref_content);
-					if (len > 0 && ref_content[len - 1] == '\n')
-						ref_content[len - 1] = '\0';
-					
-					/* Format ref name and content */
-					char *ref_entry = malloc(strlen(entry->d_name) + strlen(ref_content) + 10);
-					if (ref_entry) {
-						sprintf(ref_entry, "%s %s", ref_content, entry->d_name);
-						ref_list[ref_count++] = ref_entry;
-					}
-				}
-				fclose(ref_file);
-			}
-		} else if (S_ISDIR(st.st_mode)) {
-			/* Handle nested refs (e.g., refs/heads) in a real implementation */
-			/* For simplicity, we skip nested refs in this example */
+		if (S_ISDIR(st.st_mode)) {
+			if (depth + 1 < LOCAL_LIST_DEPTH)
+				local_listing_walk(listing, child_path, child_key, depth + 1);
+			else
+				DEBUG_WARN("local_list_refs: not descending into %s", child_path);
+		} else if (S_ISREG(st.st_mode)) {
+			local_listing_add(listing, child_key);
 		}
 	}
-	
 	closedir(dir);
-	
-	/* Set output parameters */
-	*refs = ref_list;
-	*count = ref_count;
-	
+}
+
+static int local_list_refs(eb_transport_t *transport, char ***refs, size_t *count)
+{
+	if (!transport || !transport->data || !refs || !count)
+		return EB_ERROR_INVALID_PARAMETER;
+	*refs = NULL;
+	*count = 0;
+
+	struct local_data *local = transport->data;
+	const char *root = local->prefix[0] ? local->prefix : "sets";
+	char path[PATH_MAX];
+	int status = local_key_path(transport, root, path, sizeof(path));
+	if (status != EB_SUCCESS)
+		return status;
+
+	/* A directory nothing was pushed to yet lists as empty */
+	struct local_listing listing = { NULL, 0, 0, EB_SUCCESS };
+	local_listing_walk(&listing, path, root, 0);
+	if (listing.status != EB_SUCCESS) {
+		for (size_t i = 0; i < listing.count; i++)
+			free(listing.keys[i]);
+		free(listing.keys);
+		return listing.status;
+	}
+	*refs = listing.keys;
+	*count = listing.count;
+	return EB_SUCCESS;
+}
+
+static int local_delete_refs(eb_transport_t *transport, const char **refs, size_t count)
+{
+	if (!transport || !transport->data || !refs || count == 0)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	size_t failed = 0;
+	int first_error = EB_SUCCESS;
+	for (size_t i = 0; i < count; i++) {
+		char path[PATH_MAX];
+		if (!refs[i] || !*refs[i])
+			continue;
+		int status = local_key_path(transport, refs[i], path, sizeof(path));
+		/* Already gone is as good as deleted */
+		if (status == EB_SUCCESS && unlink(path) != 0 && errno != ENOENT) {
+			status = local_errno_status(errno);
+			snprintf(transport->error_msg, sizeof(transport->error_msg),
+				 "Failed to delete %s: %s", path, strerror(errno));
+		}
+		if (status != EB_SUCCESS) {
+			failed++;
+			if (first_error == EB_SUCCESS)
+				first_error = status;
+		}
+	}
+
+	DEBUG_INFO("Deleted %zu objects, %zu failed", count - failed, failed);
+	if (failed > 1) {
+		size_t len = strlen(transport->error_msg);
+		snprintf(transport->error_msg + len, sizeof(transport->error_msg) - len,
+			 " (%zu objects failed)", failed);
+	}
+	return first_error;
+}
+
+/* Local transports hold no connection, any other directory will do */
+static int local_retarget(eb_transport_t *transport, const char *url)
+{
+	if (!transport || !transport->data || !url)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct local_data *local = transport->data;
+	char *prefix = NULL;
+	int status = local_parse_url(url, &prefix);
+	if (status != EB_SUCCESS)
+		return status;
+	free(local->prefix);
+	local->prefix = prefix;
 	return EB_SUCCESS;
 }
 
-/* Export local transport operations */
+/* Local transport operations structure */
 struct transport_ops local_ops = {
 	.connect = local_connect,
 	.disconnect = local_disconnect,
 	.send_data = local_send_data,
 	.receive_data = local_receive_data,
-	.list_refs = local_list_refs
+	.list_refs = local_list_refs,
+	.delete_refs = local_delete_refs,
+	.retarget = local_retarget,
+	.receive_stream = local_receive_stream,
+	.put_object = local_put_object
 };
 
-static int mkdir_p(const char *path) {
-    char tmp[PATH_MAX];
-    char *p = NULL;
-    size_t len;
-    int ret;
-
-    if (!path || !*path) return -1;
-    
-    snprintf(tmp, sizeof(tmp), "%s", path);
-    len = strlen(tmp);
-    if (tmp[len - 1] == '/') tmp[len - 1] = 0;
-    
-    for (p = tmp + 1; *p; p++) {
-        if (*p == '/') {
-            *p = 0;
-            ret = mkdir(tmp, 0755);
-            if (ret != 0 && errno != EEXIST) return -1;
-            *p = '/';
-        }
-    }
-    ret = mkdir(tmp, 0755);
-    return (ret != 0 && errno != EEXIST) ? -1 : 0;
-} 
\ No newline at end of file
+/* Local transport initialization */
+int local_transport_init(void)
+{
+	DEBUG_PRINT("Local transport module initialized");
+	return EB_SUCCESS;
+}
@@ -18,7 +18,6 @@
 #include <sys/types.h>
 #include <ctype.h>
 #include <time.h>
-#include <jansson.h>
 #include <pthread.h>
 #include <dirent.h>
 
@@ -28,6 +27,9 @@
 #include "transformer.h"
 #include "path_utils.h"
 #include "json_transformer.h"
+#include "object_path.h"
+#include "set_index.h"
+#include "remote_metadata.h"
 
 /* AWS SDK includes */
 #include <aws/common/common.h>
@@ -49,6 +51,8 @@
 #include <aws/http/connection.h>
 #include <aws/io/stream.h>
 #include <aws/common/array_list.h>
+#include <aws/common/encoding.h>
+#include <aws/cal/hash.h>
 
 /* Add EB_ERROR_CONNECTION definition if not defined */
 #ifndef EB_ERROR_CONNECTION
@@ -82,6 +86,8 @@ struct s3_data {
     char *bucket;
     char *prefix;
     char *region;
+    size_t part_size;              /* Bytes per multipart upload part */
+    uint32_t max_connections;      /* Parts uploaded concurrently */
     /* Add signing config storage to support paginator API */
     struct aws_signing_config_aws signing_config;
     
@@ -92,22 +98,177 @@ struct s3_data {
 struct aws_mutex s_mutex = AWS_MUTEX_INIT;
 struct aws_condition_variable s_cvar = AWS_CONDITION_VARIABLE_INIT;
 
-/* Helper function to process events during waits */
-static void process_events_while_waiting(struct s3_data *s3, int milliseconds) {
-    /* Sleep briefly to allow other events to be processed */
-    (void)s3; /* Unused parameter */
-    DEBUG_INFO("Processing events for %d ms", milliseconds);
-    usleep(milliseconds * 1000);
-}
-
 /* S3 operation completion and data context */
 struct s3_operation_context {
     struct aws_mutex *lock;
     struct aws_condition_variable *signal;
     int error_code;
     bool is_done;
+    uint64_t bytes_transferred;    /* Upload progress so far */
+    time_t last_progress;          /* When bytes last moved */
 };
 
+/*
+ * Multipart uploads
+ *
+ * The client splits uploads larger than one part into parts of
+ * part_size bytes and sends up to max_connections of them at once. Both
+ * can be set on the remote URL:
+ *
+ *   s3://bucket/prefix?region=eu-west-1&part_size=16&parallel=8
+ *
+ * with part_size in MiB. An upload that stops making progress for
+ * S3_STALL_TIMEOUT_SECONDS is paused rather than aborted, and its upload
+ * id is kept under S3_UPLOAD_STATE_DIR so that sending the same object
+ * again (eb_remote_resume_push, or a retry) only uploads the missing parts.
+ */
+#define S3_DEFAULT_PART_SIZE_MB 8
+#define S3_MIN_PART_SIZE_MB 5          /* S3 rejects smaller parts */
+#define S3_MAX_PART_SIZE_MB 5120
+#define S3_DEFAULT_PARALLEL 8
+#define S3_STALL_TIMEOUT_SECONDS 60
+#define S3_UPLOAD_STATE_DIR ".embr/uploads"
+
+/*
+ * Client concurrency
+ *
+ * The remote's s3.threads, s3.max_connections and s3.throughput_gbps
+ * reach the transport as eb_transport_options_t. Zero threads lets the
+ * CRT start one event loop per core; the throughput target is what the
+ * CRT sizes its connection pool from when max_connections is not set.
+ */
+#define S3_DEFAULT_THROUGHPUT_GBPS 10.0
+
+/* Numeric query parameter of a URL, clamped to [min, max] */
+static size_t s3_url_size_param(const char *url, const char *param,
+                                size_t fallback, size_t min, size_t max) {
+    char *value = get_url_param(url, param);
+    if (!value)
+        return fallback;
+    
+    char *end = NULL;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    size_t result = fallback;
+    if (end != value && *end == '\0') {
+        result = (size_t)parsed;
+        if (result < min) result = min;
+        if (result > max) result = max;
+    } else {
+        DEBUG_WARN("Ignoring invalid %s=%s in S3 URL", param, value);
+    }
+    free(value);
+    return result;
+}
+
+/* Same hash as the remote layer uses to tell payloads apart */
+static unsigned long s3_payload_checksum(const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long hash = 5381;
+    for (size_t i = 0; i < size; i++) {
+        hash = ((hash << 5) + hash) + bytes[i];
+    }
+    return hash;
+}
+
+static void s3_upload_state_path(const char *key, char *path_out, size_t path_size) {
+    char name[1024];
+    snprintf(name, sizeof(name), "%s", key);
+    for (char *p = name; *p; p++) {
+        if (*p == '/') *p = '_';
+    }
+    snprintf(path_out, path_size, "%s/%s.upload", S3_UPLOAD_STATE_DIR, name);
+}
+
+/*
+ * Resume token of a paused upload of this payload to this key, if any
+ *
+ * State left by a different payload is dropped; S3 lifecycle rules clean
+ * up its incomplete parts.
+ */
+static struct aws_s3_meta_request_resume_token *s3_load_upload_state(
+    struct s3_data *s3, const char *key, size_t size, unsigned long checksum) {
+    
+    char path[PATH_MAX];
+    s3_upload_state_path(key, path, sizeof(path));
+    FILE *state = fopen(path, "r");
+    if (!state)
+        return NULL;
+    
+    char upload_id[512] = {0};
+    unsigned long long part_size = 0, parts = 0, saved_size = 0;
+    unsigned long saved_checksum = 0;
+    int fields = fscanf(state, "upload_id %511s\npart_size %llu\nparts %llu\nsize %llu\nchecksum %lx\n",
+                        upload_id, &part_size, &parts, &saved_size, &saved_checksum);
+    fclose(state);
+    
+    if (fields != 5 || saved_size != size || saved_checksum != checksum ||
+        part_size != s3->part_size) {
+        DEBUG_INFO("Discarding stale upload state for %s", key);
+        unlink(path);
+        return NULL;
+    }
+    
+    struct aws_s3_upload_resume_token_options options = {
+        .upload_id = aws_byte_cursor_from_c_str(upload_id),
+        .part_size = (uint64_t)part_size,
+        .total_num_parts = (size_t)parts,
+    };
+    struct aws_s3_meta_request_resume_token *token =
+        aws_s3_meta_request_resume_token_new_upload(s3->allocator, &options);
+    if (token) {
+        DEBUG_INFO("Resuming multipart upload %s of %s", upload_id, key);
+    }
+    return token;
+}
+
+static void s3_save_upload_state(const char *key, struct aws_s3_meta_request_resume_token *token,
+                                 size_t size, unsigned long checksum) {
+    struct aws_byte_cursor upload_id = aws_s3_meta_request_resume_token_upload_id(token);
+    if (upload_id.len == 0)
+        return;
+    
+    mkdir(S3_UPLOAD_STATE_DIR, 0755);
+    char path[PATH_MAX];
+    s3_upload_state_path(key, path, sizeof(path));
+    FILE *state = fopen(path, "w");
+    if (!state) {
+        DEBUG_WARN("Failed to save upload state to %s: %s", path, strerror(errno));
+        return;
+    }
+    fprintf(state, "upload_id %.*s\n", (int)upload_id.len, (const char *)upload_id.ptr);
+    fprintf(state, "part_size %llu\n",
+            (unsigned long long)aws_s3_meta_request_resume_token_part_size(token));
+    fprintf(state, "parts %llu\n",
+            (unsigned long long)aws_s3_meta_request_resume_token_total_num_parts(token));
+    fprintf(state, "size %llu\n", (unsigned long long)size);
+    fprintf(state, "checksum %lx\n", checksum);
+    fclose(state);
+    DEBUG_INFO("Saved state of paused upload %s (%zu/%zu parts done)", path,
+               aws_s3_meta_request_resume_token_num_parts_completed(token),
+               aws_s3_meta_request_resume_token_total_num_parts(token));
+}
+
+static void s3_clear_upload_state(const char *key) {
+    char path[PATH_MAX];
+    s3_upload_state_path(key, path, sizeof(path));
+    unlink(path);
+}
+
+/* Track upload progress so only a stalled upload times out */
+static void s3_on_upload_progress(
+    struct aws_s3_meta_request *meta_request,
+    const struct aws_s3_meta_request_progress *progress,
+    void *user_data)
+{
+    (void)meta_request;
+    struct s3_operation_context *context = (struct s3_operation_context *)user_data;
+    
+    aws_mutex_lock(context->lock);
+    context->bytes_transferred += progress->bytes_transferred;
+    context->last_progress = time(NULL);
+    aws_mutex_unlock(context->lock);
+}
+
 /* Check if an operation is done */
 static bool s_is_operation_done(void *arg) {
     struct s3_operation_context *context = arg;
@@ -141,7 +302,8 @@ static void s3_on_s3_operation_finished(
     aws_mutex_lock(context->lock);
     context->error_code = error_code;
     context->is_done = true;
-    aws_condition_variable_notify_one(context->signal);
+    /* Transports share the condition variable, wake every waiter */
+    aws_condition_variable_notify_all(context->signal);
     aws_mutex_unlock(context->lock);
     
     DEBUG_INFO("S3 operation context updated and signaled");
@@ -166,33 +328,79 @@ static void s3_on_list_finished(struct aws_s3_paginator *paginator, int error_co
     aws_mutex_unlock(context->lock);
 }
 
-/* S3 send data implementation using proper AWS S3 SDK patterns */
-static int s3_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash) {
-    DEBUG_INFO("s3_send_data called with transport=%p, data=%p, size=%zu, hash=%s", 
+/* Index entry whose raw object has the size of the data being sent */
+struct s3_index_match {
+    size_t size;
+    bool found;
+    char hash[65];
+    char source[PATH_MAX];
+};
+
+static int s3_match_raw_size(const char *source, const char *model, const char *hash, void *ctx) {
+    struct s3_index_match *match = (struct s3_index_match *)ctx;
+    (void)model;
+
+    char raw_path[1024];
+    struct stat st;
+    eb_object_path(".", hash, "raw", raw_path, sizeof(raw_path));
+    if (stat(raw_path, &st) != 0 || (size_t)st.st_size != match->size) {
+        return 0;
+    }
+
+    strncpy(match->hash, hash, sizeof(match->hash) - 1);
+    strncpy(match->source, source, sizeof(match->source) - 1);
+    match->found = true;
+    return 1;
+}
+
+/*
+ * Upload of an object that has been submitted and not waited for yet
+ *
+ * The data PUT runs on the client while the submitter goes on; waiting
+ * for it also uploads the set metadata that goes with the object.
+ */
+struct s3_upload {
+    struct s3_operation_context context;
+    struct aws_s3_meta_request *request;
+    struct aws_http_message *message;
+    char temp_file_path[PATH_MAX];
+    char data_key[1024];
+    char metadata_key[1024];
+    char set_name[256];
+    char host[256];
+    size_t size;                   /* Bytes of the transformed payload */
+    unsigned long checksum;        /* s3_payload_checksum() of the payload */
+    time_t timestamp;              /* Storage time of the embedding */
+};
+
+/* Transform an object, write it out and start its upload */
+static int s3_submit_data(eb_transport_t *transport, const void *data, size_t size,
+                          const char *hash, void **request_out) {
+    DEBUG_INFO("s3_submit_data called with transport=%p, data=%p, size=%zu, hash=%s", 
               transport, data, size, hash ? hash : "(null)");
     
     if (!transport) {
-        DEBUG_ERROR("s3_send_data: transport parameter is NULL");
+        DEBUG_ERROR("s3_submit_data: transport parameter is NULL");
         return EB_ERROR_INVALID_PARAMETER;
     }
     
     if (!transport->data) {
-        DEBUG_ERROR("s3_send_data: transport->data is NULL");
+        DEBUG_ERROR("s3_submit_data: transport->data is NULL");
         return EB_ERROR_INVALID_PARAMETER;
     }
     
     if (!data) {
-        DEBUG_ERROR("s3_send_data: data parameter is NULL");
+        DEBUG_ERROR("s3_submit_data: data parameter is NULL");
         return EB_ERROR_INVALID_PARAMETER;
     }
     
     if (size == 0) {
-        DEBUG_ERROR("s3_send_data: size parameter is 0");
+        DEBUG_ERROR("s3_submit_data: size parameter is 0");
         return EB_ERROR_INVALID_PARAMETER;
     }
     
     if (!hash || !*hash) {
-        DEBUG_ERROR("s3_send_data: hash parameter is NULL or empty");
+        DEBUG_ERROR("s3_submit_data: hash parameter is NULL or empty");
         eb_set_error(EB_ERROR_INVALID_PARAMETER, "No hash provided for S3 upload");
         return EB_ERROR_INVALID_PARAMETER;
     }
@@ -200,7 +408,7 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
     struct s3_data *s3 = (struct s3_data *)transport->data;
     
     if (!s3->is_connected) {
-        DEBUG_ERROR("s3_send_data: Not connected to S3");
+        DEBUG_ERROR("s3_submit_data: Not connected to S3");
         snprintf(transport->error_msg, sizeof(transport->error_msg),
                 "Not connected to S3");
         return EB_ERROR_NOT_CONNECTED;
@@ -210,7 +418,7 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
                size, s3->bucket, s3->prefix, hash);
     
     // Add debug log for target_path
-    DEBUG_INFO("s3_send_data: transport->target_path = '%s'", transport->target_path ? transport->target_path : "(null)");
+    DEBUG_INFO("s3_submit_data: transport->target_path = '%s'", transport->target_path ? transport->target_path : "(null)");
     
     /* Check the content of the first few bytes for debugging */
     const unsigned char *bytes = (const unsigned char *)data;
@@ -243,15 +451,14 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
     
     /* Check if data is already pre-compressed */
     if (transport->data_is_precompressed) {
-        DEBUG_WARN("Data is already pre-compressed, skipping transformation");
-        DEBUG_WARN("data_is_precompressed flag is set to TRUE");
+        DEBUG_INFO("Object record for a native remote, skipping transformation");
         
-        /* Check for ZSTD magic number */
-        const unsigned char* bytes = (const unsigned char *)data;
-        if (size >= 4 && 
-            bytes[0] == 0x28 && bytes[1] == 0xB5 && 
-            bytes[2] == 0x2F && bytes[3] == 0xFD) {
-            DEBUG_INFO("ZSTD magic number detected in pre-compressed data");
+        /* The record is stored as is, only its header is checked */
+        if (!eb_remote_object_is_record(data, size)) {
+            DEBUG_ERROR("Not a self-contained object record");
+            snprintf(transport->error_msg, sizeof(transport->error_msg),
+                    "Not a self-contained object record");
+            return EB_ERROR_INVALID_FORMAT;
         }
         
         /* Use the pre-compressed data directly */
@@ -337,187 +544,155 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
             
             DEBUG_INFO("Looking for metadata for file: %s", target_filename);
             
-            char* index_path = get_current_set_index_path();
-            FILE *index_file = index_path ? fopen(index_path, "r") : NULL;
-            if (index_file) {
-                char line[1024];
-                while (fgets(line, sizeof(line), index_file)) {
-                    /* Remove newline */
-                    size_t len = strlen(line);
-                    if (len > 0 && line[len-1] == '\n') {
-                        line[len-1] = '\0';
+            struct s3_index_match match = { size, false, {0}, {0} };
+            eb_set_index_t *set_index = NULL;
+            if (eb_set_index_open_current(".", &set_index) == EB_SUCCESS) {
+                eb_set_index_foreach(set_index, NULL, s3_match_raw_size, &match);
+                eb_set_index_close(set_index);
+            }
+            
+            if (match.found) {
+                /* This is most likely our file, store its hash for metadata lookup */
+                strncpy(hash, match.hash, sizeof(hash) - 1);
+                DEBUG_INFO("Found likely matching hash in index: %s for file %s (size: %zu)", 
+                           hash, match.source, size);
+                
+                /* Store the original source file path */
+                char original_source_file[PATH_MAX] = {0};
+                strncpy(original_source_file, match.source, sizeof(original_source_file) - 1);
+                
+                /* Extract the original document name from the source file */
+                if (original_source_file[0] != '\0') {
+                    const char *src_basename = strrchr(original_source_file, '/');
+                    if (src_basename) {
+                        strncpy(document_name, src_basename + 1, sizeof(document_name) - 1);
+                    } else {
+                        strncpy(document_name, original_source_file, sizeof(document_name) - 1);
                     }
                     
-                    char file_hash[128] = {0};
-                    char file_path[896] = {0};
+                    /* Clean document name */
+                    for (char *p = document_name; *p; p++) {
+                        if (*p == ' ' || *p == '/' || *p == '\\' || *p == ':' || 
+                            *p == '*' || *p == '?' || *p == '"' || *p == '<' || 
+                            *p == '>' || *p == '|') {
+                            *p = '_';
+                        }
+                    }
                     
-                    /* Format is: hash filename */
-                    if (sscanf(line, "%127s %895s", file_hash, file_path) != 2) {
-                        continue;
+                    DEBUG_INFO("Using document name from index: %s", document_name);
+                }
+                
+                /* Now load the metadata for this hash */
+                char meta_path[PATH_MAX];
+                eb_object_path(".", hash, "meta", meta_path, sizeof(meta_path));
+                
+                DEBUG_INFO("Reading metadata from: %s", meta_path);
+                FILE *meta_file = fopen(meta_path, "r");
+                if (meta_file) {
+                    time_t file_timestamp = 0;
+                    char provider[128] = {0};
+                    char source_file_path[PATH_MAX] = {0}; // Store the source file path
+                    
+                    char meta_line[1024];
+                    while (fgets(meta_line, sizeof(meta_line), meta_file)) {
+                        /* Look for provider field */
+                        if (strncmp(meta_line, "model=", 6) == 0) {
+                            strncpy(provider, meta_line + 6, sizeof(provider) - 1);
+                            
+                            /* Remove newline if present */
+                            char *newline = strchr(provider, '\n');
+                            if (newline) *newline = '\0';
+                            
+                            DEBUG_INFO("Found provider in metadata: %s", provider);
+                        }
+                        
+                        /* Look for timestamp field */
+                        if (strncmp(meta_line, "timestamp=", 10) == 0) {
+                            file_timestamp = atol(meta_line + 10);
+                            DEBUG_INFO("Found timestamp in metadata: %ld", (long)file_timestamp);
+                        }
+                        
+                        /* Look for source file field */
+                        if (strncmp(meta_line, "source_file=", 12) == 0) {
+                            strncpy(source_file_path, meta_line + 12, sizeof(source_file_path) - 1);
+                            
+                            /* Remove newline if present */
+                            char *newline = strchr(source_file_path, '\n');
+                            if (newline) *newline = '\0';
+                            
+                            DEBUG_INFO("Found source file in metadata: %s", source_file_path);
+                        }
                     }
                     
-                    /* Find the hash we're currently processing based on the raw file */
-                    char raw_path[1024];
-                    snprintf(raw_path, sizeof(raw_path), ".embr/objects/%s.raw", file_hash);
+                    fclose(meta_file);
                     
-                    struct stat st;
-                    if (stat(raw_path, &st) == 0) {
-                        /* This is a valid file, check if our current data matches the size */
-                        if (st.st_size == size) {
-                            /* This is most likely our file, store its hash for metadata lookup */
-                            strncpy(hash, file_hash, sizeof(hash) - 1);
-                            DEBUG_INFO("Found likely matching hash in index: %s for file %s (size: %zu)", 
-                                       hash, file_path, (size_t)st.st_size);
+                    /* Load source document text for blob field if source file exists */
+                    if (source_file_path[0] != '\0') {
+                        FILE *source_file = fopen(source_file_path, "r");
+                        if (source_file) {
+                            DEBUG_INFO("Reading document text from source: %s", source_file_path);
                             
-                            /* Store the original source file path */
-                            char original_source_file[PATH_MAX] = {0};
-                            strncpy(original_source_file, file_path, sizeof(original_source_file) - 1);
+                            /* Determine file size */
+                            fseek(source_file, 0, SEEK_END);
+                            long source_size = ftell(source_file);
+                            fseek(source_file, 0, SEEK_SET);
                             
-                            /* Extract the original document name from the source file */
-                            if (original_source_file[0] != '\0') {
-                                const char *src_basename = strrchr(original_source_file, '/');
-                                if (src_basename) {
-                                    strncpy(document_name, src_basename + 1, sizeof(document_name) - 1);
-                                } else {
-                                    strncpy(document_name, original_source_file, sizeof(document_name) - 1);
-                                }
+                            /* Allocate buffer for document text */
+                            char *document_text = (char*)malloc(source_size + 1);
+                            if (document_text) {
+                                size_t bytes_read = fread(document_text, 1, source_size, source_file);
+                                document_text[bytes_read] = '\0';
                                 
-                                /* Clean document name */
-                                for (char *p = document_name; *p; p++) {
-                                    if (*p == ' ' || *p == '/' || *p == '\\' || *p == ':' || 
-                                        *p == '*' || *p == '?' || *p == '"' || *p == '<' || 
-                                        *p == '>' || *p == '|') {
-                                        *p = '_';
-                                    }
-                                }
+                                /* Set document text for Parquet transformer */
+                                extern void eb_parquet_set_document_text(const char* text);
+                                DEBUG_INFO("Setting document text for blob field (%zu bytes)", bytes_read);
+                                eb_parquet_set_document_text(document_text);
                                 
-                                DEBUG_INFO("Using document name from index: %s", document_name);
+                                free(document_text);
+                            } else {
+                                DEBUG_ERROR("Failed to allocate memory for document text");
                             }
                             
-                            /* Now load the metadata for this hash */
-                            char meta_path[PATH_MAX];
-                            snprintf(meta_path, sizeof(meta_path), ".embr/objects/%s.meta", hash);
-                            
-                            DEBUG_INFO("Reading metadata from: %s", meta_path);
-                            FILE *meta_file = fopen(meta_path, "r");
-                            if (meta_file) {
-                                time_t file_timestamp = 0;
-                                char provider[128] = {0};
-                                char source_file_path[PATH_MAX] = {0}; // Store the source file path
-                                
-                                char meta_line[1024];
-                                while (fgets(meta_line, sizeof(meta_line), meta_file)) {
-                                    /* Look for provider field */
-                                    if (strncmp(meta_line, "model=", 6) == 0) {
-                                        strncpy(provider, meta_line + 6, sizeof(provider) - 1);
-                                        
-                                        /* Remove newline if present */
-                                        char *newline = strchr(provider, '\n');
-                                        if (newline) *newline = '\0';
-                                        
-                                        DEBUG_INFO("Found provider in metadata: %s", provider);
-                                    }
-                                    
-                                    /* Look for timestamp field */
-                                    if (strncmp(meta_line, "timestamp=", 10) == 0) {
-                                        file_timestamp = atol(meta_line + 10);
-                                        DEBUG_INFO("Found timestamp in metadata: %ld", (long)file_timestamp);
-                                    }
-                                    
-                                    /* Look for source file field */
-                                    if (strncmp(meta_line, "source_file=", 12) == 0) {
-                                        strncpy(source_file_path, meta_line + 12, sizeof(source_file_path) - 1);
-                                        
-                                        /* Remove newline if present */
-                                        char *newline = strchr(source_file_path, '\n');
-                                        if (newline) *newline = '\0';
-                                        
-                                        DEBUG_INFO("Found source file in metadata: %s", source_file_path);
-                                    }
-                                }
-                                
-                                fclose(meta_file);
-                                
-                                /* Load source document text for blob field if source file exists */
-                                if (source_file_path[0] != '\0') {
-                                    FILE *source_file = fopen(source_file_path, "r");
-                                    if (source_file) {
-                                        DEBUG_INFO("Reading document text from source: %s", source_file_path);
-                                        
-                                        /* Determine file size */
-                                        fseek(source_file, 0, SEEK_END);
-                                        long source_size = ftell(source_file);
-                                        fseek(source_file, 0, SEEK_SET);
-                                        
-                                        /* Allocate buffer for document text */
-                                        char *document_text = (char*)malloc(source_size + 1);
-                                        if (document_text) {
-                                            size_t bytes_read = fread(document_text, 1, source_size, source_file);
-                                            document_text[bytes_read] = '\0';
-                                            
-                                            /* Set document text for Parquet transformer */
-                                            extern void eb_parquet_set_document_text(const char* text);
-                                            DEBUG_INFO("Setting document text for blob field (%zu bytes)", bytes_read);
-                                            eb_parquet_set_document_text(document_text);
-                                            
-                                            free(document_text);
-                                        } else {
-                                            DEBUG_ERROR("Failed to allocate memory for document text");
-                                        }
-                                        
-                                        fclose(source_file);
-                                    } else {
-                                        DEBUG_WARN("Could not open source file: %s", source_file_path);
-                                    }
-                                }
-                                
-                                /* Use the metadata information */
-                                if (file_timestamp > 0) {
-                                    now = file_timestamp;
-                                    DEBUG_INFO("Using local storage timestamp: %ld", (long)now);
-                                } else {
-                                    DEBUG_ERROR("Unable to find local storage timestamp for document embedding");
-                                    snprintf(transport->error_msg, sizeof(transport->error_msg),
-                                            "Unable to find local storage timestamp for document embedding");
-                                    
-                                    /* Free transformed data if needed */
-                                    if (need_to_free_transformed) {
-                                        free(transformed_data);
-                                    }
-                                    
-                                    if (index_file) {
-                                        fclose(index_file);
-                                    }
-                                    if (index_path) free(index_path);
-                                    closedir(dir);
-                                    return EB_ERROR_INVALID_DATA;
-                                }
-                                
-                                if (provider[0] != '\0') {
-                                    strncpy(model_name, provider, sizeof(model_name) - 1);
-                                    
-                                    /* Clean model name */
-                                    for (char *p = model_name; *p; p++) {
-                                        if (*p == ' ' || *p == '/' || *p == '\\' || *p == ':' || 
-                                            *p == '*' || *p == '?' || *p == '"' || *p == '<' || 
-                                            *p == '>' || *p == '|') {
-                                            *p = '_';
-                                        }
-                                    }
-                                    
-                                    DEBUG_INFO("Using model name from metadata: %s", model_name);
-                                }
-                                
-                                /* We've processed this file, can break the loop */
-                                break;
+                            fclose(source_file);
+                        } else {
+                            DEBUG_WARN("Could not open source file: %s", source_file_path);
+                        }
+                    }
+                    
+                    /* Use the metadata information */
+                    if (file_timestamp > 0) {
+                        now = file_timestamp;
+                        DEBUG_INFO("Using local storage timestamp: %ld", (long)now);
+                    } else {
+                        DEBUG_ERROR("Unable to find local storage timestamp for document embedding");
+                        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                                "Unable to find local storage timestamp for document embedding");
+                        
+                        /* Free transformed data if needed */
+                        if (need_to_free_transformed) {
+                            free(transformed_data);
+                        }
+                        
+                        closedir(dir);
+                        return EB_ERROR_INVALID_DATA;
+                    }
+                    
+                    if (provider[0] != '\0') {
+                        strncpy(model_name, provider, sizeof(model_name) - 1);
+                        
+                        /* Clean model name */
+                        for (char *p = model_name; *p; p++) {
+                            if (*p == ' ' || *p == '/' || *p == '\\' || *p == ':' || 
+                                *p == '*' || *p == '?' || *p == '"' || *p == '<' || 
+                                *p == '>' || *p == '|') {
+                                *p = '_';
                             }
                         }
+                        
+                        DEBUG_INFO("Using model name from metadata: %s", model_name);
                     }
                 }
-                
-                fclose(index_file);
             }
-            if (index_path) free(index_path);
             
             closedir(dir);
         } else {
@@ -584,6 +759,9 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
 
     DEBUG_INFO("Wrote %zd bytes to temporary file", write_result);
 
+    /* Identifies the payload of a paused upload */
+    unsigned long payload_checksum = s3_payload_checksum(transformed_data, transformed_size);
+
     /* We can free the transformed data now as it's been written to disk */
     if (need_to_free_transformed) {
         free(transformed_data);
@@ -629,79 +807,96 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
     /* Log the full request details */
     DEBUG_INFO("Sending PUT request to Host: %s, Path: %s", host_header_value, uri_buffer);
     
-    /* Setup synchronization primitives for upload operation */
-    struct s3_operation_context upload_context = {
+    /* The callbacks outlive this call, keep their context with the upload */
+    struct s3_upload *upload = calloc(1, sizeof(*upload));
+    if (!upload) {
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to allocate memory for S3 upload");
+        aws_http_message_release(data_message);
+        unlink(temp_file_path);
+        return EB_ERROR_MEMORY;
+    }
+    upload->context = (struct s3_operation_context) {
         .lock = &s_mutex,
         .signal = &s_cvar,
         .error_code = 0,
-        .is_done = false
+        .is_done = false,
+        .bytes_transferred = 0,
+        .last_progress = time(NULL)
     };
     
-    /* Create the options for the data upload */
+    /* Pick up a paused multipart upload of the same payload */
+    struct aws_s3_meta_request_resume_token *resume_token = NULL;
+    if (transformed_size > s3->part_size) {
+        resume_token = s3_load_upload_state(s3, s3_data_key, transformed_size, payload_checksum);
+    }
+    
+    /* Create the options for the data upload, the body streams from the file */
     struct aws_s3_meta_request_options data_options = {
         .type = AWS_S3_META_REQUEST_TYPE_PUT_OBJECT,
         .message = data_message, 
         .send_filepath = aws_byte_cursor_from_c_str(temp_file_path),
-        .user_data = &upload_context,
-        .finish_callback = s3_on_s3_operation_finished
+        .user_data = &upload->context,
+        .finish_callback = s3_on_s3_operation_finished,
+        .progress_callback = s3_on_upload_progress,
+        .resume_token = resume_token
     };
 
     DEBUG_INFO("Preparing to upload data file to S3: %s", s3_data_key);
 
     /* Send the data to S3 */
     struct aws_s3_meta_request *data_request = aws_s3_client_make_meta_request(s3->s3_client, &data_options);
+    if (resume_token) {
+        aws_s3_meta_request_resume_token_release(resume_token);
+        resume_token = NULL;
+    }
     if (!data_request) {
         DEBUG_ERROR("Failed to create S3 meta request for data upload: %s", aws_error_str(aws_last_error()));
         snprintf(transport->error_msg, sizeof(transport->error_msg),
                 "Failed to create S3 meta request for data upload: %s", aws_error_str(aws_last_error()));
         aws_http_message_release(data_message);
         unlink(temp_file_path);
+        free(upload);
         return EB_ERROR_GENERIC;
     }
 
+    upload->request = data_request;
+    upload->message = data_message;
+    snprintf(upload->temp_file_path, sizeof(upload->temp_file_path), "%s", temp_file_path);
+    snprintf(upload->data_key, sizeof(upload->data_key), "%s", s3_data_key);
+    snprintf(upload->metadata_key, sizeof(upload->metadata_key), "%s", s3_metadata_key);
+    snprintf(upload->set_name, sizeof(upload->set_name), "%s", set_name_buf);
+    snprintf(upload->host, sizeof(upload->host), "%s", host_header_value);
+    upload->size = transformed_size;
+    upload->checksum = payload_checksum;
+    upload->timestamp = now;
+    
+    *request_out = upload;
+    return EB_SUCCESS;
+}
+
+/* Wait for the data upload of a submitted object, then upload the set metadata */
+static int s3_finish_upload(eb_transport_t *transport, struct s3_upload *upload) {
+    struct s3_data *s3 = (struct s3_data *)transport->data;
+    
     DEBUG_INFO("Waiting for data upload to complete...");
 
-    /* Wait for the upload to complete with a timeout */
+    /* Wait for the upload, giving up only when it stops making progress */
     aws_mutex_lock(&s_mutex);
-    struct timespec start_time, current_time;
-    clock_gettime(CLOCK_REALTIME, &start_time);
     bool timed_out = false;
-    int max_wait_seconds = 60; /* Extend timeout to 60 seconds */
     
-    DEBUG_INFO("Waiting for S3 upload to complete (timeout: %d secs)", max_wait_seconds);
+    DEBUG_INFO("Waiting for S3 upload to complete (stall timeout: %d secs)", S3_STALL_TIMEOUT_SECONDS);
     
-    while (!upload_context.is_done) {
-        /* Check if the upload has completed */
-        if (upload_context.is_done) {
-            break;
-        }
-        
-        /* Check for timeout */
-        clock_gettime(CLOCK_REALTIME, &current_time);
-        int elapsed_seconds = (current_time.tv_sec - start_time.tv_sec);
-        
-        if (elapsed_seconds >= max_wait_seconds) {
-            DEBUG_ERROR("S3 upload operation timed out after %d seconds", max_wait_seconds);
+    while (!upload->context.is_done) {
+        time_t stalled = time(NULL) - upload->context.last_progress;
+        if (stalled >= S3_STALL_TIMEOUT_SECONDS) {
+            DEBUG_ERROR("S3 upload made no progress for %ld seconds (%llu bytes sent)",
+                      (long)stalled, (unsigned long long)upload->context.bytes_transferred);
             timed_out = true;
             break;
         }
         
-        /* Log progress periodically */
-        if (elapsed_seconds % 5 == 0 && elapsed_seconds > 0) {
-            DEBUG_INFO("Still waiting for upload to complete... (%d seconds elapsed)", 
-                     elapsed_seconds);
-        }
-        
-        /* Temporarily release the mutex to allow the S3 client to process callbacks */
-        aws_mutex_unlock(&s_mutex);
-        
-        /* Process events while waiting */
-        process_events_while_waiting(s3, 100); /* Wait 100ms */
-        
-        /* Re-acquire the mutex before checking the condition again */
-        aws_mutex_lock(&s_mutex);
-        
-        /* Use condition variable with a short timeout */
+        /* Sleep until the finish callback signals, waking each second for the timeout check */
         int64_t wait_timeout_ns = 1000000000; /* 1 second in nanoseconds */
         
         aws_condition_variable_wait_for_pred(
@@ -709,136 +904,64 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
             &s_mutex, 
             wait_timeout_ns, 
             s_is_operation_done, 
-            &upload_context);
-    }
-
-    /* Check if we timed out */
-    if (!upload_context.is_done) {
-        DEBUG_ERROR("S3 upload operation timed out");
-        timed_out = true;
+            &upload->context);
     }
     aws_mutex_unlock(&s_mutex);
+    
+    if (timed_out) {
+        /* Pause instead of cancelling so the uploaded parts can be reused */
+        struct aws_s3_meta_request_resume_token *pause_token = NULL;
+        if (aws_s3_meta_request_pause(upload->request, &pause_token) == AWS_OP_SUCCESS && pause_token) {
+            s3_save_upload_state(upload->data_key, pause_token, upload->size, upload->checksum);
+            aws_s3_meta_request_resume_token_release(pause_token);
+        } else {
+            aws_s3_meta_request_cancel(upload->request);
+        }
+        
+        /* The finish callback still runs and touches upload_context */
+        aws_mutex_lock(&s_mutex);
+        aws_condition_variable_wait_for_pred(
+            &s_cvar, &s_mutex, (int64_t)S3_STALL_TIMEOUT_SECONDS * 1000000000,
+            s_is_operation_done, &upload->context);
+        aws_mutex_unlock(&s_mutex);
+    } else if (upload->context.error_code == AWS_ERROR_SUCCESS) {
+        s3_clear_upload_state(upload->data_key);
+    }
 
     /* Clean up data request */
     DEBUG_INFO("Releasing S3 data request");
-    aws_s3_meta_request_release(data_request);
-    aws_http_message_release(data_message);
-    unlink(temp_file_path);
+    aws_s3_meta_request_release(upload->request);
+    aws_http_message_release(upload->message);
+    unlink(upload->temp_file_path);
 
     /* Check for upload errors */
     if (timed_out) {
-        DEBUG_ERROR("S3 data upload operation timed out");
+        DEBUG_ERROR("S3 data upload operation stalled");
         snprintf(transport->error_msg, sizeof(transport->error_msg),
-                "S3 data upload operation timed out");
+                "S3 data upload stalled, pushing it again resumes it");
         return EB_ERROR_TIMEOUT;
-    } else if (upload_context.error_code != AWS_ERROR_SUCCESS) {
+    } else if (upload->context.error_code != AWS_ERROR_SUCCESS) {
         DEBUG_ERROR("Failed to upload data to S3: error code %d (%s)", 
-                  upload_context.error_code,
-                  aws_error_str(upload_context.error_code));
+                  upload->context.error_code,
+                  aws_error_str(upload->context.error_code));
         snprintf(transport->error_msg, sizeof(transport->error_msg),
                 "Failed to upload data to S3: error code %d (%s)", 
-                upload_context.error_code,
-                aws_error_str(upload_context.error_code));
+                upload->context.error_code,
+                aws_error_str(upload->context.error_code));
         return EB_ERROR_CONNECTION;
     }
 
     DEBUG_INFO("Data upload completed successfully");
 
     /* Now upload the metadata file */
-    /* Build expanded metadata JSON using Jansson */
-    json_t *root = json_object();
-    json_object_set_new(root, "timestamp", json_integer((json_int_t)now));
-    json_object_set_new(root, "size", json_integer((json_int_t)transformed_size));
-    json_object_set_new(root, "set", json_string(set_name_buf));
-
-    // --- Gather objects from per-set log ---
-    json_t *objects_arr = json_array();
-    {
-        char *log_path = get_current_set_log_path();
-        if (log_path) {
-            FILE *log_file = fopen(log_path, "r");
-            if (log_file) {
-                char line[PATH_MAX + 128];
-                while (fgets(line, sizeof(line), log_file)) {
-                    char timestamp_str[32], hash[65], src_path[PATH_MAX], model[64];
-                    if (sscanf(line, "%31s %64s %s %63s", timestamp_str, hash, src_path, model) == 4) {
-                        json_t *obj = json_object();
-                        json_object_set_new(obj, "hash", json_string(hash));
-                        json_object_set_new(obj, "path", json_string(src_path));
-                        json_object_set_new(obj, "created", json_integer(atoll(timestamp_str)));
-                        json_object_set_new(obj, "model", json_string(model));
-                        json_array_append_new(objects_arr, obj);
-                    }
-                }
-                fclose(log_file);
-            }
-            free(log_path);
-        }
-    }
-    json_object_set_new(root, "objects", objects_arr);
-
-    // --- Gather index from per-set index ---
-    json_t *index_arr = json_array();
-    {
-        char *index_path = get_current_set_index_path();
-        if (index_path) {
-            FILE *idx_file = fopen(index_path, "r");
-            if (idx_file) {
-                char hash[65], src_path[PATH_MAX];
-                while (fscanf(idx_file, "%64s %s", hash, src_path) == 2) {
-                    json_t *idx_obj = json_object();
-                    json_object_set_new(idx_obj, "hash", json_string(hash));
-                    json_object_set_new(idx_obj, "path", json_string(src_path));
-                    json_array_append_new(index_arr, idx_obj);
-                }
-                fclose(idx_file);
-            }
-            free(index_path);
-        }
-    }
-    json_object_set_new(root, "index", index_arr);
-
-    // --- Gather refs ---
-    json_t *refs_obj = json_object();
-    char* model_refs_dir = get_current_set_model_refs_dir();
-    if (model_refs_dir) {
-        DIR *refs_dir = opendir(model_refs_dir);
-        if (refs_dir) {
-            struct dirent *entry;
-            while ((entry = readdir(refs_dir)) != NULL) {
-                if (entry->d_type != DT_REG) continue;
-                char ref_path[512];
-                snprintf(ref_path, sizeof(ref_path), "%s/%s", model_refs_dir, entry->d_name);
-                FILE *ref = fopen(ref_path, "r");
-                if (ref) {
-                    char hash[256];
-                    if (fgets(hash, sizeof(hash), ref)) {
-                        char *nl = strchr(hash, '\n'); if (nl) *nl = '\0';
-                        json_object_set_new(refs_obj, entry->d_name, json_string(hash));
-                    }
-                    fclose(ref);
-                }
-            }
-            closedir(refs_dir);
-        }
-        free(model_refs_dir);
-    }
-    json_object_set_new(root, "refs", refs_obj);
-
-    // --- Set head ---
-    char head_val[128] = "main";
-    FILE *head = fopen(".embr/HEAD", "r");
-    if (head) {
-        if (fgets(head_val, sizeof(head_val), head)) {
-            char *nl = strchr(head_val, '\n'); if (nl) *nl = '\0';
-        }
-        fclose(head);
+    char *metadata_content = NULL;
+    int metadata_result = eb_remote_metadata_build(upload->set_name, upload->size, upload->timestamp,
+                                                   &metadata_content);
+    if (metadata_result != EB_SUCCESS) {
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to build set metadata");
+        return metadata_result;
     }
-    json_object_set_new(root, "head", json_string(head_val));
-
-    // --- Serialize JSON ---
-    char *metadata_content = json_dumps(root, JSON_INDENT(2));
-    json_decref(root);
     
     /* Create a temporary file for the metadata */
     char meta_temp_filename[256];
@@ -848,13 +971,15 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
         DEBUG_ERROR("Failed to create temporary file for metadata: %s", strerror(errno));
         snprintf(transport->error_msg, sizeof(transport->error_msg),
                 "Failed to create temporary file for metadata: %s", strerror(errno));
+        free(metadata_content);
         return EB_ERROR_FILE_IO;
     }
     
     /* Write the metadata to the temporary file */
     size_t metadata_length = strlen(metadata_content);
-    write_result = write(meta_temp_fd, metadata_content, metadata_length);
+    ssize_t write_result = write(meta_temp_fd, metadata_content, metadata_length);
     close(meta_temp_fd);
+    free(metadata_content);
     
     if (write_result != (ssize_t)metadata_length) {
         DEBUG_ERROR("Failed to write metadata to temporary file: %s", strerror(errno));
@@ -879,7 +1004,7 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
     
     /* Set the full path in the URI */
     char meta_uri_buffer[2048];
-    snprintf(meta_uri_buffer, sizeof(meta_uri_buffer), "/%s", s3_metadata_key);
+    snprintf(meta_uri_buffer, sizeof(meta_uri_buffer), "/%s", upload->metadata_key);
     struct aws_byte_cursor meta_uri_cursor = aws_byte_cursor_from_c_str(meta_uri_buffer);
     aws_http_message_set_request_path(meta_message, meta_uri_cursor);
     
@@ -891,10 +1016,14 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
     aws_http_message_add_header(meta_message, meta_content_type_header);
     
     /* Add host header */
+    struct aws_http_header host_header = {
+        .name = aws_byte_cursor_from_c_str("Host"),
+        .value = aws_byte_cursor_from_c_str(upload->host),
+    };
     aws_http_message_add_header(meta_message, host_header);
     
     /* Log the full request details */
-    DEBUG_INFO("Sending PUT request to Host: %s, Path: %s", host_header_value, meta_uri_buffer);
+    DEBUG_INFO("Sending PUT request to Host: %s, Path: %s", upload->host, meta_uri_buffer);
     
     /* Setup synchronization primitives for metadata upload operation */
     struct s3_operation_context meta_context = {
@@ -913,7 +1042,7 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
         .finish_callback = s3_on_s3_operation_finished
     };
 
-    DEBUG_INFO("Preparing to upload metadata file to S3: %s", s3_metadata_key);
+    DEBUG_INFO("Preparing to upload metadata file to S3: %s", upload->metadata_key);
 
     /* Send the metadata to S3 */
     struct aws_s3_meta_request *meta_request = aws_s3_client_make_meta_request(s3->s3_client, &meta_options);
@@ -959,16 +1088,7 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
                      elapsed_seconds);
         }
         
-        /* Temporarily release the mutex to allow the S3 client to process callbacks */
-        aws_mutex_unlock(&s_mutex);
-        
-        /* Process events while waiting */
-        process_events_while_waiting(s3, 100); /* Wait 100ms */
-        
-        /* Re-acquire the mutex before checking the condition again */
-        aws_mutex_lock(&s_mutex);
-        
-        /* Use condition variable with a short timeout */
+        /* Sleep until the finish callback signals, waking each second for the timeout check */
         int64_t wait_timeout_ns = 1000000000; /* 1 second in nanoseconds */
         
         aws_condition_variable_wait_for_pred(
@@ -1013,6 +1133,25 @@ static int s3_send_data(eb_transport_t *transport, const void *data, size_t size
     return EB_SUCCESS;
 }
 
+static int s3_wait_data(eb_transport_t *transport, void *request) {
+    if (!transport || !transport->data || !request)
+        return EB_ERROR_INVALID_PARAMETER;
+    
+    struct s3_upload *upload = (struct s3_upload *)request;
+    int result = s3_finish_upload(transport, upload);
+    free(upload);
+    return result;
+}
+
+/* S3 send data implementation using proper AWS S3 SDK patterns */
+static int s3_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash) {
+    void *upload = NULL;
+    int result = s3_submit_data(transport, data, size, hash, &upload);
+    if (result != EB_SUCCESS)
+        return result;
+    return s3_wait_data(transport, upload);
+}
+
 /* Connect to S3 */
 static int s3_connect(eb_transport_t *transport) {
     if (!transport)
@@ -1020,6 +1159,8 @@ static int s3_connect(eb_transport_t *transport) {
     
     char *aws_key = NULL;
     char *aws_secret = NULL;
+    char key_buf[256] = {0};      /* Credentials read from ~/.aws/credentials */
+    char secret_buf[256] = {0};
     
     /* Check for AWS environment variables first */
     aws_key = getenv("AWS_ACCESS_KEY_ID");
@@ -1040,8 +1181,6 @@ static int s3_connect(eb_transport_t *transport) {
             if (cred_file) {
                 DEBUG_PRINT("Opened AWS credentials file %s", credentials_path);
                 char line[1024];
-                char key_buf[256] = {0};
-                char secret_buf[256] = {0};
                 bool in_default_section = false;
                 
                 while (fgets(line, sizeof(line), cred_file)) {
@@ -1096,14 +1235,8 @@ static int s3_connect(eb_transport_t *transport) {
                 
                 /* Use credentials from file if found */
                 if (key_buf[0] && secret_buf[0]) {
-                    static char saved_key[256];
-                    static char saved_secret[256];
-                    
-                    strncpy(saved_key, key_buf, sizeof(saved_key));
-                    strncpy(saved_secret, secret_buf, sizeof(saved_secret));
-                    
-                    aws_key = saved_key;
-                    aws_secret = saved_secret;
+                    aws_key = key_buf;
+                    aws_secret = secret_buf;
                     
                     DEBUG_PRINT("Using AWS credentials from ~/.aws/credentials");
                 } else {
@@ -1151,6 +1284,14 @@ static int s3_connect(eb_transport_t *transport) {
         }
     }
     
+    /* Multipart upload tuning, see S3_DEFAULT_PART_SIZE_MB */
+    s3->part_size = s3_url_size_param(transport->url, "part_size", S3_DEFAULT_PART_SIZE_MB,
+                                      S3_MIN_PART_SIZE_MB, S3_MAX_PART_SIZE_MB) * 1024 * 1024;
+    size_t default_connections = transport->options.max_connections ?
+                                 transport->options.max_connections : S3_DEFAULT_PARALLEL;
+    s3->max_connections = (uint32_t)s3_url_size_param(transport->url, "parallel",
+                                                      default_connections, 1, 256);
+    
     /* Get a clean URL without query parameters */
     char *clean_url = get_url_without_params(transport->url);
     if (!clean_url) {
@@ -1187,8 +1328,8 @@ static int s3_connect(eb_transport_t *transport) {
     aws_auth_library_init(s3->allocator);
     aws_s3_library_init(s3->allocator);
     
-    /* Create event loop group with a single thread to match minimal sample */
-    uint16_t num_event_loop_threads = 1; /* Single-threaded event loop group */
+    /* Create the event loop group, 0 threads lets the CRT use one per core */
+    uint16_t num_event_loop_threads = (uint16_t)transport->options.threads;
     DEBUG_INFO("Creating event loop group with %d threads", num_event_loop_threads);
     s3->event_loop_group = aws_event_loop_group_new_default(s3->allocator, num_event_loop_threads, NULL);
     if (!s3->event_loop_group) {
@@ -1288,10 +1429,12 @@ static int s3_connect(eb_transport_t *transport) {
         .tls_mode = AWS_MR_TLS_ENABLED, /* Re-enable TLS with proper configuration */
         .signing_config = &s3->signing_config,
         .compute_content_md5 = AWS_MR_CONTENT_MD5_ENABLED,
-        .part_size = 5 * 1024 * 1024, /* 5MB default part size */
-        .multipart_upload_threshold = 8 * 1024 * 1024, /* Use multipart for files larger than 8MB */
-        .max_part_size = 128 * 1024 * 1024, /* 128MB max part size */
-        .throughput_target_gbps = 1.0, /* 1 Gbps target throughput */
+        .part_size = s3->part_size,
+        .multipart_upload_threshold = s3->part_size, /* Use multipart for anything over one part */
+        .max_part_size = (size_t)S3_MAX_PART_SIZE_MB * 1024 * 1024,
+        .max_active_connections_override = s3->max_connections,
+        .throughput_target_gbps = transport->options.throughput_gbps > 0 ?
+                                  transport->options.throughput_gbps : S3_DEFAULT_THROUGHPUT_GBPS,
     };
     
     /* Initialize TLS context options */
@@ -1711,8 +1854,26 @@ static void s3_metadata_complete_cb(
     aws_mutex_unlock(context->lock);
 }
 
-/* Callbacks for S3 data download */
-static int s3_data_body_cb(
+/* Download handing the body to a sink as the client receives it */
+struct stream_context {
+    int error_code;
+    bool is_done;
+    struct aws_mutex *lock;
+    struct aws_condition_variable *signal;
+    eb_transport_sink_fn sink;
+    void *sink_ctx;
+    int sink_status;               /* Status of the sink that aborted, 0 otherwise */
+    size_t received;
+    int response_status;
+};
+
+static bool s_is_stream_done(void *arg) {
+    struct stream_context *context = arg;
+    return context->is_done;
+}
+
+/* GET bodies arrive in order, so the sink sees the object sequentially */
+static int s3_stream_body_cb(
     struct aws_s3_meta_request *meta_request,
     const struct aws_byte_cursor *body,
     uint64_t range_start,
@@ -1721,115 +1882,85 @@ static int s3_data_body_cb(
     (void)meta_request;
     (void)range_start;
     
-    struct download_context *context = user_data;
-    
-    DEBUG_INFO("s3_on_data_body: received %zu bytes at range start %llu", 
-              body->len, (unsigned long long)range_start);
-    
-    /* Ensure we have enough space */
-    if (context->current_pos + body->len > context->capacity) {
-        DEBUG_WARN("s3_on_data_body: buffer capacity exceeded (%zu + %zu > %zu)",
-                  context->current_pos, body->len, context->capacity);
-        
-        /* We can't expand the buffer, so just copy what we can */
-        size_t bytes_to_copy = context->capacity - context->current_pos;
-        if (bytes_to_copy > 0) {
-            DEBUG_INFO("s3_on_data_body: copying partial data (%zu bytes)", bytes_to_copy);
-            memcpy((char*)context->data + context->current_pos, body->ptr, bytes_to_copy);
-            context->current_pos += bytes_to_copy;
-            context->data_size = context->current_pos;
-        }
-        
-        /* Signal that we've received more data than we can store */
-        DEBUG_WARN("s3_on_data_body: discarding excess data");
-        return AWS_OP_SUCCESS; /* Continue receiving but discard excess */
+    struct stream_context *context = user_data;
+    int status = context->sink(context->sink_ctx, body->ptr, body->len);
+    if (status != 0) {
+        DEBUG_WARN("s3_stream_body_cb: sink stopped the download (status %d)", status);
+        context->sink_status = status;
+        return aws_raise_error(AWS_ERROR_S3_CANCELED);
     }
-    
-    /* Copy the data */
-    DEBUG_INFO("s3_on_data_body: copying %zu bytes at offset %zu", 
-              body->len, context->current_pos);
-    memcpy((char*)context->data + context->current_pos, body->ptr, body->len);
-    context->current_pos += body->len;
-    context->data_size = context->current_pos;
-    
+    context->received += body->len;
     return AWS_OP_SUCCESS;
 }
 
-static void s3_data_complete_cb(
+static void s3_stream_complete_cb(
     struct aws_s3_meta_request *meta_request,
     const struct aws_s3_meta_request_result *meta_request_result,
     void *user_data)
 {
     (void)meta_request;
     
-    struct download_context *context = user_data;
-    
-    DEBUG_INFO("s3_on_data_complete: download finished with error code %d", 
-              meta_request_result->error_code);
-    
-    if (meta_request_result->error_code != AWS_ERROR_SUCCESS) {
-        DEBUG_ERROR("s3_on_data_complete: AWS error: %s", 
-                  aws_error_debug_str(meta_request_result->error_code));
-    }
-    
-    if (meta_request_result->response_status) {
-        DEBUG_INFO("s3_on_data_complete: HTTP status code: %d", 
-                  meta_request_result->response_status);
-    }
+    struct stream_context *context = user_data;
     
     aws_mutex_lock(context->lock);
     context->error_code = meta_request_result->error_code;
+    context->response_status = meta_request_result->response_status;
     context->is_done = true;
-    DEBUG_INFO("s3_on_data_complete: signaling completion");
-    aws_condition_variable_notify_one(context->signal);
+    aws_condition_variable_notify_all(context->signal);
     aws_mutex_unlock(context->lock);
 }
 
-/* Receive data from S3 */
-static int s3_receive_data(eb_transport_t *transport, void *buffer, size_t size, size_t *received) {
-    if (!transport || !transport->data || !buffer || size == 0 || !received)
+/* Range header value for a download, false when the whole object is wanted */
+static bool s3_range_header(const eb_transport_range_t *range, char *value, size_t value_size) {
+    if (!range)
+        return false;
+    if (range->from_end) {
+        if (range->length == 0)
+            return false;
+        snprintf(value, value_size, "bytes=-%llu", (unsigned long long)range->length);
+    } else if (range->length == 0) {
+        if (range->offset == 0)
+            return false;
+        snprintf(value, value_size, "bytes=%llu-", (unsigned long long)range->offset);
+    } else {
+        snprintf(value, value_size, "bytes=%llu-%llu", (unsigned long long)range->offset,
+                 (unsigned long long)(range->offset + range->length - 1));
+    }
+    return true;
+}
+
+/* Stream an object, or a byte range of it, from S3 */
+static int s3_receive_stream(eb_transport_t *transport, const eb_transport_range_t *range,
+                             eb_transport_sink_fn sink, void *ctx, size_t *received) {
+    if (!transport || !transport->data || !sink || !received)
         return EB_ERROR_INVALID_PARAMETER;
     
     struct s3_data *s3 = (struct s3_data *)transport->data;
+    *received = 0;
     
     if (!s3->is_connected) {
         snprintf(transport->error_msg, sizeof(transport->error_msg),
                 "Not connected to S3");
         return EB_ERROR_NOT_CONNECTED;
     }
-    
-    DEBUG_INFO("Downloading from S3 bucket '%s' with prefix '%s'", 
-               s3->bucket, s3->prefix);
-
-    // Always use direct-download logic for any key
-    char s3_data_key[1024] = {0};
-    snprintf(s3_data_key, sizeof(s3_data_key), "%s", transport->target_path);
-    DEBUG_INFO("Direct data download: S3 key = %s", s3_data_key);
-    // Setup synchronization primitives
-    struct aws_mutex mutex = AWS_MUTEX_INIT;
-    struct aws_condition_variable completion_signal = AWS_CONDITION_VARIABLE_INIT;
-    void *data_buffer = malloc(size);
-    if (!data_buffer) {
+    if (!transport->target_path) {
         snprintf(transport->error_msg, sizeof(transport->error_msg),
-                "Failed to allocate memory for data download");
-        return EB_ERROR_MEMORY;
+                "No object selected for download");
+        return EB_ERROR_INVALID_PARAMETER;
     }
-    struct download_context data_context = {
-        .error_code = 0,
-        .is_done = false,
-        .lock = &mutex,
-        .signal = &completion_signal,
-        .data = data_buffer,
-        .data_size = 0,
-        .capacity = size,
-        .current_pos = 0
-    };
-    struct aws_http_message *data_request = aws_http_message_new_request(s3->allocator);
-    if (!data_request) {
+    
+    /* Make sure the path starts with a slash for S3 requests */
+    char request_path[1024];
+    snprintf(request_path, sizeof(request_path), "%s%s",
+             transport->target_path[0] == '/' ? "" : "/", transport->target_path);
+    DEBUG_INFO("Downloading s3://%s%s", s3->bucket, request_path);
+    
+    struct aws_http_message *request = aws_http_message_new_request(s3->allocator);
+    if (!request) {
         DEBUG_ERROR("Failed to create HTTP request for data download");
-        free(data_buffer);
         return EB_ERROR_MEMORY;
     }
+    
     char host_header_value[256];
     snprintf(host_header_value, sizeof(host_header_value), "%s.s3.%s.amazonaws.com", 
             s3->bucket, s3->region);
@@ -1838,189 +1969,574 @@ static int s3_receive_data(eb_transport_t *transport, void *buffer, size_t size,
         .value = aws_byte_cursor_from_c_str(host_header_value),
         .compression = AWS_HTTP_HEADER_COMPRESSION_USE_CACHE
     };
-    if (aws_http_message_add_header(data_request, host_header) != AWS_OP_SUCCESS) {
-        DEBUG_ERROR("Failed to add Host header to data request");
-        aws_http_message_release(data_request);
-        free(data_buffer);
-        return EB_ERROR_GENERIC;
-    }
-    if (aws_http_message_set_request_method(data_request, aws_http_method_get) != AWS_OP_SUCCESS) {
-        DEBUG_ERROR("Failed to set GET method on data request");
-        aws_http_message_release(data_request);
-        free(data_buffer);
-        return EB_ERROR_GENERIC;
-    }
-    // Make sure the path starts with a slash for S3 requests
-    char s3_data_request_path[1024];
-    if (s3_data_key[0] != '/') {
-        snprintf(s3_data_request_path, sizeof(s3_data_request_path), "/%s", s3_data_key);
-    } else {
-        strncpy(s3_data_request_path, s3_data_key, sizeof(s3_data_request_path)-1);
-        s3_data_request_path[sizeof(s3_data_request_path)-1] = '\0';
-    }
-    DEBUG_INFO("S3 data request path: %s", s3_data_request_path);
-    if (aws_http_message_set_request_path(data_request, 
-            aws_byte_cursor_from_c_str(s3_data_request_path)) != AWS_OP_SUCCESS) {
-        DEBUG_ERROR("Failed to set path on data request: %s", s3_data_request_path);
-        aws_http_message_release(data_request);
-        free(data_buffer);
+    
+    char range_value[64];
+    bool ranged = s3_range_header(range, range_value, sizeof(range_value));
+    struct aws_http_header range_header = {
+        .name = aws_byte_cursor_from_c_str("Range"),
+        .value = aws_byte_cursor_from_c_str(range_value),
+    };
+    
+    if (aws_http_message_add_header(request, host_header) != AWS_OP_SUCCESS ||
+        (ranged && aws_http_message_add_header(request, range_header) != AWS_OP_SUCCESS) ||
+        aws_http_message_set_request_method(request, aws_http_method_get) != AWS_OP_SUCCESS ||
+        aws_http_message_set_request_path(request, aws_byte_cursor_from_c_str(request_path)) != AWS_OP_SUCCESS) {
+        DEBUG_ERROR("Failed to build data request for %s", request_path);
+        aws_http_message_release(request);
         return EB_ERROR_GENERIC;
     }
-    struct aws_s3_meta_request_options data_options = {
+    if (ranged)
+        DEBUG_INFO("Requesting %s", range_value);
+    
+    struct aws_mutex mutex = AWS_MUTEX_INIT;
+    struct aws_condition_variable completion_signal = AWS_CONDITION_VARIABLE_INIT;
+    struct stream_context context = {
+        .error_code = 0,
+        .is_done = false,
+        .lock = &mutex,
+        .signal = &completion_signal,
+        .sink = sink,
+        .sink_ctx = ctx,
+        .sink_status = 0,
+        .received = 0,
+        .response_status = 0
+    };
+    struct aws_s3_meta_request_options options = {
         .type = AWS_S3_META_REQUEST_TYPE_GET_OBJECT,
-        .message = data_request,
-        .user_data = &data_context,
-        .body_callback = s3_data_body_cb,
-        .finish_callback = s3_data_complete_cb
+        .message = request,
+        .user_data = &context,
+        .body_callback = s3_stream_body_cb,
+        .finish_callback = s3_stream_complete_cb
     };
-    struct aws_s3_meta_request *data_meta_request = 
-        aws_s3_client_make_meta_request(s3->s3_client, &data_options);
-    if (!data_meta_request) {
+    struct aws_s3_meta_request *meta_request = aws_s3_client_make_meta_request(s3->s3_client, &options);
+    if (!meta_request) {
         DEBUG_ERROR("Failed to create data download request: %s (AWS error: %d)",
                    aws_error_debug_str(aws_last_error()), aws_last_error());
-        aws_http_message_release(data_request);
-        free(data_buffer);
+        aws_http_message_release(request);
         return EB_ERROR_CONNECTION;
     }
+    
     aws_mutex_lock(&mutex);
-    aws_condition_variable_wait_pred(
-        &completion_signal, &mutex, s_is_download_done, &data_context);
+    aws_condition_variable_wait_pred(&completion_signal, &mutex, s_is_stream_done, &context);
     aws_mutex_unlock(&mutex);
-    if (data_context.error_code != AWS_ERROR_SUCCESS) {
-        DEBUG_ERROR("Failed to download data: %s",
-                   aws_error_debug_str(data_context.error_code));
-        aws_s3_meta_request_release(data_meta_request);
-        aws_http_message_release(data_request);
-        free(data_buffer);
+    aws_s3_meta_request_release(meta_request);
+    aws_http_message_release(request);
+    
+    *received = context.received;
+    if (context.sink_status != 0)
+        return context.sink_status;
+    if (context.error_code != AWS_ERROR_SUCCESS) {
         snprintf(transport->error_msg, sizeof(transport->error_msg),
-                "Failed to download data: %s",
-                aws_error_debug_str(data_context.error_code));
-        return EB_ERROR_CONNECTION;
+                "Failed to download data: %s (HTTP %d)",
+                aws_error_debug_str(context.error_code), context.response_status);
+        DEBUG_ERROR("%s", transport->error_msg);
+        return context.response_status == 404 ? EB_ERROR_NOT_FOUND : EB_ERROR_CONNECTION;
     }
-    {
-        /* Return raw Parquet buffer to CLI for inverse-transform + metadata extraction */
-        size_t copy_size = (data_context.data_size > size) ? size : data_context.data_size;
-        memcpy(buffer, data_buffer, copy_size);
-        *received = copy_size;
-        free(data_buffer);
-        DEBUG_INFO("Successfully downloaded %zu bytes from S3", *received);
-        return EB_SUCCESS;
+    
+    DEBUG_INFO("Successfully downloaded %zu bytes from S3", context.received);
+    return EB_SUCCESS;
+}
+
+/* Copies what fits in the caller buffer and drops the rest */
+struct truncating_sink {
+    char *buffer;
+    size_t size;
+    size_t used;
+};
+
+static int s3_truncating_sink(void *ctx, const void *data, size_t size) {
+    struct truncating_sink *sink = ctx;
+    size_t room = sink->size - sink->used;
+    if (size > room) {
+        DEBUG_WARN("s3_receive_data: buffer capacity exceeded, discarding %zu bytes", size - room);
+        size = room;
     }
+    memcpy(sink->buffer + sink->used, data, size);
+    sink->used += size;
+    return 0;
 }
 
-/* Delete refs/objects in the S3 bucket (stub for now) */
-static int s3_delete_refs(eb_transport_t *transport, const char **refs, size_t count) {
-    if (!transport || !transport->data || !refs || count == 0)
+/* Receive data from S3 straight into the caller buffer */
+static int s3_receive_data(eb_transport_t *transport, void *buffer, size_t size, size_t *received) {
+    if (!transport || !transport->data || !buffer || size == 0 || !received)
         return EB_ERROR_INVALID_PARAMETER;
+    
+    struct truncating_sink sink = { .buffer = buffer, .size = size, .used = 0 };
+    size_t streamed = 0;
+    int result = s3_receive_stream(transport, NULL, s3_truncating_sink, &sink, &streamed);
+    *received = sink.used;
+    return result;
+}
 
+/*
+ * Batched deletes
+ *
+ * Keys go out in DeleteObjects requests of up to S3_DELETE_BATCH_KEYS,
+ * S3_DELETE_PIPELINE of them in flight at once. The requests are quiet,
+ * so a response only lists the keys that could not be deleted.
+ */
+/* Store a buffer verbatim under a key, e.g. a pack or a manifest */
+static int s3_put_object(eb_transport_t *transport, const char *key, const void *data, size_t size) {
+    if (!transport || !transport->data || !key)
+        return EB_ERROR_INVALID_PARAMETER;
+    
     struct s3_data *s3 = (struct s3_data *)transport->data;
     if (!s3->is_connected) {
         snprintf(transport->error_msg, sizeof(transport->error_msg),
                 "Not connected to S3");
         return EB_ERROR_NOT_CONNECTED;
     }
-
+    
+    char request_path[1024];
+    snprintf(request_path, sizeof(request_path), "%s%s", key[0] == '/' ? "" : "/", key);
     char host_header_value[256];
     snprintf(host_header_value, sizeof(host_header_value), "%s.s3.%s.amazonaws.com", 
             s3->bucket, s3->region);
-    struct aws_http_header host_header = {
-        .name = aws_byte_cursor_from_c_str("Host"),
-        .value = aws_byte_cursor_from_c_str(host_header_value),
+    char content_length[32];
+    snprintf(content_length, sizeof(content_length), "%zu", size);
+    struct aws_http_header headers[] = {
+        { .name = aws_byte_cursor_from_c_str("Host"),
+          .value = aws_byte_cursor_from_c_str(host_header_value) },
+        { .name = aws_byte_cursor_from_c_str("Content-Type"),
+          .value = aws_byte_cursor_from_c_str("application/octet-stream") },
+        { .name = aws_byte_cursor_from_c_str("Content-Length"),
+          .value = aws_byte_cursor_from_c_str(content_length) },
     };
+    
+    struct aws_byte_cursor body_cursor = aws_byte_cursor_from_array(data, size);
+    struct aws_http_message *message = aws_http_message_new_request(s3->allocator);
+    struct aws_input_stream *body_stream = aws_input_stream_new_from_cursor(s3->allocator, &body_cursor);
+    if (!message || !body_stream) {
+        if (message)
+            aws_http_message_release(message);
+        if (body_stream)
+            aws_input_stream_release(body_stream);
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to create PUT message for %s", key);
+        return EB_ERROR_MEMORY;
+    }
+    aws_http_message_set_request_method(message, aws_http_method_put);
+    aws_http_message_set_request_path(message, aws_byte_cursor_from_c_str(request_path));
+    for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); i++)
+        aws_http_message_add_header(message, headers[i]);
+    aws_http_message_set_body_stream(message, body_stream);
+    
+    struct s3_operation_context context = {
+        .lock = &s_mutex,
+        .signal = &s_cvar,
+        .error_code = 0,
+        .is_done = false
+    };
+    struct aws_s3_meta_request_options options = {
+        .type = AWS_S3_META_REQUEST_TYPE_PUT_OBJECT,
+        .message = message,
+        .user_data = &context,
+        .finish_callback = s3_on_s3_operation_finished
+    };
+    struct aws_s3_meta_request *request = aws_s3_client_make_meta_request(s3->s3_client, &options);
+    if (!request) {
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to create S3 meta request for %s: %s", key, aws_error_str(aws_last_error()));
+        aws_http_message_release(message);
+        aws_input_stream_release(body_stream);
+        return EB_ERROR_GENERIC;
+    }
+    
+    DEBUG_INFO("Storing %zu bytes at s3://%s%s", size, s3->bucket, request_path);
+    aws_mutex_lock(&s_mutex);
+    aws_condition_variable_wait_pred(&s_cvar, &s_mutex, s_is_operation_done, &context);
+    aws_mutex_unlock(&s_mutex);
+    aws_s3_meta_request_release(request);
+    aws_http_message_release(message);
+    aws_input_stream_release(body_stream);
+    
+    if (context.error_code != AWS_ERROR_SUCCESS) {
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to store %s: %s", key, aws_error_debug_str(context.error_code));
+        return EB_ERROR_CONNECTION;
+    }
+    return EB_SUCCESS;
+}
 
-    for (size_t i = 0; i < count; ++i) {
-        const char *key = refs[i];
-        if (!key || !*key) continue;
+#define S3_DELETE_BATCH_KEYS 1000      /* S3 limit per DeleteObjects */
+#define S3_DELETE_PIPELINE 4
+#define S3_DELETE_TIMEOUT_SECONDS 60
+
+struct s3_delete_batch {
+    struct s3_operation_context context;
+    struct aws_s3_meta_request *request;
+    struct aws_http_message *message;
+    struct aws_input_stream *body_stream;
+    struct aws_byte_buf body;          /* Request XML */
+    struct aws_byte_buf response;      /* Response XML */
+    int response_status;
+    size_t keys;                       /* Keys in the request */
+};
 
-        struct aws_http_message *del_message = aws_http_message_new_request(s3->allocator);
-        if (!del_message) {
-            snprintf(transport->error_msg, sizeof(transport->error_msg),
-                    "Failed to create DELETE message for object %s", key);
-            return EB_ERROR_GENERIC;
-        }
+static int s3_delete_body_cb(
+    struct aws_s3_meta_request *meta_request,
+    const struct aws_byte_cursor *body,
+    uint64_t range_start,
+    void *user_data)
+{
+    (void)meta_request;
+    (void)range_start;
+    
+    struct s3_delete_batch *batch = user_data;
+    return aws_byte_buf_append_dynamic(&batch->response, body);
+}
 
-        aws_http_message_set_request_method(del_message, aws_http_method_delete);
+static void s3_delete_finished(
+    struct aws_s3_meta_request *meta_request,
+    const struct aws_s3_meta_request_result *meta_request_result,
+    void *user_data)
+{
+    (void)meta_request;
+    
+    struct s3_delete_batch *batch = user_data;
+    
+    aws_mutex_lock(batch->context.lock);
+    batch->context.error_code = meta_request_result->error_code;
+    batch->response_status = meta_request_result->response_status;
+    if (meta_request_result->error_response_body && batch->response.len == 0) {
+        struct aws_byte_cursor error_body = aws_byte_cursor_from_buf(meta_request_result->error_response_body);
+        aws_byte_buf_append_dynamic(&batch->response, &error_body);
+    }
+    batch->context.is_done = true;
+    aws_condition_variable_notify_all(batch->context.signal);
+    aws_mutex_unlock(batch->context.lock);
+}
 
-        char uri_buffer[2048];
-        if (key[0] != '/') {
-            snprintf(uri_buffer, sizeof(uri_buffer), "/%s", key);
-        } else {
-            strncpy(uri_buffer, key, sizeof(uri_buffer)-1);
-            uri_buffer[sizeof(uri_buffer)-1] = '\0';
+/* Append a key to the request XML, escaping what XML reserves */
+static int s3_append_xml_key(struct aws_byte_buf *body, const char *key) {
+    struct aws_byte_cursor open = aws_byte_cursor_from_c_str("<Object><Key>");
+    struct aws_byte_cursor close = aws_byte_cursor_from_c_str("</Key></Object>");
+    if (aws_byte_buf_append_dynamic(body, &open) != AWS_OP_SUCCESS)
+        return AWS_OP_ERR;
+    for (const char *c = key; *c; c++) {
+        const char *escaped = NULL;
+        switch (*c) {
+        case '&': escaped = "&amp;"; break;
+        case '<': escaped = "&lt;"; break;
+        case '>': escaped = "&gt;"; break;
+        case '"': escaped = "&quot;"; break;
+        case '\'': escaped = "&apos;"; break;
         }
-        struct aws_byte_cursor uri_cursor = aws_byte_cursor_from_c_str(uri_buffer);
-        aws_http_message_set_request_path(del_message, uri_cursor);
-        aws_http_message_add_header(del_message, host_header);
-
-        struct s3_operation_context del_context = {
-            .lock = &s_mutex,
-            .signal = &s_cvar,
-            .error_code = 0,
-            .is_done = false
-        };
-
-        struct aws_s3_meta_request_options del_options = {
-            .message = del_message,
-            .user_data = &del_context,
-            .finish_callback = s3_on_s3_operation_finished
-        };
-
-        struct aws_s3_meta_request *del_request = aws_s3_client_make_meta_request(s3->s3_client, &del_options);
-        if (!del_request) {
+        struct aws_byte_cursor part = escaped ? aws_byte_cursor_from_c_str(escaped)
+                                              : aws_byte_cursor_from_array(c, 1);
+        if (aws_byte_buf_append_dynamic(body, &part) != AWS_OP_SUCCESS)
+            return AWS_OP_ERR;
+    }
+    return aws_byte_buf_append_dynamic(body, &close);
+}
+
+/* Copy the text of the first <tag> in [start, end) */
+static void s3_xml_value(const char *start, const char *end, const char *tag,
+                         char *value, size_t value_size) {
+    char open[64], close[64];
+    snprintf(open, sizeof(open), "<%s>", tag);
+    snprintf(close, sizeof(close), "</%s>", tag);
+    value[0] = '\0';
+    const char *from = strstr(start, open);
+    if (!from || from >= end)
+        return;
+    from += strlen(open);
+    const char *to = strstr(from, close);
+    if (!to || to > end)
+        return;
+    size_t len = (size_t)(to - from);
+    if (len >= value_size)
+        len = value_size - 1;
+    memcpy(value, from, len);
+    value[len] = '\0';
+}
+
+static void s3_free_delete_batch(struct s3_delete_batch *batch) {
+    if (batch->request)
+        aws_s3_meta_request_release(batch->request);
+    if (batch->message)
+        aws_http_message_release(batch->message);
+    if (batch->body_stream)
+        aws_input_stream_release(batch->body_stream);
+    aws_byte_buf_clean_up(&batch->body);
+    aws_byte_buf_clean_up(&batch->response);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/* Build and start a DeleteObjects request for keys [*next, count) */
+static int s3_start_delete_batch(eb_transport_t *transport, struct s3_delete_batch *batch,
+                                 const char **refs, size_t count, size_t *next) {
+    struct s3_data *s3 = (struct s3_data *)transport->data;
+    
+    memset(batch, 0, sizeof(*batch));
+    batch->context = (struct s3_operation_context) {
+        .lock = &s_mutex,
+        .signal = &s_cvar,
+        .error_code = 0,
+        .is_done = false
+    };
+    aws_byte_buf_init(&batch->body, s3->allocator, 4096);
+    aws_byte_buf_init(&batch->response, s3->allocator, 1024);
+    
+    struct aws_byte_cursor head = aws_byte_cursor_from_c_str(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?><Delete><Quiet>true</Quiet>");
+    struct aws_byte_cursor tail = aws_byte_cursor_from_c_str("</Delete>");
+    bool built = aws_byte_buf_append_dynamic(&batch->body, &head) == AWS_OP_SUCCESS;
+    while (built && *next < count && batch->keys < S3_DELETE_BATCH_KEYS) {
+        const char *key = refs[(*next)++];
+        if (!key || !*key)
+            continue;
+        if (key[0] == '/')
+            key++;
+        built = s3_append_xml_key(&batch->body, key) == AWS_OP_SUCCESS;
+        batch->keys++;
+    }
+    built = built && aws_byte_buf_append_dynamic(&batch->body, &tail) == AWS_OP_SUCCESS;
+    if (!built) {
+        s3_free_delete_batch(batch);
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to build DeleteObjects request");
+        return EB_ERROR_MEMORY;
+    }
+    if (batch->keys == 0) {
+        s3_free_delete_batch(batch);
+        return EB_SUCCESS;
+    }
+    
+    /* DeleteObjects requires the MD5 of its body */
+    uint8_t md5[16];
+    struct aws_byte_buf md5_buf = aws_byte_buf_from_empty_array(md5, sizeof(md5));
+    struct aws_byte_cursor body_cursor = aws_byte_cursor_from_buf(&batch->body);
+    char md5_base64[32];
+    struct aws_byte_buf md5_base64_buf = aws_byte_buf_from_empty_array(md5_base64, sizeof(md5_base64));
+    if (aws_md5_compute(s3->allocator, &body_cursor, &md5_buf, 0) != AWS_OP_SUCCESS ||
+        aws_base64_encode(&(struct aws_byte_cursor){ .ptr = md5, .len = md5_buf.len },
+                          &md5_base64_buf) != AWS_OP_SUCCESS) {
+        s3_free_delete_batch(batch);
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to checksum DeleteObjects request");
+        return EB_ERROR_GENERIC;
+    }
+    md5_base64[md5_base64_buf.len] = '\0';
+    
+    char host_header_value[256];
+    snprintf(host_header_value, sizeof(host_header_value), "%s.s3.%s.amazonaws.com", 
+            s3->bucket, s3->region);
+    char content_length[32];
+    snprintf(content_length, sizeof(content_length), "%zu", batch->body.len);
+    struct aws_http_header headers[] = {
+        { .name = aws_byte_cursor_from_c_str("Host"),
+          .value = aws_byte_cursor_from_c_str(host_header_value) },
+        { .name = aws_byte_cursor_from_c_str("Content-Type"),
+          .value = aws_byte_cursor_from_c_str("application/xml") },
+        { .name = aws_byte_cursor_from_c_str("Content-Length"),
+          .value = aws_byte_cursor_from_c_str(content_length) },
+        { .name = aws_byte_cursor_from_c_str("Content-MD5"),
+          .value = aws_byte_cursor_from_c_str(md5_base64) },
+    };
+    
+    batch->message = aws_http_message_new_request(s3->allocator);
+    batch->body_stream = aws_input_stream_new_from_cursor(s3->allocator, &body_cursor);
+    if (!batch->message || !batch->body_stream) {
+        s3_free_delete_batch(batch);
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to create DeleteObjects message");
+        return EB_ERROR_MEMORY;
+    }
+    aws_http_message_set_request_method(batch->message, aws_http_method_post);
+    aws_http_message_set_request_path(batch->message, aws_byte_cursor_from_c_str("/?delete"));
+    for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); i++)
+        aws_http_message_add_header(batch->message, headers[i]);
+    aws_http_message_set_body_stream(batch->message, batch->body_stream);
+    
+    struct aws_s3_meta_request_options options = {
+        .type = AWS_S3_META_REQUEST_TYPE_DEFAULT,
+        .operation_name = aws_byte_cursor_from_c_str("DeleteObjects"),
+        .message = batch->message,
+        .user_data = batch,
+        .body_callback = s3_delete_body_cb,
+        .finish_callback = s3_delete_finished
+    };
+    batch->request = aws_s3_client_make_meta_request(s3->s3_client, &options);
+    if (!batch->request) {
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Failed to create S3 meta request for delete: %s", aws_error_str(aws_last_error()));
+        s3_free_delete_batch(batch);
+        return EB_ERROR_GENERIC;
+    }
+    
+    DEBUG_INFO("Deleting %zu objects in one DeleteObjects request", batch->keys);
+    return EB_SUCCESS;
+}
+
+/* Count and log the keys a finished batch failed to delete */
+static size_t s3_delete_batch_failures(eb_transport_t *transport, struct s3_delete_batch *batch,
+                                       size_t failed_before) {
+    if (batch->context.error_code != AWS_ERROR_SUCCESS) {
+        char code[64];
+        aws_byte_buf_append_null_terminator(&batch->response);
+        s3_xml_value((const char *)batch->response.buffer,
+                     (const char *)batch->response.buffer + batch->response.len,
+                     "Code", code, sizeof(code));
+        DEBUG_ERROR("DeleteObjects of %zu keys failed: %s (HTTP %d %s)", batch->keys,
+                   aws_error_str(batch->context.error_code), batch->response_status, code);
+        if (failed_before == 0)
             snprintf(transport->error_msg, sizeof(transport->error_msg),
-                    "Failed to create S3 meta request for delete: %s", aws_error_str(aws_last_error()));
-            aws_http_message_release(del_message);
-            return EB_ERROR_GENERIC;
-        }
+                    "Failed to delete %zu objects: HTTP %d %s", batch->keys,
+                    batch->response_status, code[0] ? code : aws_error_str(batch->context.error_code));
+        return batch->keys;
+    }
+    
+    size_t failed = 0;
+    aws_byte_buf_append_null_terminator(&batch->response);
+    const char *cursor = (const char *)batch->response.buffer;
+    const char *error;
+    while ((error = strstr(cursor, "<Error>")) != NULL) {
+        const char *end = strstr(error, "</Error>");
+        if (!end)
+            break;
+        char key[1024], code[64], message[256];
+        s3_xml_value(error, end, "Key", key, sizeof(key));
+        s3_xml_value(error, end, "Code", code, sizeof(code));
+        s3_xml_value(error, end, "Message", message, sizeof(message));
+        DEBUG_ERROR("Failed to delete object %s: %s %s", key, code, message);
+        if (failed_before + failed == 0)
+            snprintf(transport->error_msg, sizeof(transport->error_msg),
+                    "Failed to delete object %s: %s", key, code);
+        failed++;
+        cursor = end;
+    }
+    return failed;
+}
 
-        aws_mutex_lock(&s_mutex);
-        struct timespec start_time, current_time;
-        clock_gettime(CLOCK_REALTIME, &start_time);
-        bool timed_out = false;
-        int max_wait_seconds = 30;
-        while (!del_context.is_done) {
-            clock_gettime(CLOCK_REALTIME, &current_time);
-            int elapsed_seconds = (current_time.tv_sec - start_time.tv_sec);
-            if (elapsed_seconds >= max_wait_seconds) {
-                timed_out = true;
+/* Delete refs/objects in the S3 bucket with batched DeleteObjects requests */
+static int s3_delete_refs(eb_transport_t *transport, const char **refs, size_t count) {
+    if (!transport || !transport->data || !refs || count == 0)
+        return EB_ERROR_INVALID_PARAMETER;
+
+    struct s3_data *s3 = (struct s3_data *)transport->data;
+    if (!s3->is_connected) {
+        snprintf(transport->error_msg, sizeof(transport->error_msg),
+                "Not connected to S3");
+        return EB_ERROR_NOT_CONNECTED;
+    }
+
+    struct s3_delete_batch batches[S3_DELETE_PIPELINE];
+    size_t next = 0;
+    size_t failed = 0;
+    size_t deleted = 0;
+    int result = EB_SUCCESS;
+    
+    while (next < count && result == EB_SUCCESS) {
+        /* Start a window of batches, then collect them all */
+        size_t started = 0;
+        while (started < S3_DELETE_PIPELINE && next < count) {
+            result = s3_start_delete_batch(transport, &batches[started], refs, count, &next);
+            if (result != EB_SUCCESS)
                 break;
+            if (batches[started].request)
+                started++;
+        }
+        
+        time_t deadline = time(NULL) + S3_DELETE_TIMEOUT_SECONDS;
+        for (size_t i = 0; i < started; i++) {
+            aws_mutex_lock(&s_mutex);
+            while (!batches[i].context.is_done) {
+                if (time(NULL) >= deadline) {
+                    /* Cancelled requests still finish, wait for that */
+                    aws_mutex_unlock(&s_mutex);
+                    aws_s3_meta_request_cancel(batches[i].request);
+                    aws_mutex_lock(&s_mutex);
+                    aws_condition_variable_wait_pred(&s_cvar, &s_mutex,
+                                                     s_is_operation_done, &batches[i].context);
+                    break;
+                }
+                aws_condition_variable_wait_for_pred(&s_cvar, &s_mutex, 1000000000,
+                                                     s_is_operation_done, &batches[i].context);
             }
             aws_mutex_unlock(&s_mutex);
-            process_events_while_waiting(s3, 100);
-            aws_mutex_lock(&s_mutex);
-            int64_t wait_timeout_ns = 1000000000;
-            aws_condition_variable_wait_for_pred(
-                &s_cvar, 
-                &s_mutex, 
-                wait_timeout_ns, 
-                s_is_operation_done, 
-                &del_context);
+            
+            size_t batch_failed = s3_delete_batch_failures(transport, &batches[i], failed);
+            failed += batch_failed;
+            deleted += batches[i].keys - batch_failed;
+            s3_free_delete_batch(&batches[i]);
         }
-        aws_mutex_unlock(&s_mutex);
-        aws_s3_meta_request_release(del_request);
-        aws_http_message_release(del_message);
-        if (timed_out) {
-            snprintf(transport->error_msg, sizeof(transport->error_msg),
-                    "S3 delete operation timed out for key: %s", key);
-            return EB_ERROR_TIMEOUT;
-        } else if (del_context.error_code != AWS_ERROR_SUCCESS) {
-            snprintf(transport->error_msg, sizeof(transport->error_msg),
-                    "Failed to delete object %s: error code %d (%s)", 
-                    key, del_context.error_code, aws_error_str(del_context.error_code));
-            return EB_ERROR_CONNECTION;
+    }
+    
+    DEBUG_INFO("Deleted %zu objects, %zu failed", deleted, failed);
+    if (result != EB_SUCCESS)
+        return result;
+    if (failed > 0) {
+        if (failed > 1) {
+            size_t len = strlen(transport->error_msg);
+            snprintf(transport->error_msg + len, sizeof(transport->error_msg) - len,
+                    " (%zu objects failed)", failed);
         }
+        return EB_ERROR_CONNECTION;
     }
     return EB_SUCCESS;
 }
 
 /* Operations table for S3 transport */
+/* Compare one query parameter of two URLs, absent in both counts as equal */
+static bool s3_same_url_param(const char *a, const char *b, const char *param) {
+    char *value_a = get_url_param(a, param);
+    char *value_b = get_url_param(b, param);
+    bool same = (!value_a && !value_b) ||
+                (value_a && value_b && strcmp(value_a, value_b) == 0);
+    free(value_a);
+    free(value_b);
+    return same;
+}
+
+/*
+ * Point a connected transport at another prefix of its bucket
+ *
+ * The client, TLS session and credentials only depend on the bucket,
+ * region and endpoint, so a URL that keeps those can reuse them.
+ */
+static int s3_retarget(eb_transport_t *transport, const char *url) {
+    if (!transport || !transport->data || !url)
+        return EB_ERROR_INVALID_PARAMETER;
+    
+    struct s3_data *s3 = (struct s3_data *)transport->data;
+    if (!s3->is_connected || !s3->bucket)
+        return EB_ERROR_NOT_CONNECTED;
+    
+    if (!s3_same_url_param(transport->url, url, "region") ||
+        !s3_same_url_param(transport->url, url, "endpoint"))
+        return EB_ERROR_UNSUPPORTED;
+    
+    char *bucket = NULL;
+    char *prefix = NULL;
+    if (parse_s3_url(url, &bucket, &prefix, NULL) < 0)
+        return EB_ERROR_INVALID_URL;
+    
+    if (strcmp(bucket, s3->bucket) != 0) {
+        free(bucket);
+        free(prefix);
+        return EB_ERROR_UNSUPPORTED;
+    }
+    free(bucket);
+    
+    free(s3->prefix);
+    s3->prefix = prefix;
+    DEBUG_PRINT("Retargeted S3 transport to bucket '%s' prefix '%s'", s3->bucket, s3->prefix);
+    return EB_SUCCESS;
+}
+
 struct transport_ops s3_ops = {
     .connect = s3_connect,
     .send_data = s3_send_data,
     .receive_data = s3_receive_data,
+    .receive_stream = s3_receive_stream,
+    .put_object = s3_put_object,
     .disconnect = s3_disconnect,
     .list_refs = s3_list_refs,
-    .delete_refs = s3_delete_refs // New: delete operation
+    .delete_refs = s3_delete_refs, // New: delete operation
+    .retarget = s3_retarget,
+    .submit_data = s3_submit_data,
+    .wait_data = s3_wait_data
 };
 
 int s3_transport_init(void) {
@@ -8,90 +8,929 @@
  * (at your option) any later version.
  */
 
+#define _GNU_SOURCE /* For strndup and SOCK_CLOEXEC */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 #include "transport.h"
 #include "error.h"
 #include "debug.h"
+#include "remote_metadata.h"
+#include "serve.h"
+
+/*
+ * SSH transport
+ *
+ * Like git over ssh, the transport runs the server end on the remote host
+ * ("embr serve <root>", see serve.h) and talks to it over the ssh
+ * channel. Both URL forms are understood:
+ *
+ *   ssh://[user@]host[:port]/srv/embeddings   keys below /
+ *   [user@]host:embeddings                     keys below the home directory
+ *
+ * Keys are laid out as on S3. Every transport of the process that points
+ * at the same host and server shares one ssh connection: requests from
+ * any thread are written to it as they come and their answers are matched
+ * up by a reader thread, so many objects are in flight on one channel and
+ * a high-latency link costs one round trip per batch rather than one per
+ * object.
+ *
+ * EB_SSH names the ssh program and its options ("ssh" by default), and
+ * EB_SSH_SERVER the embr binary on the remote host ("embr").
+ */
+#define SSH_DEFAULT_PROGRAM "ssh"
+#define SSH_DEFAULT_SERVER "embr"
+#define SSH_MAX_ARGS 32
+#define SSH_DELETE_WINDOW 256
+
+/* Request on a connection, waiting for its DONE frame */
+struct ssh_call {
+	uint32_t id;
+	bool done;
+	int status;
+	char message[256];
+
+	/* Answer body */
+	eb_transport_sink_fn sink;
+	void *sink_ctx;
+	int sink_status;
+	size_t received;
+
+	struct ssh_call *next;
+};
+
+/* One ssh process, shared by every transport to the same server */
+struct ssh_conn {
+	char *id;                     /* program, destination, port, root and server */
+	int refs;
+	int fd;                       /* Our end of the socket pair ssh runs on */
+	pid_t pid;
+	pthread_t reader;
+	bool reader_started;
+
+	pthread_mutex_t write_lock;   /* Keeps the frames of a request together */
+	pthread_mutex_t lock;         /* Guards everything below */
+	pthread_cond_t cond;
+	uint32_t next_id;
+	struct ssh_call *calls;       /* Requests waiting for an answer */
+	bool broken;
+
+	/* metadata.json is rewritten once the last upload in flight is in */
+	size_t uploads;
+	bool metadata_stale;
+	char metadata_key[1024];
+	char set_name[256];
+	size_t last_size;
+	time_t last_timestamp;
+
+	struct ssh_conn *next;
+};
 
-/* Stub implementation - SSH transport is disabled */
 struct ssh_data {
-	void *placeholder;  /* Just a placeholder to avoid empty struct */
+	struct ssh_conn *conn;
+	char *prefix;                 /* Key prefix of the URL, "" for none */
 };
 
+/* Upload handed out by ssh_submit_data */
+struct ssh_upload {
+	struct ssh_call call;
+	char metadata_key[1024];
+	char set_name[256];
+	size_t size;
+	time_t timestamp;
+};
+
+/* Where a URL points */
+struct ssh_target {
+	char destination[256];        /* [user@]host */
+	char port[16];
+	char root[8];                 /* Directory keys are resolved under */
+	char server[512];
+	char *prefix;
+};
+
+static pthread_mutex_t ssh_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ssh_conn *ssh_registry = NULL;
+
+static void ssh_call_fail_all(struct ssh_conn *conn)
+{
+	for (struct ssh_call *call = conn->calls; call; call = call->next) {
+		call->done = true;
+		call->status = EB_ERROR_CONNECTION_CLOSED;
+		snprintf(call->message, sizeof(call->message), "Connection to the ssh remote was lost");
+	}
+	conn->calls = NULL;
+	conn->broken = true;
+	pthread_cond_broadcast(&conn->cond);
+}
+
+static struct ssh_call *ssh_call_take(struct ssh_conn *conn, uint32_t id, bool remove)
+{
+	for (struct ssh_call **link = &conn->calls; *link; link = &(*link)->next) {
+		struct ssh_call *call = *link;
+		if (call->id == id) {
+			if (remove)
+				*link = call->next;
+			return call;
+		}
+	}
+	return NULL;
+}
+
+/* Route answers to the requests waiting for them */
+static void *ssh_reader_main(void *arg)
+{
+	struct ssh_conn *conn = arg;
+	unsigned char *buffer = malloc(EB_SERVE_CHUNK_SIZE);
+	char message[EB_SERVE_MAX_KEY + 1];
+
+	while (buffer) {
+		eb_serve_frame_t frame;
+		if (eb_serve_read_header(conn->fd, &frame) != EB_SUCCESS ||
+		    eb_serve_read_all(conn->fd, message, frame.key_length) != EB_SUCCESS)
+			break;
+		message[frame.key_length] = '\0';
+
+		pthread_mutex_lock(&conn->lock);
+		struct ssh_call *call = ssh_call_take(conn, frame.id, false);
+		pthread_mutex_unlock(&conn->lock);
+
+		if (frame.type == EB_SERVE_DATA) {
+			/* The caller waits for DONE, so the call outlives its data */
+			uint64_t remaining = frame.body_length;
+			bool ok = true;
+			while (remaining > 0 && ok) {
+				size_t chunk = remaining < EB_SERVE_CHUNK_SIZE ? (size_t)remaining : EB_SERVE_CHUNK_SIZE;
+				ok = eb_serve_read_all(conn->fd, buffer, chunk) == EB_SUCCESS;
+				remaining -= chunk;
+				if (ok && call && call->sink && call->sink_status == 0) {
+					call->sink_status = call->sink(call->sink_ctx, buffer, chunk);
+					if (call->sink_status == 0)
+						call->received += chunk;
+				}
+			}
+			if (!ok)
+				break;
+			continue;
+		}
+
+		unsigned char status[4] = {0};
+		if (frame.type != EB_SERVE_DONE || frame.body_length != sizeof(status) ||
+		    eb_serve_read_all(conn->fd, status, sizeof(status)) != EB_SUCCESS) {
+			DEBUG_ERROR("ssh: unexpected frame %u from the remote server", frame.type);
+			break;
+		}
+
+		pthread_mutex_lock(&conn->lock);
+		call = ssh_call_take(conn, frame.id, true);
+		if (call) {
+			call->status = (int32_t)eb_serve_get_u32(status);
+			snprintf(call->message, sizeof(call->message), "%s", message);
+			call->done = true;
+			pthread_cond_broadcast(&conn->cond);
+		}
+		pthread_mutex_unlock(&conn->lock);
+	}
+
+	free(buffer);
+	pthread_mutex_lock(&conn->lock);
+	ssh_call_fail_all(conn);
+	pthread_mutex_unlock(&conn->lock);
+	return NULL;
+}
+
+/* Send a request, its answer is collected by ssh_call_wait() */
+static int ssh_call_start(struct ssh_conn *conn, struct ssh_call *call, uint8_t type, const char *key,
+			  const void *body, size_t body_size)
+{
+	size_t key_length = strlen(key);
+	if (key_length > EB_SERVE_MAX_KEY)
+		return EB_ERROR_PATH_TOO_LONG;
+
+	pthread_mutex_lock(&conn->lock);
+	if (conn->broken) {
+		pthread_mutex_unlock(&conn->lock);
+		snprintf(call->message, sizeof(call->message), "Connection to the ssh remote was lost");
+		return EB_ERROR_CONNECTION_CLOSED;
+	}
+	call->id = conn->next_id++;
+	call->done = false;
+	call->status = EB_SUCCESS;
+	call->message[0] = '\0';
+	call->next = conn->calls;
+	conn->calls = call;
+	pthread_mutex_unlock(&conn->lock);
+
+	eb_serve_frame_t frame = { type, call->id, (uint32_t)key_length, (uint64_t)body_size };
+	pthread_mutex_lock(&conn->write_lock);
+	int status = eb_serve_write_header(conn->fd, &frame);
+	if (status == EB_SUCCESS)
+		status = eb_serve_write_all(conn->fd, key, key_length);
+	if (status == EB_SUCCESS && body_size > 0)
+		status = eb_serve_write_all(conn->fd, body, body_size);
+	pthread_mutex_unlock(&conn->write_lock);
+
+	if (status != EB_SUCCESS) {
+		/* Half a frame leaves the stream unusable, let the reader fail everyone */
+		shutdown(conn->fd, SHUT_RDWR);
+		pthread_mutex_lock(&conn->lock);
+		ssh_call_take(conn, call->id, true);
+		conn->broken = true;
+		pthread_mutex_unlock(&conn->lock);
+		snprintf(call->message, sizeof(call->message), "Connection to the ssh remote was lost");
+	}
+	return status;
+}
+
+static int ssh_call_wait(struct ssh_conn *conn, struct ssh_call *call)
+{
+	pthread_mutex_lock(&conn->lock);
+	while (!call->done)
+		pthread_cond_wait(&conn->cond, &conn->lock);
+	pthread_mutex_unlock(&conn->lock);
+	return call->sink_status != 0 ? call->sink_status : call->status;
+}
+
+/* Outcome of a call, with its message kept on the transport */
+static int ssh_call_result(eb_transport_t *transport, const struct ssh_call *call, int status)
+{
+	if (status != EB_SUCCESS && call->message[0])
+		snprintf(transport->error_msg, sizeof(transport->error_msg), "%s", call->message);
+	return status;
+}
+
+static int ssh_request(eb_transport_t *transport, struct ssh_call *call, uint8_t type, const char *key,
+		       const void *body, size_t body_size)
+{
+	struct ssh_data *ssh = transport->data;
+	int status = ssh_call_start(ssh->conn, call, type, key, body, body_size);
+	if (status == EB_SUCCESS)
+		status = ssh_call_wait(ssh->conn, call);
+	return ssh_call_result(transport, call, status);
+}
+
+/* Append an argument quoted for the remote shell */
+static void ssh_shell_quote(char *out, size_t out_size, const char *arg)
+{
+	size_t used = strlen(out);
+	if (used + 1 < out_size)
+		out[used++] = '\'';
+	for (const char *p = arg; *p && used + 5 < out_size; p++) {
+		if (*p == '\'') {
+			memcpy(out + used, "'\\''", 4);
+			used += 4;
+		} else {
+			out[used++] = *p;
+		}
+	}
+	if (used + 1 < out_size)
+		out[used++] = '\'';
+	out[used] = '\0';
+}
+
+/* Start ssh and wait for the server greeting */
+static int ssh_conn_spawn(struct ssh_conn *conn, const struct ssh_target *target,
+			  char *error, size_t error_size)
+{
+	const char *program = getenv("EB_SSH");
+	char *words = strdup(program && *program ? program : SSH_DEFAULT_PROGRAM);
+	char command[1200] = "";
+	char *argv[SSH_MAX_ARGS + 6];
+	int argc = 0;
+
+	if (!words)
+		return EB_ERROR_MEMORY;
+	for (char *save = NULL, *word = strtok_r(words, " \t", &save); word && argc < SSH_MAX_ARGS;
+	     word = strtok_r(NULL, " \t", &save))
+		argv[argc++] = word;
+	if (argc == 0) {
+		free(words);
+		snprintf(error, error_size, "EB_SSH is empty");
+		return EB_ERROR_CONFIG;
+	}
+	if (target->port[0]) {
+		argv[argc++] = "-p";
+		argv[argc++] = (char *)target->port;
+	}
+	argv[argc++] = (char *)target->destination;
+	ssh_shell_quote(command, sizeof(command), target->server);
+	strncat(command, " serve ", sizeof(command) - strlen(command) - 1);
+	ssh_shell_quote(command, sizeof(command), target->root);
+	argv[argc++] = command;
+	argv[argc] = NULL;
+
+	int sockets[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+		snprintf(error, error_size, "Cannot create socket pair: %s", strerror(errno));
+		free(words);
+		return EB_ERROR_RESOURCE_EXHAUSTED;
+	}
+
+	DEBUG_INFO("Starting %s %s %s", argv[0], target->destination, command);
+	pid_t pid = fork();
+	if (pid == 0) {
+		/* dup2 clears close-on-exec on the copies */
+		if (dup2(sockets[1], STDIN_FILENO) < 0 || dup2(sockets[1], STDOUT_FILENO) < 0)
+			_exit(127);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	close(sockets[1]);
+	free(words);
+	if (pid < 0) {
+		snprintf(error, error_size, "Cannot start ssh: %s", strerror(errno));
+		close(sockets[0]);
+		return EB_ERROR_PROCESS_FAILED;
+	}
+	conn->fd = sockets[0];
+	conn->pid = pid;
+
+	eb_serve_frame_t hello;
+	char greeting[EB_SERVE_MAX_KEY + 1];
+	int status = eb_serve_read_header(conn->fd, &hello);
+	if (status == EB_SUCCESS)
+		status = eb_serve_read_all(conn->fd, greeting, hello.key_length);
+	if (status != EB_SUCCESS) {
+		int exit_status = 0;
+		close(conn->fd);
+		conn->fd = -1;
+		waitpid(pid, &exit_status, 0);
+		snprintf(error, error_size, "ssh %s did not start '%s serve' (exit status %d)",
+			 target->destination, target->server,
+			 WIFEXITED(exit_status) ? WEXITSTATUS(exit_status) : -1);
+		return EB_ERROR_CONNECTION_FAILED;
+	}
+	greeting[hello.key_length] = '\0';
+	if (hello.type != EB_SERVE_HELLO || strcmp(greeting, EB_SERVE_GREETING) != 0) {
+		snprintf(error, error_size, "Unexpected greeting from %s: '%.64s'", target->destination, greeting);
+		return EB_ERROR_REMOTE_PROTOCOL;
+	}
+	return EB_SUCCESS;
+}
+
+static void ssh_conn_free(struct ssh_conn *conn)
+{
+	if (conn->fd >= 0) {
+		if (!conn->broken) {
+			pthread_mutex_lock(&conn->write_lock);
+			eb_serve_write_frame(conn->fd, EB_SERVE_BYE, 0, NULL, 0, NULL, 0);
+			pthread_mutex_unlock(&conn->write_lock);
+		}
+		shutdown(conn->fd, SHUT_WR);
+		if (conn->reader_started)
+			pthread_join(conn->reader, NULL);
+		close(conn->fd);
+	}
+	if (conn->pid > 0)
+		waitpid(conn->pid, NULL, 0);
+	pthread_cond_destroy(&conn->cond);
+	pthread_mutex_destroy(&conn->lock);
+	pthread_mutex_destroy(&conn->write_lock);
+	free(conn->id);
+	free(conn);
+}
+
+/* Share the connection to a target, starting ssh when there is none yet */
+static int ssh_conn_get(const struct ssh_target *target, struct ssh_conn **conn_out,
+			char *error, size_t error_size)
+{
+	const char *program = getenv("EB_SSH");
+	size_t id_size = strlen(target->destination) + strlen(target->server) + 600;
+	char *id = malloc(id_size);
+	if (!id)
+		return EB_ERROR_MEMORY;
+	snprintf(id, id_size, "%s\n%s\n%s\n%s\n%s", program ? program : SSH_DEFAULT_PROGRAM,
+		 target->destination, target->port, target->root, target->server);
+
+	pthread_mutex_lock(&ssh_registry_lock);
+	for (struct ssh_conn *conn = ssh_registry; conn; conn = conn->next) {
+		if (strcmp(conn->id, id) != 0)
+			continue;
+		pthread_mutex_lock(&conn->lock);
+		bool usable = !conn->broken;
+		pthread_mutex_unlock(&conn->lock);
+		if (usable) {
+			conn->refs++;
+			pthread_mutex_unlock(&ssh_registry_lock);
+			free(id);
+			*conn_out = conn;
+			return EB_SUCCESS;
+		}
+	}
+
+	struct ssh_conn *conn = calloc(1, sizeof(*conn));
+	if (!conn) {
+		pthread_mutex_unlock(&ssh_registry_lock);
+		free(id);
+		return EB_ERROR_MEMORY;
+	}
+	conn->id = id;
+	conn->fd = -1;
+	conn->refs = 1;
+	conn->next_id = 1;
+	pthread_mutex_init(&conn->write_lock, NULL);
+	pthread_mutex_init(&conn->lock, NULL);
+	pthread_cond_init(&conn->cond, NULL);
+
+	/* Connecting under the registry lock keeps concurrent callers on one ssh */
+	int status = ssh_conn_spawn(conn, target, error, error_size);
+	if (status == EB_SUCCESS) {
+		if (pthread_create(&conn->reader, NULL, ssh_reader_main, conn) == 0) {
+			conn->reader_started = true;
+		} else {
+			snprintf(error, error_size, "Cannot start the ssh reader thread");
+			status = EB_ERROR_RESOURCE_EXHAUSTED;
+		}
+	}
+	if (status != EB_SUCCESS) {
+		conn->broken = true;
+		pthread_mutex_unlock(&ssh_registry_lock);
+		ssh_conn_free(conn);
+		return status;
+	}
+	conn->next = ssh_registry;
+	ssh_registry = conn;
+	pthread_mutex_unlock(&ssh_registry_lock);
+
+	DEBUG_PRINT("Connected to ssh remote %s", target->destination);
+	*conn_out = conn;
+	return EB_SUCCESS;
+}
+
+static void ssh_conn_put(struct ssh_conn *conn)
+{
+	pthread_mutex_lock(&ssh_registry_lock);
+	if (--conn->refs > 0) {
+		pthread_mutex_unlock(&ssh_registry_lock);
+		return;
+	}
+	for (struct ssh_conn **link = &ssh_registry; *link; link = &(*link)->next) {
+		if (*link == conn) {
+			*link = conn->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ssh_registry_lock);
+	ssh_conn_free(conn);
+}
+
+/*
+ * Split ssh://[user@]host[:port]/path and [user@]host:path
+ *
+ * The prefix is the path as remote.c derives object keys from it, with
+ * the query and trailing slashes removed.
+ */
+static int ssh_parse_url(const char *url, struct ssh_target *target)
+{
+	const char *host;
+	const char *path;
+	size_t host_length;
+
+	memset(target, 0, sizeof(*target));
+	if (strncmp(url, "ssh://", 6) == 0) {
+		host = url + 6;
+		host_length = strcspn(host, "/?");
+		path = host + host_length;
+		if (*path == '/')
+			path++;
+		snprintf(target->root, sizeof(target->root), "/");
+	} else {
+		host = url;
+		host_length = strcspn(host, ":");
+		if (host[host_length] != ':')
+			return EB_ERROR_INVALID_URL;
+		path = host + host_length + 1;
+		snprintf(target->root, sizeof(target->root), "%s", *path == '/' ? "/" : ".");
+	}
+	if (host_length == 0 || host_length >= sizeof(target->destination))
+		return EB_ERROR_INVALID_URL;
+	snprintf(target->destination, sizeof(target->destination), "%.*s", (int)host_length, host);
+
+	/* A port only comes with ssh:// URLs, after the user */
+	char *at = strrchr(target->destination, '@');
+	char *colon = strrchr(at ? at : target->destination, ':');
+	if (colon) {
+		snprintf(target->port, sizeof(target->port), "%s", colon + 1);
+		*colon = '\0';
+	}
+	if (!target->destination[0] || target->destination[strlen(target->destination) - 1] == '@')
+		return EB_ERROR_INVALID_URL;
+
+	const char *server = getenv("EB_SSH_SERVER");
+	snprintf(target->server, sizeof(target->server), "%s", server && *server ? server : SSH_DEFAULT_SERVER);
+
+	size_t path_length = strcspn(path, "?");
+	while (path_length > 0 && path[path_length - 1] == '/')
+		path_length--;
+	target->prefix = strndup(path, path_length);
+	return target->prefix ? EB_SUCCESS : EB_ERROR_MEMORY;
+}
+
 static int ssh_connect(eb_transport_t *transport)
 {
-	if (!transport)
+	if (!transport || !transport->url)
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-		 "SSH transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	DEBUG_PRINT("SSH transport not supported");
-	return EB_ERROR_NOT_IMPLEMENTED;
+
+	struct ssh_target target;
+	int status = ssh_parse_url(transport->url, &target);
+	if (status != EB_SUCCESS) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Invalid ssh URL: %s", transport->url);
+		free(target.prefix);
+		return status == EB_ERROR_MEMORY ? status : EB_ERROR_INVALID_URL;
+	}
+
+	struct ssh_data *ssh = calloc(1, sizeof(*ssh));
+	if (!ssh) {
+		free(target.prefix);
+		return EB_ERROR_MEMORY;
+	}
+	status = ssh_conn_get(&target, &ssh->conn, transport->error_msg, sizeof(transport->error_msg));
+	if (status != EB_SUCCESS) {
+		free(target.prefix);
+		free(ssh);
+		return status;
+	}
+	ssh->prefix = target.prefix;
+	transport->data = ssh;
+	return EB_SUCCESS;
 }
 
 static int ssh_disconnect(eb_transport_t *transport)
 {
 	if (!transport)
 		return EB_ERROR_INVALID_PARAMETER;
-	
+
+	struct ssh_data *ssh = transport->data;
+	if (ssh) {
+		ssh_conn_put(ssh->conn);
+		free(ssh->prefix);
+		free(ssh);
+	}
+	transport->data = NULL;
 	return EB_SUCCESS;
 }
 
-static int ssh_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash)
+/* Encode an object and write its PUT to the connection */
+static int ssh_submit_data(eb_transport_t *transport, const void *data, size_t size,
+			   const char *hash, void **request_out)
 {
-	(void)data;  /* Suppress unused parameter warning */
-	(void)size;  /* Suppress unused parameter warning */
-	(void)hash;  /* Suppress unused parameter warning */
-	
-	if (!transport)
+	if (!transport || !transport->data || !data || size == 0 || !request_out)
+		return EB_ERROR_INVALID_PARAMETER;
+	if (!hash || !*hash) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "No hash provided for ssh upload");
 		return EB_ERROR_INVALID_PARAMETER;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-			 "SSH transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	return EB_ERROR_NOT_IMPLEMENTED;
+	}
+
+	struct ssh_data *ssh = transport->data;
+	struct ssh_upload *upload = calloc(1, sizeof(*upload));
+	if (!upload)
+		return EB_ERROR_MEMORY;
+
+	char data_key[1024];
+	eb_remote_object_keys(ssh->prefix, transport->target_path, hash,
+			      upload->set_name, sizeof(upload->set_name), data_key, sizeof(data_key),
+			      upload->metadata_key, sizeof(upload->metadata_key));
+	upload->timestamp = eb_remote_object_time(hash);
+
+	void *payload = NULL;
+	size_t payload_size = 0;
+	int status = eb_remote_object_encode(data, size, transport->data_is_precompressed,
+					     &payload, &payload_size);
+	if (status != EB_SUCCESS) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "Failed to transform data to Parquet format: %d", status);
+		if (payload && payload != data)
+			free(payload);
+		free(upload);
+		return status;
+	}
+
+	pthread_mutex_lock(&ssh->conn->lock);
+	ssh->conn->uploads++;
+	pthread_mutex_unlock(&ssh->conn->lock);
+
+	/* Written before returning, so the payload does not have to outlive the call */
+	status = ssh_call_start(ssh->conn, &upload->call, EB_SERVE_PUT, data_key,
+				payload, payload_size);
+	if (payload != data)
+		free(payload);
+	if (status != EB_SUCCESS) {
+		pthread_mutex_lock(&ssh->conn->lock);
+		ssh->conn->uploads--;
+		pthread_mutex_unlock(&ssh->conn->lock);
+		ssh_call_result(transport, &upload->call, status);
+		free(upload);
+		return status;
+	}
+	upload->size = payload_size;
+	*request_out = upload;
+	DEBUG_INFO("Uploading %zu bytes to %s", payload_size, data_key);
+	return EB_SUCCESS;
 }
 
-static int ssh_receive_data(eb_transport_t *transport, void *buffer, 
-						  size_t size, size_t *received)
+/* Wait for an upload, then store metadata.json if no other upload is in flight */
+static int ssh_wait_data(eb_transport_t *transport, void *request)
 {
-	(void)buffer;  /* Suppress unused parameter warning */
-	(void)size;    /* Suppress unused parameter warning */
-	
-	if (!transport || !received)
+	if (!transport || !transport->data || !request)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct ssh_data *ssh = transport->data;
+	struct ssh_conn *conn = ssh->conn;
+	struct ssh_upload *upload = request;
+	int status = ssh_call_result(transport, &upload->call, ssh_call_wait(conn, &upload->call));
+
+	char metadata_key[1024];
+	char set_name[256];
+	size_t last_size = 0;
+	time_t last_timestamp = 0;
+	bool write_metadata = false;
+
+	pthread_mutex_lock(&conn->lock);
+	if (status == EB_SUCCESS) {
+		conn->metadata_stale = true;
+		snprintf(conn->metadata_key, sizeof(conn->metadata_key), "%s", upload->metadata_key);
+		snprintf(conn->set_name, sizeof(conn->set_name), "%s", upload->set_name);
+		conn->last_size = upload->size;
+		conn->last_timestamp = upload->timestamp;
+	}
+	conn->uploads--;
+	if (conn->uploads == 0 && conn->metadata_stale) {
+		write_metadata = true;
+		conn->metadata_stale = false;
+		snprintf(metadata_key, sizeof(metadata_key), "%s", conn->metadata_key);
+		snprintf(set_name, sizeof(set_name), "%s", conn->set_name);
+		last_size = conn->last_size;
+		last_timestamp = conn->last_timestamp;
+	}
+	pthread_mutex_unlock(&conn->lock);
+	free(upload);
+
+	if (write_metadata) {
+		char *metadata = NULL;
+		struct ssh_call call = {0};
+		int built = eb_remote_metadata_build(set_name, last_size, last_timestamp, &metadata);
+		if (built == EB_SUCCESS)
+			built = ssh_request(transport, &call, EB_SERVE_PUT, metadata_key, metadata, strlen(metadata));
+		free(metadata);
+		if (built != EB_SUCCESS && status == EB_SUCCESS)
+			status = built;
+	}
+	return status;
+}
+
+static int ssh_send_data(eb_transport_t *transport, const void *data, size_t size, const char *hash)
+{
+	void *upload = NULL;
+	int status = ssh_submit_data(transport, data, size, hash, &upload);
+	if (status != EB_SUCCESS)
+		return status;
+	return ssh_wait_data(transport, upload);
+}
+
+static int ssh_receive_stream(eb_transport_t *transport, const eb_transport_range_t *range,
+			      eb_transport_sink_fn sink, void *ctx, size_t *received)
+{
+	if (!transport || !transport->data || !sink || !received)
 		return EB_ERROR_INVALID_PARAMETER;
-	
 	*received = 0;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-		 "SSH transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	return EB_ERROR_NOT_IMPLEMENTED;
+
+	if (!transport->target_path) {
+		snprintf(transport->error_msg, sizeof(transport->error_msg),
+			 "No object selected for download");
+		return EB_ERROR_INVALID_PARAMETER;
+	}
+
+	unsigned char body[17] = {0};
+	if (range) {
+		eb_serve_put_u64(body, range->offset);
+		eb_serve_put_u64(body + 8, range->length);
+		body[16] = range->from_end ? 1 : 0;
+	}
+
+	struct ssh_call call = { .sink = sink, .sink_ctx = ctx };
+	int status = ssh_request(transport, &call, EB_SERVE_GET, transport->target_path, body, sizeof(body));
+	*received = call.received;
+	return status;
+}
+
+struct truncating_sink {
+	char *buffer;
+	size_t size;
+	size_t used;
+};
+
+static int ssh_truncating_sink(void *ctx, const void *data, size_t size)
+{
+	struct truncating_sink *sink = ctx;
+	size_t room = sink->size - sink->used;
+
+	if (size > room) {
+		DEBUG_WARN("ssh_receive_data: buffer capacity exceeded, discarding %zu bytes", size - room);
+		size = room;
+	}
+	memcpy(sink->buffer + sink->used, data, size);
+	sink->used += size;
+	return EB_SUCCESS;
+}
+
+static int ssh_receive_data(eb_transport_t *transport, void *buffer,
+			    size_t size, size_t *received)
+{
+	if (!transport || !buffer || size == 0 || !received)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct truncating_sink sink = { .buffer = buffer, .size = size, .used = 0 };
+	size_t streamed = 0;
+	int status = ssh_receive_stream(transport, NULL, ssh_truncating_sink, &sink, &streamed);
+	*received = sink.used;
+	return status;
+}
+
+static int ssh_put_object(eb_transport_t *transport, const char *key, const void *data, size_t size)
+{
+	if (!transport || !transport->data || !key || (!data && size > 0))
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct ssh_call call = {0};
+	return ssh_request(transport, &call, EB_SERVE_PUT, key, data, size);
+}
+
+/* Newline separated keys of a listing */
+struct ssh_listing {
+	char *data;
+	size_t size;
+	size_t capacity;
+};
+
+static int ssh_listing_sink(void *ctx, const void *data, size_t size)
+{
+	struct ssh_listing *listing = ctx;
+
+	if (listing->size + size + 1 > listing->capacity) {
+		size_t capacity = listing->capacity ? listing->capacity : 4096;
+		while (capacity < listing->size + size + 1)
+			capacity *= 2;
+		char *grown = realloc(listing->data, capacity);
+		if (!grown)
+			return EB_ERROR_MEMORY;
+		listing->data = grown;
+		listing->capacity = capacity;
+	}
+	memcpy(listing->data + listing->size, data, size);
+	listing->size += size;
+	listing->data[listing->size] = '\0';
+	return EB_SUCCESS;
 }
 
 static int ssh_list_refs(eb_transport_t *transport, char ***refs, size_t *count)
 {
-	if (!transport || !refs || !count)
+	if (!transport || !transport->data || !refs || !count)
 		return EB_ERROR_INVALID_PARAMETER;
-	
 	*refs = NULL;
 	*count = 0;
-	
-	snprintf(transport->error_msg, sizeof(transport->error_msg),
-		 "SSH transport is not supported in this build");
-	transport->last_error = EB_ERROR_NOT_IMPLEMENTED;
-	
-	return EB_ERROR_NOT_IMPLEMENTED;
+
+	struct ssh_data *ssh = transport->data;
+	struct ssh_listing listing = { NULL, 0, 0 };
+	struct ssh_call call = { .sink = ssh_listing_sink, .sink_ctx = &listing };
+	int status = ssh_request(transport, &call, EB_SERVE_LIST,
+				 ssh->prefix[0] ? ssh->prefix : "sets", NULL, 0);
+	if (status != EB_SUCCESS || listing.size == 0) {
+		free(listing.data);
+		return status;
+	}
+
+	size_t lines = 0;
+	for (size_t i = 0; i < listing.size; i++)
+		lines += listing.data[i] == '\n';
+	char **keys = calloc(lines + 1, sizeof(char *));
+	if (!keys) {
+		free(listing.data);
+		return EB_ERROR_MEMORY;
+	}
+
+	size_t found = 0;
+	for (char *save = NULL, *line = strtok_r(listing.data, "\n", &save); line;
+	     line = strtok_r(NULL, "\n", &save)) {
+		keys[found] = strdup(line);
+		if (!keys[found]) {
+			status = EB_ERROR_MEMORY;
+			break;
+		}
+		found++;
+	}
+	free(listing.data);
+
+	if (status != EB_SUCCESS) {
+		for (size_t i = 0; i < found; i++)
+			free(keys[i]);
+		free(keys);
+		return status;
+	}
+	*refs = keys;
+	*count = found;
+	return EB_SUCCESS;
+}
+
+static int ssh_delete_refs(eb_transport_t *transport, const char **refs, size_t count)
+{
+	if (!transport || !transport->data || !refs || count == 0)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct ssh_data *ssh = transport->data;
+	struct ssh_call *calls = calloc(SSH_DELETE_WINDOW, sizeof(*calls));
+	if (!calls)
+		return EB_ERROR_MEMORY;
+
+	size_t failed = 0;
+	size_t deleted = 0;
+	int first_error = EB_SUCCESS;
+	size_t next = 0;
+
+	/* Windows of deletes written back to back, then their answers */
+	while (next < count) {
+		int started_status[SSH_DELETE_WINDOW];
+		size_t started = 0;
+		while (started < SSH_DELETE_WINDOW && next < count) {
+			const char *key = refs[next++];
+			if (!key || !*key)
+				continue;
+			memset(&calls[started], 0, sizeof(calls[started]));
+			started_status[started] = ssh_call_start(ssh->conn, &calls[started], EB_SERVE_DELETE,
+								 key, NULL, 0);
+			started++;
+		}
+
+		for (size_t i = 0; i < started; i++) {
+			int result = started_status[i];
+			if (result == EB_SUCCESS)
+				result = ssh_call_wait(ssh->conn, &calls[i]);
+			if (result == EB_SUCCESS || result == EB_ERROR_NOT_FOUND) {
+				deleted++;
+			} else {
+				failed++;
+				if (first_error == EB_SUCCESS)
+					first_error = ssh_call_result(transport, &calls[i], result);
+			}
+		}
+	}
+	free(calls);
+
+	DEBUG_INFO("Deleted %zu objects, %zu failed", deleted, failed);
+	if (failed > 1) {
+		size_t len = strlen(transport->error_msg);
+		snprintf(transport->error_msg + len, sizeof(transport->error_msg) - len,
+			 " (%zu objects failed)", failed);
+	}
+	return first_error;
+}
+
+/*
+ * Point a connected transport at another path of the same server
+ *
+ * The connection only depends on the host and the server command.
+ */
+static int ssh_retarget(eb_transport_t *transport, const char *url)
+{
+	if (!transport || !transport->data || !url)
+		return EB_ERROR_INVALID_PARAMETER;
+
+	struct ssh_data *ssh = transport->data;
+	struct ssh_target current = {0};
+	struct ssh_target target = {0};
+	if (ssh_parse_url(transport->url, &current) != EB_SUCCESS ||
+	    ssh_parse_url(url, &target) != EB_SUCCESS) {
+		free(current.prefix);
+		free(target.prefix);
+		return EB_ERROR_UNSUPPORTED;
+	}
+	bool same = strcmp(current.destination, target.destination) == 0 &&
+		    strcmp(current.port, target.port) == 0 &&
+		    strcmp(current.root, target.root) == 0 &&
+		    strcmp(current.server, target.server) == 0;
+	free(current.prefix);
+
+	pthread_mutex_lock(&ssh->conn->lock);
+	bool broken = ssh->conn->broken;
+	pthread_mutex_unlock(&ssh->conn->lock);
+	if (!same || broken) {
+		free(target.prefix);
+		return EB_ERROR_UNSUPPORTED;
+	}
+	free(ssh->prefix);
+	ssh->prefix = target.prefix;
+	DEBUG_PRINT("Retargeted ssh transport to %s prefix '%s'", target.destination, ssh->prefix);
+	return EB_SUCCESS;
 }
 
 /* SSH transport operations structure */
@@ -100,12 +939,18 @@ struct transport_ops ssh_ops = {
 	.disconnect = ssh_disconnect,
 	.send_data = ssh_send_data,
 	.receive_data = ssh_receive_data,
-	.list_refs = ssh_list_refs
+	.list_refs = ssh_list_refs,
+	.delete_refs = ssh_delete_refs,
+	.retarget = ssh_retarget,
+	.submit_data = ssh_submit_data,
+	.wait_data = ssh_wait_data,
+	.receive_stream = ssh_receive_stream,
+	.put_object = ssh_put_object
 };
 
 /* SSH transport initialization */
 int ssh_transport_init(void)
 {
-	DEBUG_PRINT("SSH transport module initialized (stub implementation)");
+	DEBUG_PRINT("SSH transport module initialized");
 	return EB_SUCCESS;
-} 
\ No newline at end of file
+}
@@ -18,9 +18,26 @@ eb_status_t eb_decompress_zstd(const void *source, size_t source_size, void **de
 // Magic numbers for binary format
 #define EB_MAGIC_VECTOR 0x53564245  // "EBVS"
 #define EB_MAGIC_META  0x4D564245   // "EBVM"
+#define EB_VECTOR_MAGIC 0x4542564D  // Object header magic in .raw files
 
 // Object flags
 #define EB_FLAG_COMPRESSED 0x01  // Object is compressed with ZSTD
+#define EB_FLAG_SHUFFLED   0x02  // Float32 bytes were shuffled into planes before compression
+#define EB_FLAG_NORM       0x04  // A float32 L2 norm of the values follows the stored payload
+#define EB_FLAG_NORMALIZED 0x08  // The values have unit L2 norm
+
+#define EB_FLAG_DELTA      0x80000000u  // The payload is an XOR residual against a base object (object_delta.h)
+
+// Compressed vectors keep the ID of their ZSTD dictionary in flag bits 8-30, 0 for none
+#define EB_FLAG_DICT_SHIFT 8
+#define EB_FLAG_DICT_MASK  0x7FFFFF00u
+#define EB_FLAG_DICT_ID(flags) (((flags) & EB_FLAG_DICT_MASK) >> EB_FLAG_DICT_SHIFT)
+#define EB_DICT_ID_MAX     (EB_FLAG_DICT_MASK >> EB_FLAG_DICT_SHIFT)
+
+// Vectors stored in a reduced dtype keep the eb_dtype_t in bits 4-7, 0 (EB_FLOAT32) for none
+#define EB_FLAG_DTYPE_SHIFT 4
+#define EB_FLAG_DTYPE_MASK  0xF0u
+#define EB_FLAG_DTYPE(flags) ((eb_dtype_t)(((flags) & EB_FLAG_DTYPE_MASK) >> EB_FLAG_DTYPE_SHIFT))
 
 // START OF SET THE VERSION HERE
 // Version components
@@ -48,7 +65,10 @@ typedef enum {
     EB_FLOAT32,
     EB_FLOAT64,
     EB_INT32,
-    EB_INT64
+    EB_INT64,
+    EB_FLOAT16,     // IEEE 754 half precision
+    EB_BFLOAT16,    // Upper 16 bits of a float32
+    EB_INT8         // Signed bytes behind a float32 scale (see quantize.h)
 } eb_dtype_t;
 
 // Compact binary metadata header
@@ -77,6 +97,7 @@ typedef struct {
     float* values;           // Array of embedding values
     size_t dimensions;       // Number of dimensions
     bool normalize;          // Whether to normalize the embedding
+    float norm;              // Cached L2 norm of values, negative if not known
 } eb_embedding_t;
 
 // Storage types - now optimized for binary storage
@@ -87,14 +108,19 @@ typedef struct eb_metadata {
     struct eb_metadata* next;
 } eb_metadata_t;
 
+struct eb_meta_blob;
+struct eb_arena;
+
 typedef struct eb_stored_vector {
     uint64_t id;                    // Vector ID
     eb_embedding_t* embedding;      // Vector data
-    eb_metadata_t* metadata;        // Linked list of metadata
+    eb_metadata_t* metadata;        // Linked list of metadata (a view of meta if that is set)
     char* model_version;            // Model version string
     uint64_t timestamp;            // Storage timestamp
     uint64_t parent_id;            // ID of parent vector (0 if none)
     struct eb_stored_vector* next;  // Next version in chain
+    const struct eb_meta_blob* meta; // Flat metadata (metadata.h), NULL if not kept flat
+    struct eb_arena* arena;         // Arena holding the strings of a query result, or NULL
 } eb_stored_vector_t;
 
 typedef struct {
@@ -139,7 +165,8 @@ void eb_destroy_embedding(eb_embedding_t* embedding);
 eb_status_t eb_metadata_create(const char* key, const char* value, eb_metadata_t** out);
 void eb_metadata_destroy(eb_metadata_t* metadata);
 
-// Comparison functions
+// Comparison functions (k-NN preservation over whole sets is in neighborhood.h,
+// many-to-many similarity in similarity.h)
 eb_status_t eb_compare_embeddings(
     const eb_embedding_t* embedding_a,
     const eb_embedding_t* embedding_b,
@@ -185,13 +212,6 @@ eb_status_t eb_compute_euclidean_distance(
     float* result
 );
 
-eb_status_t eb_compute_neighborhood_preservation(
-    const eb_embedding_t* old_vectors,
-    const eb_embedding_t* new_vectors,
-    size_t k,
-    float* out
-);
-
 /*
  * PHASE 2+ Operations (Currently Disabled)
  * Complex version control operations to be re-enabled later
@@ -271,6 +291,29 @@ typedef struct {
     uint8_t hash[32];
 } eb_object_header_t;
 
+/* Hash object IDs are computed with, fixed per repository at init */
+typedef enum {
+    EB_HASH_SHA256 = 0,
+    EB_HASH_BLAKE3 = 1
+} eb_hash_algo_t;
+
+#define EB_HASH_ALGO_MAX EB_HASH_BLAKE3
+
+/*
+ * The top byte of an object header's version is the eb_hash_algo_t its ID
+ * was computed with. SHA-256 objects keep the bare version, so they read
+ * as before, and older readers refuse objects hashed with anything else.
+ */
+#define EB_VERSION_HASH_SHIFT 24
+#define EB_VERSION_HASH_MASK 0xFF000000u
+#define EB_OBJECT_VERSION(algo) ((uint32_t)EB_VERSION | ((uint32_t)(algo) << EB_VERSION_HASH_SHIFT))
+#define EB_VERSION_HASH(v) ((eb_hash_algo_t)(((v) & EB_VERSION_HASH_MASK) >> EB_VERSION_HASH_SHIFT))
+
+static inline bool eb_object_version_valid(uint32_t version) {
+    return (version & ~EB_VERSION_HASH_MASK) <= EB_VERSION &&
+           EB_VERSION_HASH(version) <= EB_HASH_ALGO_MAX;
+}
+
 /**
  * Remote repository configuration
  */
@@ -28,6 +28,7 @@ eb_status_t eb_vector_create(void* data, size_t dimensions, eb_embedding_t** out
     memcpy(vector->values, data, dimensions * sizeof(float));
     vector->dimensions = dimensions;
     vector->normalize = false;
+    vector->norm = -1.0f;
 
     *out = vector;
     return EB_SUCCESS;
@@ -0,0 +1,81 @@
+/*
+ * EmbeddingBridge - Test Repository Fixture
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "repo_fixture.h"
+
+static char start_dir[PATH_MAX];
+static char root[PATH_MAX];
+
+static const char* const REPO_DIRS[] = {
+    ".embr",
+    ".embr/objects",
+    ".embr/objects/temp",
+    ".embr/sets",
+    ".embr/sets/main",
+    ".embr/sets/main/refs",
+    ".embr/sets/main/refs/models",
+    ".embr/metadata",
+    ".embr/metadata/files",
+    ".embr/metadata/models",
+    ".embr/metadata/versions",
+};
+
+static void write_file(const char* path, const char* contents) {
+    FILE* f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(contents, f);
+    fclose(f);
+}
+
+void fixture_dir(void) {
+    if (root[0] != '\0')
+        fixture_cleanup();
+    const char* tmp = getenv("TMPDIR");
+    snprintf(root, sizeof(root), "%s/embr-test-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    assert(mkdtemp(root) != NULL);
+
+    assert(getcwd(start_dir, sizeof(start_dir)) != NULL);
+    assert(chdir(root) == 0);
+}
+
+void fixture_repo(const char* config) {
+    fixture_dir();
+    for (size_t i = 0; i < sizeof(REPO_DIRS) / sizeof(REPO_DIRS[0]); i++)
+        assert(mkdir(REPO_DIRS[i], 0755) == 0);
+
+    write_file(".embr/HEAD", "main\n");
+    if (config)
+        write_file(".embr/config", config);
+}
+
+const char* fixture_root(void) {
+    return root;
+}
+
+const char* fixture_start_dir(void) {
+    return start_dir;
+}
+
+void fixture_cleanup(void) {
+    assert(root[0] != '\0');
+    assert(chdir(start_dir) == 0);
+
+    char command[PATH_MAX + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", root);
+    system(command);
+    root[0] = '\0';
+}
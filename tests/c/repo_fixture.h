@@ -0,0 +1,42 @@
+/*
+ * EmbeddingBridge - Test Repository Fixture
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef EB_TEST_REPO_FIXTURE_H
+#define EB_TEST_REPO_FIXTURE_H
+
+/*
+ * Tests run in a fresh directory made with mkdtemp() under $TMPDIR (/tmp
+ * by default), never inside the checkout. Only one fixture is set up at
+ * a time: setting up another removes the current one first, and
+ * fixture_cleanup() changes back to the directory the test was started
+ * in and removes everything below the fixture.
+ */
+
+/* Make an empty directory and change into it */
+void fixture_dir(void);
+
+/**
+ * Make a repository laid out like embr init, on set main, and change
+ * into it
+ *
+ * @param config Contents of .embr/config, NULL for none
+ */
+void fixture_repo(const char* config);
+
+/* Absolute path of the current fixture */
+const char* fixture_root(void);
+
+/* Directory the test was started in */
+const char* fixture_start_dir(void);
+
+/* Change back and remove the fixture */
+void fixture_cleanup(void);
+
+#endif /* EB_TEST_REPO_FIXTURE_H */
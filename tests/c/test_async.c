@@ -0,0 +1,210 @@
+/*
+ * EmbeddingBridge - Asynchronous Operation Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "async.h"
+#include "set_index.h"
+#include "repo_fixture.h"
+
+#define VECTORS 16
+#define DIMS 8
+
+static eb_store_t* open_store(void) {
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    return store;
+}
+
+typedef struct {
+    float values[DIMS];
+    eb_embedding_t embedding;
+    eb_metadata_t source;
+    char name[32];
+} vector_t;
+
+static void make_vector(vector_t* v, int i) {
+    for (int k = 0; k < DIMS; k++)
+        v->values[k] = (float)(i * DIMS + k);
+    v->embedding = (eb_embedding_t){ v->values, DIMS, false, -1.0f };
+    snprintf(v->name, sizeof(v->name), "doc-%d.txt", i);
+    v->source = (eb_metadata_t){ .key = "source", .value = v->name, .next = NULL };
+}
+
+static int count_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    (void)model;
+    (void)hash;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static pthread_mutex_t count_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void count_done(eb_future_t* future, eb_status_t status, void* ctx) {
+    (void)future;
+    assert(status == EB_SUCCESS);
+    pthread_mutex_lock(&count_lock);
+    (*(int*)ctx)++;
+    pthread_mutex_unlock(&count_lock);
+}
+
+static void test_store_vectors(void) {
+    printf("Testing asynchronous stores...\n");
+
+    fixture_repo(NULL);
+    eb_store_t* store = open_store();
+    eb_async_t* async = NULL;
+    assert(eb_async_create(4, 4, &async) == EB_SUCCESS);
+
+    static vector_t vectors[VECTORS];
+    eb_future_t* futures[VECTORS];
+    int completed = 0;
+    for (int i = 0; i < VECTORS; i++) {
+        make_vector(&vectors[i], i);
+        assert(eb_store_vector_async(async, store, &vectors[i].embedding, &vectors[i].source,
+                                     "openai", count_done, &completed, &futures[i]) == EB_SUCCESS);
+    }
+    for (int i = 0; i < VECTORS; i++) {
+        assert(eb_future_wait(futures[i]) == EB_SUCCESS);
+        assert(eb_future_done(futures[i]));
+        assert(eb_future_vector_id(futures[i]) != 0);
+        assert(eb_future_cancel(futures[i]) == EB_ERROR_INVALID_STATE);
+        eb_future_free(futures[i]);
+    }
+    assert(completed == VECTORS);
+    eb_async_destroy(async);
+
+    /* Stores running one at a time kept every index update */
+    eb_set_index_t* index = NULL;
+    int entries = 0;
+    assert(eb_set_index_open_current(".", &index) == EB_SUCCESS);
+    assert(eb_set_index_foreach(index, NULL, count_entry, &entries) == EB_SUCCESS);
+    eb_set_index_close(index);
+    assert(entries == VECTORS);
+
+    eb_store_destroy(store);
+    fixture_cleanup();
+
+    printf("✓ Asynchronous stores passed\n");
+}
+
+/* Holds the only worker in the callback of the first store until opened */
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static bool gate_entered = false;
+static bool gate_open = false;
+
+static void hold_worker(eb_future_t* future, eb_status_t status, void* ctx) {
+    (void)future;
+    (void)status;
+    (void)ctx;
+    pthread_mutex_lock(&gate_lock);
+    gate_entered = true;
+    pthread_cond_broadcast(&gate_cond);
+    while (!gate_open)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+}
+
+static void record_status(eb_future_t* future, eb_status_t status, void* ctx) {
+    (void)future;
+    *(eb_status_t*)ctx = status;
+}
+
+typedef struct {
+    eb_async_t* async;
+    eb_store_t* store;
+    vector_t* vector;
+    eb_future_t* future;
+    bool submitted;
+} submitter_t;
+
+static void* submit_blocked(void* arg) {
+    submitter_t* s = arg;
+    assert(eb_store_vector_async(s->async, s->store, &s->vector->embedding, &s->vector->source,
+                                 "openai", NULL, NULL, &s->future) == EB_SUCCESS);
+    pthread_mutex_lock(&count_lock);
+    s->submitted = true;
+    pthread_mutex_unlock(&count_lock);
+    return NULL;
+}
+
+static void test_cancel_and_backpressure(void) {
+    printf("Testing cancellation and backpressure...\n");
+
+    fixture_repo(NULL);
+    eb_store_t* store = open_store();
+    eb_async_t* async = NULL;
+    assert(eb_async_create(1, 1, &async) == EB_SUCCESS);
+
+    static vector_t vectors[3];
+    for (int i = 0; i < 3; i++)
+        make_vector(&vectors[i], i);
+
+    eb_future_t* running = NULL;
+    assert(eb_store_vector_async(async, store, &vectors[0].embedding, &vectors[0].source,
+                                 "openai", hold_worker, NULL, &running) == EB_SUCCESS);
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_entered)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+
+    /* The worker is busy: one store waits, the next submission blocks */
+    eb_status_t cancelled_status = EB_SUCCESS;
+    eb_future_t* queued = NULL;
+    assert(eb_store_vector_async(async, store, &vectors[1].embedding, &vectors[1].source,
+                                 "openai", record_status, &cancelled_status, &queued) == EB_SUCCESS);
+    submitter_t submitter = { async, store, &vectors[2], NULL, false };
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, submit_blocked, &submitter) == 0);
+    usleep(50 * 1000);
+    pthread_mutex_lock(&count_lock);
+    assert(!submitter.submitted);
+    pthread_mutex_unlock(&count_lock);
+
+    /* Cancelling the waiting store frees its slot */
+    assert(eb_future_cancel(running) == EB_ERROR_INVALID_STATE);
+    assert(eb_future_cancel(queued) == EB_SUCCESS);
+    assert(cancelled_status == EB_ERROR_INTERRUPTED);
+    assert(eb_future_wait(queued) == EB_ERROR_INTERRUPTED);
+    assert(eb_future_vector_id(queued) == 0);
+    assert(pthread_join(thread, NULL) == 0);
+    assert(submitter.submitted);
+
+    pthread_mutex_lock(&gate_lock);
+    gate_open = true;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+    assert(eb_future_wait(running) == EB_SUCCESS);
+    assert(eb_future_wait(submitter.future) == EB_SUCCESS);
+
+    eb_future_free(running);
+    eb_future_free(queued);
+    eb_future_free(submitter.future);
+    eb_async_destroy(async);
+    eb_store_destroy(store);
+    fixture_cleanup();
+
+    printf("✓ Cancellation and backpressure passed\n");
+}
+
+int main(void) {
+    printf("Running async tests...\n");
+    test_store_vectors();
+    test_cancel_and_backpressure();
+    printf("All async tests passed!\n");
+    return 0;
+}
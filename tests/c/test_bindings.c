@@ -0,0 +1,101 @@
+/*
+ * EmbeddingBridge - Language Binding Entry Point Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "bindings.h"
+#include "repo_fixture.h"
+
+#define ROWS 5
+#define DIMS 6
+
+static void test_matrix_round_trip(void) {
+    printf("Testing matrix store and fetch...\n");
+
+    fixture_repo(NULL);
+    eb_store_t* store = NULL;
+    assert(embr_store_init(".", &store) == EB_SUCCESS);
+
+    float values[ROWS * DIMS];
+    for (int i = 0; i < ROWS * DIMS; i++)
+        values[i] = (float)i * 0.25f;
+    const char* sources[ROWS] = { "a.txt", "b.txt", "c.txt", "d.txt", "e.txt" };
+    char hashes[ROWS * EMBR_HASH_SLOT];
+    assert(embr_store_matrix(store, values, ROWS, DIMS, sources, "openai", hashes) == EB_SUCCESS);
+
+    /* Fetch in another order, one by prefix */
+    const char* wanted[ROWS];
+    char prefix[13];
+    memcpy(prefix, &hashes[1 * EMBR_HASH_SLOT], 12);
+    prefix[12] = '\0';
+    for (int i = 0; i < ROWS; i++)
+        wanted[i] = &hashes[(ROWS - 1 - i) * EMBR_HASH_SLOT];
+    wanted[ROWS - 2] = prefix;
+
+    size_t dims = 0;
+    assert(embr_vector_dims(store, wanted[0], &dims) == EB_SUCCESS);
+    assert(dims == DIMS);
+
+    float out[ROWS * DIMS];
+    assert(embr_get_many(store, wanted, ROWS, DIMS, out) == EB_SUCCESS);
+    for (int i = 0; i < ROWS; i++)
+        assert(memcmp(&out[i * DIMS], &values[(ROWS - 1 - i) * DIMS], DIMS * sizeof(float)) == 0);
+
+    /* A matrix of the wrong width is refused */
+    assert(embr_get_many(store, wanted, 1, DIMS - 1, out) == EB_ERROR_DIMENSION_MISMATCH);
+
+    embr_store_destroy(store);
+    fixture_cleanup();
+
+    printf("✓ Matrix store and fetch passed\n");
+}
+
+static void test_store_file(void) {
+    printf("Testing file store...\n");
+
+    fixture_repo(NULL);
+    float values[DIMS] = { 1, 2, 3, 4, 5, 6 };
+    FILE* f = fopen("vector.bin", "wb");
+    assert(f != NULL);
+    assert(fwrite(values, sizeof(float), DIMS, f) == DIMS);
+    fclose(f);
+
+    eb_store_t* store = NULL;
+    assert(embr_store_init(".", &store) == EB_SUCCESS);
+    char hash[EMBR_HASH_SLOT];
+    assert(embr_store_file(store, "vector.bin", "doc.txt", NULL, hash) == EB_SUCCESS);
+    assert(strlen(hash) == 64);
+
+    const char* hashes[1] = { hash };
+    float out[DIMS];
+    assert(embr_get_many(store, hashes, 1, DIMS, out) == EB_SUCCESS);
+    assert(memcmp(out, values, sizeof(values)) == 0);
+
+    const char* missing[1] = { "ffffffffffff" };
+    size_t dims;
+    assert(embr_vector_dims(store, missing[0], &dims) != EB_SUCCESS);
+    assert(embr_get_many(store, missing, 1, DIMS, out) != EB_SUCCESS);
+
+    embr_store_destroy(store);
+    fixture_cleanup();
+
+    printf("✓ File store passed\n");
+}
+
+int main(void) {
+    printf("Running binding tests...\n");
+    test_matrix_round_trip();
+    test_store_file();
+    printf("All binding tests passed!\n");
+    return 0;
+}
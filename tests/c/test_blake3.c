@@ -0,0 +1,112 @@
+/*
+ * EmbeddingBridge - BLAKE3 Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "blake3.h"
+
+/* Vectors of the BLAKE3 reference test suite, over the bytes i % 251 */
+static const struct {
+    size_t len;
+    const char* hex;
+} vectors[] = {
+    { 0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262" },
+    { 1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213" },
+    { 1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11" },
+    { 1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7" },
+    { 1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444" },
+    { 2048, "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a" },
+    { 2049, "5f4d72f40d7a5f82b15ca2b2e44b1de3c2ef86c426c95c1af0b6879522563030" },
+    { 3072, "b98cb0ff3623be03326b373de6b9095218513e64f1ee2edd2525c7ad1e5cffd2" },
+    { 3073, "7124b49501012f81cc7f11ca069ec9226cecb8a2c850cfe644e327d22d3e1cd3" },
+    { 4096, "015094013f57a5277b59d8475c0501042c0b642e531b0a1c8f58d2163229e969" },
+    { 4097, "9b4052b38f1c5fc8b1f9ff7ac7b27cd242487b3d890d15c96a1c25b8aa0fb995" },
+    { 5120, "9cadc15fed8b5d854562b26a9536d9707cadeda9b143978f319ab34230535833" },
+    { 8192, "aae792484c8efe4f19e2ca7d371d8c467ffb10748d8a5a1ae579948f718a2a63" },
+    { 102400, "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085" },
+};
+
+static void to_hex(const uint8_t hash[EB_BLAKE3_OUT_LEN], char hex[65]) {
+    for (int i = 0; i < EB_BLAKE3_OUT_LEN; i++)
+        sprintf(hex + i * 2, "%02x", hash[i]);
+}
+
+static uint8_t* pattern(size_t len) {
+    uint8_t* data = malloc(len ? len : 1);
+    assert(data != NULL);
+    for (size_t i = 0; i < len; i++)
+        data[i] = (uint8_t)(i % 251);
+    return data;
+}
+
+static void test_vectors(void) {
+    printf("Testing BLAKE3 vectors...\n");
+    for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        uint8_t* data = pattern(vectors[v].len);
+        uint8_t hash[EB_BLAKE3_OUT_LEN];
+        char hex[65];
+
+        eb_blake3(data, vectors[v].len, hash);
+        to_hex(hash, hex);
+        if (strcmp(hex, vectors[v].hex) != 0)
+            fprintf(stderr, "length %zu: %s\n", vectors[v].len, hex);
+        assert(strcmp(hex, vectors[v].hex) == 0);
+
+        eb_blake3_t hasher;
+        eb_blake3_init(&hasher);
+        eb_blake3_update(&hasher, data, vectors[v].len);
+        eb_blake3_final(&hasher, hash);
+        to_hex(hash, hex);
+        assert(strcmp(hex, vectors[v].hex) == 0);
+        free(data);
+    }
+
+    uint8_t hash[EB_BLAKE3_OUT_LEN];
+    char hex[65];
+    eb_blake3("abc", 3, hash);
+    to_hex(hash, hex);
+    assert(strcmp(hex, "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85") == 0);
+    printf("✓ BLAKE3 vectors passed\n");
+}
+
+/* Multi-threaded tree hashing and uneven incremental updates agree */
+static void test_large(void) {
+    printf("Testing large inputs...\n");
+    const size_t sizes[] = { (size_t)1 << 20, ((size_t)3 << 20) + 12345, EB_BLAKE3_PARALLEL_MIN + 1 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint8_t* data = pattern(sizes[s]);
+        uint8_t tree[EB_BLAKE3_OUT_LEN], streamed[EB_BLAKE3_OUT_LEN];
+        eb_blake3(data, sizes[s], tree);
+
+        eb_blake3_t hasher;
+        eb_blake3_init(&hasher);
+        size_t pos = 0, step = 1;
+        while (pos < sizes[s]) {
+            size_t take = step < sizes[s] - pos ? step : sizes[s] - pos;
+            eb_blake3_update(&hasher, data + pos, take);
+            pos += take;
+            step = step * 7 % 20011 + 1;
+        }
+        eb_blake3_final(&hasher, streamed);
+        assert(memcmp(tree, streamed, EB_BLAKE3_OUT_LEN) == 0);
+        free(data);
+    }
+    printf("✓ Large inputs passed\n");
+}
+
+int main(void) {
+    printf("Running BLAKE3 tests...\n");
+    test_vectors();
+    test_large();
+    printf("All BLAKE3 tests passed!\n");
+    return 0;
+}
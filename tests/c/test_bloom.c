@@ -0,0 +1,169 @@
+/*
+ * EmbeddingBridge - Object Bloom Filter Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "bloom.h"
+#include "store.h"
+#include "object_path.h"
+#include "hash_utils.h"
+#include "repo_fixture.h"
+
+#define FILTER_PATH ".embr/" EB_BLOOM_FILE
+
+/* A uniform 32-byte key, as object hashes are */
+static void make_key(uint64_t n, uint8_t key[32]) {
+    uint64_t x = n * 0x9E3779B97F4A7C15ULL + 1;
+    for (int i = 0; i < 4; i++) {
+        x ^= x >> 31;
+        x *= 0xBF58476D1CE4E5B9ULL;
+        x ^= x >> 29;
+        memcpy(key + i * 8, &x, 8);
+    }
+}
+
+static void test_filter(void) {
+    printf("Testing bloom filter...\n");
+
+    eb_bloom_t* bloom = NULL;
+    assert(eb_bloom_create(0, &bloom) == EB_SUCCESS);
+    uint8_t key[32];
+    for (uint64_t i = 0; i < EB_BLOOM_MIN_CAPACITY; i++) {
+        make_key(i, key);
+        eb_bloom_add(bloom, key);
+    }
+    assert(eb_bloom_count(bloom) > EB_BLOOM_MIN_CAPACITY * 99 / 100);
+
+    /* No false misses, and about 1% false hits at capacity */
+    size_t false_hits = 0;
+    for (uint64_t i = 0; i < EB_BLOOM_MIN_CAPACITY; i++) {
+        make_key(i, key);
+        assert(eb_bloom_maybe(bloom, key));
+        make_key(i + ((uint64_t)1 << 32), key);
+        false_hits += eb_bloom_maybe(bloom, key);
+    }
+    assert(false_hits < EB_BLOOM_MIN_CAPACITY / 50);
+
+    /* Adding a key twice is counted once */
+    uint64_t count = eb_bloom_count(bloom);
+    make_key(7, key);
+    eb_bloom_add(bloom, key);
+    assert(eb_bloom_count(bloom) == count);
+    eb_bloom_free(bloom);
+    printf("✓ Bloom filter passed\n");
+}
+
+static void test_save_merge(void) {
+    printf("Testing saved filters...\n");
+    fixture_repo(NULL);
+
+    eb_bloom_t* a = NULL;
+    eb_bloom_t* b = NULL;
+    uint8_t key[32];
+    assert(eb_bloom_create(1000, &a) == EB_SUCCESS && eb_bloom_create(1000, &b) == EB_SUCCESS);
+    make_key(1, key);
+    eb_bloom_add(a, key);
+    make_key(2, key);
+    eb_bloom_add(b, key);
+
+    /* A save keeps what another writer saved before it */
+    assert(eb_bloom_save(a, "filter") == EB_SUCCESS);
+    assert(eb_bloom_save(b, "filter") == EB_SUCCESS);
+    eb_bloom_t* loaded = NULL;
+    assert(eb_bloom_load("filter", &loaded) == EB_SUCCESS);
+    make_key(1, key);
+    assert(eb_bloom_maybe(loaded, key));
+    make_key(2, key);
+    assert(eb_bloom_maybe(loaded, key));
+    eb_bloom_free(loaded);
+    eb_bloom_free(a);
+    eb_bloom_free(b);
+
+    /* Damaged and missing files */
+    assert(truncate("filter", 100) == 0);
+    assert(eb_bloom_load("filter", &loaded) == EB_ERROR_INVALID_FORMAT && loaded == NULL);
+    assert(eb_bloom_load("missing", &loaded) == EB_ERROR_NOT_FOUND);
+
+    fixture_cleanup();
+    printf("✓ Saved filters passed\n");
+}
+
+static void store_values(const char* source, float seed, char hash[65]) {
+    float values[16];
+    for (int i = 0; i < 16; i++)
+        values[i] = seed + (float)i;
+    const char* sources[1] = { source };
+    char hashes[1][65];
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, 1, 16, sources, "m", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+    memcpy(hash, hashes[0], 65);
+}
+
+static bool filter_has(const char* hex) {
+    eb_bloom_t* bloom = NULL;
+    uint8_t hash[32];
+    assert(eb_bloom_load(FILTER_PATH, &bloom) == EB_SUCCESS);
+    assert(eb_hex_to_hash(hex, hash));
+    bool maybe = eb_bloom_maybe(bloom, hash);
+    eb_bloom_free(bloom);
+    return maybe;
+}
+
+static void test_store(void) {
+    printf("Testing the store's object filter...\n");
+    fixture_repo(NULL);
+
+    char first[65], second[65], again[65];
+    store_values("a.txt", 1.0f, first);
+    assert(access(FILTER_PATH, F_OK) == 0 && filter_has(first));
+
+    /* An object the filter missed is kept, not replaced */
+    store_values("b.txt", 2.0f, second);
+    char path[PATH_MAX], copy[PATH_MAX];
+    assert(eb_object_path(".", second, "raw", path, sizeof(path)) == 0);
+    snprintf(copy, sizeof(copy), "%s.keep", path);
+    assert(rename(path, copy) == 0);
+    assert(unlink(FILTER_PATH) == 0);
+    store_values("c.txt", 3.0f, again);     /* Rebuilds the filter without b */
+    assert(!filter_has(second) && filter_has(first));
+    assert(rename(copy, path) == 0);
+    struct stat before, after;
+    assert(stat(path, &before) == 0);
+    store_values("b.txt", 2.0f, again);
+    assert(strcmp(again, second) == 0);
+    assert(stat(path, &after) == 0 && after.st_ino == before.st_ino);
+    assert(filter_has(second));
+
+    /* A rebuild finds loose objects */
+    assert(unlink(FILTER_PATH) == 0);
+    eb_bloom_t* bloom = NULL;
+    assert(eb_bloom_open_objects(".", NULL, &bloom) == EB_SUCCESS);
+    assert(eb_bloom_count(bloom) == 3);
+    eb_bloom_free(bloom);
+
+    fixture_cleanup();
+    printf("✓ Store object filter passed\n");
+}
+
+int main(void) {
+    printf("Running bloom filter tests...\n");
+    test_filter();
+    test_save_merge();
+    test_store();
+    printf("All bloom filter tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * EmbeddingBridge - Content-Defined Chunking Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "chunk.h"
+
+#define PAYLOAD_SIZE (24 * 1024 * 1024)
+
+/* Deterministic incompressible bytes */
+static unsigned char* make_payload(size_t size, uint64_t seed) {
+    unsigned char* data = malloc(size);
+    assert(data);
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[i] = (unsigned char)(seed >> 56);
+    }
+    return data;
+}
+
+static size_t count_shared(const eb_chunk_t* a, size_t a_count, const eb_chunk_t* b, size_t b_count) {
+    size_t shared = 0;
+    for (size_t i = 0; i < a_count; i++) {
+        for (size_t j = 0; j < b_count; j++) {
+            if (strcmp(a[i].hash, b[j].hash) == 0) {
+                shared++;
+                break;
+            }
+        }
+    }
+    return shared;
+}
+
+static void test_split_bounds(void) {
+    printf("Testing chunk boundaries...\n");
+    unsigned char* data = make_payload(PAYLOAD_SIZE, 1);
+    eb_chunk_t* chunks = NULL;
+    size_t count = 0;
+    assert(eb_chunk_split(data, PAYLOAD_SIZE, &chunks, &count) == EB_SUCCESS);
+    assert(count > PAYLOAD_SIZE / EB_CHUNK_MAX_SIZE);
+
+    uint64_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        assert(chunks[i].offset == offset);
+        assert(chunks[i].length <= EB_CHUNK_MAX_SIZE);
+        assert(i == count - 1 || chunks[i].length >= EB_CHUNK_MIN_SIZE);
+        char hash[65];
+        assert(eb_chunk_hash(data + offset, chunks[i].length, hash) == EB_SUCCESS);
+        assert(strcmp(hash, chunks[i].hash) == 0);
+        offset += chunks[i].length;
+    }
+    assert(offset == PAYLOAD_SIZE);
+
+    /* Small payloads are a single chunk, empty ones none */
+    eb_chunk_t* small = NULL;
+    size_t small_count = 0;
+    assert(eb_chunk_split(data, 1000, &small, &small_count) == EB_SUCCESS);
+    assert(small_count == 1 && small[0].length == 1000);
+    free(small);
+    assert(eb_chunk_split(data, 0, &small, &small_count) == EB_SUCCESS);
+    assert(small_count == 0);
+    free(small);
+
+    free(chunks);
+    free(data);
+    printf("Chunk boundary tests passed!\n");
+}
+
+static void test_split_shift(void) {
+    printf("Testing chunks after an insertion...\n");
+    unsigned char* data = make_payload(PAYLOAD_SIZE, 2);
+    unsigned char* shifted = malloc(PAYLOAD_SIZE + 100);
+    assert(shifted);
+    memcpy(shifted, data, PAYLOAD_SIZE / 2);
+    memset(shifted + PAYLOAD_SIZE / 2, 0x5a, 100);
+    memcpy(shifted + PAYLOAD_SIZE / 2 + 100, data + PAYLOAD_SIZE / 2, PAYLOAD_SIZE - PAYLOAD_SIZE / 2);
+
+    eb_chunk_t *a = NULL, *b = NULL;
+    size_t a_count = 0, b_count = 0;
+    assert(eb_chunk_split(data, PAYLOAD_SIZE, &a, &a_count) == EB_SUCCESS);
+    assert(eb_chunk_split(shifted, PAYLOAD_SIZE + 100, &b, &b_count) == EB_SUCCESS);
+
+    /* Only the chunks around the insertion change */
+    assert(count_shared(a, a_count, b, b_count) + 2 >= a_count);
+
+    char digest_a[65], digest_b[65], digest_again[65];
+    assert(eb_chunk_digest(a, a_count, digest_a) == EB_SUCCESS);
+    assert(eb_chunk_digest(b, b_count, digest_b) == EB_SUCCESS);
+    assert(eb_chunk_digest(a, a_count, digest_again) == EB_SUCCESS);
+    assert(strcmp(digest_a, digest_again) == 0 && strcmp(digest_a, digest_b) != 0);
+
+    free(a);
+    free(b);
+    free(shifted);
+    free(data);
+    printf("Chunk insertion tests passed!\n");
+}
+
+static void test_list_round_trip(void) {
+    printf("Testing chunk lists...\n");
+    unsigned char* data = make_payload(PAYLOAD_SIZE / 2, 3);
+    eb_chunk_t* chunks = NULL;
+    size_t count = 0;
+    assert(eb_chunk_split(data, PAYLOAD_SIZE / 2, &chunks, &count) == EB_SUCCESS);
+
+    char* text = NULL;
+    size_t size = 0;
+    assert(eb_chunk_list_format(chunks, count, &text, &size) == EB_SUCCESS);
+    assert(strncmp(text, EB_CHUNK_LIST_HEADER "\n", strlen(EB_CHUNK_LIST_HEADER) + 1) == 0);
+
+    eb_chunk_t* parsed = NULL;
+    size_t parsed_count = 0;
+    assert(eb_chunk_list_parse(text, size, &parsed, &parsed_count) == EB_SUCCESS);
+    assert(parsed_count == count);
+    for (size_t i = 0; i < count; i++) {
+        assert(parsed[i].offset == chunks[i].offset && parsed[i].length == chunks[i].length);
+        assert(strcmp(parsed[i].hash, chunks[i].hash) == 0);
+    }
+    free(parsed);
+
+    assert(eb_chunk_list_parse("# embr have 1\n", 14, &parsed, &parsed_count) == EB_ERROR_INVALID_FORMAT);
+    const char* broken = EB_CHUNK_LIST_HEADER "\nnot-a-hash 12\n";
+    assert(eb_chunk_list_parse(broken, strlen(broken), &parsed, &parsed_count) == EB_ERROR_INVALID_FORMAT);
+
+    free(text);
+    free(chunks);
+    free(data);
+    printf("Chunk list tests passed!\n");
+}
+
+int main(void) {
+    printf("Running chunk tests...\n");
+    test_split_bounds();
+    test_split_shift();
+    test_list_round_trip();
+    printf("All chunk tests passed!\n");
+    return 0;
+}
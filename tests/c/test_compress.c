@@ -0,0 +1,147 @@
+/*
+ * EmbeddingBridge - Compression Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "compress.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define SMALL_SIZE 100000
+#define LARGE_SIZE (9u << 20)
+
+/* Compressible but not trivially so: runs of a slowly changing pattern */
+static unsigned char* make_data(size_t size) {
+    unsigned char* data = malloc(size);
+    assert(data != NULL);
+    unsigned state = 12345;
+    for (size_t i = 0; i < size; i++) {
+        if (i % 64 == 0)
+            state = state * 1103515245u + 12345u;
+        data[i] = (unsigned char)((state >> 16) + i % 7);
+    }
+    return data;
+}
+
+static void write_file(const char* path, const void* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    assert(fwrite(data, 1, size, f) == size);
+    fclose(f);
+}
+
+static unsigned char* read_file(const char* path, size_t* size_out) {
+    FILE* f = fopen(path, "rb");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char* data = malloc(size ? (size_t)size : 1);
+    assert(data != NULL && fread(data, 1, (size_t)size, f) == (size_t)size);
+    fclose(f);
+    *size_out = (size_t)size;
+    return data;
+}
+
+static void check_buffer(size_t size) {
+    unsigned char* data = make_data(size);
+    void* compressed = NULL;
+    size_t compressed_size = 0;
+    assert(compress_buffer(data, size, 3, &compressed, &compressed_size) == EB_SUCCESS);
+    assert(eb_is_zstd_compressed(compressed, compressed_size));
+    assert(compressed_size < size);
+
+    void* restored = NULL;
+    size_t restored_size = 0;
+    assert(eb_decompress_zstd(compressed, compressed_size, &restored, &restored_size) == EB_SUCCESS);
+    assert(restored_size == size && memcmp(restored, data, size) == 0);
+    free(restored);
+    free(compressed);
+    free(data);
+}
+
+static void test_buffers(void) {
+    printf("Testing buffer compression...\n");
+    check_buffer(SMALL_SIZE);
+    check_buffer(LARGE_SIZE);
+
+    /* Level 0 copies */
+    void* copy = NULL;
+    size_t copy_size = 0;
+    assert(compress_buffer("abc", 3, 0, &copy, &copy_size) == EB_SUCCESS);
+    assert(copy_size == 3 && memcmp(copy, "abc", 3) == 0);
+    free(copy);
+    assert(compress_buffer(NULL, 3, 1, &copy, &copy_size) == EB_ERROR_INVALID_PARAMETER);
+    printf("✓ Buffer compression passed\n");
+}
+
+static void check_file(size_t size, int level) {
+    unsigned char* data = make_data(size);
+    write_file(TEST_ROOT "/plain", data, size);
+    assert(compress_file(TEST_ROOT "/plain", TEST_ROOT "/packed", level) == EB_SUCCESS);
+    assert(decompress_file(TEST_ROOT "/packed", TEST_ROOT "/restored") == EB_SUCCESS);
+
+    size_t packed_size = 0, restored_size = 0;
+    unsigned char* packed = read_file(TEST_ROOT "/packed", &packed_size);
+    unsigned char* restored = read_file(TEST_ROOT "/restored", &restored_size);
+    assert(restored_size == size && memcmp(restored, data, size) == 0);
+    if (level > 0) {
+        /* One frame, whole files read back with the buffer API too */
+        assert((size == 0 || packed_size < size) && eb_is_zstd_compressed(packed, packed_size));
+        void* whole = NULL;
+        size_t whole_size = 0;
+        assert(eb_decompress_zstd(packed, packed_size, &whole, &whole_size) == EB_SUCCESS);
+        assert(whole_size == size && memcmp(whole, data, size) == 0);
+        free(whole);
+    } else {
+        assert(packed_size == size);
+    }
+    free(packed);
+    free(restored);
+    free(data);
+}
+
+static void test_files(void) {
+    printf("Testing file compression...\n");
+    check_file(SMALL_SIZE, 3);
+    check_file(LARGE_SIZE, 1);
+    check_file(SMALL_SIZE, 0);
+    check_file(0, 3);
+
+    /* A truncated frame fails and leaves no output behind */
+    unsigned char* data = make_data(SMALL_SIZE);
+    write_file(TEST_ROOT "/plain", data, SMALL_SIZE);
+    assert(compress_file(TEST_ROOT "/plain", TEST_ROOT "/packed", 3) == EB_SUCCESS);
+    size_t packed_size = 0;
+    unsigned char* packed = read_file(TEST_ROOT "/packed", &packed_size);
+    write_file(TEST_ROOT "/packed", packed, packed_size / 2);
+    unlink(TEST_ROOT "/restored");
+    assert(decompress_file(TEST_ROOT "/packed", TEST_ROOT "/restored") == EB_ERROR_COMPRESSION);
+    assert(access(TEST_ROOT "/restored", F_OK) != 0);
+
+    assert(compress_file(TEST_ROOT "/missing", TEST_ROOT "/packed", 3) == EB_ERROR_IO);
+    assert(decompress_file(NULL, TEST_ROOT "/restored") == EB_ERROR_INVALID_PARAMETER);
+    free(packed);
+    free(data);
+    printf("✓ File compression passed\n");
+}
+
+int main(void) {
+    printf("Running compression tests...\n");
+    fixture_dir();
+    test_buffers();
+    test_files();
+    fixture_cleanup();
+    printf("All compression tests passed!\n");
+    return 0;
+}
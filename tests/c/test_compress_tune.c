@@ -0,0 +1,120 @@
+/*
+ * EmbeddingBridge - Adaptive Compression Level Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "compress_tune.h"
+#include "thread_pool.h"
+
+#define MB (1024.0 * 1024.0)
+#define WINDOW (1u << 20)
+#define ROUNDS 2000
+
+/* A made-up compressor: level n runs at speed / n MB/s and shrinks by gain per level */
+typedef struct {
+    double speed;
+    double gain;
+} model_t;
+
+/* Drive the tuner with the model and count the levels it picks after settling */
+static void run(const eb_compress_bounds_t* bounds, const model_t* model, int counts[23]) {
+    eb_compress_tune_reset();
+    for (int i = 0; i < 23; i++)
+        counts[i] = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        int level = eb_compress_tune_level(bounds);
+        assert(level >= bounds->min_level && level <= bounds->max_level);
+        if (round >= ROUNDS / 2)
+            counts[level]++;
+        double ratio = 1.0 - model->gain * level;
+        double seconds = WINDOW / (model->speed / level * MB);
+        eb_compress_tune_record(bounds, level, WINDOW, (size_t)(WINDOW * ratio),
+                                (uint64_t)(seconds * 1e9));
+    }
+}
+
+/* The level picked most often */
+static int settled(const int counts[23]) {
+    int best = 0;
+    for (int i = 1; i < 23; i++)
+        if (counts[i] > counts[best])
+            best = i;
+    return best;
+}
+
+static void test_target(void) {
+    printf("Testing levels against a throughput target...\n");
+    int counts[23];
+
+    /* 1000 MB/s at level 1: level 5 is the slowest that keeps 200 MB/s */
+    eb_compress_bounds_t bounds = { 1, 19, (uint64_t)(200 * MB) };
+    model_t model = { 1000.0, 0.02 };
+    run(&bounds, &model, counts);
+    assert(settled(counts) == 5);
+    for (int i = 7; i < 23; i++)
+        assert(counts[i] == 0);
+    assert(counts[5] > ROUNDS / 2 * 9 / 10);
+
+    /* A lower target buys a higher level, capped at the bound */
+    bounds.target = (uint64_t)(10 * MB);
+    bounds.max_level = 12;
+    run(&bounds, &model, counts);
+    assert(settled(counts) == 12);
+
+    /* An unreachable target stays at the lowest level */
+    bounds.min_level = 3;
+    bounds.target = (uint64_t)(10000 * MB);
+    run(&bounds, &model, counts);
+    assert(counts[3] == ROUNDS / 2);
+    printf("✓ Throughput target passed\n");
+}
+
+static void test_no_gain(void) {
+    printf("Testing levels that do not compress better...\n");
+    int counts[23];
+    eb_compress_bounds_t bounds = { 1, 19, (uint64_t)(1 * MB) };
+    model_t model = { 1000.0, 0.0 };
+    run(&bounds, &model, counts);
+    assert(settled(counts) == 1);
+    assert(counts[1] > ROUNDS / 2 * 9 / 10);
+    printf("✓ No gain passed\n");
+}
+
+static void test_small_reports(void) {
+    printf("Testing reports smaller than a window...\n");
+    eb_compress_bounds_t bounds = { 2, 9, (uint64_t)(1 * MB) };
+    eb_compress_tune_reset();
+    assert(eb_compress_tune_level(&bounds) == 2);
+
+    /* Nothing moves until a whole window has been reported */
+    for (int i = 0; i < 15; i++)
+        eb_compress_tune_record(&bounds, 2, WINDOW / 16, WINDOW / 32, 1000);
+    assert(eb_compress_tune_level(&bounds) == 2);
+    eb_compress_tune_record(&bounds, 2, WINDOW / 16, WINDOW / 32, 1000);
+    assert(eb_compress_tune_level(&bounds) == 3);
+
+    /* Bad input is ignored */
+    eb_compress_tune_record(NULL, 3, WINDOW, WINDOW, 1);
+    eb_compress_tune_record(&bounds, 0, WINDOW, WINDOW, 1);
+    eb_compress_tune_record(&bounds, 3, 0, 0, 1);
+    assert(eb_compress_tune_level(&bounds) == 3);
+    printf("✓ Small reports passed\n");
+}
+
+int main(void) {
+    printf("Running adaptive compression level tests...\n");
+    setenv(EB_THREADS_ENV, "1", 1);
+    test_target();
+    test_no_gain();
+    test_small_reports();
+    printf("All adaptive compression level tests passed!\n");
+    return 0;
+}
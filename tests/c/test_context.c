@@ -0,0 +1,166 @@
+/*
+ * EmbeddingBridge - Library Context Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include "context.h"
+#include "set_index.h"
+#include "repo_fixture.h"
+
+#define THREADS 4
+#define PER_THREAD 8
+#define VALUE_COUNT 16
+
+static void setup_repo(void) {
+    fixture_repo("[storage]\n\tcompression = false\n");
+}
+
+typedef struct {
+    eb_context_t* ctx;
+    int id;
+    char hashes[PER_THREAD][65];
+} worker_t;
+
+static float seed_of(int id, int i) {
+    return (float)(id * PER_THREAD + i) + 0.5f;
+}
+
+/* Each worker fills its own batch and commits it through the context */
+static void* ingest(void* arg) {
+    worker_t* w = arg;
+    eb_store_batch_t* batch = NULL;
+    assert(eb_context_batch_begin(w->ctx, &batch) == EB_SUCCESS);
+
+    for (int i = 0; i < PER_THREAD; i++) {
+        char input[64], source[64];
+        snprintf(input, sizeof(input), "input-%d-%d.bin", w->id, i);
+        snprintf(source, sizeof(source), "doc-%d-%d.txt", w->id, i);
+
+        float values[VALUE_COUNT];
+        for (int k = 0; k < VALUE_COUNT; k++)
+            values[k] = seed_of(w->id, i);
+        FILE* f = fopen(input, "wb");
+        assert(f != NULL);
+        assert(fwrite(values, sizeof(float), VALUE_COUNT, f) == VALUE_COUNT);
+        fclose(f);
+
+        assert(eb_store_batch_add(batch, input, source, "openai", w->hashes[i]) == EB_SUCCESS);
+    }
+    assert(eb_context_batch_commit(w->ctx, batch) == EB_SUCCESS);
+    return NULL;
+}
+
+/* Each worker reads back every object through the shared store */
+static void* verify(void* arg) {
+    worker_t* workers = arg;
+    eb_store_t* store = NULL;
+    assert(eb_context_store(workers[0].ctx, &store) == EB_SUCCESS);
+
+    for (int id = 0; id < THREADS; id++) {
+        for (int i = 0; i < PER_THREAD; i++) {
+            char full[65];
+            char prefix[13];
+            memcpy(prefix, workers[id].hashes[i], 12);
+            prefix[12] = '\0';
+            assert(eb_store_resolve_hash(store, prefix, full, sizeof(full)) == EB_SUCCESS);
+            assert(strcmp(full, workers[id].hashes[i]) == 0);
+
+            eb_object_view_t view;
+            assert(eb_object_map(store, full, 0, &view) == EB_SUCCESS);
+            assert(view.size == VALUE_COUNT * sizeof(float));
+            float value;
+            memcpy(&value, view.data, sizeof(value));
+            assert(value == seed_of(id, i));
+            eb_object_unmap(&view);
+        }
+    }
+    return NULL;
+}
+
+static int count_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    (void)model;
+    (void)hash;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static void test_open(void) {
+    printf("Testing context open...\n");
+
+    setup_repo();
+    eb_context_t* ctx = NULL;
+    assert(eb_context_open(NULL, &ctx) == EB_SUCCESS);
+    char cwd[PATH_MAX];
+    assert(getcwd(cwd, sizeof(cwd)) != NULL);
+    assert(strcmp(eb_context_root(ctx), cwd) == 0);
+
+    /* The store is opened once and shared */
+    eb_store_t* first = NULL;
+    eb_store_t* second = NULL;
+    assert(eb_context_store(ctx, &first) == EB_SUCCESS);
+    assert(eb_context_store(ctx, &second) == EB_SUCCESS);
+    assert(first != NULL && first == second);
+    eb_context_close(ctx);
+
+    assert(eb_context_open("/", &ctx) == EB_ERROR_NOT_INITIALIZED);
+    fixture_cleanup();
+
+    printf("✓ Context open passed\n");
+}
+
+static void test_concurrent_use(void) {
+    printf("Testing concurrent use of one context...\n");
+
+    setup_repo();
+    eb_context_t* ctx = NULL;
+    assert(eb_context_open(".", &ctx) == EB_SUCCESS);
+
+    worker_t workers[THREADS];
+    pthread_t threads[THREADS];
+    for (int id = 0; id < THREADS; id++) {
+        workers[id].ctx = ctx;
+        workers[id].id = id;
+        assert(pthread_create(&threads[id], NULL, ingest, &workers[id]) == 0);
+    }
+    for (int id = 0; id < THREADS; id++)
+        assert(pthread_join(threads[id], NULL) == 0);
+
+    /* No commit lost another one's index update */
+    eb_set_index_t* index = NULL;
+    int entries = 0;
+    assert(eb_set_index_open_current(".", &index) == EB_SUCCESS);
+    assert(eb_set_index_foreach(index, NULL, count_entry, &entries) == EB_SUCCESS);
+    eb_set_index_close(index);
+    assert(entries == THREADS * PER_THREAD);
+
+    for (int id = 0; id < THREADS; id++)
+        assert(pthread_create(&threads[id], NULL, verify, workers) == 0);
+    for (int id = 0; id < THREADS; id++)
+        assert(pthread_join(threads[id], NULL) == 0);
+
+    eb_context_close(ctx);
+    fixture_cleanup();
+
+    printf("✓ Concurrent use passed\n");
+}
+
+int main(void) {
+    printf("Running context tests...\n");
+    test_open();
+    test_concurrent_use();
+    printf("All context tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * EmbeddingBridge - Runtime Counter Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "counters.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define THREADS 8
+#define ADDS 10000
+#define COUNT 20
+#define DIMS 64
+
+static uint64_t counter(eb_counter_t c) {
+    uint64_t values[EB_COUNTER_COUNT];
+    eb_counters_snapshot(values);
+    return values[c];
+}
+
+static pthread_barrier_t added;
+
+static void* add_retries(void* arg) {
+    (void)arg;
+    for (int i = 0; i < ADDS; i++)
+        eb_counter_add(EB_COUNTER_REMOTE_RETRIES, 1);
+    // Counted while the thread still runs, and after it exits
+    pthread_barrier_wait(&added);
+    pthread_barrier_wait(&added);
+    return NULL;
+}
+
+static void test_threads(void) {
+    printf("Testing counters across threads...\n");
+    uint64_t before = counter(EB_COUNTER_REMOTE_RETRIES);
+
+    pthread_t threads[THREADS];
+    assert(pthread_barrier_init(&added, NULL, THREADS + 1) == 0);
+    for (int i = 0; i < THREADS; i++)
+        assert(pthread_create(&threads[i], NULL, add_retries, NULL) == 0);
+    pthread_barrier_wait(&added);
+    assert(counter(EB_COUNTER_REMOTE_RETRIES) - before == (uint64_t)THREADS * ADDS);
+    pthread_barrier_wait(&added);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&added);
+    assert(counter(EB_COUNTER_REMOTE_RETRIES) - before == (uint64_t)THREADS * ADDS);
+
+    // Merged values add to the totals, as a daemon child's do
+    uint64_t merged[EB_COUNTER_COUNT] = {0};
+    merged[EB_COUNTER_REMOTE_RETRIES] = 5;
+    merged[EB_COUNTER_S3_IN_BYTES] = 7;
+    uint64_t s3_before = counter(EB_COUNTER_S3_IN_BYTES);
+    eb_counters_merge(merged);
+    assert(counter(EB_COUNTER_REMOTE_RETRIES) - before == (uint64_t)THREADS * ADDS + 5);
+    assert(counter(EB_COUNTER_S3_IN_BYTES) - s3_before == 7);
+
+    // Out of range counters are ignored
+    eb_counter_add(EB_COUNTER_COUNT, 1);
+    printf("✓ Counters across threads passed\n");
+}
+
+static void test_store(void) {
+    printf("Testing store counters...\n");
+    fixture_repo(NULL);
+    uint64_t before[EB_COUNTER_COUNT], after[EB_COUNTER_COUNT];
+    eb_counters_snapshot(before);
+
+    float values[COUNT * DIMS];
+    const char* sources[COUNT];
+    char names[COUNT][32];
+    char hashes[COUNT][65];
+    for (int n = 0; n < COUNT; n++) {
+        for (int i = 0; i < DIMS; i++)
+            values[n * DIMS + i] = (float)((n * 31 + i * 17) % 97) * 0.125f;
+        snprintf(names[n], sizeof(names[n]), "doc%d.txt", n);
+        sources[n] = names[n];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, COUNT, DIMS, sources, "m", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    eb_counters_snapshot(after);
+    assert(after[EB_COUNTER_OBJECTS_WRITTEN] - before[EB_COUNTER_OBJECTS_WRITTEN] >= COUNT);
+    assert(after[EB_COUNTER_HASH_BYTES] - before[EB_COUNTER_HASH_BYTES] >=
+           (uint64_t)COUNT * DIMS * sizeof(float));
+    assert(after[EB_COUNTER_HASH_NS] > before[EB_COUNTER_HASH_NS]);
+    assert(after[EB_COUNTER_COMPRESS_IN_BYTES] > before[EB_COUNTER_COMPRESS_IN_BYTES]);
+    assert(after[EB_COUNTER_COMPRESS_OUT_BYTES] > before[EB_COUNTER_COMPRESS_OUT_BYTES]);
+
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    for (int n = 0; n < COUNT; n++) {
+        eb_object_view_t view;
+        assert(eb_object_map(store, hashes[n], 0, &view) == EB_SUCCESS);
+        eb_object_unmap(&view);
+    }
+    eb_store_destroy(store);
+
+    eb_counters_snapshot(before);
+    assert(before[EB_COUNTER_OBJECTS_READ] - after[EB_COUNTER_OBJECTS_READ] == COUNT);
+    assert(before[EB_COUNTER_DECOMPRESS_IN_BYTES] > after[EB_COUNTER_DECOMPRESS_IN_BYTES]);
+    assert(before[EB_COUNTER_DECOMPRESS_OUT_BYTES] > after[EB_COUNTER_DECOMPRESS_OUT_BYTES]);
+    fixture_cleanup();
+    printf("✓ Store counters passed\n");
+}
+
+static void test_print(void) {
+    printf("Testing counter reports...\n");
+    for (int i = 0; i < EB_COUNTER_COUNT; i++) {
+        assert(eb_counter_name(i) && eb_counter_help(i));
+        for (int j = 0; j < i; j++)
+            assert(strcmp(eb_counter_name(i), eb_counter_name(j)) != 0);
+    }
+    assert(eb_counter_name(EB_COUNTER_COUNT) == NULL);
+
+    uint64_t values[EB_COUNTER_COUNT] = {0};
+    values[EB_COUNTER_OBJECTS_READ] = 12;
+    values[EB_COUNTER_STAT_CACHE_HITS] = 3;
+    values[EB_COUNTER_STAT_CACHE_MISSES] = 1;
+    char text[4096];
+    FILE* out = fmemopen(text, sizeof(text), "w");
+    assert(out != NULL);
+    eb_counters_print(out, values, false);
+    fclose(out);
+    assert(strstr(text, "objects_read           12\n") != NULL);
+    assert(strstr(text, "stat_cache_hit_rate    75.0%\n") != NULL);
+    assert(strstr(text, "remote_cache_hit_rate") == NULL);    /* Not used */
+
+    out = fmemopen(text, sizeof(text), "w");
+    assert(out != NULL);
+    eb_counters_print(out, values, true);
+    fclose(out);
+    const char* start = "{\"objects_read\":12,\"objects_written\":0,";
+    assert(strncmp(text, start, strlen(start)) == 0);
+    assert(strstr(text, "\"prefetch_stalls\":0}\n") != NULL);
+    printf("✓ Counter reports passed\n");
+}
+
+int main(void) {
+    printf("Running counter tests...\n");
+    test_threads();
+    test_store();
+    test_print();
+    printf("All counter tests passed!\n");
+    return 0;
+}
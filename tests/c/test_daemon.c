@@ -0,0 +1,173 @@
+/*
+ * EmbeddingBridge - Local Command Daemon Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "daemon.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "daemon"
+
+static char root[PATH_MAX];
+
+/* The repository is a directory of the fixture, which stays outside it */
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " TEST_ROOT "/.embr " TEST_ROOT "/sub");
+    snprintf(root, sizeof(root), "%s/%s", fixture_root(), TEST_ROOT);
+}
+
+static int refreshes = 0;
+
+static void count_refresh(const char* path, void* ctx) {
+    (void)path;
+    (void)ctx;
+    refreshes++;
+}
+
+/* Print what the command saw; exit with its argument count */
+static int echo_run(int argc, char** argv, void* ctx) {
+    (void)ctx;
+    char cwd[PATH_MAX];
+    assert(getcwd(cwd, sizeof(cwd)) != NULL);
+    printf("cwd=%s refreshes=%d", strrchr(cwd, '/') + 1, refreshes);
+    for (int i = 0; i < argc; i++)
+        printf(" %s", argv[i]);
+    printf(" env=%s\n", getenv(EB_DAEMON_DISABLE_ENV) ? "set" : "unset");
+    return argc;
+}
+
+static pid_t start_daemon(void) {
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        eb_daemon_ops_t ops = { count_refresh, echo_run, NULL };
+        _exit(eb_daemon_serve(root, &ops) == EB_SUCCESS ? 0 : 1);
+    }
+
+    /* Wait until the daemon accepts, a stale socket may be in place before */
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s", root, EB_DAEMON_SOCKET);
+    bool up = false;
+    for (int i = 0; i < 500 && !up; i++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        up = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        close(fd);
+        if (!up)
+            usleep(10000);
+    }
+    assert(up);
+    struct stat st;
+    assert(stat(addr.sun_path, &st) == 0);
+    assert((st.st_mode & 0077) == 0);
+    return pid;
+}
+
+/* Forward with stdout captured in a file */
+static eb_status_t forward_captured(int argc, char** argv, int* code, char* out, size_t size) {
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/out.txt", root);
+    int file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    assert(file >= 0);
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(file, STDOUT_FILENO);
+    eb_status_t status = eb_daemon_forward(root, argc, argv, code);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    ssize_t n = pread(file, out, size - 1, 0);
+    out[n > 0 ? n : 0] = '\0';
+    close(file);
+    return status;
+}
+
+static void test_forward(void) {
+    printf("Testing command forwarding...\n");
+
+    setup_repo();
+    char* argv[] = { "status", "--verbose", "a b.txt" };
+    int code = -1;
+    char out[512];
+
+    /* No daemon yet: nothing runs */
+    assert(forward_captured(3, argv, &code, out, sizeof(out)) == EB_ERROR_NOT_CONNECTED);
+    assert(code == -1 && out[0] == '\0');
+
+    pid_t daemon = start_daemon();
+    eb_daemon_ops_t ops = { NULL, echo_run, NULL };
+    assert(eb_daemon_serve(root, &ops) == EB_ERROR_ALREADY_EXISTS);
+    assert(chdir(fixture_root()) == 0);
+
+    assert(chdir(TEST_ROOT "/sub") == 0);
+    assert(forward_captured(3, argv, &code, out, sizeof(out)) == EB_SUCCESS);
+    assert(chdir(fixture_root()) == 0);
+    assert(code == 3);
+    assert(strcmp(out, "cwd=sub refreshes=2 status --verbose a b.txt env=set\n") == 0);
+
+    /* Each request sees state refreshed again */
+    assert(chdir(TEST_ROOT) == 0);
+    assert(forward_captured(1, argv, &code, out, sizeof(out)) == EB_SUCCESS);
+    assert(code == 1);
+    assert(chdir(fixture_root()) == 0);
+    assert(strcmp(out, "cwd=daemon refreshes=3 status env=set\n") == 0);
+
+    kill(daemon, SIGTERM);
+    int wstatus;
+    assert(waitpid(daemon, &wstatus, 0) == daemon);
+    assert(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+    assert(access(TEST_ROOT "/" EB_DAEMON_SOCKET, F_OK) != 0);
+    assert(forward_captured(1, argv, &code, out, sizeof(out)) == EB_ERROR_NOT_CONNECTED);
+
+    fixture_cleanup();
+    printf("✓ Command forwarding passed\n");
+}
+
+static void test_stale_socket(void) {
+    printf("Testing stale socket replacement...\n");
+
+    setup_repo();
+    pid_t daemon = start_daemon();
+    kill(daemon, SIGKILL);
+    waitpid(daemon, NULL, 0);
+    assert(access(TEST_ROOT "/" EB_DAEMON_SOCKET, F_OK) == 0);
+
+    daemon = start_daemon();
+    char* argv[] = { "diff" };
+    int code = -1;
+    char out[512];
+    assert(forward_captured(1, argv, &code, out, sizeof(out)) == EB_SUCCESS);
+    assert(code == 1);
+
+    kill(daemon, SIGINT);
+    waitpid(daemon, NULL, 0);
+    fixture_cleanup();
+    printf("✓ Stale socket replacement passed\n");
+}
+
+int main(void) {
+    printf("Running daemon tests...\n");
+    test_forward();
+    test_stale_socket();
+    printf("All daemon tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * EmbeddingBridge - Distance Kernel Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "distance.h"
+
+/* Sizes that exercise the unrolled loops, the vector tail and the scalar tail */
+static const size_t SIZES[] = { 0, 1, 3, 7, 8, 15, 16, 17, 31, 33, 100, 384, 768, 1536, 3072 };
+static const eb_kernel_t KERNELS[] = {
+    EB_KERNEL_SCALAR, EB_KERNEL_AVX2, EB_KERNEL_AVX512, EB_KERNEL_NEON
+};
+
+static float* random_vector(size_t n, unsigned* seed) {
+    float* v = malloc((n ? n : 1) * sizeof(float));
+    assert(v != NULL);
+    for (size_t i = 0; i < n; i++)
+        v[i] = (float)rand_r(seed) / (float)RAND_MAX * 2.0f - 1.0f;
+    return v;
+}
+
+/* Relative error against the double-accumulating path, with an absolute floor */
+static void assert_close(double expected, float actual, double scale) {
+    double tolerance = 1e-5 * (scale > 1.0 ? scale : 1.0);
+    if (fabs(expected - (double)actual) > tolerance) {
+        fprintf(stderr, "expected %.9g, got %.9g\n", expected, (double)actual);
+        assert(0);
+    }
+}
+
+static void check_kernel(void) {
+    unsigned seed = 42;
+    for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+        size_t n = SIZES[s];
+        float* a = random_vector(n, &seed);
+        float* b = random_vector(n, &seed);
+
+        double dot = 0.0, norm_a = 0.0, norm_b = 0.0, l2 = 0.0, abs_dot = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            dot += (double)a[i] * (double)b[i];
+            abs_dot += fabs((double)a[i] * (double)b[i]);
+            norm_a += (double)a[i] * (double)a[i];
+            norm_b += (double)b[i] * (double)b[i];
+            double diff = (double)a[i] - (double)b[i];
+            l2 += diff * diff;
+        }
+
+        /* Dot products cancel, so scale their tolerance by the sum of |a[i]b[i]| */
+        assert_close(dot, eb_dot(a, b, n), abs_dot);
+        assert_close(l2, eb_l2_squared(a, b, n), l2);
+
+        eb_cosine_terms_t terms = eb_cosine_terms(a, b, n);
+        assert_close(dot, terms.dot, abs_dot);
+        assert_close(norm_a, terms.norm_a, norm_a);
+        assert_close(norm_b, terms.norm_b, norm_b);
+
+        if (n > 0)
+            assert_close(dot / (sqrt(norm_a) * sqrt(norm_b)),
+                         terms.dot / (sqrtf(terms.norm_a) * sqrtf(terms.norm_b)), 1.0);
+
+        free(a);
+        free(b);
+    }
+}
+
+/* Reduced dtypes against the double reference over their widened values */
+static void check_reduced_kernel(void) {
+    static const eb_dtype_t DTYPES[] = { EB_FLOAT32, EB_FLOAT16, EB_BFLOAT16, EB_INT8 };
+    const size_t dtype_count = sizeof(DTYPES) / sizeof(DTYPES[0]);
+    unsigned seed = 7;
+    for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+        size_t n = SIZES[s];
+        if (n == 0)
+            continue;
+        float* a = random_vector(n, &seed);
+        float* b = random_vector(n, &seed);
+        float* wa = malloc(n * sizeof(float));
+        float* wb = malloc(n * sizeof(float));
+        assert(wa != NULL && wb != NULL);
+
+        for (size_t da = 0; da < dtype_count; da++) {
+            for (size_t db = 0; db < dtype_count; db++) {
+                void* pa = NULL;
+                void* pb = NULL;
+                size_t size_a = 0, size_b = 0;
+                assert(eb_quantize(a, n, DTYPES[da], &pa, &size_a) == EB_SUCCESS);
+                assert(eb_quantize(b, n, DTYPES[db], &pb, &size_b) == EB_SUCCESS);
+                eb_vector_ref_t ra, rb;
+                assert(eb_vector_ref_init(&ra, DTYPES[da], pa, size_a) == EB_SUCCESS);
+                assert(eb_vector_ref_init(&rb, DTYPES[db], pb, size_b) == EB_SUCCESS);
+                eb_vector_ref_get(&ra, 0, n, wa);
+                eb_vector_ref_get(&rb, 0, n, wb);
+
+                double dot = 0.0, norm_a = 0.0, norm_b = 0.0, l2 = 0.0, abs_dot = 0.0;
+                for (size_t i = 0; i < n; i++) {
+                    dot += (double)wa[i] * (double)wb[i];
+                    abs_dot += fabs((double)wa[i] * (double)wb[i]);
+                    norm_a += (double)wa[i] * (double)wa[i];
+                    norm_b += (double)wb[i] * (double)wb[i];
+                    double diff = (double)wa[i] - (double)wb[i];
+                    l2 += diff * diff;
+                }
+
+                eb_cosine_terms_t terms = eb_vector_cosine_terms(&ra, &rb);
+                assert_close(dot, terms.dot, abs_dot);
+                assert_close(norm_a, terms.norm_a, norm_a);
+                assert_close(norm_b, terms.norm_b, norm_b);
+                /* Int8 distances are expanded from the dot product */
+                assert_close(l2, eb_vector_l2_squared(&ra, &rb), norm_a + norm_b);
+
+                free(pa);
+                free(pb);
+            }
+        }
+        free(a);
+        free(b);
+        free(wa);
+        free(wb);
+    }
+}
+
+/* Int8 codes and sign bits, which must come out exact */
+static void check_code_kernel(void) {
+    unsigned seed = 11;
+    for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+        size_t n = SIZES[s];
+        int8_t* a = malloc(n + 1);
+        int8_t* b = malloc(n + 1);
+        assert(a != NULL && b != NULL);
+        int64_t dot = 0;
+        for (size_t i = 0; i < n; i++) {
+            // The extremes too, where the 16-bit pair sums are largest
+            a[i] = i % 5 == 0 ? 127 : (int8_t)(rand_r(&seed) % 255 - 127);
+            b[i] = i % 5 == 0 ? (i % 2 ? -127 : 127) : (int8_t)(rand_r(&seed) % 255 - 127);
+            dot += a[i] * b[i];
+        }
+        assert(eb_dot_i8(a, b, n) == dot);
+
+        size_t words = n / 8;
+        uint64_t* x = calloc(words + 1, sizeof(uint64_t));
+        uint64_t* y = calloc(words + 1, sizeof(uint64_t));
+        assert(x != NULL && y != NULL);
+        uint64_t bits = 0;
+        for (size_t w = 0; w < words; w++) {
+            x[w] = ((uint64_t)rand_r(&seed) << 40) ^ ((uint64_t)rand_r(&seed) << 20) ^ (uint64_t)rand_r(&seed);
+            y[w] = w % 3 ? ~x[w] : x[w] ^ (uint64_t)rand_r(&seed);
+            for (uint64_t diff = x[w] ^ y[w]; diff; diff &= diff - 1)
+                bits++;
+        }
+        assert(eb_hamming(x, y, words) == bits);
+        free(a);
+        free(b);
+        free(x);
+        free(y);
+    }
+}
+
+static void test_kernels(void) {
+    printf("Testing distance kernels against the double reference...\n");
+
+    eb_kernel_t initial = eb_kernel_active();
+    printf("  selected kernel: %s\n", eb_kernel_name(initial));
+    assert(eb_kernel_supported(initial));
+
+    for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+        if (!eb_kernel_select(KERNELS[k])) {
+            printf("  %s: not supported, skipped\n", eb_kernel_name(KERNELS[k]));
+            assert(eb_kernel_active() != KERNELS[k]);
+            continue;
+        }
+        assert(eb_kernel_active() == KERNELS[k]);
+        check_kernel();
+        check_reduced_kernel();
+        check_code_kernel();
+        printf("  %s: ok\n", eb_kernel_name(KERNELS[k]));
+    }
+
+    assert(eb_kernel_select(initial));
+    printf("Distance kernel tests passed!\n");
+}
+
+static void test_special_values(void) {
+    printf("Testing distance kernels with special values...\n");
+
+    float a[40], b[40];
+    for (int i = 0; i < 40; i++) {
+        a[i] = 1.0f;
+        b[i] = 1.0f;
+    }
+    assert(eb_l2_squared(a, b, 40) == 0.0f);
+    assert(eb_dot(a, b, 40) == 40.0f);
+
+    /* A NaN anywhere, including the tail, propagates to the result */
+    a[37] = NAN;
+    assert(isnan(eb_dot(a, b, 40)));
+    assert(isnan(eb_l2_squared(a, b, 40)));
+    assert(isnan(eb_cosine_terms(a, b, 40).norm_a));
+
+    printf("Special value tests passed!\n");
+}
+
+static void test_known_norms(void) {
+    printf("Testing distance kernels with known norms...\n");
+
+    float a[100], b[100];
+    for (int i = 0; i < 100; i++) {
+        a[i] = sinf((float)i * 0.3f);
+        b[i] = cosf((float)i * 0.7f);
+    }
+    eb_vector_ref_t ra, rb;
+    assert(eb_vector_ref_init(&ra, EB_FLOAT32, a, sizeof(a)) == EB_SUCCESS);
+    assert(eb_vector_ref_init(&rb, EB_FLOAT32, b, sizeof(b)) == EB_SUCCESS);
+    assert(ra.norm < 0.0f && rb.norm < 0.0f);
+
+    eb_cosine_terms_t summed = eb_vector_cosine_terms(&ra, &rb);
+    assert(fabsf(eb_vector_norm(&ra) - sqrtf(summed.norm_a)) < 1e-5f);
+
+    /* Known norms are used as given, the dot product is still computed */
+    ra.norm = 2.0f;
+    rb.norm = 3.0f;
+    eb_cosine_terms_t known = eb_vector_cosine_terms(&ra, &rb);
+    assert(known.dot == eb_dot(a, b, 100));
+    assert(known.norm_a == 4.0f && known.norm_b == 9.0f);
+    assert(eb_vector_norm(&ra) == 2.0f);
+
+    /* Only one side known */
+    rb.norm = -1.0f;
+    known = eb_vector_cosine_terms(&ra, &rb);
+    assert(known.norm_a == 4.0f && known.norm_b == summed.norm_b);
+
+    printf("Known norm tests passed!\n");
+}
+
+int main(void) {
+    printf("Running distance kernel tests...\n");
+
+    test_kernels();
+    test_special_values();
+    test_known_norms();
+
+    printf("All distance kernel tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * EmbeddingBridge - Storage Footprint Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "du.h"
+#include "store.h"
+#include "pack.h"
+#include "object_path.h"
+#include "repo_fixture.h"
+
+#define COUNT 40
+#define CHANGED 10      /* Sources stored again with other values */
+#define OTHER 3         /* Sources stored for a second model too */
+#define DIMS 64
+#define OBJECTS (COUNT + CHANGED + OTHER)
+
+static void store_vectors(int count, const char* model, int seed, char (*hashes)[65]) {
+    static float values[COUNT * DIMS];
+    const char* sources[COUNT];
+    char names[COUNT][32];
+    for (int n = 0; n < count; n++) {
+        for (int i = 0; i < DIMS; i++)
+            values[n * DIMS + i] = (float)((n * 31 + i * 17 + seed) % 97) * 0.125f;
+        snprintf(names[n], sizeof(names[n]), "doc%d.txt", n);
+        sources[n] = names[n];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, count, DIMS, sources, model, hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static size_t ratio_total(const eb_du_report_t* report) {
+    size_t total = 0;
+    for (size_t i = 0; i < EB_DU_RATIO_BUCKETS; i++)
+        total += report->ratios[i];
+    return total;
+}
+
+static void test_footprint(void) {
+    printf("Testing the storage footprint...\n");
+    fixture_repo(NULL);
+    char hashes[COUNT][65];
+    store_vectors(COUNT, "m", 0, hashes);
+    store_vectors(CHANGED, "m", 1, hashes);
+    store_vectors(OTHER, "n", 2, hashes);
+
+    eb_du_options_t options = { .threads = 4, .max_files = 5 };
+    eb_du_report_t report;
+    assert(eb_du(".", &options, &report) == EB_SUCCESS);
+    assert(report.total.objects == OBJECTS && report.loose.objects == OBJECTS);
+    assert(report.packed.objects == 0 && report.packs == 0 && report.unreadable == 0);
+    assert(report.total.stored_bytes == report.loose.stored_bytes);
+    assert(report.total.raw_bytes >= (uint64_t)OBJECTS * DIMS * sizeof(float));
+    assert(ratio_total(&report) == OBJECTS);
+    assert(report.marked && report.unreferenced.objects == 0);
+
+    // Everything is in main, which recorded every version
+    assert(report.set_count == 1 && strcmp(report.sets[0].name, "main") == 0);
+    const eb_du_set_t* main_set = &report.sets[0];
+    assert(main_set->current.objects == COUNT + OTHER);
+    assert(main_set->history.objects == OBJECTS);
+    assert(main_set->history.stored_bytes == report.total.stored_bytes);
+    assert(main_set->sources == COUNT && main_set->versions == OBJECTS);
+
+    assert(report.model_count == 2);
+    assert(strcmp(report.models[0].name, "m") == 0 && report.models[0].usage.objects == COUNT + CHANGED);
+    assert(strcmp(report.models[1].name, "n") == 0 && report.models[1].usage.objects == OTHER);
+
+    // 1 version, 2, and 3 for the sources of both models
+    assert(report.versions[0] == COUNT - CHANGED);
+    assert(report.versions[1] == CHANGED - OTHER);
+    assert(report.versions[2] == OTHER);
+    assert(report.file_count == 5 && report.files[0].versions == OTHER);
+    for (size_t i = 1; i < report.file_count; i++)
+        assert(report.files[i - 1].usage.stored_bytes >= report.files[i].usage.stored_bytes);
+    eb_du_report_free(&report);
+
+    // Packed objects count as packed; one held loose too counts for both copies
+    eb_repack_result_t repacked;
+    assert(eb_pack_repack(".", NULL, NULL, NULL, NULL, &repacked) == EB_SUCCESS);
+    assert(eb_du(".", NULL, &report) == EB_SUCCESS);
+    assert(report.loose.objects == 0 && report.packed.objects == OBJECTS && report.packs == 1);
+    assert(ratio_total(&report) == OBJECTS);
+    assert(report.sets[0].history.objects == OBJECTS);
+    assert(report.file_count == COUNT);
+    eb_du_report_free(&report);
+
+    // A loose copy of a packed object
+    eb_pack_set_t* packs = NULL;
+    void* record = NULL;
+    size_t size = 0;
+    assert(eb_pack_open(".", &packs) == EB_SUCCESS);
+    assert(eb_pack_read(packs, hashes[0], &record, &size) == EB_SUCCESS);
+    eb_pack_close(packs);
+    char path[PATH_MAX];
+    assert(eb_object_write_path(".", hashes[0], "raw", path, sizeof(path)) == 0);
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL && fwrite(record, 1, size, f) == size);
+    fclose(f);
+    free(record);
+
+    assert(eb_du(".", NULL, &report) == EB_SUCCESS);
+    assert(report.total.objects == OBJECTS + 1 && report.loose.objects == 1);
+    struct stat st;
+    assert(eb_object_path(".", hashes[0], "meta", path, sizeof(path)) == 0 && stat(path, &st) == 0);
+    assert(report.loose.stored_bytes == size + (uint64_t)st.st_size);
+    assert(report.total.stored_bytes == report.loose.stored_bytes + report.packed.stored_bytes);
+    assert(report.sets[0].history.objects == OBJECTS);
+    assert(report.sets[0].history.stored_bytes == report.total.stored_bytes);
+    eb_du_report_free(&report);
+
+    fixture_cleanup();
+    printf("✓ Storage footprint passed\n");
+}
+
+static void test_reclaimable(void) {
+    printf("Testing reclaimable objects...\n");
+    fixture_repo(NULL);
+    char hashes[COUNT][65];
+    store_vectors(COUNT, "m", 0, hashes);
+
+    // A copy under a name no set references, last written a day ago
+    char path[PATH_MAX], orphan[PATH_MAX];
+    const char* fake = "abababababababababababababababababababababababababababababababab";
+    assert(eb_object_path(".", hashes[0], "raw", path, sizeof(path)) == 0);
+    assert(eb_object_write_path(".", fake, "raw", orphan, sizeof(orphan)) == 0);
+    char command[3 * PATH_MAX];
+    snprintf(command, sizeof(command), "cp '%s' '%s'", path, orphan);
+    assert(system(command) == 0);
+    struct utimbuf old = { time(NULL) - 86400, time(NULL) - 86400 };
+    assert(utime(orphan, &old) == 0);
+
+    eb_du_report_t report;
+    eb_du_options_t options = { .expire = time(NULL) };
+    assert(eb_du(".", &options, &report) == EB_SUCCESS);
+    assert(report.total.objects == COUNT + 1);
+    assert(report.unreferenced.objects == 1 && report.reclaimable.objects == 1);
+    assert(report.reclaimable.stored_bytes > sizeof(eb_object_header_t));
+    assert(report.sets[0].history.objects == COUNT);
+    eb_du_report_free(&report);
+
+    // Not yet past the prune date
+    options.expire = time(NULL) - 2 * 86400;
+    assert(eb_du(".", &options, &report) == EB_SUCCESS);
+    assert(report.unreferenced.objects == 1 && report.reclaimable.objects == 0);
+    eb_du_report_free(&report);
+
+    fixture_cleanup();
+    printf("✓ Reclaimable objects passed\n");
+}
+
+static void test_empty(void) {
+    printf("Testing an empty repository...\n");
+    fixture_repo(NULL);
+    eb_du_report_t report;
+    assert(eb_du(".", NULL, &report) == EB_SUCCESS);
+    assert(report.total.objects == 0 && report.set_count == 1 && report.model_count == 0);
+    assert(report.file_count == 0 && report.marked);
+    eb_du_report_free(&report);
+    assert(eb_du(NULL, NULL, &report) == EB_ERROR_INVALID_INPUT);
+
+    assert(eb_du_version_bucket_min(0) == 1 && eb_du_version_bucket_min(1) == 2);
+    assert(eb_du_version_bucket_min(3) == 5 && eb_du_version_bucket_min(6) == 33);
+    fixture_cleanup();
+    printf("✓ Empty repository passed\n");
+}
+
+int main(void) {
+    printf("Running storage footprint tests...\n");
+    test_footprint();
+    test_reclaimable();
+    test_empty();
+    printf("All storage footprint tests passed!\n");
+    return 0;
+}
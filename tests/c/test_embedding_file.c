@@ -0,0 +1,243 @@
+/*
+ * EmbeddingBridge - Embedding File Loader Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "embedding_file.h"
+#include "repo_fixture.h"
+
+#define TEST_DIR "."
+
+static void write_file(const char* path, const void* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    assert(f);
+    assert(fwrite(data, 1, size, f) == size);
+    fclose(f);
+}
+
+/* A .npy file with a hand-written header, version 1.0 */
+static size_t make_npy(uint8_t* out, const char* dict, const void* data, size_t size) {
+    size_t length = strlen(dict);
+    memcpy(out, "\x93NUMPY\x01\x00", 8);
+    out[8] = (uint8_t)(length & 0xFF);
+    out[9] = (uint8_t)(length >> 8);
+    memcpy(out + 10, dict, length);
+    memcpy(out + 10 + length, data, size);
+    return 10 + length + size;
+}
+
+static void put16(uint8_t* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+static void put32(uint8_t* p, uint32_t v) { put16(p, v & 0xFFFF); put16(p + 2, v >> 16); }
+
+/* A stored zip with one member per name, as np.savez writes it (CRCs left 0) */
+static size_t make_npz(uint8_t* out, const char** names, const uint8_t** members,
+                       const size_t* sizes, size_t count, uint16_t method) {
+    size_t position = 0;
+    uint32_t offsets[4];
+    for (size_t i = 0; i < count; i++) {
+        offsets[i] = (uint32_t)position;
+        uint8_t* local = out + position;
+        memset(local, 0, 30);
+        put32(local, 0x04034b50);
+        put16(local + 8, method);
+        put32(local + 18, (uint32_t)sizes[i]);
+        put32(local + 22, (uint32_t)sizes[i]);
+        put16(local + 26, (uint16_t)strlen(names[i]));
+        memcpy(local + 30, names[i], strlen(names[i]));
+        position += 30 + strlen(names[i]);
+        memcpy(out + position, members[i], sizes[i]);
+        position += sizes[i];
+    }
+    size_t central = position;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* entry = out + position;
+        memset(entry, 0, 46);
+        put32(entry, 0x02014b50);
+        put16(entry + 10, method);
+        put32(entry + 20, (uint32_t)sizes[i]);
+        put32(entry + 24, (uint32_t)sizes[i]);
+        put16(entry + 28, (uint16_t)strlen(names[i]));
+        put32(entry + 42, offsets[i]);
+        memcpy(entry + 46, names[i], strlen(names[i]));
+        position += 46 + strlen(names[i]);
+    }
+    uint8_t* end = out + position;
+    memset(end, 0, 22);
+    put32(end, 0x06054b50);
+    put16(end + 8, (uint16_t)count);
+    put16(end + 10, (uint16_t)count);
+    put32(end + 12, (uint32_t)(position - central));
+    put32(end + 16, (uint32_t)central);
+    return position + 22;
+}
+
+static void test_npy_header(void) {
+    printf("Testing .npy header parsing...\n");
+    float values[6] = {1, 2, 3, 4, 5, 6};
+    uint8_t buf[512];
+    eb_array_t array;
+
+    /* Written headers are aligned and read back */
+    char header[EB_NPY_HEADER_MAX];
+    size_t shape[2] = {2, 3};
+    size_t length = eb_npy_header(EB_FLOAT32, shape, 2, header);
+    assert(length == 128);
+    assert(header[length - 1] == '\n');
+    memcpy(buf, header, length);
+    memcpy(buf + length, values, sizeof(values));
+    assert(eb_npy_parse(buf, length + sizeof(values), &array) == EB_SUCCESS);
+    assert(array.dtype == EB_FLOAT32 && array.ndim == 2);
+    assert(array.shape[0] == 2 && array.shape[1] == 3);
+    assert(array.data == buf + 128);
+
+    size_t rows, dims;
+    assert(eb_array_rows(&array, &rows, &dims) == EB_SUCCESS);
+    assert(rows == 2 && dims == 3);
+    assert(((const float*)eb_array_row(&array, 1, dims))[0] == 4.0f);
+
+    /* Key order, quotes and spacing are free; every key is required */
+    length = make_npy(buf, "{\"shape\": (6,), 'fortran_order':False,'descr':'<f4'}  \n", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_SUCCESS);
+    assert(array.ndim == 1 && array.shape[0] == 6);
+    length = make_npy(buf, "{'descr': '<f4', 'shape': (6,), }\n", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_ERROR_INVALID_FORMAT);
+    length = make_npy(buf, "{'descr': '<f4', 'fortran_order': False, 'shape': (6,), 'x': 1}\n",
+                      values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_ERROR_INVALID_FORMAT);
+
+    /* (6) is not a tuple, and the data must match the shape exactly */
+    length = make_npy(buf, "{'descr': '<f4', 'fortran_order': False, 'shape': (6), }\n", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_ERROR_INVALID_FORMAT);
+    length = make_npy(buf, "{'descr': '<f4', 'fortran_order': False, 'shape': (5,), }\n", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_ERROR_INVALID_FORMAT);
+    length = make_npy(buf, "{'descr': '<f4', 'fortran_order': False, 'shape': (6,), }", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_ERROR_INVALID_FORMAT);
+
+    /* Other dtypes and byte orders */
+    length = make_npy(buf, "{'descr': '>f4', 'fortran_order': False, 'shape': (6,), }\n", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_ERROR_UNSUPPORTED);
+    length = make_npy(buf, "{'descr': '<i4', 'fortran_order': False, 'shape': (6,), }\n", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_ERROR_UNSUPPORTED);
+
+    /* Version 2.0 has a 4-byte header length */
+    const char* dict = "{'descr': '<f8', 'fortran_order': False, 'shape': (3,), }\n";
+    double doubles[3] = {0.5, -1.5, 2.25};
+    memcpy(buf, "\x93NUMPY\x02\x00", 8);
+    uint32_t dict_length = (uint32_t)strlen(dict);
+    memcpy(buf + 8, &dict_length, 4);
+    memcpy(buf + 12, dict, dict_length);
+    memcpy(buf + 12 + dict_length, doubles, sizeof(doubles));
+    assert(eb_npy_parse(buf, 12 + dict_length + sizeof(doubles), &array) == EB_SUCCESS);
+    assert(array.dtype == EB_FLOAT64 && array.elem_size == 8);
+    float converted[3];
+    eb_array_get(&array, 0, 3, converted);
+    assert(converted[0] == 0.5f && converted[1] == -1.5f && converted[2] == 2.25f);
+
+    /* Unknown versions are refused */
+    buf[6] = 4;
+    assert(eb_npy_parse(buf, 12 + dict_length + sizeof(doubles), &array) == EB_ERROR_UNSUPPORTED);
+
+    /* Fortran-order matrices have no contiguous rows */
+    length = make_npy(buf, "{'descr': '<f4', 'fortran_order': True, 'shape': (2, 3), }\n", values, sizeof(values));
+    assert(eb_npy_parse(buf, length, &array) == EB_SUCCESS);
+    assert(eb_array_rows(&array, &rows, &dims) == EB_ERROR_UNSUPPORTED);
+    printf(".npy header tests passed!\n");
+}
+
+static void test_files(void) {
+    printf("Testing mapped embedding files...\n");
+    fixture_dir();
+    float values[6] = {1, 2, 3, 4, 5, 6};
+    uint8_t buf[1024];
+    eb_embedding_file_t* file = NULL;
+
+    /* .bin files are bare floats, split into rows when dims is given */
+    write_file(TEST_DIR "/v.bin", values, sizeof(values));
+    assert(eb_embedding_file_open(TEST_DIR "/v.bin", 0, &file) == EB_SUCCESS);
+    assert(!eb_embedding_file_is_numpy(file));
+    const eb_array_t* array = eb_embedding_file_embeddings(file);
+    assert(array && array->ndim == 1 && array->shape[0] == 6);
+    eb_embedding_file_close(file);
+    assert(eb_embedding_file_open(TEST_DIR "/v.bin", 3, &file) == EB_SUCCESS);
+    array = eb_embedding_file_embeddings(file);
+    assert(array->ndim == 2 && array->shape[0] == 2 && array->shape[1] == 3);
+    eb_embedding_file_close(file);
+    assert(eb_embedding_file_open(TEST_DIR "/v.bin", 4, &file) == EB_ERROR_DIMENSION_MISMATCH);
+
+    /* The magic decides, not the extension */
+    size_t length = make_npy(buf, "{'descr': '<f4', 'fortran_order': False, 'shape': (6,), }\n",
+                             values, sizeof(values));
+    write_file(TEST_DIR "/v.bin", buf, length);
+    assert(eb_embedding_file_open(TEST_DIR "/v.bin", 0, &file) == EB_SUCCESS);
+    assert(eb_embedding_file_is_numpy(file));
+    size_t size;
+    const uint8_t* bytes = eb_embedding_file_bytes(file, &size);
+    assert(size == length);
+    array = eb_embedding_file_embeddings(file);
+    assert(array->data == bytes + length - sizeof(values));
+    eb_embedding_file_close(file);
+
+    /* .npz members are viewed in place */
+    uint8_t ids[256], embeddings[256];
+    size_t shape[2] = {2, 3};
+    char header[EB_NPY_HEADER_MAX];
+    size_t header_size = eb_npy_header(EB_FLOAT32, shape, 2, header);
+    memcpy(embeddings, header, header_size);
+    memcpy(embeddings + header_size, values, sizeof(values));
+    size_t ids_size = make_npy(ids, "{'descr': '<f4', 'fortran_order': False, 'shape': (2,), }\n", values, 8);
+    const char* names[] = {"ids.npy", "embeddings.npy"};
+    const uint8_t* members[] = {ids, embeddings};
+    size_t sizes[] = {ids_size, header_size + sizeof(values)};
+    length = make_npz(buf, names, members, sizes, 2, 0);
+    write_file(TEST_DIR "/v.npz", buf, length);
+    assert(eb_embedding_file_open(TEST_DIR "/v.npz", 0, &file) == EB_SUCCESS);
+    assert(eb_embedding_file_count(file) == 2);
+    assert(strcmp(eb_embedding_file_array(file, 0)->name, "ids") == 0);
+    array = eb_embedding_file_embeddings(file);
+    assert(array && strcmp(array->name, "embeddings") == 0);
+    size_t rows, dims;
+    assert(eb_array_rows(array, &rows, &dims) == EB_SUCCESS && rows == 2 && dims == 3);
+    float row[3];
+    eb_array_get(array, 3, 3, row);
+    assert(row[0] == 4.0f && row[2] == 6.0f);
+    eb_embedding_file_close(file);
+
+    /* Several arrays and none named embeddings */
+    names[1] = "other.npy";
+    length = make_npz(buf, names, members, sizes, 2, 0);
+    write_file(TEST_DIR "/v.npz", buf, length);
+    assert(eb_embedding_file_open(TEST_DIR "/v.npz", 0, &file) == EB_SUCCESS);
+    assert(eb_embedding_file_embeddings(file) == NULL);
+    eb_embedding_file_close(file);
+
+    /* np.savez_compressed archives cannot be viewed */
+    length = make_npz(buf, names, members, sizes, 2, 8);
+    write_file(TEST_DIR "/v.npz", buf, length);
+    assert(eb_embedding_file_open(TEST_DIR "/v.npz", 0, &file) == EB_ERROR_UNSUPPORTED);
+
+    /* Truncated files */
+    write_file(TEST_DIR "/v.npz", buf, length - 10);
+    assert(eb_embedding_file_open(TEST_DIR "/v.npz", 0, &file) == EB_ERROR_INVALID_FORMAT);
+    assert(eb_embedding_file_open(TEST_DIR "/missing.npy", 0, &file) == EB_ERROR_FILE_IO);
+
+    fixture_cleanup();
+    printf("Mapped embedding file tests passed!\n");
+}
+
+int main(void) {
+    printf("Running embedding file tests...\n");
+    test_npy_header();
+    test_files();
+    printf("All embedding file tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * EmbeddingBridge - Repository Integrity Check Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include "fsck.h"
+#include "store.h"
+#include "pack.h"
+#include "remote.h"
+#include "object_path.h"
+#include "set_index.h"
+#include "log_index.h"
+#include "repo_fixture.h"
+
+#define COUNT 40
+#define DIMS 16
+
+static char hashes[COUNT][65];
+
+static void store_vectors(void) {
+    float values[COUNT * DIMS];
+    const char* sources[COUNT];
+    char names[COUNT][32];
+    for (int n = 0; n < COUNT; n++) {
+        for (int i = 0; i < DIMS; i++)
+            values[n * DIMS + i] = (float)(n * DIMS + i) * 0.25f;
+        snprintf(names[n], sizeof(names[n]), "doc%d.txt", n);
+        sources[n] = names[n];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, COUNT, DIMS, sources, "m", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static void object_file(const char* hash, char* path, size_t size) {
+    assert(eb_object_path(".", hash, "raw", path, size) == 0);
+}
+
+static unsigned progress_calls;
+static size_t progress_done;
+
+static void count_progress(void* ctx, size_t done, size_t total) {
+    (void)ctx;
+    assert(done <= total && done > progress_done);
+    progress_done = done;
+    progress_calls++;
+}
+
+static void run_fsck(unsigned threads, eb_fsck_report_t* report) {
+    eb_fsck_options_t options = { .threads = threads, .progress = count_progress };
+    progress_calls = 0;
+    progress_done = 0;
+    assert(eb_fsck(".", &options, report) == EB_SUCCESS);
+    assert(progress_done == report->loose + report->packed);
+}
+
+static const eb_fsck_problem_t* find_problem(const eb_fsck_report_t* report, eb_fsck_kind_t kind,
+                                             const char* hash) {
+    for (size_t i = 0; i < report->problem_count; i++) {
+        if (report->problems[i].kind == kind && strcmp(report->problems[i].hash, hash) == 0)
+            return &report->problems[i];
+    }
+    return NULL;
+}
+
+static void test_clean(void) {
+    printf("Testing a clean repository...\n");
+    fixture_repo(NULL);
+    store_vectors();
+
+    eb_fsck_report_t report;
+    run_fsck(4, &report);
+    assert(report.loose == COUNT && report.packed == 0 && report.bytes > 0);
+    assert(report.references == COUNT && report.sets == 1);
+    assert(report.problem_count == 0);
+    assert(progress_calls == 1);    /* One block */
+    eb_fsck_report_free(&report);
+
+    // Packed objects are read from the pack
+    eb_repack_result_t repacked;
+    assert(eb_pack_repack(".", NULL, NULL, NULL, NULL, &repacked) == EB_SUCCESS);
+    assert(repacked.objects_packed == COUNT);
+    run_fsck(2, &report);
+    assert(report.loose == 0 && report.packed == COUNT && report.problem_count == 0);
+    eb_fsck_report_free(&report);
+
+    fixture_cleanup();
+    printf("✓ Clean repository passed\n");
+}
+
+static void test_damage(void) {
+    printf("Testing damaged objects...\n");
+    fixture_repo(NULL);
+    store_vectors();
+    char path[PATH_MAX], other[PATH_MAX];
+
+    // A flipped byte past the header
+    object_file(hashes[1], path, sizeof(path));
+    FILE* f = fopen(path, "r+b");
+    assert(f != NULL);
+    long offset = (long)sizeof(eb_object_header_t) + 8;
+    assert(fseek(f, offset, SEEK_SET) == 0);
+    int c = fgetc(f);
+    assert(c != EOF && fseek(f, offset, SEEK_SET) == 0);
+    fputc(c ^ 0x5A, f);
+    fclose(f);
+
+    // An intact object stored under another name
+    char fake[65];
+    memset(fake, 'a', 64);
+    fake[64] = '\0';
+    object_file(hashes[2], path, sizeof(path));
+    object_file(fake, other, sizeof(other));
+    char command[2 * PATH_MAX + 16];
+    snprintf(command, sizeof(command), "mkdir -p $(dirname %s) && cp %s %s", other, path, other);
+    assert(system(command) == 0);
+
+    // A referenced object that is gone
+    object_file(hashes[3], path, sizeof(path));
+    assert(unlink(path) == 0);
+
+    // A stored norm that is not the vector's, which the content hash does not cover
+    object_file(hashes[4], path, sizeof(path));
+    f = fopen(path, "r+b");
+    assert(f != NULL);
+    float norm = 0.0f;
+    assert(fseek(f, -(long)sizeof(norm), SEEK_END) == 0 && fread(&norm, sizeof(norm), 1, f) == 1);
+    assert(norm > 0.0f);
+    norm *= 2.0f;
+    assert(fseek(f, -(long)sizeof(norm), SEEK_END) == 0 && fwrite(&norm, sizeof(norm), 1, f) == 1);
+    fclose(f);
+
+    eb_fsck_report_t report;
+    run_fsck(3, &report);
+    assert(report.loose == COUNT);
+    assert(report.problem_count == 4);
+    const eb_fsck_problem_t* p = find_problem(&report, EB_FSCK_CORRUPT, hashes[1]);
+    assert(p && p->status != EB_SUCCESS && strstr(p->where, ".embr/objects/") == p->where);
+    p = find_problem(&report, EB_FSCK_CORRUPT, hashes[4]);
+    assert(p && p->status == EB_ERROR_INVALID_DATA);
+    assert(find_problem(&report, EB_FSCK_MISNAMED, fake));
+    p = find_problem(&report, EB_FSCK_MISSING, hashes[3]);
+    assert(p && strcmp(p->where, ".embr/sets/main/index") == 0);
+    assert(report.counts[EB_FSCK_CORRUPT] == 2 && report.counts[EB_FSCK_MISSING] == 1);
+
+    // Sorted by kind
+    for (size_t i = 1; i < report.problem_count; i++)
+        assert(report.problems[i - 1].kind <= report.problems[i].kind);
+    eb_fsck_report_free(&report);
+
+    fixture_cleanup();
+    printf("✓ Damaged objects passed\n");
+}
+
+/* A removal as embr rm records it, with its object collected */
+static void remove_source(const char* source, const char* hash) {
+    eb_set_index_change_t change = { source, "m", NULL };
+    assert(eb_set_index_append(".", ".embr/sets/main/index", &change, 1) == EB_SUCCESS);
+    FILE* f = fopen(".embr/sets/main/log", "a");
+    assert(f != NULL);
+    fprintf(f, "%ld %s %s m\n", (long)time(NULL), EB_LOG_TOMBSTONE, source);
+    fclose(f);
+    char command[256];
+    snprintf(command, sizeof(command), "cd .embr/sets/main/refs/models && grep -v ' %s$' m > m.tmp; mv m.tmp m",
+             source);
+    assert(system(command) == 0);
+
+    char path[PATH_MAX];
+    object_file(hash, path, sizeof(path));
+    assert(unlink(path) == 0);
+}
+
+static void test_removed(void) {
+    printf("Testing removed sources...\n");
+    fixture_repo(NULL);
+    store_vectors();
+    remove_source("doc5.txt", hashes[5]);
+
+    // The log lines the tombstone ends are not references
+    eb_fsck_report_t report;
+    run_fsck(2, &report);
+    assert(report.loose == COUNT - 1 && report.references == COUNT - 1);
+    assert(report.problem_count == 0);
+    eb_fsck_report_free(&report);
+
+    fixture_cleanup();
+    printf("✓ Removed sources passed\n");
+}
+
+static void test_remote(void) {
+    printf("Testing the remote manifest check...\n");
+    fixture_repo(NULL);
+    store_vectors();
+
+    char url[PATH_MAX + 16], cwd[PATH_MAX];
+    assert(getcwd(cwd, sizeof(cwd)) != NULL);
+    snprintf(url, sizeof(url), "file://%s/remote", cwd);
+    assert(system("mkdir -p remote") == 0);
+    assert(eb_remote_init() == EB_SUCCESS);
+    assert(eb_remote_add("fsck-test", url, NULL, 0, false, "json") == EB_SUCCESS);
+
+    eb_fsck_options_t options = { .threads = 2, .remote = "fsck-test" };
+    eb_fsck_report_t report;
+
+    // A set never pushed is left alone
+    assert(eb_fsck(".", &options, &report) == EB_SUCCESS);
+    assert(report.remote_sets == 0 && report.problem_count == 0);
+    eb_fsck_report_free(&report);
+
+    // A manifest without one entry
+    eb_remote_have_t have = {0};
+    const char* listed[COUNT - 1];
+    for (int i = 1; i < COUNT; i++)
+        listed[i - 1] = hashes[i];
+    assert(eb_remote_have_add(&have, listed, COUNT - 1) == EB_SUCCESS);
+    assert(eb_remote_have_store("fsck-test", "sets/main", &have) == EB_SUCCESS);
+    eb_remote_have_free(&have);
+
+    assert(eb_fsck(".", &options, &report) == EB_SUCCESS);
+    assert(report.remote_sets == 1 && report.problem_count == 1);
+    assert(find_problem(&report, EB_FSCK_REMOTE_MISSING, hashes[0]));
+    eb_fsck_report_free(&report);
+
+    eb_remote_remove("fsck-test");
+    fixture_cleanup();
+    printf("✓ Remote manifest check passed\n");
+}
+
+int main(void) {
+    printf("Running fsck tests...\n");
+    test_clean();
+    test_damage();
+    test_removed();
+    test_remote();
+    printf("All fsck tests passed!\n");
+    return 0;
+}
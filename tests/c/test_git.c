@@ -0,0 +1,124 @@
+/*
+ * EmbeddingBridge - Git Metadata Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include "git_types.h"
+#include "repo_fixture.h"
+
+static void setup_repo(void) {
+    fixture_dir();
+    assert(system("mkdir -p dir/sub && git init -q . && git config user.name Tester && "
+                  "git config user.email tester@example.com && "
+                  "echo one > a.txt && echo two > dir/b.txt && echo three > dir/sub/c.txt && "
+                  "echo other > dir/other.txt && git add . && git commit -q -m initial") == 0);
+}
+
+static void cleanup_repo(void) {
+    eb_git_close();
+    fixture_cleanup();
+}
+
+/* Output of a git command, without the newline */
+static void git_output(const char* command, char* out, size_t size) {
+    FILE* fp = popen(command, "r");
+    assert(fp != NULL);
+    assert(fgets(out, (int)size, fp) != NULL);
+    pclose(fp);
+    out[strcspn(out, "\n")] = '\0';
+}
+
+static void test_metadata_many(void) {
+    printf("Testing batched metadata...\n");
+    setup_repo();
+    assert(system("echo changed > a.txt && echo new > d.txt") == 0);
+
+    const char* paths[] = {"dir/sub/c.txt", "a.txt", "d.txt", "dir/b.txt", "a.txt", "missing.txt"};
+    size_t count = sizeof(paths) / sizeof(paths[0]);
+    eb_git_metadata_t meta[6];
+    assert(eb_git_get_metadata_many(paths, count, meta) == EB_SUCCESS);
+
+    char head[64], blob[64];
+    git_output("git rev-parse HEAD", head, sizeof(head));
+    for (size_t i = 0; i < count; i++) {
+        assert(strcmp(meta[i].commit_id, head) == 0);
+        assert(strcmp(meta[i].author, "Tester <tester@example.com>") == 0);
+        assert(meta[i].commit_time > 0 && meta[i].branch[0] != '\0');
+    }
+
+    git_output("git rev-parse HEAD:dir/sub/c.txt", blob, sizeof(blob));
+    assert(strcmp(meta[0].blob_id, blob) == 0 && meta[0].is_tracked && !meta[0].is_modified);
+    git_output("git rev-parse HEAD:a.txt", blob, sizeof(blob));
+    assert(strcmp(meta[1].blob_id, blob) == 0 && meta[1].is_tracked && meta[1].is_modified);
+    assert(memcmp(&meta[4], &meta[1], sizeof(meta[1])) == 0);   /* Asked for twice */
+    git_output("git rev-parse HEAD:dir/b.txt", blob, sizeof(blob));
+    assert(strcmp(meta[3].blob_id, blob) == 0 && meta[3].is_tracked);
+    assert(meta[2].blob_id[0] == '\0' && !meta[2].is_tracked);
+    assert(meta[5].blob_id[0] == '\0' && !meta[5].is_tracked && !meta[5].is_modified);
+
+    // The single-file form agrees, from the same cached handle
+    eb_git_metadata_t* one = NULL;
+    assert(eb_git_get_metadata("dir/b.txt", &one) == EB_SUCCESS);
+    assert(memcmp(one, &meta[3], sizeof(*one)) == 0);
+    free(one);
+    assert(eb_git_get_metadata_many(NULL, 0, NULL) == EB_SUCCESS);
+    assert(eb_git_get_metadata_many(NULL, 1, meta) == EB_ERROR_INVALID_INPUT);
+
+    cleanup_repo();
+    printf("✓ Batched metadata passed\n");
+}
+
+static void test_file_at_ref(void) {
+    printf("Testing files at a ref...\n");
+    setup_repo();
+    assert(system("echo changed > dir/b.txt && git commit -q -am second") == 0);
+
+    char* content = NULL;
+    size_t length = 0;
+    assert(eb_git_get_file_at_ref("HEAD", "dir/b.txt", &content, &length) == EB_SUCCESS);
+    assert(length == 8 && strcmp(content, "changed\n") == 0);
+    free(content);
+    assert(eb_git_get_file_at_ref("HEAD~1", "dir/b.txt", &content, &length) == EB_SUCCESS);
+    assert(length == 4 && strcmp(content, "two\n") == 0);
+    free(content);
+
+    assert(eb_git_get_file_at_ref("HEAD", "dir", &content, &length) == EB_ERROR_GIT_OPERATION);
+    assert(eb_git_get_file_at_ref("HEAD", "nope.txt", &content, &length) == EB_ERROR_GIT_OPERATION);
+    assert(eb_git_get_file_at_ref("no-such-ref", "a.txt", &content, &length) == EB_ERROR_GIT_OPERATION);
+    assert(eb_git_is_valid_ref("HEAD~1") && !eb_git_is_valid_ref("no-such-ref"));
+
+    cleanup_repo();
+    printf("✓ Files at a ref passed\n");
+}
+
+static void test_outside(void) {
+    printf("Testing outside a repository...\n");
+    char saved_cwd[PATH_MAX];
+    assert(getcwd(saved_cwd, sizeof(saved_cwd)) != NULL);
+    assert(chdir("/") == 0);
+    const char* paths[] = {"a.txt"};
+    eb_git_metadata_t meta;
+    assert(eb_git_get_metadata_many(paths, 1, &meta) == EB_ERROR_NOT_GIT_REPO);
+    assert(chdir(saved_cwd) == 0);
+    printf("✓ Outside a repository passed\n");
+}
+
+int main(void) {
+    printf("Running git metadata tests...\n");
+    test_metadata_many();
+    test_file_at_ref();
+    test_outside();
+    printf("All git metadata tests passed!\n");
+    return 0;
+}
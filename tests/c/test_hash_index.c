@@ -0,0 +1,153 @@
+/*
+ * EmbeddingBridge - Object Hash Index Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "hash_index.h"
+#include "pack.h"
+#include "types.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define TEST_OBJECTS TEST_ROOT "/.embr/objects"
+#define TEST_INDEX TEST_ROOT "/.embr/" EB_HASH_INDEX_FILE
+
+static const char* HASHES[] = {
+    "12ab000000000000000000000000000000000000000000000000000000000000",
+    "12ac000000000000000000000000000000000000000000000000000000000000",
+    "9900000000000000000000000000000000000000000000000000000000000000",
+};
+#define HASH_COUNT (sizeof(HASHES) / sizeof(HASHES[0]))
+
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " TEST_OBJECTS " " TEST_ROOT "/.embr/metadata");
+}
+
+static void write_loose(const char* hash) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.raw", TEST_OBJECTS, hash);
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+
+    eb_object_header_t header = {
+        .magic = EB_VECTOR_MAGIC,
+        .version = EB_VERSION,
+        .obj_type = EB_OBJ_VECTOR,
+        .flags = 0,
+        .size = 64
+    };
+    assert(fwrite(&header, sizeof(header), 1, f) == 1);
+    assert(fwrite(hash, 64, 1, f) == 1);
+    fclose(f);
+}
+
+/* Move the objects directory mtime into the past so the index is persisted */
+static void age_objects_dir(void) {
+    struct timeval times[2];
+    gettimeofday(&times[0], NULL);
+    times[0].tv_sec -= 60;
+    times[1] = times[0];
+    assert(utimes(TEST_OBJECTS, times) == 0);
+}
+
+static void test_loose_resolution(void) {
+    printf("Testing loose object resolution...\n");
+    setup_repo();
+    for (size_t i = 0; i < HASH_COUNT; i++)
+        write_loose(HASHES[i]);
+    /* Sidecars and foreign files are not objects */
+    system("touch " TEST_OBJECTS "/9911111111111111111111111111111111111111111111111111111111111111.meta");
+    system("touch " TEST_OBJECTS "/12ab-not-a-hash.raw");
+
+    char full[65];
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12ab", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[0]) == 0);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "99", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[2]) == 0);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12a", full) == EB_ERROR_HASH_AMBIGUOUS);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12ad", full) == EB_ERROR_NOT_FOUND);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "ffff", full) == EB_ERROR_NOT_FOUND);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "xyz!", full) == EB_ERROR_NOT_FOUND);
+
+    printf("Loose resolution tests passed!\n");
+}
+
+static void test_index_persistence(void) {
+    printf("Testing index persistence and invalidation...\n");
+
+    age_objects_dir();
+    assert(eb_hash_index_rebuild(TEST_ROOT) == EB_SUCCESS);
+
+    struct stat st;
+    assert(stat(TEST_INDEX, &st) == 0);
+    assert((size_t)st.st_size == sizeof(eb_hash_index_header_t) + HASH_COUNT * 32);
+
+    char full[65];
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12ac", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[1]) == 0);
+
+    /* A new object changes the directory mtime and must be found */
+    const char* fresh = "12ad000000000000000000000000000000000000000000000000000000000000";
+    write_loose(fresh);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12ad", full) == EB_SUCCESS);
+    assert(strcmp(full, fresh) == 0);
+
+    /* A removed object must disappear from the results */
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.raw", TEST_OBJECTS, HASHES[2]);
+    assert(unlink(path) == 0);
+    age_objects_dir();
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "99", full) == EB_ERROR_NOT_FOUND);
+
+    printf("Persistence tests passed!\n");
+}
+
+static void test_packed_objects(void) {
+    printf("Testing resolution across loose and packed objects...\n");
+    setup_repo();
+    write_loose(HASHES[0]);
+    assert(eb_pack_repack(TEST_ROOT, NULL, NULL, NULL, NULL, NULL) == EB_SUCCESS);
+    write_loose(HASHES[1]);
+
+    char full[65];
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12ab", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[0]) == 0);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12ac", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[1]) == 0);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "12a", full) == EB_ERROR_HASH_AMBIGUOUS);
+
+    /* The same object loose and packed is not ambiguous */
+    write_loose(HASHES[0]);
+    eb_pack_set_t* packs = NULL;
+    assert(eb_pack_open(TEST_ROOT, &packs) == EB_SUCCESS);
+    assert(eb_hash_index_resolve(TEST_ROOT, packs, "12ab", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[0]) == 0);
+    eb_pack_close(packs);
+
+    printf("Packed resolution tests passed!\n");
+}
+
+int main(void) {
+    printf("Running hash index tests...\n");
+
+    test_loose_resolution();
+    test_index_persistence();
+    test_packed_objects();
+
+    fixture_cleanup();
+    printf("All hash index tests passed!\n");
+    return 0;
+}
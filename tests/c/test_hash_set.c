@@ -0,0 +1,134 @@
+/*
+ * EmbeddingBridge - Object Hash Set Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "hash_set.h"
+#include "hash_utils.h"
+
+#define ENTRY_COUNT 100000
+
+/* Deterministic, well spread test hashes */
+static void make_hash(uint32_t n, uint8_t hash[32]) {
+    uint64_t x = n * 0x9E3779B97F4A7C15ULL + 1;
+    for (int i = 0; i < 32; i += 8) {
+        x ^= x >> 31;
+        x *= 0xBF58476D1CE4E5B9ULL;
+        x ^= x >> 27;
+        memcpy(hash + i, &x, 8);
+    }
+}
+
+static int count_visit(const uint8_t hash[32], void* ctx) {
+    (void)hash;
+    (*(size_t*)ctx)++;
+    return 0;
+}
+
+static void test_add_contains(void) {
+    printf("Testing hash set add and lookup...\n");
+
+    eb_hash_set_t* set = NULL;
+    assert(eb_hash_set_create(0, &set) == EB_SUCCESS);
+    uint8_t hash[32];
+    bool added = false;
+
+    /* Grows well past its initial size */
+    for (uint32_t i = 0; i < ENTRY_COUNT; i++) {
+        make_hash(i, hash);
+        assert(eb_hash_set_add(set, hash, &added) == EB_SUCCESS && added);
+    }
+    assert(eb_hash_set_count(set) == ENTRY_COUNT);
+    make_hash(42, hash);
+    assert(eb_hash_set_add(set, hash, &added) == EB_SUCCESS && !added);
+    assert(eb_hash_set_count(set) == ENTRY_COUNT);
+
+    for (uint32_t i = 0; i < 2 * ENTRY_COUNT; i++) {
+        make_hash(i, hash);
+        assert(eb_hash_set_contains(set, hash) == (i < ENTRY_COUNT));
+    }
+
+    size_t visited = 0;
+    assert(eb_hash_set_foreach(set, count_visit, &visited) == 0);
+    assert(visited == ENTRY_COUNT);
+
+    /* Hex forms */
+    char hex[65];
+    make_hash(7, hash);
+    eb_hash_to_hex(hash, hex);
+    assert(eb_hash_set_contains_hex(set, hex));
+    assert(!eb_hash_set_contains_hex(set, "abc"));
+    assert(eb_hash_set_add_hex(set, "xyz", NULL) == EB_ERROR_INVALID_INPUT);
+    make_hash(ENTRY_COUNT, hash);
+    eb_hash_to_hex(hash, hex);
+    assert(eb_hash_set_add_hex(set, hex, &added) == EB_SUCCESS && added);
+
+    eb_hash_set_destroy(set);
+    printf("Hash set add and lookup tests passed!\n");
+}
+
+static void test_remove(void) {
+    printf("Testing hash set removal...\n");
+
+    eb_hash_set_t* set = NULL;
+    assert(eb_hash_set_create(1000, &set) == EB_SUCCESS);
+    uint8_t hash[32];
+
+    /* Colliding home slots: identical first 8 bytes, different tails */
+    for (uint32_t i = 0; i < 64; i++) {
+        memset(hash, 0, sizeof(hash));
+        hash[31] = (uint8_t)i;
+        hash[0] = (uint8_t)(i % 4);
+        assert(eb_hash_set_add(set, hash, NULL) == EB_SUCCESS);
+    }
+    for (uint32_t i = 0; i < 64; i += 2) {
+        memset(hash, 0, sizeof(hash));
+        hash[31] = (uint8_t)i;
+        hash[0] = (uint8_t)(i % 4);
+        assert(eb_hash_set_remove(set, hash));
+        assert(!eb_hash_set_remove(set, hash));
+    }
+    assert(eb_hash_set_count(set) == 32);
+    for (uint32_t i = 0; i < 64; i++) {
+        memset(hash, 0, sizeof(hash));
+        hash[31] = (uint8_t)i;
+        hash[0] = (uint8_t)(i % 4);
+        assert(eb_hash_set_contains(set, hash) == (i % 2 == 1));
+    }
+
+    for (uint32_t i = 0; i < 20000; i++) {
+        make_hash(i, hash);
+        assert(eb_hash_set_add(set, hash, NULL) == EB_SUCCESS);
+    }
+    for (uint32_t i = 0; i < 20000; i += 3) {
+        make_hash(i, hash);
+        assert(eb_hash_set_remove(set, hash));
+    }
+    for (uint32_t i = 0; i < 20000; i++) {
+        make_hash(i, hash);
+        assert(eb_hash_set_contains(set, hash) == (i % 3 != 0));
+    }
+
+    eb_hash_set_destroy(set);
+    printf("Hash set removal tests passed!\n");
+}
+
+int main(void) {
+    printf("Running hash set tests...\n");
+
+    test_add_contains();
+    test_remove();
+
+    printf("All hash set tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * EmbeddingBridge - Columnar Version History Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "history.h"
+#include "log_index.h"
+#include "repo_fixture.h"
+
+#define TEST_DIR "."
+#define TEST_LOG TEST_DIR "/log"
+#define LINE_COUNT 50000
+#define SOURCE_COUNT 500
+
+static const char* models[] = { "openai", "voyage", "cohere" };
+
+static void write_log(void) {
+    fixture_dir();
+    FILE* f = fopen(TEST_LOG, "w");
+    assert(f != NULL);
+    for (int i = 0; i < LINE_COUNT; i++)
+        fprintf(f, "%d %064x doc%d.txt %s\n", 1700000000 + i, i + 1, i % SOURCE_COUNT,
+                models[i % 3]);
+    fprintf(f, "%d %s doc7.txt openai\n", 1700000000 + LINE_COUNT, EB_LOG_TOMBSTONE);
+    fclose(f);
+}
+
+static void test_all_sources(void) {
+    printf("Testing full history columns...\n");
+
+    write_log();
+    eb_history_t* h = NULL;
+    assert(eb_history_load(TEST_LOG, NULL, &h) == EB_SUCCESS);
+    assert(h->count == LINE_COUNT + 1);
+    assert(h->model_count == 3 && h->source_count == SOURCE_COUNT);
+
+    /* Model usage: a pass over one column */
+    size_t per_model[3] = {0};
+    for (size_t i = 0; i < h->count; i++) {
+        if (!(h->flags[i] & EB_HISTORY_REMOVED))
+            per_model[h->model_ids[i]]++;
+    }
+    assert(per_model[eb_history_model_id(h, "openai")] == (LINE_COUNT + 2) / 3);
+    assert(per_model[eb_history_model_id(h, "cohere")] == LINE_COUNT / 3);
+    assert(eb_history_model_id(h, "missing") == UINT32_MAX);
+
+    size_t row = 12345;
+    assert(h->timestamps[row] == 1700000000 + (int64_t)row);
+    assert(strcmp(h->sources[h->source_ids[row]], "doc345.txt") == 0);
+    assert(h->hashes[row][31] == (uint8_t)((row + 1) & 0xFF));
+    assert(h->hashes[row][30] == (uint8_t)((row + 1) >> 8));
+
+    size_t last = h->count - 1;
+    assert(h->flags[last] & EB_HISTORY_REMOVED);
+    assert(h->source_ids[last] == eb_history_source_id(h, "doc7.txt"));
+    static const uint8_t zero[32];
+    assert(memcmp(h->hashes[last], zero, 32) == 0);
+
+    eb_history_free(h);
+    printf("✓ Full history columns passed\n");
+}
+
+static void test_one_source(void) {
+    printf("Testing single source history...\n");
+
+    write_log();
+    eb_history_t* h = NULL;
+    assert(eb_history_load(TEST_LOG, "doc7.txt", &h) == EB_SUCCESS);
+    assert(h->count == LINE_COUNT / SOURCE_COUNT + 1);
+    assert(h->source_count == 1);
+    for (size_t i = 1; i < h->count; i++)
+        assert(h->timestamps[i] > h->timestamps[i - 1]);
+    eb_history_free(h);
+
+    assert(eb_history_load(TEST_DIR "/missing", NULL, &h) == EB_SUCCESS);
+    assert(h->count == 0 && h->model_count == 0);
+    eb_history_free(h);
+
+    fixture_cleanup();
+    printf("✓ Single source history passed\n");
+}
+
+int main(void) {
+    printf("Running history tests...\n");
+    test_all_sources();
+    test_one_source();
+    printf("All history tests passed!\n");
+    return 0;
+}
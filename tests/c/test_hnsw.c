@@ -0,0 +1,408 @@
+/*
+ * EmbeddingBridge - HNSW Vector Index Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "hnsw.h"
+#include "set_index.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS 32
+#define COUNT 600
+#define OTHER_DIMS 16
+#define OTHER_COUNT 20
+#define K 10
+
+static float vectors[COUNT][DIMS];
+static uint64_t rng = 88172645463325252ull;
+
+static float next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (float)((rng >> 11) & 0xFFFFFF) / (float)0x1000000 - 0.5f;
+}
+
+/* Minimal .npy file around the values */
+static void write_npy(const char* path, const float* values, size_t count) {
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu,), }", count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    uint16_t header_size = (uint16_t)length;
+    assert(fwrite("\x93NUMPY\x01\x00", 1, 8, f) == 8);
+    assert(fwrite(&header_size, sizeof(header_size), 1, f) == 1);
+    assert(fwrite(header, 1, (size_t)length, f) == (size_t)length);
+    assert(fwrite(values, sizeof(float), count, f) == count);
+    fclose(f);
+}
+
+static void store_vector(const char* source, const char* model, const float* values,
+                         size_t dims, char hash[65]) {
+    write_npy("vector.npy", values, dims);
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "vector.npy", source, model, hash) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static void setup_repo(void) {
+    fixture_repo(NULL);
+
+    /* Clustered vectors, so the graph has structure to find */
+    float centers[16][DIMS];
+    for (int c = 0; c < 16; c++) {
+        for (int d = 0; d < DIMS; d++)
+            centers[c][d] = next_random();
+    }
+    for (int i = 0; i < COUNT; i++) {
+        for (int d = 0; d < DIMS; d++)
+            vectors[i][d] = centers[i % 16][d] + 0.3f * next_random();
+    }
+
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    for (int i = 0; i < COUNT; i++) {
+        char path[64], source[64];
+        snprintf(path, sizeof(path), "v%d.npy", i);
+        snprintf(source, sizeof(source), "doc%d.txt", i);
+        write_npy(path, vectors[i], DIMS);
+        assert(eb_store_batch_add(batch, path, source, "m1", NULL) == EB_SUCCESS);
+    }
+    for (int i = 0; i < OTHER_COUNT; i++) {
+        float other[OTHER_DIMS];
+        char path[64], source[64];
+        for (int d = 0; d < OTHER_DIMS; d++)
+            other[d] = next_random();
+        snprintf(path, sizeof(path), "w%d.npy", i);
+        snprintf(source, sizeof(source), "doc%d.txt", i);
+        write_npy(path, other, OTHER_DIMS);
+        assert(eb_store_batch_add(batch, path, source, "other@v2", NULL) == EB_SUCCESS);
+    }
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static float cosine_distance(const float* a, const float* b) {
+    double dot = 0, na = 0, nb = 0;
+    for (int d = 0; d < DIMS; d++) {
+        dot += (double)a[d] * b[d];
+        na += (double)a[d] * a[d];
+        nb += (double)b[d] * b[d];
+    }
+    return (float)(1.0 - dot / sqrt(na * nb));
+}
+
+/* Exact k nearest of the live vectors */
+static void brute_force(const float* query, const bool* live, int nearest[K]) {
+    float best[K];
+    for (int j = 0; j < K; j++) {
+        best[j] = INFINITY;
+        nearest[j] = -1;
+    }
+    for (int i = 0; i < COUNT; i++) {
+        if (!live[i])
+            continue;
+        float d = cosine_distance(query, vectors[i]);
+        for (int j = 0; j < K; j++) {
+            if (d < best[j]) {
+                memmove(&best[j + 1], &best[j], (K - 1 - j) * sizeof(float));
+                memmove(&nearest[j + 1], &nearest[j], (K - 1 - j) * sizeof(int));
+                best[j] = d;
+                nearest[j] = i;
+                break;
+            }
+        }
+    }
+}
+
+static int source_index(const char* source) {
+    int i = -1;
+    assert(sscanf(source, "doc%d.txt", &i) == 1);
+    return i;
+}
+
+/* Mean fraction of the exact neighbors found for random queries */
+static double recall(const eb_hnsw_t* index, const bool* live) {
+    size_t found = 0;
+    for (int q = 0; q < 50; q++) {
+        float query[DIMS];
+        for (int d = 0; d < DIMS; d++)
+            query[d] = vectors[(q * 7) % COUNT][d] + 0.2f * next_random();
+
+        int nearest[K];
+        brute_force(query, live, nearest);
+        eb_hnsw_match_t matches[K];
+        size_t count = 0;
+        assert(eb_hnsw_search(index, query, DIMS, K, 0, matches, &count) == EB_SUCCESS);
+        assert(count == K);
+        for (size_t i = 0; i < count; i++) {
+            assert(i == 0 || matches[i].distance >= matches[i - 1].distance);
+            int id = source_index(matches[i].source);
+            assert(live[id]);
+            for (int j = 0; j < K; j++)
+                found += nearest[j] == id;
+        }
+    }
+    return (double)found / (50.0 * K);
+}
+
+typedef struct {
+    size_t nodes;
+    size_t deleted;
+    uint32_t dims;
+    int graphs;
+} info_t;
+
+static int find_info(const eb_hnsw_info_t* info, void* ctx) {
+    info_t* out = ctx;
+    out->graphs++;
+    if (strcmp(info->model, "m1") == 0) {
+        out->nodes = info->nodes;
+        out->deleted = info->deleted;
+        out->dims = info->dims;
+    }
+    return 0;
+}
+
+static info_t graph_info(void) {
+    info_t info = { 0, 0, 0, 0 };
+    assert(eb_hnsw_foreach(".", find_info, &info) == EB_SUCCESS);
+    return info;
+}
+
+static void test_build_and_search(void) {
+    printf("Testing index build and search...\n");
+
+    eb_hnsw_build_result_t result;
+    assert(eb_hnsw_build(".", NULL, &result) == EB_SUCCESS);
+    assert(result.models == 2);
+    assert(result.vectors == COUNT + OTHER_COUNT);
+    assert(result.skipped == 0);
+
+    info_t info = graph_info();
+    assert(info.graphs == 2 && info.nodes == COUNT && info.deleted == 0 && info.dims == DIMS);
+
+    eb_hnsw_t* index = NULL;
+    assert(eb_hnsw_open(".", "m1", &index) == EB_SUCCESS);
+    bool live[COUNT];
+    for (int i = 0; i < COUNT; i++)
+        live[i] = true;
+    double r = recall(index, live);
+    printf("  recall@%d: %.3f\n", K, r);
+    assert(r >= 0.9);
+
+    /* A stored vector finds itself, with the hash the set index records */
+    eb_hnsw_match_t matches[K];
+    size_t count = 0;
+    assert(eb_hnsw_search(index, vectors[123], DIMS, 1, 0, matches, &count) == EB_SUCCESS);
+    assert(count == 1 && strcmp(matches[0].source, "doc123.txt") == 0);
+    assert(fabsf(matches[0].distance) < 1e-5f);
+    eb_set_index_t* set_index = NULL;
+    char hash[65];
+    assert(eb_set_index_open_current(".", &set_index) == EB_SUCCESS);
+    assert(eb_set_index_lookup(set_index, "doc123.txt", "m1", hash) == EB_SUCCESS);
+    assert(strcmp(hash, matches[0].hash) == 0);
+    eb_set_index_close(set_index);
+
+    assert(eb_hnsw_search(index, vectors[0], OTHER_DIMS, K, 0, matches, &count) ==
+           EB_ERROR_DIMENSION_MISMATCH);
+    eb_hnsw_close(index);
+
+    /* Model names are escaped in file names */
+    assert(eb_hnsw_open(".", "other@v2", &index) == EB_SUCCESS);
+    eb_hnsw_close(index);
+    assert(eb_hnsw_open(".", "missing", &index) == EB_ERROR_NOT_FOUND);
+
+    printf("Index build and search tests passed!\n");
+}
+
+static void test_incremental_updates(void) {
+    printf("Testing incremental index updates...\n");
+
+    /* Storing again replaces the entry of the source */
+    float moved[DIMS];
+    for (int d = 0; d < DIMS; d++)
+        moved[d] = -vectors[5][d];
+    char hash[65];
+    store_vector("doc5.txt", "m1", moved, DIMS, hash);
+
+    info_t info = graph_info();
+    assert(info.nodes == COUNT + 1 && info.deleted == 1);
+
+    eb_hnsw_t* index = NULL;
+    eb_hnsw_match_t matches[K];
+    size_t count = 0;
+    assert(eb_hnsw_open(".", "m1", &index) == EB_SUCCESS);
+    assert(eb_hnsw_search(index, moved, DIMS, 1, 0, matches, &count) == EB_SUCCESS);
+    assert(count == 1 && strcmp(matches[0].source, "doc5.txt") == 0);
+    assert(strcmp(matches[0].hash, hash) == 0);
+    assert(eb_hnsw_search(index, vectors[5], DIMS, K, 0, matches, &count) == EB_SUCCESS);
+    for (size_t i = 0; i < count; i++)
+        assert(strcmp(matches[i].source, "doc5.txt") != 0);
+    eb_hnsw_close(index);
+
+    /* Removing a source for every model touches both graphs */
+    eb_set_index_change_t removal = { "doc7.txt", NULL, NULL };
+    assert(eb_set_index_apply_current(".", &removal, 1) == EB_SUCCESS);
+    assert(eb_hnsw_apply(".", &removal, 1) == EB_SUCCESS);
+    info = graph_info();
+    assert(info.deleted == 2);
+
+    assert(eb_hnsw_open(".", "m1", &index) == EB_SUCCESS);
+    assert(eb_hnsw_search(index, vectors[7], DIMS, K, 0, matches, &count) == EB_SUCCESS);
+    assert(count == K);
+    for (size_t i = 0; i < count; i++)
+        assert(strcmp(matches[i].source, "doc7.txt") != 0);
+    eb_hnsw_close(index);
+
+    printf("Incremental index update tests passed!\n");
+}
+
+static int count_vector_files(void) {
+    DIR* dir = opendir(".embr/sets/main/" EB_HNSW_DIR);
+    assert(dir != NULL);
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        count += len > 4 && strcmp(entry->d_name + len - 4, ".vec") == 0;
+    }
+    closedir(dir);
+    return count;
+}
+
+static void test_compaction(void) {
+    printf("Testing index compaction...\n");
+
+    /* Removing most of a graph rebuilds it from the live rows */
+    bool live[COUNT];
+    eb_set_index_change_t* changes = malloc(COUNT * sizeof(*changes));
+    char (*sources)[32] = malloc(COUNT * sizeof(*sources));
+    assert(changes && sources);
+    size_t change_count = 0;
+    for (int i = 0; i < COUNT; i++) {
+        live[i] = i % 3 == 0;
+        if (!live[i] && i != 7) {
+            snprintf(sources[change_count], sizeof(sources[0]), "doc%d.txt", i);
+            changes[change_count] = (eb_set_index_change_t){ sources[change_count], "m1", NULL };
+            change_count++;
+        }
+    }
+    assert(eb_set_index_apply_current(".", changes, change_count) == EB_SUCCESS);
+    assert(eb_hnsw_apply(".", changes, change_count) == EB_SUCCESS);
+    free(changes);
+    free(sources);
+
+    info_t info = graph_info();
+    assert(info.deleted == 0 && info.nodes == COUNT / 3);
+    assert(count_vector_files() == 2);
+
+    eb_hnsw_t* index = NULL;
+    assert(eb_hnsw_open(".", "m1", &index) == EB_SUCCESS);
+    double r = recall(index, live);
+    printf("  recall@%d after compaction: %.3f\n", K, r);
+    assert(r >= 0.9);
+    eb_hnsw_close(index);
+
+    /* A rebuild starts a new generation and drops the old rows */
+    assert(eb_hnsw_build(".", NULL, NULL) == EB_SUCCESS);
+    assert(count_vector_files() == 2);
+    info = graph_info();
+    assert(info.nodes == COUNT / 3 && info.deleted == 0);
+
+    printf("Index compaction tests passed!\n");
+}
+
+typedef struct {
+    const eb_hnsw_t* index;
+    int first;
+    char results[20][K][65];
+} search_job_t;
+
+static void* search_worker(void* arg) {
+    search_job_t* job = arg;
+    for (int q = 0; q < 20; q++) {
+        eb_hnsw_match_t matches[K];
+        size_t count = 0;
+        if (eb_hnsw_search(job->index, vectors[job->first + q], DIMS, K, 32, matches, &count) != EB_SUCCESS)
+            return NULL;
+        for (size_t i = 0; i < count; i++)
+            memcpy(job->results[q][i], matches[i].hash, 65);
+    }
+    return NULL;
+}
+
+static void test_concurrent_search(void) {
+    printf("Testing concurrent searches...\n");
+
+    eb_hnsw_t* index = NULL;
+    assert(eb_hnsw_open(".", "m1", &index) == EB_SUCCESS);
+
+    static search_job_t expected, jobs[4];
+    expected.index = index;
+    expected.first = 0;
+    search_worker(&expected);
+
+    pthread_t threads[4];
+    for (int t = 0; t < 4; t++) {
+        memset(&jobs[t], 0, sizeof(jobs[t]));
+        jobs[t].index = index;
+        assert(pthread_create(&threads[t], NULL, search_worker, &jobs[t]) == 0);
+    }
+    for (int t = 0; t < 4; t++) {
+        assert(pthread_join(threads[t], NULL) == 0);
+        assert(memcmp(jobs[t].results, expected.results, sizeof(expected.results)) == 0);
+    }
+    eb_hnsw_close(index);
+
+    printf("Concurrent search tests passed!\n");
+}
+
+static void test_drop(void) {
+    printf("Testing index removal...\n");
+
+    assert(eb_hnsw_drop(".") == EB_SUCCESS);
+    assert(eb_hnsw_foreach(".", find_info, &(info_t){ 0, 0, 0, 0 }) == EB_ERROR_NOT_FOUND);
+
+    /* Without an index, updates are not tracked */
+    char hash[65];
+    store_vector("doc9.txt", "m1", vectors[9], DIMS, hash);
+    assert(access(".embr/sets/main/" EB_HNSW_DIR, F_OK) != 0);
+
+    printf("Index removal tests passed!\n");
+}
+
+int main(void) {
+    printf("Running HNSW index tests...\n");
+
+    setup_repo();
+    test_build_and_search();
+    test_incremental_updates();
+    test_compaction();
+    test_concurrent_search();
+    test_drop();
+    fixture_cleanup();
+
+    printf("All HNSW index tests passed!\n");
+    return 0;
+}
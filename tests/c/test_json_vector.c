@@ -0,0 +1,175 @@
+/*
+ * EmbeddingBridge - JSON Vector Encoding Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+#include "json_vector.h"
+
+static void check_format(float value, const char* expected) {
+    char buf[EB_JSON_FLOAT_MAX + 1];
+    size_t len = eb_json_format_float(value, buf);
+    buf[len] = '\0';
+    if (strcmp(buf, expected) != 0) {
+        fprintf(stderr, "%.9g printed as %s, expected %s\n", (double)value, buf, expected);
+        assert(0);
+    }
+}
+
+static void test_format(void) {
+    printf("Testing shortest float printing...\n");
+    check_format(0.0f, "0");
+    check_format(-0.0f, "-0");
+    check_format(1.0f, "1");
+    check_format(0.1f, "0.1");
+    check_format(-0.25f, "-0.25");
+    check_format(100.0f, "100");
+    check_format(123456789.0f, "123456790");
+    check_format(1e9f, "1e9");
+    check_format(0.0001f, "0.0001");
+    check_format(1e-5f, "1e-5");
+    check_format(3.4028235e38f, "3.4028235e38");
+    check_format(1.17549435e-38f, "1.1754944e-38");
+    check_format(1.4e-45f, "1e-45");
+    check_format(NAN, "null");
+    check_format(INFINITY, "null");
+
+    /* Every printed value reads back to the same bits, fast path or not */
+    uint32_t state = 12345;
+    char buf[EB_JSON_FLOAT_MAX];
+    for (int i = 0; i < 1000000; i++) {
+        state = state * 1664525u + 1013904223u;
+        float value;
+        memcpy(&value, &state, sizeof(value));
+        if (!isfinite(value))
+            continue;
+        size_t len = eb_json_format_float(value, buf);
+        assert(len <= EB_JSON_FLOAT_MAX);
+        float back;
+        assert(eb_json_parse_float(buf, len, &back) == len);
+        assert(memcmp(&back, &value, sizeof(value)) == 0);
+    }
+    printf("Float printing tests passed!\n");
+}
+
+static void test_parse(void) {
+    printf("Testing float parsing...\n");
+    float value;
+    assert(eb_json_parse_float("1.5E-3,", 7, &value) == 6 && value == 1.5e-3f);
+    assert(eb_json_parse_float("-12", 3, &value) == 3 && value == -12.0f);
+    assert(eb_json_parse_float("null", 4, &value) == 4 && isnan(value));
+    /* More digits than the fast path takes */
+    const char* digits = "0.100000001490116119384765625";
+    assert(eb_json_parse_float(digits, strlen(digits), &value) == strlen(digits) && value == 0.1f);
+    assert(eb_json_parse_float("abc", 3, &value) == 0);
+    assert(eb_json_parse_float("1.", 2, &value) == 0);
+
+    float* values = NULL;
+    size_t count = 0, consumed = 0;
+    const char* array = " [1, -0.5 ,2e2] trailing";
+    assert(eb_json_parse_floats(array, strlen(array), &values, &count, &consumed) == EB_SUCCESS);
+    assert(count == 3 && values[0] == 1.0f && values[1] == -0.5f && values[2] == 200.0f);
+    assert(array[consumed - 1] == ']');
+    free(values);
+
+    assert(eb_json_parse_floats("[]", 2, &values, &count, NULL) == EB_SUCCESS && count == 0);
+    free(values);
+    assert(eb_json_parse_floats("[1 2]", 5, &values, &count, NULL) == EB_ERROR_INVALID_FORMAT);
+    assert(eb_json_parse_floats("[1,]", 4, &values, &count, NULL) == EB_ERROR_INVALID_FORMAT);
+    assert(eb_json_parse_floats("[1,2", 4, &values, &count, NULL) == EB_ERROR_INVALID_FORMAT);
+    printf("Float parsing tests passed!\n");
+}
+
+struct collected {
+    char* data;
+    size_t size;
+    size_t calls;
+};
+
+static int collect(void* ctx, const void* data, size_t size) {
+    struct collected* out = ctx;
+    out->data = realloc(out->data, out->size + size + 1);
+    assert(out->data);
+    memcpy(out->data + out->size, data, size);
+    out->size += size;
+    out->data[out->size] = '\0';
+    out->calls++;
+    return 0;
+}
+
+static void test_ndjson(void) {
+    printf("Testing NDJSON vectors...\n");
+    struct collected out = {0};
+    eb_json_writer_t* writer = NULL;
+    assert(eb_json_writer_open(collect, &out, &writer) == EB_SUCCESS);
+
+    float small[] = { 0.5f, -1.0f, 0.1f };
+    eb_json_vector_t first = { "abc", "dir/\"doc\".txt", "model", 1700000000, small, 3 };
+    assert(eb_json_writer_add(writer, &first) == EB_SUCCESS);
+
+    /* A vector spanning several output blocks */
+    size_t dims = 20000;
+    float* large = malloc(dims * sizeof(float));
+    assert(large);
+    for (size_t i = 0; i < dims; i++)
+        large[i] = (float)i / 3.0f - 1000.0f;
+    eb_json_vector_t second = { "def", NULL, NULL, 0, large, dims };
+    assert(eb_json_writer_add(writer, &second) == EB_SUCCESS);
+
+    size_t bytes = 0;
+    assert(eb_json_writer_close(writer, &bytes) == EB_SUCCESS);
+    assert(bytes == out.size && out.calls > 1);
+
+    const char* expected = "{\"id\":\"abc\",\"source\":\"dir/\\\"doc\\\".txt\",\"model\":\"model\","
+                           "\"timestamp\":1700000000,\"values\":[0.5,-1,0.1]}\n";
+    assert(strncmp(out.data, expected, strlen(expected)) == 0);
+
+    /* Both lines read back */
+    char* newline = strchr(out.data, '\n');
+    eb_json_vector_t vector;
+    assert(eb_json_vector_parse(out.data, (size_t)(newline - out.data), &vector) == EB_SUCCESS);
+    assert(strcmp(vector.id, "abc") == 0 && strcmp(vector.source, "dir/\"doc\".txt") == 0);
+    assert(strcmp(vector.model, "model") == 0 && vector.timestamp == 1700000000);
+    assert(vector.dims == 3 && memcmp(vector.values, small, sizeof(small)) == 0);
+    eb_json_vector_clear(&vector);
+
+    char* rest = newline + 1;
+    assert(eb_json_vector_parse(rest, out.size - (size_t)(rest - out.data), &vector) == EB_SUCCESS);
+    assert(strcmp(vector.id, "def") == 0 && !vector.source && !vector.model);
+    assert(vector.dims == dims && memcmp(vector.values, large, dims * sizeof(float)) == 0);
+    eb_json_vector_clear(&vector);
+
+    /* Unknown members are skipped, order does not matter */
+    const char* other = "{\"values\": [1, 2], \"extra\": {\"a\": [\"]\", 3]}, \"id\": \"x\\u0041\"}";
+    assert(eb_json_vector_parse(other, strlen(other), &vector) == EB_SUCCESS);
+    assert(strcmp(vector.id, "xA") == 0 && vector.dims == 2 && vector.values[1] == 2.0f);
+    eb_json_vector_clear(&vector);
+
+    const char* no_id = "{\"values\":[1]}";
+    assert(eb_json_vector_parse(no_id, strlen(no_id), &vector) == EB_ERROR_INVALID_FORMAT);
+    const char* broken = "{\"id\":\"x\",\"values\":[1,}";
+    assert(eb_json_vector_parse(broken, strlen(broken), &vector) == EB_ERROR_INVALID_FORMAT);
+
+    free(large);
+    free(out.data);
+    printf("NDJSON vector tests passed!\n");
+}
+
+int main(void) {
+    printf("Running JSON vector tests...\n");
+    test_format();
+    test_parse();
+    test_ndjson();
+    printf("All JSON vector tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * EmbeddingBridge - Log Index Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "log_index.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define TEST_LOG TEST_ROOT "/log"
+#define TEST_LOG_INDEX TEST_LOG EB_LOG_INDEX_SUFFIX
+
+static const char* HASH_A = "aa00000000000000000000000000000000000000000000000000000000000001";
+static const char* HASH_B = "bb00000000000000000000000000000000000000000000000000000000000002";
+
+static void append_line(const char* mode, long timestamp, const char* hash,
+                        const char* source, const char* model) {
+    FILE* f = fopen(TEST_LOG, mode);
+    assert(f != NULL);
+    if (model)
+        fprintf(f, "%ld %s %s %s\n", timestamp, hash, source, model);
+    else
+        fprintf(f, "%ld %s %s\n", timestamp, hash, source);
+    fclose(f);
+}
+
+static eb_log_index_header_t read_header(void) {
+    eb_log_index_header_t header;
+    FILE* f = fopen(TEST_LOG_INDEX, "rb");
+    assert(f != NULL);
+    assert(fread(&header, sizeof(header), 1, f) == 1);
+    fclose(f);
+    return header;
+}
+
+struct collected {
+    long timestamps[16];
+    char models[16][32];
+    int count;
+};
+
+static int collect(const eb_log_entry_t* entry, void* ctx) {
+    struct collected* c = ctx;
+    assert(c->count < 16);
+    c->timestamps[c->count] = (long)entry->timestamp;
+    snprintf(c->models[c->count], sizeof(c->models[0]), "%s", entry->model);
+    c->count++;
+    return 0;
+}
+
+static struct collected history(const char* source) {
+    struct collected c;
+    memset(&c, 0, sizeof(c));
+    assert(eb_log_foreach_source(TEST_LOG, source, collect, &c) == EB_SUCCESS);
+    return c;
+}
+
+static void test_append(void) {
+    printf("Testing log index appends...\n");
+
+    fixture_dir();
+    struct collected c = history("a.txt");
+    assert(c.count == 0);
+
+    append_line("w", 100, HASH_A, "a.txt", "openai");
+    append_line("a", 101, HASH_B, "b.txt", "openai");
+    append_line("a", 102, HASH_B, "a.txt", "voyage");
+    assert(eb_log_index_update(TEST_LOG) == EB_SUCCESS);
+
+    eb_log_index_header_t header = read_header();
+    assert(header.magic == EB_LOG_INDEX_MAGIC);
+    assert(header.record_count == 3 && header.key_count == 2);
+
+    c = history("a.txt");
+    assert(c.count == 2);
+    assert(c.timestamps[0] == 100 && strcmp(c.models[0], "openai") == 0);
+    assert(c.timestamps[1] == 102 && strcmp(c.models[1], "voyage") == 0);
+
+    /* Lines appended by other writers are picked up on the next read */
+    append_line("a", 103, HASH_A, "a.txt", NULL);
+    c = history("a.txt");
+    assert(c.count == 3);
+    assert(c.timestamps[2] == 103 && c.models[2][0] == '\0');
+    assert(read_header().record_count == 4);
+
+    /* A trailing partial line waits for its newline */
+    FILE* f = fopen(TEST_LOG, "a");
+    fputs("104 ", f);
+    fclose(f);
+    assert(history("a.txt").count == 3);
+    f = fopen(TEST_LOG, "a");
+    fprintf(f, "%s a.txt openai\n", HASH_B);
+    fclose(f);
+    c = history("a.txt");
+    assert(c.count == 4 && c.timestamps[3] == 104);
+
+    fixture_cleanup();
+    printf("Log index append tests passed!\n");
+}
+
+static void test_rebuild(void) {
+    printf("Testing log index rebuild...\n");
+
+    fixture_dir();
+    append_line("w", 100, HASH_A, "a.txt", "openai");
+    append_line("a", 101, HASH_A, "a.txt", "openai");
+    assert(history("a.txt").count == 2);
+
+    /* A rewritten log no longer matches the fingerprint */
+    append_line("w", 200, HASH_B, "b.txt", "openai");
+    append_line("a", 201, HASH_B, "a.txt", "cohere");
+    append_line("a", 202, HASH_B, "c.txt", "openai");
+    struct collected c = history("a.txt");
+    assert(c.count == 1 && c.timestamps[0] == 201);
+    assert(read_header().record_count == 3);
+
+    /* A damaged index is rebuilt from the log */
+    eb_log_index_header_t header = read_header();
+    header.slot_count = 3;
+    FILE* f = fopen(TEST_LOG_INDEX, "r+b");
+    assert(f != NULL);
+    assert(fwrite(&header, sizeof(header), 1, f) == 1);
+    fclose(f);
+    c = history("a.txt");
+    assert(c.count == 1 && strcmp(c.models[0], "cohere") == 0);
+    assert(read_header().slot_count >= 1024);
+
+    fixture_cleanup();
+    printf("Log index rebuild tests passed!\n");
+}
+
+static void test_growth(void) {
+    printf("Testing log index growth...\n");
+
+    fixture_dir();
+    append_line("w", 1, HASH_A, "docs/0.txt", "openai");
+    assert(eb_log_index_update(TEST_LOG) == EB_SUCCESS);
+    uint64_t slots = read_header().slot_count;
+
+    FILE* f = fopen(TEST_LOG, "a");
+    assert(f != NULL);
+    for (int i = 1; i < 2000; i++)
+        fprintf(f, "%d %s docs/%d.txt openai\n", i, HASH_A, i);
+    fclose(f);
+    append_line("a", 5000, HASH_B, "docs/7.txt", "voyage");
+    assert(eb_log_index_update(TEST_LOG) == EB_SUCCESS);
+
+    eb_log_index_header_t header = read_header();
+    assert(header.slot_count > slots);
+    assert(header.key_count == 2000 && header.record_count == 2001);
+
+    struct collected c = history("docs/7.txt");
+    assert(c.count == 2);
+    assert(c.timestamps[0] == 7 && c.timestamps[1] == 5000);
+    assert(history("docs/1999.txt").count == 1);
+    assert(history("docs/2000.txt").count == 0);
+
+    fixture_cleanup();
+    printf("Log index growth tests passed!\n");
+}
+
+static int take_three(const eb_log_entry_t* entry, void* ctx) {
+    struct collected* c = ctx;
+    collect(entry, ctx);
+    return c->count == 3;
+}
+
+static void test_reverse(void) {
+    printf("Testing newest-first log reads...\n");
+
+    fixture_dir();
+    /* Enough lines to span several backward read chunks */
+    FILE* f = fopen(TEST_LOG, "w");
+    assert(f != NULL);
+    for (int i = 1; i <= 5000; i++)
+        fprintf(f, "%d %s docs/%d.txt openai\n", i, HASH_A, i % 3);
+    fclose(f);
+    append_line("a", 9000, HASH_B, "docs/1.txt", NULL);
+
+    struct collected c;
+    memset(&c, 0, sizeof(c));
+    assert(eb_log_foreach_reverse(TEST_LOG, "docs/1.txt", take_three, &c) == EB_SUCCESS);
+    assert(c.count == 3);
+    assert(c.timestamps[0] == 9000 && strcmp(c.models[0], "") == 0);
+    assert(c.timestamps[1] == 4999 && c.timestamps[2] == 4996);
+
+    /* Without a usable index the log is read backwards from its end */
+    assert(unlink(TEST_LOG_INDEX) == 0);
+    assert(mkdir(TEST_LOG_INDEX, 0755) == 0);
+    memset(&c, 0, sizeof(c));
+    assert(eb_log_foreach_reverse(TEST_LOG, "docs/2.txt", take_three, &c) == EB_SUCCESS);
+    assert(c.count == 3);
+    assert(c.timestamps[0] == 5000 && c.timestamps[1] == 4997 && c.timestamps[2] == 4994);
+    assert(rmdir(TEST_LOG_INDEX) == 0);
+
+    memset(&c, 0, sizeof(c));
+    assert(eb_log_foreach_reverse(TEST_LOG, NULL, take_three, &c) == EB_SUCCESS);
+    assert(c.count == 3);
+    assert(c.timestamps[0] == 9000 && c.timestamps[1] == 5000 && c.timestamps[2] == 4999);
+
+    fixture_cleanup();
+    printf("Newest-first log read tests passed!\n");
+}
+
+int main(void) {
+    printf("Running log index tests...\n");
+
+    test_append();
+    test_rebuild();
+    test_growth();
+    test_reverse();
+
+    printf("All log index tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * EmbeddingBridge - In-Memory Vector Table Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "memory_store.h"
+#include "store.h"
+
+#define ROW_COUNT 100000
+#define DIMS 7
+
+static void fill(float* values, uint32_t n) {
+    for (int i = 0; i < DIMS; i++)
+        values[i] = (float)n + (float)i / 10.0f;
+}
+
+static void test_table(void) {
+    printf("Testing memory table add and lookup...\n");
+
+    eb_memory_table_t* table = NULL;
+    assert(eb_memory_table_create(&table) == EB_SUCCESS);
+
+    float values[DIMS];
+    eb_embedding_t embedding = { values, DIMS, false, -1.0f };
+    char text[32];
+    eb_metadata_t meta = { "text", text, 0, NULL };
+
+    /* Grows well past every initial size */
+    for (uint32_t i = 0; i < ROW_COUNT; i++) {
+        fill(values, i);
+        snprintf(text, sizeof(text), "doc %u", i);
+        uint32_t row;
+        const char* model = i % 3 == 0 ? "openai" : "voyage";
+        assert(eb_memory_table_add(table, 1000 + i, 0, &embedding, &meta, model, i, &row) ==
+               EB_SUCCESS);
+        assert(row == i);
+    }
+    assert(eb_memory_table_count(table) == ROW_COUNT);
+
+    for (uint32_t i = 0; i < ROW_COUNT; i += 7) {
+        uint32_t row = eb_memory_table_find(table, 1000 + i);
+        assert(row == i);
+        snprintf(text, sizeof(text), "doc %u", i);
+        assert(eb_memory_table_find_text(table, text) == i);
+
+        eb_stored_vector_t stored;
+        eb_memory_table_row(table, row, &stored);
+        fill(values, i);
+        assert(stored.id == 1000 + i && stored.timestamp == i);
+        assert(memcmp(stored.embedding->values, values, sizeof(values)) == 0);
+        assert(((uintptr_t)stored.embedding->values & 63) == 0);
+        assert(strcmp(stored.metadata->value, text) == 0);
+        assert(strcmp(stored.model_version, i % 3 == 0 ? "openai" : "voyage") == 0);
+    }
+    assert(eb_memory_table_find(table, 7) == EB_MEMORY_NO_ROW);
+    assert(eb_memory_table_find_text(table, "missing") == EB_MEMORY_NO_ROW);
+
+    /* Model names are interned */
+    eb_stored_vector_t a, b;
+    eb_memory_table_row(table, 0, &a);
+    eb_memory_table_row(table, 3, &b);
+    assert(a.model_version == b.model_version);
+
+    /* A second row with an id becomes the newest and links back */
+    fill(values, 1);
+    snprintf(text, sizeof(text), "doc 5");
+    uint32_t row;
+    assert(eb_memory_table_add(table, 1005, 1005, &embedding, &meta, "openai", 0, &row) ==
+           EB_SUCCESS);
+    assert(eb_memory_table_find(table, 1005) == row);
+    assert(eb_memory_table_find_text(table, "doc 5") == row);
+    assert(eb_memory_table_prev(table, row) == 5);
+    assert(eb_memory_table_prev(table, 5) == EB_MEMORY_NO_ROW);
+
+    eb_memory_table_destroy(table);
+    printf("✓ Memory table add and lookup passed\n");
+}
+
+static void test_store(void) {
+    printf("Testing memory store vectors...\n");
+
+    eb_store_config_t config = {0};
+    config.root_path = ":memory:";
+    eb_store_t* store = NULL;
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+
+    float values[DIMS];
+    fill(values, 3);
+    eb_embedding_t embedding = { values, DIMS, false, -1.0f };
+    eb_metadata_t lang = { "lang", "en", 0, NULL };
+    eb_metadata_t meta = { "text", "hello", 0, &lang };
+
+    uint64_t first, second;
+    assert(eb_store_vector(store, &embedding, &meta, "openai", &first) == EB_SUCCESS);
+    values[0] = 42.0f;
+    assert(eb_store_vector(store, &embedding, &meta, "openai", &second) == EB_SUCCESS);
+    assert(first == second);
+
+    /* The newest version is returned, with its metadata */
+    eb_embedding_t* out = NULL;
+    eb_metadata_t* out_meta = NULL;
+    assert(eb_get_vector(store, second, &out, &out_meta) == EB_SUCCESS);
+    assert(out->dimensions == DIMS && out->values[0] == 42.0f);
+    assert(strcmp(out_meta->key, "text") == 0 && strcmp(out_meta->next->value, "en") == 0);
+    eb_destroy_embedding(out);
+    eb_metadata_destroy(out_meta);
+
+    eb_stored_vector_t* versions = NULL;
+    size_t count = 0;
+    assert(eb_get_vector_evolution(store, first, 0, UINT64_MAX, &versions, &count) ==
+           EB_SUCCESS);
+    assert(count == 2);
+    assert(versions[0].embedding->values[0] == 3.0f);
+    assert(versions[1].embedding->values[0] == 42.0f);
+    eb_destroy_stored_vectors(versions, count);
+
+    assert(eb_get_vector(store, 12345, &out, NULL) == EB_ERROR_NOT_FOUND);
+    eb_store_destroy(store);
+    printf("✓ Memory store vectors passed\n");
+}
+
+int main(void) {
+    printf("Running memory store tests...\n");
+    test_table();
+    test_store();
+    printf("All memory store tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * EmbeddingBridge - Flat Metadata Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "metadata.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define VERSION_COUNT 2000
+
+static void test_blob(void) {
+    printf("Testing flat metadata...\n");
+
+    eb_arena_t arena;
+    eb_arena_init(&arena, 0);
+    const char* keys[] = { "source", "model", "empty" };
+    const char* values[] = { "doc.txt", "openai-3", "" };
+    eb_meta_blob_t* blob = eb_meta_blob_build(&arena, keys, values, 3);
+    assert(blob != NULL);
+    assert(eb_meta_blob_count(blob) == 3);
+    assert(strcmp(eb_meta_blob_key(blob, 1), "model") == 0);
+    assert(strcmp(eb_meta_blob_value(blob, 1), "openai-3") == 0);
+    assert(strcmp(eb_meta_blob_get(blob, "empty"), "") == 0);
+    assert(eb_meta_blob_get(blob, "missing") == NULL);
+
+    /* The list view shares the blob's strings */
+    eb_metadata_t* list = eb_meta_blob_list(&arena, blob);
+    assert(list && list->next && list->next->next && !list->next->next->next);
+    assert(list->next->value == eb_meta_blob_value(blob, 1));
+
+    /* And a list converts back, malloc'd without an arena */
+    eb_meta_blob_t* copy = eb_meta_blob_from_list(NULL, list);
+    assert(copy && copy->size == blob->size);
+    assert(memcmp(copy, blob, blob->size) == 0);
+    free(copy);
+
+    assert(eb_meta_blob_count(eb_meta_blob_build(&arena, NULL, NULL, 0)) == 0);
+    eb_arena_destroy(&arena);
+    printf("✓ Flat metadata passed\n");
+}
+
+static void test_history(void) {
+    printf("Testing version history metadata...\n");
+
+    fixture_repo(NULL);
+    FILE* f = fopen(".embr/sets/main/log", "w");
+    assert(f != NULL);
+    for (int i = 0; i < VERSION_COUNT; i++)
+        fprintf(f, "%d %064x %s %s\n", 1700000000 + i, i, i % 2 ? "a.txt" : "b.txt",
+                i % 3 ? "openai" : "voyage");
+    fclose(f);
+
+    eb_stored_vector_t* versions = NULL;
+    size_t count = 0;
+    assert(get_version_history(".", "a.txt", &versions, &count) == EB_SUCCESS);
+    assert(count == VERSION_COUNT / 2);
+    for (size_t i = 0; i < count; i++) {
+        int n = 2 * (int)i + 1;
+        char hash[65], timestamp[32];
+        snprintf(hash, sizeof(hash), "%064x", n);
+        snprintf(timestamp, sizeof(timestamp), "%d", 1700000000 + n);
+
+        assert(versions[i].timestamp == (uint64_t)(1700000000 + n));
+        assert(strcmp(versions[i].model_version, n % 3 ? "openai" : "voyage") == 0);
+        assert(strcmp(eb_meta_blob_get(versions[i].meta, "hash"), hash) == 0);
+        assert(strcmp(eb_meta_blob_get(versions[i].meta, "timestamp"), timestamp) == 0);
+        assert(strcmp(versions[i].metadata->key, "hash") == 0);
+        assert(strcmp(versions[i].metadata->next->next->value, versions[i].model_version) == 0);
+        assert(versions[i].next == (i + 1 < count ? &versions[i + 1] : NULL));
+    }
+    eb_destroy_stored_vectors(versions, count);
+
+    assert(get_version_history(".", "none.txt", &versions, &count) == EB_SUCCESS);
+    assert(count == 0 && versions == NULL);
+
+    fixture_cleanup();
+    printf("✓ Version history metadata passed\n");
+}
+
+int main(void) {
+    printf("Running flat metadata tests...\n");
+    test_blob();
+    test_history();
+    printf("All flat metadata tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * EmbeddingBridge - k-NN Neighborhood Preservation Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+#include "neighborhood.h"
+#include "distance.h"
+
+/* Enough rows and dimensions to span several query blocks and candidate tiles */
+#define COUNT    600
+#define OLD_DIMS 256
+#define NEW_DIMS 96
+#define K        10
+
+static float* random_matrix(size_t count, size_t dims, unsigned* seed) {
+    float* m = malloc(count * dims * sizeof(float));
+    assert(m != NULL);
+    for (size_t i = 0; i < count * dims; i++)
+        m[i] = (float)rand_r(seed) / (float)RAND_MAX * 2.0f - 1.0f;
+    return m;
+}
+
+/* Distance to every other row, computed the same way, then fully sorted */
+struct ranked {
+    float dist;
+    size_t index;
+};
+
+static int compare_ranked(const void* a, const void* b) {
+    const struct ranked* x = a;
+    const struct ranked* y = b;
+    if (x->dist != y->dist)
+        return x->dist < y->dist ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static void brute_force_knn(const float* m, size_t dims, eb_knn_metric_t metric,
+                            size_t query, size_t* out) {
+    struct ranked* all = malloc(COUNT * sizeof(*all));
+    assert(all != NULL);
+    const float* q = m + query * dims;
+    float q_norm = eb_dot(q, q, dims);
+    size_t n = 0;
+    for (size_t j = 0; j < COUNT; j++) {
+        if (j == query)
+            continue;
+        const float* c = m + j * dims;
+        float c_norm = eb_dot(c, c, dims);
+        float dot = eb_dot(q, c, dims);
+        float dist;
+        if (metric == EB_KNN_COSINE) {
+            dist = 1.0f - dot * (1.0f / sqrtf(q_norm)) * (1.0f / sqrtf(c_norm));
+        } else {
+            dist = q_norm + c_norm - 2.0f * dot;
+            if (dist < 0.0f)
+                dist = 0.0f;
+        }
+        all[n++] = (struct ranked){ dist, j };
+    }
+    qsort(all, n, sizeof(*all), compare_ranked);
+    for (size_t i = 0; i < K; i++)
+        out[i] = all[i].index;
+    free(all);
+}
+
+static float reference_score(const float* old_m, const float* new_m, eb_knn_metric_t metric,
+                             size_t query) {
+    size_t a[K], b[K];
+    brute_force_knn(old_m, OLD_DIMS, metric, query, a);
+    brute_force_knn(new_m, NEW_DIMS, metric, query, b);
+    size_t shared = 0;
+    for (size_t i = 0; i < K; i++)
+        for (size_t j = 0; j < K; j++)
+            if (a[i] == b[j])
+                shared++;
+    return (float)shared / (float)K;
+}
+
+static void test_matches_brute_force(void) {
+    printf("Testing k-NN preservation against brute force...\n");
+
+    unsigned seed = 11;
+    float* old_m = random_matrix(COUNT, OLD_DIMS, &seed);
+    float* new_m = random_matrix(COUNT, NEW_DIMS, &seed);
+
+    /* Make the new model partly agree with the old one */
+    for (size_t i = 0; i < COUNT; i++)
+        for (size_t d = 0; d < NEW_DIMS; d++)
+            new_m[i * NEW_DIMS + d] = 0.7f * old_m[i * OLD_DIMS + d] + 0.3f * new_m[i * NEW_DIMS + d];
+
+    eb_matrix_t old_set = { old_m, OLD_DIMS };
+    eb_matrix_t new_set = { new_m, NEW_DIMS };
+    const eb_knn_metric_t metrics[] = { EB_KNN_COSINE, EB_KNN_L2 };
+    float* scores = malloc(COUNT * sizeof(float));
+    assert(scores != NULL);
+
+    for (size_t m = 0; m < 2; m++) {
+        eb_knn_options_t options = { K, metrics[m], 1 };
+        float mean = -1.0f;
+        assert(eb_knn_preservation(&old_set, &new_set, COUNT, &options, scores, &mean) == EB_SUCCESS);
+
+        double total = 0.0;
+        for (size_t i = 0; i < COUNT; i++) {
+            assert(scores[i] == reference_score(old_m, new_m, metrics[m], i));
+            total += scores[i];
+        }
+        assert(fabs(total / COUNT - mean) < 1e-6);
+        assert(mean > 0.0f && mean < 1.0f);
+
+        /* Any number of workers gives the same scores and the same mean */
+        const unsigned threads[] = { 0, 3, 64 };
+        float* parallel = malloc(COUNT * sizeof(float));
+        assert(parallel != NULL);
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            float parallel_mean = -1.0f;
+            options.threads = threads[t];
+            assert(eb_knn_preservation(&old_set, &new_set, COUNT, &options, parallel, &parallel_mean) == EB_SUCCESS);
+            assert(memcmp(parallel, scores, COUNT * sizeof(float)) == 0);
+            assert(parallel_mean == mean);
+        }
+        free(parallel);
+        printf("  %s: mean preservation %.3f\n", metrics[m] == EB_KNN_COSINE ? "cosine" : "l2", mean);
+    }
+
+    free(scores);
+    free(old_m);
+    free(new_m);
+    printf("Brute force comparison tests passed!\n");
+}
+
+static void test_identical_sets(void) {
+    printf("Testing k-NN preservation of identical sets...\n");
+
+    unsigned seed = 3;
+    float* m = random_matrix(COUNT, NEW_DIMS, &seed);
+    eb_matrix_t set = { m, NEW_DIMS };
+    eb_knn_options_t options = { K, EB_KNN_COSINE, 0 };
+    float mean = 0.0f;
+    assert(eb_knn_preservation(&set, &set, COUNT, &options, NULL, &mean) == EB_SUCCESS);
+    assert(mean == 1.0f);
+
+    /* Zero vectors and ties still give a full, deterministic neighbor list */
+    memset(m, 0, 20 * NEW_DIMS * sizeof(float));
+    float scores[20];
+    options.k = 19;
+    assert(eb_knn_preservation(&set, &set, 20, &options, scores, NULL) == EB_SUCCESS);
+    for (int i = 0; i < 20; i++)
+        assert(scores[i] == 1.0f);
+
+    options.metric = EB_KNN_L2;
+    options.k = 20;
+    assert(eb_knn_preservation(&set, &set, 20, &options, NULL, &mean) == EB_ERROR_INVALID_INPUT);
+    options.k = 0;
+    assert(eb_knn_preservation(&set, &set, 20, &options, NULL, &mean) == EB_ERROR_INVALID_INPUT);
+    assert(eb_knn_preservation(&set, &set, 20, NULL, NULL, &mean) == EB_ERROR_INVALID_INPUT);
+
+    free(m);
+    printf("Identical set tests passed!\n");
+}
+
+/* Callers in several threads, each with its own workers */
+struct caller {
+    const eb_matrix_t* old_set;
+    const eb_matrix_t* new_set;
+    float scores[COUNT];
+};
+
+static void* call_preservation(void* arg) {
+    struct caller* c = arg;
+    eb_knn_options_t options = { K, EB_KNN_L2, 2 };
+    assert(eb_knn_preservation(c->old_set, c->new_set, COUNT, &options, c->scores, NULL) == EB_SUCCESS);
+    return NULL;
+}
+
+static void test_concurrent_callers(void) {
+    printf("Testing concurrent k-NN preservation calls...\n");
+
+    unsigned seed = 5;
+    float* old_m = random_matrix(COUNT, OLD_DIMS, &seed);
+    float* new_m = random_matrix(COUNT, NEW_DIMS, &seed);
+    eb_matrix_t old_set = { old_m, OLD_DIMS };
+    eb_matrix_t new_set = { new_m, NEW_DIMS };
+
+    static struct caller callers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        callers[i].old_set = &old_set;
+        callers[i].new_set = &new_set;
+        assert(pthread_create(&threads[i], NULL, call_preservation, &callers[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        assert(pthread_join(threads[i], NULL) == 0);
+    for (int i = 1; i < 4; i++)
+        assert(memcmp(callers[i].scores, callers[0].scores, sizeof(callers[0].scores)) == 0);
+
+    free(old_m);
+    free(new_m);
+    printf("Concurrent call tests passed!\n");
+}
+
+int main(void) {
+    printf("Running k-NN preservation tests...\n");
+
+    test_matches_brute_force();
+    test_identical_sets();
+    test_concurrent_callers();
+
+    printf("All k-NN preservation tests passed!\n");
+    return 0;
+}
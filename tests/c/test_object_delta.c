@@ -0,0 +1,271 @@
+/*
+ * EmbeddingBridge - Delta Object Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include "object_delta.h"
+#include "store.h"
+#include "gc.h"
+#include "repo_fixture.h"
+
+#define VALUE_COUNT 1536
+
+static void setup_repo(bool delta) {
+    char config[256];
+    snprintf(config, sizeof(config), "[storage]\n\tcompression = true\n\tfilter = shuffle\n\tdelta = %s\n",
+             delta ? "true" : "false");
+    fixture_repo(config);
+}
+
+/* Version k of a document's embedding: the same direction, slightly moved */
+static void make_values(float* values, int version) {
+    for (int i = 0; i < VALUE_COUNT; i++)
+        values[i] = 0.05f * sinf((float)i * 0.37f) + 0.0004f * (float)version * cosf((float)i * 1.91f);
+}
+
+static void store_version(int version, char hash[65]) {
+    float values[VALUE_COUNT];
+    make_values(values, version);
+    FILE* f = fopen("input.bin", "wb");
+    assert(f != NULL);
+    assert(fwrite(values, sizeof(float), VALUE_COUNT, f) == VALUE_COUNT);
+    fclose(f);
+
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "input.bin", "a.txt", "openai", hash) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+/* Map a stored version and check it reads back exactly */
+static void check_version(eb_store_t* store, const char* hash, int version,
+                          uint32_t* flags, uint32_t* depth, size_t* record_size) {
+    float values[VALUE_COUNT];
+    make_values(values, version);
+    eb_object_view_t view;
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    assert(view.size == sizeof(values) && memcmp(view.data, values, view.size) == 0);
+    *flags = view.header.flags;
+    *depth = view.delta_depth;
+    *record_size = view.record_size;
+    eb_object_unmap(&view);
+}
+
+static int count_delta(const char* hash, const char* base, void* ctx) {
+    assert(strlen(hash) == 64 && strlen(base) == 64);
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static void test_xor(void) {
+    printf("Testing delta XOR...\n");
+    uint8_t a[37], b[37], d[37];
+    for (int i = 0; i < 37; i++) {
+        a[i] = (uint8_t)(i * 13 + 1);
+        b[i] = (uint8_t)(i * 7 + 5);
+    }
+    eb_delta_xor(d, a, b, sizeof(a));
+    for (int i = 0; i < 37; i++)
+        assert(d[i] == (uint8_t)(a[i] ^ b[i]));
+    eb_delta_xor(d, d, b, sizeof(d));
+    assert(memcmp(d, a, sizeof(a)) == 0);
+    printf("✓ Delta XOR passed\n");
+}
+
+static void test_records(void) {
+    printf("Testing delta records...\n");
+    setup_repo(true);
+    int count = 0;
+    assert(eb_delta_foreach(".", count_delta, &count) == EB_SUCCESS && count == 0);
+
+    char a[65], b[65];
+    memset(a, 'a', 64);
+    memset(b, 'b', 64);
+    a[64] = b[64] = '\0';
+    assert(eb_delta_record(".", a, b) == EB_SUCCESS);
+    assert(eb_delta_record(".", b, "short") == EB_ERROR_INVALID_INPUT);
+
+    /* A line cut short is skipped */
+    FILE* f = fopen(EB_DELTA_FILE, "a");
+    assert(f != NULL);
+    fputs("cccc", f);
+    fclose(f);
+    assert(eb_delta_foreach(".", count_delta, &count) == EB_SUCCESS && count == 1);
+    fixture_cleanup();
+    printf("✓ Delta records passed\n");
+}
+
+/* Record size of every version stored whole, in a repository without deltas */
+static void full_sizes(size_t* sizes, int versions) {
+    setup_repo(false);
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    for (int v = 0; v < versions; v++) {
+        char hash[65];
+        uint32_t flags, depth;
+        store_version(v, hash);
+        check_version(store, hash, v, &flags, &depth, &sizes[v]);
+        assert(!(flags & EB_FLAG_DELTA));
+    }
+    eb_store_destroy(store);
+    fixture_cleanup();
+}
+
+static void test_chain(void) {
+    printf("Testing delta chains...\n");
+    size_t full[EB_DELTA_MAX_DEPTH + 3];
+    full_sizes(full, EB_DELTA_MAX_DEPTH + 3);
+
+    setup_repo(true);
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+
+    /* The first version has nothing to build on */
+    char hashes[EB_DELTA_MAX_DEPTH + 3][65];
+    uint32_t flags, depth;
+    size_t size;
+    store_version(0, hashes[0]);
+    check_version(store, hashes[0], 0, &flags, &depth, &size);
+    assert(!(flags & EB_FLAG_DELTA) && depth == 0 && size == full[0]);
+
+    /* Then one delta per version until a keyframe restarts the chain */
+    for (int v = 1; v <= EB_DELTA_MAX_DEPTH + 2; v++) {
+        store_version(v, hashes[v]);
+        check_version(store, hashes[v], v, &flags, &depth, &size);
+        if (v == EB_DELTA_MAX_DEPTH + 1) {
+            assert(!(flags & EB_FLAG_DELTA) && depth == 0);
+        } else {
+            uint32_t expected = v <= EB_DELTA_MAX_DEPTH ? (uint32_t)v : 1;
+            assert((flags & EB_FLAG_DELTA) && depth == expected);
+            /* Deltas are only kept when they beat the same version stored whole */
+            assert(size < full[v]);
+        }
+    }
+
+    /* read_object rebuilds too; exports are self-contained */
+    void* data = NULL;
+    size_t data_size = 0;
+    eb_object_header_t header;
+    assert(read_object(store, hashes[3], &data, &data_size, &header) == EB_SUCCESS);
+    float values[VALUE_COUNT];
+    make_values(values, 3);
+    assert(data_size == sizeof(values) && memcmp(data, values, data_size) == 0);
+    free(data);
+    assert(eb_object_export(store, hashes[3], &data, &data_size) == EB_SUCCESS);
+    memcpy(&header, data, sizeof(header));
+    assert(!(header.flags & EB_FLAG_DELTA) && (header.flags & EB_FLAG_COMPRESSED));
+    free(data);
+
+    int count = 0;
+    assert(eb_delta_foreach(".", count_delta, &count) == EB_SUCCESS);
+    assert(count == EB_DELTA_MAX_DEPTH + 1);
+    eb_store_destroy(store);
+    fixture_cleanup();
+    printf("✓ Delta chains passed\n");
+}
+
+static void test_disabled(void) {
+    printf("Testing storage without deltas...\n");
+    setup_repo(false);
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    char first[65], second[65];
+    uint32_t flags, depth;
+    size_t size;
+    store_version(0, first);
+    store_version(1, second);
+    check_version(store, second, 1, &flags, &depth, &size);
+    assert(!(flags & EB_FLAG_DELTA) && depth == 0);
+    assert(access(EB_DELTA_FILE, F_OK) != 0);
+    eb_store_destroy(store);
+    fixture_cleanup();
+    printf("✓ Storage without deltas passed\n");
+}
+
+static void test_failed_write(void) {
+    printf("Testing deltas that fail to write...\n");
+    setup_repo(true);
+    char base[65];
+    store_version(0, base);
+
+    /* Objects are written through temp, which now cannot hold files */
+    system("rm -rf .embr/objects/temp && touch .embr/objects/temp");
+    float values[VALUE_COUNT];
+    make_values(values, 1);
+    FILE* f = fopen("input.bin", "wb");
+    assert(f != NULL);
+    assert(fwrite(values, sizeof(float), VALUE_COUNT, f) == VALUE_COUNT);
+    fclose(f);
+    eb_store_batch_t* batch = NULL;
+    char hash[65];
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "input.bin", "a.txt", "openai", hash) != EB_SUCCESS);
+    eb_store_batch_abort(batch);
+
+    /* No record is left for an object that was never stored */
+    int count = 0;
+    assert(eb_delta_foreach(".", count_delta, &count) == EB_SUCCESS && count == 0);
+
+    system("rm -f .embr/objects/temp && mkdir .embr/objects/temp");
+    store_version(1, hash);
+    assert(eb_delta_foreach(".", count_delta, &count) == EB_SUCCESS && count == 1);
+    fixture_cleanup();
+    printf("✓ Deltas that fail to write passed\n");
+}
+
+static void test_gc_keeps_bases(void) {
+    printf("Testing gc of delta bases...\n");
+    setup_repo(true);
+    char base[65], delta[65];
+    store_version(0, base);
+    store_version(1, delta);
+
+    /* Only the delta is referenced now */
+    FILE* f = fopen(".embr/sets/main/log", "w");
+    assert(f != NULL);
+    fprintf(f, "1700000000 %s a.txt openai\n", delta);
+    fclose(f);
+    system("rm -f .embr/sets/main/log.idx .embr/sets/main/refs/models/*");
+    system("find .embr/objects -type f -exec touch -d '2 days ago' {} +");
+
+    eb_gc_result_t result;
+    assert(gc_run("now", false, &result) == EB_SUCCESS);
+
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    uint32_t flags, depth;
+    size_t size;
+    check_version(store, delta, 1, &flags, &depth, &size);
+    assert((flags & EB_FLAG_DELTA) && depth == 1);
+    eb_store_destroy(store);
+    fixture_cleanup();
+    printf("✓ Gc of delta bases passed\n");
+}
+
+int main(void) {
+    printf("Running delta object tests...\n");
+    test_xor();
+    test_records();
+    test_chain();
+    test_disabled();
+    test_failed_write();
+    test_gc_keeps_bases();
+    printf("All delta object tests passed!\n");
+    return 0;
+}
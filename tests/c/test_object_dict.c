@@ -0,0 +1,176 @@
+/*
+ * EmbeddingBridge - Compression Dictionary Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include "store.h"
+#include "compress.h"
+#include "object_dict.h"
+#include "object_path.h"
+#include "repo_fixture.h"
+
+#define VALUE_COUNT 384
+
+static void setup_repo(void) {
+    fixture_repo("[storage]\n\tcompression = true\n\tcompression_level = 3\n");
+}
+
+/* Vectors drawn from a small value set, like quantized embeddings */
+static void make_values(int seed, float* values) {
+    for (int i = 0; i < VALUE_COUNT; i++)
+        values[i] = (float)(((i * 7 + seed * 13) % 23) - 11) * 0.125f;
+    values[0] = (float)seed;  /* Keep every vector distinct */
+}
+
+static void store_vectors(int first, int count, char (*hashes)[65]) {
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    for (int i = 0; i < count; i++) {
+        float values[VALUE_COUNT];
+        make_values(first + i, values);
+        FILE* f = fopen("input.bin", "wb");
+        assert(f != NULL);
+        assert(fwrite(values, sizeof(float), VALUE_COUNT, f) == VALUE_COUNT);
+        fclose(f);
+
+        char source[32];
+        snprintf(source, sizeof(source), "doc%d.txt", first + i);
+        assert(eb_store_batch_add(batch, "input.bin", source, "openai", hashes[i]) == EB_SUCCESS);
+    }
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static eb_store_t* open_store(void) {
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    return store;
+}
+
+static void check_object(eb_store_t* store, const char* hash, int seed, uint32_t dict_id) {
+    float expected[VALUE_COUNT];
+    make_values(seed, expected);
+
+    eb_object_view_t view;
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    assert(view.header.flags & EB_FLAG_COMPRESSED);
+    assert(EB_FLAG_DICT_ID(view.header.flags) == dict_id);
+    assert(view.size == sizeof(expected) && memcmp(view.data, expected, view.size) == 0);
+    eb_object_unmap(&view);
+}
+
+static void test_train_and_store(void) {
+    printf("Testing dictionary training...\n");
+
+    setup_repo();
+    char hashes[64][65];
+    store_vectors(0, 4, hashes);
+
+    /* Too few vectors to train on */
+    assert(eb_object_dict_train(".", NULL, NULL) == EB_ERROR_NOT_FOUND);
+    assert(eb_object_dictionary(".") == 0);
+
+    store_vectors(4, 60, hashes + 4);
+    eb_dict_train_options_t options = { 0, 4096 };
+    eb_dict_train_result_t result;
+    assert(eb_object_dict_train(".", &options, &result) == EB_SUCCESS);
+    assert(result.id == 1 && result.samples == 64);
+    assert(result.dict_size > 0 && result.dict_size <= 4096);
+    assert(eb_object_dictionary(".") == 1);
+    assert(access(".embr/dicts/1.zdict", F_OK) == 0);
+
+    /* New vectors use the dictionary, older ones keep decoding without it */
+    char fresh[1][65];
+    store_vectors(100, 1, fresh);
+    eb_store_t* store = open_store();
+    check_object(store, fresh[0], 100, 1);
+    check_object(store, hashes[0], 0, 0);
+
+    /* Exported records no longer need the dictionary */
+    void* record = NULL;
+    size_t record_size = 0;
+    assert(eb_object_export(store, fresh[0], &record, &record_size) == EB_SUCCESS);
+    eb_object_header_t header;
+    memcpy(&header, record, sizeof(header));
+    assert(EB_FLAG_DICT_ID(header.flags) == 0 && (header.flags & EB_FLAG_COMPRESSED));
+    assert(header.flags & EB_FLAG_NORM);  /* The norm still trails the payload */
+    void* decoded = NULL;
+    size_t decoded_size = 0;
+    assert(eb_decompress_zstd((uint8_t*)record + sizeof(header),
+                              record_size - sizeof(header) - sizeof(float),
+                              &decoded, &decoded_size) == EB_SUCCESS);
+    assert(decoded_size == header.size);
+    free(decoded);
+    free(record);
+
+    /* Retraining picks the next ID and leaves old objects readable */
+    assert(eb_object_dict_train(".", &options, &result) == EB_SUCCESS);
+    assert(result.id == 2 && eb_object_dictionary(".") == 2);
+    check_object(store, fresh[0], 100, 1);
+    eb_store_destroy(store);
+
+    /* A clone without the dictionary reports it missing instead of misreading */
+    system("mkdir copy && cp -r .embr copy && rm copy/.embr/dicts/1.zdict");
+    char copy_root[PATH_MAX];
+    assert(realpath("copy", copy_root) != NULL);
+    eb_store_config_t config = { .root_path = copy_root };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    eb_object_view_t view;
+    assert(eb_object_map(store, fresh[0], 0, &view) == EB_ERROR_NOT_FOUND);
+    eb_store_destroy(store);
+
+    fixture_cleanup();
+    printf("Dictionary training tests passed!\n");
+}
+
+static void* roundtrip_thread(void* arg) {
+    int seed = *(int*)arg;
+    float values[VALUE_COUNT];
+    make_values(seed, values);
+    for (int i = 0; i < 50; i++) {
+        void* compressed = NULL;
+        void* decoded = NULL;
+        size_t compressed_size = 0, decoded_size = 0;
+        assert(eb_compress_zstd(values, sizeof(values), &compressed, &compressed_size, 3) == EB_SUCCESS);
+        assert(eb_decompress_zstd(compressed, compressed_size, &decoded, &decoded_size) == EB_SUCCESS);
+        assert(decoded_size == sizeof(values) && memcmp(decoded, values, decoded_size) == 0);
+        free(compressed);
+        free(decoded);
+    }
+    return NULL;
+}
+
+static void test_thread_contexts(void) {
+    printf("Testing per-thread compression contexts...\n");
+
+    pthread_t threads[4];
+    int seeds[4] = {1, 2, 3, 4};
+    for (int i = 0; i < 4; i++)
+        assert(pthread_create(&threads[i], NULL, roundtrip_thread, &seeds[i]) == 0);
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    printf("Per-thread compression context tests passed!\n");
+}
+
+int main(void) {
+    printf("Running compression dictionary tests...\n");
+
+    test_train_and_store();
+    test_thread_contexts();
+
+    printf("All compression dictionary tests passed!\n");
+    return 0;
+}
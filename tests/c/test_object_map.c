@@ -0,0 +1,345 @@
+/*
+ * EmbeddingBridge - Object Map Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include "store.h"
+#include "distance.h"
+#include "pack.h"
+#include "object_path.h"
+#include "repo_fixture.h"
+
+#define VALUE_COUNT 64
+
+static void setup_repo(bool compression) {
+    char config[256];
+    snprintf(config, sizeof(config), "[storage]\n\tcompression = %s\n", compression ? "true" : "false");
+    fixture_repo(config);
+}
+
+static void store_values(const char* source, float seed, char hash[65]) {
+    float values[VALUE_COUNT];
+    for (int i = 0; i < VALUE_COUNT; i++)
+        values[i] = seed;
+
+    FILE* f = fopen("input.bin", "wb");
+    assert(f != NULL);
+    assert(fwrite(values, sizeof(float), VALUE_COUNT, f) == VALUE_COUNT);
+    fclose(f);
+
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "input.bin", source, "openai", hash) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static eb_store_t* open_store(void) {
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    return store;
+}
+
+static void check_values(const eb_object_view_t* view, float seed) {
+    assert(view->size == VALUE_COUNT * sizeof(float));
+    for (int i = 0; i < VALUE_COUNT; i++) {
+        float value;
+        memcpy(&value, (const uint8_t*)view->data + i * sizeof(float), sizeof(value));
+        assert(value == seed);
+    }
+}
+
+static void check_read_parity(eb_store_t* store, const char* hash, const eb_object_view_t* view) {
+    void* data = NULL;
+    size_t size = 0;
+    eb_object_header_t header;
+    assert(read_object(store, hash, &data, &size, &header) == EB_SUCCESS);
+    assert(size == view->size && memcmp(data, view->data, size) == 0);
+    assert(header.flags == view->header.flags);
+    free(data);
+}
+
+static void test_uncompressed(void) {
+    printf("Testing uncompressed object maps...\n");
+
+    setup_repo(false);
+    assert(!eb_object_compression("."));
+    char hash[65];
+    store_values("a.txt", 1.5f, hash);
+
+    /* The payload is read in place from the mapped file */
+    eb_store_t* store = open_store();
+    eb_object_view_t view;
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    assert(view.map_base != NULL && view.buffer == NULL);
+    assert(!(view.header.flags & EB_FLAG_COMPRESSED));
+    assert(view.data == (const uint8_t*)view.record + sizeof(eb_object_header_t));
+    check_values(&view, 1.5f);
+    check_read_parity(store, hash, &view);
+    eb_object_unmap(&view);
+    assert(view.map_base == NULL && view.data == NULL);
+
+    /* Packed records map the same way, at an unaligned offset */
+    eb_store_destroy(store);
+    assert(eb_pack_repack(".", NULL, NULL, NULL, NULL, NULL) == EB_SUCCESS);
+    store = open_store();
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    assert(view.buffer == NULL);
+    check_values(&view, 1.5f);
+    eb_object_unmap(&view);
+
+    assert(eb_object_map(store, "ff00000000000000000000000000000000000000000000000000000000000000",
+                         0, &view) == EB_ERROR_NOT_FOUND);
+    eb_store_destroy(store);
+
+    fixture_cleanup();
+    printf("Uncompressed object map tests passed!\n");
+}
+
+static void test_compressed(void) {
+    printf("Testing compressed object maps...\n");
+
+    setup_repo(true);
+    assert(eb_object_compression("."));
+    char hash[65];
+    store_values("a.txt", 2.5f, hash);
+
+    eb_store_t* store = open_store();
+    eb_object_view_t view;
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    assert(view.header.flags & EB_FLAG_COMPRESSED);
+    assert(view.buffer != NULL && view.data == view.buffer);
+    check_values(&view, 2.5f);
+    check_read_parity(store, hash, &view);
+    eb_object_unmap(&view);
+
+    /* Raw views leave the stored bytes alone */
+    assert(eb_object_map(store, hash, EB_OBJECT_MAP_RAW, &view) == EB_SUCCESS);
+    assert(view.buffer == NULL);
+    assert(view.header.magic == EB_VECTOR_MAGIC);
+    assert(view.size == view.record_size - sizeof(eb_object_header_t) - sizeof(float));
+    assert(view.size < VALUE_COUNT * sizeof(float));
+    assert(view.norm == 2.5f * 8.0f);
+    eb_object_unmap(&view);
+
+    /* A damaged object still maps raw, but not decoded */
+    eb_store_destroy(store);
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), ".embr/objects/%s.raw", hash);
+    FILE* f = fopen(path, "r+b");
+    assert(f != NULL);
+    assert(fwrite("XXXX", 1, 4, f) == 4);
+    fclose(f);
+    store = open_store();
+    assert(eb_object_map(store, hash, 0, &view) != EB_SUCCESS);
+    assert(eb_object_map(store, hash, EB_OBJECT_MAP_RAW, &view) == EB_SUCCESS);
+    assert(view.header.magic == 0 && view.data == view.record);
+    eb_object_unmap(&view);
+    eb_store_destroy(store);
+
+    fixture_cleanup();
+    printf("Compressed object map tests passed!\n");
+}
+
+static void test_stored_norms(void) {
+    printf("Testing stored vector norms...\n");
+
+    setup_repo(false);
+    char hash[65], unit_hash[65];
+    store_values("a.txt", 1.5f, hash);
+    store_values("b.txt", 0.125f, unit_hash);
+
+    /* The norm follows the payload and comes back with the view */
+    eb_store_t* store = open_store();
+    eb_object_view_t view;
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    assert((view.header.flags & EB_FLAG_NORM) && !(view.header.flags & EB_FLAG_NORMALIZED));
+    assert(view.record_size == sizeof(eb_object_header_t) + VALUE_COUNT * sizeof(float) + sizeof(float));
+    check_values(&view, 1.5f);
+    assert(view.norm == 12.0f);
+    eb_vector_ref_t ref;
+    assert(eb_object_vector_ref(&view, &ref) == EB_SUCCESS);
+    assert(ref.dims == VALUE_COUNT && ref.norm == 12.0f && eb_vector_norm(&ref) == 12.0f);
+    eb_object_unmap(&view);
+
+    assert(eb_object_map(store, unit_hash, 0, &view) == EB_SUCCESS);
+    assert(view.header.flags & EB_FLAG_NORMALIZED);
+    assert(view.norm == 1.0f);
+    eb_object_unmap(&view);
+    eb_store_destroy(store);
+
+    /* Objects written before norms were stored have none until asked */
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), ".embr/objects/%s.raw", hash);
+    FILE* f = fopen(path, "r+b");
+    assert(f != NULL);
+    eb_object_header_t header;
+    assert(fread(&header, sizeof(header), 1, f) == 1);
+    header.flags &= ~(uint32_t)(EB_FLAG_NORM | EB_FLAG_NORMALIZED);
+    assert(fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1);
+    fclose(f);
+    assert(truncate(path, sizeof(header) + VALUE_COUNT * sizeof(float)) == 0);
+
+    store = open_store();
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    check_values(&view, 1.5f);
+    assert(view.norm < 0.0f);
+    assert(eb_object_vector_ref(&view, &ref) == EB_SUCCESS);
+    assert(ref.norm < 0.0f && fabsf(eb_vector_norm(&ref) - 12.0f) < 1e-5f);
+    eb_object_unmap(&view);
+    eb_store_destroy(store);
+
+    fixture_cleanup();
+    printf("Stored vector norm tests passed!\n");
+}
+
+#define ARCHIVE_ROWS 8
+#define ARCHIVE_DIMS 4096
+
+static void test_archive_level(void) {
+    printf("Testing auto compression and the archive level...\n");
+
+    setup_repo(true);
+    FILE* f = fopen(".embr/config", "w");
+    assert(f != NULL);
+    fputs("[storage]\n\tcompression = auto\n\tcompression_max_level = 6\n\tarchive_level = 19\n", f);
+    fclose(f);
+    eb_compress_bounds_t bounds;
+    assert(eb_object_compression(".") && eb_object_compression_auto(".", &bounds));
+    assert(bounds.min_level == 1 && bounds.max_level == 6 && bounds.target == 64ull << 20);
+    assert(eb_object_archive_level(".") == 19);
+
+    /* Rows with long repeats, where a higher level finds more */
+    static float values[ARCHIVE_ROWS * ARCHIVE_DIMS];
+    static char names[ARCHIVE_ROWS][16];
+    const char* sources[ARCHIVE_ROWS];
+    char hashes[ARCHIVE_ROWS][65];
+    for (int r = 0; r < ARCHIVE_ROWS; r++) {
+        for (int i = 0; i < ARCHIVE_DIMS; i++)
+            values[r * ARCHIVE_DIMS + i] = (float)((i * 37 + r) % 1021) / 1021.0f;
+        snprintf(names[r], sizeof(names[r]), "r%d.txt", r);
+        sources[r] = names[r];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, ARCHIVE_ROWS, ARCHIVE_DIMS, sources, "m", hashes) ==
+           EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    /* Loose vectors are recompressed as they move into the pack */
+    eb_store_t* store = open_store();
+    eb_repack_result_t result;
+    assert(eb_pack_repack(".", NULL, NULL, eb_object_archive, store, &result) == EB_SUCCESS);
+    assert(result.objects_packed == ARCHIVE_ROWS);
+    assert(result.objects_rewritten > 0 && result.objects_rewritten <= ARCHIVE_ROWS);
+    eb_store_destroy(store);
+
+    store = open_store();
+    for (int r = 0; r < ARCHIVE_ROWS; r++) {
+        eb_object_view_t view;
+        assert(eb_object_map(store, hashes[r], 0, &view) == EB_SUCCESS);
+        eb_vector_ref_t ref;
+        assert(eb_object_vector_ref(&view, &ref) == EB_SUCCESS && ref.dims == ARCHIVE_DIMS);
+        static float row[ARCHIVE_DIMS];
+        eb_vector_ref_get(&ref, 0, ARCHIVE_DIMS, row);
+        assert(memcmp(row, values + r * ARCHIVE_DIMS, sizeof(row)) == 0);
+        eb_object_unmap(&view);
+    }
+
+    /* Records that are not compressed vectors are left alone */
+    eb_object_header_t header = { .magic = EB_VECTOR_MAGIC, .obj_type = EB_OBJ_VECTOR };
+    void* out = (void*)1;
+    size_t out_size = 0;
+    assert(eb_object_archive(store, hashes[0], &header, sizeof(header), &out, &out_size) == EB_SUCCESS);
+    assert(out == NULL);
+    eb_store_destroy(store);
+
+    fixture_cleanup();
+    printf("Auto compression and archive level tests passed!\n");
+}
+
+/* Objects keep the hash they were named by after the repository changes it */
+static void test_mixed_hash(void) {
+    printf("Testing objects under both hash algorithms...\n");
+
+    setup_repo(true);
+    assert(eb_object_hash(".") == EB_HASH_SHA256);
+    char sha_hash[65], blake_hash[65], again[65];
+    store_values("a.txt", 2.5f, sha_hash);
+
+    assert(eb_object_set_hash(".", EB_HASH_BLAKE3) == EB_SUCCESS);
+    assert(eb_object_hash(".") == EB_HASH_BLAKE3);
+    system("echo source > b.txt && cp b.txt c.txt");
+    store_values("b.txt", 2.5f, blake_hash);
+    store_values("c.txt", 2.5f, again);
+    assert(strcmp(sha_hash, blake_hash) != 0 && strcmp(blake_hash, again) == 0);
+
+    /* Each verifies with the algorithm in its header, loose and packed */
+    for (int pass = 0; pass < 2; pass++) {
+        eb_store_t* store = open_store();
+        eb_object_view_t view;
+        assert(eb_object_map(store, sha_hash, 0, &view) == EB_SUCCESS);
+        assert(EB_VERSION_HASH(view.header.version) == EB_HASH_SHA256);
+        assert(view.header.version == EB_VERSION);
+        check_values(&view, 2.5f);
+        eb_object_unmap(&view);
+        assert(eb_object_map(store, blake_hash, 0, &view) == EB_SUCCESS);
+        assert(EB_VERSION_HASH(view.header.version) == EB_HASH_BLAKE3);
+        check_values(&view, 2.5f);
+        eb_object_unmap(&view);
+        eb_store_destroy(store);
+
+        eb_repack_result_t result;
+        if (pass == 0)
+            assert(eb_pack_repack(".", NULL, NULL, NULL, NULL, &result) == EB_SUCCESS);
+    }
+
+    /* The source hash is recorded with its algorithm */
+    char expected[65], sha_source[65], path[PATH_MAX], line[256];
+    assert(eb_source_file_hash_with("c.txt", EB_HASH_BLAKE3, expected, sizeof(expected)) == EB_SUCCESS);
+    assert(eb_source_file_hash("c.txt", sha_source, sizeof(sha_source)) == EB_SUCCESS);
+    assert(strcmp(expected, sha_source) != 0);
+    assert(eb_object_path(".", blake_hash, "meta", path, sizeof(path)) == 0);
+    FILE* f = fopen(path, "r");
+    assert(f != NULL);
+    bool recorded = false, hashed = false;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        recorded |= strcmp(line, "source_hash_algo=blake3") == 0;
+        hashed |= strncmp(line, "source_hash=", 12) == 0 && strcmp(line + 12, expected) == 0;
+    }
+    fclose(f);
+    assert(recorded && hashed);
+
+    eb_hash_algo_t algo;
+    assert(eb_object_hash_parse("md5", &algo) == EB_ERROR_INVALID_INPUT);
+    assert(!eb_object_version_valid(EB_OBJECT_VERSION(EB_HASH_ALGO_MAX + 1)));
+
+    fixture_cleanup();
+    printf("Mixed hash algorithm tests passed!\n");
+}
+
+int main(void) {
+    printf("Running object map tests...\n");
+
+    test_uncompressed();
+    test_compressed();
+    test_stored_norms();
+    test_archive_level();
+    test_mixed_hash();
+
+    printf("All object map tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * EmbeddingBridge - Object Layout Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "object_path.h"
+#include "hash_index.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define TEST_OBJECTS TEST_ROOT "/.embr/objects"
+
+static const char* HASHES[] = {
+    "ab00000000000000000000000000000000000000000000000000000000000001",
+    "ab00000000000000000000000000000000000000000000000000000000000002",
+    "cd00000000000000000000000000000000000000000000000000000000000003",
+};
+#define HASH_COUNT (sizeof(HASHES) / sizeof(HASHES[0]))
+
+static void setup_repo(const char* config) {
+    fixture_dir();
+    system("mkdir -p " TEST_OBJECTS "/pack " TEST_ROOT "/.embr/metadata");
+
+    FILE* f = fopen(TEST_ROOT "/.embr/config", "w");
+    assert(f != NULL);
+    fputs(config, f);
+    fclose(f);
+}
+
+static void touch(const char* path) {
+    FILE* f = fopen(path, "w");
+    assert(f != NULL);
+    fputs("x", f);
+    fclose(f);
+}
+
+static bool exists(const char* path) {
+    return access(path, F_OK) == 0;
+}
+
+/* Count visited files per extension */
+struct count_ctx {
+    int raw;
+    int meta;
+};
+
+static int count_visit(const char* hex_hash, const char* ext, const char* path,
+                       const struct stat* st, void* data) {
+    struct count_ctx* ctx = data;
+    (void)path;
+    (void)st;
+    assert(strlen(hex_hash) == 64);
+    if (strcmp(ext, "raw") == 0) ctx->raw++;
+    if (strcmp(ext, "meta") == 0) ctx->meta++;
+    return 0;
+}
+
+static void test_layout_config(void) {
+    printf("Testing layout configuration...\n");
+
+    setup_repo("[core]\n\tversion = 0.1.0\n\n[storage]\n\tcompression = true\n");
+    assert(eb_object_layout(TEST_ROOT) == EB_LAYOUT_FLAT);
+
+    assert(eb_object_set_layout(TEST_ROOT, EB_LAYOUT_FANOUT) == EB_SUCCESS);
+    assert(eb_object_layout(TEST_ROOT) == EB_LAYOUT_FANOUT);
+    assert(eb_object_set_layout(TEST_ROOT, EB_LAYOUT_FLAT) == EB_SUCCESS);
+    assert(eb_object_set_layout(TEST_ROOT, EB_LAYOUT_FANOUT) == EB_SUCCESS);
+
+    /* Exactly one layout line, other settings untouched */
+    FILE* f = fopen(TEST_ROOT "/.embr/config", "r");
+    assert(f != NULL);
+    char line[256];
+    int layout_lines = 0;
+    bool compression = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (strstr(line, "layout"))
+            layout_lines++;
+        if (strstr(line, "compression = true"))
+            compression = true;
+    }
+    fclose(f);
+    assert(layout_lines == 1);
+    assert(compression);
+
+    eb_object_layout_t layout;
+    assert(eb_object_layout_parse("fanout", &layout) == EB_SUCCESS && layout == EB_LAYOUT_FANOUT);
+    assert(eb_object_layout_parse("flat", &layout) == EB_SUCCESS && layout == EB_LAYOUT_FLAT);
+    assert(eb_object_layout_parse("deep", &layout) == EB_ERROR_INVALID_INPUT);
+
+    printf("Layout configuration tests passed!\n");
+}
+
+static void test_paths(void) {
+    printf("Testing object paths in both layouts...\n");
+
+    setup_repo("[storage]\n\tlayout = fanout\n");
+    char path[512];
+    assert(eb_object_write_path(TEST_ROOT, HASHES[0], "raw", path, sizeof(path)) == 0);
+    assert(strcmp(path, TEST_OBJECTS "/ab/00000000000000000000000000000000000000000000000000000000000001.raw") == 0);
+    touch(path);
+
+    /* A flat object written before the switch is still found */
+    touch(TEST_OBJECTS "/cd00000000000000000000000000000000000000000000000000000000000003.raw");
+    assert(eb_object_path(TEST_ROOT, HASHES[2], "raw", path, sizeof(path)) == 0);
+    assert(strcmp(path, TEST_OBJECTS "/cd00000000000000000000000000000000000000000000000000000000000003.raw") == 0);
+
+    /* Missing objects resolve to the configured layout */
+    assert(eb_object_path(TEST_ROOT, HASHES[1], "meta", path, sizeof(path)) == 0);
+    assert(strcmp(path, TEST_OBJECTS "/ab/00000000000000000000000000000000000000000000000000000000000002.meta") == 0);
+
+    char tiny[16];
+    assert(eb_object_path(TEST_ROOT, HASHES[0], "raw", tiny, sizeof(tiny)) == -1);
+
+    printf("Object path tests passed!\n");
+}
+
+static void test_migrate(void) {
+    printf("Testing layout migration...\n");
+
+    setup_repo("[storage]\n\tcompression = true\n");
+    char path[512];
+    for (size_t i = 0; i < HASH_COUNT; i++) {
+        assert(eb_object_write_path(TEST_ROOT, HASHES[i], "raw", path, sizeof(path)) == 0);
+        touch(path);
+        assert(eb_object_write_path(TEST_ROOT, HASHES[i], "meta", path, sizeof(path)) == 0);
+        touch(path);
+    }
+    /* Not objects: must be left alone */
+    touch(TEST_OBJECTS "/README");
+    touch(TEST_OBJECTS "/pack/pack-test.idx");
+
+    size_t moved = 0;
+    assert(eb_object_migrate(TEST_ROOT, EB_LAYOUT_FANOUT, &moved) == EB_SUCCESS);
+    assert(moved == HASH_COUNT * 2);
+    assert(eb_object_layout(TEST_ROOT) == EB_LAYOUT_FANOUT);
+    assert(exists(TEST_OBJECTS "/cd/00000000000000000000000000000000000000000000000000000000000003.meta"));
+    assert(!exists(TEST_OBJECTS "/cd00000000000000000000000000000000000000000000000000000000000003.meta"));
+    assert(exists(TEST_OBJECTS "/README"));
+    assert(exists(TEST_OBJECTS "/pack/pack-test.idx"));
+
+    struct count_ctx counts = {0, 0};
+    assert(eb_object_foreach(TEST_ROOT, count_visit, &counts) == EB_SUCCESS);
+    assert(counts.raw == (int)HASH_COUNT && counts.meta == (int)HASH_COUNT);
+
+    /* Short hashes resolve through the fan-out directories */
+    char full[65];
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "cd00", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[2]) == 0);
+    assert(eb_hash_index_resolve(TEST_ROOT, NULL, "ab00", full) == EB_ERROR_HASH_AMBIGUOUS);
+
+    /* Running again is a no-op */
+    assert(eb_object_migrate(TEST_ROOT, EB_LAYOUT_FANOUT, &moved) == EB_SUCCESS);
+    assert(moved == 0);
+
+    assert(eb_object_migrate(TEST_ROOT, EB_LAYOUT_FLAT, &moved) == EB_SUCCESS);
+    assert(moved == HASH_COUNT * 2);
+    assert(exists(TEST_OBJECTS "/ab00000000000000000000000000000000000000000000000000000000000001.raw"));
+    assert(!exists(TEST_OBJECTS "/ab"));
+
+    printf("Migration tests passed!\n");
+}
+
+int main(void) {
+    printf("Running object layout tests...\n");
+
+    test_layout_config();
+    test_paths();
+    test_migrate();
+
+    fixture_cleanup();
+    printf("All object layout tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * EmbeddingBridge - Batched Object Read Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "object_reader.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS 16
+#define COUNT 300
+
+static char hashes[COUNT][65];
+static const char* requested[COUNT + 1];
+
+static void setup_repo(void) {
+    fixture_repo(NULL);
+
+    static float values[COUNT * DIMS];
+    static char names[COUNT][32];
+    const char* sources[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        for (int d = 0; d < DIMS; d++)
+            values[i * DIMS + d] = (float)(i * DIMS + d);
+        snprintf(names[i], sizeof(names[i]), "doc%03d.txt", i);
+        sources[i] = names[i];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, COUNT, DIMS, sources, "m", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+typedef struct {
+    int seen[COUNT + 1];
+    size_t delivered;
+    size_t missing;
+    size_t stop_after;      /* 0 to read everything */
+} read_ctx_t;
+
+static int check_object(void* arg, size_t index, eb_status_t status, eb_object_view_t* view) {
+    read_ctx_t* ctx = arg;
+    assert(index <= COUNT);
+    ctx->seen[index]++;
+    ctx->delivered++;
+    if (index == COUNT) {
+        // The one hash that was never stored
+        assert(status == EB_ERROR_NOT_FOUND && view == NULL);
+        ctx->missing++;
+    } else {
+        assert(status == EB_SUCCESS && view != NULL);
+        eb_vector_ref_t ref;
+        assert(eb_object_vector_ref(view, &ref) == EB_SUCCESS && ref.dims == DIMS);
+        float row[DIMS];
+        eb_vector_ref_get(&ref, 0, DIMS, row);
+        for (int d = 0; d < DIMS; d++)
+            assert(row[d] == (float)(index * DIMS + (size_t)d));
+    }
+    return ctx->stop_after && ctx->delivered == ctx->stop_after;
+}
+
+static void read_all(const eb_object_read_options_t* options) {
+    read_ctx_t ctx = { 0 };
+    assert(eb_object_read_many(NULL, requested, COUNT + 1, options, check_object, &ctx) ==
+           EB_ERROR_INVALID_INPUT);
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    assert(eb_object_read_many(store, requested, COUNT + 1, options, check_object, &ctx) == EB_SUCCESS);
+    for (int i = 0; i <= COUNT; i++)
+        assert(ctx.seen[i] == 1);
+    assert(ctx.missing == 1);
+
+    /* Stopping early delivers nothing more */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.stop_after = 10;
+    assert(eb_object_read_many(store, requested, COUNT + 1, options, check_object, &ctx) == EB_SUCCESS);
+    assert(ctx.delivered == 10);
+    assert(eb_object_read_many(store, requested, 0, options, check_object, &ctx) == EB_SUCCESS);
+    eb_store_destroy(store);
+}
+
+/* A callback may keep a view past its return */
+typedef struct {
+    eb_object_view_t views[4];
+} keep_ctx_t;
+
+static int keep_view(void* arg, size_t index, eb_status_t status, eb_object_view_t* view) {
+    keep_ctx_t* ctx = arg;
+    assert(status == EB_SUCCESS);
+    ctx->views[index] = *view;
+    memset(view, 0, sizeof(*view));
+    return 0;
+}
+
+static void test_keep_views(void) {
+    printf("Testing views kept by the callback...\n");
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    keep_ctx_t ctx;
+    eb_object_read_options_t options = { .depth = 2 };
+    assert(eb_object_read_many(store, requested + 100, 4, &options, keep_view, &ctx) == EB_SUCCESS);
+    for (int i = 0; i < 4; i++) {
+        eb_vector_ref_t ref;
+        assert(eb_object_vector_ref(&ctx.views[i], &ref) == EB_SUCCESS);
+        float first;
+        eb_vector_ref_get(&ref, 0, 1, &first);
+        assert(first == (float)((100 + i) * DIMS));
+        eb_object_unmap(&ctx.views[i]);
+    }
+    eb_store_destroy(store);
+    printf("✓ Kept views passed\n");
+}
+
+int main(void) {
+    printf("Running batched object read tests...\n");
+    setup_repo();
+    for (int i = 0; i < COUNT; i++)
+        requested[i] = hashes[i];
+    requested[COUNT] = "00000000000000000000000000000000000000000000000000000000000000ff";
+
+    printf("Testing reads (io_uring %s)...\n", eb_object_read_uring_available() ? "available" : "unavailable");
+    eb_object_read_options_t options = { 0 };
+    read_all(NULL);
+    options.depth = 1;
+    read_all(&options);
+    printf("✓ Default reads passed\n");
+
+    printf("Testing pread reads...\n");
+    options.no_uring = true;
+    options.depth = 0;
+    read_all(&options);
+    options.depth = 3;
+    read_all(&options);
+    printf("✓ pread reads passed\n");
+
+    test_keep_views();
+    fixture_cleanup();
+    printf("All batched object read tests passed!\n");
+    return 0;
+}
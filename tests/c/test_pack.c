@@ -0,0 +1,319 @@
+/*
+ * EmbeddingBridge - Packfile Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pack.h"
+#include "types.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define TEST_OBJECTS TEST_ROOT "/.embr/objects"
+
+static const char* HASHES[] = {
+    "0a11111111111111111111111111111111111111111111111111111111111111",
+    "0a22222222222222222222222222222222222222222222222222222222222222",
+    "7f00000000000000000000000000000000000000000000000000000000000000",
+    "ff00000000000000000000000000000000000000000000000000000000000001",
+};
+#define HASH_COUNT (sizeof(HASHES) / sizeof(HASHES[0]))
+
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " TEST_OBJECTS);
+}
+
+/* Write a loose object whose payload is the hash string itself */
+static void write_loose(const char* hash) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.raw", TEST_OBJECTS, hash);
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+
+    eb_object_header_t header = {
+        .magic = EB_VECTOR_MAGIC,
+        .version = EB_VERSION,
+        .obj_type = EB_OBJ_VECTOR,
+        .flags = 0,
+        .size = 64
+    };
+    assert(fwrite(&header, sizeof(header), 1, f) == 1);
+    assert(fwrite(hash, 64, 1, f) == 1);
+    fclose(f);
+}
+
+static bool loose_exists(const char* hash) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.raw", TEST_OBJECTS, hash);
+    return access(path, F_OK) == 0;
+}
+
+static void test_repack_and_read(void) {
+    printf("Testing repack of loose objects...\n");
+    setup_repo();
+    for (size_t i = 0; i < HASH_COUNT; i++)
+        write_loose(HASHES[i]);
+
+    eb_repack_result_t result;
+    assert(eb_pack_repack(TEST_ROOT, NULL, NULL, NULL, NULL, &result) == EB_SUCCESS);
+    assert(result.objects_packed == HASH_COUNT);
+    assert(result.loose_removed == HASH_COUNT);
+    for (size_t i = 0; i < HASH_COUNT; i++)
+        assert(!loose_exists(HASHES[i]));
+
+    eb_pack_set_t* packs = NULL;
+    assert(eb_pack_open(TEST_ROOT, &packs) == EB_SUCCESS);
+    assert(eb_pack_count(packs) == 1);
+    assert(eb_pack_object_count(packs) == HASH_COUNT);
+
+    for (size_t i = 0; i < HASH_COUNT; i++) {
+        assert(eb_pack_contains(packs, HASHES[i]));
+
+        void* data = NULL;
+        size_t size = 0;
+        assert(eb_pack_read(packs, HASHES[i], &data, &size) == EB_SUCCESS);
+        assert(size == sizeof(eb_object_header_t) + 64);
+        const eb_object_header_t* header = data;
+        assert(header->magic == EB_VECTOR_MAGIC);
+        assert(memcmp((const char*)data + sizeof(*header), HASHES[i], 64) == 0);
+        free(data);
+    }
+    assert(!eb_pack_contains(packs, "1234567890123456789012345678901234567890123456789012345678901234"));
+    eb_pack_close(packs);
+
+    printf("Repack tests passed!\n");
+}
+
+static void test_prefix_resolution(void) {
+    printf("Testing prefix resolution through the fan-out index...\n");
+
+    eb_pack_set_t* packs = NULL;
+    assert(eb_pack_open(TEST_ROOT, &packs) == EB_SUCCESS);
+
+    char full[65];
+    assert(eb_pack_resolve_prefix(packs, "7f", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[2]) == 0);
+    assert(eb_pack_resolve_prefix(packs, "0a2", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[1]) == 0);
+    assert(eb_pack_resolve_prefix(packs, "f", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[3]) == 0);
+    assert(eb_pack_resolve_prefix(packs, "0a", full) == EB_ERROR_HASH_AMBIGUOUS);
+    assert(eb_pack_resolve_prefix(packs, "0", full) == EB_ERROR_HASH_AMBIGUOUS);
+    assert(eb_pack_resolve_prefix(packs, "0b", full) == EB_ERROR_NOT_FOUND);
+    assert(eb_pack_resolve_prefix(packs, "zz", full) == EB_ERROR_NOT_FOUND);
+    assert(eb_pack_resolve_prefix(packs, HASHES[0], full) == EB_SUCCESS);
+
+    eb_pack_close(packs);
+    printf("Prefix resolution tests passed!\n");
+}
+
+static bool drop_first(const char* hex_hash, time_t mtime, void* ctx) {
+    (void)mtime;
+    return strcmp(hex_hash, (const char*)ctx) != 0;
+}
+
+static void test_incremental_repack(void) {
+    printf("Testing repack with existing packs and a filter...\n");
+
+    /* A fresh loose write, plus a loose duplicate of a packed object */
+    const char* fresh = "5500000000000000000000000000000000000000000000000000000000000000";
+    write_loose(fresh);
+    write_loose(HASHES[2]);
+
+    eb_repack_result_t result;
+    assert(eb_pack_repack(TEST_ROOT, drop_first, (void*)HASHES[0], NULL, NULL, &result) == EB_SUCCESS);
+    assert(result.objects_dropped == 1);
+    assert(result.objects_packed == HASH_COUNT);
+    assert(result.packs_replaced == 1);
+    assert(!loose_exists(fresh));
+    assert(!loose_exists(HASHES[2]));
+
+    eb_pack_set_t* packs = NULL;
+    assert(eb_pack_open(TEST_ROOT, &packs) == EB_SUCCESS);
+    assert(eb_pack_count(packs) == 1);
+    assert(eb_pack_contains(packs, fresh));
+    assert(!eb_pack_contains(packs, HASHES[0]));
+
+    char full[65];
+    assert(eb_pack_resolve_prefix(packs, "0a", full) == EB_SUCCESS);
+    assert(strcmp(full, HASHES[1]) == 0);
+    eb_pack_close(packs);
+
+    printf("Incremental repack tests passed!\n");
+}
+
+static void test_empty_repository(void) {
+    printf("Testing repository without packs...\n");
+    setup_repo();
+
+    eb_pack_set_t* packs = NULL;
+    assert(eb_pack_open(TEST_ROOT, &packs) == EB_SUCCESS);
+    assert(eb_pack_count(packs) == 0);
+
+    char full[65];
+    assert(eb_pack_resolve_prefix(packs, "abcd", full) == EB_ERROR_NOT_FOUND);
+    eb_pack_close(packs);
+
+    eb_repack_result_t result;
+    assert(eb_pack_repack(TEST_ROOT, NULL, NULL, NULL, NULL, &result) == EB_SUCCESS);
+    assert(result.objects_packed == 0);
+
+    printf("Empty repository tests passed!\n");
+}
+
+/* Record with the layout of a loose object whose payload is the hash */
+static void make_record(const char* hash, char record[sizeof(eb_object_header_t) + 64]) {
+    eb_object_header_t header = {
+        .magic = EB_VECTOR_MAGIC,
+        .version = EB_VERSION,
+        .obj_type = EB_OBJ_VECTOR,
+        .flags = 0,
+        .size = 64
+    };
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), hash, 64);
+}
+
+static void test_build_and_install(void) {
+    printf("Testing in-memory packs and installing them...\n");
+    setup_repo();
+
+    char records[HASH_COUNT][sizeof(eb_object_header_t) + 64];
+    eb_pack_object_t objects[HASH_COUNT + 1];
+    for (size_t i = 0; i < HASH_COUNT; i++) {
+        /* Out of hash order, the index sorts but the records keep it */
+        size_t j = HASH_COUNT - 1 - i;
+        make_record(HASHES[j], records[i]);
+        objects[i] = (eb_pack_object_t){ HASHES[j], records[i], sizeof(records[i]) };
+    }
+    objects[HASH_COUNT] = objects[0];
+
+    void* pack = NULL;
+    void* idx = NULL;
+    size_t pack_size = 0, idx_size = 0;
+    char name[65];
+    assert(eb_pack_build(objects, HASH_COUNT + 1, &pack, &pack_size, &idx, &idx_size, name) == EB_SUCCESS);
+    assert(pack_size == sizeof(eb_pack_header_t) + HASH_COUNT * sizeof(records[0]));
+    assert(eb_pack_idx_count(idx, idx_size) == HASH_COUNT);
+    size_t entry_count = 0;
+    const eb_pack_idx_entry_t* entries = eb_pack_idx_entries(idx, idx_size, &entry_count);
+    assert(entries && entry_count == HASH_COUNT);
+    for (size_t i = 1; i < entry_count; i++)
+        assert(memcmp(entries[i - 1].hash, entries[i].hash, 32) < 0);
+    assert(eb_pack_idx_entries(idx, idx_size - 1, &entry_count) == NULL);
+
+    for (size_t i = 0; i < HASH_COUNT; i++) {
+        uint64_t offset = 0, length = 0;
+        assert(eb_pack_idx_lookup(idx, idx_size, objects[i].hex_hash, &offset, &length) == EB_SUCCESS);
+        assert(offset == sizeof(eb_pack_header_t) + i * sizeof(records[0]));
+        assert(length == sizeof(records[0]));
+        assert(memcmp((const char*)pack + offset, records[i], length) == 0);
+    }
+    uint64_t offset, length;
+    assert(eb_pack_idx_lookup(idx, idx_size, "1234567890123456789012345678901234567890123456789012345678901234",
+                              &offset, &length) == EB_ERROR_NOT_FOUND);
+    assert(eb_pack_idx_lookup(idx, idx_size - 1, HASHES[0], &offset, &length) == EB_ERROR_INVALID_FORMAT);
+
+    /* A pack whose records do not match its index is refused */
+    char installed[65];
+    assert(eb_pack_install(TEST_ROOT, pack, pack_size - 1, idx, idx_size, installed) == EB_ERROR_INVALID_FORMAT);
+    assert(!eb_pack_installed(TEST_ROOT, name));
+
+    assert(eb_pack_install(TEST_ROOT, pack, pack_size, idx, idx_size, installed) == EB_SUCCESS);
+    assert(strcmp(installed, name) == 0);
+    assert(eb_pack_installed(TEST_ROOT, name));
+    assert(eb_pack_install(TEST_ROOT, pack, pack_size, idx, idx_size, installed) == EB_SUCCESS);
+
+    eb_pack_set_t* packs = NULL;
+    assert(eb_pack_open(TEST_ROOT, &packs) == EB_SUCCESS);
+    assert(eb_pack_count(packs) == 1);
+    for (size_t i = 0; i < HASH_COUNT; i++) {
+        void* data = NULL;
+        size_t size = 0;
+        assert(eb_pack_read(packs, HASHES[i], &data, &size) == EB_SUCCESS);
+        assert(memcmp((const char*)data + sizeof(eb_object_header_t), HASHES[i], 64) == 0);
+        free(data);
+    }
+    eb_pack_close(packs);
+
+    free(pack);
+    free(idx);
+    printf("In-memory pack tests passed!\n");
+}
+
+static void test_prune(void) {
+    printf("Testing pruning of the packs holding dropped objects...\n");
+    setup_repo();
+
+    /* One pack from a repack, one installed, one loose object */
+    write_loose(HASHES[0]);
+    write_loose(HASHES[1]);
+    eb_repack_result_t result;
+    assert(eb_pack_repack(TEST_ROOT, NULL, NULL, NULL, NULL, &result) == EB_SUCCESS);
+
+    char records[2][sizeof(eb_object_header_t) + 64];
+    eb_pack_object_t objects[2];
+    for (size_t i = 0; i < 2; i++) {
+        make_record(HASHES[2 + i], records[i]);
+        objects[i] = (eb_pack_object_t){ HASHES[2 + i], records[i], sizeof(records[i]) };
+    }
+    void* pack = NULL;
+    void* idx = NULL;
+    size_t pack_size = 0, idx_size = 0;
+    char name[65], installed[65];
+    assert(eb_pack_build(objects, 2, &pack, &pack_size, &idx, &idx_size, name) == EB_SUCCESS);
+    assert(eb_pack_install(TEST_ROOT, pack, pack_size, idx, idx_size, installed) == EB_SUCCESS);
+    free(pack);
+    free(idx);
+
+    const char* fresh = "5500000000000000000000000000000000000000000000000000000000000000";
+    write_loose(fresh);
+
+    /* Nothing to drop leaves everything as it is */
+    assert(eb_pack_prune(TEST_ROOT, drop_first, (void*)fresh, &result) == EB_SUCCESS);
+    assert(result.objects_dropped == 0 && result.packs_replaced == 0);
+
+    assert(eb_pack_prune(TEST_ROOT, drop_first, (void*)HASHES[0], &result) == EB_SUCCESS);
+    assert(result.objects_dropped == 1 && result.objects_packed == 1);
+    assert(result.packs_replaced == 1 && result.loose_removed == 0);
+    assert(result.bytes_replaced > result.bytes_written);
+    assert(loose_exists(fresh));
+    assert(eb_pack_installed(TEST_ROOT, name));
+
+    eb_pack_set_t* packs = NULL;
+    assert(eb_pack_open(TEST_ROOT, &packs) == EB_SUCCESS);
+    assert(eb_pack_count(packs) == 2);
+    assert(!eb_pack_contains(packs, HASHES[0]));
+    for (size_t i = 1; i < HASH_COUNT; i++)
+        assert(eb_pack_contains(packs, HASHES[i]));
+    assert(!eb_pack_contains(packs, fresh));
+    eb_pack_close(packs);
+
+    printf("Pack pruning tests passed!\n");
+}
+
+int main(void) {
+    printf("Running packfile tests...\n");
+
+    test_repack_and_read();
+    test_prefix_resolution();
+    test_incremental_repack();
+    test_empty_repository();
+    test_build_and_install();
+    test_prune();
+
+    fixture_cleanup();
+    printf("All packfile tests passed!\n");
+    return 0;
+}
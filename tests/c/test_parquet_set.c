@@ -0,0 +1,222 @@
+/*
+ * EmbeddingBridge - Set-Level Parquet Export Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <unistd.h>
+#include <arrow-glib/arrow-glib.h>
+#include <parquet-glib/parquet-glib.h>
+#include "parquet_set.h"
+#include "set_snapshot.h"
+#include "repo_fixture.h"
+
+#define TEST_DIR "."
+#define TEST_DIMS 16
+#define TEST_ROWS 5000
+
+/* Rows and row groups of a written file */
+static void read_counts(const char* path, gint64* rows, gint* groups) {
+    GError* error = NULL;
+    GParquetArrowFileReader* reader = gparquet_arrow_file_reader_new_path(path, &error);
+    assert(reader && !error);
+    *groups = gparquet_arrow_file_reader_get_n_row_groups(reader);
+    GArrowTable* table = gparquet_arrow_file_reader_read_table(reader, &error);
+    assert(table && !error);
+    *rows = (gint64)garrow_table_get_n_rows(table);
+    g_object_unref(table);
+    g_object_unref(reader);
+}
+
+static void test_row_groups_and_files(void) {
+    printf("Testing row groups and file rotation...\n");
+    fixture_dir();
+
+    /* 1024-row groups (the minimum), files closed after two of them */
+    eb_parquet_set_options_t options = { .row_group_bytes = 1, .file_bytes = 2 * 1024 * TEST_DIMS * sizeof(float), .format = EB_PARQUET_SET_PARQUET };
+    eb_parquet_set_writer_t* writer = NULL;
+    assert(eb_parquet_set_writer_open(TEST_DIR, "vectors-16", TEST_DIMS, &options, &writer) == EB_SUCCESS);
+
+    float values[TEST_DIMS];
+    for (int i = 0; i < TEST_ROWS; i++) {
+        char id[65];
+        snprintf(id, sizeof(id), "%064d", i);
+        for (int j = 0; j < TEST_DIMS; j++)
+            values[j] = (float)(i * TEST_DIMS + j);
+        eb_parquet_set_row_t row = { id, values, i % 2 ? "doc.txt" : NULL, "model", 1700000000 + i };
+        assert(eb_parquet_set_writer_add(writer, &row) == EB_SUCCESS);
+    }
+
+    char** files = NULL;
+    size_t count = 0;
+    assert(eb_parquet_set_writer_close(writer, &files, &count) == EB_SUCCESS);
+    /* 5000 rows: groups of 1024, 1024 | 1024, 1024 | 904 */
+    assert(count == 3);
+    assert(strcmp(files[0], TEST_DIR "/vectors-16-00000.parquet") == 0);
+
+    gint64 total = 0;
+    for (size_t i = 0; i < count; i++) {
+        gint64 rows = 0;
+        gint groups = 0;
+        read_counts(files[i], &rows, &groups);
+        assert(groups == (i < 2 ? 2 : 1));
+        total += rows;
+        free(files[i]);
+    }
+    assert(total == TEST_ROWS);
+    free(files);
+
+    fixture_cleanup();
+    printf("Row group and file rotation tests passed!\n");
+}
+
+static void test_abort(void) {
+    printf("Testing aborted exports...\n");
+    fixture_dir();
+
+    eb_parquet_set_options_t options = { .row_group_bytes = 1, .file_bytes = 1, .format = EB_PARQUET_SET_PARQUET };
+    eb_parquet_set_writer_t* writer = NULL;
+    assert(eb_parquet_set_writer_open(TEST_DIR, "vectors-16", TEST_DIMS, &options, &writer) == EB_SUCCESS);
+    float values[TEST_DIMS] = {0};
+    for (int i = 0; i < 1500; i++) {
+        eb_parquet_set_row_t row = { "id", values, NULL, NULL, 0 };
+        assert(eb_parquet_set_writer_add(writer, &row) == EB_SUCCESS);
+    }
+    assert(access(TEST_DIR "/vectors-16-00000.parquet", F_OK) == 0);
+    eb_parquet_set_writer_abort(writer);
+    assert(access(TEST_DIR "/vectors-16-00000.parquet", F_OK) != 0);
+
+    assert(eb_parquet_set_writer_open(TEST_DIR, "x", 0, NULL, &writer) == EB_ERROR_INVALID_PARAMETER);
+
+    fixture_cleanup();
+    printf("Aborted export tests passed!\n");
+}
+
+struct scan_count {
+    size_t rows;
+    bool values_ok;
+};
+
+static eb_status_t count_row(const eb_parquet_set_row_t* row, void* ctx) {
+    struct scan_count* count = ctx;
+    count->rows++;
+    if (row->values) {
+        /* Values were written as row * dims + j, with the row in the id */
+        int i = atoi(row->id);
+        count->values_ok = count->values_ok && row->values[0] == (float)(i * TEST_DIMS) &&
+                           row->values[TEST_DIMS - 1] == (float)(i * TEST_DIMS + TEST_DIMS - 1);
+    }
+    return EB_SUCCESS;
+}
+
+static void test_scan(void) {
+    printf("Testing projected and filtered scans...\n");
+    fixture_dir();
+
+    /* Three row groups of 1024 rows, each from its own source file */
+    eb_parquet_set_options_t options = { .row_group_bytes = 1, .format = EB_PARQUET_SET_PARQUET };
+    eb_parquet_set_writer_t* writer = NULL;
+    assert(eb_parquet_set_writer_open(TEST_DIR, "vectors-16", TEST_DIMS, &options, &writer) == EB_SUCCESS);
+    float values[TEST_DIMS];
+    for (int i = 0; i < 3 * 1024; i++) {
+        char id[65], source[32];
+        snprintf(id, sizeof(id), "%064d", i);
+        snprintf(source, sizeof(source), "doc-%d.txt", i / 1024);
+        for (int j = 0; j < TEST_DIMS; j++)
+            values[j] = (float)(i * TEST_DIMS + j);
+        eb_parquet_set_row_t row = { id, values, source, "model", i };
+        assert(eb_parquet_set_writer_add(writer, &row) == EB_SUCCESS);
+    }
+    char** files = NULL;
+    size_t count = 0;
+    assert(eb_parquet_set_writer_close(writer, &files, &count) == EB_SUCCESS);
+    assert(count == 1);
+
+    struct scan_count all = { 0, true };
+    size_t groups = 0;
+    assert(eb_parquet_set_scan(files[0], NULL, count_row, &all, &groups) == EB_SUCCESS);
+    assert(all.rows == 3 * 1024 && groups == 3);
+
+    /* Statistics rule out the other two row groups */
+    eb_parquet_set_filter_t filter = { "doc-1.txt", NULL, true };
+    struct scan_count one = { 0, true };
+    assert(eb_parquet_set_scan(files[0], &filter, count_row, &one, &groups) == EB_SUCCESS);
+    assert(one.rows == 1024 && groups == 1 && one.values_ok);
+
+    eb_parquet_set_filter_t missing = { "doc-1.txt", "other-model", false };
+    struct scan_count none = { 0, true };
+    assert(eb_parquet_set_scan(files[0], &missing, count_row, &none, &groups) == EB_SUCCESS);
+    assert(none.rows == 0 && groups == 0);
+
+    free(files[0]);
+    free(files);
+    fixture_cleanup();
+    printf("Projected and filtered scan tests passed!\n");
+}
+
+static void test_arrow_ipc(void) {
+    printf("Testing mapped Arrow IPC files...\n");
+    fixture_dir();
+
+    eb_parquet_set_options_t options = { .row_group_bytes = 1, .format = EB_PARQUET_SET_ARROW };
+    eb_parquet_set_writer_t* writer = NULL;
+    assert(eb_parquet_set_writer_open(TEST_DIR, "vectors-16", TEST_DIMS, &options, &writer) == EB_SUCCESS);
+    float values[TEST_DIMS];
+    for (int i = 0; i < 2500; i++) {
+        char id[65];
+        snprintf(id, sizeof(id), "%064d", i);
+        for (int j = 0; j < TEST_DIMS; j++)
+            values[j] = (float)(i * TEST_DIMS + j);
+        eb_parquet_set_row_t row = { id, values, "doc.txt", NULL, i };
+        assert(eb_parquet_set_writer_add(writer, &row) == EB_SUCCESS);
+    }
+    char** files = NULL;
+    size_t count = 0;
+    assert(eb_parquet_set_writer_close(writer, &files, &count) == EB_SUCCESS);
+    assert(count == 1 && strcmp(files[0], TEST_DIR "/vectors-16-00000.arrow") == 0);
+
+    /* 1024-row groups become record batches, read back as matrices */
+    eb_set_snapshot_t* snapshot = NULL;
+    assert(eb_set_snapshot_open(files[0], &snapshot) == EB_SUCCESS);
+    assert(eb_set_snapshot_dims(snapshot) == TEST_DIMS && eb_set_snapshot_rows(snapshot) == 2500);
+    size_t row = 0;
+    for (size_t b = 0; b < eb_set_snapshot_batches(snapshot); b++) {
+        const float* matrix = NULL;
+        size_t rows = 0;
+        assert(eb_set_snapshot_matrix(snapshot, b, &matrix, &rows) == EB_SUCCESS);
+        for (size_t r = 0; r < rows; r++, row++)
+            assert(matrix[r * TEST_DIMS + 3] == (float)(row * TEST_DIMS + 3));
+        char id[65], expected[65];
+        snprintf(expected, sizeof(expected), "%064zu", row - 1);
+        assert(eb_set_snapshot_id(snapshot, b, rows - 1, id) == EB_SUCCESS);
+        assert(strcmp(id, expected) == 0);
+    }
+    assert(row == 2500);
+    eb_set_snapshot_close(snapshot);
+
+    assert(eb_set_snapshot_open(TEST_DIR "/missing.arrow", &snapshot) == EB_ERROR_INVALID_FORMAT);
+
+    free(files[0]);
+    free(files);
+    fixture_cleanup();
+    printf("Mapped Arrow IPC tests passed!\n");
+}
+
+int main(void) {
+    printf("Running set-level Parquet tests...\n");
+    test_row_groups_and_files();
+    test_abort();
+    test_scan();
+    test_arrow_ipc();
+    printf("All set-level Parquet tests passed!\n");
+    return 0;
+}
@@ -17,6 +17,7 @@
 
 #include "transformer.h"
 #include "status.h"
+#include "parquet_transformer.h"
 
 /* Forward declarations */
 extern eb_transformer_t* eb_parquet_transformer_create(int compression_level);
@@ -303,6 +304,23 @@ int main(void) {
     
     printf("Parquet transformer registered successfully\n");
     
+    // Test 4: Footer size from the trailer, as read with a ranged download
+    printf("\n=== Test 4: Footer size ===\n");
+    const unsigned char trailer[] = { 0x2c, 0x01, 0x00, 0x00, 'P', 'A', 'R', '1' };
+    size_t footer_size = eb_parquet_footer_size(trailer, sizeof(trailer));
+    if (footer_size != 300 + EB_PARQUET_TRAILER_SIZE) {
+        printf("ERROR: Footer size %zu, expected %d\n", footer_size, 300 + EB_PARQUET_TRAILER_SIZE);
+        return 1;
+    }
+    const unsigned char not_parquet[] = { 0x2c, 0x01, 0x00, 0x00, 'P', 'A', 'R', '2' };
+    if (eb_parquet_footer_size(not_parquet, sizeof(not_parquet)) != 0 ||
+        eb_parquet_footer_size(trailer, 4) != 0) {
+        printf("ERROR: Invalid trailer accepted\n");
+        return 1;
+    }
+    
+    printf("Footer size read correctly\n");
+    
     printf("\nAll tests passed.\n");
     return 0;
 } 
\ No newline at end of file
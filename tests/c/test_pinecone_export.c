@@ -0,0 +1,152 @@
+/*
+ * EmbeddingBridge - Pinecone Bulk Export Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <math.h>
+#include "pinecone_export.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS 8
+#define COUNT 2500
+
+static char hashes[COUNT][65];
+
+/* Minimal .npy file around the values */
+static void write_npy(const char* path, const float* values, size_t count) {
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu,), }", count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    uint16_t header_size = (uint16_t)length;
+    assert(fwrite("\x93NUMPY\x01\x00", 1, 8, f) == 8);
+    assert(fwrite(&header_size, sizeof(header_size), 1, f) == 1);
+    assert(fwrite(header, 1, (size_t)length, f) == (size_t)length);
+    assert(fwrite(values, sizeof(float), count, f) == count);
+    fclose(f);
+}
+
+/* main holds COUNT vectors, more than two read windows */
+static void setup_repo(void) {
+    fixture_repo(NULL);
+    assert(mkdir("out", 0755) == 0);
+
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    for (int i = 0; i < COUNT; i++) {
+        float values[DIMS];
+        for (int d = 0; d < DIMS; d++)
+            values[d] = sinf((float)(i * DIMS + d) * 0.37f);
+        char path[64], source[64];
+        snprintf(path, sizeof(path), "v%d.npy", i);
+        snprintf(source, sizeof(source), "doc%04d.txt", i);
+        write_npy(path, values, DIMS);
+        assert(eb_store_batch_add(batch, path, source, "m1", hashes[i]) == EB_SUCCESS);
+    }
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static int compare_hashes(const void* a, const void* b) {
+    return strcmp(a, b);
+}
+
+static void test_ndjson_batches(void) {
+    printf("Testing NDJSON upsert batches...\n");
+    eb_pinecone_options_t options = { EB_PINECONE_NDJSON, 25, 4096, 64 * 1024, "ns", NULL, 4 };
+    char** files = NULL;
+    size_t count = 0;
+    eb_pinecone_stats_t stats;
+    assert(eb_pinecone_export(".", "main", "out", &options, &files, &count, &stats) == EB_SUCCESS);
+    assert(stats.vectors == COUNT && stats.skipped == 0);
+    assert(count > 1 && strcmp(files[0], "out/upsert-00000.ndjson") == 0);
+
+    /* Every line is a request within both limits; every vector is in one */
+    static char seen[COUNT][65];
+    size_t ids = 0, lines = 0;
+    static char line[8192];
+    const char* suffix = "],\"namespace\":\"ns\"}\n";
+    for (size_t i = 0; i < count; i++) {
+        FILE* f = fopen(files[i], "r");
+        assert(f != NULL);
+        while (fgets(line, sizeof(line), f)) {
+            size_t length = strlen(line);
+            assert(length - 1 <= 4096);
+            assert(strncmp(line, "{\"vectors\":[{\"id\":\"", 19) == 0);
+            assert(strcmp(line + length - strlen(suffix), suffix) == 0);
+            size_t in_line = 0;
+            for (const char* p = line; (p = strstr(p, "{\"id\":\"")) != NULL; p += 7) {
+                assert(ids < COUNT);
+                memcpy(seen[ids++], p + 7, 64);
+                seen[ids - 1][64] = '\0';
+                in_line++;
+            }
+            assert(in_line >= 1 && in_line <= 25);
+            assert(strstr(line, "\"metadata\":{\"timestamp\":") && strstr(line, "\"model\":\"m1\""));
+            lines++;
+        }
+        fclose(f);
+        free(files[i]);
+    }
+    free(files);
+    assert(lines == stats.batches && ids == COUNT);
+
+    qsort(seen, COUNT, sizeof(seen[0]), compare_hashes);
+    static char expected[COUNT][65];
+    memcpy(expected, hashes, sizeof(expected));
+    qsort(expected, COUNT, sizeof(expected[0]), compare_hashes);
+    assert(memcmp(seen, expected, sizeof(seen)) == 0);
+    system("rm -f out/*");
+    printf("NDJSON upsert batch tests passed!\n");
+}
+
+static void test_export_errors(void) {
+    printf("Testing export limits and errors...\n");
+    eb_pinecone_stats_t stats;
+    char** files = NULL;
+    size_t count = 0;
+
+    /* No vector fits a 64-byte request: all are skipped and nothing is written */
+    eb_pinecone_options_t tiny = { EB_PINECONE_NDJSON, 0, 64, 0, NULL, NULL, 2 };
+    assert(eb_pinecone_export(".", "main", "out", &tiny, &files, &count, &stats) == EB_SUCCESS);
+    assert(count == 0 && stats.vectors == 0 && stats.skipped == COUNT);
+    free(files);
+    assert(access("out/upsert-00000.ndjson", F_OK) != 0);
+
+    eb_pinecone_options_t other = { EB_PINECONE_NDJSON, 0, 0, 0, NULL, "m2", 1 };
+    assert(eb_pinecone_export(".", "main", "out", &other, NULL, &count, &stats) == EB_SUCCESS);
+    assert(count == 0 && stats.vectors == 0 && stats.skipped == 0);
+
+    assert(eb_pinecone_export(".", "missing", "out", NULL, NULL, NULL, NULL) == EB_ERROR_NOT_FOUND);
+    assert(eb_pinecone_export(".", "../main", "out", NULL, NULL, NULL, NULL) == EB_ERROR_INVALID_PARAMETER);
+    printf("Export limit and error tests passed!\n");
+}
+
+int main(void) {
+    printf("Running Pinecone export tests...\n");
+
+    setup_repo();
+    test_ndjson_batches();
+    test_export_errors();
+    fixture_cleanup();
+
+    printf("All Pinecone export tests passed!\n");
+    return 0;
+}
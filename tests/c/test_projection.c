@@ -0,0 +1,296 @@
+/*
+ * EmbeddingBridge - Cross-Model Projection Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include "projection.h"
+#include "set_index.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS_A 12
+#define DIMS_B 20
+#define RANK 6
+#define COUNT 60
+
+static float a_values[COUNT * DIMS_A];
+static float b_values[COUNT * DIMS_B];
+
+static double cosine(const float* x, const float* y, size_t dims) {
+    double dot = 0, nx = 0, ny = 0;
+    for (size_t d = 0; d < dims; d++) {
+        dot += (double)x[d] * y[d];
+        nx += (double)x[d] * x[d];
+        ny += (double)y[d] * y[d];
+    }
+    return dot / sqrt(nx * ny);
+}
+
+/*
+ * Both models see the same RANK latent factors of a document. Model B is
+ * an isometric embedding of model A into twice the dimensions, with an
+ * offset, so a fitted projection must recover the correspondence exactly.
+ */
+static void fill(void) {
+    float mix[DIMS_A][RANK];
+    for (int i = 0; i < DIMS_A; i++)
+        for (int r = 0; r < RANK; r++)
+            mix[i][r] = sinf((float)(i * RANK + r) * 1.37f);
+
+    /* Orthonormal columns by Gram-Schmidt */
+    double embed[DIMS_A][DIMS_B];
+    for (int c = 0; c < DIMS_A; c++) {
+        for (int i = 0; i < DIMS_B; i++)
+            embed[c][i] = cos((double)(c * DIMS_B + i) * 0.91);
+        for (int p = 0; p < c; p++) {
+            double dot = 0;
+            for (int i = 0; i < DIMS_B; i++)
+                dot += embed[c][i] * embed[p][i];
+            for (int i = 0; i < DIMS_B; i++)
+                embed[c][i] -= dot * embed[p][i];
+        }
+        double norm = 0;
+        for (int i = 0; i < DIMS_B; i++)
+            norm += embed[c][i] * embed[c][i];
+        for (int i = 0; i < DIMS_B; i++)
+            embed[c][i] /= sqrt(norm);
+    }
+
+    for (int n = 0; n < COUNT; n++) {
+        float latent[RANK];
+        for (int r = 0; r < RANK; r++)
+            latent[r] = sinf((float)(n * RANK + r) * 0.53f + 0.2f) * (float)(RANK - r);
+        for (int i = 0; i < DIMS_A; i++) {
+            float sum = 0;
+            for (int r = 0; r < RANK; r++)
+                sum += mix[i][r] * latent[r];
+            a_values[n * DIMS_A + i] = sum;
+        }
+        for (int i = 0; i < DIMS_B; i++) {
+            double sum = 0.5;
+            for (int c = 0; c < DIMS_A; c++)
+                sum += embed[c][i] * a_values[n * DIMS_A + c];
+            b_values[n * DIMS_B + i] = (float)sum;
+        }
+    }
+}
+
+static double mean_cosine(const eb_projection_t* p, size_t count) {
+    eb_projection_info_t info;
+    eb_projection_describe(p, &info);
+    float* pa = malloc(info.dims * sizeof(float));
+    float* pb = malloc(info.dims * sizeof(float));
+    assert(pa && pb);
+    double total = 0;
+    for (size_t n = 0; n < count; n++) {
+        eb_projection_apply(p, EB_PROJECT_A, &a_values[n * DIMS_A], pa);
+        eb_projection_apply(p, EB_PROJECT_B, &b_values[n * DIMS_B], pb);
+        total += cosine(pa, pb, info.dims);
+    }
+    free(pa);
+    free(pb);
+    return total / (double)count;
+}
+
+static void test_fit(void) {
+    printf("Testing projection fit...\n");
+
+    eb_projection_t* p = NULL;
+    assert(eb_projection_fit(a_values, DIMS_A, b_values, DIMS_B, COUNT, RANK, &p) == EB_SUCCESS);
+    eb_projection_info_t info;
+    eb_projection_describe(p, &info);
+    assert(info.dims_a == DIMS_A && info.dims_b == DIMS_B && info.dims == RANK);
+    assert(info.pairs == COUNT);
+    assert(info.fit_cosine > 0.999f);
+    assert(fabs(mean_cosine(p, COUNT) - info.fit_cosine) < 1e-4);
+
+    /* Mismatched documents stay apart */
+    float pa[RANK], pb[RANK];
+    eb_projection_apply(p, EB_PROJECT_A, &a_values[0], pa);
+    eb_projection_apply(p, EB_PROJECT_B, &b_values[7 * DIMS_B], pb);
+    assert(cosine(pa, pb, RANK) < 0.99);
+    eb_projection_free(p);
+
+    /* The default keeps the smaller model's dimensions */
+    assert(eb_projection_fit(a_values, DIMS_A, b_values, DIMS_B, COUNT, 0, &p) == EB_SUCCESS);
+    eb_projection_describe(p, &info);
+    assert(info.dims == DIMS_A && info.fit_cosine > 0.99f);
+    eb_projection_free(p);
+
+    /* Fewer pairs than dimensions go through the Gram matrix */
+    assert(eb_projection_fit(a_values, DIMS_A, b_values, DIMS_B, 5, 0, &p) == EB_SUCCESS);
+    eb_projection_describe(p, &info);
+    assert(info.dims == 4 && info.fit_cosine > 0.999f);
+    eb_projection_free(p);
+
+    assert(eb_projection_fit(a_values, DIMS_A, b_values, DIMS_B, 5, 5, &p) == EB_ERROR_INVALID_INPUT);
+    assert(eb_projection_fit(a_values, DIMS_A, b_values, DIMS_B, 1, 0, &p) == EB_ERROR_INVALID_INPUT);
+    float bad[2 * DIMS_A];
+    memcpy(bad, a_values, sizeof(bad));
+    bad[3] = NAN;
+    assert(eb_projection_fit(bad, DIMS_A, b_values, DIMS_B, 2, 0, &p) == EB_ERROR_INVALID_INPUT);
+
+    printf("Projection fit tests passed!\n");
+}
+
+typedef struct {
+    int count;
+    char first[64];
+} list_ctx_t;
+
+static int count_projection(const char* model_a, const char* model_b,
+                            const eb_projection_info_t* info, void* ctx) {
+    list_ctx_t* list = ctx;
+    if (list->count++ == 0)
+        snprintf(list->first, sizeof(list->first), "%s|%s|%zu", model_a, model_b, info->dims);
+    return 0;
+}
+
+static void test_files(void) {
+    printf("Testing projection files...\n");
+
+    fixture_dir();
+    system("mkdir -p .embr/metadata/models");
+    const char* root = fixture_root();
+
+    eb_projection_t* p = NULL;
+    assert(eb_projection_fit(a_values, DIMS_A, b_values, DIMS_B, COUNT, RANK, &p) == EB_SUCCESS);
+    assert(eb_projection_save(root, "openai/small", "voyage~2", p) == EB_SUCCESS);
+
+    /* Loading in either order gives the same shared space */
+    eb_projection_t* forward = NULL;
+    eb_projection_t* reverse = NULL;
+    assert(eb_projection_load(root, "openai/small", "voyage~2", &forward) == EB_SUCCESS);
+    assert(eb_projection_load(root, "voyage~2", "openai/small", &reverse) == EB_SUCCESS);
+    assert(eb_projection_input_dims(forward, EB_PROJECT_A) == DIMS_A);
+    assert(eb_projection_input_dims(reverse, EB_PROJECT_A) == DIMS_B);
+    float expected[RANK], forward_out[RANK], reverse_out[RANK];
+    eb_projection_apply(p, EB_PROJECT_B, b_values, expected);
+    eb_projection_apply(forward, EB_PROJECT_B, b_values, forward_out);
+    eb_projection_apply(reverse, EB_PROJECT_A, b_values, reverse_out);
+    assert(memcmp(expected, forward_out, sizeof(expected)) == 0);
+    assert(memcmp(expected, reverse_out, sizeof(expected)) == 0);
+    eb_projection_free(forward);
+    eb_projection_free(reverse);
+
+    /* The cache hands out one projection until the file changes */
+    const eb_projection_t* cached = NULL;
+    const eb_projection_t* again = NULL;
+    assert(eb_projection_get(root, "openai/small", "voyage~2", &cached) == EB_SUCCESS);
+    assert(eb_projection_get(root, "openai/small", "voyage~2", &again) == EB_SUCCESS);
+    assert(cached == again);
+    eb_projection_free(p);
+    assert(eb_projection_fit(a_values, DIMS_A, b_values, DIMS_B, COUNT, 2, &p) == EB_SUCCESS);
+    assert(eb_projection_save(root, "openai/small", "voyage~2", p) == EB_SUCCESS);
+    assert(eb_projection_get(root, "openai/small", "voyage~2", &again) == EB_SUCCESS);
+    eb_projection_info_t info;
+    eb_projection_describe(again, &info);
+    assert(again != cached && info.dims == 2);
+
+    /* Saving the reverse order replaces the pair rather than adding one */
+    assert(eb_projection_save(root, "voyage~2", "openai/small", p) == EB_SUCCESS);
+    list_ctx_t list = { 0 };
+    assert(eb_projection_list(root, count_projection, &list) == EB_SUCCESS);
+    assert(list.count == 1 && strcmp(list.first, "voyage~2|openai/small|2") == 0);
+    eb_projection_free(p);
+
+    assert(eb_projection_remove(root, "openai/small", "voyage~2") == EB_SUCCESS);
+    assert(eb_projection_remove(root, "openai/small", "voyage~2") == EB_ERROR_NOT_FOUND);
+    assert(eb_projection_load(root, "openai/small", "voyage~2", &p) == EB_ERROR_NOT_FOUND);
+    list.count = 0;
+    assert(eb_projection_list(root, count_projection, &list) == EB_SUCCESS && list.count == 0);
+    assert(eb_projection_load(root, "same", "same", &p) == EB_ERROR_INVALID_INPUT);
+
+    fixture_cleanup();
+    printf("Projection file tests passed!\n");
+}
+
+/* Minimal .npy file around the values */
+static void write_npy(const char* path, const float* values, size_t count) {
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu,), }", count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    uint16_t header_size = (uint16_t)length;
+    assert(fwrite("\x93NUMPY\x01\x00", 1, 8, f) == 8);
+    assert(fwrite(&header_size, sizeof(header_size), 1, f) == 1);
+    assert(fwrite(header, 1, (size_t)length, f) == (size_t)length);
+    assert(fwrite(values, sizeof(float), count, f) == count);
+    fclose(f);
+}
+
+static void test_fit_set(void) {
+    printf("Testing projection fit over a set...\n");
+
+    fixture_repo(NULL);
+
+    /* Too few paired documents */
+    assert(eb_projection_fit_set(".", NULL, "small", "large", 0, NULL) == EB_ERROR_NOT_FOUND);
+
+    /* Every document has model A; all but the last few also have model B */
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    for (int n = 0; n < COUNT; n++) {
+        char path[64], source[64], hash[65];
+        snprintf(source, sizeof(source), "doc%02d.txt", n);
+        snprintf(path, sizeof(path), "a%d.npy", n);
+        write_npy(path, &a_values[n * DIMS_A], DIMS_A);
+        assert(eb_store_batch_add(batch, path, source, "small", hash) == EB_SUCCESS);
+        if (n >= COUNT - 5)
+            continue;
+        snprintf(path, sizeof(path), "b%d.npy", n);
+        write_npy(path, &b_values[n * DIMS_B], DIMS_B);
+        assert(eb_store_batch_add(batch, path, source, "large", hash) == EB_SUCCESS);
+    }
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    eb_projection_info_t info;
+    assert(eb_projection_fit_set(".", NULL, "small", "large", RANK, &info) == EB_SUCCESS);
+    assert(info.pairs == COUNT - 5 && info.dims == RANK && info.fit_cosine > 0.999f);
+    assert(eb_projection_fit_set(".", "main", "large", "small", 0, &info) == EB_SUCCESS);
+    assert(info.dims_a == DIMS_B && info.dims == DIMS_A);
+    assert(eb_projection_fit_set(".", "missing", "small", "large", 0, &info) == EB_ERROR_NOT_FOUND);
+
+    /* The held-out documents project onto their counterparts too */
+    const eb_projection_t* p = NULL;
+    assert(eb_projection_get(".", "small", "large", &p) == EB_SUCCESS);
+    float pa[DIMS_A], pb[DIMS_A];
+    for (int n = COUNT - 5; n < COUNT; n++) {
+        eb_projection_apply(p, EB_PROJECT_A, &a_values[n * DIMS_A], pa);
+        eb_projection_apply(p, EB_PROJECT_B, &b_values[n * DIMS_B], pb);
+        assert(cosine(pa, pb, info.dims) > 0.99);
+    }
+
+    fixture_cleanup();
+    printf("Projection fit over a set tests passed!\n");
+}
+
+int main(void) {
+    printf("Running projection tests...\n");
+
+    fill();
+
+    test_fit();
+    test_files();
+    test_fit_set();
+
+    printf("All projection tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * EmbeddingBridge - Reduced-Precision Storage Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include "quantize.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define VALUE_COUNT 1536
+
+static void test_half_conversions(void) {
+    printf("Testing fp16 and bf16 conversions...\n");
+
+    assert(eb_float_to_fp16(1.0f) == 0x3C00);
+    assert(eb_float_to_fp16(-2.0f) == 0xC000);
+    assert(eb_float_to_fp16(65504.0f) == 0x7BFF);
+    assert(eb_float_to_fp16(1e6f) == 0x7C00);             /* Overflow becomes Inf */
+    assert(eb_float_to_fp16(ldexpf(1.0f, -24)) == 0x0001); /* Smallest subnormal */
+    assert(eb_float_to_fp16(ldexpf(1.0f, -26)) == 0x0000);
+    assert(eb_float_to_fp16(1.0f + ldexpf(1.0f, -11)) == 0x3C00);     /* Tie to even */
+    assert(eb_float_to_fp16(1.0f + 3 * ldexpf(1.0f, -11)) == 0x3C02); /* Tie to even */
+    assert(isnan(eb_fp16_to_float(eb_float_to_fp16(NAN))));
+    assert(isinf(eb_fp16_to_float(eb_float_to_fp16(-INFINITY))));
+
+    /* Every finite half survives a round trip through float */
+    for (uint32_t h = 0; h < 0x10000; h++) {
+        if ((h & 0x7C00) == 0x7C00)
+            continue;
+        assert(eb_float_to_fp16(eb_fp16_to_float((uint16_t)h)) == h);
+    }
+
+    assert(eb_float_to_bf16(1.0f) == 0x3F80);
+    assert(eb_bf16_to_float(0x3F80) == 1.0f);
+    assert(eb_float_to_bf16(1.0f + ldexpf(1.0f, -8)) == 0x3F80);     /* Tie to even */
+    assert(eb_float_to_bf16(1.0f + 3 * ldexpf(1.0f, -8)) == 0x3F82); /* Tie to even */
+    assert(isnan(eb_bf16_to_float(eb_float_to_bf16(NAN))));
+
+    printf("Conversion tests passed!\n");
+}
+
+static void test_quantize_payloads(void) {
+    printf("Testing quantized payloads...\n");
+
+    float values[VALUE_COUNT];
+    for (int i = 0; i < VALUE_COUNT; i++)
+        values[i] = 0.05f * sinf((float)i * 0.37f);
+
+    const eb_dtype_t dtypes[] = { EB_FLOAT32, EB_FLOAT16, EB_BFLOAT16, EB_INT8 };
+    const float tolerance[] = { 0.0f, 5e-5f, 4e-4f, 3e-4f };
+    for (size_t d = 0; d < sizeof(dtypes) / sizeof(dtypes[0]); d++) {
+        void* payload = NULL;
+        size_t size = 0;
+        assert(eb_quantize(values, VALUE_COUNT, dtypes[d], &payload, &size) == EB_SUCCESS);
+        assert(size == eb_quantized_size(dtypes[d], VALUE_COUNT));
+
+        eb_vector_ref_t ref;
+        assert(eb_vector_ref_init(&ref, dtypes[d], payload, size) == EB_SUCCESS);
+        assert(ref.dims == VALUE_COUNT);
+
+        float restored[VALUE_COUNT];
+        eb_vector_ref_get(&ref, 0, VALUE_COUNT, restored);
+        for (int i = 0; i < VALUE_COUNT; i++)
+            assert(fabsf(restored[i] - values[i]) <= tolerance[d]);
+        free(payload);
+    }
+
+    /* Int8 uses the full range and rejects values it cannot scale */
+    float small[3] = { -0.5f, 0.25f, 1.0f };
+    void* payload = NULL;
+    size_t size = 0;
+    assert(eb_quantize(small, 3, EB_INT8, &payload, &size) == EB_SUCCESS);
+    const int8_t* q = (const int8_t*)payload + sizeof(float);
+    assert(q[0] == -64 && q[1] == 32 && q[2] == 127);
+    free(payload);
+    small[1] = NAN;
+    assert(eb_quantize(small, 3, EB_INT8, &payload, &size) == EB_ERROR_INVALID_INPUT);
+    assert(eb_quantize(small, 3, EB_FLOAT64, &payload, &size) == EB_ERROR_INVALID_INPUT);
+
+    eb_dtype_t dtype;
+    assert(eb_dtype_from_name("bf16", &dtype) == EB_SUCCESS && dtype == EB_BFLOAT16);
+    assert(eb_dtype_from_name("float16", &dtype) == EB_SUCCESS && dtype == EB_FLOAT16);
+    assert(eb_dtype_from_name("int4", &dtype) == EB_ERROR_INVALID_INPUT);
+
+    printf("Quantized payload tests passed!\n");
+}
+
+/* Minimal .npy file around the values */
+static size_t make_npy(uint8_t* out, const char* descr, const float* values, size_t count) {
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '%s', 'fortran_order': False, 'shape': (%zu,), }", descr, count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    memcpy(out, "\x93NUMPY\x01\x00", 8);
+    uint16_t header_size = (uint16_t)length;
+    memcpy(out + 8, &header_size, sizeof(header_size));
+    memcpy(out + 10, header, (size_t)length);
+    memcpy(out + 10 + length, values, count * sizeof(float));
+    return 10 + (size_t)length + count * sizeof(float);
+}
+
+static void test_float_payload(void) {
+    printf("Testing float32 payload detection...\n");
+
+    float values[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t file[256];
+    size_t size = make_npy(file, "<f4", values, 8);
+
+    const float* found = NULL;
+    size_t dims = 0;
+    assert(eb_float_payload(file, size, &found, &dims) == EB_SUCCESS);
+    assert(dims == 8 && memcmp(found, values, sizeof(values)) == 0);
+
+    size = make_npy(file, "<f8", values, 8);
+    assert(eb_float_payload(file, size, &found, &dims) == EB_ERROR_INVALID_FORMAT);
+
+    assert(eb_float_payload(values, sizeof(values), &found, &dims) == EB_SUCCESS);
+    assert(dims == 8 && found == values);
+
+    printf("Float32 payload tests passed!\n");
+}
+
+static void setup_repo(void) {
+    /* The shuffle filter must not touch reduced dtypes */
+    fixture_repo("[storage]\n\tcompression = true\n\tfilter = shuffle\n");
+}
+
+static void test_store_dtype(void) {
+    printf("Testing reduced-precision object storage...\n");
+
+    setup_repo();
+    float values[VALUE_COUNT];
+    for (int i = 0; i < VALUE_COUNT; i++)
+        values[i] = 0.05f * sinf((float)i * 0.37f) + 0.01f * cosf((float)i * 1.91f);
+    uint8_t* file = malloc(128 + sizeof(values));
+    assert(file != NULL);
+    size_t file_size = make_npy(file, "<f4", values, VALUE_COUNT);
+    FILE* f = fopen("input.npy", "wb");
+    assert(f != NULL);
+    assert(fwrite(file, 1, file_size, f) == file_size);
+    fclose(f);
+    free(file);
+
+    const eb_dtype_t dtypes[] = { EB_FLOAT16, EB_BFLOAT16, EB_INT8 };
+    for (size_t d = 0; d < sizeof(dtypes) / sizeof(dtypes[0]); d++) {
+        char hash[65];
+        eb_store_batch_t* batch = NULL;
+        assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+        assert(eb_store_batch_set_dtype(batch, dtypes[d]) == EB_SUCCESS);
+        assert(eb_store_batch_add(batch, "input.npy", "a.txt", "openai", hash) == EB_SUCCESS);
+        assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+        eb_store_t* store = NULL;
+        eb_store_config_t config = { .root_path = "." };
+        assert(eb_store_init(&config, &store) == EB_SUCCESS);
+        eb_object_view_t view;
+        assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+        assert(EB_FLAG_DTYPE(view.header.flags) == dtypes[d]);
+        assert(!(view.header.flags & EB_FLAG_SHUFFLED));
+        assert(view.size == eb_quantized_size(dtypes[d], VALUE_COUNT));
+
+        eb_vector_ref_t ref;
+        assert(eb_vector_ref_init(&ref, dtypes[d], view.data, view.size) == EB_SUCCESS);
+        float restored[VALUE_COUNT];
+        eb_vector_ref_get(&ref, 0, VALUE_COUNT, restored);
+        for (int i = 0; i < VALUE_COUNT; i++)
+            assert(fabsf(restored[i] - values[i]) < 1e-3f);
+        eb_object_unmap(&view);
+        eb_store_destroy(store);
+    }
+
+    /* Only float32 files can be quantized */
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_set_dtype(batch, EB_FLOAT64) == EB_ERROR_INVALID_INPUT);
+    eb_store_batch_abort(batch);
+
+    fixture_cleanup();
+    printf("Reduced-precision object storage tests passed!\n");
+}
+
+int main(void) {
+    printf("Running quantization tests...\n");
+
+    test_half_conversions();
+    test_quantize_payloads();
+    test_float_payload();
+    test_store_dtype();
+
+    printf("All quantization tests passed!\n");
+    return 0;
+}
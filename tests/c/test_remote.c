@@ -18,6 +18,8 @@
 #include "json_transformer.h"
 #include "parquet_transformer.h"
 #include "debug.h"
+#include "remote_metadata.h"
+#include "types.h"
 
 #define TEST_STR "Hello, world!"
 #define TEST_SIZE (sizeof(TEST_STR) - 1)
@@ -181,6 +183,75 @@ static void test_remote_registry(void) {
     printf("Remote registry tests passed!\n");
 }
 
+/* Parquet writer tuning parses from format_options and sticks to its remote */
+static void test_parquet_options(void) {
+    printf("Testing Parquet writer options...\n");
+    
+    eb_parquet_writer_options_t options;
+    assert(format_parse_parquet_options(NULL, &options) == EB_SUCCESS);
+    assert(options.values_encoding == EB_PARQUET_ENCODING_DEFAULT);
+    assert(options.row_group_rows == 0 && options.page_size == 0);
+    
+    assert(format_parse_parquet_options("encoding=byte_stream_split,dictionary=off,"
+                                        "dictionary.source=on,row_group_rows=4096,"
+                                        "page_size=1m,statistics=off", &options) == EB_SUCCESS);
+    assert(options.values_encoding == EB_PARQUET_ENCODING_BYTE_STREAM_SPLIT);
+    assert(options.dictionary == EB_PARQUET_OFF);
+    assert(options.column_count == 1);
+    assert(strcmp(options.columns[0].column, "source") == 0);
+    assert(options.columns[0].dictionary == EB_PARQUET_ON);
+    assert(options.row_group_rows == 4096);
+    assert(options.page_size == 1024 * 1024);
+    assert(options.statistics == EB_PARQUET_OFF);
+    
+    assert(format_parse_parquet_options("encoding=delta", &options) == EB_ERROR_INVALID_PARAMETER);
+    assert(format_parse_parquet_options("row_group_rows=0", &options) == EB_ERROR_INVALID_PARAMETER);
+    assert(format_parse_parquet_options("page_size=12q", &options) == EB_ERROR_INVALID_PARAMETER);
+    assert(format_parse_parquet_options("bloom=on", &options) == EB_ERROR_INVALID_PARAMETER);
+    assert(format_parse_parquet_options("statistics", &options) == EB_ERROR_INVALID_PARAMETER);
+    
+    assert(eb_remote_init() == EB_SUCCESS);
+    assert(eb_remote_add("test-tuned", "http://localhost:8082", NULL, 9, true, "parquet") == EB_SUCCESS);
+    assert(eb_remote_set_format_options("test-tuned", "encoding=plain,page_size=64k") == EB_SUCCESS);
+    assert(eb_remote_parquet_options("test-tuned", &options) == EB_SUCCESS);
+    assert(options.values_encoding == EB_PARQUET_ENCODING_PLAIN);
+    assert(options.page_size == 64 * 1024);
+    assert(eb_remote_set_format_options("test-tuned", "page_size=big") == EB_ERROR_INVALID_PARAMETER);
+    assert(eb_remote_set_format_options("missing", "encoding=plain") == EB_ERROR_NOT_FOUND);
+    assert(eb_remote_remove("test-tuned") == EB_SUCCESS);
+    eb_remote_shutdown();
+    
+    printf("Parquet writer option tests passed!\n");
+}
+
+/* Records for native remotes pass through untouched once their header checks out */
+static void test_native_records(void) {
+    printf("Testing native record passthrough...\n");
+    
+    unsigned char record[sizeof(eb_object_header_t) + 16] = {0};
+    eb_object_header_t header = { EB_VECTOR_MAGIC, EB_VERSION, EB_OBJ_VECTOR, 0, 16, {0} };
+    memcpy(record, &header, sizeof(header));
+    assert(eb_remote_object_is_record(record, sizeof(record)));
+    assert(!eb_remote_object_is_record(record, sizeof(header) - 1));
+    
+    void *payload = NULL;
+    size_t payload_size = 0;
+    assert(eb_remote_object_encode(record, sizeof(record), true, &payload, &payload_size) == EB_SUCCESS);
+    assert(payload == record && payload_size == sizeof(record));
+    
+    /* Records needing a local dictionary are not self-contained */
+    header.flags = 1u << EB_FLAG_DICT_SHIFT;
+    memcpy(record, &header, sizeof(header));
+    assert(!eb_remote_object_is_record(record, sizeof(record)));
+    
+    /* Neither is anything without an object header */
+    const char *text = "not an object record, just some bytes";
+    assert(eb_remote_object_encode(text, strlen(text), true, &payload, &payload_size) ==
+           EB_ERROR_INVALID_FORMAT);
+    
+    printf("Native record tests passed!\n");
+}
+
 int main(void) {
     printf("=== Remote Operations Test ===\n");
     
@@ -194,6 +265,8 @@ int main(void) {
     /* Run remote registry tests */
     printf("\nRunning remote registry tests...\n");
     test_remote_registry();
+    test_parquet_options();
+    test_native_records();
     
     printf("All remote operation tests passed!\n");
     return 0;
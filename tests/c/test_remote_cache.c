@@ -0,0 +1,133 @@
+/*
+ * EmbeddingBridge - Remote Object Cache Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "remote_cache.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+
+static const char* HASHES[] = {
+    "ab00000000000000000000000000000000000000000000000000000000000001",
+    "ab00000000000000000000000000000000000000000000000000000000000002",
+    "cd00000000000000000000000000000000000000000000000000000000000003",
+};
+
+static void setup_repo(const char* config) {
+    fixture_dir();
+    system("mkdir -p " TEST_ROOT "/.embr");
+
+    FILE* f = fopen(TEST_ROOT "/.embr/config", "w");
+    assert(f != NULL);
+    fputs(config, f);
+    fclose(f);
+}
+
+static bool exists(const char* hash, const char* ext) {
+    char path[4096];
+    assert(eb_remote_cache_path(TEST_ROOT, hash, ext, path, sizeof(path)) == EB_SUCCESS);
+    return access(path, F_OK) == 0;
+}
+
+static void insert(const char* hash, size_t size) {
+    char* raw = malloc(size);
+    assert(raw);
+    memset(raw, hash[63], size);
+    const char* meta = "source_file=a.txt\nfile_type=npy\n";
+    assert(eb_remote_cache_insert(TEST_ROOT, hash, raw, size, meta, strlen(meta)) == EB_SUCCESS);
+    free(raw);
+}
+
+static void test_insert_lookup(void) {
+    printf("Testing cache insert and lookup...\n");
+    setup_repo("[core]\n\tversion = 0.1.0\n");
+
+    assert(eb_remote_cache_lookup(TEST_ROOT, HASHES[0]) == EB_ERROR_NOT_FOUND);
+    insert(HASHES[0], 1000);
+    assert(eb_remote_cache_lookup(TEST_ROOT, HASHES[0]) == EB_SUCCESS);
+
+    char path[4096];
+    assert(eb_remote_cache_path(TEST_ROOT, HASHES[0], "raw", path, sizeof(path)) == EB_SUCCESS);
+    assert(strstr(path, "/.embr/cache/remote/ab/") != NULL);
+    struct stat st;
+    assert(stat(path, &st) == 0 && st.st_size == 1000);
+
+    char small[16];
+    assert(eb_remote_cache_path(TEST_ROOT, HASHES[0], "raw", small, sizeof(small)) == EB_ERROR_PATH_TOO_LONG);
+    assert(eb_remote_cache_path(TEST_ROOT, "abc", "raw", path, sizeof(path)) == EB_ERROR_INVALID_PARAMETER);
+
+    fixture_cleanup();
+    printf("Cache insert and lookup tests passed!\n");
+}
+
+static void test_integrity(void) {
+    printf("Testing cache integrity check...\n");
+    setup_repo("[core]\n\tversion = 0.1.0\n");
+    insert(HASHES[1], 1000);
+
+    /* Same size, different content */
+    char path[4096];
+    assert(eb_remote_cache_path(TEST_ROOT, HASHES[1], "raw", path, sizeof(path)) == EB_SUCCESS);
+    FILE* f = fopen(path, "r+b");
+    assert(f != NULL);
+    fputc('!', f);
+    fclose(f);
+
+    assert(eb_remote_cache_lookup(TEST_ROOT, HASHES[1]) == EB_ERROR_NOT_FOUND);
+    assert(!exists(HASHES[1], "raw") && !exists(HASHES[1], "meta") && !exists(HASHES[1], "sum"));
+
+    fixture_cleanup();
+    printf("Cache integrity tests passed!\n");
+}
+
+static void test_eviction(void) {
+    printf("Testing cache eviction...\n");
+    setup_repo("[core]\n\tversion = 0.1.0\n\n[storage]\n\tremote_cache_size = 5k\n");
+
+    insert(HASHES[0], 2000);
+    usleep(20000);
+    insert(HASHES[1], 2000);
+    usleep(20000);
+
+    /* Using the older entry makes the other one the eviction candidate */
+    assert(eb_remote_cache_lookup(TEST_ROOT, HASHES[0]) == EB_SUCCESS);
+    usleep(20000);
+    insert(HASHES[2], 2000);
+    assert(exists(HASHES[0], "raw"));
+    assert(!exists(HASHES[1], "raw") && !exists(HASHES[1], "sum"));
+    assert(exists(HASHES[2], "raw"));
+
+    /* The newest entry survives even when it alone is over the bound */
+    insert(HASHES[1], 8000);
+    assert(exists(HASHES[1], "raw"));
+    assert(!exists(HASHES[0], "raw") && !exists(HASHES[2], "raw"));
+
+    uint64_t freed = 0;
+    assert(eb_remote_cache_trim(TEST_ROOT, 0, &freed) == EB_SUCCESS);
+    assert(freed > 8000 && !exists(HASHES[1], "raw"));
+
+    fixture_cleanup();
+    printf("Cache eviction tests passed!\n");
+}
+
+int main(void) {
+    printf("Running remote cache tests...\n");
+    test_insert_lookup();
+    test_integrity();
+    test_eviction();
+    printf("All remote cache tests passed!\n");
+    return 0;
+}
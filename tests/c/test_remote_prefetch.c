@@ -0,0 +1,192 @@
+/*
+ * EmbeddingBridge - Remote Read-Ahead Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "remote_prefetch.h"
+#include "remote_cache.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define LOCAL 8
+#define REMOTE 64
+#define COUNT (LOCAL + REMOTE)
+#define DIMS 16
+#define WINDOW 16
+#define THREADS 8
+#define LATENCY_US 20000
+
+/* A remote that takes LATENCY_US per object and misses one of them */
+typedef struct {
+    const char* const* hashes;
+    const char* missing;
+    pthread_mutex_t lock;
+    size_t walked;                  /* Entries the walk has waited for */
+    size_t in_flight, max_in_flight;
+    size_t fetches[COUNT];
+    bool outside_window;
+} fake_remote_t;
+
+static eb_status_t fake_fetch(const char* root, const char* set_name, const char* hash, void* ctx) {
+    fake_remote_t* remote = ctx;
+    assert(strcmp(set_name, "main") == 0);
+    size_t index = 0;
+    while (strcmp(remote->hashes[index], hash) != 0)
+        index++;
+
+    pthread_mutex_lock(&remote->lock);
+    remote->fetches[index]++;
+    remote->outside_window |= index >= remote->walked + 1 + WINDOW;
+    if (++remote->in_flight > remote->max_in_flight)
+        remote->max_in_flight = remote->in_flight;
+    pthread_mutex_unlock(&remote->lock);
+
+    usleep(LATENCY_US);
+    eb_status_t status = EB_ERROR_NOT_FOUND;
+    if (strcmp(hash, remote->missing) != 0)
+        status = eb_remote_cache_insert(root, hash, hash, 64, "model=m\n", 8);
+
+    pthread_mutex_lock(&remote->lock);
+    remote->in_flight--;
+    pthread_mutex_unlock(&remote->lock);
+    return status;
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Local objects first, then objects only the fake remote has */
+static void make_hashes(char (*hashes)[65], const char** pointers) {
+    static float values[LOCAL * DIMS];
+    const char* sources[LOCAL];
+    char names[LOCAL][32];
+    for (int n = 0; n < LOCAL; n++) {
+        for (int i = 0; i < DIMS; i++)
+            values[n * DIMS + i] = (float)(n * 7 + i);
+        snprintf(names[n], sizeof(names[n]), "doc%d.txt", n);
+        sources[n] = names[n];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, LOCAL, DIMS, sources, "m", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    for (int n = LOCAL; n < COUNT; n++)
+        snprintf(hashes[n], sizeof(hashes[n]), "%056x%08x", 0xfe, n);
+    for (int n = 0; n < COUNT; n++)
+        pointers[n] = hashes[n];
+}
+
+static void test_read_ahead(void) {
+    printf("Testing read-ahead of a walk...\n");
+    fixture_repo("[core]\n\tversion = 0.1.0\n");
+    char hashes[COUNT][65];
+    const char* pointers[COUNT];
+    make_hashes(hashes, pointers);
+
+    fake_remote_t remote = { .hashes = pointers, .missing = hashes[COUNT - 5] };
+    pthread_mutex_init(&remote.lock, NULL);
+    eb_prefetch_options_t options = { WINDOW, THREADS, fake_fetch, &remote };
+    eb_prefetch_t* prefetch = NULL;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(eb_prefetch_start(".", "main", pointers, COUNT, &options, &prefetch) == EB_SUCCESS);
+
+    for (size_t i = 0; i < COUNT; i++) {
+        eb_status_t status = eb_prefetch_wait(prefetch, i);
+        assert(status == (i == COUNT - 5 ? EB_ERROR_NOT_FOUND : EB_SUCCESS));
+        if (i >= LOCAL && i != COUNT - 5)
+            assert(eb_remote_cache_lookup(".", hashes[i]) == EB_SUCCESS);
+        pthread_mutex_lock(&remote.lock);
+        remote.walked = i + 1;
+        pthread_mutex_unlock(&remote.lock);
+    }
+    double elapsed = seconds_since(&start);
+    assert(eb_prefetch_wait(prefetch, COUNT) == EB_ERROR_INVALID_PARAMETER);
+    eb_prefetch_stop(prefetch);
+
+    // Each remote object fetched once, never past the window, several at a time:
+    // the workers' and one the walk may fetch itself
+    for (size_t i = 0; i < COUNT; i++)
+        assert(remote.fetches[i] == (i < LOCAL ? 0u : 1u));
+    assert(!remote.outside_window);
+    assert(remote.max_in_flight > 1 && remote.max_in_flight <= THREADS + 1);
+    assert(elapsed < REMOTE * LATENCY_US / 1e6 / 2);
+
+    // A second walk finds everything cached
+    memset(remote.fetches, 0, sizeof(remote.fetches));
+    assert(eb_prefetch_start(".", "main", pointers, COUNT, &options, &prefetch) == EB_SUCCESS);
+    for (size_t i = 0; i < COUNT; i++)
+        assert(eb_prefetch_wait(prefetch, i) == (i == COUNT - 5 ? EB_ERROR_NOT_FOUND : EB_SUCCESS));
+    eb_prefetch_stop(prefetch);
+    for (size_t i = 0; i < COUNT; i++)
+        assert(remote.fetches[i] == (i == COUNT - 5 ? 1u : 0u));
+
+    pthread_mutex_destroy(&remote.lock);
+    fixture_cleanup();
+    printf("✓ Read-ahead of a walk passed\n");
+}
+
+static void test_on_demand(void) {
+    printf("Testing fetches on demand...\n");
+    fixture_repo("[core]\n\tversion = 0.1.0\n\n[storage]\n\tprefetch_window = 0\n");
+    char hashes[COUNT][65];
+    const char* pointers[COUNT];
+    make_hashes(hashes, pointers);
+
+    // No window: the walk fetches each object itself, one at a time
+    fake_remote_t remote = { .hashes = pointers, .missing = "" };
+    pthread_mutex_init(&remote.lock, NULL);
+    eb_prefetch_options_t options = { 0, THREADS, fake_fetch, &remote };
+    eb_prefetch_t* prefetch = NULL;
+    assert(eb_prefetch_start(".", "main", pointers, LOCAL + 4, &options, &prefetch) == EB_SUCCESS);
+    for (size_t i = 0; i < LOCAL + 4; i += 2)
+        assert(eb_prefetch_wait(prefetch, i) == EB_SUCCESS);
+    // Waiting again only returns the status
+    assert(eb_prefetch_wait(prefetch, LOCAL) == EB_SUCCESS);
+    eb_prefetch_stop(prefetch);
+    assert(remote.max_in_flight == 1);
+    for (size_t i = 0; i < LOCAL + 4; i++)
+        assert(remote.fetches[i] == (i >= LOCAL && i % 2 == 0 ? 1u : 0u));
+
+    // Short hashes are not fetched; nor is anything without a walk
+    const char* short_hash[] = { "abc" };
+    assert(eb_prefetch_start(".", "main", short_hash, 1, &options, &prefetch) == EB_SUCCESS);
+    assert(eb_prefetch_wait(prefetch, 0) == EB_ERROR_INVALID_PARAMETER);
+    eb_prefetch_stop(prefetch);
+    assert(eb_prefetch_start(".", "main", NULL, 0, NULL, &prefetch) == EB_SUCCESS);
+    assert(eb_prefetch_wait(prefetch, 0) == EB_ERROR_INVALID_PARAMETER);
+    eb_prefetch_stop(prefetch);
+    assert(eb_prefetch_start(".", NULL, pointers, 1, NULL, &prefetch) == EB_ERROR_INVALID_PARAMETER);
+
+    // Local objects need no remote
+    assert(eb_remote_fetch(".", "main", hashes[0]) == EB_SUCCESS);
+    assert(eb_remote_fetch(".", "main", "abc") == EB_ERROR_INVALID_PARAMETER);
+
+    pthread_mutex_destroy(&remote.lock);
+    fixture_cleanup();
+    printf("✓ Fetches on demand passed\n");
+}
+
+int main(void) {
+    printf("Running remote read-ahead tests...\n");
+    test_read_ahead();
+    test_on_demand();
+    printf("All remote read-ahead tests passed!\n");
+    return 0;
+}
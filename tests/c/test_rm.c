@@ -0,0 +1,112 @@
+/*
+ * EmbeddingBridge - RM Command Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "cli.h"
+#include "store.h"
+#include "set_index.h"
+#include "set_layers.h"
+#include "repo_fixture.h"
+
+#define DIMS 8
+
+static void store_vector(const char* source, float seed, char* hash) {
+    float values[DIMS];
+    for (int i = 0; i < DIMS; i++)
+        values[i] = seed + (float)i;
+    char hashes[1][65];
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, 1, DIMS, &source, "m1", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+    strcpy(hash, hashes[0]);
+}
+
+static void switch_set(const char* name) {
+    FILE* f = fopen(".embr/HEAD", "w");
+    assert(f != NULL);
+    fprintf(f, "%s\n", name);
+    fclose(f);
+}
+
+static int run_rm(const char* model, const char* file) {
+    char* argv[] = { "rm", "-q", "-m", (char*)model, (char*)file };
+    return cmd_rm(5, argv);
+}
+
+/* The source is tracked with that hash and its object can still be read */
+static void check_readable(const char* source, const char* hash) {
+    char current[65];
+    assert(get_current_hash_with_model(".", source, "m1", current, sizeof(current)) == EB_SUCCESS);
+    assert(strcmp(current, hash) == 0);
+
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    eb_object_view_t view;
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    eb_object_unmap(&view);
+    eb_store_destroy(store);
+}
+
+/* Nothing reports the source as tracked any more */
+static void check_removed(const char* source) {
+    eb_set_index_t* index = NULL;
+    char current[65];
+    assert(eb_set_index_open_current(".", &index) == EB_SUCCESS);
+    assert(eb_set_index_lookup(index, source, "m1", current) == EB_ERROR_NOT_FOUND);
+    eb_set_index_close(index);
+    assert(get_current_hash_with_model(".", source, "m1", current, sizeof(current)) ==
+           EB_ERROR_NOT_FOUND);
+}
+
+static void test_layered_base(void) {
+    printf("Testing removal from a layered set...\n");
+    fixture_repo(NULL);
+    char hash[65];
+    store_vector("doc1.txt", 1.0f, hash);
+
+    // The child shares the base's objects, so removing there must not delete them
+    assert(eb_set_layers_fork(".", "main", "trial") == EB_SUCCESS);
+    switch_set("trial");
+    assert(run_rm("m1", "doc1.txt") == 0);
+    check_removed("doc1.txt");
+
+    switch_set("main");
+    check_readable("doc1.txt", hash);
+    fixture_cleanup();
+    printf("✓ Removal from a layered set passed\n");
+}
+
+static void test_shared_vector(void) {
+    printf("Testing removal of a deduplicated vector...\n");
+    fixture_repo(NULL);
+    char hash[65], other[65];
+    store_vector("doc1.txt", 2.0f, hash);
+    store_vector("doc2.txt", 2.0f, other);
+    assert(strcmp(hash, other) == 0);
+
+    assert(run_rm("m1", "doc1.txt") == 0);
+    check_removed("doc1.txt");
+    check_readable("doc2.txt", hash);
+    fixture_cleanup();
+    printf("✓ Removal of a deduplicated vector passed\n");
+}
+
+int main(void) {
+    printf("Running rm tests...\n");
+    test_layered_base();
+    test_shared_vector();
+    printf("All rm tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * EmbeddingBridge - Remote Object Server Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "serve.h"
+
+typedef struct {
+    char root[64];
+    int fd;
+    eb_status_t status;
+} server_t;
+
+static void* server_main(void* arg) {
+    server_t* server = arg;
+    server->status = eb_serve(server->root, server->fd, server->fd);
+    return NULL;
+}
+
+/* Answer of one request: the DATA bytes and the DONE status */
+typedef struct {
+    char data[8192];
+    size_t size;
+    int status;
+    char message[256];
+} answer_t;
+
+static void send_request(int fd, uint8_t type, uint32_t id, const char* key,
+                         const void* body, size_t body_size) {
+    assert(eb_serve_write_frame(fd, type, id, key, strlen(key), body, body_size) == EB_SUCCESS);
+}
+
+static void read_answer(int fd, uint32_t id, answer_t* answer) {
+    memset(answer, 0, sizeof(*answer));
+    for (;;) {
+        eb_serve_frame_t frame;
+        assert(eb_serve_read_header(fd, &frame) == EB_SUCCESS);
+        assert(frame.id == id);
+        assert(frame.key_length < sizeof(answer->message));
+        assert(eb_serve_read_all(fd, answer->message, frame.key_length) == EB_SUCCESS);
+        if (frame.type == EB_SERVE_DONE) {
+            unsigned char status[4];
+            assert(frame.body_length == sizeof(status));
+            assert(eb_serve_read_all(fd, status, sizeof(status)) == EB_SUCCESS);
+            answer->status = (int32_t)eb_serve_get_u32(status);
+            return;
+        }
+        assert(frame.type == EB_SERVE_DATA);
+        assert(answer->size + frame.body_length <= sizeof(answer->data));
+        assert(eb_serve_read_all(fd, answer->data + answer->size, frame.body_length) == EB_SUCCESS);
+        answer->size += frame.body_length;
+    }
+}
+
+static void get_range(int fd, uint32_t id, const char* key, uint64_t offset, uint64_t length,
+                      int from_end, answer_t* answer) {
+    unsigned char range[17];
+    eb_serve_put_u64(range, offset);
+    eb_serve_put_u64(range + 8, length);
+    range[16] = (unsigned char)from_end;
+    send_request(fd, EB_SERVE_GET, id, key, range, sizeof(range));
+    read_answer(fd, id, answer);
+}
+
+static void start_server(server_t* server, pthread_t* thread, int* client) {
+    int sockets[2];
+    snprintf(server->root, sizeof(server->root), "/tmp/eb_serve_test_XXXXXX");
+    assert(mkdtemp(server->root));
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    server->fd = sockets[1];
+    *client = sockets[0];
+    assert(pthread_create(thread, NULL, server_main, server) == 0);
+
+    eb_serve_frame_t hello;
+    char greeting[64] = {0};
+    assert(eb_serve_read_header(*client, &hello) == EB_SUCCESS);
+    assert(hello.type == EB_SERVE_HELLO && hello.key_length < sizeof(greeting));
+    assert(eb_serve_read_all(*client, greeting, hello.key_length) == EB_SUCCESS);
+    assert(strcmp(greeting, EB_SERVE_GREETING) == 0);
+}
+
+static void stop_server(server_t* server, pthread_t thread, int client) {
+    send_request(client, EB_SERVE_BYE, 0, "", NULL, 0);
+    pthread_join(thread, NULL);
+    assert(server->status == EB_SUCCESS);
+    close(client);
+    close(server->fd);
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", server->root);
+    assert(system(command) == 0);
+}
+
+static void test_put_get(void) {
+    printf("Testing serve PUT and ranged GET...\n");
+    server_t server;
+    pthread_t thread;
+    int fd;
+    answer_t answer;
+    start_server(&server, &thread, &fd);
+
+    send_request(fd, EB_SERVE_PUT, 1, "sets/main/documents/a.parquet", "0123456789", 10);
+    read_answer(fd, 1, &answer);
+    assert(answer.status == EB_SUCCESS);
+
+    get_range(fd, 2, "sets/main/documents/a.parquet", 0, 0, 0, &answer);
+    assert(answer.status == EB_SUCCESS && answer.size == 10 && memcmp(answer.data, "0123456789", 10) == 0);
+    get_range(fd, 3, "sets/main/documents/a.parquet", 2, 3, 0, &answer);
+    assert(answer.status == EB_SUCCESS && answer.size == 3 && memcmp(answer.data, "234", 3) == 0);
+    get_range(fd, 4, "/sets/main/documents/a.parquet", 0, 4, 1, &answer);
+    assert(answer.status == EB_SUCCESS && answer.size == 4 && memcmp(answer.data, "6789", 4) == 0);
+    get_range(fd, 5, "sets/main/documents/a.parquet", 11, 0, 0, &answer);
+    assert(answer.status == EB_ERROR_INVALID_PARAMETER && answer.size == 0);
+    get_range(fd, 6, "sets/main/documents/missing.parquet", 0, 0, 0, &answer);
+    assert(answer.status == EB_ERROR_NOT_FOUND && answer.size == 0 && answer.message[0]);
+
+    /* Keys may not leave the root */
+    send_request(fd, EB_SERVE_PUT, 7, "sets/../../escape", "x", 1);
+    read_answer(fd, 7, &answer);
+    assert(answer.status == EB_ERROR_PERMISSION_DENIED);
+    char escaped[128];
+    snprintf(escaped, sizeof(escaped), "%s/../escape", server.root);
+    assert(access(escaped, F_OK) != 0);
+
+    stop_server(&server, thread, fd);
+    printf("Serve PUT and ranged GET tests passed!\n");
+}
+
+static void test_pipelined_list_delete(void) {
+    printf("Testing pipelined serve requests...\n");
+    server_t server;
+    pthread_t thread;
+    int fd;
+    answer_t answer;
+    start_server(&server, &thread, &fd);
+
+    /* Every request goes out before the first answer is read */
+    char key[64];
+    for (uint32_t i = 0; i < 20; i++) {
+        snprintf(key, sizeof(key), "repo/sets/main/documents/%02u.parquet", i);
+        send_request(fd, EB_SERVE_PUT, 100 + i, key, key, strlen(key));
+    }
+    send_request(fd, EB_SERVE_PUT, 120, "repo/sets/main/metadata.json", "{}", 2);
+    for (uint32_t i = 0; i <= 20; i++) {
+        read_answer(fd, 100 + i, &answer);
+        assert(answer.status == EB_SUCCESS);
+    }
+
+    send_request(fd, EB_SERVE_LIST, 200, "repo/sets/", NULL, 0);
+    read_answer(fd, 200, &answer);
+    assert(answer.status == EB_SUCCESS);
+    size_t lines = 0;
+    for (size_t i = 0; i < answer.size; i++) {
+        lines += answer.data[i] == '\n';
+    }
+    assert(lines == 21);
+    answer.data[answer.size] = '\0';
+    assert(strstr(answer.data, "repo/sets/main/documents/07.parquet\n"));
+    assert(strstr(answer.data, "repo/sets/main/metadata.json\n"));
+
+    send_request(fd, EB_SERVE_DELETE, 201, "repo/sets/main/documents/07.parquet", NULL, 0);
+    send_request(fd, EB_SERVE_DELETE, 202, "repo/sets/main/documents/07.parquet", NULL, 0);
+    read_answer(fd, 201, &answer);
+    assert(answer.status == EB_SUCCESS);
+    read_answer(fd, 202, &answer);
+    assert(answer.status == EB_SUCCESS);
+
+    send_request(fd, EB_SERVE_LIST, 203, "repo", NULL, 0);
+    read_answer(fd, 203, &answer);
+    answer.data[answer.size] = '\0';
+    assert(answer.status == EB_SUCCESS && !strstr(answer.data, "07.parquet"));
+
+    send_request(fd, EB_SERVE_LIST, 204, "nothing/here", NULL, 0);
+    read_answer(fd, 204, &answer);
+    assert(answer.status == EB_SUCCESS && answer.size == 0);
+
+    stop_server(&server, thread, fd);
+    printf("Pipelined serve request tests passed!\n");
+}
+
+int main(void) {
+    printf("Running serve tests...\n");
+    test_put_get();
+    test_pipelined_list_delete();
+    printf("All serve tests passed!\n");
+    return 0;
+}
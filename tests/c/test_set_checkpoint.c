@@ -0,0 +1,232 @@
+/*
+ * EmbeddingBridge - Set Checkpoint Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>
+#include "set_checkpoint.h"
+#include "log_index.h"
+#include "set_index.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define SET_DIR TEST_ROOT "/.embr/sets/main"
+#define LOG SET_DIR "/log"
+
+static const char* HASHES[] = {
+    "aa00000000000000000000000000000000000000000000000000000000000001",
+    "bb00000000000000000000000000000000000000000000000000000000000002",
+    "cc00000000000000000000000000000000000000000000000000000000000003",
+};
+
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " SET_DIR);
+}
+
+/* Entry i sets doc-(i % docs) to HASHES[i % 3] at time 1000 + i */
+static void append_entries(int first, int count, int docs) {
+    FILE* f = fopen(LOG, "a");
+    assert(f != NULL);
+    for (int i = first; i < first + count; i++)
+        fprintf(f, "%d %s doc-%04d.txt m\n", 1000 + i, HASHES[i % 3], i % docs);
+    fclose(f);
+}
+
+static int count_checkpoints(void) {
+    DIR* dir = opendir(SET_DIR "/" EB_CHECKPOINT_DIR);
+    if (!dir)
+        return 0;
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+        if (entry->d_name[0] != '.')
+            count++;
+    closedir(dir);
+    return count;
+}
+
+static const char* hash_of(const eb_set_state_t* state, int doc) {
+    char source[32];
+    snprintf(source, sizeof(source), "doc-%04d.txt", doc);
+    for (size_t i = 0; i < state->count; i++)
+        if (strcmp(state->items[i].source, source) == 0)
+            return state->items[i].hash;
+    return NULL;
+}
+
+static void test_point_parse(void) {
+    printf("Testing point parsing...\n");
+    eb_set_point_t at;
+    assert(eb_set_point_parse("42", &at) == EB_SUCCESS);
+    assert(at.kind == EB_SET_POINT_SEQ && at.seq == 42);
+    assert(eb_set_point_parse("@1700000000", &at) == EB_SUCCESS);
+    assert(at.kind == EB_SET_POINT_TIME && at.time == 1700000000);
+    assert(eb_set_point_parse("2024-03-01 12:30", &at) == EB_SUCCESS);
+    assert(at.kind == EB_SET_POINT_TIME);
+    time_t noon = at.time;
+    assert(eb_set_point_parse("2024-03-01T12:30:00", &at) == EB_SUCCESS && at.time == noon);
+    assert(eb_set_point_parse("2024-03-01", &at) == EB_SUCCESS && at.time < noon);
+    assert(eb_set_point_parse("yesterday", &at) == EB_ERROR_INVALID_INPUT);
+    assert(eb_set_point_parse("12x", &at) == EB_ERROR_INVALID_INPUT);
+    assert(eb_set_point_parse("", &at) == EB_ERROR_INVALID_INPUT);
+    printf("✓ Point parsing passed\n");
+}
+
+static void test_state_at(void) {
+    printf("Testing state at a point...\n");
+    setup_repo();
+    append_entries(0, 10, 4);
+
+    eb_set_state_t state;
+    assert(eb_set_state_at(LOG, NULL, &state) == EB_SUCCESS);
+    assert(state.count == 4 && state.seq == 10 && state.max_time == 1009);
+    assert(strcmp(state.items[0].source, "doc-0000.txt") == 0);
+    assert(strcmp(hash_of(&state, 0), HASHES[8 % 3]) == 0);
+    eb_set_state_free(&state);
+
+    eb_set_point_t at = { .kind = EB_SET_POINT_SEQ, .seq = 3 };
+    assert(eb_set_state_at(LOG, &at, &state) == EB_SUCCESS);
+    assert(state.count == 3 && state.seq == 3);
+    assert(hash_of(&state, 3) == NULL);
+    eb_set_state_free(&state);
+
+    at = (eb_set_point_t){ .kind = EB_SET_POINT_TIME, .time = 1004 };
+    assert(eb_set_state_at(LOG, &at, &state) == EB_SUCCESS);
+    assert(state.seq == 5 && state.count == 4);
+    assert(strcmp(hash_of(&state, 0), HASHES[4 % 3]) == 0);
+    eb_set_state_free(&state);
+
+    at = (eb_set_point_t){ .kind = EB_SET_POINT_TIME, .time = 10 };
+    assert(eb_set_state_at(LOG, &at, &state) == EB_SUCCESS);
+    assert(state.count == 0 && state.seq == 0);
+    eb_set_state_free(&state);
+    printf("✓ State at a point passed\n");
+}
+
+static void test_checkpoints(void) {
+    printf("Testing checkpoints...\n");
+    setup_repo();
+    append_entries(0, EB_CHECKPOINT_MIN - 1, 100);
+    assert(eb_checkpoint_update(LOG) == EB_SUCCESS);
+    assert(count_checkpoints() == 0);
+
+    append_entries(EB_CHECKPOINT_MIN - 1, EB_CHECKPOINT_EVERY, 100);
+    assert(eb_checkpoint_update(LOG) == EB_SUCCESS);
+    assert(count_checkpoints() == 1);
+    assert(eb_checkpoint_update(LOG) == EB_SUCCESS);
+    assert(count_checkpoints() == 1);
+
+    /* A tail after the checkpoint, then compare with a plain replay */
+    int total = EB_CHECKPOINT_MIN - 1 + EB_CHECKPOINT_EVERY + 50;
+    append_entries(total - 50, 50, 120);
+    eb_set_state_t with, without;
+    assert(eb_set_state_at(LOG, NULL, &with) == EB_SUCCESS);
+    assert(with.seq == (uint64_t)total && with.replayed == 50);
+
+    eb_set_point_t at = { .kind = EB_SET_POINT_SEQ, .seq = total - 10 };
+    eb_set_state_t partial;
+    assert(eb_set_state_at(LOG, &at, &partial) == EB_SUCCESS);
+    assert(partial.replayed == 40);
+    eb_set_state_free(&partial);
+
+    eb_checkpoint_remove_all(SET_DIR);
+    assert(count_checkpoints() == 0);
+    assert(eb_set_state_at(LOG, NULL, &without) == EB_SUCCESS);
+    assert(without.replayed == (uint64_t)total);
+    assert(with.count == without.count && with.count > 100);
+    for (size_t i = 0; i < with.count; i++) {
+        assert(strcmp(with.items[i].source, without.items[i].source) == 0);
+        assert(strcmp(with.items[i].hash, without.items[i].hash) == 0);
+        assert(with.items[i].timestamp == without.items[i].timestamp);
+    }
+    eb_set_state_free(&with);
+    eb_set_state_free(&without);
+    printf("✓ Checkpoints passed\n");
+}
+
+static void test_rewritten_log(void) {
+    printf("Testing checkpoints of a rewritten log...\n");
+    setup_repo();
+    append_entries(0, 100, 10);
+    assert(eb_checkpoint_write(LOG) == EB_SUCCESS);
+    assert(count_checkpoints() == 1);
+
+    /* Same length, different bytes just before the checkpoint */
+    system("sed -i '$ s/doc-0009/doc-0008/' " LOG);
+    eb_set_state_t state;
+    assert(eb_set_state_at(LOG, NULL, &state) == EB_SUCCESS);
+    assert(state.replayed == 100);
+    eb_set_state_free(&state);
+
+    assert(eb_checkpoint_update(LOG) == EB_SUCCESS);
+    assert(count_checkpoints() == 0);
+    printf("✓ Checkpoints of a rewritten log passed\n");
+}
+
+static void test_restore(void) {
+    printf("Testing restoring a state...\n");
+    setup_repo();
+    append_entries(0, 6, 3);
+    eb_set_index_change_t now[] = {
+        { "doc-0000.txt", "m", HASHES[2] },
+        { "doc-0001.txt", "m", HASHES[1] },
+        { "doc-0002.txt", "m", HASHES[2] },
+        { "extra.txt", "m", HASHES[0] },
+    };
+    assert(eb_set_index_apply(TEST_ROOT, SET_DIR "/index", now, 4) == EB_SUCCESS);
+
+    /* After three entries: doc-0000 aa, doc-0001 bb, doc-0002 cc */
+    eb_set_point_t at = { .kind = EB_SET_POINT_SEQ, .seq = 3 };
+    eb_set_state_t state;
+    assert(eb_set_state_at(LOG, &at, &state) == EB_SUCCESS);
+    eb_set_restore_summary_t summary;
+    assert(eb_set_state_restore(TEST_ROOT, SET_DIR, &state, &summary) == EB_SUCCESS);
+    assert(summary.restored == 1 && summary.removed == 1);
+    eb_set_state_free(&state);
+
+    eb_set_index_t* index;
+    char hash[65];
+    assert(eb_set_index_open(TEST_ROOT, SET_DIR "/index", &index) == EB_SUCCESS);
+    assert(eb_set_index_lookup(index, "doc-0000.txt", "m", hash) == EB_SUCCESS);
+    assert(strcmp(hash, HASHES[0]) == 0);
+    assert(eb_set_index_lookup(index, "doc-0002.txt", "m", hash) == EB_SUCCESS);
+    assert(strcmp(hash, HASHES[2]) == 0);
+    assert(eb_set_index_lookup(index, "extra.txt", "m", hash) == EB_ERROR_NOT_FOUND);
+    eb_set_index_close(index);
+
+    /* The restored entry is the newest in the log */
+    assert(eb_set_state_at(LOG, NULL, &state) == EB_SUCCESS);
+    assert(state.seq == 8 && strcmp(hash_of(&state, 0), HASHES[0]) == 0);
+    assert(hash_of(&state, 3) == NULL && state.count == 3);
+    eb_set_state_free(&state);
+
+    FILE* f = fopen(SET_DIR "/refs/models/m", "r");
+    assert(f != NULL);
+    char line[256];
+    assert(fgets(line, sizeof(line), f) && strstr(line, HASHES[0]) && strstr(line, "doc-0000.txt"));
+    assert(!fgets(line, sizeof(line), f));
+    fclose(f);
+    printf("✓ Restoring a state passed\n");
+}
+
+int main(void) {
+    printf("Running set checkpoint tests...\n");
+    test_point_parse();
+    test_state_at();
+    test_checkpoints();
+    test_rewritten_log();
+    test_restore();
+    fixture_cleanup();
+    printf("All set checkpoint tests passed!\n");
+    return 0;
+}
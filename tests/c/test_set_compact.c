@@ -0,0 +1,196 @@
+/*
+ * EmbeddingBridge - Set Compaction Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "set_compact.h"
+#include "set_checkpoint.h"
+#include "set_index.h"
+#include "log_index.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define SET_DIR TEST_ROOT "/.embr/sets/main"
+#define LOG SET_DIR "/log"
+#define INDEX SET_DIR "/index"
+
+static const char* HASHES[] = {
+    "aa00000000000000000000000000000000000000000000000000000000000001",
+    "bb00000000000000000000000000000000000000000000000000000000000002",
+};
+
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " SET_DIR);
+}
+
+static void append_line(int ts, const char* hash, const char* source) {
+    FILE* f = fopen(LOG, "a");
+    assert(f != NULL);
+    fprintf(f, "%d %s %s m\n", ts, hash, source);
+    fclose(f);
+}
+
+/* A line without a model, as rollback without -m writes */
+static void append_modelless(int ts, const char* hash, const char* source) {
+    FILE* f = fopen(LOG, "a");
+    assert(f != NULL);
+    fprintf(f, "%d %s %s\n", ts, hash, source);
+    fclose(f);
+}
+
+static int count_lines(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return 0;
+    int lines = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+        lines++;
+    fclose(f);
+    return lines;
+}
+
+static const char* hash_of(const eb_set_state_t* state, const char* source) {
+    for (size_t i = 0; i < state->count; i++)
+        if (strcmp(state->items[i].source, source) == 0)
+            return state->items[i].hash;
+    return NULL;
+}
+
+/* a and b recorded, a removed, b removed and recorded again */
+static void write_history(void) {
+    append_line(1000, HASHES[0], "a.txt");
+    append_line(1001, HASHES[0], "b.txt");
+    append_line(1002, HASHES[1], "a.txt");
+    append_line(1003, EB_LOG_TOMBSTONE, "a.txt");
+    append_line(1004, EB_LOG_TOMBSTONE, "b.txt");
+    append_line(1005, HASHES[1], "b.txt");
+}
+
+static void test_tombstone_replay(void) {
+    printf("Testing tombstone replay...\n");
+    setup_repo();
+    write_history();
+
+    eb_set_state_t state;
+    assert(eb_set_state_at(LOG, NULL, &state) == EB_SUCCESS);
+    assert(state.count == 1 && state.seq == 6);
+    assert(strcmp(hash_of(&state, "b.txt"), HASHES[1]) == 0);
+    eb_set_state_free(&state);
+
+    /* Before the removals both are there */
+    eb_set_point_t at = { .kind = EB_SET_POINT_SEQ, .seq = 3 };
+    assert(eb_set_state_at(LOG, &at, &state) == EB_SUCCESS);
+    assert(state.count == 2 && strcmp(hash_of(&state, "a.txt"), HASHES[1]) == 0);
+    eb_set_state_free(&state);
+    printf("✓ Tombstone replay passed\n");
+}
+
+static void test_index_append(void) {
+    printf("Testing index appends and compaction...\n");
+    setup_repo();
+    enum { DOCS = 600 };
+    static char sources[DOCS][32];
+    static eb_set_index_change_t changes[DOCS];
+    for (int i = 0; i < DOCS; i++) {
+        snprintf(sources[i], sizeof(sources[i]), "doc-%04d.txt", i);
+        changes[i] = (eb_set_index_change_t){ sources[i], "m", HASHES[i % 2] };
+    }
+    assert(eb_set_index_apply(TEST_ROOT, INDEX, changes, DOCS) == EB_SUCCESS);
+    bool compacted = true;
+    assert(eb_set_index_compact(TEST_ROOT, INDEX, &compacted) == EB_SUCCESS && !compacted);
+
+    /* Remove every even document: more than eb_set_index_apply() would
+     * leave in the tail */
+    size_t removals = 0;
+    for (int i = 0; i < DOCS; i += 2)
+        changes[removals++] = (eb_set_index_change_t){ sources[i], "m", NULL };
+    assert(eb_set_index_append(TEST_ROOT, INDEX, changes, removals) == EB_SUCCESS);
+
+    for (int pass = 0; pass < 2; pass++) {
+        eb_set_index_t* index;
+        char hash[65];
+        assert(eb_set_index_open(TEST_ROOT, INDEX, &index) == EB_SUCCESS);
+        for (int i = 0; i < DOCS; i++) {
+            eb_status_t status = eb_set_index_lookup(index, sources[i], "m", hash);
+            if (i % 2 == 0) {
+                assert(status == EB_ERROR_NOT_FOUND);
+            } else {
+                assert(status == EB_SUCCESS && strcmp(hash, HASHES[1]) == 0);
+            }
+        }
+        eb_set_index_close(index);
+
+        assert(eb_set_index_compact(TEST_ROOT, INDEX, &compacted) == EB_SUCCESS);
+        assert(compacted == (pass == 0));
+    }
+    printf("✓ Index appends and compaction passed\n");
+}
+
+static void test_log_compaction(void) {
+    printf("Testing log compaction...\n");
+    setup_repo();
+    write_history();
+    append_line(1006, HASHES[0], "c.txt");
+
+    eb_set_compact_summary_t summary;
+    assert(eb_set_compact(TEST_ROOT, SET_DIR, &summary) == EB_SUCCESS);
+    assert(summary.tombstones == 2);
+    assert(summary.dropped == 5 && summary.kept == 2);
+    assert(count_lines(LOG) == 2);
+
+    /* The same state, from the shorter log */
+    eb_set_state_t state;
+    assert(eb_set_state_at(LOG, NULL, &state) == EB_SUCCESS);
+    assert(state.count == 2 && state.seq == 2);
+    assert(strcmp(hash_of(&state, "b.txt"), HASHES[1]) == 0);
+    assert(strcmp(hash_of(&state, "c.txt"), HASHES[0]) == 0);
+    eb_set_state_free(&state);
+
+    /* Nothing left to fold in */
+    assert(eb_set_compact(TEST_ROOT, SET_DIR, &summary) == EB_SUCCESS);
+    assert(summary.tombstones == 0 && summary.dropped == 0 && summary.kept == 2);
+
+    assert(eb_set_compact(TEST_ROOT, TEST_ROOT "/.embr/sets/missing", NULL) == EB_ERROR_NOT_FOUND);
+    assert(eb_set_compact_all(TEST_ROOT) == EB_SUCCESS);
+    printf("✓ Log compaction passed\n");
+}
+
+static void test_modelless_tombstone(void) {
+    printf("Testing tombstones without a model...\n");
+    setup_repo();
+    for (int i = 0; i < 4; i++)
+        append_line(1000 + i, HASHES[i % 2], "doc0.txt");
+    append_modelless(1004, HASHES[0], "doc0.txt");
+    append_line(1005, HASHES[1], "doc1.txt");
+    append_modelless(1006, EB_LOG_TOMBSTONE, "doc0.txt");
+
+    /* It covers the lines of every model of its source */
+    eb_set_compact_summary_t summary;
+    assert(eb_set_compact(TEST_ROOT, SET_DIR, &summary) == EB_SUCCESS);
+    assert(summary.tombstones == 1);
+    assert(summary.dropped == 6 && summary.kept == 1);
+    assert(count_lines(LOG) == 1);
+    printf("✓ Tombstones without a model passed\n");
+}
+
+int main(void) {
+    printf("Running set compaction tests...\n");
+    test_tombstone_replay();
+    test_index_append();
+    test_log_compaction();
+    test_modelless_tombstone();
+    fixture_cleanup();
+    printf("All set compaction tests passed!\n");
+    return 0;
+}
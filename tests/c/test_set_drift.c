@@ -0,0 +1,337 @@
+/*
+ * EmbeddingBridge - Set-to-Set Vector Drift Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <math.h>
+#include "set_drift.h"
+#include "set_index.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS 16
+#define COUNT 400
+
+static float vectors[COUNT][DIMS];
+static float changed[COUNT][DIMS];
+static char hashes[COUNT][65];
+static char changed_hashes[COUNT][65];
+
+/* Minimal .npy file around the values */
+static void write_npy(const char* path, const float* values, size_t count) {
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu,), }", count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    uint16_t header_size = (uint16_t)length;
+    assert(fwrite("\x93NUMPY\x01\x00", 1, 8, f) == 8);
+    assert(fwrite(&header_size, sizeof(header_size), 1, f) == 1);
+    assert(fwrite(header, 1, (size_t)length, f) == (size_t)length);
+    assert(fwrite(values, sizeof(float), count, f) == count);
+    fclose(f);
+}
+
+/* Store every vector of a table in the current set and keep the hashes */
+static void store_all(float table[COUNT][DIMS], char out[COUNT][65]) {
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    for (int i = 0; i < COUNT; i++) {
+        char path[64], source[64];
+        snprintf(path, sizeof(path), "v%d.npy", i);
+        snprintf(source, sizeof(source), "doc%03d.txt", i);
+        write_npy(path, table[i], DIMS);
+        assert(eb_store_batch_add(batch, path, source, "m1", out[i]) == EB_SUCCESS);
+    }
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static void store_one(const char* source, const char* model, const float* values, size_t dims,
+                      char hash[65]) {
+    write_npy("one.npy", values, dims);
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "one.npy", source, model, hash) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+/*
+ * main holds the original vectors; experimental shares a quarter of the
+ * objects, scales a quarter, perturbs a quarter and lacks the rest.
+ */
+static void setup_repo(void) {
+    fixture_repo(NULL);
+    assert(mkdir(".embr/sets/experimental", 0755) == 0);
+
+    for (int i = 0; i < COUNT; i++) {
+        for (int d = 0; d < DIMS; d++) {
+            vectors[i][d] = sinf((float)(i * DIMS + d) * 0.71f);
+            changed[i][d] = i % 4 == 1 ? 2.0f * vectors[i][d]
+                                       : vectors[i][d] + 0.01f * (float)(i % 7 + 1) * cosf((float)d);
+        }
+    }
+
+    /* The changed objects are stored first, then main is reset to the originals */
+    store_all(changed, changed_hashes);
+    store_all(vectors, hashes);
+
+    eb_set_index_change_t* changes = malloc((COUNT + 2) * sizeof(*changes));
+    char (*sources)[32] = malloc(COUNT * sizeof(*sources));
+    assert(changes && sources);
+    size_t count = 0;
+    for (int i = 0; i < COUNT; i++) {
+        if (i % 4 == 3)
+            continue;
+        snprintf(sources[count], sizeof(sources[0]), "doc%03d.txt", i);
+        changes[count] = (eb_set_index_change_t){ sources[count], "m1",
+                                                  i % 4 == 0 ? hashes[i] : changed_hashes[i] };
+        count++;
+    }
+
+    /* A file only experimental has, and one whose vectors have other dimensions */
+    char extra_hash[65], narrow_hash[65], wide_hash[65];
+    float narrow[DIMS / 2] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    store_one("zz-extra.txt", "m1", vectors[0], DIMS, extra_hash);
+    store_one("zz-dims.txt", "m1", narrow, DIMS / 2, narrow_hash);
+    store_one("zz-dims.txt", "m1", vectors[1], DIMS, wide_hash);
+    changes[count++] = (eb_set_index_change_t){ "zz-dims.txt", "m1", narrow_hash };
+    changes[count++] = (eb_set_index_change_t){ "zz-extra.txt", "m1", extra_hash };
+    assert(eb_set_index_apply(".", ".embr/sets/experimental/index", changes, count) == EB_SUCCESS);
+
+    /* zz-extra.txt must only be in experimental; main also has another model */
+    eb_set_index_change_t main_changes[] = { { "zz-extra.txt", NULL, NULL } };
+    assert(eb_set_index_apply_current(".", main_changes, 1) == EB_SUCCESS);
+    char other_hash[65];
+    store_one("doc000.txt", "m2", vectors[5], DIMS, other_hash);
+
+    free(changes);
+    free(sources);
+}
+
+typedef struct {
+    eb_drift_pair_t pairs[COUNT + 8];
+    char sources[COUNT + 8][32];
+    size_t count;
+    size_t stop_after;
+} recorder_t;
+
+static int record_pair(const eb_drift_pair_t* pair, void* ctx) {
+    recorder_t* r = ctx;
+    assert(r->count < COUNT + 8);
+    r->pairs[r->count] = *pair;
+    snprintf(r->sources[r->count], sizeof(r->sources[0]), "%s", pair->source);
+    r->pairs[r->count].source = r->sources[r->count];
+    r->pairs[r->count].model = NULL;
+    r->pairs[r->count].hash_a = NULL;
+    r->pairs[r->count].hash_b = NULL;
+    r->count++;
+    return r->stop_after && r->count == r->stop_after;
+}
+
+static void test_vector_drift(void) {
+    printf("Testing set vector drift...\n");
+
+    static recorder_t r;
+    eb_drift_options_t options = { "m1", 3, 0, 0 };
+    eb_drift_summary_t summary;
+    assert(eb_set_drift(".", "main", "experimental", &options, record_pair, &r, &summary) ==
+           EB_SUCCESS);
+
+    assert(summary.pairs == COUNT / 4 * 3 + 1);
+    assert(summary.same == COUNT / 4);
+    assert(summary.changed == COUNT / 2);
+    assert(summary.only_a == COUNT / 4);
+    assert(summary.only_b == 1);
+    assert(summary.dimensions == 1);
+    assert(summary.unreadable == 0);
+    assert(r.count == COUNT + 2);
+
+    size_t binned = 0;
+    for (int i = 0; i < EB_DRIFT_BINS; i++)
+        binned += summary.histogram[i];
+    assert(binned == summary.same + summary.changed);
+    assert(summary.histogram[0] >= COUNT / 2);  /* Identical and scaled vectors */
+
+    double cosine_total = 0, l2_total = 0;
+    for (size_t p = 0; p < r.count; p++) {
+        const eb_drift_pair_t* pair = &r.pairs[p];
+        assert(p == 0 || strcmp(r.sources[p - 1], r.sources[p]) < 0);
+        if (strcmp(pair->source, "zz-dims.txt") == 0) {
+            assert(pair->state == EB_DRIFT_DIMENSIONS);
+            continue;
+        }
+        if (strcmp(pair->source, "zz-extra.txt") == 0) {
+            assert(pair->state == EB_DRIFT_ONLY_B);
+            continue;
+        }
+
+        int i = -1;
+        assert(sscanf(pair->source, "doc%d.txt", &i) == 1);
+        switch (i % 4) {
+        case 0:
+            assert(pair->state == EB_DRIFT_SAME && pair->cosine == 0.0f && pair->l2 == 0.0f);
+            break;
+        case 3:
+            assert(pair->state == EB_DRIFT_ONLY_A);
+            continue;
+        default: {
+            assert(pair->state == EB_DRIFT_CHANGED);
+            double dot = 0, na = 0, nb = 0, l2 = 0;
+            for (int d = 0; d < DIMS; d++) {
+                dot += (double)vectors[i][d] * changed[i][d];
+                na += (double)vectors[i][d] * vectors[i][d];
+                nb += (double)changed[i][d] * changed[i][d];
+                l2 += ((double)vectors[i][d] - changed[i][d]) * ((double)vectors[i][d] - changed[i][d]);
+            }
+            double cosine = 1.0 - dot / sqrt(na * nb);
+            assert(fabs(pair->cosine - (cosine < 0 ? 0 : cosine)) < 1e-5);
+            assert(fabs(pair->l2 - sqrt(l2)) < 1e-4 * (1 + sqrt(l2)));
+            break;
+        }
+        }
+        cosine_total += pair->cosine;
+        l2_total += pair->l2;
+    }
+    assert(fabs(summary.mean_cosine - cosine_total / (COUNT * 3 / 4)) < 1e-6);
+    assert(fabs(summary.mean_l2 - l2_total / (COUNT * 3 / 4)) < 1e-5);
+
+    /* The worker count does not change the result */
+    static recorder_t single;
+    options.threads = 1;
+    eb_drift_summary_t single_summary;
+    assert(eb_set_drift(".", "main", "experimental", &options, record_pair, &single,
+                        &single_summary) == EB_SUCCESS);
+    assert(single.count == r.count);
+    for (size_t p = 0; p < r.count; p++) {
+        assert(strcmp(single.sources[p], r.sources[p]) == 0);
+        assert(single.pairs[p].state == r.pairs[p].state);
+        assert(single.pairs[p].cosine == r.pairs[p].cosine && single.pairs[p].l2 == r.pairs[p].l2);
+    }
+    assert(single_summary.mean_cosine == summary.mean_cosine);
+
+    /* Without a filter the other model is an entry only main has */
+    assert(eb_set_drift(".", "main", "experimental", NULL, NULL, NULL, &summary) == EB_SUCCESS);
+    assert(summary.only_a == COUNT / 4 + 1);
+
+    printf("Set vector drift tests passed!\n");
+}
+
+static void test_prefix_drift(void) {
+    printf("Testing prefix-screened set drift...\n");
+
+    enum { PREFIX = 6, REFINE = 20 };
+    static recorder_t full, screened;
+    eb_drift_options_t options = { "m1", 2, 0, 0 };
+    eb_drift_summary_t full_summary, summary;
+    assert(eb_set_drift(".", "main", "experimental", &options, record_pair, &full, &full_summary) ==
+           EB_SUCCESS);
+    options.prefix_dims = PREFIX;
+    options.refine = REFINE;
+    assert(eb_set_drift(".", "main", "experimental", &options, record_pair, &screened, &summary) ==
+           EB_SUCCESS);
+    assert(summary.changed == full_summary.changed && summary.dimensions == 1);
+    assert(summary.screened == summary.changed - REFINE);
+    assert(screened.count == full.count);
+
+    double lowest_refined = 2.0, highest_screened = 0.0;
+    for (size_t p = 0; p < screened.count; p++) {
+        const eb_drift_pair_t* pair = &screened.pairs[p];
+        assert(pair->state == full.pairs[p].state);
+        if (pair->state != EB_DRIFT_CHANGED) {
+            assert(!pair->screened);
+            continue;
+        }
+
+        int i = -1;
+        assert(sscanf(pair->source, "doc%d.txt", &i) == 1);
+        double dot = 0, na = 0, nb = 0, full_na = 0, full_nb = 0;
+        for (int d = 0; d < DIMS; d++) {
+            if (d < PREFIX) {
+                dot += (double)vectors[i][d] * changed[i][d];
+                na += (double)vectors[i][d] * vectors[i][d];
+                nb += (double)changed[i][d] * changed[i][d];
+            }
+            full_na += (double)vectors[i][d] * vectors[i][d];
+            full_nb += (double)changed[i][d] * changed[i][d];
+        }
+        double prefix_cosine = 1.0 - dot / sqrt(na * nb);
+        if (prefix_cosine < 0)
+            prefix_cosine = 0;
+
+        if (!pair->screened) {
+            /* Refined pairs carry the full scores */
+            assert(pair->cosine == full.pairs[p].cosine && pair->l2 == full.pairs[p].l2);
+            if (prefix_cosine < lowest_refined)
+                lowest_refined = prefix_cosine;
+            continue;
+        }
+
+        /* Screened pairs score the renormalized prefixes; L2 uses the full norms */
+        double l2 = full_na + full_nb - 2.0 * sqrt(full_na * full_nb) * (1.0 - pair->cosine);
+        assert(fabs(pair->cosine - prefix_cosine) < 1e-5);
+        assert(fabs(pair->l2 - sqrt(l2 > 0 ? l2 : 0)) < 1e-3 * (1 + sqrt(full_na)));
+        if (prefix_cosine > highest_screened)
+            highest_screened = prefix_cosine;
+    }
+
+    /* The refined pairs are the ones that drifted most on the prefix */
+    assert(lowest_refined >= highest_screened - 1e-5);
+
+    /* A prefix as long as the vectors is no screen */
+    options.prefix_dims = DIMS;
+    assert(eb_set_drift(".", "main", "experimental", &options, NULL, NULL, &summary) == EB_SUCCESS);
+    assert(summary.screened == 0 && summary.mean_cosine == full_summary.mean_cosine);
+
+    printf("Prefix-screened set drift tests passed!\n");
+}
+
+static void test_drift_errors(void) {
+    printf("Testing set vector drift errors...\n");
+
+    eb_drift_summary_t summary;
+    assert(eb_set_drift(".", "main", "missing", NULL, NULL, NULL, &summary) == EB_ERROR_NOT_FOUND);
+    assert(eb_set_drift(".", "../sets", "main", NULL, NULL, NULL, &summary) == EB_ERROR_NOT_FOUND);
+
+    /* A set compared with itself only has identical pairs */
+    assert(eb_set_drift(".", "main", "main", NULL, NULL, NULL, &summary) == EB_SUCCESS);
+    assert(summary.pairs == summary.same && summary.changed == 0);
+    assert(summary.only_a == 0 && summary.only_b == 0 && summary.max_cosine == 0.0f);
+
+    /* Stopping early leaves a summary of the pairs visited */
+    static recorder_t r;
+    r.stop_after = 5;
+    assert(eb_set_drift(".", "main", "experimental", NULL, record_pair, &r, &summary) == EB_SUCCESS);
+    assert(r.count == 5);
+    assert(summary.pairs + summary.only_a + summary.only_b == 5);
+
+    printf("Set vector drift error tests passed!\n");
+}
+
+int main(void) {
+    printf("Running set drift tests...\n");
+
+    setup_repo();
+    test_vector_drift();
+    test_prefix_drift();
+    test_drift_errors();
+    fixture_cleanup();
+
+    printf("All set drift tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * EmbeddingBridge - Set Index Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "set_index.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define TEST_INDEX TEST_ROOT "/.embr/sets/main/index"
+
+static const char* HASH_A = "aa00000000000000000000000000000000000000000000000000000000000001";
+static const char* HASH_B = "bb00000000000000000000000000000000000000000000000000000000000002";
+static const char* HASH_C = "cc00000000000000000000000000000000000000000000000000000000000003";
+
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " TEST_ROOT "/.embr/objects " TEST_ROOT "/.embr/sets/main");
+}
+
+static eb_set_index_header_t read_header(void) {
+    eb_set_index_header_t header;
+    FILE* f = fopen(TEST_INDEX, "rb");
+    assert(f != NULL);
+    assert(fread(&header, sizeof(header), 1, f) == 1);
+    fclose(f);
+    return header;
+}
+
+static void apply(const char* source, const char* model, const char* hash) {
+    eb_set_index_change_t change = { source, model, hash };
+    assert(eb_set_index_apply(TEST_ROOT, TEST_INDEX, &change, 1) == EB_SUCCESS);
+}
+
+static void expect(const char* source, const char* model, const char* hash) {
+    eb_set_index_t* index;
+    char found[65];
+    assert(eb_set_index_open(TEST_ROOT, TEST_INDEX, &index) == EB_SUCCESS);
+    eb_status_t status = eb_set_index_lookup(index, source, model, found);
+    if (hash) {
+        assert(status == EB_SUCCESS);
+        assert(strcmp(found, hash) == 0);
+    } else {
+        assert(status == EB_ERROR_NOT_FOUND);
+    }
+    eb_set_index_close(index);
+}
+
+static int count_visit(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    (void)model;
+    (void)hash;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static int count_entries(const char* source) {
+    eb_set_index_t* index;
+    int count = 0;
+    assert(eb_set_index_open(TEST_ROOT, TEST_INDEX, &index) == EB_SUCCESS);
+    assert(eb_set_index_foreach(index, source, count_visit, &count) == EB_SUCCESS);
+    eb_set_index_close(index);
+    return count;
+}
+
+static void test_updates(void) {
+    printf("Testing index updates...\n");
+
+    setup_repo();
+    expect("a.txt", NULL, NULL);
+    assert(eb_set_index_create(TEST_INDEX) == EB_SUCCESS);
+    expect("a.txt", NULL, NULL);
+
+    apply("a.txt", "openai", HASH_A);
+    apply("a.txt", "voyage", HASH_B);
+    apply("b.txt", "openai", HASH_C);
+    expect("a.txt", "openai", HASH_A);
+    expect("a.txt", NULL, HASH_B);  /* Most recently stored model */
+    expect("b.txt", NULL, HASH_C);
+    expect("a.txt", "cohere", NULL);
+
+    /* Small updates append and commit through the header */
+    eb_set_index_header_t header = read_header();
+    assert(header.magic == EB_SET_INDEX_MAGIC);
+    assert(header.sorted_count == 0 && header.tail_count == 3);
+
+    apply("a.txt", "openai", HASH_C);
+    expect("a.txt", "openai", HASH_C);
+    expect("a.txt", NULL, HASH_C);
+    assert(count_entries("a.txt") == 2);
+
+    apply("a.txt", "voyage", NULL);
+    expect("a.txt", "voyage", NULL);
+    expect("a.txt", NULL, HASH_C);
+
+    apply("a.txt", NULL, NULL);
+    expect("a.txt", NULL, NULL);
+    assert(count_entries(NULL) == 1);
+
+    /* Invalid hashes are rejected without touching the index */
+    eb_set_index_change_t bad = { "c.txt", NULL, "xyz" };
+    assert(eb_set_index_apply(TEST_ROOT, TEST_INDEX, &bad, 1) == EB_ERROR_INVALID_INPUT);
+
+    fixture_cleanup();
+    printf("Index update tests passed!\n");
+}
+
+static void test_compaction(void) {
+    printf("Testing index compaction...\n");
+
+    setup_repo();
+    enum { COUNT = 600 };
+    static char sources[COUNT][32];
+    static eb_set_index_change_t changes[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(sources[i], sizeof(sources[i]), "docs/%04d.txt", COUNT - i);
+        changes[i].source = sources[i];
+        changes[i].model = "openai";
+        changes[i].hash = (i % 2) ? HASH_A : HASH_B;
+    }
+    assert(eb_set_index_apply(TEST_ROOT, TEST_INDEX, changes, COUNT) == EB_SUCCESS);
+
+    eb_set_index_header_t header = read_header();
+    assert(header.sorted_count == COUNT && header.tail_count == 0);
+    expect("docs/0001.txt", "openai", HASH_A);
+    expect("docs/0600.txt", "openai", HASH_B);
+    expect("docs/0000.txt", NULL, NULL);
+
+    /* Appends on top of the sorted block resolve the same way */
+    apply("docs/0300.txt", "openai", HASH_C);
+    apply("docs/0301.txt", NULL, NULL);
+    header = read_header();
+    assert(header.sorted_count == COUNT && header.tail_count == 2);
+    expect("docs/0300.txt", "openai", HASH_C);
+    expect("docs/0301.txt", NULL, NULL);
+    assert(count_entries(NULL) == COUNT - 1);
+
+    fixture_cleanup();
+    printf("Index compaction tests passed!\n");
+}
+
+static void test_text_index(void) {
+    printf("Testing text index conversion...\n");
+
+    setup_repo();
+    FILE* f = fopen(TEST_ROOT "/.embr/objects/aa00000000000000000000000000000000000000000000000000000000000001.meta", "w");
+    assert(f != NULL);
+    fputs("source_file=a.txt\nmodel=openai\n", f);
+    fclose(f);
+    f = fopen(TEST_INDEX, "w");
+    assert(f != NULL);
+    fprintf(f, "%s a.txt\n%s b.txt\n%s a.txt\n", HASH_B, HASH_C, HASH_A);
+    fclose(f);
+
+    /* Readable as is: the later a.txt line has a different model */
+    expect("a.txt", NULL, HASH_A);
+    expect("a.txt", "openai", HASH_A);
+    expect("b.txt", NULL, HASH_C);
+    assert(count_entries(NULL) == 3);
+
+    /* The first update rewrites it in the binary format */
+    apply("c.txt", "openai", HASH_C);
+    eb_set_index_header_t header = read_header();
+    assert(header.magic == EB_SET_INDEX_MAGIC);
+    assert(header.sorted_count == 4);
+    expect("a.txt", "openai", HASH_A);
+    expect("a.txt", "", HASH_B);
+
+    char buf[1024] = "";
+    f = fmemopen(buf, sizeof(buf), "w");
+    assert(f != NULL);
+    eb_set_index_t* index;
+    assert(eb_set_index_open(TEST_ROOT, TEST_INDEX, &index) == EB_SUCCESS);
+    assert(eb_set_index_export(index, f) == EB_SUCCESS);
+    eb_set_index_close(index);
+    fclose(f);
+    assert(strstr(buf, "c.txt openai\n") != NULL);
+
+    fixture_cleanup();
+    printf("Text index conversion tests passed!\n");
+}
+
+int main(void) {
+    printf("Running set index tests...\n");
+
+    test_updates();
+    test_compaction();
+    test_text_index();
+
+    printf("All set index tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * EmbeddingBridge - Copy-on-Write Set Layer Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "set_layers.h"
+#include "set_index.h"
+#include "log_index.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define SETS TEST_ROOT "/.embr/sets"
+#define MAIN_DIR SETS "/main"
+#define TRIAL_DIR SETS "/trial"
+
+static const char* HASH_A = "aa00000000000000000000000000000000000000000000000000000000000001";
+static const char* HASH_B = "bb00000000000000000000000000000000000000000000000000000000000002";
+static const char* HASH_C = "cc00000000000000000000000000000000000000000000000000000000000003";
+
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " TEST_ROOT "/.embr/objects " MAIN_DIR "/refs/models");
+    assert(eb_set_index_create(MAIN_DIR "/index") == EB_SUCCESS);
+    FILE* f = fopen(MAIN_DIR "/log", "w");
+    assert(f != NULL);
+    fclose(f);
+}
+
+/* Record a change the way the store does: index entry plus log line */
+static void add(const char* set_dir, long timestamp, const char* source, const char* hash) {
+    char path[256];
+    eb_set_index_change_t change = { source, "m", hash };
+    snprintf(path, sizeof(path), "%s/index", set_dir);
+    assert(eb_set_index_apply(TEST_ROOT, path, &change, 1) == EB_SUCCESS);
+    if (!hash)
+        return;
+    snprintf(path, sizeof(path), "%s/log", set_dir);
+    FILE* f = fopen(path, "a");
+    assert(f != NULL);
+    fprintf(f, "%ld %s %s m\n", timestamp, hash, source);
+    fclose(f);
+}
+
+static void expect(const char* set_dir, const char* source, const char* hash) {
+    char path[256], found[65];
+    eb_set_index_t* index;
+    snprintf(path, sizeof(path), "%s/index", set_dir);
+    assert(eb_set_index_open(TEST_ROOT, path, &index) == EB_SUCCESS);
+    eb_status_t status = eb_set_index_lookup(index, source, "m", found);
+    if (hash) {
+        assert(status == EB_SUCCESS);
+        assert(strcmp(found, hash) == 0);
+    } else {
+        assert(status == EB_ERROR_NOT_FOUND);
+    }
+    eb_set_index_close(index);
+}
+
+static int count_entry(const eb_log_entry_t* entry, void* ctx) {
+    (void)entry;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static int log_lines(const char* set_dir, const char* source) {
+    char path[256];
+    int count = 0;
+    snprintf(path, sizeof(path), "%s/log", set_dir);
+    if (source)
+        assert(eb_log_foreach_source(path, source, count_entry, &count) == EB_SUCCESS);
+    else
+        assert(eb_log_foreach(path, count_entry, &count) == EB_SUCCESS);
+    return count;
+}
+
+static void test_fork_isolation(void) {
+    printf("Testing layered set isolation...\n");
+    setup_repo();
+    add(MAIN_DIR, 100, "a.txt", HASH_A);
+    add(MAIN_DIR, 101, "b.txt", HASH_B);
+
+    assert(eb_set_layers_fork(TEST_ROOT, "main", "trial") == EB_SUCCESS);
+    assert(eb_set_layers_fork(TEST_ROOT, "main", "trial") == EB_ERROR_INVALID_INPUT);
+    assert(eb_set_layers_fork(TEST_ROOT, "missing", "other") == EB_ERROR_NOT_FOUND);
+    expect(TRIAL_DIR, "a.txt", HASH_A);
+    expect(TRIAL_DIR, "b.txt", HASH_B);
+    assert(log_lines(TRIAL_DIR, NULL) == 2);
+
+    /* Changes on either side after the fork stay on that side */
+    add(TRIAL_DIR, 200, "a.txt", HASH_C);
+    add(TRIAL_DIR, 201, "b.txt", NULL);
+    add(MAIN_DIR, 202, "c.txt", HASH_C);
+    expect(TRIAL_DIR, "a.txt", HASH_C);
+    expect(TRIAL_DIR, "b.txt", NULL);
+    expect(TRIAL_DIR, "c.txt", NULL);
+    expect(MAIN_DIR, "a.txt", HASH_A);
+    expect(MAIN_DIR, "b.txt", HASH_B);
+    expect(MAIN_DIR, "c.txt", HASH_C);
+    assert(log_lines(TRIAL_DIR, "a.txt") == 2);
+    assert(log_lines(TRIAL_DIR, "c.txt") == 0);
+    assert(log_lines(MAIN_DIR, NULL) == 3);
+
+    eb_set_layers_t layers;
+    assert(eb_set_layers_load(TRIAL_DIR, &layers) == EB_SUCCESS);
+    assert(layers.count == 1 && strcmp(layers.items[0].set, "main") == 0);
+    eb_set_layers_free(&layers);
+    printf("✓ Layered set isolation passed\n");
+}
+
+static void test_compaction_keeps_removals(void) {
+    printf("Testing removals across compaction...\n");
+    /* Enough changes to compact both indexes */
+    char source[32];
+    for (int i = 0; i < 600; i++) {
+        snprintf(source, sizeof(source), "bulk-%d.txt", i);
+        add(TRIAL_DIR, 300 + i, source, HASH_A);
+        add(MAIN_DIR, 300 + i, source, HASH_B);
+    }
+    expect(TRIAL_DIR, "b.txt", NULL);
+    expect(TRIAL_DIR, "a.txt", HASH_C);
+    expect(TRIAL_DIR, "bulk-10.txt", HASH_A);
+    expect(MAIN_DIR, "b.txt", HASH_B);
+    expect(MAIN_DIR, "bulk-10.txt", HASH_B);
+    printf("✓ Removals across compaction passed\n");
+}
+
+static void test_nested_fork(void) {
+    printf("Testing a set based on a layered set...\n");
+    assert(eb_set_layers_fork(TEST_ROOT, "trial", "nested") == EB_SUCCESS);
+    expect(SETS "/nested", "a.txt", HASH_C);
+    expect(SETS "/nested", "b.txt", NULL);
+    expect(SETS "/nested", "bulk-10.txt", HASH_A);
+    assert(log_lines(SETS "/nested", "a.txt") == 2);
+
+    eb_set_layers_t layers;
+    assert(eb_set_layers_load(SETS "/nested", &layers) == EB_SUCCESS);
+    assert(layers.count == 2 && strcmp(layers.items[1].set, "trial") == 0);
+    eb_set_layers_free(&layers);
+    printf("✓ Set based on a layered set passed\n");
+}
+
+static void test_flatten(void) {
+    printf("Testing flatten...\n");
+    int lines = log_lines(TRIAL_DIR, NULL);
+    assert(eb_set_layers_flatten(TEST_ROOT, TRIAL_DIR) == EB_SUCCESS);
+
+    struct stat st;
+    assert(stat(TRIAL_DIR "/" EB_SET_LAYERS_DIR, &st) != 0);
+    expect(TRIAL_DIR, "a.txt", HASH_C);
+    expect(TRIAL_DIR, "b.txt", NULL);
+    expect(TRIAL_DIR, "bulk-10.txt", HASH_A);
+    assert(log_lines(TRIAL_DIR, NULL) == lines);
+    assert(log_lines(TRIAL_DIR, "a.txt") == 2);
+
+    /* Nothing left to do the second time */
+    assert(eb_set_layers_flatten(TEST_ROOT, TRIAL_DIR) == EB_SUCCESS);
+    expect(TRIAL_DIR, "a.txt", HASH_C);
+
+    /* The set built on it still reads its own links */
+    expect(SETS "/nested", "a.txt", HASH_C);
+    assert(eb_set_layers_remove(SETS "/nested") == EB_SUCCESS);
+    assert(stat(SETS "/nested/" EB_SET_LAYERS_DIR, &st) != 0);
+    printf("✓ Flatten passed\n");
+}
+
+int main(void) {
+    printf("Running set layer tests...\n");
+    test_fork_isolation();
+    test_compaction_keeps_removals();
+    test_nested_fork();
+    test_flatten();
+    fixture_cleanup();
+    printf("All set layer tests passed!\n");
+    return 0;
+}
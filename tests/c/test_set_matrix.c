@@ -0,0 +1,214 @@
+/*
+ * EmbeddingBridge - Mappable Set Matrix Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "set_matrix.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS 8
+#define COUNT 2500
+#define CHANGED 7
+
+/* Minimal .npy file around the values */
+static void write_npy(const char* path, const float* values, size_t count) {
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu,), }", count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    uint16_t header_size = (uint16_t)length;
+    assert(fwrite("\x93NUMPY\x01\x00", 1, 8, f) == 8);
+    assert(fwrite(&header_size, sizeof(header_size), 1, f) == 1);
+    assert(fwrite(header, 1, (size_t)length, f) == (size_t)length);
+    assert(fwrite(values, sizeof(float), count, f) == count);
+    fclose(f);
+}
+
+static float value(int i, int d, int version) {
+    return sinf((float)(i * DIMS + d) * 0.37f) + (float)version;
+}
+
+/* Store vector i of a version for doc<i>.txt */
+static void store_vectors(int first, int step, int version, const char* model, size_t dims) {
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    for (int i = first; i < COUNT; i += step) {
+        float values[2 * DIMS];
+        for (size_t d = 0; d < dims; d++)
+            values[d] = value(i, (int)d, version);
+        char path[64], source[64], hash[65];
+        snprintf(path, sizeof(path), "v%d.npy", i);
+        snprintf(source, sizeof(source), "doc%04d.txt", i);
+        write_npy(path, values, dims);
+        assert(eb_store_batch_add(batch, path, source, model, hash) == EB_SUCCESS);
+    }
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static void setup_repo(void) {
+    fixture_repo(NULL);
+    store_vectors(0, 1, 0, "m1", DIMS);
+}
+
+static void check_matrix(const eb_set_matrix_t* m, int changed_version) {
+    assert(m->rows == COUNT && m->dims == DIMS);
+    assert(((uintptr_t)m->values % EB_SET_MATRIX_ALIGN) == 0);
+    for (size_t r = 0; r < m->rows; r++) {
+        char source[64];
+        snprintf(source, sizeof(source), "doc%04zu.txt", r);
+        assert(strcmp(eb_set_matrix_source(m, r), source) == 0);
+        assert(strcmp(eb_set_matrix_model(m, r), "m1") == 0);
+        int version = r % (COUNT / CHANGED) == 0 ? changed_version : 0;
+        const float* row = eb_set_matrix_values(m, r);
+        for (int d = 0; d < DIMS; d++)
+            assert(row[d] == value((int)r, d, version));
+    }
+}
+
+static void test_export(void) {
+    printf("Testing matrix export...\n");
+    eb_set_matrix_options_t options = { .model = NULL, .threads = 4 };
+    eb_set_matrix_stats_t stats;
+    assert(eb_set_matrix_export(".", "main", "main.matrix", &options, &stats) == EB_SUCCESS);
+    assert(stats.rows == COUNT && stats.reused == 0 && stats.skipped == 0);
+
+    eb_set_matrix_t m;
+    assert(eb_set_matrix_open("main.matrix", &m) == EB_SUCCESS);
+    check_matrix(&m, 0);
+    assert(eb_set_matrix_find(&m, "doc1234.txt", "m1") == 1234);
+    assert(eb_set_matrix_find(&m, "doc1234.txt", NULL) == 1234);
+    assert(eb_set_matrix_find(&m, "doc1234.txt", "m2") == SIZE_MAX);
+    assert(eb_set_matrix_find(&m, "none.txt", NULL) == SIZE_MAX);
+    eb_set_matrix_close(&m);
+    printf("✓ Matrix export passed\n");
+}
+
+static void test_incremental(void) {
+    printf("Testing incremental matrix export...\n");
+    eb_set_matrix_t before;
+    assert(eb_set_matrix_open("main.matrix", &before) == EB_SUCCESS);
+
+    store_vectors(0, COUNT / CHANGED, 1, "m1", DIMS);
+    eb_set_matrix_stats_t stats;
+    assert(eb_set_matrix_export(".", "main", "main.matrix", NULL, &stats) == EB_SUCCESS);
+    size_t changed = (COUNT + COUNT / CHANGED - 1) / (COUNT / CHANGED);
+    assert(stats.rows == COUNT && stats.reused == COUNT - changed);
+
+    /* The earlier mapping is untouched; the new file has the changes */
+    check_matrix(&before, 0);
+    eb_set_matrix_close(&before);
+    eb_set_matrix_t m;
+    assert(eb_set_matrix_open("main.matrix", &m) == EB_SUCCESS);
+    check_matrix(&m, 1);
+    eb_set_matrix_close(&m);
+    assert(access("main.matrix.tmp", F_OK) != 0);
+    printf("✓ Incremental matrix export passed\n");
+}
+
+static void test_codes(void) {
+    printf("Testing matrix codes...\n");
+    eb_set_matrix_options_t options = { .model = NULL, .threads = 2, .codes = true };
+    eb_set_matrix_stats_t stats;
+    assert(eb_set_matrix_export(".", "main", "codes.matrix", &options, &stats) == EB_SUCCESS);
+    assert(stats.rows == COUNT);
+
+    eb_set_matrix_t m;
+    assert(eb_set_matrix_open("codes.matrix", &m) == EB_SUCCESS);
+    assert(m.terms && m.codes && m.signs);
+    assert((uintptr_t)m.codes % EB_SET_MATRIX_CODE_ALIGN == 0);
+    size_t stride = eb_set_matrix_code_stride(DIMS), words = eb_set_matrix_sign_words(DIMS);
+    assert(stride == 64 && words == 1);
+    for (size_t r = 0; r < m.rows; r += 97) {
+        const float* row = eb_set_matrix_values(&m, r);
+        const int8_t* codes = m.codes + r * stride;
+        float max_abs = 0.0f, norm = 0.0f;
+        for (int d = 0; d < DIMS; d++) {
+            max_abs = fmaxf(max_abs, fabsf(row[d]));
+            norm += row[d] * row[d];
+        }
+        assert(m.terms[r].scale == max_abs / 127.0f);
+        assert(fabsf(m.terms[r].norm - sqrtf(norm)) < 1e-4f);
+        for (int d = 0; d < DIMS; d++) {
+            assert(fabsf(codes[d] * m.terms[r].scale - row[d]) <= m.terms[r].scale / 2 + 1e-6f);
+            assert(((m.signs[r * words] >> d) & 1) == (row[d] > 0.0f));
+        }
+    }
+    eb_set_matrix_close(&m);
+
+    /* Plain exports have none; codes cut short are rejected */
+    assert(eb_set_matrix_open("main.matrix", &m) == EB_SUCCESS && m.terms == NULL);
+    eb_set_matrix_close(&m);
+    struct stat st;
+    assert(stat("codes.matrix", &st) == 0 && truncate("codes.matrix", st.st_size - 8) == 0);
+    assert(eb_set_matrix_open("codes.matrix", &m) == EB_ERROR_INVALID_FORMAT);
+    printf("✓ Matrix codes passed\n");
+}
+
+static void test_models_and_errors(void) {
+    printf("Testing matrix models and errors...\n");
+
+    /* A second model of other dimensions: skipped unless chosen */
+    store_vectors(0, 10, 0, "m2", 2 * DIMS);
+    eb_set_matrix_stats_t stats;
+    assert(eb_set_matrix_export(".", "main", "all.matrix", NULL, &stats) == EB_SUCCESS);
+    assert(stats.rows == COUNT && stats.skipped == COUNT / 10);
+    eb_set_matrix_options_t m2 = { .model = "m2", .threads = 2 };
+    assert(eb_set_matrix_export(".", "main", "m2.matrix", &m2, &stats) == EB_SUCCESS);
+    assert(stats.rows == COUNT / 10 && stats.skipped == 0);
+
+    eb_set_matrix_t m;
+    assert(eb_set_matrix_open("m2.matrix", &m) == EB_SUCCESS);
+    assert(m.dims == 2 * DIMS && eb_set_matrix_find(&m, "doc0010.txt", NULL) == 1);
+    eb_set_matrix_close(&m);
+
+    /* An empty export still maps */
+    eb_set_matrix_options_t none = { .model = "m3", .threads = 1 };
+    assert(eb_set_matrix_export(".", "main", "none.matrix", &none, &stats) == EB_SUCCESS);
+    assert(eb_set_matrix_open("none.matrix", &m) == EB_SUCCESS);
+    assert(m.rows == 0);
+    eb_set_matrix_close(&m);
+
+    /* A truncated file is rejected, and replaced by the next export */
+    assert(truncate("all.matrix", EB_SET_MATRIX_ALIGN + 16) == 0);
+    assert(eb_set_matrix_open("all.matrix", &m) == EB_ERROR_INVALID_FORMAT);
+    assert(eb_set_matrix_export(".", "main", "all.matrix", NULL, &stats) == EB_SUCCESS);
+    assert(stats.reused == 0);
+    assert(eb_set_matrix_open("missing.matrix", &m) == EB_ERROR_NOT_FOUND);
+
+    assert(eb_set_matrix_export(".", "missing", "x.matrix", NULL, NULL) == EB_ERROR_NOT_FOUND);
+    assert(eb_set_matrix_export(".", "../main", "x.matrix", NULL, NULL) == EB_ERROR_INVALID_PARAMETER);
+    printf("✓ Matrix models and errors passed\n");
+}
+
+int main(void) {
+    printf("Running set matrix tests...\n");
+
+    setup_repo();
+    test_export();
+    test_incremental();
+    test_codes();
+    test_models_and_errors();
+    fixture_cleanup();
+
+    printf("All set matrix tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * EmbeddingBridge - Set Merge Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "set_merge.h"
+#include "set_index.h"
+#include "log_index.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define SETS TEST_ROOT "/.embr/sets"
+
+static const char* HASH_A = "aa00000000000000000000000000000000000000000000000000000000000001";
+static const char* HASH_B = "bb00000000000000000000000000000000000000000000000000000000000002";
+static const char* HASH_C = "cc00000000000000000000000000000000000000000000000000000000000003";
+
+static void setup_repo(void) {
+    fixture_dir();
+    system("mkdir -p " TEST_ROOT "/.embr/objects " SETS "/main " SETS "/feature");
+}
+
+static void add(const char* set, const char* source, const char* model, const char* hash) {
+    char path[256];
+    eb_set_index_change_t change = { source, model, hash };
+    snprintf(path, sizeof(path), SETS "/%s/index", set);
+    assert(eb_set_index_apply(TEST_ROOT, path, &change, 1) == EB_SUCCESS);
+}
+
+static void expect(const char* set, const char* source, const char* model, const char* hash) {
+    char path[256], found[65];
+    eb_set_index_t* index;
+    snprintf(path, sizeof(path), SETS "/%s/index", set);
+    assert(eb_set_index_open(TEST_ROOT, path, &index) == EB_SUCCESS);
+    eb_status_t status = eb_set_index_lookup(index, source, model, found);
+    if (hash) {
+        assert(status == EB_SUCCESS);
+        assert(strcmp(found, hash) == 0);
+    } else {
+        assert(status == EB_ERROR_NOT_FOUND);
+    }
+    eb_set_index_close(index);
+}
+
+typedef struct {
+    int visited;
+    int conflicts;
+} visit_ctx_t;
+
+static int visit(const eb_set_merge_entry_t* entry, void* ctx) {
+    visit_ctx_t* v = ctx;
+    v->visited++;
+    if (entry->state == EB_SET_MERGE_CONFLICT) {
+        assert(entry->target_hash && strcmp(entry->target_hash, entry->hash) != 0);
+        v->conflicts++;
+    }
+    return 0;
+}
+
+static int count_entry(const eb_log_entry_t* entry, void* ctx) {
+    (void)entry;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static void test_classify_and_union(void) {
+    printf("Testing merge classification...\n");
+    setup_repo();
+    add("main", "a.txt", "m", HASH_A);
+    add("main", "b.txt", "m", HASH_B);
+    add("feature", "a.txt", "m", HASH_A);      /* Same */
+    add("feature", "b.txt", "m", HASH_C);      /* Conflict */
+    add("feature", "b.txt", "other", HASH_C);  /* New: different model */
+    add("feature", "c.txt", "m", HASH_C);      /* New */
+
+    eb_set_merge_options_t options = { .dry_run = true, .threads = 4 };
+    eb_set_merge_summary_t summary;
+    visit_ctx_t v = { 0 };
+    assert(eb_set_merge(TEST_ROOT, "feature", "main", &options, visit, &v, &summary) == EB_SUCCESS);
+    assert(summary.entries == 4 && summary.added == 2 && summary.same == 1);
+    assert(summary.conflicts == 1 && summary.replaced == 0);
+    assert(v.visited == 4 && v.conflicts == 1);
+    expect("main", "c.txt", "m", NULL);
+
+    /* Union keeps the target's version */
+    assert(eb_set_merge(TEST_ROOT, "feature", "main", NULL, NULL, NULL, &summary) == EB_SUCCESS);
+    expect("main", "a.txt", "m", HASH_A);
+    expect("main", "b.txt", "m", HASH_B);
+    expect("main", "b.txt", "other", HASH_C);
+    expect("main", "c.txt", "m", HASH_C);
+
+    int lines = 0;
+    assert(eb_log_foreach(SETS "/main/log", count_entry, &lines) == EB_SUCCESS);
+    assert(lines == 2);
+
+    FILE* f = fopen(SETS "/main/refs/models/other", "r");
+    assert(f != NULL);
+    char line[256];
+    assert(fgets(line, sizeof(line), f) && strstr(line, "b.txt") && strstr(line, HASH_C));
+    fclose(f);
+
+    /* Nothing new the second time */
+    assert(eb_set_merge(TEST_ROOT, "feature", "main", NULL, NULL, NULL, &summary) == EB_SUCCESS);
+    assert(summary.added == 0 && summary.same == 3 && summary.conflicts == 1);
+    printf("✓ Merge classification passed\n");
+}
+
+static void test_theirs(void) {
+    printf("Testing merge taking the source version...\n");
+    eb_set_merge_options_t options = { .theirs = true };
+    eb_set_merge_summary_t summary;
+    assert(eb_set_merge(TEST_ROOT, "feature", "main", &options, NULL, NULL, &summary) == EB_SUCCESS);
+    assert(summary.conflicts == 1 && summary.replaced == 1);
+    expect("main", "b.txt", "m", HASH_C);
+    printf("✓ Merge taking the source version passed\n");
+}
+
+static void test_large_merge(void) {
+    printf("Testing a large merge...\n");
+    setup_repo();
+    enum { COUNT = 20000 };
+    eb_set_index_change_t* changes = malloc(COUNT * sizeof(*changes));
+    char (*names)[32] = malloc(COUNT * sizeof(*names));
+    assert(changes && names);
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(names[i], sizeof(names[i]), "doc-%05d.txt", i);
+        changes[i] = (eb_set_index_change_t){ names[i], "m", i % 2 ? HASH_A : HASH_B };
+    }
+    /* main holds the even documents, feature every document */
+    for (int i = 0; i < COUNT; i += 2)
+        changes[i / 2] = changes[i];
+    assert(eb_set_index_apply(TEST_ROOT, SETS "/main/index", changes, COUNT / 2) == EB_SUCCESS);
+    for (int i = 0; i < COUNT; i++)
+        changes[i] = (eb_set_index_change_t){ names[i], "m", i % 4 == 0 ? HASH_C : i % 2 ? HASH_A : HASH_B };
+    assert(eb_set_index_apply(TEST_ROOT, SETS "/feature/index", changes, COUNT) == EB_SUCCESS);
+
+    eb_set_merge_summary_t summary;
+    assert(eb_set_merge(TEST_ROOT, "feature", "main", NULL, NULL, NULL, &summary) == EB_SUCCESS);
+    assert(summary.entries == COUNT);
+    assert(summary.added == COUNT / 2);
+    assert(summary.conflicts == COUNT / 4 && summary.same == COUNT / 4);
+    expect("main", "doc-00001.txt", "m", HASH_A);
+    expect("main", "doc-00004.txt", "m", HASH_B);
+    free(changes);
+    free(names);
+
+    assert(eb_set_merge(TEST_ROOT, "feature", "feature", NULL, NULL, NULL, NULL) == EB_ERROR_INVALID_INPUT);
+    assert(eb_set_merge(TEST_ROOT, "missing", "main", NULL, NULL, NULL, NULL) == EB_ERROR_NOT_FOUND);
+    printf("✓ Large merge passed\n");
+}
+
+int main(void) {
+    printf("Running set merge tests...\n");
+    test_classify_and_union();
+    test_theirs();
+    test_large_merge();
+    fixture_cleanup();
+    printf("All set merge tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * EmbeddingBridge - Two-Stage Set Scan Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include "set_scan.h"
+#include "distance.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define COUNT 3000
+#define DIMS 96
+#define K 10
+
+static float vectors[COUNT * DIMS];
+
+/* Store count vectors of a model for doc<first>.. on; sources sort as rows do */
+static void store_vectors(int first, int count, const char* model, unsigned seed) {
+    const char** sources = malloc((size_t)count * sizeof(*sources));
+    char (*names)[32] = malloc((size_t)count * sizeof(*names));
+    char (*hashes)[65] = malloc((size_t)count * sizeof(*hashes));
+    assert(sources && names && hashes);
+    for (int n = 0; n < count; n++) {
+        float* v = &vectors[(first + n) * DIMS];
+        for (int i = 0; i < DIMS; i++)
+            v[i] = (float)rand_r(&seed) / (float)RAND_MAX * 2.0f - 1.0f;
+        snprintf(names[n], sizeof(names[n]), "doc%05d.txt", first + n);
+        sources[n] = names[n];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, &vectors[first * DIMS], (size_t)count, DIMS, sources,
+                                     model, hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+    free(sources);
+    free(names);
+    free(hashes);
+}
+
+static float exact_distance(const float* a, const float* b) {
+    eb_cosine_terms_t terms = eb_cosine_terms(a, b, DIMS);
+    return 1.0f - terms.dot / sqrtf(terms.norm_a * terms.norm_b);
+}
+
+/* The k closest rows by brute force over the floats */
+static void brute_force(const eb_set_matrix_t* m, const float* query, eb_scan_match_t* out) {
+    size_t count = 0;
+    for (size_t r = 0; r < m->rows; r++) {
+        eb_scan_match_t match = { r, exact_distance(query, eb_set_matrix_values(m, r)) };
+        size_t at = count < K ? count++ : K;
+        while (at > 0 && (out[at - 1].distance > match.distance)) {
+            if (at < K)
+                out[at] = out[at - 1];
+            at--;
+        }
+        if (at < K)
+            out[at] = match;
+    }
+}
+
+static size_t recall(const eb_scan_match_t* found, size_t count, const eb_scan_match_t* truth) {
+    size_t hits = 0;
+    for (size_t i = 0; i < count; i++)
+        for (size_t j = 0; j < K; j++)
+            hits += found[i].row == truth[j].row;
+    return hits;
+}
+
+static void test_scan(void) {
+    printf("Testing two-stage scans...\n");
+    fixture_repo(NULL);
+    store_vectors(0, COUNT, "m", 1);
+
+    eb_set_matrix_t m;
+    bool exported = false;
+    assert(eb_set_scan_open(".", "main", "m", 4, &m, &exported) == EB_SUCCESS && exported);
+    assert(m.rows == COUNT && m.dims == DIMS && m.terms != NULL);
+
+    eb_scan_match_t matches[K], truth[K];
+    size_t count = 0;
+    for (int q = 0; q < 20; q++) {
+        // A stored vector, and one between two of them
+        float query[DIMS];
+        for (int i = 0; i < DIMS; i++)
+            query[i] = q % 2 ? vectors[q * 7 * DIMS + i]
+                             : vectors[q * 7 * DIMS + i] + vectors[(q * 7 + 1) * DIMS + i];
+        brute_force(&m, query, truth);
+
+        assert(eb_set_scan(&m, query, DIMS, K, NULL, matches, &count) == EB_SUCCESS);
+        assert(count == K && recall(matches, count, truth) == K);
+        for (size_t i = 0; i < count; i++) {
+            float expected = exact_distance(query, eb_set_matrix_values(&m, matches[i].row));
+            assert(fabsf(matches[i].distance - expected) < 1e-5f);
+            assert(i == 0 || matches[i - 1].distance <= matches[i].distance);
+        }
+        if (q % 2)
+            assert(matches[0].row == (size_t)q * 7 && matches[0].distance < 1e-5f);
+
+        eb_scan_options_t binary = { EB_SCAN_BINARY, 0, NULL, 3 };
+        assert(eb_set_scan(&m, query, DIMS, K, &binary, matches, &count) == EB_SUCCESS);
+        assert(count == K && recall(matches, count, truth) >= K - 3);
+
+        // Re-ranking only k candidates still returns exact distances
+        eb_scan_options_t narrow = { EB_SCAN_INT8, K, NULL, 1 };
+        assert(eb_set_scan(&m, query, DIMS, K, &narrow, matches, &count) == EB_SUCCESS);
+        assert(count == K && recall(matches, count, truth) >= K / 2);
+    }
+
+    float query[DIMS] = { 0 };
+    assert(eb_set_scan(&m, query, DIMS - 1, K, NULL, matches, &count) == EB_ERROR_DIMENSION_MISMATCH);
+    assert(eb_set_scan(&m, query, DIMS, 0, NULL, matches, &count) == EB_ERROR_INVALID_PARAMETER);
+    assert(eb_set_scan(&m, query, DIMS, K, NULL, matches, &count) == EB_SUCCESS && count == K);
+    assert(matches[0].distance == 1.0f);
+    eb_set_matrix_close(&m);
+
+    fixture_cleanup();
+    printf("✓ Two-stage scans passed\n");
+}
+
+static void test_refresh(void) {
+    printf("Testing scan matrix refreshes...\n");
+    fixture_repo(NULL);
+    store_vectors(0, 100, "m", 2);
+
+    eb_set_matrix_t m;
+    bool exported = false;
+    assert(eb_set_scan_open(".", "main", "m", 2, &m, &exported) == EB_SUCCESS && exported);
+    eb_set_matrix_close(&m);
+    assert(eb_set_scan_open(".", "main", "m", 2, &m, &exported) == EB_SUCCESS && !exported);
+    assert(m.rows == 100);
+    eb_set_matrix_close(&m);
+
+    // Stores change the index, so the next open exports again
+    store_vectors(100, 20, "m", 3);
+    store_vectors(120, 30, "other model", 4);
+    assert(eb_set_scan_open(".", "main", "m", 2, &m, &exported) == EB_SUCCESS && exported);
+    assert(m.rows == 120);
+    eb_set_matrix_close(&m);
+    assert(eb_set_scan_open(".", "main", "other model", 2, &m, &exported) == EB_SUCCESS);
+    assert(m.rows == 30 && access(".embr/sets/main/scan/other%20model.matrix", F_OK) == 0);
+    eb_set_matrix_close(&m);
+
+    // A matrix of every model, scanned for one
+    eb_set_matrix_options_t options = { .model = NULL, .threads = 2, .codes = true };
+    assert(eb_set_matrix_export(".", "main", "all.matrix", &options, NULL) == EB_SUCCESS);
+    assert(eb_set_matrix_open("all.matrix", &m) == EB_SUCCESS && m.rows == 150);
+    eb_scan_match_t matches[K];
+    size_t count = 0;
+    eb_scan_options_t other = { EB_SCAN_INT8, 0, "other model", 0 };
+    assert(eb_set_scan(&m, &vectors[125 * DIMS], DIMS, K, &other, matches, &count) == EB_SUCCESS);
+    assert(count == K && strcmp(eb_set_matrix_source(&m, matches[0].row), "doc00125.txt") == 0);
+    for (size_t i = 0; i < count; i++)
+        assert(strcmp(eb_set_matrix_model(&m, matches[i].row), "other model") == 0);
+    eb_set_matrix_close(&m);
+
+    // Plain exports cannot be scanned; empty ones find nothing
+    options.codes = false;
+    assert(eb_set_matrix_export(".", "main", "plain.matrix", &options, NULL) == EB_SUCCESS);
+    assert(eb_set_matrix_open("plain.matrix", &m) == EB_SUCCESS);
+    assert(eb_set_scan(&m, vectors, DIMS, K, NULL, matches, &count) == EB_ERROR_UNSUPPORTED);
+    eb_set_matrix_close(&m);
+    assert(eb_set_scan_open(".", "main", "none", 0, &m, NULL) == EB_SUCCESS && m.rows == 0);
+    assert(eb_set_scan(&m, vectors, DIMS, K, NULL, matches, &count) == EB_SUCCESS && count == 0);
+    eb_set_matrix_close(&m);
+
+    assert(eb_set_scan_open(".", "missing", "m", 0, &m, NULL) == EB_ERROR_NOT_FOUND);
+    assert(eb_set_scan_open(".", "..", "m", 0, &m, NULL) == EB_ERROR_INVALID_PARAMETER);
+    fixture_cleanup();
+    printf("✓ Scan matrix refreshes passed\n");
+}
+
+int main(void) {
+    printf("Running set scan tests...\n");
+    test_scan();
+    test_refresh();
+    printf("All set scan tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * EmbeddingBridge - Per-Set Vector Sketch Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <unistd.h>
+#include "set_sketch.h"
+#include "set_index.h"
+#include "set_layers.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS 16
+#define INDEX_PATH ".embr/sets/main/index"
+#define SKETCH_PATH ".embr/sets/main/" EB_SET_SKETCH_FILE
+
+static void make_vector(unsigned n, float* values) {
+    for (int i = 0; i < DIMS; i++)
+        values[i] = sinf((float)(n * DIMS + i)) + (float)n * 0.01f;
+}
+
+/* Mean and total variance of vectors [first, end) computed directly */
+static void direct_stats(unsigned first, unsigned end, double* mean, double* variance) {
+    float v[DIMS];
+    memset(mean, 0, DIMS * sizeof(double));
+    for (unsigned n = first; n < end; n++) {
+        make_vector(n, v);
+        for (int i = 0; i < DIMS; i++)
+            mean[i] += v[i] / (double)(end - first);
+    }
+    *variance = 0.0;
+    for (unsigned n = first; n < end; n++) {
+        make_vector(n, v);
+        for (int i = 0; i < DIMS; i++)
+            *variance += (v[i] - mean[i]) * (v[i] - mean[i]) / (double)(end - first);
+    }
+}
+
+static void assert_matches(const eb_sketch_t* sketch, unsigned first, unsigned end) {
+    double mean[DIMS], variance;
+    direct_stats(first, end, mean, &variance);
+    assert(sketch->count == end - first);
+    for (int i = 0; i < DIMS; i++)
+        assert(fabs(sketch->mean[i] - mean[i]) < 1e-9);
+    eb_sketch_stats_t stats;
+    eb_sketch_stats(sketch, &stats);
+    assert(fabs(stats.variance - variance) < 1e-9);
+}
+
+static void test_sketch(void) {
+    printf("Testing sketch updates...\n");
+
+    eb_set_sketch_t set = {0};
+    eb_sketch_t* all = eb_set_sketch_group(&set, "m", DIMS, true);
+    assert(all != NULL && eb_set_sketch_group(&set, "m", DIMS, false) == all);
+    float v[DIMS];
+    for (unsigned n = 0; n < 100; n++) {
+        make_vector(n, v);
+        assert(eb_sketch_add(all, v, 1) == EB_SUCCESS);
+    }
+    assert_matches(all, 0, 100);
+
+    // Removing is exact
+    for (unsigned n = 0; n < 40; n++) {
+        make_vector(n, v);
+        assert(eb_sketch_add(all, v, -1) == EB_SUCCESS);
+    }
+    assert_matches(all, 40, 100);
+
+    // Two halves merge into the whole
+    // Creating a group moves the others
+    assert(eb_set_sketch_group(&set, "low", DIMS, true) && eb_set_sketch_group(&set, "high", DIMS, true));
+    eb_sketch_t* low = eb_set_sketch_group(&set, "low", DIMS, false);
+    eb_sketch_t* high = eb_set_sketch_group(&set, "high", DIMS, false);
+    for (unsigned n = 40; n < 100; n++) {
+        make_vector(n, v);
+        assert(eb_sketch_add(n < 70 ? low : high, v, 1) == EB_SUCCESS);
+    }
+    assert(eb_sketch_merge(low, high) == EB_SUCCESS);
+    all = eb_set_sketch_group(&set, "m", DIMS, false);
+    assert_matches(low, 40, 100);
+
+    // Identical sketches show no drift, shifted ones do
+    eb_sketch_drift_t drift;
+    assert(eb_sketch_compare(all, low, &drift) == EB_SUCCESS);
+    assert(drift.centroid_l2 < 1e-9 && drift.covariance_shift < 1e-6 && drift.norm_distance < 1e-9);
+    assert(fabs(drift.variance_ratio - 1.0) < 1e-9);
+    for (unsigned n = 0; n < 60; n++) {
+        make_vector(n, v);
+        assert(eb_sketch_add(high, v, 1) == EB_SUCCESS);
+    }
+    assert(eb_sketch_compare(all, high, &drift) == EB_SUCCESS && drift.centroid_l2 > 0.1);
+
+    // Saved and loaded, models stay sorted and group sizes unchanged
+    set.index_seq = 42;
+    assert(eb_set_sketch_save(&set, "sketch.test") == EB_SUCCESS);
+    eb_set_sketch_t loaded;
+    assert(eb_set_sketch_load("sketch.test", &loaded) == EB_SUCCESS);
+    assert(loaded.index_seq == 42 && loaded.count == 3);
+    assert(strcmp(loaded.items[0].model, "high") == 0 && strcmp(loaded.items[2].model, "m") == 0);
+    assert_matches(&loaded.items[2], 40, 100);
+    assert(memcmp(loaded.items[2].proj_outer, all->proj_outer, sizeof(all->proj_outer)) == 0);
+    eb_set_sketch_free(&loaded);
+    unlink("sketch.test");
+
+    // Nothing to take out of an empty sketch
+    eb_sketch_t* empty = eb_set_sketch_group(&set, "empty", DIMS, true);
+    assert(eb_sketch_add(empty, v, -1) == EB_ERROR_INVALID_INPUT);
+    eb_set_sketch_free(&set);
+    printf("✓ Sketch updates passed\n");
+}
+
+static void store_vectors(unsigned first, unsigned end) {
+    float values[64 * DIMS];
+    const char* sources[64];
+    char names[64][32];
+    char hashes[64][65];
+    assert(end - first <= 64);
+    for (unsigned n = first; n < end; n++) {
+        make_vector(n, values + (n - first) * DIMS);
+        snprintf(names[n - first], sizeof(names[0]), "doc%u.txt", n % 10);
+        sources[n - first] = names[n - first];
+    }
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, end - first, DIMS, sources, "m", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+static const eb_sketch_t* load_group(eb_set_sketch_t* set) {
+    assert(eb_set_sketch_load(SKETCH_PATH, set) == EB_SUCCESS);
+    return eb_set_sketch_group(set, "m", DIMS, false);
+}
+
+static void test_set(void) {
+    printf("Testing sketches kept by a set...\n");
+    fixture_repo(NULL);
+
+    // A new set gets a sketch on its first store; later stores replace vectors
+    store_vectors(0, 10);
+    eb_set_sketch_t set;
+    assert_matches(load_group(&set), 0, 10);
+    eb_set_sketch_free(&set);
+    store_vectors(10, 15);
+    assert_matches(load_group(&set), 5, 15);
+    eb_set_sketch_free(&set);
+
+    // Removals take vectors out, for one model or all of them
+    eb_set_index_change_t changes[] = {
+        { "doc0.txt", "m", NULL }, { "doc1.txt", NULL, NULL }, { "doc2.txt", "other", NULL }
+    };
+    assert(eb_set_index_append(".", INDEX_PATH, changes, 3) == EB_SUCCESS);
+    const eb_sketch_t* sketch = load_group(&set);
+    assert(sketch->count == 8);
+    eb_sketch_stats_t after;
+    eb_sketch_stats(sketch, &after);
+    eb_set_sketch_free(&set);
+
+    // A rebuilt sketch agrees with the one kept up to date
+    assert(unlink(SKETCH_PATH) == 0);
+    assert(eb_set_sketch_open(".", "main", 2, &set) == EB_SUCCESS);
+    sketch = eb_set_sketch_group(&set, "m", DIMS, false);
+    eb_sketch_stats_t rebuilt;
+    eb_sketch_stats(sketch, &rebuilt);
+    assert(sketch->count == 8 && fabs(rebuilt.variance - after.variance) < 1e-9);
+    eb_set_sketch_free(&set);
+
+    // Without a sketch, a set that holds vectors waits to be asked for one
+    assert(unlink(SKETCH_PATH) == 0);
+    store_vectors(20, 22);
+    assert(access(SKETCH_PATH, F_OK) != 0);
+    assert(eb_set_sketch_open(".", "main", 0, &set) == EB_SUCCESS);
+    eb_set_sketch_free(&set);
+
+    // A sketch that fell behind its index is dropped by the next update
+    eb_set_index_t* index = NULL;
+    assert(eb_set_index_open(".", INDEX_PATH, &index) == EB_SUCCESS);
+    assert(eb_set_sketch_load(SKETCH_PATH, &set) == EB_SUCCESS);
+    assert(set.index_seq == eb_set_index_next_seq(index));
+    set.index_seq--;
+    assert(eb_set_sketch_save(&set, SKETCH_PATH) == EB_SUCCESS);
+    eb_set_sketch_free(&set);
+    eb_set_index_close(index);
+    store_vectors(30, 31);
+    assert(access(SKETCH_PATH, F_OK) != 0);
+
+    // A set created from another starts from its sketch
+    assert(eb_set_sketch_open(".", "main", 0, &set) == EB_SUCCESS);
+    eb_set_sketch_free(&set);
+    assert(eb_set_layers_fork(".", "main", "trial") == EB_SUCCESS);
+    assert(access(".embr/sets/trial/" EB_SET_SKETCH_FILE, F_OK) == 0);
+    eb_set_sketch_t fork;
+    assert(eb_set_sketch_open(".", "trial", 0, &fork) == EB_SUCCESS);
+    assert(eb_set_sketch_open(".", "main", 0, &set) == EB_SUCCESS);
+    eb_sketch_drift_t drift;
+    assert(eb_sketch_compare(eb_set_sketch_group(&set, "m", DIMS, false),
+                             eb_set_sketch_group(&fork, "m", DIMS, false), &drift) == EB_SUCCESS);
+    assert(drift.centroid_l2 == 0.0);
+    eb_set_sketch_free(&fork);
+    eb_set_sketch_free(&set);
+    assert(eb_set_sketch_open(".", "missing", 0, &set) == EB_ERROR_NOT_FOUND);
+
+    fixture_cleanup();
+    printf("✓ Set sketches passed\n");
+}
+
+int main(void) {
+    printf("Running set sketch tests...\n");
+    test_sketch();
+    test_set();
+    printf("All set sketch tests passed!\n");
+    return 0;
+}
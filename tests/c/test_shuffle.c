@@ -0,0 +1,134 @@
+/*
+ * EmbeddingBridge - Float Byte Shuffle Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include "shuffle.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define VALUE_COUNT 1536
+
+static void test_roundtrip(void) {
+    printf("Testing shuffle round trips...\n");
+
+    /* Sizes around the 16-value vector step, with partial trailing values */
+    const size_t sizes[] = {0, 1, 3, 4, 63, 64, 65, 67, 128, 1000, 6144, 6147};
+    for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+        size_t size = sizes[n];
+        uint8_t* src = malloc(size + 1);
+        uint8_t* shuffled = malloc(size + 1);
+        uint8_t* restored = malloc(size + 1);
+        assert(src && shuffled && restored);
+        for (size_t i = 0; i < size; i++)
+            src[i] = (uint8_t)(i * 31 + 7);
+
+        eb_shuffle4(src, shuffled, size);
+        size_t count = size / 4;
+        for (size_t i = 0; i < count; i++) {
+            for (size_t b = 0; b < 4; b++)
+                assert(shuffled[b * count + i] == src[4 * i + b]);
+        }
+        assert(memcmp(shuffled + 4 * count, src + 4 * count, size - 4 * count) == 0);
+
+        eb_unshuffle4(shuffled, restored, size);
+        assert(memcmp(restored, src, size) == 0);
+
+        free(src);
+        free(shuffled);
+        free(restored);
+    }
+
+    printf("Shuffle round trip tests passed!\n");
+}
+
+static void setup_repo(const char* filter) {
+    char config[256];
+    snprintf(config, sizeof(config), "[storage]\n\tcompression = true\n\tfilter = %s\n", filter);
+    fixture_repo(config);
+}
+
+/* Embedding-like values: small magnitudes, signs and exponents vary little */
+static void make_values(float* values) {
+    for (int i = 0; i < VALUE_COUNT; i++)
+        values[i] = 0.05f * sinf((float)i * 0.37f) + 0.01f * cosf((float)i * 1.91f);
+}
+
+/* Store one vector and return the size of its object file */
+static long store_and_check(const float* values, uint32_t* flags) {
+    FILE* f = fopen("input.bin", "wb");
+    assert(f != NULL);
+    assert(fwrite(values, sizeof(float), VALUE_COUNT, f) == VALUE_COUNT);
+    fclose(f);
+
+    char hash[65];
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "input.bin", "a.txt", "openai", hash) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    eb_store_t* store = NULL;
+    eb_store_config_t config = { .root_path = "." };
+    assert(eb_store_init(&config, &store) == EB_SUCCESS);
+    eb_object_view_t view;
+    assert(eb_object_map(store, hash, 0, &view) == EB_SUCCESS);
+    assert(view.size == VALUE_COUNT * sizeof(float));
+    assert(memcmp(view.data, values, view.size) == 0);
+    *flags = view.header.flags;
+    long size = (long)view.record_size;
+    eb_object_unmap(&view);
+
+    /* read_object returns the same unshuffled values */
+    void* data = NULL;
+    size_t data_size = 0;
+    eb_object_header_t header;
+    assert(read_object(store, hash, &data, &data_size, &header) == EB_SUCCESS);
+    assert(data_size == VALUE_COUNT * sizeof(float) && memcmp(data, values, data_size) == 0);
+    free(data);
+    eb_store_destroy(store);
+    return size;
+}
+
+static void test_store_filter(void) {
+    printf("Testing shuffled object storage...\n");
+
+    float values[VALUE_COUNT];
+    make_values(values);
+    uint32_t flags = 0;
+
+    setup_repo("none");
+    long plain = store_and_check(values, &flags);
+    assert((flags & EB_FLAG_COMPRESSED) && !(flags & EB_FLAG_SHUFFLED));
+    fixture_cleanup();
+
+    setup_repo("shuffle");
+    long shuffled = store_and_check(values, &flags);
+    assert((flags & EB_FLAG_COMPRESSED) && (flags & EB_FLAG_SHUFFLED));
+    fixture_cleanup();
+
+    printf("Object sizes: plain %ld, shuffled %ld bytes\n", plain, shuffled);
+    assert(shuffled < plain);
+    printf("Shuffled object storage tests passed!\n");
+}
+
+int main(void) {
+    printf("Running shuffle tests...\n");
+
+    test_roundtrip();
+    test_store_filter();
+
+    printf("All shuffle tests passed!\n");
+    return 0;
+}
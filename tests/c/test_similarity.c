@@ -0,0 +1,282 @@
+/*
+ * EmbeddingBridge - Many-to-Many Similarity Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "similarity.h"
+
+#define DIMS 37
+#define A_COUNT 150
+#define B_COUNT 700
+
+static float a_values[A_COUNT * DIMS];
+static float b_values[B_COUNT * DIMS];
+
+static void fill(float* values, size_t count, float seed) {
+    for (size_t i = 0; i < count * DIMS; i++)
+        values[i] = sinf((float)i * seed + 0.3f);
+}
+
+static double naive(const float* x, const float* y, eb_sim_metric_t metric) {
+    double dot = 0, nx = 0, ny = 0;
+    for (int d = 0; d < DIMS; d++) {
+        dot += (double)x[d] * y[d];
+        nx += (double)x[d] * x[d];
+        ny += (double)y[d] * y[d];
+    }
+    if (metric == EB_SIM_DOT)
+        return dot;
+    return nx > 0 && ny > 0 ? dot / sqrt(nx * ny) : 0.0;
+}
+
+static void test_full_matrix(void) {
+    printf("Testing full similarity matrix...\n");
+
+    eb_matrix_t a = { a_values, DIMS };
+    eb_matrix_t b = { b_values, DIMS };
+    float* out = malloc(A_COUNT * B_COUNT * sizeof(float));
+    assert(out != NULL);
+
+    for (int metric = EB_SIM_COSINE; metric <= EB_SIM_DOT; metric++) {
+        eb_sim_options_t options = { (eb_sim_metric_t)metric, 0, false, 3, 0, 0 };
+        assert(eb_similarity_matrix(&a, A_COUNT, &b, B_COUNT, &options, out) == EB_SUCCESS);
+        for (size_t i = 0; i < A_COUNT; i++) {
+            for (size_t j = 0; j < B_COUNT; j++) {
+                double expected = naive(&a_values[i * DIMS], &b_values[j * DIMS], (eb_sim_metric_t)metric);
+                assert(fabs(out[i * B_COUNT + j] - expected) < 1e-4 * (1 + fabs(expected)));
+            }
+        }
+    }
+
+    /* Zero rows have cosine similarity 0 with everything */
+    float zero[DIMS] = { 0 };
+    eb_matrix_t z = { zero, DIMS };
+    eb_sim_options_t options = { EB_SIM_COSINE, 0, false, 1, 0, 0 };
+    assert(eb_similarity_matrix(&z, 1, &b, B_COUNT, &options, out) == EB_SUCCESS);
+    for (size_t j = 0; j < B_COUNT; j++)
+        assert(out[j] == 0.0f);
+
+    free(out);
+    printf("Full similarity matrix tests passed!\n");
+}
+
+typedef struct {
+    size_t next;
+    float* out;
+} band_ctx_t;
+
+static int check_band(size_t first, size_t rows, const float* values, void* ctx) {
+    band_ctx_t* band = ctx;
+    assert(first == band->next && rows > 0);
+    memcpy(band->out + first * B_COUNT, values, rows * B_COUNT * sizeof(float));
+    band->next += rows;
+    return 0;
+}
+
+static int stop_band(size_t first, size_t rows, const float* values, void* ctx) {
+    (void)first;
+    (void)rows;
+    (void)values;
+    (*(int*)ctx)++;
+    return 1;
+}
+
+static void test_bands(void) {
+    printf("Testing similarity bands...\n");
+
+    eb_matrix_t a = { a_values, DIMS };
+    eb_matrix_t b = { b_values, DIMS };
+    float* full = malloc(A_COUNT * B_COUNT * sizeof(float));
+    float* banded = malloc(A_COUNT * B_COUNT * sizeof(float));
+    assert(full && banded);
+
+    /* Bands arrive in order and the thread count does not change a value */
+    eb_sim_options_t options = { EB_SIM_COSINE, 0, false, 1, 0, 0 };
+    assert(eb_similarity_matrix(&a, A_COUNT, &b, B_COUNT, &options, full) == EB_SUCCESS);
+    band_ctx_t band = { 0, banded };
+    options.threads = 0;
+    assert(eb_similarity_rows(&a, A_COUNT, &b, B_COUNT, &options, check_band, &band) == EB_SUCCESS);
+    assert(band.next == A_COUNT);
+    assert(memcmp(full, banded, A_COUNT * B_COUNT * sizeof(float)) == 0);
+
+    int calls = 0;
+    assert(eb_similarity_rows(&a, A_COUNT, &b, B_COUNT, &options, stop_band, &calls) == EB_SUCCESS);
+    assert(calls == 1);
+
+    free(full);
+    free(banded);
+    printf("Similarity band tests passed!\n");
+}
+
+static void test_top_k(void) {
+    printf("Testing top-k similarity...\n");
+
+    enum { K = 7 };
+    eb_matrix_t a = { a_values, DIMS };
+    eb_matrix_t b = { b_values, DIMS };
+    size_t* indices = malloc(A_COUNT * K * sizeof(size_t));
+    float* scores = malloc(A_COUNT * K * sizeof(float));
+    float* full = malloc(A_COUNT * B_COUNT * sizeof(float));
+    assert(indices && scores && full);
+
+    eb_sim_options_t options = { EB_SIM_COSINE, K, false, 4, 0, 0 };
+    assert(eb_similarity_top_k(&a, A_COUNT, &b, B_COUNT, &options, indices, scores) == EB_SUCCESS);
+    assert(eb_similarity_matrix(&a, A_COUNT, &b, B_COUNT, &options, full) == EB_SUCCESS);
+    for (size_t i = 0; i < A_COUNT; i++) {
+        const float* row = &full[i * B_COUNT];
+        for (size_t r = 0; r < K; r++) {
+            size_t j = indices[i * K + r];
+            assert(j < B_COUNT && scores[i * K + r] == row[j]);
+            assert(r == 0 || scores[i * K + r - 1] >= scores[i * K + r]);
+        }
+        /* Nothing left out scores better than the last match */
+        size_t better = 0;
+        for (size_t j = 0; j < B_COUNT; j++)
+            better += row[j] > scores[i * K + K - 1];
+        assert(better < K);
+    }
+
+    /* A set against itself: every row is its own best match unless excluded */
+    eb_sim_options_t self = { EB_SIM_COSINE, 1, false, 2, 0, 0 };
+    assert(eb_similarity_top_k(&b, B_COUNT, &b, B_COUNT, &self, indices, scores) == EB_SUCCESS);
+    for (size_t i = 0; i < A_COUNT; i++)
+        assert(indices[i] == i && fabsf(scores[i] - 1.0f) < 1e-5f);
+    self.exclude_self = true;
+    assert(eb_similarity_top_k(&b, A_COUNT, &b, B_COUNT, &self, indices, scores) == EB_SUCCESS);
+    for (size_t i = 0; i < A_COUNT; i++)
+        assert(indices[i] != i);
+
+    /* Equal scores are ordered by index */
+    float ties[4 * 2] = { 1, 0, 2, 0, 0, 1, 3, 0 };
+    eb_matrix_t t = { ties, 2 };
+    eb_sim_options_t tie_options = { EB_SIM_COSINE, 3, false, 1, 0, 0 };
+    assert(eb_similarity_top_k(&t, 1, &t, 4, &tie_options, indices, scores) == EB_SUCCESS);
+    assert(indices[0] == 0 && indices[1] == 1 && indices[2] == 3);
+    assert(scores[2] == scores[0]);
+
+    free(indices);
+    free(scores);
+    free(full);
+    printf("Top-k similarity tests passed!\n");
+}
+
+static void test_prefix_screening(void) {
+    printf("Testing prefix screening...\n");
+
+    enum { K = 5, PREFIX = 12 };
+    eb_matrix_t a = { a_values, DIMS };
+    eb_matrix_t b = { b_values, DIMS };
+    float* out = malloc(A_COUNT * B_COUNT * sizeof(float));
+    size_t* indices = malloc(A_COUNT * K * sizeof(size_t));
+    float* scores = malloc(A_COUNT * K * sizeof(float));
+    size_t* exact_indices = malloc(A_COUNT * K * sizeof(size_t));
+    float* exact_scores = malloc(A_COUNT * K * sizeof(float));
+    assert(out && indices && scores && exact_indices && exact_scores);
+
+    /* The matrix compares the prefixes alone */
+    float pa[PREFIX], pb[DIMS] = { 0 };
+    eb_sim_options_t options = { EB_SIM_COSINE, 0, false, 2, PREFIX, 0 };
+    assert(eb_similarity_matrix(&a, A_COUNT, &b, B_COUNT, &options, out) == EB_SUCCESS);
+    for (size_t i = 0; i < A_COUNT; i += 7) {
+        for (size_t j = 0; j < B_COUNT; j += 3) {
+            float x[DIMS] = { 0 };
+            memcpy(x, &a_values[i * DIMS], sizeof(pa));
+            memcpy(pb, &b_values[j * DIMS], sizeof(pa));
+            double expected = naive(x, pb, EB_SIM_COSINE);
+            assert(fabs(out[i * B_COUNT + j] - expected) < 1e-4);
+        }
+    }
+
+    /* Refined matches carry full-dimension scores */
+    options.k = K;
+    assert(eb_similarity_top_k(&a, A_COUNT, &b, B_COUNT, &options, indices, scores) == EB_SUCCESS);
+    for (size_t i = 0; i < A_COUNT; i++) {
+        for (size_t r = 0; r < K; r++) {
+            size_t j = indices[i * K + r];
+            double expected = naive(&a_values[i * DIMS], &b_values[j * DIMS], EB_SIM_COSINE);
+            assert(fabs(scores[i * K + r] - expected) < 1e-5);
+            assert(r == 0 || scores[i * K + r - 1] >= scores[i * K + r]);
+        }
+    }
+
+    /* Screening every candidate finds the exact matches, up to rounding among near ties */
+    options.refine = B_COUNT;
+    assert(eb_similarity_top_k(&a, A_COUNT, &b, B_COUNT, &options, indices, scores) == EB_SUCCESS);
+    eb_sim_options_t exact = { EB_SIM_COSINE, K, false, 2, 0, 0 };
+    assert(eb_similarity_top_k(&a, A_COUNT, &b, B_COUNT, &exact, exact_indices, exact_scores) == EB_SUCCESS);
+    for (size_t i = 0; i < A_COUNT * K; i++)
+        assert(fabsf(scores[i] - exact_scores[i]) < 1e-5f);
+
+    /* A prefix covering every dimension is no prefix */
+    options.prefix_dims = DIMS;
+    options.refine = 0;
+    assert(eb_similarity_top_k(&a, A_COUNT, &b, B_COUNT, &options, indices, scores) == EB_SUCCESS);
+    assert(memcmp(indices, exact_indices, A_COUNT * K * sizeof(size_t)) == 0);
+
+    /* Excluding self still holds through the screen */
+    eb_sim_options_t self = { EB_SIM_DOT, 3, true, 1, PREFIX, 0 };
+    assert(eb_similarity_top_k(&b, A_COUNT, &b, B_COUNT, &self, indices, scores) == EB_SUCCESS);
+    for (size_t i = 0; i < A_COUNT; i++)
+        for (size_t r = 0; r < 3; r++)
+            assert(indices[i * 3 + r] != i);
+
+    free(out);
+    free(indices);
+    free(scores);
+    free(exact_indices);
+    free(exact_scores);
+    printf("Prefix screening tests passed!\n");
+}
+
+static void test_invalid(void) {
+    printf("Testing invalid similarity input...\n");
+
+    eb_matrix_t a = { a_values, DIMS };
+    eb_matrix_t b = { b_values, DIMS };
+    eb_matrix_t narrow = { b_values, DIMS - 1 };
+    size_t indices[4];
+    float scores[4];
+    float out[4];
+
+    eb_sim_options_t options = { EB_SIM_COSINE, 4, false, 1, 0, 0 };
+    assert(eb_similarity_top_k(&a, 1, &b, 3, &options, indices, scores) == EB_ERROR_INVALID_INPUT);
+    options.k = 3;
+    options.exclude_self = true;
+    assert(eb_similarity_top_k(&a, 1, &b, 3, &options, indices, scores) == EB_ERROR_INVALID_INPUT);
+    options.exclude_self = false;
+    assert(eb_similarity_top_k(&a, 1, &narrow, 3, &options, indices, scores) == EB_ERROR_INVALID_INPUT);
+    assert(eb_similarity_matrix(&a, 0, &b, 3, &options, out) == EB_ERROR_INVALID_INPUT);
+    assert(eb_similarity_matrix(&a, 1, &b, 3, NULL, out) == EB_ERROR_INVALID_INPUT);
+    assert(eb_similarity_rows(&a, 1, &b, 3, &options, NULL, NULL) == EB_ERROR_INVALID_INPUT);
+    options.metric = (eb_sim_metric_t)7;
+    assert(eb_similarity_matrix(&a, 1, &b, 3, &options, out) == EB_ERROR_INVALID_INPUT);
+
+    assert(eb_similarity_backend()[0] != '\0');
+    printf("Invalid similarity input tests passed!\n");
+}
+
+int main(void) {
+    printf("Running similarity tests...\n");
+
+    fill(a_values, A_COUNT, 0.37f);
+    fill(b_values, B_COUNT, 0.53f);
+
+    test_full_matrix();
+    test_bands();
+    test_top_k();
+    test_prefix_screening();
+    test_invalid();
+
+    printf("All similarity tests passed!\n");
+    return 0;
+}
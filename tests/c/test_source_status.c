@@ -0,0 +1,198 @@
+/*
+ * EmbeddingBridge - Whole-Set Source Status Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <utime.h>
+#include "source_status.h"
+#include "object_path.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define DIMS 8
+#define COUNT 200
+
+static char hashes[COUNT][65];
+
+/* Minimal .npy file around the values */
+static void write_npy(const char* path, const float* values, size_t count) {
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%zu,), }", count);
+    while ((10 + length + 1) % 64 != 0)
+        header[length++] = ' ';
+    header[length++] = '\n';
+
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    uint16_t header_size = (uint16_t)length;
+    assert(fwrite("\x93NUMPY\x01\x00", 1, 8, f) == 8);
+    assert(fwrite(&header_size, sizeof(header_size), 1, f) == 1);
+    assert(fwrite(header, 1, (size_t)length, f) == (size_t)length);
+    assert(fwrite(values, sizeof(float), count, f) == count);
+    fclose(f);
+}
+
+static void write_text(const char* path, const char* text) {
+    FILE* f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(text, f);
+    fclose(f);
+}
+
+static void source_name(int i, char* out, size_t size) {
+    snprintf(out, size, "doc%03d.txt", i);
+}
+
+/* Store an embedding for every source, and doc000.txt a second time */
+static void setup_repo(void) {
+    fixture_repo(NULL);
+
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    for (int i = 0; i < COUNT; i++) {
+        char source[32], text[64];
+        float values[DIMS];
+        source_name(i, source, sizeof(source));
+        snprintf(text, sizeof(text), "document %d\n", i);
+        write_text(source, text);
+        for (int d = 0; d < DIMS; d++)
+            values[d] = sinf((float)(i * DIMS + d) * 0.37f);
+        write_npy("v.npy", values, DIMS);
+        assert(eb_store_batch_add(batch, "v.npy", source, "m1", hashes[i]) == EB_SUCCESS);
+    }
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    float again[DIMS] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    write_npy("v.npy", again, DIMS);
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "v.npy", "doc000.txt", "m1", hashes[0]) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+}
+
+/* Drop source_hash from a .meta, as written before source hashes were recorded */
+static void strip_source_hash(const char* hash) {
+    char path[PATH_MAX], kept[4096] = "", line[1024];
+    assert(eb_object_path(".", hash, "meta", path, sizeof(path)) == 0);
+    FILE* f = fopen(path, "r");
+    assert(f != NULL);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "source_hash=", 12) != 0)
+            strncat(kept, line, sizeof(kept) - strlen(kept) - 1);
+    }
+    fclose(f);
+    write_text(path, kept);
+}
+
+typedef struct {
+    char sources[COUNT][32];
+    eb_source_state_t states[COUNT];
+    bool hashed[COUNT];
+    size_t versions[COUNT];
+    size_t count;
+    size_t stop_after;
+} recorder_t;
+
+static int record_source(const eb_source_status_t* status, void* ctx) {
+    recorder_t* r = ctx;
+    assert(r->count < COUNT);
+    snprintf(r->sources[r->count], sizeof(r->sources[0]), "%s", status->source);
+    r->states[r->count] = status->state;
+    r->hashed[r->count] = status->hashed;
+    r->versions[r->count] = status->versions;
+    r->count++;
+    return r->stop_after && r->count == r->stop_after;
+}
+
+static void test_status_all(void) {
+    printf("Testing whole-set source status...\n");
+
+    /* Every fifth source edited, every seventh deleted */
+    for (int i = 1; i < COUNT; i++) {
+        char source[32];
+        source_name(i, source, sizeof(source));
+        if (i % 7 == 0)
+            assert(unlink(source) == 0);
+        else if (i % 5 == 0)
+            write_text(source, "edited\n");
+    }
+
+    static recorder_t r;
+    eb_source_status_options_t options = { .model = NULL, .threads = 4 };
+    eb_source_summary_t summary;
+    assert(eb_source_status(".", &options, record_source, &r, &summary) == EB_SUCCESS);
+
+    size_t modified = 0, missing = 0;
+    for (int i = 1; i < COUNT; i++) {
+        if (i % 7 == 0)
+            missing++;
+        else if (i % 5 == 0)
+            modified++;
+    }
+    assert(summary.sources == COUNT && r.count == COUNT);
+    assert(summary.missing == missing);
+    assert(summary.modified == modified);
+    assert(summary.unchanged == COUNT - missing - modified);
+
+    for (int i = 0; i < COUNT; i++) {
+        char source[32];
+        source_name(i, source, sizeof(source));
+        assert(strcmp(r.sources[i], source) == 0);  /* Reported in source order */
+        assert(r.versions[i] == (i == 0 ? 2u : 1u));
+        if (i % 7 == 0 && i > 0) {
+            assert(r.states[i] == EB_SOURCE_MISSING);
+        } else {
+            assert(r.hashed[i]);
+            assert(r.states[i] == (i % 5 == 0 && i > 0 ? EB_SOURCE_MODIFIED : EB_SOURCE_UNCHANGED));
+        }
+    }
+    printf("✓ Whole-set source status passed\n");
+}
+
+static void test_status_by_mtime(void) {
+    printf("Testing source status without recorded source hashes...\n");
+
+    /* doc001.txt is untouched, doc002.txt was modified after it was embedded */
+    strip_source_hash(hashes[1]);
+    strip_source_hash(hashes[2]);
+    struct utimbuf later = { time(NULL) + 3600, time(NULL) + 3600 };
+    assert(utime("doc002.txt", &later) == 0);
+
+    static recorder_t r;
+    r.stop_after = 3;
+    eb_source_summary_t summary;
+    assert(eb_source_status(".", NULL, record_source, &r, &summary) == EB_SUCCESS);
+    assert(r.count == 3 && summary.sources == 3);
+    assert(!r.hashed[1] && r.states[1] == EB_SOURCE_UNCHANGED);
+    assert(!r.hashed[2] && r.states[2] == EB_SOURCE_MODIFIED);
+
+    /* Another model has nothing tracked */
+    eb_source_status_options_t options = { .model = "m2", .threads = 0 };
+    assert(eb_source_status(".", &options, NULL, NULL, &summary) == EB_SUCCESS);
+    assert(summary.sources == 0);
+    printf("✓ Source status by mtime passed\n");
+}
+
+int main(void) {
+    printf("Running source status tests...\n");
+    setup_repo();
+    test_status_all();
+    test_status_by_mtime();
+    fixture_cleanup();
+    printf("All source status tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * EmbeddingBridge - Source File Stat Cache Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <utime.h>
+#include "stat_cache.h"
+#include "store.h"
+#include "repo_fixture.h"
+
+#define TEST_ROOT "."
+#define CACHE_PATH TEST_ROOT "/stat-cache"
+#define SOURCE_PATH TEST_ROOT "/doc.txt"
+
+static void write_text(const char* path, const char* text) {
+    FILE* f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(text, f);
+    fclose(f);
+}
+
+/* Move the mtime well clear of the racy window */
+static void age_file(const char* path) {
+    struct utimbuf past = { time(NULL) - 60, time(NULL) - 60 };
+    assert(utime(path, &past) == 0);
+}
+
+static void test_hit_and_miss(void) {
+    printf("Testing stat cache hits and misses...\n");
+    write_text(SOURCE_PATH, "first version\n");
+    age_file(SOURCE_PATH);
+
+    char expected[65], hash[65];
+    bool cached = true;
+    assert(eb_source_file_hash(SOURCE_PATH, expected, sizeof(expected)) == EB_SUCCESS);
+
+    eb_stat_cache_t* cache = NULL;
+    assert(eb_stat_cache_open(CACHE_PATH, &cache) == EB_SUCCESS);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_SUCCESS);
+    assert(!cached && strcmp(hash, expected) == 0);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_SUCCESS);
+    assert(cached && strcmp(hash, expected) == 0);
+
+    /* Same size and the old mtime, but the ctime moves */
+    write_text(SOURCE_PATH, "other version\n");
+    age_file(SOURCE_PATH);
+    assert(eb_source_file_hash(SOURCE_PATH, expected, sizeof(expected)) == EB_SUCCESS);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_SUCCESS);
+    assert(!cached && strcmp(hash, expected) == 0);
+
+    assert(unlink(SOURCE_PATH) == 0);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_ERROR_NOT_FOUND);
+    eb_stat_cache_close(cache);
+    printf("✓ Stat cache hits and misses passed\n");
+}
+
+static void test_racy_entry(void) {
+    printf("Testing racily clean entries...\n");
+    write_text(SOURCE_PATH, "just written\n");
+
+    char hash[65];
+    bool cached = true;
+    eb_stat_cache_t* cache = NULL;
+    assert(eb_stat_cache_open(CACHE_PATH, &cache) == EB_SUCCESS);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_SUCCESS);
+    assert(!cached);
+
+    /* Modified too close to the hash to trust the stat data */
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_SUCCESS);
+    assert(!cached);
+    eb_stat_cache_close(cache);
+    printf("✓ Racily clean entries passed\n");
+}
+
+static void test_persistence(void) {
+    printf("Testing stat cache persistence...\n");
+    write_text(SOURCE_PATH, "saved version\n");
+    age_file(SOURCE_PATH);
+
+    char first[65], hash[65];
+    bool cached = true;
+    eb_stat_cache_t* cache = NULL;
+    assert(eb_stat_cache_open(CACHE_PATH, &cache) == EB_SUCCESS);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, first, &cached) == EB_SUCCESS);
+    assert(eb_stat_cache_save(cache) == EB_SUCCESS);
+    eb_stat_cache_close(cache);
+
+    assert(eb_stat_cache_open(CACHE_PATH, &cache) == EB_SUCCESS);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_SUCCESS);
+    assert(cached && strcmp(hash, first) == 0);
+    eb_stat_cache_close(cache);
+
+    /* A damaged cache opens empty */
+    write_text(CACHE_PATH, "garbage");
+    assert(eb_stat_cache_open(CACHE_PATH, &cache) == EB_SUCCESS);
+    assert(eb_stat_cache_hash(cache, "doc.txt", SOURCE_PATH, hash, &cached) == EB_SUCCESS);
+    assert(!cached && strcmp(hash, first) == 0);
+    eb_stat_cache_close(cache);
+    printf("✓ Stat cache persistence passed\n");
+}
+
+int main(void) {
+    printf("Running stat cache tests...\n");
+    fixture_dir();
+    test_hit_and_miss();
+    test_racy_entry();
+    test_persistence();
+    fixture_cleanup();
+    printf("All stat cache tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * EmbeddingBridge - Batch Store Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include "store.h"
+#include "set_index.h"
+#include "embedding_file.h"
+#include "object_path.h"
+#include "repo_fixture.h"
+
+static void write_vector(const char* path, float seed) {
+    float values[8];
+    for (int i = 0; i < 8; i++)
+        values[i] = seed + (float)i;
+
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    assert(fwrite(values, sizeof(float), 8, f) == 8);
+    fclose(f);
+}
+
+static int count_lines(const char* path, const char* needle) {
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return 0;
+    char line[1024];
+    int count = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (!needle || strstr(line, needle))
+            count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static bool has_line(const char* path, const char* hash, const char* source) {
+    char expected[256];
+    snprintf(expected, sizeof(expected), "%s %s\n", hash, source);
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[1024];
+    bool found = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (strcmp(line, expected) == 0)
+            found = true;
+    }
+    fclose(f);
+    return found;
+}
+
+static int count_entry(const char* source, const char* model, const char* hash, void* ctx) {
+    (void)source;
+    (void)model;
+    (void)hash;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static void test_batch_merges_index(void) {
+    printf("Testing batch index merge...\n");
+
+    fixture_repo(NULL);
+    write_vector("a1.bin", 1.0f);
+    write_vector("a2.bin", 2.0f);
+    write_vector("a3.bin", 3.0f);
+    write_vector("b1.bin", 4.0f);
+    write_vector("c1.bin", 5.0f);
+
+    /* Existing entries from a single store */
+    char old_a[65], other_model[65];
+    assert(store_embedding_file("a1.bin", "a.txt", ".", "openai", EB_FLOAT32) == EB_SUCCESS);
+    assert(get_current_hash_with_model(".", "a.txt", "openai", old_a, sizeof(old_a)) == EB_SUCCESS);
+
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "b1.bin", "a.txt", "voyage", other_model) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    /* Same source and model is replaced, also within the batch */
+    char hash2[65], hash3[65], hash_b[65];
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "a2.bin", "a.txt", "openai", hash2) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "c1.bin", "b.txt", "openai", hash_b) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "a3.bin", "a.txt", "openai", hash3) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    eb_set_index_t* index = NULL;
+    int entries = 0;
+    assert(eb_set_index_open_current(".", &index) == EB_SUCCESS);
+    assert(eb_set_index_foreach(index, NULL, count_entry, &entries) == EB_SUCCESS);
+    eb_set_index_close(index);
+    assert(entries == 3);
+
+    char current[65];
+    assert(get_current_hash_with_model(".", "a.txt", "openai", current, sizeof(current)) == EB_SUCCESS);
+    assert(strcmp(current, hash3) == 0);
+    assert(strcmp(current, old_a) != 0 && strcmp(current, hash2) != 0);
+    assert(get_current_hash_with_model(".", "a.txt", "voyage", current, sizeof(current)) == EB_SUCCESS);
+    assert(strcmp(current, other_model) == 0);
+    assert(get_current_hash_with_model(".", "b.txt", "openai", current, sizeof(current)) == EB_SUCCESS);
+    assert(strcmp(current, hash_b) == 0);
+
+    /* One model ref per source and model */
+    const char* refs = ".embr/sets/main/refs/models/openai";
+    assert(count_lines(refs, NULL) == 2);
+    assert(has_line(refs, hash3, "a.txt"));
+    assert(has_line(refs, hash_b, "b.txt"));
+    assert(has_line(".embr/sets/main/refs/models/voyage", other_model, "a.txt"));
+
+    /* Every store is logged */
+    assert(count_lines(".embr/sets/main/log", NULL) == 5);
+    assert(count_lines(".embr/sets/main/log", hash2) == 1);
+
+    fixture_cleanup();
+    printf("Batch index merge tests passed!\n");
+}
+
+static void test_batch_abort(void) {
+    printf("Testing batch abort...\n");
+
+    fixture_repo(NULL);
+    write_vector("a1.bin", 1.0f);
+
+    eb_store_batch_t* batch = NULL;
+    char hash[65];
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "a1.bin", "a.txt", "openai", hash) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "missing.bin", "b.txt", "openai", NULL) == EB_ERROR_FILE_IO);
+    eb_store_batch_abort(batch);
+
+    /* Nothing indexed, the object itself was written */
+    assert(access(".embr/sets/main/index", F_OK) != 0);
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), ".embr/objects/%s.raw", hash);
+    assert(access(path, F_OK) == 0);
+
+    /* Empty batches commit without touching the index */
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+    assert(access(".embr/sets/main/index", F_OK) != 0);
+
+    fixture_cleanup();
+    printf("Batch abort tests passed!\n");
+}
+
+/* Rows of a matrix are stored as the .npy vectors a single store would write */
+static void test_batch_matrix(void) {
+    printf("Testing matrix batch store...\n");
+
+    fixture_repo(NULL);
+    float matrix[3][8];
+    for (int r = 0; r < 3; r++)
+        for (int i = 0; i < 8; i++)
+            matrix[r][i] = (float)(r * 8 + i);
+    FILE* f = fopen("matrix.bin", "wb");
+    assert(f != NULL);
+    assert(fwrite(matrix, sizeof(float), 24, f) == 24);
+    fclose(f);
+
+    char header[EB_NPY_HEADER_MAX];
+    size_t dims = 8;
+    size_t header_size = eb_npy_header(EB_FLOAT32, &dims, 1, header);
+    assert(header_size > 0);
+    f = fopen("row1.npy", "wb");
+    assert(f != NULL);
+    assert(fwrite(header, 1, header_size, f) == header_size);
+    assert(fwrite(matrix[1], sizeof(float), 8, f) == 8);
+    fclose(f);
+
+    const char* sources[] = { "a.txt", "b.txt", "c.txt" };
+    char hashes[3][65], single[65];
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_rows(batch, "matrix.bin", 8, sources, 2, "openai", hashes) ==
+           EB_ERROR_DIMENSION_MISMATCH);
+    assert(eb_store_batch_add(batch, "matrix.bin", "a.txt", "openai", single) == EB_SUCCESS);
+    eb_store_batch_abort(batch);
+
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_rows(batch, "matrix.bin", 8, sources, 3, "openai", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_add(batch, "row1.npy", "d.txt", "openai", single) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+    assert(strcmp(hashes[1], single) == 0);
+    assert(strcmp(hashes[0], hashes[2]) != 0);
+
+    char current[65];
+    assert(get_current_hash_with_model(".", "c.txt", "openai", current, sizeof(current)) == EB_SUCCESS);
+    assert(strcmp(current, hashes[2]) == 0);
+
+    fixture_cleanup();
+    printf("Matrix batch store tests passed!\n");
+}
+
+/* Many rows, written across threads; repeated rows share one object */
+static void test_batch_matrix_parallel(void) {
+    printf("Testing parallel matrix batch store...\n");
+
+    fixture_repo(NULL);
+    enum { ROWS = 1000, DISTINCT = 250 };
+    static float values[ROWS * 8];
+    static char names[ROWS][32];
+    const char* sources[ROWS];
+    for (int r = 0; r < ROWS; r++) {
+        for (int i = 0; i < 8; i++)
+            values[r * 8 + i] = (float)((r % DISTINCT) * 8 + i);
+        snprintf(names[r], sizeof(names[r]), "doc%04d.txt", r);
+        sources[r] = names[r];
+    }
+
+    static char hashes[ROWS][65];
+    eb_store_batch_t* batch = NULL;
+    assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+    assert(eb_store_batch_add_matrix(batch, values, ROWS, 8, sources, "openai", hashes) == EB_SUCCESS);
+    assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+
+    for (int r = 0; r < ROWS; r++) {
+        if (r >= DISTINCT)
+            assert(strcmp(hashes[r], hashes[r % DISTINCT]) == 0);
+        else if (r > 0)
+            assert(strcmp(hashes[r], hashes[r - 1]) != 0);
+        char current[65];
+        assert(get_current_hash_with_model(".", sources[r], "openai", current, sizeof(current)) == EB_SUCCESS);
+        assert(strcmp(current, hashes[r]) == 0);
+    }
+
+    /* No temporary file is left behind */
+    assert(system("test -z \"$(ls .embr/objects/temp)\"") == 0);
+
+    fixture_cleanup();
+    printf("Parallel matrix batch store tests passed!\n");
+}
+
+/* Each durability mode stores and commits alike, only the flushing differs */
+static void test_batch_durability(void) {
+    printf("Testing batch durability modes...\n");
+
+    const char* modes[] = { NULL, "none", "group", "strict", "fsync" };
+    const eb_durability_t expected[] = {
+        EB_DURABILITY_GROUP, EB_DURABILITY_NONE, EB_DURABILITY_GROUP,
+        EB_DURABILITY_STRICT, EB_DURABILITY_GROUP
+    };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        fixture_repo(NULL);
+        if (modes[m]) {
+            FILE* f = fopen(".embr/config", "w");
+            assert(f != NULL);
+            fprintf(f, "[storage]\n\tdurability = %s\n", modes[m]);
+            fclose(f);
+        }
+        assert(eb_object_durability(".") == expected[m]);
+
+        write_vector("a1.bin", 1.0f);
+        write_vector("b1.bin", 2.0f);
+        char a[65], b[65], current[65];
+        eb_store_batch_t* batch = NULL;
+        assert(eb_store_batch_begin(".", &batch) == EB_SUCCESS);
+        assert(eb_store_batch_add(batch, "a1.bin", "a.txt", "openai", a) == EB_SUCCESS);
+        assert(eb_store_batch_add(batch, "b1.bin", "b.txt", "openai", b) == EB_SUCCESS);
+        assert(eb_store_batch_commit(batch) == EB_SUCCESS);
+        assert(get_current_hash_with_model(".", "b.txt", "openai", current, sizeof(current)) == EB_SUCCESS);
+        assert(strcmp(current, b) == 0);
+        fixture_cleanup();
+    }
+
+    printf("Batch durability tests passed!\n");
+}
+
+int main(void) {
+    printf("Running batch store tests...\n");
+
+    test_batch_merges_index();
+    test_batch_abort();
+    test_batch_matrix();
+    test_batch_matrix_parallel();
+    test_batch_durability();
+
+    printf("All batch store tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * EmbeddingBridge - Streaming Ingest Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "store.h"
+#include "store_stream.h"
+#include "repo_fixture.h"
+
+static bool is_stored(const char* source, const char* model) {
+    char hash[65];
+    return get_current_hash_with_model(".", source, model, hash, sizeof(hash)) == EB_SUCCESS;
+}
+
+static int open_input(const char* path, const void* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    assert(fwrite(data, 1, size, f) == size);
+    fclose(f);
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0);
+    return fd;
+}
+
+static size_t put_frame_n(unsigned char* out, const char* source, size_t source_len,
+                          const char* model, const float* values, uint32_t dims) {
+    size_t model_len = model ? strlen(model) : 0;
+    uint32_t length = (uint32_t)(2 + source_len + 2 + model_len + 4 + dims * sizeof(float));
+    size_t pos = 0;
+    memcpy(out + pos, &length, 4);
+    pos += 4;
+    out[pos++] = (unsigned char)source_len;
+    out[pos++] = 0;
+    memcpy(out + pos, source, source_len);
+    pos += source_len;
+    out[pos++] = (unsigned char)model_len;
+    out[pos++] = 0;
+    if (model_len)
+        memcpy(out + pos, model, model_len);
+    pos += model_len;
+    memcpy(out + pos, &dims, 4);
+    pos += 4;
+    memcpy(out + pos, values, dims * sizeof(float));
+    return pos + dims * sizeof(float);
+}
+
+static size_t put_frame(unsigned char* out, const char* source, const char* model,
+                        const float* values, uint32_t dims) {
+    return put_frame_n(out, source, strlen(source), model, values, dims);
+}
+
+static size_t commit_calls;
+
+static void count_commit(void* ctx, size_t records) {
+    (void)ctx;
+    assert(records > 0);
+    commit_calls++;
+}
+
+static void test_ndjson(void) {
+    printf("Testing NDJSON stream...\n");
+    fixture_repo(NULL);
+
+    const char* input =
+        "{\"source\":\"a.txt\",\"model\":\"openai\",\"values\":[0.5,1,2,3]}\n"
+        "\n"
+        "{\"id\":\"ignored\",\"source\":\"b.txt\",\"values\":[1,2,3,4]}\n"
+        "{\"source\":\"c.txt\",\"model\":\"voyage\",\"values\":[1,2]}\n"
+        "{\"source\":\"a.txt\",\"model\":\"openai\",\"values\":[9,8,7,6]}";
+    int fd = open_input("in.ndjson", input, strlen(input));
+
+    eb_stream_options_t options = { .format = EB_STREAM_NDJSON, .model = "openai",
+                                    .on_commit = count_commit };
+    eb_stream_stats_t stats;
+    commit_calls = 0;
+    assert(eb_store_stream(".", fd, &options, &stats) == EB_SUCCESS);
+    close(fd);
+    assert(stats.records == 4 && stats.commits == 1 && commit_calls == 1);
+    assert(is_stored("a.txt", "openai") && is_stored("b.txt", "openai"));
+    assert(is_stored("c.txt", "voyage") && !is_stored("b.txt", "voyage"));
+
+    /* The later record for a source and model wins */
+    char hash[65], again[65];
+    assert(get_current_hash_with_model(".", "a.txt", "openai", hash, sizeof(hash)) == EB_SUCCESS);
+    const char* same = "{\"source\":\"x.txt\",\"model\":\"openai\",\"values\":[9,8,7,6]}\n";
+    fd = open_input("in.ndjson", same, strlen(same));
+    assert(eb_store_stream(".", fd, &options, NULL) == EB_SUCCESS);
+    close(fd);
+    assert(get_current_hash_with_model(".", "x.txt", "openai", again, sizeof(again)) == EB_SUCCESS);
+    assert(strcmp(hash, again) == 0);
+
+    fixture_cleanup();
+    printf("✓ NDJSON stream passed\n");
+}
+
+static void test_frames(void) {
+    printf("Testing binary frame stream...\n");
+    fixture_repo(NULL);
+
+    static unsigned char input[4096];
+    size_t size = 0;
+    float values[8];
+    char source[32];
+    for (int r = 0; r < 5; r++) {
+        for (int i = 0; i < 8; i++)
+            values[i] = (float)(r * 8 + i);
+        snprintf(source, sizeof(source), "doc%d.txt", r);
+        size += put_frame(input + size, source, r == 4 ? "voyage" : NULL, values, 8);
+    }
+    int fd = open_input("in.bin", input, size);
+
+    /* Two records per commit, the last one on its own at the end */
+    eb_stream_options_t options = { .format = EB_STREAM_FRAMES, .model = "openai",
+                                    .commit_records = 2 };
+    eb_stream_stats_t stats;
+    assert(eb_store_stream(".", fd, &options, &stats) == EB_SUCCESS);
+    close(fd);
+    assert(stats.records == 5 && stats.commits == 3);
+    assert(is_stored("doc0.txt", "openai") && is_stored("doc3.txt", "openai"));
+    assert(is_stored("doc4.txt", "voyage"));
+
+    /* A truncated frame fails after the records before it are committed */
+    fixture_cleanup();
+    fixture_repo(NULL);
+    fd = open_input("in.bin", input, size - 3);
+    assert(eb_store_stream(".", fd, &options, &stats) == EB_ERROR_INVALID_FORMAT);
+    close(fd);
+    assert(stats.records == 4 && stats.line == 5);
+    assert(is_stored("doc3.txt", "openai") && !is_stored("doc4.txt", "voyage"));
+
+    /* A frame whose dims disagree with its length */
+    size = put_frame(input, "bad.txt", NULL, values, 8);
+    input[size - 8 * sizeof(float) - 4] = 9;
+    fd = open_input("in.bin", input, size);
+    assert(eb_store_stream(".", fd, &options, &stats) == EB_ERROR_INVALID_FORMAT);
+    close(fd);
+    assert(stats.records == 0 && stats.line == 1);
+
+    fixture_cleanup();
+    printf("✓ Binary frame stream passed\n");
+}
+
+static void test_malformed(void) {
+    printf("Testing malformed records...\n");
+    fixture_repo(NULL);
+
+    const char* input =
+        "{\"source\":\"a.txt\",\"values\":[1,2]}\n"
+        "{\"values\":[1,2]}\n"
+        "{\"source\":\"c.txt\",\"values\":[1,2]}\n";
+    int fd = open_input("in.ndjson", input, strlen(input));
+    eb_stream_options_t options = { .format = EB_STREAM_NDJSON, .model = "openai" };
+    eb_stream_stats_t stats;
+    assert(eb_store_stream(".", fd, &options, &stats) == EB_ERROR_INVALID_FORMAT);
+    close(fd);
+    assert(stats.records == 0 && stats.line == 2);
+    assert(!is_stored("a.txt", "openai"));
+
+    options.format = (eb_stream_format_t)7;
+    assert(eb_store_stream(".", 0, &options, NULL) == EB_ERROR_INVALID_INPUT);
+
+    fixture_cleanup();
+    printf("✓ Malformed records passed\n");
+}
+
+/* A stream of one NDJSON record for source fails on it */
+static void expect_rejected_json(const char* source) {
+    char input[256];
+    snprintf(input, sizeof(input), "{\"source\":\"%s\",\"values\":[1,2]}\n", source);
+    int fd = open_input("in.ndjson", input, strlen(input));
+    eb_stream_options_t options = { .format = EB_STREAM_NDJSON, .model = "openai" };
+    eb_stream_stats_t stats;
+    assert(eb_store_stream(".", fd, &options, &stats) == EB_ERROR_INVALID_FORMAT);
+    close(fd);
+    assert(stats.records == 0 && stats.line == 1);
+}
+
+static void expect_rejected_frame(const char* source, size_t source_len) {
+    unsigned char input[256];
+    float values[2] = { 1, 2 };
+    size_t size = put_frame_n(input, source, source_len, NULL, values, 2);
+    int fd = open_input("in.bin", input, size);
+    eb_stream_options_t options = { .format = EB_STREAM_FRAMES, .model = "openai" };
+    eb_stream_stats_t stats;
+    assert(eb_store_stream(".", fd, &options, &stats) == EB_ERROR_INVALID_FORMAT);
+    close(fd);
+    assert(stats.records == 0 && stats.line == 1);
+}
+
+/* Sources become fields of log lines and paths below the root */
+static void test_unsafe_sources(void) {
+    printf("Testing unsafe sources...\n");
+    fixture_repo(NULL);
+
+    /* A newline would start a log line of the record's choosing */
+    expect_rejected_json("a.txt openai\\n1 - b.txt");
+    expect_rejected_json("a.txt\\nb.txt");
+    expect_rejected_json("a\\tb.txt");
+    expect_rejected_json("a b.txt");
+    expect_rejected_json("/etc/passwd");
+    expect_rejected_json("../outside.txt");
+    expect_rejected_json("sub/../../outside.txt");
+    expect_rejected_frame("a.txt\n0 - b.txt", 15);
+    expect_rejected_frame("a\0b.txt", 7);
+    expect_rejected_frame("a\x7f.txt", 6);
+    expect_rejected_frame("/etc/passwd", 11);
+    expect_rejected_frame("..", 2);
+    assert(!is_stored("a.txt", "openai") && !is_stored("b.txt", "openai"));
+
+    /* A link out of the repository is outside it too */
+    assert(symlink("/", "out") == 0);
+    expect_rejected_json("out");
+    expect_rejected_frame("out", 3);
+
+    /* An existing file is recorded by its path from the root */
+    assert(mkdir("sub", 0755) == 0);
+    fclose(fopen("sub/a.txt", "w"));
+    const char* input = "{\"source\":\"./sub//a.txt\",\"values\":[1,2]}\n";
+    int fd = open_input("in.ndjson", input, strlen(input));
+    eb_stream_options_t options = { .format = EB_STREAM_NDJSON, .model = "openai" };
+    assert(eb_store_stream(".", fd, &options, NULL) == EB_SUCCESS);
+    close(fd);
+    assert(is_stored("sub/a.txt", "openai"));
+
+    fixture_cleanup();
+    printf("✓ Unsafe sources passed\n");
+}
+
+typedef struct {
+    int fd;
+    bool seen_early;    /* First record committed while the stream was open */
+} writer_t;
+
+static void* write_slowly(void* arg) {
+    writer_t* writer = arg;
+    const char* first = "{\"source\":\"a.txt\",\"values\":[1,2,3]}\n";
+    const char* second = "{\"source\":\"b.txt\",\"values\":[4,5,6]}\n";
+    assert(write(writer->fd, first, strlen(first)) == (ssize_t)strlen(first));
+    for (int i = 0; i < 200 && !writer->seen_early; i++) {
+        usleep(10000);
+        writer->seen_early = is_stored("a.txt", "openai");
+    }
+    assert(write(writer->fd, second, strlen(second)) == (ssize_t)strlen(second));
+    close(writer->fd);
+    return NULL;
+}
+
+/* An idle producer's records are committed after commit_ms, not at the end */
+static void test_commit_interval(void) {
+    printf("Testing commits on a pipe...\n");
+    fixture_repo(NULL);
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    writer_t writer = { fds[1], false };
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, write_slowly, &writer) == 0);
+
+    eb_stream_options_t options = { .format = EB_STREAM_NDJSON, .model = "openai",
+                                    .commit_ms = 20 };
+    eb_stream_stats_t stats;
+    assert(eb_store_stream(".", fds[0], &options, &stats) == EB_SUCCESS);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    assert(writer.seen_early);
+    assert(stats.records == 2 && stats.commits == 2);
+    assert(is_stored("b.txt", "openai"));
+
+    fixture_cleanup();
+    printf("✓ Commits on a pipe passed\n");
+}
+
+int main(void) {
+    printf("Running streaming ingest tests...\n");
+    test_ndjson();
+    test_frames();
+    test_malformed();
+    test_unsafe_sources();
+    test_commit_interval();
+    printf("All streaming ingest tests passed!\n");
+    return 0;
+}
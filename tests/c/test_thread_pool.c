@@ -0,0 +1,129 @@
+/*
+ * EmbeddingBridge - Shared Thread Pool Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "thread_pool.h"
+
+#define ITEMS 100000
+#define OUTER 16
+#define INNER 64
+
+static unsigned char seen[ITEMS];
+
+static void mark_range(void* ctx, size_t begin, size_t end) {
+    size_t* total = ctx;
+    for (size_t i = begin; i < end; i++) {
+        seen[i]++;
+        __atomic_add_fetch(total, i, __ATOMIC_RELAXED);
+    }
+}
+
+static void test_parallel_for(eb_pool_t* pool) {
+    size_t total = 0;
+    memset(seen, 0, sizeof(seen));
+    eb_parallel_for(pool, ITEMS, 97, 0, mark_range, &total);
+    assert(total == (size_t)ITEMS * (ITEMS - 1) / 2);
+    for (size_t i = 0; i < ITEMS; i++)
+        assert(seen[i] == 1);
+
+    /* One thread, and nothing to do */
+    total = 0;
+    eb_parallel_for(pool, 1000, 0, 1, mark_range, &total);
+    assert(total == 1000 * 999 / 2);
+    eb_parallel_for(pool, 0, 10, 0, mark_range, &total);
+}
+
+/* Outer tasks each spawn and wait for a group of their own */
+typedef struct {
+    eb_pool_t* pool;
+    size_t* counter;
+} nested_t;
+
+static void count_one(void* arg) {
+    __atomic_add_fetch((size_t*)arg, 1, __ATOMIC_RELAXED);
+}
+
+static void outer_task(void* arg) {
+    nested_t* n = arg;
+    eb_task_group_t group;
+    eb_task_group_init(&group, n->pool);
+    for (int i = 0; i < INNER; i++)
+        eb_task_group_spawn(&group, count_one, n->counter);
+    eb_task_group_wait(&group);
+}
+
+static void test_nested(eb_pool_t* pool) {
+    size_t counter = 0;
+    nested_t n = { pool, &counter };
+    eb_task_group_t group;
+    eb_task_group_init(&group, pool);
+    for (int i = 0; i < OUTER; i++)
+        eb_task_group_spawn(&group, outer_task, &n);
+    eb_task_group_wait(&group);
+    assert(counter == OUTER * INNER);
+}
+
+static void test_own_pools(void) {
+    printf("Testing task groups and parallel loops...\n");
+    unsigned sizes[] = { 0, 1, 3 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        eb_pool_t* pool = NULL;
+        assert(eb_pool_create(sizes[i], &pool) == EB_SUCCESS);
+        assert(eb_pool_workers(pool) == sizes[i]);
+        test_parallel_for(pool);
+        test_nested(pool);
+        eb_pool_destroy(pool);
+    }
+    assert(eb_pool_create(EB_POOL_MAX_WORKERS + 1, &(eb_pool_t*){ NULL }) == EB_ERROR_INVALID_PARAMETER);
+    printf("✓ Task groups and parallel loops passed\n");
+}
+
+static void test_shared_pool(void) {
+    printf("Testing the shared pool...\n");
+    setenv(EB_THREADS_ENV, "3", 1);
+    eb_pool_configure(8);
+    eb_pool_t* pool = eb_pool_shared();
+    assert(pool != NULL && eb_pool_shared() == pool);
+    assert(eb_pool_workers(pool) == 2);
+
+    /* Calls are capped at the budget and at their blocks */
+    assert(eb_pool_threads(0, 1000) == 3);
+    assert(eb_pool_threads(16, 1000) == 3);
+    assert(eb_pool_threads(2, 1000) == 2);
+    assert(eb_pool_threads(0, 1) == 1);
+    assert(eb_pool_threads(0, 0) == 1);
+    test_parallel_for(NULL);
+
+    /* A forked child starts a pool of its own */
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        eb_pool_t* child = eb_pool_shared();
+        size_t total = 0;
+        eb_parallel_for(NULL, ITEMS, 100, 0, mark_range, &total);
+        _exit(child && child != pool && total == (size_t)ITEMS * (ITEMS - 1) / 2 ? 0 : 1);
+    }
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    printf("✓ Shared pool passed\n");
+}
+
+int main(void) {
+    printf("Running thread pool tests...\n");
+    test_own_pools();
+    test_shared_pool();
+    printf("All thread pool tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * EmbeddingBridge - Phase Timing Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "timing.h"
+
+static char* report(void) {
+    static char buf[4096];
+    FILE* f = tmpfile();
+    assert(f != NULL);
+    eb_timing_report(f, 1.5);
+    rewind(f);
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static void test_disabled(void) {
+    printf("Testing disabled timing...\n");
+    assert(!eb_timing_enabled());
+    assert(eb_timing_begin("ignored") == -1);
+    eb_timing_end(-1);
+    assert(report()[0] == '\0');
+    printf("✓ Disabled timing passed\n");
+}
+
+static void test_nested(void) {
+    printf("Testing nested phases...\n");
+    eb_timing_enable();
+    int outer = eb_timing_begin("outer");
+    int inner = eb_timing_begin("inner");
+    assert(outer >= 0 && inner > outer);
+    eb_timing_end(inner);
+    eb_timing_end(inner);    /* Ending twice changes nothing */
+    eb_timing_end(outer);
+    int next = eb_timing_begin("next");
+    eb_timing_end(next);
+
+    const char* text = report();
+    const char* before = strstr(text, "timing: before main");
+    const char* o = strstr(text, "timing: outer");
+    const char* i = strstr(text, "timing:   inner");
+    const char* n = strstr(text, "timing: next");
+    const char* total = strstr(text, "timing: total");
+    assert(before && o && i && n && total);
+    assert(before < o && o < i && i < n && n < total);
+    assert(strstr(before, "1.500 ms (cpu)") != NULL);
+    printf("✓ Nested phases passed\n");
+}
+
+static void test_full(void) {
+    printf("Testing a full phase table...\n");
+    int last = 0;
+    for (int k = 0; k < EB_TIMING_MAX_PHASES; k++) {
+        int handle = eb_timing_begin("phase");
+        eb_timing_end(handle);
+        if (handle >= 0)
+            last = handle;
+    }
+    assert(last == EB_TIMING_MAX_PHASES - 1);
+    assert(eb_timing_begin("overflow") == -1);
+    assert(strstr(report(), "overflow") == NULL);
+    printf("✓ Full phase table passed\n");
+}
+
+int main(void) {
+    printf("Running timing tests...\n");
+    test_disabled();
+    test_nested();
+    test_full();
+    printf("All timing tests passed!\n");
+    return 0;
+}
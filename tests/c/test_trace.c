@@ -0,0 +1,117 @@
+/*
+ * EmbeddingBridge - Tracing Span Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include "trace.h"
+#include "repo_fixture.h"
+
+#define TRACE_FILE "trace.json"
+#define THREADS 4
+#define SPANS 100
+
+static char* read_trace(void) {
+    FILE* f = fopen(TRACE_FILE, "r");
+    assert(f != NULL);
+    assert(fseek(f, 0, SEEK_END) == 0);
+    long size = ftell(f);
+    rewind(f);
+    char* text = malloc((size_t)size + 1);
+    assert(text && fread(text, 1, (size_t)size, f) == (size_t)size);
+    text[size] = '\0';
+    fclose(f);
+    return text;
+}
+
+static size_t count(const char* text, const char* needle) {
+    size_t n = 0;
+    for (const char* p = strstr(text, needle); p; p = strstr(p + 1, needle))
+        n++;
+    return n;
+}
+
+static void* spans(void* arg) {
+    (void)arg;
+    for (int i = 0; i < SPANS; i++) {
+        EB_TRACE_SCOPE("test/worker");
+    }
+    return NULL;
+}
+
+static void test_spans(void) {
+    printf("Testing spans across threads...\n");
+    assert(eb_trace_enabled());
+
+    {
+        EB_TRACE_SCOPE("test/outer");
+        EB_TRACE_BEGIN(inner, "test/inner");
+        usleep(1000);
+        EB_TRACE_END(inner);
+        EB_TRACE_END(inner);    /* Ending twice records it once */
+    }
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+        assert(pthread_create(&threads[i], NULL, spans, NULL) == 0);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    assert(eb_trace_flush() == 0);
+    char* text = read_trace();
+    assert(strncmp(text, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39) == 0);
+    assert(count(text, "\"name\":\"test/outer\",\"cat\":\"test\",\"ph\":\"X\"") == 1);
+    assert(count(text, "\"name\":\"test/inner\"") == 1);
+    assert(count(text, "\"name\":\"test/worker\"") == THREADS * SPANS);
+    assert(count(text, "\"ph\":\"X\"") == 2 + THREADS * SPANS);
+
+    // The inner span lasted about a millisecond
+    const char* dur = strstr(strstr(text, "\"name\":\"test/inner\""), "\"dur\":");
+    assert(dur && atof(dur + 6) >= 1000.0);
+    free(text);
+    printf("✓ Spans across threads passed\n");
+}
+
+static void test_ring(void) {
+    printf("Testing a full ring...\n");
+    for (int i = 0; i < EB_TRACE_RING_EVENTS + 10; i++) {
+        EB_TRACE_SCOPE("test/ring");
+    }
+    assert(eb_trace_flush() == 0);
+    char* text = read_trace();
+    // The main thread's ring now only holds the newest spans
+    assert(count(text, "\"name\":\"test/ring\"") == EB_TRACE_RING_EVENTS);
+    assert(count(text, "\"name\":\"test/outer\"") == 0);
+    assert(count(text, "\"name\":\"test/worker\"") == THREADS * SPANS);
+    free(text);
+    printf("✓ Full ring passed\n");
+}
+
+int main(void) {
+    printf("Running trace tests...\n");
+#ifdef EB_ENABLE_TRACE
+    fixture_dir();
+    char trace_path[PATH_MAX];
+    snprintf(trace_path, sizeof(trace_path), "%s/" TRACE_FILE, fixture_root());
+    setenv(EB_TRACE_ENV, trace_path, 1);
+    test_spans();
+    test_ring();
+    // The flush at exit then has nowhere to write
+    fixture_cleanup();
+#else
+    assert(!eb_trace_enabled());
+    printf("Tracing is compiled out, skipping\n");
+#endif
+    printf("All trace tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * EmbeddingBridge - Streaming Transformer Tests
+ * Copyright (C) 2024 ProgramComputer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "transformer.h"
+#include "json_transformer.h"
+#include "compress.h"
+
+/* Sink collecting everything into one buffer */
+struct collected {
+    unsigned char *data;
+    size_t size;
+    size_t calls;
+};
+
+static int collect(void *ctx, const void *data, size_t size) {
+    struct collected *out = ctx;
+    out->data = realloc(out->data, out->size + size + 1);
+    assert(out->data);
+    memcpy(out->data + out->size, data, size);
+    out->size += size;
+    out->calls++;
+    return 0;
+}
+
+static int refuse(void *ctx, const void *data, size_t size) {
+    (void)ctx;
+    (void)data;
+    (void)size;
+    return EB_ERROR_IO;
+}
+
+/* Stream input in pieces of piece bytes and compare with the whole-buffer transform */
+static void check_stream(eb_transformer_t *transformer, const char *input, size_t size, size_t piece) {
+    void *expected = NULL;
+    size_t expected_size = 0;
+    assert(eb_transform(transformer, size ? input : "", size, &expected, &expected_size) == EB_SUCCESS);
+
+    struct collected out = {0};
+    eb_transform_stream_t *stream = NULL;
+    assert(eb_transform_stream_open(transformer, collect, &out, &stream) == EB_SUCCESS);
+    for (size_t off = 0; off < size; off += piece) {
+        size_t n = size - off < piece ? size - off : piece;
+        assert(eb_transform_stream_feed(stream, input + off, n) == EB_SUCCESS);
+    }
+    size_t written = 0;
+    assert(eb_transform_stream_finish(stream, &written) == EB_SUCCESS);
+
+    assert(written == out.size);
+    assert(out.size == expected_size);
+    assert(memcmp(out.data, expected, expected_size) == 0);
+    free(out.data);
+    free(expected);
+}
+
+static void test_json_stream(void) {
+    printf("Testing streamed JSON transform...\n");
+    eb_transformer_t *pretty = eb_json_transformer_create(true, 2);
+    eb_transformer_t *compact = eb_json_transformer_create(false, 0);
+    assert(pretty && pretty->stream && compact && compact->stream);
+
+    const char *json = "  \n{\"a\": [1, 2, 3]}";
+    const char *text = " \t line one\nline \"two\"\\ \x01 end";
+    size_t pieces[] = { 1, 2, 7, 4096 };
+    for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+        check_stream(pretty, json, strlen(json), pieces[i]);
+        check_stream(pretty, text, strlen(text), pieces[i]);
+        check_stream(compact, text, strlen(text), pieces[i]);
+    }
+    /* Empty and whitespace-only input are wrapped */
+    check_stream(compact, "", 0, 1);
+    check_stream(compact, "   ", 3, 1);
+
+    /* Input larger than one escape block goes out in several blocks */
+    size_t big_size = 1024 * 1024;
+    char *big = malloc(big_size);
+    assert(big);
+    for (size_t i = 0; i < big_size; i++)
+        big[i] = (char)('a' + i % 26);
+    big[0] = 'x';
+    check_stream(compact, big, big_size, 100000);
+    free(big);
+
+    eb_transformer_free(pretty);
+    eb_transformer_free(compact);
+    printf("Streamed JSON transform tests passed!\n");
+}
+
+/* A transformer without a streaming encoder: upper-cases its input */
+static eb_status_t upper_transform(struct eb_transformer *transformer, const void *src, size_t src_size,
+                                   void **dst_out, size_t *dst_size_out) {
+    (void)transformer;
+    char *dst = malloc(src_size + 1);
+    if (!dst)
+        return EB_ERROR_MEMORY;
+    for (size_t i = 0; i < src_size; i++) {
+        char c = ((const char *)src)[i];
+        dst[i] = c >= 'a' && c <= 'z' ? (char)(c - 32) : c;
+    }
+    *dst_out = dst;
+    *dst_size_out = src_size;
+    return EB_SUCCESS;
+}
+
+static void test_whole_buffer_fallback(void) {
+    printf("Testing streams over whole-buffer transformers...\n");
+    eb_transformer_t *upper = eb_transformer_create("upper", "upper", upper_transform, upper_transform,
+                                                    NULL, NULL, NULL);
+    assert(upper && !upper->stream);
+    check_stream(upper, "streamed in pieces", 18, 5);
+    eb_transformer_free(upper);
+    printf("Whole-buffer fallback tests passed!\n");
+}
+
+static void test_pipeline(void) {
+    printf("Testing transform -> compress -> sink pipeline...\n");
+    assert(eb_transformer_registry_init() == EB_SUCCESS);
+    assert(eb_register_json_transformer() == EB_SUCCESS);
+
+    size_t size = 512 * 1024;
+    char *input = malloc(size);
+    assert(input);
+    for (size_t i = 0; i < size; i++)
+        input[i] = (char)('0' + i % 10);
+
+    struct collected out = {0};
+    eb_transform_stream_t *stream = NULL;
+    assert(eb_transform_pipeline_open("json", 3, collect, &out, &stream) == EB_SUCCESS);
+    for (size_t off = 0; off < size; off += 10000)
+        assert(eb_transform_stream_feed(stream, input + off, size - off < 10000 ? size - off : 10000) == EB_SUCCESS);
+    size_t written = 0;
+    assert(eb_transform_stream_finish(stream, &written) == EB_SUCCESS);
+    assert(written == out.size && out.size < size);
+    assert(eb_is_zstd_compressed(out.data, out.size));
+
+    /* The frame holds exactly what the transformer produces on its own */
+    void *expected = NULL;
+    size_t expected_size = 0;
+    assert(eb_transform(eb_find_transformer_by_format("json"), input, size, &expected, &expected_size) == EB_SUCCESS);
+    void *plain = NULL;
+    size_t plain_size = 0;
+    assert(eb_decompress_zstd(out.data, out.size, &plain, &plain_size) == EB_SUCCESS);
+    assert(plain_size == expected_size && memcmp(plain, expected, expected_size) == 0);
+    free(plain);
+    free(out.data);
+    free(expected);
+
+    /* A sink error stops the pipeline and comes back to the caller */
+    assert(eb_transform_pipeline_open("json", 0, refuse, NULL, &stream) == EB_SUCCESS);
+    eb_status_t status = eb_transform_stream_feed(stream, input, size);
+    if (status == EB_SUCCESS)
+        status = eb_transform_stream_finish(stream, NULL);
+    else
+        eb_transform_stream_abort(stream);
+    assert(status == EB_ERROR_IO);
+
+    assert(eb_transform_pipeline_open("no-such-format", 0, collect, &out, &stream) == EB_ERROR_TRANSFORMER);
+
+    free(input);
+    eb_transformer_registry_cleanup();
+    printf("Pipeline tests passed!\n");
+}
+
+int main(void) {
+    printf("Running streaming transformer tests...\n");
+    test_json_stream();
+    test_whole_buffer_fallback();
+    test_pipeline();
+    printf("All streaming transformer tests passed!\n");
+    return 0;
+}
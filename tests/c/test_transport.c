@@ -12,6 +12,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include "transport.h"
 #include "debug.h"
@@ -178,6 +180,50 @@ static void test_transport_list_refs(void) {
     printf("Transport list refs tests passed!\n");
 }
 
+/* Test keyed objects: put, ranged reads and copies into a file */
+static void test_transport_objects(void) {
+    printf("Testing local transport objects...\n");
+    
+    eb_transport_t *transport = transport_open("file://" TEST_DIR);
+    assert(transport != NULL);
+    assert(transport_connect(transport) == EB_SUCCESS);
+    
+    const char *key = TEST_DIR "/sets/main/documents/object.bin";
+    assert(transport_put_object(transport, key, TEST_STR, TEST_SIZE) == EB_SUCCESS);
+    transport->target_path = strdup(key);
+    
+    char buffer[128] = {0};
+    size_t received = 0;
+    eb_transport_range_t range = { .offset = 7, .length = 15, .from_end = false };
+    assert(transport_receive_range(transport, &range, buffer, sizeof(buffer), &received) == EB_SUCCESS);
+    assert(received == 15 && memcmp(buffer, "EmbeddingBridge", 15) == 0);
+    
+    /* Straight into a file descriptor, the whole object then its tail */
+    int fd = open(TEST_DIR "/copy.bin", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    assert(transport_receive_stream(transport, NULL, transport_fd_sink, &fd, &received) == EB_SUCCESS);
+    assert(received == TEST_SIZE);
+    eb_transport_range_t tail = { .offset = 0, .length = 10, .from_end = true };
+    assert(transport_receive_stream(transport, &tail, transport_fd_sink, &fd, &received) == EB_SUCCESS);
+    assert(received == 10);
+    memset(buffer, 0, sizeof(buffer));
+    assert(pread(fd, buffer, sizeof(buffer), 0) == (ssize_t)(TEST_SIZE + 10));
+    assert(memcmp(buffer, TEST_STR, TEST_SIZE) == 0);
+    assert(memcmp(buffer + TEST_SIZE, "Transport!", 10) == 0);
+    close(fd);
+    
+    /* Deleting twice succeeds, reading afterwards does not */
+    const char *refs[] = { key };
+    assert(transport_delete_refs(transport, refs, 1) == EB_SUCCESS);
+    assert(transport_delete_refs(transport, refs, 1) == EB_SUCCESS);
+    assert(transport_receive_data(transport, buffer, sizeof(buffer), &received) == EB_ERROR_NOT_FOUND);
+    
+    transport_disconnect(transport);
+    transport_close(transport);
+    
+    printf("Local transport object tests passed!\n");
+}
+
 int main(void) {
     printf("=== Transport Tests ===\n");
     
@@ -192,6 +238,7 @@ int main(void) {
     test_transport_connect();
     test_transport_data();
     test_transport_list_refs();
+    test_transport_objects();
     
     /* Clean up test environment */
     cleanup_test_dir();